@@ -29,6 +29,7 @@
 """
 
 load("@bazel_skylib//lib:paths.bzl", "paths")
+load("@bazel_skylib//rules:common_settings.bzl", "BuildSettingInfo")
 
 # begin:google_only
 # load("@bazel_tools//tools/cpp:toolchain_utils.bzl", "find_cpp_toolchain", "use_cpp_toolchain")
@@ -240,7 +241,12 @@ def _generate_upb_protos(ctx, generator, proto_info, proto_sources):
     args.use_param_file(param_file_arg = "@%s")
     args.set_param_file_format("multiline")
 
-    args.add("--" + generator + "_out=" + _get_real_root(ctx, srcs[0]))
+    params = ""
+    specialized_encoders = getattr(ctx.attr, "_specialized_encoders", None)
+    if specialized_encoders and specialized_encoders[BuildSettingInfo].value:
+        params = "specialized_encoders:"
+
+    args.add("--" + generator + "_out=" + params + _get_real_root(ctx, srcs[0]))
     args.add("--plugin=protoc-gen-" + generator + "=" + tool.path)
     args.add("--descriptor_set_in=" + ctx.configuration.host_path_separator.join([f.path for f in transitive_sets]))
     args.add_all(proto_sources, map_each = _get_real_short_path)
@@ -450,6 +456,7 @@ upb_proto_library_aspect = aspect(
             "//:generated_code_support__only_for_generated_code_do_not_use__i_give_permission_to_break_me",
         ]),
         "_fasttable_enabled": attr.label(default = "//:fasttable_enabled"),
+        "_specialized_encoders": attr.label(default = "//:specialized_encoders"),
     },
     implementation = upb_proto_library_aspect_impl,
     provides = _get_upb_proto_library_aspect_provides(),
@@ -30,21 +30,64 @@
 
 #include <benchmark/benchmark.h>
 
+#include <stdlib.h>
 #include <string.h>
 
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "google/ads/googleads/v13/services/google_ads_service.upbdefs.h"
 #include "google/protobuf/descriptor.pb.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
 #include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/test_messages_proto3.upb.h"
+#include "google/protobuf/test_messages_proto3.upbdefs.h"
+#include "google/protobuf/text_format.h"
+#include "google/protobuf/util/json_util.h"
 #include "benchmarks/descriptor.pb.h"
 #include "benchmarks/descriptor.upb.h"
 #include "benchmarks/descriptor.upbdefs.h"
 #include "benchmarks/descriptor_sv.pb.h"
+#include "benchmarks/perf_counters.h"
+#include "benchmarks/repeated_float.upb.proto.h"
+#include "benchmarks/synthetic_payloads.h"
+#include "protos/protos.h"
+#include "protos/repeated_field.h"
 #include "upb/base/internal/log2.h"
+#include "upb/collections/array.h"
+#include "upb/collections/map.h"
+#include "upb/hash/int_table.h"
+#include "upb/hash/str_table.h"
+#include "upb/io/tokenizer.h"
+#include "upb/json/decode.h"
+#include "upb/json/encode.h"
+#include "upb/json/transcode.h"
+#include "upb/lex/round_trip.h"
+#include "upb/lex/strtod.h"
+#include "upb/lex/utf8.h"
 #include "upb/mem/arena.h"
+#include "upb/mem/arena.hpp"
+#include "upb/message/copy.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_descriptor/link.h"
+#include "upb/mini_table/extension_registry.h"
+#include "upb/mini_table/internal/message.h"
 #include "upb/reflection/def.hpp"
+#include "upb/text/decode.h"
+#include "upb/text/encode.h"
+#include "upb/wire/decode_fast.h"
+#include "upb/wire/encode.h"
+#include "upb/wire/writer.h"
+#include "utf8_range.h"
 
 upb_StringView descriptor = benchmarks_descriptor_proto_upbdefinit.descriptor;
 namespace protobuf = ::google::protobuf;
@@ -100,6 +143,9 @@ static void BM_ArenaFuseUnbalanced(benchmark::State& state) {
   state.SetItemsProcessed(n);
 }
 BENCHMARK(BM_ArenaFuseUnbalanced)->Range(2, 128);
+// Every thread fuses its own arenas, so this measures how well independent
+// fuses scale (allocator and cache effects only).
+BENCHMARK(BM_ArenaFuseUnbalanced)->Arg(128)->ThreadRange(2, 16)->UseRealTime();
 
 static void BM_ArenaFuseBalanced(benchmark::State& state) {
   std::vector<upb_Arena*> arenas(state.range(0));
@@ -128,6 +174,48 @@ static void BM_ArenaFuseBalanced(benchmark::State& state) {
 }
 BENCHMARK(BM_ArenaFuseBalanced)->Range(2, 128);
 
+// All threads randomly fuse and free arenas drawn from a small shared pool, so
+// fuses and frees constantly race on the same few roots.  The pool size
+// controls how contended those roots are.
+static void BM_ArenaFuseFreeContended(benchmark::State& state) {
+  static std::array<std::atomic<upb_Arena*>, 64> pool;
+  const size_t pool_size = state.range(0);
+  uint64_t rng = state.thread_index() * 0x9E3779B97F4A7C15 + 1;
+  auto next_slot = [&]() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return &pool[rng % pool_size];
+  };
+
+  for (auto _ : state) {
+    std::atomic<upb_Arena*>* slots[2] = {next_slot(), next_slot()};
+    upb_Arena* arenas[2];
+    for (int i = 0; i < 2; i++) {
+      arenas[i] = slots[i]->exchange(nullptr, std::memory_order_acq_rel);
+      if (!arenas[i]) arenas[i] = upb_Arena_New();
+    }
+    upb_Arena_Fuse(arenas[0], arenas[1]);
+    for (int i = 0; i < 2; i++) {
+      upb_Arena* old = slots[i]->exchange(arenas[i], std::memory_order_acq_rel);
+      if (old) upb_Arena_Free(old);
+    }
+  }
+
+  if (state.thread_index() == 0) {
+    for (auto& slot : pool) {
+      upb_Arena* a = slot.exchange(nullptr, std::memory_order_relaxed);
+      if (a) upb_Arena_Free(a);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ArenaFuseFreeContended)
+    ->Arg(2)
+    ->Arg(64)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
 enum LoadDescriptorMode {
   NoLayout,
   WithLayout,
@@ -210,6 +298,130 @@ static void BM_LoadAdsDescriptor_Upb(benchmark::State& state) {
 BENCHMARK_TEMPLATE(BM_LoadAdsDescriptor_Upb, NoLayout);
 BENCHMARK_TEMPLATE(BM_LoadAdsDescriptor_Upb, WithLayout);
 
+// A upb_DefPool_ParallelForFunc that runs the tasks on |*closure| threads.
+static void ParallelFor(void* closure, size_t count,
+                        void (*task)(void* arg, size_t i), void* arg) {
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < *static_cast<int*>(closure); t++) {
+    threads.emplace_back([&] {
+      for (size_t i; (i = next.fetch_add(1)) < count;) task(arg, i);
+    });
+  }
+  for (std::thread& t : threads) t.join();
+}
+
+// Like BM_LoadAdsDescriptor_Upb<WithLayout>, but adds all of the files with
+// one upb_DefPool_AddFiles() call, building independent files on
+// state.range(0) threads.
+static void BM_LoadAdsDescriptor_Upb_AddFiles(benchmark::State& state) {
+  extern _upb_DefPool_Init
+      google_ads_googleads_v13_services_google_ads_service_proto_upbdefinit;
+  std::vector<upb_StringView> serialized_files;
+  absl::flat_hash_set<const _upb_DefPool_Init*> seen_files;
+  CollectFileDescriptors(
+      &google_ads_googleads_v13_services_google_ads_service_proto_upbdefinit,
+      serialized_files, seen_files);
+  int threads = state.range(0);
+  size_t bytes_per_iter = 0;
+  for (auto _ : state) {
+    bytes_per_iter = 0;
+    upb::Arena arena;
+    upb::DefPool defpool;
+    std::vector<const google_protobuf_FileDescriptorProto*> files;
+    for (auto file : serialized_files) {
+      const google_protobuf_FileDescriptorProto* proto =
+          google_protobuf_FileDescriptorProto_parse_ex(
+              file.data, file.size, nullptr, kUpb_DecodeOption_AliasString,
+              arena.ptr());
+      if (!proto) {
+        printf("Failed to parse file.\n");
+        exit(1);
+      }
+      files.push_back(proto);
+      bytes_per_iter += file.size;
+    }
+    upb::Status status;
+    if (!upb_DefPool_AddFiles(defpool.ptr(), files.data(), files.size(),
+                              threads > 1 ? ParallelFor : nullptr, &threads,
+                              status.ptr())) {
+      printf("Failed to add files: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * bytes_per_iter);
+}
+BENCHMARK(BM_LoadAdsDescriptor_Upb_AddFiles)
+    ->ArgName("threads")
+    ->Arg(1)
+    ->Arg(4);
+
+// Runs protoc-gen-upb on a CodeGeneratorRequest that generates every file of
+// the ads schema at once, with `jobs=state.range(0)`.  The time includes
+// starting the plugin and writing its output to /dev/null; since the work
+// happens in another process, it is measured as real time.
+static void BM_GenerateAdsCode_Upb(benchmark::State& state) {
+  std::string plugin;
+  for (const char* path :
+       {"upbc/protoc-gen-upb", "bazel-bin/upbc/protoc-gen-upb"}) {
+    if (std::filesystem::exists(path)) plugin = path;
+  }
+  if (plugin.empty()) {
+    state.SkipWithError("protoc-gen-upb not found");
+    return;
+  }
+
+  extern _upb_DefPool_Init
+      google_ads_googleads_v13_services_google_ads_service_proto_upbdefinit;
+  std::vector<upb_StringView> serialized_files;
+  absl::flat_hash_set<const _upb_DefPool_Init*> seen_files;
+  CollectFileDescriptors(
+      &google_ads_googleads_v13_services_google_ads_service_proto_upbdefinit,
+      serialized_files, seen_files);
+
+  // CodeGeneratorRequest: file_to_generate = 1, parameter = 2,
+  // proto_file = 15.
+  upb::Arena arena;
+  upb_WireWriter w;
+  upb_WireWriter_Init(&w, arena.ptr());
+  size_t bytes_per_iter = 0;
+  for (auto file : serialized_files) {
+    const google_protobuf_FileDescriptorProto* proto =
+        google_protobuf_FileDescriptorProto_parse(file.data, file.size,
+                                                  arena.ptr());
+    upb_StringView name = google_protobuf_FileDescriptorProto_name(proto);
+    upb_WireWriter_WriteDelimitedField(&w, 1, name.data, name.size);
+    bytes_per_iter += file.size;
+  }
+  std::string parameter = absl::StrCat("jobs=", state.range(0));
+  upb_WireWriter_WriteDelimitedField(&w, 2, parameter.data(),
+                                     parameter.size());
+  for (auto file : serialized_files) {
+    upb_WireWriter_WriteDelimitedField(&w, 15, file.data, file.size);
+  }
+
+  std::string request =
+      (std::filesystem::temp_directory_path() / "upb_ads_request.bin")
+          .string();
+  FILE* f = fopen(request.c_str(), "wb");
+  fwrite(upb_WireWriter_Data(&w), 1, upb_WireWriter_Size(&w), f);
+  fclose(f);
+  std::string cmd = absl::StrCat(plugin, " < ", request, " > /dev/null");
+  for (auto _ : state) {
+    if (system(cmd.c_str()) != 0) {
+      state.SkipWithError("protoc-gen-upb failed");
+      break;
+    }
+  }
+  std::filesystem::remove(request);
+  state.SetBytesProcessed(state.iterations() * bytes_per_iter);
+}
+BENCHMARK(BM_GenerateAdsCode_Upb)
+    ->ArgName("jobs")
+    ->Arg(1)
+    ->Arg(4)
+    ->UseRealTime();
+
 template <LoadDescriptorMode Mode>
 static void BM_LoadAdsDescriptor_Proto2(benchmark::State& state) {
   extern _upb_DefPool_Init
@@ -253,6 +465,74 @@ static void BM_LoadAdsDescriptor_Proto2(benchmark::State& state) {
 BENCHMARK_TEMPLATE(BM_LoadAdsDescriptor_Proto2, NoLayout);
 BENCHMARK_TEMPLATE(BM_LoadAdsDescriptor_Proto2, WithLayout);
 
+static void CollectMiniDescriptors(const upb_MessageDef* m, upb_Arena* arena,
+                                   std::vector<upb_StringView>& out) {
+  upb_StringView mini_descriptor;
+  if (!upb_MessageDef_MiniDescriptorEncode(m, arena, &mini_descriptor)) {
+    printf("Failed to encode mini descriptor.\n");
+    exit(1);
+  }
+  out.push_back(mini_descriptor);
+  for (int i = 0; i < upb_MessageDef_NestedMessageCount(m); i++) {
+    CollectMiniDescriptors(upb_MessageDef_NestedMessage(m, i), arena, out);
+  }
+}
+
+static void CollectMiniDescriptors(
+    const upb_FileDef* f, upb_Arena* arena, std::vector<upb_StringView>& out,
+    absl::flat_hash_set<const upb_FileDef*>& seen) {
+  if (!seen.insert(f).second) return;
+  for (int i = 0; i < upb_FileDef_DependencyCount(f); i++) {
+    CollectMiniDescriptors(upb_FileDef_Dependency(f, i), arena, out, seen);
+  }
+  for (int i = 0; i < upb_FileDef_TopLevelMessageCount(f); i++) {
+    CollectMiniDescriptors(upb_FileDef_TopLevelMessage(f, i), arena, out);
+  }
+}
+
+enum MiniTableSchema {
+  DescriptorSchema,
+  AdsSchema,
+};
+
+// Builds a mini table for every message in the schema (and its dependencies)
+// from its mini descriptor, sharing one scratch buffer as upb_DefPool does.
+template <MiniTableSchema Schema>
+static void BM_BuildMiniTables(benchmark::State& state) {
+  upb::Arena encode_arena;
+  upb::DefPool defpool;
+  const upb_MessageDef* root =
+      Schema == DescriptorSchema
+          ? upb_benchmark_FileDescriptorSet_getmsgdef(defpool.ptr())
+          : google_ads_googleads_v13_services_SearchGoogleAdsRequest_getmsgdef(
+                defpool.ptr());
+  std::vector<upb_StringView> mini_descriptors;
+  absl::flat_hash_set<const upb_FileDef*> seen_files;
+  CollectMiniDescriptors(upb_MessageDef_File(root), encode_arena.ptr(),
+                         mini_descriptors, seen_files);
+
+  void* scratch = nullptr;
+  size_t scratch_size = 0;
+  for (auto _ : state) {
+    upb::Arena arena;
+    for (auto mini_descriptor : mini_descriptors) {
+      upb_MiniTable* table = upb_MiniTable_BuildWithBuf(
+          mini_descriptor.data, mini_descriptor.size,
+          kUpb_MiniTablePlatform_Native, arena.ptr(), &scratch, &scratch_size,
+          nullptr);
+      if (!table) {
+        printf("Failed to build mini table.\n");
+        exit(1);
+      }
+      benchmark::DoNotOptimize(table);
+    }
+  }
+  free(scratch);
+  state.SetItemsProcessed(state.iterations() * mini_descriptors.size());
+}
+BENCHMARK_TEMPLATE(BM_BuildMiniTables, DescriptorSchema);
+BENCHMARK_TEMPLATE(BM_BuildMiniTables, AdsSchema);
+
 enum CopyStrings {
   Copy,
   Alias,
@@ -264,8 +544,33 @@ enum ArenaMode {
   InitBlock,
 };
 
+// Memory expansion of a parse, which capacity planning depends on as much as
+// on speed.  Runs `parse` once more, outside the timing loop, into a fresh
+// heap arena and reports the bytes that arena took from its allocator per
+// input byte as "arena/B".  Using a heap arena keeps the figure comparable
+// across arena modes, since an initial block would hide part of it.  When
+// built with UPB_ENABLE_ARENA_STATS, also reports the allocation count and
+// the bytes stranded at the end of retired blocks, per input byte.
+//
+// compare.py passes every "/B" counter to benchstat, so these are compared
+// alongside the time.
+template <class F>
+static void SetArenaCounters(benchmark::State& state, size_t bytes,
+                             const F& parse) {
+  upb::Arena arena;
+  parse(arena.ptr());
+  state.counters["arena/B"] =
+      (double)upb_Arena_SpaceAllocated(arena.ptr()) / bytes;
+  upb_ArenaStats stats;
+  if (upb_Arena_GetStats(arena.ptr(), &stats)) {
+    state.counters["allocs/B"] = (double)stats.allocs / bytes;
+    state.counters["waste/B"] = (double)stats.tail_waste / bytes;
+  }
+}
+
 template <ArenaMode AMode, CopyStrings Copy>
 static void BM_Parse_Upb_FileDesc(benchmark::State& state) {
+  upb_benchmark::PerfCounters perf(state);
   for (auto _ : state) {
     upb_Arena* arena;
     if (AMode == InitBlock) {
@@ -284,107 +589,1761 @@ static void BM_Parse_Upb_FileDesc(benchmark::State& state) {
     upb_Arena_Free(arena);
   }
   state.SetBytesProcessed(state.iterations() * descriptor.size);
+  SetArenaCounters(state, descriptor.size, [](upb_Arena* arena) {
+    upb_benchmark_FileDescriptorProto_parse_ex(
+        descriptor.data, descriptor.size, nullptr,
+        Copy == Alias ? kUpb_DecodeOption_AliasString : 0, arena);
+  });
 }
 BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc, UseArena, Copy);
 BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc, UseArena, Alias);
 BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc, InitBlock, Copy);
 BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc, InitBlock, Alias);
 
-template <ArenaMode AMode, class P>
-struct Proto2Factory;
+// Parses only the top level of the descriptor; sub-messages are left for
+// promotion on first access.
+static void BM_Parse_Upb_FileDesc_Lazy(benchmark::State& state) {
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb_Arena* arena = upb_Arena_Init(buf, sizeof(buf), nullptr);
+    upb_benchmark_FileDescriptorProto* set =
+        upb_benchmark_FileDescriptorProto_parse_ex(
+            descriptor.data, descriptor.size, nullptr,
+            kUpb_DecodeOption_AliasString |
+                kUpb_DecodeOption_ExperimentalLazySubMessages,
+            arena);
+    if (!set) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_Arena_Free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+  SetArenaCounters(state, descriptor.size, [](upb_Arena* arena) {
+    upb_benchmark_FileDescriptorProto_parse_ex(
+        descriptor.data, descriptor.size, nullptr,
+        kUpb_DecodeOption_AliasString |
+            kUpb_DecodeOption_ExperimentalLazySubMessages,
+        arena);
+  });
+}
+BENCHMARK(BM_Parse_Upb_FileDesc_Lazy);
 
-template <class P>
-struct Proto2Factory<NoArena, P> {
- public:
-  P* GetProto() { return &proto; }
+// Multi-threaded variants, for contention that single-threaded runs cannot
+// show: the allocator behind upb_Arena_New(), false sharing, and any global
+// state touched by the decoder or encoder.  Pass the --benchmark_out JSON to
+// scaling.py to see throughput per thread relative to one thread.
 
- private:
-  P proto;
+enum ThreadArena {
+  // A fresh heap arena per iteration, like a server with an arena per request.
+  NewArena,
+  // Each thread reuses its own initial block and never calls malloc.
+  PerThreadBlock,
 };
 
-template <class P>
-struct Proto2Factory<UseArena, P> {
- public:
-  P* GetProto() { return protobuf::Arena::CreateMessage<P>(&arena); }
-
- private:
-  protobuf::Arena arena;
+// Thread-private stand-in for |buf|, which the threads cannot share.
+struct ThreadBlock {
+  upb_Arena* NewArena(ThreadArena mode) {
+    return mode == PerThreadBlock
+               ? upb_Arena_Init(block.data(), block.size(), nullptr)
+               : upb_Arena_New();
+  }
+  std::vector<char> block = std::vector<char>(sizeof(buf));
 };
 
-template <class P>
-struct Proto2Factory<InitBlock, P> {
- public:
-  Proto2Factory() : arena(GetOptions()) {}
-  P* GetProto() { return protobuf::Arena::CreateMessage<P>(&arena); }
+template <ThreadArena AMode, CopyStrings Copy>
+static void BM_Parse_Upb_FileDesc_Threaded(benchmark::State& state) {
+  ThreadBlock block;
+  for (auto _ : state) {
+    upb_Arena* arena = block.NewArena(AMode);
+    upb_benchmark_FileDescriptorProto* set =
+        upb_benchmark_FileDescriptorProto_parse_ex(
+            descriptor.data, descriptor.size, nullptr,
+            Copy == Alias ? kUpb_DecodeOption_AliasString : 0, arena);
+    if (!set) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_Arena_Free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc_Threaded, NewArena, Copy)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Parse_Upb_FileDesc_Threaded, PerThreadBlock, Alias)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
 
- private:
-  protobuf::ArenaOptions GetOptions() {
-    protobuf::ArenaOptions opts;
-    opts.initial_block = (char*)buf;
-    opts.initial_block_size = sizeof(buf);
-    return opts;
+// All threads serialize the same message, as servers do with shared
+// responses; the encoder must not write to it.
+template <ThreadArena AMode>
+static void BM_SerializeDescriptor_Upb_Threaded(benchmark::State& state) {
+  static const upb_benchmark_FileDescriptorProto* set = [] {
+    upb_benchmark_FileDescriptorProto* set =
+        upb_benchmark_FileDescriptorProto_parse(
+            descriptor.data, descriptor.size, upb_Arena_New());
+    if (!set) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    return set;
+  }();
+  ThreadBlock block;
+  int64_t total = 0;
+  for (auto _ : state) {
+    upb_Arena* arena = block.NewArena(AMode);
+    size_t size;
+    char* data = upb_benchmark_FileDescriptorProto_serialize(set, arena, &size);
+    if (!data) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    total += size;
+    upb_Arena_Free(arena);
   }
+  state.SetBytesProcessed(total);
+}
+BENCHMARK_TEMPLATE(BM_SerializeDescriptor_Upb_Threaded, NewArena)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_SerializeDescriptor_Upb_Threaded, PerThreadBlock)
+    ->ThreadRange(1, 64)
+    ->UseRealTime();
 
-  protobuf::Arena arena;
+enum CloneMode {
+  DeepClone,
+  ShallowClone,
 };
 
-using FileDesc = ::upb_benchmark::FileDescriptorProto;
-using FileDescSV = ::upb_benchmark::sv::FileDescriptorProto;
+template <CloneMode Mode>
+static void BM_Clone_Upb_FileDesc(benchmark::State& state) {
+  upb::Arena src_arena;
+  upb_benchmark_FileDescriptorProto* src =
+      upb_benchmark_FileDescriptorProto_parse(descriptor.data, descriptor.size,
+                                              src_arena.ptr());
+  if (!src) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  for (auto _ : state) {
+    upb_Arena* arena = upb_Arena_Init(buf, sizeof(buf), nullptr);
+    upb_Message* clone =
+        Mode == DeepClone
+            ? upb_Message_DeepClone(
+                  src, &upb_benchmark_FileDescriptorProto_msg_init, arena)
+            : upb_Message_ShallowClone(
+                  src, &upb_benchmark_FileDescriptorProto_msg_init, arena);
+    if (!clone) {
+      printf("Failed to clone.\n");
+      exit(1);
+    }
+    upb_Arena_Free(arena);
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK_TEMPLATE(BM_Clone_Upb_FileDesc, DeepClone);
+BENCHMARK_TEMPLATE(BM_Clone_Upb_FileDesc, ShallowClone);
 
-template <class P, ArenaMode AMode, CopyStrings kCopy>
-void BM_Parse_Proto2(benchmark::State& state) {
-  constexpr protobuf::MessageLite::ParseFlags kParseFlags =
-      kCopy == Copy
-          ? protobuf::MessageLite::ParseFlags::kMergePartial
-          : protobuf::MessageLite::ParseFlags::kMergePartialWithAliasing;
+enum LargeBlockMode {
+  RegularPages,
+  HugePages,
+};
+
+// Concatenating serialized messages merges them, so repeating the descriptor
+// yields a large but valid input whose repeated fields keep growing.
+static const std::string& LargeDescriptor() {
+  static const std::string* large = [] {
+    auto* s = new std::string();
+    while (s->size() < 64 << 20) s->append(descriptor.data, descriptor.size);
+    return s;
+  }();
+  return *large;
+}
+
+template <LargeBlockMode Mode>
+static void BM_Parse_Upb_LargeFileDesc(benchmark::State& state) {
+  const std::string& input = LargeDescriptor();
+  upb_ArenaOptions options = {};
+  if (Mode == HugePages) {
+    options.large_block_alloc = &upb_alloc_hugepage;
+    options.large_block_threshold = kUpb_HugePageSize;
+  }
+  upb_benchmark::PerfCounters perf(state);
   for (auto _ : state) {
-    Proto2Factory<AMode, P> proto_factory;
-    auto proto = proto_factory.GetProto();
-    absl::string_view input(descriptor.data, descriptor.size);
-    bool ok = proto->template ParseFrom<kParseFlags>(input);
-    if (!ok) {
+    upb_Arena* arena =
+        upb_Arena_InitWithOptions(nullptr, 0, &upb_alloc_global, &options);
+    upb_benchmark_FileDescriptorProto* set =
+        upb_benchmark_FileDescriptorProto_parse_ex(
+            input.data(), input.size(), nullptr, kUpb_DecodeOption_AliasString,
+            arena);
+    if (!set) {
       printf("Failed to parse.\n");
       exit(1);
     }
+    upb_Arena_Free(arena);
   }
-  state.SetBytesProcessed(state.iterations() * descriptor.size);
+  state.SetBytesProcessed(state.iterations() * input.size());
+  SetArenaCounters(state, input.size(), [&](upb_Arena* arena) {
+    upb_benchmark_FileDescriptorProto_parse_ex(input.data(), input.size(),
+                                               nullptr,
+                                               kUpb_DecodeOption_AliasString,
+                                               arena);
+  });
 }
-BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDesc, NoArena, Copy);
-BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDesc, UseArena, Copy);
-BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDesc, InitBlock, Copy);
-BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDescSV, InitBlock, Alias);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_LargeFileDesc, RegularPages);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_LargeFileDesc, HugePages);
 
-static void BM_SerializeDescriptor_Proto2(benchmark::State& state) {
-  upb_benchmark::FileDescriptorProto proto;
-  proto.ParseFromArray(descriptor.data, descriptor.size);
+// Parses a single packed int32 field whose values all encode to
+// state.range(0) bytes.
+static void BM_Parse_Upb_PackedVarint(benchmark::State& state) {
+  const int kCount = 4096;
+  const int bytes = state.range(0);
+  upb_Arena* arena = upb_Arena_New();
+  upb_benchmark_SourceCodeInfo_Location* loc =
+      upb_benchmark_SourceCodeInfo_Location_new(arena);
+  int32_t* path =
+      upb_benchmark_SourceCodeInfo_Location_resize_path(loc, kCount, arena);
+  for (int i = 0; i < kCount; i++) {
+    if (bytes == 1) {
+      path[i] = i % 128;
+    } else if (bytes < 5) {
+      int32_t min = 1 << (7 * (bytes - 1));
+      path[i] = min + i % min;
+    } else if (bytes == 5) {
+      path[i] = (1 << 28) + i;
+    } else {
+      path[i] = -1 - i;  // Negative int32 values take ten bytes.
+    }
+  }
+  size_t size;
+  char* data =
+      upb_benchmark_SourceCodeInfo_Location_serialize(loc, arena, &size);
+  upb_benchmark::PerfCounters perf(state);
   for (auto _ : state) {
-    proto.SerializePartialToArray(buf, sizeof(buf));
+    upb_Arena* parse_arena = upb_Arena_Init(buf, sizeof(buf), nullptr);
+    upb_benchmark_SourceCodeInfo_Location* parsed =
+        upb_benchmark_SourceCodeInfo_Location_parse(data, size, parse_arena);
+    if (!parsed) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_Arena_Free(parse_arena);
   }
-  state.SetBytesProcessed(state.iterations() * descriptor.size);
+  state.SetItemsProcessed(state.iterations() * kCount);
+  state.SetBytesProcessed(state.iterations() * size);
+  SetArenaCounters(state, size, [&](upb_Arena* parse_arena) {
+    upb_benchmark_SourceCodeInfo_Location_parse(data, size, parse_arena);
+  });
+  upb_Arena_Free(arena);
 }
-BENCHMARK(BM_SerializeDescriptor_Proto2);
+BENCHMARK(BM_Parse_Upb_PackedVarint)->Arg(1)->Arg(2)->Arg(3)->Arg(5)->Arg(10);
 
-static void BM_SerializeDescriptor_Upb(benchmark::State& state) {
-  int64_t total = 0;
+// Returns true if a field with the one-byte `tag` dispatches to a specialized
+// fast-table parser in `mt`, rather than to the generic fallback.  Always
+// false in builds without the fast table.
+static bool HasFastTableParser(const upb_MiniTable* mt, uint8_t tag) {
+  if (mt->table_mask == (uint8_t)-1) return false;
+  const _upb_FastTable_Entry* ent = &mt->fasttable[(tag & mt->table_mask) >> 3];
+  return ent->field_parser != &_upb_FastDecoder_DecodeGeneric &&
+         (uint8_t)(ent->field_data ^ tag) == 0;
+}
+
+// Parses fields whose label and type are closed enums.  The "fast_path"
+// counter is the fraction of fields in each entry that the fast table hands
+// to a specialized parser.
+static void BM_Parse_Upb_ClosedEnum(benchmark::State& state) {
+  const int kCount = 1024;
   upb_Arena* arena = upb_Arena_New();
-  upb_benchmark_FileDescriptorProto* set =
-      upb_benchmark_FileDescriptorProto_parse(descriptor.data, descriptor.size,
-                                              arena);
-  if (!set) {
-    printf("Failed to parse.\n");
-    exit(1);
+  upb_benchmark_DescriptorProto* msg = upb_benchmark_DescriptorProto_new(arena);
+  for (int i = 0; i < kCount; i++) {
+    upb_benchmark_FieldDescriptorProto* field =
+        upb_benchmark_DescriptorProto_add_field(msg, arena);
+    upb_benchmark_FieldDescriptorProto_set_number(field, i + 1);
+    upb_benchmark_FieldDescriptorProto_set_label(field, 1 + i % 3);
+    upb_benchmark_FieldDescriptorProto_set_type(field, 1 + i % 18);
   }
+  size_t size;
+  char* data = upb_benchmark_DescriptorProto_serialize(msg, arena, &size);
+  upb_benchmark::PerfCounters perf(state);
   for (auto _ : state) {
-    upb_Arena* enc_arena = upb_Arena_Init(buf, sizeof(buf), nullptr);
-    size_t size;
-    char* data =
-        upb_benchmark_FileDescriptorProto_serialize(set, enc_arena, &size);
-    if (!data) {
-      printf("Failed to serialize.\n");
+    upb_Arena* parse_arena =
+        upb_Arena_Init(buf, sizeof(buf), &upb_alloc_global);
+    upb_benchmark_DescriptorProto* parsed =
+        upb_benchmark_DescriptorProto_parse(data, size, parse_arena);
+    if (!parsed) {
+      printf("Failed to parse.\n");
       exit(1);
     }
-    total += size;
+    upb_Arena_Free(parse_arena);
   }
-  state.SetBytesProcessed(total);
+
+  // Tags for number (3), label (4) and type (5), all varints.
+  const upb_MiniTable* mt = &upb_benchmark_FieldDescriptorProto_msg_init;
+  int fast = 0;
+  for (uint8_t tag : {3 << 3, 4 << 3, 5 << 3}) {
+    fast += HasFastTableParser(mt, tag);
+  }
+  state.counters["fast_path"] = fast / 3.0;
+  state.SetItemsProcessed(state.iterations() * kCount);
+  state.SetBytesProcessed(state.iterations() * size);
+  SetArenaCounters(state, size, [&](upb_Arena* parse_arena) {
+    upb_benchmark_DescriptorProto_parse(data, size, parse_arena);
+  });
+  upb_Arena_Free(arena);
 }
-BENCHMARK(BM_SerializeDescriptor_Upb);
+BENCHMARK(BM_Parse_Upb_ClosedEnum);
+
+static void AppendVarint(std::string* out, uint32_t val) {
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back(byte);
+  } while (val);
+}
+
+// Parses a message carrying state.range(0) int32 extensions, out of 64 that
+// are registered for it.  The registry also holds 64 extensions for each of
+// 15 other messages, as a large binary would.
+static void BM_Parse_Upb_Extensions(benchmark::State& state) {
+  const int kExtendees = 16;
+  const int kExtensionsPerExtendee = 64;
+  const int count = state.range(0);
+  upb::Arena arena;
+  upb::Status status;
+  upb_ExtensionRegistry* extreg = upb_ExtensionRegistry_New(arena.ptr());
+  const upb_MiniTable* extendee = nullptr;
+  for (int i = 0; i < kExtendees; i++) {
+    upb::MtDataEncoder e;
+    e.StartMessage(kUpb_MessageModifier_IsExtendable);
+    e.PutField(kUpb_FieldType_Int32, 1, 0);
+    upb_MiniTable* mt = upb_MiniTable_Build(e.data().data(), e.data().size(),
+                                            arena.ptr(), status.ptr());
+    for (int j = 0; j < kExtensionsPerExtendee; j++) {
+      upb::MtDataEncoder ext_e;
+      ext_e.EncodeExtension(kUpb_FieldType_Int32, 1000 + j, 0);
+      const upb_MiniTableExtension* ext =
+          upb_MiniTableExtension_Build(ext_e.data().data(),
+                                       ext_e.data().size(), mt, arena.ptr(),
+                                       status.ptr());
+      if (!ext || !upb_ExtensionRegistry_Add(extreg, ext)) {
+        printf("Failed to build extensions.\n");
+        exit(1);
+      }
+    }
+    extendee = mt;
+  }
+
+  std::string data;
+  for (int j = 0; j < count; j++) {
+    AppendVarint(&data, (1000 + j * kExtensionsPerExtendee / count) << 3);
+    AppendVarint(&data, j);
+  }
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb_Arena* parse_arena =
+        upb_Arena_Init(buf, sizeof(buf), &upb_alloc_global);
+    upb_Message* msg = upb_Message_New(extendee, parse_arena);
+    if (upb_Decode(data.data(), data.size(), msg, extendee, extreg, 0,
+                   parse_arena) != kUpb_DecodeStatus_Ok) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+    upb_Arena_Free(parse_arena);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+  state.SetBytesProcessed(state.iterations() * data.size());
+  SetArenaCounters(state, data.size(), [&](upb_Arena* parse_arena) {
+    upb_Message* msg = upb_Message_New(extendee, parse_arena);
+    upb_Decode(data.data(), data.size(), msg, extendee, extreg, 0,
+               parse_arena);
+  });
+}
+BENCHMARK(BM_Parse_Upb_Extensions)->Arg(8)->Arg(64);
+
+// Worst cases.  Pathological shapes found by performance fuzzing (see
+// upb::fuzz::SlowInputTracker), each scaled by state.range(0) so that
+// --benchmark_filter=WorstCase reports a Big-O fit: anything worse than
+// linear is an algorithmic regression.
+
+enum WireWorstCase {
+  NestedUnknownGroups,  // Unknown groups nested 64 deep, range(0) times.
+  ManyUnknownFields,    // range(0) distinct unknown varint fields.
+  HugeUnknownField,     // One unknown field of range(0) KiB.
+  DuplicateMapKeys,     // range(0) map entries, all with the same key.
+  LongPrefixMapKeys,    // range(0) string keys sharing a 1 KiB prefix.
+  SparseIntMapKeys,     // range(0) int32 keys spread over the key space.
+  ManyExtensions,       // range(0) distinct extensions, each set once.
+};
+
+// An extendable message with map<string, int32> = 1, map<int32, int32> = 2,
+// and 4096 registered int32 extensions numbered from 1000.
+struct WorstCaseSchema {
+  static constexpr int kExtensions = 4096;
+
+  WorstCaseSchema() {
+    extreg = upb_ExtensionRegistry_New(arena.ptr());
+    upb::MtDataEncoder e;
+    e.StartMessage(kUpb_MessageModifier_IsExtendable);
+    e.PutField(kUpb_FieldType_Message, 1, kUpb_FieldModifier_IsRepeated);
+    e.PutField(kUpb_FieldType_Message, 2, kUpb_FieldModifier_IsRepeated);
+    upb_MiniTable* mt = upb_MiniTable_Build(e.data().data(), e.data().size(),
+                                            arena.ptr(), status.ptr());
+    bool ok = mt;
+    upb_FieldType keys[] = {kUpb_FieldType_String, kUpb_FieldType_Int32};
+    for (int i = 0; ok && i < 2; i++) {
+      upb::MtDataEncoder map_e;
+      map_e.EncodeMap(keys[i], kUpb_FieldType_Int32, 0, 0);
+      upb_MiniTable* entry =
+          upb_MiniTable_Build(map_e.data().data(), map_e.data().size(),
+                              arena.ptr(), status.ptr());
+      ok = entry &&
+           upb_MiniTable_SetSubMessage(
+               mt, const_cast<upb_MiniTableField*>(&mt->fields[i]), entry);
+    }
+    for (int i = 0; ok && i < kExtensions; i++) {
+      upb::MtDataEncoder ext_e;
+      ext_e.EncodeExtension(kUpb_FieldType_Int32, 1000 + i, 0);
+      const upb_MiniTableExtension* ext = upb_MiniTableExtension_Build(
+          ext_e.data().data(), ext_e.data().size(), mt, arena.ptr(),
+          status.ptr());
+      ok = ext && upb_ExtensionRegistry_Add(extreg, ext);
+    }
+    if (!ok) {
+      printf("Failed to build schema: %s\n", status.error_message());
+      exit(1);
+    }
+    layout = mt;
+  }
+
+  upb::Arena arena;
+  upb::Status status;
+  upb_ExtensionRegistry* extreg;
+  const upb_MiniTable* layout;
+};
+
+static void AppendMapEntry(std::string* out, int field,
+                           const std::string& entry) {
+  AppendVarint(out, field << 3 | 2);
+  AppendVarint(out, entry.size());
+  out->append(entry);
+}
+
+static std::string WireWorstCasePayload(WireWorstCase shape, int n) {
+  std::string data;
+  switch (shape) {
+    case NestedUnknownGroups:
+      for (int i = 0; i < n; i++) {
+        for (int d = 0; d < 64; d++) AppendVarint(&data, (500 + d) << 3 | 3);
+        for (int d = 63; d >= 0; d--) AppendVarint(&data, (500 + d) << 3 | 4);
+      }
+      break;
+    case ManyUnknownFields:
+      for (int i = 0; i < n; i++) {
+        AppendVarint(&data, (100000 + i) << 3);
+        AppendVarint(&data, i);
+      }
+      break;
+    case HugeUnknownField:
+      AppendVarint(&data, 500 << 3 | 2);
+      AppendVarint(&data, n * 1024);
+      data.append(n * 1024, 'x');
+      break;
+    case DuplicateMapKeys:
+    case LongPrefixMapKeys:
+      for (int i = 0; i < n; i++) {
+        std::string key = shape == DuplicateMapKeys
+                              ? "key"
+                              : std::string(1024, 'k') + std::to_string(i);
+        std::string entry;
+        AppendVarint(&entry, 1 << 3 | 2);
+        AppendVarint(&entry, key.size());
+        entry.append(key);
+        AppendVarint(&entry, 2 << 3);
+        AppendVarint(&entry, i);
+        AppendMapEntry(&data, 1, entry);
+      }
+      break;
+    case SparseIntMapKeys:
+      for (int i = 0; i < n; i++) {
+        std::string entry;
+        AppendVarint(&entry, 1 << 3);
+        AppendVarint(&entry, (i * 0x10001u) & 0x7fffffff);
+        AppendVarint(&entry, 2 << 3);
+        AppendVarint(&entry, i);
+        AppendMapEntry(&data, 2, entry);
+      }
+      break;
+    case ManyExtensions:
+      for (int i = 0; i < n; i++) {
+        AppendVarint(&data, (1000 + i % WorstCaseSchema::kExtensions) << 3);
+        AppendVarint(&data, i);
+      }
+      break;
+  }
+  return data;
+}
+
+template <WireWorstCase Shape>
+static void BM_Parse_Upb_WorstCase(benchmark::State& state) {
+  static const WorstCaseSchema* schema = new WorstCaseSchema;
+  std::string data = WireWorstCasePayload(Shape, state.range(0));
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb_Message* msg = upb_Message_New(schema->layout, arena.ptr());
+    if (upb_Decode(data.data(), data.size(), msg, schema->layout,
+                   schema->extreg, 0, arena.ptr()) != kUpb_DecodeStatus_Ok) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetComplexityN(state.range(0));
+  state.SetBytesProcessed(state.iterations() * data.size());
+  SetArenaCounters(state, data.size(), [&](upb_Arena* arena) {
+    upb_Message* msg = upb_Message_New(schema->layout, arena);
+    upb_Decode(data.data(), data.size(), msg, schema->layout, schema->extreg,
+               0, arena);
+  });
+}
+BENCHMARK_TEMPLATE(BM_Parse_Upb_WorstCase, NestedUnknownGroups)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_WorstCase, ManyUnknownFields)
+    ->RangeMultiplier(4)
+    ->Range(16, 16384)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_WorstCase, HugeUnknownField)
+    ->RangeMultiplier(4)
+    ->Range(16, 16384)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_WorstCase, DuplicateMapKeys)
+    ->RangeMultiplier(4)
+    ->Range(16, 16384)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_WorstCase, LongPrefixMapKeys)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_WorstCase, SparseIntMapKeys)
+    ->RangeMultiplier(4)
+    ->Range(16, 16384)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_Parse_Upb_WorstCase, ManyExtensions)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity(benchmark::oN);
+
+enum JsonWorstCase {
+  JsonNestedUnknown,   // Ignored unknown arrays nested 48 deep, range(0) times.
+  JsonNestedMessages,  // Messages nested 24 deep, range(0) times.
+  JsonEscapes,         // A string of range(0) \u escapes, some surrogates.
+};
+
+static std::string JsonWorstCasePayload(JsonWorstCase shape, int n) {
+  std::string json = "{";
+  switch (shape) {
+    case JsonNestedUnknown:
+      for (int i = 0; i < n; i++) {
+        json += (i ? ", \"unknown" : "\"unknown") + std::to_string(i) + "\": ";
+        json += std::string(48, '[') + std::string(48, ']');
+      }
+      break;
+    case JsonNestedMessages:
+      json += "\"messageType\": [";
+      for (int i = 0; i < n; i++) {
+        if (i) json += ", ";
+        for (int d = 0; d < 24; d++) json += "{\"nestedType\": [";
+        for (int d = 0; d < 24; d++) json += "]}";
+      }
+      json += "]";
+      break;
+    case JsonEscapes:
+      json += "\"name\": \"";
+      for (int i = 0; i < n; i++) {
+        json += i % 2 ? "\\u00e9" : "\\ud83d\\ude00";
+      }
+      json += "\"";
+      break;
+  }
+  return json + "}";
+}
+
+template <JsonWorstCase Shape>
+static void BM_JsonDecode_WorstCase(benchmark::State& state) {
+  std::string json = JsonWorstCasePayload(Shape, state.range(0));
+  upb::DefPool defpool;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Message* msg =
+        upb_Message_New(upb_MessageDef_MiniTable(m), arena.ptr());
+    if (!upb_JsonDecode(json.data(), json.size(), msg, m, defpool.ptr(),
+                        upb_JsonDecode_IgnoreUnknown, arena.ptr(),
+                        status.ptr())) {
+      printf("Failed to decode: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetComplexityN(state.range(0));
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+BENCHMARK_TEMPLATE(BM_JsonDecode_WorstCase, JsonNestedUnknown)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_JsonDecode_WorstCase, JsonNestedMessages)
+    ->RangeMultiplier(4)
+    ->Range(16, 1024)
+    ->Complexity(benchmark::oN);
+BENCHMARK_TEMPLATE(BM_JsonDecode_WorstCase, JsonEscapes)
+    ->RangeMultiplier(4)
+    ->Range(16, 16384)
+    ->Complexity(benchmark::oN);
+
+// Replays the inputs that upb::fuzz::SlowInputTracker wrote to the directory
+// named by UPB_BENCHMARK_SLOW_INPUTS: "wire-*" files are parsed and "json-*"
+// files JSON-decoded, as protobuf_test_messages.proto3.TestAllTypesProto3 like
+// the fuzz tests that found them.
+static void BM_Decode_SlowInput(benchmark::State& state, std::string path,
+                                bool json) {
+  std::string data;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    printf("Failed to open %s.\n", path.c_str());
+    exit(1);
+  }
+  char chunk[4096];
+  for (size_t n; (n = fread(chunk, 1, sizeof(chunk), f)) > 0;) {
+    data.append(chunk, n);
+  }
+  fclose(f);
+  upb::DefPool defpool;
+  const upb_MessageDef* m =
+      protobuf_test_messages_proto3_TestAllTypesProto3_getmsgdef(defpool.ptr());
+  const upb_MiniTable* layout = upb_MessageDef_MiniTable(m);
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Message* msg = upb_Message_New(layout, arena.ptr());
+    // Failing is fine: these are fuzz inputs, and only the time matters.
+    if (json) {
+      upb_JsonDecode(data.data(), data.size(), msg, m, defpool.ptr(),
+                     upb_JsonDecode_IgnoreUnknown, arena.ptr(), status.ptr());
+    } else {
+      upb_Decode(data.data(), data.size(), msg, layout, nullptr, 0,
+                 arena.ptr());
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+static const bool kSlowInputsRegistered = [] {
+  const char* dir = getenv("UPB_BENCHMARK_SLOW_INPUTS");
+  if (!dir) return false;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    std::string name = entry.path().filename().string();
+    bool json = name.rfind("json-", 0) == 0;
+    if (!json && name.rfind("wire-", 0) != 0) continue;
+    benchmark::RegisterBenchmark(("BM_Decode_SlowInput/" + name).c_str(),
+                                 BM_Decode_SlowInput, entry.path().string(),
+                                 json);
+  }
+  return true;
+}();
+
+enum Utf8Validator {
+  UpbUtf8,
+  Utf8Range,
+};
+
+// Validates state.range(0) bytes of text that is mostly ASCII, with a two-,
+// three- or four-byte character every few words.
+template <Utf8Validator V>
+static void BM_ValidateUtf8(benchmark::State& state) {
+  static const char* const kWords[] = {"lorem ", "ipsum ", "caf\xc3\xa9 ",
+                                       "dolor ", "\xe2\x82\xac ", "sit ",
+                                       "\xf0\x9f\x98\x80 ", "amet "};
+  std::string text;
+  for (int i = 0; text.size() < (size_t)state.range(0); i++) {
+    text += kWords[i % 8];
+  }
+  while (text.size() > (size_t)state.range(0) || (text.back() & 0x80)) {
+    text.pop_back();
+  }
+  for (auto _ : state) {
+    bool ok;
+    if (V == UpbUtf8) {
+      ok = upb_Utf8_IsValid(text.data(), text.size());
+    } else {
+      ok = utf8_range2((const unsigned char*)text.data(), text.size()) == 0;
+    }
+    if (!ok) {
+      printf("Failed to validate.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK_TEMPLATE(BM_ValidateUtf8, UpbUtf8)
+    ->RangeMultiplier(4)
+    ->Range(16, 64 << 10);
+BENCHMARK_TEMPLATE(BM_ValidateUtf8, Utf8Range)
+    ->RangeMultiplier(4)
+    ->Range(16, 64 << 10);
+
+enum DoubleShape {
+  Metric,    // Values like latencies and ratios, mostly 16-17 digits.
+  Counter,   // Integers that happen to be stored as doubles.
+};
+
+// Formats doubles the way the JSON and text encoders do.
+template <DoubleShape Shape>
+static void BM_EncodeRoundTripDouble(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::vector<double> values;
+  for (int i = 0; i < 1024; i++) {
+    if (Shape == Metric) {
+      values.push_back(std::uniform_real_distribution<double>(0, 1000)(rng));
+    } else {
+      values.push_back(rng() % 1000000);
+    }
+  }
+  char buf[kUpb_RoundTripBufferSize];
+  for (auto _ : state) {
+    for (double val : values) {
+      _upb_EncodeRoundTripDouble(val, buf, sizeof(buf));
+      benchmark::DoNotOptimize(buf);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK_TEMPLATE(BM_EncodeRoundTripDouble, Metric);
+BENCHMARK_TEMPLATE(BM_EncodeRoundTripDouble, Counter);
+
+enum DoubleParser {
+  UseStrtod,
+  UseUpb,
+};
+
+// Parses doubles the way the JSON decoder and text tokenizer do.
+template <DoubleShape Shape, DoubleParser Parser>
+static void BM_ParseDouble(benchmark::State& state) {
+  std::mt19937_64 rng(1);
+  std::vector<std::string> values;
+  char buf[kUpb_RoundTripBufferSize];
+  for (int i = 0; i < 1024; i++) {
+    if (Shape == Metric) {
+      _upb_EncodeRoundTripDouble(
+          std::uniform_real_distribution<double>(0, 1000)(rng), buf,
+          sizeof(buf));
+    } else {
+      _upb_EncodeRoundTripDouble(rng() % 1000000, buf, sizeof(buf));
+    }
+    values.push_back(buf);
+  }
+  for (auto _ : state) {
+    for (const std::string& str : values) {
+      double val;
+      if (Parser == UseStrtod) {
+        val = _upb_NoLocaleStrtod(str.c_str(), nullptr);
+      } else {
+        upb_BufToDouble(str.data(), str.data() + str.size(), &val);
+      }
+      benchmark::DoNotOptimize(val);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+BENCHMARK_TEMPLATE(BM_ParseDouble, Metric, UseStrtod);
+BENCHMARK_TEMPLATE(BM_ParseDouble, Metric, UseUpb);
+BENCHMARK_TEMPLATE(BM_ParseDouble, Counter, UseStrtod);
+BENCHMARK_TEMPLATE(BM_ParseDouble, Counter, UseUpb);
+
+enum JsonShape {
+  LongStrings,  // A few large string values, like documents or blobs.
+  Indented,     // Many short values, pretty-printed one per line.
+  Integers,     // Many small integers.
+};
+
+// A FileDescriptorProto whose repeated "dependency" or "publicDependency"
+// field holds the values.
+static std::string BenchmarkJson(JsonShape shape) {
+  std::string json = "{\n  \"dependency\": [";
+  if (shape == LongStrings) {
+    std::string line;
+    for (int i = 0; line.size() < 80; i++) line += "lorem ipsum dolor ";
+    line += "\\n";
+    for (int i = 0; i < 16; i++) {
+      json += i ? ", \"" : "\"";
+      for (int j = 0; j < 200; j++) json += line;
+      json += "\"";
+    }
+  } else if (shape == Indented) {
+    for (int i = 0; i < 1000; i++) {
+      json += i ? ",\n" : "\n";
+      json += "        \"google/protobuf/file" + std::to_string(i) + ".proto\"";
+    }
+  } else {
+    json = "{\"publicDependency\": [";
+    for (int i = 0; i < 1000; i++) {
+      json += (i ? "," : "") + std::to_string(i * 7919 % 100000);
+    }
+  }
+  json += "\n  ]\n}\n";
+  return json;
+}
+
+template <JsonShape Shape>
+static void BM_JsonDecode(benchmark::State& state) {
+  std::string json = BenchmarkJson(Shape);
+  upb::DefPool defpool;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Message* msg =
+        upb_Message_New(upb_MessageDef_MiniTable(m), arena.ptr());
+    if (!upb_JsonDecode(json.data(), json.size(), msg, m, defpool.ptr(), 0,
+                        arena.ptr(), status.ptr())) {
+      printf("Failed to decode: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+BENCHMARK_TEMPLATE(BM_JsonDecode, LongStrings);
+BENCHMARK_TEMPLATE(BM_JsonDecode, Indented);
+BENCHMARK_TEMPLATE(BM_JsonDecode, Integers);
+
+template <JsonShape Shape>
+static void BM_JsonEncode(benchmark::State& state) {
+  std::string json = BenchmarkJson(Shape);
+  upb::DefPool defpool;
+  upb::Arena arena;
+  upb::Status status;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_Message* msg = upb_Message_New(upb_MessageDef_MiniTable(m), arena.ptr());
+  if (!upb_JsonDecode(json.data(), json.size(), msg, m, defpool.ptr(), 0,
+                      arena.ptr(), status.ptr())) {
+    printf("Failed to decode: %s\n", status.error_message());
+    exit(1);
+  }
+  std::vector<char> out(json.size() * 2);
+  size_t size = 0;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    size = upb_JsonEncode(msg, m, defpool.ptr(), 0, out.data(), out.size(),
+                          status.ptr());
+    if (size >= out.size()) {
+      printf("Failed to encode.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK_TEMPLATE(BM_JsonEncode, LongStrings);
+BENCHMARK_TEMPLATE(BM_JsonEncode, Indented);
+BENCHMARK_TEMPLATE(BM_JsonEncode, Integers);
+
+// Log-like records, one FileDescriptorProto per line.
+static std::string BenchmarkJsonLines() {
+  std::string json;
+  for (int i = 0; i < 1000; i++) {
+    std::string n = std::to_string(i);
+    json += "{\"name\": \"file" + n + ".proto\", \"package\": \"pkg" + n +
+            "\", \"dependency\": [\"a.proto\", \"b.proto\"], "
+            "\"publicDependency\": [" + n + "], \"syntax\": \"proto3\", "
+            "\"options\": {\"javaPackage\": \"com.example\", "
+            "\"optimizeFor\": \"SPEED\", \"ccEnableArenas\": true}}\n";
+  }
+  return json;
+}
+
+enum JsonLinesMode { PerLine, Batch };
+
+template <JsonLinesMode Mode>
+static void BM_JsonDecodeLines(benchmark::State& state) {
+  std::string json = BenchmarkJsonLines();
+  upb::DefPool defpool;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Array* msgs = upb_Array_New(arena.ptr(), kUpb_CType_Message);
+    bool ok = true;
+    if (Mode == Batch) {
+      ok = upb_JsonDecodeLines(json.data(), json.size(), msgs, m,
+                               defpool.ptr(), 0, arena.ptr(), status.ptr());
+    } else {
+      const char* ptr = json.data();
+      const char* end = ptr + json.size();
+      while (ok && ptr < end) {
+        const char* nl = (const char*)memchr(ptr, '\n', end - ptr);
+        upb_MessageValue val;
+        val.msg_val =
+            upb_Message_New(upb_MessageDef_MiniTable(m), arena.ptr());
+        ok = upb_JsonDecode(ptr, nl - ptr, (upb_Message*)val.msg_val, m,
+                            defpool.ptr(), 0, arena.ptr(), status.ptr()) &&
+             upb_Array_Append(msgs, val, arena.ptr());
+        ptr = nl + 1;
+      }
+    }
+    if (!ok) {
+      printf("Failed to decode: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+BENCHMARK_TEMPLATE(BM_JsonDecodeLines, PerLine);
+BENCHMARK_TEMPLATE(BM_JsonDecodeLines, Batch);
+
+// Benchmarks over the payloads from gen_synthetic_payloads.py, one per schema
+// from gen_synthetic_protos.py.  state.range(0) indexes kSyntheticWorkloads.
+
+struct SyntheticSchema {
+  explicit SyntheticSchema(const upb_benchmark::SyntheticWorkload& w) {
+    const google_protobuf_FileDescriptorProto* file =
+        google_protobuf_FileDescriptorProto_parse(
+            w.descriptor.data, w.descriptor.size, arena.ptr());
+    upb::Status status;
+    if (!file || !upb_DefPool_AddFile(defpool.ptr(), file, status.ptr())) {
+      printf("Failed to load %s: %s\n", w.name, status.error_message());
+      exit(1);
+    }
+    m = upb_DefPool_FindMessageByName(defpool.ptr(), w.message);
+    layout = upb_MessageDef_MiniTable(m);
+  }
+
+  upb::Arena arena;
+  upb::DefPool defpool;
+  const upb_MessageDef* m;
+  const upb_MiniTable* layout;
+};
+
+static void SyntheticWorkloads(benchmark::internal::Benchmark* b) {
+  b->DenseRange(0, upb_benchmark::kSyntheticWorkloadCount - 1);
+}
+
+static void BM_Parse_Upb_Synthetic(benchmark::State& state) {
+  const upb_benchmark::SyntheticWorkload& w =
+      upb_benchmark::kSyntheticWorkloads[state.range(0)];
+  SyntheticSchema schema(w);
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb_Message* msg = upb_Message_New(schema.layout, arena.ptr());
+    if (upb_Decode(w.binary.data, w.binary.size, msg, schema.layout, nullptr,
+                   0, arena.ptr()) != kUpb_DecodeStatus_Ok) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetLabel(w.name);
+  state.SetBytesProcessed(state.iterations() * w.binary.size);
+  SetArenaCounters(state, w.binary.size, [&](upb_Arena* arena) {
+    upb_Message* msg = upb_Message_New(schema.layout, arena);
+    upb_Decode(w.binary.data, w.binary.size, msg, schema.layout, nullptr, 0,
+               arena);
+  });
+}
+BENCHMARK(BM_Parse_Upb_Synthetic)->Apply(SyntheticWorkloads);
+
+static void BM_Serialize_Upb_Synthetic(benchmark::State& state) {
+  const upb_benchmark::SyntheticWorkload& w =
+      upb_benchmark::kSyntheticWorkloads[state.range(0)];
+  SyntheticSchema schema(w);
+  upb_Message* msg = upb_Message_New(schema.layout, schema.arena.ptr());
+  if (upb_Decode(w.binary.data, w.binary.size, msg, schema.layout, nullptr, 0,
+                 schema.arena.ptr()) != kUpb_DecodeStatus_Ok) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  size_t size = 0;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    char* data;
+    if (upb_Encode(msg, schema.layout, 0, arena.ptr(), &data, &size) !=
+        kUpb_EncodeStatus_Ok) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+  }
+  state.SetLabel(w.name);
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_Serialize_Upb_Synthetic)->Apply(SyntheticWorkloads);
+
+static void BM_JsonDecode_Upb_Synthetic(benchmark::State& state) {
+  const upb_benchmark::SyntheticWorkload& w =
+      upb_benchmark::kSyntheticWorkloads[state.range(0)];
+  SyntheticSchema schema(w);
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Message* msg = upb_Message_New(schema.layout, arena.ptr());
+    if (!upb_JsonDecode(w.json.data, w.json.size, msg, schema.m,
+                        schema.defpool.ptr(), 0, arena.ptr(), status.ptr())) {
+      printf("Failed to decode: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetLabel(w.name);
+  state.SetBytesProcessed(state.iterations() * w.json.size);
+  SetArenaCounters(state, w.json.size, [&](upb_Arena* arena) {
+    upb::Status status;
+    upb_Message* msg = upb_Message_New(schema.layout, arena);
+    upb_JsonDecode(w.json.data, w.json.size, msg, schema.m,
+                   schema.defpool.ptr(), 0, arena, status.ptr());
+  });
+}
+BENCHMARK(BM_JsonDecode_Upb_Synthetic)->Apply(SyntheticWorkloads);
+
+static void BM_JsonEncode_Upb_Synthetic(benchmark::State& state) {
+  const upb_benchmark::SyntheticWorkload& w =
+      upb_benchmark::kSyntheticWorkloads[state.range(0)];
+  SyntheticSchema schema(w);
+  upb::Status status;
+  upb_Message* msg = upb_Message_New(schema.layout, schema.arena.ptr());
+  if (upb_Decode(w.binary.data, w.binary.size, msg, schema.layout, nullptr, 0,
+                 schema.arena.ptr()) != kUpb_DecodeStatus_Ok) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  std::vector<char> out(w.json.size * 2);
+  size_t size = 0;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    size = upb_JsonEncode(msg, schema.m, schema.defpool.ptr(), 0, out.data(),
+                          out.size(), status.ptr());
+    if (size >= out.size()) {
+      printf("Failed to encode.\n");
+      exit(1);
+    }
+  }
+  state.SetLabel(w.name);
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_JsonEncode_Upb_Synthetic)->Apply(SyntheticWorkloads);
+
+static void BM_TextEncode_Upb_Synthetic(benchmark::State& state) {
+  const upb_benchmark::SyntheticWorkload& w =
+      upb_benchmark::kSyntheticWorkloads[state.range(0)];
+  SyntheticSchema schema(w);
+  upb_Message* msg = upb_Message_New(schema.layout, schema.arena.ptr());
+  if (upb_Decode(w.binary.data, w.binary.size, msg, schema.layout, nullptr, 0,
+                 schema.arena.ptr()) != kUpb_DecodeStatus_Ok) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  std::vector<char> out(
+      upb_TextEncode(msg, schema.m, schema.defpool.ptr(), 0, nullptr, 0) + 1);
+  size_t size = 0;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    size = upb_TextEncode(msg, schema.m, schema.defpool.ptr(), 0, out.data(),
+                          out.size());
+    if (size >= out.size()) {
+      printf("Failed to encode.\n");
+      exit(1);
+    }
+  }
+  state.SetLabel(w.name);
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_TextEncode_Upb_Synthetic)->Apply(SyntheticWorkloads);
+
+enum TranscodePath {
+  TwoStep,  // Parse into a message with upb_Decode() or upb_JsonDecode().
+  Direct,   // upb_JsonTranscodeFromBinary() and upb_JsonTranscodeToBinary().
+};
+
+// One request of a binary-to-JSON gateway: the output goes in a fresh arena.
+template <TranscodePath Path>
+static void BM_JsonTranscodeFromBinary_Upb_Synthetic(benchmark::State& state) {
+  const upb_benchmark::SyntheticWorkload& w =
+      upb_benchmark::kSyntheticWorkloads[state.range(0)];
+  SyntheticSchema schema(w);
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    char* json;
+    size_t size;
+    bool ok;
+    if (Path == TwoStep) {
+      upb_Message* msg = upb_Message_New(schema.layout, arena.ptr());
+      size_t cap = 2 * w.binary.size + 64;
+      json = static_cast<char*>(upb_Arena_Malloc(arena.ptr(), cap));
+      ok = upb_Decode(w.binary.data, w.binary.size, msg, schema.layout,
+                      nullptr, 0, arena.ptr()) == kUpb_DecodeStatus_Ok;
+      size = upb_JsonEncode(msg, schema.m, schema.defpool.ptr(), 0, json, cap,
+                            status.ptr());
+      if (ok && size >= cap) {
+        json = static_cast<char*>(upb_Arena_Malloc(arena.ptr(), size + 1));
+        upb_JsonEncode(msg, schema.m, schema.defpool.ptr(), 0, json, size + 1,
+                       status.ptr());
+      }
+    } else {
+      ok = upb_JsonTranscodeFromBinary(
+          w.binary.data, w.binary.size, schema.m, schema.defpool.ptr(), 0,
+          arena.ptr(), &json, &size, status.ptr());
+    }
+    if (!ok) {
+      printf("Failed to transcode.\n");
+      exit(1);
+    }
+    benchmark::DoNotOptimize(json);
+  }
+  state.SetLabel(w.name);
+  state.SetBytesProcessed(state.iterations() * w.binary.size);
+}
+BENCHMARK_TEMPLATE(BM_JsonTranscodeFromBinary_Upb_Synthetic, TwoStep)
+    ->Apply(SyntheticWorkloads);
+BENCHMARK_TEMPLATE(BM_JsonTranscodeFromBinary_Upb_Synthetic, Direct)
+    ->Apply(SyntheticWorkloads);
+
+template <TranscodePath Path>
+static void BM_JsonTranscodeToBinary_Upb_Synthetic(benchmark::State& state) {
+  const upb_benchmark::SyntheticWorkload& w =
+      upb_benchmark::kSyntheticWorkloads[state.range(0)];
+  SyntheticSchema schema(w);
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    char* data;
+    size_t size;
+    bool ok;
+    if (Path == TwoStep) {
+      upb_Message* msg = upb_Message_New(schema.layout, arena.ptr());
+      ok = upb_JsonDecode(w.json.data, w.json.size, msg, schema.m,
+                          schema.defpool.ptr(), 0, arena.ptr(),
+                          status.ptr()) &&
+           upb_Encode(msg, schema.layout, 0, arena.ptr(), &data, &size) ==
+               kUpb_EncodeStatus_Ok;
+    } else {
+      ok = upb_JsonTranscodeToBinary(w.json.data, w.json.size, schema.m,
+                                     schema.defpool.ptr(), 0, arena.ptr(),
+                                     &data, &size, status.ptr());
+    }
+    if (!ok) {
+      printf("Failed to transcode: %s\n", status.error_message());
+      exit(1);
+    }
+    benchmark::DoNotOptimize(data);
+  }
+  state.SetLabel(w.name);
+  state.SetBytesProcessed(state.iterations() * w.json.size);
+}
+BENCHMARK_TEMPLATE(BM_JsonTranscodeToBinary_Upb_Synthetic, TwoStep)
+    ->Apply(SyntheticWorkloads);
+BENCHMARK_TEMPLATE(BM_JsonTranscodeToBinary_Upb_Synthetic, Direct)
+    ->Apply(SyntheticWorkloads);
+
+// Keys shaped like the full names in a DefPool's symbol table.
+static std::vector<std::string> TableKeys(size_t n) {
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < n; i++) {
+    keys.push_back("google.protobuf.Message" + std::to_string(i * 7919));
+  }
+  return keys;
+}
+
+static void BM_StrTableInsert(benchmark::State& state) {
+  std::vector<std::string> keys = TableKeys(state.range(0));
+  for (auto _ : state) {
+    upb_Arena* arena = upb_Arena_New();
+    upb_strtable t;
+    upb_strtable_init(&t, 4, arena);
+    for (size_t i = 0; i < keys.size(); i++) {
+      upb_strtable_insert(&t, keys[i].data(), keys[i].size(),
+                          upb_value_int32(i), arena);
+    }
+    upb_Arena_Free(arena);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_StrTableInsert)->RangeMultiplier(8)->Range(8, 32768);
+
+static void BM_StrTableLookup(benchmark::State& state) {
+  std::vector<std::string> keys = TableKeys(state.range(0));
+  upb::Arena arena;
+  upb_strtable t;
+  upb_strtable_init(&t, keys.size(), arena.ptr());
+  for (size_t i = 0; i < keys.size(); i++) {
+    upb_strtable_insert(&t, keys[i].data(), keys[i].size(), upb_value_int32(i),
+                        arena.ptr());
+  }
+  // Half of the lookups miss.
+  std::vector<std::string> misses = keys;
+  for (auto& key : misses) key += "x";
+  for (auto _ : state) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      const std::string& key = i % 2 ? misses[i] : keys[i];
+      upb_value v;
+      benchmark::DoNotOptimize(
+          upb_strtable_lookup2(&t, key.data(), key.size(), &v));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_StrTableLookup)->RangeMultiplier(8)->Range(8, 32768);
+
+static void BM_StrTableIterate(benchmark::State& state) {
+  std::vector<std::string> keys = TableKeys(state.range(0));
+  upb::Arena arena;
+  upb_strtable t;
+  upb_strtable_init(&t, 4, arena.ptr());
+  for (size_t i = 0; i < keys.size(); i++) {
+    upb_strtable_insert(&t, keys[i].data(), keys[i].size(), upb_value_int32(i),
+                        arena.ptr());
+  }
+  for (auto _ : state) {
+    intptr_t iter = UPB_STRTABLE_BEGIN;
+    upb_StringView key;
+    upb_value val;
+    while (upb_strtable_next2(&t, &key, &val, &iter)) {
+      benchmark::DoNotOptimize(val);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_StrTableIterate)->RangeMultiplier(8)->Range(8, 32768);
+
+// Map keys and field names are mostly shorter than the full names above.
+static void BM_StrTableLookupShort(benchmark::State& state) {
+  std::vector<std::string> keys;
+  for (int i = 0; i < state.range(0); i++) {
+    keys.push_back(std::to_string(i * 7919));
+  }
+  upb::Arena arena;
+  upb_strtable t;
+  upb_strtable_init(&t, keys.size(), arena.ptr());
+  for (size_t i = 0; i < keys.size(); i++) {
+    upb_strtable_insert(&t, keys[i].data(), keys[i].size(), upb_value_int32(i),
+                        arena.ptr());
+  }
+  for (auto _ : state) {
+    for (const std::string& key : keys) {
+      upb_value v;
+      benchmark::DoNotOptimize(
+          upb_strtable_lookup2(&t, key.data(), key.size(), &v));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_StrTableLookupShort)->RangeMultiplier(8)->Range(8, 32768);
+
+static void BM_DefPool_FindMessageByName(benchmark::State& state) {
+  upb::DefPool defpool;
+  const upb_FileDef* file = upb_MessageDef_File(
+      upb_benchmark_FileDescriptorSet_getmsgdef(defpool.ptr()));
+  std::vector<std::string> names;
+  for (int i = 0; i < upb_FileDef_TopLevelMessageCount(file); i++) {
+    names.push_back(
+        upb_MessageDef_FullName(upb_FileDef_TopLevelMessage(file, i)));
+  }
+  if (state.range(0)) defpool.Freeze();
+  for (auto _ : state) {
+    for (const std::string& name : names) {
+      benchmark::DoNotOptimize(
+          upb_DefPool_FindMessageByName(defpool.ptr(), name.c_str()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_DefPool_FindMessageByName)->ArgName("frozen")->Arg(0)->Arg(1);
+
+static void BM_MessageDef_FindFieldByName(benchmark::State& state) {
+  upb::DefPool defpool;
+  const upb_FileDef* file = upb_MessageDef_File(
+      upb_benchmark_FileDescriptorSet_getmsgdef(defpool.ptr()));
+  std::vector<std::pair<const upb_MessageDef*, std::string>> fields;
+  for (int i = 0; i < upb_FileDef_TopLevelMessageCount(file); i++) {
+    const upb_MessageDef* m = upb_FileDef_TopLevelMessage(file, i);
+    for (int j = 0; j < upb_MessageDef_FieldCount(m); j++) {
+      fields.emplace_back(m, upb_FieldDef_Name(upb_MessageDef_Field(m, j)));
+    }
+  }
+  for (auto _ : state) {
+    for (const auto& field : fields) {
+      benchmark::DoNotOptimize(upb_MessageDef_FindFieldByNameWithSize(
+          field.first, field.second.data(), field.second.size()));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * fields.size());
+}
+BENCHMARK(BM_MessageDef_FindFieldByName);
+
+// Sparse keys, so that they all land in the hash part.
+static void BM_IntTableLookup(benchmark::State& state) {
+  const size_t n = state.range(0);
+  upb::Arena arena;
+  upb_inttable t;
+  upb_inttable_init(&t, arena.ptr());
+  for (size_t i = 1; i <= n; i++) {
+    upb_inttable_insert(&t, i * 65537, upb_value_int32(i), arena.ptr());
+  }
+  for (auto _ : state) {
+    for (size_t i = 1; i <= n; i++) {
+      upb_value v;
+      benchmark::DoNotOptimize(upb_inttable_lookup(&t, i * 65537, &v));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_IntTableLookup)->RangeMultiplier(8)->Range(8, 32768);
+
+// Looks up random keys of a map with `range(0)` entries, 1024 at a time, one
+// by one or as a batch.  The keys cycle through many more than 1024, so that
+// large maps do not stay in cache.
+static void BM_MapLookup(benchmark::State& state) {
+  const size_t n = state.range(0);
+  const bool batch = state.range(1);
+  upb::Arena arena;
+  upb_Map* map = upb_Map_New(arena.ptr(), kUpb_CType_Int64, kUpb_CType_Int64);
+  for (size_t i = 0; i < n; i++) {
+    upb_MessageValue key, val;
+    key.int64_val = i * 65537;
+    val.int64_val = i;
+    upb_Map_Set(map, key, val, arena.ptr());
+  }
+  std::vector<upb_MessageValue> keys(1 << 20), vals(1024);
+  uint64_t x = 1;
+  for (auto& key : keys) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    key.int64_val = (x >> 33) % n * 65537;
+  }
+  size_t start = 0;
+  for (auto _ : state) {
+    const upb_MessageValue* k = &keys[start];
+    if (batch) {
+      upb_Map_GetBatch(map, k, vals.size(), vals.data(), nullptr);
+    } else {
+      for (size_t i = 0; i < vals.size(); i++) {
+        upb_Map_Get(map, k[i], &vals[i]);
+      }
+    }
+    benchmark::DoNotOptimize(vals.data());
+    start = (start + vals.size()) % keys.size();
+  }
+  state.SetItemsProcessed(state.iterations() * vals.size());
+}
+BENCHMARK(BM_MapLookup)
+    ->ArgsProduct({{1 << 10, 1 << 16, 1 << 22}, {false, true}});
+
+template <ArenaMode AMode, class P>
+struct Proto2Factory;
+
+template <class P>
+struct Proto2Factory<NoArena, P> {
+ public:
+  P* GetProto() { return &proto; }
+
+ private:
+  P proto;
+};
+
+template <class P>
+struct Proto2Factory<UseArena, P> {
+ public:
+  P* GetProto() { return protobuf::Arena::CreateMessage<P>(&arena); }
+
+ private:
+  protobuf::Arena arena;
+};
+
+template <class P>
+struct Proto2Factory<InitBlock, P> {
+ public:
+  Proto2Factory() : arena(GetOptions()) {}
+  P* GetProto() { return protobuf::Arena::CreateMessage<P>(&arena); }
+
+ private:
+  protobuf::ArenaOptions GetOptions() {
+    protobuf::ArenaOptions opts;
+    opts.initial_block = (char*)buf;
+    opts.initial_block_size = sizeof(buf);
+    return opts;
+  }
+
+  protobuf::Arena arena;
+};
+
+using FileDesc = ::upb_benchmark::FileDescriptorProto;
+using FileDescSV = ::upb_benchmark::sv::FileDescriptorProto;
+
+template <class P, ArenaMode AMode, CopyStrings kCopy>
+void BM_Parse_Proto2(benchmark::State& state) {
+  constexpr protobuf::MessageLite::ParseFlags kParseFlags =
+      kCopy == Copy
+          ? protobuf::MessageLite::ParseFlags::kMergePartial
+          : protobuf::MessageLite::ParseFlags::kMergePartialWithAliasing;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    Proto2Factory<AMode, P> proto_factory;
+    auto proto = proto_factory.GetProto();
+    absl::string_view input(descriptor.data, descriptor.size);
+    bool ok = proto->template ParseFrom<kParseFlags>(input);
+    if (!ok) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDesc, NoArena, Copy);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDesc, UseArena, Copy);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDesc, InitBlock, Copy);
+BENCHMARK_TEMPLATE(BM_Parse_Proto2, FileDescSV, InitBlock, Alias);
+
+static void BM_SerializeDescriptor_Proto2(benchmark::State& state) {
+  upb_benchmark::FileDescriptorProto proto;
+  proto.ParseFromArray(descriptor.data, descriptor.size);
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    proto.SerializePartialToArray(buf, sizeof(buf));
+  }
+  state.SetBytesProcessed(state.iterations() * descriptor.size);
+}
+BENCHMARK(BM_SerializeDescriptor_Proto2);
+
+static void BM_SerializeDescriptor_Upb(benchmark::State& state) {
+  int64_t total = 0;
+  upb_Arena* arena = upb_Arena_New();
+  upb_benchmark_FileDescriptorProto* set =
+      upb_benchmark_FileDescriptorProto_parse(descriptor.data, descriptor.size,
+                                              arena);
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb_Arena* enc_arena = upb_Arena_Init(buf, sizeof(buf), nullptr);
+    size_t size;
+    char* data =
+        upb_benchmark_FileDescriptorProto_serialize(set, enc_arena, &size);
+    if (!data) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    total += size;
+  }
+  state.SetBytesProcessed(total);
+}
+BENCHMARK(BM_SerializeDescriptor_Upb);
+
+// Always uses the table-driven encoder, for comparison with the generated
+// _serialize() above when building with --//:specialized_encoders.
+static void BM_SerializeDescriptor_Upb_MiniTable(benchmark::State& state) {
+  int64_t total = 0;
+  upb_Arena* arena = upb_Arena_New();
+  upb_benchmark_FileDescriptorProto* set =
+      upb_benchmark_FileDescriptorProto_parse(descriptor.data, descriptor.size,
+                                              arena);
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb_Arena* enc_arena = upb_Arena_Init(buf, sizeof(buf), nullptr);
+    char* data;
+    size_t size;
+    upb_EncodeStatus status =
+        upb_Encode(set, &upb_benchmark_FileDescriptorProto_msg_init, 0,
+                   enc_arena, &data, &size);
+    if (status != kUpb_EncodeStatus_Ok) {
+      printf("Failed to serialize.\n");
+      exit(1);
+    }
+    total += size;
+  }
+  state.SetBytesProcessed(total);
+}
+BENCHMARK(BM_SerializeDescriptor_Upb_MiniTable);
+
+static void BM_TextEncodeDescriptor_Upb(benchmark::State& state) {
+  upb::DefPool defpool;
+  upb::Arena arena;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_benchmark_FileDescriptorProto* set =
+      upb_benchmark_FileDescriptorProto_parse(descriptor.data, descriptor.size,
+                                              arena.ptr());
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  const upb_Message* msg = (const upb_Message*)set;
+  std::vector<char> out(
+      upb_TextEncode(msg, m, defpool.ptr(), 0, nullptr, 0) + 1);
+  size_t size = 0;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    size = upb_TextEncode(msg, m, defpool.ptr(), 0, out.data(), out.size());
+    if (size >= out.size()) {
+      printf("Failed to encode.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_TextEncodeDescriptor_Upb);
+
+static void BM_TextEncodeDescriptor_Proto2(benchmark::State& state) {
+  FileDesc proto;
+  proto.ParseFromArray(descriptor.data, descriptor.size);
+  std::string text;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    text.clear();
+    protobuf::TextFormat::PrintToString(proto, &text);
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_TextEncodeDescriptor_Proto2);
+
+// The descriptor in text format, for the text parsing benchmarks.
+static std::string DescriptorText() {
+  FileDesc proto;
+  proto.ParseFromArray(descriptor.data, descriptor.size);
+  std::string text;
+  protobuf::TextFormat::PrintToString(proto, &text);
+  return text;
+}
+
+static void BM_TextDecodeDescriptor_Upb(benchmark::State& state) {
+  std::string text = DescriptorText();
+  upb::DefPool defpool;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Message* msg =
+        upb_Message_New(upb_MessageDef_MiniTable(m), arena.ptr());
+    if (!upb_TextDecode(text.data(), text.size(), msg, m, defpool.ptr(), 0,
+                        arena.ptr(), status.ptr())) {
+      printf("Failed to decode: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+  SetArenaCounters(state, text.size(), [&](upb_Arena* arena) {
+    upb::Status status;
+    upb_Message* msg = upb_Message_New(upb_MessageDef_MiniTable(m), arena);
+    upb_TextDecode(text.data(), text.size(), msg, m, defpool.ptr(), 0, arena,
+                   status.ptr());
+  });
+}
+BENCHMARK(BM_TextDecodeDescriptor_Upb);
+
+static void BM_TextDecodeDescriptor_Proto2(benchmark::State& state) {
+  std::string text = DescriptorText();
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    protobuf::Arena arena;
+    FileDesc* proto = protobuf::Arena::CreateMessage<FileDesc>(&arena);
+    if (!protobuf::TextFormat::ParseFromString(text, proto)) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_TextDecodeDescriptor_Proto2);
+
+// The descriptor as JSON, for the JSON benchmarks over real-world data.
+static std::string DescriptorJson() {
+  FileDesc proto;
+  proto.ParseFromArray(descriptor.data, descriptor.size);
+  std::string json;
+  if (!protobuf::util::MessageToJsonString(proto, &json).ok()) {
+    printf("Failed to convert to JSON.\n");
+    exit(1);
+  }
+  return json;
+}
+
+static void BM_JsonDecodeDescriptor_Upb(benchmark::State& state) {
+  std::string json = DescriptorJson();
+  upb::DefPool defpool;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Message* msg =
+        upb_Message_New(upb_MessageDef_MiniTable(m), arena.ptr());
+    if (!upb_JsonDecode(json.data(), json.size(), msg, m, defpool.ptr(), 0,
+                        arena.ptr(), status.ptr())) {
+      printf("Failed to decode: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+  SetArenaCounters(state, json.size(), [&](upb_Arena* arena) {
+    upb::Status status;
+    upb_Message* msg = upb_Message_New(upb_MessageDef_MiniTable(m), arena);
+    upb_JsonDecode(json.data(), json.size(), msg, m, defpool.ptr(), 0, arena,
+                   status.ptr());
+  });
+}
+BENCHMARK(BM_JsonDecodeDescriptor_Upb);
+
+static void BM_JsonDecodeDescriptor_Proto2(benchmark::State& state) {
+  std::string json = DescriptorJson();
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    protobuf::Arena arena;
+    FileDesc* proto = protobuf::Arena::CreateMessage<FileDesc>(&arena);
+    if (!protobuf::util::JsonStringToMessage(json, proto).ok()) {
+      printf("Failed to parse.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+BENCHMARK(BM_JsonDecodeDescriptor_Proto2);
+
+static void BM_JsonEncodeDescriptor_Upb(benchmark::State& state) {
+  upb::DefPool defpool;
+  upb::Arena arena;
+  const upb_MessageDef* m =
+      upb_benchmark_FileDescriptorProto_getmsgdef(defpool.ptr());
+  upb_benchmark_FileDescriptorProto* set =
+      upb_benchmark_FileDescriptorProto_parse(descriptor.data, descriptor.size,
+                                              arena.ptr());
+  if (!set) {
+    printf("Failed to parse.\n");
+    exit(1);
+  }
+  const upb_Message* msg = (const upb_Message*)set;
+  upb::Status status;
+  std::vector<char> out(
+      upb_JsonEncode(msg, m, defpool.ptr(), 0, nullptr, 0, status.ptr()) + 1);
+  size_t size = 0;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    size = upb_JsonEncode(msg, m, defpool.ptr(), 0, out.data(), out.size(),
+                          status.ptr());
+    if (size >= out.size()) {
+      printf("Failed to encode.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_JsonEncodeDescriptor_Upb);
+
+static void BM_JsonEncodeDescriptor_Proto2(benchmark::State& state) {
+  FileDesc proto;
+  proto.ParseFromArray(descriptor.data, descriptor.size);
+  std::string json;
+  upb_benchmark::PerfCounters perf(state);
+  for (auto _ : state) {
+    json.clear();
+    if (!protobuf::util::MessageToJsonString(proto, &json).ok()) {
+      printf("Failed to encode.\n");
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * json.size());
+}
+BENCHMARK(BM_JsonEncodeDescriptor_Proto2);
+
+enum TokenizerInput {
+  ProtoSource,  // A .proto file with doc comments and indentation.
+  TextFormat,   // The descriptor in text format.
+};
+
+// Declarations in the style of the tokenizer tests, scaled up.
+static std::string BenchmarkProtoSource() {
+  std::string text = "syntax = \"proto2\";\n\npackage upb_benchmark;\n\n";
+  for (int i = 0; i < 500; i++) {
+    std::string n = std::to_string(i);
+    text += "// Leading comment for Message" + n + ".\n";
+    text += "// It runs over more than one line, like most doc comments.\n";
+    text += "message Message" + n + " {\n";
+    text += "  /* A block comment,\n   * spanning lines. */\n";
+    text += "  optional int32 field_one = 1;  // Trailing comment.\n";
+    text += "  repeated string field_two = 2 [default = \"a string value\"];\n";
+    text += "  optional double field_three = 3 [default = 1.5e10];\n";
+    text += "  optional bytes field_four = 4 [default = \"\\001\\x02\\n\"];\n";
+    text += "\n  enum Kind" + n + " {\n";
+    text += "    KIND_UNSPECIFIED = 0;\n";
+    text += "    KIND_SOMETHING_RATHER_LONG = 0x7fffffff;\n";
+    text += "  }\n}\n\n";
+  }
+  return text;
+}
+
+template <TokenizerInput Input, CopyStrings Copy>
+static void BM_Tokenize(benchmark::State& state) {
+  std::string text =
+      Input == ProtoSource ? BenchmarkProtoSource() : DescriptorText();
+  const int options =
+      (Input == TextFormat ? kUpb_TokenizerOption_CommentStyleShell : 0) |
+      (Copy == Alias ? kUpb_TokenizerOption_AliasInput : 0);
+  for (auto _ : state) {
+    upb::Arena arena;
+    upb::Status status;
+    upb_Tokenizer* t = upb_Tokenizer_New(text.data(), text.size(), nullptr,
+                                         options, arena.ptr());
+    while (upb_Tokenizer_Next(t, status.ptr())) {
+    }
+    if (!upb_Status_IsOk(status.ptr())) {
+      printf("Failed to tokenize: %s\n", status.error_message());
+      exit(1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK_TEMPLATE(BM_Tokenize, ProtoSource, Copy);
+BENCHMARK_TEMPLATE(BM_Tokenize, ProtoSource, Alias);
+BENCHMARK_TEMPLATE(BM_Tokenize, TextFormat, Copy);
+BENCHMARK_TEMPLATE(BM_Tokenize, TextFormat, Alias);
+
+enum RepeatedAccess { Iterator, Span };
+
+template <RepeatedAccess Access>
+static void BM_RepeatedFloatSum(benchmark::State& state) {
+  ::protos::Arena arena;
+  auto msg =
+      ::protos::CreateMessage<upb_benchmark::protos::RepeatedFloat>(arena);
+  for (int i = 0; i < state.range(0); i++) {
+    msg.mutable_values()->push_back(i * 0.5f);
+  }
+  auto values = msg.values();
+  for (auto _ : state) {
+    float sum = 0;
+    if (Access == Iterator) {
+      for (float f : values) sum += f;
+    } else {
+      for (float f : values.span()) sum += f;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_RepeatedFloatSum, Iterator)->Range(64, 64 << 10);
+BENCHMARK_TEMPLATE(BM_RepeatedFloatSum, Span)->Range(64, 64 << 10);
@@ -58,7 +58,8 @@ def GitWorktree(commit):
 def Run(cmd):
   subprocess.check_call(cmd, shell=True)
 
-def Benchmark(outbase, bench_cpu=True, runs=12, fasttable=False):
+def Benchmark(outbase, bench_cpu=True, runs=12, fasttable=False,
+              perf_counters=False):
   tmpfile = "/tmp/bench-output.json"
   Run("rm -rf {}".format(tmpfile))
   #Run("CC=clang bazel test ...")
@@ -69,7 +70,8 @@ def Benchmark(outbase, bench_cpu=True, runs=12, fasttable=False):
 
   if bench_cpu:
     Run("CC=clang bazel build -c opt --copt=-march=native benchmarks:benchmark" + extra_args)
-    Run("./bazel-bin/benchmarks/benchmark --benchmark_out_format=json --benchmark_out={} --benchmark_repetitions={} --benchmark_min_time=0.05 --benchmark_enable_random_interleaving=true".format(tmpfile, runs))
+    env = "UPB_BENCHMARK_PERF_COUNTERS=1 " if perf_counters else ""
+    Run(env + "./bazel-bin/benchmarks/benchmark --benchmark_out_format=json --benchmark_out={} --benchmark_repetitions={} --benchmark_min_time=0.05 --benchmark_enable_random_interleaving=true".format(tmpfile, runs))
     with open(tmpfile) as f:
       bench_json = json.load(f)
 
@@ -83,7 +85,14 @@ def Benchmark(outbase, bench_cpu=True, runs=12, fasttable=False):
         name = name.replace(" ", "")
         name = re.sub(r'^BM_', 'Benchmark', name)
         values = (name, run["iterations"], run["cpu_time"])
-        print("{} {} {} ns/op".format(*values), file=f)
+        line = "{} {} {} ns/op".format(*values)
+        # Counters from benchmarks/perf_counters.h, eg. "insts/B" and "IPC",
+        # and the arena memory per input byte from the parse benchmarks, eg.
+        # "arena/B", so that memory regressions show up next to speed.
+        for key, value in sorted(run.items()):
+          if key.endswith("/B") or key == "IPC":
+            line += " {} {}".format(value, key)
+        print(line, file=f)
     Run("sort {} -o {} ".format(txt_filename, txt_filename))
 
   Run("CC=clang bazel build -c opt --copt=-g --copt=-march=native :conformance_upb"
@@ -94,6 +103,13 @@ def Benchmark(outbase, bench_cpu=True, runs=12, fasttable=False):
 baseline = "main"
 bench_cpu = True
 fasttable = False
+perf_counters = False
+
+# --perf_counters adds per-byte hardware counters (instructions, cycles,
+# branch and cache misses) to the comparison; see benchmarks/perf_counters.h.
+if "--perf_counters" in sys.argv:
+  sys.argv.remove("--perf_counters")
+  perf_counters = True
 
 if len(sys.argv) > 1:
   baseline = sys.argv[1]
@@ -103,11 +119,13 @@ if len(sys.argv) > 1:
     pass
 
 # Benchmark our current directory first, since it's more likely to be broken.
-Benchmark("/tmp/new", bench_cpu, fasttable=fasttable)
+Benchmark("/tmp/new", bench_cpu, fasttable=fasttable,
+          perf_counters=perf_counters)
 
 # Benchmark the baseline.
 with GitWorktree(baseline):
-  Benchmark("/tmp/old", bench_cpu, fasttable=fasttable)
+  Benchmark("/tmp/old", bench_cpu, fasttable=fasttable,
+            perf_counters=perf_counters)
 
 print()
 print()
@@ -0,0 +1,360 @@
+#!/usr/bin/python3
+#
+# Protocol Buffers - Google's data interchange format
+# Copyright 2023 Google LLC.  All rights reserved.
+# https://developers.google.com/protocol-buffers/
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above
+# copyright notice, this list of conditions and the following disclaimer
+# in the documentation and/or other materials provided with the
+# distribution.
+#     * Neither the name of Google LLC nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Generates payloads for the schemas written by gen_synthetic_protos.py.
+
+Usage: gen_synthetic_payloads.py OUTPUT.cc SCHEMA.proto...
+
+For each schema, writes the serialized FileDescriptorProto and one message in
+both the binary wire format and JSON to OUTPUT.cc, which implements
+synthetic_payloads.h.  Values are drawn from distributions meant to resemble
+real traffic: most fields are absent, most varints and strings are short,
+repeated fields usually hold a handful of elements and sub-messages thin out
+with depth.
+"""
+
+import base64
+import json
+import os
+import random
+import re
+import struct
+import sys
+
+# Probability that an optional field is set, at the top level.
+PRESENCE = 0.4
+
+# The synthetic schemas have many self-recursive message fields, so rather than
+# PRESENCE they share a budget: a message sets SUBMSG_FANOUT * SUBMSG_DECAY **
+# depth of them on average, and none at MAX_DEPTH.
+SUBMSG_FANOUT = 3
+SUBMSG_DECAY = 0.5
+MAX_DEPTH = 4
+
+# (weight, bits): the number of significant bits in a varint.
+VARINT_BITS = [(60, 7), (25, 14), (10, 32), (5, 63)]
+
+# (weight, low, high): the length of a string or bytes value.
+STRING_LENGTHS = [(50, 0, 16), (30, 16, 64), (15, 64, 256), (5, 256, 2048)]
+
+# (weight, low, high): the number of elements in a repeated field.
+REPEATED_COUNTS = [(30, 0, 0), (50, 1, 4), (15, 5, 16), (5, 17, 64)]
+
+WORDS = ['the', 'quick', 'brown', 'fox', 'jumps', 'over', 'lazy', 'dog',
+         'lorem', 'ipsum', 'dolor', 'sit', 'amet', 'café', '日本']
+
+TYPES = {
+    'double': 1, 'float': 2, 'int64': 3, 'uint64': 4, 'int32': 5,
+    'fixed64': 6, 'fixed32': 7, 'bool': 8, 'string': 9, 'message': 11,
+    'bytes': 12, 'uint32': 13, 'enum': 14, 'sfixed32': 15, 'sfixed64': 16,
+    'sint32': 17, 'sint64': 18,
+}
+
+LABELS = {'optional': 1, 'required': 2, 'repeated': 3}
+
+WIRE_TYPES = {
+    'double': 1, 'fixed64': 1, 'sfixed64': 1,
+    'float': 5, 'fixed32': 5, 'sfixed32': 5,
+    'string': 2, 'bytes': 2, 'message': 2,
+}
+
+
+def weighted(table):
+  total = sum(row[0] for row in table)
+  x = random.uniform(0, total)
+  for row in table:
+    x -= row[0]
+    if x <= 0:
+      return row[1:]
+  return table[-1][1:]
+
+
+# Wire format ##################################################################
+
+
+def varint(n):
+  n &= (1 << 64) - 1
+  out = bytearray()
+  while True:
+    byte = n & 0x7f
+    n >>= 7
+    if n:
+      out.append(byte | 0x80)
+    else:
+      out.append(byte)
+      return bytes(out)
+
+
+def tag(number, wire_type):
+  return varint(number << 3 | wire_type)
+
+
+def delimited(number, data):
+  return tag(number, 2) + varint(len(data)) + data
+
+
+def string_field(number, s):
+  return delimited(number, s.encode('utf-8'))
+
+
+def int_field(number, n):
+  return tag(number, 0) + varint(n)
+
+
+# Schema #######################################################################
+
+
+class Schema(object):
+
+  def __init__(self, path):
+    self.name = os.path.splitext(os.path.basename(path))[0]
+    self.syntax = 'proto2'
+    self.package = ''
+    self.messages = {}  # Name -> [(label, type, name, number)]
+    self.enums = {}  # Name -> [(name, number)]
+    current = None
+    for line in open(path):
+      m = re.match(r'syntax = "(\w+)";', line)
+      if m:
+        self.syntax = m.group(1)
+      m = re.match(r'package ([\w.]+);', line)
+      if m:
+        self.package = m.group(1)
+      m = re.match(r'enum (\w+) \{(.*)\}', line)
+      if m:
+        values = re.findall(r'(\w+) = (-?\d+);', m.group(2))
+        self.enums[m.group(1)] = [(n, int(v)) for n, v in values]
+      m = re.match(r'message (\w+) \{', line)
+      if m:
+        current = self.messages.setdefault(m.group(1), [])
+      m = re.match(r'\s*(optional|required|repeated) (\w+) (\w+) = (\d+);',
+                   line)
+      if m:
+        current.append((m.group(1), m.group(2), m.group(3), int(m.group(4))))
+
+  def full_name(self, name):
+    return self.package + '.' + name if self.package else name
+
+  def kind(self, type_name):
+    if type_name in TYPES:
+      return type_name
+    if type_name in self.enums:
+      return 'enum'
+    return 'message'
+
+  def packed(self, label, kind):
+    return (label == 'repeated' and self.syntax == 'proto3' and
+            kind not in ('string', 'bytes', 'message'))
+
+  def descriptor(self):
+    """Returns the serialized FileDescriptorProto of the schema."""
+    file_proto = string_field(1, self.name + '.proto')
+    if self.package:
+      file_proto += string_field(2, self.package)
+    for name, fields in self.messages.items():
+      msg = string_field(1, name)
+      for label, type_name, field_name, number in fields:
+        kind = self.kind(type_name)
+        field = string_field(1, field_name) + int_field(3, number)
+        field += int_field(4, LABELS[label]) + int_field(5, TYPES[kind])
+        if kind in ('enum', 'message'):
+          field += string_field(6, '.' + self.full_name(type_name))
+        field += string_field(10, field_name)
+        msg += delimited(2, field)
+      file_proto += delimited(4, msg)
+    for name, values in self.enums.items():
+      enum = string_field(1, name)
+      for value_name, number in values:
+        enum += delimited(2, string_field(1, value_name) + int_field(2, number))
+      file_proto += delimited(5, enum)
+    return file_proto + string_field(12, self.syntax)
+
+
+# Payloads #####################################################################
+
+
+def random_varint(signed):
+  bits, = weighted(VARINT_BITS)
+  n = random.getrandbits(bits)
+  if signed and random.random() < 0.05:
+    n = -n
+  return n
+
+
+def random_string():
+  low, high = weighted(STRING_LENGTHS)
+  length = random.randint(low, high)
+  s = ''
+  while len(s) < length:
+    s += random.choice(WORDS) + ' '
+  return s[:length]
+
+
+def random_value(schema, kind, type_name, depth):
+  """Returns (binary, json) for one value of the given type."""
+  if kind in ('int32', 'int64', 'sint32', 'sint64'):
+    n = random_varint(signed=True)
+    bits = 32 if '32' in kind else 64
+    n = max(min(n, 2**(bits - 1) - 1), -2**(bits - 1))
+    if kind.startswith('sint'):
+      data = varint((n << 1) ^ (n >> (bits - 1)))
+    else:
+      data = varint(n)
+    return data, str(n) if bits == 32 else '"%d"' % n
+  if kind in ('uint32', 'uint64'):
+    n = random_varint(signed=False)
+    if kind == 'uint32':
+      n &= 0xffffffff
+      return varint(n), str(n)
+    return varint(n), '"%d"' % n
+  if kind == 'bool':
+    b = random.random() < 0.5
+    return varint(int(b)), 'true' if b else 'false'
+  if kind == 'enum':
+    name, number = random.choice(schema.enums[type_name])
+    return varint(number), json.dumps(name)
+  if kind in ('fixed32', 'sfixed32'):
+    n = random.getrandbits(32)
+    if kind == 'sfixed32':
+      n = struct.unpack('<i', struct.pack('<I', n))[0]
+      return struct.pack('<i', n), str(n)
+    return struct.pack('<I', n), str(n)
+  if kind in ('fixed64', 'sfixed64'):
+    n = random.getrandbits(64)
+    if kind == 'sfixed64':
+      n = struct.unpack('<q', struct.pack('<Q', n))[0]
+      return struct.pack('<q', n), '"%d"' % n
+    return struct.pack('<Q', n), '"%d"' % n
+  if kind == 'float':
+    data = struct.pack('<f', random.uniform(-1e6, 1e6))
+    return data, repr(struct.unpack('<f', data)[0])
+  if kind == 'double':
+    d = random.uniform(-1e9, 1e9)
+    return struct.pack('<d', d), repr(d)
+  if kind == 'string':
+    s = random_string()
+    return s.encode('utf-8'), json.dumps(s, ensure_ascii=False)
+  if kind == 'bytes':
+    low, high = weighted(STRING_LENGTHS)
+    b = bytes(random.getrandbits(8) for _ in range(random.randint(low, high)))
+    return b, '"%s"' % base64.b64encode(b).decode('ascii')
+  return random_message(schema, type_name, depth + 1)
+
+
+def random_message(schema, name, depth):
+  """Returns (binary, json) for a random instance of message `name`."""
+  binary = b''
+  members = []
+  submsgs = sum(1 for f in schema.messages[name]
+                if schema.kind(f[1]) == 'message')
+  for label, type_name, field_name, number in schema.messages[name]:
+    kind = schema.kind(type_name)
+    presence = PRESENCE
+    if kind == 'message':
+      if depth + 1 >= MAX_DEPTH:
+        continue
+      presence = SUBMSG_FANOUT * SUBMSG_DECAY**depth / submsgs
+    if label == 'repeated':
+      if random.random() >= presence:
+        continue
+      low, high = weighted(REPEATED_COUNTS)
+      if kind == 'message':
+        low, high = min(low, 1), min(high, 3)
+      count = random.randint(low, high)
+      if not count:
+        continue
+      values = [random_value(schema, kind, type_name, depth)
+                for _ in range(count)]
+      if schema.packed(label, kind):
+        binary += delimited(number, b''.join(v[0] for v in values))
+      else:
+        for data, _ in values:
+          binary += tag(number, WIRE_TYPES.get(kind, 0))
+          if WIRE_TYPES.get(kind) == 2:
+            binary += varint(len(data))
+          binary += data
+      members.append('"%s": [%s]' % (field_name,
+                                     ', '.join(v[1] for v in values)))
+    elif label == 'required' or random.random() < presence:
+      data, text = random_value(schema, kind, type_name, depth)
+      binary += tag(number, WIRE_TYPES.get(kind, 0))
+      if WIRE_TYPES.get(kind) == 2:
+        binary += varint(len(data))
+      binary += data
+      members.append('"%s": %s' % (field_name, text))
+  return binary, '{' + ', '.join(members) + '}'
+
+
+# Output #######################################################################
+
+
+def c_string(data):
+  """Returns `data` as a C string literal, split over several lines."""
+  lines = []
+  for i in range(0, len(data), 16):
+    lines.append('"' + ''.join('\\%03o' % b for b in data[i:i + 16]) + '"')
+  return '\n    '.join(lines) if lines else '""'
+
+
+def string_view(data):
+  return '{%s,\n     %d}' % (c_string(data), len(data))
+
+
+def main():
+  output = sys.argv[1]
+  workloads = []
+  for path in sys.argv[2:]:
+    schema = Schema(path)
+    random.seed(a=schema.name, version=2)
+    root = next(iter(schema.messages))
+    binary, text = random_message(schema, root, 0)
+    workloads.append((schema.name, schema.descriptor(),
+                      schema.full_name(root), binary, text.encode('utf-8')))
+
+  with open(output, 'w') as f:
+    f.write('// Generated by gen_synthetic_payloads.py.  DO NOT EDIT.\n\n')
+    f.write('#include "benchmarks/synthetic_payloads.h"\n\n')
+    f.write('namespace upb_benchmark {\n\n')
+    f.write('const SyntheticWorkload kSyntheticWorkloads[] = {\n')
+    for name, descriptor, message, binary, text in workloads:
+      f.write('  {"%s",\n' % name)
+      f.write('   %s,\n' % string_view(descriptor))
+      f.write('   "%s",\n' % message)
+      f.write('   %s,\n' % string_view(binary))
+      f.write('   %s},\n' % string_view(text))
+    f.write('};\n\n')
+    f.write('const size_t kSyntheticWorkloadCount = %d;\n\n' % len(workloads))
+    f.write('}  // namespace upb_benchmark\n')
+
+
+if __name__ == '__main__':
+  main()
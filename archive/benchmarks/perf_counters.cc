@@ -0,0 +1,140 @@
+// Copyright (c) 2009-2023, Google LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Google LLC nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL Google LLC BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "benchmarks/perf_counters.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace upb_benchmark {
+
+#ifdef __linux__
+
+namespace {
+
+struct Event {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr uint64_t CacheEvent(uint64_t cache, uint64_t op, uint64_t result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+// The first event leads the group; the group is only scheduled as a whole,
+// so every count covers the same interval.
+const Event kEvents[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"insts", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"L1D-misses", PERF_TYPE_HW_CACHE,
+     CacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+int OpenEvent(const Event& event, int group_fd) {
+  struct perf_event_attr attr = {};
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.disabled = group_fd == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+}  // namespace
+
+PerfCounters::PerfCounters(benchmark::State& state) : state_(state) {
+  static const bool enabled = getenv("UPB_BENCHMARK_PERF_COUNTERS") != nullptr;
+  if (!enabled) return;
+  for (const Event& event : kEvents) {
+    int fd = OpenEvent(event, fds_.empty() ? -1 : fds_[0]);
+    if (fd < 0) {
+      // An unsupported event after the leader just drops out of the group.
+      if (!fds_.empty()) continue;
+      static bool warned = false;
+      if (!warned) {
+        fprintf(stderr, "perf_event_open() failed; not counting events.\n");
+        warned = true;
+      }
+      return;
+    }
+    fds_.push_back(fd);
+    names_.push_back(event.name);
+  }
+  ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfCounters::~PerfCounters() {
+  if (fds_.empty()) return;
+  ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  // With PERF_FORMAT_GROUP: the number of events, then one count per event.
+  std::vector<uint64_t> values(1 + fds_.size());
+  ssize_t n = read(fds_[0], values.data(), values.size() * sizeof(uint64_t));
+  for (int fd : fds_) close(fd);
+  if (n != static_cast<ssize_t>(values.size() * sizeof(uint64_t))) return;
+
+  double bytes = 0;
+  double cycles = 0;
+  double insts = 0;
+  auto it = state_.counters.find("bytes_per_second");
+  if (it != state_.counters.end()) bytes = it->second.value;
+  for (size_t i = 0; i < names_.size(); i++) {
+    double count = static_cast<double>(values[1 + i]);
+    if (kEvents[0].name == names_[i]) cycles = count;
+    if (kEvents[1].name == names_[i]) insts = count;
+    if (bytes > 0) {
+      state_.counters[std::string(names_[i]) + "/B"] = count / bytes;
+    } else {
+      state_.counters[names_[i]] =
+          benchmark::Counter(count, benchmark::Counter::kAvgIterations);
+    }
+  }
+  if (cycles > 0 && insts > 0) state_.counters["IPC"] = insts / cycles;
+}
+
+#else  // !__linux__
+
+PerfCounters::PerfCounters(benchmark::State& state) : state_(state) {}
+PerfCounters::~PerfCounters() {}
+
+#endif
+
+}  // namespace upb_benchmark
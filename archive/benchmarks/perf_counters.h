@@ -0,0 +1,67 @@
+// Copyright (c) 2009-2023, Google LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Google LLC nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL Google LLC BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_BENCHMARKS_PERF_COUNTERS_H_
+#define UPB_BENCHMARKS_PERF_COUNTERS_H_
+
+#include <benchmark/benchmark.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace upb_benchmark {
+
+// Counts hardware events (instructions, cycles, branch misses, L1D and LLC
+// misses) from construction to destruction and reports them as user
+// counters: per byte if the benchmark called SetBytesProcessed(), per
+// iteration otherwise, plus IPC.  Construct it just before the timing loop:
+//
+//   upb_benchmark::PerfCounters perf(state);
+//   for (auto _ : state) {
+//     ...
+//   }
+//   state.SetBytesProcessed(...);
+//
+// Counting is off unless UPB_BENCHMARK_PERF_COUNTERS is set in the
+// environment, and is silently skipped where perf_event_open() is not
+// available or not permitted.  Only the calling thread is counted.
+class PerfCounters {
+ public:
+  explicit PerfCounters(benchmark::State& state);
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+ private:
+  benchmark::State& state_;
+  std::vector<int> fds_;            // fds_[0] leads the group.
+  std::vector<const char*> names_;  // Parallel to fds_.
+};
+
+}  // namespace upb_benchmark
+
+#endif  // UPB_BENCHMARKS_PERF_COUNTERS_H_
@@ -0,0 +1,77 @@
+#!/usr/bin/python3
+#
+# Protocol Buffers - Google's data interchange format
+# Copyright 2023 Google LLC.  All rights reserved.
+# https://developers.google.com/protocol-buffers/
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above
+# copyright notice, this list of conditions and the following disclaimer
+# in the documentation and/or other materials provided with the
+# distribution.
+#     * Neither the name of Google LLC nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Reports how multi-threaded benchmarks scale with the thread count.
+
+Usage:
+  benchmark --benchmark_filter=Threaded --benchmark_out=out.json
+  scaling.py out.json
+
+For every benchmark run at several thread counts, prints the aggregate
+throughput at each count and its efficiency: the throughput per thread as a
+fraction of the single-threaded throughput.  Perfect scaling is 100%; a drop
+as threads are added points at contention.
+"""
+
+import collections
+import json
+import re
+import sys
+
+
+def main():
+  with open(sys.argv[1]) as f:
+    runs = json.load(f)['benchmarks']
+
+  # Name without "/threads:N" -> {N: bytes per second}
+  results = collections.OrderedDict()
+  for run in runs:
+    if run.get('run_type') == 'aggregate':
+      continue
+    m = re.match(r'(.*?)(?:/real_time)?/threads:(\d+)$', run['name'])
+    if not m or 'bytes_per_second' not in run:
+      continue
+    results.setdefault(m.group(1), {})[int(m.group(2))] = (
+        run['bytes_per_second'])
+
+  for name, by_threads in results.items():
+    print(name)
+    base = by_threads.get(1)
+    for threads, rate in sorted(by_threads.items()):
+      line = '  threads:%-3d %10.1f MB/s' % (threads, rate / 1e6)
+      if base:
+        line += '  efficiency %5.1f%%' % (100 * rate / (threads * base))
+      print(line)
+
+
+if __name__ == '__main__':
+  main()
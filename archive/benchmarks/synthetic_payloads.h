@@ -0,0 +1,52 @@
+// Copyright (c) 2009-2023, Google LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Google LLC nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL Google LLC BE LIABLE FOR ANY DIRECT,
+// INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_BENCHMARKS_SYNTHETIC_PAYLOADS_H_
+#define UPB_BENCHMARKS_SYNTHETIC_PAYLOADS_H_
+
+#include <stddef.h>
+
+#include "upb/base/string_view.h"
+
+namespace upb_benchmark {
+
+// One message for a schema from gen_synthetic_protos.py, as written by
+// gen_synthetic_payloads.py.  The schema is carried as a descriptor so that
+// several of them, which all define upb_benchmark.Message, can be loaded into
+// separate DefPools in one binary.
+struct SyntheticWorkload {
+  const char* name;           // Schema basename, eg. "100_fields".
+  upb_StringView descriptor;  // Serialized FileDescriptorProto.
+  const char* message;        // Full name of the payload's message type.
+  upb_StringView binary;      // The payload in the binary wire format.
+  upb_StringView json;        // The same payload as JSON.
+};
+
+extern const SyntheticWorkload kSyntheticWorkloads[];
+extern const size_t kSyntheticWorkloadCount;
+
+}  // namespace upb_benchmark
+
+#endif  // UPB_BENCHMARKS_SYNTHETIC_PAYLOADS_H_
@@ -326,6 +326,21 @@ const upb_MessageDef* lupb_MessageDef_check(lua_State* L, int narg) {
   return lupb_wrapper_check(L, narg, LUPB_MSGDEF);
 }
 
+/* Msgdef wrappers have a second userval: a table that msg.c uses to cache
+ * per-type data, created on first use. */
+#define LUPB_MSGDEF_CACHE_INDEX 2
+
+void lupb_MessageDef_pushcache(lua_State* L, int narg) {
+  narg = lua_absindex(L, narg);
+  lua_getiuservalue(L, narg, LUPB_MSGDEF_CACHE_INDEX);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setiuservalue(L, narg, LUPB_MSGDEF_CACHE_INDEX);
+  }
+}
+
 static int lupb_MessageDef_FieldCount(lua_State* L) {
   const upb_MessageDef* m = lupb_MessageDef_check(L, 1);
   lua_pushinteger(L, upb_MessageDef_FieldCount(m));
@@ -738,7 +753,8 @@ void lupb_DefPool_pushwrapper(lua_State* L, int narg, const void* def,
   /* Stack is now: cache, cached value. */
   if (lua_isnil(L, -1)) {
     /* Create new wrapper. */
-    lupb_wrapper* w = lupb_newuserdata(L, sizeof(*w), 1, type);
+    int n = strcmp(type, LUPB_MSGDEF) == 0 ? 2 : 1;
+    lupb_wrapper* w = lupb_newuserdata(L, sizeof(*w), n, type);
     w->def = def;
     lua_replace(L, -2); /* Replace nil */
 
@@ -43,6 +43,7 @@
 #include "upb/collections/map.h"
 #include "upb/json/decode.h"
 #include "upb/json/encode.h"
+#include "upb/message/accessors.h"
 #include "upb/message/message.h"
 #include "upb/port/def.inc"
 #include "upb/reflection/message.h"
@@ -197,6 +198,11 @@ typedef struct {
   upb_Arena* arena;
 } lupb_Arena;
 
+/* The arena's userval is a set of the Lua values that its data aliases, such
+ * as the strings that upb.decode() was asked to alias, or nil if there are
+ * none. */
+#define LUPB_ARENA_REFS_INDEX 1
+
 static upb_Arena* lupb_Arena_check(lua_State* L, int narg) {
   lupb_Arena* a = luaL_checkudata(L, narg, LUPB_ARENA);
   return a->arena;
@@ -213,10 +219,42 @@ upb_Arena* lupb_Arena_pushnew(lua_State* L) {
  *
  * Merges |from| into |to| so that there is a single arena group that contains
  * both, and both arenas will point at this new table. */
+/* lupb_Arena_keepalive()
+ *
+ * Keeps the value at |narg| alive for as long as the arena at |arena|.
+ */
+static void lupb_Arena_keepalive(lua_State* L, int arena, int narg) {
+  arena = lua_absindex(L, arena);
+  narg = lua_absindex(L, narg);
+  lua_getiuservalue(L, arena, LUPB_ARENA_REFS_INDEX);
+  if (lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setiuservalue(L, arena, LUPB_ARENA_REFS_INDEX);
+  }
+  lua_pushvalue(L, narg);
+  lua_pushboolean(L, 1);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+/* If the arena at |other| aliases any Lua values, keeps it alive for as long
+ * as the arena at |arena|, since their data may now reference each other. */
+static void lupb_Arena_keepaliverefs(lua_State* L, int arena, int other) {
+  bool has_refs;
+  lua_getiuservalue(L, other, LUPB_ARENA_REFS_INDEX);
+  has_refs = !lua_isnil(L, -1);
+  lua_pop(L, 1);
+  if (has_refs) lupb_Arena_keepalive(L, arena, other);
+}
+
 static void lupb_Arena_Fuse(lua_State* L, int to, int from) {
   upb_Arena* to_arena = lupb_Arena_check(L, to);
   upb_Arena* from_arena = lupb_Arena_check(L, from);
   upb_Arena_Fuse(to_arena, from_arena);
+  lupb_Arena_keepaliverefs(L, to, from);
+  lupb_Arena_keepaliverefs(L, from, to);
 }
 
 static void lupb_Arena_Fuseobjs(lua_State* L, int to, int from) {
@@ -656,20 +694,64 @@ static const upb_MessageDef* lupb_Message_Getmsgdef(lua_State* L, int msg) {
   return m;
 }
 
-static const upb_FieldDef* lupb_msg_tofield(lua_State* L, int msg, int field) {
+/* What field access needs to know about a field.  These are cached by field
+ * name in the msgdef wrapper's cache table, so that after the first access
+ * to a field __index and __newindex neither look it up in upb nor query its
+ * upb_FieldDef. */
+typedef struct {
+  const upb_FieldDef* f;
+  const upb_MiniTableField* field;
+  upb_MessageValue default_val;
+  upb_CType type;
+  bool is_scalar; /* Neither repeated nor a submessage. */
+} lupb_FieldInfo;
+
+static const lupb_FieldInfo* lupb_msg_tofield(lua_State* L, int msg,
+                                              int field) {
   size_t len;
   const char* fieldname = luaL_checklstring(L, field, &len);
-  const upb_MessageDef* m = lupb_Message_Getmsgdef(L, msg);
-  return upb_MessageDef_FindFieldByNameWithSize(m, fieldname, len);
+  const lupb_FieldInfo* info;
+
+  lua_getiuservalue(L, msg, LUPB_MSGDEF_INDEX);
+  lupb_MessageDef_pushcache(L, -1);
+  lua_pushvalue(L, field);
+  lua_rawget(L, -2);
+
+  if (lua_isnil(L, -1)) {
+    const upb_MessageDef* m = lupb_MessageDef_check(L, -3);
+    const upb_FieldDef* f =
+        upb_MessageDef_FindFieldByNameWithSize(m, fieldname, len);
+    lupb_FieldInfo* new_info;
+    if (f == NULL) {
+      lua_pop(L, 3);
+      return NULL;
+    }
+    lua_pop(L, 1);
+    new_info = lua_newuserdata(L, sizeof(*new_info));
+    new_info->f = f;
+    new_info->field = upb_FieldDef_MiniTable(f);
+    new_info->default_val = upb_FieldDef_Default(f);
+    new_info->type = upb_FieldDef_CType(f);
+    new_info->is_scalar =
+        !upb_FieldDef_IsRepeated(f) && !upb_FieldDef_IsSubMessage(f);
+    lua_pushvalue(L, field);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -4);
+  }
+
+  /* The msgdef wrapper, which |msg| references, keeps the info alive. */
+  info = lua_touserdata(L, -1);
+  lua_pop(L, 3);
+  return info;
 }
 
-static const upb_FieldDef* lupb_msg_checkfield(lua_State* L, int msg,
-                                               int field) {
-  const upb_FieldDef* f = lupb_msg_tofield(L, msg, field);
-  if (f == NULL) {
+static const lupb_FieldInfo* lupb_msg_checkfield(lua_State* L, int msg,
+                                                 int field) {
+  const lupb_FieldInfo* info = lupb_msg_tofield(L, msg, field);
+  if (info == NULL) {
     luaL_error(L, "no such field '%s'", lua_tostring(L, field));
   }
-  return f;
+  return info;
 }
 
 upb_Message* lupb_msg_pushnew(lua_State* L, int narg) {
@@ -816,19 +898,21 @@ int lupb_MessageDef_call(lua_State* L) {
  */
 static int lupb_msg_index(lua_State* L) {
   upb_Message* msg = lupb_msg_check(L, 1);
-  const upb_FieldDef* f = lupb_msg_checkfield(L, 1, 2);
+  const lupb_FieldInfo* info = lupb_msg_checkfield(L, 1, 2);
+  const upb_FieldDef* f = info->f;
 
-  if (upb_FieldDef_IsRepeated(f) || upb_FieldDef_IsSubMessage(f)) {
+  if (info->is_scalar) {
+    /* Value type, just push value and return .*/
+    upb_MessageValue val;
+    _upb_Message_GetField(msg, info->field, &info->default_val, &val);
+    lupb_pushmsgval(L, 0, info->type, val);
+  } else {
     /* Wrapped type; get or create wrapper. */
     upb_Arena* arena = upb_FieldDef_IsRepeated(f) ? lupb_Arenaget(L, 1) : NULL;
     upb_MutableMessageValue val = upb_Message_Mutable(msg, f, arena);
     if (!lupb_cacheget(L, val.msg)) {
       lupb_Message_Newwrapper(L, 1, f, val);
     }
-  } else {
-    /* Value type, just push value and return .*/
-    upb_MessageValue val = upb_Message_GetFieldByDef(msg, f);
-    lupb_pushmsgval(L, 0, upb_FieldDef_CType(f), val);
   }
 
   return 1;
@@ -844,11 +928,16 @@ static int lupb_msg_index(lua_State* L) {
  */
 static int lupb_Message_Newindex(lua_State* L) {
   upb_Message* msg = lupb_msg_check(L, 1);
-  const upb_FieldDef* f = lupb_msg_checkfield(L, 1, 2);
+  const lupb_FieldInfo* info = lupb_msg_checkfield(L, 1, 2);
+  const upb_FieldDef* f = info->f;
   upb_MessageValue msgval;
-  bool merge_arenas = true;
 
-  if (upb_FieldDef_IsMap(f)) {
+  if (info->is_scalar) {
+    msgval = lupb_tomsgval(L, info->type, 3, 1, LUPB_COPY);
+    _upb_Message_SetField(msg, info->field, &msgval, lupb_Arenaget(L, 1));
+    lua_pushvalue(L, 3);
+    return 1;
+  } else if (upb_FieldDef_IsMap(f)) {
     lupb_map* lmap = lupb_map_check(L, 3);
     const upb_MessageDef* entry = upb_FieldDef_MessageSubDef(f);
     const upb_FieldDef* key_f =
@@ -875,14 +964,9 @@ static int lupb_Message_Newindex(lua_State* L) {
     upb_Message* msg = lupb_msg_check(L, 3);
     lupb_msg_typechecksubmsg(L, 3, 1, f);
     msgval.msg_val = msg;
-  } else {
-    msgval = lupb_tomsgval(L, upb_FieldDef_CType(f), 3, 1, LUPB_COPY);
-    merge_arenas = false;
   }
 
-  if (merge_arenas) {
-    lupb_Arena_Fuseobjs(L, 1, 3);
-  }
+  lupb_Arena_Fuseobjs(L, 1, 3);
 
   upb_Message_SetFieldByDef(msg, f, msgval, lupb_Arenaget(L, 1));
 
@@ -944,33 +1028,100 @@ static int lupb_getoptions(lua_State* L, int narg) {
   return options;
 }
 
+/* lupb_decodeinto()
+ *
+ * Decodes the string at |narg| into |msg|, which is the message at the top of
+ * the stack.  With kUpb_DecodeOption_AliasString, strings in the message point
+ * into the Lua string, which the message's arena then keeps alive.  Otherwise
+ * the input is copied into the arena, and the message references the copy.
+ */
+static void lupb_decodeinto(lua_State* L, int narg, upb_Message* msg,
+                            const upb_MiniTable* layout, int options) {
+  size_t len;
+  const char* pb = luaL_checklstring(L, narg, &len);
+  upb_Arena* arena;
+  upb_DecodeStatus status;
+
+  narg = lua_absindex(L, narg);
+  lua_getiuservalue(L, -1, LUPB_ARENA_INDEX);
+  arena = lupb_Arena_check(L, -1);
+  if (options & kUpb_DecodeOption_AliasString) {
+    lupb_Arena_keepalive(L, -1, narg);
+  } else {
+    char* buf = upb_Arena_Malloc(arena, len);
+    memcpy(buf, pb, len);
+    pb = buf;
+  }
+  lua_pop(L, 1);
+
+  status = upb_Decode(pb, len, msg, layout, NULL,
+                      options | kUpb_DecodeOption_AliasString, arena);
+
+  if (status != kUpb_DecodeStatus_Ok) {
+    lua_pushstring(L, "Error decoding protobuf.");
+    lua_error(L);
+  }
+}
+
 /**
  * lupb_decode()
  *
  * Handles:
  *   msg = upb.decode(MessageClass, bin_string)
+ *   msg = upb.decode(MessageClass, bin_string, {upb.DECODE_ALIAS})
  */
 static int lupb_decode(lua_State* L) {
-  size_t len;
   const upb_MessageDef* m = lupb_MessageDef_check(L, 1);
-  const char* pb = lua_tolstring(L, 2, &len);
   const upb_MiniTable* layout = upb_MessageDef_MiniTable(m);
-  upb_Message* msg = lupb_msg_pushnew(L, 1);
-  upb_Arena* arena = lupb_Arenaget(L, -1);
-  char* buf;
-
-  /* Copy input data to arena, message will reference it. */
-  buf = upb_Arena_Malloc(arena, len);
-  memcpy(buf, pb, len);
+  int options = lupb_getoptions(L, 3);
+  upb_Message* msg;
 
-  upb_DecodeStatus status = upb_Decode(buf, len, msg, layout, NULL,
-                                       kUpb_DecodeOption_AliasString, arena);
+  luaL_checkstring(L, 2);
+  lua_settop(L, 2);
+  msg = lupb_msg_pushnew(L, 1);
+  lupb_decodeinto(L, 2, msg, layout, options);
+  return 1;
+}
 
-  if (status != kUpb_DecodeStatus_Ok) {
-    lua_pushstring(L, "Error decoding protobuf.");
-    return lua_error(L);
+/**
+ * lupb_decodemany()
+ *
+ * Handles:
+ *   msgs = upb.decode_many(MessageClass, {bin_string, ...})
+ *   msgs = upb.decode_many(MessageClass, {bin_string, ...}, {upb.DECODE_ALIAS})
+ *
+ * All of the messages share one arena, which saves creating one per message.
+ */
+static int lupb_decodemany(lua_State* L) {
+  const upb_MessageDef* m = lupb_MessageDef_check(L, 1);
+  const upb_MiniTable* layout = upb_MessageDef_MiniTable(m);
+  int options = lupb_getoptions(L, 3);
+  upb_Arena* arena;
+  size_t i, n;
+
+  luaL_checktype(L, 2, LUA_TTABLE);
+  n = lua_rawlen(L, 2);
+  lua_settop(L, 2);
+  lua_createtable(L, n, 0); /* 3: the results. */
+  arena = lupb_Arena_pushnew(L); /* 4: their arena. */
+
+  for (i = 1; i <= n; i++) {
+    lupb_Message* lmsg = lupb_newuserdata(L, sizeof(*lmsg), 2, LUPB_MSG);
+    lua_pushvalue(L, 4);
+    lua_setiuservalue(L, -2, LUPB_ARENA_INDEX);
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, LUPB_MSGDEF_INDEX);
+    lmsg->msg = upb_Message_New(layout, arena);
+    lupb_cacheset(L, lmsg->msg);
+
+    lua_rawgeti(L, 2, i);
+    lua_insert(L, -2);
+    lupb_decodeinto(L, -2, lmsg->msg, layout, options);
+    lua_rawseti(L, 3, i);
+    lua_pop(L, 1); /* Pop the string. */
   }
 
+  lua_settop(L, 3);
   return 1;
 }
 
@@ -1090,9 +1241,10 @@ static void lupb_setfieldi(lua_State* L, const char* field, int i) {
 
 static const struct luaL_Reg lupb_msg_toplevel_m[] = {
     {"Array", lupb_Array_New},        {"Map", lupb_Map_New},
-    {"decode", lupb_decode},          {"encode", lupb_Encode},
-    {"json_decode", lupb_jsondecode}, {"json_encode", lupb_jsonencode},
-    {"text_encode", lupb_textencode}, {NULL, NULL}};
+    {"decode", lupb_decode},          {"decode_many", lupb_decodemany},
+    {"encode", lupb_Encode},          {"json_decode", lupb_jsondecode},
+    {"json_encode", lupb_jsonencode}, {"text_encode", lupb_textencode},
+    {NULL, NULL}};
 
 void lupb_msg_registertypes(lua_State* L) {
   lupb_setfuncs(L, lupb_msg_toplevel_m);
@@ -1106,6 +1258,8 @@ void lupb_msg_registertypes(lua_State* L) {
   lupb_setfieldi(L, "TXTENC_SKIPUNKNOWN", UPB_TXTENC_SKIPUNKNOWN);
   lupb_setfieldi(L, "TXTENC_NOSORT", UPB_TXTENC_NOSORT);
 
+  lupb_setfieldi(L, "DECODE_ALIAS", kUpb_DecodeOption_AliasString);
+
   lupb_setfieldi(L, "ENCODE_DETERMINISTIC", kUpb_EncodeOption_Deterministic);
   lupb_setfieldi(L, "ENCODE_SKIPUNKNOWN", kUpb_EncodeOption_SkipUnknown);
 
@@ -316,6 +316,48 @@ function test_msg_string_map()
   assert_equal("quux", msg2.map_string_string["baz"])
 end
 
+function test_decode_alias()
+  local src = test_messages_proto3.TestAllTypesProto3{optional_string = "abc"}
+  src.optional_nested_message.corecursive.optional_string = "xyz"
+  local serialized = upb.encode(src)
+  local msg = upb.decode(test_messages_proto3.TestAllTypesProto3, serialized,
+                         {upb.DECODE_ALIAS})
+  serialized = nil
+  collectgarbage()
+  assert_equal("abc", msg.optional_string)
+
+  -- Fusing arenas keeps the aliased string alive through either of them.
+  local msg2 = test_messages_proto3.TestAllTypesProto3()
+  msg2.optional_nested_message = msg.optional_nested_message
+  msg2.optional_string = "def"
+  msg = nil
+  collectgarbage()
+  assert_equal("xyz", msg2.optional_nested_message.corecursive.optional_string)
+end
+
+function test_decode_many()
+  local strs = {}
+  for i = 1, 3 do
+    strs[i] = upb.encode(test_messages_proto3.TestAllTypesProto3{
+      optional_int32 = i,
+      optional_string = tostring(i),
+    })
+  end
+  for _, options in ipairs({{}, {upb.DECODE_ALIAS}}) do
+    local msgs = upb.decode_many(test_messages_proto3.TestAllTypesProto3, strs,
+                                 options)
+    assert_equal(3, #msgs)
+    for i = 1, 3 do
+      assert_equal(i, msgs[i].optional_int32)
+      assert_equal(tostring(i), msgs[i].optional_string)
+    end
+  end
+  assert_equal(0, #upb.decode_many(test_messages_proto3.TestAllTypesProto3, {}))
+  assert_error_match("Error decoding protobuf", function()
+    upb.decode_many(test_messages_proto3.TestAllTypesProto3, {strs[1], "\255"})
+  end)
+end
+
 function test_msg_array()
   msg = test_messages_proto3.TestAllTypesProto3()
 
@@ -518,6 +560,24 @@ function test_msg_primitives()
   assert_equal(123, msg.optional_nested_message.a)
 end
 
+function test_msg_field_cache()
+  -- Fields are cached by name per message type, so the same name must still
+  -- resolve separately in each type.
+  local msg = test_messages_proto3.TestAllTypesProto3{optional_int32 = 5}
+  local nested = test_messages_proto3['TestAllTypesProto3.NestedMessage']{a = 7}
+  assert_equal(5, msg.optional_int32)
+  assert_equal(7, nested.a)
+  assert_error_match("no such field", function() return nested.optional_int32 end)
+  assert_error_match("no such field", function() return msg.a end)
+
+  local msg2 = test_messages_proto3.TestAllTypesProto3()
+  assert_equal(0, msg2.optional_int32)
+  assert_equal("", msg2.optional_string)
+  msg2.optional_int32 = 6
+  assert_equal(6, msg2.optional_int32)
+  assert_equal(5, msg.optional_int32)
+end
+
 
 function test_string_array()
   local function test_for_string_type(upb_type)
@@ -102,6 +102,9 @@ const upb_FieldDef* lupb_FieldDef_check(lua_State* L, int narg);
 upb_DefPool* lupb_DefPool_check(lua_State* L, int narg);
 void lupb_MessageDef_pushsubmsgdef(lua_State* L, const upb_FieldDef* f);
 
+/* Pushes the per-type cache table of the msgdef wrapper at |narg|. */
+void lupb_MessageDef_pushcache(lua_State* L, int narg);
+
 void lupb_def_registertypes(lua_State* L);
 
 /** From msg.c. ***************************************************************/
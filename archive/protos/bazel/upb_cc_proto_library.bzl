@@ -270,6 +270,7 @@ _upb_cc_proto_library_aspect = aspect(
                 "@com_google_absl//absl/strings",
                 "@com_google_absl//absl/status:statusor",
                 "//protos",
+                "//protos:map_field",
                 "//protos:repeated_field",
             ],
         ),
@@ -0,0 +1,208 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_PROTOS_MAP_FIELD_H_
+#define UPB_PROTOS_MAP_FIELD_H_
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "protos/protos.h"
+#include "upb/collections/map.h"
+#include "upb/mem/arena.h"
+#include "upb/message/accessors.h"
+#include "upb/message/copy.h"
+#include "upb/mini_table/message.h"
+
+// Must be last:
+#include "upb/port/def.inc"
+
+namespace protos {
+namespace internal {
+
+// Converts map keys and values between upb_MessageValue and the types used by
+// the generated map accessors.  Scalars and enums have the same layout as the
+// upb_MessageValue member that holds them.
+template <typename T>
+struct MapValueConverter {
+  static T FromUpb(upb_MessageValue val, upb_Arena* arena) {
+    T ret;
+    memcpy(&ret, &val, sizeof(ret));
+    return ret;
+  }
+  static upb_MessageValue KeyToUpb(T key) {
+    upb_MessageValue ret;
+    memcpy(&ret, &key, sizeof(key));
+    return ret;
+  }
+  static bool ValueToUpb(T value, upb_Arena* arena, upb_MessageValue* out) {
+    *out = KeyToUpb(value);
+    return true;
+  }
+};
+
+template <>
+struct MapValueConverter<absl::string_view> {
+  static absl::string_view FromUpb(upb_MessageValue val, upb_Arena* arena) {
+    return UpbStrToStringView(val.str_val);
+  }
+  // The map copies string keys itself.
+  static upb_MessageValue KeyToUpb(absl::string_view key) {
+    upb_MessageValue ret;
+    ret.str_val = upb_StringView_FromDataAndSize(key.data(), key.size());
+    return ret;
+  }
+  static bool ValueToUpb(absl::string_view value, upb_Arena* arena,
+                         upb_MessageValue* out) {
+    out->str_val = UpbStrFromStringView(value, arena);
+    return out->str_val.data != nullptr || value.empty();
+  }
+};
+
+template <typename T>
+struct MapValueConverter<Ptr<const T>> {
+  static Ptr<const T> FromUpb(upb_MessageValue val, upb_Arena* arena) {
+    return CreateMessage<T>((upb_Message*)val.msg_val, arena);
+  }
+  static bool ValueToUpb(Ptr<const T> value, upb_Arena* arena,
+                         upb_MessageValue* out) {
+    out->msg_val = upb_Message_DeepClone(PrivateAccess::GetInternalMsg(value),
+                                         T::minitable(), arena);
+    return out->msg_val != nullptr;
+  }
+};
+
+// Iterates over the entries of a map field, yielding (key, value) pairs.
+// Inserting into or removing from the map invalidates the iterator.
+template <typename K, typename V>
+class MapFieldIterator {
+ public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = std::pair<K, V>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = void;
+  using reference = value_type;
+
+  MapFieldIterator() = default;
+  MapFieldIterator(const upb_Map* map, upb_Arena* arena)
+      : map_(map), arena_(arena) {
+    Advance();
+  }
+
+  reference operator*() const {
+    return {MapValueConverter<K>::FromUpb(key_, arena_),
+            MapValueConverter<V>::FromUpb(val_, arena_)};
+  }
+
+  MapFieldIterator& operator++() {
+    Advance();
+    return *this;
+  }
+
+  MapFieldIterator operator++(int) {
+    MapFieldIterator ret = *this;
+    Advance();
+    return ret;
+  }
+
+  friend bool operator==(const MapFieldIterator& a, const MapFieldIterator& b) {
+    return a.map_ == b.map_ && (a.map_ == nullptr || a.iter_ == b.iter_);
+  }
+  friend bool operator!=(const MapFieldIterator& a, const MapFieldIterator& b) {
+    return !(a == b);
+  }
+
+ private:
+  void Advance() {
+    if (!upb_Map_Next(map_, &key_, &val_, &iter_)) map_ = nullptr;
+  }
+
+  // nullptr once the iterator reaches the end.
+  const upb_Map* map_ = nullptr;
+  upb_Arena* arena_ = nullptr;
+  size_t iter_ = kUpb_Map_Begin;
+  upb_MessageValue key_;
+  upb_MessageValue val_;
+};
+
+// The entries of a map field, as returned by the generated accessor, for use
+// in range-based for loops.  `map` may be null for a map that was never set.
+template <typename K, typename V>
+class MapFieldRange {
+ public:
+  using iterator = MapFieldIterator<K, V>;
+
+  MapFieldRange(const upb_Map* map, upb_Arena* arena)
+      : map_(map), arena_(arena) {}
+
+  iterator begin() const {
+    return map_ != nullptr ? iterator(map_, arena_) : end();
+  }
+  iterator end() const { return iterator(); }
+
+  size_t size() const { return map_ != nullptr ? upb_Map_Size(map_) : 0; }
+  bool empty() const { return size() == 0; }
+
+ private:
+  const upb_Map* map_;
+  upb_Arena* arena_;
+};
+
+// Inserts all of `entries` into `map`, replacing the values of keys that are
+// already present.  Room for the new entries is reserved up front.  Returns
+// false if an allocation fails, in which case some entries may be inserted.
+template <typename K, typename V>
+bool InsertMapEntries(upb_Map* map, absl::Span<const std::pair<K, V>> entries,
+                      upb_Arena* arena) {
+  if (map == nullptr ||
+      !upb_Map_Reserve(map, upb_Map_Size(map) + entries.size(), arena)) {
+    return false;
+  }
+  for (const auto& entry : entries) {
+    upb_MessageValue val;
+    if (!MapValueConverter<V>::ValueToUpb(entry.second, arena, &val) ||
+        upb_Map_Insert(map, MapValueConverter<K>::KeyToUpb(entry.first), val,
+                       arena) == kUpb_MapInsertStatus_OutOfMemory) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace internal
+}  // namespace protos
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_PROTOS_MAP_FIELD_H_
@@ -32,15 +32,20 @@
 
 #include <atomic>
 #include <cstddef>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "protos/protos_extension_lock.h"
 #include "upb/mem/arena.h"
 #include "upb/message/copy.h"
 #include "upb/message/internal/extension.h"
+#include "upb/message/message.h"
 #include "upb/message/promote.h"
 #include "upb/mini_table/extension.h"
 #include "upb/mini_table/extension_registry.h"
@@ -104,6 +109,31 @@ absl::Status MessageDecodeError(upb_DecodeStatus status, SourceLocation loc
 
 namespace internal {
 
+const ExtensionRegistry* NewGeneratedExtensionRegistry(
+    const ExtensionFile& file) {
+  // Each registry gets an arena of its own, so that registries for different
+  // files can be built on different threads at once.
+  const upb::Arena* arena = new upb::Arena;
+  upb_ExtensionRegistry* registry = upb_ExtensionRegistry_New(arena->ptr());
+  if (!registry) return new ExtensionRegistry(nullptr);
+  std::unordered_set<const ExtensionFile*> seen;
+  std::vector<const ExtensionFile*> stack = {&file};
+  while (!stack.empty()) {
+    const ExtensionFile* f = stack.back();
+    stack.pop_back();
+    if (!seen.insert(f).second) continue;
+    // const_cast: upb_ExtensionRegistry_AddArray() does not modify the array.
+    if (!upb_ExtensionRegistry_AddArray(
+            registry, const_cast<const upb_MiniTableExtension**>(f->extensions),
+            f->extension_count)) {
+      return new ExtensionRegistry(nullptr);
+    }
+    stack.insert(stack.end(), f->deps, f->deps + f->dep_count);
+  }
+  if (!upb_ExtensionRegistry_Freeze(registry)) registry = nullptr;
+  return new ExtensionRegistry(registry);
+}
+
 upb_ExtensionRegistry* GetUpbExtensions(
     const ExtensionRegistry& extension_registry) {
   return extension_registry.registry_;
@@ -111,14 +141,16 @@ upb_ExtensionRegistry* GetUpbExtensions(
 
 /**
  * MessageLock(msg) acquires lock on msg when constructed and releases it when
- * destroyed.
+ * destroyed.  Frozen messages are never modified, not even by extension
+ * promotion, so they are read without taking the lock.
  */
 class MessageLock {
  public:
-  explicit MessageLock(const upb_Message* msg) : msg_(msg) {
+  explicit MessageLock(const upb_Message* msg) : msg_(msg), unlocker_(nullptr) {
+    if (upb_Message_IsFrozen(msg)) return;
     UpbExtensionLocker locker =
         upb_extension_locker_global.load(std::memory_order_acquire);
-    unlocker_ = (locker != nullptr) ? locker(msg) : nullptr;
+    if (locker != nullptr) unlocker_ = locker(msg);
   }
   MessageLock(const MessageLock&) = delete;
   void operator=(const MessageLock&) = delete;
@@ -170,6 +202,60 @@ absl::StatusOr<absl::string_view> Serialize(const upb_Message* message,
   return MessageEncodeError(status);
 }
 
+absl::StatusOr<absl::string_view> Serialize(const upb_Message* message,
+                                            const upb_MiniTable* mini_table,
+                                            absl::Span<char> buffer,
+                                            int options) {
+  MessageLock msg_lock(message);
+  size_t len;
+  upb_EncodeStatus status = upb_EncodeToBuffer(
+      message, mini_table, options, buffer.data(), buffer.size(), &len);
+  if (status == kUpb_EncodeStatus_Ok) {
+    return absl::string_view(buffer.data(), len);
+  }
+  return MessageEncodeError(status);
+}
+
+absl::Status Serialize(const upb_Message* message,
+                       const upb_MiniTable* mini_table, std::string* output,
+                       int options) {
+  MessageLock msg_lock(message);
+  size_t len;
+  output->resize(output->capacity());
+  upb_EncodeStatus status = upb_EncodeToBuffer(
+      message, mini_table, options, output->data(), output->size(), &len);
+  if (status == kUpb_EncodeStatus_NeedMoreSpace) {
+    output->resize(len);
+    status = upb_EncodeToBuffer(message, mini_table, options, output->data(),
+                                output->size(), &len);
+  }
+  if (status != kUpb_EncodeStatus_Ok) {
+    output->clear();
+    return MessageEncodeError(status);
+  }
+  output->resize(len);
+  return absl::OkStatus();
+}
+
+ArenaPool::~ArenaPool() {
+  for (upb_Arena* arena : free_) upb_Arena_Free(arena);
+}
+
+upb_Arena* ArenaPool::Acquire() {
+  if (free_.empty()) return upb_Arena_New();
+  upb_Arena* arena = free_.back();
+  free_.pop_back();
+  return arena;
+}
+
+void ArenaPool::Release(upb_Arena* arena) {
+  if (free_.size() < max_free_ && upb_Arena_Reset(arena)) {
+    free_.push_back(arena);
+  } else {
+    upb_Arena_Free(arena);
+  }
+}
+
 void DeepCopy(upb_Message* target, const upb_Message* source,
               const upb_MiniTable* mini_table, upb_Arena* arena) {
   MessageLock msg_lock(source);
@@ -182,6 +268,20 @@ upb_Message* DeepClone(const upb_Message* source,
   return upb_Message_DeepClone(source, mini_table, arena);
 }
 
+bool MergeFrom(upb_Message* target, const upb_Message* source,
+               const upb_MiniTable* mini_table, upb_Arena* arena) {
+  MessageLock msg_lock(source);
+  return upb_Message_Merge(target, source, mini_table, arena);
+}
+
+upb_Message* AdoptMessage(upb_Message* message, const upb_MiniTable* mini_table,
+                          upb_Arena* message_arena, upb_Arena* arena) {
+  if (message_arena == arena || upb_Arena_Fuse(arena, message_arena)) {
+    return message;
+  }
+  return DeepClone(message, mini_table, arena);
+}
+
 }  // namespace internal
 
 }  // namespace protos
@@ -31,11 +31,14 @@
 #ifndef UPB_PROTOS_PROTOS_H_
 #define UPB_PROTOS_PROTOS_H_
 
+#include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "upb/base/status.hpp"
 #include "upb/mem/arena.hpp"
 #include "upb/message/copy.h"
@@ -190,6 +193,23 @@ class ExtensionMiniTableProvider {
   const upb_MiniTableExtension* mini_table_ext_;
 };
 
+// The extensions defined in one .proto file.  protos_generator emits one of
+// these as a constant for every file, pointing at the constants of the files
+// it imports, so a registry can be built for a whole import graph without
+// naming each extension.
+struct ExtensionFile {
+  const upb_MiniTableExtension* const* extensions;
+  size_t extension_count;
+  const ExtensionFile* const* deps;
+  size_t dep_count;
+};
+
+// Returns a frozen registry of the extensions in |file| and in every file it
+// imports, which is never freed.  Generated code calls
+// this once per file and keeps the result.
+const ExtensionRegistry* NewGeneratedExtensionRegistry(
+    const ExtensionFile& file);
+
 // -------------------------------------------------------------------
 // ExtensionIdentifier
 // This is the type of actual extension objects.  E.g. if you have:
@@ -236,6 +256,32 @@ absl::StatusOr<absl::string_view> Serialize(const upb_Message* message,
                                             const upb_MiniTable* mini_table,
                                             upb_Arena* arena, int options);
 
+absl::StatusOr<absl::string_view> Serialize(const upb_Message* message,
+                                            const upb_MiniTable* mini_table,
+                                            absl::Span<char> buffer,
+                                            int options);
+
+absl::Status Serialize(const upb_Message* message,
+                       const upb_MiniTable* mini_table, std::string* output,
+                       int options);
+
+// A free list of reset arenas.  Arenas that were fused while in use cannot be
+// reset and are freed instead.  Not thread-safe.
+class ArenaPool {
+ public:
+  explicit ArenaPool(size_t max_free_arenas) : max_free_(max_free_arenas) {}
+  ArenaPool(const ArenaPool&) = delete;
+  ArenaPool& operator=(const ArenaPool&) = delete;
+  ~ArenaPool();
+
+  upb_Arena* Acquire();
+  void Release(upb_Arena* arena);
+
+ private:
+  std::vector<upb_Arena*> free_;
+  size_t max_free_;
+};
+
 bool HasExtensionOrUnknown(const upb_Message* msg,
                            const upb_MiniTableExtension* eid);
 
@@ -248,8 +294,47 @@ void DeepCopy(upb_Message* target, const upb_Message* source,
 upb_Message* DeepClone(const upb_Message* source,
                        const upb_MiniTable* mini_table, upb_Arena* arena);
 
+bool MergeFrom(upb_Message* target, const upb_Message* source,
+               const upb_MiniTable* mini_table, upb_Arena* arena);
+
+// Returns a message that lives as long as |arena|: |message| itself when its
+// arena could be fused with |arena|, otherwise a deep copy.
+upb_Message* AdoptMessage(upb_Message* message, const upb_MiniTable* mini_table,
+                          upb_Arena* message_arena, upb_Arena* arena);
+
+template <typename T>
+upb_Message* AdoptMessage(T&& message, upb_Arena* arena) {
+  static_assert(!std::is_reference_v<T>, "message must be an rvalue");
+  upb_Message* msg = AdoptMessage(GetInternalMsg(&message),
+                                  GetMiniTable(&message), GetArena(&message),
+                                  arena);
+  // The arena is now shared, so dropping the message's own reference to it
+  // frees nothing.
+  T moved = std::move(message);
+  return msg;
+}
+
 }  // namespace internal
 
+// Transfers |message| into |target|'s arena without copying it, so that it
+// lives as long as |target|.  Returns the adopted message.  Messages whose
+// arenas cannot be fused (see upb_Arena_Fuse()) are deep-copied instead.
+template <typename T, typename U>
+absl::StatusOr<Ptr<U>> Adopt(Ptr<T> target, U&& message) {
+  static_assert(!std::is_const_v<T>);
+  upb_Arena* arena = ::protos::internal::GetArena(target);
+  upb_Message* msg = internal::AdoptMessage(std::forward<U>(message), arena);
+  if (!msg) {
+    return MessageAllocationError();
+  }
+  return Ptr<U>(internal::CreateMessageProxy<U>(msg, arena));
+}
+
+template <typename T, typename U>
+absl::StatusOr<Ptr<U>> Adopt(T* target, U&& message) {
+  return Adopt(protos::Ptr(target), std::forward<U>(message));
+}
+
 template <typename T>
 void DeepCopy(Ptr<const T> source_message, Ptr<T> target_message) {
   static_assert(!std::is_const_v<T>);
@@ -285,6 +370,35 @@ void DeepCopy(const T* source_message, T* target_message) {
   DeepCopy(protos::Ptr(source_message), protos::Ptr(target_message));
 }
 
+// Merges `source_message` into `target_message` with the usual proto merge
+// semantics, without a serialize/parse round trip.
+template <typename T>
+bool MergeFrom(Ptr<const T> source_message, Ptr<T> target_message) {
+  static_assert(!std::is_const_v<T>);
+  return ::protos::internal::MergeFrom(
+      internal::GetInternalMsg(target_message),
+      internal::GetInternalMsg(source_message), T::minitable(),
+      static_cast<upb_Arena*>(target_message->GetInternalArena()));
+}
+
+template <typename T>
+bool MergeFrom(Ptr<const T> source_message, T* target_message) {
+  static_assert(!std::is_const_v<T>);
+  return MergeFrom(source_message, protos::Ptr(target_message));
+}
+
+template <typename T>
+bool MergeFrom(const T* source_message, Ptr<T> target_message) {
+  static_assert(!std::is_const_v<T>);
+  return MergeFrom(protos::Ptr(source_message), target_message);
+}
+
+template <typename T>
+bool MergeFrom(const T* source_message, T* target_message) {
+  static_assert(!std::is_const_v<T>);
+  return MergeFrom(protos::Ptr(source_message), protos::Ptr(target_message));
+}
+
 template <typename T>
 void ClearMessage(Ptr<T> message) {
   static_assert(!std::is_const_v<T>, "");
@@ -316,6 +430,13 @@ class ExtensionRegistry {
   }
 
  private:
+  // Wraps a registry built by NewGeneratedExtensionRegistry().
+  explicit ExtensionRegistry(upb_ExtensionRegistry* registry)
+      : registry_(registry) {}
+
+  friend const ExtensionRegistry* ::protos::internal::
+      NewGeneratedExtensionRegistry(
+          const ::protos::internal::ExtensionFile& file);
   friend upb_ExtensionRegistry* ::protos::internal::GetUpbExtensions(
       const ExtensionRegistry& extension_registry);
   upb_ExtensionRegistry* registry_;
@@ -418,8 +539,12 @@ absl::StatusOr<Ptr<const Extension>> GetExtension(
   return GetExtension(protos::Ptr(message), id);
 }
 
+// The Parse() functions take upb_DecodeOption flags and may be given a depth
+// limit with upb_DecodeOptions_MaxDepth().  With kUpb_DecodeOption_AliasString
+// the message's strings point into |bytes|, which must then outlive it.
 template <typename T>
-ABSL_MUST_USE_RESULT bool Parse(Ptr<T> message, absl::string_view bytes) {
+ABSL_MUST_USE_RESULT bool Parse(Ptr<T> message, absl::string_view bytes,
+                                int options = 0) {
   static_assert(!std::is_const_v<T>);
   upb_Message_Clear(internal::GetInternalMsg(message),
                     ::protos::internal::GetMiniTable(message));
@@ -427,14 +552,14 @@ ABSL_MUST_USE_RESULT bool Parse(Ptr<T> message, absl::string_view bytes) {
   return upb_Decode(bytes.data(), bytes.size(),
                     internal::GetInternalMsg(message),
                     ::protos::internal::GetMiniTable(message),
-                    /* extreg= */ nullptr, /* options= */ 0,
+                    /* extreg= */ nullptr, options,
                     arena) == kUpb_DecodeStatus_Ok;
 }
 
 template <typename T>
 ABSL_MUST_USE_RESULT bool Parse(
     Ptr<T> message, absl::string_view bytes,
-    const ::protos::ExtensionRegistry& extension_registry) {
+    const ::protos::ExtensionRegistry& extension_registry, int options = 0) {
   static_assert(!std::is_const_v<T>);
   upb_Message_Clear(internal::GetInternalMsg(message),
                     ::protos::internal::GetMiniTable(message));
@@ -444,19 +569,20 @@ ABSL_MUST_USE_RESULT bool Parse(
                     ::protos::internal::GetMiniTable(message),
                     /* extreg= */
                     ::protos::internal::GetUpbExtensions(extension_registry),
-                    /* options= */ 0, arena) == kUpb_DecodeStatus_Ok;
+                    options, arena) == kUpb_DecodeStatus_Ok;
 }
 
 template <typename T>
 ABSL_MUST_USE_RESULT bool Parse(
     T* message, absl::string_view bytes,
-    const ::protos::ExtensionRegistry& extension_registry) {
+    const ::protos::ExtensionRegistry& extension_registry, int options = 0) {
   static_assert(!std::is_const_v<T>);
-  return Parse(protos::Ptr(message, bytes, extension_registry));
+  return Parse(protos::Ptr<T>(message), bytes, extension_registry, options);
 }
 
 template <typename T>
-ABSL_MUST_USE_RESULT bool Parse(T* message, absl::string_view bytes) {
+ABSL_MUST_USE_RESULT bool Parse(T* message, absl::string_view bytes,
+                                int options = 0) {
   static_assert(!std::is_const_v<T>);
   upb_Message_Clear(internal::GetInternalMsg(message),
                     ::protos::internal::GetMiniTable(message));
@@ -464,7 +590,7 @@ ABSL_MUST_USE_RESULT bool Parse(T* message, absl::string_view bytes) {
   return upb_Decode(bytes.data(), bytes.size(),
                     internal::GetInternalMsg(message),
                     ::protos::internal::GetMiniTable(message),
-                    /* extreg= */ nullptr, /* options= */ 0,
+                    /* extreg= */ nullptr, options,
                     arena) == kUpb_DecodeStatus_Ok;
 }
 
@@ -475,7 +601,7 @@ absl::StatusOr<T> Parse(absl::string_view bytes, int options = 0) {
   upb_DecodeStatus status =
       upb_Decode(bytes.data(), bytes.size(), message.msg(),
                  ::protos::internal::GetMiniTable(&message),
-                 /* extreg= */ nullptr, /* options= */ 0, arena);
+                 /* extreg= */ nullptr, options, arena);
   if (status == kUpb_DecodeStatus_Ok) {
     return message;
   }
@@ -492,13 +618,31 @@ absl::StatusOr<T> Parse(absl::string_view bytes,
       upb_Decode(bytes.data(), bytes.size(), message.msg(),
                  ::protos::internal::GetMiniTable(&message),
                  ::protos::internal::GetUpbExtensions(extension_registry),
-                 /* options= */ 0, arena);
+                 options, arena);
   if (status == kUpb_DecodeStatus_Ok) {
     return message;
   }
   return MessageDecodeError(status);
 }
 
+// Parses into a new message that lives in the caller's |arena|, so that it
+// can be fused with messages already there and freed together with them.
+template <typename T>
+absl::StatusOr<Ptr<T>> Parse(absl::string_view bytes, upb::Arena& arena,
+                             int options = 0) {
+  upb_Message* message = upb_Message_New(T::minitable(), arena.ptr());
+  if (!message) {
+    return MessageAllocationError();
+  }
+  upb_DecodeStatus status =
+      upb_Decode(bytes.data(), bytes.size(), message, T::minitable(),
+                 /* extreg= */ nullptr, options, arena.ptr());
+  if (status == kUpb_DecodeStatus_Ok) {
+    return Ptr<T>(internal::CreateMessageProxy<T>(message, arena.ptr()));
+  }
+  return MessageDecodeError(status);
+}
+
 template <typename T>
 absl::StatusOr<absl::string_view> Serialize(const T* message, upb::Arena& arena,
                                             int options = 0) {
@@ -515,6 +659,117 @@ absl::StatusOr<absl::string_view> Serialize(Ptr<T> message, upb::Arena& arena,
       ::protos::internal::GetMiniTable(message), arena.ptr(), options);
 }
 
+// Serializes into the caller's |buffer| and returns the part of it that was
+// written, or a kUpb_EncodeStatus_NeedMoreSpace error if it is too small.
+template <typename T>
+absl::StatusOr<absl::string_view> Serialize(const T* message,
+                                            absl::Span<char> buffer,
+                                            int options = 0) {
+  return ::protos::internal::Serialize(
+      internal::GetInternalMsg(message),
+      ::protos::internal::GetMiniTable(message), buffer, options);
+}
+
+template <typename T>
+absl::StatusOr<absl::string_view> Serialize(Ptr<T> message,
+                                            absl::Span<char> buffer,
+                                            int options = 0) {
+  return ::protos::internal::Serialize(
+      internal::GetInternalMsg(message),
+      ::protos::internal::GetMiniTable(message), buffer, options);
+}
+
+// Replaces the contents of |output| with the serialized message.  The string's
+// existing capacity is used first, so a string that is reused, or reserved
+// with the expected size, is usually serialized into without reallocating.
+template <typename T>
+absl::Status Serialize(const T* message, std::string* output,
+                       int options = 0) {
+  return ::protos::internal::Serialize(
+      internal::GetInternalMsg(message),
+      ::protos::internal::GetMiniTable(message), output, options);
+}
+
+template <typename T>
+absl::Status Serialize(Ptr<T> message, std::string* output, int options = 0) {
+  return ::protos::internal::Serialize(
+      internal::GetInternalMsg(message),
+      ::protos::internal::GetMiniTable(message), output, options);
+}
+
+template <typename T>
+class MessagePool;
+
+// An owning handle to a message created by a MessagePool.  When the handle is
+// destroyed the message's arena is reset and returned to the pool, so the
+// handle must not outlive its pool and no Ptr obtained from it may be used
+// afterwards.
+template <typename T>
+class PooledMessage final {
+ public:
+  PooledMessage(PooledMessage&& other) noexcept
+      : pool_(std::exchange(other.pool_, nullptr)),
+        arena_(other.arena_),
+        msg_(other.msg_) {}
+  PooledMessage& operator=(PooledMessage&& other) noexcept {
+    if (this != &other) {
+      Release();
+      pool_ = std::exchange(other.pool_, nullptr);
+      arena_ = other.arena_;
+      msg_ = other.msg_;
+    }
+    return *this;
+  }
+  ~PooledMessage() { Release(); }
+
+  Ptr<T> get() const {
+    return Ptr<T>(internal::CreateMessageProxy<T>(msg_, arena_));
+  }
+  Ptr<T> operator->() const { return get(); }
+  operator Ptr<T>() const { return get(); }  // NOLINT
+
+ private:
+  friend class MessagePool<T>;
+
+  PooledMessage(internal::ArenaPool* pool, upb_Arena* arena)
+      : pool_(pool),
+        arena_(arena),
+        msg_(upb_Message_New(T::minitable(), arena)) {}
+
+  void Release() {
+    if (pool_) pool_->Release(arena_);
+    pool_ = nullptr;
+  }
+
+  internal::ArenaPool* pool_;
+  upb_Arena* arena_;
+  void* msg_;
+};
+
+// Creates messages in recycled arenas, avoiding the cost of a new arena for
+// every short-lived top-level message:
+//
+//   protos::MessagePool<Request> pool;
+//   for (...) {
+//     protos::PooledMessage<Request> request = pool.Create();
+//     request->set_name("...");
+//   }  // request's arena is reset and reused here.
+//
+// A pool is not thread-safe; use one per thread.
+template <typename T>
+class MessagePool {
+ public:
+  explicit MessagePool(size_t max_free_arenas = 16)
+      : arenas_(max_free_arenas) {}
+
+  PooledMessage<T> Create() {
+    return PooledMessage<T>(&arenas_, arenas_.Acquire());
+  }
+
+ private:
+  internal::ArenaPool arenas_;
+};
+
 }  // namespace protos
 
 #endif  // UPB_PROTOS_PROTOS_H_
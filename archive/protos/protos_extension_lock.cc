@@ -31,9 +31,31 @@
 #include "protos/protos_extension_lock.h"
 
 #include <atomic>
+#include <cstddef>
+
+#include "absl/hash/hash.h"
+#include "absl/synchronization/mutex.h"
 
 namespace protos::internal {
 
 std::atomic<UpbExtensionLocker> upb_extension_locker_global;
 
+namespace {
+
+constexpr size_t kLockStripes = 64;
+
+absl::Mutex& StripeFor(const void* msg) {
+  static absl::Mutex* const stripes = new absl::Mutex[kLockStripes];
+  return stripes[absl::HashOf(msg) % kLockStripes];
+}
+
+void StripedExtensionUnlocker(const void* msg) { StripeFor(msg).Unlock(); }
+
+}  // namespace
+
+UpbExtensionUnlocker StripedExtensionLocker(const void* msg) {
+  StripeFor(msg).Lock();
+  return &StripedExtensionUnlocker;
+}
+
 }  // namespace protos::internal
@@ -49,6 +49,13 @@ using UpbExtensionLocker = UpbExtensionUnlocker (*)(const void*);
 // TODO(b/295355754): Expose as function instead of global.
 extern std::atomic<UpbExtensionLocker> upb_extension_locker_global;
 
+// A locker that serializes access to each message rather than to all of them,
+// by mapping the message to one of a fixed set of mutexes.  Threads touching
+// different messages rarely contend:
+//
+//   upb_extension_locker_global.store(&StripedExtensionLocker);
+UpbExtensionUnlocker StripedExtensionLocker(const void* msg);
+
 }  // namespace protos::internal
 
 #endif  // UPB_PROTOS_PROTOS_EXTENSION_LOCK_H_
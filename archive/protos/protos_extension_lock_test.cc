@@ -77,9 +77,11 @@ void unlock_func(const void* msg) { m[absl::HashOf(msg) & 0x7].unlock(); }
   return &unlock_func;
 }
 
-void TestConcurrentExtensionAccess(::protos::ExtensionRegistry registry) {
+void TestConcurrentExtensionAccess(
+    ::protos::ExtensionRegistry registry,
+    ::protos::internal::UpbExtensionLocker locker = &lock_func) {
   ::protos::internal::upb_extension_locker_global.store(
-      &lock_func, std::memory_order_release);
+      locker, std::memory_order_release);
   const std::string payload = GenerateTestData();
   TestModel parsed_model =
       ::protos::Parse<TestModel>(payload, registry).value();
@@ -136,5 +138,11 @@ TEST(CppGeneratedCode, ConcurrentAccessDoesNotRaceBothEager) {
       {{&theme, &ThemeExtension::theme_extension}, arena});
 }
 
+TEST(CppGeneratedCode, ConcurrentAccessDoesNotRaceStripedLocker) {
+  ::upb::Arena arena;
+  TestConcurrentExtensionAccess({{}, arena},
+                                &::protos::internal::StripedExtensionLocker);
+}
+
 }  // namespace
 }  // namespace protos_generator::test::protos
@@ -37,6 +37,7 @@
 
 #include "absl/base/attributes.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "protos/protos.h"
 #include "protos/protos_traits.h"
 #include "protos/repeated_field_iterator.h"
@@ -258,8 +259,15 @@ class RepeatedFieldScalarProxy
   reverse_iterator crbegin() const { return reverse_iterator(end()); }
   reverse_iterator crend() const { return reverse_iterator(begin()); }
 
+  // Scalars are stored contiguously, so they can be accessed directly.  Unlike
+  // the iterators, plain pointers let the compiler vectorize loops over them.
+  // Pointers are invalidated when the field is appended to or resized.
+  T* data() const { return unsafe_array(); }
+  absl::Span<T> span() const { return absl::Span<T>(data(), this->size()); }
+
  private:
   T* unsafe_array() const {
+    if (this->arr_ == nullptr) return nullptr;
     if (kIsConst) {
       const void* unsafe_ptr = ::upb_Array_DataPtr(this->arr_);
       return static_cast<T*>(const_cast<void*>(unsafe_ptr));
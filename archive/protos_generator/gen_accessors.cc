@@ -73,6 +73,18 @@ void WriteMapAccessorDefinitions(const protobuf::Descriptor* message,
                                  absl::string_view resolved_field_name,
                                  absl::string_view class_name, Output& output);
 
+namespace {
+
+// Returns the type used for the values of a map by its accessors, given the
+// value field of the map entry.
+std::string MapValueType(const protobuf::FieldDescriptor* val) {
+  return val->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE
+             ? MessagePtrConstType(val, /* is_const */ true)
+             : CppConstType(val);
+}
+
+}  // namespace
+
 // Returns C++ class member name by resolving naming conflicts across
 // proto field names (such as clear_ prefixes) and keyword collisions.
 //
@@ -130,10 +142,12 @@ void WriteFieldAccessorsInHeader(const protobuf::Descriptor* desc,
         output(R"cc(
                  $1 $2() const;
                  $0 mutable_$2();
+                 void set_$2($3&& value);
                )cc",
                MessagePtrConstType(field, /* const */ false),
                MessagePtrConstType(field, /* const */ true),
-               resolved_field_name, resolved_upbc_name);
+               resolved_field_name,
+               MessageBaseType(field, /* maybe_const */ false));
       } else {
         output(
             R"cc(
@@ -187,6 +201,12 @@ void WriteMapFieldAccessors(const protobuf::Descriptor* desc,
       )cc",
       resolved_field_name, MessageName(desc), CppConstType(key),
       resolved_upbc_name);
+  output(
+      R"cc(
+        ::protos::internal::MapFieldRange<$1, $2> $0() const;
+        bool set_$0(absl::Span<const std::pair<$1, $2>> entries);
+      )cc",
+      resolved_field_name, CppConstType(key), MapValueType(val));
 
   if (val->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
     output(
@@ -287,6 +307,19 @@ void WriteAccessorsInSource(const protobuf::Descriptor* desc, Output& output) {
             resolved_field_name, MessageName(desc),
             MessageBaseType(field, /* maybe_const */ false), resolved_upbc_name,
             arena_expression);
+
+        // Adopts the value's arena rather than copying the message.
+        output(
+            R"cc(
+              void $0::set_$1($2&& value) {
+                $3_set_$4(msg_, ($5*)::protos::internal::AdoptMessage(
+                                    std::move(value), $6));
+              }
+            )cc",
+            class_name, resolved_field_name,
+            MessageBaseType(field, /* maybe_const */ false), MessageName(desc),
+            resolved_upbc_name, MessageName(field->message_type()),
+            arena_expression);
       }
     }
   }
@@ -313,6 +346,30 @@ void WriteMapAccessorDefinitions(const protobuf::Descriptor* message,
     optional_conversion_code =
         "upb_StringView upb_key = {key.data(), key.size()};\n";
   }
+  output(
+      R"cc(
+        ::protos::internal::MapFieldRange<$2, $3> $0::$1() const {
+          const upb_MiniTableField* field =
+              upb_MiniTable_FindFieldByNumber(&$4, $5);
+          return ::protos::internal::MapFieldRange<$2, $3>(
+              upb_Message_GetMap(msg_, field), arena_);
+        }
+      )cc",
+      class_name, resolved_field_name, CppConstType(key), MapValueType(val),
+      ::upbc::MessageInit(message->full_name()), field->number());
+  output(
+      R"cc(
+        bool $0::set_$1(absl::Span<const std::pair<$2, $3>> entries) {
+          const upb_MiniTableField* field =
+              upb_MiniTable_FindFieldByNumber(&$4, $5);
+          upb_Map* map = upb_Message_GetOrCreateMutableMap(
+              msg_, upb_MiniTable_GetSubMessageTable(&$4, field), field,
+              arena_);
+          return ::protos::internal::InsertMapEntries(map, entries, arena_);
+        }
+      )cc",
+      class_name, resolved_field_name, CppConstType(key), MapValueType(val),
+      ::upbc::MessageInit(message->full_name()), field->number());
   if (val->cpp_type() == protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
     output(
         R"cc(
@@ -452,6 +509,7 @@ void WriteUsingAccessorsInHeader(const protobuf::Descriptor* desc,
     if (field->is_map()) {
       output(
           R"cc(
+            using $0Access::$1;
             using $0Access::$1_size;
             using $0Access::clear_$1;
             using $0Access::delete_$1;
@@ -470,6 +528,7 @@ void WriteUsingAccessorsInHeader(const protobuf::Descriptor* desc,
         if (!read_only) {
           output("using $0Access::mutable_$1;\n", class_name,
                  resolved_field_name);
+          output("using $0Access::set_$1;\n", class_name, resolved_field_name);
         }
       } else {
         output("using $0Access::$1;\n", class_name, resolved_field_name);
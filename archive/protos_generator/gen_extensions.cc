@@ -30,6 +30,8 @@
 
 #include "protos_generator/gen_extensions.h"
 
+#include <vector>
+
 #include "absl/strings/str_cat.h"
 #include "protos_generator/gen_utils.h"
 #include "protos_generator/names.h"
@@ -114,4 +116,61 @@ void WriteExtensionIdentifiers(
   }
 }
 
+void WriteExtensionFileHeader(const protobuf::FileDescriptor* file,
+                              Output& output) {
+  output(
+      R"cc(
+        namespace internal {
+        extern const ::protos::internal::ExtensionFile $0;
+        }  // namespace internal
+
+        // Returns a registry of the extensions in $1 and in every file it
+        // imports, which is built on first use.
+        const ::protos::ExtensionRegistry& $2();
+      )cc",
+      ExtensionFileName(file), file->name(),
+      ExtensionRegistryFunctionName(file));
+}
+
+void WriteExtensionFile(
+    const protobuf::FileDescriptor* file,
+    const std::vector<const protobuf::FieldDescriptor*>& extensions,
+    Output& output) {
+  output("namespace {\n\n");
+  if (!extensions.empty()) {
+    output("const upb_MiniTableExtension* const kExtensions[] = {\n");
+    for (const auto* ext : extensions) {
+      output("    &$0_$1_ext,\n", ExtensionIdentifierBase(ext), ext->name());
+    }
+    output("};\n\n");
+  }
+  if (file->dependency_count()) {
+    output(
+        "const ::protos::internal::ExtensionFile* const kExtensionFileDeps[] "
+        "= {\n");
+    for (int i = 0; i < file->dependency_count(); i++) {
+      output("    &$0,\n", QualifiedExtensionFileName(file->dependency(i)));
+    }
+    output("};\n\n");
+  }
+  output("}  // namespace\n\n");
+
+  output(
+      R"cc(
+        namespace internal {
+        const ::protos::internal::ExtensionFile $0 = {$1, $2, $3, $4};
+        }  // namespace internal
+
+        const ::protos::ExtensionRegistry& $5() {
+          static const ::protos::ExtensionRegistry* registry =
+              ::protos::internal::NewGeneratedExtensionRegistry(internal::$0);
+          return *registry;
+        }
+      )cc",
+      ExtensionFileName(file), extensions.empty() ? "nullptr" : "kExtensions",
+      extensions.size(),
+      file->dependency_count() ? "kExtensionFileDeps" : "nullptr",
+      file->dependency_count(), ExtensionRegistryFunctionName(file));
+}
+
 }  // namespace protos_generator
@@ -48,6 +48,12 @@ void WriteExtensionIdentifiers(
     Output& output);
 void WriteExtensionIdentifier(const protobuf::FieldDescriptor* ext,
                               Output& output);
+void WriteExtensionFileHeader(const protobuf::FileDescriptor* file,
+                              Output& output);
+void WriteExtensionFile(
+    const protobuf::FileDescriptor* file,
+    const std::vector<const protobuf::FieldDescriptor*>& extensions,
+    Output& output);
 
 }  // namespace protos_generator
 
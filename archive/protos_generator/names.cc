@@ -141,6 +141,21 @@ std::string CppHeaderFilename(const google::protobuf::FileDescriptor* file) {
   return StripExtension(file->name()) + ".upb.proto.h";
 }
 
+std::string ExtensionFileName(const google::protobuf::FileDescriptor* file) {
+  return ToCIdent(file->name()) + "_extensions";
+}
+
+std::string QualifiedExtensionFileName(
+    const google::protobuf::FileDescriptor* file) {
+  return QualifiedFileLevelSymbol(file,
+                                  "internal::" + ExtensionFileName(file));
+}
+
+std::string ExtensionRegistryFunctionName(
+    const google::protobuf::FileDescriptor* file) {
+  return ToCIdent(file->name()) + "_extension_registry";
+}
+
 void WriteStartNamespace(const protobuf::FileDescriptor* file, Output& output) {
   // Skip namespace generation if package name is not specified.
   if (file->package().empty()) {
@@ -51,6 +51,15 @@ std::string ForwardingHeaderFilename(const google::protobuf::FileDescriptor* fil
 std::string UpbCFilename(const google::protobuf::FileDescriptor* file);
 std::string CppHeaderFilename(const google::protobuf::FileDescriptor* file);
 
+// The constant that lists a file's extensions (see
+// ::protos::internal::ExtensionFile), which is in the file's internal
+// namespace, and the function that returns a registry of them.
+std::string ExtensionFileName(const google::protobuf::FileDescriptor* file);
+std::string QualifiedExtensionFileName(
+    const google::protobuf::FileDescriptor* file);
+std::string ExtensionRegistryFunctionName(
+    const google::protobuf::FileDescriptor* file);
+
 void WriteStartNamespace(const protobuf::FileDescriptor* file, Output& output);
 void WriteEndNamespace(const protobuf::FileDescriptor* file, Output& output);
 
@@ -138,6 +138,7 @@ void WriteHeader(const protobuf::FileDescriptor* file, Output& output) {
 #ifndef $0_UPB_PROTO_H_
 #define $0_UPB_PROTO_H_
 
+#include "protos/map_field.h"
 #include "protos/protos.h"
 #include "protos/protos_internal.h"
 #include "protos/repeated_field.h"
@@ -187,6 +188,8 @@ void WriteHeader(const protobuf::FileDescriptor* file, Output& output) {
 
   WriteExtensionIdentifiersHeader(this_file_exts, output);
   output("\n");
+  WriteExtensionFileHeader(file, output);
+  output("\n");
 
   WriteEndNamespace(file, output);
 
@@ -220,6 +223,7 @@ void WriteSource(const protobuf::FileDescriptor* file, Output& output,
   const std::vector<const protobuf::FieldDescriptor*> this_file_exts =
       SortedExtensions(file);
   WriteExtensionIdentifiers(this_file_exts, output);
+  WriteExtensionFile(file, this_file_exts, output);
   WriteEndNamespace(file, output);
 
   output("#include \"upb/port/undef.inc\"\n\n");
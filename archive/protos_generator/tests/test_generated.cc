@@ -29,6 +29,7 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <limits>
+#include <map>
 #include <memory>
 #include <string>
 #include <utility>
@@ -38,6 +39,7 @@
 #include "gtest/gtest.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "protos/protos.h"
 #include "protos/repeated_field.h"
 #include "protos/repeated_field_iterator.h"
@@ -47,6 +49,8 @@
 
 using ::protos_generator::test::protos::ChildModel1;
 using ::protos_generator::test::protos::other_ext;
+using ::protos_generator::test::protos::
+    protos_generator_tests_test_model_proto_extension_registry;
 using ::protos_generator::test::protos::RED;
 using ::protos_generator::test::protos::TestEnum;
 using ::protos_generator::test::protos::TestModel;
@@ -332,6 +336,25 @@ TEST(CppGeneratedCode, Messages) {
   EXPECT_EQ(false, test_model.has_child_model_1());
 }
 
+TEST(CppGeneratedCode, SetMessageAdoptsArena) {
+  TestModel test_model;
+  ChildModel1 child;
+  child.set_child_str1(kTestStr1);
+  test_model.set_child_model_1(std::move(child));
+  EXPECT_EQ(true, test_model.has_child_model_1());
+  EXPECT_EQ(kTestStr1, test_model.child_model_1()->child_str1());
+}
+
+TEST(CppGeneratedCode, Adopt) {
+  TestModel test_model;
+  ChildModel1 child;
+  child.set_child_str1(kTestStr1);
+  absl::StatusOr<::protos::Ptr<ChildModel1>> adopted =
+      ::protos::Adopt(&test_model, std::move(child));
+  EXPECT_EQ(true, adopted.ok());
+  EXPECT_EQ(kTestStr1, (*adopted)->child_str1());
+}
+
 TEST(CppGeneratedCode, NestedMessages) {
   ::protos::Arena arena;
   auto test_model = ::protos::CreateMessage<TestModel>(arena);
@@ -504,6 +527,22 @@ TEST(CppGeneratedCode, RepeatedScalarIterator) {
   EXPECT_EQ(sum, 5 + 16 + 27);
 }
 
+TEST(CppGeneratedCode, RepeatedScalarSpan) {
+  ::protos::Arena arena;
+  auto test_model = ::protos::CreateMessage<TestModel>(arena);
+  EXPECT_TRUE(test_model.value_array().span().empty());
+  test_model.mutable_value_array()->push_back(5);
+  test_model.mutable_value_array()->push_back(16);
+  test_model.mutable_value_array()->push_back(27);
+  absl::Span<const int32_t> values = test_model.value_array().span();
+  EXPECT_THAT(values, ElementsAre(5, 16, 27));
+  absl::Span<int32_t> mutable_values =
+      test_model.mutable_value_array()->span();
+  mutable_values[1] = 17;
+  EXPECT_EQ(test_model.value_array()[1], 17);
+  EXPECT_EQ(test_model.value_array().data(), values.data());
+}
+
 TEST(CppGeneratedCode, RepeatedFieldProxyForStrings) {
   ::protos::Arena arena;
   auto test_model = ::protos::CreateMessage<TestModel>(arena);
@@ -656,6 +695,44 @@ TEST(CppGeneratedCode, MessageMapStringKeyAndInt32Value) {
   EXPECT_EQ(false, result_after_delete.ok());
 }
 
+TEST(CppGeneratedCode, MessageMapIterateAndBatchSet) {
+  ::protos::Arena arena;
+  auto test_model = ::protos::CreateMessage<TestModel>(arena);
+  EXPECT_TRUE(test_model.str_to_int_map().empty());
+  const std::pair<absl::string_view, int32_t> entries[] = {
+      {"first", 10}, {"second", 20}, {"first", 30}};
+  EXPECT_TRUE(test_model.set_str_to_int_map(entries));
+  EXPECT_EQ(2, test_model.str_to_int_map_size());
+  EXPECT_EQ(2, test_model.str_to_int_map().size());
+  std::map<std::string, int32_t> seen;
+  for (const auto& [key, value] : test_model.str_to_int_map()) {
+    seen.emplace(key, value);
+  }
+  EXPECT_EQ(2, seen.size());
+  EXPECT_EQ(30, seen["first"]);
+  EXPECT_EQ(20, seen["second"]);
+}
+
+TEST(CppGeneratedCode, MessageMapIterateMessageValues) {
+  ::protos::Arena arena;
+  auto test_model = ::protos::CreateMessage<TestModel>(arena);
+  auto child_model1 = ::protos::CreateMessage<ChildModel1>(arena);
+  child_model1.set_child_str1("abc");
+  ::protos::Ptr<ChildModel1> child_ptr = child_model1;
+  const std::pair<int32_t, ::protos::Ptr<const ChildModel1>> entries[] = {
+      {1, child_ptr}};
+  EXPECT_TRUE(test_model.set_child_map(entries));
+  // Values are copied, as with the single-entry setter.
+  child_model1.set_child_str1("abc V2");
+  int count = 0;
+  for (const auto& [key, value] : test_model.child_map()) {
+    EXPECT_EQ(1, key);
+    EXPECT_EQ("abc", value->child_str1());
+    ++count;
+  }
+  EXPECT_EQ(1, count);
+}
+
 TEST(CppGeneratedCode, HasExtension) {
   TestModel model;
   EXPECT_EQ(false, ::protos::HasExtension(&model, theme));
@@ -836,6 +913,78 @@ TEST(CppGeneratedCode, ParseWithExtensionRegistry) {
                                ->ext_name());
 }
 
+TEST(CppGeneratedCode, ParseWithGeneratedExtensionRegistry) {
+  TestModel model;
+  ThemeExtension extension1;
+  extension1.set_ext_name("Hello World");
+  EXPECT_EQ(true, ::protos::SetExtension(&model, theme, extension1).ok());
+  EXPECT_EQ(true, ::protos::SetExtension(
+                      &model, ThemeExtension::theme_extension, extension1)
+                      .ok());
+  ::upb::Arena arena;
+  auto bytes = ::protos::Serialize(&model, arena);
+  EXPECT_EQ(true, bytes.ok());
+  const ::protos::ExtensionRegistry& extensions =
+      protos_generator_tests_test_model_proto_extension_registry();
+  EXPECT_EQ(&extensions,
+            &protos_generator_tests_test_model_proto_extension_registry());
+  TestModel parsed_model =
+      ::protos::Parse<TestModel>(bytes.value(), extensions).value();
+  EXPECT_EQ("Hello World", ::protos::GetExtension(&parsed_model, theme)
+                               .value()
+                               ->ext_name());
+  EXPECT_EQ("Hello World", ::protos::GetExtension(
+                               &parsed_model, ThemeExtension::theme_extension)
+                               .value()
+                               ->ext_name());
+}
+
+TEST(CppGeneratedCode, ParseIntoArena) {
+  TestModel model;
+  model.set_str1("Test123");
+  ::upb::Arena arena;
+  auto bytes = ::protos::Serialize(&model, arena);
+  EXPECT_EQ(true, bytes.ok());
+  absl::StatusOr<::protos::Ptr<TestModel>> parsed_model =
+      ::protos::Parse<TestModel>(bytes.value(), arena,
+                                 kUpb_DecodeOption_AliasString);
+  EXPECT_EQ(true, parsed_model.ok());
+  EXPECT_EQ("Test123", (*parsed_model)->str1());
+}
+
+TEST(CppGeneratedCode, SerializeToString) {
+  TestModel model;
+  model.set_str1("Test123");
+  std::string output = "stale contents";
+  EXPECT_EQ(true, ::protos::Serialize(&model, &output).ok());
+  TestModel parsed_model = ::protos::Parse<TestModel>(output).value();
+  EXPECT_EQ("Test123", parsed_model.str1());
+}
+
+TEST(CppGeneratedCode, SerializeToBuffer) {
+  TestModel model;
+  model.set_str1("Test123");
+  char buffer[64];
+  auto bytes = ::protos::Serialize(&model, absl::MakeSpan(buffer));
+  EXPECT_EQ(true, bytes.ok());
+  EXPECT_EQ(buffer, bytes->data());
+  TestModel parsed_model = ::protos::Parse<TestModel>(bytes.value()).value();
+  EXPECT_EQ("Test123", parsed_model.str1());
+  EXPECT_EQ(false,
+            ::protos::Serialize(&model, absl::MakeSpan(buffer, 2)).ok());
+}
+
+TEST(CppGeneratedCode, MessagePool) {
+  ::protos::MessagePool<TestModel> pool;
+  for (int i = 0; i < 3; ++i) {
+    ::protos::PooledMessage<TestModel> model = pool.Create();
+    EXPECT_FALSE(model->has_str1());
+    model->set_str1("Test123");
+    ::protos::Ptr<TestModel> ptr = model;
+    EXPECT_EQ("Test123", ptr->str1());
+  }
+}
+
 TEST(CppGeneratedCode, NameCollisions) {
   TestModel model;
   model.set_template_("test");
@@ -976,6 +1125,27 @@ TEST(CppGeneratedCode, DeepCopy) {
   EXPECT_TRUE(::protos::HasExtension(&target, theme));
 }
 
+TEST(CppGeneratedCode, MergeFrom) {
+  TestModel model;
+  model.set_str2("Hello");
+  auto new_child = model.add_child_models();
+  ASSERT_TRUE(new_child.ok());
+  new_child.value()->set_child_str1("text in child");
+  ThemeExtension extension1;
+  extension1.set_ext_name("name in extension");
+  EXPECT_TRUE(::protos::SetExtension(&model, theme, extension1).ok());
+  TestModel target;
+  target.set_b1(true);
+  target.set_str2("Goodbye");
+  ASSERT_TRUE(target.add_child_models().ok());
+  EXPECT_TRUE(::protos::MergeFrom(&model, &target));
+  EXPECT_TRUE(target.b1());
+  EXPECT_EQ(target.str2(), "Hello");
+  EXPECT_EQ(target.child_models_size(), 2);
+  EXPECT_EQ(target.child_models(1)->child_str1(), "text in child");
+  EXPECT_TRUE(::protos::HasExtension(&target, theme));
+}
+
 TEST(CppGeneratedCode, HasExtensionAndRegistry) {
   // Fill model.
   TestModel source;
@@ -60,7 +60,8 @@ bool PyUpb_Array_IsEqual(const upb_Array* arr1, const upb_Array* arr2,
                          const upb_FieldDef* f);
 
 // Returns true if the given messages (of type `m`) are equal.
-bool upb_Message_IsEqual(const upb_Message* msg1, const upb_Message* msg2,
-                         const upb_MessageDef* m);
+bool PyUpb_MessageContents_IsEqual(const upb_Message* msg1,
+                                   const upb_Message* msg2,
+                                   const upb_MessageDef* m);
 
 #endif  // PYUPB_CONVERT_H__
@@ -169,12 +169,9 @@ oom:
   return NULL;
 }
 
-static PyObject* PyUpb_DescriptorBase_CopyToProto(PyObject* _self,
-                                                  PyUpb_ToProto_Func* func,
-                                                  const upb_MiniTable* layout,
-                                                  const char* expected_type,
-                                                  PyObject* py_proto) {
-  if (!PyUpb_Message_Verify(py_proto)) return NULL;
+static bool PyUpb_DescriptorBase_CheckProtoType(PyObject* py_proto,
+                                                const char* expected_type) {
+  if (!PyUpb_Message_Verify(py_proto)) return false;
   const upb_MessageDef* m = PyUpb_Message_GetMsgdef(py_proto);
   const char* type = upb_MessageDef_FullName(m);
   if (strcmp(type, expected_type) != 0) {
@@ -182,16 +179,32 @@ static PyObject* PyUpb_DescriptorBase_CopyToProto(PyObject* _self,
         PyExc_TypeError,
         "CopyToProto: message is of incorrect type '%s' (expected '%s'", type,
         expected_type);
-    return NULL;
+    return false;
   }
-  PyObject* serialized =
-      PyUpb_DescriptorBase_GetSerializedProto(_self, func, layout);
+  return true;
+}
+
+// Merges |serialized| into |py_proto| and releases it.
+static PyObject* PyUpb_DescriptorBase_MergeSerialized(PyObject* py_proto,
+                                                      PyObject* serialized) {
   if (!serialized) return NULL;
   PyObject* ret = PyUpb_Message_MergeFromString(py_proto, serialized);
   Py_DECREF(serialized);
   return ret;
 }
 
+static PyObject* PyUpb_DescriptorBase_CopyToProto(PyObject* _self,
+                                                  PyUpb_ToProto_Func* func,
+                                                  const upb_MiniTable* layout,
+                                                  const char* expected_type,
+                                                  PyObject* py_proto) {
+  if (!PyUpb_DescriptorBase_CheckProtoType(py_proto, expected_type)) {
+    return NULL;
+  }
+  return PyUpb_DescriptorBase_MergeSerialized(
+      py_proto, PyUpb_DescriptorBase_GetSerializedProto(_self, func, layout));
+}
+
 static void PyUpb_DescriptorBase_Dealloc(PyUpb_DescriptorBase* base) {
   PyUpb_ObjCache_Delete(base->def);
   Py_DECREF(base->pool);
@@ -1167,11 +1180,14 @@ static PyObject* PyUpb_FileDescriptor_GetPackage(PyObject* _self,
   return PyUnicode_FromString(upb_FileDef_Package(self->def));
 }
 
-static PyObject* PyUpb_FileDescriptor_GetSerializedPb(PyObject* self,
+static PyObject* PyUpb_FileDescriptor_GetSerializedPb(PyObject* _self,
                                                       void* closure) {
-  return PyUpb_DescriptorBase_GetSerializedProto(
-      self, (PyUpb_ToProto_Func*)&upb_FileDef_ToProto,
-      &google_protobuf_FileDescriptorProto_msg_init);
+  PyUpb_DescriptorBase* self = (PyUpb_DescriptorBase*)_self;
+  upb_StringView serialized;
+  if (!upb_FileDef_SerializedProto(self->def, &serialized)) {
+    PYUPB_RETURN_OOM;
+  }
+  return PyBytes_FromStringAndSize(serialized.data, serialized.size);
 }
 
 static PyObject* PyUpb_FileDescriptor_GetMessageTypesByName(PyObject* _self,
@@ -1280,10 +1296,12 @@ static PyObject* PyUpb_FileDescriptor_GetOptions(PyObject* _self,
 
 static PyObject* PyUpb_FileDescriptor_CopyToProto(PyObject* _self,
                                                   PyObject* py_proto) {
-  return PyUpb_DescriptorBase_CopyToProto(
-      _self, (PyUpb_ToProto_Func*)&upb_FileDef_ToProto,
-      &google_protobuf_FileDescriptorProto_msg_init,
-      PYUPB_DESCRIPTOR_PROTO_PACKAGE ".FileDescriptorProto", py_proto);
+  if (!PyUpb_DescriptorBase_CheckProtoType(
+          py_proto, PYUPB_DESCRIPTOR_PROTO_PACKAGE ".FileDescriptorProto")) {
+    return NULL;
+  }
+  return PyUpb_DescriptorBase_MergeSerialized(
+      py_proto, PyUpb_FileDescriptor_GetSerializedPb(_self, NULL));
 }
 
 static PyGetSetDef PyUpb_FileDescriptor_Getters[] = {
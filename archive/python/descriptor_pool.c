@@ -212,7 +212,14 @@ static PyObject* PyUpb_DescriptorPool_DoAddSerializedFile(
 
   if (file) {
     // If the existing file is equal to the new file, then silently ignore the
-    // duplicate add.
+    // duplicate add.  Usually it was added from the same bytes.
+    upb_StringView existing_pb;
+    if (upb_FileDef_SerializedProto(file, &existing_pb) &&
+        existing_pb.size == (size_t)size &&
+        memcmp(existing_pb.data, buf, size) == 0) {
+      result = PyUpb_FileDescriptor_Get(file);
+      goto done;
+    }
     google_protobuf_FileDescriptorProto* existing =
         upb_FileDef_ToProto(file, arena);
     if (!existing) {
@@ -220,7 +227,7 @@ static PyObject* PyUpb_DescriptorPool_DoAddSerializedFile(
       goto done;
     }
     const upb_MessageDef* m = PyUpb_DescriptorPool_GetFileProtoDef();
-    if (upb_Message_IsEqual(proto, existing, m)) {
+    if (PyUpb_MessageContents_IsEqual(proto, existing, m)) {
       result = PyUpb_FileDescriptor_Get(file);
       goto done;
     }
@@ -233,8 +240,9 @@ static PyObject* PyUpb_DescriptorPool_DoAddSerializedFile(
   upb_Status status;
   upb_Status_Clear(&status);
 
+  PyUpb_Message_WaitForDecoders();
   const upb_FileDef* filedef =
-      upb_DefPool_AddFile(self->symtab, proto, &status);
+      upb_DefPool_AddSerializedFile(self->symtab, buf, size, &status);
   if (!filedef) {
     PyErr_Format(PyExc_TypeError,
                  "Couldn't build proto file into descriptor pool: %s",
@@ -290,6 +298,46 @@ static PyObject* PyUpb_DescriptorPool_AddSerializedFile(
   return PyUpb_DescriptorPool_DoAddSerializedFile(_self, serialized_pb);
 }
 
+/*
+ * PyUpb_DescriptorPool_RegisterSerializedFile()
+ *
+ * Implements:
+ *   DescriptorPool.RegisterSerializedFile(self, serialized_file_descriptor)
+ *
+ * Registers the given serialized FileDescriptorProto to be built the first
+ * time that the file or one of its types is looked up, so that registering
+ * many files is cheap when only a few are used.  Its imports are looked up
+ * then too, so they may be registered later.  Until it is built, the file's
+ * extensions are not found by number.
+ */
+static PyObject* PyUpb_DescriptorPool_RegisterSerializedFile(
+    PyObject* _self, PyObject* serialized_pb) {
+  PyUpb_DescriptorPool* self = (PyUpb_DescriptorPool*)_self;
+  if (self->db) {
+    PyErr_SetString(
+        PyExc_ValueError,
+        "Cannot call RegisterSerializedFile on a DescriptorPool that uses a "
+        "DescriptorDatabase. Add your file to the underlying database.");
+    return NULL;
+  }
+
+  char* buf;
+  Py_ssize_t size;
+  if (PyBytes_AsStringAndSize(serialized_pb, &buf, &size) < 0) return NULL;
+
+  upb_Status status;
+  upb_Status_Clear(&status);
+  // Lookups build registered files from now on, so they modify the pool just
+  // as adding a file does.
+  PyUpb_Message_WaitForDecoders();
+  if (!upb_DefPool_RegisterFile(self->symtab, buf, size, &status)) {
+    PyErr_Format(PyExc_TypeError, "Couldn't register proto file: %s",
+                 upb_Status_ErrorMessage(&status));
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
 static PyObject* PyUpb_DescriptorPool_Add(PyObject* _self,
                                           PyObject* file_desc) {
   PyUpb_DescriptorPool* self = (PyUpb_DescriptorPool*)_self;
@@ -572,20 +620,18 @@ static PyObject* PyUpb_DescriptorPool_FindAllExtensions(PyObject* _self,
   PyUpb_DescriptorPool* self = (PyUpb_DescriptorPool*)_self;
   const upb_MessageDef* m = PyUpb_Descriptor_GetDef(msg_desc);
   size_t n;
-  const upb_FieldDef** ext = upb_DefPool_GetAllExtensions(self->symtab, m, &n);
+  const upb_FieldDef* const* ext =
+      upb_DefPool_GetExtensions(self->symtab, m, &n);
   PyObject* ret = PyList_New(n);
-  if (!ret) goto done;
+  if (!ret) return NULL;
   for (size_t i = 0; i < n; i++) {
     PyObject* field = PyUpb_FieldDescriptor_Get(ext[i]);
     if (!field) {
       Py_DECREF(ret);
-      ret = NULL;
-      goto done;
+      return NULL;
     }
     PyList_SetItem(ret, i, field);
   }
-done:
-  free(ext);
   return ret;
 }
 
@@ -594,6 +640,9 @@ static PyMethodDef PyUpb_DescriptorPool_Methods[] = {
      "Adds the FileDescriptorProto and its types to this pool."},
     {"AddSerializedFile", PyUpb_DescriptorPool_AddSerializedFile, METH_O,
      "Adds a serialized FileDescriptorProto to this pool."},
+    {"RegisterSerializedFile", PyUpb_DescriptorPool_RegisterSerializedFile,
+     METH_O,
+     "Registers a serialized FileDescriptorProto to be built on first use."},
     {"FindFileByName", PyUpb_DescriptorPool_FindFileByName, METH_O,
      "Searches for a file descriptor by its .proto name."},
     {"FindMessageTypeByName", PyUpb_DescriptorPool_FindMessageTypeByName,
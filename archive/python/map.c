@@ -137,6 +137,7 @@ void PyUpb_MapContainer_Invalidate(PyObject* obj) {
 upb_Map* PyUpb_MapContainer_EnsureReified(PyObject* _self) {
   PyUpb_MapContainer* self = (PyUpb_MapContainer*)_self;
   self->version++;
+  PyUpb_Message_NoteMutation();
   upb_Map* map = PyUpb_MapContainer_GetIfReified(self);
   if (map) return map;  // Already writable.
 
@@ -311,31 +312,105 @@ static PyObject* PyUpb_MapContainer_MergeFrom(PyObject* _self, PyObject* _arg) {
   Py_RETURN_NONE;
 }
 
-static PyObject* PyUpb_MapContainer_Repr(PyObject* _self) {
+// Converts the whole map to a dict, resolving the entry fields only once.
+static PyObject* PyUpb_MapContainer_ToDict(PyObject* _self, PyObject* arg) {
   PyUpb_MapContainer* self = (PyUpb_MapContainer*)_self;
   upb_Map* map = PyUpb_MapContainer_GetIfReified(self);
   PyObject* dict = PyDict_New();
-  if (map) {
-    const upb_FieldDef* f = PyUpb_MapContainer_GetField(self);
-    const upb_MessageDef* entry_m = upb_FieldDef_MessageSubDef(f);
-    const upb_FieldDef* key_f = upb_MessageDef_Field(entry_m, 0);
-    const upb_FieldDef* val_f = upb_MessageDef_Field(entry_m, 1);
-    size_t iter = kUpb_Map_Begin;
-    upb_MessageValue map_key, map_val;
-    while (upb_Map_Next(map, &map_key, &map_val, &iter)) {
-      PyObject* key = PyUpb_UpbToPy(map_key, key_f, self->arena);
-      PyObject* val = PyUpb_UpbToPy(map_val, val_f, self->arena);
-      if (!key || !val) {
-        Py_XDECREF(key);
-        Py_XDECREF(val);
-        Py_DECREF(dict);
-        return NULL;
+  if (!map || !dict) return dict;
+  const upb_FieldDef* f = PyUpb_MapContainer_GetField(self);
+  const upb_MessageDef* entry_m = upb_FieldDef_MessageSubDef(f);
+  const upb_FieldDef* key_f = upb_MessageDef_Field(entry_m, 0);
+  const upb_FieldDef* val_f = upb_MessageDef_Field(entry_m, 1);
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue map_key, map_val;
+  while (upb_Map_Next(map, &map_key, &map_val, &iter)) {
+    PyObject* key = PyUpb_UpbToPy(map_key, key_f, self->arena);
+    PyObject* val = PyUpb_UpbToPy(map_val, val_f, self->arena);
+    bool ok = key && val && PyDict_SetItem(dict, key, val) == 0;
+    Py_XDECREF(key);
+    Py_XDECREF(val);
+    if (!ok) {
+      Py_DECREF(dict);
+      return NULL;
+    }
+  }
+  return dict;
+}
+
+// Inserts every item of `dict` into the map, reserving room for them first.
+static bool PyUpb_MapContainer_UpdateFromDict(PyUpb_MapContainer* self,
+                                              PyObject* dict) {
+  Py_ssize_t n = PyDict_Size(dict);
+  if (n == 0) return true;
+  upb_Map* map = PyUpb_MapContainer_EnsureReified(&self->ob_base);
+  const upb_FieldDef* f = PyUpb_MapContainer_GetField(self);
+  const upb_MessageDef* entry_m = upb_FieldDef_MessageSubDef(f);
+  const upb_FieldDef* key_f = upb_MessageDef_Field(entry_m, 0);
+  const upb_FieldDef* val_f = upb_MessageDef_Field(entry_m, 1);
+  upb_Arena* arena = PyUpb_Arena_Get(self->arena);
+  if (!upb_Map_Reserve(map, upb_Map_Size(map) + n, arena)) {
+    PyErr_NoMemory();
+    return false;
+  }
+  Py_ssize_t pos = 0;
+  PyObject* key;
+  PyObject* val;
+  while (PyDict_Next(dict, &pos, &key, &val)) {
+    upb_MessageValue u_key, u_val;
+    if (!PyUpb_PyToUpb(key, key_f, &u_key, arena) ||
+        !PyUpb_PyToUpb(val, val_f, &u_val, arena)) {
+      return false;
+    }
+    // Unlike PyUpb_MapContainer_Set(), keep the version bump from
+    // EnsureReified() even if every key was already present.
+    if (upb_Map_Insert(map, u_key, u_val, arena) ==
+        kUpb_MapInsertStatus_OutOfMemory) {
+      PyErr_NoMemory();
+      return false;
+    }
+  }
+  return true;
+}
+
+// Implements MutableMapping.update() without going through __setitem__() for
+// each item.  Arguments that are not dicts are first collected into one.
+static PyObject* PyUpb_ScalarMapContainer_Update(PyObject* _self,
+                                                 PyObject* args,
+                                                 PyObject* kwargs) {
+  PyUpb_MapContainer* self = (PyUpb_MapContainer*)_self;
+  PyObject* other = NULL;
+  if (!PyArg_UnpackTuple(args, "update", 0, 1, &other)) return NULL;
+
+  if (other) {
+    PyUpb_ModuleState* state = PyUpb_ModuleState_Get();
+    PyObject* dict;
+    if (PyDict_Check(other)) {
+      dict = other;
+      Py_INCREF(dict);
+    } else if (PyObject_TypeCheck(other, state->scalar_map_container_type)) {
+      dict = PyUpb_MapContainer_ToDict(other, NULL);
+    } else {
+      dict = PyDict_New();
+      if (dict && (PyObject_HasAttrString(other, "keys")
+                       ? PyDict_Update(dict, other)
+                       : PyDict_MergeFromSeq2(dict, other, 1)) < 0) {
+        Py_CLEAR(dict);
       }
-      PyDict_SetItem(dict, key, val);
-      Py_DECREF(key);
-      Py_DECREF(val);
     }
+    if (!dict) return NULL;
+    bool ok = PyUpb_MapContainer_UpdateFromDict(self, dict);
+    Py_DECREF(dict);
+    if (!ok) return NULL;
   }
+
+  if (kwargs && !PyUpb_MapContainer_UpdateFromDict(self, kwargs)) return NULL;
+  Py_RETURN_NONE;
+}
+
+static PyObject* PyUpb_MapContainer_Repr(PyObject* _self) {
+  PyObject* dict = PyUpb_MapContainer_ToDict(_self, NULL);
+  if (!dict) return NULL;
   PyObject* repr = PyObject_Repr(dict);
   Py_DECREF(dict);
   return repr;
@@ -369,10 +444,14 @@ static PyMethodDef PyUpb_ScalarMapContainer_Methods[] = {
      "Removes all elements from the map."},
     {"get", (PyCFunction)PyUpb_MapContainer_Get, METH_VARARGS | METH_KEYWORDS,
      "Gets the value for the given key if present, or otherwise a default"},
+    {"update", (PyCFunction)PyUpb_ScalarMapContainer_Update,
+     METH_VARARGS | METH_KEYWORDS, "Updates the map from a dict or pairs."},
     {"GetEntryClass", PyUpb_MapContainer_GetEntryClass, METH_NOARGS,
      "Return the class used to build Entries of (key, value) pairs."},
     {"MergeFrom", PyUpb_MapContainer_MergeFrom, METH_O,
      "Merges a map into the current map."},
+    {"to_dict", PyUpb_MapContainer_ToDict, METH_NOARGS,
+     "Returns a dict with the contents of the map."},
     /*
    { "__deepcopy__", (PyCFunction)DeepCopy, METH_VARARGS,
      "Makes a deep copy of the class." },
@@ -418,6 +497,8 @@ static PyMethodDef PyUpb_MessageMapContainer_Methods[] = {
      "Return the class used to build Entries of (key, value) pairs."},
     {"MergeFrom", PyUpb_MapContainer_MergeFrom, METH_O,
      "Merges a map into the current map."},
+    {"to_dict", PyUpb_MapContainer_ToDict, METH_NOARGS,
+     "Returns a dict with the contents of the map."},
     /*
    { "__deepcopy__", (PyCFunction)DeepCopy, METH_VARARGS,
      "Makes a deep copy of the class." },
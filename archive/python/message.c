@@ -36,12 +36,20 @@
 #include "python/map.h"
 #include "python/repeated.h"
 #include "upb/message/copy.h"
+#include "upb/message/internal/extension.h"
+#include "upb/port/atomic.h"
 #include "upb/reflection/def.h"
+#include "upb/reflection/internal/def_pool.h"
 #include "upb/reflection/message.h"
 #include "upb/text/encode.h"
 #include "upb/util/required_fields.h"
 
+// Must be last.
+#include "upb/port/def.inc"
+
 static const upb_MessageDef* PyUpb_MessageMeta_GetMsgdef(PyObject* cls);
+static const upb_FieldDef* PyUpb_MessageMeta_FindField(PyObject* cls,
+                                                       PyObject* py_name);
 static PyObject* PyUpb_MessageMeta_GetAttr(PyObject* self, PyObject* name);
 
 // -----------------------------------------------------------------------------
@@ -204,6 +212,10 @@ typedef struct PyUpb_Message {
   // name->obj dict for non-present msg/map/repeated, NULL if none.
   PyUpb_WeakMap* unset_subobj_map;
   int version;
+  // Cached result of __getstate__(), or NULL.  Only valid while the mutation
+  // count still equals `serialized_mutations`.
+  PyObject* serialized;
+  uint64_t serialized_mutations;
 } PyUpb_Message;
 
 static PyObject* PyUpb_Message_GetAttr(PyObject* _self, PyObject* attr);
@@ -263,6 +275,7 @@ static PyObject* PyUpb_Message_New(PyObject* cls, PyObject* unused_args,
   msg->unset_subobj_map = NULL;
   msg->ext_dict = NULL;
   msg->version = 0;
+  msg->serialized = NULL;
 
   PyObject* ret = &msg->ob_base;
   PyUpb_ObjCache_Add(msg->ptr.msg, ret);
@@ -551,6 +564,7 @@ static PyObject* PyUpb_Message_NewStub(PyObject* parent, const upb_FieldDef* f,
   msg->unset_subobj_map = NULL;
   msg->ext_dict = NULL;
   msg->version = 0;
+  msg->serialized = NULL;
 
   Py_DECREF(cls);
   Py_INCREF(parent);
@@ -592,7 +606,7 @@ static bool PyUpb_Message_IsEqual(PyUpb_Message* m1, PyObject* _m2) {
   const bool e2 = PyUpb_Message_IsEmpty(m2_msg, m1_msgdef, symtab);
   if (e1 || e2) return e1 && e2;
 
-  return upb_Message_IsEqual(m1_msg, m2_msg, m1_msgdef);
+  return PyUpb_MessageContents_IsEqual(m1_msg, m2_msg, m1_msgdef);
 }
 
 static const upb_FieldDef* PyUpb_Message_InitAsMsg(PyUpb_Message* m,
@@ -633,6 +647,7 @@ static void PyUpb_Message_SetField(PyUpb_Message* parent, const upb_FieldDef* f,
  *   PyUpb_Message_IsStub(self) is false
  */
 void PyUpb_Message_EnsureReified(PyUpb_Message* self) {
+  PyUpb_Message_NoteMutation();
   if (!PyUpb_Message_IsStub(self)) return;
   upb_Arena* arena = PyUpb_Arena_Get(self->arena);
 
@@ -810,6 +825,7 @@ static void PyUpb_Message_Dealloc(PyObject* _self) {
     PyUpb_WeakMap_Free(self->unset_subobj_map);
   }
 
+  Py_XDECREF(self->serialized);
   Py_DECREF(self->arena);
 
   // We do not use PyUpb_Dealloc() here because Message is a base type and for
@@ -840,6 +856,7 @@ PyObject* PyUpb_Message_Get(upb_Message* u_msg, const upb_MessageDef* m,
   py_msg->unset_subobj_map = NULL;
   py_msg->ext_dict = NULL;
   py_msg->version = 0;
+  py_msg->serialized = NULL;
   ret = &py_msg->ob_base;
   Py_DECREF(cls);
   Py_INCREF(arena);
@@ -975,6 +992,12 @@ int PyUpb_Message_GetVersion(PyObject* _self) {
   return self->version;
 }
 
+// A single count shared by all messages, because a submessage does not know
+// which parents would have to invalidate their cached serialization.
+static uint64_t PyUpb_Message_MutationCount;
+
+void PyUpb_Message_NoteMutation(void) { PyUpb_Message_MutationCount++; }
+
 /*
  * PyUpb_Message_GetAttr()
  *
@@ -989,10 +1012,9 @@ __attribute__((flatten)) static PyObject* PyUpb_Message_GetAttr(
   PyUpb_Message* self = (void*)_self;
 
   // Lookup field by name.
-  const upb_FieldDef* field;
-  if (PyUpb_Message_LookupName(self, attr, &field, NULL, NULL)) {
-    return PyUpb_Message_GetFieldValue(_self, field);
-  }
+  const upb_FieldDef* field =
+      PyUpb_MessageMeta_FindField((PyObject*)Py_TYPE(self), attr);
+  if (field) return PyUpb_Message_GetFieldValue(_self, field);
 
   // Check base class attributes.
   assert(!PyErr_Occurred());
@@ -1022,9 +1044,10 @@ __attribute__((flatten)) static PyObject* PyUpb_Message_GetAttr(
 static int PyUpb_Message_SetAttr(PyObject* _self, PyObject* attr,
                                  PyObject* value) {
   PyUpb_Message* self = (void*)_self;
-  const upb_FieldDef* field;
-  if (!PyUpb_Message_LookupName(self, attr, &field, NULL,
-                                PyExc_AttributeError)) {
+  const upb_FieldDef* field =
+      PyUpb_MessageMeta_FindField((PyObject*)Py_TYPE(self), attr);
+  if (!field && !PyUpb_Message_LookupName(self, attr, &field, NULL,
+                                          PyExc_AttributeError)) {
     return -1;
   }
 
@@ -1095,14 +1118,6 @@ static PyObject* PyUpb_Message_IsInitialized(PyObject* _self, PyObject* args) {
   }
 }
 
-static PyObject* PyUpb_Message_ListFieldsItemKey(PyObject* self,
-                                                 PyObject* val) {
-  assert(PyTuple_Check(val));
-  PyObject* field = PyTuple_GetItem(val, 0);
-  const upb_FieldDef* f = PyUpb_FieldDescriptor_GetDef(field);
-  return PyLong_FromLong(upb_FieldDef_Number(f));
-}
-
 static PyObject* PyUpb_Message_CheckCalledFromGeneratedFile(
     PyObject* unused, PyObject* unused_arg) {
   PyErr_SetString(
@@ -1122,69 +1137,85 @@ static PyObject* PyUpb_Message_CheckCalledFromGeneratedFile(
   return NULL;
 }
 
-static bool PyUpb_Message_SortFieldList(PyObject* list) {
-  PyUpb_ModuleState* state = PyUpb_ModuleState_Get();
-  bool ok = false;
-  PyObject* args = PyTuple_New(0);
-  PyObject* kwargs = PyDict_New();
-  PyObject* method = PyObject_GetAttrString(list, "sort");
-  PyObject* call_result = NULL;
-  if (!args || !kwargs || !method) goto err;
-  if (PyDict_SetItemString(kwargs, "key", state->listfields_item_key) < 0) {
-    goto err;
-  }
-  call_result = PyObject_Call(method, args, kwargs);
-  if (!call_result) goto err;
-  ok = true;
-
-err:
-  Py_XDECREF(method);
-  Py_XDECREF(args);
-  Py_XDECREF(kwargs);
-  Py_XDECREF(call_result);
+typedef struct {
+  uint32_t number;
+  const upb_FieldDef* f;
+} PyUpb_ListFieldsExt;
+
+static int PyUpb_ListFieldsExt_Compare(const void* _a, const void* _b) {
+  const PyUpb_ListFieldsExt* a = _a;
+  const PyUpb_ListFieldsExt* b = _b;
+  return a->number < b->number ? -1 : a->number > b->number;
+}
+
+// Appends the (descriptor, value) tuple for `f` to `list`.
+static bool PyUpb_Message_AppendListField(PyObject* _self, PyObject* list,
+                                          const upb_FieldDef* f) {
+  PyObject* field_desc = PyUpb_FieldDescriptor_Get(f);
+  PyObject* py_val = PyUpb_Message_GetFieldValue(_self, f);
+  if (!field_desc || !py_val) {
+    Py_XDECREF(field_desc);
+    Py_XDECREF(py_val);
+    return false;
+  }
+  PyObject* tuple = Py_BuildValue("(NN)", field_desc, py_val);
+  if (!tuple) return false;
+  bool ok = PyList_Append(list, tuple) == 0;
+  Py_DECREF(tuple);
   return ok;
 }
 
 static PyObject* PyUpb_Message_ListFields(PyObject* _self, PyObject* arg) {
   PyObject* list = PyList_New(0);
   upb_Message* msg = PyUpb_Message_GetIfReified(_self);
-  if (!msg) return list;
+  if (!msg || !list) return list;
 
-  size_t iter1 = kUpb_Message_Begin;
   const upb_MessageDef* m = PyUpb_Message_GetMsgdef(_self);
   const upb_DefPool* symtab = upb_FileDef_Pool(upb_MessageDef_File(m));
+
+  // Users rely on fields being returned in field number order.  Regular
+  // fields already come back in that order, but extensions are stored in
+  // reverse order of creation, so we sort them here and merge the two.
+  size_t ext_count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &ext_count);
+  PyUpb_ListFieldsExt* exts = NULL;
+  size_t n = 0;
+  if (ext_count) {
+    exts = PyMem_Malloc(ext_count * sizeof(*exts));
+    if (!exts) {
+      PyErr_NoMemory();
+      goto err;
+    }
+    for (size_t i = 0; i < ext_count; i++) {
+      const upb_FieldDef* f =
+          upb_DefPool_FindExtensionByMiniTable(symtab, ext[i].ext);
+      if (!f) continue;
+      exts[n].number = upb_FieldDef_Number(f);
+      exts[n].f = f;
+      n++;
+    }
+    qsort(exts, n, sizeof(*exts), PyUpb_ListFieldsExt_Compare);
+  }
+
+  size_t iter = kUpb_Message_Begin;
+  size_t j = 0;
   const upb_FieldDef* f;
-  PyObject* field_desc = NULL;
-  PyObject* py_val = NULL;
-  PyObject* tuple = NULL;
   upb_MessageValue val;
-  uint32_t last_field = 0;
-  bool in_order = true;
-  while (upb_Message_Next(msg, m, symtab, &f, &val, &iter1)) {
-    const uint32_t field_number = upb_FieldDef_Number(f);
-    if (field_number < last_field) in_order = false;
-    last_field = field_number;
-    PyObject* field_desc = PyUpb_FieldDescriptor_Get(f);
-    PyObject* py_val = PyUpb_Message_GetFieldValue(_self, f);
-    if (!field_desc || !py_val) goto err;
-    PyObject* tuple = Py_BuildValue("(NN)", field_desc, py_val);
-    field_desc = NULL;
-    py_val = NULL;
-    if (!tuple) goto err;
-    if (PyList_Append(list, tuple)) goto err;
-    Py_DECREF(tuple);
-    tuple = NULL;
-  }
-
-  // Users rely on fields being returned in field number order.
-  if (!in_order && !PyUpb_Message_SortFieldList(list)) goto err;
+  bool has_field = upb_Message_NextByNumber(msg, m, &f, &val, &iter);
+  while (has_field || j < n) {
+    if (j < n && (!has_field || exts[j].number < upb_FieldDef_Number(f))) {
+      if (!PyUpb_Message_AppendListField(_self, list, exts[j++].f)) goto err;
+    } else {
+      if (!PyUpb_Message_AppendListField(_self, list, f)) goto err;
+      has_field = upb_Message_NextByNumber(msg, m, &f, &val, &iter);
+    }
+  }
 
+  PyMem_Free(exts);
   return list;
 
 err:
-  Py_XDECREF(field_desc);
-  Py_XDECREF(py_val);
-  Py_XDECREF(tuple);
+  PyMem_Free(exts);
   Py_DECREF(list);
   return NULL;
 }
@@ -1198,17 +1229,37 @@ static PyObject* PyUpb_Message_MergeInternal(PyObject* self, PyObject* arg,
                  Py_TYPE(self), Py_TYPE(arg));
     return NULL;
   }
-  // OPT: exit if src is empty.
-  PyObject* subargs = PyTuple_New(0);
-  PyObject* serialized =
-      check_required
-          ? PyUpb_Message_SerializeToString(arg, subargs, NULL)
-          : PyUpb_Message_SerializePartialToString(arg, subargs, NULL);
-  Py_DECREF(subargs);
-  if (!serialized) return NULL;
-  PyObject* ret = PyUpb_Message_MergeFromString(self, serialized);
-  Py_DECREF(serialized);
-  Py_XDECREF(ret);
+  PyUpb_Message* msg = (void*)self;
+  const upb_MessageDef* msgdef = _PyUpb_Message_GetMsgdef(msg);
+  const upb_Message* other_msg = PyUpb_Message_GetIfReified(arg);
+  // Merging a message into itself needs a copy of it first, and a missing
+  // required field must raise the same error as serializing does, so these go
+  // through the wire format.
+  if (self == arg ||
+      (check_required && other_msg &&
+       upb_util_HasUnsetRequired(other_msg, msgdef,
+                                 upb_FileDef_Pool(upb_MessageDef_File(msgdef)),
+                                 NULL))) {
+    PyObject* subargs = PyTuple_New(0);
+    PyObject* serialized =
+        check_required
+            ? PyUpb_Message_SerializeToString(arg, subargs, NULL)
+            : PyUpb_Message_SerializePartialToString(arg, subargs, NULL);
+    Py_DECREF(subargs);
+    if (!serialized) return NULL;
+    PyObject* ret = PyUpb_Message_MergeFromString(self, serialized);
+    Py_DECREF(serialized);
+    Py_XDECREF(ret);
+    Py_RETURN_NONE;
+  }
+  PyUpb_Message_EnsureReified(msg);
+  if (other_msg &&
+      !upb_Message_Merge(msg->ptr.msg, other_msg,
+                         upb_MessageDef_MiniTable(msgdef),
+                         PyUpb_Arena_Get(msg->arena))) {
+    return PyErr_NoMemory();
+  }
+  PyUpb_Message_SyncSubobjs(msg);
   Py_RETURN_NONE;
 }
 
@@ -1264,36 +1315,132 @@ static PyObject* PyUpb_Message_UnknownFields(PyObject* _self, PyObject* arg) {
   return NULL;
 }
 
-PyObject* PyUpb_Message_MergeFromString(PyObject* _self, PyObject* arg) {
-  PyUpb_Message* self = (void*)_self;
-  char* buf;
-  Py_ssize_t size;
-  PyObject* bytes = NULL;
-
-  if (PyMemoryView_Check(arg)) {
+// Returns a new reference to an object that owns `*buf`, a contiguous view of
+// `arg`.  `arg` may be any object supporting the buffer protocol;
+// non-contiguous buffers are copied.
+static PyObject* PyUpb_Message_GetBuffer(PyObject* arg, const char** buf,
+                                         Py_ssize_t* size) {
+  PyObject* bytes;
+  if (PyBytes_Check(arg)) {
+    Py_INCREF(arg);
+    bytes = arg;
+  } else {
+#if defined(Py_LIMITED_API) && Py_LIMITED_API < 0x030b0000
+    // The buffer protocol is not in the limited API before 3.11.
     bytes = PyBytes_FromObject(arg);
-    // Cannot fail when passed something of the correct type.
-    int err = PyBytes_AsStringAndSize(bytes, &buf, &size);
-    (void)err;
-    assert(err >= 0);
-  } else if (PyBytes_AsStringAndSize(arg, &buf, &size) < 0) {
+#else
+    PyObject* view = PyMemoryView_FromObject(arg);
+    if (!view) return NULL;
+    Py_buffer pybuf;
+    if (PyObject_GetBuffer(view, &pybuf, PyBUF_SIMPLE) == 0) {
+      // `view` holds its own export of the buffer, which keeps `*buf` valid.
+      *buf = pybuf.buf;
+      *size = pybuf.len;
+      PyBuffer_Release(&pybuf);
+      return view;
+    }
+    PyErr_Clear();  // Not contiguous.
+    bytes = PyBytes_FromObject(view);
+    Py_DECREF(view);
+#endif
+    if (!bytes) return NULL;
+  }
+  char* data;
+  if (PyBytes_AsStringAndSize(bytes, &data, size) < 0) {
+    Py_DECREF(bytes);
     return NULL;
   }
+  *buf = data;
+  return bytes;
+}
+
+static int PyUpb_Message_DecodeOptions(PyUpb_ModuleState* state) {
+  return upb_DecodeOptions_MaxDepth(state->allow_oversize_protos
+                                        ? UINT16_MAX
+                                        : kUpb_WireFormat_DefaultDepthLimit);
+}
+
+// Payloads at least this large are encoded and decoded with the GIL released,
+// so that other threads can run meanwhile.
+enum { kPyUpb_Message_GilReleaseThreshold = 64 * 1024 };
+
+// The number of threads currently decoding with the GIL released.  Decoding
+// reads the def pool's extension registry, so PyUpb_Message_WaitForDecoders()
+// must be called before the registry is modified.
+static UPB_ATOMIC(int) PyUpb_Message_GilFreeDecoders;
+
+void PyUpb_Message_WaitForDecoders(void) {
+  // New decoders cannot start because the caller holds the GIL, and running
+  // ones finish without it, so this spin is bounded.
+  while (upb_Atomic_Load(&PyUpb_Message_GilFreeDecoders,
+                         memory_order_acquire) > 0) {
+  }
+}
+
+// Decodes into a private message with the GIL released, then merges the result
+// into `msg` once the GIL is held again.  Other threads may use `msg` and its
+// arena meanwhile, so neither can be touched without the GIL.
+static upb_DecodeStatus PyUpb_Message_DecodeWithoutGil(
+    const char* buf, size_t size, upb_Message* msg, const upb_MiniTable* layout,
+    const upb_ExtensionRegistry* extreg, int options, upb_Arena* arena) {
+  upb_Arena* tmp_arena = upb_Arena_New();
+  if (!tmp_arena) return kUpb_DecodeStatus_OutOfMemory;
+  upb_Message* tmp = upb_Message_New(layout, tmp_arena);
+  upb_DecodeStatus status = kUpb_DecodeStatus_OutOfMemory;
+  if (tmp) {
+    upb_Atomic_Add(&PyUpb_Message_GilFreeDecoders, 1, memory_order_relaxed);
+    Py_BEGIN_ALLOW_THREADS;
+    status = upb_Decode(buf, size, tmp, layout, extreg, options, tmp_arena);
+    upb_Atomic_Sub(&PyUpb_Message_GilFreeDecoders, 1, memory_order_release);
+    Py_END_ALLOW_THREADS;
+  }
+  if (status == kUpb_DecodeStatus_Ok &&
+      !upb_Message_Merge(msg, tmp, layout, arena)) {
+    status = kUpb_DecodeStatus_OutOfMemory;
+  }
+  upb_Arena_Free(tmp_arena);
+  return status;
+}
+
+// If `alias` is true, string fields point into the buffer rather than being
+// copied, and the message's arena keeps the buffer alive.  The caller must not
+// modify the buffer afterwards.
+static PyObject* PyUpb_Message_MergeFromBuffer(PyObject* _self, PyObject* arg,
+                                               bool alias) {
+  PyUpb_Message* self = (void*)_self;
+  const char* buf;
+  Py_ssize_t size;
+  PyObject* owner = PyUpb_Message_GetBuffer(arg, &buf, &size);
+  if (!owner) return NULL;
 
   PyUpb_Message_EnsureReified(self);
   const upb_MessageDef* msgdef = _PyUpb_Message_GetMsgdef(self);
-  const upb_FileDef* file = upb_MessageDef_File(msgdef);
-  const upb_ExtensionRegistry* extreg =
-      upb_DefPool_ExtensionRegistry(upb_FileDef_Pool(file));
+  const upb_DefPool* pool = upb_FileDef_Pool(upb_MessageDef_File(msgdef));
+  const upb_ExtensionRegistry* extreg = upb_DefPool_ExtensionRegistry(pool);
   const upb_MiniTable* layout = upb_MessageDef_MiniTable(msgdef);
   upb_Arena* arena = PyUpb_Arena_Get(self->arena);
   PyUpb_ModuleState* state = PyUpb_ModuleState_Get();
-  int options = upb_DecodeOptions_MaxDepth(
-      state->allow_oversize_protos ? UINT16_MAX
-                                   : kUpb_WireFormat_DefaultDepthLimit);
+  int options = PyUpb_Message_DecodeOptions(state);
+  if (alias) {
+    if (!PyUpb_Arena_KeepAlive(self->arena, owner)) {
+      Py_DECREF(owner);
+      return NULL;
+    }
+    options |= kUpb_DecodeOption_AliasString;
+  }
+  // Aliased strings would not survive the merge out of the private message,
+  // and a pool that builds registered files on lookup may change its extension
+  // registry whenever the GIL is released.
   upb_DecodeStatus status =
-      upb_Decode(buf, size, self->ptr.msg, layout, extreg, options, arena);
-  Py_XDECREF(bytes);
+      !alias && size >= kPyUpb_Message_GilReleaseThreshold &&
+              !_upb_DefPool_LoadsLazily(pool)
+          ? PyUpb_Message_DecodeWithoutGil(buf, size, self->ptr.msg, layout,
+                                           extreg, options, arena)
+          : upb_Decode(buf, size, self->ptr.msg, layout, extreg, options,
+                       arena);
+  // Another thread may have cached a serialization while the GIL was released.
+  PyUpb_Message_NoteMutation();
+  Py_DECREF(owner);
   if (status != kUpb_DecodeStatus_Ok) {
     PyErr_Format(state->decode_error_class, "Error parsing message");
     return NULL;
@@ -1302,10 +1449,39 @@ PyObject* PyUpb_Message_MergeFromString(PyObject* _self, PyObject* arg) {
   return PyLong_FromSsize_t(size);
 }
 
-static PyObject* PyUpb_Message_ParseFromString(PyObject* self, PyObject* arg) {
+PyObject* PyUpb_Message_MergeFromString(PyObject* self, PyObject* arg) {
+  return PyUpb_Message_MergeFromBuffer(self, arg, false);
+}
+
+static bool PyUpb_Message_ParseBufferArgs(PyObject* args, PyObject* kwargs,
+                                          PyObject** serialized, int* alias) {
+  static const char* kwlist[] = {"serialized", "alias_buffer", NULL};
+  *alias = 0;
+  return PyArg_ParseTupleAndKeywords(args, kwargs, "O|$p", (char**)kwlist,
+                                     serialized, alias);
+}
+
+static PyObject* PyUpb_Message_MergeFromStringMethod(PyObject* self,
+                                                     PyObject* args,
+                                                     PyObject* kwargs) {
+  PyObject* serialized;
+  int alias;
+  if (!PyUpb_Message_ParseBufferArgs(args, kwargs, &serialized, &alias)) {
+    return NULL;
+  }
+  return PyUpb_Message_MergeFromBuffer(self, serialized, alias);
+}
+
+static PyObject* PyUpb_Message_ParseFromString(PyObject* self, PyObject* args,
+                                               PyObject* kwargs) {
+  PyObject* serialized;
+  int alias;
+  if (!PyUpb_Message_ParseBufferArgs(args, kwargs, &serialized, &alias)) {
+    return NULL;
+  }
   PyObject* tmp = PyUpb_Message_Clear((PyUpb_Message*)self);
   Py_DECREF(tmp);
-  return PyUpb_Message_MergeFromString(self, arg);
+  return PyUpb_Message_MergeFromBuffer(self, serialized, alias);
 }
 
 static PyObject* PyUpb_Message_ByteSize(PyObject* self, PyObject* args) {
@@ -1457,13 +1633,19 @@ static PyObject* PyUpb_Message_FindInitializationErrors(PyObject* _self,
   return ret;
 }
 
-static PyObject* PyUpb_Message_FromString(PyObject* cls, PyObject* serialized) {
+static PyObject* PyUpb_Message_FromString(PyObject* cls, PyObject* args,
+                                          PyObject* kwargs) {
   PyObject* ret = NULL;
   PyObject* length = NULL;
+  PyObject* serialized;
+  int alias;
 
+  if (!PyUpb_Message_ParseBufferArgs(args, kwargs, &serialized, &alias)) {
+    return NULL;
+  }
   ret = PyObject_CallObject(cls, NULL);
   if (ret == NULL) goto err;
-  length = PyUpb_Message_MergeFromString(ret, serialized);
+  length = PyUpb_Message_MergeFromBuffer(ret, serialized, alias);
   if (length == NULL) goto err;
 
 done:
@@ -1476,6 +1658,80 @@ err:
   goto done;
 }
 
+// Parses every buffer in `serialized` into a new message of type `cls`.  All
+// of the messages share one arena, so the batch costs a single arena and no
+// per-message Python calls; the arena is freed once every message is gone.
+static PyObject* PyUpb_Message_ParseMany(PyObject* cls, PyObject* args,
+                                         PyObject* kwargs) {
+  PyObject* iterable;
+  int alias;
+  if (!PyUpb_Message_ParseBufferArgs(args, kwargs, &iterable, &alias)) {
+    return NULL;
+  }
+  PyObject* it = PyObject_GetIter(iterable);
+  if (!it) return NULL;
+  PyObject* ret = PyList_New(0);
+  PyObject* py_arena = ret ? PyUpb_Arena_New() : NULL;
+  if (!py_arena) goto err;
+
+  const upb_MessageDef* msgdef = PyUpb_MessageMeta_GetMsgdef(cls);
+  const upb_ExtensionRegistry* extreg = upb_DefPool_ExtensionRegistry(
+      upb_FileDef_Pool(upb_MessageDef_File(msgdef)));
+  const upb_MiniTable* layout = upb_MessageDef_MiniTable(msgdef);
+  upb_Arena* arena = PyUpb_Arena_Get(py_arena);
+  PyUpb_ModuleState* state = PyUpb_ModuleState_Get();
+  int options = PyUpb_Message_DecodeOptions(state);
+  if (alias) options |= kUpb_DecodeOption_AliasString;
+
+  PyObject* item;
+  for (Py_ssize_t i = 0; (item = PyIter_Next(it)); i++) {
+    const char* buf;
+    Py_ssize_t size;
+    PyObject* owner = PyUpb_Message_GetBuffer(item, &buf, &size);
+    Py_DECREF(item);
+    if (!owner) goto err;
+    if (alias && !PyUpb_Arena_KeepAlive(py_arena, owner)) {
+      Py_DECREF(owner);
+      goto err;
+    }
+    upb_Message* u_msg = upb_Message_New(layout, arena);
+    upb_DecodeStatus status =
+        u_msg ? upb_Decode(buf, size, u_msg, layout, extreg, options, arena)
+              : kUpb_DecodeStatus_OutOfMemory;
+    Py_DECREF(owner);
+    if (status != kUpb_DecodeStatus_Ok) {
+      PyErr_Format(state->decode_error_class,
+                   "Error parsing message at index %zd", i);
+      goto err;
+    }
+    PyUpb_Message* msg = (void*)PyType_GenericAlloc((PyTypeObject*)cls, 0);
+    if (!msg) goto err;
+    msg->def = (uintptr_t)msgdef;
+    msg->arena = py_arena;
+    msg->ptr.msg = u_msg;
+    msg->unset_subobj_map = NULL;
+    msg->ext_dict = NULL;
+    msg->version = 0;
+    msg->serialized = NULL;
+    Py_INCREF(py_arena);
+    PyUpb_ObjCache_Add(u_msg, &msg->ob_base);
+    int appended = PyList_Append(ret, &msg->ob_base) == 0;
+    Py_DECREF(&msg->ob_base);
+    if (!appended) goto err;
+  }
+  if (PyErr_Occurred()) goto err;
+
+  Py_DECREF(py_arena);
+  Py_DECREF(it);
+  return ret;
+
+err:
+  Py_XDECREF(py_arena);
+  Py_XDECREF(ret);
+  Py_DECREF(it);
+  return NULL;
+}
+
 const upb_FieldDef* PyUpb_Message_GetExtensionDef(PyObject* _self,
                                                   PyObject* key) {
   const upb_FieldDef* f = PyUpb_FieldDescriptor_GetDef(key);
@@ -1563,8 +1819,17 @@ PyObject* PyUpb_Message_SerializeInternal(PyObject* _self, PyObject* args,
   if (check_required) options |= kUpb_EncodeOption_CheckRequired;
   if (deterministic) options |= kUpb_EncodeOption_Deterministic;
   char* pb;
-  upb_EncodeStatus status =
-      upb_Encode(self->ptr.msg, layout, options, arena, &pb, &size);
+  upb_EncodeStatus status;
+  if (upb_Arena_SpaceAllocated(PyUpb_Arena_Get(self->arena)) >=
+      kPyUpb_Message_GilReleaseThreshold) {
+    // The encoder only reads the message and allocates from its own arena.
+    // The message stays alive because we hold a reference to it.
+    Py_BEGIN_ALLOW_THREADS;
+    status = upb_Encode(self->ptr.msg, layout, options, arena, &pb, &size);
+    Py_END_ALLOW_THREADS;
+  } else {
+    status = upb_Encode(self->ptr.msg, layout, options, arena, &pb, &size);
+  }
   PyObject* ret = NULL;
 
   if (status != kUpb_EncodeStatus_Ok) {
@@ -1610,19 +1875,78 @@ static PyObject* PyUpb_Message_WhichOneof(PyObject* _self, PyObject* name) {
   return PyUnicode_FromString(upb_FieldDef_Name(f));
 }
 
-PyObject* DeepCopy(PyObject* _self, PyObject* arg) {
+static PyObject* PyUpb_Message_DeepCopy(PyObject* _self, PyObject* arg) {
   PyUpb_Message* self = (void*)_self;
+  const upb_MessageDef* msgdef = _PyUpb_Message_GetMsgdef(self);
+
+  // An unset submessage has no data, so its copy is a new empty message.
+  if (PyUpb_Message_IsStub(self)) {
+    PyObject* cls = PyUpb_Descriptor_GetClass(msgdef);
+    PyObject* ret = PyObject_CallObject(cls, NULL);
+    Py_DECREF(cls);
+    return ret;
+  }
 
   PyObject* arena = PyUpb_Arena_New();
+  if (!arena) return NULL;
   upb_Message* clone =
-      upb_Message_DeepClone(self->ptr.msg, upb_MessageDef_MiniTable((const upb_MessageDef*)self->def),
+      upb_Message_DeepClone(self->ptr.msg, upb_MessageDef_MiniTable(msgdef),
                             PyUpb_Arena_Get(arena));
-  PyObject* ret = PyUpb_Message_Get(clone, (const upb_MessageDef*)self->def, arena);
+  PyObject* ret = clone ? PyUpb_Message_Get(clone, msgdef, arena)
+                        : PyErr_NoMemory();
   Py_DECREF(arena);
-
   return ret;
 }
 
+// Implements the pickle protocol together with Message.__reduce__().  Pickling
+// the same unchanged message repeatedly, as when it is sent to many worker
+// processes, serializes it only once.
+static PyObject* PyUpb_Message_GetState(PyObject* _self, PyObject* arg) {
+  PyUpb_Message* self = (void*)_self;
+  if (!self->serialized ||
+      self->serialized_mutations != PyUpb_Message_MutationCount) {
+    // Serializing may release the GIL, so read the count first.
+    uint64_t mutations = PyUpb_Message_MutationCount;
+    PyObject* subargs = PyTuple_New(0);
+    PyObject* serialized =
+        PyUpb_Message_SerializePartialToString(_self, subargs, NULL);
+    Py_DECREF(subargs);
+    if (!serialized) return NULL;
+    Py_XDECREF(self->serialized);
+    self->serialized = serialized;
+    self->serialized_mutations = mutations;
+  }
+  return Py_BuildValue("{sO}", "serialized", self->serialized);
+}
+
+static PyObject* PyUpb_Message_SetState(PyObject* _self, PyObject* state) {
+  PyUpb_Message* self = (void*)_self;
+  PyObject* serialized = PyMapping_GetItemString(state, "serialized");
+  if (!serialized) return NULL;
+  // Protos pickled by Python 2 store the serialized data as a str.
+  if (PyUnicode_Check(serialized)) {
+    PyObject* bytes = PyUnicode_AsLatin1String(serialized);
+    Py_DECREF(serialized);
+    if (!bytes) return NULL;
+    serialized = bytes;
+  }
+
+  PyObject* tmp = PyUpb_Message_Clear(self);
+  Py_DECREF(tmp);
+  tmp = PyUpb_Message_MergeFromString(_self, serialized);
+  if (!tmp) {
+    Py_DECREF(serialized);
+    return NULL;
+  }
+  Py_DECREF(tmp);
+
+  // Parsing `serialized` yields this message again, so it can be pickled as is.
+  Py_XDECREF(self->serialized);
+  self->serialized = serialized;
+  self->serialized_mutations = PyUpb_Message_MutationCount;
+  Py_RETURN_NONE;
+}
+
 void PyUpb_Message_ClearExtensionDict(PyObject* _self) {
   PyUpb_Message* self = (void*)_self;
   assert(self->ext_dict);
@@ -1652,8 +1976,12 @@ static PyGetSetDef PyUpb_Message_Getters[] = {
     {NULL}};
 
 static PyMethodDef PyUpb_Message_Methods[] = {
-    {"__deepcopy__", (PyCFunction)DeepCopy, METH_VARARGS,
+    {"__deepcopy__", (PyCFunction)PyUpb_Message_DeepCopy, METH_VARARGS,
      "Makes a deep copy of the class."},
+    {"__getstate__", PyUpb_Message_GetState, METH_NOARGS,
+     "Returns the pickled state of the message."},
+    {"__setstate__", PyUpb_Message_SetState, METH_O,
+     "Restores the message from its pickled state."},
     // TODO(https://github.com/protocolbuffers/upb/issues/459)
     //{ "__unicode__", (PyCFunction)ToUnicode, METH_NOARGS,
     //  "Outputs a unicode representation of the message." },
@@ -1670,7 +1998,8 @@ static PyMethodDef PyUpb_Message_Methods[] = {
      METH_NOARGS, "Discards the unknown fields."},
     {"FindInitializationErrors", PyUpb_Message_FindInitializationErrors,
      METH_NOARGS, "Finds unset required fields."},
-    {"FromString", PyUpb_Message_FromString, METH_O | METH_CLASS,
+    {"FromString", (PyCFunction)PyUpb_Message_FromString,
+     METH_VARARGS | METH_KEYWORDS | METH_CLASS,
      "Creates new method instance from given serialized data."},
     {"HasExtension", PyUpb_Message_HasExtension, METH_O,
      "Checks if a message field is set."},
@@ -1682,10 +2011,19 @@ static PyMethodDef PyUpb_Message_Methods[] = {
      "Lists all set fields of a message."},
     {"MergeFrom", PyUpb_Message_MergeFrom, METH_O,
      "Merges a protocol message into the current message."},
-    {"MergeFromString", PyUpb_Message_MergeFromString, METH_O,
-     "Merges a serialized message into the current message."},
-    {"ParseFromString", PyUpb_Message_ParseFromString, METH_O,
-     "Parses a serialized message into the current message."},
+    {"MergeFromString", (PyCFunction)PyUpb_Message_MergeFromStringMethod,
+     METH_VARARGS | METH_KEYWORDS,
+     "Merges a serialized message into the current message.  With "
+     "alias_buffer=True, string fields alias the buffer instead of copying "
+     "it; the buffer is kept alive and must not be modified."},
+    {"ParseFromString", (PyCFunction)PyUpb_Message_ParseFromString,
+     METH_VARARGS | METH_KEYWORDS,
+     "Parses a serialized message into the current message.  Accepts "
+     "alias_buffer like MergeFromString()."},
+    {"ParseMany", (PyCFunction)PyUpb_Message_ParseMany,
+     METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+     "Parses a sequence of serialized messages into a list of new messages "
+     "that share one arena.  Accepts alias_buffer like MergeFromString()."},
     {"SerializePartialToString",
      (PyCFunction)PyUpb_Message_SerializePartialToString,
      METH_VARARGS | METH_KEYWORDS,
@@ -1700,9 +2038,6 @@ static PyMethodDef PyUpb_Message_Methods[] = {
     {"WhichOneof", PyUpb_Message_WhichOneof, METH_O,
      "Returns the name of the field set inside a oneof, "
      "or None if no field is set."},
-    {"_ListFieldsItemKey", PyUpb_Message_ListFieldsItemKey,
-     METH_O | METH_STATIC,
-     "Compares ListFields() list entries by field number"},
     {"_CheckCalledFromGeneratedFile",
      PyUpb_Message_CheckCalledFromGeneratedFile, METH_NOARGS | METH_STATIC,
      "Raises TypeError if the caller is not in a _pb2.py file."},
@@ -1747,6 +2082,9 @@ PyType_Spec PyUpb_Message_Spec = {
 typedef struct {
   const upb_MiniTable* layout;
   PyObject* py_message_descriptor;
+  // Maps each field's interned name to its index in the message def, so that
+  // attribute access can use the name's cached hash.
+  PyObject* fields;
 } PyUpb_MessageMeta;
 
 // The PyUpb_MessageMeta struct is trailing data tacked onto the end of
@@ -1765,6 +2103,35 @@ static const upb_MessageDef* PyUpb_MessageMeta_GetMsgdef(PyObject* cls) {
   return PyUpb_Descriptor_GetDef(self->py_message_descriptor);
 }
 
+static const upb_FieldDef* PyUpb_MessageMeta_FindField(PyObject* cls,
+                                                       PyObject* py_name) {
+  PyUpb_MessageMeta* self = PyUpb_GetMessageMeta(cls);
+  PyObject* index = PyDict_GetItem(self->fields, py_name);  // Borrowed.
+  if (!index) return NULL;
+  const upb_MessageDef* m =
+      PyUpb_Descriptor_GetDef(self->py_message_descriptor);
+  return upb_MessageDef_Field(m, PyLong_AsLong(index));
+}
+
+static PyObject* PyUpb_MessageMeta_BuildFieldMap(const upb_MessageDef* m) {
+  PyObject* fields = PyDict_New();
+  if (!fields) return NULL;
+  for (int i = 0, n = upb_MessageDef_FieldCount(m); i < n; i++) {
+    const upb_FieldDef* f = upb_MessageDef_Field(m, i);
+    PyObject* name = PyUnicode_FromString(upb_FieldDef_Name(f));
+    PyObject* index = name ? PyLong_FromLong(i) : NULL;
+    if (index) PyUnicode_InternInPlace(&name);
+    bool ok = index && PyDict_SetItem(fields, name, index) == 0;
+    Py_XDECREF(name);
+    Py_XDECREF(index);
+    if (!ok) {
+      Py_DECREF(fields);
+      return NULL;
+    }
+  }
+  return fields;
+}
+
 PyObject* PyUpb_MessageMeta_DoCreateClass(PyObject* py_descriptor,
                                           const char* name, PyObject* dict) {
   PyUpb_ModuleState* state = PyUpb_ModuleState_Get();
@@ -1798,13 +2165,23 @@ PyObject* PyUpb_MessageMeta_DoCreateClass(PyObject* py_descriptor,
                          state->message_class, wkt_base, dict);
   }
 
+  PyObject* fields = PyUpb_MessageMeta_BuildFieldMap(msgdef);
+  if (!fields) {
+    Py_DECREF(args);
+    return NULL;
+  }
+
   PyObject* ret = cpython_bits.type_new(state->message_meta_type, args, NULL);
   Py_DECREF(args);
-  if (!ret) return NULL;
+  if (!ret) {
+    Py_DECREF(fields);
+    return NULL;
+  }
 
   PyUpb_MessageMeta* meta = PyUpb_GetMessageMeta(ret);
   meta->py_message_descriptor = py_descriptor;
   meta->layout = upb_MessageDef_MiniTable(msgdef);
+  meta->fields = fields;
   Py_INCREF(meta->py_message_descriptor);
 
   PyUpb_ObjCache_Add(meta->layout, ret);
@@ -1853,6 +2230,7 @@ static void PyUpb_MessageMeta_Dealloc(PyObject* self) {
   PyUpb_MessageMeta* meta = PyUpb_GetMessageMeta(self);
   PyUpb_ObjCache_Delete(meta->layout);
   Py_DECREF(meta->py_message_descriptor);
+  Py_XDECREF(meta->fields);
   PyTypeObject* tp = Py_TYPE(self);
   cpython_bits.type_dealloc(self);
   Py_DECREF(tp);
@@ -1978,8 +2356,6 @@ bool PyUpb_InitMessage(PyObject* m) {
 
   if (!state->cmessage_type || !state->message_meta_type) return false;
   if (PyModule_AddObject(m, "MessageMeta", message_meta_type)) return false;
-  state->listfields_item_key = PyObject_GetAttrString(
-      (PyObject*)state->cmessage_type, "_ListFieldsItemKey");
 
   PyObject* mod =
       PyImport_ImportModule(PYUPB_PROTOBUF_PUBLIC_PACKAGE ".message");
@@ -1999,10 +2375,11 @@ bool PyUpb_InitMessage(PyObject* m) {
   Py_DECREF(enum_type_wrapper);
 
   if (!state->encode_error_class || !state->decode_error_class ||
-      !state->message_class || !state->listfields_item_key ||
-      !state->enum_type_wrapper_class) {
+      !state->message_class || !state->enum_type_wrapper_class) {
     return false;
   }
 
   return true;
 }
+
+#include "upb/port/undef.inc"
@@ -96,10 +96,19 @@ PyObject* PyUpb_Message_GetFieldValue(PyObject* _self,
 int PyUpb_Message_SetFieldValue(PyObject* _self, const upb_FieldDef* field,
                                 PyObject* value, PyObject* exc);
 
+// Waits until no thread is decoding with the GIL released.  Must be called with
+// the GIL held before adding to a upb_DefPool, whose extension registry those
+// decoders read.
+void PyUpb_Message_WaitForDecoders(void);
+
 // Returns the version associated with this message.  The version will be
 // incremented when the message changes.
 int PyUpb_Message_GetVersion(PyObject* _self);
 
+// Invalidates the serialization cached by every message's __getstate__().
+// Must be called whenever a message, repeated field or map may be modified.
+void PyUpb_Message_NoteMutation(void);
+
 // Module-level init.
 bool PyUpb_InitMessage(PyObject* m);
 
@@ -31,6 +31,7 @@
 """A bare-bones unit test that doesn't load any generated code."""
 
 
+import array
 import unittest
 from google.protobuf.pyext import _message
 from google3.net.proto2.python.internal import api_implementation
@@ -59,6 +60,16 @@ class TestMessageExtension(unittest.TestCase):
         # should result in the same object
         self.assertIs(ext_desc, pool.FindExtensionByName("test_ext"))
 
+    def test_descriptor_pool_registered_file(self):
+        serialized_desc = b'\n\ntest.proto\"\x0e\n\x02M1*\x08\x08\x01\x10\x80\x80\x80\x80\x02:\x15\n\x08test_ext\x12\x03.M1\x18\x01 \x01(\x05'
+        pool = _message.DescriptorPool()
+        self.assertIsNone(pool.RegisterSerializedFile(serialized_desc))
+        self.assertEqual("M1", pool.FindMessageTypeByName("M1").name)
+        self.assertEqual(1, pool.FindExtensionByName("test_ext").number)
+        file_desc = pool.AddSerializedFile(serialized_desc)
+        self.assertIs(file_desc, pool.FindFileByName("test.proto"))
+        self.assertRaises(TypeError, pool.RegisterSerializedFile, b"\xff")
+
 
     def test_lib_is_upb(self):
         # Ensure we are not pulling in a different protobuf library on the
@@ -86,6 +97,45 @@ class TestMessageExtension(unittest.TestCase):
         msg = unittest_pb2.TestAllTypes()
         self.assertRaises(AttributeError, getattr, msg, 'Extensions')
     
+    def testParseFromBufferAliased(self):
+        src = unittest_pb2.TestAllTypes(optional_string="hello",
+                                        repeated_bytes=[b"a", b"bc"])
+        buf = bytearray(src.SerializeToString())
+        msg = unittest_pb2.TestAllTypes()
+        msg.ParseFromString(memoryview(buf), alias_buffer=True)
+        del buf
+        self.assertEqual(src, msg)
+        msg2 = unittest_pb2.TestAllTypes.FromString(
+            memoryview(src.SerializeToString()))
+        self.assertEqual(src, msg2)
+
+    def testParseMany(self):
+        msgs = [unittest_pb2.TestAllTypes(optional_int32=i,
+                                          optional_string=str(i))
+                for i in range(3)]
+        parsed = unittest_pb2.TestAllTypes.ParseMany(
+            m.SerializeToString() for m in msgs)
+        self.assertEqual(msgs, parsed)
+        parsed[0].optional_int32 = 5
+        self.assertEqual(1, parsed[1].optional_int32)
+        with self.assertRaises(message.DecodeError):
+            unittest_pb2.TestAllTypes.ParseMany([b"", b"\xff"])
+
+    def testRepeatedScalarBuffer(self):
+        msg = unittest_pb2.TestAllTypes()
+        msg.repeated_float.extend(array.array('f', [1.5, 2.5]))
+        msg.repeated_int64.extend(array.array('q', [1, 2]))
+        msg.repeated_int64.extend([3])
+        self.assertEqual([1.5, 2.5], msg.repeated_float)
+        self.assertEqual([1, 2, 3], msg.repeated_int64)
+        view = memoryview(msg.repeated_int64)
+        self.assertTrue(view.readonly)
+        self.assertEqual('q', view.format)
+        self.assertEqual([1, 2, 3], view.tolist())
+        self.assertEqual([], memoryview(msg.repeated_double).tolist())
+        with self.assertRaises(BufferError):
+            memoryview(msg.repeated_string)
+
     def testClearStubMapField(self):
         msg = map_unittest_pb2.TestMapSubmessage()
         int32_map = msg.test_map.map_int32_int32
@@ -0,0 +1,76 @@
+# Protocol Buffers - Google's data interchange format
+# Copyright 2023 Google LLC.  All rights reserved.
+# https://developers.google.com/protocol-buffers/
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above
+# copyright notice, this list of conditions and the following disclaimer
+# in the documentation and/or other materials provided with the
+# distribution.
+#     * Neither the name of Google LLC nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+"""Times walking a deeply nested message, which stresses the wrapper caches.
+
+Every step down creates (or finds) a wrapper for the child message, and
+present children go through the object cache while unset ones go through
+their parent's stub map.
+"""
+
+import timeit
+
+from google.protobuf import unittest_pb2
+
+DEPTH = 64
+
+
+def make_nested(depth):
+    msg = unittest_pb2.NestedTestAllTypes()
+    node = msg
+    for i in range(depth):
+        node.payload.optional_int32 = i
+        node.payload.repeated_int32.append(i)
+        node = node.child
+    return unittest_pb2.NestedTestAllTypes.FromString(msg.SerializeToString())
+
+
+def walk(msg):
+    total = 0
+    node = msg
+    while node.HasField("child"):
+        total += node.payload.optional_int32 + len(node.payload.repeated_int32)
+        node = node.child
+    # Unset fields hand out stubs.
+    return total + node.child.child.payload.optional_int32
+
+
+def main():
+    msg = make_nested(DEPTH)
+    for name, stmt in [
+        ("walk parsed message", lambda: walk(msg)),
+        ("build, parse and walk", lambda: walk(make_nested(DEPTH))),
+    ]:
+        n, secs = timeit.Timer(stmt).autorange()
+        print("%-24s %8.2f us/iter" % (name, secs / n * 1e6))
+
+
+if __name__ == "__main__":
+    main()
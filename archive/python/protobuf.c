@@ -42,6 +42,9 @@
 static void PyUpb_ModuleDealloc(void* module) {
   PyUpb_ModuleState* s = PyModule_GetState(module);
   PyUpb_WeakMap_Free(s->obj_cache);
+  for (int i = 0; i < s->free_arena_count; i++) {
+    upb_Arena_Free(s->free_arenas[i]);
+  }
   if (s->c_descriptor_symtab) {
     upb_DefPool_Free(s->c_descriptor_symtab);
   }
@@ -119,71 +122,156 @@ PyObject* PyUpb_GetWktBases(PyUpb_ModuleState* state) {
 // WeakMap
 // -----------------------------------------------------------------------------
 
+// An open-addressing hash table with linear probing, keyed by pointer.
+// Removed entries leave a tombstone, so that removing during iteration never
+// moves entries that the iteration has yet to visit.  Tombstones are dropped
+// when the table is rebuilt.
+enum {
+  kPyUpb_WeakMap_EmptyKey = 0,
+  kPyUpb_WeakMap_DeletedKey = 1,  // Pointer keys are always aligned.
+  kPyUpb_WeakMap_MinSize = 8,
+};
+
+typedef struct {
+  uintptr_t key;
+  PyObject* obj;
+} PyUpb_WeakMapEntry;
+
 struct PyUpb_WeakMap {
-  upb_inttable table;
-  upb_Arena* arena;
+  PyUpb_WeakMapEntry* entries;
+  size_t mask;   // Number of entries minus one; the size is a power of two.
+  size_t count;  // Live entries.
+  size_t used;   // Live entries plus tombstones.
 };
 
+static PyUpb_WeakMapEntry* PyUpb_WeakMap_AllocEntries(size_t size) {
+  return PyMem_Calloc(size, sizeof(PyUpb_WeakMapEntry));
+}
+
 PyUpb_WeakMap* PyUpb_WeakMap_New(void) {
-  upb_Arena* arena = upb_Arena_New();
-  PyUpb_WeakMap* map = upb_Arena_Malloc(arena, sizeof(*map));
-  map->arena = arena;
-  upb_inttable_init(&map->table, map->arena);
+  PyUpb_WeakMap* map = PyMem_Malloc(sizeof(*map));
+  if (!map) return NULL;
+  map->entries = PyUpb_WeakMap_AllocEntries(kPyUpb_WeakMap_MinSize);
+  if (!map->entries) {
+    PyMem_Free(map);
+    return NULL;
+  }
+  map->mask = kPyUpb_WeakMap_MinSize - 1;
+  map->count = 0;
+  map->used = 0;
   return map;
 }
 
-void PyUpb_WeakMap_Free(PyUpb_WeakMap* map) { upb_Arena_Free(map->arena); }
+void PyUpb_WeakMap_Free(PyUpb_WeakMap* map) {
+  PyMem_Free(map->entries);
+  PyMem_Free(map);
+}
+
+static size_t PyUpb_WeakMap_Hash(uintptr_t key) {
+  // Fibonacci hashing; the high bits of the product mix in every key bit,
+  // including the low ones that alignment leaves zero.
+  uint64_t h = (uint64_t)key * 0x9e3779b97f4a7c15ull;
+  return (size_t)(h >> 32);
+}
 
-// To give better entropy in the table key, we shift away low bits that are
-// always zero.
-static const int PyUpb_PtrShift = (sizeof(void*) == 4) ? 2 : 3;
+// Returns the entry for `key`, or NULL if it is not in the map.
+static PyUpb_WeakMapEntry* PyUpb_WeakMap_Find(PyUpb_WeakMap* map,
+                                              const void* key) {
+  uintptr_t k = (uintptr_t)key;
+  for (size_t i = PyUpb_WeakMap_Hash(k);; i++) {
+    PyUpb_WeakMapEntry* e = &map->entries[i & map->mask];
+    if (e->key == k) return e;
+    if (e->key == kPyUpb_WeakMap_EmptyKey) return NULL;
+  }
+}
 
-uintptr_t PyUpb_WeakMap_GetKey(const void* key) {
-  uintptr_t n = (uintptr_t)key;
-  assert((n & ((1 << PyUpb_PtrShift) - 1)) == 0);
-  return n >> PyUpb_PtrShift;
+static void PyUpb_WeakMap_InsertNew(PyUpb_WeakMap* map, uintptr_t key,
+                                    PyObject* obj) {
+  for (size_t i = PyUpb_WeakMap_Hash(key);; i++) {
+    PyUpb_WeakMapEntry* e = &map->entries[i & map->mask];
+    if (e->key == kPyUpb_WeakMap_EmptyKey) {
+      e->key = key;
+      e->obj = obj;
+      map->count++;
+      map->used++;
+      return;
+    }
+  }
+}
+
+// Rebuilds the table without tombstones, at a size where it is at most half
+// full after one more insertion.
+static bool PyUpb_WeakMap_Rebuild(PyUpb_WeakMap* map) {
+  size_t size = kPyUpb_WeakMap_MinSize;
+  while (size < 2 * (map->count + 1)) size *= 2;
+  PyUpb_WeakMapEntry* entries = PyUpb_WeakMap_AllocEntries(size);
+  if (!entries) return false;
+  PyUpb_WeakMapEntry* old = map->entries;
+  size_t old_size = map->mask + 1;
+  map->entries = entries;
+  map->mask = size - 1;
+  map->count = 0;
+  map->used = 0;
+  for (size_t i = 0; i < old_size; i++) {
+    if (old[i].key > kPyUpb_WeakMap_DeletedKey) {
+      PyUpb_WeakMap_InsertNew(map, old[i].key, old[i].obj);
+    }
+  }
+  PyMem_Free(old);
+  return true;
 }
 
 void PyUpb_WeakMap_Add(PyUpb_WeakMap* map, const void* key, PyObject* py_obj) {
-  upb_inttable_insert(&map->table, PyUpb_WeakMap_GetKey(key),
-                      upb_value_ptr(py_obj), map->arena);
+  assert(!PyUpb_WeakMap_Find(map, key));
+  // Keep at least a quarter of the entries empty so that probes stay short.
+  // If the table cannot grow, it still has room for now.
+  if (4 * (map->used + 1) > 3 * (map->mask + 1) &&
+      !PyUpb_WeakMap_Rebuild(map) && map->used == map->mask) {
+    return;
+  }
+  PyUpb_WeakMap_InsertNew(map, (uintptr_t)key, py_obj);
+}
+
+static void PyUpb_WeakMap_Remove(PyUpb_WeakMap* map, PyUpb_WeakMapEntry* e) {
+  e->key = kPyUpb_WeakMap_DeletedKey;
+  e->obj = NULL;
+  map->count--;
 }
 
 void PyUpb_WeakMap_Delete(PyUpb_WeakMap* map, const void* key) {
-  upb_value val;
-  bool removed =
-      upb_inttable_remove(&map->table, PyUpb_WeakMap_GetKey(key), &val);
-  (void)removed;
-  assert(removed);
+  PyUpb_WeakMapEntry* e = PyUpb_WeakMap_Find(map, key);
+  assert(e);
+  if (e) PyUpb_WeakMap_Remove(map, e);
 }
 
 void PyUpb_WeakMap_TryDelete(PyUpb_WeakMap* map, const void* key) {
-  upb_inttable_remove(&map->table, PyUpb_WeakMap_GetKey(key), NULL);
+  PyUpb_WeakMapEntry* e = PyUpb_WeakMap_Find(map, key);
+  if (e) PyUpb_WeakMap_Remove(map, e);
 }
 
 PyObject* PyUpb_WeakMap_Get(PyUpb_WeakMap* map, const void* key) {
-  upb_value val;
-  if (upb_inttable_lookup(&map->table, PyUpb_WeakMap_GetKey(key), &val)) {
-    PyObject* ret = upb_value_getptr(val);
-    Py_INCREF(ret);
-    return ret;
-  } else {
-    return NULL;
-  }
+  PyUpb_WeakMapEntry* e = PyUpb_WeakMap_Find(map, key);
+  if (!e) return NULL;
+  Py_INCREF(e->obj);
+  return e->obj;
 }
 
 bool PyUpb_WeakMap_Next(PyUpb_WeakMap* map, const void** key, PyObject** obj,
                         intptr_t* iter) {
-  uintptr_t u_key;
-  upb_value val;
-  if (!upb_inttable_next(&map->table, &u_key, &val, iter)) return false;
-  *key = (void*)(u_key << PyUpb_PtrShift);
-  *obj = upb_value_getptr(val);
-  return true;
+  for (size_t i = *iter + 1; i <= map->mask; i++) {
+    PyUpb_WeakMapEntry* e = &map->entries[i];
+    if (e->key > kPyUpb_WeakMap_DeletedKey) {
+      *key = (const void*)e->key;
+      *obj = e->obj;
+      *iter = i;
+      return true;
+    }
+  }
+  return false;
 }
 
 void PyUpb_WeakMap_DeleteIter(PyUpb_WeakMap* map, intptr_t* iter) {
-  upb_inttable_removeiter(&map->table, iter);
+  PyUpb_WeakMap_Remove(map, &map->entries[*iter]);
 }
 
 // -----------------------------------------------------------------------------
@@ -222,17 +310,36 @@ PyObject* PyUpb_ObjCache_Get(const void* key) {
 typedef struct {
   PyObject_HEAD;
   upb_Arena* arena;
+  PyObject* keep_alive;  // list, or NULL if nothing is aliased.
 } PyUpb_Arena;
 
+// Arenas that hold at most this much memory once reset are kept for reuse
+// when their wrapper is freed, so that short-lived messages do not each pay
+// for a fresh arena and its first blocks.  The GIL guards the free list.
+enum { kPyUpb_Arena_MaxRecycledSize = 32 * 1024 };
+
 PyObject* PyUpb_Arena_New(void) {
   PyUpb_ModuleState* state = PyUpb_ModuleState_Get();
   PyUpb_Arena* arena = (void*)PyType_GenericAlloc(state->arena_type, 0);
-  arena->arena = upb_Arena_New();
+  arena->arena = state->free_arena_count > 0
+                     ? state->free_arenas[--state->free_arena_count]
+                     : upb_Arena_New();
   return &arena->ob_base;
 }
 
 static void PyUpb_Arena_Dealloc(PyObject* self) {
-  upb_Arena_Free(PyUpb_Arena_Get(self));
+  upb_Arena* a = PyUpb_Arena_Get(self);
+  // Our module state may already be gone during shutdown.  Arenas that were
+  // ever fused cannot be reset, since other arenas may still use them.
+  PyUpb_ModuleState* state = PyUpb_ModuleState_MaybeGet();
+  if (state && state->free_arena_count < kPyUpb_Arena_FreeListSize &&
+      upb_Arena_Reset(a) &&
+      upb_Arena_SpaceAllocated(a) <= kPyUpb_Arena_MaxRecycledSize) {
+    state->free_arenas[state->free_arena_count++] = a;
+  } else {
+    upb_Arena_Free(a);
+  }
+  Py_XDECREF(((PyUpb_Arena*)self)->keep_alive);
   PyUpb_Dealloc(self);
 }
 
@@ -240,6 +347,15 @@ upb_Arena* PyUpb_Arena_Get(PyObject* arena) {
   return ((PyUpb_Arena*)arena)->arena;
 }
 
+bool PyUpb_Arena_KeepAlive(PyObject* _arena, PyObject* obj) {
+  PyUpb_Arena* arena = (void*)_arena;
+  if (!arena->keep_alive) {
+    arena->keep_alive = PyList_New(0);
+    if (!arena->keep_alive) return false;
+  }
+  return PyList_Append(arena->keep_alive, obj) == 0;
+}
+
 static PyType_Slot PyUpb_Arena_Slots[] = {
     {Py_tp_dealloc, PyUpb_Arena_Dealloc},
     {0, NULL},
@@ -337,6 +453,7 @@ __attribute__((visibility("default"))) PyMODINIT_FUNC PyInit__message(void) {
 
   state->allow_oversize_protos = false;
   state->wkt_bases = NULL;
+  state->free_arena_count = 0;
   state->obj_cache = PyUpb_WeakMap_New();
   state->c_descriptor_symtab = NULL;
 
@@ -35,7 +35,6 @@
 
 #include "python/descriptor.h"
 #include "python/python_api.h"
-#include "upb/hash/int_table.h"
 
 // begin:github_only
 #define PYUPB_PROTOBUF_PUBLIC_PACKAGE "google.protobuf"
@@ -65,6 +64,9 @@ typedef struct PyUpb_WeakMap PyUpb_WeakMap;
 // We store all "global" state in this struct instead of using (C) global
 // variables. This makes this extension compatible with sub-interpreters.
 
+// How many reset arenas are kept for reuse, see PyUpb_Arena_New().
+enum { kPyUpb_Arena_FreeListSize = 16 };
+
 typedef struct {
   // From descriptor.c
   PyTypeObject* descriptor_types[kPyUpb_Descriptor_Count];
@@ -100,12 +102,13 @@ typedef struct {
   PyObject* message_class;
   PyTypeObject* cmessage_type;
   PyTypeObject* message_meta_type;
-  PyObject* listfields_item_key;
 
   // From protobuf.c
   bool allow_oversize_protos;
   PyObject* wkt_bases;
   PyTypeObject* arena_type;
+  upb_Arena* free_arenas[kPyUpb_Arena_FreeListSize];
+  int free_arena_count;
   PyUpb_WeakMap* obj_cache;
 
   // From repeated.c
@@ -144,6 +147,9 @@ PyObject* PyUpb_GetWktBases(PyUpb_ModuleState* state);
 // Each wrapped object should add itself to the map when it is constructed and
 // remove itself from the map when it is destroyed. The map is weak so it does
 // not take references to the cached objects.
+//
+// Adding to the map while iterating over it is not allowed, but removing
+// entries is.
 
 PyUpb_WeakMap* PyUpb_WeakMap_New(void);
 void PyUpb_WeakMap_Free(PyUpb_WeakMap* map);
@@ -158,7 +164,7 @@ void PyUpb_WeakMap_TryDelete(PyUpb_WeakMap* map, const void* key);
 // Returns a new reference to an object if it exists, otherwise returns NULL.
 PyObject* PyUpb_WeakMap_Get(PyUpb_WeakMap* map, const void* key);
 
-#define PYUPB_WEAKMAP_BEGIN UPB_INTTABLE_BEGIN
+#define PYUPB_WEAKMAP_BEGIN -1
 
 // Iteration over the weak map, eg.
 //
@@ -190,6 +196,10 @@ PyUpb_WeakMap* PyUpb_ObjCache_Instance(void);
 PyObject* PyUpb_Arena_New(void);
 upb_Arena* PyUpb_Arena_Get(PyObject* arena);
 
+// Keeps `obj` alive until the arena is freed, for memory that the arena's
+// messages alias.  Returns false and sets a Python exception on failure.
+bool PyUpb_Arena_KeepAlive(PyObject* arena, PyObject* obj);
+
 // -----------------------------------------------------------------------------
 // Utilities
 // -----------------------------------------------------------------------------
@@ -61,4 +61,9 @@ PyAPI_FUNC(const char*)
     PyUnicode_AsUTF8AndSize(PyObject* unicode, Py_ssize_t* size);
 #endif
 
+// The buffer protocol joined the limited API in 3.11.
+#if !defined(Py_LIMITED_API) || Py_LIMITED_API >= 0x030b0000
+#define PYUPB_HAS_BUFFER_PROTOCOL
+#endif
+
 #endif  // PYUPB_PYTHON_H__
@@ -126,6 +126,7 @@ void PyUpb_RepeatedContainer_Reify(PyObject* _self, upb_Array* arr) {
 
 upb_Array* PyUpb_RepeatedContainer_EnsureReified(PyObject* _self) {
   PyUpb_RepeatedContainer* self = (PyUpb_RepeatedContainer*)_self;
+  PyUpb_Message_NoteMutation();
   upb_Array* arr = PyUpb_RepeatedContainer_GetIfReified(self);
   if (arr) return arr;  // Already writable.
 
@@ -221,27 +222,232 @@ PyObject* PyUpb_RepeatedContainer_DeepCopy(PyObject* _self, PyObject* value) {
   return (PyObject*)clone;
 }
 
+#ifdef PYUPB_HAS_BUFFER_PROTOCOL
+
+// Returns the struct module format for elements of the repeated field `f` and
+// sets `*itemsize`, or returns NULL if `f` cannot be viewed as a buffer.
+static const char* PyUpb_RepeatedContainer_BufferFormat(const upb_FieldDef* f,
+                                                        Py_ssize_t* itemsize) {
+  switch (upb_FieldDef_CType(f)) {
+    case kUpb_CType_Bool:
+      *itemsize = sizeof(bool);
+      return "?";
+    case kUpb_CType_Int32:
+    case kUpb_CType_Enum:
+      *itemsize = sizeof(int32_t);
+      return "i";
+    case kUpb_CType_UInt32:
+      *itemsize = sizeof(uint32_t);
+      return "I";
+    case kUpb_CType_Int64:
+      *itemsize = sizeof(int64_t);
+      return "q";
+    case kUpb_CType_UInt64:
+      *itemsize = sizeof(uint64_t);
+      return "Q";
+    case kUpb_CType_Float:
+      *itemsize = sizeof(float);
+      return "f";
+    case kUpb_CType_Double:
+      *itemsize = sizeof(double);
+      return "d";
+    default:
+      return NULL;
+  }
+}
+
+// Returns true if elements of a buffer with struct module format `format` can
+// be copied bytewise into a repeated field with element format `field_format`.
+// Both are assumed to have the same itemsize.
+static bool PyUpb_RepeatedContainer_FormatMatches(const char* format,
+                                                  const char* field_format) {
+  if (!format) format = "B";
+  if (*format == '@' || *format == '=') format++;
+  if (*format == '<') {
+    const int one = 1;
+    if (*(const char*)&one != 1) return false;  // Big-endian host.
+    format++;
+  }
+  if (format[0] == '\0' || format[1] != '\0') return false;
+  switch (*field_format) {
+    case 'i':
+    case 'q':
+      return strchr("bhilqn", *format) != NULL;
+    case 'I':
+    case 'Q':
+      return strchr("BHILQN", *format) != NULL;
+    default:
+      return *format == *field_format;
+  }
+}
+
+// Appends the elements of `value` with a single memcpy() if it is a
+// one-dimensional, C-contiguous buffer with the field's element type.
+// Returns 1 if it did, 0 if `value` must be appended element by element, or
+// -1 on error.
+static int PyUpb_RepeatedContainer_ExtendFromBuffer(
+    PyUpb_RepeatedContainer* self, PyObject* value) {
+  const upb_FieldDef* f = PyUpb_RepeatedContainer_GetField(self);
+  Py_ssize_t itemsize;
+  const char* field_format = PyUpb_RepeatedContainer_BufferFormat(f, &itemsize);
+  // Closed enums must check each value, so they take the slow path.
+  if (!field_format || upb_FieldDef_CType(f) == kUpb_CType_Enum ||
+      !PyObject_CheckBuffer(value)) {
+    return 0;
+  }
+  Py_buffer view;
+  if (PyObject_GetBuffer(value, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) <
+      0) {
+    PyErr_Clear();
+    return 0;
+  }
+  int ret = 0;
+  if (view.ndim <= 1 && view.itemsize == itemsize &&
+      PyUpb_RepeatedContainer_FormatMatches(view.format, field_format)) {
+    upb_Array* arr = PyUpb_RepeatedContainer_EnsureReified(&self->ob_base);
+    size_t start_size = upb_Array_Size(arr);
+    size_t n = view.len / itemsize;
+    if (upb_Array_Resize(arr, start_size + n, PyUpb_Arena_Get(self->arena))) {
+      char* data = (char*)upb_Array_MutableDataPtr(arr) + start_size * itemsize;
+      if (n) memcpy(data, view.buf, view.len);
+      if (*field_format == '?') {
+        // upb requires bools to be exactly 0 or 1.
+        for (size_t i = 0; i < n; i++) data[i] = data[i] != 0;
+      }
+      ret = 1;
+    } else {
+      PyErr_NoMemory();
+      ret = -1;
+    }
+  }
+  PyBuffer_Release(&view);
+  return ret;
+}
+
+// Exports a repeated numeric field as a read-only buffer over its elements.
+// Growing the field afterwards moves its elements to new memory, so existing
+// views stop tracking the field, but they remain valid because the arena is
+// kept alive.
+static int PyUpb_RepeatedScalarContainer_GetBuffer(PyObject* _self,
+                                                   Py_buffer* view,
+                                                   int flags) {
+  PyUpb_RepeatedContainer* self = (PyUpb_RepeatedContainer*)_self;
+  const upb_FieldDef* f = PyUpb_RepeatedContainer_GetField(self);
+  Py_ssize_t itemsize;
+  const char* format = PyUpb_RepeatedContainer_BufferFormat(f, &itemsize);
+  view->obj = NULL;
+  if (!format) {
+    PyErr_Format(PyExc_BufferError,
+                 "repeated field %s does not support the buffer protocol",
+                 upb_FieldDef_FullName(f));
+    return -1;
+  }
+  if (flags & PyBUF_WRITABLE) {
+    PyErr_SetString(PyExc_BufferError, "repeated field buffers are read-only");
+    return -1;
+  }
+  Py_ssize_t* shape_and_strides = PyMem_Malloc(2 * sizeof(Py_ssize_t));
+  if (!shape_and_strides) {
+    PyErr_NoMemory();
+    return -1;
+  }
+  upb_Array* arr = PyUpb_RepeatedContainer_GetIfReified(self);
+  size_t size = arr ? upb_Array_Size(arr) : 0;
+  shape_and_strides[0] = size;
+  shape_and_strides[1] = itemsize;
+  view->buf = size ? (void*)upb_Array_DataPtr(arr) : (void*)"";
+  view->obj = _self;
+  Py_INCREF(_self);
+  view->len = size * itemsize;
+  view->readonly = 1;
+  view->itemsize = itemsize;
+  view->format = (flags & PyBUF_FORMAT) ? (char*)format : NULL;
+  view->ndim = 1;
+  view->shape = (flags & PyBUF_ND) ? shape_and_strides : NULL;
+  view->strides =
+      (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? shape_and_strides + 1 : NULL;
+  view->suboffsets = NULL;
+  view->internal = shape_and_strides;
+  return 0;
+}
+
+static void PyUpb_RepeatedScalarContainer_ReleaseBuffer(PyObject* _self,
+                                                        Py_buffer* view) {
+  PyMem_Free(view->internal);
+}
+
+#endif  // PYUPB_HAS_BUFFER_PROTOCOL
+
+// Appends the elements of `value` to a repeated scalar field in one loop,
+// reserving room for them up front.  Other iterables, and other repeated
+// fields, are first copied into a list.
+static bool PyUpb_RepeatedScalarContainer_ExtendFromSequence(
+    PyUpb_RepeatedContainer* self, upb_Array* arr, PyObject* value) {
+  PyUpb_ModuleState* state = PyUpb_ModuleState_Get();
+  PyObject* seq;
+  if (PyList_Check(value) || PyTuple_Check(value)) {
+    seq = value;
+    Py_INCREF(seq);
+  } else if (PyObject_TypeCheck(value, state->repeated_scalar_container_type)) {
+    seq = PyUpb_RepeatedContainer_ToList(value);
+  } else {
+    PyObject* it = PyObject_GetIter(value);
+    if (!it) {
+      PyErr_SetString(PyExc_TypeError, "Value must be iterable");
+      return false;
+    }
+    seq = PySequence_List(it);
+    Py_DECREF(it);
+  }
+  if (!seq) return false;
+
+  const upb_FieldDef* f = PyUpb_RepeatedContainer_GetField(self);
+  upb_Arena* arena = PyUpb_Arena_Get(self->arena);
+  bool is_list = PyList_Check(seq);
+  Py_ssize_t n = is_list ? PyList_Size(seq) : PyTuple_Size(seq);
+  bool ok = upb_Array_Reserve(arr, upb_Array_Size(arr) + n, arena);
+  if (!ok) PyErr_NoMemory();
+  for (Py_ssize_t i = 0; ok && i < n; i++) {
+    PyObject* e = is_list ? PyList_GetItem(seq, i) : PyTuple_GetItem(seq, i);
+    upb_MessageValue msgval;
+    ok = PyUpb_PyToUpb(e, f, &msgval, arena);
+    if (ok) upb_Array_Append(arr, msgval, arena);
+  }
+  Py_DECREF(seq);
+  return ok;
+}
+
 PyObject* PyUpb_RepeatedContainer_Extend(PyObject* _self, PyObject* value) {
   PyUpb_RepeatedContainer* self = (PyUpb_RepeatedContainer*)_self;
+#ifdef PYUPB_HAS_BUFFER_PROTOCOL
+  switch (PyUpb_RepeatedContainer_ExtendFromBuffer(self, value)) {
+    case 1:
+      Py_RETURN_NONE;
+    case -1:
+      return NULL;
+  }
+#endif
   upb_Array* arr = PyUpb_RepeatedContainer_EnsureReified(_self);
   size_t start_size = upb_Array_Size(arr);
+  const upb_FieldDef* f = PyUpb_RepeatedContainer_GetField(self);
+
+  if (!upb_FieldDef_IsSubMessage(f)) {
+    if (!PyUpb_RepeatedScalarContainer_ExtendFromSequence(self, arr, value)) {
+      upb_Array_Resize(arr, start_size, NULL);
+      return NULL;
+    }
+    Py_RETURN_NONE;
+  }
+
   PyObject* it = PyObject_GetIter(value);
   if (!it) {
     PyErr_SetString(PyExc_TypeError, "Value must be iterable");
     return NULL;
   }
 
-  const upb_FieldDef* f = PyUpb_RepeatedContainer_GetField(self);
-  bool submsg = upb_FieldDef_IsSubMessage(f);
   PyObject* e;
-
   while ((e = PyIter_Next(it))) {
-    PyObject* ret;
-    if (submsg) {
-      ret = PyUpb_RepeatedCompositeContainer_Append(_self, e);
-    } else {
-      ret = PyUpb_RepeatedScalarContainer_Append(_self, e);
-    }
+    PyObject* ret = PyUpb_RepeatedCompositeContainer_Append(_self, e);
     Py_XDECREF(ret);
     Py_DECREF(e);
   }
@@ -277,6 +483,7 @@ PyObject* PyUpb_RepeatedContainer_ToList(PyObject* _self) {
   const upb_FieldDef* f = PyUpb_RepeatedContainer_GetField(self);
   size_t n = upb_Array_Size(arr);
   PyObject* list = PyList_New(n);
+  if (!list) return NULL;
   for (size_t i = 0; i < n; i++) {
     PyObject* val = PyUpb_UpbToPy(upb_Array_Get(arr, i), f, self->arena);
     if (!val) {
@@ -672,6 +879,8 @@ static PyMethodDef PyUpb_RepeatedCompositeContainer_Methods[] = {
      METH_VARARGS | METH_KEYWORDS, "Sorts the repeated container."},
     {"reverse", (PyCFunction)PyUpb_RepeatedContainer_Reverse, METH_NOARGS,
      "Reverses elements order of the repeated container."},
+    {"tolist", (PyCFunction)PyUpb_RepeatedContainer_ToList, METH_NOARGS,
+     "Returns a list with the elements of the repeated container."},
     {"MergeFrom", PyUpb_RepeatedContainer_MergeFrom, METH_O,
      "Adds objects to the repeated container."},
     {NULL, NULL}};
@@ -732,6 +941,7 @@ static int PyUpb_RepeatedScalarContainer_AssignItem(PyObject* _self,
   if (!PyUpb_PyToUpb(item, f, &msgval, arena)) {
     return -1;
   }
+  PyUpb_Message_NoteMutation();
   upb_Array_Set(self->ptr.arr, index, msgval);
   return 0;
 }
@@ -768,6 +978,8 @@ static PyMethodDef PyUpb_RepeatedScalarContainer_Methods[] = {
      METH_VARARGS | METH_KEYWORDS, "Sorts the repeated container."},
     {"reverse", (PyCFunction)PyUpb_RepeatedContainer_Reverse, METH_NOARGS,
      "Reverses elements order of the repeated container."},
+    {"tolist", (PyCFunction)PyUpb_RepeatedContainer_ToList, METH_NOARGS,
+     "Returns a list with the elements of the repeated container."},
     {"MergeFrom", PyUpb_RepeatedContainer_MergeFrom, METH_O,
      "Merges a repeated container into the current container."},
     {NULL, NULL}};
@@ -785,6 +997,10 @@ static PyType_Slot PyUpb_RepeatedScalarContainer_Slots[] = {
     {Py_mp_ass_subscript, PyUpb_RepeatedContainer_AssignSubscript},
     {Py_tp_richcompare, PyUpb_RepeatedContainer_RichCompare},
     {Py_tp_hash, PyObject_HashNotImplemented},
+#ifdef PYUPB_HAS_BUFFER_PROTOCOL
+    {Py_bf_getbuffer, PyUpb_RepeatedScalarContainer_GetBuffer},
+    {Py_bf_releasebuffer, PyUpb_RepeatedScalarContainer_ReleaseBuffer},
+#endif
     {0, NULL}};
 
 static PyType_Spec PyUpb_RepeatedScalarContainer_Spec = {
@@ -61,6 +61,10 @@ upb_Array* PyUpb_RepeatedContainer_EnsureReified(PyObject* self);
 // field (either repeated composite or repeated scalar).
 PyObject* PyUpb_RepeatedContainer_Extend(PyObject* _self, PyObject* value);
 
+// Implements repeated_field.tolist(), returning a new list that holds the
+// elements of the repeated field.
+PyObject* PyUpb_RepeatedContainer_ToList(PyObject* _self);
+
 // Implements repeated_field.add(initial_values).  `_self` must be a repeated
 // composite field.
 PyObject* PyUpb_RepeatedCompositeContainer_Add(PyObject* _self, PyObject* args,
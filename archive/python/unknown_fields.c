@@ -32,22 +32,37 @@
 
 #include "python/message.h"
 #include "python/protobuf.h"
-#include "upb/wire/eps_copy_input_stream.h"
-#include "upb/wire/reader.h"
+#include "upb/message/unknown.h"
 #include "upb/wire/types.h"
 
 // -----------------------------------------------------------------------------
 // UnknownFieldSet
 // -----------------------------------------------------------------------------
 
+// The set only records where each field starts.  The UnknownField tuples are
+// created on first access, as most users look at few of them, if any.
+typedef struct {
+  size_t ofs;      // From the start of the set's data.
+  PyObject* item;  // NULL until accessed.
+} PyUpb_UnknownFieldSetEntry;
+
 typedef struct {
   PyObject_HEAD;
-  PyObject* fields;
+  PyObject* bytes;  // Owns the data; shared with the sets of nested groups.
+  const char* data;
+  size_t size;
+  bool message_set;
+  Py_ssize_t count;
+  PyUpb_UnknownFieldSetEntry* entries;
 } PyUpb_UnknownFieldSet;
 
 static void PyUpb_UnknownFieldSet_Dealloc(PyObject* _self) {
   PyUpb_UnknownFieldSet* self = (PyUpb_UnknownFieldSet*)_self;
-  Py_XDECREF(self->fields);
+  for (Py_ssize_t i = 0; i < self->count; i++) {
+    Py_XDECREF(self->entries[i].item);
+  }
+  PyMem_Free(self->entries);
+  Py_XDECREF(self->bytes);
   PyUpb_Dealloc(self);
 }
 
@@ -74,185 +89,138 @@ PyUpb_UnknownFieldSet* PyUpb_UnknownFieldSet_NewBare(void) {
 // we drop them on the floor.
 
 enum {
-  kUpb_MessageSet_StartItemTag = (1 << 3) | kUpb_WireType_StartGroup,
-  kUpb_MessageSet_EndItemTag = (1 << 3) | kUpb_WireType_EndGroup,
-  kUpb_MessageSet_TypeIdTag = (2 << 3) | kUpb_WireType_Varint,
-  kUpb_MessageSet_MessageTag = (3 << 3) | kUpb_WireType_Delimited,
+  kUpb_MessageSet_ItemFieldNumber = 1,
+  kUpb_MessageSet_TypeIdFieldNumber = 2,
+  kUpb_MessageSet_MessageFieldNumber = 3,
 };
 
-static const char* PyUpb_UnknownFieldSet_BuildMessageSetItem(
-    PyUpb_UnknownFieldSet* self, upb_EpsCopyInputStream* stream,
-    const char* ptr) {
-  PyUpb_ModuleState* s = PyUpb_ModuleState_Get();
-  int type_id = 0;
-  PyObject* msg = NULL;
-  while (!upb_EpsCopyInputStream_IsDone(stream, &ptr)) {
-    uint32_t tag;
-    ptr = upb_WireReader_ReadTag(ptr, &tag);
-    if (!ptr) goto err;
-    switch (tag) {
-      case kUpb_MessageSet_EndItemTag:
-        goto done;
-      case kUpb_MessageSet_TypeIdTag: {
-        uint64_t tmp;
-        ptr = upb_WireReader_ReadVarint(ptr, &tmp);
-        if (!ptr) goto err;
-        if (!type_id) type_id = tmp;
-        break;
-      }
-      case kUpb_MessageSet_MessageTag: {
-        int size;
-        ptr = upb_WireReader_ReadSize(ptr, &size);
-        if (!upb_EpsCopyInputStream_CheckDataSizeAvailable(stream, ptr, size)) {
-          goto err;
-        }
-        const char* str = ptr;
-        ptr = upb_EpsCopyInputStream_ReadStringAliased(stream, &str, size);
-        if (!msg) {
-          msg = PyBytes_FromStringAndSize(str, size);
-          if (!msg) goto err;
-        } else {
-          // already saw a message here so deliberately skipping the duplicate
-        }
-        break;
-      }
-      default:
-        ptr = upb_WireReader_SkipValue(ptr, tag, stream);
-        if (!ptr) goto err;
+// Reads the type id and message of a MessageSet item, returning false if the
+// item is malformed.  `*type_id` is set to 0 if the item has no type id or no
+// message, in which case it is dropped.
+static bool PyUpb_UnknownFieldSet_ReadMessageSetItem(upb_StringView item,
+                                                     int* type_id,
+                                                     upb_StringView* msg) {
+  upb_UnknownFieldIter iter;
+  upb_UnknownFieldIter_Init(&iter, item.data, item.size,
+                            kUpb_WireFormat_DefaultDepthLimit);
+  upb_UnknownFieldView field;
+  bool has_msg = false;
+  *type_id = 0;
+  while (upb_UnknownFieldIter_Next(&iter, &field)) {
+    if (field.field_number == kUpb_MessageSet_TypeIdFieldNumber &&
+        field.wire_type == kUpb_WireType_Varint) {
+      if (!*type_id) *type_id = field.data.varint;
+    } else if (field.field_number == kUpb_MessageSet_MessageFieldNumber &&
+               field.wire_type == kUpb_WireType_Delimited) {
+      // If there are several messages we deliberately skip all but the first.
+      if (!has_msg) *msg = field.data.delimited;
+      has_msg = true;
     }
   }
+  if (!has_msg) *type_id = 0;
+  return !upb_UnknownFieldIter_IsError(&iter);
+}
 
-done:
-  if (type_id && msg) {
-    PyObject* field = PyObject_CallFunction(
-        s->unknown_field_type, "iiO", type_id, kUpb_WireType_Delimited, msg);
-    if (!field) goto err;
-    PyList_Append(self->fields, field);
-    Py_DECREF(field);
-  }
-  Py_XDECREF(msg);
-  return ptr;
-
-err:
-  Py_XDECREF(msg);
-  return NULL;
+static bool PyUpb_UnknownFieldSet_IsMessageSetItem(
+    const upb_UnknownFieldView* field) {
+  return field->field_number == kUpb_MessageSet_ItemFieldNumber &&
+         field->wire_type == kUpb_WireType_StartGroup;
 }
 
-static const char* PyUpb_UnknownFieldSet_BuildMessageSet(
-    PyUpb_UnknownFieldSet* self, upb_EpsCopyInputStream* stream,
-    const char* ptr) {
-  self->fields = PyList_New(0);
-  while (!upb_EpsCopyInputStream_IsDone(stream, &ptr)) {
-    uint32_t tag;
-    ptr = upb_WireReader_ReadTag(ptr, &tag);
-    if (!ptr) goto err;
-    if (tag == kUpb_MessageSet_StartItemTag) {
-      ptr = PyUpb_UnknownFieldSet_BuildMessageSetItem(self, stream, ptr);
-    } else {
-      ptr = upb_WireReader_SkipValue(ptr, tag, stream);
+// Points `self` at the fields in `data`, which is owned by `bytes`, and finds
+// where each of them starts.  For a MessageSet, only the complete items are
+// fields.  Returns false with an exception set if the data is malformed.
+static bool PyUpb_UnknownFieldSet_Init(PyUpb_UnknownFieldSet* self,
+                                       PyObject* bytes, const char* data,
+                                       size_t size, bool message_set) {
+  Py_INCREF(bytes);
+  self->bytes = bytes;
+  self->data = data;
+  self->size = size;
+  self->message_set = message_set;
+
+  Py_ssize_t capacity = 0;
+  upb_UnknownFieldIter iter;
+  upb_UnknownFieldIter_Init(&iter, data, size,
+                            kUpb_WireFormat_DefaultDepthLimit);
+  upb_UnknownFieldView field;
+  while (upb_UnknownFieldIter_Next(&iter, &field)) {
+    if (message_set) {
+      if (!PyUpb_UnknownFieldSet_IsMessageSetItem(&field)) continue;
+      int type_id;
+      upb_StringView msg;
+      if (!PyUpb_UnknownFieldSet_ReadMessageSetItem(field.data.group, &type_id,
+                                                    &msg)) {
+        goto err;
+      }
+      if (!type_id) continue;
+    }
+    if (self->count == capacity) {
+      capacity = capacity ? capacity * 2 : 8;
+      void* entries =
+          PyMem_Realloc(self->entries, capacity * sizeof(*self->entries));
+      if (!entries) {
+        PyErr_NoMemory();
+        return false;
+      }
+      self->entries = entries;
     }
-    if (!ptr) goto err;
+    PyUpb_UnknownFieldSetEntry* entry = &self->entries[self->count++];
+    entry->ofs = field.encoded.data - data;
+    entry->item = NULL;
   }
-  if (upb_EpsCopyInputStream_IsError(stream)) goto err;
-  return ptr;
+  if (!upb_UnknownFieldIter_IsError(&iter)) return true;
 
 err:
-  Py_DECREF(self->fields);
-  self->fields = NULL;
-  return NULL;
+  PyErr_SetString(PyExc_RuntimeError, "Error parsing unknown fields");
+  return false;
 }
 
-static const char* PyUpb_UnknownFieldSet_Build(PyUpb_UnknownFieldSet* self,
-                                               upb_EpsCopyInputStream* stream,
-                                               const char* ptr,
-                                               int group_number);
-
-static const char* PyUpb_UnknownFieldSet_BuildValue(
-    PyUpb_UnknownFieldSet* self, upb_EpsCopyInputStream* stream,
-    const char* ptr, int field_number, int wire_type, int group_number,
-    PyObject** data) {
-  switch (wire_type) {
-    case kUpb_WireType_Varint: {
-      uint64_t val;
-      ptr = upb_WireReader_ReadVarint(ptr, &val);
-      if (!ptr) return NULL;
-      *data = PyLong_FromUnsignedLongLong(val);
-      return ptr;
-    }
-    case kUpb_WireType_64Bit: {
-      uint64_t val;
-      ptr = upb_WireReader_ReadFixed64(ptr, &val);
-      *data = PyLong_FromUnsignedLongLong(val);
-      return ptr;
-    }
-    case kUpb_WireType_32Bit: {
-      uint32_t val;
-      ptr = upb_WireReader_ReadFixed32(ptr, &val);
-      *data = PyLong_FromUnsignedLongLong(val);
-      return ptr;
-    }
-    case kUpb_WireType_Delimited: {
-      int size;
-      ptr = upb_WireReader_ReadSize(ptr, &size);
-      if (!upb_EpsCopyInputStream_CheckDataSizeAvailable(stream, ptr, size)) {
-        return NULL;
-      }
-      const char* str = ptr;
-      ptr = upb_EpsCopyInputStream_ReadStringAliased(stream, &str, size);
-      *data = PyBytes_FromStringAndSize(str, size);
-      return ptr;
-    }
+static PyObject* PyUpb_UnknownFieldSet_NewItem(PyUpb_UnknownFieldSet* self,
+                                               const upb_UnknownFieldView* f) {
+  PyUpb_ModuleState* s = PyUpb_ModuleState_Get();
+  if (self->message_set) {
+    int type_id;
+    upb_StringView msg;
+    PyUpb_UnknownFieldSet_ReadMessageSetItem(f->data.group, &type_id, &msg);
+    return PyObject_CallFunction(s->unknown_field_type, "iiy#", type_id,
+                                 kUpb_WireType_Delimited, msg.data,
+                                 (Py_ssize_t)msg.size);
+  }
+
+  PyObject* data;
+  switch (f->wire_type) {
+    case kUpb_WireType_Varint:
+      data = PyLong_FromUnsignedLongLong(f->data.varint);
+      break;
+    case kUpb_WireType_64Bit:
+      data = PyLong_FromUnsignedLongLong(f->data.fixed64);
+      break;
+    case kUpb_WireType_32Bit:
+      data = PyLong_FromUnsignedLongLong(f->data.fixed32);
+      break;
+    case kUpb_WireType_Delimited:
+      data = PyBytes_FromStringAndSize(f->data.delimited.data,
+                                       f->data.delimited.size);
+      break;
     case kUpb_WireType_StartGroup: {
       PyUpb_UnknownFieldSet* sub = PyUpb_UnknownFieldSet_NewBare();
       if (!sub) return NULL;
-      *data = &sub->ob_base;
-      return PyUpb_UnknownFieldSet_Build(sub, stream, ptr, field_number);
+      data = &sub->ob_base;
+      if (!PyUpb_UnknownFieldSet_Init(sub, self->bytes, f->data.group.data,
+                                      f->data.group.size, false)) {
+        Py_DECREF(data);
+        return NULL;
+      }
+      break;
     }
     default:
       assert(0);
-      *data = NULL;
       return NULL;
   }
-}
-
-// For non-MessageSet we just build the unknown fields exactly as they exist on
-// the wire.
-static const char* PyUpb_UnknownFieldSet_Build(PyUpb_UnknownFieldSet* self,
-                                               upb_EpsCopyInputStream* stream,
-                                               const char* ptr,
-                                               int group_number) {
-  PyUpb_ModuleState* s = PyUpb_ModuleState_Get();
-  self->fields = PyList_New(0);
-  while (!upb_EpsCopyInputStream_IsDone(stream, &ptr)) {
-    uint32_t tag;
-    ptr = upb_WireReader_ReadTag(ptr, &tag);
-    if (!ptr) goto err;
-    PyObject* data = NULL;
-    int field_number = upb_WireReader_GetFieldNumber(tag);
-    int wire_type = upb_WireReader_GetWireType(tag);
-    if (wire_type == kUpb_WireType_EndGroup) {
-      if (field_number != group_number) return NULL;
-      return ptr;
-    }
-    ptr = PyUpb_UnknownFieldSet_BuildValue(self, stream, ptr, field_number,
-                                           wire_type, group_number, &data);
-    if (!ptr) {
-      Py_XDECREF(data);
-      goto err;
-    }
-    assert(data);
-    PyObject* field = PyObject_CallFunction(s->unknown_field_type, "iiN",
-                                            field_number, wire_type, data);
-    PyList_Append(self->fields, field);
-    Py_DECREF(field);
-  }
-  if (upb_EpsCopyInputStream_IsError(stream)) goto err;
-  return ptr;
-
-err:
-  Py_DECREF(self->fields);
-  self->fields = NULL;
-  return NULL;
+  if (!data) return NULL;
+  return PyObject_CallFunction(s->unknown_field_type, "iiN", f->field_number,
+                               f->wire_type, data);
 }
 
 static PyObject* PyUpb_UnknownFieldSet_New(PyTypeObject* type, PyObject* args,
@@ -273,40 +241,51 @@ static PyObject* PyUpb_UnknownFieldSet_New(PyTypeObject* type, PyObject* args,
   const char* ptr = upb_Message_GetUnknown(msg, &size);
   if (size == 0) return &self->ob_base;
 
-  upb_EpsCopyInputStream stream;
-  upb_EpsCopyInputStream_Init(&stream, &ptr, size, true);
+  // The set is a snapshot, so it takes a copy of the data rather than
+  // aliasing the message, which may change later.
+  PyObject* bytes = PyBytes_FromStringAndSize(ptr, size);
+  if (!bytes) goto err;
   const upb_MessageDef* msgdef = PyUpb_Message_GetMsgdef(py_msg);
+  bool ok = PyUpb_UnknownFieldSet_Init(self, bytes, PyBytes_AsString(bytes),
+                                       size,
+                                       upb_MessageDef_IsMessageSet(msgdef));
+  Py_DECREF(bytes);
+  if (ok) return &self->ob_base;
 
-  bool ok;
-  if (upb_MessageDef_IsMessageSet(msgdef)) {
-    ok = PyUpb_UnknownFieldSet_BuildMessageSet(self, &stream, ptr) != NULL;
-  } else {
-    ok = PyUpb_UnknownFieldSet_Build(self, &stream, ptr, -1) != NULL;
-  }
-
-  if (!ok) {
-    Py_DECREF(&self->ob_base);
-    return NULL;
-  }
-
-  return &self->ob_base;
+err:
+  Py_DECREF(&self->ob_base);
+  return NULL;
 }
 
 static Py_ssize_t PyUpb_UnknownFieldSet_Length(PyObject* _self) {
   PyUpb_UnknownFieldSet* self = (PyUpb_UnknownFieldSet*)_self;
-  return self->fields ? PyObject_Length(self->fields) : 0;
+  return self->count;
 }
 
 static PyObject* PyUpb_UnknownFieldSet_GetItem(PyObject* _self,
                                                Py_ssize_t index) {
   PyUpb_UnknownFieldSet* self = (PyUpb_UnknownFieldSet*)_self;
-  if (!self->fields) {
+  if (index < 0 || index >= self->count) {
     PyErr_Format(PyExc_IndexError, "list index (%zd) out of range", index);
     return NULL;
   }
-  PyObject* ret = PyList_GetItem(self->fields, index);
-  if (ret) Py_INCREF(ret);
-  return ret;
+  PyUpb_UnknownFieldSetEntry* entry = &self->entries[index];
+  if (!entry->item) {
+    // The whole set was validated when it was created, so this cannot fail
+    // to parse.
+    upb_UnknownFieldIter iter;
+    upb_UnknownFieldIter_Init(&iter, self->data + entry->ofs,
+                              self->size - entry->ofs,
+                              kUpb_WireFormat_DefaultDepthLimit);
+    upb_UnknownFieldView field;
+    bool ok = upb_UnknownFieldIter_Next(&iter, &field);
+    assert(ok);
+    (void)ok;
+    entry->item = PyUpb_UnknownFieldSet_NewItem(self, &field);
+    if (!entry->item) return NULL;
+  }
+  Py_INCREF(entry->item);
+  return entry->item;
 }
 
 static PyType_Slot PyUpb_UnknownFieldSet_Slots[] = {
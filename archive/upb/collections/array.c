@@ -57,23 +57,55 @@ const void* upb_Array_DataPtr(const upb_Array* arr) {
   return _upb_array_ptr((upb_Array*)arr);
 }
 
-void* upb_Array_MutableDataPtr(upb_Array* arr) { return _upb_array_ptr(arr); }
+void* upb_Array_MutableDataPtr(upb_Array* arr) {
+  UPB_ASSERT(!arr->is_frozen);
+  return _upb_array_ptr(arr);
+}
 
 size_t upb_Array_Size(const upb_Array* arr) { return arr->size; }
 
+bool upb_Array_IsFrozen(const upb_Array* arr) { return arr->is_frozen; }
+
+bool upb_Array_HasInlineMessages(const upb_Array* arr) {
+  return _upb_Array_HasInlineMessages(arr);
+}
+
 upb_MessageValue upb_Array_Get(const upb_Array* arr, size_t i) {
   upb_MessageValue ret;
   const char* data = _upb_array_constptr(arr);
   int lg2 = arr->data & 7;
   UPB_ASSERT(i < arr->size);
+  if (UPB_UNLIKELY(_upb_Array_HasInlineMessages(arr))) {
+    ret.msg_val = _upb_Array_InlineMessage(arr, i);
+    return ret;
+  }
   memcpy(&ret, data + (i << lg2), 1 << lg2);
   return ret;
 }
 
+upb_MutableMessageValue upb_Array_GetMutable(upb_Array* arr, size_t i) {
+  UPB_ASSERT(!arr->is_frozen);
+  upb_MutableMessageValue ret;
+  ret.msg = (upb_Message*)upb_Array_Get(arr, i).msg_val;
+  return ret;
+}
+
 void upb_Array_Set(upb_Array* arr, size_t i, upb_MessageValue val) {
+  UPB_ASSERT(!arr->is_frozen);
   char* data = _upb_array_ptr(arr);
   int lg2 = arr->data & 7;
   UPB_ASSERT(i < arr->size);
+  if (UPB_UNLIKELY(_upb_Array_HasInlineMessages(arr))) {
+    // Copy the fields of the message into the element, which does not share
+    // the unknown fields or extensions of the source.
+    char* dst = (char*)_upb_Array_InlineMessage(arr, i);
+    const char* src = (const char*)val.msg_val;
+    if (dst != src) {
+      memset(dst - kUpb_Array_InlineHeaderSize, 0, kUpb_Array_InlineHeaderSize);
+      memcpy(dst, src, (1 << lg2) - kUpb_Array_InlineHeaderSize);
+    }
+    return;
+  }
   memcpy(data + (i << lg2), &val, 1 << lg2);
 }
 
@@ -88,6 +120,7 @@ bool upb_Array_Append(upb_Array* arr, upb_MessageValue val, upb_Arena* arena) {
 
 void upb_Array_Move(upb_Array* arr, size_t dst_idx, size_t src_idx,
                     size_t count) {
+  UPB_ASSERT(!arr->is_frozen);
   const int lg2 = arr->data & 7;
   char* data = _upb_array_ptr(arr);
   memmove(&data[dst_idx << lg2], &data[src_idx << lg2], count << lg2);
@@ -114,8 +147,11 @@ void upb_Array_Delete(upb_Array* arr, size_t i, size_t count) {
   const size_t end = i + count;
   UPB_ASSERT(i <= end);
   UPB_ASSERT(end <= arr->size);
+  UPB_ASSERT(!arr->is_frozen);
   upb_Array_Move(arr, i, end, arr->size - end);
   arr->size -= count;
+  // The slots past the new end now repeat elements that moved down.
+  if (arr->retained > arr->size) arr->retained = arr->size;
 }
 
 bool upb_Array_Resize(upb_Array* arr, size_t size, upb_Arena* arena) {
@@ -132,18 +168,38 @@ bool upb_Array_Resize(upb_Array* arr, size_t size, upb_Arena* arena) {
   return true;
 }
 
+bool upb_Array_Reserve(upb_Array* arr, size_t capacity, upb_Arena* arena) {
+  UPB_ASSERT(!arr->is_frozen);
+  return _upb_array_reserve(arr, capacity, arena);
+}
+
+void upb_Array_ShrinkToFit(upb_Array* arr, upb_Arena* arena) {
+  UPB_ASSERT(!arr->is_frozen);
+  if (arr->size == arr->capacity) return;
+  int elem_size_lg2 = arr->data & 7;
+  // Shrinking never moves the data, so this cannot fail.
+  void* ptr = upb_Arena_Realloc(arena, _upb_array_ptr(arr),
+                                arr->capacity << elem_size_lg2,
+                                arr->size << elem_size_lg2);
+  UPB_ASSERT(ptr == _upb_array_ptr(arr));
+  (void)ptr;
+  arr->capacity = arr->size;
+  if (arr->retained > arr->size) arr->retained = arr->size;
+}
+
 // EVERYTHING BELOW THIS LINE IS INTERNAL - DO NOT USE /////////////////////////
 
 bool _upb_array_realloc(upb_Array* arr, size_t min_capacity, upb_Arena* arena) {
-  size_t new_capacity = UPB_MAX(arr->capacity, 4);
+  UPB_ASSERT(!arr->is_frozen);
+  // Double the capacity so that appends are amortized O(1), but give a large
+  // reservation (such as a size hint from the decoder) exactly what it asked
+  // for rather than rounding it up to a power of two.
+  size_t new_capacity = UPB_MAX(min_capacity, UPB_MAX(arr->capacity * 2, 4));
   int elem_size_lg2 = arr->data & 7;
   size_t old_bytes = arr->capacity << elem_size_lg2;
   size_t new_bytes;
   void* ptr = _upb_array_ptr(arr);
 
-  // Log2 ceiling of size.
-  while (new_capacity < min_capacity) new_capacity *= 2;
-
   new_bytes = new_capacity << elem_size_lg2;
   ptr = upb_Arena_Realloc(arena, ptr, old_bytes, new_bytes);
   if (!ptr) return false;
@@ -48,12 +48,31 @@ UPB_API upb_Array* upb_Array_New(upb_Arena* a, upb_CType type);
 // Returns the number of elements in the array.
 UPB_API size_t upb_Array_Size(const upb_Array* arr);
 
+// Returns true if the array was frozen by upb_Array_Freeze() or as part of a
+// message frozen by upb_Message_Freeze().  A frozen array must not be
+// modified.
+UPB_API bool upb_Array_IsFrozen(const upb_Array* arr);
+
 // Returns the given element, which must be within the array's current size.
+// For an array of inline messages this points into the array, so it is
+// invalidated when the array is resized.
 UPB_API upb_MessageValue upb_Array_Get(const upb_Array* arr, size_t i);
 
+// Like upb_Array_Get(), but returns a mutable message for arrays of messages.
+UPB_API upb_MutableMessageValue upb_Array_GetMutable(upb_Array* arr, size_t i);
+
 // Sets the given element, which must be within the array's current size.
+// For an array of inline messages the fields of `val.msg_val` are copied into
+// the array, without its unknown fields or extensions; later changes to it are
+// not reflected in the array.
 UPB_API void upb_Array_Set(upb_Array* arr, size_t i, upb_MessageValue val);
 
+// Returns true if this is an array of messages that stores the messages
+// themselves rather than pointers to them, see
+// upb_MiniTable_SetInlineSubMessage().  Its elements are contiguous in memory,
+// and new elements added with upb_Array_Resize() are empty messages.
+UPB_API bool upb_Array_HasInlineMessages(const upb_Array* arr);
+
 // Appends an element to the array. Returns false on allocation failure.
 UPB_API bool upb_Array_Append(upb_Array* array, upb_MessageValue val,
                               upb_Arena* arena);
@@ -79,6 +98,16 @@ UPB_API void upb_Array_Delete(upb_Array* array, size_t i, size_t count);
 // Returns false on allocation failure.
 UPB_API bool upb_Array_Resize(upb_Array* array, size_t size, upb_Arena* arena);
 
+// Makes room for at least `capacity` elements, so that growing the array to
+// that size will not allocate.  Returns false on allocation failure.
+UPB_API bool upb_Array_Reserve(upb_Array* array, size_t capacity,
+                               upb_Arena* arena);
+
+// Reduces the capacity of the array to its size.  The unused storage goes back
+// to `arena` if it is the arena's most recent allocation; otherwise it stays
+// allocated until the arena is freed.
+UPB_API void upb_Array_ShrinkToFit(upb_Array* array, upb_Arena* arena);
+
 // Returns pointer to array data.
 UPB_API const void* upb_Array_DataPtr(const upb_Array* arr);
 
@@ -32,6 +32,7 @@
 
 #include "gtest/gtest.h"
 #include "upb/base/status.hpp"
+#include "upb/collections/internal/array.h"
 #include "upb/mem/arena.hpp"
 
 TEST(ArrayTest, Resize) {
@@ -64,3 +65,35 @@ TEST(ArrayTest, Resize) {
   EXPECT_EQ(upb_Array_Get(array, 4).int32_val, 0);
   EXPECT_EQ(upb_Array_Get(array, 5).int32_val, 0);
 }
+
+TEST(ArrayTest, ReserveAndShrinkToFit) {
+  upb::Arena arena;
+
+  upb_Array* array = upb_Array_New(arena.ptr(), kUpb_CType_Int64);
+  ASSERT_TRUE(array);
+
+  // A reservation is honored exactly rather than rounded up.
+  ASSERT_TRUE(upb_Array_Reserve(array, 100, arena.ptr()));
+  EXPECT_EQ(array->capacity, 100);
+  EXPECT_EQ(upb_Array_Size(array), 0);
+  const void* data = upb_Array_DataPtr(array);
+  for (int i = 0; i < 100; i++) {
+    upb_MessageValue mv;
+    mv.int64_val = i;
+    ASSERT_TRUE(upb_Array_Append(array, mv, arena.ptr()));
+  }
+  EXPECT_EQ(upb_Array_DataPtr(array), data);
+
+  // Appending past the reservation still grows geometrically.
+  upb_MessageValue mv;
+  mv.int64_val = 100;
+  ASSERT_TRUE(upb_Array_Append(array, mv, arena.ptr()));
+  EXPECT_EQ(array->capacity, 200);
+
+  upb_Array_ShrinkToFit(array, arena.ptr());
+  EXPECT_EQ(array->capacity, 101);
+  EXPECT_EQ(upb_Array_Size(array), 101);
+  for (int i = 0; i <= 100; i++) {
+    EXPECT_EQ(upb_Array_Get(array, i).int64_val, i);
+  }
+}
@@ -31,6 +31,7 @@
 #ifndef UPB_COLLECTIONS_INTERNAL_ARRAY_H_
 #define UPB_COLLECTIONS_INTERNAL_ARRAY_H_
 
+#include <stdint.h>
 #include <string.h>
 
 #include "upb/collections/array.h"
@@ -48,22 +49,42 @@ struct upb_Array {
   uintptr_t data;  /* Tagged ptr: low 3 bits of ptr are lg2(elem size). */
   size_t size;     /* The number of elements in the array. */
   size_t capacity; /* Allocated storage. Measured in elements. */
+  bool is_frozen;  /* Set by upb_Array_Freeze(). */
+
+  /* For arrays of message pointers, elements [size, retained) hold empty
+   * messages kept by upb_Message_ClearForReuse() for the decoder to fill
+   * again (see kUpb_DecodeOption_ReuseRetained). */
+  uint32_t retained;
 };
 // LINT.ThenChange(GoogleInternalName1)
 
+// Arrays of messages normally hold pointers, but they can also hold the
+// messages themselves (see upb_MiniTable_SetInlineMessages()).  Each element
+// is then a whole message, preceded by its upb_Message_Internal header and
+// padded to a power of two of at least 1 << kUpb_Array_MinInlineLg2 bytes.
+// No pointer or scalar is that large, so the element size alone tells the two
+// representations apart.
+#define kUpb_Array_MinInlineLg2 5
+#define kUpb_Array_MaxInlineLg2 7
+#define kUpb_Array_InlineHeaderSize 8  // sizeof(upb_Message_Internal)
+
 UPB_INLINE size_t _upb_Array_ElementSizeLg2(const upb_Array* arr) {
   size_t ret = arr->data & 7;
-  UPB_ASSERT(ret <= 4);
+  UPB_ASSERT(ret <= 4 || ret >= kUpb_Array_MinInlineLg2);
   return ret;
 }
 
+UPB_INLINE bool _upb_Array_HasInlineMessages(const upb_Array* arr) {
+  return (arr->data & 7) >= kUpb_Array_MinInlineLg2;
+}
+
 UPB_INLINE const void* _upb_array_constptr(const upb_Array* arr) {
   _upb_Array_ElementSizeLg2(arr);  // Check assertion.
   return (void*)(arr->data & ~(uintptr_t)7);
 }
 
 UPB_INLINE uintptr_t _upb_array_tagptr(void* ptr, int elem_size_lg2) {
-  UPB_ASSERT(elem_size_lg2 <= 4);
+  UPB_ASSERT(elem_size_lg2 <= kUpb_Array_MaxInlineLg2);
   return (uintptr_t)ptr | elem_size_lg2;
 }
 
@@ -71,8 +92,17 @@ UPB_INLINE void* _upb_array_ptr(upb_Array* arr) {
   return (void*)_upb_array_constptr(arr);
 }
 
+// Returns element `i` of an array of inline messages.
+UPB_INLINE upb_Message* _upb_Array_InlineMessage(const upb_Array* arr,
+                                                 size_t i) {
+  UPB_ASSERT(_upb_Array_HasInlineMessages(arr));
+  UPB_ASSERT(i < arr->capacity);
+  char* elem = (char*)_upb_array_constptr(arr) + (i << (arr->data & 7));
+  return (upb_Message*)(elem + kUpb_Array_InlineHeaderSize);
+}
+
 UPB_INLINE uintptr_t _upb_tag_arrptr(void* ptr, int elem_size_lg2) {
-  UPB_ASSERT(elem_size_lg2 <= 4);
+  UPB_ASSERT(elem_size_lg2 <= kUpb_Array_MaxInlineLg2);
   UPB_ASSERT(((uintptr_t)ptr & 7) == 0);
   return (uintptr_t)ptr | (unsigned)elem_size_lg2;
 }
@@ -85,7 +115,7 @@ UPB_INLINE size_t _upb_Array_CTypeSizeLg2(upb_CType ctype) {
 
 UPB_INLINE upb_Array* _upb_Array_New(upb_Arena* a, size_t init_capacity,
                                      int elem_size_lg2) {
-  UPB_ASSERT(elem_size_lg2 <= 4);
+  UPB_ASSERT(elem_size_lg2 <= kUpb_Array_MaxInlineLg2);
   const size_t arr_size = UPB_ALIGN_UP(sizeof(upb_Array), UPB_MALLOC_ALIGN);
   const size_t bytes = arr_size + (init_capacity << elem_size_lg2);
   upb_Array* arr = (upb_Array*)upb_Arena_Malloc(a, bytes);
@@ -93,6 +123,8 @@ UPB_INLINE upb_Array* _upb_Array_New(upb_Arena* a, size_t init_capacity,
   arr->data = _upb_tag_arrptr(UPB_PTR_AT(arr, arr_size, void), elem_size_lg2);
   arr->size = 0;
   arr->capacity = init_capacity;
+  arr->is_frozen = false;
+  arr->retained = 0;
   return arr;
 }
 
@@ -109,6 +141,7 @@ UPB_INLINE bool _upb_array_reserve(upb_Array* arr, size_t size,
 UPB_INLINE bool _upb_Array_ResizeUninitialized(upb_Array* arr, size_t size,
                                                upb_Arena* arena) {
   UPB_ASSERT(size <= arr->size || arena);  // Allow NULL arena when shrinking.
+  UPB_ASSERT(!arr->is_frozen);
   if (!_upb_array_reserve(arr, size, arena)) return false;
   arr->size = size;
   return true;
@@ -121,6 +154,7 @@ UPB_INLINE void _upb_Array_Set(upb_Array* arr, size_t i, const void* data,
                                size_t elem_size) {
   UPB_ASSERT(i < arr->size);
   UPB_ASSERT(elem_size == 1U << _upb_Array_ElementSizeLg2(arr));
+  UPB_ASSERT(!arr->is_frozen);
   char* arr_data = (char*)_upb_array_ptr(arr);
   memcpy(arr_data + (i * elem_size), data, elem_size);
 }
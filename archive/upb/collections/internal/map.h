@@ -41,19 +41,181 @@
 // Must be last.
 #include "upb/port/def.inc"
 
+// An entry of a map.  `key` and `val` are at the same offsets as in
+// upb_tabent, so the string helpers of upb/hash (upb_tabstr()) read the keys
+// of string-keyed maps, which point to a copy of the key in the same format as
+// a upb_strtable's.  Integer keys of every type are stored zero-extended to 64
+// bits; on 32-bit platforms the high half is kept in `key_hi`.
+typedef struct {
+  uintptr_t key;
+  upb_tabval val;
+#if UINTPTR_MAX == 0xffffffff
+  uint32_t key_hi;
+#endif
+} upb_MapTableEntry;
+
+// A slot of a map's index: the hash of an entry's key, and 1 + the position of
+// the entry, or 0 if the slot is empty.
+typedef struct {
+  uint32_t hash;
+  uint32_t entry;
+} upb_MapIndexSlot;
+
+// The table of a map, for keys of any type.  The entries are dense: they fill
+// entries[0, count) in the order they were inserted, except that removing an
+// entry moves the last one into its place.  Iteration is a linear scan over
+// them, however large the table has grown.  The index finds an entry by its
+// key: open addressing with linear probing, where each slot also keeps the
+// key's hash, so that most mismatches and every resize avoid touching the
+// entries.  Up to 7/8 of the index slots are used, and the entries array has
+// room for that many.
+typedef struct {
+  upb_MapTableEntry* entries;  // NULL until the first insertion.
+  upb_MapIndexSlot* index;     // `mask + 1` slots.
+  uint32_t mask;
+  uint32_t count;
+} upb_MapTable;
+
+// A key of an ordered map (see upb_Map_SetOrdered()), in the form that
+// map_sorter.c compares: integer keys are mapped to unsigned integers with the
+// same order, and string keys point to the table's copy of the key.
+typedef union {
+  uint64_t num;
+  upb_StringView str;
+} upb_MapOrderKey;
+
+// The keys of an ordered map.  keys[0, sorted) are in order, while
+// keys[sorted, size) were added since and are in no particular order; they are
+// merged into the sorted run once there are enough of them.  Removing a key
+// only counts it in `removed`, so until the next merge the keys may include
+// some that are no longer in the map, and a key may appear more than once.
+// Readers skip both.
+typedef struct {
+  upb_MapOrderKey* keys;
+  uint32_t sorted;
+  uint32_t size;
+  uint32_t capacity;
+  uint32_t removed;
+  char kind;  // How keys compare, see map_sorter.c.
+} upb_MapOrder;
+
 struct upb_Map {
   // Size of key and val, based on the map type.
   // Strings are represented as '0' because they must be handled specially.
   char key_size;
   char val_size;
 
-  upb_strtable table;
+  // Which key order `sorted` holds (see map_sorter.c), or 0 if none.
+  char sorted_kind;
+
+  // Set by upb_Map_Freeze(); the map may no longer be modified.
+  bool is_frozen;
+
+  upb_MapTable table;
+
+  // The table entries in key order, saved by upb_Map_SortKeys() for reuse by
+  // deterministic serialization.  Cleared whenever a key is inserted or
+  // removed, since that may move entries within the table.
+  const void** sorted;
+
+  // The key order that an ordered map maintains, or NULL.
+  upb_MapOrder* order;
 };
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+UPB_INLINE uint64_t _upb_MapTableEntry_IntKey(const upb_MapTableEntry* e) {
+#if UINTPTR_MAX == 0xffffffff
+  return ((uint64_t)e->key_hi << 32) | e->key;
+#else
+  return e->key;
+#endif
+}
+
+UPB_INLINE void _upb_MapTableEntry_SetIntKey(upb_MapTableEntry* e,
+                                             uint64_t key) {
+  e->key = (uintptr_t)key;
+#if UINTPTR_MAX == 0xffffffff
+  e->key_hi = (uint32_t)(key >> 32);
+#endif
+}
+
+UPB_INLINE upb_StringView _upb_MapTableEntry_StrKey(
+    const upb_MapTableEntry* e) {
+  return upb_tabstrview(e->key);
+}
+
+UPB_INLINE uint32_t _upb_MapTable_IntHash(uint64_t key) {
+  uint64_t h = key * 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 32;
+  h *= 0x9e3779b97f4a7c15ULL;
+  return (uint32_t)(h >> 32);
+}
+
+UPB_INLINE uint32_t _upb_MapTable_StrHash(upb_StringView key) {
+  return _upb_Hash(key.data, key.size, 0);
+}
+
+// Returns the number of entries that the table has room for.
+UPB_INLINE uint32_t _upb_MapTable_Capacity(const upb_MapTable* t) {
+  return t->entries ? t->mask + 1 - (t->mask + 1) / 8 : 0;
+}
+
+UPB_INLINE void _upb_MapTable_Prefetch(const upb_MapTable* t, uint32_t hash) {
+  if (t->entries) UPB_PREFETCH(&t->index[hash & t->mask]);
+}
+
+// Returns the entry whose key has hash `hash` and is equal to `key`, or NULL
+// if there is none.
+UPB_INLINE upb_MapTableEntry* _upb_MapTable_FindInt(const upb_MapTable* t,
+                                                    uint64_t key,
+                                                    uint32_t hash) {
+  if (!t->entries) return NULL;
+  // The index is never full, so the probe always hits an empty slot.
+  for (uint32_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+    const upb_MapIndexSlot* s = &t->index[i];
+    if (s->entry == 0) return NULL;
+    upb_MapTableEntry* e = &t->entries[s->entry - 1];
+    if (s->hash == hash && _upb_MapTableEntry_IntKey(e) == key) return e;
+  }
+}
+
+UPB_INLINE upb_MapTableEntry* _upb_MapTable_FindStr(const upb_MapTable* t,
+                                                    upb_StringView key,
+                                                    uint32_t hash) {
+  if (!t->entries) return NULL;
+  for (uint32_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+    const upb_MapIndexSlot* s = &t->index[i];
+    if (s->entry == 0) return NULL;
+    if (s->hash != hash) continue;
+    upb_MapTableEntry* e = &t->entries[s->entry - 1];
+    if (upb_StringView_IsEqual(_upb_MapTableEntry_StrKey(e), key)) return e;
+  }
+}
+
+// Returns the entry for `key`, adding it with an unspecified value if it is
+// not present yet, in which case `*added` is set.  A string key is copied into
+// `a`.  Returns NULL if allocation fails.
+upb_MapTableEntry* _upb_MapTable_InsertInt(upb_MapTable* t, uint64_t key,
+                                           bool* added, upb_Arena* a);
+upb_MapTableEntry* _upb_MapTable_InsertStr(upb_MapTable* t,
+                                           upb_StringView key, bool* added,
+                                           upb_Arena* a);
+
+// Removes `e`, which must be an entry of `t` whose key has hash `hash`.  The
+// last entry takes its place.  `is_str` is whether the keys are strings.
+void _upb_MapTable_Remove(upb_MapTable* t, upb_MapTableEntry* e,
+                          uint32_t hash, bool is_str);
+
+// Makes room for `size` entries.  Returns false if allocation fails.
+bool _upb_MapTable_Reserve(upb_MapTable* t, size_t size, upb_Arena* a);
+
+UPB_INLINE bool _upb_Map_IsIntKeyed(const upb_Map* map) {
+  return map->key_size != UPB_MAPTYPE_STRING;
+}
+
 // Converting between internal table representation and user values.
 //
 // _upb_map_tokey() and _upb_map_fromkey() are inverses.
@@ -78,6 +240,47 @@ UPB_INLINE void _upb_map_fromkey(upb_StringView key, void* out, size_t size) {
   }
 }
 
+// Like _upb_map_tokey() and _upb_map_fromkey(), for integer-keyed maps.
+UPB_INLINE uint64_t _upb_map_tointkey(const void* key, size_t size) {
+  switch (size) {
+    case 1: {
+      bool b;
+      memcpy(&b, key, 1);
+      return b;
+    }
+    case 4: {
+      uint32_t u32;
+      memcpy(&u32, key, 4);
+      return u32;
+    }
+    default: {
+      UPB_ASSERT(size == 8);
+      uint64_t u64;
+      memcpy(&u64, key, 8);
+      return u64;
+    }
+  }
+}
+
+UPB_INLINE void _upb_map_fromintkey(uint64_t key, void* out, size_t size) {
+  switch (size) {
+    case 1: {
+      bool b = key != 0;
+      memcpy(out, &b, 1);
+      break;
+    }
+    case 4: {
+      uint32_t u32 = (uint32_t)key;
+      memcpy(out, &u32, 4);
+      break;
+    }
+    default:
+      UPB_ASSERT(size == 8);
+      memcpy(out, &key, 8);
+      break;
+  }
+}
+
 UPB_INLINE bool _upb_map_tovalue(const void* val, size_t size,
                                  upb_value* msgval, upb_Arena* a) {
   if (size == UPB_MAPTYPE_STRING) {
@@ -96,62 +299,142 @@ UPB_INLINE void _upb_map_fromvalue(upb_value val, void* out, size_t size) {
     const upb_StringView* strp = (const upb_StringView*)upb_value_getptr(val);
     memcpy(out, strp, sizeof(upb_StringView));
   } else {
-    memcpy(out, &val, size);
+    // Copies of a constant size compile to a single move, where a copy of
+    // `size` bytes may go through a slow string instruction.
+    switch (size) {
+      case 1:
+        memcpy(out, &val, 1);
+        break;
+      case 4:
+        memcpy(out, &val, 4);
+        break;
+      default:
+        UPB_ASSERT(size == 8);
+        memcpy(out, &val, 8);
+        break;
+    }
   }
 }
 
+// Returns the entry after `*iter` and advances `*iter` to it, or returns NULL
+// at the end of the map.
 UPB_INLINE void* _upb_map_next(const upb_Map* map, size_t* iter) {
-  upb_strtable_iter it;
-  it.t = &map->table;
-  it.index = *iter;
-  upb_strtable_next(&it);
-  *iter = it.index;
-  if (upb_strtable_done(&it)) return NULL;
-  return (void*)str_tabent(&it);
+  const size_t i = ++*iter;  // kUpb_Map_Begin wraps around to 0.
+  return i < map->table.count ? &map->table.entries[i] : NULL;
+}
+
+UPB_INLINE void _upb_Map_ClearSortedKeys(upb_Map* map) {
+  map->sorted_kind = 0;
+  map->sorted = NULL;
 }
 
+// Implemented in map_sorter.c.  Before inserting into an ordered map,
+// _upb_MapOrder_Reserve() makes room for one more key, and once the key is
+// inserted (not replaced) _upb_MapOrder_Add() records it.
+bool _upb_MapOrder_Reserve(upb_Map* map, upb_Arena* a);
+void _upb_MapOrder_Add(upb_Map* map, const void* key);
+
 UPB_INLINE void _upb_Map_Clear(upb_Map* map) {
-  upb_strtable_clear(&map->table);
+  UPB_ASSERT(!map->is_frozen);
+  _upb_Map_ClearSortedKeys(map);
+  if (map->order) {
+    map->order->sorted = 0;
+    map->order->size = 0;
+    map->order->removed = 0;
+  }
+  upb_MapTable* t = &map->table;
+  if (t->count) memset(t->index, 0, (t->mask + 1) * sizeof(*t->index));
+  t->count = 0;
+}
+
+// Returns the entry for `key` and sets `*hash` to the hash of the key, or
+// returns NULL if the key is not in the map.
+UPB_INLINE upb_MapTableEntry* _upb_Map_Find(const upb_Map* map,
+                                            const void* key, size_t key_size,
+                                            uint32_t* hash) {
+  if (_upb_Map_IsIntKeyed(map)) {
+    uint64_t k = _upb_map_tointkey(key, key_size);
+    *hash = _upb_MapTable_IntHash(k);
+    return _upb_MapTable_FindInt(&map->table, k, *hash);
+  }
+  upb_StringView k = _upb_map_tokey(key, key_size);
+  *hash = _upb_MapTable_StrHash(k);
+  return _upb_MapTable_FindStr(&map->table, k, *hash);
 }
 
 UPB_INLINE bool _upb_Map_Delete(upb_Map* map, const void* key, size_t key_size,
                                 upb_value* val) {
-  upb_StringView k = _upb_map_tokey(key, key_size);
-  return upb_strtable_remove2(&map->table, k.data, k.size, val);
+  UPB_ASSERT(!map->is_frozen);
+  _upb_Map_ClearSortedKeys(map);
+  uint32_t hash;
+  upb_MapTableEntry* e = _upb_Map_Find(map, key, key_size, &hash);
+  if (!e) return false;
+  if (val) val->val = e->val.val;
+  _upb_MapTable_Remove(&map->table, e, hash, !_upb_Map_IsIntKeyed(map));
+  // The key stays in the order until the next merge drops it.
+  if (map->order) map->order->removed++;
+  return true;
 }
 
 UPB_INLINE bool _upb_Map_Get(const upb_Map* map, const void* key,
                              size_t key_size, void* val, size_t val_size) {
-  upb_value tabval;
-  upb_StringView k = _upb_map_tokey(key, key_size);
-  bool ret = upb_strtable_lookup2(&map->table, k.data, k.size, &tabval);
-  if (ret && val) {
+  uint32_t hash;
+  const upb_MapTableEntry* e = _upb_Map_Find(map, key, key_size, &hash);
+  if (!e) return false;
+  if (val) {
+    upb_value tabval = {e->val.val};
     _upb_map_fromvalue(tabval, val, val_size);
   }
-  return ret;
+  return true;
 }
 
 UPB_INLINE upb_MapInsertStatus _upb_Map_Insert(upb_Map* map, const void* key,
                                                size_t key_size, void* val,
                                                size_t val_size, upb_Arena* a) {
-  upb_StringView strkey = _upb_map_tokey(key, key_size);
+  UPB_ASSERT(!map->is_frozen);
   upb_value tabval = {0};
   if (!_upb_map_tovalue(val, val_size, &tabval, a)) {
     return kUpb_MapInsertStatus_OutOfMemory;
   }
-
-  // TODO(haberman): add overwrite operation to minimize number of lookups.
-  bool removed =
-      upb_strtable_remove2(&map->table, strkey.data, strkey.size, NULL);
-  if (!upb_strtable_insert(&map->table, strkey.data, strkey.size, tabval, a)) {
+  if (UPB_UNLIKELY(map->order) && !_upb_MapOrder_Reserve(map, a)) {
     return kUpb_MapInsertStatus_OutOfMemory;
   }
-  return removed ? kUpb_MapInsertStatus_Replaced
-                 : kUpb_MapInsertStatus_Inserted;
+
+  bool added;
+  upb_MapTableEntry* e =
+      _upb_Map_IsIntKeyed(map)
+          ? _upb_MapTable_InsertInt(&map->table,
+                                    _upb_map_tointkey(key, key_size), &added, a)
+          : _upb_MapTable_InsertStr(&map->table, _upb_map_tokey(key, key_size),
+                                    &added, a);
+  if (!e) return kUpb_MapInsertStatus_OutOfMemory;
+  e->val.val = tabval.val;
+  // Replacing a value leaves the entries where they are.
+  if (!added) return kUpb_MapInsertStatus_Replaced;
+  _upb_Map_ClearSortedKeys(map);
+  if (UPB_UNLIKELY(map->order)) _upb_MapOrder_Add(map, key);
+  return kUpb_MapInsertStatus_Inserted;
 }
 
 UPB_INLINE size_t _upb_Map_Size(const upb_Map* map) {
-  return map->table.t.count;
+  return map->table.count;
+}
+
+// Like upb_Map_Next(), but stores the key and value in the representation of
+// _upb_map_fromkey() and _upb_map_fromvalue().
+UPB_INLINE bool _upb_Map_Next(const upb_Map* map, void* key, void* val,
+                              size_t* iter) {
+  const upb_MapTableEntry* e =
+      (const upb_MapTableEntry*)_upb_map_next(map, iter);
+  if (!e) return false;
+  if (_upb_Map_IsIntKeyed(map)) {
+    _upb_map_fromintkey(_upb_MapTableEntry_IntKey(e), key, map->key_size);
+  } else {
+    _upb_map_fromkey(_upb_MapTableEntry_StrKey(e), key, map->key_size);
+  }
+  upb_value v = {e->val.val};
+  _upb_map_fromvalue(v, val, map->val_size);
+  return true;
 }
 
 // Strings/bytes are special-cased in maps.
@@ -164,6 +447,23 @@ UPB_INLINE size_t _upb_Map_CTypeSize(upb_CType ctype) {
 // Creates a new map on the given arena with this key/value type.
 upb_Map* _upb_Map_New(upb_Arena* a, size_t key_size, size_t value_size);
 
+// Like _upb_Map_New(), but with room for `size` entries before the table has
+// to grow.
+upb_Map* _upb_Map_NewSized(upb_Arena* a, size_t key_size, size_t value_size,
+                           size_t size);
+
+// Grows the map's table to hold `size` entries, see upb_Map_Reserve().
+bool _upb_Map_Reserve(upb_Map* map, size_t size, upb_Arena* a);
+
+// Returns the arena space held by the map itself: the map, its table, its
+// copies of string keys, the boxes of string values and any saved key order.
+// The data of string values and message values is not included.
+size_t _upb_Map_SpaceUsed(const upb_Map* map);
+
+// Like upb_Map_SetOrdered(), with the key type given as a field type.
+// Implemented in map_sorter.c.
+bool _upb_Map_SetOrdered(upb_Map* map, upb_FieldType key_type, upb_Arena* a);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
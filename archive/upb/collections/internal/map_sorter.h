@@ -54,6 +54,10 @@ typedef struct {
   void const** entries;
   int size;
   int cap;
+
+  // Temporary space used while sorting.
+  void* scratch;
+  size_t scratch_size;
 } _upb_mapsorter;
 
 typedef struct {
@@ -66,20 +70,34 @@ UPB_INLINE void _upb_mapsorter_init(_upb_mapsorter* s) {
   s->entries = NULL;
   s->size = 0;
   s->cap = 0;
+  s->scratch = NULL;
+  s->scratch_size = 0;
 }
 
 UPB_INLINE void _upb_mapsorter_destroy(_upb_mapsorter* s) {
   if (s->entries) free(s->entries);
+  if (s->scratch) free(s->scratch);
+}
+
+// Reads a sorted entry, which points to an entry of the map's table.
+UPB_INLINE void _upb_sortedmap_getentry(const upb_Map* map, const void* entry,
+                                        upb_MapEntry* ent) {
+  const upb_MapTableEntry* e = (const upb_MapTableEntry*)entry;
+  if (_upb_Map_IsIntKeyed(map)) {
+    _upb_map_fromintkey(_upb_MapTableEntry_IntKey(e), &ent->data.k,
+                        map->key_size);
+  } else {
+    _upb_map_fromkey(_upb_MapTableEntry_StrKey(e), &ent->data.k,
+                     map->key_size);
+  }
+  upb_value val = {e->val.val};
+  _upb_map_fromvalue(val, &ent->data.v, map->val_size);
 }
 
 UPB_INLINE bool _upb_sortedmap_next(_upb_mapsorter* s, const upb_Map* map,
                                     _upb_sortedmap* sorted, upb_MapEntry* ent) {
   if (sorted->pos == sorted->end) return false;
-  const upb_tabent* tabent = (const upb_tabent*)s->entries[sorted->pos++];
-  upb_StringView key = upb_tabstrview(tabent->key);
-  _upb_map_fromkey(key, &ent->data.k, map->key_size);
-  upb_value val = {tabent->val.val};
-  _upb_map_fromvalue(val, &ent->data.v, map->val_size);
+  _upb_sortedmap_getentry(map, s->entries[sorted->pos++], ent);
   return true;
 }
 
@@ -91,6 +109,23 @@ UPB_INLINE bool _upb_sortedmap_nextext(_upb_mapsorter* s,
   return true;
 }
 
+// Like _upb_sortedmap_next(), but iterates from the last entry to the first.
+UPB_INLINE bool _upb_sortedmap_prev(_upb_mapsorter* s, const upb_Map* map,
+                                    _upb_sortedmap* sorted, upb_MapEntry* ent) {
+  if (sorted->pos == sorted->end) return false;
+  _upb_sortedmap_getentry(map, s->entries[--sorted->end], ent);
+  return true;
+}
+
+// Like _upb_sortedmap_nextext(), but iterates from the last entry to the first.
+UPB_INLINE bool _upb_sortedmap_prevext(_upb_mapsorter* s,
+                                       _upb_sortedmap* sorted,
+                                       const upb_Message_Extension** ext) {
+  if (sorted->pos == sorted->end) return false;
+  *ext = (const upb_Message_Extension*)s->entries[--sorted->end];
+  return true;
+}
+
 UPB_INLINE void _upb_mapsorter_popmap(_upb_mapsorter* s,
                                       _upb_sortedmap* sorted) {
   s->size = sorted->start;
@@ -30,8 +30,10 @@
 
 #include "upb/collections/map.h"
 
+#include <stddef.h>
 #include <string.h>
 
+#include "upb/base/internal/log2.h"
 #include "upb/collections/internal/map.h"
 #include "upb/mem/arena.h"
 
@@ -60,13 +62,76 @@ upb_Map* upb_Map_New(upb_Arena* a, upb_CType key_type, upb_CType value_type) {
 
 size_t upb_Map_Size(const upb_Map* map) { return _upb_Map_Size(map); }
 
+bool upb_Map_IsOrdered(const upb_Map* map) { return map->order != NULL; }
+
+bool upb_Map_IsFrozen(const upb_Map* map) { return map->is_frozen; }
+
 bool upb_Map_Get(const upb_Map* map, upb_MessageValue key,
                  upb_MessageValue* val) {
   return _upb_Map_Get(map, &key, map->key_size, val, map->val_size);
 }
 
+// The batched operations work through the keys in blocks, hashing the keys of
+// a whole block and prefetching their index slots before probing for any key.
+#define kUpb_Map_BatchSize 16
+
+// Stores the hash of each of the `n` keys into `hashes` and prefetches the
+// index slot where its probe starts.
+static void _upb_Map_Prefetch(const upb_Map* map, const upb_MessageValue* keys,
+                              size_t n, uint32_t* hashes) {
+  for (size_t i = 0; i < n; i++) {
+    if (_upb_Map_IsIntKeyed(map)) {
+      hashes[i] = _upb_MapTable_IntHash(_upb_map_tointkey(&keys[i],
+                                                          map->key_size));
+    } else {
+      hashes[i] = _upb_MapTable_StrHash(_upb_map_tokey(&keys[i],
+                                                       map->key_size));
+    }
+    _upb_MapTable_Prefetch(&map->table, hashes[i]);
+  }
+}
+
+static bool _upb_Map_GetHashed(const upb_Map* map, const upb_MessageValue* key,
+                               uint32_t hash, upb_value* v) {
+  const upb_MapTableEntry* e =
+      _upb_Map_IsIntKeyed(map)
+          ? _upb_MapTable_FindInt(&map->table,
+                                  _upb_map_tointkey(key, map->key_size), hash)
+          : _upb_MapTable_FindStr(&map->table,
+                                  _upb_map_tokey(key, map->key_size), hash);
+  if (!e) return false;
+  v->val = e->val.val;
+  return true;
+}
+
+size_t upb_Map_GetBatch(const upb_Map* map, const upb_MessageValue* keys,
+                        size_t count, upb_MessageValue* vals, bool* found) {
+  uint32_t hashes[kUpb_Map_BatchSize];
+  size_t ret = 0;
+  for (size_t start = 0; start < count; start += kUpb_Map_BatchSize) {
+    const size_t n = UPB_MIN(count - start, kUpb_Map_BatchSize);
+    _upb_Map_Prefetch(map, &keys[start], n, hashes);
+    for (size_t i = 0; i < n; i++) {
+      const size_t j = start + i;
+      upb_value v;
+      const bool present = _upb_Map_GetHashed(map, &keys[j], hashes[i], &v);
+      if (present) {
+        ret++;
+        if (vals) _upb_map_fromvalue(v, &vals[j], map->val_size);
+      }
+      if (found) found[j] = present;
+    }
+  }
+  return ret;
+}
+
 void upb_Map_Clear(upb_Map* map) { _upb_Map_Clear(map); }
 
+bool upb_Map_Reserve(upb_Map* map, size_t size, upb_Arena* arena) {
+  UPB_ASSERT(arena);
+  return _upb_Map_Reserve(map, size, arena);
+}
+
 upb_MapInsertStatus upb_Map_Insert(upb_Map* map, upb_MessageValue key,
                                    upb_MessageValue val, upb_Arena* arena) {
   UPB_ASSERT(arena);
@@ -74,30 +139,46 @@ upb_MapInsertStatus upb_Map_Insert(upb_Map* map, upb_MessageValue key,
                                               map->val_size, arena);
 }
 
+bool upb_Map_InsertBatch(upb_Map* map, const upb_MessageValue* keys,
+                         const upb_MessageValue* vals, size_t count,
+                         upb_Arena* arena) {
+  UPB_ASSERT(arena);
+  if (!_upb_Map_Reserve(map, _upb_Map_Size(map) + count, arena)) return false;
+  uint32_t hashes[kUpb_Map_BatchSize];
+  for (size_t start = 0; start < count; start += kUpb_Map_BatchSize) {
+    const size_t n = UPB_MIN(count - start, kUpb_Map_BatchSize);
+    // Only the prefetch is batched; the insertion hashes each key again.
+    _upb_Map_Prefetch(map, &keys[start], n, hashes);
+    for (size_t j = start; j < start + n; j++) {
+      upb_MessageValue val = vals[j];
+      if (_upb_Map_Insert(map, &keys[j], map->key_size, &val, map->val_size,
+                          arena) == kUpb_MapInsertStatus_OutOfMemory) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 bool upb_Map_Delete(upb_Map* map, upb_MessageValue key, upb_MessageValue* val) {
   upb_value v;
   const bool removed = _upb_Map_Delete(map, &key, map->key_size, &v);
-  if (val) _upb_map_fromvalue(v, val, map->val_size);
+  if (removed && val) _upb_map_fromvalue(v, val, map->val_size);
   return removed;
 }
 
 bool upb_Map_Next(const upb_Map* map, upb_MessageValue* key,
                   upb_MessageValue* val, size_t* iter) {
-  upb_StringView k;
-  upb_value v;
-  const bool ok = upb_strtable_next2(&map->table, &k, &v, (intptr_t*)iter);
-  if (ok) {
-    _upb_map_fromkey(k, key, map->key_size);
-    _upb_map_fromvalue(v, val, map->val_size);
-  }
-  return ok;
+  return _upb_Map_Next(map, key, val, iter);
 }
 
 UPB_API void upb_Map_SetEntryValue(upb_Map* map, size_t iter,
                                    upb_MessageValue val) {
+  UPB_ASSERT(!map->is_frozen);
+  UPB_ASSERT(iter < map->table.count);
   upb_value v;
   _upb_map_tovalue(&val, map->val_size, &v, NULL);
-  upb_strtable_setentryvalue(&map->table, iter, v);
+  map->table.entries[iter].val.val = v.val;
 }
 
 bool upb_MapIterator_Next(const upb_Map* map, size_t* iter) {
@@ -105,41 +186,222 @@ bool upb_MapIterator_Next(const upb_Map* map, size_t* iter) {
 }
 
 bool upb_MapIterator_Done(const upb_Map* map, size_t iter) {
-  upb_strtable_iter i;
   UPB_ASSERT(iter != kUpb_Map_Begin);
-  i.t = &map->table;
-  i.index = iter;
-  return upb_strtable_done(&i);
+  return iter >= map->table.count;
 }
 
 // Returns the key and value for this entry of the map.
 upb_MessageValue upb_MapIterator_Key(const upb_Map* map, size_t iter) {
-  upb_strtable_iter i;
+  const upb_MapTableEntry* e = &map->table.entries[iter];
   upb_MessageValue ret;
-  i.t = &map->table;
-  i.index = iter;
-  _upb_map_fromkey(upb_strtable_iter_key(&i), &ret, map->key_size);
+  if (_upb_Map_IsIntKeyed(map)) {
+    _upb_map_fromintkey(_upb_MapTableEntry_IntKey(e), &ret, map->key_size);
+  } else {
+    _upb_map_fromkey(_upb_MapTableEntry_StrKey(e), &ret, map->key_size);
+  }
   return ret;
 }
 
 upb_MessageValue upb_MapIterator_Value(const upb_Map* map, size_t iter) {
-  upb_strtable_iter i;
+  upb_value v = {map->table.entries[iter].val.val};
   upb_MessageValue ret;
-  i.t = &map->table;
-  i.index = iter;
-  _upb_map_fromvalue(upb_strtable_iter_value(&i), &ret, map->val_size);
+  _upb_map_fromvalue(v, &ret, map->val_size);
   return ret;
 }
 
 // EVERYTHING BELOW THIS LINE IS INTERNAL - DO NOT USE /////////////////////////
 
+// Returns the number of index slots for a table with room for `size` entries.
+static uint32_t _upb_MapTable_SlotsFor(size_t size) {
+  uint32_t slots = 8;
+  // Overflow of the slot count is unreachable: the entries would not fit in
+  // memory long before.
+  while ((uint64_t)size * 8 > (uint64_t)slots * 7) slots *= 2;
+  return slots;
+}
+
+// Returns the slot of `t`'s index where the probe for `hash` ends: the empty
+// slot after every slot of the probe sequence that is in use.
+static upb_MapIndexSlot* _upb_MapTable_EmptySlot(const upb_MapTable* t,
+                                                 uint32_t hash) {
+  uint32_t i = hash & t->mask;
+  while (t->index[i].entry != 0) i = (i + 1) & t->mask;
+  return &t->index[i];
+}
+
+static bool _upb_MapTable_Resize(upb_MapTable* t, uint32_t slots,
+                                 upb_Arena* a) {
+  const uint32_t old_slots = t->entries ? t->mask + 1 : 0;
+  const uint32_t capacity = slots - slots / 8;
+  // The old entries and index stay in the arena, like the old array of a
+  // upb_strtable.
+  upb_MapTableEntry* entries =
+      upb_Arena_Realloc(a, t->entries,
+                        _upb_MapTable_Capacity(t) * sizeof(*entries),
+                        capacity * sizeof(*entries));
+  upb_MapIndexSlot* index = upb_Arena_Malloc(a, slots * sizeof(*index));
+  if (!entries || !index) return false;
+  memset(index, 0, slots * sizeof(*index));
+  const upb_MapIndexSlot* old_index = t->index;
+  t->entries = entries;
+  t->index = index;
+  t->mask = slots - 1;
+  // The slots keep the hashes, so no key is hashed again.
+  for (uint32_t i = 0; i < old_slots; i++) {
+    if (old_index[i].entry == 0) continue;
+    *_upb_MapTable_EmptySlot(t, old_index[i].hash) = old_index[i];
+  }
+  return true;
+}
+
+bool _upb_MapTable_Reserve(upb_MapTable* t, size_t size, upb_Arena* a) {
+  if (size <= _upb_MapTable_Capacity(t) && (t->entries || size == 0)) {
+    return true;
+  }
+  return _upb_MapTable_Resize(t, _upb_MapTable_SlotsFor(size), a);
+}
+
+// Appends an entry whose key has hash `hash`, which is not in the table yet.
+// Its key and value are left for the caller to set.
+static upb_MapTableEntry* _upb_MapTable_Append(upb_MapTable* t, uint32_t hash,
+                                               upb_Arena* a) {
+  if (t->count == _upb_MapTable_Capacity(t) &&
+      !_upb_MapTable_Resize(t, _upb_MapTable_SlotsFor(t->count + 1), a)) {
+    return NULL;
+  }
+  upb_MapIndexSlot* slot = _upb_MapTable_EmptySlot(t, hash);
+  slot->hash = hash;
+  slot->entry = ++t->count;
+  return &t->entries[t->count - 1];
+}
+
+upb_MapTableEntry* _upb_MapTable_InsertInt(upb_MapTable* t, uint64_t key,
+                                           bool* added, upb_Arena* a) {
+  const uint32_t hash = _upb_MapTable_IntHash(key);
+  upb_MapTableEntry* e = _upb_MapTable_FindInt(t, key, hash);
+  *added = !e;
+  if (e) return e;
+  e = _upb_MapTable_Append(t, hash, a);
+  if (e) _upb_MapTableEntry_SetIntKey(e, key);
+  return e;
+}
+
+upb_MapTableEntry* _upb_MapTable_InsertStr(upb_MapTable* t,
+                                           upb_StringView key, bool* added,
+                                           upb_Arena* a) {
+  const uint32_t hash = _upb_MapTable_StrHash(key);
+  upb_MapTableEntry* e = _upb_MapTable_FindStr(t, key, hash);
+  *added = !e;
+  if (e) return e;
+
+  // The key is copied in the format of upb_tabstr(): its length, its data and
+  // a NUL.
+  const uint32_t len = (uint32_t)key.size;
+  char* copy = upb_Arena_Malloc(a, sizeof(len) + key.size + 1);
+  if (!copy) return NULL;
+  memcpy(copy, &len, sizeof(len));
+  if (key.size) memcpy(copy + sizeof(len), key.data, key.size);
+  copy[sizeof(len) + key.size] = '\0';
+
+  e = _upb_MapTable_Append(t, hash, a);
+  if (e) e->key = (uintptr_t)copy;
+  return e;
+}
+
+// Returns the index slot that refers to the entry at `pos`, whose key has
+// hash `hash`.
+static upb_MapIndexSlot* _upb_MapTable_SlotOf(const upb_MapTable* t,
+                                              uint32_t pos, uint32_t hash) {
+  uint32_t i = hash & t->mask;
+  while (t->index[i].entry != pos + 1) i = (i + 1) & t->mask;
+  return &t->index[i];
+}
+
+void _upb_MapTable_Remove(upb_MapTable* t, upb_MapTableEntry* e,
+                          uint32_t hash, bool is_str) {
+  const uint32_t pos = (uint32_t)(e - t->entries);
+
+  // Backward-shift deletion: move later members of the probe run into the
+  // hole so that no tombstones are needed.
+  uint32_t hole = (uint32_t)(_upb_MapTable_SlotOf(t, pos, hash) - t->index);
+  uint32_t i = hole;
+  while (true) {
+    i = (i + 1) & t->mask;
+    const upb_MapIndexSlot* s = &t->index[i];
+    if (s->entry == 0) break;
+    uint32_t home = s->hash & t->mask;
+    // The slot may fill the hole only if its home is not in (hole, i].
+    if (((i - home) & t->mask) >= ((i - hole) & t->mask)) {
+      t->index[hole] = *s;
+      hole = i;
+    }
+  }
+  t->index[hole].entry = 0;
+
+  // Keep the entries dense by moving the last one into the gap.
+  const uint32_t last = --t->count;
+  if (pos == last) return;
+  const upb_MapTableEntry* moved = &t->entries[last];
+  const uint32_t moved_hash =
+      is_str ? _upb_MapTable_StrHash(_upb_MapTableEntry_StrKey(moved))
+             : _upb_MapTable_IntHash(_upb_MapTableEntry_IntKey(moved));
+  _upb_MapTable_SlotOf(t, last, moved_hash)->entry = pos + 1;
+  *e = *moved;
+}
+
+bool _upb_Map_Reserve(upb_Map* map, size_t size, upb_Arena* a) {
+  UPB_ASSERT(!map->is_frozen);
+  // The index cannot have more slots than this.
+  if (size > (1 << 30)) return false;
+  upb_MapTableEntry* entries = map->table.entries;
+  if (!_upb_MapTable_Reserve(&map->table, size, a)) return false;
+  // The saved key order points into the old entries.
+  if (map->table.entries != entries) _upb_Map_ClearSortedKeys(map);
+  return true;
+}
+
+size_t _upb_Map_SpaceUsed(const upb_Map* map) {
+  const upb_MapTable* t = &map->table;
+  size_t ret = sizeof(upb_Map);
+  if (t->entries) {
+    ret += _upb_MapTable_Capacity(t) * sizeof(*t->entries) +
+           (t->mask + 1) * sizeof(*t->index);
+  }
+  if (!_upb_Map_IsIntKeyed(map)) {
+    for (uint32_t i = 0; i < t->count; i++) {
+      ret += sizeof(uint32_t) + _upb_MapTableEntry_StrKey(&t->entries[i]).size +
+             1;
+    }
+  }
+  if (map->val_size == UPB_MAPTYPE_STRING) {
+    ret += _upb_Map_Size(map) * sizeof(upb_StringView);
+  }
+  if (map->sorted) ret += _upb_Map_Size(map) * sizeof(*map->sorted);
+  if (map->order) {
+    ret += sizeof(*map->order) + map->order->capacity * sizeof(upb_MapOrderKey);
+  }
+  return ret;
+}
+
 upb_Map* _upb_Map_New(upb_Arena* a, size_t key_size, size_t value_size) {
+  return _upb_Map_NewSized(a, key_size, value_size, 4);
+}
+
+upb_Map* _upb_Map_NewSized(upb_Arena* a, size_t key_size, size_t value_size,
+                           size_t size) {
   upb_Map* map = upb_Arena_Malloc(a, sizeof(upb_Map));
   if (!map) return NULL;
 
-  upb_strtable_init(&map->table, 4, a);
+  // map_gencode_util.h and map_sorter.c read string keys with upb_tabstr().
+  UPB_ASSERT(offsetof(upb_MapTableEntry, key) == offsetof(upb_tabent, key));
+  memset(&map->table, 0, sizeof(map->table));
+  // Small maps wait for their first insertion, as they may stay empty.
+  if (size > 4 && !_upb_MapTable_Reserve(&map->table, size, a)) return NULL;
   map->key_size = key_size;
   map->val_size = value_size;
+  map->is_frozen = false;
+  map->order = NULL;
+  _upb_Map_ClearSortedKeys(map);
 
   return map;
 }
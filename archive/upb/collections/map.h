@@ -55,9 +55,25 @@ UPB_API size_t upb_Map_Size(const upb_Map* map);
 UPB_API bool upb_Map_Get(const upb_Map* map, upb_MessageValue key,
                          upb_MessageValue* val);
 
+// Looks up `count` keys at once.  For each key that is present, stores its
+// value into |vals[i]| (if |vals| is non-NULL); values of absent keys are left
+// untouched.  If |found| is non-NULL, |found[i]| is set to whether |keys[i]|
+// was present.  Returns the number of keys that were present.
+//
+// This is faster than calling upb_Map_Get() on each key of a large map, as the
+// cache misses of the lookups overlap instead of following one another.
+UPB_API size_t upb_Map_GetBatch(const upb_Map* map,
+                                const upb_MessageValue* keys, size_t count,
+                                upb_MessageValue* vals, bool* found);
+
 // Removes all entries in the map.
 UPB_API void upb_Map_Clear(upb_Map* map);
 
+// Makes room for `size` entries in total, so that inserting up to that many
+// does not grow the map.  Existing iterators are invalidated if the map was
+// resized.  Returns false if memory allocation failed.
+UPB_API bool upb_Map_Reserve(upb_Map* map, size_t size, upb_Arena* arena);
+
 typedef enum {
   kUpb_MapInsertStatus_Inserted = 0,
   kUpb_MapInsertStatus_Replaced = 1,
@@ -80,8 +96,19 @@ UPB_API_INLINE bool upb_Map_Set(upb_Map* map, upb_MessageValue key,
          kUpb_MapInsertStatus_OutOfMemory;
 }
 
+// Sets each of `keys` to the matching entry of `vals`, as if by
+// upb_Map_Insert() in order, so a key that appears twice ends up with its last
+// value.  Room for all of the keys is reserved up front and the lookups are
+// batched as in upb_Map_GetBatch().  Returns false if memory allocation failed,
+// in which case only some of the keys may have been set.  Existing iterators
+// are invalidated.
+UPB_API bool upb_Map_InsertBatch(upb_Map* map, const upb_MessageValue* keys,
+                                 const upb_MessageValue* vals, size_t count,
+                                 upb_Arena* arena);
+
 // Deletes this key from the table. Returns true if the key was present.
-// If present and |val| is non-NULL, stores the deleted value.
+// If present and |val| is non-NULL, stores the deleted value.  If the key was
+// present, then any existing iterators will be invalidated.
 UPB_API bool upb_Map_Delete(upb_Map* map, upb_MessageValue key,
                             upb_MessageValue* val);
 
@@ -91,7 +118,43 @@ UPB_INLINE bool upb_Map_Delete2(upb_Map* map, upb_MessageValue key,
   return upb_Map_Delete(map, key, val);
 }
 
-// Map iteration:
+// Sorts the keys of the map and saves the order, so that serializing the map
+// with kUpb_EncodeOption_Deterministic reuses it instead of sorting the map
+// again on every encode.  The saved order is dropped as soon as a key is
+// inserted or removed; values may still be changed in place.  `key_type` must
+// be the map's key type.  The order is allocated from `a`, which must live at
+// least as long as the map.  Returns false if allocation failed.
+UPB_API bool upb_Map_SortKeys(upb_Map* map, upb_CType key_type, upb_Arena* a);
+
+// Puts the map in ordered mode, where it keeps its keys in the order of
+// deterministic serialization as they are inserted and removed.  Serializing
+// an ordered map with kUpb_EncodeOption_Deterministic then walks the saved
+// order instead of sorting the keys again, for any sequence of changes
+// (unlike upb_Map_SortKeys(), whose order is dropped when a key is inserted).
+//
+// New keys are appended to a short unsorted tail, which is merged into the
+// sorted keys once it grows to an eighth of them, so insertion stays
+// amortized constant time.  An ordered map takes another 16 bytes per key.
+// Iteration with upb_Map_Next() is not affected.
+//
+// `key_type` must be the map's key type, and the order is allocated from `a`,
+// which must live at least as long as the map.  Returns false if allocation
+// failed.  Maps of fields marked by upb_MiniTable_SetOrderedMap() are created
+// in ordered mode by the parser.
+UPB_API bool upb_Map_SetOrdered(upb_Map* map, upb_CType key_type,
+                                upb_Arena* a);
+
+// Returns whether the map is in ordered mode.
+UPB_API bool upb_Map_IsOrdered(const upb_Map* map);
+
+// Returns true if the map was frozen by upb_Map_Freeze() or as part of a
+// message frozen by upb_Message_Freeze().  A frozen map must not be modified.
+UPB_API bool upb_Map_IsFrozen(const upb_Map* map);
+
+// Map iteration visits the entries in the order they were inserted, except
+// that deleting an entry moves the last one into its place.  It takes time
+// proportional to the number of entries, however many have been deleted or
+// reserved:
 //
 // size_t iter = kUpb_Map_Begin;
 // upb_MessageValue key, val;
@@ -43,25 +43,27 @@ extern "C" {
 #endif
 
 // Message map operations, these get the map from the message first.
+//
+// `msg` is an entry returned by _upb_map_next().
 
 UPB_INLINE void _upb_msg_map_key(const void* msg, void* key, size_t size) {
-  const upb_tabent* ent = (const upb_tabent*)msg;
-  uint32_t u32len;
-  upb_StringView k;
-  k.data = upb_tabstr(ent->key, &u32len);
-  k.size = u32len;
-  _upb_map_fromkey(k, key, size);
+  const upb_MapTableEntry* ent = (const upb_MapTableEntry*)msg;
+  if (size != UPB_MAPTYPE_STRING) {
+    _upb_map_fromintkey(_upb_MapTableEntry_IntKey(ent), key, size);
+  } else {
+    _upb_map_fromkey(_upb_MapTableEntry_StrKey(ent), key, size);
+  }
 }
 
 UPB_INLINE void _upb_msg_map_value(const void* msg, void* val, size_t size) {
-  const upb_tabent* ent = (const upb_tabent*)msg;
+  const upb_MapTableEntry* ent = (const upb_MapTableEntry*)msg;
   upb_value v = {ent->val.val};
   _upb_map_fromvalue(v, val, size);
 }
 
 UPB_INLINE void _upb_msg_map_set_value(void* msg, const void* val,
                                        size_t size) {
-  upb_tabent* ent = (upb_tabent*)msg;
+  upb_MapTableEntry* ent = (upb_MapTableEntry*)msg;
   // This is like _upb_map_tovalue() except the entry already exists
   // so we can reuse the allocated upb_StringView for string fields.
   if (size == UPB_MAPTYPE_STRING) {
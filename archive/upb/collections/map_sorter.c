@@ -28,83 +28,236 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+
 #include "upb/collections/internal/map_sorter.h"
 
+#include <string.h>
+
 #include "upb/base/internal/log2.h"
+#include "upb/mem/arena.h"
 
 // Must be last.
 #include "upb/port/def.inc"
 
-static void _upb_mapsorter_getkeys(const void* _a, const void* _b, void* a_key,
-                                   void* b_key, size_t size) {
-  const upb_tabent* const* a = _a;
-  const upb_tabent* const* b = _b;
-  upb_StringView a_tabkey = upb_tabstrview((*a)->key);
-  upb_StringView b_tabkey = upb_tabstrview((*b)->key);
-  _upb_map_fromkey(a_tabkey, a_key, size);
-  _upb_map_fromkey(b_tabkey, b_key, size);
+// Map entries are sorted without qsort(): integer keys are mapped to unsigned
+// integers with the same order and radix sorted, while string keys are merge
+// sorted with an inlined comparison.
+
+typedef enum {
+  kUpb_MapSortKind_None = 0,
+  kUpb_MapSortKind_Bool,
+  kUpb_MapSortKind_Int32,
+  kUpb_MapSortKind_UInt32,
+  kUpb_MapSortKind_Int64,
+  kUpb_MapSortKind_UInt64,
+  kUpb_MapSortKind_String,
+} upb_MapSortKind;
+
+static const char _upb_mapsorter_kindbytype[kUpb_FieldType_SizeOf] = {
+    [kUpb_FieldType_Int64] = kUpb_MapSortKind_Int64,
+    [kUpb_FieldType_SFixed64] = kUpb_MapSortKind_Int64,
+    [kUpb_FieldType_SInt64] = kUpb_MapSortKind_Int64,
+
+    [kUpb_FieldType_UInt64] = kUpb_MapSortKind_UInt64,
+    [kUpb_FieldType_Fixed64] = kUpb_MapSortKind_UInt64,
+
+    [kUpb_FieldType_Int32] = kUpb_MapSortKind_Int32,
+    [kUpb_FieldType_SInt32] = kUpb_MapSortKind_Int32,
+    [kUpb_FieldType_SFixed32] = kUpb_MapSortKind_Int32,
+    [kUpb_FieldType_Enum] = kUpb_MapSortKind_Int32,
+
+    [kUpb_FieldType_UInt32] = kUpb_MapSortKind_UInt32,
+    [kUpb_FieldType_Fixed32] = kUpb_MapSortKind_UInt32,
+
+    [kUpb_FieldType_Bool] = kUpb_MapSortKind_Bool,
+
+    [kUpb_FieldType_String] = kUpb_MapSortKind_String,
+    [kUpb_FieldType_Bytes] = kUpb_MapSortKind_String,
+};
+
+static const char _upb_mapsorter_kindbyctype[12] = {
+    [kUpb_CType_Bool] = kUpb_MapSortKind_Bool,
+    [kUpb_CType_Int32] = kUpb_MapSortKind_Int32,
+    [kUpb_CType_Enum] = kUpb_MapSortKind_Int32,
+    [kUpb_CType_UInt32] = kUpb_MapSortKind_UInt32,
+    [kUpb_CType_Int64] = kUpb_MapSortKind_Int64,
+    [kUpb_CType_UInt64] = kUpb_MapSortKind_UInt64,
+    [kUpb_CType_String] = kUpb_MapSortKind_String,
+    [kUpb_CType_Bytes] = kUpb_MapSortKind_String,
+};
+
+// Below this many entries, insertion sort beats the radix/merge sorts.
+#define kUpb_MapSorter_InsertionSortMax 16
+
+typedef struct {
+  uint64_t key;
+  const void* ptr;
+} _upb_SortPair;
+
+static bool _upb_mapsorter_reservescratch(_upb_mapsorter* s, size_t size) {
+  if (size <= s->scratch_size) return true;
+  size_t new_size = UPB_MAX(s->scratch_size, 256);
+  while (new_size < size) new_size *= 2;
+  void* scratch = realloc(s->scratch, new_size);
+  if (!scratch) return false;
+  s->scratch = scratch;
+  s->scratch_size = new_size;
+  return true;
 }
 
-static int _upb_mapsorter_cmpi64(const void* _a, const void* _b) {
-  int64_t a, b;
-  _upb_mapsorter_getkeys(_a, _b, &a, &b, 8);
-  return a < b ? -1 : a > b;
+static void _upb_mapsorter_insertionsort(_upb_SortPair* a, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    _upb_SortPair x = a[i];
+    size_t j = i;
+    for (; j > 0 && a[j - 1].key > x.key; j--) a[j] = a[j - 1];
+    a[j] = x;
+  }
 }
 
-static int _upb_mapsorter_cmpu64(const void* _a, const void* _b) {
-  uint64_t a, b;
-  _upb_mapsorter_getkeys(_a, _b, &a, &b, 8);
-  return a < b ? -1 : a > b;
+// Sorts `a` by key, using `tmp` (which has room for `n` pairs) as scratch.
+// Only the low `key_bytes` bytes of each key are significant.  Returns
+// whichever of `a` and `tmp` holds the result.
+static _upb_SortPair* _upb_mapsorter_sortpairs(_upb_SortPair* a,
+                                               _upb_SortPair* tmp, size_t n,
+                                               int key_bytes) {
+  if (n <= kUpb_MapSorter_InsertionSortMax) {
+    _upb_mapsorter_insertionsort(a, n);
+    return a;
+  }
+
+  // LSD radix sort, one byte at a time.
+  for (int shift = 0; shift < key_bytes * 8; shift += 8) {
+    size_t count[256] = {0};
+    for (size_t i = 0; i < n; i++) count[(a[i].key >> shift) & 0xff]++;
+
+    // Skip the pass if every key has the same digit here, as is common for
+    // the high bytes of small integers.
+    if (count[(a[0].key >> shift) & 0xff] == n) continue;
+
+    size_t total = 0;
+    for (int b = 0; b < 256; b++) {
+      size_t c = count[b];
+      count[b] = total;
+      total += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      tmp[count[(a[i].key >> shift) & 0xff]++] = a[i];
+    }
+
+    _upb_SortPair* swap = a;
+    a = tmp;
+    tmp = swap;
+  }
+  return a;
 }
 
-static int _upb_mapsorter_cmpi32(const void* _a, const void* _b) {
-  int32_t a, b;
-  _upb_mapsorter_getkeys(_a, _b, &a, &b, 4);
-  return a < b ? -1 : a > b;
+// Maps an integer key as stored in the table to an unsigned key that sorts in
+// the same order.  The mapping is its own inverse.
+static uint64_t _upb_mapsorter_numkey(uint64_t key, upb_MapSortKind kind) {
+  // Keys are stored zero-extended, so only the sign bit needs flipping.
+  switch (kind) {
+    case kUpb_MapSortKind_Bool:
+    case kUpb_MapSortKind_UInt32:
+    case kUpb_MapSortKind_UInt64:
+      return key;
+    case kUpb_MapSortKind_Int32:
+      return key ^ 0x80000000U;
+    case kUpb_MapSortKind_Int64:
+      return key ^ 0x8000000000000000ULL;
+    default:
+      UPB_UNREACHABLE();
+  }
 }
 
-static int _upb_mapsorter_cmpu32(const void* _a, const void* _b) {
-  uint32_t a, b;
-  _upb_mapsorter_getkeys(_a, _b, &a, &b, 4);
-  return a < b ? -1 : a > b;
+static uint64_t _upb_mapsorter_intkey(const upb_MapTableEntry* ent,
+                                      upb_MapSortKind kind) {
+  return _upb_mapsorter_numkey(_upb_MapTableEntry_IntKey(ent), kind);
 }
 
-static int _upb_mapsorter_cmpbool(const void* _a, const void* _b) {
-  bool a, b;
-  _upb_mapsorter_getkeys(_a, _b, &a, &b, 1);
-  return a < b ? -1 : a > b;
+static int _upb_mapsorter_keybytes(upb_MapSortKind kind) {
+  switch (kind) {
+    case kUpb_MapSortKind_Bool:
+      return 1;
+    case kUpb_MapSortKind_Int32:
+    case kUpb_MapSortKind_UInt32:
+      return 4;
+    default:
+      return 8;
+  }
 }
 
-static int _upb_mapsorter_cmpstr(const void* _a, const void* _b) {
-  upb_StringView a, b;
-  _upb_mapsorter_getkeys(_a, _b, &a, &b, UPB_MAPTYPE_STRING);
+// The string order is reversed relative to memcmp() (ties broken by length,
+// shorter first).  This is the order deterministic serialization has always
+// used, and since the encoder writes backwards the serialized entries come
+// out in ascending memcmp() order.
+UPB_FORCEINLINE
+static bool _upb_mapsorter_strviewless(upb_StringView a, upb_StringView b) {
   size_t common_size = UPB_MIN(a.size, b.size);
   int cmp = memcmp(a.data, b.data, common_size);
-  if (cmp) return -cmp;
-  return a.size < b.size ? -1 : a.size > b.size;
+  if (cmp) return cmp > 0;
+  return a.size < b.size;
 }
 
-static int (*const compar[kUpb_FieldType_SizeOf])(const void*, const void*) = {
-    [kUpb_FieldType_Int64] = _upb_mapsorter_cmpi64,
-    [kUpb_FieldType_SFixed64] = _upb_mapsorter_cmpi64,
-    [kUpb_FieldType_SInt64] = _upb_mapsorter_cmpi64,
+UPB_FORCEINLINE
+static bool _upb_mapsorter_strless(const void* a, const void* b) {
+  const upb_MapTableEntry* ea = a;
+  const upb_MapTableEntry* eb = b;
+  return _upb_mapsorter_strviewless(_upb_MapTableEntry_StrKey(ea),
+                                    _upb_MapTableEntry_StrKey(eb));
+}
 
-    [kUpb_FieldType_UInt64] = _upb_mapsorter_cmpu64,
-    [kUpb_FieldType_Fixed64] = _upb_mapsorter_cmpu64,
+// Sorts `a` by string key, using `tmp` (which has room for n / 2 entries) as
+// scratch.
+static void _upb_mapsorter_sortstrs(const void** a, const void** tmp,
+                                    size_t n) {
+  if (n <= kUpb_MapSorter_InsertionSortMax) {
+    for (size_t i = 1; i < n; i++) {
+      const void* x = a[i];
+      size_t j = i;
+      for (; j > 0 && _upb_mapsorter_strless(x, a[j - 1]); j--) a[j] = a[j - 1];
+      a[j] = x;
+    }
+    return;
+  }
 
-    [kUpb_FieldType_Int32] = _upb_mapsorter_cmpi32,
-    [kUpb_FieldType_SInt32] = _upb_mapsorter_cmpi32,
-    [kUpb_FieldType_SFixed32] = _upb_mapsorter_cmpi32,
-    [kUpb_FieldType_Enum] = _upb_mapsorter_cmpi32,
+  size_t mid = n / 2;
+  _upb_mapsorter_sortstrs(a, tmp, mid);
+  _upb_mapsorter_sortstrs(a + mid, tmp, n - mid);
+  if (!_upb_mapsorter_strless(a[mid], a[mid - 1])) return;  // Already sorted.
 
-    [kUpb_FieldType_UInt32] = _upb_mapsorter_cmpu32,
-    [kUpb_FieldType_Fixed32] = _upb_mapsorter_cmpu32,
+  // Merge the left half (moved to `tmp`) with the right half, in place.
+  memcpy(tmp, a, mid * sizeof(*a));
+  size_t i = 0, j = mid, k = 0;
+  while (i < mid && j < n) {
+    a[k++] = _upb_mapsorter_strless(a[j], tmp[i]) ? a[j++] : tmp[i++];
+  }
+  while (i < mid) a[k++] = tmp[i++];
+}
 
-    [kUpb_FieldType_Bool] = _upb_mapsorter_cmpbool,
+// Sorts the `n` table entries in `ents` by key.
+static bool _upb_mapsorter_sortentries(_upb_mapsorter* s, upb_MapSortKind kind,
+                                       const void** ents, size_t n) {
+  if (kind == kUpb_MapSortKind_String) {
+    if (!_upb_mapsorter_reservescratch(s, (n / 2) * sizeof(*ents))) {
+      return false;
+    }
+    _upb_mapsorter_sortstrs(ents, s->scratch, n);
+    return true;
+  }
 
-    [kUpb_FieldType_String] = _upb_mapsorter_cmpstr,
-    [kUpb_FieldType_Bytes] = _upb_mapsorter_cmpstr,
-};
+  if (!_upb_mapsorter_reservescratch(s, 2 * n * sizeof(_upb_SortPair))) {
+    return false;
+  }
+  _upb_SortPair* pairs = s->scratch;
+  for (size_t i = 0; i < n; i++) {
+    pairs[i].key = _upb_mapsorter_intkey(ents[i], kind);
+    pairs[i].ptr = ents[i];
+  }
+  pairs = _upb_mapsorter_sortpairs(pairs, pairs + n, n,
+                                   _upb_mapsorter_keybytes(kind));
+  for (size_t i = 0; i < n; i++) ents[i] = pairs[i].ptr;
+  return true;
+}
 
 static bool _upb_mapsorter_resize(_upb_mapsorter* s, _upb_sortedmap* sorted,
                                   int size) {
@@ -122,49 +275,300 @@ static bool _upb_mapsorter_resize(_upb_mapsorter* s, _upb_sortedmap* sorted,
   return true;
 }
 
+// Copies pointers to the entries of the map's table to `dst`.
+static void _upb_mapsorter_getentries(const upb_Map* map, const void** dst) {
+  const upb_MapTable* t = &map->table;
+  for (uint32_t i = 0; i < t->count; i++) dst[i] = &t->entries[i];
+}
+
+// Ordered maps (see upb_Map_SetOrdered()) ///////////////////////////////////
+
+// Pending keys are merged into the sorted run once there are this many, or an
+// eighth as many as there are sorted keys if that is more.
+#define kUpb_MapOrder_MinPending 16
+
+UPB_FORCEINLINE
+static bool _upb_MapOrderKey_Less(upb_MapSortKind kind, upb_MapOrderKey a,
+                                  upb_MapOrderKey b) {
+  if (kind == kUpb_MapSortKind_String) {
+    return _upb_mapsorter_strviewless(a.str, b.str);
+  }
+  return a.num < b.num;
+}
+
+UPB_FORCEINLINE
+static bool _upb_MapOrderKey_Eq(upb_MapSortKind kind, upb_MapOrderKey a,
+                                upb_MapOrderKey b) {
+  if (kind == kUpb_MapSortKind_String) {
+    return upb_StringView_IsEqual(a.str, b.str);
+  }
+  return a.num == b.num;
+}
+
+// Sorts `a`, using `tmp` (which has room for n / 2 keys) as scratch.
+static void _upb_MapOrder_SortKeys(upb_MapSortKind kind, upb_MapOrderKey* a,
+                                   upb_MapOrderKey* tmp, size_t n) {
+  if (n <= kUpb_MapSorter_InsertionSortMax) {
+    for (size_t i = 1; i < n; i++) {
+      upb_MapOrderKey x = a[i];
+      size_t j = i;
+      for (; j > 0 && _upb_MapOrderKey_Less(kind, x, a[j - 1]); j--) {
+        a[j] = a[j - 1];
+      }
+      a[j] = x;
+    }
+    return;
+  }
+
+  size_t mid = n / 2;
+  _upb_MapOrder_SortKeys(kind, a, tmp, mid);
+  _upb_MapOrder_SortKeys(kind, a + mid, tmp, n - mid);
+  if (!_upb_MapOrderKey_Less(kind, a[mid], a[mid - 1])) return;
+
+  memcpy(tmp, a, mid * sizeof(*a));
+  size_t i = 0, j = mid, k = 0;
+  while (i < mid && j < n) {
+    a[k++] = _upb_MapOrderKey_Less(kind, a[j], tmp[i]) ? a[j++] : tmp[i++];
+  }
+  while (i < mid) a[k++] = tmp[i++];
+}
+
+// Returns the table entry for `key`, or NULL if it is no longer in the map.
+static const void* _upb_MapOrder_Find(const upb_Map* map, upb_MapSortKind kind,
+                                      upb_MapOrderKey key) {
+  if (kind == kUpb_MapSortKind_String) {
+    return _upb_MapTable_FindStr(&map->table, key.str,
+                                 _upb_MapTable_StrHash(key.str));
+  }
+  const uint64_t num = _upb_mapsorter_numkey(key.num, kind);
+  return _upb_MapTable_FindInt(&map->table, num, _upb_MapTable_IntHash(num));
+}
+
+// Sorts the pending keys and merges them into the sorted run, dropping
+// duplicates and, if any keys were removed, keys that are no longer in the
+// map.  Returns false if allocation failed, leaving the order unchanged.
+static bool _upb_MapOrder_Merge(upb_Map* map) {
+  upb_MapOrder* o = map->order;
+  const upb_MapSortKind kind = o->kind;
+  upb_MapOrderKey* keys = o->keys;
+  const size_t n = o->size - o->sorted;
+
+  if (n > 0) {
+    upb_MapOrderKey* pending = malloc((n + n / 2) * sizeof(*pending));
+    if (!pending) return false;
+    memcpy(pending, &keys[o->sorted], n * sizeof(*pending));
+    _upb_MapOrder_SortKeys(kind, pending, pending + n, n);
+
+    // Merging from the back fills the slots of the pending keys first, so the
+    // sorted run can stay where it is.
+    size_t i = o->sorted, j = n, k = o->size;
+    while (j > 0) {
+      if (i > 0 && _upb_MapOrderKey_Less(kind, pending[j - 1], keys[i - 1])) {
+        keys[--k] = keys[--i];
+      } else {
+        keys[--k] = pending[--j];
+      }
+    }
+    free(pending);
+  }
+
+  size_t out = 0;
+  for (size_t i = 0; i < o->size; i++) {
+    if (out > 0 && _upb_MapOrderKey_Eq(kind, keys[out - 1], keys[i])) continue;
+    if (o->removed && !_upb_MapOrder_Find(map, kind, keys[i])) continue;
+    keys[out++] = keys[i];
+  }
+  o->sorted = out;
+  o->size = out;
+  o->removed = 0;
+  return true;
+}
+
+bool _upb_MapOrder_Reserve(upb_Map* map, upb_Arena* a) {
+  upb_MapOrder* o = map->order;
+  const uint32_t max_pending = UPB_MAX(kUpb_MapOrder_MinPending, o->sorted / 8);
+  if (o->size - o->sorted >= max_pending) {
+    // If this fails, the keys just stay pending for longer.
+    _upb_MapOrder_Merge(map);
+  }
+  if (o->size < o->capacity) return true;
+
+  const uint32_t capacity = UPB_MAX(o->capacity * 2, kUpb_MapOrder_MinPending);
+  upb_MapOrderKey* keys =
+      upb_Arena_Realloc(a, o->keys, o->capacity * sizeof(*keys),
+                        capacity * sizeof(*keys));
+  if (!keys) return false;
+  o->keys = keys;
+  o->capacity = capacity;
+  return true;
+}
+
+void _upb_MapOrder_Add(upb_Map* map, const void* key) {
+  upb_MapOrder* o = map->order;
+  UPB_ASSERT(o->size < o->capacity);
+  upb_MapOrderKey* k = &o->keys[o->size++];
+  if (o->kind == kUpb_MapSortKind_String) {
+    // The order's keys point to the table's copy, as `key` may not live on.
+    upb_StringView view = _upb_map_tokey(key, map->key_size);
+    const upb_MapTableEntry* e = _upb_MapTable_FindStr(
+        &map->table, view, _upb_MapTable_StrHash(view));
+    UPB_ASSERT(e);
+    k->str = _upb_MapTableEntry_StrKey(e);
+  } else {
+    k->num = _upb_mapsorter_numkey(_upb_map_tointkey(key, map->key_size),
+                                   (upb_MapSortKind)o->kind);
+  }
+}
+
+static bool _upb_Map_SetOrderKind(upb_Map* map, upb_MapSortKind kind,
+                                  upb_Arena* a) {
+  UPB_ASSERT(!map->is_frozen);
+  UPB_ASSERT(kind != kUpb_MapSortKind_None);
+  UPB_ASSERT((kind == kUpb_MapSortKind_String) == !_upb_Map_IsIntKeyed(map));
+  if (map->order) {
+    UPB_ASSERT(map->order->kind == (char)kind);
+    return true;
+  }
+
+  const size_t size = _upb_Map_Size(map);
+  const size_t capacity = UPB_MAX(size, kUpb_MapOrder_MinPending);
+  upb_MapOrder* o = upb_Arena_Malloc(a, sizeof(*o));
+  if (!o) return false;
+  o->keys = upb_Arena_Malloc(a, capacity * sizeof(*o->keys));
+  if (!o->keys) return false;
+  o->capacity = capacity;
+  o->sorted = 0;
+  o->size = 0;
+  o->removed = 0;
+  o->kind = kind;
+
+  // The current keys start out pending.
+  size_t iter = kUpb_Map_Begin;
+  const void* ent;
+  while ((ent = _upb_map_next(map, &iter))) {
+    upb_MapOrderKey* k = &o->keys[o->size++];
+    if (kind == kUpb_MapSortKind_String) {
+      k->str = _upb_MapTableEntry_StrKey(ent);
+    } else {
+      k->num = _upb_mapsorter_intkey(ent, kind);
+    }
+  }
+  map->order = o;
+  // If this fails, the keys are merged on a later insertion.
+  _upb_MapOrder_Merge(map);
+  return true;
+}
+
+bool _upb_Map_SetOrdered(upb_Map* map, upb_FieldType key_type, upb_Arena* a) {
+  return _upb_Map_SetOrderKind(map, _upb_mapsorter_kindbytype[key_type], a);
+}
+
+bool upb_Map_SetOrdered(upb_Map* map, upb_CType key_type, upb_Arena* a) {
+  return _upb_Map_SetOrderKind(map, _upb_mapsorter_kindbyctype[key_type], a);
+}
+
+// Fills `dst` with the entries of an ordered map: the sorted run of its keys is
+// merged with the pending keys, sorted in scratch space, and every key that is
+// still in the map is looked up.
+static bool _upb_mapsorter_pushorder(_upb_mapsorter* s, const upb_Map* map,
+                                     const void** dst, size_t map_size) {
+  const upb_MapOrder* o = map->order;
+  const upb_MapSortKind kind = o->kind;
+  const upb_MapOrderKey* run = o->keys;
+  const size_t n = o->size - o->sorted;
+  if (!_upb_mapsorter_reservescratch(s, (n + n / 2) * sizeof(*run))) {
+    return false;
+  }
+  upb_MapOrderKey* pending = s->scratch;
+  if (n > 0) {
+    memcpy(pending, &run[o->sorted], n * sizeof(*pending));
+    _upb_MapOrder_SortKeys(kind, pending, pending + n, n);
+  }
+
+  size_t i = 0, j = 0, out = 0;
+  upb_MapOrderKey key, prev;
+  bool have_prev = false;
+  while (i < o->sorted || j < n) {
+    if (j == n ||
+        (i < o->sorted && !_upb_MapOrderKey_Less(kind, pending[j], run[i]))) {
+      key = run[i++];
+    } else {
+      key = pending[j++];
+    }
+    if (have_prev && _upb_MapOrderKey_Eq(kind, key, prev)) continue;
+    prev = key;
+    have_prev = true;
+    const void* ent = _upb_MapOrder_Find(map, kind, key);
+    if (ent) {
+      UPB_ASSERT(out < map_size);
+      dst[out++] = ent;
+    }
+  }
+  UPB_ASSERT(out == map_size);
+  return true;
+}
+
 bool _upb_mapsorter_pushmap(_upb_mapsorter* s, upb_FieldType key_type,
                             const upb_Map* map, _upb_sortedmap* sorted) {
   int map_size = _upb_Map_Size(map);
+  upb_MapSortKind kind = _upb_mapsorter_kindbytype[key_type];
 
   if (!_upb_mapsorter_resize(s, sorted, map_size)) return false;
 
-  // Copy non-empty entries from the table to s->entries.
   const void** dst = &s->entries[sorted->start];
-  const upb_tabent* src = map->table.t.entries;
-  const upb_tabent* end = src + upb_table_size(&map->table.t);
-  for (; src < end; src++) {
-    if (!upb_tabent_isempty(src)) {
-      *dst = src;
-      dst++;
-    }
+  if (map->sorted && map->sorted_kind == (char)kind) {
+    // Saved by upb_Map_SortKeys(), and the keys have not changed since.
+    memcpy(dst, map->sorted, map_size * sizeof(*dst));
+    return true;
+  }
+  if (map->order && map->order->kind == (char)kind) {
+    return _upb_mapsorter_pushorder(s, map, dst, map_size);
   }
-  UPB_ASSERT(dst == &s->entries[sorted->end]);
-
-  // Sort entries according to the key type.
-  qsort(&s->entries[sorted->start], map_size, sizeof(*s->entries),
-        compar[key_type]);
-  return true;
-}
 
-static int _upb_mapsorter_cmpext(const void* _a, const void* _b) {
-  const upb_Message_Extension* const* a = _a;
-  const upb_Message_Extension* const* b = _b;
-  uint32_t a_num = (*a)->ext->field.number;
-  uint32_t b_num = (*b)->ext->field.number;
-  assert(a_num != b_num);
-  return a_num < b_num ? -1 : 1;
+  _upb_mapsorter_getentries(map, dst);
+  return _upb_mapsorter_sortentries(s, kind, dst, map_size);
 }
 
 bool _upb_mapsorter_pushexts(_upb_mapsorter* s,
                              const upb_Message_Extension* exts, size_t count,
                              _upb_sortedmap* sorted) {
   if (!_upb_mapsorter_resize(s, sorted, count)) return false;
+  if (!_upb_mapsorter_reservescratch(s, 2 * count * sizeof(_upb_SortPair))) {
+    return false;
+  }
 
+  _upb_SortPair* pairs = s->scratch;
+  for (size_t i = 0; i < count; i++) {
+    pairs[i].key = exts[i].ext->field.number;
+    pairs[i].ptr = &exts[i];
+  }
+  pairs = _upb_mapsorter_sortpairs(pairs, pairs + count, count, 4);
   for (size_t i = 0; i < count; i++) {
-    s->entries[sorted->start + i] = &exts[i];
+    s->entries[sorted->start + i] = pairs[i].ptr;
   }
+  return true;
+}
+
+bool upb_Map_SortKeys(upb_Map* map, upb_CType key_type, upb_Arena* a) {
+  UPB_ASSERT(!map->is_frozen);
+  size_t size = _upb_Map_Size(map);
+  upb_MapSortKind kind = _upb_mapsorter_kindbyctype[key_type];
+  UPB_ASSERT(kind != kUpb_MapSortKind_None);
+
+  _upb_Map_ClearSortedKeys(map);
+  if (size == 0) return true;
+
+  const void** ents = upb_Arena_Malloc(a, size * sizeof(*ents));
+  if (!ents) return false;
+  _upb_mapsorter_getentries(map, ents);
+
+  _upb_mapsorter s;
+  _upb_mapsorter_init(&s);
+  bool ok = _upb_mapsorter_sortentries(&s, kind, ents, size);
+  _upb_mapsorter_destroy(&s);
+  if (!ok) return false;
 
-  qsort(&s->entries[sorted->start], count, sizeof(*s->entries),
-        _upb_mapsorter_cmpext);
+  map->sorted = ents;
+  map->sorted_kind = kind;
   return true;
 }
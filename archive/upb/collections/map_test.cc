@@ -30,8 +30,15 @@
 
 #include "upb/collections/map.h"
 
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "upb/base/string_view.h"
+#include "upb/collections/internal/map_sorter.h"
 #include "upb/mem/arena.hpp"
 
 TEST(MapTest, DeleteRegression) {
@@ -54,3 +61,331 @@ TEST(MapTest, DeleteRegression) {
   EXPECT_TRUE(
       upb_StringView_IsEqual(insert_value.str_val, delete_value.str_val));
 }
+
+TEST(MapTest, IntKeys) {
+  upb::Arena arena;
+  upb_Map* map = upb_Map_New(arena.ptr(), kUpb_CType_Int64, kUpb_CType_Int32);
+  std::map<int64_t, int32_t> expected;
+
+  // Includes key 0 and keys that differ only in their high bits.
+  for (int32_t i = 0; i < 1000; i++) {
+    upb_MessageValue key, val;
+    key.int64_val = (i % 2 ? -i : i) * (int64_t{1} << (i % 40));
+    val.int32_val = i;
+    upb_MapInsertStatus st = upb_Map_Insert(map, key, val, arena.ptr());
+    EXPECT_EQ(expected.count(key.int64_val) ? kUpb_MapInsertStatus_Replaced
+                                            : kUpb_MapInsertStatus_Inserted,
+              st);
+    expected[key.int64_val] = i;
+  }
+
+  // Deleting shifts later entries of a probe run; they must stay reachable.
+  for (auto it = expected.begin(); it != expected.end();) {
+    upb_MessageValue key, val;
+    key.int64_val = it->first;
+    if (it->second % 3 == 0) {
+      EXPECT_TRUE(upb_Map_Delete(map, key, &val));
+      EXPECT_EQ(it->second, val.int32_val);
+      EXPECT_FALSE(upb_Map_Delete(map, key, nullptr));
+      // A miss leaves |val| alone.
+      val.int32_val = -1;
+      EXPECT_FALSE(upb_Map_Delete(map, key, &val));
+      EXPECT_EQ(-1, val.int32_val);
+      it = expected.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  EXPECT_EQ(expected.size(), upb_Map_Size(map));
+  for (const auto& [k, v] : expected) {
+    upb_MessageValue key, val;
+    key.int64_val = k;
+    ASSERT_TRUE(upb_Map_Get(map, key, &val));
+    EXPECT_EQ(v, val.int32_val);
+  }
+
+  std::map<int64_t, int32_t> seen;
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue key, val;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    EXPECT_TRUE(seen.emplace(key.int64_val, val.int32_val).second);
+  }
+  EXPECT_EQ(expected, seen);
+
+  upb_Map_Clear(map);
+  EXPECT_EQ(0, upb_Map_Size(map));
+  key.int64_val = 0;
+  EXPECT_FALSE(upb_Map_Get(map, key, &val));
+}
+
+TEST(MapTest, IterationOrder) {
+  upb::Arena arena;
+  upb_Map* map = upb_Map_New(arena.ptr(), kUpb_CType_String, kUpb_CType_Int32);
+  ASSERT_TRUE(upb_Map_Reserve(map, 10000, arena.ptr()));
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; i++) keys.push_back("key" + std::to_string(i));
+  for (int i = 0; i < 100; i++) {
+    upb_MessageValue key, val;
+    key.str_val = upb_StringView_FromDataAndSize(keys[i].data(),
+                                                 keys[i].size());
+    val.int32_val = i;
+    ASSERT_TRUE(upb_Map_Set(map, key, val, arena.ptr()));
+  }
+
+  // Delete all but the first 10 keys, then key 0, whose entry is replaced by
+  // the last one.
+  for (int i = 99; i >= 10; i--) {
+    upb_MessageValue key;
+    key.str_val = upb_StringView_FromDataAndSize(keys[i].data(),
+                                                 keys[i].size());
+    ASSERT_TRUE(upb_Map_Delete(map, key, nullptr));
+  }
+  upb_MessageValue key, val;
+  key.str_val = upb_StringView_FromDataAndSize(keys[0].data(), keys[0].size());
+  ASSERT_TRUE(upb_Map_Delete(map, key, nullptr));
+
+  // Only the 9 live entries are visited, however large the map was.
+  std::vector<int32_t> seen;
+  size_t iter = kUpb_Map_Begin;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    EXPECT_EQ(keys[val.int32_val],
+              std::string(key.str_val.data, key.str_val.size));
+    seen.push_back(val.int32_val);
+  }
+  std::vector<int32_t> expected = {9, 1, 2, 3, 4, 5, 6, 7, 8};
+  EXPECT_EQ(expected, seen);
+
+  iter = kUpb_Map_Begin;
+  size_t count = 0;
+  while (upb_MapIterator_Next(map, &iter)) {
+    EXPECT_FALSE(upb_MapIterator_Done(map, iter));
+    EXPECT_EQ(expected[count], upb_MapIterator_Value(map, iter).int32_val);
+    count++;
+  }
+  EXPECT_EQ(9, count);
+  EXPECT_TRUE(upb_MapIterator_Done(map, iter));
+}
+
+TEST(MapTest, RandomOperations) {
+  upb::Arena arena;
+  upb_Map* map = upb_Map_New(arena.ptr(), kUpb_CType_UInt32, kUpb_CType_Int32);
+  std::map<uint32_t, int32_t> expected;
+  uint32_t seed = 1;
+  for (int i = 0; i < 20000; i++) {
+    seed = seed * 1103515245 + 12345;
+    upb_MessageValue key, val;
+    key.uint32_val = (seed >> 16) % 512;
+    if (seed & 1) {
+      val.int32_val = i;
+      ASSERT_TRUE(upb_Map_Set(map, key, val, arena.ptr()));
+      expected[key.uint32_val] = i;
+    } else {
+      EXPECT_EQ(expected.erase(key.uint32_val) == 1,
+                upb_Map_Delete(map, key, nullptr));
+    }
+  }
+
+  EXPECT_EQ(expected.size(), upb_Map_Size(map));
+  std::map<uint32_t, int32_t> seen;
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue key, val;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    EXPECT_TRUE(seen.emplace(key.uint32_val, val.int32_val).second);
+  }
+  EXPECT_EQ(expected, seen);
+}
+
+TEST(MapTest, BoolKeys) {
+  upb::Arena arena;
+  upb_Map* map = upb_Map_New(arena.ptr(), kUpb_CType_Bool, kUpb_CType_Int32);
+  upb_MessageValue key, val;
+  key.bool_val = true;
+  val.int32_val = 1;
+  EXPECT_EQ(kUpb_MapInsertStatus_Inserted,
+            upb_Map_Insert(map, key, val, arena.ptr()));
+  key.bool_val = false;
+  val.int32_val = 2;
+  EXPECT_EQ(kUpb_MapInsertStatus_Inserted,
+            upb_Map_Insert(map, key, val, arena.ptr()));
+  EXPECT_EQ(2, upb_Map_Size(map));
+
+  size_t iter = kUpb_Map_Begin;
+  int32_t sum = 0;
+  while (upb_MapIterator_Next(map, &iter)) {
+    upb_MessageValue k = upb_MapIterator_Key(map, iter);
+    upb_MessageValue v = upb_MapIterator_Value(map, iter);
+    EXPECT_EQ(k.bool_val ? 1 : 2, v.int32_val);
+    sum += v.int32_val;
+  }
+  EXPECT_TRUE(upb_MapIterator_Done(map, iter));
+  EXPECT_EQ(3, sum);
+}
+
+TEST(MapTest, Batch) {
+  upb::Arena arena;
+  upb_Map* map = upb_Map_New(arena.ptr(), kUpb_CType_Int32, kUpb_CType_Int32);
+  ASSERT_TRUE(upb_Map_Reserve(map, 1000, arena.ptr()));
+  EXPECT_EQ(0, upb_Map_Size(map));
+
+  // Keys 0..999, with key 10 set twice: the later value wins.
+  std::vector<upb_MessageValue> keys(1001), vals(1001);
+  for (int32_t i = 0; i < 1000; i++) {
+    keys[i].int32_val = i;
+    vals[i].int32_val = i * 2;
+  }
+  keys[1000].int32_val = 10;
+  vals[1000].int32_val = -1;
+  ASSERT_TRUE(upb_Map_InsertBatch(map, keys.data(), vals.data(), keys.size(),
+                                  arena.ptr()));
+  EXPECT_EQ(1000, upb_Map_Size(map));
+
+  // Every other lookup misses.
+  std::vector<upb_MessageValue> lookup(2000), got(2000);
+  bool found[2000];
+  for (int32_t i = 0; i < 2000; i++) {
+    lookup[i].int32_val = i % 2 ? -i : i / 2;
+  }
+  EXPECT_EQ(1000, upb_Map_GetBatch(map, lookup.data(), lookup.size(),
+                                   got.data(), found));
+  for (int32_t i = 0; i < 2000; i++) {
+    ASSERT_EQ(i % 2 == 0, found[i]) << i;
+    if (found[i]) {
+      EXPECT_EQ(i == 20 ? -1 : i, got[i].int32_val) << i;
+    }
+  }
+  EXPECT_EQ(1000, upb_Map_GetBatch(map, lookup.data(), lookup.size(), nullptr,
+                                   nullptr));
+}
+
+TEST(MapTest, BatchStringKeys) {
+  upb::Arena arena;
+  upb_Map* map = upb_Map_New(arena.ptr(), kUpb_CType_String, kUpb_CType_Int64);
+  EXPECT_EQ(0, upb_Map_GetBatch(map, nullptr, 0, nullptr, nullptr));
+
+  std::vector<std::string> strs;
+  for (int i = 0; i < 500; i++) strs.push_back("key" + std::to_string(i));
+  std::vector<upb_MessageValue> keys(strs.size()), vals(strs.size());
+  for (size_t i = 0; i < strs.size(); i++) {
+    keys[i].str_val = upb_StringView_FromDataAndSize(strs[i].data(),
+                                                     strs[i].size());
+    vals[i].int64_val = i;
+  }
+  // Lookups into an empty map find nothing.
+  bool found[500];
+  EXPECT_EQ(0, upb_Map_GetBatch(map, keys.data(), keys.size(), nullptr, found));
+  EXPECT_FALSE(found[0]);
+
+  ASSERT_TRUE(upb_Map_InsertBatch(map, keys.data(), vals.data(), 250,
+                                  arena.ptr()));
+  ASSERT_TRUE(upb_Map_InsertBatch(map, keys.data(), vals.data(), keys.size(),
+                                  arena.ptr()));
+  EXPECT_EQ(500, upb_Map_Size(map));
+
+  std::vector<upb_MessageValue> got(keys.size());
+  EXPECT_EQ(500, upb_Map_GetBatch(map, keys.data(), keys.size(), got.data(),
+                                  found));
+  for (size_t i = 0; i < keys.size(); i++) {
+    EXPECT_TRUE(found[i]);
+    EXPECT_EQ(i, got[i].int64_val);
+  }
+}
+
+// Returns the keys of `map` in the order of deterministic serialization.
+template <class T>
+static std::vector<T> SortedKeys(const upb_Map* map, upb_FieldType key_type) {
+  _upb_mapsorter sorter;
+  _upb_mapsorter_init(&sorter);
+  _upb_sortedmap sorted;
+  std::vector<T> keys;
+  EXPECT_TRUE(_upb_mapsorter_pushmap(&sorter, key_type, map, &sorted));
+  upb_MapEntry ent;
+  while (_upb_sortedmap_next(&sorter, map, &sorted, &ent)) {
+    T key;
+    memcpy(&key, &ent.data.k, sizeof(key));
+    keys.push_back(key);
+  }
+  _upb_mapsorter_popmap(&sorter, &sorted);
+  _upb_mapsorter_destroy(&sorter);
+  return keys;
+}
+
+TEST(MapTest, OrderedIntKeys) {
+  upb::Arena arena;
+  upb_Map* ordered =
+      upb_Map_New(arena.ptr(), kUpb_CType_Int32, kUpb_CType_Int32);
+  upb_Map* plain = upb_Map_New(arena.ptr(), kUpb_CType_Int32, kUpb_CType_Int32);
+  upb_MessageValue key, val;
+  // Keys that were present before are merged into the order too.
+  key.int32_val = 5;
+  val.int32_val = 0;
+  ASSERT_TRUE(upb_Map_Set(ordered, key, val, arena.ptr()));
+  ASSERT_TRUE(upb_Map_Set(plain, key, val, arena.ptr()));
+  ASSERT_TRUE(upb_Map_SetOrdered(ordered, kUpb_CType_Int32, arena.ptr()));
+  EXPECT_TRUE(upb_Map_IsOrdered(ordered));
+  EXPECT_FALSE(upb_Map_IsOrdered(plain));
+
+  // Inserts, replacements and removals of recently removed keys, with
+  // negative keys to check the signed order.
+  uint32_t x = 1;
+  for (int i = 0; i < 5000; i++) {
+    x = x * 1664525 + 1013904223;
+    key.int32_val = static_cast<int32_t>(x >> 20) - 2048;
+    val.int32_val = i;
+    if (x & 0x100) {
+      upb_Map_Delete(ordered, key, nullptr);
+      upb_Map_Delete(plain, key, nullptr);
+    } else {
+      ASSERT_TRUE(upb_Map_Set(ordered, key, val, arena.ptr()));
+      ASSERT_TRUE(upb_Map_Set(plain, key, val, arena.ptr()));
+    }
+    if (i % 500 == 0) {
+      ASSERT_EQ(SortedKeys<int32_t>(plain, kUpb_FieldType_Int32),
+                SortedKeys<int32_t>(ordered, kUpb_FieldType_Int32));
+    }
+  }
+  EXPECT_EQ(upb_Map_Size(plain), upb_Map_Size(ordered));
+  EXPECT_EQ(SortedKeys<int32_t>(plain, kUpb_FieldType_Int32),
+            SortedKeys<int32_t>(ordered, kUpb_FieldType_Int32));
+
+  upb_Map_Clear(ordered);
+  EXPECT_TRUE(SortedKeys<int32_t>(ordered, kUpb_FieldType_Int32).empty());
+  key.int32_val = -1;
+  ASSERT_TRUE(upb_Map_Set(ordered, key, val, arena.ptr()));
+  EXPECT_EQ(std::vector<int32_t>{-1},
+            SortedKeys<int32_t>(ordered, kUpb_FieldType_Int32));
+}
+
+TEST(MapTest, OrderedStringKeys) {
+  upb::Arena arena;
+  upb_Map* ordered =
+      upb_Map_New(arena.ptr(), kUpb_CType_String, kUpb_CType_Int32);
+  upb_Map* plain =
+      upb_Map_New(arena.ptr(), kUpb_CType_String, kUpb_CType_Int32);
+  ASSERT_TRUE(upb_Map_SetOrdered(ordered, kUpb_CType_String, arena.ptr()));
+
+  upb_MessageValue key, val;
+  for (int i = 0; i < 2000; i++) {
+    // The key is overwritten after each call, as the map copies it.
+    std::string str = std::to_string((i * 7919) % 1000);
+    key.str_val = upb_StringView_FromDataAndSize(str.data(), str.size());
+    val.int32_val = i;
+    if (i % 3 == 2) {
+      upb_Map_Delete(ordered, key, nullptr);
+      upb_Map_Delete(plain, key, nullptr);
+    } else {
+      ASSERT_TRUE(upb_Map_Set(ordered, key, val, arena.ptr()));
+      ASSERT_TRUE(upb_Map_Set(plain, key, val, arena.ptr()));
+    }
+    str.assign(str.size(), 'x');
+  }
+
+  std::vector<upb_StringView> want =
+      SortedKeys<upb_StringView>(plain, kUpb_FieldType_String);
+  std::vector<upb_StringView> got =
+      SortedKeys<upb_StringView>(ordered, kUpb_FieldType_String);
+  ASSERT_EQ(want.size(), got.size());
+  for (size_t i = 0; i < want.size(); i++) {
+    EXPECT_TRUE(upb_StringView_IsEqual(want[i], got[i])) << i;
+  }
+}
@@ -31,14 +31,29 @@
 /*
  * upb_table Implementation
  *
- * Implementation is heavily inspired by Lua's ltable.c.
+ * The integer table's split into an array part and a hash part is inspired by
+ * Lua's ltable.c.  The hash part is probed like Abseil's SwissTable.
  */
 
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UPB_TABLE_SSE2 1
+#elif defined(__ARM_NEON) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define UPB_TABLE_NEON 1
+#endif
+
 #include "upb/base/internal/log2.h"
+#include "upb/hash/concurrent_table.h"
+#include "upb/hash/frozen_table.h"
 #include "upb/hash/int_table.h"
 #include "upb/hash/str_table.h"
+#include "upb/mem/alloc.h"
+#include "upb/port/atomic.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -111,69 +126,226 @@ static lookupkey_t intkey(uintptr_t key) {
   return k;
 }
 
-typedef uint32_t hashfunc_t(upb_tabkey key);
 typedef bool eqlfunc_t(upb_tabkey k1, lookupkey_t k2);
 
 /* Base table (shared code) ***************************************************/
 
-static uint32_t upb_inthash(uintptr_t key) { return (uint32_t)key; }
+/* Control bytes.  A full slot holds the low 7 bits of its entry's hash, all
+ * other states have the high bit set.  The control array of a table smaller
+ * than a group is padded with kUpb_Ctrl_Sentinel, which nothing matches. */
+enum {
+  kUpb_Ctrl_Empty = 0x80,
+  kUpb_Ctrl_Deleted = 0xfe,
+  kUpb_Ctrl_Sentinel = 0xff,
+};
+
+/* The slots of a group are probed with one comparison.  A groupmask has one
+ * set bit per matching slot, at bit (slot << UPB_GROUPMASK_SHIFT). */
+#ifdef UPB_TABLE_SSE2
+
+#define UPB_TABLE_GROUP 16
+#define UPB_GROUPMASK_SHIFT 0
+typedef uint32_t upb_groupmask;
+
+static upb_groupmask group_match(const uint8_t* ctrl, uint8_t h) {
+  __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+  __m128i match = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)h));
+  return (upb_groupmask)_mm_movemask_epi8(match);
+}
+
+static upb_groupmask group_matchempty(const uint8_t* ctrl) {
+  return group_match(ctrl, kUpb_Ctrl_Empty);
+}
+
+/* Matches empty and deleted slots, which as signed bytes are exactly the ones
+ * less than the sentinel. */
+static upb_groupmask group_matchfree(const uint8_t* ctrl) {
+  __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+  __m128i sentinel = _mm_set1_epi8((char)kUpb_Ctrl_Sentinel);
+  return (upb_groupmask)_mm_movemask_epi8(_mm_cmpgt_epi8(sentinel, group));
+}
+
+#else
+
+#define UPB_TABLE_GROUP 8
+#define UPB_GROUPMASK_SHIFT 3
+typedef uint64_t upb_groupmask;
+
+#define UPB_GROUP_LSBS 0x0101010101010101ULL
+#define UPB_GROUP_MSBS 0x8080808080808080ULL
+
+/* Slot i is byte i of the result on any endianness; compilers turn this into a
+ * single load on little-endian targets. */
+static uint64_t group_load(const uint8_t* ctrl) {
+  uint64_t ret = 0;
+  for (int i = 0; i < UPB_TABLE_GROUP; i++) {
+    ret |= (uint64_t)ctrl[i] << (8 * i);
+  }
+  return ret;
+}
+
+static upb_groupmask group_match(const uint8_t* ctrl, uint8_t h) {
+#ifdef UPB_TABLE_NEON
+  uint8x8_t match = vceq_u8(vld1_u8(ctrl), vdup_n_u8(h));
+  return vget_lane_u64(vreinterpret_u64_u8(match), 0) & UPB_GROUP_MSBS;
+#else
+  /* Exact zero-byte test: no false positives from borrows. */
+  uint64_t x = group_load(ctrl) ^ (UPB_GROUP_LSBS * h);
+  return ~(((x & ~UPB_GROUP_MSBS) + ~UPB_GROUP_MSBS) | x) & UPB_GROUP_MSBS;
+#endif
+}
+
+/* Empty is the only state with the high bit set and bit 1 clear. */
+static upb_groupmask group_matchempty(const uint8_t* ctrl) {
+  uint64_t x = group_load(ctrl);
+  return x & ~(x << 6) & UPB_GROUP_MSBS;
+}
+
+/* Empty and deleted are the only states with the high bit set and bit 0 clear.
+ */
+static upb_groupmask group_matchfree(const uint8_t* ctrl) {
+  uint64_t x = group_load(ctrl);
+  return x & ~(x << 7) & UPB_GROUP_MSBS;
+}
+
+#endif
 
-static const upb_tabent* upb_getentry(const upb_table* t, uint32_t hash) {
-  return t->entries + (hash & t->mask);
+/* Returns the lowest slot in a non-empty groupmask. */
+static uint32_t groupmask_lowest(upb_groupmask m) {
+  UPB_ASSERT(m != 0);
+#ifdef __GNUC__
+  return (uint32_t)__builtin_ctzll(m) >> UPB_GROUPMASK_SHIFT;
+#else
+  uint32_t n = 0;
+  while ((m & 1) == 0) {
+    m >>= 1;
+    n++;
+  }
+  return n >> UPB_GROUPMASK_SHIFT;
+#endif
+}
+
+/* Hashes are seeded with the table size.  Without a seed, the keys of a table
+ * come out of iteration grouped by their slot, and inserting them in that
+ * order into a smaller table (as when a serialized map is decoded) makes
+ * each run of keys collide with the runs before it.
+ *
+ * The integer hash mixes the key so that both the group (high bits) and the
+ * control byte (low bits) vary with every bit of the key. */
+static uint32_t inthash_seeded(uintptr_t key, uint32_t seed) {
+  uint64_t h = (uint64_t)key ^ (seed * 0x9e3779b97f4a7c15ULL);
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 32;
+  h *= 0x9e3779b97f4a7c15ULL;
+  return (uint32_t)(h >> 32);
+}
+
+static uint32_t upb_inthash(const upb_table* t, uintptr_t key) {
+  return inthash_seeded(key, t->size_lg2);
+}
+
+static uint8_t hash_ctrl(uint32_t hash) { return hash & 0x7f; }
+
+static size_t ctrl_size(const upb_table* t) {
+  return UPB_MAX(upb_table_size(t), UPB_TABLE_GROUP);
+}
+
+/* The probe sequence visits groups at triangular offsets from the group picked
+ * by the hash, which covers every group since the count is a power of two. */
+typedef struct {
+  uint32_t mask;
+  uint32_t group;
+  uint32_t step;
+} probe_seq;
+
+static probe_seq probe_start(const upb_table* t, uint32_t hash) {
+  probe_seq seq;
+  seq.mask = t->mask / UPB_TABLE_GROUP;  // One less than the group count.
+  seq.group = (hash >> 7) & seq.mask;
+  seq.step = 0;
+  return seq;
+}
+
+static void probe_next(probe_seq* seq) {
+  seq->step++;
+  seq->group = (seq->group + seq->step) & seq->mask;
+}
+
+static size_t probe_offset(const probe_seq* seq) {
+  return (size_t)seq->group * UPB_TABLE_GROUP;
 }
 
 static bool upb_arrhas(upb_tabval key) { return key.val != (uint64_t)-1; }
 
 static bool isfull(upb_table* t) { return t->count == t->max_count; }
 
+static uint32_t load_limit(const upb_table* t) {
+  return upb_table_size(t) * MAX_LOAD;
+}
+
+/* Returns the size to rehash a full table to: the same size if deleted slots
+ * take up half of the load limit or more, else double. */
+static uint8_t grow_lg2(const upb_table* t) {
+  if (t->size_lg2 && t->count <= load_limit(t) / 2) return t->size_lg2;
+  return t->size_lg2 + 1;
+}
+
+static void reset_ctrl(upb_table* t) {
+  size_t size = upb_table_size(t);
+  memset(t->ctrl, kUpb_Ctrl_Empty, size);
+  memset(t->ctrl + size, kUpb_Ctrl_Sentinel, ctrl_size(t) - size);
+  t->max_count = load_limit(t);
+}
+
 static bool init(upb_table* t, uint8_t size_lg2, upb_Arena* a) {
   size_t bytes;
 
   t->count = 0;
   t->size_lg2 = size_lg2;
   t->mask = upb_table_size(t) ? upb_table_size(t) - 1 : 0;
-  t->max_count = upb_table_size(t) * MAX_LOAD;
+  t->max_count = load_limit(t);
   bytes = upb_table_size(t) * sizeof(upb_tabent);
   if (bytes > 0) {
-    t->entries = upb_Arena_Malloc(a, bytes);
+    t->entries = upb_Arena_Malloc(a, bytes + ctrl_size(t));
     if (!t->entries) return false;
     memset(t->entries, 0, bytes);
+    t->ctrl = (uint8_t*)t->entries + bytes;
+    reset_ctrl(t);
   } else {
     t->entries = NULL;
+    t->ctrl = NULL;
   }
   return true;
 }
 
-static upb_tabent* emptyent(upb_table* t, upb_tabent* e) {
-  upb_tabent* begin = t->entries;
-  upb_tabent* end = begin + upb_table_size(t);
-  for (e = e + 1; e < end; e++) {
-    if (upb_tabent_isempty(e)) return e;
-  }
-  for (e = begin; e < end; e++) {
-    if (upb_tabent_isempty(e)) return e;
-  }
-  UPB_ASSERT(false);
-  return NULL;
-}
-
-static upb_tabent* getentry_mutable(upb_table* t, uint32_t hash) {
-  return (upb_tabent*)upb_getentry(t, hash);
+static void clear(upb_table* t) {
+  if (!t->entries) return;
+  t->count = 0;
+  memset(t->entries, 0, upb_table_size(t) * sizeof(upb_tabent));
+  reset_ctrl(t);
 }
 
+/* Inlined so that `eql` becomes a direct call in each caller. */
+UPB_FORCEINLINE
 static const upb_tabent* findentry(const upb_table* t, lookupkey_t key,
                                    uint32_t hash, eqlfunc_t* eql) {
-  const upb_tabent* e;
-
   if (t->size_lg2 == 0) return NULL;
-  e = upb_getentry(t, hash);
-  if (upb_tabent_isempty(e)) return NULL;
+  const uint8_t h = hash_ctrl(hash);
+  probe_seq seq = probe_start(t, hash);
   while (1) {
-    if (eql(e->key, key)) return e;
-    if ((e = e->next) == NULL) return NULL;
+    const uint8_t* ctrl = t->ctrl + probe_offset(&seq);
+    for (upb_groupmask m = group_match(ctrl, h); m; m &= m - 1) {
+      const upb_tabent* e =
+          &t->entries[probe_offset(&seq) + groupmask_lowest(m)];
+      if (eql(e->key, key)) return e;
+    }
+    /* A key is never placed past a group that had an empty slot. */
+    if (group_matchempty(ctrl)) return NULL;
+    probe_next(&seq);
   }
 }
 
+UPB_FORCEINLINE
 static upb_tabent* findentry_mutable(upb_table* t, lookupkey_t key,
                                      uint32_t hash, eqlfunc_t* eql) {
   return (upb_tabent*)findentry(t, key, hash, eql);
@@ -192,90 +364,56 @@ static bool lookup(const upb_table* t, lookupkey_t key, upb_value* v,
   }
 }
 
-/* The given key must not already exist in the table. */
+/* The given key must not already exist in the table, and the table must not be
+ * full. */
 static void insert(upb_table* t, lookupkey_t key, upb_tabkey tabkey,
-                   upb_value val, uint32_t hash, hashfunc_t* hashfunc,
-                   eqlfunc_t* eql) {
-  upb_tabent* mainpos_e;
-  upb_tabent* our_e;
-
+                   upb_value val, uint32_t hash, eqlfunc_t* eql) {
   UPB_ASSERT(findentry(t, key, hash, eql) == NULL);
-
+  UPB_ASSERT(!isfull(t));
+  UPB_UNUSED(key);
+  UPB_UNUSED(eql);
+
+  probe_seq seq = probe_start(t, hash);
+  upb_groupmask m;
+  while (!(m = group_matchfree(t->ctrl + probe_offset(&seq)))) {
+    probe_next(&seq);
+  }
+  size_t i = probe_offset(&seq) + groupmask_lowest(m);
+  /* Reusing a deleted slot gives back the load it was holding. */
+  if (t->ctrl[i] == kUpb_Ctrl_Deleted) t->max_count++;
+  t->ctrl[i] = hash_ctrl(hash);
   t->count++;
-  mainpos_e = getentry_mutable(t, hash);
-  our_e = mainpos_e;
 
-  if (upb_tabent_isempty(mainpos_e)) {
-    /* Our main position is empty; use it. */
-    our_e->next = NULL;
+  upb_tabent* e = &t->entries[i];
+  e->key = tabkey;
+  e->val.val = val.val;
+  UPB_ASSERT(findentry(t, key, hash, eql) == e);
+}
+
+/* Empties slot `i`.  If its group still has an empty slot then no probe ever
+ * went past the group, and the slot can become empty again; otherwise it is
+ * marked deleted and keeps counting against the load limit until it is reused
+ * or the table is rehashed. */
+static void rmslot(upb_table* t, size_t i) {
+  uint8_t* group = t->ctrl + (i & ~(size_t)(UPB_TABLE_GROUP - 1));
+  if (group_matchempty(group)) {
+    t->ctrl[i] = kUpb_Ctrl_Empty;
   } else {
-    /* Collision. */
-    upb_tabent* new_e = emptyent(t, mainpos_e);
-    /* Head of collider's chain. */
-    upb_tabent* chain = getentry_mutable(t, hashfunc(mainpos_e->key));
-    if (chain == mainpos_e) {
-      /* Existing ent is in its main position (it has the same hash as us, and
-       * is the head of our chain).  Insert to new ent and append to this chain.
-       */
-      new_e->next = mainpos_e->next;
-      mainpos_e->next = new_e;
-      our_e = new_e;
-    } else {
-      /* Existing ent is not in its main position (it is a node in some other
-       * chain).  This implies that no existing ent in the table has our hash.
-       * Evict it (updating its chain) and use its ent for head of our chain. */
-      *new_e = *mainpos_e; /* copies next. */
-      while (chain->next != mainpos_e) {
-        chain = (upb_tabent*)chain->next;
-        UPB_ASSERT(chain);
-      }
-      chain->next = new_e;
-      our_e = mainpos_e;
-      our_e->next = NULL;
-    }
+    t->ctrl[i] = kUpb_Ctrl_Deleted;
+    t->max_count--;
   }
-  our_e->key = tabkey;
-  our_e->val.val = val.val;
-  UPB_ASSERT(findentry(t, key, hash, eql) == our_e);
+  t->count--;
+  t->entries[i].key = 0;
 }
 
 static bool rm(upb_table* t, lookupkey_t key, upb_value* val,
                upb_tabkey* removed, uint32_t hash, eqlfunc_t* eql) {
-  upb_tabent* chain = getentry_mutable(t, hash);
-  if (upb_tabent_isempty(chain)) return false;
-  if (eql(chain->key, key)) {
-    /* Element to remove is at the head of its chain. */
-    t->count--;
-    if (val) _upb_value_setval(val, chain->val.val);
-    if (removed) *removed = chain->key;
-    if (chain->next) {
-      upb_tabent* move = (upb_tabent*)chain->next;
-      *chain = *move;
-      move->key = 0; /* Make the slot empty. */
-    } else {
-      chain->key = 0; /* Make the slot empty. */
-    }
-    return true;
-  } else {
-    /* Element to remove is either in a non-head position or not in the
-     * table. */
-    while (chain->next && !eql(chain->next->key, key)) {
-      chain = (upb_tabent*)chain->next;
-    }
-    if (chain->next) {
-      /* Found element to remove. */
-      upb_tabent* rm = (upb_tabent*)chain->next;
-      t->count--;
-      if (val) _upb_value_setval(val, chain->next->val.val);
-      if (removed) *removed = rm->key;
-      rm->key = 0; /* Make the slot empty. */
-      chain->next = rm->next;
-      return true;
-    } else {
-      /* Element to remove is not in the table. */
-      return false;
-    }
-  }
+  upb_tabent* e = findentry_mutable(t, key, hash, eql);
+  if (!e) return false;
+  if (val) _upb_value_setval(val, e->val.val);
+  if (removed) *removed = e->key;
+  rmslot(t, e - t->entries);
+  return true;
 }
 
 static size_t next(const upb_table* t, size_t i) {
@@ -354,6 +492,33 @@ static uint64_t WyhashMix(uint64_t v0, uint64_t v1) {
   return low ^ high;
 }
 
+/* Loads the at most 16 bytes at |ptr| into |*a| and |*b|. */
+UPB_FORCEINLINE
+static void WyhashLoadShort(const uint8_t* ptr, size_t len, uint64_t* a,
+                            uint64_t* b) {
+  if (len > 8) {
+    // When we have at least 9 and at most 16 bytes, set A to the first 64
+    // bits of the input and B to the last 64 bits of the input. Yes, they will
+    // overlap in the middle if we are working with less than the full 16
+    // bytes.
+    *a = UnalignedLoad64(ptr);
+    *b = UnalignedLoad64(ptr + len - 8);
+  } else if (len > 3) {
+    // If we have at least 4 and at most 8 bytes, set A to the first 32
+    // bits and B to the last 32 bits.
+    *a = UnalignedLoad32(ptr);
+    *b = UnalignedLoad32(ptr + len - 4);
+  } else if (len > 0) {
+    // If we have at least 1 and at most 3 bytes, read all of the provided
+    // bits into A, with some adjustments.
+    *a = ((ptr[0] << 16) | (ptr[len >> 1] << 8) | ptr[len - 1]);
+    *b = 0;
+  } else {
+    *a = 0;
+    *b = 0;
+  }
+}
+
 static uint64_t Wyhash(const void* data, size_t len, uint64_t seed,
                        const uint64_t salt[]) {
   const uint8_t* ptr = (const uint8_t*)data;
@@ -404,30 +569,8 @@ static uint64_t Wyhash(const void* data, size_t len, uint64_t seed,
   }
 
   // We now have a data `ptr` with at most 16 bytes.
-  uint64_t a = 0;
-  uint64_t b = 0;
-  if (len > 8) {
-    // When we have at least 9 and at most 16 bytes, set A to the first 64
-    // bits of the input and B to the last 64 bits of the input. Yes, they will
-    // overlap in the middle if we are working with less than the full 16
-    // bytes.
-    a = UnalignedLoad64(ptr);
-    b = UnalignedLoad64(ptr + len - 8);
-  } else if (len > 3) {
-    // If we have at least 4 and at most 8 bytes, set A to the first 32
-    // bits and B to the last 32 bits.
-    a = UnalignedLoad32(ptr);
-    b = UnalignedLoad32(ptr + len - 4);
-  } else if (len > 0) {
-    // If we have at least 1 and at most 3 bytes, read all of the provided
-    // bits into A, with some adjustments.
-    a = ((ptr[0] << 16) | (ptr[len >> 1] << 8) | ptr[len - 1]);
-    b = 0;
-  } else {
-    a = 0;
-    b = 0;
-  }
-
+  uint64_t a, b;
+  WyhashLoadShort(ptr, len, &a, &b);
   uint64_t w = WyhashMix(a ^ salt[1], b ^ current_state);
   uint64_t z = salt[1] ^ starting_length;
   return WyhashMix(w, z);
@@ -438,18 +581,27 @@ const uint64_t kWyhashSalt[5] = {
     0x082EFA98EC4E6C89ULL, 0x452821E638D01377ULL,
 };
 
+/* Most keys (field and enum names, short map keys) are at most 16 bytes.
+ * These skip the setup of Wyhash() and are mixed with a single multiply.
+ * The length goes into the top byte of |b|, so keys whose loads overlap
+ * (like "abc" and "abcc") still differ, and the product is folded so that
+ * its low bits depend on the whole key. */
+static uint64_t WyhashShort(const void* data, size_t len, uint64_t seed,
+                            const uint64_t salt[]) {
+  uint64_t a, b;
+  WyhashLoadShort((const uint8_t*)data, len, &a, &b);
+  uint64_t h =
+      WyhashMix(a ^ salt[1], b ^ salt[0] ^ seed ^ ((uint64_t)len << 56));
+  return h ^ (h >> 32);
+}
+
 uint32_t _upb_Hash(const void* p, size_t n, uint64_t seed) {
+  if (UPB_LIKELY(n <= 16)) return WyhashShort(p, n, seed, kWyhashSalt);
   return Wyhash(p, n, seed, kWyhashSalt);
 }
 
-static uint32_t _upb_Hash_NoSeed(const char* p, size_t n) {
-  return _upb_Hash(p, n, 0);
-}
-
-static uint32_t strhash(upb_tabkey key) {
-  uint32_t len;
-  char* str = upb_tabstr(key, &len);
-  return _upb_Hash_NoSeed(str, len);
+static uint32_t strhash(const upb_table* t, const char* p, size_t n) {
+  return _upb_Hash(p, n, t->size_lg2);
 }
 
 static bool streql(upb_tabkey k1, lookupkey_t k2) {
@@ -458,21 +610,20 @@ static bool streql(upb_tabkey k1, lookupkey_t k2) {
   return len == k2.str.len && (len == 0 || memcmp(str, k2.str.str, len) == 0);
 }
 
-bool upb_strtable_init(upb_strtable* t, size_t expected_size, upb_Arena* a) {
+static int strtable_size_lg2(size_t expected_size) {
   // Multiply by approximate reciprocal of MAX_LOAD (0.85), with pow2
   // denominator.
   size_t need_entries = (expected_size + 1) * 1204 / 1024;
   UPB_ASSERT(need_entries >= expected_size * 0.85);
-  int size_lg2 = upb_Log2Ceiling(need_entries);
-  return init(&t->t, size_lg2, a);
+  return upb_Log2Ceiling(need_entries);
 }
 
-void upb_strtable_clear(upb_strtable* t) {
-  size_t bytes = upb_table_size(&t->t) * sizeof(upb_tabent);
-  t->t.count = 0;
-  memset((char*)t->t.entries, 0, bytes);
+bool upb_strtable_init(upb_strtable* t, size_t expected_size, upb_Arena* a) {
+  return init(&t->t, strtable_size_lg2(expected_size), a);
 }
 
+void upb_strtable_clear(upb_strtable* t) { clear(&t->t); }
+
 bool upb_strtable_resize(upb_strtable* t, size_t size_lg2, upb_Arena* a) {
   upb_strtable new_table;
   if (!init(&new_table.t, size_lg2, a)) return false;
@@ -487,6 +638,24 @@ bool upb_strtable_resize(upb_strtable* t, size_t size_lg2, upb_Arena* a) {
   return true;
 }
 
+bool upb_strtable_reserve(upb_strtable* t, size_t size, upb_Arena* a) {
+  if (size <= t->t.max_count) return true;
+  int size_lg2 = UPB_MAX(strtable_size_lg2(size), t->t.size_lg2);
+  return upb_strtable_resize(t, size_lg2, a);
+}
+
+size_t upb_strtable_spaceused(const upb_strtable* t) {
+  size_t size = upb_table_size(&t->t);
+  size_t ret = size ? size * sizeof(upb_tabent) + ctrl_size(&t->t) : 0;
+  intptr_t iter = UPB_STRTABLE_BEGIN;
+  upb_StringView key;
+  upb_value val;
+  while (upb_strtable_next2(t, &key, &val, &iter)) {
+    ret += key.size + sizeof(uint32_t) + 1;
+  }
+  return ret;
+}
+
 bool upb_strtable_insert(upb_strtable* t, const char* k, size_t len,
                          upb_value v, upb_Arena* a) {
   lookupkey_t key;
@@ -495,7 +664,7 @@ bool upb_strtable_insert(upb_strtable* t, const char* k, size_t len,
 
   if (isfull(&t->t)) {
     /* Need to resize.  New table of double the size, add old elements to it. */
-    if (!upb_strtable_resize(t, t->t.size_lg2 + 1, a)) {
+    if (!upb_strtable_resize(t, grow_lg2(&t->t), a)) {
       return false;
     }
   }
@@ -504,20 +673,44 @@ bool upb_strtable_insert(upb_strtable* t, const char* k, size_t len,
   tabkey = strcopy(key, a);
   if (tabkey == 0) return false;
 
-  hash = _upb_Hash_NoSeed(key.str.str, key.str.len);
-  insert(&t->t, key, tabkey, v, hash, &strhash, &streql);
+  hash = strhash(&t->t, key.str.str, key.str.len);
+  insert(&t->t, key, tabkey, v, hash, &streql);
   return true;
 }
 
 bool upb_strtable_lookup2(const upb_strtable* t, const char* key, size_t len,
                           upb_value* v) {
-  uint32_t hash = _upb_Hash_NoSeed(key, len);
+  uint32_t hash = strhash(&t->t, key, len);
   return lookup(&t->t, strkey2(key, len), v, hash, &streql);
 }
 
+uint32_t upb_strtable_hash(const upb_strtable* t, const char* key,
+                           size_t len) {
+  return strhash(&t->t, key, len);
+}
+
+void upb_strtable_prefetch(const upb_strtable* t, uint32_t hash) {
+  if (t->t.size_lg2 == 0) return;
+  probe_seq seq = probe_start(&t->t, hash);
+  UPB_PREFETCH(t->t.ctrl + probe_offset(&seq));
+  UPB_PREFETCH(&t->t.entries[probe_offset(&seq)]);
+}
+
+bool upb_strtable_lookuphash(const upb_strtable* t, const char* key,
+                             size_t len, uint32_t hash, upb_value* v) {
+  UPB_ASSERT(hash == strhash(&t->t, key, len));
+  return lookup(&t->t, strkey2(key, len), v, hash, &streql);
+}
+
+const upb_tabent* upb_strtable_lookupentry(const upb_strtable* t,
+                                           const char* key, size_t len) {
+  uint32_t hash = strhash(&t->t, key, len);
+  return findentry(&t->t, strkey2(key, len), hash, &streql);
+}
+
 bool upb_strtable_remove2(upb_strtable* t, const char* key, size_t len,
                           upb_value* val) {
-  uint32_t hash = _upb_Hash_NoSeed(key, len);
+  uint32_t hash = strhash(&t->t, key, len);
   upb_tabkey tabkey;
   return rm(&t->t, strkey2(key, len), val, &tabkey, hash, &streql);
 }
@@ -567,12 +760,37 @@ bool upb_strtable_iter_isequal(const upb_strtable_iter* i1,
 /* upb_inttable ***************************************************************/
 
 /* For inttables we use a hybrid structure where small keys are kept in an
- * array and large keys are put in the hash table. */
+ * array and large keys are put in the hash table.
+ *
+ * upb_inttable_compact() freezes a small hash part into an array of entries
+ * sorted by key, searched by bisection.  Such a table has size_lg2 == 0 but
+ * a nonzero count, which a hash table never has, and `t.entries` points to
+ * `t.count` entries.  Inserting into it turns it back into a hash table. */
 
-static uint32_t inthash(upb_tabkey key) { return upb_inthash(key); }
+/* Hash parts with at most this many keys are sorted by compaction.  Up to
+ * here bisection is no slower than probing, and the entries take less than
+ * half the space. */
+#define UPB_INTTABLE_MAXSORTED 8
 
 static bool inteql(upb_tabkey k1, lookupkey_t k2) { return k1 == k2.num; }
 
+static bool inttable_issorted(const upb_inttable* t) {
+  return t->t.size_lg2 == 0 && t->t.count > 0;
+}
+
+/* Returns the sorted entry for |key|, or NULL.  The comparison is folded
+ * into the step so that the loop does not branch on it. */
+static upb_tabent* inttable_findsorted(const upb_inttable* t, uintptr_t key) {
+  upb_tabent* base = t->t.entries;
+  size_t n = t->t.count;
+  while (n > 1) {
+    size_t half = n / 2;
+    base += (base[half - 1].key < key) * half;
+    n -= half;
+  }
+  return base->key == key ? base : NULL;
+}
+
 static upb_tabval* mutable_array(upb_inttable* t) {
   return (upb_tabval*)t->array;
 }
@@ -580,9 +798,12 @@ static upb_tabval* mutable_array(upb_inttable* t) {
 static upb_tabval* inttable_val(upb_inttable* t, uintptr_t key) {
   if (key < t->array_size) {
     return upb_arrhas(t->array[key]) ? &(mutable_array(t)[key]) : NULL;
+  } else if (inttable_issorted(t)) {
+    upb_tabent* e = inttable_findsorted(t, key);
+    return e ? &e->val : NULL;
   } else {
     upb_tabent* e =
-        findentry_mutable(&t->t, intkey(key), upb_inthash(key), &inteql);
+        findentry_mutable(&t->t, intkey(key), upb_inthash(&t->t, key), &inteql);
     return e ? &e->val : NULL;
   }
 }
@@ -636,6 +857,34 @@ bool upb_inttable_init(upb_inttable* t, upb_Arena* a) {
   return upb_inttable_sizedinit(t, 0, 4, a);
 }
 
+static void inttable_reinsert(upb_table* t, const upb_tabent* e) {
+  upb_value v;
+  _upb_value_setval(&v, e->val.val);
+  insert(t, intkey(e->key), e->key, v, upb_inthash(t, e->key), &inteql);
+}
+
+/* Moves the hash part, whether hashed or sorted, to a new hash table. */
+static bool inttable_rehash(upb_inttable* t, int size_lg2, upb_Arena* a) {
+  upb_table new_table;
+  if (!init(&new_table, size_lg2, a)) return false;
+
+  if (inttable_issorted(t)) {
+    for (size_t i = 0; i < t->t.count; i++) {
+      inttable_reinsert(&new_table, &t->t.entries[i]);
+    }
+  } else {
+    for (size_t i = begin(&t->t); i < upb_table_size(&t->t);
+         i = next(&t->t, i)) {
+      inttable_reinsert(&new_table, &t->t.entries[i]);
+    }
+  }
+
+  UPB_ASSERT(t->t.count == new_table.count);
+
+  t->t = new_table;
+  return true;
+}
+
 bool upb_inttable_insert(upb_inttable* t, uintptr_t key, upb_value val,
                          upb_Arena* a) {
   upb_tabval tabval;
@@ -648,30 +897,15 @@ bool upb_inttable_insert(upb_inttable* t, uintptr_t key, upb_value val,
     t->array_count++;
     mutable_array(t)[key].val = val.val;
   } else {
-    if (isfull(&t->t)) {
+    if (inttable_issorted(t)) {
+      /* Thaw the sorted entries, with room for this key. */
+      size_t hash_size = (t->t.count + 1) / MAX_LOAD + 1;
+      if (!inttable_rehash(t, log2ceil(hash_size), a)) return false;
+    } else if (isfull(&t->t)) {
       /* Need to resize the hash part, but we re-use the array part. */
-      size_t i;
-      upb_table new_table;
-
-      if (!init(&new_table, t->t.size_lg2 + 1, a)) {
-        return false;
-      }
-
-      for (i = begin(&t->t); i < upb_table_size(&t->t); i = next(&t->t, i)) {
-        const upb_tabent* e = &t->t.entries[i];
-        uint32_t hash;
-        upb_value v;
-
-        _upb_value_setval(&v, e->val.val);
-        hash = upb_inthash(e->key);
-        insert(&new_table, intkey(e->key), e->key, v, hash, &inthash, &inteql);
-      }
-
-      UPB_ASSERT(t->t.count == new_table.count);
-
-      t->t = new_table;
+      if (!inttable_rehash(t, grow_lg2(&t->t), a)) return false;
     }
-    insert(&t->t, intkey(key), key, val, upb_inthash(key), &inthash, &inteql);
+    insert(&t->t, intkey(key), key, val, upb_inthash(&t->t, key), &inteql);
   }
   check(t);
   return true;
@@ -691,6 +925,13 @@ bool upb_inttable_replace(upb_inttable* t, uintptr_t key, upb_value val) {
   return true;
 }
 
+static void inttable_rmsorted(upb_inttable* t, size_t i, upb_value* val) {
+  upb_tabent* e = &t->t.entries[i];
+  if (val) _upb_value_setval(val, e->val.val);
+  memmove(e, e + 1, (t->t.count - i - 1) * sizeof(*e));
+  t->t.count--;
+}
+
 bool upb_inttable_remove(upb_inttable* t, uintptr_t key, upb_value* val) {
   bool success;
   if (key < t->array_size) {
@@ -705,8 +946,13 @@ bool upb_inttable_remove(upb_inttable* t, uintptr_t key, upb_value* val) {
     } else {
       success = false;
     }
+  } else if (inttable_issorted(t)) {
+    upb_tabent* e = inttable_findsorted(t, key);
+    success = e != NULL;
+    if (success) inttable_rmsorted(t, e - t->t.entries, val);
   } else {
-    success = rm(&t->t, intkey(key), val, NULL, upb_inthash(key), &inteql);
+    success =
+        rm(&t->t, intkey(key), val, NULL, upb_inthash(&t->t, key), &inteql);
   }
   check(t);
   return success;
@@ -755,15 +1001,33 @@ void upb_inttable_compact(upb_inttable* t, upb_Arena* a) {
     size_t hash_count = upb_inttable_count(t) - arr_count;
     size_t hash_size = hash_count ? (hash_count / MAX_LOAD) + 1 : 0;
     int hashsize_lg2 = log2ceil(hash_size);
+    upb_tabent* sorted = NULL;
 
-    upb_inttable_sizedinit(&new_t, arr_size, hashsize_lg2, a);
+    if (hash_count <= UPB_INTTABLE_MAXSORTED) {
+      sorted = upb_Arena_Malloc(a, hash_count * sizeof(*sorted));
+      if (hash_count && !sorted) return;
+      hashsize_lg2 = 0;
+    }
+
+    if (!upb_inttable_sizedinit(&new_t, arr_size, hashsize_lg2, a)) return;
+    if (sorted) new_t.t.entries = sorted;
 
     {
       intptr_t iter = UPB_INTTABLE_BEGIN;
       uintptr_t key;
       upb_value val;
       while (upb_inttable_next(t, &key, &val, &iter)) {
-        upb_inttable_insert(&new_t, key, val, a);
+        if (sorted && key >= arr_size) {
+          /* Insertion sort, since there are only a few of these. */
+          size_t i = new_t.t.count++;
+          for (; i > 0 && sorted[i - 1].key > key; i--) {
+            sorted[i] = sorted[i - 1];
+          }
+          sorted[i].key = key;
+          sorted[i].val.val = val.val;
+        } else {
+          upb_inttable_insert(&new_t, key, val, a);
+        }
       }
     }
 
@@ -791,16 +1055,20 @@ bool upb_inttable_next(const upb_inttable* t, uintptr_t* key, upb_value* val,
     i--;  // Back up to exactly one position before the start of the table.
   }
 
-  size_t tab_idx = next(&t->t, i - t->array_size);
-  if (tab_idx < upb_table_size(&t->t)) {
-    upb_tabent* ent = &t->t.entries[tab_idx];
-    *key = ent->key;
-    *val = _upb_value_val(ent->val.val);
-    *iter = tab_idx + t->array_size;
-    return true;
+  size_t tab_idx;
+  if (inttable_issorted(t)) {
+    tab_idx = i - t->array_size + 1;
+    if (tab_idx >= t->t.count) return false;
+  } else {
+    tab_idx = next(&t->t, i - t->array_size);
+    if (tab_idx >= upb_table_size(&t->t)) return false;
   }
 
-  return false;
+  upb_tabent* ent = &t->t.entries[tab_idx];
+  *key = ent->key;
+  *val = _upb_value_val(ent->val.val);
+  *iter = tab_idx + t->array_size;
+  return true;
 }
 
 void upb_inttable_removeiter(upb_inttable* t, intptr_t* iter) {
@@ -808,26 +1076,12 @@ void upb_inttable_removeiter(upb_inttable* t, intptr_t* iter) {
   if ((size_t)i < t->array_size) {
     t->array_count--;
     mutable_array(t)[i].val = -1;
+  } else if (inttable_issorted(t)) {
+    /* The next entry moves into this slot, so the iterator backs up. */
+    inttable_rmsorted(t, i - t->array_size, NULL);
+    *iter = i - 1;
   } else {
-    upb_tabent* ent = &t->t.entries[i - t->array_size];
-    upb_tabent* prev = NULL;
-
-    // Linear search, not great.
-    upb_tabent* end = &t->t.entries[upb_table_size(&t->t)];
-    for (upb_tabent* e = t->t.entries; e != end; e++) {
-      if (e->next == ent) {
-        prev = e;
-        break;
-      }
-    }
-
-    if (prev) {
-      prev->next = ent->next;
-    }
-
-    t->t.count--;
-    ent->key = 0;
-    ent->next = NULL;
+    rmslot(&t->t, i - t->array_size);
   }
 }
 
@@ -848,29 +1102,392 @@ bool upb_strtable_next2(const upb_strtable* t, upb_StringView* key,
 }
 
 void upb_strtable_removeiter(upb_strtable* t, intptr_t* iter) {
-  intptr_t i = *iter;
-  upb_tabent* ent = &t->t.entries[i];
-  upb_tabent* prev = NULL;
-
-  // Linear search, not great.
-  upb_tabent* end = &t->t.entries[upb_table_size(&t->t)];
-  for (upb_tabent* e = t->t.entries; e != end; e++) {
-    if (e->next == ent) {
-      prev = e;
-      break;
+  rmslot(&t->t, *iter);
+}
+
+void upb_strtable_setentryvalue(upb_strtable* t, intptr_t iter, upb_value v) {
+  upb_tabent* ent = &t->t.entries[iter];
+  ent->val.val = v.val;
+}
+
+/* upb_frozentable ************************************************************/
+
+/* Built by "hash, displace, and compress" (Belazzougui et al.): keys are
+ * grouped into buckets of a few keys by their hash, and the buckets are
+ * placed largest first, each trying displacements until all of its keys land
+ * in free slots.  Most buckets succeed within a few tries; only the last few
+ * single-key buckets need to search for the remaining free slots. */
+
+#define UPB_FROZEN_KEYSPERBUCKET 4
+#define UPB_FROZEN_MAXBUCKETSIZE 64
+
+static uint32_t frozen_bucket(uint32_t hash, uint32_t bucket_count) {
+  return (uint32_t)(((uint64_t)hash * bucket_count) >> 32);
+}
+
+static uint32_t frozen_slot(uint32_t hash, uint32_t disp, uint32_t count) {
+  uint32_t h = hash ^ (disp * 0x9e3779b9U);
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16;
+  return (uint32_t)(((uint64_t)h * count) >> 32);
+}
+
+static uint32_t frozen_hash(upb_tabkey key, bool is_str, uint32_t seed) {
+  if (!is_str) return inthash_seeded(key, seed);
+  uint32_t len;
+  char* str = upb_tabstr(key, &len);
+  return _upb_Hash(str, len, seed);
+}
+
+/* Assigns each bucket a displacement and each key its slot.  Returns false
+ * if some bucket cannot be placed, for example because two of its keys have
+ * the same hash. */
+static bool frozen_place(const uint32_t* hashes, uint32_t n, uint32_t nb,
+                         uint32_t* disp, uint32_t* slots) {
+  size_t tmp_size = (2 * (size_t)nb + 1 + n) * sizeof(uint32_t) + n;
+  uint32_t* start = upb_gmalloc(tmp_size);  // Index in `order` of each bucket.
+  if (!start) return false;
+  uint32_t* cursor = start + nb + 1;
+  uint32_t* order = cursor + nb;  // Keys, grouped by bucket.
+  uint8_t* taken = (uint8_t*)(order + n);
+  uint32_t max_size = 0;
+  bool ok = true;
+
+  memset(start, 0, (nb + 1) * sizeof(*start));
+  for (uint32_t i = 0; i < n; i++) {
+    start[frozen_bucket(hashes[i], nb) + 1]++;
+  }
+  for (uint32_t b = 0; b < nb; b++) {
+    max_size = UPB_MAX(max_size, start[b + 1]);
+    start[b + 1] += start[b];
+    cursor[b] = start[b];
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    order[cursor[frozen_bucket(hashes[i], nb)]++] = i;
+  }
+  memset(taken, 0, n);
+  if (max_size > UPB_FROZEN_MAXBUCKETSIZE) ok = false;
+
+  for (uint32_t size = max_size; ok && size > 0; size--) {
+    for (uint32_t b = 0; ok && b < nb; b++) {
+      if (start[b + 1] - start[b] != size) continue;
+      const uint32_t* keys = &order[start[b]];
+      for (uint32_t j = 1; j < size; j++) {
+        for (uint32_t k = 0; k < j; k++) {
+          if (hashes[keys[j]] == hashes[keys[k]]) ok = false;
+        }
+      }
+
+      uint32_t d;
+      for (d = 0; ok; d++) {
+        uint32_t j;
+        for (j = 0; j < size; j++) {
+          uint32_t slot = frozen_slot(hashes[keys[j]], d, n);
+          if (taken[slot]) break;
+          taken[slot] = 1;
+          slots[keys[j]] = slot;
+        }
+        if (j == size) break;
+        while (j--) taken[slots[keys[j]]] = 0;
+        /* Each try succeeds with probability at least 1/n. */
+        if (d == UINT32_MAX / 2 || d / 64 > n) ok = false;
+      }
+      disp[b] = d;
     }
   }
 
-  if (prev) {
-    prev->next = ent->next;
+  upb_gfree(start);
+  return ok;
+}
+
+/* Builds |t| from the |n| entries in |ents|. */
+static bool frozen_build(upb_frozentable* t, const upb_tabent* ents, size_t n,
+                         bool is_str, upb_Arena* a) {
+  if (n > UINT32_MAX / 2) return false;
+  if (n == 0) {
+    memset(t, 0, sizeof(*t));
+    return true;
   }
 
-  t->t.count--;
-  ent->key = 0;
-  ent->next = NULL;
+  const uint32_t count = n;
+  const uint32_t nb = count / UPB_FROZEN_KEYSPERBUCKET + 1;
+  uint32_t* hashes = upb_gmalloc((2 * (size_t)count + nb) * sizeof(uint32_t));
+  if (!hashes) return false;
+  uint32_t* slots = hashes + count;
+  uint32_t* disp = slots + count;
+  bool ok = false;
+  uint32_t seed;
+
+  /* A new seed is only needed if two keys have the same 32-bit hash. */
+  for (seed = 0; !ok && seed < 4; seed++) {
+    for (uint32_t i = 0; i < count; i++) {
+      hashes[i] = frozen_hash(ents[i].key, is_str, seed);
+    }
+    ok = frozen_place(hashes, count, nb, disp, slots);
+  }
+
+  const size_t entries_size = count * sizeof(upb_tabent);
+  upb_tabent* entries =
+      ok ? upb_Arena_Malloc(a, entries_size + nb * sizeof(*disp)) : NULL;
+  if (entries) {
+    uint32_t* frozen_disp = (uint32_t*)((char*)entries + entries_size);
+    for (uint32_t i = 0; i < count; i++) entries[slots[i]] = ents[i];
+    memcpy(frozen_disp, disp, nb * sizeof(*disp));
+    t->entries = entries;
+    t->disp = frozen_disp;
+    t->count = count;
+    t->bucket_count = nb;
+    t->seed = seed - 1;
+  }
+
+  upb_gfree(hashes);
+  return entries != NULL;
 }
 
-void upb_strtable_setentryvalue(upb_strtable* t, intptr_t iter, upb_value v) {
-  upb_tabent* ent = &t->t.entries[iter];
-  ent->val.val = v.val;
+bool upb_frozentable_initstr(upb_frozentable* t, const upb_strtable* src,
+                             upb_Arena* a) {
+  size_t n = upb_strtable_count(src);
+  upb_tabent* ents = upb_gmalloc(UPB_MAX(n, 1) * sizeof(*ents));
+  if (!ents) return false;
+  size_t i = 0;
+  for (size_t j = begin(&src->t); j < upb_table_size(&src->t);
+       j = next(&src->t, j)) {
+    ents[i++] = src->t.entries[j];
+  }
+  UPB_ASSERT(i == n);
+  bool ok = frozen_build(t, ents, n, true, a);
+  upb_gfree(ents);
+  return ok;
+}
+
+bool upb_frozentable_initint(upb_frozentable* t, const upb_inttable* src,
+                             upb_Arena* a) {
+  size_t n = upb_inttable_count(src);
+  upb_tabent* ents = upb_gmalloc(UPB_MAX(n, 1) * sizeof(*ents));
+  if (!ents) return false;
+  intptr_t iter = UPB_INTTABLE_BEGIN;
+  uintptr_t key;
+  upb_value val;
+  size_t i = 0;
+  while (upb_inttable_next(src, &key, &val, &iter)) {
+    ents[i].key = key;
+    ents[i].val.val = val.val;
+    i++;
+  }
+  UPB_ASSERT(i == n);
+  bool ok = frozen_build(t, ents, n, false, a);
+  upb_gfree(ents);
+  return ok;
+}
+
+UPB_FORCEINLINE
+static const upb_tabent* frozen_entry(const upb_frozentable* t,
+                                      uint32_t hash) {
+  uint32_t disp = t->disp[frozen_bucket(hash, t->bucket_count)];
+  return &t->entries[frozen_slot(hash, disp, t->count)];
+}
+
+bool upb_frozentable_lookupstr(const upb_frozentable* t, const char* key,
+                               size_t len, upb_value* v) {
+  if (t->count == 0) return false;
+  const upb_tabent* e = frozen_entry(t, _upb_Hash(key, len, t->seed));
+  if (!streql(e->key, strkey2(key, len))) return false;
+  if (v) _upb_value_setval(v, e->val.val);
+  return true;
+}
+
+bool upb_frozentable_lookupint(const upb_frozentable* t, uintptr_t key,
+                               upb_value* v) {
+  if (t->count == 0) return false;
+  const upb_tabent* e = frozen_entry(t, inthash_seeded(key, t->seed));
+  if (e->key != key) return false;
+  if (v) _upb_value_setval(v, e->val.val);
+  return true;
+}
+
+bool upb_frozentable_nextint(const upb_frozentable* t, uintptr_t* key,
+                             upb_value* val, intptr_t* iter) {
+  size_t i = *iter + 1;
+  if (i >= t->count) return false;
+  *key = t->entries[i].key;
+  *val = _upb_value_val(t->entries[i].val.val);
+  *iter = i;
+  return true;
+}
+
+/* upb_concurrenttable ********************************************************/
+
+/* Open addressing with linear probing.  A slot goes from empty (key 0) to
+ * full exactly once, and it is never emptied, so a reader that reaches an
+ * empty slot knows the key was not in the table when it started probing. */
+
+typedef struct {
+  UPB_ATOMIC(uintptr_t) key;  // The key, or a pointer to its string.
+  size_t len;                 // Length of a string key.
+  upb_tabval val;
+} concurrent_ent;
+
+struct upb_concurrentarray {
+  size_t mask;
+  concurrent_ent entries[];
+};
+
+struct upb_concurrenttable {
+  UPB_ATOMIC(upb_concurrentarray*) array;
+  upb_Arena* arena;
+  size_t count;  // Only accessed by the writer.
+  bool str_keys;
+};
+
+static uint32_t concurrent_hash(const upb_concurrenttable* t, uintptr_t key,
+                                size_t len) {
+  return t->str_keys ? _upb_Hash((const char*)key, len, 0)
+                     : inthash_seeded(key, 0);
+}
+
+static upb_concurrentarray* concurrent_newarray(upb_Arena* a, size_t size) {
+  upb_concurrentarray* arr =
+      upb_Arena_Malloc(a, sizeof(*arr) + size * sizeof(concurrent_ent));
+  if (!arr) return NULL;
+  arr->mask = size - 1;
+  for (size_t i = 0; i < size; i++) upb_Atomic_Init(&arr->entries[i].key, 0);
+  return arr;
+}
+
+static concurrent_ent* concurrent_findempty(upb_concurrentarray* arr,
+                                            uint32_t hash) {
+  size_t i = hash & arr->mask;
+  while (upb_Atomic_Load(&arr->entries[i].key, memory_order_relaxed)) {
+    i = (i + 1) & arr->mask;
+  }
+  return &arr->entries[i];
+}
+
+upb_concurrenttable* upb_concurrenttable_new(upb_Arena* a, bool str_keys) {
+  upb_concurrenttable* t = upb_Arena_Malloc(a, sizeof(*t));
+  upb_concurrentarray* arr = concurrent_newarray(a, 8);
+  if (!t || !arr) return NULL;
+  upb_Atomic_Init(&t->array, arr);
+  t->arena = a;
+  t->count = 0;
+  t->str_keys = str_keys;
+  return t;
+}
+
+size_t upb_concurrenttable_count(const upb_concurrenttable* t) {
+  return t->count;
+}
+
+bool upb_concurrenttable_reserve(upb_concurrenttable* t, size_t n) {
+  upb_concurrentarray* arr = upb_Atomic_Load(&t->array, memory_order_relaxed);
+  size_t size = arr->mask + 1;
+  if (n > SIZE_MAX / 8 - t->count) return false;
+  if (t->count + n <= size - size / 4) return true;
+
+  // Keep the table at most 3/4 full.
+  size_t new_size = size * 2;
+  while (t->count + n > new_size - new_size / 4) new_size *= 2;
+  if (new_size > (SIZE_MAX - sizeof(*arr)) / sizeof(concurrent_ent)) {
+    return false;
+  }
+  upb_concurrentarray* bigger = concurrent_newarray(t->arena, new_size);
+  if (!bigger) return false;
+  for (size_t i = 0; i < size; i++) {
+    const concurrent_ent* e = &arr->entries[i];
+    uintptr_t key = upb_Atomic_Load(&e->key, memory_order_relaxed);
+    if (!key) continue;
+    concurrent_ent* dst =
+        concurrent_findempty(bigger, concurrent_hash(t, key, e->len));
+    dst->len = e->len;
+    dst->val = e->val;
+    upb_Atomic_Init(&dst->key, key);
+  }
+  upb_Atomic_Store(&t->array, bigger, memory_order_release);
+  return true;
+}
+
+static bool concurrent_insert(upb_concurrenttable* t, uintptr_t key,
+                              size_t len, upb_value val) {
+  if (!upb_concurrenttable_reserve(t, 1)) return false;
+  concurrent_ent* e =
+      concurrent_findempty(upb_Atomic_Load(&t->array, memory_order_relaxed),
+                           concurrent_hash(t, key, len));
+  e->len = len;
+  e->val.val = val.val;
+  upb_Atomic_Store(&e->key, key, memory_order_release);
+  t->count++;
+  return true;
+}
+
+bool upb_concurrenttable_insertstr(upb_concurrenttable* t, const char* key,
+                                   size_t len, upb_value val) {
+  UPB_ASSERT(t->str_keys);
+  UPB_ASSERT(!upb_concurrenttable_lookupstr(t, key, len, NULL));
+  return concurrent_insert(t, (uintptr_t)key, len, val);
+}
+
+bool upb_concurrenttable_insertint(upb_concurrenttable* t, uintptr_t key,
+                                   upb_value val) {
+  UPB_ASSERT(!t->str_keys && key != 0);
+  UPB_ASSERT(!upb_concurrenttable_lookupint(t, key, NULL));
+  return concurrent_insert(t, key, 0, val);
+}
+
+UPB_FORCEINLINE
+static const concurrent_ent* concurrent_lookup(const upb_concurrenttable* t,
+                                               lookupkey_t key, uint32_t hash,
+                                               bool str_key) {
+  const upb_concurrentarray* arr =
+      upb_Atomic_Load(&t->array, memory_order_acquire);
+  for (size_t i = hash & arr->mask;; i = (i + 1) & arr->mask) {
+    const concurrent_ent* e = &arr->entries[i];
+    uintptr_t k = upb_Atomic_Load(&e->key, memory_order_acquire);
+    if (!k) return NULL;
+    if (str_key ? e->len == key.str.len &&
+                      memcmp((const char*)k, key.str.str, e->len) == 0
+                : k == key.num) {
+      return e;
+    }
+  }
+}
+
+bool upb_concurrenttable_lookupstr(const upb_concurrenttable* t,
+                                   const char* key, size_t len, upb_value* v) {
+  const concurrent_ent* e =
+      concurrent_lookup(t, strkey2(key, len), _upb_Hash(key, len, 0), true);
+  if (!e) return false;
+  if (v) _upb_value_setval(v, e->val.val);
+  return true;
+}
+
+bool upb_concurrenttable_lookupint(const upb_concurrenttable* t, uintptr_t key,
+                                   upb_value* v) {
+  const concurrent_ent* e =
+      concurrent_lookup(t, intkey(key), inthash_seeded(key, 0), false);
+  if (!e) return false;
+  if (v) _upb_value_setval(v, e->val.val);
+  return true;
+}
+
+const upb_concurrentarray* upb_concurrenttable_snapshot(
+    const upb_concurrenttable* t) {
+  return upb_Atomic_Load(&t->array, memory_order_acquire);
+}
+
+bool upb_concurrenttable_nextint(const upb_concurrentarray* snap,
+                                 uintptr_t* key, upb_value* val,
+                                 intptr_t* iter) {
+  for (size_t i = *iter + 1; i <= snap->mask; i++) {
+    const concurrent_ent* e = &snap->entries[i];
+    uintptr_t k = upb_Atomic_Load(&e->key, memory_order_acquire);
+    if (!k) continue;
+    *key = k;
+    *val = _upb_value_val(e->val.val);
+    *iter = i;
+    return true;
+  }
+  return false;
 }
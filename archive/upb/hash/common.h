@@ -35,9 +35,12 @@
  * This file defines very fast int->upb_value (inttable) and string->upb_value
  * (strtable) hash tables.
  *
- * The table uses chained scatter with Brent's variation (inspired by the Lua
- * implementation of hash tables).  The hash function for strings is Austin
- * Appleby's "MurmurHash."
+ * The hash part is an open-addressing table in the style of Abseil's
+ * SwissTable: next to the entries is an array of control bytes, one per entry,
+ * holding 7 bits of the entry's hash (or a marker for an empty or deleted
+ * slot).  Lookups probe a group of control bytes at a time (with SSE2 or NEON
+ * where available) and only compare keys whose hash bits match.  The hash
+ * function for strings is wyhash.
  *
  * The inttable uses uintptr_t as its key, which guarantees it can be used to
  * store pointers or integers of at least 32 bits (upb isn't really useful on
@@ -168,20 +171,17 @@ typedef struct upb_tabval {
 typedef struct _upb_tabent {
   upb_tabkey key;
   upb_tabval val;
-
-  /* Internal chaining.  This is const so we can create static initializers for
-   * tables.  We cast away const sometimes, but *only* when the containing
-   * upb_table is known to be non-const.  This requires a bit of care, but
-   * the subtlety is confined to table.c. */
-  const struct _upb_tabent* next;
 } upb_tabent;
 
 typedef struct {
   size_t count;       /* Number of entries in the hash part. */
   uint32_t mask;      /* Mask to turn hash value -> bucket. */
-  uint32_t max_count; /* Max count before we hit our load limit. */
+  uint32_t max_count; /* Max count before we hit our load limit, less one for
+                         each deleted slot that has not been reused. */
   uint8_t size_lg2;   /* Size of the hashtable part is 2^size_lg2 entries. */
   upb_tabent* entries;
+  uint8_t* ctrl;      /* One control byte per entry, then padding up to a
+                         whole group. */
 } upb_table;
 
 UPB_INLINE size_t upb_table_size(const upb_table* t) {
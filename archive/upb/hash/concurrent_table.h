@@ -0,0 +1,106 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#ifndef UPB_HASH_CONCURRENT_TABLE_H_
+#define UPB_HASH_CONCURRENT_TABLE_H_
+
+#include "upb/hash/int_table.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// A hash table that one thread can insert into while any number of other
+// threads look up keys, without any locking.  Keys can be neither removed nor
+// replaced.
+//
+// Readers load the current array of entries with an acquire, and an entry's
+// key is stored with a release after its value, so a reader that finds a key
+// also sees its value and anything the writer did before inserting it.  When
+// the table grows, the writer fills a new array and then publishes it; arrays
+// that readers may still be using are never freed, but stay in the arena
+// until it is freed.
+//
+// Inserts must not run concurrently with each other.  Without C11 atomics
+// (see UPB_USE_C11_ATOMICS) the table is only safe to use from one thread.
+typedef struct upb_concurrenttable upb_concurrenttable;
+typedef struct upb_concurrentarray upb_concurrentarray;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates a table whose keys are either strings or nonzero integers.  The table's
+// arrays are allocated from |a|.  Returns NULL if memory
+// allocation failed.
+upb_concurrenttable* upb_concurrenttable_new(upb_Arena* a, bool str_keys);
+
+// The number of keys inserted so far.  Only the writer may call this.
+size_t upb_concurrenttable_count(const upb_concurrenttable* t);
+
+// Makes room for |n| more keys, so that inserting them cannot fail.
+bool upb_concurrenttable_reserve(upb_concurrenttable* t, size_t n);
+
+// Inserts a key that is not yet in the table.  String keys are not copied: |key|
+// must not be NULL, and must outlive the table.  Returns false if memory allocation failed, in which
+// case the table is unchanged.
+bool upb_concurrenttable_insertstr(upb_concurrenttable* t, const char* key,
+                                   size_t len, upb_value val);
+bool upb_concurrenttable_insertint(upb_concurrenttable* t, uintptr_t key,
+                                   upb_value val);
+
+// Looks up key in this table, returning "true" if the key was found.
+// If v is non-NULL, copies the value for this key into *v.
+bool upb_concurrenttable_lookupstr(const upb_concurrenttable* t,
+                                   const char* key, size_t len, upb_value* v);
+bool upb_concurrenttable_lookupint(const upb_concurrenttable* t, uintptr_t key,
+                                   upb_value* v);
+
+// Iteration over the integer keys present in one snapshot of the table, in no
+// particular order.  Keys inserted while iterating may or may not be seen,
+// but no key is seen twice:
+//
+//   const upb_concurrentarray* snap = upb_concurrenttable_snapshot(t);
+//   intptr_t iter = UPB_INTTABLE_BEGIN;
+//   uintptr_t key;
+//   upb_value val;
+//   while (upb_concurrenttable_nextint(snap, &key, &val, &iter)) {
+//      // ...
+//   }
+const upb_concurrentarray* upb_concurrenttable_snapshot(
+    const upb_concurrenttable* t);
+bool upb_concurrenttable_nextint(const upb_concurrentarray* snap,
+                                 uintptr_t* key, upb_value* val,
+                                 intptr_t* iter);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_HASH_CONCURRENT_TABLE_H_ */
@@ -0,0 +1,95 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_HASH_FROZEN_TABLE_H_
+#define UPB_HASH_FROZEN_TABLE_H_
+
+#include "upb/hash/int_table.h"
+#include "upb/hash/str_table.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// A read-only copy of a upb_strtable or upb_inttable, indexed by a minimal
+// perfect hash: each key's hash picks a bucket, and the bucket's
+// displacement turns the hash into the key's own slot.  A lookup hashes the
+// key once and compares it with exactly one entry, without probing.
+//
+// The entries and displacements are in one allocation.  The keys of a string
+// table are shared with the table it was built from, which must outlive it.
+typedef struct {
+  const upb_tabent* entries;  // `count` entries, one at each key's slot.
+  const uint32_t* disp;       // Displacement of each bucket.
+  uint32_t count;
+  uint32_t bucket_count;
+  uint32_t seed;
+} upb_frozentable;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Builds a frozen copy of |src|.  Returns false if memory allocation failed,
+// or (very rarely) if no perfect hash was found, and leaves |t| unchanged.
+bool upb_frozentable_initstr(upb_frozentable* t, const upb_strtable* src,
+                             upb_Arena* a);
+bool upb_frozentable_initint(upb_frozentable* t, const upb_inttable* src,
+                             upb_Arena* a);
+
+UPB_INLINE size_t upb_frozentable_count(const upb_frozentable* t) {
+  return t->count;
+}
+
+// Looks up key in this table, returning "true" if the key was found.
+// If v is non-NULL, copies the value for this key into *v.
+bool upb_frozentable_lookupstr(const upb_frozentable* t, const char* key,
+                               size_t len, upb_value* v);
+bool upb_frozentable_lookupint(const upb_frozentable* t, uintptr_t key,
+                               upb_value* v);
+
+// Iteration over a table built by upb_frozentable_initint(), in no
+// particular order:
+//
+//   intptr_t iter = UPB_INTTABLE_BEGIN;
+//   uintptr_t key;
+//   upb_value val;
+//   while (upb_frozentable_nextint(t, &key, &val, &iter)) {
+//      // ...
+//   }
+bool upb_frozentable_nextint(const upb_frozentable* t, uintptr_t* key,
+                             upb_value* val, intptr_t* iter);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_HASH_FROZEN_TABLE_H_ */
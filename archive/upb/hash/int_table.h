@@ -79,6 +79,8 @@ bool upb_inttable_replace(upb_inttable* t, uintptr_t key, upb_value val);
 // Optimizes the table for the current set of entries, for both memory use and
 // lookup time. Client should call this after all entries have been inserted;
 // inserting more entries is legal, but will likely require a table resize.
+// If only a few keys are too sparse for the array part, they are stored
+// sorted and found by binary search instead of hashing.
 void upb_inttable_compact(upb_inttable* t, upb_Arena* a);
 
 // Iteration over inttable:
@@ -88,6 +88,30 @@ UPB_INLINE bool upb_strtable_remove(upb_strtable* t, const char* key,
 // Exposed for testing only.
 bool upb_strtable_resize(upb_strtable* t, size_t size_lg2, upb_Arena* a);
 
+// Resizes the table if needed so that it holds `size` values before it has to
+// grow again.  Returns false if memory allocation failed, in which case the
+// table is unchanged.
+bool upb_strtable_reserve(upb_strtable* t, size_t size, upb_Arena* a);
+
+// Returns the arena space held by the table: its slots and its copies of the
+// keys.  Space left behind by earlier resizes is not included.
+size_t upb_strtable_spaceused(const upb_strtable* t);
+
+// Batched lookup: hashing every key and prefetching its slot before probing
+// any of them lets the cache misses of independent lookups overlap.  A hash
+// from upb_strtable_hash() is only valid until the table is next resized.
+uint32_t upb_strtable_hash(const upb_strtable* t, const char* key, size_t len);
+void upb_strtable_prefetch(const upb_strtable* t, uint32_t hash);
+
+// Like upb_strtable_lookup2(), with the hash of the key given.
+bool upb_strtable_lookuphash(const upb_strtable* t, const char* key,
+                             size_t len, uint32_t hash, upb_value* v);
+
+// Returns the entry for the key, or NULL if it is not in the table.  The entry
+// holds the table's own copy of the key.
+const upb_tabent* upb_strtable_lookupentry(const upb_strtable* t,
+                                           const char* key, size_t len);
+
 /* Iteration over strtable:
  *
  *   intptr_t iter = UPB_STRTABLE_BEGIN;
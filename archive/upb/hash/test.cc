@@ -33,14 +33,18 @@
 #include <limits.h>
 #include <string.h>
 
+#include <atomic>
 #include <iostream>
 #include <map>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/container/flat_hash_map.h"
+#include "upb/hash/concurrent_table.h"
+#include "upb/hash/frozen_table.h"
 #include "upb/hash/int_table.h"
 #include "upb/hash/str_table.h"
 #include "upb/mem/arena.hpp"
@@ -252,6 +256,190 @@ TEST(Table, Delete) {
   }
 }
 
+TEST(Table, CompactSorted) {
+  // A few sparse keys are kept sorted after compaction.
+  upb::Arena arena;
+  upb_inttable t;
+  upb_inttable_init(&t, arena.ptr());
+  std::vector<uintptr_t> keys;
+  for (uintptr_t i = 1; i <= 8; i++) keys.push_back(i);
+  for (uintptr_t i = 8; i >= 1; i--) keys.push_back(i * 1000 + 7);
+  for (uintptr_t key : keys) {
+    ASSERT_TRUE(upb_inttable_insert(&t, key, upb_value_uint32(key * 2),
+                                    arena.ptr()));
+  }
+  upb_inttable_compact(&t, arena.ptr());
+  EXPECT_EQ(0, t.t.size_lg2);
+  EXPECT_EQ(8, t.t.count);
+
+  for (uintptr_t key = 0; key <= 9000; key++) {
+    upb_value val;
+    bool expected = key <= 8 ? key > 0 : key % 1000 == 7;
+    ASSERT_EQ(expected, upb_inttable_lookup(&t, key, &val)) << key;
+    if (expected) EXPECT_EQ(key * 2, upb_value_getuint32(val));
+  }
+  EXPECT_TRUE(upb_inttable_replace(&t, 5007, upb_value_uint32(1)));
+  EXPECT_FALSE(upb_inttable_replace(&t, 5008, upb_value_uint32(1)));
+
+  // Iteration visits the sorted keys in order, and removing through the
+  // iterator does not skip any of them.
+  intptr_t iter = UPB_INTTABLE_BEGIN;
+  uintptr_t key, prev = 0;
+  upb_value val;
+  size_t seen = 0;
+  while (upb_inttable_next(&t, &key, &val, &iter)) {
+    EXPECT_GT(key, prev);
+    prev = key;
+    seen++;
+    if (key > 8 && (key / 1000) % 2) upb_inttable_removeiter(&t, &iter);
+  }
+  EXPECT_EQ(keys.size(), seen);
+  EXPECT_EQ(12, upb_inttable_count(&t));
+  EXPECT_FALSE(upb_inttable_lookup(&t, 5007, nullptr));
+  EXPECT_TRUE(upb_inttable_lookup(&t, 6007, nullptr));
+
+  // Inserting turns the sorted keys back into a hash table.
+  ASSERT_TRUE(upb_inttable_insert(&t, 5007, upb_value_uint32(3), arena.ptr()));
+  EXPECT_NE(0, t.t.size_lg2);
+  EXPECT_EQ(13, upb_inttable_count(&t));
+  for (uintptr_t i = 1; i <= 8; i++) {
+    bool expected = i % 2 == 0 || i == 5;
+    EXPECT_EQ(expected, upb_inttable_lookup(&t, i * 1000 + 7, nullptr)) << i;
+  }
+  EXPECT_TRUE(upb_inttable_remove(&t, 6007, &val));
+  EXPECT_EQ(12014, upb_value_getuint32(val));
+}
+
+TEST(Table, FrozenStringTable) {
+  upb::Arena arena;
+  upb_strtable src;
+  upb_strtable_init(&src, 4, arena.ptr());
+  upb_frozentable t;
+  ASSERT_TRUE(upb_frozentable_initstr(&t, &src, arena.ptr()));
+  EXPECT_EQ(0, upb_frozentable_count(&t));
+  EXPECT_FALSE(upb_frozentable_lookupstr(&t, "", 0, nullptr));
+
+  std::vector<std::string> keys = {"", "a", "google.protobuf.FieldDescriptor"};
+  for (int i = 0; i < 2000; i++) keys.push_back("pkg.Msg" + std::to_string(i));
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(upb_strtable_insert(&src, keys[i].data(), keys[i].size(),
+                                    upb_value_int32(i), arena.ptr()));
+  }
+  ASSERT_TRUE(upb_frozentable_initstr(&t, &src, arena.ptr()));
+  EXPECT_EQ(keys.size(), upb_frozentable_count(&t));
+  for (size_t i = 0; i < keys.size(); i++) {
+    upb_value val;
+    ASSERT_TRUE(upb_frozentable_lookupstr(&t, keys[i].data(), keys[i].size(),
+                                          &val))
+        << keys[i];
+    EXPECT_EQ(i, upb_value_getint32(val));
+  }
+  for (int i = 2000; i < 4000; i++) {
+    std::string miss = "pkg.Msg" + std::to_string(i);
+    EXPECT_FALSE(
+        upb_frozentable_lookupstr(&t, miss.data(), miss.size(), nullptr));
+  }
+  EXPECT_FALSE(upb_frozentable_lookupstr(&t, "pkg.Msg1", 7, nullptr));
+}
+
+TEST(Table, FrozenIntTable) {
+  upb::Arena arena;
+  upb_inttable src;
+  upb_inttable_init(&src, arena.ptr());
+  std::set<uintptr_t> keys;
+  for (uintptr_t i = 0; i < 1000; i++) keys.insert(i * 0x10000 + 0x1230);
+  for (uintptr_t i = 0; i < 10; i++) keys.insert(i);
+  for (uintptr_t key : keys) {
+    ASSERT_TRUE(upb_inttable_insert(&src, key, upb_value_uint32(~key & 0xff),
+                                    arena.ptr()));
+  }
+  upb_frozentable t;
+  ASSERT_TRUE(upb_frozentable_initint(&t, &src, arena.ptr()));
+  EXPECT_EQ(keys.size(), upb_frozentable_count(&t));
+  for (uintptr_t key : keys) {
+    upb_value val;
+    ASSERT_TRUE(upb_frozentable_lookupint(&t, key, &val)) << key;
+    EXPECT_EQ(~key & 0xff, upb_value_getuint32(val));
+    EXPECT_FALSE(upb_frozentable_lookupint(&t, key + 0x10, nullptr));
+  }
+
+  std::set<uintptr_t> seen;
+  intptr_t iter = UPB_INTTABLE_BEGIN;
+  uintptr_t key;
+  upb_value val;
+  while (upb_frozentable_nextint(&t, &key, &val, &iter)) {
+    EXPECT_TRUE(seen.insert(key).second);
+    EXPECT_EQ(~key & 0xff, upb_value_getuint32(val));
+  }
+  EXPECT_EQ(keys, seen);
+}
+
+TEST(Table, ConcurrentStringTable) {
+  upb::Arena arena;
+  upb_concurrenttable* t = upb_concurrenttable_new(arena.ptr(), true);
+  ASSERT_NE(nullptr, t);
+  EXPECT_FALSE(upb_concurrenttable_lookupstr(t, "", 0, nullptr));
+
+  std::vector<std::string> keys = {"", "a", "google.protobuf.FieldDescriptor"};
+  for (int i = 0; i < 1000; i++) keys.push_back("pkg.Msg" + std::to_string(i));
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(upb_concurrenttable_insertstr(t, keys[i].data(), keys[i].size(),
+                                              upb_value_int32(i)));
+  }
+  EXPECT_EQ(keys.size(), upb_concurrenttable_count(t));
+  for (size_t i = 0; i < keys.size(); i++) {
+    upb_value val;
+    ASSERT_TRUE(upb_concurrenttable_lookupstr(t, keys[i].data(),
+                                              keys[i].size(), &val))
+        << keys[i];
+    EXPECT_EQ(i, upb_value_getint32(val));
+  }
+  EXPECT_FALSE(upb_concurrenttable_lookupstr(t, "pkg.Msg1000", 11, nullptr));
+  EXPECT_FALSE(upb_concurrenttable_lookupstr(t, "pkg.Msg1", 7, nullptr));
+}
+
+TEST(Table, ConcurrentIntTable) {
+  // One thread inserts keys in order while others look them up.
+  constexpr uintptr_t kKeys = 20000;
+  upb::Arena arena;
+  upb_concurrenttable* t = upb_concurrenttable_new(arena.ptr(), false);
+  ASSERT_NE(nullptr, t);
+  std::atomic<uintptr_t> inserted{0};
+  auto reader = [&] {
+    uintptr_t n;
+    while ((n = inserted.load(std::memory_order_acquire)) < kKeys) {
+      // Every key inserted before |n| was loaded is visible.
+      const uintptr_t step = n / 16 + 1;
+      for (uintptr_t key = n; key > 0; key = key > step ? key - step : 0) {
+        upb_value val;
+        ASSERT_TRUE(upb_concurrenttable_lookupint(t, key * 0x1000, &val))
+            << key;
+        EXPECT_EQ(key, upb_value_getuint64(val));
+      }
+    }
+  };
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) readers.emplace_back(reader);
+  for (uintptr_t key = 1; key <= kKeys; key++) {
+    ASSERT_TRUE(upb_concurrenttable_insertint(t, key * 0x1000,
+                                              upb_value_uint64(key)));
+    inserted.store(key, std::memory_order_release);
+  }
+  for (std::thread& r : readers) r.join();
+
+  EXPECT_FALSE(upb_concurrenttable_lookupint(t, 0x1001, nullptr));
+  std::set<uintptr_t> seen;
+  const upb_concurrentarray* snap = upb_concurrenttable_snapshot(t);
+  intptr_t iter = UPB_INTTABLE_BEGIN;
+  uintptr_t key;
+  upb_value val;
+  while (upb_concurrenttable_nextint(snap, &key, &val, &iter)) {
+    EXPECT_EQ(key, upb_value_getuint64(val) * 0x1000);
+    EXPECT_TRUE(seen.insert(key).second);
+  }
+  EXPECT_EQ(kKeys, seen.size());
+}
+
 TEST(Table, Init) {
   for (int i = 0; i < 2048; i++) {
     /* Tests that the size calculations in init() (lg2 size for target load)
@@ -261,3 +449,51 @@ TEST(Table, Init) {
     upb_strtable_init(&t, i, arena.ptr());
   }
 }
+
+TEST(Table, DeleteChurn) {
+  // Deleted slots are reclaimed by rehashing at the same size, so a table
+  // whose size stays bounded does not keep growing.
+  upb::Arena arena;
+  upb_strtable t;
+  upb_strtable_init(&t, 0, arena.ptr());
+  std::set<std::string> live;
+  for (int i = 0; i < 20000; i++) {
+    std::string key = std::to_string(i);
+    ASSERT_TRUE(upb_strtable_insert(&t, key.data(), key.size(),
+                                    upb_value_int32(i), arena.ptr()));
+    live.insert(key);
+    if (i >= 50) {
+      std::string old = std::to_string(i - 50);
+      upb_value val;
+      ASSERT_TRUE(upb_strtable_remove2(&t, old.data(), old.size(), &val));
+      EXPECT_EQ(i - 50, upb_value_getint32(val));
+      live.erase(old);
+    }
+  }
+  EXPECT_EQ(live.size(), upb_strtable_count(&t));
+  EXPECT_LE(t.t.size_lg2, 8);
+
+  for (const auto& key : live) {
+    upb_value val;
+    ASSERT_TRUE(upb_strtable_lookup2(&t, key.data(), key.size(), &val));
+    EXPECT_EQ(key, std::to_string(upb_value_getint32(val)));
+  }
+
+  // Removing through an iterator leaves the other entries reachable.
+  intptr_t iter = UPB_STRTABLE_BEGIN;
+  upb_StringView key;
+  upb_value val;
+  size_t removed = 0;
+  while (upb_strtable_next2(&t, &key, &val, &iter)) {
+    if (upb_value_getint32(val) % 2) {
+      upb_strtable_removeiter(&t, &iter);
+      live.erase(std::string(key.data, key.size));
+      removed++;
+    }
+  }
+  EXPECT_GT(removed, 0);
+  EXPECT_EQ(live.size(), upb_strtable_count(&t));
+  for (const auto& k : live) {
+    EXPECT_TRUE(upb_strtable_lookup2(&t, k.data(), k.size(), nullptr));
+  }
+}
@@ -0,0 +1,301 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// For write() and pthreads, which are not part of C99.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "upb/io/async_output_stream.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifndef _WIN32
+
+enum {
+  kUpb_AsyncOutputStream_DefaultBlockSize = 256 * 1024,
+  kUpb_AsyncOutputStream_DefaultBlockCount = 4,
+};
+
+typedef struct {
+  char* data;
+  size_t size;  // Bytes to write, set when the block is submitted.
+} upb_AsyncOutputStream_Block;
+
+typedef struct {
+  upb_ZeroCopyOutputStream base;
+
+  int fd;
+  upb_AsyncOutputStream_Block* blocks;
+  int block_count;
+  size_t block_size;
+
+  // Only touched by the caller's thread.
+  int current;      // The block being filled.
+  size_t position;  // Bytes filled in the current block.
+  size_t last_returned_size;
+  size_t submitted;  // Bytes in blocks already handed to the writer.
+
+  // Protected by |mu|.  Blocks [next_write, next_write + pending) wrap around
+  // the ring and are waiting to be written; |current| is never among them.
+  pthread_mutex_t mu;
+  pthread_cond_t work;   // Signaled when |pending| grows or |stop| is set.
+  pthread_cond_t space;  // Signaled when |pending| shrinks.
+  int next_write;
+  int pending;
+  int error;  // The errno of a failed write(); later blocks are discarded.
+  bool stop;
+
+  pthread_t thread;
+} upb_AsyncOutputStream;
+
+static int upb_AsyncOutputStream_WriteAll(int fd, const char* data,
+                                          size_t size) {
+  while (size) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    data += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static void* upb_AsyncOutputStream_Writer(void* arg) {
+  upb_AsyncOutputStream* s = arg;
+
+  pthread_mutex_lock(&s->mu);
+  while (true) {
+    while (!s->pending && !s->stop) pthread_cond_wait(&s->work, &s->mu);
+    if (!s->pending) break;
+
+    const upb_AsyncOutputStream_Block* b = &s->blocks[s->next_write];
+    if (!s->error) {
+      // The caller will not touch this block until we release it below.
+      pthread_mutex_unlock(&s->mu);
+      const int error = upb_AsyncOutputStream_WriteAll(s->fd, b->data, b->size);
+      pthread_mutex_lock(&s->mu);
+      if (!s->error) s->error = error;
+    }
+
+    s->next_write = (s->next_write + 1) % s->block_count;
+    s->pending--;
+    pthread_cond_signal(&s->space);
+  }
+  pthread_mutex_unlock(&s->mu);
+
+  return NULL;
+}
+
+// Hands the current block to the writer and waits until the next block in
+// the ring is free.  Returns false if a write has failed.
+static bool upb_AsyncOutputStream_Submit(upb_AsyncOutputStream* s,
+                                         upb_Status* status) {
+  pthread_mutex_lock(&s->mu);
+  if (s->position) {
+    s->blocks[s->current].size = s->position;
+    s->submitted += s->position;
+    s->position = 0;
+    s->current = (s->current + 1) % s->block_count;
+    s->pending++;
+    pthread_cond_signal(&s->work);
+  }
+  while (s->pending == s->block_count && !s->error) {
+    pthread_cond_wait(&s->space, &s->mu);
+  }
+  const int error = s->error;
+  pthread_mutex_unlock(&s->mu);
+
+  if (error) {
+    upb_Status_SetErrorFormat(status, "write() failed: %s", strerror(error));
+    return false;
+  }
+  return true;
+}
+
+static void* upb_AsyncOutputStream_Next(upb_ZeroCopyOutputStream* z,
+                                        size_t* count, upb_Status* status) {
+  upb_AsyncOutputStream* s = (upb_AsyncOutputStream*)z;
+
+  if (s->position == s->block_size &&
+      !upb_AsyncOutputStream_Submit(s, status)) {
+    s->last_returned_size = 0;
+    *count = 0;
+    return NULL;
+  }
+
+  char* out = s->blocks[s->current].data + s->position;
+  const size_t chunk = s->block_size - s->position;
+  s->position = s->block_size;
+  s->last_returned_size = chunk;
+  *count = chunk;
+
+  return out;
+}
+
+static void upb_AsyncOutputStream_BackUp(upb_ZeroCopyOutputStream* z,
+                                         size_t count) {
+  upb_AsyncOutputStream* s = (upb_AsyncOutputStream*)z;
+
+  UPB_ASSERT(s->last_returned_size >= count);
+  s->position -= count;
+  s->last_returned_size -= count;
+}
+
+static size_t upb_AsyncOutputStream_ByteCount(
+    const upb_ZeroCopyOutputStream* z) {
+  const upb_AsyncOutputStream* s = (const upb_AsyncOutputStream*)z;
+
+  return s->submitted + s->position;
+}
+
+static const _upb_ZeroCopyOutputStream_VTable upb_AsyncOutputStream_vtable = {
+    upb_AsyncOutputStream_Next,
+    upb_AsyncOutputStream_BackUp,
+    upb_AsyncOutputStream_ByteCount,
+};
+
+upb_ZeroCopyOutputStream* upb_AsyncOutputStream_New(int fd, size_t block_size,
+                                                    int block_count,
+                                                    upb_Arena* arena) {
+  if (!block_size) block_size = kUpb_AsyncOutputStream_DefaultBlockSize;
+  if (!block_count) block_count = kUpb_AsyncOutputStream_DefaultBlockCount;
+  if (block_count < 2) return NULL;
+
+  upb_AsyncOutputStream* s = upb_Arena_Malloc(arena, sizeof(*s));
+  if (!s) return NULL;
+
+  s->blocks = upb_Arena_Malloc(arena, block_count * sizeof(*s->blocks));
+  if (!s->blocks) return NULL;
+  for (int i = 0; i < block_count; i++) {
+    s->blocks[i].data = upb_Arena_Malloc(arena, block_size);
+    if (!s->blocks[i].data) return NULL;
+    s->blocks[i].size = 0;
+  }
+
+  s->base.vtable = &upb_AsyncOutputStream_vtable;
+  s->fd = fd;
+  s->block_count = block_count;
+  s->block_size = block_size;
+  s->current = 0;
+  s->position = 0;
+  s->last_returned_size = 0;
+  s->submitted = 0;
+  s->next_write = 0;
+  s->pending = 0;
+  s->error = 0;
+  s->stop = false;
+
+  if (pthread_mutex_init(&s->mu, NULL) != 0) return NULL;
+  if (pthread_cond_init(&s->work, NULL) != 0) goto err_mu;
+  if (pthread_cond_init(&s->space, NULL) != 0) goto err_work;
+  if (pthread_create(&s->thread, NULL, upb_AsyncOutputStream_Writer, s) != 0) {
+    goto err_space;
+  }
+
+  return (upb_ZeroCopyOutputStream*)s;
+
+err_space:
+  pthread_cond_destroy(&s->space);
+err_work:
+  pthread_cond_destroy(&s->work);
+err_mu:
+  pthread_mutex_destroy(&s->mu);
+  return NULL;
+}
+
+bool upb_AsyncOutputStream_Flush(upb_ZeroCopyOutputStream* z,
+                                 upb_Status* status) {
+  upb_AsyncOutputStream* s = (upb_AsyncOutputStream*)z;
+
+  s->last_returned_size = 0;  // Don't let caller back up.
+  if (!upb_AsyncOutputStream_Submit(s, status)) return false;
+
+  pthread_mutex_lock(&s->mu);
+  while (s->pending) pthread_cond_wait(&s->space, &s->mu);
+  const int error = s->error;
+  pthread_mutex_unlock(&s->mu);
+
+  if (error) {
+    upb_Status_SetErrorFormat(status, "write() failed: %s", strerror(error));
+    return false;
+  }
+  return true;
+}
+
+bool upb_AsyncOutputStream_Close(upb_ZeroCopyOutputStream* z,
+                                 upb_Status* status) {
+  upb_AsyncOutputStream* s = (upb_AsyncOutputStream*)z;
+
+  const bool ok = upb_AsyncOutputStream_Flush(z, status);
+
+  pthread_mutex_lock(&s->mu);
+  s->stop = true;
+  pthread_cond_signal(&s->work);
+  pthread_mutex_unlock(&s->mu);
+  pthread_join(s->thread, NULL);
+
+  pthread_cond_destroy(&s->space);
+  pthread_cond_destroy(&s->work);
+  pthread_mutex_destroy(&s->mu);
+
+  return ok;
+}
+
+#else  // _WIN32
+
+upb_ZeroCopyOutputStream* upb_AsyncOutputStream_New(int fd, size_t block_size,
+                                                    int block_count,
+                                                    upb_Arena* arena) {
+  return NULL;
+}
+
+bool upb_AsyncOutputStream_Flush(upb_ZeroCopyOutputStream* z,
+                                 upb_Status* status) {
+  return false;
+}
+
+bool upb_AsyncOutputStream_Close(upb_ZeroCopyOutputStream* z,
+                                 upb_Status* status) {
+  return false;
+}
+
+#endif  // _WIN32
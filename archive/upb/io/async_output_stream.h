@@ -0,0 +1,79 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_IO_ASYNC_OUTPUT_STREAM_H_
+#define UPB_IO_ASYNC_OUTPUT_STREAM_H_
+
+#include "upb/base/status.h"
+#include "upb/io/zero_copy_output_stream.h"
+#include "upb/mem/arena.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A ZeroCopyOutputStream which write()s to the file descriptor |fd| from a
+// background thread, so that the caller can keep filling buffers while
+// earlier ones are being written.
+//
+// Data is collected in a ring of |block_count| (at least 2) buffers of
+// |block_size| bytes each, allocated from |arena|; zero selects a default for
+// either.  A buffer is handed to the writer thread once it is full, and
+// Next() only blocks when every buffer is waiting to be written.
+//
+// The stream owns a thread, so it must be closed with
+// upb_AsyncOutputStream_Close() before |arena| is freed.  The descriptor is
+// not closed.  Returns NULL on allocation failure, if the thread cannot be
+// started, or where threads are not supported.
+upb_ZeroCopyOutputStream* upb_AsyncOutputStream_New(int fd, size_t block_size,
+                                                    int block_count,
+                                                    upb_Arena* arena);
+
+// Hands any partially filled buffer to the writer thread and waits until
+// everything written so far has reached the descriptor.  Returns false and
+// sets |status| if a write has failed.
+bool upb_AsyncOutputStream_Flush(upb_ZeroCopyOutputStream* z,
+                                 upb_Status* status);
+
+// Flushes the stream, then stops the writer thread.  The stream must not be
+// used afterwards.  Returns false and sets |status| if a write has failed.
+bool upb_AsyncOutputStream_Close(upb_ZeroCopyOutputStream* z,
+                                 upb_Status* status);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_IO_ASYNC_OUTPUT_STREAM_H_ */
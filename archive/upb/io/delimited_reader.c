@@ -0,0 +1,116 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/io/delimited_reader.h"
+
+#include <string.h>
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Makes the next chunk of the stream current.  Returns false at the end of the
+// stream or on error.
+static bool upb_DelimitedReader_Fill(upb_DelimitedReader* r,
+                                     upb_Status* status) {
+  size_t count;
+  const char* data = upb_ZeroCopyInputStream_Next(r->stream, &count, status);
+  if (!data) {
+    r->ptr = NULL;
+    r->end = NULL;
+    return false;
+  }
+  r->ptr = data;
+  r->end = data + count;
+  return true;
+}
+
+static bool upb_DelimitedReader_Truncated(upb_Status* status) {
+  if (upb_Status_IsOk(status)) {
+    upb_Status_SetErrorMessage(status, "truncated delimited message");
+  }
+  return false;
+}
+
+static bool upb_DelimitedReader_ReadSize(upb_DelimitedReader* r,
+                                         uint64_t* size, upb_Status* status) {
+  uint64_t val = 0;
+  for (int i = 0; i < 10; i++) {
+    if (r->ptr == r->end && !upb_DelimitedReader_Fill(r, status)) {
+      // A clean end of stream is only allowed between messages.
+      return i == 0 ? false : upb_DelimitedReader_Truncated(status);
+    }
+    uint8_t byte = *r->ptr++;
+    val |= (uint64_t)(byte & 0x7f) << (i * 7);
+    if ((byte & 0x80) == 0) {
+      *size = val;
+      return true;
+    }
+  }
+  upb_Status_SetErrorMessage(status, "malformed delimited message length");
+  return false;
+}
+
+bool upb_DelimitedReader_Next(upb_DelimitedReader* r, upb_Arena* arena,
+                              upb_StringView* msg, upb_Status* status) {
+  uint64_t size;
+  if (!upb_DelimitedReader_ReadSize(r, &size, status)) return false;
+  if (size > INT32_MAX) {
+    upb_Status_SetErrorMessage(status, "delimited message too large");
+    return false;
+  }
+
+  // Fast path: the whole message is in the current chunk.
+  if ((size_t)(r->end - r->ptr) >= size) {
+    *msg = upb_StringView_FromDataAndSize(r->ptr, size);
+    r->ptr += size;
+    r->copied = false;
+    return true;
+  }
+
+  // The message spans chunks, so stitch it together in the arena.
+  char* buf = upb_Arena_Malloc(arena, size);
+  if (!buf) {
+    upb_Status_SetErrorMessage(status, "out of memory");
+    return false;
+  }
+  size_t copied = 0;
+  while (copied < size) {
+    if (r->ptr == r->end && !upb_DelimitedReader_Fill(r, status)) {
+      return upb_DelimitedReader_Truncated(status);
+    }
+    size_t n = UPB_MIN((size_t)(r->end - r->ptr), size - copied);
+    memcpy(buf + copied, r->ptr, n);
+    r->ptr += n;
+    copied += n;
+  }
+  *msg = upb_StringView_FromDataAndSize(buf, size);
+  r->copied = true;
+  return true;
+}
@@ -0,0 +1,103 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_IO_DELIMITED_READER_H_
+#define UPB_IO_DELIMITED_READER_H_
+
+#include "upb/base/status.h"
+#include "upb/base/string_view.h"
+#include "upb/io/zero_copy_input_stream.h"
+#include "upb/mem/arena.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reads a sequence of messages that are each prefixed by their length as a
+// varint (the format written by writeDelimitedTo() in other protobuf
+// implementations), yielding the serialized bytes of one message at a time.
+//
+// A message that lies entirely within one chunk of the underlying stream is
+// returned without copying.  Only messages that span chunks are copied, into
+// the arena passed to upb_DelimitedReader_Next().
+typedef struct {
+  upb_ZeroCopyInputStream* stream;
+  const char* ptr;  // Unread data in the current chunk.
+  const char* end;
+  bool copied;  // Whether the last message was copied into the arena.
+} upb_DelimitedReader;
+
+UPB_INLINE void upb_DelimitedReader_Init(upb_DelimitedReader* r,
+                                         upb_ZeroCopyInputStream* stream) {
+  r->stream = stream;
+  r->ptr = NULL;
+  r->end = NULL;
+  r->copied = false;
+}
+
+// Reads the next message, storing its serialized bytes in `*msg`.  Returns
+// false at the end of the stream or on error; errors are reported in `status`,
+// which must be OK on entry.
+//
+// If the message was copied, the data is owned by `arena`.  Otherwise it
+// points into the stream's buffer and is only valid until the next call to
+// upb_DelimitedReader_Next() or upb_DelimitedReader_Close(), so it should be
+// decoded without kUpb_DecodeOption_AliasString unless
+// upb_DelimitedReader_WasCopied() returns true.
+bool upb_DelimitedReader_Next(upb_DelimitedReader* r, upb_Arena* arena,
+                              upb_StringView* msg, upb_Status* status);
+
+// Returns true if the message most recently returned by
+// upb_DelimitedReader_Next() was copied into the arena.
+UPB_INLINE bool upb_DelimitedReader_WasCopied(const upb_DelimitedReader* r) {
+  return r->copied;
+}
+
+// Returns any data that has been read from the stream but not consumed back to
+// the stream with upb_ZeroCopyInputStream_BackUp(), so that the stream is left
+// positioned just after the last message returned.
+UPB_INLINE void upb_DelimitedReader_Close(upb_DelimitedReader* r) {
+  if (r->ptr != r->end) {
+    upb_ZeroCopyInputStream_BackUp(r->stream, r->end - r->ptr);
+  }
+  r->ptr = NULL;
+  r->end = NULL;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_IO_DELIMITED_READER_H_ */
@@ -0,0 +1,143 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/io/delimited_reader.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "upb/base/status.hpp"
+#include "upb/io/chunked_input_stream.h"
+#include "upb/mem/arena.hpp"
+
+namespace {
+
+std::string Delimited(const std::vector<std::string>& msgs) {
+  std::string out;
+  for (const auto& msg : msgs) {
+    size_t size = msg.size();
+    do {
+      char byte = size & 0x7f;
+      size >>= 7;
+      if (size) byte |= 0x80;
+      out.push_back(byte);
+    } while (size);
+    out += msg;
+  }
+  return out;
+}
+
+TEST(DelimitedReaderTest, ReadsMessages) {
+  std::vector<std::string> msgs = {"", "a", std::string(200, 'b'), "cd",
+                                   std::string(1000, 'e')};
+  std::string data = Delimited(msgs);
+
+  for (size_t chunk : {1, 2, 3, 7, 64, 10000}) {
+    upb::Arena arena;
+    upb_ZeroCopyInputStream* stream =
+        upb_ChunkedInputStream_New(data.data(), data.size(), chunk, arena.ptr());
+    upb_DelimitedReader reader;
+    upb_DelimitedReader_Init(&reader, stream);
+    upb::Status status;
+    upb_StringView msg;
+
+    for (const auto& expected : msgs) {
+      ASSERT_TRUE(upb_DelimitedReader_Next(&reader, arena.ptr(), &msg,
+                                           status.ptr()))
+          << status.error_message();
+      EXPECT_EQ(expected, std::string(msg.data, msg.size));
+      if (!upb_DelimitedReader_WasCopied(&reader)) {
+        // Messages that were not copied alias the input.
+        EXPECT_GE(msg.data, data.data());
+        EXPECT_LE(msg.data + msg.size, data.data() + data.size());
+      }
+    }
+    EXPECT_FALSE(
+        upb_DelimitedReader_Next(&reader, arena.ptr(), &msg, status.ptr()));
+    EXPECT_TRUE(status.ok());
+  }
+}
+
+TEST(DelimitedReaderTest, ZeroCopyWithinChunk) {
+  std::string data = Delimited({"hello", "world"});
+  upb::Arena arena;
+  upb_ZeroCopyInputStream* stream =
+      upb_ChunkedInputStream_New(data.data(), data.size(), 100, arena.ptr());
+  upb_DelimitedReader reader;
+  upb_DelimitedReader_Init(&reader, stream);
+  upb::Status status;
+  upb_StringView msg;
+
+  ASSERT_TRUE(
+      upb_DelimitedReader_Next(&reader, arena.ptr(), &msg, status.ptr()));
+  EXPECT_FALSE(upb_DelimitedReader_WasCopied(&reader));
+  EXPECT_EQ(data.data() + 1, msg.data);
+}
+
+TEST(DelimitedReaderTest, Truncated) {
+  std::string data = Delimited({"hello", "world"});
+  for (size_t len = 1; len < data.size(); len++) {
+    if (len == 6) continue;  // Ends cleanly after the first message.
+    upb::Arena arena;
+    upb_ZeroCopyInputStream* stream =
+        upb_ChunkedInputStream_New(data.data(), len, 3, arena.ptr());
+    upb_DelimitedReader reader;
+    upb_DelimitedReader_Init(&reader, stream);
+    upb::Status status;
+    upb_StringView msg;
+
+    while (upb_DelimitedReader_Next(&reader, arena.ptr(), &msg, status.ptr())) {
+    }
+    EXPECT_FALSE(status.ok()) << len;
+  }
+}
+
+TEST(DelimitedReaderTest, CloseBacksUpUnreadData) {
+  std::string data = Delimited({"hello"}) + "trailing";
+  upb::Arena arena;
+  upb_ZeroCopyInputStream* stream =
+      upb_ChunkedInputStream_New(data.data(), data.size(), 100, arena.ptr());
+  upb_DelimitedReader reader;
+  upb_DelimitedReader_Init(&reader, stream);
+  upb::Status status;
+  upb_StringView msg;
+
+  ASSERT_TRUE(
+      upb_DelimitedReader_Next(&reader, arena.ptr(), &msg, status.ptr()));
+  upb_DelimitedReader_Close(&reader);
+  EXPECT_EQ(6, upb_ZeroCopyInputStream_ByteCount(stream));
+
+  size_t count;
+  const void* rest = upb_ZeroCopyInputStream_Next(stream, &count, status.ptr());
+  EXPECT_EQ("trailing", std::string(static_cast<const char*>(rest), count));
+}
+
+}  // namespace
@@ -0,0 +1,528 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Forward encoder.  _upb_Encode_ComputeSize() first records the length of
+// every delimited sub-message (in pre-order) so that we can write each length
+// prefix before the data it describes.
+
+#include "upb/io/encode_stream.h"
+
+#include <string.h>
+
+#include "upb/collections/internal/array.h"
+#include "upb/collections/internal/map_sorter.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/internal/extension.h"
+#include "upb/mini_table/sub.h"
+#include "upb/wire/internal/common.h"
+#include "upb/wire/internal/encode.h"
+#include "upb/wire/internal/swap.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef struct {
+  upb_EncodeStatus status;
+  jmp_buf err;
+  int options;
+  _upb_mapsorter sorter;
+
+  // Sub-message and packed lengths, in the order they are written.
+  const size_t* sizes;
+  size_t size_count;
+  size_t next_size;
+
+  upb_ZeroCopyOutputStream* stream;
+  upb_Status* stream_status;
+  char *ptr, *end;
+  bool have_chunk;
+} upb_StreamEncoder;
+
+UPB_NORETURN static void _upb_StreamEncoder_Err(upb_StreamEncoder* e,
+                                                upb_EncodeStatus s) {
+  UPB_ASSERT(s != kUpb_EncodeStatus_Ok);
+  e->status = s;
+  UPB_LONGJMP(e->err, 1);
+}
+
+static size_t _upb_StreamEncoder_PopSize(upb_StreamEncoder* e) {
+  UPB_ASSERT(e->next_size < e->size_count);
+  return e->sizes[e->next_size++];
+}
+
+static void _upb_StreamEncoder_SortMap(upb_StreamEncoder* e,
+                                       const upb_MiniTable* layout,
+                                       const upb_Map* map,
+                                       _upb_sortedmap* sorted) {
+  if (!_upb_mapsorter_pushmap(&e->sorter,
+                              layout->fields[0].UPB_PRIVATE(descriptortype),
+                              map, sorted)) {
+    _upb_StreamEncoder_Err(e, kUpb_EncodeStatus_OutOfMemory);
+  }
+}
+
+static void _upb_StreamEncoder_SortExts(upb_StreamEncoder* e,
+                                        const upb_Message_Extension* ext,
+                                        size_t count, _upb_sortedmap* sorted) {
+  if (!_upb_mapsorter_pushexts(&e->sorter, ext, count, sorted)) {
+    _upb_StreamEncoder_Err(e, kUpb_EncodeStatus_OutOfMemory);
+  }
+}
+
+UPB_NOINLINE
+static void _upb_StreamEncoder_NextChunk(upb_StreamEncoder* e) {
+  size_t count;
+  char* chunk = upb_ZeroCopyOutputStream_Next(e->stream, &count,
+                                              e->stream_status);
+  if (!chunk) {
+    if (upb_Status_IsOk(e->stream_status)) {
+      upb_Status_SetErrorMessage(e->stream_status, "output stream is full");
+    }
+    e->ptr = e->end = NULL;
+    e->have_chunk = false;
+    _upb_StreamEncoder_Err(e, kUpb_EncodeStatus_WriteError);
+  }
+  e->ptr = chunk;
+  e->end = chunk + count;
+  e->have_chunk = true;
+}
+
+static void _upb_StreamEncoder_WriteBytes(upb_StreamEncoder* e,
+                                          const void* data, size_t len) {
+  const char* src = data;
+  while (len) {
+    if (e->ptr == e->end) _upb_StreamEncoder_NextChunk(e);
+    size_t n = UPB_MIN(len, (size_t)(e->end - e->ptr));
+    memcpy(e->ptr, src, n);
+    e->ptr += n;
+    src += n;
+    len -= n;
+  }
+}
+
+UPB_FORCEINLINE
+static void _upb_StreamEncoder_WriteVarint(upb_StreamEncoder* e,
+                                           uint64_t val) {
+  if (e->end - e->ptr >= kUpb_WireWriter_MaxVarintSize) {
+    e->ptr += upb_WireWriter_EncodeVarint(val, e->ptr);
+  } else {
+    char buf[kUpb_WireWriter_MaxVarintSize];
+    _upb_StreamEncoder_WriteBytes(e, buf,
+                                  upb_WireWriter_EncodeVarint(val, buf));
+  }
+}
+
+static void _upb_StreamEncoder_WriteFixed64(upb_StreamEncoder* e,
+                                            uint64_t val) {
+  val = _upb_BigEndian_Swap64(val);
+  _upb_StreamEncoder_WriteBytes(e, &val, sizeof(uint64_t));
+}
+
+static void _upb_StreamEncoder_WriteFixed32(upb_StreamEncoder* e,
+                                            uint32_t val) {
+  val = _upb_BigEndian_Swap32(val);
+  _upb_StreamEncoder_WriteBytes(e, &val, sizeof(uint32_t));
+}
+
+static void _upb_StreamEncoder_WriteTag(upb_StreamEncoder* e,
+                                        uint32_t field_number,
+                                        uint8_t wire_type) {
+  _upb_StreamEncoder_WriteVarint(e, (field_number << 3) | wire_type);
+}
+
+static void _upb_StreamEncoder_WriteFixedArray(upb_StreamEncoder* e,
+                                               const upb_Array* arr,
+                                               size_t elem_size, uint32_t tag) {
+  const char* ptr = _upb_array_constptr(arr);
+  const char* end = ptr + arr->size * elem_size;
+
+  if (!tag && _upb_IsLittleEndian()) {
+    _upb_StreamEncoder_WriteBytes(e, ptr, end - ptr);
+    return;
+  }
+
+  for (; ptr != end; ptr += elem_size) {
+    if (tag) _upb_StreamEncoder_WriteVarint(e, tag);
+    if (elem_size == 4) {
+      uint32_t val;
+      memcpy(&val, ptr, sizeof(val));
+      _upb_StreamEncoder_WriteFixed32(e, val);
+    } else {
+      UPB_ASSERT(elem_size == 8);
+      uint64_t val;
+      memcpy(&val, ptr, sizeof(val));
+      _upb_StreamEncoder_WriteFixed64(e, val);
+    }
+  }
+}
+
+static void _upb_StreamEncoder_WriteMessage(upb_StreamEncoder* e,
+                                            const upb_Message* msg,
+                                            const upb_MiniTable* m);
+
+static void _upb_StreamEncoder_WriteSubMessage(upb_StreamEncoder* e,
+                                               upb_TaggedMessagePtr tagged,
+                                               const upb_MiniTable* m) {
+  const upb_Message* msg = _upb_Encode_SubMessage(tagged, &m);
+  _upb_StreamEncoder_WriteMessage(e, msg, m);
+}
+
+static void _upb_StreamEncoder_WriteDelimitedMessage(
+    upb_StreamEncoder* e, upb_TaggedMessagePtr tagged, const upb_MiniTable* m) {
+  _upb_StreamEncoder_WriteVarint(e, _upb_StreamEncoder_PopSize(e));
+  _upb_StreamEncoder_WriteSubMessage(e, tagged, m);
+}
+
+static void _upb_StreamEncoder_WriteScalar(upb_StreamEncoder* e,
+                                           const void* _field_mem,
+                                           const upb_MiniTableSub* subs,
+                                           const upb_MiniTableField* f) {
+  const char* field_mem = _field_mem;
+
+#define CASE(ctype, type, wtype, encodeval)           \
+  {                                                   \
+    ctype val = *(ctype*)field_mem;                   \
+    _upb_StreamEncoder_WriteTag(e, f->number, wtype); \
+    _upb_StreamEncoder_Write##type(e, encodeval);     \
+    break;                                            \
+  }
+
+  switch (f->UPB_PRIVATE(descriptortype)) {
+    case kUpb_FieldType_Int64:
+    case kUpb_FieldType_UInt64:
+      CASE(uint64_t, Varint, kUpb_WireType_Varint, val);
+    case kUpb_FieldType_UInt32:
+      CASE(uint32_t, Varint, kUpb_WireType_Varint, val);
+    case kUpb_FieldType_Int32:
+    case kUpb_FieldType_Enum:
+      CASE(int32_t, Varint, kUpb_WireType_Varint, (int64_t)val);
+    case kUpb_FieldType_Double:
+    case kUpb_FieldType_SFixed64:
+    case kUpb_FieldType_Fixed64:
+      CASE(uint64_t, Fixed64, kUpb_WireType_64Bit, val);
+    case kUpb_FieldType_Float:
+    case kUpb_FieldType_Fixed32:
+    case kUpb_FieldType_SFixed32:
+      CASE(uint32_t, Fixed32, kUpb_WireType_32Bit, val);
+    case kUpb_FieldType_Bool:
+      CASE(bool, Varint, kUpb_WireType_Varint, val);
+    case kUpb_FieldType_SInt32:
+      CASE(int32_t, Varint, kUpb_WireType_Varint, upb_WireWriter_ZigZag32(val));
+    case kUpb_FieldType_SInt64:
+      CASE(int64_t, Varint, kUpb_WireType_Varint, upb_WireWriter_ZigZag64(val));
+    case kUpb_FieldType_String:
+    case kUpb_FieldType_Bytes: {
+      upb_StringView view = *(upb_StringView*)field_mem;
+      _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_Delimited);
+      _upb_StreamEncoder_WriteVarint(e, view.size);
+      _upb_StreamEncoder_WriteBytes(e, view.data, view.size);
+      break;
+    }
+    case kUpb_FieldType_Group: {
+      upb_TaggedMessagePtr submsg = *(upb_TaggedMessagePtr*)field_mem;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      if (submsg == 0) return;
+      _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_StartGroup);
+      _upb_StreamEncoder_WriteSubMessage(e, submsg, subm);
+      _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_EndGroup);
+      break;
+    }
+    case kUpb_FieldType_Message: {
+      upb_TaggedMessagePtr submsg = *(upb_TaggedMessagePtr*)field_mem;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      if (submsg == 0) return;
+      _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_Delimited);
+      _upb_StreamEncoder_WriteDelimitedMessage(e, submsg, subm);
+      break;
+    }
+    default:
+      UPB_UNREACHABLE();
+  }
+#undef CASE
+}
+
+static void _upb_StreamEncoder_WriteArray(upb_StreamEncoder* e,
+                                          const upb_Message* msg,
+                                          const upb_MiniTableSub* subs,
+                                          const upb_MiniTableField* f) {
+  const upb_Array* arr = *UPB_PTR_AT(msg, f->offset, upb_Array*);
+  bool packed = _upb_MiniTableField_IsPacked(f);
+
+  if (arr == NULL || arr->size == 0) return;
+
+  if (packed) {
+    _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_Delimited);
+    _upb_StreamEncoder_WriteVarint(e, _upb_StreamEncoder_PopSize(e));
+  }
+
+#define VARINT_CASE(ctype, encode)                                       \
+  {                                                                      \
+    const ctype* ptr = _upb_array_constptr(arr);                         \
+    const ctype* end = ptr + arr->size;                                  \
+    uint32_t tag = packed ? 0 : (f->number << 3) | kUpb_WireType_Varint; \
+    for (; ptr != end; ptr++) {                                          \
+      if (tag) _upb_StreamEncoder_WriteVarint(e, tag);                   \
+      _upb_StreamEncoder_WriteVarint(e, encode);                         \
+    }                                                                    \
+  }                                                                      \
+  break;
+
+#define TAG(wire_type) (packed ? 0 : (f->number << 3 | wire_type))
+
+  switch (f->UPB_PRIVATE(descriptortype)) {
+    case kUpb_FieldType_Double:
+    case kUpb_FieldType_SFixed64:
+    case kUpb_FieldType_Fixed64:
+      _upb_StreamEncoder_WriteFixedArray(e, arr, sizeof(uint64_t),
+                                         TAG(kUpb_WireType_64Bit));
+      break;
+    case kUpb_FieldType_Float:
+    case kUpb_FieldType_Fixed32:
+    case kUpb_FieldType_SFixed32:
+      _upb_StreamEncoder_WriteFixedArray(e, arr, sizeof(uint32_t),
+                                         TAG(kUpb_WireType_32Bit));
+      break;
+    case kUpb_FieldType_Int64:
+    case kUpb_FieldType_UInt64:
+      VARINT_CASE(uint64_t, *ptr);
+    case kUpb_FieldType_UInt32:
+      VARINT_CASE(uint32_t, *ptr);
+    case kUpb_FieldType_Int32:
+    case kUpb_FieldType_Enum:
+      VARINT_CASE(int32_t, (int64_t)*ptr);
+    case kUpb_FieldType_Bool:
+      VARINT_CASE(bool, *ptr);
+    case kUpb_FieldType_SInt32:
+      VARINT_CASE(int32_t, upb_WireWriter_ZigZag32(*ptr));
+    case kUpb_FieldType_SInt64:
+      VARINT_CASE(int64_t, upb_WireWriter_ZigZag64(*ptr));
+    case kUpb_FieldType_String:
+    case kUpb_FieldType_Bytes: {
+      const upb_StringView* ptr = _upb_array_constptr(arr);
+      const upb_StringView* end = ptr + arr->size;
+      for (; ptr != end; ptr++) {
+        _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_Delimited);
+        _upb_StreamEncoder_WriteVarint(e, ptr->size);
+        _upb_StreamEncoder_WriteBytes(e, ptr->data, ptr->size);
+      }
+      break;
+    }
+    case kUpb_FieldType_Group: {
+      const upb_TaggedMessagePtr* ptr = _upb_array_constptr(arr);
+      const upb_TaggedMessagePtr* end = ptr + arr->size;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      for (; ptr != end; ptr++) {
+        _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_StartGroup);
+        _upb_StreamEncoder_WriteSubMessage(e, *ptr, subm);
+        _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_EndGroup);
+      }
+      break;
+    }
+    case kUpb_FieldType_Message: {
+      const upb_TaggedMessagePtr* ptr = _upb_array_constptr(arr);
+      const upb_TaggedMessagePtr* end = ptr + arr->size;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      if (_upb_Array_HasInlineMessages(arr)) {
+        for (size_t i = 0; i < arr->size; i++) {
+          upb_Message* submsg = _upb_Array_InlineMessage(arr, i);
+          upb_TaggedMessagePtr tagged =
+              _upb_TaggedMessagePtr_Pack(submsg, false);
+          _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_Delimited);
+          _upb_StreamEncoder_WriteDelimitedMessage(e, tagged, subm);
+        }
+        break;
+      }
+      for (; ptr != end; ptr++) {
+        _upb_StreamEncoder_WriteTag(e, f->number, kUpb_WireType_Delimited);
+        _upb_StreamEncoder_WriteDelimitedMessage(e, *ptr, subm);
+      }
+      break;
+    }
+  }
+#undef VARINT_CASE
+#undef TAG
+}
+
+static void _upb_StreamEncoder_WriteMapEntry(upb_StreamEncoder* e,
+                                             uint32_t number,
+                                             const upb_MiniTable* layout,
+                                             const upb_MapEntry* ent) {
+  _upb_StreamEncoder_WriteTag(e, number, kUpb_WireType_Delimited);
+  _upb_StreamEncoder_WriteVarint(e, _upb_StreamEncoder_PopSize(e));
+  _upb_StreamEncoder_WriteScalar(e, &ent->data.k, layout->subs,
+                                 &layout->fields[0]);
+  _upb_StreamEncoder_WriteScalar(e, &ent->data.v, layout->subs,
+                                 &layout->fields[1]);
+}
+
+static void _upb_StreamEncoder_WriteMap(upb_StreamEncoder* e,
+                                        const upb_Message* msg,
+                                        const upb_MiniTableSub* subs,
+                                        const upb_MiniTableField* f) {
+  const upb_Map* map = *UPB_PTR_AT(msg, f->offset, const upb_Map*);
+  const upb_MiniTable* layout = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+
+  if (map == NULL) return;
+
+  if (e->options & kUpb_EncodeOption_Deterministic) {
+    _upb_sortedmap sorted;
+    upb_MapEntry ent;
+    _upb_StreamEncoder_SortMap(e, layout, map, &sorted);
+    while (_upb_sortedmap_prev(&e->sorter, map, &sorted, &ent)) {
+      _upb_StreamEncoder_WriteMapEntry(e, f->number, layout, &ent);
+    }
+    _upb_mapsorter_popmap(&e->sorter, &sorted);
+  } else {
+    size_t iter = kUpb_Map_Begin;
+    upb_MapEntry ent;
+    while (_upb_Map_Next(map, &ent.data.k, &ent.data.v, &iter)) {
+      _upb_StreamEncoder_WriteMapEntry(e, f->number, layout, &ent);
+    }
+  }
+}
+
+static void _upb_StreamEncoder_WriteField(upb_StreamEncoder* e,
+                                          const upb_Message* msg,
+                                          const upb_MiniTableSub* subs,
+                                          const upb_MiniTableField* field) {
+  switch (upb_FieldMode_Get(field)) {
+    case kUpb_FieldMode_Array:
+      _upb_StreamEncoder_WriteArray(e, msg, subs, field);
+      break;
+    case kUpb_FieldMode_Map:
+      _upb_StreamEncoder_WriteMap(e, msg, subs, field);
+      break;
+    case kUpb_FieldMode_Scalar:
+      _upb_StreamEncoder_WriteScalar(
+          e, _upb_MiniTableField_GetConstPtr(msg, field), subs, field);
+      break;
+    default:
+      UPB_UNREACHABLE();
+  }
+}
+
+static void _upb_StreamEncoder_WriteExt(upb_StreamEncoder* e,
+                                        const upb_Message_Extension* ext,
+                                        bool is_message_set) {
+  if (UPB_UNLIKELY(is_message_set)) {
+    _upb_StreamEncoder_WriteTag(e, kUpb_MsgSet_Item, kUpb_WireType_StartGroup);
+    _upb_StreamEncoder_WriteTag(e, kUpb_MsgSet_TypeId, kUpb_WireType_Varint);
+    _upb_StreamEncoder_WriteVarint(e, ext->ext->field.number);
+    _upb_StreamEncoder_WriteTag(e, kUpb_MsgSet_Message,
+                                kUpb_WireType_Delimited);
+    _upb_StreamEncoder_WriteVarint(e, _upb_StreamEncoder_PopSize(e));
+    _upb_StreamEncoder_WriteMessage(e, ext->data.ptr, ext->ext->sub.submsg);
+    _upb_StreamEncoder_WriteTag(e, kUpb_MsgSet_Item, kUpb_WireType_EndGroup);
+  } else {
+    _upb_StreamEncoder_WriteField(e, &ext->data, &ext->ext->sub,
+                                  &ext->ext->field);
+  }
+}
+
+static void _upb_StreamEncoder_WriteMessage(upb_StreamEncoder* e,
+                                            const upb_Message* msg,
+                                            const upb_MiniTable* m) {
+  const upb_MiniTableField* f = &m->fields[0];
+  const upb_MiniTableField* end = f + m->field_count;
+  for (; f != end; f++) {
+    if (_upb_Encode_ShouldEncode(msg, f)) {
+      _upb_StreamEncoder_WriteField(e, msg, m->subs, f);
+    }
+  }
+
+  // Extensions and unknown fields come out in the same order as upb_Encode()
+  // produces them, which (since that encoder runs backwards) means walking
+  // the extensions from last to first.
+  if (m->ext != kUpb_ExtMode_NonExtendable) {
+    size_t ext_count;
+    const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &ext_count);
+    bool is_message_set = m->ext == kUpb_ExtMode_IsMessageSet;
+    if (ext_count) {
+      if (e->options & kUpb_EncodeOption_Deterministic) {
+        _upb_sortedmap sorted;
+        _upb_StreamEncoder_SortExts(e, ext, ext_count, &sorted);
+        while (_upb_sortedmap_prevext(&e->sorter, &sorted, &ext)) {
+          _upb_StreamEncoder_WriteExt(e, ext, is_message_set);
+        }
+        _upb_mapsorter_popmap(&e->sorter, &sorted);
+      } else {
+        const upb_Message_Extension* first = ext;
+        ext += ext_count;
+        while (ext != first) {
+          _upb_StreamEncoder_WriteExt(e, --ext, is_message_set);
+        }
+      }
+    }
+  }
+
+  if ((e->options & kUpb_EncodeOption_SkipUnknown) == 0) {
+    size_t unknown_size;
+    const char* unknown = upb_Message_GetUnknown(msg, &unknown_size);
+    if (unknown) _upb_StreamEncoder_WriteBytes(e, unknown, unknown_size);
+  }
+}
+
+upb_EncodeStatus upb_EncodeToStream(const void* msg, const upb_MiniTable* l,
+                                    int options, upb_Arena* arena,
+                                    upb_ZeroCopyOutputStream* stream,
+                                    upb_Status* status) {
+  upb_StreamEncoder e;
+  upb_Status local_status;
+  size_t* sizes;
+  size_t size;
+
+  if (!status) status = &local_status;
+  upb_Status_Clear(status);
+
+  e.status = _upb_Encode_ComputeSize(msg, l, options, arena, &sizes,
+                                     &e.size_count, &size);
+  if (e.status != kUpb_EncodeStatus_Ok) return e.status;
+
+  e.options = options;
+  e.sizes = sizes;
+  e.next_size = 0;
+  e.stream = stream;
+  e.stream_status = status;
+  e.ptr = NULL;
+  e.end = NULL;
+  e.have_chunk = false;
+  _upb_mapsorter_init(&e.sorter);
+
+  if (UPB_SETJMP(e.err) == 0) {
+    _upb_StreamEncoder_WriteMessage(&e, msg, l);
+    UPB_ASSERT(e.next_size == e.size_count);
+  }
+
+  // Hand any unused part of the last chunk back to the stream.
+  if (e.have_chunk) upb_ZeroCopyOutputStream_BackUp(stream, e.end - e.ptr);
+
+  _upb_mapsorter_destroy(&e.sorter);
+  return e.status;
+}
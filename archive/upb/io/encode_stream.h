@@ -0,0 +1,70 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_IO_ENCODE_STREAM_H_
+#define UPB_IO_ENCODE_STREAM_H_
+
+#include "upb/base/status.h"
+#include "upb/io/zero_copy_output_stream.h"
+#include "upb/mem/arena.h"
+#include "upb/mini_table/message.h"
+#include "upb/wire/encode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Serializes `msg` into `stream`, front to back, in whatever chunks the stream
+// provides.  Unlike upb_Encode(), which encodes backwards into one contiguous
+// buffer that is grown (and copied) as needed, this first computes the size
+// of every sub-message so that the output never has to be moved.  The sizes
+// are kept in a table allocated from `arena`.
+//
+// The options and the output are the same as for upb_Encode(), except that
+// map entries may be written in a different order unless
+// kUpb_EncodeOption_Deterministic is set.  If the stream fails,
+// kUpb_EncodeStatus_WriteError is returned and the stream's error is stored in
+// `status`; in that case some output may already have been written.
+UPB_API upb_EncodeStatus upb_EncodeToStream(const void* msg,
+                                            const upb_MiniTable* l,
+                                            int options, upb_Arena* arena,
+                                            upb_ZeroCopyOutputStream* stream,
+                                            upb_Status* status);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_IO_ENCODE_STREAM_H_ */
@@ -0,0 +1,284 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// For read(), fstat(), mmap() and posix_madvise(), which are not part of C99.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "upb/io/file_input_stream.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifndef _WIN32
+
+enum { kUpb_FileInputStream_DefaultBlockSize = 64 * 1024 };
+
+typedef struct {
+  upb_ZeroCopyInputStream base;
+
+  int fd;
+  int error;  // The errno of a failed read(), reported by every later Next().
+  bool eof;
+  char* buf;
+  size_t block_size;
+  size_t start;  // buf[start, end) has been read but not yet returned.
+  size_t end;
+  size_t position;
+  size_t last_returned_size;
+} upb_FileInputStream;
+
+// Reads the next block into the buffer.  Returns false at EOF or on error.
+static bool upb_FileInputStream_Fill(upb_FileInputStream* f,
+                                     upb_Status* status) {
+  if (!f->eof && !f->error) {
+    ssize_t n;
+    do {
+      n = read(f->fd, f->buf, f->block_size);
+    } while (n < 0 && errno == EINTR);
+
+    if (n > 0) {
+      f->start = 0;
+      f->end = n;
+      return true;
+    }
+    if (n == 0) {
+      f->eof = true;
+    } else {
+      f->error = errno;
+    }
+  }
+
+  if (f->error) {
+    upb_Status_SetErrorFormat(status, "read() failed: %s", strerror(f->error));
+  }
+  return false;
+}
+
+static const void* upb_FileInputStream_Next(upb_ZeroCopyInputStream* z,
+                                            size_t* count,
+                                            upb_Status* status) {
+  upb_FileInputStream* f = (upb_FileInputStream*)z;
+
+  if (f->start == f->end && !upb_FileInputStream_Fill(f, status)) {
+    f->last_returned_size = 0;
+    *count = 0;
+    return NULL;
+  }
+
+  const char* out = f->buf + f->start;
+  const size_t chunk = f->end - f->start;
+  f->start = f->end;
+  f->position += chunk;
+  f->last_returned_size = chunk;
+  *count = chunk;
+
+  return out;
+}
+
+static void upb_FileInputStream_BackUp(upb_ZeroCopyInputStream* z,
+                                       size_t count) {
+  upb_FileInputStream* f = (upb_FileInputStream*)z;
+
+  UPB_ASSERT(f->last_returned_size >= count);
+  f->start -= count;
+  f->position -= count;
+  f->last_returned_size -= count;
+}
+
+static bool upb_FileInputStream_Skip(upb_ZeroCopyInputStream* z,
+                                     size_t count) {
+  upb_FileInputStream* f = (upb_FileInputStream*)z;
+
+  f->last_returned_size = 0;  // Don't let caller back up.
+  while (count > 0) {
+    if (f->start == f->end && !upb_FileInputStream_Fill(f, NULL)) return false;
+    const size_t n = UPB_MIN(count, f->end - f->start);
+    f->start += n;
+    f->position += n;
+    count -= n;
+  }
+  return true;
+}
+
+static size_t upb_FileInputStream_ByteCount(const upb_ZeroCopyInputStream* z) {
+  const upb_FileInputStream* f = (const upb_FileInputStream*)z;
+
+  return f->position;
+}
+
+static const _upb_ZeroCopyInputStream_VTable upb_FileInputStream_vtable = {
+    upb_FileInputStream_Next,
+    upb_FileInputStream_BackUp,
+    upb_FileInputStream_Skip,
+    upb_FileInputStream_ByteCount,
+};
+
+upb_ZeroCopyInputStream* upb_FileInputStream_New(int fd, size_t block_size,
+                                                 upb_Arena* arena) {
+  upb_FileInputStream* f = upb_Arena_Malloc(arena, sizeof(*f));
+  if (!f) return NULL;
+
+  if (!block_size) block_size = kUpb_FileInputStream_DefaultBlockSize;
+  f->buf = upb_Arena_Malloc(arena, block_size);
+  if (!f->buf) return NULL;
+
+  f->base.vtable = &upb_FileInputStream_vtable;
+  f->fd = fd;
+  f->error = 0;
+  f->eof = false;
+  f->block_size = block_size;
+  f->start = 0;
+  f->end = 0;
+  f->position = 0;
+  f->last_returned_size = 0;
+
+  return (upb_ZeroCopyInputStream*)f;
+}
+
+typedef struct {
+  upb_ZeroCopyInputStream base;
+
+  char* data;
+  size_t size;
+  size_t position;
+  size_t last_returned_size;
+} upb_MmapInputStream;
+
+static const void* upb_MmapInputStream_Next(upb_ZeroCopyInputStream* z,
+                                            size_t* count,
+                                            upb_Status* status) {
+  upb_MmapInputStream* m = (upb_MmapInputStream*)z;
+  UPB_ASSERT(m->position <= m->size);
+
+  const char* out = m->data + m->position;
+  const size_t chunk = m->size - m->position;
+  m->position = m->size;
+  m->last_returned_size = chunk;
+  *count = chunk;
+
+  return chunk ? out : NULL;
+}
+
+static void upb_MmapInputStream_BackUp(upb_ZeroCopyInputStream* z,
+                                       size_t count) {
+  upb_MmapInputStream* m = (upb_MmapInputStream*)z;
+
+  UPB_ASSERT(m->last_returned_size >= count);
+  m->position -= count;
+  m->last_returned_size -= count;
+}
+
+static bool upb_MmapInputStream_Skip(upb_ZeroCopyInputStream* z,
+                                     size_t count) {
+  upb_MmapInputStream* m = (upb_MmapInputStream*)z;
+
+  m->last_returned_size = 0;  // Don't let caller back up.
+  if (count > m->size - m->position) {
+    m->position = m->size;
+    return false;
+  }
+
+  m->position += count;
+  return true;
+}
+
+static size_t upb_MmapInputStream_ByteCount(const upb_ZeroCopyInputStream* z) {
+  const upb_MmapInputStream* m = (const upb_MmapInputStream*)z;
+
+  return m->position;
+}
+
+static const _upb_ZeroCopyInputStream_VTable upb_MmapInputStream_vtable = {
+    upb_MmapInputStream_Next,
+    upb_MmapInputStream_BackUp,
+    upb_MmapInputStream_Skip,
+    upb_MmapInputStream_ByteCount,
+};
+
+upb_ZeroCopyInputStream* upb_MmapInputStream_New(int fd, upb_Arena* arena) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return NULL;
+  if ((uint64_t)st.st_size > SIZE_MAX) return NULL;
+
+  upb_MmapInputStream* m = upb_Arena_Malloc(arena, sizeof(*m));
+  if (!m) return NULL;
+
+  m->base.vtable = &upb_MmapInputStream_vtable;
+  m->data = NULL;
+  m->size = (size_t)st.st_size;
+  m->position = 0;
+  m->last_returned_size = 0;
+
+  // An empty file cannot be mapped, but it is a valid (empty) stream.
+  if (m->size) {
+    void* data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return NULL;
+    posix_madvise(data, m->size, POSIX_MADV_SEQUENTIAL);
+    m->data = data;
+  }
+
+  return (upb_ZeroCopyInputStream*)m;
+}
+
+void upb_MmapInputStream_Free(upb_ZeroCopyInputStream* z) {
+  upb_MmapInputStream* m = (upb_MmapInputStream*)z;
+
+  if (m->data) munmap(m->data, m->size);
+  m->data = NULL;
+  m->size = 0;
+  m->position = 0;
+}
+
+#else  // _WIN32
+
+upb_ZeroCopyInputStream* upb_FileInputStream_New(int fd, size_t block_size,
+                                                 upb_Arena* arena) {
+  return NULL;
+}
+
+upb_ZeroCopyInputStream* upb_MmapInputStream_New(int fd, upb_Arena* arena) {
+  return NULL;
+}
+
+void upb_MmapInputStream_Free(upb_ZeroCopyInputStream* z) {}
+
+#endif  // _WIN32
@@ -0,0 +1,72 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_IO_FILE_INPUT_STREAM_H_
+#define UPB_IO_FILE_INPUT_STREAM_H_
+
+#include "upb/io/zero_copy_input_stream.h"
+#include "upb/mem/arena.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A ZeroCopyInputStream which read()s from the file descriptor |fd|, starting
+// at its current offset, into a single buffer of |block_size| bytes (or a
+// default size if zero) that is reused for every call to Next().  Pipes and
+// sockets work as well as files.  The descriptor is not closed.  Returns NULL
+// if the buffer cannot be allocated, or where file descriptors are not
+// supported.
+upb_ZeroCopyInputStream* upb_FileInputStream_New(int fd, size_t block_size,
+                                                 upb_Arena* arena);
+
+// A ZeroCopyInputStream over the whole of the regular file |fd|, which is
+// mapped into memory with a hint that it will be read sequentially.  The
+// first call to Next() returns the entire file, so nothing is copied.
+// Returns NULL if the file cannot be mapped (a pipe, for example), in which
+// case upb_FileInputStream_New() can be used instead.
+//
+// The mapping does not depend on |fd| staying open, but it is not owned by
+// |arena|: it must be released with upb_MmapInputStream_Free().
+upb_ZeroCopyInputStream* upb_MmapInputStream_New(int fd, upb_Arena* arena);
+
+// Unmaps the file.  The stream must not be used afterwards.
+void upb_MmapInputStream_Free(upb_ZeroCopyInputStream* z);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_IO_FILE_INPUT_STREAM_H_ */
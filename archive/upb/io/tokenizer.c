@@ -30,6 +30,14 @@
 
 #include "upb/io/tokenizer.h"
 
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UPB_TOKENIZER_SSE2 1
+#endif
+
 #include "upb/io/string.h"
 #include "upb/lex/strtod.h"
 #include "upb/lex/unicode.h"
@@ -52,8 +60,6 @@ typedef enum {
   kUpb_CommentType_None,
 } upb_CommentType;
 
-static bool upb_Tokenizer_IsUnprintable(char c) { return '\0' < c && c < ' '; }
-
 // Since we count columns we need to interpret tabs somehow.  We'll take
 // the standard 8-character definition for lack of any way to do better.
 static const int kUpb_Tokenizer_TabWidth = 8;
@@ -89,34 +95,74 @@ static int DigitValue(char digit) {
   return kUpb_Tokenizer_AsciiToInt[digit & 0xFF];
 }
 
-static bool upb_Tokenizer_IsLetter(char c) {
-  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || (c == '_');
-}
-
-static bool upb_Tokenizer_IsDigit(char c) { return '0' <= c && c <= '9'; }
-
-static bool upb_Tokenizer_IsOctalDigit(char c) { return '0' <= c && c <= '7'; }
+// Character classes, as bits in kUpb_Tokenizer_CharClass.  The tokenizer
+// tests every character it consumes, so this is a single table lookup.
+enum {
+  kUpb_CharClass_Letter = 1 << 0,       // a-z, A-Z and '_'
+  kUpb_CharClass_Digit = 1 << 1,        // 0-9
+  kUpb_CharClass_OctalDigit = 1 << 2,   // 0-7
+  kUpb_CharClass_HexDigit = 1 << 3,     // 0-9, a-f and A-F
+  kUpb_CharClass_Blank = 1 << 4,        // Whitespace other than '\n'.
+  kUpb_CharClass_Newline = 1 << 5,      // '\n'
+  kUpb_CharClass_Escape = 1 << 6,       // May follow a backslash in a string.
+  kUpb_CharClass_Unprintable = 1 << 7,  // Control characters except '\0'.
+
+  kUpb_CharClass_Alphanumeric = kUpb_CharClass_Letter | kUpb_CharClass_Digit,
+  kUpb_CharClass_Whitespace = kUpb_CharClass_Blank | kUpb_CharClass_Newline,
+};
 
-static bool upb_Tokenizer_IsHexDigit(char c) {
-  return ('0' <= c && c <= '9') || ('a' <= c && c <= 'f') ||
-         ('A' <= c && c <= 'F');
-}
+#define L kUpb_CharClass_Letter
+#define D kUpb_CharClass_Digit
+#define O kUpb_CharClass_OctalDigit
+#define H kUpb_CharClass_HexDigit
+#define B kUpb_CharClass_Blank
+#define N kUpb_CharClass_Newline
+#define E kUpb_CharClass_Escape
+#define U kUpb_CharClass_Unprintable
+
+// Non-ASCII characters are in no class.
+static const uint8_t kUpb_Tokenizer_CharClass[256] = {
+    0, U, U, U, U, U, U, U,                                  // 00-07
+    U, B|U, N|U, B|U, B|U, B|U, U, U,                        // 08-0F
+    U, U, U, U, U, U, U, U,                                  // 10-17
+    U, U, U, U, U, U, U, U,                                  // 18-1F
+    B, 0, E, 0, 0, 0, 0, E,                                  // ' '-'\''
+    0, 0, 0, 0, 0, 0, 0, 0,                                  // '('-'/'
+    D|O|H, D|O|H, D|O|H, D|O|H, D|O|H, D|O|H, D|O|H, D|O|H,  // '0'-'7'
+    D|H, D|H, 0, 0, 0, 0, 0, E,                              // '8'-'?'
+    0, L|H, L|H, L|H, L|H, L|H, L|H, L,                      // '@'-'G'
+    L, L, L, L, L, L, L, L,                                  // 'H'-'O'
+    L, L, L, L, L, L, L, L,                                  // 'P'-'W'
+    L, L, L, 0, E, 0, 0, L,                                  // 'X'-'_'
+    0, L|H|E, L|H|E, L|H, L|H, L|H, L|H|E, L,                // '`'-'g'
+    L, L, L, L, L, L, L|E, L,                                // 'h'-'o'
+    L, L, L|E, L, L|E, L, L|E, L,                            // 'p'-'w'
+    L, L, L, 0, 0, 0, 0, 0,                                  // 'x'-DEL
+};
 
-static bool upb_Tokenizer_IsAlphanumeric(char c) {
-  return upb_Tokenizer_IsLetter(c) || upb_Tokenizer_IsDigit(c);
+#undef L
+#undef D
+#undef O
+#undef H
+#undef B
+#undef N
+#undef E
+#undef U
+
+UPB_INLINE bool upb_Tokenizer_InClass(char c, int cls) {
+  return (kUpb_Tokenizer_CharClass[(uint8_t)c] & cls) != 0;
 }
 
-static bool upb_Tokenizer_IsWhitespaceNoNewline(char c) {
-  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+static bool upb_Tokenizer_IsLetter(char c) {
+  return upb_Tokenizer_InClass(c, kUpb_CharClass_Letter);
 }
 
-static bool upb_Tokenizer_IsWhitespace(char c) {
-  return c == '\n' || upb_Tokenizer_IsWhitespaceNoNewline(c);
+static bool upb_Tokenizer_IsOctalDigit(char c) {
+  return upb_Tokenizer_InClass(c, kUpb_CharClass_OctalDigit);
 }
 
-static bool upb_Tokenizer_IsEscape(char c) {
-  return c == 'a' || c == 'b' || c == 'f' || c == 'n' || c == 'r' || c == 't' ||
-         c == 'v' || c == '\\' || c == '?' || c == '\'' || c == '\"';
+static bool upb_Tokenizer_IsHexDigit(char c) {
+  return upb_Tokenizer_InClass(c, kUpb_CharClass_HexDigit);
 }
 
 static char TranslateEscape(char c) {
@@ -159,6 +205,11 @@ struct upb_Tokenizer {
   // e.g. tokens of TYPE_STRING will still be escaped and in quotes.
   upb_String token_text;
 
+  // With kUpb_TokenizerOption_AliasInput, the text of a token that did not
+  // cross a buffer boundary, pointing into the input.  Otherwise its data is
+  // NULL and the text is in token_text.
+  upb_StringView token_alias;
+
   // "line" and "column" specify the position of the first character of
   // the token within the input stream. They are zero-based.
   int token_line;
@@ -234,9 +285,13 @@ static void Refresh(upb_Tokenizer* t) {
   t->buffer = NULL;
   t->buffer_pos = 0;
 
+  // Without a stream, the end of the flat array is the end of input.
   upb_Status status;
-  const void* data =
-      upb_ZeroCopyInputStream_Next(t->input, &t->buffer_size, &status);
+  const void* data = NULL;
+  t->buffer_size = 0;
+  if (t->input) {
+    data = upb_ZeroCopyInputStream_Next(t->input, &t->buffer_size, &status);
+  }
 
   if (t->buffer_size > 0) {
     t->buffer = data;
@@ -271,6 +326,18 @@ static void NextChar(upb_Tokenizer* t) {
   }
 }
 
+// Moves to |ptr| within the current buffer, or to the start of the next
+// buffer if |ptr| is the end of this one.  The caller has already counted
+// the characters that were passed over.
+static void AdvanceTo(upb_Tokenizer* t, const char* ptr) {
+  t->buffer_pos = ptr - t->buffer;
+  if (t->buffer_pos < t->buffer_size) {
+    t->current_char = *ptr;
+  } else {
+    Refresh(t);
+  }
+}
+
 static void RecordTo(upb_Tokenizer* t, upb_String* target) {
   t->record_target = target;
   t->record_start = t->buffer_pos;
@@ -278,8 +345,16 @@ static void RecordTo(upb_Tokenizer* t, upb_String* target) {
 
 static void StopRecording(upb_Tokenizer* t) {
   if (t->buffer_pos > t->record_start) {
-    upb_String_Append(t->record_target, t->buffer + t->record_start,
-                      t->buffer_pos - t->record_start);
+    const char* start = t->buffer + t->record_start;
+    const size_t size = t->buffer_pos - t->record_start;
+    if ((t->options & kUpb_TokenizerOption_AliasInput) &&
+        t->record_target == &t->token_text &&
+        upb_String_Empty(&t->token_text)) {
+      // Refresh() has not copied any of the token, so it is all still here.
+      t->token_alias = upb_StringView_FromDataAndSize(start, size);
+    } else {
+      upb_String_Append(t->record_target, start, size);
+    }
   }
   t->record_target = NULL;
   t->record_start = -1;
@@ -290,6 +365,7 @@ static void StopRecording(upb_Tokenizer* t) {
 static void StartToken(upb_Tokenizer* t) {
   t->token_type = kUpb_TokenType_Start;
   upb_String_Clear(&t->token_text);
+  t->token_alias.data = NULL;
   t->token_line = t->line;
   t->token_column = t->column;
   RecordTo(t, &t->token_text);
@@ -311,14 +387,14 @@ static void EndToken(upb_Tokenizer* t) {
 
 // Returns true if the current character is of the given character
 // class, but does not consume anything.
-static bool LookingAt(const upb_Tokenizer* t, bool (*f)(char)) {
-  return f(t->current_char);
+static bool LookingAt(const upb_Tokenizer* t, int cls) {
+  return upb_Tokenizer_InClass(t->current_char, cls);
 }
 
 // If the current character is in the given class, consume it and return true.
 // Otherwise return false.
-static bool TryConsumeOne(upb_Tokenizer* t, bool (*f)(char)) {
-  if (f(t->current_char)) {
+static bool TryConsumeOne(upb_Tokenizer* t, int cls) {
+  if (upb_Tokenizer_InClass(t->current_char, cls)) {
     NextChar(t);
     return true;
   } else {
@@ -336,24 +412,76 @@ static bool TryConsume(upb_Tokenizer* t, char c) {
   }
 }
 
-// Consume zero or more of the given character class.
-static void ConsumeZeroOrMore(upb_Tokenizer* t, bool (*f)(char)) {
-  while (f(t->current_char)) {
-    NextChar(t);
+// Returns the first character in [ptr, end) that is not a space.
+static const char* SkipSpaces(const char* ptr, const char* end) {
+#ifdef UPB_TOKENIZER_SSE2
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' '))) != 0xffff) {
+      break;
+    }
+    ptr += 16;
+  }
+#else
+  while (end - ptr >= 8) {
+    uint64_t data;
+    memcpy(&data, ptr, 8);
+    if (data != 0x2020202020202020) break;
+    ptr += 8;
+  }
+#endif
+  while (ptr < end && *ptr == ' ') ptr++;
+  return ptr;
+}
+
+// Consume zero or more of the given character class.  Runs are scanned
+// directly in the current buffer, so NextChar() is only needed to move on
+// to the next one.
+static void ConsumeZeroOrMore(upb_Tokenizer* t, int cls) {
+  while (LookingAt(t, cls)) {
+    const char* ptr = t->buffer + t->buffer_pos;
+    const char* end = t->buffer + t->buffer_size;
+
+    if (cls & kUpb_CharClass_Whitespace) {
+      do {
+        if (*ptr == ' ') {
+          const char* run_end = SkipSpaces(ptr + 1, end);
+          t->column += run_end - ptr;
+          ptr = run_end;
+        } else if (*ptr == '\n') {
+          t->line++;
+          t->column = 0;
+          ptr++;
+        } else if (*ptr == '\t') {
+          t->column +=
+              kUpb_Tokenizer_TabWidth - t->column % kUpb_Tokenizer_TabWidth;
+          ptr++;
+        } else {
+          t->column++;
+          ptr++;
+        }
+      } while (ptr < end && upb_Tokenizer_InClass(*ptr, cls));
+    } else {
+      // No other class contains a newline or a tab.
+      const char* start = ptr;
+      do {
+        ptr++;
+      } while (ptr < end && upb_Tokenizer_InClass(*ptr, cls));
+      t->column += ptr - start;
+    }
+
+    AdvanceTo(t, ptr);
   }
 }
 
 // Consume one or more of the given character class or log the given
 // error message.
-static void ConsumeOneOrMore(upb_Tokenizer* t, bool (*f)(char),
-                             const char* err_msg) {
-  if (!f(t->current_char)) {
+static void ConsumeOneOrMore(upb_Tokenizer* t, int cls, const char* err_msg) {
+  if (!LookingAt(t, cls)) {
     ReportError(t, err_msg);
   }
 
-  do {
-    NextChar(t);
-  } while (f(t->current_char));
+  ConsumeZeroOrMore(t, cls);
 }
 
 // -----------------------------------------------------------------
@@ -362,6 +490,25 @@ static void ConsumeOneOrMore(upb_Tokenizer* t, bool (*f)(char),
 // the first, since the calling function consumes the first character
 // in order to decide what kind of token is being read.
 
+// Consumes the current character of a string literal, and any following ones
+// in the current buffer that need no special handling.
+static void ConsumeStringRun(upb_Tokenizer* t, char delimiter) {
+  if (t->current_char == '\t') {
+    NextChar(t);
+    return;
+  }
+
+  const char* ptr = t->buffer + t->buffer_pos;
+  const char* end = t->buffer + t->buffer_size;
+  const char* run_end = ptr + 1;
+  while (run_end < end && *run_end != delimiter && *run_end != '\\' &&
+         *run_end != '\0' && *run_end != '\t' && *run_end != '\n') {
+    run_end++;
+  }
+  t->column += run_end - ptr;
+  AdvanceTo(t, run_end);
+}
+
 // Read and consume a string, ending when the given delimiter is consumed.
 static void ConsumeString(upb_Tokenizer* t, char delimiter) {
   while (true) {
@@ -375,22 +522,22 @@ static void ConsumeString(upb_Tokenizer* t, char delimiter) {
       case '\\': {
         // An escape sequence.
         NextChar(t);
-        if (TryConsumeOne(t, upb_Tokenizer_IsEscape)) {
+        if (TryConsumeOne(t, kUpb_CharClass_Escape)) {
           // Valid escape sequence.
-        } else if (TryConsumeOne(t, upb_Tokenizer_IsOctalDigit)) {
+        } else if (TryConsumeOne(t, kUpb_CharClass_OctalDigit)) {
           // Possibly followed by two more octal digits, but these will
           // just be consumed by the main loop anyway so we don't need
           // to do so explicitly here.
         } else if (TryConsume(t, 'x')) {
-          if (!TryConsumeOne(t, upb_Tokenizer_IsHexDigit)) {
+          if (!TryConsumeOne(t, kUpb_CharClass_HexDigit)) {
             ReportError(t, "Expected hex digits for escape sequence.");
           }
           // Possibly followed by another hex digit, but again we don't care.
         } else if (TryConsume(t, 'u')) {
-          if (!TryConsumeOne(t, upb_Tokenizer_IsHexDigit) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit)) {
+          if (!TryConsumeOne(t, kUpb_CharClass_HexDigit) ||
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit) ||
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit) ||
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit)) {
             ReportError(t, "Expected four hex digits for \\u escape sequence.");
           }
         } else if (TryConsume(t, 'U')) {
@@ -398,11 +545,11 @@ static void ConsumeString(upb_Tokenizer* t, char delimiter) {
           // legal.
           if (!TryConsume(t, '0') || !TryConsume(t, '0') ||
               !(TryConsume(t, '0') || TryConsume(t, '1')) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit) ||
-              !TryConsumeOne(t, upb_Tokenizer_IsHexDigit)) {
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit) ||
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit) ||
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit) ||
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit) ||
+              !TryConsumeOne(t, kUpb_CharClass_HexDigit)) {
             ReportError(t,
                         "Expected eight hex digits up to 10ffff for \\U escape "
                         "sequence");
@@ -418,7 +565,7 @@ static void ConsumeString(upb_Tokenizer* t, char delimiter) {
           NextChar(t);
           return;
         }
-        NextChar(t);
+        ConsumeStringRun(t, delimiter);
         break;
       }
     }
@@ -435,13 +582,13 @@ static upb_TokenType ConsumeNumber(upb_Tokenizer* t, bool started_with_zero,
 
   if (started_with_zero && (TryConsume(t, 'x') || TryConsume(t, 'X'))) {
     // A hex number (started with "0x").
-    ConsumeOneOrMore(t, upb_Tokenizer_IsHexDigit,
+    ConsumeOneOrMore(t, kUpb_CharClass_HexDigit,
                      "\"0x\" must be followed by hex digits.");
 
-  } else if (started_with_zero && LookingAt(t, upb_Tokenizer_IsDigit)) {
+  } else if (started_with_zero && LookingAt(t, kUpb_CharClass_Digit)) {
     // An octal number (had a leading zero).
-    ConsumeZeroOrMore(t, upb_Tokenizer_IsOctalDigit);
-    if (LookingAt(t, upb_Tokenizer_IsDigit)) {
+    ConsumeZeroOrMore(t, kUpb_CharClass_OctalDigit);
+    if (LookingAt(t, kUpb_CharClass_Digit)) {
       ReportError(t, "Numbers starting with leading zero must be in octal.");
     }
 
@@ -449,20 +596,20 @@ static upb_TokenType ConsumeNumber(upb_Tokenizer* t, bool started_with_zero,
     // A decimal number.
     if (started_with_dot) {
       is_float = true;
-      ConsumeZeroOrMore(t, upb_Tokenizer_IsDigit);
+      ConsumeZeroOrMore(t, kUpb_CharClass_Digit);
     } else {
-      ConsumeZeroOrMore(t, upb_Tokenizer_IsDigit);
+      ConsumeZeroOrMore(t, kUpb_CharClass_Digit);
 
       if (TryConsume(t, '.')) {
         is_float = true;
-        ConsumeZeroOrMore(t, upb_Tokenizer_IsDigit);
+        ConsumeZeroOrMore(t, kUpb_CharClass_Digit);
       }
     }
 
     if (TryConsume(t, 'e') || TryConsume(t, 'E')) {
       is_float = true;
       if (!TryConsume(t, '-')) TryConsume(t, '+');
-      ConsumeOneOrMore(t, upb_Tokenizer_IsDigit,
+      ConsumeOneOrMore(t, kUpb_CharClass_Digit,
                        "\"e\" must be followed by exponent.");
     }
 
@@ -471,7 +618,7 @@ static upb_TokenType ConsumeNumber(upb_Tokenizer* t, bool started_with_zero,
     }
   }
 
-  if (LookingAt(t, upb_Tokenizer_IsLetter)) {
+  if (LookingAt(t, kUpb_CharClass_Letter)) {
     ReportError(t, "Need space between number and identifier.");
   }
 
@@ -487,13 +634,77 @@ static upb_TokenType ConsumeNumber(upb_Tokenizer* t, bool started_with_zero,
   return is_float ? kUpb_TokenType_Float : kUpb_TokenType_Integer;
 }
 
+#ifndef UPB_TOKENIZER_SSE2
+// Returns nonzero if any byte of |data| is |c|.  The test is exact per byte,
+// so there are no false positives from borrows.
+UPB_INLINE uint64_t HasByte(uint64_t data, char c) {
+  const uint64_t msbs = 0x8080808080808080;
+  const uint64_t x = data ^ (0x0101010101010101 * (uint8_t)c);
+  return ~(((x & ~msbs) + ~msbs) | x) & msbs;
+}
+#endif
+
+// Returns the first '\0', '\t' or '\n' in [ptr, end), or also the first '*'
+// or '/' for a block comment, or |end| if there is none.  Every character
+// before it advances the column by one.
+static const char* ScanComment(const char* ptr, const char* end, bool block) {
+#ifdef UPB_TOKENIZER_SSE2
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+    __m128i stop = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    if (block) {
+      stop = _mm_or_si128(
+          stop, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('/'))));
+    }
+    if (_mm_movemask_epi8(stop)) break;
+    ptr += 16;
+  }
+#else
+  while (end - ptr >= 8) {
+    uint64_t data;
+    memcpy(&data, ptr, 8);
+    uint64_t stop = HasByte(data, '\0') | HasByte(data, '\t') |
+                    HasByte(data, '\n');
+    if (block) stop |= HasByte(data, '*') | HasByte(data, '/');
+    if (stop) break;
+    ptr += 8;
+  }
+#endif
+  while (ptr < end && *ptr != '\0' && *ptr != '\t' && *ptr != '\n' &&
+         (!block || (*ptr != '*' && *ptr != '/'))) {
+    ptr++;
+  }
+  return ptr;
+}
+
+// Consumes comment text up to the next '\0' or '\n', or for a block comment
+// also up to the next '*' or '/'.
+static void ConsumeCommentText(upb_Tokenizer* t, bool block) {
+  while (true) {
+    const char c = t->current_char;
+    if (c == '\0' || c == '\n' || (block && (c == '*' || c == '/'))) return;
+    if (c == '\t') {
+      NextChar(t);
+      continue;
+    }
+
+    const char* ptr = t->buffer + t->buffer_pos;
+    const char* end = t->buffer + t->buffer_size;
+    const char* run_end = ScanComment(ptr + 1, end, block);
+    t->column += run_end - ptr;
+    AdvanceTo(t, run_end);
+  }
+}
+
 // Consume the rest of a line.
 static void ConsumeLineComment(upb_Tokenizer* t, upb_String* content) {
   if (content != NULL) RecordTo(t, content);
 
-  while (t->current_char != '\0' && t->current_char != '\n') {
-    NextChar(t);
-  }
+  ConsumeCommentText(t, false);
   TryConsume(t, '\n');
 
   if (content != NULL) StopRecording(t);
@@ -506,16 +717,13 @@ static void ConsumeBlockComment(upb_Tokenizer* t, upb_String* content) {
   if (content != NULL) RecordTo(t, content);
 
   while (true) {
-    while (t->current_char != '\0' && t->current_char != '*' &&
-           t->current_char != '/' && t->current_char != '\n') {
-      NextChar(t);
-    }
+    ConsumeCommentText(t, true);
 
     if (TryConsume(t, '\n')) {
       if (content != NULL) StopRecording(t);
 
       // Consume leading whitespace and asterisk;
-      ConsumeZeroOrMore(t, upb_Tokenizer_IsWhitespaceNoNewline);
+      ConsumeZeroOrMore(t, kUpb_CharClass_Blank);
       if (TryConsume(t, '*')) {
         if (TryConsume(t, '/')) {
           // End of comment.
@@ -576,15 +784,15 @@ static upb_CommentType TryConsumeCommentStart(upb_Tokenizer* t) {
 // consume it and return true.
 static bool TryConsumeWhitespace(upb_Tokenizer* t) {
   if (t->options & kUpb_TokenizerOption_ReportNewlines) {
-    if (TryConsumeOne(t, upb_Tokenizer_IsWhitespaceNoNewline)) {
-      ConsumeZeroOrMore(t, upb_Tokenizer_IsWhitespaceNoNewline);
+    if (TryConsumeOne(t, kUpb_CharClass_Blank)) {
+      ConsumeZeroOrMore(t, kUpb_CharClass_Blank);
       t->token_type = kUpb_TokenType_Whitespace;
       return true;
     }
     return false;
   }
-  if (TryConsumeOne(t, upb_Tokenizer_IsWhitespace)) {
-    ConsumeZeroOrMore(t, upb_Tokenizer_IsWhitespace);
+  if (TryConsumeOne(t, kUpb_CharClass_Whitespace)) {
+    ConsumeZeroOrMore(t, kUpb_CharClass_Whitespace);
     t->token_type = kUpb_TokenType_Whitespace;
     return (t->options & kUpb_TokenizerOption_ReportWhitespace) != 0;
   }
@@ -614,11 +822,11 @@ int upb_Tokenizer_EndColumn(const upb_Tokenizer* t) {
 int upb_Tokenizer_Line(const upb_Tokenizer* t) { return t->token_line; }
 
 int upb_Tokenizer_TextSize(const upb_Tokenizer* t) {
-  return t->token_text.size_;
+  return t->token_alias.data ? t->token_alias.size : t->token_text.size_;
 }
 
 const char* upb_Tokenizer_TextData(const upb_Tokenizer* t) {
-  return t->token_text.data_;
+  return t->token_alias.data ? t->token_alias.data : t->token_text.data_;
 }
 
 upb_TokenType upb_Tokenizer_Type(const upb_Tokenizer* t) {
@@ -631,14 +839,28 @@ bool upb_Tokenizer_Next(upb_Tokenizer* t, upb_Status* status) {
   t->previous_line = t->token_line;
   t->previous_column = t->token_column;
   t->previous_end_column = t->token_end_column;
+  t->token_alias.data = NULL;
 
   if (UPB_SETJMP(t->err)) return false;
 
   while (!t->read_error) {
-    StartToken(t);
-    bool report_token = TryConsumeWhitespace(t) || TryConsumeNewline(t);
-    EndToken(t);
-    if (report_token) return true;
+    if (t->options & kUpb_TokenizerOption_ReportWhitespace) {
+      StartToken(t);
+      bool report_token = TryConsumeWhitespace(t) || TryConsumeNewline(t);
+      EndToken(t);
+      if (report_token) return true;
+    } else {
+      // Whitespace is not a token, so skip it without recording its text.
+      t->token_type = kUpb_TokenType_Start;
+      upb_String_Clear(&t->token_text);
+      t->token_line = t->line;
+      t->token_column = t->column;
+      if (LookingAt(t, kUpb_CharClass_Whitespace)) {
+        ConsumeZeroOrMore(t, kUpb_CharClass_Whitespace);
+        t->token_type = kUpb_TokenType_Whitespace;
+      }
+      t->token_end_column = t->column;
+    }
 
     switch (TryConsumeCommentStart(t)) {
       case kUpb_CommentType_Line:
@@ -656,15 +878,15 @@ bool upb_Tokenizer_Next(upb_Tokenizer* t, upb_Status* status) {
     // Check for EOF before continuing.
     if (t->read_error) break;
 
-    if (LookingAt(t, upb_Tokenizer_IsUnprintable) || t->current_char == '\0') {
+    if (LookingAt(t, kUpb_CharClass_Unprintable) || t->current_char == '\0') {
       ReportError(t, "Invalid control characters encountered in text.");
     }
 
     // Reading some sort of token.
     StartToken(t);
 
-    if (TryConsumeOne(t, upb_Tokenizer_IsLetter)) {
-      ConsumeZeroOrMore(t, upb_Tokenizer_IsAlphanumeric);
+    if (LookingAt(t, kUpb_CharClass_Letter)) {
+      ConsumeZeroOrMore(t, kUpb_CharClass_Alphanumeric);
       t->token_type = kUpb_TokenType_Identifier;
     } else if (TryConsume(t, '0')) {
       t->token_type = ConsumeNumber(t, true, false);
@@ -672,7 +894,7 @@ bool upb_Tokenizer_Next(upb_Tokenizer* t, upb_Status* status) {
       // This could be the beginning of a floating-point number, or it could
       // just be a '.' symbol.
 
-      if (TryConsumeOne(t, upb_Tokenizer_IsDigit)) {
+      if (TryConsumeOne(t, kUpb_CharClass_Digit)) {
         // It's a floating-point number.
         if (t->previous_type == kUpb_TokenType_Identifier &&
             t->token_line == t->previous_line &&
@@ -685,7 +907,7 @@ bool upb_Tokenizer_Next(upb_Tokenizer* t, upb_Status* status) {
       } else {
         t->token_type = kUpb_TokenType_Symbol;
       }
-    } else if (TryConsumeOne(t, upb_Tokenizer_IsDigit)) {
+    } else if (TryConsumeOne(t, kUpb_CharClass_Digit)) {
       t->token_type = ConsumeNumber(t, false, false);
     } else if (TryConsume(t, '\"')) {
       ConsumeString(t, '\"');
@@ -784,8 +1006,9 @@ bool upb_Parse_Integer(const char* text, uint64_t max_value, uint64_t* output) {
 }
 
 double upb_Parse_Float(const char* text) {
-  char* end;
-  double result = _upb_NoLocaleStrtod(text, &end);
+  double result;
+  const char* end = upb_BufToDouble(text, text + strlen(text), &result);
+  if (!end) end = text;
 
   // "1e" is not a valid float, but if the tokenizer reads it, it will
   // report an error but still return it as a valid token.  We need to
@@ -956,9 +1179,9 @@ upb_StringView upb_Parse_String(const char* text, upb_Arena* arena) {
                                         upb_String_Size(&output));
 }
 
-static bool AllInClass(bool (*f)(char), const char* text, int size) {
+static bool AllInClass(int cls, const char* text, int size) {
   for (int i = 0; i < size; i++) {
-    if (!f(text[i])) return false;
+    if (!upb_Tokenizer_InClass(text[i], cls)) return false;
   }
   return true;
 }
@@ -967,7 +1190,7 @@ bool upb_Tokenizer_IsIdentifier(const char* data, int size) {
   // Mirrors IDENTIFIER definition in Tokenizer::Next() above.
   if (size == 0) return false;
   if (!upb_Tokenizer_IsLetter(data[0])) return false;
-  if (!AllInClass(upb_Tokenizer_IsAlphanumeric, data + 1, size - 1))
+  if (!AllInClass(kUpb_CharClass_Alphanumeric, data + 1, size - 1))
     return false;
   return true;
 }
@@ -996,6 +1219,7 @@ upb_Tokenizer* upb_Tokenizer_New(const void* data, size_t size,
   t->options = options;
 
   upb_String_Init(&t->token_text, arena);
+  t->token_alias.data = NULL;
   t->token_type = kUpb_TokenType_Start;
   t->token_line = 0;
   t->token_column = 0;
@@ -1017,7 +1241,7 @@ upb_Tokenizer* upb_Tokenizer_New(const void* data, size_t size,
 void upb_Tokenizer_Fini(upb_Tokenizer* t) {
   // If we had any buffer left unread, return it to the underlying stream
   // so that someone else can read it.
-  if (t->buffer_size > t->buffer_pos) {
+  if (t->input && t->buffer_size > t->buffer_pos) {
     upb_ZeroCopyInputStream_BackUp(t->input, t->buffer_size - t->buffer_pos);
   }
 }
@@ -101,6 +101,13 @@ typedef enum {
   // By default the tokenizer expects C-style (/* */) comments.
   // If set, it expects shell-style (#) comments instead.
   kUpb_TokenizerOption_CommentStyleShell = 1 << 3,
+
+  // If set, the text of a token that lies within a single input buffer
+  // points into that buffer instead of being copied.  Only tokens that cross
+  // into the next buffer are copied.  The text is then not NUL-terminated,
+  // so upb_Tokenizer_TextSize() must be used, and it is only valid until the
+  // next call to upb_Tokenizer_Next() or upb_Tokenizer_Fini().
+  kUpb_TokenizerOption_AliasInput = 1 << 4,
 } upb_Tokenizer_Option;
 
 typedef struct upb_Tokenizer upb_Tokenizer;
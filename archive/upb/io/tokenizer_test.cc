@@ -484,6 +484,55 @@ TEST_2D(TokenizerTest, MultipleTokens, kMultiTokenCases, kBlockSizes) {
   } while (token_fields.type != kUpb_TokenType_End);
 }
 
+TEST_2D(TokenizerTest, AliasInput, kMultiTokenCases, kBlockSizes) {
+  // Same as above, but tokens that fit in one block point into the input.
+  const std::string& text = kMultiTokenCases_case.input;
+  upb::Arena arena;
+  auto input = TestInputStream(text.data(), text.size(), kBlockSizes_case,
+                               arena.ptr());
+  auto t = upb_Tokenizer_New(NULL, 0, input, kUpb_TokenizerOption_AliasInput,
+                             arena.ptr());
+
+  TokenFields token_fields;
+  upb_Status status;
+  upb_Status_Clear(&status);
+  size_t offset = 0;
+  int i = 0;
+  do {
+    token_fields = kMultiTokenCases_case.output[i++];
+
+    SCOPED_TRACE(testing::Message()
+                 << "Token #" << i << ": " << absl::CEscape(token_fields.text));
+
+    if (token_fields.type == kUpb_TokenType_End) {
+      EXPECT_FALSE(upb_Tokenizer_Next(t, &status));
+      EXPECT_TRUE(upb_Status_IsOk(&status));
+    } else {
+      EXPECT_TRUE(upb_Tokenizer_Next(t, NULL));
+    }
+
+    EXPECT_EQ(upb_Tokenizer_Type(t), token_fields.type);
+    EXPECT_EQ(upb_Tokenizer_Line(t), token_fields.line);
+    EXPECT_EQ(upb_Tokenizer_Column(t), token_fields.column);
+    EXPECT_EQ(upb_Tokenizer_EndColumn(t), token_fields.end_column);
+    const char* data = upb_Tokenizer_TextData(t);
+    const int size = upb_Tokenizer_TextSize(t);
+    EXPECT_EQ(std::string(data, size), token_fields.text);
+
+    // A token that ends before its block (and the input) does is never
+    // copied.
+    if (size > 0) {
+      const size_t start = text.find(token_fields.text, offset);
+      ASSERT_NE(start, std::string::npos);
+      offset = start + size;
+      if (start / kBlockSizes_case == offset / kBlockSizes_case &&
+          offset < text.size()) {
+        EXPECT_EQ(data, text.data() + start);
+      }
+    }
+  } while (token_fields.type != kUpb_TokenType_End);
+}
+
 MultiTokenCase kMultiWhitespaceTokenCases[] = {
     // Test all token types at the same time.
     {"foo 1 \t1.2  \n   +\v'bar'",
@@ -37,10 +37,17 @@
 // process is run with a variety of block sizes for both the input and
 // the output.
 
+#ifndef _WIN32
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
 #include "gtest/gtest.h"
 #include "upb/base/status.hpp"
+#include "upb/io/async_output_stream.h"
 #include "upb/io/chunked_input_stream.h"
 #include "upb/io/chunked_output_stream.h"
+#include "upb/io/file_input_stream.h"
 #include "upb/mem/arena.hpp"
 
 namespace upb {
@@ -74,6 +81,12 @@ class IoTest : public testing::Test {
   // via WriteStuffLarge().
   void ReadStuffLarge(upb_ZeroCopyInputStream* input);
 
+#ifndef _WIN32
+  // Writes |size| bytes of |data| to a new temporary file and returns a
+  // descriptor for it, positioned at the start.
+  int WriteTempFile(const void* data, int size);
+#endif
+
   static const int kBlockSizes[];
   static const int kBlockSizeCount;
 };
@@ -209,6 +222,18 @@ void IoTest::ReadStuffLarge(upb_ZeroCopyInputStream* input) {
   EXPECT_EQ(ReadFromInput(input, &byte, 1), 0);
 }
 
+#ifndef _WIN32
+int IoTest::WriteTempFile(const void* data, int size) {
+  char path[] = "/tmp/upb_io_test_XXXXXX";
+  int fd = mkstemp(path);
+  EXPECT_GE(fd, 0);
+  unlink(path);
+  EXPECT_EQ(write(fd, data, size), size);
+  EXPECT_EQ(lseek(fd, 0, SEEK_SET), 0);
+  return fd;
+}
+#endif
+
 // ===================================================================
 
 TEST_F(IoTest, ArrayIo) {
@@ -228,6 +253,170 @@ TEST_F(IoTest, ArrayIo) {
   }
 }
 
+#ifndef _WIN32
+TEST_F(IoTest, FileIo) {
+  const int kBufferSize = 256;
+  uint8_t buffer[kBufferSize];
+
+  upb::Arena arena;
+  auto output =
+      upb_ChunkedOutputStream_New(buffer, kBufferSize, 7, arena.ptr());
+  int size = WriteStuff(output);
+  int fd = WriteTempFile(buffer, size);
+
+  for (int i = 0; i < kBlockSizeCount; i++) {
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+    auto input = upb_FileInputStream_New(fd, kBlockSizes[i], arena.ptr());
+    ReadStuff(input);
+  }
+
+  auto input = upb_MmapInputStream_New(fd, arena.ptr());
+  ASSERT_NE(input, nullptr);
+  ReadStuff(input);
+  upb_MmapInputStream_Free(input);
+  close(fd);
+}
+
+TEST_F(IoTest, LargeFileIo) {
+  std::unique_ptr<uint8_t[]> buffer(new uint8_t[256 * 1024]);
+
+  upb::Arena arena;
+  auto output =
+      upb_ChunkedOutputStream_New(buffer.get(), 256 * 1024, 4096, arena.ptr());
+  int size = WriteStuffLarge(output);
+  int fd = WriteTempFile(buffer.get(), size);
+
+  for (size_t block_size : {1000, 0}) {
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+    auto input = upb_FileInputStream_New(fd, block_size, arena.ptr());
+    ReadStuffLarge(input);
+  }
+
+  auto input = upb_MmapInputStream_New(fd, arena.ptr());
+  ASSERT_NE(input, nullptr);
+  ReadStuffLarge(input);
+  upb_MmapInputStream_Free(input);
+  close(fd);
+}
+
+TEST_F(IoTest, PipeIo) {
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+
+  upb::Arena arena;
+  ASSERT_EQ(write(fds[1], "Hello world!\nSome text.", 23), 23);
+  close(fds[1]);
+
+  // Pipes can't be mapped, but they can be read.
+  EXPECT_EQ(upb_MmapInputStream_New(fds[0], arena.ptr()), nullptr);
+  auto input = upb_FileInputStream_New(fds[0], 5, arena.ptr());
+  ReadString(input, "Hello world!\n");
+  EXPECT_TRUE(upb_ZeroCopyInputStream_Skip(input, 5));
+  ReadString(input, "text.");
+  EXPECT_FALSE(upb_ZeroCopyInputStream_Skip(input, 1));
+  EXPECT_EQ(upb_ZeroCopyInputStream_ByteCount(input), 23);
+  close(fds[0]);
+}
+
+TEST_F(IoTest, AsyncFileIo) {
+  upb::Arena arena;
+  for (int i = 0; i < kBlockSizeCount; i++) {
+    for (int block_count : {2, 3}) {
+      int fd = WriteTempFile("", 0);
+      auto output = upb_AsyncOutputStream_New(fd, kBlockSizes[i], block_count,
+                                              arena.ptr());
+      ASSERT_NE(output, nullptr);
+      WriteStuff(output);
+      upb::Status status;
+      EXPECT_TRUE(upb_AsyncOutputStream_Close(output, status.ptr()));
+
+      ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+      ReadStuff(upb_FileInputStream_New(fd, 0, arena.ptr()));
+      close(fd);
+    }
+  }
+}
+
+TEST_F(IoTest, LargeAsyncFileIo) {
+  upb::Arena arena;
+  for (size_t block_size : {1000, 0}) {
+    int fd = WriteTempFile("", 0);
+    auto output = upb_AsyncOutputStream_New(fd, block_size, 0, arena.ptr());
+    ASSERT_NE(output, nullptr);
+    WriteString(output, "Hello world!\n");
+    upb::Status status;
+    EXPECT_TRUE(upb_AsyncOutputStream_Flush(output, status.ptr()));
+    EXPECT_EQ(lseek(fd, 0, SEEK_CUR), 13);
+    WriteString(output, "Some te");
+    WriteString(output, "xt.  Blah blah.");
+    WriteString(output, std::string(100000, 'x'));
+    WriteString(output, std::string(100000, 'y'));
+    WriteString(output, "01234567890123456789");
+    EXPECT_EQ(upb_ZeroCopyOutputStream_ByteCount(output), 200055);
+    EXPECT_TRUE(upb_AsyncOutputStream_Close(output, status.ptr()));
+
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+    ReadStuffLarge(upb_FileInputStream_New(fd, 0, arena.ptr()));
+    close(fd);
+  }
+}
+
+// Check that a write error is reported by Next() and Close().
+TEST(AsyncStream, WriteError) {
+  upb::Arena arena;
+  auto output = upb_AsyncOutputStream_New(-1, 16, 2, arena.ptr());
+  ASSERT_NE(output, nullptr);
+  size_t size;
+  upb::Status status;
+  void* data = nullptr;
+  for (int i = 0; i < 100; i++) {
+    data = upb_ZeroCopyOutputStream_Next(output, &size, status.ptr());
+    if (!data) break;
+    memset(data, 'x', size);
+  }
+  EXPECT_EQ(data, nullptr);
+  EXPECT_EQ(size, 0);
+  EXPECT_FALSE(upb_Status_IsOk(status.ptr()));
+
+  upb::Status close_status;
+  EXPECT_FALSE(upb_AsyncOutputStream_Close(output, close_status.ptr()));
+  EXPECT_FALSE(upb_Status_IsOk(close_status.ptr()));
+}
+
+// Check that a read error is reported, and keeps being reported.
+TEST(FileStream, ReadError) {
+  upb::Arena arena;
+  auto input = upb_FileInputStream_New(-1, 0, arena.ptr());
+  for (int i = 0; i < 2; i++) {
+    size_t size;
+    upb::Status status;
+    const void* data = upb_ZeroCopyInputStream_Next(input, &size, status.ptr());
+    EXPECT_EQ(data, nullptr);
+    EXPECT_EQ(size, 0);
+    EXPECT_FALSE(upb_Status_IsOk(status.ptr()));
+  }
+}
+
+// Check that an empty file doesn't confuse the code.
+TEST_F(IoTest, FileEOF) {
+  upb::Arena arena;
+  int fd = WriteTempFile("", 0);
+  for (int i = 0; i < 2; i++) {
+    auto input = i ? upb_MmapInputStream_New(fd, arena.ptr())
+                   : upb_FileInputStream_New(fd, 0, arena.ptr());
+    ASSERT_NE(input, nullptr);
+    size_t size;
+    upb::Status status;
+    const void* data = upb_ZeroCopyInputStream_Next(input, &size, status.ptr());
+    EXPECT_EQ(data, nullptr);
+    EXPECT_EQ(size, 0);
+    EXPECT_TRUE(upb_Status_IsOk(status.ptr()));
+    if (i) upb_MmapInputStream_Free(input);
+  }
+  close(fd);
+}
+#endif
+
 TEST(ChunkedStream, SingleInput) {
   const int kBufferSize = 256;
   uint8_t buffer[kBufferSize];
@@ -30,7 +30,6 @@
 
 #include "upb/json/decode.h"
 
-#include <errno.h>
 #include <float.h>
 #include <inttypes.h>
 #include <limits.h>
@@ -38,15 +37,36 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "upb/collections/array.h"
 #include "upb/collections/map.h"
+#include "upb/json/internal/scan.h"
 #include "upb/lex/atoi.h"
+#include "upb/lex/base64.h"
+#include "upb/lex/strtod.h"
+#include "upb/lex/timestamp.h"
 #include "upb/lex/unicode.h"
+#include "upb/lex/utf8.h"
+#include "upb/mem/alloc.h"
 #include "upb/reflection/message.h"
 #include "upb/wire/encode.h"
 
 // Must be last.
 #include "upb/port/def.inc"
 
+/* Remembers which field followed |prev| (a field, or the message itself for
+ * the first field) the last time.  Messages of one type usually list their
+ * fields in the same order, so this mostly avoids the name lookup when
+ * decoding many of them. */
+typedef struct {
+  const void* prev;
+  const upb_MessageDef* m;
+  const upb_FieldDef* next;
+  const char* name; /* The name |next| was given by, JSON or proto. */
+  size_t size;
+} jsondec_nextfield;
+
+enum { kJsonDecFieldCacheBits = 8 };
+
 typedef struct {
   const char *ptr, *end;
   upb_Arena* arena; /* TODO: should we have a tmp arena for tmp data? */
@@ -55,12 +75,31 @@ typedef struct {
   upb_Status* status;
   jmp_buf err;
   int line;
-  const char* line_begin;
+  size_t line_begin; /* Input offset of the current line's start. */
   bool is_first;
   int options;
   const upb_FieldDef* debug_field;
+
+  /* Input position.  |base| is at input offset |base_pos|, so offsets stay
+   * meaningful when streaming input moves to a new chunk.  Input from offset
+   * |pin| onward (SIZE_MAX for none) is kept in memory across refills, copied
+   * into |window| if necessary.  |stream| is NULL when the whole input is in
+   * memory. */
+  upb_ZeroCopyInputStream* stream;
+  const char* base;
+  size_t base_pos;
+  size_t pin;
+  char* window;
+  size_t window_size;
+
+  /* Field cache for batches, or NULL.  |prev_field| is the last field
+   * decoded in the current object, or NULL. */
+  jsondec_nextfield* field_cache;
+  const upb_FieldDef* prev_field;
 } jsondec;
 
+enum { kJsonDecMinWindow = 4096 };
+
 enum { JD_OBJECT, JD_ARRAY, JD_STRING, JD_NUMBER, JD_TRUE, JD_FALSE, JD_NULL };
 
 /* Forward declarations of mutually-recursive functions. */
@@ -89,9 +128,17 @@ static bool jsondec_isvalue(const upb_FieldDef* f) {
          jsondec_isnullvalue(f);
 }
 
+static size_t jsondec_pos(const jsondec* d, const char* ptr) {
+  return d->base_pos + (size_t)(ptr - d->base);
+}
+
+static const char* jsondec_at(const jsondec* d, size_t pos) {
+  return d->base + (pos - d->base_pos);
+}
+
 UPB_NORETURN static void jsondec_err(jsondec* d, const char* msg) {
   upb_Status_SetErrorFormat(d->status, "Error parsing JSON @%d:%d: %s", d->line,
-                            (int)(d->ptr - d->line_begin), msg);
+                            (int)(jsondec_pos(d, d->ptr) - d->line_begin), msg);
   UPB_LONGJMP(d->err, 1);
 }
 
@@ -99,42 +146,139 @@ UPB_PRINTF(2, 3)
 UPB_NORETURN static void jsondec_errf(jsondec* d, const char* fmt, ...) {
   va_list argp;
   upb_Status_SetErrorFormat(d->status, "Error parsing JSON @%d:%d: ", d->line,
-                            (int)(d->ptr - d->line_begin));
+                            (int)(jsondec_pos(d, d->ptr) - d->line_begin));
   va_start(argp, fmt);
   upb_Status_VAppendErrorFormat(d->status, fmt, argp);
   va_end(argp);
   UPB_LONGJMP(d->err, 1);
 }
 
-static void jsondec_skipws(jsondec* d) {
-  while (d->ptr != d->end) {
+/* Reads more streaming input once d->ptr has reached d->end.  Input from the
+ * pin (or d->ptr) onward is moved to the front of the window first, so callers
+ * must hold on to earlier input by offset, not by pointer.  Returns false at
+ * EOF or when there is no stream. */
+UPB_NOINLINE static bool jsondec_fill(jsondec* d) {
+  if (!d->stream) return false;
+
+  size_t keep_pos = UPB_MIN(d->pin, jsondec_pos(d, d->ptr));
+  const char* keep = jsondec_at(d, keep_pos);
+  size_t keep_len = d->end - keep;
+  size_t ptr_ofs = d->ptr - keep;
+
+  if (keep_len) {
+    if (keep_len + kJsonDecMinWindow > d->window_size) {
+      size_t size = UPB_MAX(2 * d->window_size, keep_len + kJsonDecMinWindow);
+      char* window = upb_gmalloc(size);
+      if (!window) jsondec_err(d, "Out of memory");
+      memcpy(window, keep, keep_len);
+      upb_gfree(d->window);
+      d->window = window;
+      d->window_size = size;
+    } else if (keep != d->window) {
+      memmove(d->window, keep, keep_len);
+    }
+    d->base = d->window;
+    d->base_pos = keep_pos;
+    d->ptr = d->window + ptr_ofs;
+    d->end = d->window + keep_len;
+  }
+
+  size_t count;
+  const char* chunk =
+      upb_ZeroCopyInputStream_Next(d->stream, &count, d->status);
+  if (!chunk) {
+    if (!upb_Status_IsOk(d->status)) UPB_LONGJMP(d->err, 1);
+    d->stream = NULL;
+    return false;
+  }
+
+  if (!keep_len) {
+    /* Nothing to keep, so parse straight out of the stream's buffer. */
+    d->base = d->ptr = chunk;
+    d->base_pos = keep_pos;
+    d->end = chunk + count;
+    return true;
+  }
+
+  size_t n = UPB_MIN(count, d->window_size - keep_len);
+  memcpy(d->window + keep_len, chunk, n);
+  upb_ZeroCopyInputStream_BackUp(d->stream, count - n);
+  d->end += n;
+  return true;
+}
+
+/* Returns true if there is at least one more byte of input. */
+static bool jsondec_more(jsondec* d) {
+  return d->ptr != d->end || jsondec_fill(d);
+}
+
+/* Returns true if at least |n| contiguous bytes of input are available. */
+static bool jsondec_ensure(jsondec* d, size_t n) {
+  while ((size_t)(d->end - d->ptr) < n) {
+    if (!jsondec_fill(d)) return false;
+  }
+  return true;
+}
+
+/* Skips spaces, tabs and carriage returns, stopping at newlines so the caller
+ * can count lines.  Indentation comes in long runs, so whole blocks are
+ * skipped at a time. */
+static const char* jsondec_skipblanks(const char* ptr, const char* end) {
+#ifdef UPB_JSON_SSE2
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+    __m128i blank = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    if (_mm_movemask_epi8(blank) != 0xffff) break;
+    ptr += 16;
+  }
+#else
+  while (end - ptr >= 8) {
+    uint64_t data;
+    memcpy(&data, ptr, 8);
+    if (data != 0x2020202020202020) break;
+    ptr += 8;
+  }
+#endif
+  while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')) ptr++;
+  return ptr;
+}
+
+/* Skips whitespace, returning false at EOF. */
+static bool jsondec_tryskipws(jsondec* d) {
+  while (jsondec_more(d)) {
     switch (*d->ptr) {
       case '\n':
         d->line++;
-        d->line_begin = d->ptr;
+        d->line_begin = jsondec_pos(d, d->ptr);
         /* Fallthrough. */
       case '\r':
       case '\t':
       case ' ':
-        d->ptr++;
+        d->ptr = jsondec_skipblanks(d->ptr + 1, d->end);
         break;
       default:
-        return;
+        return true;
     }
   }
-  jsondec_err(d, "Unexpected EOF");
+  return false;
+}
+
+static void jsondec_skipws(jsondec* d) {
+  if (!jsondec_tryskipws(d)) jsondec_err(d, "Unexpected EOF");
 }
 
 static bool jsondec_tryparsech(jsondec* d, char ch) {
-  if (d->ptr == d->end || *d->ptr != ch) return false;
+  if (!jsondec_more(d) || *d->ptr != ch) return false;
   d->ptr++;
   return true;
 }
 
 static void jsondec_parselit(jsondec* d, const char* lit) {
-  size_t avail = d->end - d->ptr;
   size_t len = strlen(lit);
-  if (avail < len || memcmp(d->ptr, lit, len) != 0) {
+  if (!jsondec_ensure(d, len) || memcmp(d->ptr, lit, len) != 0) {
     jsondec_errf(d, "Expected: '%s'", lit);
   }
   d->ptr += len;
@@ -251,16 +395,17 @@ static bool jsondec_objnext(jsondec* d) {
 /* JSON number ****************************************************************/
 
 static bool jsondec_tryskipdigits(jsondec* d) {
-  const char* start = d->ptr;
+  bool any = false;
 
-  while (d->ptr < d->end) {
+  while (jsondec_more(d)) {
     if (*d->ptr < '0' || *d->ptr > '9') {
       break;
     }
     d->ptr++;
+    any = true;
   }
 
-  return d->ptr != start;
+  return any;
 }
 
 static void jsondec_skipdigits(jsondec* d) {
@@ -269,12 +414,17 @@ static void jsondec_skipdigits(jsondec* d) {
   }
 }
 
-static double jsondec_number(jsondec* d) {
-  const char* start = d->ptr;
+/* Skips over the syntax of a number, as specified by JSON, returning its
+ * start.  Sets |*is_integer| if it has neither a fraction nor an exponent. */
+static const char* jsondec_skipnumber(jsondec* d, bool* is_integer) {
+  /* Pin the start so the number stays in memory if the input is refilled. */
+  size_t saved_pin = d->pin;
+  size_t start = jsondec_pos(d, d->ptr);
+  d->pin = UPB_MIN(saved_pin, start);
 
   assert(jsondec_rawpeek(d) == JD_NUMBER);
 
-  /* Skip over the syntax of a number, as specified by JSON. */
+  *is_integer = true;
   if (*d->ptr == '-') d->ptr++;
 
   if (jsondec_tryparsech(d, '0')) {
@@ -285,15 +435,14 @@ static double jsondec_number(jsondec* d) {
     jsondec_skipdigits(d);
   }
 
-  if (d->ptr == d->end) goto parse;
   if (jsondec_tryparsech(d, '.')) {
+    *is_integer = false;
     jsondec_skipdigits(d);
   }
-  if (d->ptr == d->end) goto parse;
 
-  if (*d->ptr == 'e' || *d->ptr == 'E') {
-    d->ptr++;
-    if (d->ptr == d->end) {
+  if (jsondec_tryparsech(d, 'e') || jsondec_tryparsech(d, 'E')) {
+    *is_integer = false;
+    if (!jsondec_more(d)) {
       jsondec_err(d, "Unexpected EOF in number");
     }
     if (*d->ptr == '+' || *d->ptr == '-') {
@@ -302,30 +451,28 @@ static double jsondec_number(jsondec* d) {
     jsondec_skipdigits(d);
   }
 
-parse:
-  /* Having verified the syntax of a JSON number, use strtod() to parse
-   * (strtod() accepts a superset of JSON syntax). */
-  errno = 0;
-  {
-    char* end;
-    double val = strtod(start, &end);
-    assert(end == d->ptr);
-
-    /* Currently the min/max-val conformance tests fail if we check this.  Does
-     * this mean the conformance tests are wrong or strtod() is wrong, or
-     * something else?  Investigate further. */
-    /*
-    if (errno == ERANGE) {
-      jsondec_err(d, "Number out of range");
-    }
-    */
+  d->pin = saved_pin;
+  return jsondec_at(d, start);
+}
 
-    if (val > DBL_MAX || val < -DBL_MAX) {
-      jsondec_err(d, "Number out of range");
-    }
+/* Parses the number in [start, d->ptr), which jsondec_skipnumber() accepted. */
+static double jsondec_todouble(jsondec* d, const char* start) {
+  double val;
+  const char* end = upb_BufToDouble(start, d->ptr, &val);
+  UPB_ASSERT(end == d->ptr);
+  UPB_UNUSED(end);
 
-    return val;
+  if (val > DBL_MAX || val < -DBL_MAX) {
+    jsondec_err(d, "Number out of range");
   }
+
+  return val;
+}
+
+static double jsondec_number(jsondec* d) {
+  bool is_integer;
+  const char* start = jsondec_skipnumber(d, &is_integer);
+  return jsondec_todouble(d, start);
 }
 
 /* JSON string ****************************************************************/
@@ -357,7 +504,7 @@ static uint32_t jsondec_codepoint(jsondec* d) {
   uint32_t cp = 0;
   const char* end;
 
-  if (d->end - d->ptr < 4) {
+  if (!jsondec_ensure(d, 4)) {
     jsondec_err(d, "EOF inside string");
   }
 
@@ -398,10 +545,12 @@ static size_t jsondec_unicode(jsondec* d, char* out) {
   return bytes;
 }
 
-static void jsondec_resize(jsondec* d, char** buf, char** end, char** buf_end) {
+/* Grows the buffer to have room for at least |need| more bytes. */
+static void jsondec_resize(jsondec* d, char** buf, char** end, char** buf_end,
+                           size_t need) {
   size_t oldsize = *buf_end - *buf;
   size_t len = *end - *buf;
-  size_t size = UPB_MAX(8, 2 * oldsize);
+  size_t size = UPB_MAX(UPB_MAX(8, 2 * oldsize), len + need);
 
   *buf = upb_Arena_Realloc(d->arena, *buf, len, size);
   if (!*buf) jsondec_err(d, "Out of memory");
@@ -421,11 +570,24 @@ static upb_StringView jsondec_string(jsondec* d) {
     jsondec_err(d, "Expected string");
   }
 
-  while (d->ptr < d->end) {
+  while (jsondec_more(d)) {
+    const char* run_end = _upb_Json_SkipPlain(d->ptr, d->end);
+    size_t run = run_end - d->ptr;
+    if (run) {
+      /* Leave room for the terminator or the next character. */
+      if ((size_t)(buf_end - end) <= run) {
+        jsondec_resize(d, &buf, &end, &buf_end, run + 1);
+      }
+      memcpy(end, d->ptr, run);
+      end += run;
+      d->ptr = run_end;
+      if (d->ptr == d->end) continue;
+    }
+
     char ch = *d->ptr++;
 
     if (end == buf_end) {
-      jsondec_resize(d, &buf, &end, &buf_end);
+      jsondec_resize(d, &buf, &end, &buf_end, 1);
     }
 
     switch (ch) {
@@ -433,16 +595,19 @@ static upb_StringView jsondec_string(jsondec* d) {
         upb_StringView ret;
         ret.data = buf;
         ret.size = end - buf;
+        if (!upb_Utf8_IsValid(ret.data, ret.size)) {
+          jsondec_err(d, "Invalid UTF-8 in JSON string");
+        }
         *end = '\0'; /* Needed for possible strtod(). */
         return ret;
       }
       case '\\':
-        if (d->ptr == d->end) goto eof;
+        if (!jsondec_more(d)) goto eof;
         if (*d->ptr == 'u') {
           d->ptr++;
           if (buf_end - end < 4) {
             /* Allow space for maximum-sized codepoint (4 bytes). */
-            jsondec_resize(d, &buf, &end, &buf_end);
+            jsondec_resize(d, &buf, &end, &buf_end, 4);
           }
           end += jsondec_unicode(d, end);
         } else {
@@ -450,11 +615,8 @@ static upb_StringView jsondec_string(jsondec* d) {
         }
         break;
       default:
-        if ((unsigned char)*d->ptr < 0x20) {
-          jsondec_err(d, "Invalid char in JSON string");
-        }
-        *end++ = ch;
-        break;
+        /* _upb_Json_SkipPlain() only stops early for control characters. */
+        jsondec_err(d, "Invalid char in JSON string");
     }
   }
 
@@ -462,6 +624,22 @@ eof:
   jsondec_err(d, "EOF inside string");
 }
 
+/* Parses an object key.  When the input is all in memory, a key without
+ * escapes is returned in place instead of being copied.  The caller must
+ * check that it is valid UTF-8 unless it matches a field name. */
+static upb_StringView jsondec_key(jsondec* d) {
+  jsondec_skipws(d);
+  if (!d->stream && *d->ptr == '"') {
+    const char* start = d->ptr + 1;
+    const char* end = _upb_Json_SkipPlain(start, d->end);
+    if (end != d->end && *end == '"') {
+      d->ptr = end + 1;
+      return upb_StringView_FromDataAndSize(start, end - start);
+    }
+  }
+  return jsondec_string(d);
+}
+
 static void jsondec_skipval(jsondec* d) {
   switch (jsondec_peek(d)) {
     case JD_OBJECT:
@@ -500,116 +678,14 @@ static void jsondec_skipval(jsondec* d) {
 
 /* Base64 decoding for bytes fields. ******************************************/
 
-static unsigned int jsondec_base64_tablelookup(const char ch) {
-  /* Table includes the normal base64 chars plus the URL-safe variant. */
-  const signed char table[256] = {
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       62 /*+*/, -1,       62 /*-*/, -1,       63 /*/ */, 52 /*0*/,
-      53 /*1*/, 54 /*2*/, 55 /*3*/, 56 /*4*/, 57 /*5*/, 58 /*6*/,  59 /*7*/,
-      60 /*8*/, 61 /*9*/, -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       0 /*A*/,  1 /*B*/,  2 /*C*/,  3 /*D*/,   4 /*E*/,
-      5 /*F*/,  6 /*G*/,  07 /*H*/, 8 /*I*/,  9 /*J*/,  10 /*K*/,  11 /*L*/,
-      12 /*M*/, 13 /*N*/, 14 /*O*/, 15 /*P*/, 16 /*Q*/, 17 /*R*/,  18 /*S*/,
-      19 /*T*/, 20 /*U*/, 21 /*V*/, 22 /*W*/, 23 /*X*/, 24 /*Y*/,  25 /*Z*/,
-      -1,       -1,       -1,       -1,       63 /*_*/, -1,        26 /*a*/,
-      27 /*b*/, 28 /*c*/, 29 /*d*/, 30 /*e*/, 31 /*f*/, 32 /*g*/,  33 /*h*/,
-      34 /*i*/, 35 /*j*/, 36 /*k*/, 37 /*l*/, 38 /*m*/, 39 /*n*/,  40 /*o*/,
-      41 /*p*/, 42 /*q*/, 43 /*r*/, 44 /*s*/, 45 /*t*/, 46 /*u*/,  47 /*v*/,
-      48 /*w*/, 49 /*x*/, 50 /*y*/, 51 /*z*/, -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1,       -1,       -1,        -1,
-      -1,       -1,       -1,       -1};
-
-  /* Sign-extend return value so high bit will be set on any unexpected char. */
-  return table[(unsigned)ch];
-}
-
-static char* jsondec_partialbase64(jsondec* d, const char* ptr, const char* end,
-                                   char* out) {
-  int32_t val = -1;
-
-  switch (end - ptr) {
-    case 2:
-      val = jsondec_base64_tablelookup(ptr[0]) << 18 |
-            jsondec_base64_tablelookup(ptr[1]) << 12;
-      out[0] = val >> 16;
-      out += 1;
-      break;
-    case 3:
-      val = jsondec_base64_tablelookup(ptr[0]) << 18 |
-            jsondec_base64_tablelookup(ptr[1]) << 12 |
-            jsondec_base64_tablelookup(ptr[2]) << 6;
-      out[0] = val >> 16;
-      out[1] = (val >> 8) & 0xff;
-      out += 2;
-      break;
-  }
-
-  if (val < 0) {
-    jsondec_err(d, "Corrupt base64");
-  }
-
-  return out;
-}
-
 static size_t jsondec_base64(jsondec* d, upb_StringView str) {
   /* We decode in place. This is safe because this is a new buffer (not
    * aliasing the input) and because base64 decoding shrinks 4 bytes into 3. */
-  char* out = (char*)str.data;
-  const char* ptr = str.data;
-  const char* end = ptr + str.size;
-  const char* end4 = ptr + (str.size & -4); /* Round down to multiple of 4. */
-
-  for (; ptr < end4; ptr += 4, out += 3) {
-    int val = jsondec_base64_tablelookup(ptr[0]) << 18 |
-              jsondec_base64_tablelookup(ptr[1]) << 12 |
-              jsondec_base64_tablelookup(ptr[2]) << 6 |
-              jsondec_base64_tablelookup(ptr[3]) << 0;
-
-    if (val < 0) {
-      /* Junk chars or padding. Remove trailing padding, if any. */
-      if (end - ptr == 4 && ptr[3] == '=') {
-        if (ptr[2] == '=') {
-          end -= 2;
-        } else {
-          end -= 1;
-        }
-      }
-      break;
-    }
-
-    out[0] = val >> 16;
-    out[1] = (val >> 8) & 0xff;
-    out[2] = val & 0xff;
-  }
-
-  if (ptr < end) {
-    /* Process remaining chars. We do not require padding. */
-    out = jsondec_partialbase64(d, ptr, end, out);
+  size_t size;
+  if (!upb_Base64_Decode(str.data, str.size, (char*)str.data, &size)) {
+    jsondec_err(d, "Corrupt base64");
   }
-
-  return out - str.data;
+  return size;
 }
 
 /* Low-level integer parsing **************************************************/
@@ -655,7 +731,14 @@ static upb_MessageValue jsondec_int(jsondec* d, const upb_FieldDef* f) {
 
   switch (jsondec_peek(d)) {
     case JD_NUMBER: {
-      double dbl = jsondec_number(d);
+      bool is_integer;
+      const char* start = jsondec_skipnumber(d, &is_integer);
+      /* Integers are parsed directly, which is both faster and exact. */
+      if (is_integer &&
+          upb_BufToInt64(start, d->ptr, &val.int64_val, NULL) == d->ptr) {
+        break;
+      }
+      double dbl = jsondec_todouble(d, start);
       if (dbl > 9223372036854774784.0 || dbl < -9223372036854775808.0) {
         jsondec_err(d, "JSON number is out of range.");
       }
@@ -692,7 +775,13 @@ static upb_MessageValue jsondec_uint(jsondec* d, const upb_FieldDef* f) {
 
   switch (jsondec_peek(d)) {
     case JD_NUMBER: {
-      double dbl = jsondec_number(d);
+      bool is_integer;
+      const char* start = jsondec_skipnumber(d, &is_integer);
+      if (is_integer &&
+          upb_BufToUint64(start, d->ptr, &val.uint64_val) == d->ptr) {
+        break;
+      }
+      double dbl = jsondec_todouble(d, start);
       if (dbl > 18446744073709549568.0 || dbl < 0) {
         jsondec_err(d, "JSON number is out of range.");
       }
@@ -739,8 +828,9 @@ static upb_MessageValue jsondec_double(jsondec* d, const upb_FieldDef* f) {
         val.double_val = INFINITY;
       } else if (jsondec_streql(str, "-Infinity")) {
         val.double_val = -INFINITY;
-      } else {
-        val.double_val = strtod(str.data, NULL);
+      } else if (upb_BufToDouble(str.data, str.data + str.size,
+                                 &val.double_val) != str.data + str.size) {
+        val.double_val = _upb_NoLocaleStrtod(str.data, NULL);
       }
       break;
     default:
@@ -884,13 +974,61 @@ static upb_MessageValue jsondec_msg(jsondec* d, const upb_FieldDef* f) {
   return val;
 }
 
+/* Encoders write fields in declaration order, so the key after |prev| (NULL
+ * for the first key) is most likely the next field declared in |m|. */
+static const upb_FieldDef* jsondec_predictfield(const upb_MessageDef* m,
+                                                const upb_FieldDef* prev) {
+  int i = 0;
+  if (prev) {
+    if (upb_FieldDef_ContainingType(prev) != m) return NULL;
+    i = upb_FieldDef_Index(prev) + 1;
+  }
+  return i < upb_MessageDef_FieldCount(m) ? upb_MessageDef_Field(m, i) : NULL;
+}
+
+static const upb_FieldDef* jsondec_findfield(jsondec* d,
+                                             const upb_MessageDef* m,
+                                             upb_StringView name) {
+  const void* prev = d->prev_field ? (const void*)d->prev_field : m;
+  jsondec_nextfield* ent = NULL;
+  const upb_FieldDef* f;
+
+  if (d->field_cache) {
+    uint32_t hash = (uint32_t)((uintptr_t)prev >> 3) * 2654435761u;
+    ent = &d->field_cache[hash >> (32 - kJsonDecFieldCacheBits)];
+    if (ent->prev == prev && ent->m == m && ent->size == name.size &&
+        memcmp(ent->name, name.data, name.size) == 0) {
+      d->prev_field = ent->next;
+      return ent->next;
+    }
+  }
+
+  f = jsondec_predictfield(m, d->prev_field);
+  if (!f || !(jsondec_streql(name, upb_FieldDef_JsonName(f)) ||
+              jsondec_streql(name, upb_FieldDef_Name(f)))) {
+    f = upb_MessageDef_FindByJsonNameWithSize(m, name.data, name.size);
+    if (!f) return NULL;
+  }
+
+  if (ent) {
+    ent->prev = prev;
+    ent->m = m;
+    ent->next = f;
+    ent->name = upb_FieldDef_JsonName(f);
+    if (!jsondec_streql(name, ent->name)) ent->name = upb_FieldDef_Name(f);
+    ent->size = name.size;
+  }
+  d->prev_field = f;
+  return f;
+}
+
 static void jsondec_field(jsondec* d, upb_Message* msg,
                           const upb_MessageDef* m) {
   upb_StringView name;
   const upb_FieldDef* f;
   const upb_FieldDef* preserved;
 
-  name = jsondec_string(d);
+  name = jsondec_key(d);
   jsondec_entrysep(d);
 
   if (name.size >= 2 && name.data[0] == '[' &&
@@ -905,10 +1043,13 @@ static void jsondec_field(jsondec* d, upb_Message* msg,
           upb_MessageDef_FullName(m));
     }
   } else {
-    f = upb_MessageDef_FindByJsonNameWithSize(m, name.data, name.size);
+    f = jsondec_findfield(d, m, name);
   }
 
   if (!f) {
+    if (!upb_Utf8_IsValid(name.data, name.size)) {
+      jsondec_err(d, "Invalid UTF-8 in JSON string");
+    }
     if ((d->options & upb_JsonDecode_IgnoreUnknown) == 0) {
       jsondec_errf(d, "No such field: " UPB_STRINGVIEW_FORMAT,
                    UPB_STRINGVIEW_ARGS(name));
@@ -949,11 +1090,14 @@ static void jsondec_field(jsondec* d, upb_Message* msg,
 
 static void jsondec_object(jsondec* d, upb_Message* msg,
                            const upb_MessageDef* m) {
+  const upb_FieldDef* saved_prev = d->prev_field;
+  d->prev_field = NULL;
   jsondec_objstart(d);
   while (jsondec_objnext(d)) {
     jsondec_field(d, msg, m);
   }
   jsondec_objend(d);
+  d->prev_field = saved_prev;
 }
 
 static upb_MessageValue jsondec_value(jsondec* d, const upb_FieldDef* f) {
@@ -983,60 +1127,11 @@ static upb_MessageValue jsondec_value(jsondec* d, const upb_FieldDef* f) {
 
 /* Well-known types ***********************************************************/
 
-static int jsondec_tsdigits(jsondec* d, const char** ptr, size_t digits,
-                            const char* after) {
-  uint64_t val;
-  const char* p = *ptr;
-  const char* end = p + digits;
-  size_t after_len = after ? strlen(after) : 0;
-
-  UPB_ASSERT(digits <= 9); /* int can't overflow. */
-
-  if (jsondec_buftouint64(d, p, end, &val) != end ||
-      (after_len && memcmp(end, after, after_len) != 0)) {
-    jsondec_err(d, "Malformed timestamp");
-  }
-
-  UPB_ASSERT(val < INT_MAX);
-
-  *ptr = end + after_len;
-  return (int)val;
-}
-
-static int jsondec_nanos(jsondec* d, const char** ptr, const char* end) {
-  uint64_t nanos = 0;
-  const char* p = *ptr;
-
-  if (p != end && *p == '.') {
-    const char* nano_end = jsondec_buftouint64(d, p + 1, end, &nanos);
-    int digits = (int)(nano_end - p - 1);
-    int exp_lg10 = 9 - digits;
-    if (digits > 9) {
-      jsondec_err(d, "Too many digits for partial seconds");
-    }
-    while (exp_lg10--) nanos *= 10;
-    *ptr = nano_end;
-  }
-
-  UPB_ASSERT(nanos < INT_MAX);
-
-  return (int)nanos;
-}
-
-/* jsondec_epochdays(1970, 1, 1) == 1970-01-01 == 0. */
-int jsondec_epochdays(int y, int m, int d) {
-  const uint32_t year_base = 4800; /* Before min year, multiple of 400. */
-  const uint32_t m_adj = m - 3;    /* March-based month. */
-  const uint32_t carry = m_adj > (uint32_t)m ? 1 : 0;
-  const uint32_t adjust = carry ? 12 : 0;
-  const uint32_t y_adj = y + year_base - carry;
-  const uint32_t month_days = ((m_adj + adjust) * 62719 + 769) / 2048;
-  const uint32_t leap_days = y_adj / 4 - y_adj / 100 + y_adj / 400;
-  return y_adj * 365 + leap_days + month_days + (d - 1) - 2472632;
-}
-
-static int64_t jsondec_unixtime(int y, int m, int d, int h, int min, int s) {
-  return (int64_t)jsondec_epochdays(y, m, d) * 86400 + h * 3600 + min * 60 + s;
+static int32_t jsondec_nanos(jsondec* d, const char** ptr, const char* end) {
+  int32_t nanos;
+  *ptr = upb_BufToNanos(*ptr, end, &nanos);
+  if (!*ptr) jsondec_err(d, "Too many digits for partial seconds");
+  return nanos;
 }
 
 static void jsondec_timestamp(jsondec* d, upb_Message* msg,
@@ -1046,48 +1141,21 @@ static void jsondec_timestamp(jsondec* d, upb_Message* msg,
   upb_StringView str = jsondec_string(d);
   const char* ptr = str.data;
   const char* end = ptr + str.size;
+  int32_t ofs;
 
-  if (str.size < 20) goto malformed;
-
-  {
-    /* 1972-01-01T01:00:00 */
-    int year = jsondec_tsdigits(d, &ptr, 4, "-");
-    int mon = jsondec_tsdigits(d, &ptr, 2, "-");
-    int day = jsondec_tsdigits(d, &ptr, 2, "T");
-    int hour = jsondec_tsdigits(d, &ptr, 2, ":");
-    int min = jsondec_tsdigits(d, &ptr, 2, ":");
-    int sec = jsondec_tsdigits(d, &ptr, 2, NULL);
-
-    seconds.int64_val = jsondec_unixtime(year, mon, day, hour, min, sec);
+  /* 1972-01-01T01:00:00 */
+  if (str.size < 20 || !upb_BufToDateTime(ptr, &seconds.int64_val)) {
+    goto malformed;
   }
+  ptr += 19;
 
   nanos.int32_val = jsondec_nanos(d, &ptr, end);
 
-  {
-    /* [+-]08:00 or Z */
-    int ofs_hour = 0;
-    int ofs_min = 0;
-    bool neg = false;
-
-    if (ptr == end) goto malformed;
-
-    switch (*ptr++) {
-      case '-':
-        neg = true;
-        /* fallthrough */
-      case '+':
-        if ((end - ptr) != 5) goto malformed;
-        ofs_hour = jsondec_tsdigits(d, &ptr, 2, ":");
-        ofs_min = jsondec_tsdigits(d, &ptr, 2, NULL);
-        ofs_min = ((ofs_hour * 60) + ofs_min) * 60;
-        seconds.int64_val += (neg ? ofs_min : -ofs_min);
-        break;
-      case 'Z':
-        if (ptr != end) goto malformed;
-        break;
-      default:
-        goto malformed;
-    }
+  /* [+-]08:00 or Z */
+  if (end - ptr == 6 && upb_BufToUtcOffset(ptr, &ofs)) {
+    seconds.int64_val -= ofs;
+  } else if (end - ptr != 1 || *ptr != 'Z') {
+    goto malformed;
   }
 
   if (seconds.int64_val < -62135596800) {
@@ -1341,25 +1409,32 @@ static void jsondec_any(jsondec* d, upb_Message* msg, const upb_MessageDef* m) {
   const upb_FieldDef* value_f = upb_MessageDef_FindFieldByNumber(m, 2);
   upb_Message* any_msg;
   const upb_MessageDef* any_m = NULL;
-  const char* pre_type_data = NULL;
+  bool has_pre_type = false;
+  size_t pre_type_data = 0;
   const char* pre_type_end = NULL;
+  size_t saved_pin = d->pin;
   upb_MessageValue encoded;
 
   jsondec_objstart(d);
 
-  /* Scan looking for "@type", which is not necessarily first. */
+  /* Scan looking for "@type", which is not necessarily first.  Fields before
+   * it are pinned so they can be replayed once the type is known. */
   while (!any_m && jsondec_objnext(d)) {
-    const char* start = d->ptr;
+    size_t start = jsondec_pos(d, d->ptr);
+    if (!has_pre_type) d->pin = UPB_MIN(saved_pin, start);
     upb_StringView name = jsondec_string(d);
     jsondec_entrysep(d);
     if (jsondec_streql(name, "@type")) {
       any_m = jsondec_typeurl(d, msg, m);
-      if (pre_type_data) {
-        pre_type_end = start;
+      if (has_pre_type) {
+        pre_type_end = jsondec_at(d, start);
         while (*pre_type_end != ',') pre_type_end--;
+      } else {
+        d->pin = saved_pin;
       }
     } else {
-      if (!pre_type_data) pre_type_data = start;
+      if (!has_pre_type) pre_type_data = start;
+      has_pre_type = true;
       jsondec_skipval(d);
     }
   }
@@ -1371,21 +1446,34 @@ static void jsondec_any(jsondec* d, upb_Message* msg, const upb_MessageDef* m) {
   const upb_MiniTable* any_layout = upb_MessageDef_MiniTable(any_m);
   any_msg = upb_Message_New(any_layout, d->arena);
 
-  if (pre_type_data) {
-    size_t len = pre_type_end - pre_type_data + 1;
+  if (has_pre_type) {
+    const char* data = jsondec_at(d, pre_type_data);
+    size_t len = pre_type_end - data + 1;
     char* tmp = upb_Arena_Malloc(d->arena, len);
     const char* saved_ptr = d->ptr;
     const char* saved_end = d->end;
-    memcpy(tmp, pre_type_data, len - 1);
+    const char* saved_base = d->base;
+    size_t saved_base_pos = d->base_pos;
+    upb_ZeroCopyInputStream* saved_stream = d->stream;
+    int saved_line = d->line;
+    size_t saved_line_begin = d->line_begin;
+    memcpy(tmp, data, len - 1);
     tmp[len - 1] = '}';
-    d->ptr = tmp;
+    d->pin = saved_pin;
+    d->ptr = d->base = tmp;
     d->end = tmp + len;
+    d->stream = NULL;
     d->is_first = true;
     while (jsondec_objnext(d)) {
       jsondec_anyfield(d, any_msg, any_m);
     }
     d->ptr = saved_ptr;
     d->end = saved_end;
+    d->base = saved_base;
+    d->base_pos = saved_base_pos;
+    d->stream = saved_stream;
+    d->line = saved_line;
+    d->line_begin = saved_line_begin;
   }
 
   while (jsondec_objnext(d)) {
@@ -1453,6 +1541,9 @@ static bool upb_JsonDecoder_Decode(jsondec* const d, upb_Message* const msg,
                                    const upb_MessageDef* const m) {
   if (UPB_SETJMP(d->err)) return false;
 
+  /* Empty input leaves the message empty. */
+  if (!jsondec_more(d)) return true;
+
   jsondec_tomsg(d, msg, m);
   return true;
 }
@@ -1472,9 +1563,111 @@ bool upb_JsonDecode(const char* buf, size_t size, upb_Message* msg,
   d.options = options;
   d.depth = 64;
   d.line = 1;
-  d.line_begin = d.ptr;
+  d.line_begin = 0;
   d.debug_field = NULL;
   d.is_first = false;
+  d.stream = NULL;
+  d.base = buf;
+  d.base_pos = 0;
+  d.pin = SIZE_MAX;
+  d.window = NULL;
+  d.window_size = 0;
+  d.field_cache = NULL;
+  d.prev_field = NULL;
+
+  UPB_PROBE(json_decode_begin, upb_MessageDef_MiniTable(m), size);
+  bool ok = upb_JsonDecoder_Decode(&d, msg, m);
+  UPB_PROBE(json_decode_end, upb_MessageDef_MiniTable(m), size, ok);
+  return ok;
+}
+
+bool upb_JsonDecodeFromStream(upb_ZeroCopyInputStream* stream,
+                              upb_Message* msg, const upb_MessageDef* m,
+                              const upb_DefPool* symtab, int options,
+                              upb_Arena* arena, upb_Status* status) {
+  jsondec d;
+  upb_Status local_status;
+
+  if (!status) status = &local_status;
+  upb_Status_Clear(status);
+
+  d.ptr = NULL;
+  d.end = NULL;
+  d.arena = arena;
+  d.symtab = symtab;
+  d.status = status;
+  d.options = options;
+  d.depth = 64;
+  d.line = 1;
+  d.line_begin = 0;
+  d.debug_field = NULL;
+  d.is_first = false;
+  d.stream = stream;
+  d.base = NULL;
+  d.base_pos = 0;
+  d.pin = SIZE_MAX;
+  d.window = NULL;
+  d.window_size = 0;
+  d.field_cache = NULL;
+  d.prev_field = NULL;
+
+  bool ok = upb_JsonDecoder_Decode(&d, msg, m);
+  upb_gfree(d.window);
+  return ok;
+}
+
+static bool upb_JsonDecoder_DecodeLines(jsondec* const d,
+                                        const upb_MessageDef* const m,
+                                        upb_Array* const msgs) {
+  if (UPB_SETJMP(d->err)) return false;
+
+  const upb_MiniTable* layout = upb_MessageDef_MiniTable(m);
+  bool more = jsondec_tryskipws(d);
+  while (more) {
+    upb_MessageValue val;
+    val.msg_val = upb_Message_New(layout, d->arena);
+    if (!val.msg_val) jsondec_err(d, "Out of memory");
+    jsondec_tomsg(d, (upb_Message*)val.msg_val, m);
+    if (!upb_Array_Append(msgs, val, d->arena)) {
+      jsondec_err(d, "Out of memory");
+    }
 
-  return upb_JsonDecoder_Decode(&d, msg, m);
+    int line = d->line;
+    more = jsondec_tryskipws(d);
+    if (more && d->line == line) {
+      jsondec_err(d, "Expected a newline after the message");
+    }
+  }
+  return true;
+}
+
+bool upb_JsonDecodeLines(const char* buf, size_t size, upb_Array* msgs,
+                         const upb_MessageDef* m, const upb_DefPool* symtab,
+                         int options, upb_Arena* arena, upb_Status* status) {
+  jsondec d;
+  jsondec_nextfield field_cache[1 << kJsonDecFieldCacheBits];
+
+  memset(field_cache, 0, sizeof(field_cache));
+
+  d.ptr = buf;
+  d.end = buf + size;
+  d.arena = arena;
+  d.symtab = symtab;
+  d.status = status;
+  d.options = options;
+  d.depth = 64;
+  d.line = 1;
+  d.line_begin = 0;
+  d.debug_field = NULL;
+  d.is_first = false;
+  d.stream = NULL;
+  d.base = buf;
+  d.base_pos = 0;
+  d.pin = SIZE_MAX;
+  d.window = NULL;
+  d.window_size = 0;
+  d.field_cache = field_cache;
+  d.prev_field = NULL;
+
+  return upb_JsonDecoder_DecodeLines(&d, m, msgs);
 }
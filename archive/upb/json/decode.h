@@ -31,6 +31,8 @@
 #ifndef UPB_JSON_DECODE_H_
 #define UPB_JSON_DECODE_H_
 
+#include "upb/collections/array.h"
+#include "upb/io/zero_copy_input_stream.h"
 #include "upb/reflection/def.h"
 
 // Must be last.
@@ -46,6 +48,30 @@ UPB_API bool upb_JsonDecode(const char* buf, size_t size, upb_Message* msg,
                             const upb_MessageDef* m, const upb_DefPool* symtab,
                             int options, upb_Arena* arena, upb_Status* status);
 
+/* Like upb_JsonDecode(), but reads the input from |stream| as it arrives, so
+ * the document never has to be in memory at once.  Only the token being
+ * parsed is buffered (or, for an Any, the fields before its "@type").  The
+ * stream may be read past the end of the JSON value.  Returns false on error,
+ * including a failure of the stream. */
+UPB_API bool upb_JsonDecodeFromStream(upb_ZeroCopyInputStream* stream,
+                                      upb_Message* msg,
+                                      const upb_MessageDef* m,
+                                      const upb_DefPool* symtab, int options,
+                                      upb_Arena* arena, upb_Status* status);
+
+/* Decodes newline-delimited JSON: any number of messages of type |m|, each
+ * starting on a new line, which are appended to |msgs| (an array of
+ * messages).  Blank lines are skipped.  This is faster than calling
+ * upb_JsonDecode() for each line, as field name lookups are cached across
+ * messages.  JSON strings cannot contain raw newlines, so input with one
+ * message per line can be split at any newline to decode the parts on
+ * separate threads, each with its own arena and array.  Returns false on
+ * error, in which case the messages decoded so far are left in |msgs|. */
+UPB_API bool upb_JsonDecodeLines(const char* buf, size_t size, upb_Array* msgs,
+                                 const upb_MessageDef* m,
+                                 const upb_DefPool* symtab, int options,
+                                 upb_Arena* arena, upb_Status* status);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
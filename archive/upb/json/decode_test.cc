@@ -32,6 +32,7 @@
 
 #include "google/protobuf/struct.upb.h"
 #include "gtest/gtest.h"
+#include "upb/io/chunked_input_stream.h"
 #include "upb/json/test.upb.h"
 #include "upb/json/test.upbdefs.h"
 #include "upb/mem/arena.hpp"
@@ -92,3 +93,189 @@ TEST(JsonTest, DecodeFloats) {
     EXPECT_EQ(box, nullptr);
   }
 }
+
+TEST(JsonTest, DecodeUtf8) {
+  upb::Arena a;
+
+  upb_test_Box* box =
+      JsonDecode("{\"name\": \"caf\xc3\xa9 \\u00e9\"}", a.ptr());
+  ASSERT_NE(box, nullptr);
+  upb_StringView name = upb_test_Box_name(box);
+  EXPECT_EQ(std::string(name.data, name.size), "caf\xc3\xa9 \xc3\xa9");
+
+  // Truncated sequence, surrogate, and a bad byte far into a long string.
+  EXPECT_EQ(JsonDecode("{\"name\": \"caf\xc3\"}", a.ptr()), nullptr);
+  EXPECT_EQ(JsonDecode("{\"name\": \"\xed\xa0\x80\"}", a.ptr()), nullptr);
+  std::string json = "{\"name\": \"" + std::string(100, 'x') + "\xff\"}";
+  EXPECT_EQ(JsonDecode(json.c_str(), a.ptr()), nullptr);
+}
+
+TEST(JsonTest, DecodeLongStrings) {
+  upb::Arena a;
+
+  // Long runs of plain bytes with escapes at every alignment.
+  for (size_t n = 0; n < 70; n++) {
+    std::string plain(n, 'x');
+    std::string json = "{\"name\": \"" + plain + "\\n" + plain + "\\u00e9" +
+                       plain + "\\\"\"}";
+    upb_test_Box* box = JsonDecode(json.c_str(), a.ptr());
+    ASSERT_NE(box, nullptr) << n;
+    upb_StringView name = upb_test_Box_name(box);
+    EXPECT_EQ(std::string(name.data, name.size),
+              plain + "\n" + plain + "\xc3\xa9" + plain + "\"");
+  }
+
+  // Control characters are rejected wherever they are.
+  for (size_t n = 0; n < 40; n++) {
+    std::string json = "{\"name\": \"" + std::string(n, 'x') + "\x01" +
+                       std::string(40 - n, 'x') + "\"}";
+    EXPECT_EQ(JsonDecode(json.c_str(), a.ptr()), nullptr) << n;
+  }
+  EXPECT_EQ(JsonDecode("{\"name\": \"\\n\x1f\"}", a.ptr()), nullptr);
+}
+
+TEST(JsonTest, DecodeBytes) {
+  upb::Arena a;
+
+  // Padding is optional and the URL-safe alphabet is accepted, even mixed.
+  for (const char* json :
+       {R"({"data": "+/-_Zm9vYg=="})", R"({"data": "+/-_Zm9vYg"})"}) {
+    upb_test_Box* box = JsonDecode(json, a.ptr());
+    ASSERT_NE(box, nullptr) << json;
+    upb_StringView data = upb_test_Box_data(box);
+    EXPECT_EQ(std::string(data.data, data.size), "\xfb\xff\xbf" "foob");
+  }
+
+  // Long enough to be decoded in 32-char blocks, then corrupted anywhere.
+  std::string encoded;
+  for (size_t i = 0; i < 50; i++) encoded += "eHh4";
+  std::string json = "{\"data\": \"" + encoded + "\"}";
+  upb_test_Box* box = JsonDecode(json.c_str(), a.ptr());
+  ASSERT_NE(box, nullptr);
+  upb_StringView data = upb_test_Box_data(box);
+  EXPECT_EQ(std::string(data.data, data.size), std::string(150, 'x'));
+  for (size_t i = 0; i < encoded.size(); i++) {
+    std::string bad = encoded;
+    bad[i] = '.';
+    json = "{\"data\": \"" + bad + "\"}";
+    EXPECT_EQ(JsonDecode(json.c_str(), a.ptr()), nullptr) << i;
+  }
+  EXPECT_EQ(JsonDecode(R"({"data": "Zm9vY"})", a.ptr()), nullptr);
+}
+
+TEST(JsonTest, DecodeIndented) {
+  upb::Arena a;
+  upb::Status status;
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_Box_getmsgdef(defpool.ptr()));
+
+  std::string indent(40, ' ');
+  std::string json = "{\r\n" + indent + "\"name\":\t\"x\",\n" + indent +
+                     "\"d\": 2\n" + indent + "\t,\n" + indent + "\"f\": z}";
+  upb_test_Box* box = upb_test_Box_new(a.ptr());
+  EXPECT_FALSE(upb_JsonDecode(json.data(), json.size(), box, m.ptr(),
+                              defpool.ptr(), 0, a.ptr(), status.ptr()));
+  // The error is reported on the right line.
+  std::string error = status.error_message();
+  EXPECT_EQ(error.rfind("Error parsing JSON @5:", 0), 0) << error;
+}
+
+// Decodes |json| from a stream of |chunk|-byte pieces, or all at once if
+// |chunk| is 0, and returns the result in wire format or the error.
+static std::string DecodeToWire(const std::string& json, size_t chunk) {
+  upb::Arena a;
+  upb::Status status;
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_Box_getmsgdef(defpool.ptr()));
+  upb_test_Box* box = upb_test_Box_new(a.ptr());
+  bool ok;
+  if (chunk) {
+    upb_ZeroCopyInputStream* stream =
+        upb_ChunkedInputStream_New(json.data(), json.size(), chunk, a.ptr());
+    ok = upb_JsonDecodeFromStream(stream, box, m.ptr(), defpool.ptr(), 0,
+                                  a.ptr(), status.ptr());
+  } else {
+    ok = upb_JsonDecode(json.data(), json.size(), box, m.ptr(), defpool.ptr(),
+                        0, a.ptr(), status.ptr());
+  }
+  if (!ok) return status.error_message();
+  size_t size;
+  char* data = upb_test_Box_serialize(box, a.ptr(), &size);
+  return std::string(data, size);
+}
+
+TEST(JsonTest, DecodeFromStream) {
+  std::string plain(5000, 'x');
+  std::string json = "{\n  \"name\": \"" + plain +
+                     "\\n\\u00e9\\ud83d\\ude00\",\n"
+                     "  \"first_tag\": \"Z_BAR\", \"more_tags\": [1, 13, -2],\n"
+                     "  \"d\": -12345.678e-3, \"f\": 1.5,\n"
+                     "  \"val\": {\"a\": [true, false, null, 12.5e1, \"s\"]},\n"
+                     "  \"any\": {\"name\": \"" +
+                     plain +
+                     "\", \"d\": 1234567.125,\n"
+                     "  \"@type\": \"type.googleapis.com/upb_test.Box\",\n"
+                     "          \"f\": 2}\n}\n";
+  std::string expected = DecodeToWire(json, 0);
+  ASSERT_GT(expected.size(), 2 * plain.size());
+  for (size_t chunk : {1, 2, 3, 7, 64, 4095, 4096, 5003, 100000}) {
+    EXPECT_EQ(expected, DecodeToWire(json, chunk)) << chunk;
+  }
+
+  // Errors are reported at the same place, and truncated input is an error.
+  std::string bad = json;
+  bad.replace(bad.find("13"), 2, "1z");
+  std::string error = DecodeToWire(bad, 0);
+  EXPECT_EQ(error.rfind("Error parsing JSON @3:", 0), 0) << error;
+  std::string truncated = json.substr(0, json.size() - 3);
+  for (size_t chunk : {1, 5, 4096}) {
+    EXPECT_EQ(error, DecodeToWire(bad, chunk)) << chunk;
+    EXPECT_EQ(DecodeToWire(truncated, 0), DecodeToWire(truncated, chunk));
+  }
+  EXPECT_EQ(DecodeToWire("", 1), "");
+}
+
+TEST(JsonTest, DecodeLines) {
+  std::vector<std::string> lines = {
+      R"({"name": "a", "d": 1.5, "val": {"x": [1, {"y": null}]}})",
+      R"({"name": "b", "d": 2.5, "val": {"x": [2, {"y": true}]}})",
+      // Field order changes, and proto names are accepted too.
+      R"({"d": 3.5, "first_tag": "Z_BAR", "name": "c"})",
+      R"({"firstTag": 13, "name": "d", "more_tags": [1, -2]})",
+      R"({"na\u006de": "e", "firstTag": 1})",
+      R"({})",
+  };
+  std::string json = "\n";
+  for (const auto& line : lines) json += line + "\r\n\n";
+
+  upb::Arena a;
+  upb::Status status;
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_Box_getmsgdef(defpool.ptr()));
+  upb_Array* msgs = upb_Array_New(a.ptr(), kUpb_CType_Message);
+  ASSERT_TRUE(upb_JsonDecodeLines(json.data(), json.size(), msgs, m.ptr(),
+                                  defpool.ptr(), 0, a.ptr(), status.ptr()))
+      << status.error_message();
+  ASSERT_EQ(upb_Array_Size(msgs), lines.size());
+  for (size_t i = 0; i < lines.size(); i++) {
+    const upb_test_Box* box =
+        (const upb_test_Box*)upb_Array_Get(msgs, i).msg_val;
+    size_t size;
+    char* data = upb_test_Box_serialize(box, a.ptr(), &size);
+    EXPECT_EQ(std::string(data, size), DecodeToWire(lines[i], 0)) << i;
+  }
+
+  // Each message must start on a new line, and errors give the right line.
+  upb_Array* more = upb_Array_New(a.ptr(), kUpb_CType_Message);
+  std::string bad = R"({"name": "a"})" "\n" R"({"name": "b"} {})";
+  EXPECT_FALSE(upb_JsonDecodeLines(bad.data(), bad.size(), more, m.ptr(),
+                                   defpool.ptr(), 0, a.ptr(), status.ptr()));
+  EXPECT_EQ(upb_Array_Size(more), 2);
+  std::string error = status.error_message();
+  EXPECT_EQ(error.rfind("Error parsing JSON @2:", 0), 0) << error;
+  bad = json + R"({"nam": "e"})";
+  EXPECT_FALSE(upb_JsonDecodeLines(bad.data(), bad.size(), more, m.ptr(),
+                                   defpool.ptr(), 0, a.ptr(), status.ptr()));
+  error = status.error_message();
+  EXPECT_EQ(error.rfind("Error parsing JSON @14:", 0), 0) << error;
+}
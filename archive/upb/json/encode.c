@@ -37,9 +37,14 @@
 #include <stdarg.h>
 #include <string.h>
 
+#include "upb/collections/array.h"
 #include "upb/collections/map.h"
+#include "upb/io/zero_copy_output_stream.h"
+#include "upb/json/internal/scan.h"
+#include "upb/lex/atoi.h"
+#include "upb/lex/base64.h"
 #include "upb/lex/round_trip.h"
-#include "upb/port/vsnprintf_compat.h"
+#include "upb/lex/timestamp.h"
 #include "upb/reflection/message.h"
 #include "upb/wire/decode.h"
 
@@ -49,12 +54,17 @@
 typedef struct {
   char *buf, *ptr, *end;
   size_t overflow;
+  upb_ZeroCopyOutputStream* stream; /* If set, [buf, end) is its last chunk. */
   int indent_depth;
   int options;
   const upb_DefPool* ext_pool;
   jmp_buf err;
   upb_Status* status;
   upb_Arena* arena;
+  /* The type URL and type of the last Any, so that runs of Anys of one type
+   * look up the type once. */
+  upb_StringView any_type_url;
+  const upb_MessageDef* any_m;
 } jsonenc;
 
 static void jsonenc_msg(jsonenc* e, const upb_Message* msg,
@@ -90,11 +100,37 @@ static upb_Arena* jsonenc_arena(jsonenc* e) {
   return e->arena;
 }
 
+UPB_NOINLINE static void jsonenc_putbytes_stream(jsonenc* e, const char* data,
+                                                 size_t len) {
+  while (len) {
+    if (e->ptr == e->end) {
+      size_t count;
+      char* chunk = upb_ZeroCopyOutputStream_Next(e->stream, &count, e->status);
+      if (!chunk) {
+        e->buf = e->ptr = e->end = NULL;
+        if (upb_Status_IsOk(e->status)) {
+          jsonenc_err(e, "output stream is full");
+        }
+        longjmp(e->err, 1);
+      }
+      e->buf = e->ptr = chunk;
+      e->end = chunk + count;
+    }
+    size_t n = UPB_MIN(len, (size_t)(e->end - e->ptr));
+    memcpy(e->ptr, data, n);
+    e->ptr += n;
+    data += n;
+    len -= n;
+  }
+}
+
 static void jsonenc_putbytes(jsonenc* e, const void* data, size_t len) {
   size_t have = e->end - e->ptr;
   if (UPB_LIKELY(have >= len)) {
     memcpy(e->ptr, data, len);
     e->ptr += len;
+  } else if (e->stream) {
+    jsonenc_putbytes_stream(e, data, len);
   } else {
     if (have) {
       memcpy(e->ptr, data, have);
@@ -108,38 +144,29 @@ static void jsonenc_putstr(jsonenc* e, const char* str) {
   jsonenc_putbytes(e, str, strlen(str));
 }
 
-UPB_PRINTF(2, 3)
-static void jsonenc_printf(jsonenc* e, const char* fmt, ...) {
-  size_t n;
-  size_t have = e->end - e->ptr;
-  va_list args;
-
-  va_start(args, fmt);
-  n = _upb_vsnprintf(e->ptr, have, fmt, args);
-  va_end(args);
-
-  if (UPB_LIKELY(have > n)) {
-    e->ptr += n;
+/* Integers are formatted straight into the output buffer when there is room. */
+static void jsonenc_putint(jsonenc* e, int64_t val) {
+  if (UPB_LIKELY(e->end - e->ptr >= kUpb_Int64BufferSize)) {
+    e->ptr += upb_Int64ToBuf(val, e->ptr);
   } else {
-    e->ptr = UPB_PTRADD(e->ptr, have);
-    e->overflow += (n - have);
+    char buf[kUpb_Int64BufferSize];
+    jsonenc_putbytes(e, buf, upb_Int64ToBuf(val, buf));
   }
 }
 
-static void jsonenc_nanos(jsonenc* e, int32_t nanos) {
-  int digits = 9;
+static void jsonenc_putuint(jsonenc* e, uint64_t val) {
+  if (UPB_LIKELY(e->end - e->ptr >= kUpb_Int64BufferSize)) {
+    e->ptr += upb_Uint64ToBuf(val, e->ptr);
+  } else {
+    char buf[kUpb_Int64BufferSize];
+    jsonenc_putbytes(e, buf, upb_Uint64ToBuf(val, buf));
+  }
+}
 
-  if (nanos == 0) return;
+static void jsonenc_checknanos(jsonenc* e, int32_t nanos) {
   if (nanos < 0 || nanos >= 1000000000) {
     jsonenc_err(e, "error formatting timestamp as JSON: invalid nanos");
   }
-
-  while (nanos % 1000 == 0) {
-    nanos /= 1000;
-    digits -= 3;
-  }
-
-  jsonenc_printf(e, ".%.*" PRId32, digits, nanos);
 }
 
 static void jsonenc_timestamp(jsonenc* e, const upb_Message* msg,
@@ -148,7 +175,8 @@ static void jsonenc_timestamp(jsonenc* e, const upb_Message* msg,
   const upb_FieldDef* nanos_f = upb_MessageDef_FindFieldByNumber(m, 2);
   int64_t seconds = upb_Message_GetFieldByDef(msg, seconds_f).int64_val;
   int32_t nanos = upb_Message_GetFieldByDef(msg, nanos_f).int32_val;
-  int L, N, I, J, K, hour, min, sec;
+  char buf[kUpb_TimestampBufferSize + 2];
+  int n;
 
   if (seconds < -62135596800) {
     jsonenc_err(e,
@@ -159,30 +187,12 @@ static void jsonenc_timestamp(jsonenc* e, const upb_Message* msg,
                 "error formatting timestamp as JSON: maximum acceptable value "
                 "is 9999-12-31T23:59:59Z");
   }
+  jsonenc_checknanos(e, nanos);
 
-  /* Julian Day -> Y/M/D, Algorithm from:
-   * Fliegel, H. F., and Van Flandern, T. C., "A Machine Algorithm for
-   *   Processing Calendar Dates," Communications of the Association of
-   *   Computing Machines, vol. 11 (1968), p. 657.  */
-  seconds += 62135596800;  // Ensure seconds is positive.
-  L = (int)(seconds / 86400) - 719162 + 68569 + 2440588;
-  N = 4 * L / 146097;
-  L = L - (146097 * N + 3) / 4;
-  I = 4000 * (L + 1) / 1461001;
-  L = L - 1461 * I / 4 + 31;
-  J = 80 * L / 2447;
-  K = L - 2447 * J / 80;
-  L = J / 11;
-  J = J + 2 - 12 * L;
-  I = 100 * (N - 49) + I + L;
-
-  sec = seconds % 60;
-  min = (seconds / 60) % 60;
-  hour = (seconds / 3600) % 24;
-
-  jsonenc_printf(e, "\"%04d-%02d-%02dT%02d:%02d:%02d", I, J, K, hour, min, sec);
-  jsonenc_nanos(e, nanos);
-  jsonenc_putstr(e, "Z\"");
+  buf[0] = '"';
+  n = 1 + upb_TimestampToBuf(seconds, nanos, buf + 1);
+  buf[n++] = '"';
+  jsonenc_putbytes(e, buf, n);
 }
 
 static void jsonenc_duration(jsonenc* e, const upb_Message* msg,
@@ -192,6 +202,8 @@ static void jsonenc_duration(jsonenc* e, const upb_Message* msg,
   int64_t seconds = upb_Message_GetFieldByDef(msg, seconds_f).int64_val;
   int32_t nanos = upb_Message_GetFieldByDef(msg, nanos_f).int32_val;
   bool negative = false;
+  char buf[3 + kUpb_Int64BufferSize + kUpb_NanosBufferSize + 1];
+  int n = 0;
 
   if (seconds > 315576000000 || seconds < -315576000000 ||
       (seconds != 0 && nanos != 0 && (seconds < 0) != (nanos < 0))) {
@@ -206,14 +218,15 @@ static void jsonenc_duration(jsonenc* e, const upb_Message* msg,
     negative = true;
     nanos = -nanos;
   }
+  jsonenc_checknanos(e, nanos);
 
-  jsonenc_putstr(e, "\"");
-  if (negative) {
-    jsonenc_putstr(e, "-");
-  }
-  jsonenc_printf(e, "%" PRId64, seconds);
-  jsonenc_nanos(e, nanos);
-  jsonenc_putstr(e, "s\"");
+  buf[n++] = '"';
+  if (negative) buf[n++] = '-';
+  n += upb_Uint64ToBuf(seconds, buf + n);
+  n += upb_NanosToBuf(nanos, buf + n);
+  buf[n++] = 's';
+  buf[n++] = '"';
+  jsonenc_putbytes(e, buf, n);
 }
 
 static void jsonenc_enum(int32_t val, const upb_FieldDef* f, jsonenc* e) {
@@ -228,47 +241,37 @@ static void jsonenc_enum(int32_t val, const upb_FieldDef* f, jsonenc* e) {
             : upb_EnumDef_FindValueByNumber(e_def, val);
 
     if (ev) {
-      jsonenc_printf(e, "\"%s\"", upb_EnumValueDef_Name(ev));
+      jsonenc_putstr(e, "\"");
+      jsonenc_putstr(e, upb_EnumValueDef_Name(ev));
+      jsonenc_putstr(e, "\"");
     } else {
-      jsonenc_printf(e, "%" PRId32, val);
+      jsonenc_putint(e, val);
     }
   }
 }
 
 static void jsonenc_bytes(jsonenc* e, upb_StringView str) {
-  /* This is the regular base64, not the "web-safe" version. */
-  static const char base64[] =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-  const unsigned char* ptr = (unsigned char*)str.data;
-  const unsigned char* end = UPB_PTRADD(ptr, str.size);
-  char buf[4];
+  /* This is the regular base64, not the "web-safe" version.  It is encoded
+   * straight into the output buffer when there is room, and otherwise in
+   * chunks that are a multiple of 3 bytes, so only the last one is padded. */
+  const char* ptr = str.data;
+  size_t len = str.size;
+  char buf[1024];
 
   jsonenc_putstr(e, "\"");
 
-  while (end - ptr >= 3) {
-    buf[0] = base64[ptr[0] >> 2];
-    buf[1] = base64[((ptr[0] & 0x3) << 4) | (ptr[1] >> 4)];
-    buf[2] = base64[((ptr[1] & 0xf) << 2) | (ptr[2] >> 6)];
-    buf[3] = base64[ptr[2] & 0x3f];
-    jsonenc_putbytes(e, buf, 4);
-    ptr += 3;
+  if ((size_t)(e->end - e->ptr) >= upb_Base64_EncodedSize(len)) {
+    upb_Base64_Encode(ptr, len, e->ptr);
+    e->ptr += upb_Base64_EncodedSize(len);
+    len = 0;
   }
 
-  switch (end - ptr) {
-    case 2:
-      buf[0] = base64[ptr[0] >> 2];
-      buf[1] = base64[((ptr[0] & 0x3) << 4) | (ptr[1] >> 4)];
-      buf[2] = base64[(ptr[1] & 0xf) << 2];
-      buf[3] = '=';
-      jsonenc_putbytes(e, buf, 4);
-      break;
-    case 1:
-      buf[0] = base64[ptr[0] >> 2];
-      buf[1] = base64[((ptr[0] & 0x3) << 4)];
-      buf[2] = '=';
-      buf[3] = '=';
-      jsonenc_putbytes(e, buf, 4);
-      break;
+  while (len > 0) {
+    size_t n = UPB_MIN(len, sizeof(buf) / 4 * 3);
+    upb_Base64_Encode(ptr, n, buf);
+    jsonenc_putbytes(e, buf, upb_Base64_EncodedSize(n));
+    ptr += n;
+    len -= n;
   }
 
   jsonenc_putstr(e, "\"");
@@ -279,6 +282,15 @@ static void jsonenc_stringbody(jsonenc* e, upb_StringView str) {
   const char* end = UPB_PTRADD(ptr, str.size);
 
   while (ptr < end) {
+    /* Copy the run of bytes that need no escaping in one go.  This could
+     * include non-ASCII bytes; we rely on the string being valid UTF-8. */
+    const char* run_end = _upb_Json_SkipPlain(ptr, end);
+    if (run_end != ptr) {
+      jsonenc_putbytes(e, ptr, run_end - ptr);
+      ptr = run_end;
+      if (ptr == end) break;
+    }
+
     switch (*ptr) {
       case '\n':
         jsonenc_putstr(e, "\\n");
@@ -301,15 +313,15 @@ static void jsonenc_stringbody(jsonenc* e, upb_StringView str) {
       case '\\':
         jsonenc_putstr(e, "\\\\");
         break;
-      default:
-        if ((uint8_t)*ptr < 0x20) {
-          jsonenc_printf(e, "\\u%04x", (int)(uint8_t)*ptr);
-        } else {
-          /* This could be a non-ASCII byte.  We rely on the string being valid
-           * UTF-8. */
-          jsonenc_putbytes(e, ptr, 1);
-        }
+      default: {
+        /* Any other control character. */
+        static const char hex[] = "0123456789abcdef";
+        char buf[6] = {'\\', 'u', '0', '0'};
+        buf[4] = hex[(uint8_t)*ptr >> 4];
+        buf[5] = hex[*ptr & 0xf];
+        jsonenc_putbytes(e, buf, 6);
         break;
+      }
     }
     ptr++;
   }
@@ -366,6 +378,10 @@ static const upb_MessageDef* jsonenc_getanymsg(jsonenc* e,
     jsonenc_err(e, "Tried to encode Any, but no symtab was provided");
   }
 
+  if (e->any_m && upb_StringView_IsEqual(type_url, e->any_type_url)) {
+    return e->any_m;
+  }
+
   if (type_url.size == 0) goto badurl;
 
   while (true) {
@@ -385,6 +401,8 @@ static const upb_MessageDef* jsonenc_getanymsg(jsonenc* e,
     jsonenc_errf(e, "Couldn't find Any type: %.*s", (int)(end - ptr), ptr);
   }
 
+  e->any_type_url = type_url;
+  e->any_m = ret;
   return ret;
 
 badurl:
@@ -403,8 +421,12 @@ static void jsonenc_any(jsonenc* e, const upb_Message* msg,
   upb_Arena* arena = jsonenc_arena(e);
   upb_Message* any = upb_Message_New(any_layout, arena);
 
-  if (upb_Decode(value.data, value.size, any, any_layout, NULL, 0, arena) !=
-      kUpb_DecodeStatus_Ok) {
+  /* The packed value outlives `any`, which is freed with the encoder's arena,
+   * so strings can alias it instead of being copied. */
+  upb_DecodeStatus status =
+      upb_Decode(value.data, value.size, any, any_layout, NULL,
+                 kUpb_DecodeOption_AliasString, arena);
+  if (status != kUpb_DecodeStatus_Ok) {
     jsonenc_err(e, "Error decoding message in Any");
   }
 
@@ -613,16 +635,20 @@ static void jsonenc_scalar(jsonenc* e, upb_MessageValue val,
       upb_JsonEncode_Double(e, val.double_val);
       break;
     case kUpb_CType_Int32:
-      jsonenc_printf(e, "%" PRId32, val.int32_val);
+      jsonenc_putint(e, val.int32_val);
       break;
     case kUpb_CType_UInt32:
-      jsonenc_printf(e, "%" PRIu32, val.uint32_val);
+      jsonenc_putuint(e, val.uint32_val);
       break;
     case kUpb_CType_Int64:
-      jsonenc_printf(e, "\"%" PRId64 "\"", val.int64_val);
+      jsonenc_putstr(e, "\"");
+      jsonenc_putint(e, val.int64_val);
+      jsonenc_putstr(e, "\"");
       break;
     case kUpb_CType_UInt64:
-      jsonenc_printf(e, "\"%" PRIu64 "\"", val.uint64_val);
+      jsonenc_putstr(e, "\"");
+      jsonenc_putuint(e, val.uint64_val);
+      jsonenc_putstr(e, "\"");
       break;
     case kUpb_CType_String:
       jsonenc_string(e, val.str_val);
@@ -648,16 +674,16 @@ static void jsonenc_mapkey(jsonenc* e, upb_MessageValue val,
       jsonenc_putstr(e, val.bool_val ? "true" : "false");
       break;
     case kUpb_CType_Int32:
-      jsonenc_printf(e, "%" PRId32, val.int32_val);
+      jsonenc_putint(e, val.int32_val);
       break;
     case kUpb_CType_UInt32:
-      jsonenc_printf(e, "%" PRIu32, val.uint32_val);
+      jsonenc_putuint(e, val.uint32_val);
       break;
     case kUpb_CType_Int64:
-      jsonenc_printf(e, "%" PRId64, val.int64_val);
+      jsonenc_putint(e, val.int64_val);
       break;
     case kUpb_CType_UInt64:
-      jsonenc_printf(e, "%" PRIu64, val.uint64_val);
+      jsonenc_putuint(e, val.uint64_val);
       break;
     case kUpb_CType_String:
       jsonenc_stringbody(e, val.str_val);
@@ -717,14 +743,18 @@ static void jsonenc_fieldval(jsonenc* e, const upb_FieldDef* f,
     // TODO: For MessageSet, I would have expected this to print the message
     // name here, but Python doesn't appear to do this. We should do more
     // research here about what various implementations do.
-    jsonenc_printf(e, "\"[%s]\":", upb_FieldDef_FullName(f));
+    jsonenc_putstr(e, "\"[");
+    jsonenc_putstr(e, upb_FieldDef_FullName(f));
+    jsonenc_putstr(e, "]\":");
   } else {
     if (e->options & upb_JsonEncode_UseProtoNames) {
       name = upb_FieldDef_Name(f);
     } else {
       name = upb_FieldDef_JsonName(f);
     }
-    jsonenc_printf(e, "\"%s\":", name);
+    jsonenc_putstr(e, "\"");
+    jsonenc_putstr(e, name);
+    jsonenc_putstr(e, "\":");
   }
 
   if (upb_FieldDef_IsMap(f)) {
@@ -798,10 +828,84 @@ size_t upb_JsonEncode(const upb_Message* msg, const upb_MessageDef* m,
   e.ptr = buf;
   e.end = UPB_PTRADD(buf, size);
   e.overflow = 0;
+  e.stream = NULL;
   e.options = options;
   e.ext_pool = ext_pool;
   e.status = status;
   e.arena = NULL;
+  e.any_m = NULL;
 
   return upb_JsonEncoder_Encode(&e, msg, m, size);
 }
+
+static size_t upb_JsonEncoder_EncodeLines(jsonenc* const e,
+                                          const upb_Array* const msgs,
+                                          const upb_MessageDef* const m,
+                                          const size_t size) {
+  if (UPB_SETJMP(e->err) != 0) return -1;
+
+  size_t n = upb_Array_Size(msgs);
+  for (size_t i = 0; i < n; i++) {
+    jsonenc_msgfield(e, upb_Array_Get(msgs, i).msg_val, m);
+    jsonenc_putstr(e, "\n");
+  }
+  if (e->arena) upb_Arena_Free(e->arena);
+  return jsonenc_nullz(e, size);
+}
+
+size_t upb_JsonEncodeLines(const upb_Array* msgs, const upb_MessageDef* m,
+                           const upb_DefPool* ext_pool, int options, char* buf,
+                           size_t size, upb_Status* status) {
+  jsonenc e;
+
+  e.buf = buf;
+  e.ptr = buf;
+  e.end = UPB_PTRADD(buf, size);
+  e.overflow = 0;
+  e.stream = NULL;
+  e.options = options;
+  e.ext_pool = ext_pool;
+  e.status = status;
+  e.arena = NULL;
+  e.any_m = NULL;
+
+  return upb_JsonEncoder_EncodeLines(&e, msgs, m, size);
+}
+
+static bool upb_JsonEncoder_EncodeToStream(jsonenc* const e,
+                                           const upb_Message* const msg,
+                                           const upb_MessageDef* const m) {
+  if (UPB_SETJMP(e->err) != 0) return false;
+
+  jsonenc_msgfield(e, msg, m);
+  return true;
+}
+
+bool upb_JsonEncodeToStream(const upb_Message* msg, const upb_MessageDef* m,
+                            const upb_DefPool* ext_pool, int options,
+                            upb_ZeroCopyOutputStream* stream,
+                            upb_Status* status) {
+  jsonenc e;
+  upb_Status local_status;
+
+  if (!status) status = &local_status;
+  upb_Status_Clear(status);
+
+  e.buf = NULL;
+  e.ptr = NULL;
+  e.end = NULL;
+  e.overflow = 0;
+  e.stream = stream;
+  e.options = options;
+  e.ext_pool = ext_pool;
+  e.status = status;
+  e.arena = NULL;
+  e.any_m = NULL;
+
+  bool ok = upb_JsonEncoder_EncodeToStream(&e, msg, m);
+
+  /* Hand any unused part of the last chunk back to the stream. */
+  if (e.buf) upb_ZeroCopyOutputStream_BackUp(stream, e.end - e.ptr);
+  if (e.arena) upb_Arena_Free(e.arena);
+  return ok;
+}
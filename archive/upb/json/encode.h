@@ -31,6 +31,8 @@
 #ifndef UPB_JSON_ENCODE_H_
 #define UPB_JSON_ENCODE_H_
 
+#include "upb/collections/array.h"
+#include "upb/io/zero_copy_output_stream.h"
 #include "upb/reflection/def.h"
 
 // Must be last.
@@ -64,6 +66,25 @@ UPB_API size_t upb_JsonEncode(const upb_Message* msg, const upb_MessageDef* m,
                               const upb_DefPool* ext_pool, int options,
                               char* buf, size_t size, upb_Status* status);
 
+/* Like upb_JsonEncode(), but writes the output to |stream| in whatever chunks
+ * it provides, so the output is produced in a single pass without knowing its
+ * size in advance.  No NULL terminator is written.  Returns false on error,
+ * including a failure of the stream; in that case some output may already have
+ * been written. */
+UPB_API bool upb_JsonEncodeToStream(const upb_Message* msg,
+                                    const upb_MessageDef* m,
+                                    const upb_DefPool* ext_pool, int options,
+                                    upb_ZeroCopyOutputStream* stream,
+                                    upb_Status* status);
+
+/* Encodes each message in |msgs| (an array of messages of type |m|) followed
+ * by a newline, producing newline-delimited JSON that upb_JsonDecodeLines()
+ * accepts.  Output and return value are as for upb_JsonEncode(). */
+UPB_API size_t upb_JsonEncodeLines(const upb_Array* msgs,
+                                   const upb_MessageDef* m,
+                                   const upb_DefPool* ext_pool, int options,
+                                   char* buf, size_t size, upb_Status* status);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -30,9 +30,11 @@
 
 #include "upb/json/encode.h"
 
+#include "google/protobuf/any.upb.h"
 #include "google/protobuf/struct.upb.h"
 #include "gtest/gtest.h"
 #include "upb/base/status.hpp"
+#include "upb/io/chunked_output_stream.h"
 #include "upb/json/test.upb.h"
 #include "upb/json/test.upbdefs.h"
 #include "upb/mem/arena.hpp"
@@ -103,3 +105,155 @@ TEST(JsonTest, EncodeNullEnum) {
   EXPECT_EQ(R"({"val":null})",
             JsonEncode(foo, upb_JsonEncode_FormatEnumsAsIntegers));
 }
+
+TEST(JsonTest, EncodeStringEscapes) {
+  upb::Arena a;
+  upb_test_Box* foo = upb_test_Box_new(a.ptr());
+
+  // Escapes at every alignment within long runs of plain bytes.
+  for (size_t n = 0; n < 40; n++) {
+    std::string plain(n, 'x');
+    std::string name =
+        plain + "\"" + plain + "\\\n\x01\x1f" + plain + "caf\xc3\xa9";
+    upb_test_Box_set_name(
+        foo, upb_StringView_FromDataAndSize(name.data(), name.size()));
+    EXPECT_EQ("{\"name\":\"" + plain + "\\\"" + plain +
+                  "\\\\\\n\\u0001\\u001f" + plain + "caf\xc3\xa9\"}",
+              JsonEncode(foo, 0));
+  }
+}
+
+TEST(JsonTest, EncodeBytes) {
+  upb::Arena a;
+  upb_test_Box* foo = upb_test_Box_new(a.ptr());
+  upb_test_Box_set_data(foo, upb_StringView_FromString("\xfb\xff\xbf"));
+  EXPECT_EQ(R"({"data":"+/+/"})", JsonEncode(foo, 0));
+  upb_test_Box_set_data(foo, upb_StringView_FromString("foob"));
+  EXPECT_EQ(R"({"data":"Zm9vYg=="})", JsonEncode(foo, 0));
+
+  // Long enough to be encoded in several chunks when it does not fit in the
+  // output buffer.
+  std::string data(3000, 'x');
+  std::string encoded;
+  for (size_t i = 0; i < data.size() / 3; i++) encoded += "eHh4";
+  upb_test_Box_set_data(
+      foo, upb_StringView_FromDataAndSize(data.data(), data.size()));
+  EXPECT_EQ("{\"data\":\"" + encoded + "\"}", JsonEncode(foo, 0));
+}
+
+TEST(JsonTest, EncodeIntegers) {
+  upb::Arena a;
+  upb_test_Box* foo = upb_test_Box_new(a.ptr());
+  const int32_t tags[] = {0, 9, -10, 99, 100, 2147483647, -2147483647 - 1};
+  for (int32_t tag : tags) {
+    upb_test_Box_add_more_tags(foo, tag, a.ptr());
+  }
+  EXPECT_EQ(R"({"moreTags":[0,9,-10,99,100,2147483647,-2147483648]})",
+            JsonEncode(foo, upb_JsonEncode_FormatEnumsAsIntegers));
+}
+
+TEST(JsonTest, EncodeToStream) {
+  upb::Arena a;
+  upb_test_Box* foo = upb_test_Box_new(a.ptr());
+  std::string name(100, 'x');
+  name += "\n\"";
+  upb_test_Box_set_name(
+      foo, upb_StringView_FromDataAndSize(name.data(), name.size()));
+  upb_test_Box_set_last_tag(foo, upb_test_Z_BAZ);
+  for (int32_t tag : {1, -20, 300}) {
+    upb_test_Box_add_more_tags(foo, tag, a.ptr());
+  }
+  int options = upb_JsonEncode_FormatEnumsAsIntegers;
+  std::string expected = JsonEncode(foo, options);
+
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_Box_getmsgdef(defpool.ptr()));
+  for (size_t chunk : {1, 2, 3, 5, 16, 100, 10000}) {
+    std::string buf(expected.size(), '\0');
+    upb_ZeroCopyOutputStream* stream =
+        upb_ChunkedOutputStream_New(&buf[0], buf.size(), chunk, a.ptr());
+    upb::Status status;
+    EXPECT_TRUE(upb_JsonEncodeToStream(foo, m.ptr(), defpool.ptr(), options,
+                                       stream, status.ptr()));
+    EXPECT_EQ(expected.size(), upb_ZeroCopyOutputStream_ByteCount(stream));
+    EXPECT_EQ(expected, buf) << chunk;
+  }
+
+  // Running out of room in the stream is an error.
+  std::string buf(expected.size() - 1, '\0');
+  upb_ZeroCopyOutputStream* stream =
+      upb_ChunkedOutputStream_New(&buf[0], buf.size(), 16, a.ptr());
+  upb::Status status;
+  EXPECT_FALSE(upb_JsonEncodeToStream(foo, m.ptr(), defpool.ptr(), options,
+                                      stream, status.ptr()));
+  EXPECT_FALSE(status.ok());
+}
+
+TEST(JsonTest, EncodeLines) {
+  upb::Arena a;
+  upb::Status status;
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_Box_getmsgdef(defpool.ptr()));
+  upb_Array* msgs = upb_Array_New(a.ptr(), kUpb_CType_Message);
+  std::string expected;
+  for (int i = 0; i < 3; i++) {
+    upb_test_Box* box = upb_test_Box_new(a.ptr());
+    upb_test_Box_set_d(box, i);
+    if (i == 1) upb_test_Box_set_name(box, upb_StringView_FromString("x"));
+    upb_MessageValue val;
+    val.msg_val = (const upb_Message*)box;
+    ASSERT_TRUE(upb_Array_Append(msgs, val, a.ptr()));
+    expected += JsonEncode(box, 0) + "\n";
+  }
+
+  size_t size = upb_JsonEncodeLines(msgs, m.ptr(), defpool.ptr(), 0, NULL, 0,
+                                    status.ptr());
+  ASSERT_EQ(size, expected.size());
+  std::string buf(size + 1, '\0');
+  EXPECT_EQ(size, upb_JsonEncodeLines(msgs, m.ptr(), defpool.ptr(), 0, &buf[0],
+                                      buf.size(), status.ptr()));
+  buf.resize(size);
+  EXPECT_EQ(expected, buf);
+}
+
+static void SetAny(google_protobuf_Any* any, const char* type_url,
+                   const char* data, size_t size) {
+  google_protobuf_Any_set_type_url(any, upb_StringView_FromString(type_url));
+  google_protobuf_Any_set_value(any,
+                                upb_StringView_FromDataAndSize(data, size));
+}
+
+TEST(JsonTest, EncodeNestedAny) {
+  upb::Arena a;
+  const char kBoxUrl[] = "type.googleapis.com/upb_test.Box";
+  size_t size;
+
+  google_protobuf_Value* value = google_protobuf_Value_new(a.ptr());
+  google_protobuf_Value_set_number_value(value, 1);
+  char* data = google_protobuf_Value_serialize(value, a.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+
+  // Box -> Any(Box) -> Any(Box) -> Any(Value), so that the type of an Any is
+  // the same as, then different from, the one before it.
+  upb_test_Box* box = upb_test_Box_new(a.ptr());
+  upb_test_Box_set_name(box, upb_StringView_FromString("b"));
+  SetAny(upb_test_Box_mutable_any(box, a.ptr()),
+         "type.googleapis.com/google.protobuf.Value", data, size);
+  data = upb_test_Box_serialize(box, a.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+
+  box = upb_test_Box_new(a.ptr());
+  upb_test_Box_set_name(box, upb_StringView_FromString("a"));
+  SetAny(upb_test_Box_mutable_any(box, a.ptr()), kBoxUrl, data, size);
+  data = upb_test_Box_serialize(box, a.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+
+  box = upb_test_Box_new(a.ptr());
+  SetAny(upb_test_Box_mutable_any(box, a.ptr()), kBoxUrl, data, size);
+  EXPECT_EQ(
+      R"({"any":{"@type":"type.googleapis.com/upb_test.Box","name":"a",)"
+      R"("any":{"@type":"type.googleapis.com/upb_test.Box","name":"b",)"
+      R"("any":{"@type":"type.googleapis.com/google.protobuf.Value",)"
+      R"("value":1}}}})",
+      JsonEncode(box, 0));
+}
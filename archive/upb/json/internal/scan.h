@@ -0,0 +1,92 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#ifndef UPB_JSON_INTERNAL_SCAN_H_
+#define UPB_JSON_INTERNAL_SCAN_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UPB_JSON_SSE2 1
+#endif
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the first quote, backslash or control character in [ptr, end), or
+// `end` if there is none.  These are the bytes that a JSON string cannot hold
+// verbatim, so everything before the result can be copied as it is.
+UPB_INLINE const char* _upb_Json_SkipPlain(const char* ptr, const char* end) {
+#ifdef UPB_JSON_SSE2
+  while (end - ptr >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)ptr);
+    __m128i ctrl = _mm_set1_epi8(0x1f);
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+    if (_mm_movemask_epi8(special)) break;
+    ptr += 16;
+  }
+#else
+  const uint64_t lsbs = 0x0101010101010101;
+  const uint64_t msbs = 0x8080808080808080;
+  while (end - ptr >= 8) {
+    uint64_t data;
+    memcpy(&data, ptr, 8);
+    // Exact per-byte tests, so there are no false positives from borrows.
+    uint64_t quote = data ^ (lsbs * '"');
+    uint64_t slash = data ^ (lsbs * '\\');
+    quote = ~(((quote & ~msbs) + ~msbs) | quote);
+    slash = ~(((slash & ~msbs) + ~msbs) | slash);
+    uint64_t ctrl = ~(((data & ~msbs) + lsbs * 0x60) | data);
+    if ((quote | slash | ctrl) & msbs) break;
+    ptr += 8;
+  }
+#endif
+  while (ptr < end && *ptr != '"' && *ptr != '\\' &&
+         (unsigned char)*ptr >= 0x20) {
+    ptr++;
+  }
+  return ptr;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_JSON_INTERNAL_SCAN_H_ */
@@ -0,0 +1,155 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/json/transcode.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "upb/json/decode.h"
+#include "upb/json/encode.h"
+#include "upb/message/message.h"
+#include "upb/reflection/def.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+/* Scratch space for the intermediate message, which is enough for most
+ * requests to transcode without a heap allocation. */
+#define kUpb_JsonTranscode_InitialBlock 4096
+
+static bool upb_JsonTranscode_OutOfMemory(upb_Status* status) {
+  upb_Status_SetErrorMessage(status, "Out of memory");
+  return false;
+}
+
+static bool upb_JsonTranscode_FromBinary(const char* data, size_t size,
+                                         const upb_MessageDef* m,
+                                         const upb_DefPool* ext_pool,
+                                         int options, upb_Arena* scratch,
+                                         upb_Arena* arena, char** json,
+                                         size_t* json_size,
+                                         upb_Status* status) {
+  const upb_MiniTable* layout = upb_MessageDef_MiniTable(m);
+  const upb_ExtensionRegistry* extreg =
+      ext_pool ? upb_DefPool_ExtensionRegistry(ext_pool) : NULL;
+  upb_Message* msg = upb_Message_New(layout, scratch);
+  if (!msg) return upb_JsonTranscode_OutOfMemory(status);
+  if (upb_Decode(data, size, msg, layout, extreg,
+                 kUpb_DecodeOption_AliasString,
+                 scratch) != kUpb_DecodeStatus_Ok) {
+    upb_Status_SetErrorMessage(status, "Error decoding binary input");
+    return false;
+  }
+
+  /* JSON is usually larger than the wire format, so start with room for
+   * twice the input and only encode again if that was not enough. */
+  size_t cap = 2 * size + 64;
+  char* buf = upb_Arena_Malloc(arena, cap);
+  if (!buf) return upb_JsonTranscode_OutOfMemory(status);
+  size_t n = upb_JsonEncode(msg, m, ext_pool, options, buf, cap, status);
+  if (n == (size_t)-1) return false;
+  if (n < cap) {
+    upb_Arena_ShrinkLast(arena, buf, cap, n + 1);
+  } else {
+    buf = upb_Arena_Realloc(arena, buf, cap, n + 1);
+    if (!buf) return upb_JsonTranscode_OutOfMemory(status);
+    upb_JsonEncode(msg, m, ext_pool, options, buf, n + 1, status);
+  }
+
+  *json = buf;
+  *json_size = n;
+  return true;
+}
+
+bool upb_JsonTranscodeFromBinary(const char* data, size_t size,
+                                 const upb_MessageDef* m,
+                                 const upb_DefPool* ext_pool, int options,
+                                 upb_Arena* arena, char** json,
+                                 size_t* json_size, upb_Status* status) {
+  uint64_t initial[kUpb_JsonTranscode_InitialBlock / sizeof(uint64_t)];
+  upb_Arena* scratch =
+      upb_Arena_Init(initial, sizeof(initial), &upb_alloc_global);
+  if (!scratch) return upb_JsonTranscode_OutOfMemory(status);
+  bool ok = upb_JsonTranscode_FromBinary(data, size, m, ext_pool, options,
+                                         scratch, arena, json, json_size,
+                                         status);
+  upb_Arena_Free(scratch);
+  return ok;
+}
+
+static bool upb_JsonTranscode_ToBinary(const char* json, size_t size,
+                                       const upb_MessageDef* m,
+                                       const upb_DefPool* ext_pool,
+                                       int options, upb_Arena* scratch,
+                                       upb_Arena* arena, char** data,
+                                       size_t* data_size, upb_Status* status) {
+  const upb_MiniTable* layout = upb_MessageDef_MiniTable(m);
+  upb_Message* msg = upb_Message_New(layout, scratch);
+  if (!msg) return upb_JsonTranscode_OutOfMemory(status);
+  if (!upb_JsonDecode(json, size, msg, m, ext_pool, options, scratch,
+                      status)) {
+    return false;
+  }
+
+  /* Encode into the scratch arena, which absorbs the encoder's buffer growth,
+   * and copy only the result to |arena|. */
+  char* buf;
+  size_t n;
+  if (upb_Encode(msg, layout, 0, scratch, &buf, &n) != kUpb_EncodeStatus_Ok) {
+    upb_Status_SetErrorMessage(status, "Error encoding binary output");
+    return false;
+  }
+  char* out = upb_Arena_Malloc(arena, n);
+  if (n && !out) return upb_JsonTranscode_OutOfMemory(status);
+  if (n) memcpy(out, buf, n);
+
+  *data = out;
+  *data_size = n;
+  return true;
+}
+
+bool upb_JsonTranscodeToBinary(const char* json, size_t size,
+                               const upb_MessageDef* m,
+                               const upb_DefPool* ext_pool, int options,
+                               upb_Arena* arena, char** data,
+                               size_t* data_size, upb_Status* status) {
+  uint64_t initial[kUpb_JsonTranscode_InitialBlock / sizeof(uint64_t)];
+  upb_Arena* scratch =
+      upb_Arena_Init(initial, sizeof(initial), &upb_alloc_global);
+  if (!scratch) return upb_JsonTranscode_OutOfMemory(status);
+  bool ok = upb_JsonTranscode_ToBinary(json, size, m, ext_pool, options,
+                                       scratch, arena, data, data_size,
+                                       status);
+  upb_Arena_Free(scratch);
+  return ok;
+}
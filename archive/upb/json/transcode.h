@@ -0,0 +1,74 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_JSON_TRANSCODE_H_
+#define UPB_JSON_TRANSCODE_H_
+
+#include "upb/mem/arena.h"
+#include "upb/reflection/def.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Converts |data|, a serialized message of type |m|, to JSON.  The output is
+ * the same as from upb_Decode() followed by upb_JsonEncode() with |options|,
+ * but the intermediate message lives in a scratch arena that is freed before
+ * returning, and it aliases the strings of |data| instead of copying them.
+ * Only the output, which is NULL-terminated, is allocated from |arena|.
+ * Extensions are parsed and printed if |ext_pool| is non-NULL.  Returns false
+ * on error. */
+UPB_API bool upb_JsonTranscodeFromBinary(const char* data, size_t size,
+                                         const upb_MessageDef* m,
+                                         const upb_DefPool* ext_pool,
+                                         int options, upb_Arena* arena,
+                                         char** json, size_t* json_size,
+                                         upb_Status* status);
+
+/* Converts |json|, a message of type |m| in JSON format, to the binary wire
+ * format, as upb_JsonDecode() with |options| followed by upb_Encode() would.
+ * As above, the intermediate message does not outlive the call and only the
+ * output is allocated from |arena|.  Returns false on error. */
+UPB_API bool upb_JsonTranscodeToBinary(const char* json, size_t size,
+                                       const upb_MessageDef* m,
+                                       const upb_DefPool* ext_pool, int options,
+                                       upb_Arena* arena, char** data,
+                                       size_t* data_size, upb_Status* status);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_JSON_TRANSCODE_H_ */
@@ -0,0 +1,141 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/json/transcode.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "upb/base/status.hpp"
+#include "upb/json/encode.h"
+#include "upb/json/test.upb.h"
+#include "upb/json/test.upbdefs.h"
+#include "upb/mem/arena.hpp"
+#include "upb/reflection/def.hpp"
+
+namespace {
+
+class TranscodeTest : public testing::Test {
+ protected:
+  TranscodeTest() : m_(upb_test_Box_getmsgdef(defpool_.ptr())) {}
+
+  // Returns the JSON for `box` from upb_JsonEncode().
+  std::string JsonEncode(const upb_test_Box* box) {
+    upb::Status status;
+    size_t size = upb_JsonEncode(box, m_.ptr(), defpool_.ptr(), 0, nullptr, 0,
+                                 status.ptr());
+    EXPECT_NE(size, (size_t)-1) << status.error_message();
+    std::string json(size + 1, '\0');
+    upb_JsonEncode(box, m_.ptr(), defpool_.ptr(), 0, &json[0], json.size(),
+                   status.ptr());
+    json.resize(size);
+    return json;
+  }
+
+  upb::DefPool defpool_;
+  upb::MessageDefPtr m_;
+};
+
+TEST_F(TranscodeTest, RoundTrip) {
+  upb::Arena arena;
+  upb_test_Box* box = upb_test_Box_new(arena.ptr());
+  upb_test_Box_set_name(box, upb_StringView_FromString("box"));
+  upb_test_Box_set_last_tag(box, upb_test_Z_BAT);
+  for (int32_t tag : {1, -2}) {
+    upb_test_Box_add_more_tags(box, tag, arena.ptr());
+  }
+  upb_test_Box_set_d(box, 1.5);
+  size_t size;
+  char* data = upb_test_Box_serialize(box, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+
+  upb::Status status;
+  char* json;
+  size_t json_size;
+  ASSERT_TRUE(upb_JsonTranscodeFromBinary(data, size, m_.ptr(),
+                                          defpool_.ptr(), 0, arena.ptr(),
+                                          &json, &json_size, status.ptr()))
+      << status.error_message();
+  EXPECT_EQ(JsonEncode(box), std::string(json, json_size));
+  EXPECT_EQ('\0', json[json_size]);
+
+  char* binary;
+  size_t binary_size;
+  ASSERT_TRUE(upb_JsonTranscodeToBinary(json, json_size, m_.ptr(),
+                                        defpool_.ptr(), 0, arena.ptr(),
+                                        &binary, &binary_size, status.ptr()))
+      << status.error_message();
+  EXPECT_EQ(std::string(data, size), std::string(binary, binary_size));
+}
+
+TEST_F(TranscodeTest, LargeOutput) {
+  // Control characters take six bytes each in JSON, which overflows the
+  // initial guess at the output size.
+  upb::Arena arena;
+  upb_test_Box* box = upb_test_Box_new(arena.ptr());
+  std::string name(10000, '\x01');
+  upb_test_Box_set_name(
+      box, upb_StringView_FromDataAndSize(name.data(), name.size()));
+  size_t size;
+  char* data = upb_test_Box_serialize(box, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+
+  upb::Status status;
+  char* json;
+  size_t json_size;
+  ASSERT_TRUE(upb_JsonTranscodeFromBinary(data, size, m_.ptr(),
+                                          defpool_.ptr(), 0, arena.ptr(),
+                                          &json, &json_size, status.ptr()))
+      << status.error_message();
+  EXPECT_GT(json_size, 2 * size);
+  EXPECT_EQ(JsonEncode(box), std::string(json, json_size));
+}
+
+TEST_F(TranscodeTest, Errors) {
+  upb::Arena arena;
+  upb::Status status;
+  char* out;
+  size_t out_size;
+  const char kTruncated[] = "\x22\x05" "ab";
+  EXPECT_FALSE(upb_JsonTranscodeFromBinary(
+      kTruncated, sizeof(kTruncated) - 1, m_.ptr(), defpool_.ptr(), 0,
+      arena.ptr(), &out, &out_size, status.ptr()));
+  EXPECT_FALSE(status.ok());
+
+  status = upb::Status();
+  const char kBadJson[] = R"({"name": 1})";
+  EXPECT_FALSE(upb_JsonTranscodeToBinary(kBadJson, sizeof(kBadJson) - 1,
+                                         m_.ptr(), defpool_.ptr(), 0,
+                                         arena.ptr(), &out, &out_size,
+                                         status.ptr()));
+  EXPECT_FALSE(status.ok());
+}
+
+}  // namespace
@@ -35,6 +35,17 @@
 
 const char* upb_BufToUint64(const char* ptr, const char* end, uint64_t* val) {
   uint64_t u64 = 0;
+  // The first 19 digits cannot overflow, so skip the checks for them.
+  const char* unchecked_end = end - ptr > 19 ? ptr + 19 : end;
+  while (ptr < unchecked_end) {
+    unsigned ch = *ptr - '0';
+    if (ch >= 10) {
+      *val = u64;
+      return ptr;
+    }
+    u64 = u64 * 10 + ch;
+    ptr++;
+  }
   while (ptr < end) {
     unsigned ch = *ptr - '0';
     if (ch >= 10) break;
@@ -69,3 +80,44 @@ const char* upb_BufToInt64(const char* ptr, const char* end, int64_t* val,
   if (is_neg) *is_neg = neg;
   return ptr;
 }
+
+// Two digits at a time halves the number of divisions.
+static const char kUpb_DigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+int upb_Uint64ToBuf(uint64_t val, char* buf) {
+  int len = 1;
+  uint64_t n = val;
+  for (; n >= 100; n /= 100) len += 2;
+  if (n >= 10) len++;
+
+  char* ptr = buf + len;
+  while (val >= 100) {
+    const char* pair = &kUpb_DigitPairs[(val % 100) * 2];
+    val /= 100;
+    *--ptr = pair[1];
+    *--ptr = pair[0];
+  }
+  if (val >= 10) {
+    *--ptr = kUpb_DigitPairs[val * 2 + 1];
+    *--ptr = kUpb_DigitPairs[val * 2];
+  } else {
+    *--ptr = '0' + (char)val;
+  }
+  return len;
+}
+
+int upb_Int64ToBuf(int64_t val, char* buf) {
+  if (val >= 0) return upb_Uint64ToBuf(val, buf);
+  *buf = '-';
+  return 1 + upb_Uint64ToBuf(-(uint64_t)val, buf + 1);
+}
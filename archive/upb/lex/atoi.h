@@ -49,6 +49,15 @@ const char* upb_BufToUint64(const char* ptr, const char* end, uint64_t* val);
 const char* upb_BufToInt64(const char* ptr, const char* end, int64_t* val,
                            bool* is_neg);
 
+// The most bytes that upb_Uint64ToBuf() or upb_Int64ToBuf() will write.
+enum { kUpb_Int64BufferSize = 20 };
+
+// The reverse: write the decimal form of `val` to `buf`, which must have room
+// for kUpb_Int64BufferSize bytes, and return the number of bytes written.  The
+// result is not NUL-terminated.
+int upb_Uint64ToBuf(uint64_t val, char* buf);
+int upb_Int64ToBuf(int64_t val, char* buf);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
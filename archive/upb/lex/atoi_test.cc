@@ -110,3 +110,30 @@ TEST(AtoiTest, Int64) {
     EXPECT_EQ(val, values[i]);
   }
 }
+
+TEST(AtoiTest, ToBuf) {
+  char buf[kUpb_Int64BufferSize];
+
+  // Every digit count, and the values on either side of each boundary.
+  uint64_t p = 1;
+  for (int digits = 1; digits <= 20; digits++) {
+    for (uint64_t u : {p, p - 1, p + 1, p * 7 / 3}) {
+      EXPECT_EQ(absl::StrCat(u), std::string(buf, upb_Uint64ToBuf(u, buf)));
+      int64_t i = (int64_t)u;
+      EXPECT_EQ(absl::StrCat(i), std::string(buf, upb_Int64ToBuf(i, buf)));
+      EXPECT_EQ(absl::StrCat(-i), std::string(buf, upb_Int64ToBuf(-i, buf)));
+    }
+    p *= 10;
+  }
+
+  const int64_t values[] = {
+      std::numeric_limits<int64_t>::max(),
+      std::numeric_limits<int64_t>::min(),
+  };
+  for (size_t i = 0; i < ABSL_ARRAYSIZE(values); i++) {
+    EXPECT_EQ(absl::StrCat(values[i]),
+              std::string(buf, upb_Int64ToBuf(values[i], buf)));
+  }
+  uint64_t max = std::numeric_limits<uint64_t>::max();
+  EXPECT_EQ(absl::StrCat(max), std::string(buf, upb_Uint64ToBuf(max, buf)));
+}
@@ -0,0 +1,318 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/lex/base64.h"
+
+#include <stdint.h>
+
+#include "upb/port/cpu.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define UPB_BASE64_AVX2 1
+#endif
+
+// Must be last.
+#include "upb/port/def.inc"
+
+static const char _upb_Base64_Chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Both the standard alphabet and the URL-safe one, which has '-' and '_' in
+// place of '+' and '/'.  Anything else is -1.
+static const signed char _upb_Base64_Values[256] = {
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       62 /*+*/, -1,       62 /*-*/, -1,       63 /*/ */, 52 /*0*/,
+    53 /*1*/, 54 /*2*/, 55 /*3*/, 56 /*4*/, 57 /*5*/, 58 /*6*/,  59 /*7*/,
+    60 /*8*/, 61 /*9*/, -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       0 /*A*/,  1 /*B*/,  2 /*C*/,  3 /*D*/,   4 /*E*/,
+    5 /*F*/,  6 /*G*/,  07 /*H*/, 8 /*I*/,  9 /*J*/,  10 /*K*/,  11 /*L*/,
+    12 /*M*/, 13 /*N*/, 14 /*O*/, 15 /*P*/, 16 /*Q*/, 17 /*R*/,  18 /*S*/,
+    19 /*T*/, 20 /*U*/, 21 /*V*/, 22 /*W*/, 23 /*X*/, 24 /*Y*/,  25 /*Z*/,
+    -1,       -1,       -1,       -1,       63 /*_*/, -1,        26 /*a*/,
+    27 /*b*/, 28 /*c*/, 29 /*d*/, 30 /*e*/, 31 /*f*/, 32 /*g*/,  33 /*h*/,
+    34 /*i*/, 35 /*j*/, 36 /*k*/, 37 /*l*/, 38 /*m*/, 39 /*n*/,  40 /*o*/,
+    41 /*p*/, 42 /*q*/, 43 /*r*/, 44 /*s*/, 45 /*t*/, 46 /*u*/,  47 /*v*/,
+    48 /*w*/, 49 /*x*/, 50 /*y*/, 51 /*z*/, -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1,       -1,       -1,        -1,
+    -1,       -1,       -1,       -1};
+
+// Sign-extends, so the high bit of the result is set for any unexpected char.
+static uint32_t _upb_Base64_Value(char ch) {
+  return (uint32_t)(int32_t)_upb_Base64_Values[(unsigned char)ch];
+}
+
+static void _upb_Base64_EncodeScalar(const uint8_t* ptr, const uint8_t* end,
+                                     char* out) {
+  const char* chars = _upb_Base64_Chars;
+
+  for (; end - ptr >= 3; ptr += 3, out += 4) {
+    out[0] = chars[ptr[0] >> 2];
+    out[1] = chars[((ptr[0] & 0x3) << 4) | (ptr[1] >> 4)];
+    out[2] = chars[((ptr[1] & 0xf) << 2) | (ptr[2] >> 6)];
+    out[3] = chars[ptr[2] & 0x3f];
+  }
+
+  switch (end - ptr) {
+    case 2:
+      out[0] = chars[ptr[0] >> 2];
+      out[1] = chars[((ptr[0] & 0x3) << 4) | (ptr[1] >> 4)];
+      out[2] = chars[(ptr[1] & 0xf) << 2];
+      out[3] = '=';
+      break;
+    case 1:
+      out[0] = chars[ptr[0] >> 2];
+      out[1] = chars[(ptr[0] & 0x3) << 4];
+      out[2] = '=';
+      out[3] = '=';
+      break;
+  }
+}
+
+static bool _upb_Base64_DecodeScalar(const char* ptr, const char* end,
+                                     char* out, char** out_end) {
+  const char* end4 = ptr + ((end - ptr) & -4);  // Round down to groups of 4.
+
+  for (; ptr < end4; ptr += 4, out += 3) {
+    int32_t val = _upb_Base64_Value(ptr[0]) << 18 |
+                  _upb_Base64_Value(ptr[1]) << 12 |
+                  _upb_Base64_Value(ptr[2]) << 6 | _upb_Base64_Value(ptr[3]);
+
+    if (val < 0) {
+      // Junk chars or padding.  Remove trailing padding, if any.
+      if (end - ptr == 4 && ptr[3] == '=') {
+        end -= ptr[2] == '=' ? 2 : 1;
+      }
+      break;
+    }
+
+    out[0] = val >> 16;
+    out[1] = (val >> 8) & 0xff;
+    out[2] = val & 0xff;
+  }
+
+  // Process the remaining chars.  We do not require padding.
+  int32_t val = 0;
+  switch (end - ptr) {
+    case 0:
+      break;
+    case 2:
+      val = _upb_Base64_Value(ptr[0]) << 18 | _upb_Base64_Value(ptr[1]) << 12;
+      out[0] = val >> 16;
+      out += 1;
+      break;
+    case 3:
+      val = _upb_Base64_Value(ptr[0]) << 18 |
+            _upb_Base64_Value(ptr[1]) << 12 | _upb_Base64_Value(ptr[2]) << 6;
+      out[0] = val >> 16;
+      out[1] = (val >> 8) & 0xff;
+      out += 2;
+      break;
+    default:
+      return false;
+  }
+
+  *out_end = out;
+  return val >= 0;
+}
+
+#ifdef UPB_BASE64_AVX2
+
+// The shuffles below work within each 128-bit lane, so the constants are
+// repeated in both.
+#define UPB_BASE64_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)      \
+  _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d), (char)(e),    \
+                   (char)(f), (char)(g), (char)(h), (char)(i), (char)(j),    \
+                   (char)(k), (char)(l), (char)(m), (char)(n), (char)(o),    \
+                   (char)(p), (char)(a), (char)(b), (char)(c), (char)(d),    \
+                   (char)(e), (char)(f), (char)(g), (char)(h), (char)(i),    \
+                   (char)(j), (char)(k), (char)(l), (char)(m), (char)(n),    \
+                   (char)(o), (char)(p))
+
+// Encodes 24 bytes to 32 chars per iteration, following Muła and Lemire,
+// "Faster Base64 Encoding and Decoding Using AVX2 Instructions" (2018).  Each
+// lane loads 16 bytes and uses 12, so this stops while 28 bytes remain and
+// returns the number of bytes consumed.
+__attribute__((target("avx2"))) static size_t _upb_Base64_EncodeAvx2(
+    const uint8_t* ptr, size_t len, char* out) {
+  // Spreads each group of 3 bytes abc over 4 as bacb, so that the 16-bit
+  // halves hold ab and bc.
+  const __m256i spread =
+      UPB_BASE64_TABLE(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+  // Offsets from each 6-bit value to its char, indexed as below.
+  const __m256i offsets =
+      UPB_BASE64_TABLE('A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                       '0' - 52, '+' - 62, '/' - 63, 0, 0);
+  size_t done = 0;
+
+  for (; len - done >= 28; done += 24, out += 32) {
+    __m256i in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(ptr + done))),
+        _mm_loadu_si128((const __m128i*)(ptr + done + 12)), 1);
+    in = _mm256_shuffle_epi8(in, spread);
+
+    // Move the four 6-bit fields of each 32-bit word into its four bytes:
+    // the first and third with a high multiply, the second and fourth with a
+    // low one.
+    __m256i hi = _mm256_mulhi_epu16(
+        _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+        _mm256_set1_epi32(0x04000040));
+    __m256i lo = _mm256_mullo_epi16(
+        _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+        _mm256_set1_epi32(0x01000010));
+    __m256i vals = _mm256_or_si256(hi, lo);
+
+    // Index the offsets by range: 0 for A-Z, 1 for a-z, 2-11 for the digits
+    // and 12 and 13 for '+' and '/'.
+    __m256i index = _mm256_subs_epu8(vals, _mm256_set1_epi8(51));
+    index = _mm256_sub_epi8(index,
+                            _mm256_cmpgt_epi8(vals, _mm256_set1_epi8(25)));
+    vals = _mm256_add_epi8(vals, _mm256_shuffle_epi8(offsets, index));
+
+    _mm256_storeu_si256((__m256i*)out, vals);
+  }
+
+  return done;
+}
+
+// Decodes 32 chars to 24 bytes per iteration, stopping at the first block
+// that contains anything but the two alphabets (such as padding), and returns
+// the number of chars consumed.  Only the 24 decoded bytes are stored, so this
+// is safe in place.
+__attribute__((target("avx2"))) static size_t _upb_Base64_DecodeAvx2(
+    const char* ptr, size_t len, char* out) {
+  // A char is valid iff the bits for its low nibble and its high nibble are
+  // disjoint.  Each high nibble 2-7 has its own bit, which is set for the low
+  // nibbles that are invalid in that row; all other high nibbles are invalid.
+  const __m256i lo_bits =
+      UPB_BASE64_TABLE(0x55, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41, 0x41,
+                       0x41, 0x43, 0x6a, 0x6b, 0x6b, 0x6b, 0x6a);
+  const __m256i hi_bits =
+      UPB_BASE64_TABLE(0x40, 0x40, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+                       0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40);
+  // The offset from each char to its value, indexed by its high nibble, or by
+  // 1 for '/'.
+  const __m256i offsets =
+      UPB_BASE64_TABLE(0, '/' - 63, '+' - 62, '0' - 52, 'A', 'A', 'a' - 26,
+                       'a' - 26, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i gather =
+      UPB_BASE64_TABLE(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  size_t done = 0;
+
+  for (; len - done >= 32; done += 32, out += 24) {
+    __m256i in = _mm256_loadu_si256((const __m256i*)(ptr + done));
+
+    // Map the URL-safe '-' and '_' to '+' and '/'.
+    in = _mm256_sub_epi8(
+        in, _mm256_and_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('-')),
+                             _mm256_set1_epi8('-' - '+')));
+    in = _mm256_sub_epi8(
+        in, _mm256_and_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('_')),
+                             _mm256_set1_epi8('_' - '/')));
+
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+    __m256i lo = _mm256_and_si256(in, nibble);
+    if (!_mm256_testz_si256(_mm256_shuffle_epi8(lo_bits, lo),
+                            _mm256_shuffle_epi8(hi_bits, hi))) {
+      break;
+    }
+
+    __m256i index =
+        _mm256_add_epi8(hi, _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')));
+    __m256i vals = _mm256_sub_epi8(in, _mm256_shuffle_epi8(offsets, index));
+
+    // Merge pairs of 6-bit values into 12 bits, then pairs of those into 24,
+    // and gather the three bytes of each 32-bit word in big-endian order.
+    vals = _mm256_maddubs_epi16(vals, _mm256_set1_epi32(0x01400140));
+    vals = _mm256_madd_epi16(vals, _mm256_set1_epi32(0x00011000));
+    vals = _mm256_shuffle_epi8(vals, gather);
+    vals = _mm256_permutevar8x32_epi32(
+        vals, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+    _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(vals));
+    _mm_storel_epi64((__m128i*)(out + 16), _mm256_extracti128_si256(vals, 1));
+  }
+
+  return done;
+}
+
+#endif  // UPB_BASE64_AVX2
+
+void upb_Base64_Encode(const char* ptr, size_t len, char* out) {
+  const uint8_t* p = (const uint8_t*)ptr;
+#ifdef UPB_BASE64_AVX2
+  if (len >= 28 && upb_Cpu_Has(kUpb_CpuFeature_Avx2)) {
+    size_t n = _upb_Base64_EncodeAvx2(p, len, out);
+    p += n;
+    len -= n;
+    out += n / 3 * 4;
+  }
+#endif
+  _upb_Base64_EncodeScalar(p, p + len, out);
+}
+
+bool upb_Base64_Decode(const char* ptr, size_t len, char* out, size_t* size) {
+  char* start = out;
+#ifdef UPB_BASE64_AVX2
+  if (len >= 32 && upb_Cpu_Has(kUpb_CpuFeature_Avx2)) {
+    size_t n = _upb_Base64_DecodeAvx2(ptr, len, out);
+    ptr += n;
+    len -= n;
+    out += n / 4 * 3;
+  }
+#endif
+  if (!_upb_Base64_DecodeScalar(ptr, ptr + len, out, &out)) return false;
+  *size = out - start;
+  return true;
+}
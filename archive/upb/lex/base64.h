@@ -0,0 +1,69 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_LEX_BASE64_H_
+#define UPB_LEX_BASE64_H_
+
+#include <stddef.h>
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the length of the padded base64 encoding of `len` bytes.
+UPB_INLINE size_t upb_Base64_EncodedSize(size_t len) {
+  return (len + 2) / 3 * 4;
+}
+
+// Writes the padded base64 encoding of [ptr, ptr + len) to `out`, which must
+// have room for upb_Base64_EncodedSize(len) bytes.  Uses the standard
+// alphabet, not the URL-safe one.
+void upb_Base64_Encode(const char* ptr, size_t len, char* out);
+
+// Decodes the base64 in [ptr, ptr + len) to `out`, which needs room for
+// (len + 3) / 4 * 3 bytes and may be `ptr` itself to decode in place.  Both
+// the standard and the URL-safe alphabet are accepted, even mixed, and the
+// trailing padding is optional.  Returns false if the input is corrupt;
+// otherwise sets `*size` to the number of bytes written.
+//
+// On x86-64 builds with GCC or Clang, long inputs are encoded and decoded 32
+// characters at a time with AVX2 when the CPU supports it.
+bool upb_Base64_Decode(const char* ptr, size_t len, char* out, size_t* size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_LEX_BASE64_H_ */
@@ -0,0 +1,220 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/lex/base64.h"
+
+#include <stdint.h>
+
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "upb/port/cpu.h"
+
+namespace {
+
+const char kChars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Straightforward implementations to check against.
+std::string ReferenceEncode(const std::string& s) {
+  std::string out;
+  uint32_t bits = 0;
+  int n = 0;
+  for (unsigned char c : s) {
+    bits = bits << 8 | c;
+    n += 8;
+    while (n >= 6) {
+      n -= 6;
+      out += kChars[(bits >> n) & 0x3f];
+    }
+  }
+  if (n > 0) out += kChars[(bits << (6 - n)) & 0x3f];
+  while (out.size() % 4) out += '=';
+  return out;
+}
+
+bool ReferenceDecode(std::string s, std::string* out) {
+  if (s.size() % 4 == 0 && !s.empty() && s.back() == '=') {
+    s.resize(s.size() - (s[s.size() - 2] == '=' ? 2 : 1));
+  }
+  if (s.size() % 4 == 1) return false;
+  out->clear();
+  uint32_t bits = 0;
+  int n = 0;
+  for (char c : s) {
+    int val;
+    if (c >= 'A' && c <= 'Z') {
+      val = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+      val = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+      val = c - '0' + 52;
+    } else if (c == '+' || c == '-') {
+      val = 62;
+    } else if (c == '/' || c == '_') {
+      val = 63;
+    } else {
+      return false;
+    }
+    bits = bits << 6 | val;
+    n += 6;
+    if (n >= 8) {
+      n -= 8;
+      *out += (char)(bits >> n);
+    }
+  }
+  return true;
+}
+
+std::string Encode(const std::string& s) {
+  std::string out(upb_Base64_EncodedSize(s.size()), '\0');
+  upb_Base64_Encode(s.data(), s.size(), &out[0]);
+  return out;
+}
+
+// Decodes both in place and into a separate buffer, checking that the two
+// agree.
+bool Decode(const std::string& s, std::string* out) {
+  std::string buf((s.size() + 3) / 4 * 3, '\0');
+  size_t size;
+  bool ok = upb_Base64_Decode(s.data(), s.size(), &buf[0], &size);
+
+  std::string in_place = s;
+  size_t in_place_size;
+  EXPECT_EQ(ok, upb_Base64_Decode(in_place.data(), in_place.size(),
+                                  &in_place[0], &in_place_size));
+  if (!ok) return false;
+
+  buf.resize(size);
+  in_place.resize(in_place_size);
+  EXPECT_EQ(buf, in_place);
+  *out = buf;
+  return true;
+}
+
+std::string RandomBytes(std::mt19937* rng, size_t len) {
+  std::string s;
+  for (size_t i = 0; i < len; i++) s += (char)(*rng)();
+  return s;
+}
+
+TEST(Base64Test, Rfc4648Vectors) {
+  EXPECT_EQ("", Encode(""));
+  EXPECT_EQ("Zg==", Encode("f"));
+  EXPECT_EQ("Zm8=", Encode("fo"));
+  EXPECT_EQ("Zm9v", Encode("foo"));
+  EXPECT_EQ("Zm9vYg==", Encode("foob"));
+  EXPECT_EQ("Zm9vYmE=", Encode("fooba"));
+  EXPECT_EQ("Zm9vYmFy", Encode("foobar"));
+
+  std::string out;
+  EXPECT_TRUE(Decode("Zm9vYg==", &out));
+  EXPECT_EQ("foob", out);
+  EXPECT_TRUE(Decode("Zm9vYg", &out));
+  EXPECT_EQ("foob", out);
+  EXPECT_TRUE(Decode("Zm9vYmE", &out));
+  EXPECT_EQ("fooba", out);
+  EXPECT_TRUE(Decode("", &out));
+  EXPECT_EQ("", out);
+  EXPECT_FALSE(Decode("Z", &out));
+  EXPECT_FALSE(Decode("Zm9vY", &out));
+  EXPECT_FALSE(Decode("Zm9=Yg==", &out));
+  EXPECT_FALSE(Decode("Zm9vYg===", &out));
+}
+
+// Covers every length around the 24- and 32-byte blocks of the vector paths.
+void CheckRoundTrip() {
+  std::mt19937 rng(12345);
+  for (size_t len = 0; len < 300; len++) {
+    std::string s = RandomBytes(&rng, len);
+    std::string encoded = Encode(s);
+    ASSERT_EQ(ReferenceEncode(s), encoded) << len;
+
+    std::string decoded;
+    ASSERT_TRUE(Decode(encoded, &decoded)) << len;
+    EXPECT_EQ(s, decoded) << len;
+
+    // Without padding and with the URL-safe alphabet, even mixed.
+    while (!encoded.empty() && encoded.back() == '=') encoded.pop_back();
+    for (char& c : encoded) {
+      if (c == '+' && rng() % 2) c = '-';
+      if (c == '/' && rng() % 2) c = '_';
+    }
+    ASSERT_TRUE(Decode(encoded, &decoded)) << len;
+    EXPECT_EQ(s, decoded) << len;
+  }
+}
+
+TEST(Base64Test, RoundTrip) { CheckRoundTrip(); }
+
+TEST(Base64Test, ScalarRoundTrip) {
+  uint32_t mask = upb_Cpu_SetFeatureMask(0);
+  CheckRoundTrip();
+  upb_Cpu_SetFeatureMask(mask);
+}
+
+TEST(Base64Test, EveryByte) {
+  // Each byte at every position in and around the 32-char blocks of the
+  // vector path.
+  std::string valid = Encode(std::string(75, 'x'));
+  for (int c = 0; c < 256; c++) {
+    for (size_t i = 0; i < valid.size(); i++) {
+      std::string s = valid;
+      s[i] = (char)c;
+      std::string expected;
+      std::string got;
+      bool ok = ReferenceDecode(s, &expected);
+      ASSERT_EQ(ok, Decode(s, &got)) << c << " " << i;
+      if (ok) EXPECT_EQ(expected, got) << c << " " << i;
+    }
+  }
+}
+
+TEST(Base64Test, MatchesReference) {
+  std::mt19937 rng(12345);
+  const char kJunk[] = {'=', '!', ' ', '.', ':', '@', '[', '`', '{', '\x80',
+                        '\xff', '\0'};
+  for (int i = 0; i < 20000; i++) {
+    std::string s = Encode(RandomBytes(&rng, rng() % 120));
+    if (rng() % 2 && !s.empty()) {
+      s[rng() % s.size()] = kJunk[rng() % sizeof(kJunk)];
+    }
+    if (rng() % 4 == 0 && !s.empty()) s.resize(rng() % s.size());
+
+    std::string expected;
+    std::string got;
+    bool ok = ReferenceDecode(s, &expected);
+    ASSERT_EQ(ok, Decode(s, &got)) << s;
+    if (ok) EXPECT_EQ(expected, got) << s;
+  }
+}
+
+}  // namespace
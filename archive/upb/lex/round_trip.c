@@ -31,7 +31,9 @@
 #include "upb/lex/round_trip.h"
 
 #include <float.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -49,8 +51,365 @@ static void upb_FixLocale(char* p) {
   }
 }
 
+/* Shortest digits (Grisu3) ***************************************************/
+
+// Finds the shortest decimal digits that read back as a given binary float,
+// using only 64-bit integer arithmetic.  This is the Grisu3 algorithm from
+// Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately with
+// Integers" (PLDI 2010).  It proves its answer correct or gives up, which
+// happens for about 0.5% of doubles; callers then fall back to printf().
+
+// A floating-point number f * 2^e with a 64-bit significand.
+typedef struct {
+  uint64_t f;
+  int e;
+} upb_DiyFp;
+
+// Cached powers of ten: 10^k ~= f * 2^e for k = -348, -340, ..., 340, with
+// f normalized and rounded to nearest.
+static const struct {
+  uint64_t f;
+  int16_t e;
+  int16_t k;
+} kUpb_CachedPowers[] = {
+    {UINT64_C(0xfa8fd5a0081c0288), -1220, -348},
+    {UINT64_C(0xbaaee17fa23ebf76), -1193, -340},
+    {UINT64_C(0x8b16fb203055ac76), -1166, -332},
+    {UINT64_C(0xcf42894a5dce35ea), -1140, -324},
+    {UINT64_C(0x9a6bb0aa55653b2d), -1113, -316},
+    {UINT64_C(0xe61acf033d1a45df), -1087, -308},
+    {UINT64_C(0xab70fe17c79ac6ca), -1060, -300},
+    {UINT64_C(0xff77b1fcbebcdc4f), -1034, -292},
+    {UINT64_C(0xbe5691ef416bd60c), -1007, -284},
+    {UINT64_C(0x8dd01fad907ffc3c), -980, -276},
+    {UINT64_C(0xd3515c2831559a83), -954, -268},
+    {UINT64_C(0x9d71ac8fada6c9b5), -927, -260},
+    {UINT64_C(0xea9c227723ee8bcb), -901, -252},
+    {UINT64_C(0xaecc49914078536d), -874, -244},
+    {UINT64_C(0x823c12795db6ce57), -847, -236},
+    {UINT64_C(0xc21094364dfb5637), -821, -228},
+    {UINT64_C(0x9096ea6f3848984f), -794, -220},
+    {UINT64_C(0xd77485cb25823ac7), -768, -212},
+    {UINT64_C(0xa086cfcd97bf97f4), -741, -204},
+    {UINT64_C(0xef340a98172aace5), -715, -196},
+    {UINT64_C(0xb23867fb2a35b28e), -688, -188},
+    {UINT64_C(0x84c8d4dfd2c63f3b), -661, -180},
+    {UINT64_C(0xc5dd44271ad3cdba), -635, -172},
+    {UINT64_C(0x936b9fcebb25c996), -608, -164},
+    {UINT64_C(0xdbac6c247d62a584), -582, -156},
+    {UINT64_C(0xa3ab66580d5fdaf6), -555, -148},
+    {UINT64_C(0xf3e2f893dec3f126), -529, -140},
+    {UINT64_C(0xb5b5ada8aaff80b8), -502, -132},
+    {UINT64_C(0x87625f056c7c4a8b), -475, -124},
+    {UINT64_C(0xc9bcff6034c13053), -449, -116},
+    {UINT64_C(0x964e858c91ba2655), -422, -108},
+    {UINT64_C(0xdff9772470297ebd), -396, -100},
+    {UINT64_C(0xa6dfbd9fb8e5b88f), -369, -92},
+    {UINT64_C(0xf8a95fcf88747d94), -343, -84},
+    {UINT64_C(0xb94470938fa89bcf), -316, -76},
+    {UINT64_C(0x8a08f0f8bf0f156b), -289, -68},
+    {UINT64_C(0xcdb02555653131b6), -263, -60},
+    {UINT64_C(0x993fe2c6d07b7fac), -236, -52},
+    {UINT64_C(0xe45c10c42a2b3b06), -210, -44},
+    {UINT64_C(0xaa242499697392d3), -183, -36},
+    {UINT64_C(0xfd87b5f28300ca0e), -157, -28},
+    {UINT64_C(0xbce5086492111aeb), -130, -20},
+    {UINT64_C(0x8cbccc096f5088cc), -103, -12},
+    {UINT64_C(0xd1b71758e219652c), -77, -4},
+    {UINT64_C(0x9c40000000000000), -50, 4},
+    {UINT64_C(0xe8d4a51000000000), -24, 12},
+    {UINT64_C(0xad78ebc5ac620000), 3, 20},
+    {UINT64_C(0x813f3978f8940984), 30, 28},
+    {UINT64_C(0xc097ce7bc90715b3), 56, 36},
+    {UINT64_C(0x8f7e32ce7bea5c70), 83, 44},
+    {UINT64_C(0xd5d238a4abe98068), 109, 52},
+    {UINT64_C(0x9f4f2726179a2245), 136, 60},
+    {UINT64_C(0xed63a231d4c4fb27), 162, 68},
+    {UINT64_C(0xb0de65388cc8ada8), 189, 76},
+    {UINT64_C(0x83c7088e1aab65db), 216, 84},
+    {UINT64_C(0xc45d1df942711d9a), 242, 92},
+    {UINT64_C(0x924d692ca61be758), 269, 100},
+    {UINT64_C(0xda01ee641a708dea), 295, 108},
+    {UINT64_C(0xa26da3999aef774a), 322, 116},
+    {UINT64_C(0xf209787bb47d6b85), 348, 124},
+    {UINT64_C(0xb454e4a179dd1877), 375, 132},
+    {UINT64_C(0x865b86925b9bc5c2), 402, 140},
+    {UINT64_C(0xc83553c5c8965d3d), 428, 148},
+    {UINT64_C(0x952ab45cfa97a0b3), 455, 156},
+    {UINT64_C(0xde469fbd99a05fe3), 481, 164},
+    {UINT64_C(0xa59bc234db398c25), 508, 172},
+    {UINT64_C(0xf6c69a72a3989f5c), 534, 180},
+    {UINT64_C(0xb7dcbf5354e9bece), 561, 188},
+    {UINT64_C(0x88fcf317f22241e2), 588, 196},
+    {UINT64_C(0xcc20ce9bd35c78a5), 614, 204},
+    {UINT64_C(0x98165af37b2153df), 641, 212},
+    {UINT64_C(0xe2a0b5dc971f303a), 667, 220},
+    {UINT64_C(0xa8d9d1535ce3b396), 694, 228},
+    {UINT64_C(0xfb9b7cd9a4a7443c), 720, 236},
+    {UINT64_C(0xbb764c4ca7a44410), 747, 244},
+    {UINT64_C(0x8bab8eefb6409c1a), 774, 252},
+    {UINT64_C(0xd01fef10a657842c), 800, 260},
+    {UINT64_C(0x9b10a4e5e9913129), 827, 268},
+    {UINT64_C(0xe7109bfba19c0c9d), 853, 276},
+    {UINT64_C(0xac2820d9623bf429), 880, 284},
+    {UINT64_C(0x80444b5e7aa7cf85), 907, 292},
+    {UINT64_C(0xbf21e44003acdd2d), 933, 300},
+    {UINT64_C(0x8e679c2f5e44ff8f), 960, 308},
+    {UINT64_C(0xd433179d9c8cb841), 986, 316},
+    {UINT64_C(0x9e19db92b4e31ba9), 1013, 324},
+    {UINT64_C(0xeb96bf6ebadf77d9), 1039, 332},
+    {UINT64_C(0xaf87023b9bf0ee6b), 1066, 340},
+};
+
+static const uint32_t kUpb_SmallPowersOfTen[] = {
+    1,      10,      100,      1000,      10000,
+    100000, 1000000, 10000000, 100000000, 1000000000,
+};
+
+// The range [alpha, gamma] that the scaled value's exponent must fall into,
+// so its integral part fits in 32 bits and digit generation cannot overflow.
+#define kUpb_Grisu_MinTargetExponent -60
+#define kUpb_Grisu_MaxTargetExponent -32
+
+static upb_DiyFp upb_DiyFp_Normalize(upb_DiyFp x) {
+  while (!(x.f & UINT64_C(0xFFC0000000000000))) {
+    x.f <<= 10;
+    x.e -= 10;
+  }
+  while (!(x.f & UINT64_C(0x8000000000000000))) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+// Returns x * y, rounded to 64 bits.
+static upb_DiyFp upb_DiyFp_Mul(upb_DiyFp x, upb_DiyFp y) {
+  const uint64_t kMask32 = 0xFFFFFFFF;
+  uint64_t a = x.f >> 32;
+  uint64_t b = x.f & kMask32;
+  uint64_t c = y.f >> 32;
+  uint64_t d = y.f & kMask32;
+  uint64_t ac = a * c;
+  uint64_t bc = b * c;
+  uint64_t ad = a * d;
+  uint64_t bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & kMask32) + (bc & kMask32);
+  tmp += 1U << 31;  // Round.
+  upb_DiyFp ret;
+  ret.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  ret.e = x.e + y.e + 64;
+  return ret;
+}
+
+// Returns the cached power of ten c = 10^-k such that the exponent of w * c
+// lands in [alpha, gamma].
+static upb_DiyFp upb_CachedPowerFor(int w_e, int* k) {
+  // ceil((alpha - w_e - 1) * log10(2)) is the smallest usable -k; estimate it
+  // with fixed point and correct the estimate below.
+  int x = kUpb_Grisu_MinTargetExponent - w_e - 1;
+  int mk = x >= 0 ? (x * 78913 + (1 << 18) - 1) >> 18 : -((-x * 78913) >> 18);
+  int i = (mk + 348 + 7) / 8;
+  if (i < 0) i = 0;
+  const int max_i = sizeof(kUpb_CachedPowers) / sizeof(kUpb_CachedPowers[0]);
+  if (i >= max_i) i = max_i - 1;
+  while (w_e + kUpb_CachedPowers[i].e + 64 < kUpb_Grisu_MinTargetExponent) i++;
+  while (w_e + kUpb_CachedPowers[i].e + 64 > kUpb_Grisu_MaxTargetExponent) i--;
+  upb_DiyFp c = {kUpb_CachedPowers[i].f, kUpb_CachedPowers[i].e};
+  *k = -kUpb_CachedPowers[i].k;
+  return c;
+}
+
+// Nudges the last digit of buf towards w, where the digits so far are
+// `rest` below too_high.  Returns false if the digits cannot be shown to be
+// the closest shortest representation.
+static bool upb_Grisu_RoundWeed(char* buf, int len, uint64_t dist_too_high_w,
+                                uint64_t unsafe_interval, uint64_t rest,
+                                uint64_t ten_kappa, uint64_t unit) {
+  uint64_t small_dist = dist_too_high_w - unit;
+  uint64_t big_dist = dist_too_high_w + unit;
+  while (rest < small_dist && unsafe_interval - rest >= ten_kappa &&
+         (rest + ten_kappa < small_dist ||
+          small_dist - rest >= rest + ten_kappa - small_dist)) {
+    buf[len - 1]--;
+    rest += ten_kappa;
+  }
+  if (rest < big_dist && unsafe_interval - rest >= ten_kappa &&
+      (rest + ten_kappa < big_dist ||
+       big_dist - rest > rest + ten_kappa - big_dist)) {
+    return false;
+  }
+  return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// Generates the shortest digits of w that lie strictly within (low, high),
+// all three having the same exponent.  On success the value is
+// buf[0..*len) * 10^*kappa.
+static bool upb_Grisu_DigitGen(upb_DiyFp low, upb_DiyFp w, upb_DiyFp high,
+                               char* buf, int* len, int* kappa) {
+  uint64_t unit = 1;
+  // The boundaries are only known to within one unit, so widen them by that
+  // much and only accept digits that are safely inside.
+  uint64_t too_low = low.f - unit;
+  uint64_t too_high = high.f + unit;
+  uint64_t unsafe_interval = too_high - too_low;
+  int shift = -w.e;
+  uint64_t one = (uint64_t)1 << shift;
+  uint32_t integrals = (uint32_t)(too_high >> shift);
+  uint64_t fractionals = too_high & (one - 1);
+
+  int k = sizeof(kUpb_SmallPowersOfTen) / sizeof(kUpb_SmallPowersOfTen[0]);
+  while (k > 1 && integrals < kUpb_SmallPowersOfTen[k - 1]) k--;
+  uint32_t divisor = kUpb_SmallPowersOfTen[k - 1];
+  *kappa = k;
+  *len = 0;
+
+  while (*kappa > 0) {
+    buf[(*len)++] = '0' + integrals / divisor;
+    integrals %= divisor;
+    (*kappa)--;
+    uint64_t rest = ((uint64_t)integrals << shift) + fractionals;
+    if (rest < unsafe_interval) {
+      return upb_Grisu_RoundWeed(buf, *len, too_high - w.f, unsafe_interval,
+                                 rest, (uint64_t)divisor << shift, unit);
+    }
+    divisor /= 10;
+  }
+
+  for (;;) {
+    fractionals *= 10;
+    unit *= 10;
+    unsafe_interval *= 10;
+    buf[(*len)++] = '0' + (int)(fractionals >> shift);
+    fractionals &= one - 1;
+    (*kappa)--;
+    if (fractionals < unsafe_interval) {
+      return upb_Grisu_RoundWeed(buf, *len, (too_high - w.f) * unit,
+                                 unsafe_interval, fractionals, one, unit);
+    }
+  }
+}
+
+// Computes the shortest digits of f * 2^e, a positive float whose type has
+// the given hidden bit and subnormal exponent.  On success the value is
+// buf[0..*len) * 10^*exp.
+static bool upb_Grisu3(uint64_t f, int e, uint64_t hidden_bit,
+                       int denormal_exponent, char* buf, int* len, int* exp) {
+  upb_DiyFp v = {f, e};
+  upb_DiyFp w = upb_DiyFp_Normalize(v);
+
+  // The boundaries are halfway to the neighboring floats.  The lower one is
+  // closer if f is a power of two, as the exponent steps down there.
+  upb_DiyFp high = {(f << 1) + 1, e - 1};
+  high = upb_DiyFp_Normalize(high);
+  upb_DiyFp low;
+  if (f == hidden_bit && e != denormal_exponent) {
+    low.f = (f << 2) - 1;
+    low.e = e - 2;
+  } else {
+    low.f = (f << 1) - 1;
+    low.e = e - 1;
+  }
+  low.f <<= low.e - high.e;
+  low.e = high.e;
+
+  UPB_ASSERT(low.e == w.e && w.e == high.e);
+
+  int mk;
+  upb_DiyFp c = upb_CachedPowerFor(w.e, &mk);
+  int kappa;
+  if (!upb_Grisu_DigitGen(upb_DiyFp_Mul(low, c), upb_DiyFp_Mul(w, c),
+                          upb_DiyFp_Mul(high, c), buf, len, &kappa)) {
+    return false;
+  }
+  *exp = mk + kappa;
+  return true;
+}
+
+// Writes digits[0..n) * 10^exp the way printf("%.*g", precision) would, but
+// always with a '.' radix.
+static void upb_FormatDigits(bool neg, const char* digits, int n, int exp,
+                             int precision, char* buf) {
+  int sci_exp = n + exp - 1;
+  if (neg) *buf++ = '-';
+  if (sci_exp < -4 || sci_exp >= precision) {
+    *buf++ = digits[0];
+    if (n > 1) {
+      *buf++ = '.';
+      memcpy(buf, digits + 1, n - 1);
+      buf += n - 1;
+    }
+    *buf++ = 'e';
+    if (sci_exp < 0) {
+      *buf++ = '-';
+      sci_exp = -sci_exp;
+    } else {
+      *buf++ = '+';
+    }
+    if (sci_exp >= 100) *buf++ = '0' + sci_exp / 100;
+    *buf++ = '0' + sci_exp / 10 % 10;
+    *buf++ = '0' + sci_exp % 10;
+  } else if (sci_exp < 0) {
+    *buf++ = '0';
+    *buf++ = '.';
+    memset(buf, '0', -sci_exp - 1);
+    buf += -sci_exp - 1;
+    memcpy(buf, digits, n);
+    buf += n;
+  } else if (n <= sci_exp + 1) {
+    memcpy(buf, digits, n);
+    memset(buf + n, '0', sci_exp + 1 - n);
+    buf += sci_exp + 1;
+  } else {
+    memcpy(buf, digits, sci_exp + 1);
+    buf += sci_exp + 1;
+    *buf++ = '.';
+    memcpy(buf, digits + sci_exp + 1, n - sci_exp - 1);
+    buf += n - sci_exp - 1;
+  }
+  *buf = '\0';
+}
+
+// Formats the float f * 2^e (0 < f, finite) if Grisu3 succeeds.  The layout
+// matches the printf() fallback: precision `dig` for values that need at most
+// that many digits, `max_dig` for the rest.
+static bool upb_EncodeShortest(bool neg, uint64_t f, int e, uint64_t hidden_bit,
+                               int denormal_exponent, int dig, int max_dig,
+                               char* buf) {
+  char digits[20];
+  int n;
+  int exp;
+  if (!upb_Grisu3(f, e, hidden_bit, denormal_exponent, digits, &n, &exp)) {
+    return false;
+  }
+  upb_FormatDigits(neg, digits, n, exp, n <= dig ? dig : max_dig, buf);
+  return true;
+}
+
 void _upb_EncodeRoundTripDouble(double val, char* buf, size_t size) {
   assert(size >= kUpb_RoundTripBufferSize);
+  uint64_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  const uint64_t kHiddenBit = UINT64_C(1) << 52;
+  uint64_t f = bits & (kHiddenBit - 1);
+  int biased_e = (int)(bits >> 52) & 0x7ff;
+  bool neg = bits >> 63;
+  if (biased_e == 0 && f == 0) {
+    strcpy(buf, neg ? "-0" : "0");
+    return;
+  }
+  if (biased_e != 0x7ff) {
+    int e = -1074;
+    if (biased_e) {
+      f |= kHiddenBit;
+      e = biased_e - 1075;
+    }
+    if (upb_EncodeShortest(neg, f, e, kHiddenBit, -1074, DBL_DIG, DBL_DIG + 2,
+                           buf)) {
+      return;
+    }
+  }
+
   snprintf(buf, size, "%.*g", DBL_DIG, val);
   if (strtod(buf, NULL) != val) {
     snprintf(buf, size, "%.*g", DBL_DIG + 2, val);
@@ -61,6 +420,28 @@ void _upb_EncodeRoundTripDouble(double val, char* buf, size_t size) {
 
 void _upb_EncodeRoundTripFloat(float val, char* buf, size_t size) {
   assert(size >= kUpb_RoundTripBufferSize);
+  uint32_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  const uint32_t kHiddenBit = 1U << 23;
+  uint32_t f = bits & (kHiddenBit - 1);
+  int biased_e = (int)(bits >> 23) & 0xff;
+  bool neg = bits >> 31;
+  if (biased_e == 0 && f == 0) {
+    strcpy(buf, neg ? "-0" : "0");
+    return;
+  }
+  if (biased_e != 0xff) {
+    int e = -149;
+    if (biased_e) {
+      f |= kHiddenBit;
+      e = biased_e - 150;
+    }
+    if (upb_EncodeShortest(neg, f, e, kHiddenBit, -149, FLT_DIG, FLT_DIG + 3,
+                           buf)) {
+      return;
+    }
+  }
+
   snprintf(buf, size, "%.*g", FLT_DIG, val);
   if (strtof(buf, NULL) != val) {
     snprintf(buf, size, "%.*g", FLT_DIG + 3, val);
@@ -35,9 +35,11 @@
 #include "upb/port/def.inc"
 
 // Encodes a float or double that is round-trippable, but as short as possible.
-// These routines are not fully optimal (not guaranteed to be shortest), but are
-// short-ish and match the implementation that has been used in protobuf since
-// the beginning.
+// The digits are the shortest that round-trip for all but a fraction of a
+// percent of values, where we fall back to the printf()-based implementation
+// that protobuf has used since the beginning.  Either way the layout (when to
+// use an exponent) matches that implementation's "%g", and the radix is always
+// '.' regardless of locale.
 
 // The given buffer size must be at least kUpb_RoundTripBufferSize.
 enum { kUpb_RoundTripBufferSize = 32 };
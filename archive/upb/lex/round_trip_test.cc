@@ -0,0 +1,111 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/lex/round_trip.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+std::string EncodeDouble(double val) {
+  char buf[kUpb_RoundTripBufferSize];
+  _upb_EncodeRoundTripDouble(val, buf, sizeof(buf));
+  return buf;
+}
+
+std::string EncodeFloat(float val) {
+  char buf[kUpb_RoundTripBufferSize];
+  _upb_EncodeRoundTripFloat(val, buf, sizeof(buf));
+  return buf;
+}
+
+TEST(RoundTripTest, Double) {
+  EXPECT_EQ("0", EncodeDouble(0));
+  EXPECT_EQ("-0", EncodeDouble(-0.0));
+  EXPECT_EQ("1", EncodeDouble(1));
+  EXPECT_EQ("0.1", EncodeDouble(0.1));
+  EXPECT_EQ("-1.5", EncodeDouble(-1.5));
+  EXPECT_EQ("0.0001", EncodeDouble(0.0001));
+  EXPECT_EQ("1e-05", EncodeDouble(0.00001));
+  EXPECT_EQ("100000000000000", EncodeDouble(1e14));
+  EXPECT_EQ("1e+15", EncodeDouble(1e15));
+  EXPECT_EQ("1e+100", EncodeDouble(1e100));
+  EXPECT_EQ("0.3333333333333333", EncodeDouble(1.0 / 3));
+  EXPECT_EQ("0.30000000000000004", EncodeDouble(0.1 + 0.2));
+  EXPECT_EQ("1.7976931348623157e+308",
+            EncodeDouble(std::numeric_limits<double>::max()));
+  EXPECT_EQ("2.2250738585072014e-308",
+            EncodeDouble(std::numeric_limits<double>::min()));
+  EXPECT_EQ("5e-324", EncodeDouble(std::numeric_limits<double>::denorm_min()));
+}
+
+TEST(RoundTripTest, Float) {
+  EXPECT_EQ("0", EncodeFloat(0));
+  EXPECT_EQ("0.1", EncodeFloat(0.1f));
+  EXPECT_EQ("-2.5", EncodeFloat(-2.5f));
+  EXPECT_EQ("1e+06", EncodeFloat(1e6f));
+  EXPECT_EQ("16777216", EncodeFloat(16777216.0f));
+  EXPECT_EQ("3.4028235e+38", EncodeFloat(std::numeric_limits<float>::max()));
+  EXPECT_EQ("1e-45", EncodeFloat(std::numeric_limits<float>::denorm_min()));
+}
+
+TEST(RoundTripTest, RandomDoubles) {
+  std::mt19937_64 rng(42);
+  for (int i = 0; i < 100000; i++) {
+    uint64_t bits = rng();
+    double val;
+    memcpy(&val, &bits, sizeof(val));
+    if (val != val) continue;
+    std::string str = EncodeDouble(val);
+    EXPECT_EQ(val, strtod(str.c_str(), nullptr)) << str;
+  }
+}
+
+TEST(RoundTripTest, RandomFloats) {
+  std::mt19937 rng(42);
+  for (int i = 0; i < 100000; i++) {
+    uint32_t bits = rng();
+    float val;
+    memcpy(&val, &bits, sizeof(val));
+    if (val != val) continue;
+    std::string str = EncodeFloat(val);
+    EXPECT_EQ(val, strtof(str.c_str(), nullptr)) << str;
+  }
+}
+
+}  // namespace
@@ -40,6 +40,13 @@ extern "C" {
 
 double _upb_NoLocaleStrtod(const char *str, char **endptr);
 
+// Parses the decimal number at the start of [ptr, end) into the nearest double,
+// regardless of locale.  The syntax is an optional '-', digits with an optional
+// '.', and an optional exponent; unlike strtod() there is no leading space,
+// '+', hex, "inf" or "nan".  Returns a pointer past the number, or NULL if
+// there are no digits.
+const char *upb_BufToDouble(const char *ptr, const char *end, double *val);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,125 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#include "upb/lex/strtod.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Parses all of |str|, failing the test if upb_BufToDouble() stops early.
+double Parse(const std::string& str) {
+  double val = -1;
+  const char* end = upb_BufToDouble(str.data(), str.data() + str.size(), &val);
+  EXPECT_EQ(end, str.data() + str.size()) << str;
+  return val;
+}
+
+TEST(StrtodTest, Simple) {
+  EXPECT_EQ(0, Parse("0"));
+  EXPECT_TRUE(std::signbit(Parse("-0")));
+  EXPECT_EQ(1, Parse("1"));
+  EXPECT_EQ(-1.5, Parse("-1.5"));
+  EXPECT_EQ(0.1, Parse("0.1"));
+  EXPECT_EQ(0.1, Parse("00000.1000000"));
+  EXPECT_EQ(1.0, Parse("1."));
+  EXPECT_EQ(0.5, Parse(".5"));
+  EXPECT_EQ(15, Parse("1.5e1"));
+  EXPECT_EQ(15, Parse("1.5E+1"));
+  EXPECT_EQ(1.5, Parse("15e-1"));
+  EXPECT_EQ(0, Parse("0e999999999"));
+  EXPECT_EQ(18446744073709551615.0, Parse("18446744073709551615"));
+  EXPECT_EQ(std::numeric_limits<double>::max(),
+            Parse("1.7976931348623157e308"));
+  EXPECT_EQ(std::numeric_limits<double>::min(),
+            Parse("2.2250738585072014e-308"));
+  EXPECT_EQ(std::numeric_limits<double>::denorm_min(), Parse("5e-324"));
+  EXPECT_EQ(std::numeric_limits<double>::infinity(), Parse("1e309"));
+  EXPECT_EQ(0, Parse("1e-400"));
+}
+
+TEST(StrtodTest, Stops) {
+  const char* str = "1.25e3x";
+  double val;
+  EXPECT_EQ(str + 6, upb_BufToDouble(str, str + strlen(str), &val));
+  EXPECT_EQ(1250, val);
+
+  // An exponent without digits is not part of the number.
+  str = "2e+";
+  EXPECT_EQ(str + 1, upb_BufToDouble(str, str + strlen(str), &val));
+  EXPECT_EQ(2, val);
+
+  // The end of the buffer is respected even if more digits follow.
+  str = "12345";
+  EXPECT_EQ(str + 3, upb_BufToDouble(str, str + 3, &val));
+  EXPECT_EQ(123, val);
+
+  EXPECT_EQ(nullptr, upb_BufToDouble(str, str, &val));
+  for (const char* bad : {"-", ".", "-.", "e5", "+1", " 1", "inf", "nan"}) {
+    EXPECT_EQ(nullptr, upb_BufToDouble(bad, bad + strlen(bad), &val)) << bad;
+  }
+}
+
+TEST(StrtodTest, Halfway) {
+  // Exactly halfway between two doubles, ties to even.
+  EXPECT_EQ(9007199254740992.0, Parse("9007199254740993"));
+  EXPECT_EQ(9007199254740996.0, Parse("9007199254740995"));
+  // Just above halfway only after the 19th significant digit.
+  EXPECT_EQ(9007199254740994.0, Parse("9007199254740993.0000000000000001"));
+  EXPECT_EQ(9007199254740992.0, Parse("9007199254740993.0000000000000000"));
+  // Many more digits than a double can hold.
+  std::string big = "0." + std::string(800, '3');
+  EXPECT_EQ(1.0 / 3, Parse(big));
+  EXPECT_EQ(1.0 / 3, Parse(big + "e0"));
+  EXPECT_EQ(100.0 / 3, Parse(big + "e2"));
+}
+
+TEST(StrtodTest, MatchesStrtod) {
+  std::mt19937_64 rng(1234);
+  char buf[64];
+  for (int i = 0; i < 100000; i++) {
+    uint64_t bits = rng();
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    if (d != d || d - d != 0) continue;
+    snprintf(buf, sizeof(buf), "%.*g", 1 + (int)(rng() % 20), d);
+    EXPECT_EQ(strtod(buf, nullptr), Parse(buf)) << buf;
+  }
+}
+
+}  // namespace
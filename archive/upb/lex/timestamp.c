@@ -0,0 +1,170 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/lex/timestamp.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// The days before the first of each month in a year that starts in March, so
+// that the leap day falls at the end.
+static const uint16_t kUpb_DaysBeforeMonth[12] = {
+    306, 337, 0, 31, 61, 92, 122, 153, 184, 214, 245, 275};
+
+// Returns the number of days from 1970-01-01 to y-m-d, where `m` is 1-12 and
+// `y` is 0-9999.
+static int32_t _upb_DaysFromCivil(int y, int m, int d) {
+  // Count March-based years from 4800 BC, a multiple of 400 years before any
+  // year we accept.
+  uint32_t y_adj = y + 4800 - (m <= 2);
+  uint32_t leap_days = y_adj / 4 - y_adj / 100 + y_adj / 400;
+  int32_t days = y_adj * 365 + leap_days + kUpb_DaysBeforeMonth[m - 1];
+  return days + (d - 1) - 2472632;
+}
+
+// The reverse of _upb_DaysFromCivil(), for any date from 0000-03-01 on.  From
+// Hinnant, "chrono-Compatible Low-Level Date Algorithms".
+static void _upb_CivilFromDays(int32_t days, int* y, int* m, int* d) {
+  uint32_t z = days + 719468;  // Days since 0000-03-01.
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;  // Day of the 400-year era.
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);  // From March 1st.
+  uint32_t mp = (5 * doy + 2) / 153;                       // March is 0.
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = era * 400 + yoe + (*m <= 2);
+}
+
+static void _upb_Timestamp_Put2(char* ptr, uint32_t val) {
+  ptr[0] = '0' + val / 10;
+  ptr[1] = '0' + val % 10;
+}
+
+static void _upb_Timestamp_Put3(char* ptr, uint32_t val) {
+  ptr[0] = '0' + val / 100;
+  _upb_Timestamp_Put2(ptr + 1, val % 100);
+}
+
+// Returns the value of the two digits at `ptr`, setting `*bad` if either is
+// not a digit.
+static int _upb_Timestamp_Get2(const char* ptr, bool* bad) {
+  unsigned hi = (unsigned char)ptr[0] - '0';
+  unsigned lo = (unsigned char)ptr[1] - '0';
+  *bad |= (hi > 9) | (lo > 9);
+  return hi * 10 + lo;
+}
+
+int upb_NanosToBuf(int32_t nanos, char* buf) {
+  UPB_ASSERT(nanos >= 0 && nanos < 1000000000);
+  if (nanos == 0) return 0;
+
+  // Write all nine digits, then drop trailing groups of three zeros.
+  uint32_t millis = nanos / 1000000;
+  uint32_t micros = nanos / 1000 % 1000;
+  uint32_t rest = nanos % 1000;
+  buf[0] = '.';
+  _upb_Timestamp_Put3(buf + 1, millis);
+  _upb_Timestamp_Put3(buf + 4, micros);
+  _upb_Timestamp_Put3(buf + 7, rest);
+  return rest ? 10 : micros ? 7 : 4;
+}
+
+int upb_TimestampToBuf(int64_t seconds, int32_t nanos, char* buf) {
+  UPB_ASSERT(seconds >= -62135596800 && seconds <= 253402300799);
+
+  // Seconds since 0001-01-01, which are never negative.
+  uint64_t since_year1 = seconds + 62135596800;
+  uint32_t secs = since_year1 % 86400;
+  int y, m, d;
+  _upb_CivilFromDays((int32_t)(since_year1 / 86400) - 719162, &y, &m, &d);
+
+  _upb_Timestamp_Put2(buf, y / 100);
+  _upb_Timestamp_Put2(buf + 2, y % 100);
+  buf[4] = '-';
+  _upb_Timestamp_Put2(buf + 5, m);
+  buf[7] = '-';
+  _upb_Timestamp_Put2(buf + 8, d);
+  buf[10] = 'T';
+  _upb_Timestamp_Put2(buf + 11, secs / 3600);
+  buf[13] = ':';
+  _upb_Timestamp_Put2(buf + 14, secs / 60 % 60);
+  buf[16] = ':';
+  _upb_Timestamp_Put2(buf + 17, secs % 60);
+
+  int len = 19 + upb_NanosToBuf(nanos, buf + 19);
+  buf[len++] = 'Z';
+  return len;
+}
+
+bool upb_BufToDateTime(const char* ptr, int64_t* seconds) {
+  bool bad = (ptr[4] != '-') | (ptr[7] != '-') | (ptr[10] != 'T') |
+             (ptr[13] != ':') | (ptr[16] != ':');
+  int year = _upb_Timestamp_Get2(ptr, &bad) * 100 +
+             _upb_Timestamp_Get2(ptr + 2, &bad);
+  int mon = _upb_Timestamp_Get2(ptr + 5, &bad);
+  int day = _upb_Timestamp_Get2(ptr + 8, &bad);
+  int hour = _upb_Timestamp_Get2(ptr + 11, &bad);
+  int min = _upb_Timestamp_Get2(ptr + 14, &bad);
+  int sec = _upb_Timestamp_Get2(ptr + 17, &bad);
+  if (bad || mon < 1 || mon > 12) return false;
+
+  *seconds = (int64_t)_upb_DaysFromCivil(year, mon, day) * 86400 +
+             hour * 3600 + min * 60 + sec;
+  return true;
+}
+
+bool upb_BufToUtcOffset(const char* ptr, int32_t* seconds) {
+  bool bad = ((ptr[0] != '+') & (ptr[0] != '-')) | (ptr[3] != ':');
+  int hour = _upb_Timestamp_Get2(ptr + 1, &bad);
+  int min = _upb_Timestamp_Get2(ptr + 4, &bad);
+  if (bad) return false;
+
+  int32_t ofs = (hour * 60 + min) * 60;
+  *seconds = ptr[0] == '-' ? -ofs : ofs;
+  return true;
+}
+
+const char* upb_BufToNanos(const char* ptr, const char* end, int32_t* nanos) {
+  static const int32_t kScale[10] = {
+      0, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1};
+
+  *nanos = 0;
+  if (ptr == end || *ptr != '.') return ptr;
+
+  const char* start = ++ptr;
+  int32_t val = 0;
+  for (; ptr < end && (unsigned char)(*ptr - '0') < 10; ptr++) {
+    if (ptr - start == 9) return NULL;
+    val = val * 10 + (*ptr - '0');
+  }
+  *nanos = val * kScale[ptr - start];
+  return ptr;
+}
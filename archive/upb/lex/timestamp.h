@@ -0,0 +1,83 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_LEX_TIMESTAMP_H_
+#define UPB_LEX_TIMESTAMP_H_
+
+#include <stdint.h>
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed-width RFC 3339 dates and times, as used by the JSON forms of
+// google.protobuf.Timestamp and Duration.  Digits are converted a field at a
+// time without loops or printf(), and days are counted from 1970-01-01 in the
+// proleptic Gregorian calendar.
+
+// The most bytes that upb_NanosToBuf() or upb_TimestampToBuf() will write.
+enum {
+  kUpb_NanosBufferSize = 10,      // .999999999
+  kUpb_TimestampBufferSize = 30,  // 9999-12-31T23:59:59.999999999Z
+};
+
+// Writes `nanos`, which must be in [0, 999999999], to `buf` as fractional
+// seconds with 3, 6 or 9 digits after the point, or as nothing if it is zero.
+// Returns the number of bytes written.
+int upb_NanosToBuf(int32_t nanos, char* buf);
+
+// Writes `seconds` since the epoch, which must be within years 0001-9999, and
+// `nanos` as for upb_NanosToBuf(), to `buf` in the form
+// "1972-01-01T10:00:20.021Z".  Returns the number of bytes written.
+int upb_TimestampToBuf(int64_t seconds, int32_t nanos, char* buf);
+
+// Parses the 19 bytes at `ptr` in the form "1972-01-01T10:00:20" to seconds
+// since the epoch.  Returns false if they are malformed.
+bool upb_BufToDateTime(const char* ptr, int64_t* seconds);
+
+// Parses the 6 bytes at `ptr` in the form "+08:00" or "-08:00" to seconds
+// east of UTC.  Returns false if they are malformed.
+bool upb_BufToUtcOffset(const char* ptr, int32_t* seconds);
+
+// Parses fractional seconds in the form ".021" from [ptr, end), leaving
+// `*nanos` zero if `ptr` is not at a point.  Returns the new position, or NULL
+// if there are more than 9 digits.
+const char* upb_BufToNanos(const char* ptr, const char* end, int32_t* nanos);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_LEX_TIMESTAMP_H_ */
@@ -0,0 +1,149 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/lex/timestamp.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+const int64_t kMinSeconds = -62135596800;  // 0001-01-01T00:00:00Z
+const int64_t kMaxSeconds = 253402300799;  // 9999-12-31T23:59:59Z
+
+// Formats with the algorithm of Fliegel and Van Flandern, "A Machine
+// Algorithm for Processing Calendar Dates" (1968), to check against.
+std::string ReferenceFormat(int64_t seconds, int32_t nanos) {
+  seconds += 62135596800;
+  int L = (int)(seconds / 86400) - 719162 + 68569 + 2440588;
+  int N = 4 * L / 146097;
+  L = L - (146097 * N + 3) / 4;
+  int I = 4000 * (L + 1) / 1461001;
+  L = L - 1461 * I / 4 + 31;
+  int J = 80 * L / 2447;
+  int K = L - 2447 * J / 80;
+  L = J / 11;
+  J = J + 2 - 12 * L;
+  I = 100 * (N - 49) + I + L;
+
+  char buf[64];
+  int n = snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d", I, J, K,
+                   (int)(seconds / 3600 % 24), (int)(seconds / 60 % 60),
+                   (int)(seconds % 60));
+  if (nanos) {
+    int digits = 9;
+    while (nanos % 1000 == 0) {
+      nanos /= 1000;
+      digits -= 3;
+    }
+    n += snprintf(buf + n, sizeof(buf) - n, ".%0*d", digits, nanos);
+  }
+  return std::string(buf, n) + "Z";
+}
+
+std::string Format(int64_t seconds, int32_t nanos) {
+  char buf[kUpb_TimestampBufferSize];
+  return std::string(buf, upb_TimestampToBuf(seconds, nanos, buf));
+}
+
+TEST(TimestampTest, Format) {
+  EXPECT_EQ("0001-01-01T00:00:00Z", Format(kMinSeconds, 0));
+  EXPECT_EQ("9999-12-31T23:59:59.999999999Z", Format(kMaxSeconds, 999999999));
+  EXPECT_EQ("1970-01-01T00:00:00.001Z", Format(0, 1000000));
+  EXPECT_EQ("1969-12-31T23:59:59.000001Z", Format(-1, 1000));
+  EXPECT_EQ("2000-02-29T12:00:00.000000001Z", Format(951825600, 1));
+
+  std::mt19937_64 rng(12345);
+  for (int i = 0; i < 100000; i++) {
+    int64_t seconds = kMinSeconds + rng() % (kMaxSeconds - kMinSeconds + 1);
+    int32_t nanos = rng() % 4 == 0 ? 0 : rng() % 1000000000;
+    if (rng() % 2) nanos -= nanos % 1000;
+    ASSERT_EQ(ReferenceFormat(seconds, nanos), Format(seconds, nanos))
+        << seconds << " " << nanos;
+  }
+}
+
+TEST(TimestampTest, RoundTrip) {
+  std::mt19937_64 rng(12345);
+  for (int i = 0; i < 100000; i++) {
+    int64_t seconds = kMinSeconds + rng() % (kMaxSeconds - kMinSeconds + 1);
+    int32_t nanos = rng() % 1000000000;
+    std::string str = Format(seconds, nanos);
+
+    int64_t parsed_seconds;
+    int32_t parsed_nanos;
+    ASSERT_TRUE(upb_BufToDateTime(str.data(), &parsed_seconds)) << str;
+    const char* end = str.data() + str.size() - 1;
+    EXPECT_EQ(end, upb_BufToNanos(str.data() + 19, end, &parsed_nanos));
+    EXPECT_EQ(seconds, parsed_seconds) << str;
+    EXPECT_EQ(nanos, parsed_nanos) << str;
+  }
+}
+
+TEST(TimestampTest, ParseErrors) {
+  int64_t seconds;
+  EXPECT_TRUE(upb_BufToDateTime("1972-01-01T10:00:20", &seconds));
+  EXPECT_EQ(63108020, seconds);
+  for (const char* str :
+       {"1972-01-01t10:00:20", "1972/01/01T10:00:20", "1972-01-01T10-00:20",
+        "1972-00-01T10:00:20", "1972-13-01T10:00:20", "197a-01-01T10:00:20",
+        "1972-01-01T10:00:2 ", "1972-01-01T10:0\xff:20"}) {
+    EXPECT_FALSE(upb_BufToDateTime(str, &seconds)) << str;
+  }
+
+  int32_t ofs;
+  EXPECT_TRUE(upb_BufToUtcOffset("+08:30", &ofs));
+  EXPECT_EQ(30600, ofs);
+  EXPECT_TRUE(upb_BufToUtcOffset("-01:00", &ofs));
+  EXPECT_EQ(-3600, ofs);
+  EXPECT_FALSE(upb_BufToUtcOffset("08:30Z", &ofs));
+  EXPECT_FALSE(upb_BufToUtcOffset("+08-30", &ofs));
+  EXPECT_FALSE(upb_BufToUtcOffset("+0a:30", &ofs));
+
+  int32_t nanos;
+  std::string str = ".5s";
+  EXPECT_EQ(&str[2], upb_BufToNanos(&str[0], &str[3], &nanos));
+  EXPECT_EQ(500000000, nanos);
+  str = "s";
+  EXPECT_EQ(&str[0], upb_BufToNanos(&str[0], &str[1], &nanos));
+  EXPECT_EQ(0, nanos);
+  str = ".123456789";
+  EXPECT_EQ(&str[10], upb_BufToNanos(&str[0], &str[10], &nanos));
+  EXPECT_EQ(123456789, nanos);
+  str = ".1234567891";
+  EXPECT_EQ(nullptr, upb_BufToNanos(&str[0], &str[11], &nanos));
+}
+
+}  // namespace
@@ -0,0 +1,277 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/lex/utf8.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "upb/port/cpu.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define UPB_UTF8_AVX2 1
+#endif
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Checks one sequence at a time against the well-formed byte sequences in
+// Table 3-7 of the Unicode Standard.
+static bool _upb_Utf8_IsValidScalar(const uint8_t* ptr, const uint8_t* end) {
+  while (ptr < end) {
+    if (end - ptr >= 8) {
+      uint64_t data;
+      memcpy(&data, ptr, 8);
+      if ((data & 0x8080808080808080) == 0) {
+        ptr += 8;
+        continue;
+      }
+    }
+
+    uint8_t c = *ptr;
+    if (c < 0x80) {
+      ptr++;
+      continue;
+    }
+
+    // Range of the second byte; later bytes are always 0x80-0xbf.
+    uint8_t lo = 0x80;
+    uint8_t hi = 0xbf;
+    int n;
+    if (c >= 0xc2 && c <= 0xdf) {
+      n = 1;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      n = 2;
+      if (c == 0xe0) lo = 0xa0;  // Overlong.
+      if (c == 0xed) hi = 0x9f;  // Surrogate.
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      n = 3;
+      if (c == 0xf0) lo = 0x90;  // Overlong.
+      if (c == 0xf4) hi = 0x8f;  // Above U+10FFFF.
+    } else {
+      return false;
+    }
+
+    if (end - ptr <= n) return false;
+    if (ptr[1] < lo || ptr[1] > hi) return false;
+    for (int i = 2; i <= n; i++) {
+      if ((ptr[i] & 0xc0) != 0x80) return false;
+    }
+    ptr += n + 1;
+  }
+  return true;
+}
+
+#ifdef UPB_UTF8_AVX2
+
+// The lookup algorithm of Keiser and Lemire, "Validating UTF-8 In Less Than
+// One Instruction Per Byte" (2021). Each byte is classified by the high and
+// low nibbles of the byte before it and the high nibble of the byte itself;
+// the three table lookups are ANDed, and any bit left set is an error.
+// Sequences of three and four bytes are checked by requiring a continuation
+// byte wherever one is owed by the lead byte two or three positions back.
+
+#define UPB_UTF8_TOO_SHORT (1 << 0)   // 11______ 0_______ or 11______ 11______
+#define UPB_UTF8_TOO_LONG (1 << 1)    // 0_______ 10______
+#define UPB_UTF8_OVERLONG_3 (1 << 2)  // 11100000 100_____
+#define UPB_UTF8_TOO_LARGE (1 << 3)   // 11110100 1001____ and above
+#define UPB_UTF8_SURROGATE (1 << 4)   // 11101101 101_____
+#define UPB_UTF8_OVERLONG_2 (1 << 5)  // 1100000_ 10______
+#define UPB_UTF8_TOO_LARGE_1000 (1 << 6)  // 11110101 1000____ and above
+#define UPB_UTF8_OVERLONG_4 (1 << 6)      // 11110000 1000____
+#define UPB_UTF8_TWO_CONTS (1 << 7)       // 10______ 10______
+#define UPB_UTF8_CARRY \
+  (UPB_UTF8_TOO_SHORT | UPB_UTF8_TOO_LONG | UPB_UTF8_TWO_CONTS)
+
+// _mm256_shuffle_epi8() looks up within each 128-bit lane, so the table is
+// repeated in both.
+#define UPB_UTF8_TABLE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)        \
+  _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d), (char)(e),    \
+                   (char)(f), (char)(g), (char)(h), (char)(i), (char)(j),    \
+                   (char)(k), (char)(l), (char)(m), (char)(n), (char)(o),    \
+                   (char)(p), (char)(a), (char)(b), (char)(c), (char)(d),    \
+                   (char)(e), (char)(f), (char)(g), (char)(h), (char)(i),    \
+                   (char)(j), (char)(k), (char)(l), (char)(m), (char)(n),    \
+                   (char)(o), (char)(p))
+
+// Returns the bytes of `input` shifted later by `n`, with the first `n` taken
+// from the end of `prev`.
+#define UPB_UTF8_PREV(input, prev, n)                                   \
+  _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), \
+                     16 - n)
+
+__attribute__((target("avx2"))) static __m256i _upb_Utf8_HighNibble(
+    __m256i v) {
+  return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+// Returns a vector that is nonzero wherever the 32 bytes of `input`,
+// preceded by those of `prev`, are not well-formed.
+__attribute__((target("avx2"))) static __m256i _upb_Utf8_CheckBytes(
+    __m256i input, __m256i prev) {
+  const __m256i prev1 = UPB_UTF8_PREV(input, prev, 1);
+  const __m256i byte_1_high = _mm256_shuffle_epi8(
+      UPB_UTF8_TABLE(
+          // 0_______ ________
+          UPB_UTF8_TOO_LONG, UPB_UTF8_TOO_LONG, UPB_UTF8_TOO_LONG,
+          UPB_UTF8_TOO_LONG, UPB_UTF8_TOO_LONG, UPB_UTF8_TOO_LONG,
+          UPB_UTF8_TOO_LONG, UPB_UTF8_TOO_LONG,
+          // 10______ ________
+          UPB_UTF8_TWO_CONTS, UPB_UTF8_TWO_CONTS, UPB_UTF8_TWO_CONTS,
+          UPB_UTF8_TWO_CONTS,
+          // 1100____ ________
+          UPB_UTF8_TOO_SHORT | UPB_UTF8_OVERLONG_2,
+          // 1101____ ________
+          UPB_UTF8_TOO_SHORT,
+          // 1110____ ________
+          UPB_UTF8_TOO_SHORT | UPB_UTF8_OVERLONG_3 | UPB_UTF8_SURROGATE,
+          // 1111____ ________
+          UPB_UTF8_TOO_SHORT | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000 |
+              UPB_UTF8_OVERLONG_4),
+      _upb_Utf8_HighNibble(prev1));
+  const __m256i byte_1_low = _mm256_shuffle_epi8(
+      UPB_UTF8_TABLE(
+          // ____0000 ________
+          UPB_UTF8_CARRY | UPB_UTF8_OVERLONG_3 | UPB_UTF8_OVERLONG_2 |
+              UPB_UTF8_OVERLONG_4,
+          // ____0001 ________
+          UPB_UTF8_CARRY | UPB_UTF8_OVERLONG_2,
+          // ____001_ ________
+          UPB_UTF8_CARRY, UPB_UTF8_CARRY,
+          // ____0100 ________
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE,
+          // ____0101 ________ through ____1100 ________
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          // ____1101 ________
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000 |
+              UPB_UTF8_SURROGATE,
+          // ____111_ ________
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000,
+          UPB_UTF8_CARRY | UPB_UTF8_TOO_LARGE | UPB_UTF8_TOO_LARGE_1000),
+      _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)));
+  const __m256i byte_2_high = _mm256_shuffle_epi8(
+      UPB_UTF8_TABLE(
+          // ________ 0_______
+          UPB_UTF8_TOO_SHORT, UPB_UTF8_TOO_SHORT, UPB_UTF8_TOO_SHORT,
+          UPB_UTF8_TOO_SHORT, UPB_UTF8_TOO_SHORT, UPB_UTF8_TOO_SHORT,
+          UPB_UTF8_TOO_SHORT, UPB_UTF8_TOO_SHORT,
+          // ________ 1000____
+          UPB_UTF8_TOO_LONG | UPB_UTF8_OVERLONG_2 | UPB_UTF8_TWO_CONTS |
+              UPB_UTF8_OVERLONG_3 | UPB_UTF8_TOO_LARGE_1000 |
+              UPB_UTF8_OVERLONG_4,
+          // ________ 1001____
+          UPB_UTF8_TOO_LONG | UPB_UTF8_OVERLONG_2 | UPB_UTF8_TWO_CONTS |
+              UPB_UTF8_OVERLONG_3 | UPB_UTF8_TOO_LARGE,
+          // ________ 101_____
+          UPB_UTF8_TOO_LONG | UPB_UTF8_OVERLONG_2 | UPB_UTF8_TWO_CONTS |
+              UPB_UTF8_SURROGATE | UPB_UTF8_TOO_LARGE,
+          UPB_UTF8_TOO_LONG | UPB_UTF8_OVERLONG_2 | UPB_UTF8_TWO_CONTS |
+              UPB_UTF8_SURROGATE | UPB_UTF8_TOO_LARGE,
+          // ________ 11______
+          UPB_UTF8_TOO_SHORT, UPB_UTF8_TOO_SHORT, UPB_UTF8_TOO_SHORT,
+          UPB_UTF8_TOO_SHORT),
+      _upb_Utf8_HighNibble(input));
+  const __m256i special = _mm256_and_si256(
+      _mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+  // Only 111_____ two bytes back or 1111____ three bytes back leave the top
+  // bit set, and exactly those positions must hold a continuation byte. The
+  // TWO_CONTS bit of `special` is set for every continuation that follows
+  // another one, so XOR leaves an error wherever the two disagree.
+  const __m256i third = _mm256_subs_epu8(UPB_UTF8_PREV(input, prev, 2),
+                                         _mm256_set1_epi8(0xe0 - 0x80));
+  const __m256i fourth = _mm256_subs_epu8(UPB_UTF8_PREV(input, prev, 3),
+                                          _mm256_set1_epi8(0xf0 - 0x80));
+  const __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth),
+                                          _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must23, special);
+}
+
+// Returns a vector that is nonzero if `input` ends partway through a
+// sequence.
+__attribute__((target("avx2"))) static __m256i _upb_Utf8_IsIncomplete(
+    __m256i input) {
+  const __m256i max = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xf0 - 1),
+      (char)(0xe0 - 1), (char)(0xc0 - 1));
+  return _mm256_subs_epu8(input, max);
+}
+
+__attribute__((target("avx2"))) static bool _upb_Utf8_IsValidAvx2(
+    const uint8_t* ptr, const uint8_t* end) {
+  __m256i prev = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  __m256i error = _mm256_setzero_si256();
+  uint8_t tail[32];
+  while (ptr < end) {
+    __m256i input;
+    if (end - ptr >= 32) {
+      input = _mm256_loadu_si256((const __m256i*)ptr);
+      ptr += 32;
+    } else {
+      // Pad the last block with ASCII, which cannot complete a sequence.
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, ptr, end - ptr);
+      input = _mm256_loadu_si256((const __m256i*)tail);
+      ptr = end;
+    }
+    if (_mm256_movemask_epi8(input) == 0) {
+      error = _mm256_or_si256(error, incomplete);
+      incomplete = _mm256_setzero_si256();
+    } else {
+      error = _mm256_or_si256(error, _upb_Utf8_CheckBytes(input, prev));
+      incomplete = _upb_Utf8_IsIncomplete(input);
+    }
+    prev = input;
+  }
+  error = _mm256_or_si256(error, incomplete);
+  return _mm256_testz_si256(error, error);
+}
+
+#endif  // UPB_UTF8_AVX2
+
+bool upb_Utf8_IsValid(const char* ptr, size_t len) {
+  const uint8_t* p = (const uint8_t*)ptr;
+#ifdef UPB_UTF8_AVX2
+  if (len >= 32 && upb_Cpu_Has(kUpb_CpuFeature_Avx2)) {
+    return _upb_Utf8_IsValidAvx2(p, p + len);
+  }
+#endif
+  return _upb_Utf8_IsValidScalar(p, p + len);
+}
@@ -0,0 +1,171 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/lex/utf8.h"
+
+#include <stdint.h>
+
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "upb/lex/unicode.h"
+#include "upb/port/cpu.h"
+
+namespace {
+
+// A straightforward decoder to check against.
+bool ReferenceIsValid(const std::string& s) {
+  size_t i = 0;
+  while (i < s.size()) {
+    uint8_t c = s[i];
+    int n;
+    uint32_t cp;
+    if (c < 0x80) {
+      i++;
+      continue;
+    } else if ((c & 0xe0) == 0xc0) {
+      n = 1;
+      cp = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+      n = 2;
+      cp = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+      n = 3;
+      cp = c & 0x07;
+    } else {
+      return false;
+    }
+    if (s.size() - i <= (size_t)n) return false;
+    for (int j = 1; j <= n; j++) {
+      uint8_t cont = s[i + j];
+      if ((cont & 0xc0) != 0x80) return false;
+      cp = (cp << 6) | (cont & 0x3f);
+    }
+    static const uint32_t kMin[] = {0, 0x80, 0x800, 0x10000};
+    if (cp < kMin[n] || cp > 0x10ffff) return false;
+    if (cp >= 0xd800 && cp <= 0xdfff) return false;
+    i += n + 1;
+  }
+  return true;
+}
+
+bool IsValid(const std::string& s) {
+  return upb_Utf8_IsValid(s.data(), s.size());
+}
+
+TEST(Utf8Test, Sequences) {
+  struct {
+    const char* bytes;
+    bool valid;
+  } cases[] = {
+      {"a", true},
+      {"\xc2\x80", true},
+      {"\xdf\xbf", true},
+      {"\xe0\xa0\x80", true},
+      {"\xed\x9f\xbf", true},
+      {"\xee\x80\x80", true},
+      {"\xef\xbf\xbf", true},
+      {"\xf0\x90\x80\x80", true},
+      {"\xf4\x8f\xbf\xbf", true},
+      {"\x80", false},                // Lone continuation.
+      {"\xbf", false},                // Lone continuation.
+      {"\xc0\x80", false},            // Overlong.
+      {"\xc1\xbf", false},            // Overlong.
+      {"\xe0\x9f\xbf", false},        // Overlong.
+      {"\xf0\x8f\xbf\xbf", false},    // Overlong.
+      {"\xed\xa0\x80", false},        // Surrogate.
+      {"\xed\xbf\xbf", false},        // Surrogate.
+      {"\xf4\x90\x80\x80", false},    // Above U+10FFFF.
+      {"\xf5\x80\x80\x80", false},    // Above U+10FFFF.
+      {"\xff", false},
+      {"\xc2", false},                // Truncated.
+      {"\xe0\xa0", false},            // Truncated.
+      {"\xf0\x90\x80", false},        // Truncated.
+      {"\xc2\x80\x80", false},        // Extra continuation.
+      {"\xe0\xa0\x80\x80", false},    // Extra continuation.
+      {"\xf0\x90\x80\x80\x80", false},  // Extra continuation.
+  };
+  for (const auto& c : cases) {
+    // Place each sequence at every offset around the 32-byte block
+    // boundaries, followed by ASCII or by the end of the input.
+    for (size_t offset = 0; offset < 70; offset++) {
+      for (size_t suffix : {0, 1, 40}) {
+        std::string s =
+            std::string(offset, 'x') + c.bytes + std::string(suffix, 'y');
+        EXPECT_EQ(c.valid, IsValid(s)) << c.bytes << " " << offset;
+      }
+    }
+  }
+  EXPECT_TRUE(upb_Utf8_IsValid(nullptr, 0));
+}
+
+void CheckMatchesReference() {
+  std::mt19937 rng(12345);
+  for (int i = 0; i < 20000; i++) {
+    // Build valid text from random codepoints, then sometimes corrupt it.
+    std::string s;
+    size_t len = rng() % 200;
+    while (s.size() < len) {
+      uint32_t cp;
+      switch (rng() % 4) {
+        case 0:
+          cp = rng() % 0x80;
+          break;
+        case 1:
+          cp = rng() % 0x800;
+          break;
+        case 2:
+          cp = rng() % 0x10000;
+          break;
+        default:
+          cp = rng() % 0x110000;
+          break;
+      }
+      if (upb_Unicode_IsHigh(cp) || upb_Unicode_IsLow(cp)) continue;
+      char buf[4];
+      s.append(buf, upb_Unicode_ToUTF8(cp, buf));
+    }
+    ASSERT_TRUE(IsValid(s)) << i;
+    if (rng() % 2 && !s.empty()) s[rng() % s.size()] = rng();
+    if (rng() % 4 == 0 && !s.empty()) s.resize(rng() % s.size());
+    EXPECT_EQ(ReferenceIsValid(s), IsValid(s)) << i;
+  }
+}
+
+TEST(Utf8Test, MatchesReference) { CheckMatchesReference(); }
+
+TEST(Utf8Test, ScalarMatchesReference) {
+  uint32_t mask = upb_Cpu_SetFeatureMask(0);
+  CheckMatchesReference();
+  upb_Cpu_SetFeatureMask(mask);
+}
+
+}  // namespace
@@ -28,9 +28,21 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+// For MAP_ANONYMOUS, MAP_HUGETLB and madvise(), which are not part of C99.
+// If this has no effect (for example because system headers were already
+// included by an amalgamation) upb_alloc_hugepage falls back to malloc().
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "upb/mem/alloc.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -48,3 +60,77 @@ static void* upb_global_allocfunc(upb_alloc* alloc, void* ptr, size_t oldsize,
 }
 
 upb_alloc upb_alloc_global = {&upb_global_allocfunc};
+
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+
+static size_t upb_HugePage_RoundUp(size_t size) {
+  return UPB_ALIGN_UP(size, (size_t)kUpb_HugePageSize);
+}
+
+static void* upb_HugePage_Map(size_t size) {
+  size = upb_HugePage_RoundUp(size);
+#ifdef MAP_HUGETLB
+  // Explicit huge pages only succeed if the administrator reserved some.
+  void* ret = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ret != MAP_FAILED) return ret;
+#endif
+
+  // Otherwise over-allocate so we can trim the mapping to a huge page
+  // boundary, which transparent huge pages require.
+  size_t padded = size + kUpb_HugePageSize;
+  char* mem = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) return NULL;
+  char* aligned = (char*)UPB_ALIGN_UP((uintptr_t)mem, kUpb_HugePageSize);
+  size_t head = aligned - mem;
+  if (head) munmap(mem, head);
+  munmap(aligned + size, padded - head - size);
+#ifdef MADV_HUGEPAGE
+  madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+  return aligned;
+}
+
+static void* upb_hugepage_allocfunc(upb_alloc* alloc, void* ptr,
+                                    size_t oldsize, size_t size) {
+  UPB_UNUSED(alloc);
+  const bool old_mapped = oldsize >= kUpb_HugePageSize;
+  const bool new_mapped = size >= kUpb_HugePageSize;
+
+  if (!old_mapped && !new_mapped) {
+    return upb_global_allocfunc(alloc, ptr, oldsize, size);
+  }
+
+  if (old_mapped && new_mapped &&
+      upb_HugePage_RoundUp(oldsize) == upb_HugePage_RoundUp(size)) {
+    return ptr;
+  }
+
+  void* ret = NULL;
+  if (size) {
+    ret = new_mapped ? upb_HugePage_Map(size) : malloc(size);
+    if (!ret) return NULL;
+    if (ptr) memcpy(ret, ptr, UPB_MIN(oldsize, size));
+  }
+
+  if (ptr) {
+    if (old_mapped) {
+      // Unlike free(), munmap() does not clear ASAN poisoning (which arenas
+      // apply to their unused space), so a later mapping could inherit it.
+      UPB_UNPOISON_MEMORY_REGION(ptr, upb_HugePage_RoundUp(oldsize));
+      munmap(ptr, upb_HugePage_RoundUp(oldsize));
+    } else {
+      free(ptr);
+    }
+  }
+  return ret;
+}
+
+upb_alloc upb_alloc_hugepage = {&upb_hugepage_allocfunc};
+
+#else
+
+upb_alloc upb_alloc_hugepage = {&upb_global_allocfunc};
+
+#endif
@@ -73,6 +73,13 @@ UPB_INLINE void upb_free(upb_alloc* alloc, void* ptr) {
   alloc->func(alloc, ptr, 0, 0);
 }
 
+// Like upb_free(), but passes the size of the allocation as `oldsize` so that
+// size-aware allocators can avoid tracking it themselves.
+UPB_INLINE void upb_free_sized(upb_alloc* alloc, void* ptr, size_t size) {
+  UPB_ASSERT(alloc);
+  alloc->func(alloc, ptr, size, 0);
+}
+
 // The global allocator used by upb. Uses the standard malloc()/free().
 
 extern upb_alloc upb_alloc_global;
@@ -92,6 +99,18 @@ UPB_INLINE void* upb_grealloc(void* ptr, size_t oldsize, size_t size) {
 
 UPB_INLINE void upb_gfree(void* ptr) { upb_free(&upb_alloc_global, ptr); }
 
+// An allocator for large arena blocks.  Allocations of at least
+// kUpb_HugePageSize bytes are rounded up to a multiple of that size and, where
+// the platform supports it, backed by huge pages (explicit huge pages if any
+// are reserved, otherwise transparent huge pages) to reduce TLB misses.
+// Smaller allocations, and all allocations on other platforms, use malloc().
+//
+// Memory from this allocator must be freed with upb_free_sized(), since the
+// size determines how it was obtained.  upb_Arena always does this.
+#define kUpb_HugePageSize (2 * 1024 * 1024)
+
+extern upb_alloc upb_alloc_hugepage;
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
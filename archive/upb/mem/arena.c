@@ -30,6 +30,7 @@
 
 #include "upb/mem/internal/arena.h"
 
+#include "upb/mem/block_cache.h"
 #include "upb/port/atomic.h"
 
 // Must be last.
@@ -45,6 +46,11 @@ struct _upb_MemBlock {
 static const size_t memblock_reserve =
     UPB_ALIGN_UP(sizeof(_upb_MemBlock), UPB_MALLOC_ALIGN);
 
+// Arenas without an initial block live at the front of their first block.
+static const size_t first_block_overhead =
+    UPB_ALIGN_UP(sizeof(_upb_MemBlock), UPB_MALLOC_ALIGN) +
+    UPB_ALIGN_MALLOC(sizeof(upb_Arena));
+
 typedef struct _upb_ArenaRoot {
   upb_Arena* root;
   uintptr_t tagged_count;
@@ -95,7 +101,7 @@ size_t upb_Arena_SpaceAllocated(upb_Arena* arena) {
     _upb_MemBlock* block =
         upb_Atomic_Load(&arena->blocks, memory_order_relaxed);
     while (block != NULL) {
-      memsize += sizeof(_upb_MemBlock) + block->size;
+      memsize += block->size;
       block = upb_Atomic_Load(&block->next, memory_order_relaxed);
     }
     arena = upb_Atomic_Load(&arena->next, memory_order_relaxed);
@@ -104,6 +110,31 @@ size_t upb_Arena_SpaceAllocated(upb_Arena* arena) {
   return memsize;
 }
 
+size_t _upb_Arena_UsedSince(upb_Arena* a, const _upb_MemBlock* blocks,
+                            size_t has) {
+  _upb_MemBlock* block = upb_Atomic_Load(&a->blocks, memory_order_relaxed);
+  for (; block != blocks; block = upb_Atomic_Load(&block->next,
+                                                   memory_order_relaxed)) {
+    has += block->size - memblock_reserve;
+  }
+  return has - _upb_ArenaHas(a);
+}
+
+bool upb_Arena_Contains(const upb_Arena* a, const void* ptr) {
+  const char* p = (const char*)ptr;
+  if (a->initial_block && p >= a->initial_block && p < (const char*)a) {
+    return true;
+  }
+  _upb_MemBlock* block = upb_Atomic_Load(&a->blocks, memory_order_relaxed);
+  while (block != NULL) {
+    if (p >= (const char*)block && p < (const char*)block + block->size) {
+      return true;
+    }
+    block = upb_Atomic_Load(&block->next, memory_order_relaxed);
+  }
+  return false;
+}
+
 uint32_t upb_Arena_DebugRefCount(upb_Arena* a) {
   // These loads could probably be relaxed, but given that this is debug-only,
   // it's not worth introducing a new variant for it.
@@ -115,66 +146,282 @@ uint32_t upb_Arena_DebugRefCount(upb_Arena* a) {
   return _upb_Arena_RefCountFromTagged(poc);
 }
 
-static void upb_Arena_AddBlock(upb_Arena* a, void* ptr, size_t size) {
+// Returns how many more bytes of blocks `a` may allocate without exceeding
+// the space limit of its fused group, or SIZE_MAX if there is no limit.
+static size_t upb_Arena_Headroom(upb_Arena* a) {
+  upb_Arena* self = a->owner;
+  uintptr_t poc = upb_Atomic_Load(&self->parent_or_count, memory_order_acquire);
+  size_t limit;
+  size_t used;
+  if (_upb_Arena_IsTaggedRefcount(poc) &&
+      upb_Atomic_Load(&self->next, memory_order_acquire) == NULL) {
+    // Not fused, which is the common case.
+    if (!self->max_space_allocated) return SIZE_MAX;
+    limit = self->max_space_allocated;
+    used = upb_Atomic_Load(&self->space_allocated, memory_order_relaxed);
+  } else {
+    // Other threads may be allocating from the group at the same time, so the
+    // total is approximate and the group may overshoot by up to one block per
+    // thread.
+    upb_Arena* m = _upb_Arena_FindRoot(self).root;
+    if (!upb_Atomic_Load(&m->group_has_limit, memory_order_acquire)) {
+      return SIZE_MAX;
+    }
+    limit = SIZE_MAX;
+    used = 0;
+    for (; m != NULL; m = upb_Atomic_Load(&m->next, memory_order_acquire)) {
+      if (m->max_space_allocated) {
+        limit = UPB_MIN(limit, m->max_space_allocated);
+      }
+      used += upb_Atomic_Load(&m->space_allocated, memory_order_relaxed);
+    }
+    if (limit == SIZE_MAX) return SIZE_MAX;
+  }
+  return used < limit ? limit - used : 0;
+}
+
+static void upb_Arena_ChargeBlock(upb_Arena* a, size_t block_size) {
+  upb_Arena* self = a->owner;
+  size_t used = upb_Atomic_Load(&self->space_allocated, memory_order_relaxed);
+  upb_Atomic_Store(&self->space_allocated, used + block_size,
+                   memory_order_relaxed);
+}
+
+// `block_size` is the full size of the allocation at `ptr`; allocation from the
+// block begins `offset` bytes in.
+static void upb_Arena_AddBlock(upb_Arena* a, void* ptr, size_t offset,
+                               size_t block_size) {
   _upb_MemBlock* block = ptr;
 
   // Insert into linked list.
-  block->size = (uint32_t)size;
+  block->size = (uint32_t)block_size;
   upb_Atomic_Init(&block->next, a->blocks);
   upb_Atomic_Store(&a->blocks, block, memory_order_release);
 
-  a->head.ptr = UPB_PTR_AT(block, memblock_reserve, char);
-  a->head.end = UPB_PTR_AT(block, size, char);
+  a->head.ptr = UPB_PTR_AT(block, offset, char);
+  a->head.end = UPB_PTR_AT(block, block_size, char);
 
   UPB_POISON_MEMORY_REGION(a->head.ptr, a->head.end - a->head.ptr);
 }
 
+static const uint32_t kUpb_Arena_DefaultInitialBlockSize = 256;
+static const uint32_t kUpb_Arena_DefaultGrowthFactor = 2;
+static const uint32_t kUpb_Arena_MaxBlockSize = UINT32_MAX;
+
+static upb_alloc* upb_Arena_AllocForBlock(upb_alloc* block_alloc,
+                                          upb_alloc* large_block_alloc,
+                                          uint32_t large_block_threshold,
+                                          size_t block_size) {
+  if (large_block_alloc && block_size >= large_block_threshold) {
+    return large_block_alloc;
+  }
+  return block_alloc;
+}
+
+// Returns the allocator that `a` uses for a block of `block_size` bytes.
+static upb_alloc* upb_Arena_BlockAllocFor(upb_Arena* a, size_t block_size) {
+  return upb_Arena_AllocForBlock(upb_Arena_BlockAlloc(a), a->large_block_alloc,
+                                 a->large_block_threshold, block_size);
+}
+
+// Returns the usable size of the next general-purpose block.  Sizes exclude
+// block overhead, so a growth factor of 1 yields equally sized blocks.
+static size_t upb_Arena_NextBlockSize(upb_Arena* a) {
+  if (a->last_block_size == 0) return a->initial_block_size;
+  if (a->last_block_size > a->max_block_size / a->growth_factor) {
+    return a->max_block_size;
+  }
+  return (size_t)a->last_block_size * a->growth_factor;
+}
+
 static bool upb_Arena_AllocBlock(upb_Arena* a, size_t size) {
-  if (!a->block_alloc) return false;
-  _upb_MemBlock* last_block = upb_Atomic_Load(&a->blocks, memory_order_acquire);
-  size_t last_size = last_block != NULL ? last_block->size : 128;
-  size_t block_size = UPB_MAX(size, last_size * 2) + memblock_reserve;
-  _upb_MemBlock* block = upb_malloc(upb_Arena_BlockAlloc(a), block_size);
+  if (!upb_Arena_BlockAlloc(a)) return false;
+  size_t usable_size = UPB_MAX(size, upb_Arena_NextBlockSize(a));
+  if (usable_size > kUpb_Arena_MaxBlockSize - memblock_reserve) return false;
+  // Near the space limit, fall back to a block that just fits.
+  size_t headroom = upb_Arena_Headroom(a);
+  if (headroom < memblock_reserve || headroom - memblock_reserve < size) {
+    return false;
+  }
+  usable_size = UPB_MIN(usable_size, headroom - memblock_reserve);
+  size_t block_size = usable_size + memblock_reserve;
+  _upb_MemBlock* block = upb_malloc(upb_Arena_BlockAllocFor(a, block_size),
+                                    block_size);
 
   if (!block) return false;
-  upb_Arena_AddBlock(a, block, block_size);
+  upb_Arena_ChargeBlock(a, block_size);
+#ifdef UPB_ENABLE_ARENA_STATS
+  a->head.stats.blocks++;
+  a->head.stats.tail_waste += _upb_ArenaHas(a);
+#endif
+  upb_Arena_AddBlock(a, block, memblock_reserve, block_size);
+  a->last_block_size = (uint32_t)usable_size;
+  UPB_PROBE(arena_block, a, block_size);
   return true;
 }
 
+// Allocates a block that holds exactly one allocation of `size` bytes.  The
+// current block stays in place so its remaining space is not wasted.
+static void* upb_Arena_AllocDedicatedBlock(upb_Arena* a, size_t size) {
+  if (!upb_Arena_BlockAlloc(a)) return NULL;
+  if (size > kUpb_Arena_MaxBlockSize - memblock_reserve) return NULL;
+  size_t block_size = size + memblock_reserve;
+  if (upb_Arena_Headroom(a) < block_size) return NULL;
+  _upb_MemBlock* block = upb_malloc(upb_Arena_BlockAllocFor(a, block_size),
+                                    block_size);
+
+  if (!block) return NULL;
+  upb_Arena_ChargeBlock(a, block_size);
+#ifdef UPB_ENABLE_ARENA_STATS
+  a->head.stats.blocks++;
+  a->head.stats.allocs++;
+  if (size > a->head.stats.largest_alloc) a->head.stats.largest_alloc = size;
+#endif
+  block->size = (uint32_t)block_size;
+  upb_Atomic_Init(&block->next, a->blocks);
+  upb_Atomic_Store(&a->blocks, block, memory_order_release);
+  UPB_PROBE(arena_block, a, block_size);
+  return UPB_PTR_AT(block, memblock_reserve, void);
+}
+
 void* _upb_Arena_SlowMalloc(upb_Arena* a, size_t size) {
-  if (!upb_Arena_AllocBlock(a, size)) return NULL; /* Out of memory. */
-  UPB_ASSERT(_upb_ArenaHas(a) >= size);
+#ifdef UPB_ENABLE_ARENA_STATS
+  a->head.stats.slow_mallocs++;
+#endif
+  if (a->huge_alloc_threshold && size >= a->huge_alloc_threshold) {
+    return upb_Arena_AllocDedicatedBlock(a, size);
+  }
+  // Leave room for the guard so that upb_Arena_Malloc() cannot fail even
+  // when block growth is capped.
+  size_t span = size + UPB_ASAN_GUARD_SIZE;
+  if (!upb_Arena_AllocBlock(a, span)) return NULL; /* Out of memory. */
+  UPB_ASSERT(_upb_ArenaHas(a) >= span);
   return upb_Arena_Malloc(a, size);
 }
 
 /* Public Arena API ***********************************************************/
 
-static upb_Arena* upb_Arena_InitSlow(upb_alloc* alloc) {
-  const size_t first_block_overhead = sizeof(upb_Arena) + memblock_reserve;
+static void upb_Arena_InitStats(upb_Arena* a) {
+#ifdef UPB_ENABLE_ARENA_STATS
+  memset(&a->head.stats, 0, sizeof(a->head.stats));
+  a->stats_hook = NULL;
+  a->stats_hook_ctx = NULL;
+#else
+  UPB_UNUSED(a);
+#endif
+}
+
+bool upb_Arena_GetStats(upb_Arena* a, upb_ArenaStats* stats) {
+#ifdef UPB_ENABLE_ARENA_STATS
+  *stats = a->head.stats;
+  return true;
+#else
+  UPB_UNUSED(a);
+  UPB_UNUSED(stats);
+  return false;
+#endif
+}
+
+bool upb_Arena_SetStatsHook(upb_Arena* a, upb_ArenaStatsHook* hook,
+                            void* ctx) {
+#ifdef UPB_ENABLE_ARENA_STATS
+  a->stats_hook = hook;
+  a->stats_hook_ctx = ctx;
+  return true;
+#else
+  UPB_UNUSED(a);
+  UPB_UNUSED(hook);
+  UPB_UNUSED(ctx);
+  return false;
+#endif
+}
+
+static void upb_Arena_InitPolicy(upb_Arena* a,
+                                 const upb_ArenaOptions* options) {
+  a->last_block_size = 0;
+  a->initial_block_size = kUpb_Arena_DefaultInitialBlockSize;
+  a->max_block_size = kUpb_Arena_MaxBlockSize - memblock_reserve;
+  a->huge_alloc_threshold = 0;
+  a->growth_factor = kUpb_Arena_DefaultGrowthFactor;
+  a->large_block_threshold = 0;
+  a->large_block_alloc = NULL;
+  a->max_space_allocated = 0;
+  a->free_executor = NULL;
+  a->free_executor_ctx = NULL;
+  a->deferred_free_threshold = 0;
+  a->owner = a;
+  if (!options) return;
+
+  a->max_space_allocated = options->max_space_allocated;
+  a->free_executor = options->free_executor;
+  a->free_executor_ctx = options->free_executor_ctx;
+  a->deferred_free_threshold = options->deferred_free_threshold;
+  if (options->max_block_size && options->max_block_size < a->max_block_size) {
+    a->max_block_size = (uint32_t)options->max_block_size;
+  }
+  if (options->initial_block_size) {
+    a->initial_block_size =
+        (uint32_t)UPB_MIN(options->initial_block_size, a->max_block_size);
+  }
+  if (options->growth_factor) a->growth_factor = options->growth_factor;
+  if (options->huge_alloc_threshold) {
+    a->huge_alloc_threshold =
+        (uint32_t)UPB_MIN(options->huge_alloc_threshold, UINT32_MAX);
+  }
+  if (options->large_block_alloc &&
+      options->large_block_threshold <= UINT32_MAX) {
+    a->large_block_alloc = options->large_block_alloc;
+    a->large_block_threshold = (uint32_t)options->large_block_threshold;
+  }
+}
+
+static upb_Arena* upb_Arena_InitSlow(upb_alloc* alloc,
+                                     const upb_ArenaOptions* options) {
+  size_t initial_block_size = kUpb_Arena_DefaultInitialBlockSize;
   upb_Arena* a;
 
+  if (options && options->initial_block_size) {
+    initial_block_size = UPB_MIN(options->initial_block_size,
+                                 kUpb_Arena_MaxBlockSize - first_block_overhead);
+  }
+
   /* We need to malloc the initial block. */
   char* mem;
-  size_t n = first_block_overhead + 256;
-  if (!alloc || !(mem = upb_malloc(alloc, n))) {
-    return NULL;
+  size_t n = first_block_overhead + initial_block_size;
+  if (!alloc) return NULL;
+  upb_alloc* first_alloc = alloc;
+  if (options && options->large_block_alloc &&
+      n >= options->large_block_threshold) {
+    first_alloc = options->large_block_alloc;
   }
+  if (!(mem = upb_malloc(first_alloc, n))) return NULL;
 
-  a = UPB_PTR_AT(mem, n - sizeof(*a), upb_Arena);
-  n -= sizeof(*a);
+  // The arena itself lives at the front of its first block, right after the
+  // block header, so that the block records the full size of the allocation.
+  a = UPB_PTR_AT(mem, memblock_reserve, upb_Arena);
 
   a->block_alloc = upb_Arena_MakeBlockAlloc(alloc, 0);
+  a->initial_block = NULL;
   upb_Atomic_Init(&a->parent_or_count, _upb_Arena_TaggedFromRefcount(1));
   upb_Atomic_Init(&a->next, NULL);
   upb_Atomic_Init(&a->tail, a);
   upb_Atomic_Init(&a->blocks, NULL);
+  upb_Atomic_Init(&a->space_allocated, n);
+  upb_Arena_InitPolicy(a, options);
+  upb_Atomic_Init(&a->group_has_limit, a->max_space_allocated != 0);
+  upb_Arena_InitStats(a);
+#ifdef UPB_ENABLE_ARENA_STATS
+  a->head.stats.blocks = 1;
+#endif
 
-  upb_Arena_AddBlock(a, mem, n);
+  upb_Arena_AddBlock(a, mem, first_block_overhead, n);
+  a->last_block_size = (uint32_t)initial_block_size;
 
   return a;
 }
 
-upb_Arena* upb_Arena_Init(void* mem, size_t n, upb_alloc* alloc) {
+upb_Arena* upb_Arena_InitWithOptions(void* mem, size_t n, upb_alloc* alloc,
+                                     const upb_ArenaOptions* options) {
   upb_Arena* a;
 
   if (n) {
@@ -190,7 +437,7 @@ upb_Arena* upb_Arena_Init(void* mem, size_t n, upb_alloc* alloc) {
   n = UPB_ALIGN_DOWN(n, UPB_ALIGN_OF(upb_Arena));
 
   if (UPB_UNLIKELY(n < sizeof(upb_Arena))) {
-    return upb_Arena_InitSlow(alloc);
+    return upb_Arena_InitSlow(alloc, options);
   }
 
   a = UPB_PTR_AT(mem, n - sizeof(*a), upb_Arena);
@@ -199,14 +446,59 @@ upb_Arena* upb_Arena_Init(void* mem, size_t n, upb_alloc* alloc) {
   upb_Atomic_Init(&a->next, NULL);
   upb_Atomic_Init(&a->tail, a);
   upb_Atomic_Init(&a->blocks, NULL);
+  upb_Atomic_Init(&a->space_allocated, 0);
+  upb_Arena_InitPolicy(a, options);
+  upb_Atomic_Init(&a->group_has_limit, a->max_space_allocated != 0);
+  upb_Arena_InitStats(a);
   a->block_alloc = upb_Arena_MakeBlockAlloc(alloc, 1);
+  a->initial_block = mem;
   a->head.ptr = mem;
   a->head.end = UPB_PTR_AT(mem, n - sizeof(*a), char);
 
   return a;
 }
 
-static void arena_dofree(upb_Arena* a) {
+upb_Arena* upb_Arena_Init(void* mem, size_t n, upb_alloc* alloc) {
+  return upb_Arena_InitWithOptions(mem, n, alloc, NULL);
+}
+
+// Collects freed blocks that go back to the same upb_BlockCache, so that they
+// can be handed to it all at once.
+typedef struct {
+  upb_BlockCache* cache;
+  void* first;
+  void* last;
+} upb_Arena_BlockBatch;
+
+static void upb_Arena_FlushBlockBatch(upb_Arena_BlockBatch* batch) {
+  if (batch->first) {
+    _upb_BlockCache_ReturnChain(batch->cache, batch->first, batch->last);
+  }
+  batch->first = NULL;
+  batch->last = NULL;
+}
+
+static void upb_Arena_FreeBlock(upb_alloc* alloc, _upb_MemBlock* block,
+                                upb_Arena_BlockBatch* batch) {
+  size_t size = block->size;
+  upb_BlockCache* cache = batch ? _upb_BlockCache_FromAlloc(alloc) : NULL;
+  if (!cache) {
+    upb_free_sized(alloc, block, size);
+    return;
+  }
+  if (cache != batch->cache) {
+    upb_Arena_FlushBlockBatch(batch);
+    batch->cache = cache;
+  }
+  _upb_BlockCache_LinkBlock(block, size, batch->first);
+  batch->first = block;
+  if (!batch->last) batch->last = block;
+}
+
+// Frees every arena in the group rooted at `a`.  With a `batch`, blocks that
+// came from a upb_BlockCache are returned to it through
+// _upb_BlockCache_ReturnChain(), which is safe on any thread.
+static void arena_dofree(upb_Arena* a, upb_Arena_BlockBatch* batch) {
   UPB_ASSERT(_upb_Arena_RefCountFromTagged(a->parent_or_count) == 1);
 
   while (a != NULL) {
@@ -214,16 +506,59 @@ static void arena_dofree(upb_Arena* a) {
     upb_Arena* next_arena =
         (upb_Arena*)upb_Atomic_Load(&a->next, memory_order_acquire);
     upb_alloc* block_alloc = upb_Arena_BlockAlloc(a);
+    upb_alloc* large_block_alloc = a->large_block_alloc;
+    uint32_t large_block_threshold = a->large_block_threshold;
+#ifdef UPB_ENABLE_ARENA_STATS
+    if (a->stats_hook) {
+      upb_ArenaStats stats = a->head.stats;
+      stats.tail_waste += _upb_ArenaHas(a);
+      a->stats_hook(&stats, a->stats_hook_ctx);
+    }
+#endif
     _upb_MemBlock* block = upb_Atomic_Load(&a->blocks, memory_order_acquire);
     while (block != NULL) {
       // Load first since we are deleting block.
       _upb_MemBlock* next_block =
           upb_Atomic_Load(&block->next, memory_order_acquire);
-      upb_free(block_alloc, block);
+      upb_Arena_FreeBlock(
+          upb_Arena_AllocForBlock(block_alloc, large_block_alloc,
+                                  large_block_threshold, block->size),
+          block, batch);
       block = next_block;
     }
     a = next_arena;
   }
+  if (batch) upb_Arena_FlushBlockBatch(batch);
+}
+
+// Passes the group rooted at `root`, whose last reference is being dropped,
+// to a free executor if one of its arenas has one and the group is big
+// enough.  Only arenas are visited, not their blocks.
+static bool upb_Arena_TryDeferFree(upb_Arena* root) {
+  // The arena lives in its initial block, which the caller may reuse as soon
+  // as upb_Arena_Free() returns.  Such arenas are never fused.
+  if (upb_Arena_HasInitialBlock(root)) return false;
+  if (!root->free_executor &&
+      upb_Atomic_Load(&root->next, memory_order_acquire) == NULL) {
+    return false;  // Not fused and no executor, which is the common case.
+  }
+  upb_Arena* executor_arena = NULL;
+  size_t total = 0;
+  for (upb_Arena* m = root; m != NULL;
+       m = upb_Atomic_Load(&m->next, memory_order_acquire)) {
+    if (!executor_arena && m->free_executor) executor_arena = m;
+    total += upb_Atomic_Load(&m->space_allocated, memory_order_relaxed);
+  }
+  if (!executor_arena || total < executor_arena->deferred_free_threshold) {
+    return false;
+  }
+  executor_arena->free_executor(root, executor_arena->free_executor_ctx);
+  return true;
+}
+
+void upb_Arena_FreeDeferred(upb_Arena* group) {
+  upb_Arena_BlockBatch batch = {NULL, NULL, NULL};
+  arena_dofree(group, &batch);
 }
 
 void upb_Arena_Free(upb_Arena* a) {
@@ -238,7 +573,7 @@ retry:
   // expensive then direct loads.  As an optimization, we only do RMW ops
   // when we need to update things for other threads to see.
   if (poc == _upb_Arena_TaggedFromRefcount(1)) {
-    arena_dofree(a);
+    if (!upb_Arena_TryDeferFree(a)) arena_dofree(a, NULL);
     return;
   }
 
@@ -255,29 +590,84 @@ retry:
   goto retry;
 }
 
+bool upb_Arena_Reset(upb_Arena* a) {
+  uintptr_t poc = upb_Atomic_Load(&a->parent_or_count, memory_order_acquire);
+  if (poc != _upb_Arena_TaggedFromRefcount(1)) return false;
+  if (upb_Atomic_Load(&a->next, memory_order_acquire) != NULL) return false;
+
+  _upb_MemBlock* first = NULL;  // The block holding the arena itself.
+  _upb_MemBlock* largest = NULL;
+  _upb_MemBlock* block = upb_Atomic_Load(&a->blocks, memory_order_acquire);
+  while (block != NULL) {
+    _upb_MemBlock* next_block =
+        upb_Atomic_Load(&block->next, memory_order_acquire);
+    if (UPB_PTR_AT(block, memblock_reserve, upb_Arena) == a) {
+      first = block;
+    } else if (!largest || block->size > largest->size) {
+      if (largest) {
+        upb_free_sized(upb_Arena_BlockAllocFor(a, largest->size), largest,
+                       largest->size);
+      }
+      largest = block;
+    } else {
+      upb_free_sized(upb_Arena_BlockAllocFor(a, block->size), block,
+                     block->size);
+    }
+    block = next_block;
+  }
+
+  upb_Atomic_Store(&a->blocks, NULL, memory_order_relaxed);
+  upb_Atomic_Store(&a->space_allocated,
+                   (first ? first->size : 0) + (largest ? largest->size : 0),
+                   memory_order_relaxed);
+  a->last_block_size = 0;
+  if (first) {
+    upb_Arena_AddBlock(a, first, first_block_overhead, first->size);
+    a->last_block_size = first->size - first_block_overhead;
+  } else {
+    a->head.ptr = a->initial_block;
+    a->head.end = (char*)a;
+    UPB_POISON_MEMORY_REGION(a->head.ptr, a->head.end - a->head.ptr);
+  }
+
+  if (largest && largest->size - memblock_reserve > _upb_ArenaHas(a)) {
+    upb_Arena_AddBlock(a, largest, memblock_reserve, largest->size);
+    a->last_block_size = largest->size - memblock_reserve;
+  } else if (largest) {
+    // Keep the block, but leave allocation in the larger initial block.
+    upb_Atomic_Init(&largest->next, a->blocks);
+    upb_Atomic_Store(&a->blocks, largest, memory_order_relaxed);
+    a->last_block_size = largest->size - memblock_reserve;
+  }
+  return true;
+}
+
 static void _upb_Arena_DoFuseArenaLists(upb_Arena* const parent,
                                         upb_Arena* child) {
-  upb_Arena* parent_tail = upb_Atomic_Load(&parent->tail, memory_order_relaxed);
+  // List links are published with release and read with acquire: a thread
+  // walking the list may reach an arena created on another thread, and must
+  // see that arena's initialized fields.
+  upb_Arena* parent_tail = upb_Atomic_Load(&parent->tail, memory_order_acquire);
   do {
     // Our tail might be stale, but it will always converge to the true tail.
     upb_Arena* parent_tail_next =
-        upb_Atomic_Load(&parent_tail->next, memory_order_relaxed);
+        upb_Atomic_Load(&parent_tail->next, memory_order_acquire);
     while (parent_tail_next != NULL) {
       parent_tail = parent_tail_next;
       parent_tail_next =
-          upb_Atomic_Load(&parent_tail->next, memory_order_relaxed);
+          upb_Atomic_Load(&parent_tail->next, memory_order_acquire);
     }
 
     upb_Arena* displaced =
-        upb_Atomic_Exchange(&parent_tail->next, child, memory_order_relaxed);
-    parent_tail = upb_Atomic_Load(&child->tail, memory_order_relaxed);
+        upb_Atomic_Exchange(&parent_tail->next, child, memory_order_acq_rel);
+    parent_tail = upb_Atomic_Load(&child->tail, memory_order_acquire);
 
     // If we displaced something that got installed racily, we can simply
     // reinstall it on our new tail.
     child = displaced;
   } while (child != NULL);
 
-  upb_Atomic_Store(&parent->tail, parent_tail, memory_order_relaxed);
+  upb_Atomic_Store(&parent->tail, parent_tail, memory_order_release);
 }
 
 static upb_Arena* _upb_Arena_DoFuse(upb_Arena* a1, upb_Arena* a2,
@@ -301,6 +691,14 @@ static upb_Arena* _upb_Arena_DoFuse(upb_Arena* a1, upb_Arena* a2,
     r2 = tmp;
   }
 
+  // If `r2`'s group has a space limit, so will the fused one.  Mark `r1`
+  // before adding `r2`'s refs to it: whoever later fuses `r1` away reads the
+  // mark after their own update of `r1`'s refcount, which is ordered with ours
+  // below.  If this attempt fails, the mark is merely conservative.
+  if (upb_Atomic_Load(&r2.root->group_has_limit, memory_order_acquire)) {
+    upb_Atomic_Store(&r1.root->group_has_limit, true, memory_order_release);
+  }
+
   // The moment we install `r1` as the parent for `r2` all racing frees may
   // immediately begin decrementing `r1`'s refcount (including pending
   // increments to that refcount and their frees!).  We need to add `r2`'s refs
@@ -316,10 +714,15 @@ static upb_Arena* _upb_Arena_DoFuse(upb_Arena* a1, upb_Arena* a2,
   // delta.
   uintptr_t r2_untagged_count = r2.tagged_count & ~1;
   uintptr_t with_r2_refs = r1.tagged_count + r2_untagged_count;
-  if (!upb_Atomic_CompareExchangeStrong(
-          &r1.root->parent_or_count, &r1.tagged_count, with_r2_refs,
-          memory_order_release, memory_order_acquire)) {
-    return NULL;
+  while (!upb_Atomic_CompareExchangeWeak(
+      &r1.root->parent_or_count, &r1.tagged_count, with_r2_refs,
+      memory_order_release, memory_order_acquire)) {
+    // When many threads fuse into the same group, the root's refcount is
+    // highly contended.  As long as `r1` is still a root, a changed refcount
+    // does not invalidate anything we have computed, so retry right away
+    // instead of walking both trees again.
+    if (_upb_Arena_IsTaggedPointer(r1.tagged_count)) return NULL;
+    with_r2_refs = r1.tagged_count + r2_untagged_count;
   }
 
   // Perform the actual fuse by removing the refs from `r2` and swapping in the
@@ -54,10 +54,78 @@
 
 typedef struct upb_Arena upb_Arena;
 
+// Per-arena allocation statistics.  These are only collected when upb is built
+// with UPB_ENABLE_ARENA_STATS defined, which must be consistent across every
+// translation unit that includes this header.
+typedef struct {
+  size_t allocs;            // Successful calls to upb_Arena_Malloc().
+  size_t slow_mallocs;      // Allocations that went through the slow path.
+  size_t largest_alloc;     // Largest single allocation, in bytes.
+  size_t blocks;            // Blocks obtained from the block allocator.
+  size_t tail_waste;        // Bytes left unused at the end of retired blocks.
+  size_t realloc_in_place;  // upb_Arena_Realloc() calls that did not move.
+  size_t realloc_copies;    // upb_Arena_Realloc() calls that copied.
+} upb_ArenaStats;
+
+// Called with the final statistics of an arena right before it is freed.
+typedef void upb_ArenaStatsHook(const upb_ArenaStats* stats, void* ctx);
+
+// Takes over the blocks of a fused group of arenas whose last reference was
+// just dropped (see upb_ArenaOptions.free_executor).  `group` may only be
+// passed to upb_Arena_FreeDeferred(), exactly once and from any thread.
+typedef void upb_ArenaFreeExecutor(upb_Arena* group, void* ctx);
+
 typedef struct {
   char *ptr, *end;
+#ifdef UPB_ENABLE_ARENA_STATS
+  upb_ArenaStats stats;
+#endif
 } _upb_ArenaHead;
 
+// Controls how an arena sizes the blocks it allocates from its upb_alloc.
+// Zero-valued fields select the default behavior.
+typedef struct {
+  // Usable size of the first block allocated from the upb_alloc.  Default 256.
+  size_t initial_block_size;
+
+  // Each new block is this many times larger than the previous one (but never
+  // smaller than the allocation that triggered it).  Default 2.
+  uint32_t growth_factor;
+
+  // Upper bound for block growth.  Allocations larger than this still get a
+  // block big enough to hold them.  Default: unbounded.
+  size_t max_block_size;
+
+  // Allocations of at least this many bytes are placed in a dedicated block
+  // of exactly the right size, leaving the current block and the growth
+  // sequence untouched.  Default: disabled.
+  size_t huge_alloc_threshold;
+
+  // If set, blocks of at least `large_block_threshold` bytes (including any
+  // dedicated blocks) come from this allocator instead of the arena's, for
+  // example upb_alloc_hugepage.
+  upb_alloc* large_block_alloc;
+  size_t large_block_threshold;
+
+  // Caps the memory this arena may take from its allocators, as measured by
+  // upb_Arena_SpaceAllocated().  Once a new block would exceed the cap, the
+  // allocation fails as if the allocator were out of memory; upb_Decode()
+  // then returns kUpb_DecodeStatus_OutOfMemory.  When arenas are fused, the
+  // smallest cap in the group applies to the group's total.  A caller-provided
+  // initial block is not counted.  Default: unlimited.
+  size_t max_space_allocated;
+
+  // If set, freeing the last reference to a fused group whose blocks total at
+  // least `deferred_free_threshold` bytes does not free them in the caller:
+  // upb_Arena_Free() instead passes the group to `free_executor`, which might
+  // queue it for a background thread that calls upb_Arena_FreeDeferred().  If
+  // several arenas in a group set an executor, any one of them may be used.
+  // Default: groups are always freed right away.
+  upb_ArenaFreeExecutor* free_executor;
+  void* free_executor_ctx;
+  size_t deferred_free_threshold;
+} upb_ArenaOptions;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -67,13 +135,46 @@ extern "C" {
 // is a fixed-size arena and cannot grow.
 UPB_API upb_Arena* upb_Arena_Init(void* mem, size_t n, upb_alloc* alloc);
 
+// Like upb_Arena_Init(), but blocks are sized according to |options|, which
+// may be NULL for the defaults.  |options| is not referenced after the call.
+UPB_API upb_Arena* upb_Arena_InitWithOptions(void* mem, size_t n,
+                                             upb_alloc* alloc,
+                                             const upb_ArenaOptions* options);
+
 UPB_API void upb_Arena_Free(upb_Arena* a);
+
+// Frees every block of a group that was passed to a upb_ArenaFreeExecutor.
+// May be called from any thread.  Blocks that came from a upb_BlockCache are
+// handed back to the cache in batches; see upb_BlockCache for details.
+UPB_API void upb_Arena_FreeDeferred(upb_Arena* group);
 UPB_API bool upb_Arena_Fuse(upb_Arena* a, upb_Arena* b);
 
+// Discards everything allocated from the arena so that its memory can be
+// reused.  The initial block (if any) and the largest block allocated from
+// |alloc| are kept; all other blocks are returned to |alloc|.  Allocation
+// resumes from whichever retained block is larger.
+//
+// Returns false and leaves the arena untouched if it has ever been fused,
+// since other arenas may still reference the memory.
+UPB_API bool upb_Arena_Reset(upb_Arena* a);
+
 void* _upb_Arena_SlowMalloc(upb_Arena* a, size_t size);
 size_t upb_Arena_SpaceAllocated(upb_Arena* arena);
 uint32_t upb_Arena_DebugRefCount(upb_Arena* arena);
 
+// Returns true if `ptr` points into memory allocated from `a` itself.  Blocks
+// of arenas fused with `a` are not searched.
+bool upb_Arena_Contains(const upb_Arena* a, const void* ptr);
+
+// Copies the statistics of this arena (not including any arenas it is fused
+// with) into |stats|.  Returns false if statistics are not compiled in.
+UPB_API bool upb_Arena_GetStats(upb_Arena* a, upb_ArenaStats* stats);
+
+// Registers |hook| to be called when |a| is freed.  Returns false if
+// statistics are not compiled in.
+UPB_API bool upb_Arena_SetStatsHook(upb_Arena* a, upb_ArenaStatsHook* hook,
+                                    void* ctx);
+
 UPB_INLINE size_t _upb_ArenaHas(upb_Arena* a) {
   _upb_ArenaHead* h = (_upb_ArenaHead*)a;
   return (size_t)(h->end - h->ptr);
@@ -94,6 +195,10 @@ UPB_API_INLINE void* upb_Arena_Malloc(upb_Arena* a, size_t size) {
   UPB_UNPOISON_MEMORY_REGION(ret, size);
 
   h->ptr += span;
+#ifdef UPB_ENABLE_ARENA_STATS
+  h->stats.allocs++;
+  if (size > h->stats.largest_alloc) h->stats.largest_alloc = size;
+#endif
 
   return ret;
 }
@@ -124,12 +229,21 @@ UPB_API_INLINE void* upb_Arena_Realloc(upb_Arena* a, void* ptr, size_t oldsize,
     ptrdiff_t diff = size - oldsize;
     if ((ptrdiff_t)_upb_ArenaHas(a) >= diff) {
       h->ptr += diff;
+#ifdef UPB_ENABLE_ARENA_STATS
+      h->stats.realloc_in_place++;
+#endif
       return ptr;
     }
   } else if (size <= oldsize) {
+#ifdef UPB_ENABLE_ARENA_STATS
+    h->stats.realloc_in_place++;
+#endif
     return ptr;
   }
 
+#ifdef UPB_ENABLE_ARENA_STATS
+  h->stats.realloc_copies++;
+#endif
   void* ret = upb_Arena_Malloc(a, size);
 
   if (ret && oldsize > 0) {
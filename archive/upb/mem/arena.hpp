@@ -45,10 +45,23 @@ class Arena {
       : ptr_(upb_Arena_Init(initial_block, size, &upb_alloc_global),
              upb_Arena_Free) {}
 
+  // Arenas whose blocks are sized according to `options`.
+  explicit Arena(const upb_ArenaOptions& options)
+      : ptr_(upb_Arena_InitWithOptions(nullptr, 0, &upb_alloc_global,
+                                       &options),
+             upb_Arena_Free) {}
+  Arena(char* initial_block, size_t size, const upb_ArenaOptions& options)
+      : ptr_(upb_Arena_InitWithOptions(initial_block, size, &upb_alloc_global,
+                                       &options),
+             upb_Arena_Free) {}
+
   upb_Arena* ptr() const { return ptr_.get(); }
 
   void Fuse(Arena& other) { upb_Arena_Fuse(ptr(), other.ptr()); }
 
+  // Returns false if the arena has been fused, see upb_Arena_Reset().
+  bool Reset() { return upb_Arena_Reset(ptr()); }
+
  protected:
   std::unique_ptr<upb_Arena, decltype(&upb_Arena_Free)> ptr_;
 };
@@ -59,6 +72,8 @@ template <int N>
 class InlinedArena : public Arena {
  public:
   InlinedArena() : Arena(initial_block_, N) {}
+  explicit InlinedArena(const upb_ArenaOptions& options)
+      : Arena(initial_block_, N, options) {}
   ~InlinedArena() {
     // Explicitly destroy the arena now so that it does not outlive
     // initial_block_.
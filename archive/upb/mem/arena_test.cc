@@ -32,6 +32,7 @@
 
 #include <array>
 #include <atomic>
+#include <cstring>
 #include <thread>
 #include <vector>
 
@@ -40,6 +41,10 @@
 #include "absl/random/distributions.h"
 #include "absl/random/random.h"
 #include "absl/synchronization/notification.h"
+#include "upb/mem/arena.hpp"
+#include "upb/mem/block_cache.h"
+#include "upb/mem/numa_alloc.h"
+#include "upb/mem/shared_arena.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -83,6 +88,507 @@ TEST(ArenaTest, FuseWithInitialBlock) {
   for (int i = 0; i < size; ++i) upb_Arena_Free(arenas[i]);
 }
 
+TEST(ArenaTest, GrowthPolicy) {
+  upb_ArenaOptions options = {};
+  options.initial_block_size = 4096;
+  options.growth_factor = 1;
+  upb::Arena arena(options);
+
+  // Every block is the same size, so space grows linearly.
+  EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 4000), nullptr);
+  size_t one_block = upb_Arena_SpaceAllocated(arena.ptr());
+  EXPECT_GE(one_block, 4096);
+  EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 4000), nullptr);
+  size_t two_blocks = upb_Arena_SpaceAllocated(arena.ptr());
+  EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 4000), nullptr);
+  size_t three_blocks = upb_Arena_SpaceAllocated(arena.ptr());
+  EXPECT_EQ(three_blocks - two_blocks, two_blocks - one_block);
+}
+
+TEST(ArenaTest, MaxBlockSize) {
+  upb_ArenaOptions options = {};
+  options.max_block_size = 1024;
+  upb::Arena arena(options);
+
+  for (int i = 0; i < 100; i++) {
+    EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 512), nullptr);
+  }
+  // Larger allocations still succeed.
+  EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 10000), nullptr);
+  size_t before = upb_Arena_SpaceAllocated(arena.ptr());
+  EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 1000), nullptr);
+  EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 1000), nullptr);
+  EXPECT_LT(upb_Arena_SpaceAllocated(arena.ptr()) - before, 4096);
+}
+
+TEST(ArenaTest, HugeAllocationGetsDedicatedBlock) {
+  upb_ArenaOptions options = {};
+  options.huge_alloc_threshold = 1 << 16;
+  upb::Arena arena(options);
+
+  char* a = static_cast<char*>(upb_Arena_Malloc(arena.ptr(), 8));
+  size_t before = upb_Arena_SpaceAllocated(arena.ptr());
+  EXPECT_NE(upb_Arena_Malloc(arena.ptr(), 1 << 20), nullptr);
+  size_t huge = upb_Arena_SpaceAllocated(arena.ptr()) - before;
+  EXPECT_GE(huge, 1 << 20);
+  EXPECT_LT(huge, (1 << 20) + 64);
+
+  // The block that was current before the huge allocation is still in use.
+  char* b = static_cast<char*>(upb_Arena_Malloc(arena.ptr(), 8));
+  EXPECT_EQ(b, a + 8 + UPB_ASAN_GUARD_SIZE);
+}
+
+TEST(ArenaTest, ResetReusesLargestBlock) {
+  upb_Arena* arena = upb_Arena_New();
+  for (int i = 0; i < 100; i++) {
+    EXPECT_NE(upb_Arena_Malloc(arena, 1000), nullptr);
+  }
+  size_t used = upb_Arena_SpaceAllocated(arena);
+  ASSERT_TRUE(upb_Arena_Reset(arena));
+  size_t kept = upb_Arena_SpaceAllocated(arena);
+  EXPECT_LT(kept, used);
+
+  // Allocation proceeds from the retained block until it is exhausted.
+  char* p1 = static_cast<char*>(upb_Arena_Malloc(arena, 1000));
+  char* p2 = static_cast<char*>(upb_Arena_Malloc(arena, 1000));
+  EXPECT_EQ(p2, p1 + 1000 + UPB_ASAN_GUARD_SIZE);
+  EXPECT_EQ(upb_Arena_SpaceAllocated(arena), kept);
+  upb_Arena_Free(arena);
+}
+
+TEST(ArenaTest, ResetWithInitialBlock) {
+  char buf[1024];
+  upb_Arena* arena = upb_Arena_Init(buf, sizeof(buf), &upb_alloc_global);
+  char* first = static_cast<char*>(upb_Arena_Malloc(arena, 16));
+  EXPECT_NE(upb_Arena_Malloc(arena, 5000), nullptr);
+  ASSERT_TRUE(upb_Arena_Reset(arena));
+
+  // The 5000-byte block is larger than the initial block, so it is used first.
+  char* p = static_cast<char*>(upb_Arena_Malloc(arena, 16));
+  EXPECT_TRUE(p < buf || p >= buf + sizeof(buf));
+  upb_Arena_Free(arena);
+
+  arena = upb_Arena_Init(buf, sizeof(buf), &upb_alloc_global);
+  first = static_cast<char*>(upb_Arena_Malloc(arena, 16));
+  ASSERT_TRUE(upb_Arena_Reset(arena));
+  EXPECT_EQ(upb_Arena_Malloc(arena, 16), first);
+  upb_Arena_Free(arena);
+}
+
+TEST(ArenaTest, ResetFusedArenaFails) {
+  upb_Arena* arena1 = upb_Arena_New();
+  upb_Arena* arena2 = upb_Arena_New();
+  EXPECT_TRUE(upb_Arena_Fuse(arena1, arena2));
+  EXPECT_FALSE(upb_Arena_Reset(arena1));
+  EXPECT_FALSE(upb_Arena_Reset(arena2));
+  upb_Arena_Free(arena2);
+  // Even after the other arena is gone its blocks are still in our list.
+  EXPECT_FALSE(upb_Arena_Reset(arena1));
+  upb_Arena_Free(arena1);
+}
+
+TEST(ArenaTest, MaxSpaceAllocated) {
+  upb_ArenaOptions options = {};
+  options.max_space_allocated = 16 * 1024;
+  upb::Arena arena(options);
+
+  int allocs = 0;
+  while (upb_Arena_Malloc(arena.ptr(), 1000) != nullptr) {
+    ASSERT_LT(++allocs, 100);
+  }
+  EXPECT_GT(allocs, 0);
+  EXPECT_LE(upb_Arena_SpaceAllocated(arena.ptr()), options.max_space_allocated);
+
+  EXPECT_EQ(upb_Arena_Malloc(arena.ptr(), 1 << 20), nullptr);
+
+  // Reset gives back the space of the blocks it frees.
+  ASSERT_TRUE(upb_Arena_Reset(arena.ptr()));
+  size_t kept = upb_Arena_SpaceAllocated(arena.ptr());
+  while (upb_Arena_SpaceAllocated(arena.ptr()) == kept) {
+    ASSERT_NE(upb_Arena_Malloc(arena.ptr(), 1000), nullptr);
+  }
+  EXPECT_LE(upb_Arena_SpaceAllocated(arena.ptr()), options.max_space_allocated);
+}
+
+TEST(ArenaTest, MaxSpaceAllocatedAppliesToFusedGroup) {
+  upb_ArenaOptions options = {};
+  options.max_space_allocated = 16 * 1024;
+  upb::Arena limited(options);
+  upb::Arena unlimited;
+  ASSERT_TRUE(upb_Arena_Fuse(limited.ptr(), unlimited.ptr()));
+
+  // The unlimited arena is now bound by its partner's limit.
+  int allocs = 0;
+  while (upb_Arena_Malloc(unlimited.ptr(), 1000) != nullptr) {
+    ASSERT_LT(++allocs, 100);
+  }
+  EXPECT_LE(upb_Arena_SpaceAllocated(limited.ptr()),
+            options.max_space_allocated);
+  EXPECT_EQ(upb_Arena_Malloc(limited.ptr(), 10000), nullptr);
+}
+
+TEST(ArenaTest, MaxSpaceAllocatedSurvivesLaterFuses) {
+  upb_ArenaOptions options = {};
+  options.max_space_allocated = 16 * 1024;
+  for (int limited_pos = 0; limited_pos < 4; limited_pos++) {
+    upb::Arena arenas[4];
+    upb::Arena limited(options);
+    // Build the group one arena at a time, so that the limit has to carry
+    // over to whichever arena ends up as the root.
+    for (int i = 0; i < 4; i++) {
+      if (i == limited_pos) {
+        ASSERT_TRUE(upb_Arena_Fuse(arenas[0].ptr(), limited.ptr()));
+      }
+      ASSERT_TRUE(upb_Arena_Fuse(arenas[0].ptr(), arenas[i].ptr()));
+    }
+    int allocs = 0;
+    while (upb_Arena_Malloc(arenas[3].ptr(), 1000) != nullptr) {
+      ASSERT_LT(++allocs, 100);
+    }
+    EXPECT_LE(upb_Arena_SpaceAllocated(limited.ptr()),
+              options.max_space_allocated);
+  }
+
+  // A group with no limit is not bound by anything.
+  upb::Arena a;
+  upb::Arena b;
+  ASSERT_TRUE(upb_Arena_Fuse(a.ptr(), b.ptr()));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_NE(upb_Arena_Malloc(b.ptr(), 1000), nullptr);
+  }
+}
+
+TEST(ArenaTest, Contains) {
+  char buf[1024];
+  upb_Arena* a = upb_Arena_Init(buf, sizeof(buf), &upb_alloc_global);
+  upb_Arena* b = upb_Arena_New();
+  void* small = upb_Arena_Malloc(a, 16);
+  void* large = upb_Arena_Malloc(a, 4096);
+  void* other = upb_Arena_Malloc(b, 16);
+  EXPECT_TRUE(upb_Arena_Contains(a, small));
+  EXPECT_TRUE(upb_Arena_Contains(a, large));
+  EXPECT_FALSE(upb_Arena_Contains(a, other));
+  EXPECT_FALSE(upb_Arena_Contains(b, small));
+  EXPECT_FALSE(upb_Arena_Contains(a, a));
+  upb_Arena_Free(a);
+  upb_Arena_Free(b);
+}
+
+TEST(ArenaTest, LargeBlockAllocator) {
+  upb_ArenaOptions options = {};
+  options.large_block_alloc = &upb_alloc_hugepage;
+  options.large_block_threshold = kUpb_HugePageSize;
+  upb::Arena arena(options);
+
+  // Small blocks come from the regular allocator, large ones are rounded up
+  // to whole huge pages.
+  for (int i = 0; i < 100; i++) {
+    char* p = static_cast<char*>(upb_Arena_Malloc(arena.ptr(), 100000));
+    ASSERT_NE(p, nullptr);
+    memset(p, i, 100000);
+  }
+  EXPECT_TRUE(upb_Arena_Reset(arena.ptr()));
+  char* p = static_cast<char*>(upb_Arena_Malloc(arena.ptr(), 3 << 20));
+  ASSERT_NE(p, nullptr);
+  memset(p, 0, 3 << 20);
+}
+
+TEST(ArenaTest, HugePageAllocator) {
+  for (size_t size : {size_t{100}, size_t{kUpb_HugePageSize},
+                      size_t{kUpb_HugePageSize * 3 + 1}}) {
+    char* p = static_cast<char*>(upb_malloc(&upb_alloc_hugepage, size));
+    ASSERT_NE(p, nullptr);
+    memset(p, 1, size);
+    char* q = static_cast<char*>(
+        upb_realloc(&upb_alloc_hugepage, p, size, size * 2));
+    ASSERT_NE(q, nullptr);
+    EXPECT_EQ(q[size - 1], 1);
+    upb_free_sized(&upb_alloc_hugepage, q, size * 2);
+  }
+}
+
+#ifdef UPB_ENABLE_ARENA_STATS
+
+TEST(ArenaTest, Stats) {
+  upb_Arena* arena = upb_Arena_New();
+  upb_ArenaStats final_stats = {};
+  ASSERT_TRUE(upb_Arena_SetStatsHook(
+      arena,
+      [](const upb_ArenaStats* stats, void* ctx) {
+        *static_cast<upb_ArenaStats*>(ctx) = *stats;
+      },
+      &final_stats));
+
+  void* p = upb_Arena_Malloc(arena, 16);
+  p = upb_Arena_Realloc(arena, p, 16, 32);  // Grows in place.
+  upb_Arena_Malloc(arena, 8);
+  p = upb_Arena_Realloc(arena, p, 32, 64);  // Not the last alloc: copies.
+  upb_Arena_Malloc(arena, 10000);
+
+  upb_ArenaStats stats;
+  ASSERT_TRUE(upb_Arena_GetStats(arena, &stats));
+  EXPECT_EQ(stats.allocs, 4);
+  EXPECT_EQ(stats.realloc_in_place, 1);
+  EXPECT_EQ(stats.realloc_copies, 1);
+  EXPECT_EQ(stats.slow_mallocs, 1);
+  EXPECT_EQ(stats.largest_alloc, 10000);
+  EXPECT_EQ(stats.blocks, 2);
+  EXPECT_GT(stats.tail_waste, 0);
+
+  upb_Arena_Free(arena);
+  EXPECT_EQ(final_stats.allocs, 4);
+  EXPECT_GE(final_stats.tail_waste, stats.tail_waste);
+}
+
+#else
+
+TEST(ArenaTest, StatsDisabled) {
+  upb_Arena* arena = upb_Arena_New();
+  upb_ArenaStats stats;
+  EXPECT_FALSE(upb_Arena_GetStats(arena, &stats));
+  EXPECT_FALSE(upb_Arena_SetStatsHook(arena, nullptr, nullptr));
+  upb_Arena_Free(arena);
+}
+
+#endif
+
+TEST(ArenaTest, BlockCacheRecyclesBlocks) {
+  upb_BlockCache cache;
+  upb_BlockCache_Init(&cache, &upb_alloc_global, 1 << 20);
+
+  upb_Arena* arena = upb_Arena_InitWithBlockCache(NULL, 0, &cache);
+  ASSERT_TRUE(arena != nullptr);
+  EXPECT_NE(upb_Arena_Malloc(arena, 5000), nullptr);
+  upb_Arena_Free(arena);
+
+  const upb_BlockCacheStats* stats = upb_BlockCache_Stats(&cache);
+  EXPECT_EQ(stats->hits, 0);
+  EXPECT_EQ(stats->misses, 2);
+  EXPECT_EQ(stats->retained, 2);
+  EXPECT_GT(stats->cached_bytes, 5000);
+
+  // The same allocation pattern is now served entirely from the cache.
+  arena = upb_Arena_InitWithBlockCache(NULL, 0, &cache);
+  ASSERT_TRUE(arena != nullptr);
+  EXPECT_NE(upb_Arena_Malloc(arena, 5000), nullptr);
+  upb_Arena_Free(arena);
+  EXPECT_EQ(stats->hits, 2);
+  EXPECT_EQ(stats->misses, 2);
+
+  upb_BlockCache_Release(&cache);
+  EXPECT_EQ(stats->cached_bytes, 0);
+}
+
+TEST(ArenaTest, BlockCacheBoundedRetention) {
+  upb_BlockCache cache;
+  upb_BlockCache_Init(&cache, &upb_alloc_global, 0);
+
+  upb_Arena* arena = upb_Arena_InitWithBlockCache(NULL, 0, &cache);
+  ASSERT_TRUE(arena != nullptr);
+  upb_Arena_Free(arena);
+
+  const upb_BlockCacheStats* stats = upb_BlockCache_Stats(&cache);
+  EXPECT_EQ(stats->retained, 0);
+  EXPECT_EQ(stats->released, 1);
+  EXPECT_EQ(stats->cached_bytes, 0);
+
+  // Oversized blocks always bypass the cache.
+  upb_BlockCache_Init(&cache, &upb_alloc_global, SIZE_MAX);
+  arena = upb_Arena_InitWithBlockCache(NULL, 0, &cache);
+  ASSERT_TRUE(arena != nullptr);
+  EXPECT_NE(upb_Arena_Malloc(arena, 64 << 20), nullptr);
+  upb_Arena_Free(arena);
+  EXPECT_EQ(stats->retained, 1);
+  EXPECT_EQ(stats->released, 1);
+  upb_BlockCache_Release(&cache);
+}
+
+// A upb_ArenaFreeExecutor that queues groups in a std::vector.
+extern "C" void QueueGroup(upb_Arena* group, void* ctx) {
+  static_cast<std::vector<upb_Arena*>*>(ctx)->push_back(group);
+}
+
+TEST(ArenaTest, DeferredFree) {
+  std::vector<upb_Arena*> queued;
+  upb_ArenaOptions options = {};
+  options.free_executor = &QueueGroup;
+  options.free_executor_ctx = &queued;
+  options.deferred_free_threshold = 64 * 1024;
+
+  // Small groups are still freed right away.
+  upb_Arena* small = upb_Arena_InitWithOptions(NULL, 0, &upb_alloc_global,
+                                               &options);
+  upb_Arena_Free(small);
+  EXPECT_TRUE(queued.empty());
+
+  // A large group is queued once its last arena is freed, even though the
+  // arena with the executor is not the last one.
+  upb_Arena* a = upb_Arena_InitWithOptions(NULL, 0, &upb_alloc_global,
+                                           &options);
+  upb_Arena* b = upb_Arena_New();
+  ASSERT_TRUE(upb_Arena_Fuse(a, b));
+  EXPECT_NE(upb_Arena_Malloc(b, 100000), nullptr);
+  upb_Arena_Free(a);
+  EXPECT_TRUE(queued.empty());
+  upb_Arena_Free(b);
+  ASSERT_EQ(queued.size(), 1);
+
+  std::thread reclaimer([&] { upb_Arena_FreeDeferred(queued[0]); });
+  reclaimer.join();
+
+  // Arenas with an initial block are never deferred.
+  queued.clear();
+  options.deferred_free_threshold = 0;
+  char buf[1024];
+  upb_Arena* initial = upb_Arena_InitWithOptions(buf, sizeof(buf),
+                                                 &upb_alloc_global, &options);
+  EXPECT_NE(upb_Arena_Malloc(initial, 5000), nullptr);
+  upb_Arena_Free(initial);
+  EXPECT_TRUE(queued.empty());
+}
+
+TEST(ArenaTest, DeferredFreeReturnsBlocksToCache) {
+  upb_BlockCache cache;
+  upb_BlockCache_Init(&cache, &upb_alloc_global, 1 << 20);
+  std::vector<upb_Arena*> queued;
+  upb_ArenaOptions options = {};
+  options.free_executor = &QueueGroup;
+  options.free_executor_ctx = &queued;
+
+  upb_Arena* arena = upb_Arena_InitWithOptions(
+      NULL, 0, upb_BlockCache_Alloc(&cache), &options);
+  ASSERT_TRUE(arena != nullptr);
+  EXPECT_NE(upb_Arena_Malloc(arena, 5000), nullptr);
+  upb_Arena_Free(arena);
+  ASSERT_EQ(queued.size(), 1);
+
+  // The blocks are freed on another thread, which must not touch the cache's
+  // free lists; they wait in one batch until this thread needs them.
+  std::thread reclaimer([&] { upb_Arena_FreeDeferred(queued[0]); });
+  reclaimer.join();
+  const upb_BlockCacheStats* stats = upb_BlockCache_Stats(&cache);
+  EXPECT_EQ(stats->retained, 0);
+  EXPECT_EQ(stats->cached_bytes, 0);
+
+  arena = upb_Arena_InitWithBlockCache(NULL, 0, &cache);
+  ASSERT_TRUE(arena != nullptr);
+  EXPECT_NE(upb_Arena_Malloc(arena, 5000), nullptr);
+  EXPECT_EQ(stats->retained, 2);
+  EXPECT_EQ(stats->hits, 2);
+  EXPECT_EQ(stats->misses, 2);
+  upb_Arena_Free(arena);
+
+  upb_BlockCache_Release(&cache);
+  EXPECT_EQ(stats->cached_bytes, 0);
+}
+
+TEST(ArenaTest, NumaAllocCachesBlocksPerNode) {
+  upb_NumaAlloc* numa = upb_NumaAlloc_New(1 << 20);
+  ASSERT_NE(numa, nullptr);
+  int node = upb_NumaAlloc_CurrentNode();
+  EXPECT_GE(node, 0);
+
+  upb_ArenaOptions options = {};
+  options.initial_block_size = 64 * 1024;
+  upb_Arena* arena = upb_Arena_InitWithNumaAlloc(nullptr, 0, numa, &options);
+  ASSERT_NE(arena, nullptr);
+  for (int i = 0; i < 100; i++) {
+    memset(upb_Arena_Malloc(arena, 1000), 0, 1000);
+  }
+  EXPECT_EQ(upb_NumaAlloc_CachedBytes(numa, node), 0);
+  upb_Arena_Free(arena);
+  size_t cached = upb_NumaAlloc_CachedBytes(numa, node);
+  EXPECT_GT(cached, 0);
+
+  // A new arena on the same node reuses the cached blocks.
+  arena = upb_Arena_InitWithNumaAlloc(nullptr, 0, numa, &options);
+  ASSERT_NE(arena, nullptr);
+  EXPECT_LT(upb_NumaAlloc_CachedBytes(numa, node), cached);
+  upb_Arena_Free(arena);
+  upb_NumaAlloc_Free(numa);
+}
+
+TEST(ArenaTest, NumaAllocThreads) {
+  upb_NumaAlloc* numa = upb_NumaAlloc_New(1 << 20);
+  ASSERT_NE(numa, nullptr);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([numa] {
+      for (int j = 0; j < 100; j++) {
+        upb_Arena* arena =
+            upb_Arena_InitWithNumaAlloc(nullptr, 0, numa, nullptr);
+        ASSERT_NE(arena, nullptr);
+        for (int k = 0; k < 20; k++) {
+          void* p = upb_Arena_Malloc(arena, 1000 * k);
+          ASSERT_NE(p, nullptr);
+          memset(p, k, 1000 * k);
+        }
+        upb_Arena_Free(arena);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  upb_NumaAlloc_Free(numa);
+}
+
+TEST(ArenaTest, SharedArenaPacksBlocksIntoSlabs) {
+  upb_SharedArena* shared = upb_SharedArena_New(&upb_alloc_global, 1 << 16);
+  ASSERT_TRUE(shared != nullptr);
+  upb_Arena* a = upb_SharedArena_NewThreadArena(shared);
+  upb_Arena* b = upb_SharedArena_NewThreadArena(shared);
+  ASSERT_TRUE(a != nullptr);
+  ASSERT_TRUE(b != nullptr);
+  EXPECT_EQ(upb_SharedArena_SpaceAllocated(shared), 1 << 16);
+
+  for (int i = 0; i < 100; i++) {
+    EXPECT_NE(upb_Arena_Malloc(a, 100), nullptr);
+    EXPECT_NE(upb_Arena_Malloc(b, 100), nullptr);
+  }
+  EXPECT_EQ(upb_SharedArena_SpaceAllocated(shared), 1 << 16);
+
+  // Too large for a slab.
+  EXPECT_NE(upb_Arena_Malloc(a, 1 << 20), nullptr);
+  EXPECT_GE(upb_SharedArena_SpaceAllocated(shared), (1 << 16) + (1 << 20));
+
+  // Freeing a thread arena releases nothing.
+  upb_Arena_Free(b);
+  upb_SharedArena_Free(shared);
+}
+
+TEST(ArenaTest, SharedArenaThreads) {
+  upb_SharedArena* shared = upb_SharedArena_New(&upb_alloc_global, 1 << 14);
+  ASSERT_TRUE(shared != nullptr);
+  constexpr int kThreads = 8;
+  constexpr int kAllocs = 10000;
+  std::vector<std::vector<std::pair<char*, size_t>>> allocs(kThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      absl::BitGen gen;
+      upb_Arena* arena = upb_SharedArena_NewThreadArena(shared);
+      ASSERT_TRUE(arena != nullptr);
+      for (int j = 0; j < kAllocs; ++j) {
+        size_t size = absl::Uniform<size_t>(gen, 1, 5000);
+        char* ptr = static_cast<char*>(upb_Arena_Malloc(arena, size));
+        ASSERT_TRUE(ptr != nullptr);
+        memset(ptr, i, size);
+        allocs[i].emplace_back(ptr, size);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  // No allocation was overwritten by another thread.
+  for (int i = 0; i < kThreads; ++i) {
+    for (const auto& alloc : allocs[i]) {
+      for (size_t j = 0; j < alloc.second; ++j) {
+        ASSERT_EQ(alloc.first[j], i);
+      }
+    }
+  }
+  upb_SharedArena_Free(shared);
+}
+
 class Environment {
  public:
   ~Environment() {
@@ -0,0 +1,174 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/mem/block_cache.h"
+
+#include <string.h>
+
+#include "upb/port/atomic.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Returns the smallest size class that fits `size`, or -1 if it is larger than
+// the largest class.
+static int upb_BlockCache_SizeClass(size_t size) {
+  size_t class_size = kUpb_BlockCache_MinBlockSize;
+  for (int i = 0; i < kUpb_BlockCache_SizeClasses; i++) {
+    if (size <= class_size) return i;
+    class_size <<= 1;
+  }
+  return -1;
+}
+
+static size_t upb_BlockCache_ClassSize(int size_class) {
+  return (size_t)kUpb_BlockCache_MinBlockSize << size_class;
+}
+
+// `returned` is declared as a plain pointer so that the header also compiles
+// as C++, where UPB_ATOMIC() is not available.
+static UPB_ATOMIC(void*)* upb_BlockCache_Returned(upb_BlockCache* c) {
+  return (UPB_ATOMIC(void*)*)&c->returned;
+}
+
+static void upb_BlockCache_Free(upb_BlockCache* c, void* ptr, size_t size);
+
+// Moves the blocks returned by upb_Arena_FreeDeferred() into the free lists.
+static void upb_BlockCache_TakeReturned(upb_BlockCache* c) {
+  UPB_ATOMIC(void*)* returned = upb_BlockCache_Returned(c);
+  if (!upb_Atomic_Load(returned, memory_order_relaxed)) return;
+  void* block = upb_Atomic_Exchange(returned, NULL, memory_order_acquire);
+  while (block) {
+    void* next;
+    size_t size;
+    memcpy(&next, block, sizeof(next));
+    memcpy(&size, (char*)block + sizeof(next), sizeof(size));
+    upb_BlockCache_Free(c, block, size);
+    block = next;
+  }
+}
+
+static void* upb_BlockCache_Malloc(upb_BlockCache* c, size_t size) {
+  int size_class = upb_BlockCache_SizeClass(size);
+  if (size_class < 0) {
+    c->stats.misses++;
+    return upb_malloc(c->backing, size);
+  }
+
+  void* block = c->free_lists[size_class];
+  if (!block) {
+    upb_BlockCache_TakeReturned(c);
+    block = c->free_lists[size_class];
+  }
+  if (block) {
+    memcpy(&c->free_lists[size_class], block, sizeof(void*));
+    c->stats.hits++;
+    c->stats.cached_bytes -= upb_BlockCache_ClassSize(size_class);
+    return block;
+  }
+
+  c->stats.misses++;
+  return upb_malloc(c->backing, upb_BlockCache_ClassSize(size_class));
+}
+
+static void upb_BlockCache_Free(upb_BlockCache* c, void* ptr, size_t size) {
+  // An unsized free gives us no way to find the size class.  The block is
+  // still a valid allocation from the backing allocator, so release it there.
+  int size_class = size ? upb_BlockCache_SizeClass(size) : -1;
+  if (size_class >= 0) {
+    size_t class_size = upb_BlockCache_ClassSize(size_class);
+    if (c->stats.cached_bytes + class_size <= c->max_cached_bytes) {
+      memcpy(ptr, &c->free_lists[size_class], sizeof(void*));
+      c->free_lists[size_class] = ptr;
+      c->stats.cached_bytes += class_size;
+      c->stats.retained++;
+      return;
+    }
+  }
+
+  c->stats.released++;
+  upb_free(c->backing, ptr);
+}
+
+static void* upb_BlockCache_AllocFunc(upb_alloc* alloc, void* ptr,
+                                      size_t oldsize, size_t size) {
+  upb_BlockCache* c = (upb_BlockCache*)alloc;
+
+  if (size == 0) {
+    if (ptr) upb_BlockCache_Free(c, ptr, oldsize);
+    return NULL;
+  }
+
+  void* ret = upb_BlockCache_Malloc(c, size);
+  if (ret && ptr) {
+    memcpy(ret, ptr, UPB_MIN(oldsize, size));
+    upb_BlockCache_Free(c, ptr, oldsize);
+  }
+  return ret;
+}
+
+void upb_BlockCache_Init(upb_BlockCache* c, upb_alloc* backing,
+                         size_t max_cached_bytes) {
+  memset(c, 0, sizeof(*c));
+  c->alloc.func = &upb_BlockCache_AllocFunc;
+  c->backing = backing;
+  c->max_cached_bytes = max_cached_bytes;
+  upb_Atomic_Init(upb_BlockCache_Returned(c), NULL);
+}
+
+void upb_BlockCache_Release(upb_BlockCache* c) {
+  upb_BlockCache_TakeReturned(c);
+  for (int i = 0; i < kUpb_BlockCache_SizeClasses; i++) {
+    void* block = c->free_lists[i];
+    while (block) {
+      void* next;
+      memcpy(&next, block, sizeof(void*));
+      upb_free(c->backing, block);
+      block = next;
+    }
+    c->free_lists[i] = NULL;
+  }
+  c->stats.cached_bytes = 0;
+}
+
+upb_BlockCache* _upb_BlockCache_FromAlloc(upb_alloc* alloc) {
+  return alloc->func == &upb_BlockCache_AllocFunc ? (upb_BlockCache*)alloc
+                                                  : NULL;
+}
+
+void _upb_BlockCache_ReturnChain(upb_BlockCache* c, void* first, void* last) {
+  UPB_ATOMIC(void*)* returned = upb_BlockCache_Returned(c);
+  void* head = upb_Atomic_Load(returned, memory_order_relaxed);
+  do {
+    memcpy(last, &head, sizeof(head));
+  } while (!upb_Atomic_CompareExchangeWeak(returned, &head, first,
+                                           memory_order_release,
+                                           memory_order_relaxed));
+}
@@ -0,0 +1,138 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/* upb_BlockCache is a upb_alloc that keeps freed blocks in power-of-two size
+ * classes and hands them back out on later allocations, so that arenas which
+ * are created and destroyed at a high rate stop hitting the global allocator
+ * for every block.
+ *
+ * A upb_BlockCache is *not* thread-safe.  The intended use is one cache per
+ * thread (for example in a `thread_local`), with every arena that draws from
+ * the cache also being freed on that thread.  In particular an arena using a
+ * cache must not be fused with an arena that may be freed on another thread.
+ *
+ * The one exception is upb_Arena_FreeDeferred(), which may run on any thread:
+ * it pushes the blocks it frees onto a lock-free list of returned blocks, one
+ * batch per call, and the cache's own thread moves them into the free lists
+ * the next time it runs out of blocks of some size, or in
+ * upb_BlockCache_Release().
+ *
+ * Freed blocks are only retained when the caller passes the allocation size
+ * (as upb_Arena does via upb_free_sized()); unsized frees and allocations that
+ * exceed the largest size class go straight to the backing allocator. */
+
+#ifndef UPB_MEM_BLOCK_CACHE_H_
+#define UPB_MEM_BLOCK_CACHE_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#include "upb/mem/alloc.h"
+#include "upb/mem/arena.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Size classes are 256 << i for i in [0, kUpb_BlockCache_SizeClasses).
+#define kUpb_BlockCache_MinBlockSize 256
+#define kUpb_BlockCache_SizeClasses 16
+
+typedef struct {
+  size_t hits;          // Allocations served from the cache.
+  size_t misses;        // Allocations passed to the backing allocator.
+  size_t retained;      // Frees whose block was kept for reuse.
+  size_t released;      // Frees passed to the backing allocator.
+  size_t cached_bytes;  // Bytes currently held by the cache.
+} upb_BlockCacheStats;
+
+typedef struct {
+  upb_alloc alloc;  // Must be first.
+  upb_alloc* backing;
+  size_t max_cached_bytes;
+  void* free_lists[kUpb_BlockCache_SizeClasses];
+  // Blocks returned by upb_Arena_FreeDeferred(), possibly on other threads.
+  // Only accessed atomically, from block_cache.c.
+  void* returned;
+  upb_BlockCacheStats stats;
+} upb_BlockCache;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Initializes a cache that draws from `backing` and retains at most
+// `max_cached_bytes` of freed blocks.
+UPB_API void upb_BlockCache_Init(upb_BlockCache* c, upb_alloc* backing,
+                                 size_t max_cached_bytes);
+
+// Returns every cached block to the backing allocator.  The cache remains
+// usable afterwards.  Must be called before the cache goes out of scope, once
+// no upb_Arena_FreeDeferred() calls for its blocks are pending.
+UPB_API void upb_BlockCache_Release(upb_BlockCache* c);
+
+UPB_API_INLINE upb_alloc* upb_BlockCache_Alloc(upb_BlockCache* c) {
+  return &c->alloc;
+}
+
+UPB_API_INLINE const upb_BlockCacheStats* upb_BlockCache_Stats(
+    const upb_BlockCache* c) {
+  return &c->stats;
+}
+
+// Like upb_Arena_Init(), but all blocks beyond the initial one are drawn from
+// (and returned to) `cache`.
+UPB_API_INLINE upb_Arena* upb_Arena_InitWithBlockCache(void* mem, size_t n,
+                                                       upb_BlockCache* cache) {
+  return upb_Arena_Init(mem, n, upb_BlockCache_Alloc(cache));
+}
+
+// Internal-only: returns the cache whose upb_alloc is `alloc`, or NULL if
+// `alloc` does not belong to a upb_BlockCache.
+upb_BlockCache* _upb_BlockCache_FromAlloc(upb_alloc* alloc);
+
+// Internal-only: prepares the freed `block` of `size` bytes to be returned to
+// a cache in a chain, ahead of `next`.
+UPB_INLINE void _upb_BlockCache_LinkBlock(void* block, size_t size,
+                                          void* next) {
+  memcpy(block, &next, sizeof(next));
+  memcpy((char*)block + sizeof(next), &size, sizeof(size));
+}
+
+// Internal-only: returns the chain of linked blocks from `first` to `last` to
+// `c`.  May be called from any thread.
+void _upb_BlockCache_ReturnChain(upb_BlockCache* c, void* first, void* last);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_MEM_BLOCK_CACHE_H_ */
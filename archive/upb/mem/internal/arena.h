@@ -32,6 +32,7 @@
 #define UPB_MEM_INTERNAL_ARENA_H_
 
 #include "upb/mem/arena.h"
+#include "upb/port/atomic.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -65,6 +66,48 @@ struct upb_Arena {
   // Linked list of blocks to free/cleanup.  Atomic only for the benefit of
   // upb_Arena_SpaceAllocated().
   UPB_ATOMIC(_upb_MemBlock*) blocks;
+
+  // Start of the caller-provided initial block, if any.  The arena itself
+  // sits at the end of that block.
+  char* initial_block;
+
+  // Block growth policy (see upb_ArenaOptions).  `last_block_size` is the
+  // usable size of the most recent block allocated for general use, or 0 if
+  // no block has been allocated from `block_alloc` yet.
+  uint32_t last_block_size;
+  uint32_t initial_block_size;
+  uint32_t max_block_size;
+  uint32_t huge_alloc_threshold;
+  uint32_t growth_factor;
+  uint32_t large_block_threshold;
+  upb_alloc* large_block_alloc;
+
+  // See upb_ArenaOptions.max_space_allocated; 0 if unlimited.
+  size_t max_space_allocated;
+
+  // See upb_ArenaOptions.free_executor; NULL if the arena's group is always
+  // freed right away.
+  upb_ArenaFreeExecutor* free_executor;
+  void* free_executor_ctx;
+  size_t deferred_free_threshold;
+
+  // Total size of the blocks in `blocks`.  Written only by the thread that
+  // owns the arena, but read by threads enforcing the limit of a fused group.
+  UPB_ATOMIC(size_t) space_allocated;
+
+  // Whether this arena or any arena fused into it has a max_space_allocated.
+  // Only meaningful on the root of a fused group, where it lets
+  // upb_Arena_Headroom() skip walking the group when nothing is limited.
+  UPB_ATOMIC(bool) group_has_limit;
+
+  // The arena that `blocks` are charged to: itself, except for the temporary
+  // copies made by _upb_Arena_SwapIn().
+  upb_Arena* owner;
+
+#ifdef UPB_ENABLE_ARENA_STATS
+  upb_ArenaStatsHook* stats_hook;
+  void* stats_hook_ctx;
+#endif
 };
 
 UPB_INLINE bool _upb_Arena_IsTaggedRefcount(uintptr_t parent_or_count) {
@@ -112,6 +155,40 @@ UPB_INLINE bool upb_Arena_HasInitialBlock(upb_Arena* arena) {
   return arena->block_alloc & 0x1;
 }
 
+// Copies the allocation state of `src` into the temporary arena `des`.  The
+// temporary arena only needs to be able to allocate, not fuse or free, so
+// parent_or_count, next and tail are left uninitialized.
+UPB_INLINE void _upb_Arena_SwapIn(upb_Arena* des, const upb_Arena* src) {
+  _upb_MemBlock* blocks = upb_Atomic_Load(&src->blocks, memory_order_relaxed);
+  des->head = src->head;
+  des->block_alloc = src->block_alloc;
+  upb_Atomic_Init(&des->blocks, blocks);
+  des->initial_block = src->initial_block;
+  des->last_block_size = src->last_block_size;
+  des->initial_block_size = src->initial_block_size;
+  des->max_block_size = src->max_block_size;
+  des->huge_alloc_threshold = src->huge_alloc_threshold;
+  des->growth_factor = src->growth_factor;
+  des->large_block_threshold = src->large_block_threshold;
+  des->large_block_alloc = src->large_block_alloc;
+  des->max_space_allocated = src->max_space_allocated;
+  des->owner = src->owner;
+}
+
+// Copies the allocation state of the temporary arena `src` back into `des`.
+UPB_INLINE void _upb_Arena_SwapOut(upb_Arena* des, const upb_Arena* src) {
+  _upb_MemBlock* blocks = upb_Atomic_Load(&src->blocks, memory_order_relaxed);
+  des->head = src->head;
+  upb_Atomic_Store(&des->blocks, blocks, memory_order_relaxed);
+  des->last_block_size = src->last_block_size;
+}
+
+// Returns how much of `a` was used up since `blocks` was its list of blocks
+// and it had `has` bytes free, including the unused ends of blocks it left
+// behind.  Arenas fused with `a` are not counted.
+size_t _upb_Arena_UsedSince(upb_Arena* a, const _upb_MemBlock* blocks,
+                            size_t has);
+
 #include "upb/port/undef.inc"
 
 #endif /* UPB_MEM_INTERNAL_ARENA_H_ */
@@ -0,0 +1,284 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// For MAP_ANONYMOUS and syscall(), which are not part of C99.  If this has no
+// effect (for example because system headers were already included by an
+// amalgamation) upb_NumaAlloc falls back to malloc().
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "upb/mem/numa_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "upb/port/atomic.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#if defined(__linux__) && defined(MAP_ANONYMOUS) && defined(SYS_getcpu) && \
+    defined(SYS_mbind)
+#define UPB_NUMA_ALLOC_MAP
+#endif
+
+// Number of freed blocks cached per size class and node.
+#define kUpb_NumaAlloc_CacheSlots 8
+
+// Nodes that blocks can be bound to; blocks for higher nodes are not bound.
+#define kUpb_NumaAlloc_MaxBindNode 1024
+
+// The node mask passed to mbind(), in words.
+#define kUpb_NumaAlloc_MaskBits (8 * sizeof(unsigned long))
+#define kUpb_NumaAlloc_MaskWords \
+  ((kUpb_NumaAlloc_MaxBindNode + kUpb_NumaAlloc_MaskBits - 1) / \
+   kUpb_NumaAlloc_MaskBits)
+
+// MPOL_PREFERRED from <linux/mempolicy.h>: use the given node, but fall back to
+// others rather than fail when it is out of memory.
+#define kUpb_NumaAlloc_MpolPreferred 1
+
+typedef struct {
+  UPB_ATOMIC(void*) slots[kUpb_NumaAlloc_SizeClasses]
+                         [kUpb_NumaAlloc_CacheSlots];
+  UPB_ATOMIC(size_t) cached_bytes;
+} _upb_NumaAlloc_Cache;
+
+struct upb_NumaAlloc {
+  upb_alloc alloc;  // Must be first.
+  size_t max_cached_bytes;
+  _upb_NumaAlloc_Cache caches[kUpb_NumaAlloc_MaxNodes];
+};
+
+int upb_NumaAlloc_CurrentNode(void) {
+#ifdef UPB_NUMA_ALLOC_MAP
+  unsigned cpu;
+  unsigned node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0) return (int)node;
+#endif
+  return 0;
+}
+
+#ifdef UPB_NUMA_ALLOC_MAP
+
+// Mapped blocks start with a header that records their node.
+static const size_t header_size = UPB_ALIGN_UP(sizeof(int), UPB_MALLOC_ALIGN);
+
+// Returns the smallest size class that fits `size`, or -1 if it is larger than
+// the largest class.
+static int upb_NumaAlloc_SizeClass(size_t size) {
+  size_t class_size = kUpb_NumaAlloc_MinBlockSize;
+  for (int i = 0; i < kUpb_NumaAlloc_SizeClasses; i++) {
+    if (size <= class_size) return i;
+    class_size <<= 1;
+  }
+  return -1;
+}
+
+static size_t upb_NumaAlloc_ClassSize(int size_class) {
+  return (size_t)kUpb_NumaAlloc_MinBlockSize << size_class;
+}
+
+// Returns the size of the mapping that holds a block of `size` bytes.
+static size_t upb_NumaAlloc_MapSize(size_t size) {
+  size += header_size;
+  int size_class = upb_NumaAlloc_SizeClass(size);
+  if (size_class >= 0) return upb_NumaAlloc_ClassSize(size_class);
+  return UPB_ALIGN_UP(size, (size_t)kUpb_NumaAlloc_MinBlockSize);
+}
+
+static void* upb_NumaAlloc_Map(size_t map_size, int node) {
+  char* mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) return NULL;
+  if (node < kUpb_NumaAlloc_MaxBindNode) {
+    // The pages are not touched yet, so binding the range decides where they
+    // will be placed.  This fails harmlessly on kernels without NUMA support.
+    unsigned long mask[kUpb_NumaAlloc_MaskWords];
+    memset(mask, 0, sizeof(mask));
+    size_t word = node / kUpb_NumaAlloc_MaskBits;
+    mask[word] = 1UL << (node % kUpb_NumaAlloc_MaskBits);
+    syscall(SYS_mbind, mem, map_size, kUpb_NumaAlloc_MpolPreferred, mask,
+            (unsigned long)kUpb_NumaAlloc_MaxBindNode + 1, 0);
+  }
+  memcpy(mem, &node, sizeof(node));
+  return mem + header_size;
+}
+
+static void upb_NumaAlloc_Unmap(void* ptr, size_t map_size) {
+  // The arena may have left the block poisoned, and the address range can be
+  // mapped again later.
+  char* mem = (char*)ptr - header_size;
+  UPB_UNPOISON_MEMORY_REGION(mem, map_size);
+  munmap(mem, map_size);
+}
+
+static void* upb_NumaAlloc_Malloc(upb_NumaAlloc* n, size_t size) {
+  if (size + header_size < kUpb_NumaAlloc_MinBlockSize) return malloc(size);
+
+  int node = upb_NumaAlloc_CurrentNode();
+  int size_class = upb_NumaAlloc_SizeClass(size + header_size);
+  if (size_class >= 0) {
+    _upb_NumaAlloc_Cache* cache = &n->caches[node % kUpb_NumaAlloc_MaxNodes];
+    UPB_ATOMIC(void*)* slots = cache->slots[size_class];
+    for (int i = 0; i < kUpb_NumaAlloc_CacheSlots; i++) {
+      if (!upb_Atomic_Load(&slots[i], memory_order_relaxed)) continue;
+      // Taking the block with an exchange gives it to exactly one thread.
+      void* block = upb_Atomic_Exchange(&slots[i], NULL, memory_order_acquire);
+      if (block) {
+        UPB_UNPOISON_MEMORY_REGION(block, size);
+        upb_Atomic_Sub(&cache->cached_bytes,
+                       upb_NumaAlloc_ClassSize(size_class),
+                       memory_order_relaxed);
+        return block;
+      }
+    }
+  }
+  return upb_NumaAlloc_Map(upb_NumaAlloc_MapSize(size), node);
+}
+
+static void upb_NumaAlloc_FreeBlock(upb_NumaAlloc* n, void* ptr,
+                                    size_t size) {
+  if (size + header_size < kUpb_NumaAlloc_MinBlockSize) {
+    free(ptr);
+    return;
+  }
+
+  size_t map_size = upb_NumaAlloc_MapSize(size);
+  int size_class = upb_NumaAlloc_SizeClass(size + header_size);
+  if (size_class >= 0) {
+    // The block goes back to the cache of the node it lives on, whichever
+    // thread frees it.
+    int node;
+    memcpy(&node, (char*)ptr - header_size, sizeof(node));
+    _upb_NumaAlloc_Cache* cache = &n->caches[node % kUpb_NumaAlloc_MaxNodes];
+    size_t cached = upb_Atomic_Load(&cache->cached_bytes, memory_order_relaxed);
+    do {
+      if (cached + map_size > n->max_cached_bytes) goto release;
+    } while (!upb_Atomic_CompareExchangeWeak(&cache->cached_bytes, &cached,
+                                             cached + map_size,
+                                             memory_order_relaxed,
+                                             memory_order_relaxed));
+
+    UPB_ATOMIC(void*)* slots = cache->slots[size_class];
+    for (int i = 0; i < kUpb_NumaAlloc_CacheSlots; i++) {
+      void* expected = NULL;
+      if (upb_Atomic_CompareExchangeStrong(&slots[i], &expected, ptr,
+                                           memory_order_release,
+                                           memory_order_relaxed)) {
+        return;
+      }
+    }
+    upb_Atomic_Sub(&cache->cached_bytes, map_size, memory_order_relaxed);
+  }
+
+release:
+  upb_NumaAlloc_Unmap(ptr, map_size);
+}
+
+#else
+
+static void* upb_NumaAlloc_Malloc(upb_NumaAlloc* n, size_t size) {
+  UPB_UNUSED(n);
+  return malloc(size);
+}
+
+static void upb_NumaAlloc_FreeBlock(upb_NumaAlloc* n, void* ptr,
+                                    size_t size) {
+  UPB_UNUSED(n);
+  UPB_UNUSED(size);
+  free(ptr);
+}
+
+#endif
+
+static void* upb_NumaAlloc_AllocFunc(upb_alloc* alloc, void* ptr,
+                                     size_t oldsize, size_t size) {
+  upb_NumaAlloc* n = (upb_NumaAlloc*)alloc;
+
+  if (size == 0) {
+    if (ptr) upb_NumaAlloc_FreeBlock(n, ptr, oldsize);
+    return NULL;
+  }
+
+  void* ret = upb_NumaAlloc_Malloc(n, size);
+  if (ret && ptr) {
+    memcpy(ret, ptr, UPB_MIN(oldsize, size));
+    upb_NumaAlloc_FreeBlock(n, ptr, oldsize);
+  }
+  return ret;
+}
+
+upb_NumaAlloc* upb_NumaAlloc_New(size_t max_cached_bytes) {
+  upb_NumaAlloc* n = upb_gmalloc(sizeof(*n));
+  if (!n) return NULL;
+  n->alloc.func = &upb_NumaAlloc_AllocFunc;
+  n->max_cached_bytes = max_cached_bytes;
+  for (int i = 0; i < kUpb_NumaAlloc_MaxNodes; i++) {
+    _upb_NumaAlloc_Cache* cache = &n->caches[i];
+    for (int j = 0; j < kUpb_NumaAlloc_SizeClasses; j++) {
+      for (int k = 0; k < kUpb_NumaAlloc_CacheSlots; k++) {
+        upb_Atomic_Init(&cache->slots[j][k], NULL);
+      }
+    }
+    upb_Atomic_Init(&cache->cached_bytes, 0);
+  }
+  return n;
+}
+
+void upb_NumaAlloc_Free(upb_NumaAlloc* n) {
+#ifdef UPB_NUMA_ALLOC_MAP
+  for (int i = 0; i < kUpb_NumaAlloc_MaxNodes; i++) {
+    _upb_NumaAlloc_Cache* cache = &n->caches[i];
+    for (int j = 0; j < kUpb_NumaAlloc_SizeClasses; j++) {
+      for (int k = 0; k < kUpb_NumaAlloc_CacheSlots; k++) {
+        void* block =
+            upb_Atomic_Load(&cache->slots[j][k], memory_order_acquire);
+        if (block) upb_NumaAlloc_Unmap(block, upb_NumaAlloc_ClassSize(j));
+      }
+    }
+  }
+#endif
+  upb_gfree(n);
+}
+
+upb_alloc* upb_NumaAlloc_Alloc(upb_NumaAlloc* n) { return &n->alloc; }
+
+size_t upb_NumaAlloc_CachedBytes(upb_NumaAlloc* n, int node) {
+  _upb_NumaAlloc_Cache* cache = &n->caches[node % kUpb_NumaAlloc_MaxNodes];
+  return upb_Atomic_Load(&cache->cached_bytes, memory_order_relaxed);
+}
@@ -0,0 +1,110 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/* upb_NumaAlloc is a thread-safe upb_alloc for arena blocks on machines with
+ * several NUMA nodes.  Each block is placed on the node of the thread that
+ * allocates it, so a worker that decodes into an arena gets node-local memory
+ * even if the block was freed by a thread on another node.  Freed blocks are
+ * kept in a cache per node and only handed out again to threads running on
+ * that node.
+ *
+ * Blocks of at least kUpb_NumaAlloc_MinBlockSize bytes (including a small
+ * header) are mapped directly from the kernel and bound to the node; smaller
+ * blocks come from malloc(), which in practice serves them from pages local
+ * to the allocating thread.  Memory from this allocator must be freed with
+ * upb_free_sized(), since the size determines how it was obtained.
+ * upb_Arena always does this.
+ *
+ * A thread is only pinned to its node if the caller arranges it, for example
+ * with sched_setaffinity(); a thread that migrates keeps using blocks from
+ * its old node until the arena allocates again.  On platforms other than
+ * Linux every allocation uses malloc() and there is a single node.  Without
+ * C11 atomics (see upb/port/atomic.h) the caches are not thread-safe. */
+
+#ifndef UPB_MEM_NUMA_ALLOC_H_
+#define UPB_MEM_NUMA_ALLOC_H_
+
+#include <stddef.h>
+
+#include "upb/mem/alloc.h"
+#include "upb/mem/arena.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Smallest block that is bound to a node.  Size classes are
+// kUpb_NumaAlloc_MinBlockSize << i for i in [0, kUpb_NumaAlloc_SizeClasses);
+// larger blocks are not cached.
+#define kUpb_NumaAlloc_MinBlockSize 4096
+#define kUpb_NumaAlloc_SizeClasses 10
+
+// Nodes with higher numbers share the cache of node % kUpb_NumaAlloc_MaxNodes,
+// but their blocks are still bound to the right node.
+#define kUpb_NumaAlloc_MaxNodes 16
+
+typedef struct upb_NumaAlloc upb_NumaAlloc;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates an allocator that caches at most `max_cached_bytes` of freed blocks
+// per node.  Returns NULL on allocation failure.
+UPB_API upb_NumaAlloc* upb_NumaAlloc_New(size_t max_cached_bytes);
+
+// Returns every cached block to the system and frees the allocator.  All
+// arenas that use it must have been freed.
+UPB_API void upb_NumaAlloc_Free(upb_NumaAlloc* n);
+
+UPB_API upb_alloc* upb_NumaAlloc_Alloc(upb_NumaAlloc* n);
+
+// Returns the number of bytes of freed blocks currently cached for `node`.
+UPB_API size_t upb_NumaAlloc_CachedBytes(upb_NumaAlloc* n, int node);
+
+// Returns the NUMA node of the CPU the calling thread is running on, or 0 if
+// it cannot be determined.
+UPB_API int upb_NumaAlloc_CurrentNode(void);
+
+// Like upb_Arena_InitWithOptions(), but all blocks beyond the initial one are
+// drawn from (and returned to) `numa`.
+UPB_API_INLINE upb_Arena* upb_Arena_InitWithNumaAlloc(
+    void* mem, size_t size, upb_NumaAlloc* numa,
+    const upb_ArenaOptions* options) {
+  return upb_Arena_InitWithOptions(mem, size, upb_NumaAlloc_Alloc(numa),
+                                   options);
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_MEM_NUMA_ALLOC_H_ */
@@ -0,0 +1,180 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "upb/mem/shared_arena.h"
+
+#include <string.h>
+
+#include "upb/port/atomic.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef struct _upb_SharedArena_Slab {
+  struct _upb_SharedArena_Slab* next;
+  size_t size;  // Usable bytes after the header.
+  UPB_ATOMIC(size_t) used;
+} _upb_SharedArena_Slab;
+
+static const size_t kUpb_SharedArena_SlabHeaderSize =
+    UPB_ALIGN_MALLOC(sizeof(_upb_SharedArena_Slab));
+
+struct upb_SharedArena {
+  upb_alloc alloc;  // Must be first.
+  upb_alloc* backing;
+  size_t slab_size;
+
+  // Slabs that blocks are carved from.  Only the first has any room left.
+  UPB_ATOMIC(_upb_SharedArena_Slab*) slabs;
+
+  // Allocations too large for a slab.
+  UPB_ATOMIC(_upb_SharedArena_Slab*) dedicated;
+
+  UPB_ATOMIC(size_t) space_allocated;
+};
+
+static char* _upb_SharedArena_SlabData(_upb_SharedArena_Slab* slab) {
+  return (char*)slab + kUpb_SharedArena_SlabHeaderSize;
+}
+
+static _upb_SharedArena_Slab* _upb_SharedArena_NewSlab(upb_SharedArena* s,
+                                                       size_t size,
+                                                       size_t used) {
+  _upb_SharedArena_Slab* slab =
+      upb_malloc(s->backing, kUpb_SharedArena_SlabHeaderSize + size);
+  if (!slab) return NULL;
+  slab->size = size;
+  upb_Atomic_Init(&slab->used, used);
+  return slab;
+}
+
+static void _upb_SharedArena_Push(UPB_ATOMIC(_upb_SharedArena_Slab*) * list,
+                                  _upb_SharedArena_Slab* slab) {
+  _upb_SharedArena_Slab* head = upb_Atomic_Load(list, memory_order_relaxed);
+  do {
+    slab->next = head;
+  } while (!upb_Atomic_CompareExchangeWeak(list, &head, slab,
+                                           memory_order_release,
+                                           memory_order_relaxed));
+}
+
+static void* _upb_SharedArena_Malloc(upb_SharedArena* s, size_t size) {
+  size = UPB_ALIGN_MALLOC(size);
+
+  if (size > s->slab_size / 4) {
+    _upb_SharedArena_Slab* slab = _upb_SharedArena_NewSlab(s, size, size);
+    if (!slab) return NULL;
+    _upb_SharedArena_Push(&s->dedicated, slab);
+    upb_Atomic_Add(&s->space_allocated, size, memory_order_relaxed);
+    return _upb_SharedArena_SlabData(slab);
+  }
+
+  _upb_SharedArena_Slab* slab =
+      upb_Atomic_Load(&s->slabs, memory_order_acquire);
+  while (true) {
+    if (slab) {
+      size_t used = upb_Atomic_Load(&slab->used, memory_order_relaxed);
+      while (used + size <= slab->size) {
+        if (upb_Atomic_CompareExchangeWeak(&slab->used, &used, used + size,
+                                           memory_order_relaxed,
+                                           memory_order_relaxed)) {
+          return _upb_SharedArena_SlabData(slab) + used;
+        }
+      }
+    }
+
+    // The slab is used up, so start a new one with this block at its front.
+    _upb_SharedArena_Slab* new_slab =
+        _upb_SharedArena_NewSlab(s, s->slab_size, size);
+    if (!new_slab) return NULL;
+    new_slab->next = slab;
+    if (upb_Atomic_CompareExchangeStrong(&s->slabs, &slab, new_slab,
+                                         memory_order_release,
+                                         memory_order_acquire)) {
+      upb_Atomic_Add(&s->space_allocated, s->slab_size, memory_order_relaxed);
+      return _upb_SharedArena_SlabData(new_slab);
+    }
+
+    // Another thread started a slab first; `slab` is now that one.
+    upb_free(s->backing, new_slab);
+  }
+}
+
+static void* _upb_SharedArena_AllocFunc(upb_alloc* alloc, void* ptr,
+                                        size_t oldsize, size_t size) {
+  upb_SharedArena* s = (upb_SharedArena*)alloc;
+
+  // Blocks are only released by upb_SharedArena_Free().
+  if (size == 0) return NULL;
+
+  void* ret = _upb_SharedArena_Malloc(s, size);
+  if (ret && ptr) memcpy(ret, ptr, UPB_MIN(oldsize, size));
+  return ret;
+}
+
+upb_SharedArena* upb_SharedArena_New(upb_alloc* backing, size_t slab_size) {
+  upb_SharedArena* s = upb_malloc(backing, sizeof(*s));
+  if (!s) return NULL;
+  s->alloc.func = &_upb_SharedArena_AllocFunc;
+  s->backing = backing;
+  s->slab_size = slab_size ? slab_size : kUpb_SharedArena_DefaultSlabSize;
+  upb_Atomic_Init(&s->slabs, NULL);
+  upb_Atomic_Init(&s->dedicated, NULL);
+  upb_Atomic_Init(&s->space_allocated, 0);
+  return s;
+}
+
+static void _upb_SharedArena_FreeList(upb_SharedArena* s,
+                                      _upb_SharedArena_Slab* slab) {
+  while (slab) {
+    _upb_SharedArena_Slab* next = slab->next;
+    upb_free(s->backing, slab);
+    slab = next;
+  }
+}
+
+void upb_SharedArena_Free(upb_SharedArena* s) {
+  _upb_SharedArena_FreeList(
+      s, upb_Atomic_Load(&s->slabs, memory_order_acquire));
+  _upb_SharedArena_FreeList(
+      s, upb_Atomic_Load(&s->dedicated, memory_order_acquire));
+  upb_free(s->backing, s);
+}
+
+upb_Arena* upb_SharedArena_NewThreadArena(upb_SharedArena* s) {
+  // Keep every block small enough to be carved from a slab.
+  upb_ArenaOptions options;
+  memset(&options, 0, sizeof(options));
+  options.max_block_size = s->slab_size / 4;
+  return upb_Arena_InitWithOptions(NULL, 0, &s->alloc, &options);
+}
+
+size_t upb_SharedArena_SpaceAllocated(upb_SharedArena* s) {
+  return upb_Atomic_Load(&s->space_allocated, memory_order_relaxed);
+}
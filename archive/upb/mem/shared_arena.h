@@ -0,0 +1,96 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+/* upb_SharedArena is a pool of memory that many threads can allocate from at
+ * once and that is freed as a unit, for building one message tree on several
+ * threads.
+ *
+ * Each thread allocates through a upb_Arena of its own from
+ * upb_SharedArena_NewThreadArena(), so the fast path is the usual bump
+ * pointer with no atomic operations.  When a thread arena needs a new block,
+ * it carves one out of a slab shared by all threads with a compare-and-swap,
+ * and only when the slab is used up is a new one taken from the backing
+ * allocator.  Compared to independent arenas fused together (see
+ * upb_Arena_Fuse()), there is no reference counting, and blocks are packed
+ * into a few large allocations.
+ *
+ * Everything allocated from the thread arenas lives until
+ * upb_SharedArena_Free().  upb_Arena_Free() on a thread arena is allowed but
+ * releases nothing, and a thread arena must not be fused with an arena that
+ * may outlive the shared arena.
+ *
+ * Without C11 atomics (see upb/port/atomic.h), the slab handoff is not
+ * thread-safe and the thread arenas must all be used from one thread. */
+
+#ifndef UPB_MEM_SHARED_ARENA_H_
+#define UPB_MEM_SHARED_ARENA_H_
+
+#include <stddef.h>
+
+#include "upb/mem/alloc.h"
+#include "upb/mem/arena.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// The default slab size of upb_SharedArena_New().
+#define kUpb_SharedArena_DefaultSlabSize (64 * 1024)
+
+typedef struct upb_SharedArena upb_SharedArena;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Creates a shared arena that takes slabs of `slab_size` bytes (or
+// kUpb_SharedArena_DefaultSlabSize if 0) from `backing`.  Blocks of more than
+// a quarter of a slab get an allocation of their own.  Returns NULL on
+// allocation failure.
+UPB_API upb_SharedArena* upb_SharedArena_New(upb_alloc* backing,
+                                             size_t slab_size);
+
+// Frees the shared arena together with every thread arena created from it and
+// everything allocated from them.
+UPB_API void upb_SharedArena_Free(upb_SharedArena* s);
+
+// Returns a new arena that takes its blocks from `s`.  May be called from any
+// thread.  The returned arena is an ordinary, single-threaded upb_Arena, so
+// each thread needs its own.  Returns NULL on allocation failure.
+UPB_API upb_Arena* upb_SharedArena_NewThreadArena(upb_SharedArena* s);
+
+// Returns the number of bytes taken from the backing allocator so far.
+UPB_API size_t upb_SharedArena_SpaceAllocated(upb_SharedArena* s);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_MEM_SHARED_ARENA_H_ */
@@ -32,8 +32,11 @@
 
 #include "upb/collections/array.h"
 #include "upb/collections/internal/array.h"
+#include "upb/collections/internal/map.h"
 #include "upb/collections/map.h"
+#include "upb/message/internal/message.h"
 #include "upb/message/message.h"
+#include "upb/message/tagged_ptr.h"
 #include "upb/mini_table/field.h"
 #include "upb/wire/decode.h"
 #include "upb/wire/encode.h"
@@ -92,3 +95,92 @@ bool upb_Message_IsExactlyEqual(const upb_Message* m1, const upb_Message* m2,
   upb_Arena_Free(a);
   return ret;
 }
+
+// Freezes a sub-message, which may be in the unlinked, "empty" state.
+static void _upb_Message_FreezeTagged(upb_TaggedMessagePtr tagged,
+                                      const upb_MiniTable* mini_table) {
+  upb_Message* msg = _upb_TaggedMessagePtr_GetMessage(tagged);
+  if (!msg) return;
+  upb_Message_Freeze(msg, upb_TaggedMessagePtr_IsEmpty(tagged)
+                              ? &_kUpb_MiniTable_Empty
+                              : mini_table);
+}
+
+void upb_Message_Freeze(upb_Message* msg, const upb_MiniTable* mini_table) {
+  // Sub-objects may be shared (see upb_Message_ShallowClone()), so a frozen
+  // message has already been walked.
+  if (_upb_Message_IsFrozen(msg)) return;
+  _upb_Message_SetFrozen(msg);
+
+  for (size_t i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    const upb_MiniTable* sub =
+        upb_MiniTableField_CType(field) == kUpb_CType_Message
+            ? mini_table->subs[field->UPB_PRIVATE(submsg_index)].submsg
+            : NULL;
+    switch (upb_FieldMode_Get(field)) {
+      case kUpb_FieldMode_Map: {
+        upb_Map* map = (upb_Map*)upb_Message_GetMap(msg, field);
+        if (!map) break;
+        const upb_MiniTableField* val_field = &sub->fields[1];
+        upb_Map_Freeze(
+            map, upb_MiniTableField_CType(val_field) == kUpb_CType_Message
+                     ? sub->subs[val_field->UPB_PRIVATE(submsg_index)].submsg
+                     : NULL);
+        break;
+      }
+      case kUpb_FieldMode_Array: {
+        upb_Array* arr = (upb_Array*)upb_Message_GetArray(msg, field);
+        if (arr) upb_Array_Freeze(arr, sub);
+        break;
+      }
+      case kUpb_FieldMode_Scalar:
+        if (sub) {
+          _upb_Message_FreezeTagged(
+              upb_Message_GetTaggedMessagePtr(msg, field, NULL), sub);
+        }
+        break;
+    }
+  }
+
+  size_t ext_count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &ext_count);
+  for (size_t i = 0; i < ext_count; i++) {
+    const upb_MiniTableExtension* e = ext[i].ext;
+    const upb_MiniTableField* field = &e->field;
+    if (upb_IsRepeatedOrMap(field)) {
+      upb_Array_Freeze((upb_Array*)ext[i].data.ptr, e->sub.submsg);
+    } else if (upb_MiniTableField_CType(field) == kUpb_CType_Message) {
+      _upb_Message_FreezeTagged((upb_TaggedMessagePtr)ext[i].data.ptr,
+                                e->sub.submsg);
+    }
+  }
+}
+
+void upb_Array_Freeze(upb_Array* arr, const upb_MiniTable* sub) {
+  if (arr->is_frozen) return;
+  arr->is_frozen = true;
+  if (!sub) return;
+  const size_t size = arr->size;
+  if (_upb_Array_HasInlineMessages(arr)) {
+    for (size_t i = 0; i < size; i++) {
+      upb_Message_Freeze(_upb_Array_InlineMessage(arr, i), sub);
+    }
+    return;
+  }
+  upb_TaggedMessagePtr* elems = _upb_array_ptr(arr);
+  for (size_t i = 0; i < size; i++) {
+    _upb_Message_FreezeTagged(elems[i], sub);
+  }
+}
+
+void upb_Map_Freeze(upb_Map* map, const upb_MiniTable* sub) {
+  if (map->is_frozen) return;
+  map->is_frozen = true;
+  if (!sub) return;
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue key, val;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    upb_Message_Freeze((upb_Message*)val.msg_val, sub);
+  }
+}
@@ -60,6 +60,8 @@ UPB_API_INLINE void upb_Message_ClearField(upb_Message* msg,
 
 UPB_API_INLINE void upb_Message_Clear(upb_Message* msg,
                                       const upb_MiniTable* l) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
   // Note: Can't use UPB_PTR_AT() here because we are doing pointer subtraction.
   char* mem = (char*)msg - sizeof(upb_Message_Internal);
   memset(mem, 0, upb_msg_sizeof(l));
@@ -302,6 +304,7 @@ UPB_API_INLINE upb_Message* upb_Message_GetOrCreateMutableMessage(
     upb_Message* msg, const upb_MiniTable* mini_table,
     const upb_MiniTableField* field, upb_Arena* arena) {
   UPB_ASSERT(arena);
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
   UPB_ASSUME(upb_MiniTableField_CType(field) == kUpb_CType_Message);
   upb_Message* sub_message = *UPB_PTR_AT(msg, field->offset, upb_Message*);
   if (!sub_message) {
@@ -309,6 +312,7 @@ UPB_API_INLINE upb_Message* upb_Message_GetOrCreateMutableMessage(
         mini_table->subs[field->UPB_PRIVATE(submsg_index)].submsg;
     UPB_ASSERT(sub_mini_table);
     sub_message = _upb_Message_New(sub_mini_table, arena);
+    _upb_Message_Modified(msg);
     *UPB_PTR_AT(msg, field->offset, upb_Message*) = sub_message;
     _upb_Message_SetPresence(msg, field);
   }
@@ -327,6 +331,9 @@ UPB_API_INLINE const upb_Array* upb_Message_GetArray(
 UPB_API_INLINE upb_Array* upb_Message_GetMutableArray(
     upb_Message* msg, const upb_MiniTableField* field) {
   _upb_MiniTableField_CheckIsArray(field);
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  // The caller may change the array, which we cannot track.
+  _upb_Message_Modified(msg);
   return (upb_Array*)upb_Message_GetArray(msg, field);
 }
 
@@ -365,6 +372,8 @@ UPB_API_INLINE const upb_Map* upb_Message_GetMap(
 
 UPB_API_INLINE upb_Map* upb_Message_GetMutableMap(
     upb_Message* msg, const upb_MiniTableField* field) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
   return (upb_Map*)upb_Message_GetMap(msg, field);
 }
 
@@ -394,6 +403,28 @@ upb_MapInsertStatus upb_Message_InsertMapEntry(upb_Map* map,
 bool upb_Message_IsExactlyEqual(const upb_Message* m1, const upb_Message* m2,
                                 const upb_MiniTable* layout);
 
+// Marks the message and everything reachable from it (sub-messages, arrays,
+// maps and extensions) as frozen.  A frozen message must not be modified
+// again: every setter, clear and mutable getter asserts that its target is
+// not frozen.  Nothing in upb writes to a frozen tree when it is read,
+// encoded or compared, so once the freeze is visible to other threads (e.g.
+// through a mutex or an atomic store) they may read it concurrently.
+//
+// Copy-on-write clones (see upb_Message_ShallowClone()) share frozen
+// sub-objects with the original and copy them only when they are mutated, so
+// a frozen message is a cheap base for many variants.  Freezing does not
+// affect the arena, which must still outlive every reader.
+UPB_API void upb_Message_Freeze(upb_Message* msg,
+                                const upb_MiniTable* mini_table);
+
+// Freezes the array and, for an array of messages, its elements, which use
+// `sub`.  `sub` is ignored for other arrays and may be NULL.
+UPB_API void upb_Array_Freeze(upb_Array* arr, const upb_MiniTable* sub);
+
+// Freezes the map and, if its values are messages, the values, which use
+// `sub`.  `sub` is ignored for other maps and may be NULL.
+UPB_API void upb_Map_Freeze(upb_Map* map, const upb_MiniTable* sub);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -37,17 +37,24 @@
 #include "upb/message/accessors.h"
 
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "google/protobuf/test_messages_proto2.upb.h"
 #include "google/protobuf/test_messages_proto3.upb.h"
 #include "upb/base/string_view.h"
 #include "upb/collections/array.h"
+#include "upb/collections/map.h"
+#include "upb/message/copy.h"
 #include "upb/mini_descriptor/decode.h"
 #include "upb/mini_descriptor/internal/encode.hpp"
 #include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_descriptor/link.h"
+#include "upb/mini_table/extension_registry.h"
+#include "upb/mini_table/internal/field.h"
 #include "upb/test/test.upb.h"
 #include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
 
 // Must be last
 #include "upb/port/def.inc"
@@ -424,4 +431,361 @@ TEST(GeneratedCode, EnumClosedCheck) {
   upb_Arena_Free(arena);
 }
 
+TEST(GeneratedCode, OutOfLineFields) {
+  upb_Arena* arena = upb_Arena_New();
+
+  upb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kUpb_FieldType_Int32, 1, 0);
+  e.PutField(kUpb_FieldType_Int64, 2, 0);
+  e.PutField(kUpb_FieldType_String, 3, 0);
+  e.PutField(kUpb_FieldType_Int32, 4, kUpb_FieldModifier_IsProto3Singular);
+  const uint8_t hotness[] = {kUpb_FieldHotness_Default,
+                             kUpb_FieldHotness_OutOfLine,
+                             kUpb_FieldHotness_OutOfLine,
+                             kUpb_FieldHotness_OutOfLine};
+
+  upb_Status status;
+  upb_Status_Clear(&status);
+  void* buf = nullptr;
+  size_t buf_size = 0;
+  upb_MiniTable* table = upb_MiniTable_BuildWithHotness(
+      e.data().data(), e.data().size(), kUpb_MiniTablePlatform_Native, hotness,
+      sizeof(hotness), arena, &buf, &buf_size, &status);
+  free(buf);
+  ASSERT_NE(nullptr, table) << upb_Status_ErrorMessage(&status);
+  const upb_MiniTableField* f1 = &table->fields[0];
+  const upb_MiniTableField* f2 = &table->fields[1];
+  const upb_MiniTableField* f3 = &table->fields[2];
+  const upb_MiniTableField* f4 = &table->fields[3];
+  // Only the hasbits and field 1 are stored in the message.
+  EXPECT_EQ(8, table->size);
+
+  upb_Message* msg = upb_Message_New(table, arena);
+  EXPECT_FALSE(upb_Message_HasField(msg, f2));
+  EXPECT_EQ(0, upb_Message_GetInt64(msg, f2, 0));
+  EXPECT_EQ(0, upb_Message_GetInt32(msg, f4, 0));
+  upb_Message_ClearField(msg, f2);
+
+  EXPECT_TRUE(upb_Message_SetInt32(msg, f1, 1, arena));
+  EXPECT_TRUE(upb_Message_SetInt64(msg, f2, 2, arena));
+  EXPECT_TRUE(upb_Message_SetString(
+      msg, f3, upb_StringView_FromString("three"), arena));
+  EXPECT_TRUE(upb_Message_SetInt32(msg, f4, 4, arena));
+  EXPECT_TRUE(upb_Message_HasField(msg, f2));
+  EXPECT_EQ(2, upb_Message_GetInt64(msg, f2, 0));
+  EXPECT_EQ(4, upb_Message_GetInt32(msg, f4, 0));
+
+  size_t size;
+  char* data;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, table, 0, arena, &data, &size));
+  upb_Message* parsed = upb_Message_New(table, arena);
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(data, size, parsed, table, nullptr, 0, arena));
+  EXPECT_EQ(1, upb_Message_GetInt32(parsed, f1, 0));
+  EXPECT_EQ(2, upb_Message_GetInt64(parsed, f2, 0));
+  upb_StringView str = upb_Message_GetString(parsed, f3, {});
+  EXPECT_EQ("three", std::string(str.data, str.size));
+  EXPECT_EQ(4, upb_Message_GetInt32(parsed, f4, 0));
+
+  upb_Message* clone = upb_Message_DeepClone(msg, table, arena);
+  ASSERT_NE(nullptr, clone);
+  EXPECT_TRUE(upb_Message_SetInt64(msg, f2, 20, arena));
+  EXPECT_EQ(2, upb_Message_GetInt64(clone, f2, 0));
+  EXPECT_EQ(4, upb_Message_GetInt32(clone, f4, 0));
+
+  upb_Message_ClearField(msg, f2);
+  EXPECT_FALSE(upb_Message_HasField(msg, f2));
+  EXPECT_EQ(0, upb_Message_GetInt64(msg, f2, 0));
+  upb_Message_Clear(msg, table);
+  EXPECT_EQ(0, upb_Message_GetInt32(msg, f4, 0));
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, InlineStrings) {
+  upb_Arena* arena = upb_Arena_New();
+
+  upb::MtDataEncoder e;
+  e.StartMessage(0);
+  e.PutField(kUpb_FieldType_Bytes, 1, 0);
+  e.PutField(kUpb_FieldType_Int32, 2, 0);
+  const uint8_t hotness[] = {kUpb_FieldHotness_InlineString,
+                             kUpb_FieldHotness_InlineString};
+
+  upb_Status status;
+  upb_Status_Clear(&status);
+  void* buf = nullptr;
+  size_t buf_size = 0;
+  upb_MiniTable* table = upb_MiniTable_BuildWithHotness(
+      e.data().data(), e.data().size(), kUpb_MiniTablePlatform_Native, hotness,
+      sizeof(hotness), arena, &buf, &buf_size, &status);
+  free(buf);
+  ASSERT_NE(nullptr, table) << upb_Status_ErrorMessage(&status);
+  const upb_MiniTableField* f1 = &table->fields[0];
+  const upb_MiniTableField* f2 = &table->fields[1];
+  // The inline-string flag shares its bit with the packed flag.
+  EXPECT_TRUE(_upb_MiniTableField_HasInlineString(f1));
+  EXPECT_FALSE(_upb_MiniTableField_IsPacked(f1));
+  EXPECT_FALSE(_upb_MiniTableField_HasInlineString(f2));
+  // The buffer follows the view and does not overlap field 2.
+  const size_t buf_end =
+      f1->offset + sizeof(upb_StringView) + kUpb_MiniTableField_InlineStringSize;
+  EXPECT_LE(buf_end, table->size);
+  EXPECT_TRUE(f2->offset < f1->offset || f2->offset >= buf_end);
+
+  auto in_message = [&](const upb_Message* msg, const char* ptr) {
+    return ptr >= (const char*)msg && ptr < (const char*)msg + table->size;
+  };
+
+  for (const std::string& value :
+       {std::string("short"), std::string(16, 'x'), std::string(17, 'y')}) {
+    std::string data = std::string{0x0a, static_cast<char>(value.size())} +
+                       value + std::string{0x10, 0x05};
+    for (int options : {0, (int)kUpb_DecodeOption_AliasString}) {
+      upb_Message* msg = upb_Message_New(table, arena);
+      ASSERT_EQ(kUpb_DecodeStatus_Ok, upb_Decode(data.data(), data.size(),
+                                                 msg, table, nullptr, options,
+                                                 arena));
+      upb_StringView str = upb_Message_GetString(msg, f1, {});
+      EXPECT_EQ(value, std::string(str.data, str.size));
+      EXPECT_EQ(5, upb_Message_GetInt32(msg, f2, 0));
+      // Aliased strings need no copy, long ones do not fit.
+      EXPECT_EQ(options == 0 && value.size() <= 16,
+                in_message(msg, str.data));
+
+      size_t size;
+      char* encoded;
+      ASSERT_EQ(kUpb_EncodeStatus_Ok,
+                upb_Encode(msg, table, 0, arena, &encoded, &size));
+      EXPECT_EQ(data, std::string(encoded, size));
+      ASSERT_EQ(kUpb_EncodeStatus_Ok,
+                upb_Message_ByteSize(msg, table, 0, &size));
+      EXPECT_EQ(data.size(), size);
+
+      upb_Message* clone = upb_Message_DeepClone(msg, table, arena);
+      ASSERT_NE(nullptr, clone);
+      str = upb_Message_GetString(clone, f1, {});
+      EXPECT_EQ(value, std::string(str.data, str.size));
+      EXPECT_EQ(value.size() <= 16, in_message(clone, str.data));
+    }
+  }
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, InlineSubMessages) {
+  upb_Arena* arena = upb_Arena_New();
+  upb_Status status;
+  upb_Status_Clear(&status);
+
+  upb::MtDataEncoder point_e;
+  point_e.StartMessage(0);
+  point_e.PutField(kUpb_FieldType_Int32, 1, 0);
+  point_e.PutField(kUpb_FieldType_Int32, 2, 0);
+  upb_MiniTable* point = upb_MiniTable_Build(
+      point_e.data().data(), point_e.data().size(), arena, &status);
+  ASSERT_NE(nullptr, point) << upb_Status_ErrorMessage(&status);
+
+  upb::MtDataEncoder parent_e;
+  parent_e.StartMessage(0);
+  parent_e.PutField(kUpb_FieldType_Message, 1, kUpb_FieldModifier_IsRepeated);
+  upb_MiniTable* parent = upb_MiniTable_Build(
+      parent_e.data().data(), parent_e.data().size(), arena, &status);
+  ASSERT_NE(nullptr, parent) << upb_Status_ErrorMessage(&status);
+  upb_MiniTableField* field = const_cast<upb_MiniTableField*>(
+      upb_MiniTable_FindFieldByNumber(parent, 1));
+  EXPECT_FALSE(upb_MiniTable_SetInlineSubMessage(parent, field, parent));
+  ASSERT_TRUE(upb_MiniTable_SetInlineSubMessage(parent, field, point));
+  EXPECT_TRUE(_upb_MiniTableField_HasInlineMessages(field));
+  EXPECT_FALSE(_upb_MiniTableField_IsPacked(field));
+  const upb_MiniTableField* x = &point->fields[0];
+  const upb_MiniTableField* y = &point->fields[1];
+
+  std::string data;
+  for (int i = 0; i < 10; i++) {
+    data += std::string{0x0a, 0x04, 0x08, static_cast<char>(i), 0x10,
+                        static_cast<char>(2 * i)};
+  }
+  upb_Message* msg = upb_Message_New(parent, arena);
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, upb_Decode(data.data(), data.size(), msg,
+                                             parent, nullptr, 0, arena));
+  upb_Array* arr = upb_Message_GetMutableArray(msg, field);
+  ASSERT_NE(nullptr, arr);
+  EXPECT_TRUE(upb_Array_HasInlineMessages(arr));
+  ASSERT_EQ(10, upb_Array_Size(arr));
+  const char* first = (const char*)upb_Array_Get(arr, 0).msg_val;
+  for (int i = 0; i < 10; i++) {
+    const upb_Message* elem = upb_Array_Get(arr, i).msg_val;
+    EXPECT_EQ(first + i * upb_msg_sizeof(point), (const char*)elem);
+    EXPECT_EQ(i, upb_Message_GetInt32(elem, x, -1));
+    EXPECT_EQ(2 * i, upb_Message_GetInt32(elem, y, -1));
+  }
+
+  size_t size;
+  char* encoded;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, parent, 0, arena, &encoded, &size));
+  EXPECT_EQ(data, std::string(encoded, size));
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Message_ByteSize(msg, parent, 0, &size));
+  EXPECT_EQ(data.size(), size);
+
+  // Setting an element copies the message into the array.
+  upb_Message* standalone = upb_Message_New(point, arena);
+  upb_Message_SetInt32(standalone, x, 100, arena);
+  upb_MessageValue val;
+  val.msg_val = standalone;
+  upb_Array_Set(arr, 3, val);
+  upb_Message_SetInt32(standalone, x, 200, arena);
+  upb_Message* elem = upb_Array_GetMutable(arr, 3).msg;
+  EXPECT_EQ(100, upb_Message_GetInt32(elem, x, -1));
+  EXPECT_FALSE(upb_Message_HasField(elem, y));
+  upb_Message_SetInt32(elem, y, 7, arena);
+  EXPECT_EQ(7, upb_Message_GetInt32(upb_Array_Get(arr, 3).msg_val, y, -1));
+
+  // Sub-messages that do not fit in an element stay out of the array.
+  upb::MtDataEncoder big_e;
+  big_e.StartMessage(0);
+  for (int i = 1; i <= 20; i++) big_e.PutField(kUpb_FieldType_Int64, i, 0);
+  upb_MiniTable* big = upb_MiniTable_Build(
+      big_e.data().data(), big_e.data().size(), arena, &status);
+  ASSERT_NE(nullptr, big) << upb_Status_ErrorMessage(&status);
+  EXPECT_FALSE(upb_MiniTable_SetInlineSubMessage(parent, field, big));
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, OrderedMap) {
+  upb_Arena* arena = upb_Arena_New();
+  upb_Status status;
+  upb_Status_Clear(&status);
+
+  upb::MtDataEncoder entry_e;
+  entry_e.EncodeMap(kUpb_FieldType_Int32, kUpb_FieldType_Int32, 0, 0);
+  upb_MiniTable* entry = upb_MiniTable_Build(
+      entry_e.data().data(), entry_e.data().size(), arena, &status);
+  ASSERT_NE(nullptr, entry) << upb_Status_ErrorMessage(&status);
+
+  upb::MtDataEncoder parent_e;
+  parent_e.StartMessage(0);
+  parent_e.PutField(kUpb_FieldType_Int32, 1, 0);
+  parent_e.PutField(kUpb_FieldType_Message, 2, kUpb_FieldModifier_IsRepeated);
+  upb_MiniTable* parent = upb_MiniTable_Build(
+      parent_e.data().data(), parent_e.data().size(), arena, &status);
+  ASSERT_NE(nullptr, parent) << upb_Status_ErrorMessage(&status);
+  upb_MiniTableField* scalar = const_cast<upb_MiniTableField*>(
+      upb_MiniTable_FindFieldByNumber(parent, 1));
+  upb_MiniTableField* field = const_cast<upb_MiniTableField*>(
+      upb_MiniTable_FindFieldByNumber(parent, 2));
+  EXPECT_FALSE(upb_MiniTable_SetOrderedMap(parent, scalar));
+  EXPECT_FALSE(upb_MiniTable_SetOrderedMap(parent, field));
+  ASSERT_TRUE(upb_MiniTable_SetSubMessage(parent, field, entry));
+  ASSERT_TRUE(upb_MiniTable_SetOrderedMap(parent, field));
+  // The ordered-map flag shares its bit with the packed flag.
+  EXPECT_TRUE(_upb_MiniTableField_IsOrderedMap(field));
+  EXPECT_FALSE(_upb_MiniTableField_IsPacked(field));
+  EXPECT_FALSE(_upb_MiniTableField_HasInlineMessages(field));
+
+  // Entries arrive out of order, with one duplicate key.
+  const int keys[] = {50, 3, 90, 7, 3, 60, 1};
+  std::string data;
+  for (int key : keys) {
+    data += std::string{0x12, 0x04, 0x08, static_cast<char>(key), 0x10,
+                        static_cast<char>(key + 1)};
+  }
+  upb_Message* msg = upb_Message_New(parent, arena);
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, upb_Decode(data.data(), data.size(), msg,
+                                             parent, nullptr, 0, arena));
+  upb_Map* map = upb_Message_GetMutableMap(msg, field);
+  ASSERT_NE(nullptr, map);
+  EXPECT_TRUE(upb_Map_IsOrdered(map));
+  EXPECT_EQ(6, upb_Map_Size(map));
+
+  // Serializes like a map that is sorted at encode time.
+  upb_MiniTable* plain = upb_MiniTable_Build(
+      parent_e.data().data(), parent_e.data().size(), arena, &status);
+  ASSERT_NE(nullptr, plain) << upb_Status_ErrorMessage(&status);
+  ASSERT_TRUE(upb_MiniTable_SetSubMessage(
+      plain, const_cast<upb_MiniTableField*>(&plain->fields[1]), entry));
+  upb_Message* plain_msg = upb_Message_New(plain, arena);
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, upb_Decode(data.data(), data.size(),
+                                             plain_msg, plain, nullptr, 0,
+                                             arena));
+  const upb_Map* plain_map =
+      upb_Message_GetMutableMap(plain_msg, &plain->fields[1]);
+  EXPECT_FALSE(upb_Map_IsOrdered(plain_map));
+
+  size_t size, plain_size;
+  char* encoded;
+  char* plain_encoded;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, parent, kUpb_EncodeOption_Deterministic, arena,
+                       &encoded, &size));
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(plain_msg, plain, kUpb_EncodeOption_Deterministic,
+                       arena, &plain_encoded, &plain_size));
+  EXPECT_EQ(std::string(plain_encoded, plain_size), std::string(encoded, size));
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, ManyExtensions) {
+  upb_Arena* arena = upb_Arena_New();
+  upb_Status status;
+  upb_Status_Clear(&status);
+  upb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartMessage(kUpb_MessageModifier_IsExtendable));
+  ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, 1, 0));
+  upb_MiniTable* extendee = upb_MiniTable_Build(
+      e.data().data(), e.data().size(), arena, &status);
+  ASSERT_NE(nullptr, extendee) << upb_Status_ErrorMessage(&status);
+  std::vector<const upb_MiniTableExtension*> exts;
+  upb_ExtensionRegistry* reg = upb_ExtensionRegistry_New(arena);
+  for (uint32_t i = 0; i < 100; i++) {
+    upb::MtDataEncoder ext_e;
+    ASSERT_TRUE(ext_e.EncodeExtension(kUpb_FieldType_Int32, 100 + i, 0));
+    const upb_MiniTableExtension* ext =
+        upb_MiniTableExtension_Build(ext_e.data().data(), ext_e.data().size(),
+                                     extendee, arena, &status);
+    ASSERT_NE(nullptr, ext) << upb_Status_ErrorMessage(&status);
+    ASSERT_TRUE(upb_ExtensionRegistry_Add(reg, ext));
+    exts.push_back(ext);
+  }
+
+  // Enough extensions to be indexed, interleaved with removals that move the
+  // last-created extension into the removed one's slot.
+  upb_Message* msg = upb_Message_New(extendee, arena);
+  std::vector<bool> present(100, false);
+  for (uint32_t i = 0; i < 100; i++) {
+    ASSERT_TRUE(upb_Message_SetInt32(msg, &exts[i]->field, i + 1, arena));
+    present[i] = true;
+    if (i % 3 == 2) {
+      upb_Message_ClearField(msg, &exts[i / 2]->field);
+      present[i / 2] = false;
+    }
+  }
+  size_t count = 0;
+  for (uint32_t i = 0; i < 100; i++) {
+    const upb_MiniTableField* f = &exts[i]->field;
+    EXPECT_EQ(present[i], upb_Message_HasField(msg, f)) << i;
+    EXPECT_EQ(present[i] ? i + 1 : 0, upb_Message_GetInt32(msg, f, 0)) << i;
+    count += present[i];
+  }
+  EXPECT_EQ(count, upb_Message_ExtensionCount(msg));
+
+  // The decoder adds extensions through the same index.
+  size_t size;
+  char* buf;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, extendee, 0, arena, &buf, &size));
+  upb_Message* parsed = upb_Message_New(extendee, arena);
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(buf, size, parsed, extendee, reg, 0, arena));
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_EQ(present[i] ? i + 1 : 0,
+              upb_Message_GetInt32(parsed, &exts[i]->field, 0))
+        << i;
+  }
+  EXPECT_EQ(count, upb_Message_ExtensionCount(parsed));
+  upb_Arena_Free(arena);
+}
+
 }  // namespace
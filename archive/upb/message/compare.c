@@ -0,0 +1,400 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/compare.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "upb/base/descriptor_constants.h"
+#include "upb/base/string_view.h"
+#include "upb/collections/internal/array.h"
+#include "upb/collections/internal/map.h"
+#include "upb/hash/common.h"
+#include "upb/message/accessors.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/internal/extension.h"
+#include "upb/message/internal/message.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/field.h"
+#include "upb/mini_table/internal/field.h"
+#include "upb/mini_table/internal/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+static bool upb_MessageField_IsMap(const upb_MiniTableField* field) {
+  return upb_FieldMode_Get(field) == kUpb_FieldMode_Map;
+}
+
+static const upb_MiniTable* upb_Compare_SubTable(
+    const upb_MiniTable* mini_table, const upb_MiniTableField* field) {
+  if (upb_MiniTableField_CType(field) != kUpb_CType_Message ||
+      field->UPB_PRIVATE(submsg_index) == kUpb_NoSub) {
+    return NULL;
+  }
+  return upb_MiniTable_GetSubMessageTable(mini_table, field);
+}
+
+static bool upb_Compare_TaggedMessages(upb_TaggedMessagePtr t1,
+                                       upb_TaggedMessagePtr t2,
+                                       const upb_MiniTable* sub) {
+  if (t1 == t2) return true;
+  const upb_Message* msg1 = _upb_TaggedMessagePtr_GetMessage(t1);
+  const upb_Message* msg2 = _upb_TaggedMessagePtr_GetMessage(t2);
+  if (!msg1 || !msg2) return false;
+  // An unpromoted message holds all of its data as unknown fields, so it can
+  // only be compared with another unpromoted message.
+  bool empty = upb_TaggedMessagePtr_IsEmpty(t1);
+  if (empty != upb_TaggedMessagePtr_IsEmpty(t2)) return false;
+  if (empty || !sub) sub = &_kUpb_MiniTable_Empty;
+  return upb_Message_IsEqual(msg1, msg2, sub);
+}
+
+// Compares two values of type `type` stored at `p1` and `p2` in their
+// in-message representation.
+static bool upb_Compare_Values(const void* p1, const void* p2, upb_CType type,
+                               const upb_MiniTable* sub) {
+  switch (type) {
+    case kUpb_CType_Bool:
+      return *(const bool*)p1 == *(const bool*)p2;
+    case kUpb_CType_Float: {
+      float f1, f2;
+      memcpy(&f1, p1, sizeof(f1));
+      memcpy(&f2, p2, sizeof(f2));
+      return f1 == f2 || memcmp(p1, p2, sizeof(f1)) == 0;
+    }
+    case kUpb_CType_Double: {
+      double d1, d2;
+      memcpy(&d1, p1, sizeof(d1));
+      memcpy(&d2, p2, sizeof(d2));
+      return d1 == d2 || memcmp(p1, p2, sizeof(d1)) == 0;
+    }
+    case kUpb_CType_Int32:
+    case kUpb_CType_UInt32:
+    case kUpb_CType_Enum:
+      return memcmp(p1, p2, 4) == 0;
+    case kUpb_CType_Int64:
+    case kUpb_CType_UInt64:
+      return memcmp(p1, p2, 8) == 0;
+    case kUpb_CType_String:
+    case kUpb_CType_Bytes:
+      return upb_StringView_IsEqual(*(const upb_StringView*)p1,
+                                    *(const upb_StringView*)p2);
+    case kUpb_CType_Message:
+      return upb_Compare_TaggedMessages(*(const upb_TaggedMessagePtr*)p1,
+                                        *(const upb_TaggedMessagePtr*)p2, sub);
+  }
+  UPB_UNREACHABLE();
+}
+
+bool upb_Array_IsEqual(const upb_Array* arr1, const upb_Array* arr2,
+                       upb_CType value_type, const upb_MiniTable* sub) {
+  size_t size = arr1 ? arr1->size : 0;
+  if (size != (arr2 ? arr2->size : 0)) return false;
+  if (size == 0 || arr1 == arr2) return true;
+  if (UPB_UNLIKELY(_upb_Array_HasInlineMessages(arr1) ||
+                   _upb_Array_HasInlineMessages(arr2))) {
+    if (!sub) sub = &_kUpb_MiniTable_Empty;
+    for (size_t i = 0; i < size; i++) {
+      if (!upb_Message_IsEqual(upb_Array_Get(arr1, i).msg_val,
+                               upb_Array_Get(arr2, i).msg_val, sub)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  const char* data1 = _upb_array_constptr(arr1);
+  const char* data2 = _upb_array_constptr(arr2);
+  const int lg2 = _upb_Array_CTypeSizeLg2(value_type);
+  // Identical bytes are always equal elements.  Only pointer-bearing elements
+  // and floating point values can be equal without it.
+  if (memcmp(data1, data2, size << lg2) == 0) return true;
+  switch (value_type) {
+    case kUpb_CType_Bool:
+    case kUpb_CType_Int32:
+    case kUpb_CType_UInt32:
+    case kUpb_CType_Enum:
+    case kUpb_CType_Int64:
+    case kUpb_CType_UInt64:
+      return false;
+    default:
+      break;
+  }
+  for (size_t i = 0; i < size; i++) {
+    size_t ofs = i << lg2;
+    if (!upb_Compare_Values(data1 + ofs, data2 + ofs, value_type, sub)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool upb_Map_IsEqual(const upb_Map* map1, const upb_Map* map2,
+                     const upb_MiniTable* map_entry_table) {
+  size_t size = map1 ? _upb_Map_Size(map1) : 0;
+  if (size != (map2 ? _upb_Map_Size(map2) : 0)) return false;
+  if (size == 0 || map1 == map2) return true;
+  const upb_MiniTableField* val_field = &map_entry_table->fields[1];
+  upb_CType val_type = upb_MiniTableField_CType(val_field);
+  const upb_MiniTable* val_sub =
+      upb_Compare_SubTable(map_entry_table, val_field);
+  upb_MessageValue key, val1, val2;
+  size_t iter = kUpb_Map_Begin;
+  while (upb_Map_Next(map1, &key, &val1, &iter)) {
+    if (!upb_Map_Get(map2, key, &val2)) return false;
+    if (!upb_Compare_Values(&val1, &val2, val_type, val_sub)) return false;
+  }
+  return true;
+}
+
+static bool upb_Compare_Field(const upb_Message* msg1, const upb_Message* msg2,
+                              const upb_MiniTable* mini_table,
+                              const upb_MiniTableField* field) {
+  if (upb_IsRepeatedOrMap(field)) {
+    const void* p1 = _upb_MiniTableField_GetConstPtr(msg1, field);
+    const void* p2 = _upb_MiniTableField_GetConstPtr(msg2, field);
+    if (upb_MessageField_IsMap(field)) {
+      return upb_Map_IsEqual(*(const upb_Map* const*)p1,
+                             *(const upb_Map* const*)p2,
+                             upb_MiniTable_GetSubMessageTable(mini_table, field));
+    }
+    return upb_Array_IsEqual(*(const upb_Array* const*)p1,
+                             *(const upb_Array* const*)p2,
+                             upb_MiniTableField_CType(field),
+                             upb_Compare_SubTable(mini_table, field));
+  }
+  if (field->presence != 0) {
+    bool has = _upb_Message_HasNonExtensionField(msg1, field);
+    if (has != _upb_Message_HasNonExtensionField(msg2, field)) return false;
+    if (!has) return true;
+  }
+  return upb_Compare_Values(_upb_MiniTableField_GetConstPtr(msg1, field),
+                            _upb_MiniTableField_GetConstPtr(msg2, field),
+                            upb_MiniTableField_CType(field),
+                            upb_Compare_SubTable(mini_table, field));
+}
+
+static bool upb_Compare_Extensions(const upb_Message* msg1,
+                                   const upb_Message* msg2) {
+  size_t count1, count2;
+  const upb_Message_Extension* exts = _upb_Message_Getexts(msg1, &count1);
+  _upb_Message_Getexts(msg2, &count2);
+  if (count1 != count2) return false;
+  for (size_t i = 0; i < count1; i++) {
+    const upb_MiniTableExtension* e = exts[i].ext;
+    const upb_Message_Extension* other = _upb_Message_Getext(msg2, e);
+    if (!other) return false;
+    upb_CType type = upb_MiniTableField_CType(&e->field);
+    const upb_MiniTable* sub =
+        type == kUpb_CType_Message ? e->sub.submsg : NULL;
+    if (upb_IsRepeatedOrMap(&e->field)) {
+      if (!upb_Array_IsEqual(exts[i].data.ptr, other->data.ptr, type, sub)) {
+        return false;
+      }
+    } else if (!upb_Compare_Values(&exts[i].data, &other->data, type, sub)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool upb_Message_IsEqual(const upb_Message* msg1, const upb_Message* msg2,
+                         const upb_MiniTable* mini_table) {
+  if (msg1 == msg2) return true;
+  size_t len1, len2;
+  const char* unknown1 = upb_Message_GetUnknown(msg1, &len1);
+  const char* unknown2 = upb_Message_GetUnknown(msg2, &len2);
+  if (len1 != len2 || (len1 && memcmp(unknown1, unknown2, len1) != 0)) {
+    return false;
+  }
+  if (!upb_Compare_Extensions(msg1, msg2)) return false;
+
+  // Identical hasbits, oneof cases and in-line fields are always equal, which
+  // leaves only the fields stored out of line to check.
+  bool same_body = memcmp(msg1, msg2, mini_table->size) == 0;
+  for (size_t i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    if (same_body && !_upb_MiniTableField_IsOutOfLine(field)) continue;
+    if (!upb_Compare_Field(msg1, msg2, mini_table, field)) return false;
+  }
+  return true;
+}
+
+// Hashing //////////////////////////////////////////////////////////////////
+
+static uint64_t upb_Hash_Message(const upb_Message* msg,
+                                 const upb_MiniTable* mini_table,
+                                 uint64_t seed);
+
+static uint64_t upb_Hash_Value(const void* p, upb_CType type,
+                               const upb_MiniTable* sub, uint64_t seed) {
+  switch (type) {
+    case kUpb_CType_Bool:
+      return _upb_Hash(p, 1, seed);
+    case kUpb_CType_Float: {
+      float f;
+      memcpy(&f, p, sizeof(f));
+      if (f == 0) f = 0;  // Equal zeros must hash equally.
+      return _upb_Hash(&f, sizeof(f), seed);
+    }
+    case kUpb_CType_Double: {
+      double d;
+      memcpy(&d, p, sizeof(d));
+      if (d == 0) d = 0;
+      return _upb_Hash(&d, sizeof(d), seed);
+    }
+    case kUpb_CType_Int32:
+    case kUpb_CType_UInt32:
+    case kUpb_CType_Enum:
+      return _upb_Hash(p, 4, seed);
+    case kUpb_CType_Int64:
+    case kUpb_CType_UInt64:
+      return _upb_Hash(p, 8, seed);
+    case kUpb_CType_String:
+    case kUpb_CType_Bytes: {
+      const upb_StringView* str = p;
+      return _upb_Hash(str->data, str->size, seed);
+    }
+    case kUpb_CType_Message: {
+      upb_TaggedMessagePtr tagged = *(const upb_TaggedMessagePtr*)p;
+      const upb_Message* msg = _upb_TaggedMessagePtr_GetMessage(tagged);
+      if (!msg) return seed;
+      if (upb_TaggedMessagePtr_IsEmpty(tagged) || !sub) {
+        sub = &_kUpb_MiniTable_Empty;
+      }
+      return upb_Hash_Message(msg, sub, seed);
+    }
+  }
+  UPB_UNREACHABLE();
+}
+
+static uint64_t upb_Hash_Array(const upb_Array* arr, upb_CType type,
+                               const upb_MiniTable* sub, uint64_t seed) {
+  size_t size = arr->size;
+  seed = _upb_Hash(&size, sizeof(size), seed);
+  if (UPB_UNLIKELY(_upb_Array_HasInlineMessages(arr))) {
+    if (!sub) sub = &_kUpb_MiniTable_Empty;
+    for (size_t i = 0; i < size; i++) {
+      seed = upb_Hash_Message(upb_Array_Get(arr, i).msg_val, sub, seed);
+    }
+    return seed;
+  }
+  const char* data = _upb_array_constptr(arr);
+  const int lg2 = _upb_Array_CTypeSizeLg2(type);
+  for (size_t i = 0; i < size; i++) {
+    seed = upb_Hash_Value(data + (i << lg2), type, sub, seed);
+  }
+  return seed;
+}
+
+// Map entries are hashed independently and summed, so that the result does not
+// depend on iteration order.
+static uint64_t upb_Hash_Map(const upb_Map* map,
+                             const upb_MiniTable* map_entry_table,
+                             uint64_t seed) {
+  const upb_MiniTableField* key_field = &map_entry_table->fields[0];
+  const upb_MiniTableField* val_field = &map_entry_table->fields[1];
+  upb_CType key_type = upb_MiniTableField_CType(key_field);
+  upb_CType val_type = upb_MiniTableField_CType(val_field);
+  const upb_MiniTable* val_sub =
+      upb_Compare_SubTable(map_entry_table, val_field);
+  uint64_t sum = 0;
+  upb_MessageValue key, val;
+  size_t iter = kUpb_Map_Begin;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    uint64_t h = upb_Hash_Value(&key, key_type, NULL, seed);
+    sum += upb_Hash_Value(&val, val_type, val_sub, h);
+  }
+  return _upb_Hash(&sum, sizeof(sum), seed);
+}
+
+static uint64_t upb_Hash_Field(const upb_Message* msg,
+                               const upb_MiniTable* mini_table,
+                               const upb_MiniTableField* field,
+                               uint64_t seed) {
+  const void* p = _upb_MiniTableField_GetConstPtr(msg, field);
+  upb_CType type = upb_MiniTableField_CType(field);
+  if (upb_MessageField_IsMap(field)) {
+    const upb_Map* map = *(const upb_Map* const*)p;
+    if (!map || _upb_Map_Size(map) == 0) return seed;
+    seed = _upb_Hash(&field->number, sizeof(field->number), seed);
+    return upb_Hash_Map(map, upb_MiniTable_GetSubMessageTable(mini_table, field),
+                        seed);
+  }
+  if (upb_IsRepeatedOrMap(field)) {
+    const upb_Array* arr = *(const upb_Array* const*)p;
+    if (!arr || arr->size == 0) return seed;
+    seed = _upb_Hash(&field->number, sizeof(field->number), seed);
+    return upb_Hash_Array(arr, type, upb_Compare_SubTable(mini_table, field),
+                          seed);
+  }
+  if (field->presence != 0 && !_upb_Message_HasNonExtensionField(msg, field)) {
+    return seed;
+  }
+  seed = _upb_Hash(&field->number, sizeof(field->number), seed);
+  return upb_Hash_Value(p, type, upb_Compare_SubTable(mini_table, field), seed);
+}
+
+static uint64_t upb_Hash_Message(const upb_Message* msg,
+                                 const upb_MiniTable* mini_table,
+                                 uint64_t seed) {
+  for (size_t i = 0; i < mini_table->field_count; i++) {
+    seed = upb_Hash_Field(msg, mini_table, &mini_table->fields[i], seed);
+  }
+
+  // Extensions are stored in reverse order of creation, so like map entries
+  // they are hashed independently and summed.
+  size_t count;
+  const upb_Message_Extension* exts = _upb_Message_Getexts(msg, &count);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    const upb_MiniTableField* f = &exts[i].ext->field;
+    upb_CType type = upb_MiniTableField_CType(f);
+    const upb_MiniTable* sub =
+        type == kUpb_CType_Message ? exts[i].ext->sub.submsg : NULL;
+    uint64_t h = _upb_Hash(&f->number, sizeof(f->number), seed);
+    sum += upb_IsRepeatedOrMap(f)
+               ? upb_Hash_Array(exts[i].data.ptr, type, sub, h)
+               : upb_Hash_Value(&exts[i].data, type, sub, h);
+  }
+  if (count) seed = _upb_Hash(&sum, sizeof(sum), seed);
+
+  size_t len;
+  const char* unknown = upb_Message_GetUnknown(msg, &len);
+  if (len) seed = _upb_Hash(unknown, len, seed);
+  return seed;
+}
+
+uint32_t upb_Message_Hash(const upb_Message* msg,
+                          const upb_MiniTable* mini_table, uint64_t seed) {
+  return (uint32_t)upb_Hash_Message(msg, mini_table, seed);
+}
@@ -0,0 +1,91 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Equality and hashing of messages using only their MiniTables, without
+// reflection.
+//
+// Two messages are equal if they have the same fields set to equal values and
+// byte-for-byte identical unknown fields.  Float and double values are equal
+// if they compare equal with == or have identical bits, so NaNs are equal to
+// themselves and every message is equal to itself.  A sub-message that was
+// parsed lazily and never promoted (see upb/message/promote.h) only equals
+// another unpromoted sub-message with the same data.  For a comparison that
+// ignores the order of unknown fields, see upb/util/compare.h.
+//
+// upb_Message_Hash() is consistent with upb_Message_IsEqual(): equal messages
+// hash equally, regardless of the order in which their map entries and
+// extensions were set.
+
+#ifndef UPB_MESSAGE_COMPARE_H_
+#define UPB_MESSAGE_COMPARE_H_
+
+#include <stdint.h>
+
+#include "upb/base/descriptor_constants.h"
+#include "upb/collections/array.h"
+#include "upb/collections/map.h"
+#include "upb/message/message.h"
+#include "upb/mini_table/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns true if `msg1` and `msg2`, both of type `mini_table`, are equal.
+bool upb_Message_IsEqual(const upb_Message* msg1, const upb_Message* msg2,
+                         const upb_MiniTable* mini_table);
+
+// Returns true if the arrays hold equal elements in the same order.  `sub` is
+// the element MiniTable for arrays of messages and NULL otherwise.  A NULL
+// array is equal to an empty one.
+bool upb_Array_IsEqual(const upb_Array* arr1, const upb_Array* arr2,
+                       upb_CType value_type, const upb_MiniTable* sub);
+
+// Returns true if the maps hold equal values under the same keys.  A NULL map
+// is equal to an empty one.
+bool upb_Map_IsEqual(const upb_Map* map1, const upb_Map* map2,
+                     const upb_MiniTable* map_entry_table);
+
+// Returns a hash of the contents of `msg`, consistent with
+// upb_Message_IsEqual().  The hash is stable for a given `seed` and binary,
+// but not across versions of upb.
+uint32_t upb_Message_Hash(const upb_Message* msg,
+                          const upb_MiniTable* mini_table, uint64_t seed);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_MESSAGE_COMPARE_H_
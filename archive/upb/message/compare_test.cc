@@ -0,0 +1,248 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/compare.h"
+
+#include <math.h>
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/base/string_view.h"
+#include "upb/mem/arena.h"
+#include "upb/message/copy.h"
+#include "upb/message/internal/message.h"
+
+namespace {
+
+typedef protobuf_test_messages_proto2_TestAllTypesProto2 TestAllTypes;
+typedef protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage
+    NestedMessage;
+
+const upb_MiniTable* kTable =
+    &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init;
+
+upb_StringView Str(const char* s) { return upb_StringView_FromString(s); }
+
+bool IsEqual(const TestAllTypes* msg1, const TestAllTypes* msg2) {
+  bool ret = upb_Message_IsEqual(msg1, msg2, kTable);
+  EXPECT_EQ(ret, upb_Message_IsEqual(msg2, msg1, kTable));
+  if (ret) {
+    EXPECT_EQ(upb_Message_Hash(msg1, kTable, 0),
+              upb_Message_Hash(msg2, kTable, 0));
+  }
+  return ret;
+}
+
+TestAllTypes* NewPopulated(upb_Arena* arena) {
+  TestAllTypes* msg = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(msg, 1);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int64(msg, 2);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_double(msg,
+                                                                       1.5);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_string(
+      msg, Str("a string too long to be stored inline"));
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_bytes(
+      msg, Str("short"));
+  NestedMessage* nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          msg, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(nested,
+                                                                       3);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_string(
+      msg, Str("x"), arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_string(
+      msg, Str("y"), arena);
+  nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+          msg, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(nested,
+                                                                       4);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_oneof_string(
+      msg, Str("oneof"));
+  protobuf_test_messages_proto2_set_extension_int32(msg, 5, arena);
+  for (int i = 0; i < 10; i++) {
+    protobuf_test_messages_proto2_TestAllTypesProto2_map_int32_int32_set(
+        msg, i, i * i, arena);
+  }
+  return msg;
+}
+
+TEST(CompareTest, EqualToSelfAndClone) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg = NewPopulated(arena);
+  EXPECT_TRUE(IsEqual(msg, msg));
+  TestAllTypes* clone =
+      (TestAllTypes*)upb_Message_DeepClone(msg, kTable, arena);
+  ASSERT_NE(clone, nullptr);
+  EXPECT_TRUE(IsEqual(msg, clone));
+
+  // A round trip through the wire format yields an equal message.  The
+  // extension would come back as an unknown field, as no registry is used.
+  protobuf_test_messages_proto2_clear_extension_int32(msg);
+  size_t size;
+  char* data =
+      protobuf_test_messages_proto2_TestAllTypesProto2_serialize(msg, arena,
+                                                                 &size);
+  ASSERT_NE(data, nullptr);
+  TestAllTypes* parsed =
+      protobuf_test_messages_proto2_TestAllTypesProto2_parse(data, size, arena);
+  ASSERT_NE(parsed, nullptr);
+  EXPECT_TRUE(IsEqual(msg, parsed));
+  upb_Arena_Free(arena);
+}
+
+TEST(CompareTest, DetectsDifferences) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg = NewPopulated(arena);
+
+  TestAllTypes* other = NewPopulated(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int64(other,
+                                                                      7);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_clear_optional_int32(other);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  // Presence matters even when the value is the default.
+  other = NewPopulated(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_bool(other,
+                                                                     false);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_string(
+      other, Str("a string too long to be stored inlinE"));
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  NestedMessage* nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          other, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(nested,
+                                                                       9);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_string(
+      other, Str("z"), arena);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_oneof_uint32(other, 0);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  protobuf_test_messages_proto2_set_extension_int32(other, 6, arena);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_int32_int32_set(
+      other, 3, 10, arena);
+  EXPECT_FALSE(IsEqual(msg, other));
+
+  other = NewPopulated(arena);
+  const char unknown[] = {'\xf8', '\x3e', '\x01'};  // Field 999, varint 1.
+  ASSERT_TRUE(_upb_Message_AddUnknown(other, unknown, sizeof(unknown), arena));
+  EXPECT_FALSE(IsEqual(msg, other));
+  upb_Arena_Free(arena);
+}
+
+TEST(CompareTest, MapAndExtensionOrderDoesNotMatter) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg1 = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  TestAllTypes* msg2 = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  const char* keys[] = {"one", "two", "three", "four", "five"};
+  for (int i = 0; i < 5; i++) {
+    protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+        msg1, Str(keys[i]), Str(keys[4 - i]), arena);
+    protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+        msg2, Str(keys[4 - i]), Str(keys[i]), arena);
+  }
+  EXPECT_TRUE(IsEqual(msg1, msg2));
+
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(msg1, 1);
+  protobuf_test_messages_proto2_set_extension_int32(msg1, 2, arena);
+  protobuf_test_messages_proto2_set_extension_int32(msg2, 2, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(msg2, 1);
+  EXPECT_TRUE(IsEqual(msg1, msg2));
+  upb_Arena_Free(arena);
+}
+
+TEST(CompareTest, FloatingPoint) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg1 = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  TestAllTypes* msg2 = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_float(msg1,
+                                                                      0.0f);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_float(msg2,
+                                                                      -0.0f);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_double(
+      msg1, 0.0, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_double(
+      msg2, -0.0, arena);
+  EXPECT_TRUE(IsEqual(msg1, msg2));
+
+  // NaN is equal to itself, so that every message is equal to itself.
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_double(msg1,
+                                                                       NAN);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_double(msg2,
+                                                                       NAN);
+  EXPECT_TRUE(IsEqual(msg1, msg2));
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_double(msg2,
+                                                                       1.0);
+  EXPECT_FALSE(IsEqual(msg1, msg2));
+  upb_Arena_Free(arena);
+}
+
+TEST(CompareTest, EmptyAndAbsentContainersAreEqual) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg1 = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  TestAllTypes* msg2 = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_int32(msg1, 1,
+                                                                      arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_int32_int32_set(
+      msg1, 1, 1, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_clear_repeated_int32(msg1);
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_int32_int32_clear(msg1);
+  EXPECT_TRUE(IsEqual(msg1, msg2));
+  upb_Arena_Free(arena);
+}
+
+TEST(CompareTest, HashDependsOnSeed) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg = NewPopulated(arena);
+  EXPECT_NE(upb_Message_Hash(msg, kTable, 0), upb_Message_Hash(msg, kTable, 1));
+  upb_Arena_Free(arena);
+}
+
+}  // namespace
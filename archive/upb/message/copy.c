@@ -41,6 +41,8 @@
 #include "upb/message/message.h"
 #include "upb/mini_table/field.h"
 #include "upb/mini_table/internal/field.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -49,18 +51,6 @@ static bool upb_MessageField_IsMap(const upb_MiniTableField* field) {
   return upb_FieldMode_Get(field) == kUpb_FieldMode_Map;
 }
 
-static upb_StringView upb_Clone_StringView(upb_StringView str,
-                                           upb_Arena* arena) {
-  if (str.size == 0) {
-    return upb_StringView_FromDataAndSize(NULL, 0);
-  }
-  void* cloned_data = upb_Arena_Malloc(arena, str.size);
-  upb_StringView cloned_str =
-      upb_StringView_FromDataAndSize(cloned_data, str.size);
-  memcpy(cloned_data, str.data, str.size);
-  return cloned_str;
-}
-
 static bool upb_Clone_MessageValue(void* value, upb_CType value_type,
                                    const upb_MiniTable* sub, upb_Arena* arena) {
   switch (value_type) {
@@ -105,10 +95,15 @@ upb_Map* upb_Map_DeepClone(const upb_Map* map, upb_CType key_type,
                            upb_CType value_type,
                            const upb_MiniTable* map_entry_table,
                            upb_Arena* arena) {
-  upb_Map* cloned_map = _upb_Map_New(arena, map->key_size, map->val_size);
+  upb_Map* cloned_map = _upb_Map_NewSized(arena, map->key_size, map->val_size,
+                                          _upb_Map_Size(map));
   if (cloned_map == NULL) {
     return NULL;
   }
+  if (upb_Map_IsOrdered(map) &&
+      !upb_Map_SetOrdered(cloned_map, key_type, arena)) {
+    return NULL;
+  }
   upb_MessageValue key, val;
   size_t iter = kUpb_Map_Begin;
   while (upb_Map_Next(map, &key, &val, &iter)) {
@@ -154,20 +149,54 @@ static upb_Map* upb_Message_Map_DeepClone(const upb_Map* map,
 upb_Array* upb_Array_DeepClone(const upb_Array* array, upb_CType value_type,
                                const upb_MiniTable* sub, upb_Arena* arena) {
   size_t size = array->size;
-  upb_Array* cloned_array =
-      _upb_Array_New(arena, size, _upb_Array_CTypeSizeLg2(value_type));
+  const int lg2 = _upb_Array_CTypeSizeLg2(value_type);
+  upb_Array* cloned_array = _upb_Array_New(arena, size, lg2);
   if (!cloned_array) {
     return NULL;
   }
   if (!_upb_Array_ResizeUninitialized(cloned_array, size, arena)) {
     return NULL;
   }
-  for (size_t i = 0; i < size; ++i) {
-    upb_MessageValue val = upb_Array_Get(array, i);
-    if (!upb_Clone_MessageValue(&val, value_type, sub, arena)) {
-      return false;
+  if (UPB_UNLIKELY(_upb_Array_HasInlineMessages(array))) {
+    for (size_t i = 0; i < size; ++i) {
+      upb_MessageValue val = upb_Array_Get(array, i);
+      if (!upb_Clone_MessageValue(&val, value_type, sub, arena)) {
+        return NULL;
+      }
+      upb_Array_Set(cloned_array, i, val);
     }
-    upb_Array_Set(cloned_array, i, val);
+    return cloned_array;
+  }
+  // Copy the elements wholesale, then fix up the ones holding pointers.
+  UPB_ASSERT(_upb_Array_ElementSizeLg2(array) == (size_t)lg2);
+  void* data = _upb_array_ptr(cloned_array);
+  memcpy(data, _upb_array_constptr(array), size << lg2);
+  switch (value_type) {
+    case kUpb_CType_String:
+    case kUpb_CType_Bytes: {
+      // All string data of the array goes into a single allocation.
+      upb_StringView* strs = (upb_StringView*)data;
+      size_t total = 0;
+      for (size_t i = 0; i < size; ++i) total += strs[i].size;
+      if (total == 0) break;
+      char* ptr = (char*)upb_Arena_Malloc(arena, total);
+      if (!ptr) return NULL;
+      for (size_t i = 0; i < size; ++i) {
+        memcpy(ptr, strs[i].data, strs[i].size);
+        strs[i].data = ptr;
+        ptr += strs[i].size;
+      }
+    } break;
+    case kUpb_CType_Message: {
+      upb_TaggedMessagePtr* msgs = (upb_TaggedMessagePtr*)data;
+      for (size_t i = 0; i < size; ++i) {
+        if (!upb_Clone_MessageValue(&msgs[i], value_type, sub, arena)) {
+          return NULL;
+        }
+      }
+    } break;
+    default:
+      break;
   }
   return cloned_array;
 }
@@ -184,6 +213,9 @@ static bool upb_Message_Array_DeepClone(const upb_Array* array,
           ? upb_MiniTable_GetSubMessageTable(mini_table, field)
           : NULL,
       arena);
+  if (!cloned_array) {
+    return false;
+  }
 
   // Clear out upb_Array* due to parent memcpy.
   _upb_Message_SetNonExtensionField(clone, field, &cloned_array);
@@ -200,11 +232,37 @@ static bool upb_Clone_ExtensionValue(
       mini_table_ext->sub.submsg, arena);
 }
 
-upb_Message* _upb_Message_Copy(upb_Message* dst, const upb_Message* src,
-                               const upb_MiniTable* mini_table,
-                               upb_Arena* arena) {
+static bool upb_Clone_FitsInlineString(const upb_MiniTableField* field,
+                                       upb_StringView str) {
+  return _upb_MiniTableField_HasInlineString(field) &&
+         str.size <= kUpb_MiniTableField_InlineStringSize;
+}
+
+// Returns the total size of the singular strings of `src` that a copy cannot
+// keep in an inline buffer.  They are all copied into one allocation.
+static size_t upb_Message_ClonedStringSize(const upb_Message* src,
+                                           const upb_MiniTable* mini_table) {
+  upb_StringView empty_string = upb_StringView_FromDataAndSize(NULL, 0);
+  size_t total = 0;
+  for (size_t i = 0; i < mini_table->field_count; ++i) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    if (upb_IsRepeatedOrMap(field)) continue;
+    upb_CType type = upb_MiniTableField_CType(field);
+    if (type != kUpb_CType_String && type != kUpb_CType_Bytes) continue;
+    upb_StringView str = upb_Message_GetString(src, field, empty_string);
+    if (!upb_Clone_FitsInlineString(field, str)) total += str.size;
+  }
+  return total;
+}
+
+// Copies `src` into `dst`, placing its strings at `str_buf`, which must hold
+// upb_Message_ClonedStringSize() bytes.
+static upb_Message* _upb_Message_CopyWithStrings(
+    upb_Message* dst, const upb_Message* src, const upb_MiniTable* mini_table,
+    char* str_buf, upb_Arena* arena) {
   upb_StringView empty_string = upb_StringView_FromDataAndSize(NULL, 0);
-  // Only copy message area skipping upb_Message_Internal.
+  // Only copy message area skipping upb_Message_Internal.  This leaves only
+  // pointer-bearing fields to fix up below.
   memcpy(dst, src, mini_table->size);
   for (size_t i = 0; i < mini_table->field_count; ++i) {
     const upb_MiniTableField* field = &mini_table->fields[i];
@@ -236,15 +294,35 @@ upb_Message* _upb_Message_Copy(upb_Message* dst, const upb_Message* src,
         case kUpb_CType_String:
         case kUpb_CType_Bytes: {
           upb_StringView str = upb_Message_GetString(src, field, empty_string);
-          if (str.size != 0) {
-            if (!upb_Message_SetString(
-                    dst, field, upb_Clone_StringView(str, arena), arena)) {
-              return NULL;
-            }
+          if (str.size == 0) break;
+          if (upb_Clone_FitsInlineString(field, str)) {
+            // Short strings go to the clone's own inline buffer.
+            upb_StringView* view = UPB_PTR_AT(dst, field->offset, void);
+            char* buf = (char*)(view + 1);
+            memmove(buf, str.data, str.size);
+            view->data = buf;
+            break;
+          }
+          memcpy(str_buf, str.data, str.size);
+          str.data = str_buf;
+          str_buf += str.size;
+          if (UPB_UNLIKELY(_upb_MiniTableField_IsOutOfLine(field))) {
+            if (!upb_Message_SetString(dst, field, str, arena)) return NULL;
+          } else {
+            // Presence was already copied along with the message body.
+            *UPB_PTR_AT(dst, field->offset, upb_StringView) = str;
           }
         } break;
         default:
-          // Scalar, already copied.
+          // Scalar, already copied unless it is stored out of line.
+          if (UPB_UNLIKELY(_upb_MiniTableField_IsOutOfLine(field))) {
+            const void* val = _upb_MiniTableField_GetConstPtr(src, field);
+            if (_upb_MiniTable_ValueIsNonZero(val, field)) {
+              void* mem = _upb_Message_MutableOutOfLine(dst, field, arena);
+              if (!mem) return NULL;
+              _upb_MiniTable_CopyFieldData(mem, val, field);
+            }
+          }
           break;
       }
     } else {
@@ -305,6 +383,18 @@ upb_Message* _upb_Message_Copy(upb_Message* dst, const upb_Message* src,
   return dst;
 }
 
+upb_Message* _upb_Message_Copy(upb_Message* dst, const upb_Message* src,
+                               const upb_MiniTable* mini_table,
+                               upb_Arena* arena) {
+  size_t str_size = upb_Message_ClonedStringSize(src, mini_table);
+  char* str_buf = NULL;
+  if (str_size) {
+    str_buf = (char*)upb_Arena_Malloc(arena, str_size);
+    if (!str_buf) return NULL;
+  }
+  return _upb_Message_CopyWithStrings(dst, src, mini_table, str_buf, arena);
+}
+
 bool upb_Message_DeepCopy(upb_Message* dst, const upb_Message* src,
                           const upb_MiniTable* mini_table, upb_Arena* arena) {
   upb_Message_Clear(dst, mini_table);
@@ -317,6 +407,413 @@ bool upb_Message_DeepCopy(upb_Message* dst, const upb_Message* src,
 upb_Message* upb_Message_DeepClone(const upb_Message* message,
                                    const upb_MiniTable* mini_table,
                                    upb_Arena* arena) {
+  // The clone and its strings share one allocation.  The body is filled in
+  // by the copy, so only the internal header needs to be cleared.
+  size_t msg_size = upb_msg_sizeof(mini_table);
+  size_t str_size = upb_Message_ClonedStringSize(message, mini_table);
+  char* mem = (char*)upb_Arena_Malloc(arena, msg_size + str_size);
+  if (!mem) return NULL;
+  memset(mem, 0, sizeof(upb_Message_Internal));
+  upb_Message* clone = UPB_PTR_AT(mem, sizeof(upb_Message_Internal), void);
+  return _upb_Message_CopyWithStrings(clone, message, mini_table,
+                                      mem + msg_size, arena);
+}
+
+upb_Message* upb_Message_Compact(const upb_Message* message,
+                                 const upb_MiniTable* mini_table,
+                                 upb_Arena* message_arena, upb_Arena* arena,
+                                 size_t* reclaimed) {
+  size_t before = upb_Arena_SpaceAllocated(arena);
+  upb_Message* compacted = upb_Message_DeepClone(message, mini_table, arena);
+  if (!compacted) return NULL;
+  if (reclaimed) {
+    size_t used = upb_Arena_SpaceAllocated(arena) - before;
+    size_t old = upb_Arena_SpaceAllocated(message_arena);
+    *reclaimed = old > used ? old - used : 0;
+  }
+  return compacted;
+}
+
+// Merging ////////////////////////////////////////////////////////////////////
+
+// Appends deep copies of the elements of `src` to `dst`.
+static bool upb_Array_Merge(upb_Array* dst, const upb_Array* src,
+                            upb_CType value_type, const upb_MiniTable* sub,
+                            upb_Arena* arena) {
+  size_t n = src->size;
+  if (n == 0) return true;
+  upb_Array* clone = upb_Array_DeepClone(src, value_type, sub, arena);
+  if (!clone) return false;
+  if (UPB_UNLIKELY(_upb_Array_HasInlineMessages(dst))) {
+    for (size_t i = 0; i < n; i++) {
+      if (!upb_Array_Append(dst, upb_Array_Get(clone, i), arena)) return false;
+    }
+    return true;
+  }
+  size_t old_size = dst->size;
+  const int lg2 = _upb_Array_CTypeSizeLg2(value_type);
+  if (!_upb_Array_ResizeUninitialized(dst, old_size + n, arena)) return false;
+  memcpy((char*)_upb_array_ptr(dst) + (old_size << lg2),
+         _upb_array_constptr(clone), n << lg2);
+  return true;
+}
+
+// Merges the message `src` into `*dst`, which is 0 if there is no message
+// there yet.  Unpromoted ("empty") messages hold their data in wire format, so
+// merging one with a promoted message goes through the wire format.
+static bool upb_Message_MergeTagged(upb_TaggedMessagePtr* dst,
+                                    upb_TaggedMessagePtr src,
+                                    const upb_MiniTable* sub,
+                                    upb_Arena* arena) {
+  const upb_Message* src_msg = _upb_TaggedMessagePtr_GetMessage(src);
+  if (!src_msg) return true;
+  bool src_empty = upb_TaggedMessagePtr_IsEmpty(src);
+  if (!sub) sub = &_kUpb_MiniTable_Empty;
+  if (!*dst) {
+    upb_Message* clone = upb_Message_DeepClone(
+        src_msg, src_empty ? &_kUpb_MiniTable_Empty : sub, arena);
+    if (!clone) return false;
+    *dst = _upb_TaggedMessagePtr_Pack(clone, src_empty);
+    return true;
+  }
+  upb_Message* dst_msg = _upb_TaggedMessagePtr_GetMessage(*dst);
+  bool dst_empty = upb_TaggedMessagePtr_IsEmpty(*dst);
+  if (!src_empty && !dst_empty) {
+    return upb_Message_Merge(dst_msg, src_msg, sub, arena);
+  }
+  char* buf;
+  size_t size;
+  if (src_empty) {
+    buf = (char*)upb_Message_GetUnknown(src_msg, &size);
+  } else if (upb_Encode(src_msg, sub, 0, arena, &buf, &size) !=
+             kUpb_EncodeStatus_Ok) {
+    return false;
+  }
+  if (dst_empty) return _upb_Message_AddUnknown(dst_msg, buf, size, arena);
+  return upb_Decode(buf, size, dst_msg, sub, NULL, 0, arena) ==
+         kUpb_DecodeStatus_Ok;
+}
+
+static bool upb_Message_MergeField(upb_Message* dst, const upb_Message* src,
+                                   const upb_MiniTable* mini_table,
+                                   const upb_MiniTableField* field,
+                                   upb_Arena* arena) {
+  upb_CType type = upb_MiniTableField_CType(field);
+  if (upb_MessageField_IsMap(field)) {
+    const upb_Map* map = upb_Message_GetMap(src, field);
+    if (!map || upb_Map_Size(map) == 0) return true;
+    const upb_MiniTable* entry =
+        upb_MiniTable_GetSubMessageTable(mini_table, field);
+    upb_Map* clone =
+        upb_Map_DeepClone(map, upb_MiniTableField_CType(&entry->fields[0]),
+                          upb_MiniTableField_CType(&entry->fields[1]), entry,
+                          arena);
+    if (!clone) return false;
+    upb_Map* dst_map = upb_Message_GetMutableMap(dst, field);
+    if (!dst_map) {
+      _upb_Message_SetNonExtensionField(dst, field, &clone);
+      return true;
+    }
+    upb_MessageValue key, val;
+    size_t iter = kUpb_Map_Begin;
+    while (upb_Map_Next(clone, &key, &val, &iter)) {
+      if (!upb_Map_Set(dst_map, key, val, arena)) return false;
+    }
+    return true;
+  }
+  if (upb_IsRepeatedOrMap(field)) {
+    const upb_Array* arr = upb_Message_GetArray(src, field);
+    if (!arr || arr->size == 0) return true;
+    upb_Array* dst_arr =
+        upb_Message_GetOrCreateMutableArray(dst, field, arena);
+    return dst_arr &&
+           upb_Array_Merge(dst_arr, arr, type,
+                           type == kUpb_CType_Message &&
+                                   field->UPB_PRIVATE(submsg_index) !=
+                                       kUpb_NoSub
+                               ? upb_MiniTable_GetSubMessageTable(mini_table,
+                                                                  field)
+                               : NULL,
+                           arena);
+  }
+  const void* val = _upb_MiniTableField_GetConstPtr(src, field);
+  if (field->presence != 0 ? !_upb_Message_HasNonExtensionField(src, field)
+                           : !_upb_MiniTable_ValueIsNonZero(val, field)) {
+    return true;
+  }
+  switch (type) {
+    case kUpb_CType_Message: {
+      // The slot holds some other member of the oneof if the field is unset.
+      upb_TaggedMessagePtr sub_msg =
+          _upb_Message_HasNonExtensionField(dst, field)
+              ? upb_Message_GetTaggedMessagePtr(dst, field, NULL)
+              : 0;
+      if (!upb_Message_MergeTagged(&sub_msg, *(upb_TaggedMessagePtr*)val,
+                                   upb_MiniTable_GetSubMessageTable(mini_table,
+                                                                    field),
+                                   arena)) {
+        return false;
+      }
+      _upb_Message_SetNonExtensionField(dst, field, &sub_msg);
+      return true;
+    }
+    case kUpb_CType_String:
+    case kUpb_CType_Bytes: {
+      upb_StringView str = *(const upb_StringView*)val;
+      if (str.size) {
+        char* data = upb_Arena_Malloc(arena, str.size);
+        if (!data) return false;
+        memcpy(data, str.data, str.size);
+        str.data = data;
+      }
+      return _upb_Message_SetField(dst, field, &str, arena);
+    }
+    default:
+      return _upb_Message_SetField(dst, field, val, arena);
+  }
+}
+
+bool upb_Message_Merge(upb_Message* dst, const upb_Message* src,
+                       const upb_MiniTable* mini_table, upb_Arena* arena) {
+  UPB_ASSERT(dst != src);
+  UPB_ASSERT(!_upb_Message_IsFrozen(dst));
+  for (size_t i = 0; i < mini_table->field_count; ++i) {
+    if (!upb_Message_MergeField(dst, src, mini_table, &mini_table->fields[i],
+                                arena)) {
+      return false;
+    }
+  }
+
+  size_t ext_count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(src, &ext_count);
+  for (size_t i = 0; i < ext_count; ++i) {
+    const upb_MiniTableExtension* e = ext[i].ext;
+    const upb_MiniTableField* field = &e->field;
+    upb_CType type = upb_MiniTableField_CType(field);
+    upb_Message_Extension* dst_ext =
+        (upb_Message_Extension*)_upb_Message_Getext(dst, e);
+    bool existed = dst_ext != NULL;
+    if (!dst_ext) dst_ext = _upb_Message_GetOrCreateExtension(dst, e, arena);
+    if (!dst_ext) return false;
+    if (upb_IsRepeatedOrMap(field)) {
+      if (!existed) {
+        dst_ext->data.ptr =
+            upb_Array_DeepClone(ext[i].data.ptr, type, e->sub.submsg, arena);
+        if (!dst_ext->data.ptr) return false;
+      } else if (!upb_Array_Merge(dst_ext->data.ptr, ext[i].data.ptr, type,
+                                  e->sub.submsg, arena)) {
+        return false;
+      }
+    } else if (type == kUpb_CType_Message) {
+      upb_TaggedMessagePtr sub_msg =
+          existed ? (upb_TaggedMessagePtr)dst_ext->data.ptr : 0;
+      if (!upb_Message_MergeTagged(&sub_msg,
+                                   (upb_TaggedMessagePtr)ext[i].data.ptr,
+                                   e->sub.submsg, arena)) {
+        return false;
+      }
+      dst_ext->data.ptr = (void*)sub_msg;
+    } else if (!upb_Clone_ExtensionValue(e, &ext[i], dst_ext, arena)) {
+      return false;
+    }
+  }
+
+  size_t unknown_size;
+  const char* unknown = upb_Message_GetUnknown(src, &unknown_size);
+  return unknown_size == 0 ||
+         _upb_Message_AddUnknown(dst, unknown, unknown_size, arena);
+}
+
+static upb_Message* _upb_Message_ShallowCopy(upb_Message* dst,
+                                             const upb_Message* src,
+                                             const upb_MiniTable* mini_table,
+                                             upb_Arena* arena) {
+  upb_StringView empty_string = upb_StringView_FromDataAndSize(NULL, 0);
+  // Sub-messages, arrays, maps and string data are shared by the memcpy.
+  memcpy(dst, src, mini_table->size);
+  for (size_t i = 0; i < mini_table->field_count; ++i) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    if (upb_IsRepeatedOrMap(field)) continue;
+    if (UPB_UNLIKELY(_upb_MiniTableField_IsOutOfLine(field))) {
+      // Not covered by the memcpy; string data is still shared.
+      const void* val = _upb_MiniTableField_GetConstPtr(src, field);
+      if (_upb_MiniTable_ValueIsNonZero(val, field)) {
+        void* mem = _upb_Message_MutableOutOfLine(dst, field, arena);
+        if (!mem) return NULL;
+        _upb_MiniTable_CopyFieldData(mem, val, field);
+      }
+      continue;
+    }
+    if (_upb_MiniTableField_HasInlineString(field)) {
+      // A short string lives in the source's own inline buffer.
+      const upb_StringView* src_view =
+          UPB_PTR_AT(src, field->offset, const upb_StringView);
+      upb_StringView* view = UPB_PTR_AT(dst, field->offset, upb_StringView);
+      upb_StringView str = upb_Message_GetString(src, field, empty_string);
+      if (str.data == (const char*)(src_view + 1)) {
+        view->data = (const char*)(view + 1);
+      }
+    }
+  }
+  // Share extension values.
+  size_t ext_count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(src, &ext_count);
+  for (size_t i = 0; i < ext_count; ++i) {
+    upb_Message_Extension* dst_ext =
+        _upb_Message_GetOrCreateExtension(dst, ext[i].ext, arena);
+    if (!dst_ext) return NULL;
+    dst_ext->data = ext[i].data;
+  }
+  // Share unknowns.
+  size_t unknown_size = 0;
+  const char* ptr = upb_Message_GetUnknown(src, &unknown_size);
+  if (unknown_size != 0 &&
+      !_upb_Message_AddUnknownAliased(dst, ptr, unknown_size, arena)) {
+    return NULL;
+  }
+  return dst;
+}
+
+upb_Message* upb_Message_ShallowClone(const upb_Message* message,
+                                      const upb_MiniTable* mini_table,
+                                      upb_Arena* arena) {
   upb_Message* clone = upb_Message_New(mini_table, arena);
-  return _upb_Message_Copy(clone, message, mini_table, arena);
+  if (!clone) return NULL;
+  return _upb_Message_ShallowCopy(clone, message, mini_table, arena);
+}
+
+static upb_Array* upb_Array_ShallowClone(const upb_Array* array,
+                                         const upb_MiniTable* sub,
+                                         upb_Arena* arena) {
+  size_t size = array->size;
+  if (UPB_UNLIKELY(_upb_Array_HasInlineMessages(array))) {
+    // Elements stored by value cannot be shared, so the copy holds pointers
+    // to shallow clones of them instead.
+    upb_Array* cloned_array =
+        _upb_Array_New(arena, size, _upb_Array_CTypeSizeLg2(kUpb_CType_Message));
+    if (!cloned_array ||
+        !_upb_Array_ResizeUninitialized(cloned_array, size, arena)) {
+      return NULL;
+    }
+    for (size_t i = 0; i < size; ++i) {
+      upb_MessageValue val = upb_Array_Get(array, i);
+      val.msg_val = upb_Message_ShallowClone(val.msg_val, sub, arena);
+      if (!val.msg_val) return NULL;
+      upb_Array_Set(cloned_array, i, val);
+    }
+    return cloned_array;
+  }
+  int lg2 = _upb_Array_ElementSizeLg2(array);
+  upb_Array* cloned_array = _upb_Array_New(arena, size, lg2);
+  if (!cloned_array ||
+      !_upb_Array_ResizeUninitialized(cloned_array, size, arena)) {
+    return NULL;
+  }
+  memcpy(_upb_array_ptr(cloned_array), _upb_array_constptr(array),
+         size << lg2);
+  return cloned_array;
+}
+
+static upb_Map* upb_Map_ShallowClone(const upb_Map* map, upb_CType key_type,
+                                     upb_Arena* arena) {
+  upb_Map* cloned_map = _upb_Map_NewSized(arena, map->key_size, map->val_size,
+                                          _upb_Map_Size(map));
+  if (cloned_map == NULL) {
+    return NULL;
+  }
+  if (upb_Map_IsOrdered(map) &&
+      !upb_Map_SetOrdered(cloned_map, key_type, arena)) {
+    return NULL;
+  }
+  upb_MessageValue key, val;
+  size_t iter = kUpb_Map_Begin;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    if (upb_Map_Insert(cloned_map, key, val, arena) ==
+        kUpb_MapInsertStatus_OutOfMemory) {
+      return NULL;
+    }
+  }
+  return cloned_map;
+}
+
+upb_Message* upb_Message_MutableMessageCopyOnWrite(
+    upb_Message* msg, const upb_MiniTable* mini_table,
+    const upb_MiniTableField* field, upb_Arena* arena) {
+  UPB_ASSERT(arena);
+  upb_Message* sub_message = upb_TaggedMessagePtr_GetNonEmptyMessage(
+      upb_Message_GetTaggedMessagePtr(msg, field, NULL));
+  if (sub_message && !_upb_Message_IsFrozen(sub_message) &&
+      upb_Arena_Contains(arena, sub_message)) {
+    return sub_message;
+  }
+  const upb_MiniTable* sub_mini_table =
+      upb_MiniTable_GetSubMessageTable(mini_table, field);
+  UPB_ASSERT(sub_mini_table);
+  sub_message = sub_message
+                    ? upb_Message_ShallowClone(sub_message, sub_mini_table,
+                                               arena)
+                    : upb_Message_New(sub_mini_table, arena);
+  if (!sub_message) return NULL;
+  upb_Message_SetMessage(msg, mini_table, field, sub_message);
+  return sub_message;
+}
+
+upb_Array* upb_Message_MutableArrayCopyOnWrite(upb_Message* msg,
+                                               const upb_MiniTable* mini_table,
+                                               const upb_MiniTableField* field,
+                                               upb_Arena* arena) {
+  UPB_ASSERT(arena);
+  upb_Array* array = upb_Message_GetMutableArray(msg, field);
+  if (!array) return upb_Message_GetOrCreateMutableArray(msg, field, arena);
+  if (!array->is_frozen && upb_Arena_Contains(arena, array)) return array;
+  const upb_MiniTable* sub =
+      upb_MiniTableField_CType(field) == kUpb_CType_Message &&
+              field->UPB_PRIVATE(submsg_index) != kUpb_NoSub
+          ? upb_MiniTable_GetSubMessageTable(mini_table, field)
+          : NULL;
+  array = upb_Array_ShallowClone(array, sub, arena);
+  if (!array) return NULL;
+  _upb_Message_SetNonExtensionField(msg, field, &array);
+  return array;
+}
+
+upb_Map* upb_Message_MutableMapCopyOnWrite(upb_Message* msg,
+                                           const upb_MiniTable* mini_table,
+                                           const upb_MiniTableField* field,
+                                           upb_Arena* arena) {
+  UPB_ASSERT(arena);
+  const upb_MiniTable* map_entry_table =
+      mini_table->subs[field->UPB_PRIVATE(submsg_index)].submsg;
+  UPB_ASSERT(map_entry_table);
+  upb_Map* map = upb_Message_GetMutableMap(msg, field);
+  if (!map) {
+    return upb_Message_GetOrCreateMutableMap(msg, map_entry_table, field,
+                                             arena);
+  }
+  if (!map->is_frozen && upb_Arena_Contains(arena, map)) return map;
+  map = upb_Map_ShallowClone(
+      map, upb_MiniTableField_CType(&map_entry_table->fields[0]), arena);
+  if (!map) return NULL;
+  _upb_Message_SetNonExtensionField(msg, field, &map);
+  return map;
+}
+
+upb_Message* upb_Array_MutableMessageCopyOnWrite(upb_Array* array, size_t i,
+                                                 const upb_MiniTable* sub,
+                                                 upb_Arena* arena) {
+  UPB_ASSERT(arena);
+  UPB_ASSERT(!array->is_frozen);
+  upb_MessageValue val = upb_Array_Get(array, i);
+  upb_Message* element = (upb_Message*)val.msg_val;
+  // Inline elements belong to the array itself.
+  if (_upb_Array_HasInlineMessages(array) ||
+      (!_upb_Message_IsFrozen(element) &&
+       upb_Arena_Contains(arena, element))) {
+    return element;
+  }
+  UPB_ASSERT(!upb_TaggedMessagePtr_IsEmpty((upb_TaggedMessagePtr)element));
+  val.msg_val = upb_Message_ShallowClone(element, sub, arena);
+  if (!val.msg_val) return NULL;
+  upb_Array_Set(array, i, val);
+  return (upb_Message*)val.msg_val;
 }
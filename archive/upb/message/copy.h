@@ -60,6 +60,77 @@ upb_Map* upb_Map_DeepClone(const upb_Map* map, upb_CType key_type,
 bool upb_Message_DeepCopy(upb_Message* dst, const upb_Message* src,
                           const upb_MiniTable* mini_table, upb_Arena* arena);
 
+// Relocates the message tree rooted at `message` into `arena`, which should be
+// a fresh arena, and returns the copy, or NULL on allocation failure.  This
+// reclaims the garbage that a long-lived, repeatedly mutated message leaves in
+// its arena (replaced strings and sub-messages, arrays abandoned when they
+// grew): once nothing else refers to `message_arena`, freeing it leaves only
+// the compacted copy.  Arrays get exactly their size as capacity, and the
+// strings of each message or array share one allocation.
+//
+// If `reclaimed` is non-NULL, it receives the number of bytes by which the
+// blocks of `message_arena` (and any arena fused with it) exceed those that
+// the copy added to `arena`, or 0 if they do not.
+upb_Message* upb_Message_Compact(const upb_Message* message,
+                                 const upb_MiniTable* mini_table,
+                                 upb_Arena* message_arena, upb_Arena* arena,
+                                 size_t* reclaimed);
+
+// Merges `src` into `dst` with the usual protobuf semantics, without a round
+// trip through the wire format: fields set in `src` overwrite singular scalar
+// fields, are appended to repeated fields, update map entries and are merged
+// recursively into sub-messages.  Extensions and unknown fields of `src` are
+// merged in the same way.  All data is deep copied into `arena`, which must be
+// the arena of `dst` or fused with it.  `src` must not be `dst`.  Returns false
+// on allocation failure, in which case `dst` may be partially merged.
+bool upb_Message_Merge(upb_Message* dst, const upb_Message* src,
+                       const upb_MiniTable* mini_table, upb_Arena* arena);
+
+// Shallow clones a message using the provided target arena.  Scalars and
+// strings are copied, but sub-messages, arrays, maps, extension values and
+// unknown fields are shared with `message` instead of being cloned, so the
+// cost is proportional to the size of the top-level message only.
+//
+// The shared objects must be treated as frozen: mutate them through the
+// *CopyOnWrite() functions below, which first replace a shared object with a
+// shallow copy in `arena`.  Sharing is detected by the arena an object was
+// allocated from, so `arena` must be neither the arena of `message` nor fused
+// with it, and `message` must outlive the clone.  Frozen objects (see
+// upb_Message_Freeze()) are always copied before mutation, so if `message` is
+// frozen the clone may use any arena, including that of `message`.
+upb_Message* upb_Message_ShallowClone(const upb_Message* message,
+                                      const upb_MiniTable* mini_table,
+                                      upb_Arena* arena);
+
+// Returns the sub-message in `field` of `msg` for mutation, creating it if
+// absent and shallow cloning it into `arena` if it is frozen or was not
+// allocated there.
+upb_Message* upb_Message_MutableMessageCopyOnWrite(
+    upb_Message* msg, const upb_MiniTable* mini_table,
+    const upb_MiniTableField* field, upb_Arena* arena);
+
+// Like upb_Message_MutableMessageCopyOnWrite(), for a repeated field.  The
+// elements of a copied array remain shared; see
+// upb_Array_MutableMessageCopyOnWrite().
+upb_Array* upb_Message_MutableArrayCopyOnWrite(upb_Message* msg,
+                                               const upb_MiniTable* mini_table,
+                                               const upb_MiniTableField* field,
+                                               upb_Arena* arena);
+
+// Like upb_Message_MutableMessageCopyOnWrite(), for a map field.  Message
+// values of a copied map remain shared.
+upb_Map* upb_Message_MutableMapCopyOnWrite(upb_Message* msg,
+                                           const upb_MiniTable* mini_table,
+                                           const upb_MiniTableField* field,
+                                           upb_Arena* arena);
+
+// Returns element `i` of a message array returned by
+// upb_Message_MutableArrayCopyOnWrite() for mutation, shallow cloning it into
+// `arena` if it is frozen or was not allocated there.
+upb_Message* upb_Array_MutableMessageCopyOnWrite(upb_Array* array, size_t i,
+                                                 const upb_MiniTable* sub,
+                                                 upb_Arena* arena);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -40,6 +40,7 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -48,6 +49,7 @@
 #include "upb/collections/map.h"
 #include "upb/mem/arena.h"
 #include "upb/message/accessors.h"
+#include "upb/message/compare.h"
 #include "upb/message/internal/message.h"
 #include "upb/message/message.h"
 #include "upb/mini_table/message.h"
@@ -59,6 +61,8 @@ namespace {
 const uint32_t kFieldOptionalInt32 = 1;
 const uint32_t kFieldOptionalString = 14;
 const uint32_t kFieldOptionalNestedMessage = 18;
+const uint32_t kFieldRepeatedNestedMessage = 48;
+const uint32_t kFieldMapStringString = 69;
 
 const char kTestStr1[] = "Hello1";
 const char kTestStr2[] = "HelloWorld2";
@@ -341,4 +345,440 @@ TEST(GeneratedCode, DeepCloneMessageWithUnknowns) {
   upb_Arena_Free(clone_arena);
 }
 
+TEST(GeneratedCode, CompactMessageReclaimsGarbage) {
+  upb_Arena* source_arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(source_arena);
+  const upb_MiniTableField* optional_int32_field =
+      find_proto2_field(kFieldOptionalInt32);
+  const upb_MiniTableField* optional_string_field =
+      find_proto2_field(kFieldOptionalString);
+  upb_Message_SetInt32(msg, optional_int32_field, kTestInt32, nullptr);
+  // Replace the string many times, leaving the old values behind as garbage.
+  std::string value;
+  for (int i = 0; i < 1000; ++i) {
+    value = std::string(100, 'a' + i % 26);
+    char* buf = (char*)upb_Arena_Malloc(source_arena, value.size());
+    memcpy(buf, value.data(), value.size());
+    upb_Message_SetString(
+        msg, optional_string_field,
+        upb_StringView_FromDataAndSize(buf, value.size()), source_arena);
+  }
+  upb_Arena* arena = upb_Arena_New();
+  size_t reclaimed = 0;
+  protobuf_test_messages_proto2_TestAllTypesProto2* compacted =
+      (protobuf_test_messages_proto2_TestAllTypesProto2*)upb_Message_Compact(
+          msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+          source_arena, arena, &reclaimed);
+  ASSERT_NE(compacted, nullptr);
+  EXPECT_GT(reclaimed, 1000 * 90);
+  EXPECT_LT(upb_Arena_SpaceAllocated(arena), 4096);
+  upb_Arena_Free(source_arena);
+  EXPECT_EQ(upb_Message_GetInt32(compacted, optional_int32_field, 0),
+            kTestInt32);
+  EXPECT_TRUE(upb_StringView_IsEqual(
+      upb_Message_GetString(compacted, optional_string_field,
+                            upb_StringView_FromDataAndSize(nullptr, 0)),
+      upb_StringView_FromDataAndSize(value.data(), value.size())));
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, ShallowCloneMessageSharesSubMessage) {
+  upb_Arena* source_arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(source_arena);
+  const upb_MiniTableField* nested_message_field =
+      find_proto2_field(kFieldOptionalNestedMessage);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(
+      msg, kTestInt32);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_string(
+      msg, upb_StringView_FromString(kTestStr1));
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          msg, source_arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+      nested, kTestNestedInt32);
+
+  upb_Arena* arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* clone =
+      (protobuf_test_messages_proto2_TestAllTypesProto2*)
+          upb_Message_ShallowClone(
+              msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+              arena);
+  EXPECT_EQ(kTestInt32,
+            protobuf_test_messages_proto2_TestAllTypesProto2_optional_int32(
+                clone));
+  EXPECT_TRUE(upb_StringView_IsEqual(
+      protobuf_test_messages_proto2_TestAllTypesProto2_optional_string(clone),
+      upb_StringView_FromString(kTestStr1)));
+  // The sub-message is shared until it is mutated.
+  EXPECT_EQ(upb_Message_GetMessage(clone, nested_message_field, nullptr),
+            (const upb_Message*)nested);
+
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(clone,
+                                                                      0);
+  upb_Message* cloned_nested = upb_Message_MutableMessageCopyOnWrite(
+      clone, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+      nested_message_field, arena);
+  ASSERT_NE(cloned_nested, nullptr);
+  EXPECT_NE(cloned_nested, (upb_Message*)nested);
+  // A second call returns the copy that is already owned by the clone.
+  EXPECT_EQ(cloned_nested,
+            upb_Message_MutableMessageCopyOnWrite(
+                clone,
+                &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+                nested_message_field, arena));
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+      (protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage*)
+          cloned_nested,
+      0);
+
+  // The template is unchanged.
+  EXPECT_EQ(kTestInt32,
+            protobuf_test_messages_proto2_TestAllTypesProto2_optional_int32(
+                msg));
+  EXPECT_EQ(kTestNestedInt32,
+            protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_a(
+                nested));
+  upb_Arena_Free(arena);
+  upb_Arena_Free(source_arena);
+}
+
+TEST(GeneratedCode, ShallowCloneMessageArrayCopyOnWrite) {
+  upb_Arena* source_arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(source_arena);
+  const upb_MiniTableField* repeated_nested_field =
+      find_proto2_field(kFieldRepeatedNestedMessage);
+  const upb_MiniTable* nested_mini_table =
+      &protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_msg_init;
+  for (int32_t i = 0; i < 3; ++i) {
+    protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* nested =
+        protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+            msg, source_arena);
+    ASSERT_NE(nested, nullptr);
+    protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+        nested, i);
+  }
+
+  upb_Arena* arena = upb_Arena_New();
+  upb_Message* clone = upb_Message_ShallowClone(
+      msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init, arena);
+  EXPECT_EQ(upb_Message_GetArray(clone, repeated_nested_field),
+            upb_Message_GetArray(msg, repeated_nested_field));
+
+  upb_Array* array = upb_Message_MutableArrayCopyOnWrite(
+      clone, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+      repeated_nested_field, arena);
+  ASSERT_NE(array, nullptr);
+  EXPECT_NE(array, upb_Message_GetArray(msg, repeated_nested_field));
+  ASSERT_EQ(upb_Array_Size(array), 3);
+  upb_Message* element =
+      upb_Array_MutableMessageCopyOnWrite(array, 1, nested_mini_table, arena);
+  ASSERT_NE(element, nullptr);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+      (protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage*)element,
+      kTestNestedInt32);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* appended =
+      protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+          (protobuf_test_messages_proto2_TestAllTypesProto2*)clone, arena);
+  ASSERT_NE(appended, nullptr);
+
+  size_t size;
+  const protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* const*
+      cloned_elements =
+          protobuf_test_messages_proto2_TestAllTypesProto2_repeated_nested_message(
+              (protobuf_test_messages_proto2_TestAllTypesProto2*)clone, &size);
+  EXPECT_EQ(size, 4);
+  EXPECT_EQ(kTestNestedInt32,
+            protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_a(
+                cloned_elements[1]));
+  const protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* const*
+      elements =
+          protobuf_test_messages_proto2_TestAllTypesProto2_repeated_nested_message(
+              msg, &size);
+  EXPECT_EQ(size, 3);
+  EXPECT_EQ(1, protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_a(
+                   elements[1]));
+  // Untouched elements stay shared.
+  EXPECT_EQ(cloned_elements[0], elements[0]);
+  upb_Arena_Free(arena);
+  upb_Arena_Free(source_arena);
+}
+
+TEST(GeneratedCode, ShallowCloneMessageMapCopyOnWrite) {
+  upb_Arena* source_arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(source_arena);
+  ASSERT_TRUE(
+      protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+          msg, upb_StringView_FromString("key1"),
+          upb_StringView_FromString("value1"), source_arena));
+  const upb_MiniTableField* map_field =
+      find_proto2_field(kFieldMapStringString);
+
+  upb_Arena* arena = upb_Arena_New();
+  upb_Message* clone = upb_Message_ShallowClone(
+      msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init, arena);
+  EXPECT_EQ(upb_Message_GetMap(clone, map_field),
+            upb_Message_GetMap(msg, map_field));
+  upb_Map* map = upb_Message_MutableMapCopyOnWrite(
+      clone, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+      map_field, arena);
+  ASSERT_NE(map, nullptr);
+  EXPECT_NE(map, upb_Message_GetMap(msg, map_field));
+  ASSERT_TRUE(
+      protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+          (protobuf_test_messages_proto2_TestAllTypesProto2*)clone,
+          upb_StringView_FromString("key2"),
+          upb_StringView_FromString("value2"), arena));
+
+  EXPECT_EQ(
+      protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_size(
+          (protobuf_test_messages_proto2_TestAllTypesProto2*)clone),
+      2);
+  EXPECT_EQ(
+      protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_size(
+          msg),
+      1);
+  upb_StringView value;
+  EXPECT_TRUE(
+      protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_get(
+          (protobuf_test_messages_proto2_TestAllTypesProto2*)clone,
+          upb_StringView_FromString("key1"), &value));
+  EXPECT_TRUE(
+      upb_StringView_IsEqual(value, upb_StringView_FromString("value1")));
+  upb_Arena_Free(arena);
+  upb_Arena_Free(source_arena);
+}
+
+
+TEST(GeneratedCode, FreezeMessageCopyOnWrite) {
+  upb_Arena* arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  const upb_MiniTableField* nested_message_field =
+      find_proto2_field(kFieldOptionalNestedMessage);
+  const upb_MiniTableField* repeated_nested_field =
+      find_proto2_field(kFieldRepeatedNestedMessage);
+  const upb_MiniTableField* map_field =
+      find_proto2_field(kFieldMapStringString);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(
+      msg, kTestInt32);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          msg, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+      nested, kTestNestedInt32);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* element =
+      protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+          msg, arena);
+  ASSERT_NE(element, nullptr);
+  ASSERT_TRUE(
+      protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+          msg, upb_StringView_FromString("key1"),
+          upb_StringView_FromString("value1"), arena));
+
+  upb_Message_Freeze(
+      msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init);
+  EXPECT_TRUE(upb_Message_IsFrozen(msg));
+  EXPECT_TRUE(upb_Message_IsFrozen(nested));
+  EXPECT_TRUE(upb_Message_IsFrozen(element));
+  EXPECT_TRUE(
+      upb_Array_IsFrozen(upb_Message_GetArray(msg, repeated_nested_field)));
+  EXPECT_TRUE(upb_Map_IsFrozen(upb_Message_GetMap(msg, map_field)));
+  // Reads are unaffected.
+  EXPECT_EQ(kTestInt32,
+            protobuf_test_messages_proto2_TestAllTypesProto2_optional_int32(
+                msg));
+
+  // A frozen template may be cloned into its own arena: the frozen
+  // sub-objects are still copied before they are mutated.
+  upb_Message* clone = upb_Message_ShallowClone(
+      msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init, arena);
+  ASSERT_NE(clone, nullptr);
+  EXPECT_FALSE(upb_Message_IsFrozen(clone));
+  upb_Message* cloned_nested = upb_Message_MutableMessageCopyOnWrite(
+      clone, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+      nested_message_field, arena);
+  ASSERT_NE(cloned_nested, nullptr);
+  EXPECT_NE(cloned_nested, (upb_Message*)nested);
+  EXPECT_FALSE(upb_Message_IsFrozen(cloned_nested));
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+      (protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage*)
+          cloned_nested,
+      0);
+  upb_Array* array = upb_Message_MutableArrayCopyOnWrite(
+      clone, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+      repeated_nested_field, arena);
+  ASSERT_NE(array, nullptr);
+  EXPECT_FALSE(upb_Array_IsFrozen(array));
+  upb_Message* cloned_element = upb_Array_MutableMessageCopyOnWrite(
+      array, 0,
+      &protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_msg_init,
+      arena);
+  ASSERT_NE(cloned_element, nullptr);
+  EXPECT_NE(cloned_element, (upb_Message*)element);
+  upb_Map* map = upb_Message_MutableMapCopyOnWrite(
+      clone, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+      map_field, arena);
+  ASSERT_NE(map, nullptr);
+  EXPECT_FALSE(upb_Map_IsFrozen(map));
+  EXPECT_NE(map, upb_Message_GetMap(msg, map_field));
+
+  EXPECT_EQ(kTestNestedInt32,
+            protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_a(
+                nested));
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, FrozenMessageConcurrentEncode) {
+  upb_Arena* arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  for (int i = 0; i < 100; ++i) {
+    std::string key = std::to_string(i);
+    ASSERT_TRUE(
+        protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+            msg, upb_StringView_FromDataAndSize(key.data(), key.size()),
+            upb_StringView_FromString(kTestStr1), arena));
+  }
+  upb_Message_Freeze(
+      msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init);
+
+  std::vector<std::string> encoded(4);
+  std::vector<std::thread> threads;
+  for (std::string& out : encoded) {
+    threads.emplace_back([msg, &out] {
+      upb_Arena* thread_arena = upb_Arena_New();
+      size_t size;
+      char* data;
+      if (upb_Encode(msg,
+                     &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+                     kUpb_EncodeOption_Deterministic, thread_arena, &data,
+                     &size) == kUpb_EncodeStatus_Ok) {
+        out.assign(data, size);
+      }
+      upb_Arena_Free(thread_arena);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  EXPECT_FALSE(encoded[0].empty());
+  for (const std::string& out : encoded) EXPECT_EQ(out, encoded[0]);
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, MergeMessageMatchesWireMerge) {
+  upb_Arena* arena = upb_Arena_New();
+  upb_Arena* src_arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2* dst =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(dst, 1);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_string(
+      dst, upb_StringView_FromString(kTestStr1));
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          dst, arena),
+      kTestNestedInt32);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_int32(dst, 1,
+                                                                      arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+      dst, upb_StringView_FromString("k"), upb_StringView_FromString("dst"),
+      arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+      dst, upb_StringView_FromString("x"), upb_StringView_FromString("dst"),
+      arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_oneof_uint32(dst, 5);
+
+  protobuf_test_messages_proto2_TestAllTypesProto2* src =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(src_arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_string(
+      src, upb_StringView_FromString(kTestStr2));
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          src, src_arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(
+      protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_mutable_corecursive(
+          nested, src_arena),
+      kTestInt32);
+  protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_int32(
+      src, 2, src_arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+      protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+          src, src_arena),
+      kTestNestedInt32);
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+      src, upb_StringView_FromString("k"), upb_StringView_FromString("src"),
+      src_arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_oneof_string(
+      src, upb_StringView_FromString(kTestStr1));
+  const char unknown[] = {'\xf8', '\x3e', '\x01'};  // Field 999, varint 1.
+  ASSERT_TRUE(
+      _upb_Message_AddUnknown(src, unknown, sizeof(unknown), src_arena));
+
+  // Parsing two messages back to back merges them.
+  size_t dst_size, src_size;
+  char* dst_data = protobuf_test_messages_proto2_TestAllTypesProto2_serialize(
+      dst, arena, &dst_size);
+  char* src_data = protobuf_test_messages_proto2_TestAllTypesProto2_serialize(
+      src, arena, &src_size);
+  ASSERT_NE(dst_data, nullptr);
+  ASSERT_NE(src_data, nullptr);
+  std::string wire = std::string(dst_data, dst_size) +
+                     std::string(src_data, src_size);
+  protobuf_test_messages_proto2_TestAllTypesProto2* expected =
+      protobuf_test_messages_proto2_TestAllTypesProto2_parse(
+          wire.data(), wire.size(), arena);
+  ASSERT_NE(expected, nullptr);
+
+  ASSERT_TRUE(upb_Message_Merge(
+      dst, src, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+      arena));
+  upb_Arena_Free(src_arena);
+  EXPECT_TRUE(upb_Message_IsEqual(
+      dst, expected,
+      &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init));
+  upb_Arena_Free(arena);
+}
+
+TEST(GeneratedCode, MergeMessageExtensions) {
+  upb_Arena* arena = upb_Arena_New();
+  protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrect* dst =
+      protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrect_new(
+          arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrect* src =
+      protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrect_new(
+          arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1*
+      ext = protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_new(
+          arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_set_str(
+      ext, upb_StringView_FromString(kTestStr1));
+  protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_set_message_set_extension(
+      src, ext, arena);
+  const upb_MiniTable* mini_table =
+      &protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrect_msg_init;
+
+  // The first merge copies the extension, the second merges into the copy.
+  ASSERT_TRUE(upb_Message_Merge(dst, src, mini_table, arena));
+  const protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1*
+      merged =
+          protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_message_set_extension(
+              dst);
+  ASSERT_NE(merged, nullptr);
+  EXPECT_NE(merged, ext);
+  protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_set_str(
+      ext, upb_StringView_FromString(kTestStr2));
+  ASSERT_TRUE(upb_Message_Merge(dst, src, mini_table, arena));
+  EXPECT_EQ(
+      protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_message_set_extension(
+          dst),
+      merged);
+  EXPECT_TRUE(upb_StringView_IsEqual(
+      protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_str(
+          merged),
+      upb_StringView_FromString(kTestStr2)));
+  upb_Arena_Free(arena);
+}
+
 }  // namespace
@@ -0,0 +1,311 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/image.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "upb/collections/internal/array.h"
+#include "upb/collections/map.h"
+#include "upb/mem/alloc.h"
+#include "upb/message/accessors.h"
+#include "upb/message/copy.h"
+#include "upb/message/internal/message.h"
+#include "upb/message/space_used.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/internal/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// An image is this header (a multiple of 8 bytes, so the body stays
+// aligned), then the body (the used part of an arena block
+// holding a frozen clone of the message tree), then one uint32_t per pointer
+// in the body giving its index as a pointer-sized word.  The pointers hold
+// their offset from the start of the body, plus `base`.
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t pointer_size;
+  uint64_t base;  // The address of the body it was relocated for, or 0.
+  uint64_t body_size;
+  uint64_t root;  // Offset of the root message in the body.
+  uint32_t root_size;
+  uint32_t root_field_count;
+  uint64_t pointer_count;
+} upb_MessageImage_Header;
+
+#define kUpb_MessageImage_Magic 0x49425055  // "UPBI" in little endian.
+#define kUpb_MessageImage_Version 1
+
+// Blocks are aligned to this, so that both clones see the same alignments.
+#define kUpb_MessageImage_BlockAlign 64
+
+static bool _upb_Message_HasExtensions(const upb_Message* msg,
+                                       const upb_MiniTable* mini_table);
+
+// A sub-message may be in the unlinked, "empty" state.
+static bool _upb_Message_TaggedHasExtensions(upb_TaggedMessagePtr tagged,
+                                             const upb_MiniTable* mini_table) {
+  const upb_Message* msg = _upb_TaggedMessagePtr_GetMessage(tagged);
+  if (!msg) return false;
+  if (upb_TaggedMessagePtr_IsEmpty(tagged) || !mini_table) {
+    mini_table = &_kUpb_MiniTable_Empty;
+  }
+  return _upb_Message_HasExtensions(msg, mini_table);
+}
+
+static bool _upb_Message_HasExtensions(const upb_Message* msg,
+                                       const upb_MiniTable* mini_table) {
+  if (upb_Message_ExtensionCount(msg)) return true;
+  for (size_t i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    if (upb_MiniTableField_CType(field) != kUpb_CType_Message) continue;
+    const upb_MiniTable* sub =
+        field->UPB_PRIVATE(submsg_index) != kUpb_NoSub
+            ? upb_MiniTable_GetSubMessageTable(mini_table, field)
+            : NULL;
+    switch (upb_FieldMode_Get(field)) {
+      case kUpb_FieldMode_Map: {
+        const upb_Map* map = upb_Message_GetMap(msg, field);
+        if (!map) break;
+        const upb_MiniTableField* val_field = &sub->fields[1];
+        if (upb_MiniTableField_CType(val_field) != kUpb_CType_Message) break;
+        const upb_MiniTable* val_sub =
+            upb_MiniTable_GetSubMessageTable(sub, val_field);
+        size_t iter = kUpb_Map_Begin;
+        upb_MessageValue key, val;
+        while (upb_Map_Next(map, &key, &val, &iter)) {
+          if (_upb_Message_HasExtensions(val.msg_val, val_sub)) return true;
+        }
+        break;
+      }
+      case kUpb_FieldMode_Array: {
+        const upb_Array* arr = upb_Message_GetArray(msg, field);
+        if (!arr) break;
+        for (size_t j = 0; j < arr->size; j++) {
+          if (_upb_Array_HasInlineMessages(arr)) {
+            if (_upb_Message_HasExtensions(
+                    _upb_Array_InlineMessage(arr, j),
+                    sub ? sub : &_kUpb_MiniTable_Empty)) {
+              return true;
+            }
+          } else {
+            const upb_TaggedMessagePtr* elems = _upb_array_constptr(arr);
+            if (_upb_Message_TaggedHasExtensions(elems[j], sub)) return true;
+          }
+        }
+        break;
+      }
+      case kUpb_FieldMode_Scalar:
+        if (_upb_Message_TaggedHasExtensions(
+                upb_Message_GetTaggedMessagePtr(msg, field, NULL), sub)) {
+          return true;
+        }
+        break;
+    }
+  }
+  return false;
+}
+
+// Deep clones and freezes `msg` into a fixed block of `n` bytes at `mem`,
+// returning the clone (or NULL if it does not fit) and the bytes used.
+static const upb_Message* _upb_Message_CloneIntoBlock(
+    const upb_Message* msg, const upb_MiniTable* mini_table, char* mem,
+    size_t n, size_t* used) {
+  // Padding must compare equal between the two clones.
+  memset(mem, 0, n);
+  upb_Arena* arena = upb_Arena_Init(mem, n, NULL);
+  if (!arena) return NULL;
+  upb_Message* clone = upb_Message_DeepClone(msg, mini_table, arena);
+  if (clone) {
+    upb_Message_Freeze(clone, mini_table);
+    // The arena lives at the end of its initial block and allocates upwards.
+    *used = (size_t)((char*)arena - _upb_ArenaHas(arena) - mem);
+    UPB_UNPOISON_MEMORY_REGION(mem, *used);
+  }
+  upb_Arena_Free(arena);
+  return clone;
+}
+
+// Clones the tree into two blocks at different addresses: the words that
+// differ between them by the distance between the blocks are the pointers.
+// Everything else is copied from the same source, so it must be equal.
+static bool _upb_Message_WriteImageWithBlockSize(
+    const upb_Message* msg, const upb_MiniTable* mini_table, size_t n,
+    upb_Arena* arena, char** image, size_t* size, bool* retry) {
+  *retry = false;
+  char* buf[2];
+  char* mem[2];
+  const upb_Message* clone[2];
+  size_t used[2];
+  bool ok = false;
+  buf[0] = upb_gmalloc(n + kUpb_MessageImage_BlockAlign);
+  buf[1] = upb_gmalloc(n + kUpb_MessageImage_BlockAlign);
+  if (!buf[0] || !buf[1]) goto done;
+  for (int i = 0; i < 2; i++) {
+    mem[i] = (char*)UPB_ALIGN_UP((uintptr_t)buf[i],
+                                 kUpb_MessageImage_BlockAlign);
+    clone[i] = _upb_Message_CloneIntoBlock(msg, mini_table, mem[i], n,
+                                           &used[i]);
+    if (!clone[i]) {
+      *retry = true;
+      goto done;
+    }
+  }
+  if (used[0] != used[1] || used[0] % sizeof(uintptr_t) != 0 ||
+      used[0] / sizeof(uintptr_t) > UINT32_MAX ||
+      (const char*)clone[0] - mem[0] != (const char*)clone[1] - mem[1]) {
+    goto done;
+  }
+
+  const uintptr_t* words[2] = {(const uintptr_t*)mem[0],
+                               (const uintptr_t*)mem[1]};
+  const uintptr_t delta = (uintptr_t)mem[1] - (uintptr_t)mem[0];
+  size_t word_count = used[0] / sizeof(uintptr_t);
+  size_t pointer_count = 0;
+  for (size_t i = 0; i < word_count; i++) {
+    if (words[0][i] == words[1][i]) continue;
+    if (words[1][i] - words[0][i] != delta) goto done;
+    pointer_count++;
+  }
+
+  size_t image_size = sizeof(upb_MessageImage_Header) + used[0] +
+                      pointer_count * sizeof(uint32_t);
+  char* out = upb_Arena_Malloc(arena, image_size);
+  if (!out) goto done;
+  upb_MessageImage_Header* h = (upb_MessageImage_Header*)out;
+  h->magic = kUpb_MessageImage_Magic;
+  h->version = kUpb_MessageImage_Version;
+  h->pointer_size = sizeof(void*);
+  h->base = 0;
+  h->body_size = used[0];
+  h->root = (uint64_t)((const char*)clone[0] - mem[0]);
+  h->root_size = mini_table->size;
+  h->root_field_count = mini_table->field_count;
+  h->pointer_count = pointer_count;
+
+  uintptr_t* body = (uintptr_t*)(out + sizeof(*h));
+  char* pointers = (char*)body + used[0];
+  for (size_t i = 0; i < word_count; i++) {
+    body[i] = words[0][i];
+    if (words[0][i] == words[1][i]) continue;
+    body[i] -= (uintptr_t)mem[0];
+    uint32_t index = (uint32_t)i;
+    memcpy(pointers, &index, sizeof(index));
+    pointers += sizeof(index);
+  }
+  *image = out;
+  *size = image_size;
+  ok = true;
+
+done:
+  upb_gfree(buf[0]);
+  upb_gfree(buf[1]);
+  return ok;
+}
+
+bool upb_Message_WriteImage(const upb_Message* msg,
+                            const upb_MiniTable* mini_table, upb_Arena* arena,
+                            char** image, size_t* size) {
+  if (_upb_Message_HasExtensions(msg, mini_table)) return false;
+  // The clone needs room for the arena itself and for allocation padding,
+  // which upb_Message_SpaceUsed() does not count.
+  size_t n = upb_Message_SpaceUsed(msg, mini_table, NULL);
+  n += n / 4 + 1024;
+  while (true) {
+    bool retry;
+    if (_upb_Message_WriteImageWithBlockSize(msg, mini_table, n, arena, image,
+                                             size, &retry)) {
+      return true;
+    }
+    if (!retry || n > SIZE_MAX / 2 - kUpb_MessageImage_BlockAlign) {
+      return false;
+    }
+    n *= 2;
+  }
+}
+
+const upb_Message* upb_MessageImage_Relocate(
+    void* image, size_t size, const void* base,
+    const upb_MiniTable* mini_table) {
+  if (size < sizeof(upb_MessageImage_Header) || (uintptr_t)image % 8 != 0 ||
+      (uintptr_t)base % 8 != 0) {
+    return NULL;
+  }
+  upb_MessageImage_Header* h = image;
+  if (h->magic != kUpb_MessageImage_Magic ||
+      h->version != kUpb_MessageImage_Version ||
+      h->pointer_size != sizeof(void*) ||
+      h->root_size != mini_table->size ||
+      h->root_field_count != mini_table->field_count) {
+    return NULL;
+  }
+  size_t avail = size - sizeof(*h);
+  if (h->body_size > avail || h->body_size % sizeof(uintptr_t) != 0 ||
+      h->pointer_count > (avail - h->body_size) / sizeof(uint32_t) ||
+      h->root < sizeof(upb_Message_Internal) || h->root > h->body_size ||
+      h->body_size - h->root < mini_table->size) {
+    return NULL;
+  }
+
+  uintptr_t* body = (uintptr_t*)((char*)image + sizeof(*h));
+  const char* pointers = (const char*)body + h->body_size;
+  const size_t word_count = h->body_size / sizeof(uintptr_t);
+  const uintptr_t old_base = (uintptr_t)h->base;
+  const uintptr_t new_base = (uintptr_t)base + sizeof(*h);
+
+  // Check everything before changing anything.  A pointer may point just
+  // past the body, as an empty allocation at the end of the arena does.
+  for (size_t i = 0; i < h->pointer_count; i++) {
+    uint32_t index;
+    memcpy(&index, pointers + i * sizeof(index), sizeof(index));
+    if (index >= word_count || body[index] - old_base > h->body_size) {
+      return NULL;
+    }
+  }
+  for (size_t i = 0; i < h->pointer_count; i++) {
+    uint32_t index;
+    memcpy(&index, pointers + i * sizeof(index), sizeof(index));
+    body[index] = body[index] - old_base + new_base;
+  }
+  h->base = new_base;
+  return (const upb_Message*)(new_base + h->root);
+}
+
+const upb_Message* upb_MessageImage_Load(const void* image, size_t size,
+                                         const upb_MiniTable* mini_table,
+                                         upb_Arena* arena) {
+  void* copy = upb_Arena_Malloc(arena, size);
+  if (!copy) return NULL;
+  memcpy(copy, image, size);
+  return upb_MessageImage_Relocate(copy, size, copy, mini_table);
+}
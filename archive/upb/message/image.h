@@ -0,0 +1,96 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Message images: a message tree written into one position-independent
+// buffer, for passing decoded messages through shared memory or keeping them
+// in on-disk caches without a round trip through the wire format.
+//
+// The image holds the message tree in its in-memory layout, with every
+// pointer stored as an offset, followed by a table of where the pointers are.
+// Relocating it rewrites those pointers for the address the image will be
+// read at, in time proportional to the number of pointers and without
+// parsing.  The relocated messages are frozen (see upb_Message_Freeze()) and
+// are read with the normal accessors.
+//
+// An image can only be read by a program that uses the same upb_MiniTable
+// layout (the same generated code, or mini tables built the same way) on a
+// machine with the same pointer size and byte order.  Relocation checks that
+// every pointer stays within the image, but not the rest of the contents, so
+// images must come from a trusted writer.
+
+#ifndef UPB_MESSAGE_IMAGE_H_
+#define UPB_MESSAGE_IMAGE_H_
+
+#include <stddef.h>
+
+#include "upb/mem/arena.h"
+#include "upb/message/message.h"
+#include "upb/mini_table/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Writes the message tree rooted at `msg` into an image allocated from
+// `arena`, stored in `*image` and `*size`.  Returns false on allocation
+// failure, or if the tree contains extensions, whose upb_MiniTableExtension
+// pointers are only meaningful in the writing process.
+UPB_API bool upb_Message_WriteImage(const upb_Message* msg,
+                                    const upb_MiniTable* mini_table,
+                                    upb_Arena* arena, char** image,
+                                    size_t* size);
+
+// Rewrites the pointers of `image` so that it can be read at address `base`,
+// and returns the root message as seen at `base`, or NULL if `image` is not a
+// valid image of a `mini_table` message.  `base` may be `image` itself, or
+// the address at which another process maps a copy of it read-only.  Both
+// must be aligned to 8 bytes.  An image may be relocated any number of times;
+// on failure it is left untouched.
+UPB_API const upb_Message* upb_MessageImage_Relocate(
+    void* image, size_t size, const void* base,
+    const upb_MiniTable* mini_table);
+
+// Copies `image`, which may be read-only, into `arena` and relocates the copy
+// there.  Returns its root message, or NULL if the image is invalid or
+// allocation fails.
+UPB_API const upb_Message* upb_MessageImage_Load(
+    const void* image, size_t size, const upb_MiniTable* mini_table,
+    upb_Arena* arena);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_MESSAGE_IMAGE_H_ */
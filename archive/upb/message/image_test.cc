@@ -0,0 +1,197 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/image.h"
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/base/string_view.h"
+#include "upb/mem/arena.h"
+#include "upb/message/message.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+
+namespace {
+
+using TestAllTypes = protobuf_test_messages_proto2_TestAllTypesProto2;
+using NestedMessage =
+    protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage;
+
+const upb_MiniTable* kMiniTable =
+    &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init;
+
+upb_StringView View(const std::string& str) {
+  return upb_StringView_FromDataAndSize(str.data(), str.size());
+}
+
+std::string Serialize(const upb_Message* msg, upb_Arena* arena) {
+  char* data;
+  size_t size;
+  EXPECT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, kMiniTable, kUpb_EncodeOption_Deterministic, arena,
+                       &data, &size));
+  return std::string(data, size);
+}
+
+TestAllTypes* MakeMessage(upb_Arena* arena) {
+  static const std::string kLong(300, 'x');
+  TestAllTypes* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(msg, 7);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_string(
+      msg, View(kLong));
+  NestedMessage* nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          msg, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(nested,
+                                                                       1);
+  for (int i = 0; i < 20; i++) {
+    protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_int32(
+        msg, i, arena);
+    NestedMessage* elem =
+        protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+            msg, arena);
+    protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(elem,
+                                                                         i);
+    std::string key = "key" + std::to_string(i);
+    protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+        msg, View(key), View(kLong), arena);
+    protobuf_test_messages_proto2_TestAllTypesProto2_map_string_nested_message_set(
+        msg, View(key), elem, arena);
+  }
+  // Unknown field 1000: "unknown".
+  const std::string unknown = "\xc2\x3e\x07unknown";
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(unknown.data(), unknown.size(), msg, kMiniTable,
+                       nullptr, 0, arena));
+  return msg;
+}
+
+TEST(MessageImageTest, LoadRoundTrips) {
+  upb_Arena* arena = upb_Arena_New();
+  std::string expected = Serialize(MakeMessage(arena), arena);
+  char* image;
+  size_t size;
+  ASSERT_TRUE(upb_Message_WriteImage(MakeMessage(arena), kMiniTable, arena,
+                                     &image, &size));
+  // The image does not refer to the memory of the original message.
+  std::vector<char> saved(image, image + size);
+  upb_Arena_Free(arena);
+
+  upb_Arena* load_arena = upb_Arena_New();
+  const upb_Message* loaded = upb_MessageImage_Load(saved.data(), saved.size(),
+                                                    kMiniTable, load_arena);
+  ASSERT_NE(nullptr, loaded);
+  EXPECT_TRUE(upb_Message_IsFrozen(loaded));
+  EXPECT_EQ(expected, Serialize(loaded, load_arena));
+  upb_StringView val;
+  EXPECT_TRUE(protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_get(
+      static_cast<const TestAllTypes*>(loaded), View("key7"), &val));
+  EXPECT_EQ(300, val.size);
+  upb_Arena_Free(load_arena);
+}
+
+TEST(MessageImageTest, RelocateForAnotherAddress) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg = MakeMessage(arena);
+  std::string expected = Serialize(msg, arena);
+  char* image;
+  size_t size;
+  ASSERT_TRUE(upb_Message_WriteImage(msg, kMiniTable, arena, &image, &size));
+
+  // Relocate in a staging buffer for the address of a read-only copy.
+  std::vector<uint64_t> staging(size / 8 + 1);
+  std::vector<uint64_t> view(size / 8 + 1);
+  memcpy(staging.data(), image, size);
+  const upb_Message* root = upb_MessageImage_Relocate(
+      staging.data(), size, view.data(), kMiniTable);
+  ASSERT_NE(nullptr, root);
+  EXPECT_GE(static_cast<const void*>(root), view.data());
+  memcpy(view.data(), staging.data(), size);
+  EXPECT_EQ(expected, Serialize(root, arena));
+
+  // A relocated image can be relocated again.
+  root = upb_MessageImage_Relocate(view.data(), size, view.data(), kMiniTable);
+  ASSERT_NE(nullptr, root);
+  EXPECT_EQ(expected, Serialize(root, arena));
+  upb_Arena_Free(arena);
+}
+
+TEST(MessageImageTest, RejectsInvalidImages) {
+  upb_Arena* arena = upb_Arena_New();
+  char* image;
+  size_t size;
+  ASSERT_TRUE(upb_Message_WriteImage(MakeMessage(arena), kMiniTable, arena,
+                                     &image, &size));
+  std::string saved(image, size);
+
+  EXPECT_EQ(nullptr,
+            upb_MessageImage_Relocate(image, size - 1, image, kMiniTable));
+  EXPECT_EQ(nullptr, upb_MessageImage_Relocate(
+                         image, size, image,
+                         &protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_msg_init));
+  // Point the last pointer outside of the image.  The body follows the
+  // 48-byte header.
+  uint32_t index;
+  memcpy(&index, image + size - sizeof(index), sizeof(index));
+  uintptr_t* word = reinterpret_cast<uintptr_t*>(image + 48) + index;
+  uintptr_t old_word = *word;
+  *word = size * 2;
+  EXPECT_EQ(nullptr, upb_MessageImage_Relocate(image, size, image, kMiniTable));
+  *word = old_word;
+  EXPECT_EQ(saved, std::string(image, size));
+  EXPECT_NE(nullptr, upb_MessageImage_Relocate(image, size, image, kMiniTable));
+  upb_Arena_Free(arena);
+}
+
+TEST(MessageImageTest, RejectsExtensions) {
+  upb_Arena* arena = upb_Arena_New();
+  auto* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrect_new(
+          arena);
+  auto* ext =
+      protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_new(
+          arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrectExtension1_set_message_set_extension(
+      msg, ext, arena);
+  char* image;
+  size_t size;
+  EXPECT_FALSE(upb_Message_WriteImage(
+      msg, &protobuf_test_messages_proto2_TestAllTypesProto2_MessageSetCorrect_msg_init,
+      arena, &image, &size));
+  upb_Arena_Free(arena);
+}
+
+}  // namespace
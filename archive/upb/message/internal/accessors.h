@@ -120,13 +120,26 @@ UPB_INLINE bool _upb_MiniTableField_InOneOf(const upb_MiniTableField* field) {
   return field->presence < 0;
 }
 
+// Returns NULL for an out-of-line field whose storage has not been allocated
+// yet; use _upb_Message_MutableOutOfLine() to allocate it.
 UPB_INLINE void* _upb_MiniTableField_GetPtr(upb_Message* msg,
                                             const upb_MiniTableField* field) {
+  if (UPB_UNLIKELY(_upb_MiniTableField_IsOutOfLine(field))) {
+    const upb_Message_InternalData* in = _upb_Message_GetInternalData(msg);
+    if (!in || field->offset >= in->out_of_line_size) return NULL;
+    return in->out_of_line + field->offset;
+  }
   return (char*)msg + field->offset;
 }
 
+// For an out-of-line field without storage this points to zeros, which is
+// the value of every field that was never set.
 UPB_INLINE const void* _upb_MiniTableField_GetConstPtr(
     const upb_Message* msg, const upb_MiniTableField* field) {
+  if (UPB_UNLIKELY(_upb_MiniTableField_IsOutOfLine(field))) {
+    const void* ptr = _upb_MiniTableField_GetPtr((upb_Message*)msg, field);
+    return ptr ? ptr : _kUpb_Message_ZeroField;
+  }
   return (char*)msg + field->offset;
 }
 
@@ -232,8 +245,9 @@ _upb_MiniTable_ElementSizeLg2(const upb_MiniTableField* field) {
 // about how they read/write the message data, for efficiency.
 //
 // These functions work on both extensions and non-extensions. If the field
-// of a setter is known to be a non-extension, the arena may be NULL and the
-// returned bool value may be ignored since it will always succeed.
+// of a setter is known to be a non-extension that is not out-of-line (see
+// kUpb_LabelFlags_IsOutOfLine), the arena may be NULL and the returned bool
+// value may be ignored since it will always succeed.
 
 UPB_INLINE bool _upb_Message_HasExtensionField(
     const upb_Message* msg, const upb_MiniTableExtension* ext) {
@@ -266,6 +280,23 @@ static UPB_FORCEINLINE void _upb_Message_GetNonExtensionField(
                                field);
 }
 
+// Generated getters for singular fields read the field at a constant offset
+// instead of going through a upb_MiniTableField.  In debug builds they call
+// this to check those constants against the MiniTable they were generated
+// with.
+UPB_INLINE bool _upb_MiniTable_CheckFieldLayout(const upb_MiniTable* m,
+                                                uint32_t number,
+                                                uint16_t offset,
+                                                int16_t presence) {
+  for (int i = 0; i < m->field_count; i++) {
+    const upb_MiniTableField* f = &m->fields[i];
+    if (f->number != number) continue;
+    return f->offset == offset && f->presence == presence &&
+           !_upb_MiniTableField_IsOutOfLine(f);
+  }
+  return false;
+}
+
 UPB_INLINE void _upb_Message_GetExtensionField(
     const upb_Message* msg, const upb_MiniTableExtension* mt_ext,
     const void* default_val, void* val) {
@@ -292,15 +323,21 @@ UPB_INLINE void _upb_Message_GetField(const upb_Message* msg,
 UPB_INLINE void _upb_Message_SetNonExtensionField(
     upb_Message* msg, const upb_MiniTableField* field, const void* val) {
   UPB_ASSUME(!upb_MiniTableField_IsExtension(field));
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
+  void* ptr = _upb_MiniTableField_GetPtr(msg, field);
+  // Out-of-line fields need an arena, see _upb_Message_SetField().
+  UPB_ASSERT(ptr);
   _upb_Message_SetPresence(msg, field);
-  _upb_MiniTable_CopyFieldData(_upb_MiniTableField_GetPtr(msg, field), val,
-                               field);
+  _upb_MiniTable_CopyFieldData(ptr, val, field);
 }
 
 UPB_INLINE bool _upb_Message_SetExtensionField(
     upb_Message* msg, const upb_MiniTableExtension* mt_ext, const void* val,
     upb_Arena* a) {
   UPB_ASSERT(a);
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
   upb_Message_Extension* ext =
       _upb_Message_GetOrCreateExtension(msg, mt_ext, a);
   if (!ext) return false;
@@ -315,6 +352,10 @@ UPB_INLINE bool _upb_Message_SetField(upb_Message* msg,
     const upb_MiniTableExtension* ext = (const upb_MiniTableExtension*)field;
     return _upb_Message_SetExtensionField(msg, ext, val, a);
   } else {
+    if (UPB_UNLIKELY(_upb_MiniTableField_IsOutOfLine(field)) &&
+        !_upb_Message_MutableOutOfLine(msg, field, a)) {
+      return false;
+    }
     _upb_Message_SetNonExtensionField(msg, field, val);
     return true;
   }
@@ -322,20 +363,15 @@ UPB_INLINE bool _upb_Message_SetField(upb_Message* msg,
 
 UPB_INLINE void _upb_Message_ClearExtensionField(
     upb_Message* msg, const upb_MiniTableExtension* ext_l) {
-  upb_Message_Internal* in = upb_Message_Getinternal(msg);
-  if (!in->internal) return;
-  const upb_Message_Extension* base =
-      UPB_PTR_AT(in->internal, in->internal->ext_begin, upb_Message_Extension);
-  upb_Message_Extension* ext =
-      (upb_Message_Extension*)_upb_Message_Getext(msg, ext_l);
-  if (ext) {
-    *ext = *base;
-    in->internal->ext_begin += sizeof(upb_Message_Extension);
-  }
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
+  _upb_Message_RemoveExtension(msg, ext_l);
 }
 
 UPB_INLINE void _upb_Message_ClearNonExtensionField(
     upb_Message* msg, const upb_MiniTableField* field) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
   if (field->presence > 0) {
     _upb_clearhas(msg, _upb_Message_Hasidx(field));
   } else if (_upb_MiniTableField_InOneOf(field)) {
@@ -343,9 +379,10 @@ UPB_INLINE void _upb_Message_ClearNonExtensionField(
     if (*oneof_case != field->number) return;
     *oneof_case = 0;
   }
+  void* ptr = _upb_MiniTableField_GetPtr(msg, field);
+  if (!ptr) return;  // Out-of-line field that was never set.
   const char zeros[16] = {0};
-  _upb_MiniTable_CopyFieldData(_upb_MiniTableField_GetPtr(msg, field), zeros,
-                               field);
+  _upb_MiniTable_CopyFieldData(ptr, zeros, field);
 }
 
 UPB_INLINE void _upb_Message_AssertMapIsUntagged(
@@ -365,6 +402,8 @@ UPB_INLINE upb_Map* _upb_Message_GetOrCreateMutableMap(
     size_t val_size, upb_Arena* arena) {
   _upb_MiniTableField_CheckIsMap(field);
   _upb_Message_AssertMapIsUntagged(msg, field);
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
   upb_Map* map = NULL;
   upb_Map* default_map_value = NULL;
   _upb_Message_GetNonExtensionField(msg, field, &default_map_value, &map);
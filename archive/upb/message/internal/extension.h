@@ -77,6 +77,11 @@ const upb_Message_Extension* _upb_Message_Getexts(const upb_Message* msg,
 const upb_Message_Extension* _upb_Message_Getext(
     const upb_Message* msg, const upb_MiniTableExtension* ext);
 
+// Removes the given extension from the message, if present.  The last-created
+// extension takes its place in the array.
+void _upb_Message_RemoveExtension(upb_Message* msg,
+                                  const upb_MiniTableExtension* ext);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
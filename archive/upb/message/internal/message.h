@@ -42,6 +42,7 @@
 #include <string.h>
 
 #include "upb/hash/common.h"
+#include "upb/hash/int_table.h"
 #include "upb/message/internal/extension.h"
 #include "upb/message/message.h"
 #include "upb/mini_table/extension.h"
@@ -59,32 +60,92 @@ extern const float kUpb_FltInfinity;
 extern const double kUpb_Infinity;
 extern const double kUpb_NaN;
 
+// Zero bytes large enough for any field, returned when reading an out-of-line
+// field that has no storage yet.
+extern const uint64_t _kUpb_Message_ZeroField[2];
+
+// An index of the unknown fields of a message by field number, so that
+// upb_MiniTable_FindUnknown() need not parse them all on every call.  It is
+// built on demand by upb_MiniTable_GetOrPromoteExtension() (see promote.c),
+// kept up to date when a single indexed field is deleted, and dropped by any
+// other change to the unknown fields.
+typedef struct {
+  uint32_t number;
+  uint32_t ofs;   // From the start of the unknown fields.
+  uint32_t len;   // 0 once the field was deleted.
+  uint32_t next;  // The next entry with the same number, or UINT32_MAX.
+} upb_UnknownIndexEntry;
+
+typedef struct {
+  upb_inttable heads;              // Field number -> first live entry.
+  upb_UnknownIndexEntry* entries;  // In the order of the unknown fields.
+  uint32_t count;
+} upb_UnknownIndex;
+
+// The encoding of a message saved by an encode with
+// kUpb_EncodeOption_CacheEncodings, to be reused by the next one if neither
+// the message nor anything in it has changed in between.  Messages that are
+// too small to be worth caching still get one, with size 0, to link them to
+// their parent.
+typedef struct upb_Message_EncodeCache {
+  // The message that this one was last encoded in, which is marked dirty
+  // along with it.  NULL for the top-level message.
+  upb_Message* parent;
+  char* data;
+  uint32_t size;
+  uint32_t capacity;
+  int options;  // The encode options that produced `data`.
+  int depth;    // The depth limit left when it was encoded.
+
+  // Set when the message changes.  A dirty message has dirty parents too, so
+  // marking stops at the first one that is already dirty.
+  bool dirty;
+} upb_Message_EncodeCache;
+
 /* Internal members of a upb_Message that track unknown fields and/or
  * extensions. We can change this without breaking binary compatibility.  We put
  * these before the user's data.  The user's upb_Message* points after the
  * upb_Message_Internal. */
 
 typedef struct {
-  /* Total size of this structure, including the data that follows.
+  /* Total size of this structure, including the extension data that follows.
    * Must be aligned to 8, which is alignof(upb_Message_Extension) */
   uint32_t size;
 
-  /* Offsets relative to the beginning of this structure.
-   *
-   * Unknown data grows forward from the beginning to unknown_end.
-   * Extension data grows backward from size to ext_begin.
-   * When the two meet, we're out of data and have to realloc.
-   *
-   * If we imagine that the final member of this struct is:
-   *   char data[size - overhead];  // overhead =
-   * sizeof(upb_Message_InternalData)
-   *
-   * Then we have:
-   *   unknown data: data[0 .. (unknown_end - overhead)]
-   *   extensions data: data[(ext_begin - overhead) .. (size - overhead)] */
-  uint32_t unknown_end;
+  /* Offset relative to the beginning of this structure.  Extension data grows
+   * backward from size to ext_begin; when it reaches the end of the struct,
+   * we're out of room and have to realloc. */
   uint32_t ext_begin;
-  /* Data follows, as if there were an array:
+
+  /* Unknown data: unknown[0 .. unknown_size].  It lives in its own buffer of
+   * unknown_capacity bytes, so that adding to it never moves the extensions.
+   * If unknown_capacity is 0, the unknown data (if any) instead aliases a parse
+   * input buffer (see kUpb_DecodeOption_AliasUnknown) and is read-only. */
+  const char* unknown;
+  uint32_t unknown_size;
+  uint32_t unknown_capacity;
+
+  /* Storage for the fields that the mini table placed out of line (see
+   * kUpb_LabelFlags_IsOutOfLine), or NULL if none were set.  It grows as
+   * fields at higher offsets are set; fields beyond out_of_line_size are
+   * implicitly zero. */
+  char* out_of_line;
+  uint32_t out_of_line_size;
+
+  /* See upb_UnknownIndex, or NULL if it was not built. */
+  upb_UnknownIndex* unknown_index;
+
+  /* Once a message has many extensions, maps each upb_MiniTableExtension* to
+   * its slot, counted backward from `size` so that slots stay put as
+   * extensions are added and the data is reallocated.  NULL for messages with
+   * few extensions, or if allocating the index failed. */
+  upb_inttable* ext_index;
+
+  /* See upb_Message_EncodeCache, or NULL if the message was never encoded with
+   * kUpb_EncodeOption_CacheEncodings. */
+  upb_Message_EncodeCache* encode_cache;
+
+  /* Extension data follows, as if there were an array:
    *   char data[size - sizeof(upb_Message_InternalData)]; */
 } upb_Message_InternalData;
 
@@ -125,6 +186,53 @@ UPB_INLINE upb_Message_Internal* upb_Message_Getinternal(
   return (upb_Message_Internal*)((char*)msg - size);
 }
 
+// The low bit of upb_Message_Internal.internal marks a frozen message (see
+// upb_Message_Freeze()).  Code that may see a frozen message must read the
+// internal data through _upb_Message_GetInternalData(); code that modifies a
+// message may use the field directly, since the bit is never set there.
+#define kUpb_Message_FrozenBit ((uintptr_t)1)
+
+UPB_INLINE upb_Message_InternalData* _upb_Message_GetInternalData(
+    const upb_Message* msg) {
+  uintptr_t tagged = (uintptr_t)upb_Message_Getinternal(msg)->internal;
+  return (upb_Message_InternalData*)(tagged & ~kUpb_Message_FrozenBit);
+}
+
+UPB_INLINE bool _upb_Message_IsFrozen(const upb_Message* msg) {
+  uintptr_t tagged = (uintptr_t)upb_Message_Getinternal(msg)->internal;
+  return (tagged & kUpb_Message_FrozenBit) != 0;
+}
+
+UPB_INLINE void _upb_Message_SetFrozen(upb_Message* msg) {
+  upb_Message_Internal* in = upb_Message_Getinternal(msg);
+  in->internal = (upb_Message_InternalData*)((uintptr_t)in->internal |
+                                             kUpb_Message_FrozenBit);
+}
+
+// Marks the encode cache of `msg` and of the messages it is in as dirty.
+void _upb_Message_DropEncodeCache(upb_Message_EncodeCache* cache);
+
+// Called by every mutator before it changes `msg`, so that its cached
+// encoding (see kUpb_EncodeOption_CacheEncodings) is not reused.
+UPB_INLINE void _upb_Message_Modified(upb_Message* msg) {
+  upb_Message_InternalData* in = upb_Message_Getinternal(msg)->internal;
+  if (UPB_UNLIKELY(in && in->encode_cache)) {
+    _upb_Message_DropEncodeCache(in->encode_cache);
+  }
+}
+
+// Attaches `cache` to `msg`.  Returns false on allocation failure.
+bool _upb_Message_SetEncodeCache(upb_Message* msg,
+                                 upb_Message_EncodeCache* cache,
+                                 upb_Arena* arena);
+
+// Returns the storage of out-of-line `field` for writing, allocating or
+// growing the message's out-of-line block as needed.  Returns NULL on
+// allocation failure.
+void* _upb_Message_MutableOutOfLine(upb_Message* msg,
+                                    const upb_MiniTableField* field,
+                                    upb_Arena* arena);
+
 // Discards the unknown fields for this message only.
 void _upb_Message_DiscardUnknown_shallow(upb_Message* msg);
 
@@ -133,6 +241,24 @@ void _upb_Message_DiscardUnknown_shallow(upb_Message* msg);
 bool _upb_Message_AddUnknown(upb_Message* msg, const char* data, size_t len,
                              upb_Arena* arena);
 
+// Makes room for `len` more bytes of unknown data, so that adding them with
+// _upb_Message_AddUnknown() will not allocate.  Returns false on allocation
+// failure.
+bool _upb_Message_ReserveUnknown(upb_Message* msg, size_t len,
+                                 upb_Arena* arena);
+
+// Like _upb_Message_AddUnknown(), but references `data` instead of copying it
+// when it directly follows the unknown data the message already aliases (or
+// the message has no unknown data yet).  `data` must outlive the message.
+bool _upb_Message_AddUnknownAliased(upb_Message* msg, const char* data,
+                                    size_t len, upb_Arena* arena);
+
+// Like upb_Message_DeleteUnknown(), but may also delete from the middle of
+// aliased unknown data, which is copied into the message first.  Returns false
+// on allocation failure.
+bool _upb_Message_DeleteUnknown(upb_Message* msg, const char* data, size_t len,
+                                upb_Arena* arena);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
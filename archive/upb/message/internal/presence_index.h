@@ -0,0 +1,66 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_MESSAGE_INTERNAL_PRESENCE_INDEX_H_
+#define UPB_MESSAGE_INTERNAL_PRESENCE_INDEX_H_
+
+#include <stdint.h>
+
+#include "upb/message/presence_index.h"
+#include "upb/mini_table/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// The iterator position of a field with hasbit `i` is `i`, and that of
+// others[j] is `hasbit_end + j`, so positions up to `end` count fields and
+// callers may use the ones after it (see upb_Message_NextPresent()).
+struct upb_PresenceIndex {
+  const upb_MiniTable* mini_table;
+
+  // One more than the highest hasbit.  Hasbit 0 is never used.
+  uint16_t hasbit_end;
+  uint16_t other_count;
+
+  // The position in mini_table->fields of the field with each hasbit.
+  const uint16_t* by_hasbit;
+
+  // The positions in mini_table->fields of the fields without hasbits, with
+  // only the first member of each oneof.
+  const uint16_t* others;
+};
+
+UPB_INLINE size_t _upb_PresenceIndex_End(const upb_PresenceIndex* index) {
+  return (size_t)index->hasbit_end + index->other_count;
+}
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_MESSAGE_INTERNAL_PRESENCE_INDEX_H_
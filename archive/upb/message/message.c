@@ -41,6 +41,7 @@
 const float kUpb_FltInfinity = INFINITY;
 const double kUpb_Infinity = INFINITY;
 const double kUpb_NaN = NAN;
+const uint64_t _kUpb_Message_ZeroField[2] = {0, 0};
 
 static const size_t overhead = sizeof(upb_Message_InternalData);
 
@@ -50,19 +51,32 @@ upb_Message* upb_Message_New(const upb_MiniTable* mini_table,
 }
 
 static bool realloc_internal(upb_Message* msg, size_t need, upb_Arena* arena) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
   upb_Message_Internal* in = upb_Message_Getinternal(msg);
   if (!in->internal) {
-    /* No internal data, allocate from scratch. */
-    size_t size = UPB_MAX(128, upb_Log2CeilingSize(need + overhead));
+    /* No internal data, allocate from scratch.  Room for extensions is only
+     * made once one is added. */
+    size_t size =
+        need ? UPB_MAX((size_t)128,
+                       (size_t)upb_Log2CeilingSize(need + overhead))
+             : overhead;
     upb_Message_InternalData* internal = upb_Arena_Malloc(arena, size);
     if (!internal) return false;
     internal->size = size;
-    internal->unknown_end = overhead;
     internal->ext_begin = size;
+    internal->unknown = NULL;
+    internal->unknown_size = 0;
+    internal->unknown_capacity = 0;
+    internal->out_of_line = NULL;
+    internal->out_of_line_size = 0;
+    internal->unknown_index = NULL;
+    internal->ext_index = NULL;
+    internal->encode_cache = NULL;
     in->internal = internal;
-  } else if (in->internal->ext_begin - in->internal->unknown_end < need) {
+  } else if (in->internal->ext_begin - overhead < need) {
     /* Internal data is too small, reallocate. */
-    size_t new_size = upb_Log2CeilingSize(in->internal->size + need);
+    size_t new_size =
+        UPB_MAX(128, upb_Log2CeilingSize(in->internal->size + need));
     size_t ext_bytes = in->internal->size - in->internal->ext_begin;
     size_t new_ext_begin = new_size - ext_bytes;
     upb_Message_InternalData* internal =
@@ -77,76 +91,295 @@ static bool realloc_internal(upb_Message* msg, size_t need, upb_Arena* arena) {
     internal->size = new_size;
     in->internal = internal;
   }
-  UPB_ASSERT(in->internal->ext_begin - in->internal->unknown_end >= need);
+  UPB_ASSERT(in->internal->ext_begin - overhead >= need);
+  return true;
+}
+
+// Grows the unknown data buffer to hold `len` more bytes, copying in the data
+// it aliased, if any.  The data keeps its offsets, so the index stays valid.
+static bool _upb_Message_GrowUnknown(upb_Message_InternalData* internal,
+                                     size_t len, upb_Arena* arena) {
+  size_t need = internal->unknown_size + len;
+  if (need <= internal->unknown_capacity) return true;
+  if (need > UINT32_MAX / 2) return false;
+  size_t new_capacity = UPB_MAX(64, upb_Log2CeilingSize(need));
+  char* buf;
+  if (internal->unknown_capacity) {
+    buf = upb_Arena_Realloc(arena, (char*)internal->unknown,
+                            internal->unknown_capacity, new_capacity);
+  } else {
+    buf = upb_Arena_Malloc(arena, new_capacity);
+    if (buf && internal->unknown_size) {
+      memcpy(buf, internal->unknown, internal->unknown_size);
+    }
+  }
+  if (!buf) return false;
+  internal->unknown = buf;
+  internal->unknown_capacity = new_capacity;
+  return true;
+}
+
+bool _upb_Message_ReserveUnknown(upb_Message* msg, size_t len,
+                                 upb_Arena* arena) {
+  return realloc_internal(msg, 0, arena) &&
+         _upb_Message_GrowUnknown(upb_Message_Getinternal(msg)->internal, len,
+                                  arena);
+}
+
+void _upb_Message_DropEncodeCache(upb_Message_EncodeCache* cache) {
+  while (cache && !cache->dirty) {
+    cache->dirty = true;
+    if (!cache->parent) break;
+    cache = _upb_Message_GetInternalData(cache->parent)->encode_cache;
+  }
+}
+
+bool _upb_Message_SetEncodeCache(upb_Message* msg,
+                                 upb_Message_EncodeCache* cache,
+                                 upb_Arena* arena) {
+  if (!realloc_internal(msg, 0, arena)) return false;
+  upb_Message_Getinternal(msg)->internal->encode_cache = cache;
   return true;
 }
 
 bool _upb_Message_AddUnknown(upb_Message* msg, const char* data, size_t len,
                              upb_Arena* arena) {
-  if (!realloc_internal(msg, len, arena)) return false;
-  upb_Message_Internal* in = upb_Message_Getinternal(msg);
-  memcpy(UPB_PTR_AT(in->internal, in->internal->unknown_end, char), data, len);
-  in->internal->unknown_end += len;
+  _upb_Message_Modified(msg);
+  if (!_upb_Message_ReserveUnknown(msg, len, arena)) return false;
+  upb_Message_InternalData* internal = upb_Message_Getinternal(msg)->internal;
+  internal->unknown_index = NULL;
+  memcpy((char*)internal->unknown + internal->unknown_size, data, len);
+  internal->unknown_size += len;
   return true;
 }
 
+bool _upb_Message_AddUnknownAliased(upb_Message* msg, const char* data,
+                                    size_t len, upb_Arena* arena) {
+  if (!realloc_internal(msg, 0, arena)) return false;
+  upb_Message_InternalData* internal = upb_Message_Getinternal(msg)->internal;
+  if (internal->unknown_capacity == 0) {
+    if (internal->unknown_size == 0) {
+      internal->unknown_index = NULL;
+      internal->unknown = data;
+      internal->unknown_size = len;
+      return true;
+    }
+    if (internal->unknown + internal->unknown_size == data) {
+      internal->unknown_index = NULL;
+      internal->unknown_size += len;
+      return true;
+    }
+  }
+  return _upb_Message_AddUnknown(msg, data, len, arena);
+}
+
+static size_t _upb_Message_FieldDataSize(const upb_MiniTableField* field) {
+  switch (_upb_MiniTableField_GetRep(field)) {
+    case kUpb_FieldRep_1Byte:
+      return 1;
+    case kUpb_FieldRep_4Byte:
+      return 4;
+    case kUpb_FieldRep_8Byte:
+      return 8;
+    case kUpb_FieldRep_StringView:
+      return sizeof(upb_StringView);
+  }
+  UPB_UNREACHABLE();
+}
+
+void* _upb_Message_MutableOutOfLine(upb_Message* msg,
+                                    const upb_MiniTableField* field,
+                                    upb_Arena* arena) {
+  UPB_ASSERT(_upb_MiniTableField_IsOutOfLine(field));
+  if (!realloc_internal(msg, 0, arena)) return NULL;
+  upb_Message_InternalData* internal = upb_Message_Getinternal(msg)->internal;
+  size_t end = field->offset + _upb_Message_FieldDataSize(field);
+  if (end > internal->out_of_line_size) {
+    // Out-of-line fields are rarely set, so grow exponentially, but start
+    // small.
+    size_t old_size = internal->out_of_line_size;
+    size_t new_size = UPB_ALIGN_UP(UPB_MAX(end, old_size * 2), 8);
+    char* block = upb_Arena_Realloc(arena, internal->out_of_line, old_size,
+                                    new_size);
+    if (!block) return NULL;
+    memset(block + old_size, 0, new_size - old_size);
+    internal->out_of_line = block;
+    internal->out_of_line_size = new_size;
+  }
+  return internal->out_of_line + field->offset;
+}
+
 void _upb_Message_DiscardUnknown_shallow(upb_Message* msg) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
   upb_Message_Internal* in = upb_Message_Getinternal(msg);
   if (in->internal) {
-    in->internal->unknown_end = overhead;
+    if (!in->internal->unknown_capacity) in->internal->unknown = NULL;
+    in->internal->unknown_size = 0;
+    in->internal->unknown_index = NULL;
   }
 }
 
 const char* upb_Message_GetUnknown(const upb_Message* msg, size_t* len) {
-  const upb_Message_Internal* in = upb_Message_Getinternal(msg);
-  if (in->internal) {
-    *len = in->internal->unknown_end - overhead;
-    return (char*)(in->internal + 1);
+  const upb_Message_InternalData* internal = _upb_Message_GetInternalData(msg);
+  if (internal) {
+    *len = internal->unknown_size;
+    return internal->unknown;
   } else {
     *len = 0;
     return NULL;
   }
 }
 
+// Updates the index of the unknown fields for the deletion of the `len` bytes
+// at `ofs`, or drops it unless those are exactly one indexed field.
+static void _upb_UnknownIndex_Delete(upb_Message_InternalData* internal,
+                                     size_t ofs, size_t len) {
+  upb_UnknownIndex* index = internal->unknown_index;
+  if (!index) return;
+  upb_UnknownIndexEntry* entries = index->entries;
+  // Live entries have increasing offsets, and a deleted one has the offset of
+  // the live entry after it.
+  uint32_t lo = 0;
+  uint32_t hi = index->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (entries[mid].ofs < ofs) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  while (lo < index->count && entries[lo].len == 0) lo++;
+  if (lo == index->count || entries[lo].ofs != ofs || entries[lo].len != len) {
+    internal->unknown_index = NULL;
+    return;
+  }
+
+  upb_UnknownIndexEntry* e = &entries[lo];
+  upb_value v;
+  upb_inttable_lookup(&index->heads, e->number, &v);
+  uint32_t i = upb_value_getuint32(v);
+  if (i == lo) {
+    if (e->next == UINT32_MAX) {
+      upb_inttable_remove(&index->heads, e->number, NULL);
+    } else {
+      upb_inttable_replace(&index->heads, e->number,
+                           upb_value_uint32(e->next));
+    }
+  } else {
+    while (entries[i].next != lo) i = entries[i].next;
+    entries[i].next = e->next;
+  }
+  e->len = 0;
+  for (uint32_t j = lo + 1; j < index->count; j++) {
+    entries[j].ofs -= len;
+  }
+}
+
 void upb_Message_DeleteUnknown(upb_Message* msg, const char* data, size_t len) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
   upb_Message_Internal* in = upb_Message_Getinternal(msg);
-  const char* internal_unknown_end =
-      UPB_PTR_AT(in->internal, in->internal->unknown_end, char);
 #ifndef NDEBUG
   size_t full_unknown_size;
   const char* full_unknown = upb_Message_GetUnknown(msg, &full_unknown_size);
   UPB_ASSERT((uintptr_t)data >= (uintptr_t)full_unknown);
   UPB_ASSERT((uintptr_t)data < (uintptr_t)(full_unknown + full_unknown_size));
   UPB_ASSERT((uintptr_t)(data + len) > (uintptr_t)data);
-  UPB_ASSERT((uintptr_t)(data + len) <= (uintptr_t)internal_unknown_end);
+  UPB_ASSERT((uintptr_t)(data + len) <=
+             (uintptr_t)(full_unknown + full_unknown_size));
 #endif
-  if ((data + len) != internal_unknown_end) {
-    memmove((char*)data, data + len, internal_unknown_end - data - len);
+  upb_Message_InternalData* internal = in->internal;
+  _upb_UnknownIndex_Delete(internal, data - internal->unknown, len);
+  const char* unknown_end = internal->unknown + internal->unknown_size;
+  if (internal->unknown_capacity == 0) {
+    // The input buffer can't be modified, so we can only trim its ends.
+    UPB_ASSERT(data == internal->unknown || data + len == unknown_end);
+    if (data == internal->unknown) internal->unknown += len;
+    internal->unknown_size -= len;
+    return;
+  }
+  if ((data + len) != unknown_end) {
+    memmove((char*)data, data + len, unknown_end - data - len);
   }
-  in->internal->unknown_end -= len;
+  internal->unknown_size -= len;
+}
+
+bool _upb_Message_DeleteUnknown(upb_Message* msg, const char* data, size_t len,
+                                upb_Arena* arena) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  upb_Message_InternalData* internal = upb_Message_Getinternal(msg)->internal;
+  const char* unknown = internal->unknown;
+  if (internal->unknown_capacity == 0 && data != unknown &&
+      data + len != unknown + internal->unknown_size) {
+    if (!_upb_Message_GrowUnknown(internal, 0, arena)) return false;
+    data = internal->unknown + (data - unknown);
+  }
+  upb_Message_DeleteUnknown(msg, data, len);
+  return true;
 }
 
 const upb_Message_Extension* _upb_Message_Getexts(const upb_Message* msg,
                                                   size_t* count) {
-  const upb_Message_Internal* in = upb_Message_Getinternal(msg);
-  if (in->internal) {
-    *count = (in->internal->size - in->internal->ext_begin) /
+  const upb_Message_InternalData* internal = _upb_Message_GetInternalData(msg);
+  if (internal) {
+    *count = (internal->size - internal->ext_begin) /
              sizeof(upb_Message_Extension);
-    return UPB_PTR_AT(in->internal, in->internal->ext_begin, void);
+    return UPB_PTR_AT(internal, internal->ext_begin, void);
   } else {
     *count = 0;
     return NULL;
   }
 }
 
+// Messages with this many extensions get an index, so that looking one up
+// does not scan them all.
+#define kUpb_Message_ExtensionIndexMin 16
+
+static upb_Message_Extension* _upb_Message_ExtensionSlot(
+    const upb_Message_InternalData* internal, size_t slot) {
+  return UPB_PTR_AT(internal,
+                    internal->size - (slot + 1) * sizeof(upb_Message_Extension),
+                    upb_Message_Extension);
+}
+
+static size_t _upb_Message_ExtensionSlotOf(
+    const upb_Message_InternalData* internal, const upb_Message_Extension* e) {
+  size_t ofs = (const char*)e - (const char*)internal;
+  return (internal->size - ofs) / sizeof(upb_Message_Extension) - 1;
+}
+
+// Indexes all of the message's extensions, leaving the index NULL if we run
+// out of memory.
+static void _upb_Message_BuildExtensionIndex(upb_Message_InternalData* internal,
+                                             upb_Arena* arena) {
+  size_t n = (internal->size - internal->ext_begin) /
+             sizeof(upb_Message_Extension);
+  upb_inttable* index = upb_Arena_Malloc(arena, sizeof(*index));
+  if (!index || !upb_inttable_init(index, arena)) return;
+  for (size_t i = 0; i < n; i++) {
+    const upb_Message_Extension* ext = _upb_Message_ExtensionSlot(internal, i);
+    if (!upb_inttable_insert(index, (uintptr_t)ext->ext, upb_value_uint32(i),
+                             arena)) {
+      return;
+    }
+  }
+  internal->ext_index = index;
+}
+
 const upb_Message_Extension* _upb_Message_Getext(
     const upb_Message* msg, const upb_MiniTableExtension* e) {
+  const upb_Message_InternalData* internal = _upb_Message_GetInternalData(msg);
+  if (internal && internal->ext_index) {
+    upb_value v;
+    if (!upb_inttable_lookup(internal->ext_index, (uintptr_t)e, &v)) {
+      return NULL;
+    }
+    return _upb_Message_ExtensionSlot(internal, upb_value_getuint32(v));
+  }
+
   size_t n;
   const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &n);
-
-  /* For now we use linear search exclusively to find extensions. If this
-   * becomes an issue due to messages with lots of extensions, we can introduce
-   * a table of some sort. */
   for (size_t i = 0; i < n; i++) {
     if (ext[i].ext == e) {
       return &ext[i];
@@ -162,14 +395,49 @@ upb_Message_Extension* _upb_Message_GetOrCreateExtension(
       (upb_Message_Extension*)_upb_Message_Getext(msg, e);
   if (ext) return ext;
   if (!realloc_internal(msg, sizeof(upb_Message_Extension), arena)) return NULL;
-  upb_Message_Internal* in = upb_Message_Getinternal(msg);
-  in->internal->ext_begin -= sizeof(upb_Message_Extension);
-  ext = UPB_PTR_AT(in->internal, in->internal->ext_begin, void);
+  upb_Message_InternalData* internal = upb_Message_Getinternal(msg)->internal;
+  internal->ext_begin -= sizeof(upb_Message_Extension);
+  ext = UPB_PTR_AT(internal, internal->ext_begin, void);
   memset(ext, 0, sizeof(upb_Message_Extension));
   ext->ext = e;
+  size_t slot = _upb_Message_ExtensionSlotOf(internal, ext);
+  if (internal->ext_index) {
+    if (!upb_inttable_insert(internal->ext_index, (uintptr_t)e,
+                             upb_value_uint32(slot), arena)) {
+      internal->ext_index = NULL;
+    }
+  } else if (slot + 1 >= kUpb_Message_ExtensionIndexMin) {
+    _upb_Message_BuildExtensionIndex(internal, arena);
+  }
   return ext;
 }
 
+void _upb_Message_RemoveExtension(upb_Message* msg,
+                                  const upb_MiniTableExtension* e) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  upb_Message_InternalData* internal = upb_Message_Getinternal(msg)->internal;
+  if (!internal) return;
+  upb_Message_Extension* ext =
+      (upb_Message_Extension*)_upb_Message_Getext(msg, e);
+  if (!ext) return;
+  const upb_Message_Extension* base =
+      UPB_PTR_AT(internal, internal->ext_begin, upb_Message_Extension);
+  if (internal->ext_index) {
+    upb_inttable_remove(internal->ext_index, (uintptr_t)e, NULL);
+    if (ext != base) {
+      upb_inttable_replace(
+          internal->ext_index, (uintptr_t)base->ext,
+          upb_value_uint32(_upb_Message_ExtensionSlotOf(internal, ext)));
+    }
+  }
+  *ext = *base;
+  internal->ext_begin += sizeof(upb_Message_Extension);
+}
+
+bool upb_Message_IsFrozen(const upb_Message* msg) {
+  return _upb_Message_IsFrozen(msg);
+}
+
 size_t upb_Message_ExtensionCount(const upb_Message* msg) {
   size_t count;
   _upb_Message_Getexts(msg, &count);
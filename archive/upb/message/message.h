@@ -58,12 +58,17 @@ void upb_Message_AddUnknown(upb_Message* msg, const char* data, size_t len,
 // Returns a reference to the message's unknown data.
 const char* upb_Message_GetUnknown(const upb_Message* msg, size_t* len);
 
-// Removes partial unknown data from message.
+// Removes partial unknown data from message.  If the unknown data aliases a
+// parse input buffer (see kUpb_DecodeOption_AliasUnknown), `data` must be at
+// its beginning or end.
 void upb_Message_DeleteUnknown(upb_Message* msg, const char* data, size_t len);
 
 // Returns the number of extensions present in this message.
 size_t upb_Message_ExtensionCount(const upb_Message* msg);
 
+// Returns true if the message was frozen by upb_Message_Freeze().
+UPB_API bool upb_Message_IsFrozen(const upb_Message* msg);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
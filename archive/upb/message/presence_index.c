@@ -0,0 +1,195 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/presence_index.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "upb/collections/array.h"
+#include "upb/collections/map.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/internal/presence_index.h"
+#include "upb/mini_table/field.h"
+#include "upb/mini_table/internal/field.h"
+#include "upb/mini_table/internal/message.h"
+#include "upb/wire/internal/swap.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+upb_PresenceIndex* upb_PresenceIndex_New(const upb_MiniTable* mini_table,
+                                         upb_Arena* arena) {
+  size_t hasbit_end = 1;
+  size_t other_count = 0;
+  for (int i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* f = &mini_table->fields[i];
+    if (f->presence > 0) {
+      hasbit_end = UPB_MAX(hasbit_end, (size_t)f->presence + 1);
+    } else {
+      other_count++;
+    }
+  }
+
+  upb_PresenceIndex* index = upb_Arena_Malloc(
+      arena, sizeof(*index) + (hasbit_end + other_count) * sizeof(uint16_t));
+  if (!index) return NULL;
+  uint16_t* by_hasbit = (uint16_t*)(index + 1);
+  uint16_t* others = by_hasbit + hasbit_end;
+  memset(by_hasbit, 0, hasbit_end * sizeof(*by_hasbit));
+
+  other_count = 0;
+  for (int i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* f = &mini_table->fields[i];
+    if (f->presence > 0) {
+      by_hasbit[f->presence] = i;
+      continue;
+    }
+    if (f->presence < 0) {
+      // Members of a oneof share a case, so only the first one is listed.
+      bool seen = false;
+      for (size_t j = 0; j < other_count; j++) {
+        if (mini_table->fields[others[j]].presence == f->presence) {
+          seen = true;
+          break;
+        }
+      }
+      if (seen) continue;
+    }
+    others[other_count++] = i;
+  }
+
+  index->mini_table = mini_table;
+  index->hasbit_end = hasbit_end;
+  index->other_count = other_count;
+  index->by_hasbit = by_hasbit;
+  index->others = others;
+  return index;
+}
+
+const upb_MiniTable* upb_PresenceIndex_MiniTable(
+    const upb_PresenceIndex* index) {
+  return index->mini_table;
+}
+
+static int upb_PresenceIndex_CountTrailingZeros(uint64_t x) {
+  UPB_ASSERT(x != 0);
+#ifdef __GNUC__
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Returns hasbits [64 * word, 64 * word + 64) of `msg`, reading no further
+// than the first `bytes` bytes, which hold all of its hasbits.
+static uint64_t upb_PresenceIndex_LoadHasbits(const upb_Message* msg,
+                                              size_t word, size_t bytes) {
+  uint64_t bits = 0;
+  memcpy(&bits, (const char*)msg + word * 8, UPB_MIN(bytes - word * 8, 8));
+  return _upb_BigEndian_Swap64(bits);
+}
+
+// Returns true if `f`, which has neither a hasbit nor a oneof, is set.
+static bool upb_PresenceIndex_IsSet(const upb_Message* msg,
+                                    const upb_MiniTableField* f) {
+  const void* mem = _upb_MiniTableField_GetConstPtr(msg, f);
+  switch (upb_FieldMode_Get(f)) {
+    case kUpb_FieldMode_Map: {
+      const upb_Map* map = *(const upb_Map* const*)mem;
+      return map && upb_Map_Size(map) != 0;
+    }
+    case kUpb_FieldMode_Array: {
+      const upb_Array* arr = *(const upb_Array* const*)mem;
+      return arr && upb_Array_Size(arr) != 0;
+    }
+    case kUpb_FieldMode_Scalar:
+      break;
+  }
+  // Sub-message pointers are covered too: NULL is zero.
+  return _upb_MiniTable_ValueIsNonZero(mem, f);
+}
+
+bool upb_Message_NextPresentField(const upb_Message* msg,
+                                  const upb_PresenceIndex* index,
+                                  const upb_MiniTableField** f,
+                                  size_t* iter) {
+  const upb_MiniTable* m = index->mini_table;
+  const size_t hasbit_end = index->hasbit_end;
+  const size_t end = _upb_PresenceIndex_End(index);
+  size_t i = *iter + 1;
+
+  // Hasbit 0 is never used, and a message without hasbits may have a field
+  // where it would be.
+  if (i == 0) i = 1;
+
+  if (i < hasbit_end) {
+    const size_t bytes = (hasbit_end + 7) / 8;
+    size_t word = i / 64;
+    uint64_t bits = upb_PresenceIndex_LoadHasbits(msg, word, bytes) &
+                    (~(uint64_t)0 << (i % 64));
+    while (true) {
+      if (bits) {
+        i = word * 64 + upb_PresenceIndex_CountTrailingZeros(bits);
+        if (i >= hasbit_end) break;
+        *f = &m->fields[index->by_hasbit[i]];
+        *iter = i;
+        return true;
+      }
+      if (++word * 64 >= hasbit_end) break;
+      bits = upb_PresenceIndex_LoadHasbits(msg, word, bytes);
+    }
+    i = hasbit_end;
+  }
+
+  for (; i < end; i++) {
+    const upb_MiniTableField* field = &m->fields[index->others[i - hasbit_end]];
+    if (_upb_MiniTableField_InOneOf(field)) {
+      uint32_t number = _upb_getoneofcase_field(msg, field);
+      if (number == 0) continue;
+      if (number != field->number) {
+        field = upb_MiniTable_FindFieldByNumber(m, number);
+      }
+    } else if (!upb_PresenceIndex_IsSet(msg, field)) {
+      continue;
+    }
+    *f = field;
+    *iter = i;
+    return true;
+  }
+
+  *iter = end;
+  return false;
+}
@@ -0,0 +1,98 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Iteration over the fields that are set in a message, using only its
+// MiniTable.
+//
+// A upb_PresenceIndex arranges the fields of a MiniTable so that the set
+// fields can be found without visiting the others: fields with hasbits are
+// found by scanning the hasbit words of the message, and only the remaining
+// fields (oneofs, repeated fields, maps and fields with implicit presence) are
+// checked one by one, with a single check per oneof.  Iterating a message with
+// hundreds of fields of which few are set therefore costs little more than
+// the set fields themselves.
+
+#ifndef UPB_MESSAGE_PRESENCE_INDEX_H_
+#define UPB_MESSAGE_PRESENCE_INDEX_H_
+
+#include <stddef.h>
+
+#include "upb/mem/arena.h"
+#include "upb/message/message.h"
+#include "upb/mini_table/field.h"
+#include "upb/mini_table/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef struct upb_PresenceIndex upb_PresenceIndex;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Builds the index for `mini_table`, allocated from `arena`.  Returns NULL on
+// allocation failure.  The index only depends on the MiniTable, so one index
+// can be shared by any number of messages and threads.
+UPB_API upb_PresenceIndex* upb_PresenceIndex_New(
+    const upb_MiniTable* mini_table, upb_Arena* arena);
+
+UPB_API const upb_MiniTable* upb_PresenceIndex_MiniTable(
+    const upb_PresenceIndex* index);
+
+// Iterate over the fields that are set in `msg`, whose type must be the
+// MiniTable of `index`:
+//
+// size_t iter = kUpb_PresenceIndex_Begin;
+// const upb_MiniTableField* f;
+// while (upb_Message_NextPresentField(msg, index, &f, &iter)) {
+//   process_field(f);
+// }
+//
+// A field is set if it would be serialized: it has its hasbit set, is the
+// active member of its oneof, is a non-empty array or map, or has a non-zero
+// value with implicit presence.  Fields with hasbits come first, in hasbit
+// order, so the order is unrelated to both field numbers and declaration
+// order.  Extensions are not returned.
+
+#define kUpb_PresenceIndex_Begin -1
+
+UPB_API bool upb_Message_NextPresentField(const upb_Message* msg,
+                                          const upb_PresenceIndex* index,
+                                          const upb_MiniTableField** f,
+                                          size_t* iter);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_MESSAGE_PRESENCE_INDEX_H_
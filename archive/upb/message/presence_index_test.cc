@@ -0,0 +1,218 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/presence_index.h"
+
+#include <stdint.h>
+
+#include <set>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "upb/base/descriptor_constants.h"
+#include "upb/base/status.hpp"
+#include "upb/collections/array.h"
+#include "upb/mem/arena.hpp"
+#include "upb/message/accessors.h"
+#include "upb/message/message.h"
+#include "upb/message/test.upb.h"
+#include "upb/message/test.upbdefs.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_table/internal/field.h"
+#include "upb/mini_table/message.h"
+#include "upb/reflection/def.hpp"
+#include "upb/reflection/message.h"
+
+namespace {
+
+std::set<uint32_t> PresentFields(const upb_Message* msg,
+                                 const upb_PresenceIndex* index) {
+  std::set<uint32_t> ret;
+  size_t iter = kUpb_PresenceIndex_Begin;
+  const upb_MiniTableField* f;
+  while (upb_Message_NextPresentField(msg, index, &f, &iter)) {
+    EXPECT_TRUE(ret.insert(f->number).second);
+  }
+  // Iteration stays finished.
+  EXPECT_FALSE(upb_Message_NextPresentField(msg, index, &f, &iter));
+  return ret;
+}
+
+std::set<const upb_FieldDef*> PresentDefs(
+    const upb_Message* msg, const upb_MessageDef* m,
+    bool (*next)(const upb_Message*, const upb_MessageDef*,
+                 const upb_DefPool*, const upb_FieldDef**, upb_MessageValue*,
+                 size_t*)) {
+  std::set<const upb_FieldDef*> ret;
+  size_t iter = kUpb_Message_Begin;
+  const upb_FieldDef* f;
+  upb_MessageValue val;
+  while (next(msg, m, nullptr, &f, &val, &iter)) {
+    EXPECT_TRUE(ret.insert(f).second);
+  }
+  return ret;
+}
+
+}  // namespace
+
+TEST(PresenceIndexTest, SpansHasbitWords) {
+  // Fields 1-100 have hasbits, 101 has implicit presence, 102 is repeated and
+  // 103-104 form a oneof.
+  upb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartMessage(0));
+  for (uint32_t i = 1; i <= 100; i++) {
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, i, 0));
+  }
+  ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, 101,
+                         kUpb_FieldModifier_IsProto3Singular));
+  ASSERT_TRUE(
+      e.PutField(kUpb_FieldType_Int32, 102, kUpb_FieldModifier_IsRepeated));
+  ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, 103, 0));
+  ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, 104, 0));
+  ASSERT_TRUE(e.StartOneof());
+  ASSERT_TRUE(e.PutOneofField(103));
+  ASSERT_TRUE(e.PutOneofField(104));
+
+  upb::Arena arena;
+  upb::Status status;
+  upb_MiniTable* table = upb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table) << status.error_message();
+  upb_PresenceIndex* index = upb_PresenceIndex_New(table, arena.ptr());
+  ASSERT_NE(nullptr, index);
+  EXPECT_EQ(table, upb_PresenceIndex_MiniTable(index));
+
+  upb_Message* msg = upb_Message_New(table, arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  EXPECT_EQ(std::set<uint32_t>{}, PresentFields(msg, index));
+
+  const uint32_t set[] = {1, 2, 63, 64, 65, 100};
+  for (uint32_t number : set) {
+    upb_Message_SetInt32(msg, upb_MiniTable_FindFieldByNumber(table, number),
+                         number, arena.ptr());
+  }
+  EXPECT_EQ(std::set<uint32_t>(set, set + 6), PresentFields(msg, index));
+
+  // Empty arrays and zero implicit-presence values are not set.
+  const upb_MiniTableField* repeated =
+      upb_MiniTable_FindFieldByNumber(table, 102);
+  upb_Array* arr =
+      upb_Message_GetOrCreateMutableArray(msg, repeated, arena.ptr());
+  ASSERT_NE(nullptr, arr);
+  upb_Message_SetInt32(msg, upb_MiniTable_FindFieldByNumber(table, 101), 0,
+                       arena.ptr());
+  EXPECT_EQ(std::set<uint32_t>(set, set + 6), PresentFields(msg, index));
+
+  upb_MessageValue val;
+  val.int32_val = 1;
+  ASSERT_TRUE(upb_Array_Append(arr, val, arena.ptr()));
+  upb_Message_SetInt32(msg, upb_MiniTable_FindFieldByNumber(table, 101), 1,
+                       arena.ptr());
+  upb_Message_SetInt32(msg, upb_MiniTable_FindFieldByNumber(table, 104), 1,
+                       arena.ptr());
+  EXPECT_EQ((std::set<uint32_t>{1, 2, 63, 64, 65, 100, 101, 102, 104}),
+            PresentFields(msg, index));
+
+  upb_Message_ClearField(msg, upb_MiniTable_FindFieldByNumber(table, 64));
+  upb_Message_SetInt32(msg, upb_MiniTable_FindFieldByNumber(table, 103), 1,
+                       arena.ptr());
+  EXPECT_EQ((std::set<uint32_t>{1, 2, 63, 65, 100, 101, 102, 103}),
+            PresentFields(msg, index));
+}
+
+TEST(PresenceIndexTest, NoHasbits) {
+  // The first field lives where hasbits would be.
+  upb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartMessage(0));
+  ASSERT_TRUE(e.PutField(kUpb_FieldType_Int64, 1,
+                         kUpb_FieldModifier_IsProto3Singular));
+  ASSERT_TRUE(e.PutField(kUpb_FieldType_Int64, 2,
+                         kUpb_FieldModifier_IsProto3Singular));
+
+  upb::Arena arena;
+  upb::Status status;
+  upb_MiniTable* table = upb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table) << status.error_message();
+  upb_PresenceIndex* index = upb_PresenceIndex_New(table, arena.ptr());
+  ASSERT_NE(nullptr, index);
+
+  upb_Message* msg = upb_Message_New(table, arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  upb_Message_SetInt64(msg, upb_MiniTable_FindFieldByNumber(table, 1), -1,
+                       arena.ptr());
+  EXPECT_EQ(std::set<uint32_t>{1}, PresentFields(msg, index));
+}
+
+TEST(PresenceIndexTest, MatchesMessageNext) {
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_TestRequiredFields_getmsgdef(defpool.ptr()));
+  ASSERT_TRUE(m);
+
+  upb::Arena arena;
+  upb_test_TestRequiredFields* msg =
+      upb_test_TestRequiredFields_new(arena.ptr());
+  EXPECT_EQ(PresentDefs(msg, m.ptr(), upb_Message_Next),
+            PresentDefs(msg, m.ptr(), upb_Message_NextPresent));
+  upb_test_TestRequiredFields_set_required_int64(msg, 1);
+  upb_test_TestRequiredFields_mutable_optional_message(msg, arena.ptr());
+  std::set<const upb_FieldDef*> fields =
+      PresentDefs(msg, m.ptr(), upb_Message_Next);
+  EXPECT_EQ(2, fields.size());
+  EXPECT_EQ(fields, PresentDefs(msg, m.ptr(), upb_Message_NextPresent));
+}
+
+TEST(PresenceIndexTest, NextByNumberMatchesMessageNext) {
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_TestRequiredFields_getmsgdef(defpool.ptr()));
+  ASSERT_TRUE(m);
+
+  upb::Arena arena;
+  upb_test_TestRequiredFields* msg =
+      upb_test_TestRequiredFields_new(arena.ptr());
+  upb_test_TestRequiredFields_set_required_int64(msg, 1);
+  upb_test_TestRequiredFields_mutable_optional_message(msg, arena.ptr());
+  upb_test_TestRequiredFields_set_required_int32(msg, 1);
+
+  std::set<const upb_FieldDef*> fields;
+  size_t iter = kUpb_Message_Begin;
+  const upb_FieldDef* f;
+  upb_MessageValue val;
+  uint32_t last = 0;
+  while (upb_Message_NextByNumber(msg, m.ptr(), &f, &val, &iter)) {
+    EXPECT_LT(last, upb_FieldDef_Number(f));
+    last = upb_FieldDef_Number(f);
+    EXPECT_TRUE(fields.insert(f).second);
+  }
+  EXPECT_EQ(3, fields.size());
+  EXPECT_EQ(fields, PresentDefs(msg, m.ptr(), upb_Message_Next));
+}
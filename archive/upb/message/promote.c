@@ -34,11 +34,12 @@
 #include "upb/collections/internal/array.h"
 #include "upb/collections/map.h"
 #include "upb/message/accessors.h"
+#include "upb/message/internal/message.h"
 #include "upb/message/message.h"
+#include "upb/message/unknown.h"
 #include "upb/mini_table/field.h"
 #include "upb/wire/decode.h"
 #include "upb/wire/encode.h"
-#include "upb/wire/eps_copy_input_stream.h"
 #include "upb/wire/reader.h"
 
 // Must be last.
@@ -75,6 +76,56 @@ static upb_UnknownToMessageRet upb_MiniTable_ParseUnknownMessage(
   return ret;
 }
 
+// Parses the unknown fields of `msg` once into a upb_UnknownIndex, returning
+// NULL if they are malformed or we run out of memory.
+static upb_UnknownIndex* upb_UnknownIndex_Build(const upb_Message* msg,
+                                                int depth_limit,
+                                                upb_Arena* arena) {
+  upb_UnknownIndex* index = upb_Arena_Malloc(arena, sizeof(*index));
+  if (!index || !upb_inttable_init(&index->heads, arena)) return NULL;
+  index->entries = NULL;
+  index->count = 0;
+  uint32_t capacity = 0;
+  // The last entry for each field number, to append to its chain.
+  upb_inttable tails;
+  if (!upb_inttable_init(&tails, arena)) return NULL;
+
+  size_t size;
+  const char* unknown = upb_Message_GetUnknown(msg, &size);
+  upb_UnknownFieldIter iter;
+  upb_UnknownFieldIter_Init(&iter, unknown, size, depth_limit);
+  upb_UnknownFieldView field;
+
+  while (upb_UnknownFieldIter_Next(&iter, &field)) {
+    if (index->count == capacity) {
+      uint32_t new_capacity = UPB_MAX(8, capacity * 2);
+      index->entries = upb_Arena_Realloc(
+          arena, index->entries, capacity * sizeof(*index->entries),
+          new_capacity * sizeof(*index->entries));
+      if (!index->entries) return NULL;
+      capacity = new_capacity;
+    }
+    uint32_t i = index->count++;
+    upb_UnknownIndexEntry* e = &index->entries[i];
+    e->number = field.field_number;
+    e->ofs = field.encoded.data - unknown;
+    e->len = field.encoded.size;
+    e->next = UINT32_MAX;
+
+    upb_value v;
+    if (upb_inttable_lookup(&tails, e->number, &v)) {
+      index->entries[upb_value_getuint32(v)].next = i;
+      upb_inttable_replace(&tails, e->number, upb_value_uint32(i));
+    } else if (!upb_inttable_insert(&index->heads, e->number,
+                                    upb_value_uint32(i), arena) ||
+               !upb_inttable_insert(&tails, e->number, upb_value_uint32(i),
+                                    arena)) {
+      return NULL;
+    }
+  }
+  return upb_UnknownFieldIter_IsError(&iter) ? NULL : index;
+}
+
 upb_GetExtension_Status upb_MiniTable_GetOrPromoteExtension(
     upb_Message* msg, const upb_MiniTableExtension* ext_table,
     int decode_options, upb_Arena* arena,
@@ -85,7 +136,14 @@ upb_GetExtension_Status upb_MiniTable_GetOrPromoteExtension(
     return kUpb_GetExtension_Ok;
   }
 
-  // Check unknown fields, if available promote.
+  // Check unknown fields, if available promote.  Callers typically promote
+  // many extensions one after another, so index the unknown fields once
+  // rather than parsing them all again for every lookup.
+  upb_Message_InternalData* internal = upb_Message_Getinternal(msg)->internal;
+  if (internal && !internal->unknown_index && !_upb_Message_IsFrozen(msg)) {
+    internal->unknown_index =
+        upb_UnknownIndex_Build(msg, kUpb_WireFormat_DefaultDepthLimit, arena);
+  }
   int field_number = ext_table->field.number;
   upb_FindUnknownRet result = upb_MiniTable_FindUnknown(
       msg, field_number, kUpb_WireFormat_DefaultDepthLimit);
@@ -110,6 +168,17 @@ upb_GetExtension_Status upb_MiniTable_GetOrPromoteExtension(
       break;
   }
   upb_Message* extension_msg = parse_result.message;
+  if (_upb_Message_IsFrozen(msg)) {
+    // Frozen messages may be read concurrently, so we hand out a detached
+    // copy of the extension instead of adding it to |msg|.
+    upb_Message_Extension* ext = upb_Arena_Malloc(arena, sizeof(*ext));
+    if (!ext) return kUpb_GetExtension_OutOfMemory;
+    upb_Message_Freeze(extension_msg, extension_table);
+    ext->ext = ext_table;
+    memcpy(&ext->data, &extension_msg, sizeof(extension_msg));
+    *extension = ext;
+    return kUpb_GetExtension_Ok;
+  }
   // Add to extensions.
   upb_Message_Extension* ext =
       _upb_Message_GetOrCreateExtension(msg, ext_table, arena);
@@ -119,7 +188,9 @@ upb_GetExtension_Status upb_MiniTable_GetOrPromoteExtension(
   memcpy(&ext->data, &extension_msg, sizeof(extension_msg));
   *extension = ext;
   const char* delete_ptr = upb_Message_GetUnknown(msg, &len) + ofs;
-  upb_Message_DeleteUnknown(msg, delete_ptr, result.len);
+  if (!_upb_Message_DeleteUnknown(msg, delete_ptr, result.len, arena)) {
+    return kUpb_GetExtension_OutOfMemory;
+  }
   return kUpb_GetExtension_Ok;
 }
 
@@ -134,26 +205,37 @@ upb_FindUnknownRet upb_MiniTable_FindUnknown(const upb_Message* msg,
   upb_FindUnknownRet ret;
 
   const char* ptr = upb_Message_GetUnknown(msg, &size);
-  upb_EpsCopyInputStream stream;
-  upb_EpsCopyInputStream_Init(&stream, &ptr, size, true);
-
-  while (!upb_EpsCopyInputStream_IsDone(&stream, &ptr)) {
-    uint32_t tag;
-    const char* unknown_begin = ptr;
-    ptr = upb_WireReader_ReadTag(ptr, &tag);
-    if (!ptr) return upb_FindUnknownRet_ParseError();
-    if (field_number == upb_WireReader_GetFieldNumber(tag)) {
+  const upb_Message_InternalData* internal = _upb_Message_GetInternalData(msg);
+  if (internal && internal->unknown_index) {
+    const upb_UnknownIndex* index = internal->unknown_index;
+    upb_value v;
+    if (upb_inttable_lookup(&index->heads, field_number, &v)) {
+      const upb_UnknownIndexEntry* e =
+          &index->entries[upb_value_getuint32(v)];
       ret.status = kUpb_FindUnknown_Ok;
-      ret.ptr = upb_EpsCopyInputStream_GetAliasedPtr(&stream, unknown_begin);
-      ptr = _upb_WireReader_SkipValue(ptr, tag, depth_limit, &stream);
-      // Because we know that the input is a flat buffer, it is safe to perform
-      // pointer arithmetic on aliased pointers.
-      ret.len = upb_EpsCopyInputStream_GetAliasedPtr(&stream, ptr) - ret.ptr;
+      ret.ptr = ptr + e->ofs;
+      ret.len = e->len;
       return ret;
     }
+    ret.status = kUpb_FindUnknown_NotPresent;
+    ret.ptr = NULL;
+    ret.len = 0;
+    return ret;
+  }
 
-    ptr = _upb_WireReader_SkipValue(ptr, tag, depth_limit, &stream);
-    if (!ptr) return upb_FindUnknownRet_ParseError();
+  upb_UnknownFieldIter iter;
+  upb_UnknownFieldIter_Init(&iter, ptr, size, depth_limit);
+  upb_UnknownFieldView field;
+  while (upb_UnknownFieldIter_Next(&iter, &field)) {
+    if (field.field_number == field_number) {
+      ret.status = kUpb_FindUnknown_Ok;
+      ret.ptr = field.encoded.data;
+      ret.len = field.encoded.size;
+      return ret;
+    }
+  }
+  if (upb_UnknownFieldIter_IsError(&iter)) {
+    return upb_FindUnknownRet_ParseError();
   }
   ret.status = kUpb_FindUnknown_NotPresent;
   ret.ptr = NULL;
@@ -198,22 +280,112 @@ upb_DecodeStatus upb_Message_PromoteMessage(upb_Message* parent,
   return ret;
 }
 
+upb_DecodeStatus upb_Message_GetOrPromoteMessage(
+    upb_Message* parent, const upb_MiniTable* mini_table,
+    const upb_MiniTableField* field, int decode_options, upb_Arena* arena,
+    upb_Message** sub_message) {
+  upb_TaggedMessagePtr tagged =
+      upb_Message_GetTaggedMessagePtr(parent, field, NULL);
+  if (!upb_TaggedMessagePtr_IsEmpty(tagged)) {
+    *sub_message = _upb_TaggedMessagePtr_GetMessage(tagged);
+    return kUpb_DecodeStatus_Ok;
+  }
+  return upb_Message_PromoteMessage(parent, mini_table, field, decode_options,
+                                    arena, sub_message);
+}
+
+// Empty messages are promoted in batches with upb_DecodeBatch(), which reuses
+// one decoder and allocates the messages of a batch together.
+#define kUpb_PromoteBatch_Size 32
+
+typedef struct {
+  upb_StringView bufs[kUpb_PromoteBatch_Size];
+  upb_Message* msgs[kUpb_PromoteBatch_Size];
+  upb_DecodeStatus statuses[kUpb_PromoteBatch_Size];
+  size_t slots[kUpb_PromoteBatch_Size];  // Array index or map iterator.
+  size_t count;
+} upb_PromoteBatch;
+
+// Adds the empty message `tagged`, to be stored back at `slot`.  The bytes
+// are the ones it was parsed from, kept as its unknown fields.
+static void upb_PromoteBatch_Add(upb_PromoteBatch* b,
+                                 upb_TaggedMessagePtr tagged, size_t slot) {
+  upb_Message* empty = _upb_TaggedMessagePtr_GetEmptyMessage(tagged);
+  upb_StringView* buf = &b->bufs[b->count];
+  buf->data = upb_Message_GetUnknown(empty, &buf->size);
+  b->msgs[b->count] = NULL;
+  b->slots[b->count++] = slot;
+}
+
+static void upb_PromoteBatch_Decode(upb_PromoteBatch* b,
+                                    const upb_MiniTable* mini_table,
+                                    int decode_options, upb_Arena* arena) {
+  upb_DecodeBatch(b->bufs, b->count, b->msgs, mini_table, NULL, decode_options,
+                  arena, b->statuses);
+}
+
+// Returns the first failure of the batch, or kUpb_DecodeStatus_Ok.
+static upb_DecodeStatus upb_PromoteBatch_Status(const upb_PromoteBatch* b) {
+  for (size_t i = 0; i < b->count; i++) {
+    if (b->statuses[i] != kUpb_DecodeStatus_Ok) return b->statuses[i];
+  }
+  return kUpb_DecodeStatus_Ok;
+}
+
+static upb_DecodeStatus upb_Array_FlushPromoteBatch(upb_Array* arr,
+                                                    upb_PromoteBatch* b,
+                                                    const upb_MiniTable* m,
+                                                    int decode_options,
+                                                    upb_Arena* arena) {
+  upb_PromoteBatch_Decode(b, m, decode_options, arena);
+  upb_TaggedMessagePtr* data = _upb_array_ptr(arr);
+  for (size_t i = 0; i < b->count; i++) {
+    if (b->statuses[i] != kUpb_DecodeStatus_Ok) continue;
+    data[b->slots[i]] = _upb_TaggedMessagePtr_Pack(b->msgs[i], false);
+  }
+  upb_DecodeStatus status = upb_PromoteBatch_Status(b);
+  b->count = 0;
+  return status;
+}
+
 upb_DecodeStatus upb_Array_PromoteMessages(upb_Array* arr,
                                            const upb_MiniTable* mini_table,
                                            int decode_options,
                                            upb_Arena* arena) {
-  void** data = _upb_array_ptr(arr);
+  // Inline messages are always linked.
+  if (_upb_Array_HasInlineMessages(arr)) return kUpb_DecodeStatus_Ok;
+  const upb_TaggedMessagePtr* data = _upb_array_constptr(arr);
   size_t size = arr->size;
+  upb_PromoteBatch batch;
+  batch.count = 0;
   for (size_t i = 0; i < size; i++) {
-    upb_TaggedMessagePtr tagged;
-    memcpy(&tagged, &data[i], sizeof(tagged));
-    if (!upb_TaggedMessagePtr_IsEmpty(tagged)) continue;
-    upb_DecodeStatus status =
-        upb_Message_PromoteOne(&tagged, mini_table, decode_options, arena);
+    if (!upb_TaggedMessagePtr_IsEmpty(data[i])) continue;
+    upb_PromoteBatch_Add(&batch, data[i], i);
+    if (batch.count < kUpb_PromoteBatch_Size) continue;
+    upb_DecodeStatus status = upb_Array_FlushPromoteBatch(
+        arr, &batch, mini_table, decode_options, arena);
     if (status != kUpb_DecodeStatus_Ok) return status;
-    memcpy(&data[i], &tagged, sizeof(tagged));
   }
-  return kUpb_DecodeStatus_Ok;
+  if (batch.count == 0) return kUpb_DecodeStatus_Ok;
+  return upb_Array_FlushPromoteBatch(arr, &batch, mini_table, decode_options,
+                                     arena);
+}
+
+static upb_DecodeStatus upb_Map_FlushPromoteBatch(upb_Map* map,
+                                                  upb_PromoteBatch* b,
+                                                  const upb_MiniTable* m,
+                                                  int decode_options,
+                                                  upb_Arena* arena) {
+  upb_PromoteBatch_Decode(b, m, decode_options, arena);
+  for (size_t i = 0; i < b->count; i++) {
+    if (b->statuses[i] != kUpb_DecodeStatus_Ok) continue;
+    upb_MessageValue val;
+    val.tagged_msg_val = _upb_TaggedMessagePtr_Pack(b->msgs[i], false);
+    upb_Map_SetEntryValue(map, b->slots[i], val);
+  }
+  upb_DecodeStatus status = upb_PromoteBatch_Status(b);
+  b->count = 0;
+  return status;
 }
 
 upb_DecodeStatus upb_Map_PromoteMessages(upb_Map* map,
@@ -221,16 +393,153 @@ upb_DecodeStatus upb_Map_PromoteMessages(upb_Map* map,
                                          int decode_options, upb_Arena* arena) {
   size_t iter = kUpb_Map_Begin;
   upb_MessageValue key, val;
+  upb_PromoteBatch batch;
+  batch.count = 0;
   while (upb_Map_Next(map, &key, &val, &iter)) {
     if (!upb_TaggedMessagePtr_IsEmpty(val.tagged_msg_val)) continue;
-    upb_DecodeStatus status = upb_Message_PromoteOne(
-        &val.tagged_msg_val, mini_table, decode_options, arena);
+    upb_PromoteBatch_Add(&batch, val.tagged_msg_val, iter);
+    if (batch.count < kUpb_PromoteBatch_Size) continue;
+    upb_DecodeStatus status = upb_Map_FlushPromoteBatch(
+        map, &batch, mini_table, decode_options, arena);
+    if (status != kUpb_DecodeStatus_Ok) return status;
+  }
+  if (batch.count == 0) return kUpb_DecodeStatus_Ok;
+  return upb_Map_FlushPromoteBatch(map, &batch, mini_table, decode_options,
+                                   arena);
+}
+
+static upb_DecodeStatus upb_Message_DoPromoteAll(upb_Message* msg,
+                                                 const upb_MiniTable* m,
+                                                 int decode_options,
+                                                 upb_Arena* arena);
+
+// Returns whether `m` is a real message type, rather than the placeholder of
+// an unlinked field.
+static bool upb_Promote_IsLinked(const upb_MiniTable* m) {
+  return m != &_kUpb_MiniTable_Empty;
+}
+
+// Walks the non-empty messages of `arr` first, so that the ones promoted
+// afterwards, which are fully parsed already, are not walked again.
+static upb_DecodeStatus upb_Array_PromoteAll(upb_Array* arr,
+                                             const upb_MiniTable* m,
+                                             int decode_options,
+                                             upb_Arena* arena) {
+  if (_upb_Array_HasInlineMessages(arr)) {
+    for (size_t i = 0; i < arr->size; i++) {
+      upb_DecodeStatus status = upb_Message_DoPromoteAll(
+          _upb_Array_InlineMessage(arr, i), m, decode_options, arena);
+      if (status != kUpb_DecodeStatus_Ok) return status;
+    }
+    return kUpb_DecodeStatus_Ok;
+  }
+  const upb_TaggedMessagePtr* data = _upb_array_constptr(arr);
+  bool has_empty = false;
+  for (size_t i = 0; i < arr->size; i++) {
+    if (upb_TaggedMessagePtr_IsEmpty(data[i])) {
+      has_empty = true;
+      continue;
+    }
+    upb_DecodeStatus status = upb_Message_DoPromoteAll(
+        _upb_TaggedMessagePtr_GetMessage(data[i]), m, decode_options, arena);
+    if (status != kUpb_DecodeStatus_Ok) return status;
+  }
+  if (!has_empty || !upb_Promote_IsLinked(m)) return kUpb_DecodeStatus_Ok;
+  return upb_Array_PromoteMessages(arr, m, decode_options, arena);
+}
+
+static upb_DecodeStatus upb_Map_PromoteAll(upb_Map* map, const upb_MiniTable* m,
+                                           int decode_options,
+                                           upb_Arena* arena) {
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue key, val;
+  bool has_empty = false;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    if (upb_TaggedMessagePtr_IsEmpty(val.tagged_msg_val)) {
+      has_empty = true;
+      continue;
+    }
+    upb_DecodeStatus status = upb_Message_DoPromoteAll(
+        _upb_TaggedMessagePtr_GetMessage(val.tagged_msg_val), m,
+        decode_options, arena);
+    if (status != kUpb_DecodeStatus_Ok) return status;
+  }
+  if (!has_empty || !upb_Promote_IsLinked(m)) return kUpb_DecodeStatus_Ok;
+  return upb_Map_PromoteMessages(map, m, decode_options, arena);
+}
+
+static upb_DecodeStatus upb_Message_DoPromoteAll(upb_Message* msg,
+                                                 const upb_MiniTable* m,
+                                                 int decode_options,
+                                                 upb_Arena* arena) {
+  upb_DecodeStatus status = kUpb_DecodeStatus_Ok;
+  for (size_t i = 0; i < m->field_count; i++) {
+    const upb_MiniTableField* field = &m->fields[i];
+    if (upb_MiniTableField_CType(field) != kUpb_CType_Message) continue;
+    const upb_MiniTable* sub = m->subs[field->UPB_PRIVATE(submsg_index)].submsg;
+    switch (upb_FieldMode_Get(field)) {
+      case kUpb_FieldMode_Scalar: {
+        upb_TaggedMessagePtr tagged =
+            upb_Message_GetTaggedMessagePtr(msg, field, NULL);
+        if (!tagged) break;
+        if (!upb_TaggedMessagePtr_IsEmpty(tagged)) {
+          status = upb_Message_DoPromoteAll(
+              _upb_TaggedMessagePtr_GetMessage(tagged), sub, decode_options,
+              arena);
+        } else if (upb_Promote_IsLinked(sub)) {
+          upb_Message* promoted;
+          status = upb_Message_PromoteMessage(msg, m, field, decode_options,
+                                              arena, &promoted);
+        }
+        break;
+      }
+      case kUpb_FieldMode_Array: {
+        upb_Array* arr = upb_Message_GetMutableArray(msg, field);
+        if (arr) status = upb_Array_PromoteAll(arr, sub, decode_options, arena);
+        break;
+      }
+      case kUpb_FieldMode_Map: {
+        upb_Map* map = upb_Message_GetMutableMap(msg, field);
+        const upb_MiniTableField* val_field = &sub->fields[1];
+        if (!map || upb_MiniTableField_CType(val_field) != kUpb_CType_Message) {
+          break;
+        }
+        status = upb_Map_PromoteAll(
+            map, sub->subs[val_field->UPB_PRIVATE(submsg_index)].submsg,
+            decode_options, arena);
+        break;
+      }
+    }
+    if (status != kUpb_DecodeStatus_Ok) return status;
+  }
+
+  // Extensions are always linked and parsed eagerly, but may contain empty
+  // messages further down.
+  size_t count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &count);
+  for (size_t i = 0; i < count; i++) {
+    const upb_MiniTableExtension* e = ext[i].ext;
+    if (upb_MiniTableField_CType(&e->field) != kUpb_CType_Message) continue;
+    if (upb_IsRepeatedOrMap(&e->field)) {
+      status = upb_Array_PromoteAll((upb_Array*)ext[i].data.ptr, e->sub.submsg,
+                                    decode_options, arena);
+    } else {
+      status = upb_Message_DoPromoteAll((upb_Message*)ext[i].data.ptr,
+                                        e->sub.submsg, decode_options, arena);
+    }
     if (status != kUpb_DecodeStatus_Ok) return status;
-    upb_Map_SetEntryValue(map, iter, val);
   }
   return kUpb_DecodeStatus_Ok;
 }
 
+upb_DecodeStatus upb_Message_PromoteAll(upb_Message* msg,
+                                        const upb_MiniTable* mini_table,
+                                        int decode_options, upb_Arena* arena) {
+  // Promoted messages are parsed in full, so they need no further walk.
+  decode_options &= ~kUpb_DecodeOption_ExperimentalLazySubMessages;
+  return upb_Message_DoPromoteAll(msg, mini_table, decode_options, arena);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // OLD promotion functions, will be removed!
 ////////////////////////////////////////////////////////////////////////////////
@@ -265,7 +574,11 @@ upb_UnknownToMessageRet upb_MiniTable_PromoteUnknownToMessage(
                                                 decode_options, arena);
         if (ret.status == kUpb_UnknownToMessage_Ok) {
           message = ret.message;
-          upb_Message_DeleteUnknown(msg, unknown_data, unknown_size);
+          if (!_upb_Message_DeleteUnknown(msg, unknown_data, unknown_size,
+                                          arena)) {
+            ret.status = kUpb_UnknownToMessage_OutOfMemory;
+            return ret;
+          }
         }
       } break;
       case kUpb_FindUnknown_ParseError:
@@ -318,7 +631,9 @@ upb_UnknownToMessage_Status upb_MiniTable_PromoteUnknownToMessageArray(
         if (!upb_Array_Append(repeated_messages, value, arena)) {
           return kUpb_UnknownToMessage_OutOfMemory;
         }
-        upb_Message_DeleteUnknown(msg, unknown.ptr, unknown.len);
+        if (!_upb_Message_DeleteUnknown(msg, unknown.ptr, unknown.len, arena)) {
+          return kUpb_UnknownToMessage_OutOfMemory;
+        }
       } else {
         return ret.status;
       }
@@ -358,7 +673,9 @@ upb_UnknownToMessage_Status upb_MiniTable_PromoteUnknownToMap(
     }
     UPB_ASSUME(insert_status == kUpb_MapInsertStatus_Inserted ||
                insert_status == kUpb_MapInsertStatus_Replaced);
-    upb_Message_DeleteUnknown(msg, unknown.ptr, unknown.len);
+    if (!_upb_Message_DeleteUnknown(msg, unknown.ptr, unknown.len, arena)) {
+      return kUpb_UnknownToMessage_OutOfMemory;
+    }
   }
   return kUpb_UnknownToMessage_Ok;
 }
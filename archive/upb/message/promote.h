@@ -58,6 +58,10 @@ typedef enum {
 // Returns a message extension or promotes an unknown field to
 // an extension.
 //
+// A frozen message (see upb_Message_Freeze()) is not modified: an extension
+// found in its unknown fields is parsed into a new, frozen extension message
+// allocated from `arena` on every call.
+//
 // TODO(ferhat): Only supports extension fields that are messages,
 // expand support to include non-message types.
 upb_GetExtension_Status upb_MiniTable_GetOrPromoteExtension(
@@ -119,6 +123,17 @@ upb_DecodeStatus upb_Message_PromoteMessage(upb_Message* parent,
                                             upb_Arena* arena,
                                             upb_Message** promoted);
 
+// Returns the value of the non-repeated message field `field` in `*sub_message`
+// (NULL if it is not set), first promoting it if it is "empty", for example
+// because it was parsed with kUpb_DecodeOption_ExperimentalLazySubMessages.
+// `field` must be linked.
+//
+// If promotion fails, the error is returned and `parent` is unchanged.
+upb_DecodeStatus upb_Message_GetOrPromoteMessage(
+    upb_Message* parent, const upb_MiniTable* mini_table,
+    const upb_MiniTableField* field, int decode_options, upb_Arena* arena,
+    upb_Message** sub_message);
+
 // Promotes any "empty" messages in this array to a message of the correct type
 // `mini_table`.  This function should only be called for arrays of messages.
 //
@@ -139,6 +154,21 @@ upb_DecodeStatus upb_Map_PromoteMessages(upb_Map* map,
                                          const upb_MiniTable* mini_table,
                                          int decode_options, upb_Arena* arena);
 
+// Promotes every "empty" message in the tree of `msg` whose type is linked
+// now, in a single walk: sub-messages, arrays, map values and extensions,
+// recursively.  The empty messages of an array or map are parsed in batches
+// that share a decoder and an allocation (see upb_DecodeBatch()), from the
+// bytes they were originally parsed from.  Promoted messages are parsed in
+// full, even if `decode_options` asks for lazy sub-messages, so only fields
+// that are still unlinked stay empty; these need
+// kUpb_DecodeOption_ExperimentalAllowUnlinked.
+//
+// If the return value indicates an error status, some but not all messages
+// may have been promoted, but the tree itself will not be corrupted.
+upb_DecodeStatus upb_Message_PromoteAll(upb_Message* msg,
+                                        const upb_MiniTable* mini_table,
+                                        int decode_options, upb_Arena* arena);
+
 ////////////////////////////////////////////////////////////////////////////////
 // OLD promotion interfaces, will be removed!
 ////////////////////////////////////////////////////////////////////////////////
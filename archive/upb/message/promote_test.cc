@@ -46,6 +46,7 @@
 #include "upb/mem/arena.hpp"
 #include "upb/message/accessors.h"
 #include "upb/message/copy.h"
+#include "upb/message/internal/message.h"
 #include "upb/mini_descriptor/internal/encode.hpp"
 #include "upb/mini_descriptor/internal/modifiers.h"
 #include "upb/test/test.upb.h"
@@ -238,6 +239,102 @@ TEST(GeneratedCode, Extensions) {
   upb_Arena_Free(arena);
 }
 
+TEST(GeneratedCode, ExtensionsFromFrozenMessage) {
+  upb::Arena arena;
+  upb_test_ModelWithExtensions* msg =
+      upb_test_ModelWithExtensions_new(arena.ptr());
+  upb_test_ModelExtension2* extension =
+      upb_test_ModelExtension2_new(arena.ptr());
+  upb_test_ModelExtension2_set_i(extension, 5);
+  upb_test_ModelExtension2_set_model_ext(msg, extension, arena.ptr());
+  size_t size;
+  char* serialized =
+      upb_test_ModelWithExtensions_serialize(msg, arena.ptr(), &size);
+  upb_test_EmptyMessageWithExtensions* base_msg =
+      upb_test_EmptyMessageWithExtensions_parse(serialized, size, arena.ptr());
+  upb_Message_Freeze(base_msg, &upb_test_EmptyMessageWithExtensions_msg_init);
+  size_t start_len;
+  upb_Message_GetUnknown(base_msg, &start_len);
+
+  // The extension is parsed anew each time, leaving the message untouched.
+  for (int i = 0; i < 2; i++) {
+    const upb_Message_Extension* upb_ext;
+    upb_GetExtension_Status promote_status =
+        upb_MiniTable_GetOrPromoteExtension(
+            base_msg, &upb_test_ModelExtension2_model_ext_ext, 0, arena.ptr(),
+            &upb_ext);
+    EXPECT_EQ(kUpb_GetExtension_Ok, promote_status);
+    upb_test_ModelExtension2* ext2 =
+        (upb_test_ModelExtension2*)upb_ext->data.ptr;
+    EXPECT_EQ(5, upb_test_ModelExtension2_i(ext2));
+    EXPECT_TRUE(upb_Message_IsFrozen(ext2));
+  }
+  size_t end_len;
+  upb_Message_GetUnknown(base_msg, &end_len);
+  EXPECT_EQ(start_len, end_len);
+  EXPECT_EQ(0, upb_Message_ExtensionCount(base_msg));
+}
+
+TEST(GeneratedCode, ExtensionsPromotedOutOfOrder) {
+  upb_Arena* arena = upb_Arena_New();
+  upb_test_ModelWithExtensions* msg = upb_test_ModelWithExtensions_new(arena);
+  const upb_MiniTableExtension* exts[] = {
+      &upb_test_ModelExtension2_model_ext_ext,
+      &upb_test_ModelExtension2_model_ext_2_ext,
+      &upb_test_ModelExtension2_model_ext_3_ext,
+      &upb_test_ModelExtension2_model_ext_4_ext,
+      &upb_test_ModelExtension2_model_ext_5_ext,
+  };
+  void (*setters[])(struct upb_test_ModelWithExtensions*,
+                    const upb_test_ModelExtension2*, upb_Arena*) = {
+      upb_test_ModelExtension2_set_model_ext,
+      upb_test_ModelExtension2_set_model_ext_2,
+      upb_test_ModelExtension2_set_model_ext_3,
+      upb_test_ModelExtension2_set_model_ext_4,
+      upb_test_ModelExtension2_set_model_ext_5,
+  };
+  for (int i = 0; i < 5; i++) {
+    upb_test_ModelExtension2* ext = upb_test_ModelExtension2_new(arena);
+    upb_test_ModelExtension2_set_i(ext, i);
+    setters[i](msg, ext, arena);
+  }
+  size_t serialized_size;
+  char* serialized =
+      upb_test_ModelWithExtensions_serialize(msg, arena, &serialized_size);
+  upb_test_EmptyMessageWithExtensions* base_msg =
+      upb_test_EmptyMessageWithExtensions_parse(serialized, serialized_size,
+                                                arena);
+
+  // Promoting from the middle and the ends of the unknown fields must keep
+  // every later lookup pointing at the right bytes.
+  const upb_Message_Extension* upb_ext;
+  for (int i : {2, 0, 4, 1, 3}) {
+    upb_GetExtension_Status promote_status =
+        upb_MiniTable_GetOrPromoteExtension(base_msg, exts[i], 0, arena,
+                                            &upb_ext);
+    EXPECT_EQ(kUpb_GetExtension_Ok, promote_status);
+    EXPECT_EQ(i, upb_test_ModelExtension2_i(
+                     (upb_test_ModelExtension2*)upb_ext->data.ptr));
+    EXPECT_EQ(kUpb_FindUnknown_NotPresent,
+              upb_MiniTable_FindUnknown(base_msg, exts[i]->field.number,
+                                        kUpb_WireFormat_DefaultDepthLimit)
+                  .status);
+  }
+  size_t unknown_size;
+  upb_Message_GetUnknown(base_msg, &unknown_size);
+  EXPECT_EQ(0, unknown_size);
+  EXPECT_EQ(5, upb_Message_ExtensionCount(base_msg));
+
+  // Unknown fields added after promotion are found as well.
+  ASSERT_TRUE(
+      _upb_Message_AddUnknown(base_msg, serialized, serialized_size, arena));
+  upb_FindUnknownRet result = upb_MiniTable_FindUnknown(
+      base_msg, exts[3]->field.number, kUpb_WireFormat_DefaultDepthLimit);
+  EXPECT_EQ(kUpb_FindUnknown_Ok, result.status);
+
+  upb_Arena_Free(arena);
+}
+
 // Create a minitable to mimic ModelWithSubMessages with unlinked subs
 // to lazily promote unknowns after parsing.
 upb_MiniTable* CreateMiniTableWithEmptySubTables(upb_Arena* arena) {
@@ -568,6 +665,173 @@ TEST(GeneratedCode, PromoteUnknownRepeatedMessage) {
             6);
 }
 
+TEST(GeneratedCode, LazySubMessages) {
+  upb::Arena arena;
+  upb_test_ModelWithSubMessages* input_msg =
+      upb_test_ModelWithSubMessages_new(arena.ptr());
+  upb_test_ModelWithSubMessages_set_id(input_msg, 11);
+  upb_test_ModelWithExtensions* child =
+      upb_test_ModelWithSubMessages_mutable_optional_child(input_msg,
+                                                           arena.ptr());
+  upb_test_ModelWithExtensions_set_random_int32(child, 12);
+  upb_test_ModelWithExtensions* item =
+      upb_test_ModelWithSubMessages_add_items(input_msg, arena.ptr());
+  upb_test_ModelWithExtensions_set_random_int32(item, 5);
+  item = upb_test_ModelWithSubMessages_add_items(input_msg, arena.ptr());
+  upb_test_ModelWithExtensions_set_random_int32(item, 6);
+  size_t size;
+  char* data =
+      upb_test_ModelWithSubMessages_serialize(input_msg, arena.ptr(), &size);
+
+  // A second occurrence of optional_child {repeated_int32: 7}, which merges
+  // into the first.
+  std::string serialized(data, size);
+  serialized.append("\x2a\x02\x28\x07", 4);
+
+  const upb_MiniTable* mini_table = &upb_test_ModelWithSubMessages_msg_init;
+  const int decode_options = kUpb_DecodeOption_ExperimentalLazySubMessages;
+  upb_Message* msg = _upb_Message_New(mini_table, arena.ptr());
+  upb_DecodeStatus decode_status =
+      upb_Decode(serialized.data(), serialized.size(), msg, mini_table,
+                 nullptr, decode_options, arena.ptr());
+  ASSERT_EQ(decode_status, kUpb_DecodeStatus_Ok);
+
+  // The parent's own fields are parsed as usual.
+  EXPECT_EQ(upb_Message_GetInt32(
+                msg, upb_MiniTable_FindFieldByNumber(mini_table, 4), 0),
+            11);
+
+  // Sub-messages are present but have not been parsed.
+  const upb_MiniTableField* child_field =
+      upb_MiniTable_FindFieldByNumber(mini_table, 5);
+  const upb_MiniTableField* items_field =
+      upb_MiniTable_FindFieldByNumber(mini_table, 6);
+  EXPECT_TRUE(upb_Message_HasField(msg, child_field));
+  EXPECT_TRUE(upb_TaggedMessagePtr_IsEmpty(
+      upb_Message_GetTaggedMessagePtr(msg, child_field, nullptr)));
+  upb_Array* items = upb_Message_GetMutableArray(msg, items_field);
+  ASSERT_EQ(2, upb_Array_Size(items));
+
+  // Lazy messages reserialize to the same bytes as eagerly parsed ones.
+  upb_test_ModelWithSubMessages* eager = upb_test_ModelWithSubMessages_parse(
+      serialized.data(), serialized.size(), arena.ptr());
+  ASSERT_NE(nullptr, eager);
+  size_t eager_size;
+  char* eager_data =
+      upb_test_ModelWithSubMessages_serialize(eager, arena.ptr(), &eager_size);
+  CheckReserialize(msg, mini_table, arena.ptr(), eager_data, eager_size);
+
+  // Sub-messages are parsed on first access.
+  upb_Message* promoted;
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Message_GetOrPromoteMessage(msg, mini_table, child_field,
+                                            decode_options, arena.ptr(),
+                                            &promoted));
+  ASSERT_NE(nullptr, promoted);
+  EXPECT_EQ(promoted, upb_Message_GetMessage(msg, child_field, nullptr));
+  child = (upb_test_ModelWithExtensions*)promoted;
+  EXPECT_EQ(upb_test_ModelWithExtensions_random_int32(child), 12);
+  size_t repeated_size;
+  const int32_t* repeated =
+      upb_test_ModelWithExtensions_repeated_int32(child, &repeated_size);
+  ASSERT_EQ(repeated_size, 1);
+  EXPECT_EQ(repeated[0], 7);
+
+  // Accessing it again returns the same message.
+  upb_Message* again;
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Message_GetOrPromoteMessage(msg, mini_table, child_field,
+                                            decode_options, arena.ptr(),
+                                            &again));
+  EXPECT_EQ(promoted, again);
+
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Array_PromoteMessages(items,
+                                      &upb_test_ModelWithExtensions_msg_init,
+                                      decode_options, arena.ptr()));
+  EXPECT_EQ(upb_test_ModelWithExtensions_random_int32(
+                (upb_test_ModelWithExtensions*)upb_Array_Get(items, 0).msg_val),
+            5);
+  EXPECT_EQ(upb_test_ModelWithExtensions_random_int32(
+                (upb_test_ModelWithExtensions*)upb_Array_Get(items, 1).msg_val),
+            6);
+}
+
+TEST(GeneratedCode, LazySubMessageErrorOnPromote) {
+  upb::Arena arena;
+  const upb_MiniTable* mini_table = &upb_test_ModelWithSubMessages_msg_init;
+  const upb_MiniTableField* child_field =
+      upb_MiniTable_FindFieldByNumber(mini_table, 5);
+
+  // optional_child holds a truncated varint.
+  std::string serialized("\x2a\x02\x18\x80", 4);
+  const int decode_options = kUpb_DecodeOption_ExperimentalLazySubMessages;
+  upb_Message* msg = _upb_Message_New(mini_table, arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(serialized.data(), serialized.size(), msg, mini_table,
+                       nullptr, decode_options, arena.ptr()));
+
+  // The error surfaces when the sub-message is first accessed.
+  upb_Message* promoted = nullptr;
+  EXPECT_EQ(kUpb_DecodeStatus_Malformed,
+            upb_Message_GetOrPromoteMessage(msg, mini_table, child_field,
+                                            decode_options, arena.ptr(),
+                                            &promoted));
+  EXPECT_TRUE(upb_TaggedMessagePtr_IsEmpty(
+      upb_Message_GetTaggedMessagePtr(msg, child_field, nullptr)));
+}
+
+TEST(GeneratedCode, PromoteAllLazySubMessages) {
+  upb::Arena arena;
+  upb_test_ModelWithSubMessages* input_msg =
+      upb_test_ModelWithSubMessages_new(arena.ptr());
+  upb_test_ModelWithExtensions* child =
+      upb_test_ModelWithSubMessages_mutable_optional_child(input_msg,
+                                                           arena.ptr());
+  upb_test_ModelWithExtensions_set_random_int32(child, 12);
+  // Enough items for several decode batches.
+  const int kItems = 100;
+  for (int i = 0; i < kItems; i++) {
+    upb_test_ModelWithExtensions* item =
+        upb_test_ModelWithSubMessages_add_items(input_msg, arena.ptr());
+    upb_test_ModelWithExtensions_set_random_int32(item, i);
+  }
+  size_t size;
+  char* data =
+      upb_test_ModelWithSubMessages_serialize(input_msg, arena.ptr(), &size);
+
+  const upb_MiniTable* mini_table = &upb_test_ModelWithSubMessages_msg_init;
+  const int decode_options = kUpb_DecodeOption_ExperimentalLazySubMessages;
+  upb_Message* msg = _upb_Message_New(mini_table, arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(data, size, msg, mini_table, nullptr, decode_options,
+                       arena.ptr()));
+
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Message_PromoteAll(msg, mini_table, decode_options,
+                                   arena.ptr()));
+  const upb_MiniTableField* child_field =
+      upb_MiniTable_FindFieldByNumber(mini_table, 5);
+  upb_TaggedMessagePtr tagged =
+      upb_Message_GetTaggedMessagePtr(msg, child_field, nullptr);
+  ASSERT_FALSE(upb_TaggedMessagePtr_IsEmpty(tagged));
+  EXPECT_EQ(upb_test_ModelWithExtensions_random_int32(
+                (upb_test_ModelWithExtensions*)
+                    upb_TaggedMessagePtr_GetNonEmptyMessage(tagged)),
+            12);
+  const upb_Array* items = upb_Message_GetArray(
+      msg, upb_MiniTable_FindFieldByNumber(mini_table, 6));
+  ASSERT_EQ(kItems, upb_Array_Size(items));
+  for (int i = 0; i < kItems; i++) {
+    upb_MessageValue val = upb_Array_Get(items, i);
+    ASSERT_FALSE(upb_TaggedMessagePtr_IsEmpty(val.tagged_msg_val));
+    EXPECT_EQ(upb_test_ModelWithExtensions_random_int32(
+                  (upb_test_ModelWithExtensions*)val.msg_val),
+              i);
+  }
+  CheckReserialize(msg, mini_table, arena.ptr(), data, size);
+}
+
 TEST(GeneratedCode, PromoteUnknownToMap) {
   upb::Arena arena;
   upb_test_ModelWithMaps* input_msg = upb_test_ModelWithMaps_new(arena.ptr());
@@ -0,0 +1,133 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/reuse.h"
+
+#include <stdint.h>
+
+#include "upb/collections/internal/array.h"
+#include "upb/collections/internal/map.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/internal/message.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/internal/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Clears the sub-message `tagged` for reuse.  Returns false if it cannot be
+// kept: it is unlinked, unknown to us or frozen, and so cannot be cleared.
+static bool _upb_TaggedMessage_ClearForReuse(upb_TaggedMessagePtr tagged,
+                                             const upb_MiniTable* mini_table) {
+  upb_Message* msg = _upb_TaggedMessagePtr_GetMessage(tagged);
+  if (!msg || upb_TaggedMessagePtr_IsEmpty(tagged) || !mini_table ||
+      _upb_Message_IsFrozen(msg)) {
+    return false;
+  }
+  upb_Message_ClearForReuse(msg, mini_table);
+  return true;
+}
+
+static void _upb_Array_ClearForReuse(upb_Array* arr,
+                                     const upb_MiniTableField* field,
+                                     const upb_MiniTable* sub) {
+  if (upb_MiniTableField_CType(field) == kUpb_CType_Message &&
+      !_upb_Array_HasInlineMessages(arr)) {
+    // Elements that an earlier clear kept, and the decoder did not use, are
+    // kept again along with the ones in the array now.
+    size_t n = UPB_MAX(arr->size, arr->retained);
+    if (n > UINT32_MAX) n = UINT32_MAX;
+    upb_TaggedMessagePtr* elems = _upb_array_ptr(arr);
+    for (size_t i = 0; i < n; i++) {
+      if (!_upb_TaggedMessage_ClearForReuse(elems[i], sub)) elems[i] = 0;
+    }
+    arr->retained = n;
+  }
+  arr->size = 0;
+}
+
+void upb_Message_ClearForReuse(upb_Message* msg,
+                               const upb_MiniTable* mini_table) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Message_Modified(msg);
+  for (size_t i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    void* ptr = _upb_MiniTableField_GetPtr(msg, field);
+    if (!ptr) continue;  // Out-of-line field that was never set.
+    bool is_message = upb_MiniTableField_CType(field) == kUpb_CType_Message;
+    const upb_MiniTable* sub =
+        is_message && field->UPB_PRIVATE(submsg_index) != kUpb_NoSub
+            ? upb_MiniTable_GetSubMessageTable(mini_table, field)
+            : NULL;
+
+    switch (upb_FieldMode_Get(field)) {
+      case kUpb_FieldMode_Map: {
+        upb_Map** map = ptr;
+        if (!*map) break;
+        if ((*map)->is_frozen) {
+          *map = NULL;
+        } else {
+          _upb_Map_Clear(*map);
+        }
+        break;
+      }
+      case kUpb_FieldMode_Array: {
+        upb_Array** arr = ptr;
+        if (!*arr) break;
+        if ((*arr)->is_frozen) {
+          *arr = NULL;
+        } else {
+          _upb_Array_ClearForReuse(*arr, field, sub);
+        }
+        break;
+      }
+      case kUpb_FieldMode_Scalar: {
+        // The parser merges into a sub-message that is already there, whether
+        // or not its hasbit is set.  Members of a oneof share their storage,
+        // so they are never kept.
+        if (is_message && field->presence > 0 &&
+            _upb_TaggedMessage_ClearForReuse(*(upb_TaggedMessagePtr*)ptr,
+                                             sub)) {
+          _upb_clearhas(msg, _upb_Message_Hasidx(field));
+        } else {
+          _upb_Message_ClearNonExtensionField(msg, field);
+        }
+        break;
+      }
+    }
+  }
+
+  upb_Message_InternalData* in = upb_Message_Getinternal(msg)->internal;
+  if (in) {
+    in->ext_begin = in->size;
+    in->ext_index = NULL;
+  }
+  _upb_Message_DiscardUnknown_shallow(msg);
+}
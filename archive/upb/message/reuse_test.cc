@@ -0,0 +1,155 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/reuse.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "upb/base/descriptor_constants.h"
+#include "upb/base/status.hpp"
+#include "upb/collections/array.h"
+#include "upb/mem/arena.h"
+#include "upb/mem/arena.hpp"
+#include "upb/message/accessors.h"
+#include "upb/message/message.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_table/message.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+
+namespace {
+
+class ClearForReuseTest : public testing::Test {
+ protected:
+  // A proto2 message with an int32 (1), itself (2), a repeated itself (3) and
+  // a repeated int32 (4).
+  void SetUp() override {
+    upb::MtDataEncoder e;
+    ASSERT_TRUE(e.StartMessage(0));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, 1, 0));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Message, 2, 0));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Message, 3,
+                           kUpb_FieldModifier_IsRepeated));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, 4,
+                           kUpb_FieldModifier_IsRepeated));
+    upb::Status status;
+    mt_ = upb_MiniTable_Build(e.data().data(), e.data().size(), arena_.ptr(),
+                              status.ptr());
+    ASSERT_NE(mt_, nullptr);
+    for (uint32_t number : {2, 3}) {
+      ASSERT_TRUE(upb_MiniTable_SetSubMessage(
+          mt_, const_cast<upb_MiniTableField*>(
+                   upb_MiniTable_FindFieldByNumber(mt_, number)),
+          mt_));
+    }
+  }
+
+  const upb_MiniTableField* Field(uint32_t number) {
+    return upb_MiniTable_FindFieldByNumber(mt_, number);
+  }
+
+  const upb_Message* Element(const upb_Message* msg, size_t i) {
+    return upb_Array_Get(upb_Message_GetArray(msg, Field(3)), i).msg_val;
+  }
+
+  upb_DecodeStatus Decode(const std::string& data, upb_Message* msg) {
+    return upb_Decode(data.data(), data.size(), msg, mt_, nullptr,
+                      kUpb_DecodeOption_ReuseRetained, arena_.ptr());
+  }
+
+  upb::Arena arena_;
+  upb_MiniTable* mt_;
+};
+
+// {1: 5, 2: {1: 7}, 3: [{1: 1}, {1: 2}], 4: [1, 2, 3]}
+const std::string kFull("\x08\x05\x12\x02\x08\x07\x1a\x02\x08\x01\x1a\x02\x08"
+                        "\x02\x20\x01\x20\x02\x20\x03",
+                        20);
+
+TEST_F(ClearForReuseTest, ClearsButKeepsMemory) {
+  upb_Message* msg = upb_Message_New(mt_, arena_.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, Decode(kFull, msg));
+  const upb_Message* sub = upb_Message_GetMessage(msg, Field(2), nullptr);
+  const upb_Array* elems = upb_Message_GetArray(msg, Field(3));
+  const upb_Message* first = Element(msg, 0);
+  const upb_Message* second = Element(msg, 1);
+
+  upb_Message_ClearForReuse(msg, mt_);
+  EXPECT_FALSE(upb_Message_HasField(msg, Field(1)));
+  EXPECT_FALSE(upb_Message_HasField(msg, Field(2)));
+  EXPECT_EQ(0, upb_Array_Size(elems));
+  EXPECT_EQ(0, upb_Array_Size(upb_Message_GetArray(msg, Field(4))));
+  EXPECT_FALSE(upb_Message_HasField(first, Field(1)));
+  char* buf;
+  size_t size;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, mt_, 0, arena_.ptr(), &buf, &size));
+  EXPECT_EQ(0, size);
+
+  // Only the first element is sent this time; the second stays in reserve.
+  const std::string partial("\x1a\x02\x08\x03", 4);
+  size_t before = _upb_ArenaHas(arena_.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, Decode(partial, msg));
+  EXPECT_EQ(before, _upb_ArenaHas(arena_.ptr()));
+  EXPECT_EQ(elems, upb_Message_GetArray(msg, Field(3)));
+  ASSERT_EQ(1, upb_Array_Size(elems));
+  EXPECT_EQ(first, Element(msg, 0));
+  EXPECT_EQ(3, upb_Message_GetInt32(first, Field(1), 0));
+
+  upb_Message_ClearForReuse(msg, mt_);
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, Decode(kFull, msg));
+  EXPECT_EQ(before, _upb_ArenaHas(arena_.ptr()));
+  EXPECT_TRUE(upb_Message_HasField(msg, Field(2)));
+  EXPECT_EQ(sub, upb_Message_GetMessage(msg, Field(2), nullptr));
+  EXPECT_EQ(7, upb_Message_GetInt32(sub, Field(1), 0));
+  EXPECT_EQ(first, Element(msg, 0));
+  EXPECT_EQ(second, Element(msg, 1));
+  EXPECT_EQ(2, upb_Message_GetInt32(second, Field(1), 0));
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, mt_, 0, arena_.ptr(), &buf, &size));
+  EXPECT_EQ(kFull, std::string(buf, size));
+}
+
+TEST_F(ClearForReuseTest, WithoutOptionElementsAreNew) {
+  upb_Message* msg = upb_Message_New(mt_, arena_.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, Decode(kFull, msg));
+  const upb_Message* first = Element(msg, 0);
+  upb_Message_ClearForReuse(msg, mt_);
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(kFull.data(), kFull.size(), msg, mt_, nullptr, 0,
+                       arena_.ptr()));
+  EXPECT_NE(first, Element(msg, 0));
+  EXPECT_EQ(1, upb_Message_GetInt32(Element(msg, 0), Field(1), 0));
+}
+
+}  // namespace
@@ -0,0 +1,211 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/space_used.h"
+
+#include "upb/collections/internal/array.h"
+#include "upb/collections/internal/map.h"
+#include "upb/collections/map.h"
+#include "upb/message/accessors.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/internal/message.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/internal/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+static size_t _upb_Message_StringSpaceUsed(upb_StringView str,
+                                           const upb_Arena* arena) {
+  if (str.size == 0) return 0;
+  return !arena || upb_Arena_Contains(arena, str.data) ? str.size : 0;
+}
+
+static size_t _upb_Message_ContentsSpaceUsed(const upb_Message* msg,
+                                             const upb_MiniTable* mini_table,
+                                             const upb_Arena* arena);
+
+// A sub-message may be in the unlinked, "empty" state.
+static size_t _upb_Message_TaggedSpaceUsed(upb_TaggedMessagePtr tagged,
+                                           const upb_MiniTable* mini_table,
+                                           const upb_Arena* arena) {
+  upb_Message* msg = _upb_TaggedMessagePtr_GetMessage(tagged);
+  if (!msg) return 0;
+  if (upb_TaggedMessagePtr_IsEmpty(tagged) || !mini_table) {
+    mini_table = &_kUpb_MiniTable_Empty;
+  }
+  return upb_Message_SpaceUsed(msg, mini_table, arena);
+}
+
+static size_t _upb_Array_SpaceUsed(const upb_Array* arr, upb_CType type,
+                                   const upb_MiniTable* sub,
+                                   const upb_Arena* arena) {
+  size_t ret = sizeof(*arr) + (arr->capacity << _upb_Array_ElementSizeLg2(arr));
+  const size_t size = arr->size;
+  switch (type) {
+    case kUpb_CType_String:
+    case kUpb_CType_Bytes: {
+      const upb_StringView* elems = _upb_array_constptr(arr);
+      for (size_t i = 0; i < size; i++) {
+        ret += _upb_Message_StringSpaceUsed(elems[i], arena);
+      }
+      break;
+    }
+    case kUpb_CType_Message:
+      if (_upb_Array_HasInlineMessages(arr)) {
+        // The message bodies are part of the array's storage.
+        if (!sub) sub = &_kUpb_MiniTable_Empty;
+        for (size_t i = 0; i < size; i++) {
+          ret += _upb_Message_ContentsSpaceUsed(
+              _upb_Array_InlineMessage(arr, i), sub, arena);
+        }
+      } else {
+        const upb_TaggedMessagePtr* elems = _upb_array_constptr(arr);
+        for (size_t i = 0; i < size; i++) {
+          ret += _upb_Message_TaggedSpaceUsed(elems[i], sub, arena);
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
+
+static size_t _upb_Map_ValuesSpaceUsed(const upb_Map* map,
+                                       const upb_MiniTable* entry,
+                                       const upb_Arena* arena) {
+  const upb_MiniTableField* val_field = &entry->fields[1];
+  upb_CType type = upb_MiniTableField_CType(val_field);
+  if (type != kUpb_CType_String && type != kUpb_CType_Bytes &&
+      type != kUpb_CType_Message) {
+    return 0;
+  }
+  const upb_MiniTable* sub =
+      type == kUpb_CType_Message
+          ? upb_MiniTable_GetSubMessageTable(entry, val_field)
+          : NULL;
+  size_t ret = 0;
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue key, val;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    ret += type == kUpb_CType_Message
+               ? upb_Message_SpaceUsed(val.msg_val, sub, arena)
+               : _upb_Message_StringSpaceUsed(val.str_val, arena);
+  }
+  return ret;
+}
+
+// Everything but the message body itself.
+static size_t _upb_Message_ContentsSpaceUsed(const upb_Message* msg,
+                                             const upb_MiniTable* mini_table,
+                                             const upb_Arena* arena) {
+  size_t ret = 0;
+  const upb_Message_InternalData* in = _upb_Message_GetInternalData(msg);
+  if (in) {
+    ret += in->size + in->unknown_capacity + in->out_of_line_size;
+    if (in->unknown_index) {
+      ret += sizeof(*in->unknown_index) +
+             in->unknown_index->count * sizeof(*in->unknown_index->entries);
+    }
+  }
+
+  for (size_t i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    upb_CType type = upb_MiniTableField_CType(field);
+    switch (upb_FieldMode_Get(field)) {
+      case kUpb_FieldMode_Map: {
+        const upb_Map* map = upb_Message_GetMap(msg, field);
+        if (!map) break;
+        ret += _upb_Map_SpaceUsed(map) +
+               _upb_Map_ValuesSpaceUsed(
+                   map, upb_MiniTable_GetSubMessageTable(mini_table, field),
+                   arena);
+        break;
+      }
+      case kUpb_FieldMode_Array: {
+        const upb_Array* arr = upb_Message_GetArray(msg, field);
+        if (!arr) break;
+        ret += _upb_Array_SpaceUsed(
+            arr, type,
+            type == kUpb_CType_Message &&
+                    field->UPB_PRIVATE(submsg_index) != kUpb_NoSub
+                ? upb_MiniTable_GetSubMessageTable(mini_table, field)
+                : NULL,
+            arena);
+        break;
+      }
+      case kUpb_FieldMode_Scalar: {
+        if (type != kUpb_CType_String && type != kUpb_CType_Bytes &&
+            type != kUpb_CType_Message) {
+          break;
+        }
+        // The slot holds some other member of the oneof if the field is unset.
+        if (field->presence != 0 &&
+            !_upb_Message_HasNonExtensionField(msg, field)) {
+          break;
+        }
+        const void* val = _upb_MiniTableField_GetConstPtr(msg, field);
+        ret += type == kUpb_CType_Message
+                   ? _upb_Message_TaggedSpaceUsed(
+                         *(const upb_TaggedMessagePtr*)val,
+                         upb_MiniTable_GetSubMessageTable(mini_table, field),
+                         arena)
+                   : _upb_Message_StringSpaceUsed(*(const upb_StringView*)val,
+                                                  arena);
+        break;
+      }
+    }
+  }
+
+  size_t ext_count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &ext_count);
+  for (size_t i = 0; i < ext_count; i++) {
+    const upb_MiniTableExtension* e = ext[i].ext;
+    const upb_MiniTableField* field = &e->field;
+    upb_CType type = upb_MiniTableField_CType(field);
+    if (upb_IsRepeatedOrMap(field)) {
+      ret += _upb_Array_SpaceUsed(ext[i].data.ptr, type, e->sub.submsg, arena);
+    } else if (type == kUpb_CType_Message) {
+      ret += _upb_Message_TaggedSpaceUsed(
+          (upb_TaggedMessagePtr)ext[i].data.ptr, e->sub.submsg, arena);
+    } else if (type == kUpb_CType_String || type == kUpb_CType_Bytes) {
+      ret += _upb_Message_StringSpaceUsed(ext[i].data.str, arena);
+    }
+  }
+  return ret;
+}
+
+size_t upb_Message_SpaceUsed(const upb_Message* msg,
+                             const upb_MiniTable* mini_table,
+                             const upb_Arena* arena) {
+  return upb_msg_sizeof(mini_table) +
+         _upb_Message_ContentsSpaceUsed(msg, mini_table, arena);
+}
@@ -0,0 +1,149 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/space_used.h"
+
+#include <cstddef>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/base/string_view.h"
+#include "upb/mem/arena.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+
+namespace {
+
+using TestAllTypes = protobuf_test_messages_proto2_TestAllTypesProto2;
+
+size_t SpaceUsed(const TestAllTypes* msg, const upb_Arena* arena = nullptr) {
+  return upb_Message_SpaceUsed(
+      msg, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init, arena);
+}
+
+TEST(SpaceUsedTest, ScalarsAreInTheBody) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  size_t size = SpaceUsed(msg);
+  EXPECT_GE(size,
+            protobuf_test_messages_proto2_TestAllTypesProto2_msg_init.size);
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(msg, 1);
+  EXPECT_EQ(size, SpaceUsed(msg));
+  upb_Arena_Free(arena);
+}
+
+TEST(SpaceUsedTest, CountsNestedMessagesArraysAndMaps) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  size_t size = SpaceUsed(msg);
+
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage* nested =
+      protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+          msg, arena);
+  protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(nested,
+                                                                       5);
+  size_t with_nested = SpaceUsed(msg);
+  EXPECT_GT(with_nested, size);
+
+  for (int i = 0; i < 10; i++) {
+    ASSERT_NE(
+        protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+            msg, arena),
+        nullptr);
+  }
+  size_t with_repeated = SpaceUsed(msg);
+  EXPECT_GE(with_repeated, with_nested + 10 * sizeof(void*));
+
+  std::string value(100, 'v');
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+      msg, upb_StringView_FromString("key"),
+      upb_StringView_FromDataAndSize(value.data(), value.size()), arena);
+  EXPECT_GE(SpaceUsed(msg), with_repeated + value.size());
+
+  upb_Arena_Free(arena);
+}
+
+TEST(SpaceUsedTest, SkipsStringsOutsideTheArena) {
+  upb_Arena* arena = upb_Arena_New();
+  TestAllTypes* src =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  std::string big(1000, 'x');
+  protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+      src, upb_StringView_FromString("k"),
+      upb_StringView_FromDataAndSize(big.data(), big.size()), arena);
+  size_t len;
+  char* buf = protobuf_test_messages_proto2_TestAllTypesProto2_serialize(
+      src, arena, &len);
+  ASSERT_NE(buf, nullptr);
+
+  upb_Arena* copy_arena = upb_Arena_New();
+  TestAllTypes* copied =
+      protobuf_test_messages_proto2_TestAllTypesProto2_parse(buf, len,
+                                                             copy_arena);
+  ASSERT_NE(copied, nullptr);
+  EXPECT_GE(SpaceUsed(copied, copy_arena), big.size());
+
+  // The aliased value lives in `arena`, not in `alias_arena`.
+  upb_Arena* alias_arena = upb_Arena_New();
+  TestAllTypes* aliased =
+      protobuf_test_messages_proto2_TestAllTypesProto2_parse_ex(
+          buf, len, nullptr, kUpb_DecodeOption_AliasString, alias_arena);
+  ASSERT_NE(aliased, nullptr);
+  EXPECT_LE(SpaceUsed(aliased, alias_arena) + big.size(),
+            SpaceUsed(copied, copy_arena));
+  EXPECT_GE(SpaceUsed(aliased), big.size());
+
+  upb_Arena_Free(alias_arena);
+  upb_Arena_Free(copy_arena);
+  upb_Arena_Free(arena);
+}
+
+TEST(SpaceUsedTest, CountsUnknownFields) {
+  upb_Arena* arena = upb_Arena_New();
+  // Field 9999 is not in TestAllTypesProto2: tag (9999 << 3 | 2), then a
+  // 200-byte length-delimited payload.
+  std::string wire = "\xfa\xf0\x04";
+  wire.push_back(static_cast<char>(200 | 0x80));
+  wire.push_back(1);
+  wire.append(200, 'u');
+  TestAllTypes* msg = protobuf_test_messages_proto2_TestAllTypesProto2_parse(
+      wire.data(), wire.size(), arena);
+  ASSERT_NE(msg, nullptr);
+  EXPECT_GE(SpaceUsed(msg),
+            protobuf_test_messages_proto2_TestAllTypesProto2_msg_init.size +
+                wire.size());
+  EXPECT_LE(SpaceUsed(msg), upb_Arena_SpaceAllocated(arena));
+  upb_Arena_Free(arena);
+}
+
+}  // namespace
@@ -34,6 +34,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "google/protobuf/test_messages_proto3.upb.h"
+#include "google/protobuf/test_messages_proto3.upbdefs.h"
 #include "upb/base/status.hpp"
 #include "upb/json/decode.h"
 #include "upb/json/encode.h"
@@ -174,6 +175,40 @@ TEST(MessageTest, MessageSet) {
   VerifyMessageSet(ext_msg3);
 }
 
+TEST(MessageTest, MessageSetItemOrder) {
+  upb::Arena arena;
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(upb_test_TestMessageSet_getmsgdef(defpool.ptr()));
+  EXPECT_TRUE(m.ptr() != nullptr);
+
+  // Item {type_id: 4, message: {optional_int32: 234}}, with the type_id
+  // first (as encoders write it), last, and after a field to be skipped.
+  const std::string items[] = {
+      std::string("\x0b\x10\x04\x1a\x03\x08\xea\x01\x0c", 9),
+      std::string("\x0b\x1a\x03\x08\xea\x01\x10\x04\x0c", 9),
+      std::string("\x0b\x20\x01\x10\x04\x1a\x03\x08\xea\x01\x0c", 11),
+  };
+  for (const std::string& item : items) {
+    upb_test_TestMessageSet* ext_msg = upb_test_TestMessageSet_parse_ex(
+        item.data(), item.size(), upb_DefPool_ExtensionRegistry(defpool.ptr()),
+        0, arena.ptr());
+    ASSERT_TRUE(ext_msg != nullptr);
+    VerifyMessageSet(ext_msg);
+  }
+
+  // A payload that is cut short, or that ends a group it did not start.
+  const std::string bad_items[] = {
+      std::string("\x0b\x10\x04\x1a\x01\x08\x0c", 7),
+      std::string("\x0b\x10\x04\x1a\x01\x0c\x0c", 7),
+  };
+  for (const std::string& item : bad_items) {
+    EXPECT_EQ(nullptr, upb_test_TestMessageSet_parse_ex(
+                           item.data(), item.size(),
+                           upb_DefPool_ExtensionRegistry(defpool.ptr()), 0,
+                           arena.ptr()));
+  }
+}
+
 TEST(MessageTest, UnknownMessageSet) {
   static const char data[] = "ABCDE";
   upb_StringView data_view = upb_StringView_FromString(data);
@@ -506,6 +541,60 @@ TEST(MessageTest, MapField) {
       upb_test_TestMapFieldExtra_map_field_get(test_msg_extra2, 0, nullptr));
 }
 
+// Returns a serialized TestMapMessageValue holding {key: {inner_key: ONE}}.
+static std::string SerializeMapMessageValue(int32_t key, int32_t inner_key) {
+  upb::Arena arena;
+  upb_test_TestMapField* val = upb_test_TestMapField_new(arena.ptr());
+  EXPECT_TRUE(upb_test_TestMapField_map_field_set(
+      val, inner_key, upb_test_TestMapField_ONE, arena.ptr()));
+  upb_test_TestMapMessageValue* msg =
+      upb_test_TestMapMessageValue_new(arena.ptr());
+  EXPECT_TRUE(
+      upb_test_TestMapMessageValue_map_field_set(msg, key, val, arena.ptr()));
+  size_t size;
+  char* serialized =
+      upb_test_TestMapMessageValue_serialize(msg, arena.ptr(), &size);
+  EXPECT_NE(nullptr, serialized);
+  return std::string(serialized, size);
+}
+
+TEST(MessageTest, MapFieldDuplicateKey) {
+  upb::Arena arena;
+  std::string first = SerializeMapMessageValue(5, 1);
+  std::string second = SerializeMapMessageValue(5, 2);
+
+  upb_test_TestMapMessageValue* msg = upb_test_TestMapMessageValue_parse(
+      first.data(), first.size(), arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  upb_test_TestMapField* old_val;
+  ASSERT_TRUE(upb_test_TestMapMessageValue_map_field_get(msg, 5, &old_val));
+
+  // Parsing the same key again replaces the value rather than merging into
+  // it, and leaves the value the caller already holds untouched.
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(second.data(), second.size(), msg,
+                       &upb_test_TestMapMessageValue_msg_init, nullptr, 0,
+                       arena.ptr()));
+  EXPECT_EQ(1, upb_test_TestMapMessageValue_map_field_size(msg));
+  upb_test_TestMapField* new_val;
+  ASSERT_TRUE(upb_test_TestMapMessageValue_map_field_get(msg, 5, &new_val));
+  EXPECT_NE(old_val, new_val);
+  EXPECT_EQ(1, upb_test_TestMapField_map_field_size(new_val));
+  EXPECT_TRUE(upb_test_TestMapField_map_field_get(new_val, 2, nullptr));
+  EXPECT_EQ(1, upb_test_TestMapField_map_field_size(old_val));
+  EXPECT_TRUE(upb_test_TestMapField_map_field_get(old_val, 1, nullptr));
+
+  // Within a single payload the last entry for a key wins.
+  std::string both = first + second;
+  msg = upb_test_TestMapMessageValue_parse(both.data(), both.size(),
+                                           arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  EXPECT_EQ(1, upb_test_TestMapMessageValue_map_field_size(msg));
+  ASSERT_TRUE(upb_test_TestMapMessageValue_map_field_get(msg, 5, &new_val));
+  EXPECT_EQ(1, upb_test_TestMapField_map_field_size(new_val));
+  EXPECT_TRUE(upb_test_TestMapField_map_field_get(new_val, 2, nullptr));
+}
+
 // begin:google_only
 //
 // static void DecodeEncodeArbitrarySchemaAndPayload(
@@ -684,3 +773,38 @@ TEST(MessageTest, MapField) {
 // }
 //
 // end:google_only
+
+// begin:google_only
+//
+// // Performance fuzzing: looks for payloads that are slow to decode for their
+// // size, rather than ones that crash.  Run with UPB_FUZZ_SLOW_INPUTS set to a
+// // directory to collect them for the worst-case benchmarks.
+// static void DecodeArbitraryPayloadForTime(std::string_view proto_payload) {
+//   static upb::fuzz::SlowInputTracker tracker("wire");
+//   upb::Arena arena;
+//   const upb_MiniTable* mini_table =
+//       &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+//   upb_Message* msg = upb_Message_New(mini_table, arena.ptr());
+//   upb::fuzz::SlowInputTracker::Timer timer(&tracker, proto_payload);
+//   upb_Decode(proto_payload.data(), proto_payload.size(), msg, mini_table,
+//              nullptr, 0, arena.ptr());
+// }
+// FUZZ_TEST(FuzzTest, DecodeArbitraryPayloadForTime);
+//
+// static void JsonDecodeArbitraryPayloadForTime(std::string_view json) {
+//   static upb::fuzz::SlowInputTracker tracker("json");
+//   upb::Arena arena;
+//   upb::DefPool defpool;
+//   upb::Status status;
+//   const upb_MessageDef* m =
+//       protobuf_test_messages_proto3_TestAllTypesProto3_getmsgdef(
+//           defpool.ptr());
+//   upb_Message* msg =
+//       upb_Message_New(upb_MessageDef_MiniTable(m), arena.ptr());
+//   upb::fuzz::SlowInputTracker::Timer timer(&tracker, json);
+//   upb_JsonDecode(json.data(), json.size(), msg, m, defpool.ptr(),
+//                  upb_JsonDecode_IgnoreUnknown, arena.ptr(), status.ptr());
+// }
+// FUZZ_TEST(FuzzTest, JsonDecodeArbitraryPayloadForTime);
+//
+// end:google_only
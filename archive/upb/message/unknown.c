@@ -0,0 +1,140 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/unknown.h"
+
+#include "upb/wire/eps_copy_input_stream.h"
+#include "upb/wire/reader.h"
+#include "upb/wire/types.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+void upb_UnknownFieldIter_Init(upb_UnknownFieldIter* iter, const char* buf,
+                               size_t size, int depth_limit) {
+  upb_EpsCopyInputStream_Init(&iter->stream, &buf, size, true);
+  iter->ptr = buf;
+  iter->depth_limit = depth_limit;
+  iter->error = false;
+}
+
+// Skips the rest of a group whose start tag `tag` was just read, setting
+// `*body_end` to the start of its end tag in the input buffer.  Returns NULL
+// if the group is malformed or unterminated.
+static const char* upb_UnknownFieldIter_SkipGroup(upb_UnknownFieldIter* iter,
+                                                  const char* ptr, uint32_t tag,
+                                                  const char** body_end) {
+  int depth_limit = iter->depth_limit;
+  if (--depth_limit == 0) return NULL;
+  uint32_t end_group_tag = (tag & ~7U) | kUpb_WireType_EndGroup;
+  while (!upb_EpsCopyInputStream_IsDone(&iter->stream, &ptr)) {
+    const char* tag_start = ptr;
+    ptr = upb_WireReader_ReadTag(ptr, &tag);
+    if (!ptr) return NULL;
+    if (tag == end_group_tag) {
+      *body_end =
+          upb_EpsCopyInputStream_GetAliasedPtr(&iter->stream, tag_start);
+      return ptr;
+    }
+    ptr = _upb_WireReader_SkipValue(ptr, tag, depth_limit, &iter->stream);
+    if (!ptr) return NULL;
+  }
+  return NULL;
+}
+
+bool upb_UnknownFieldIter_Next(upb_UnknownFieldIter* iter,
+                               upb_UnknownFieldView* field) {
+  upb_EpsCopyInputStream* stream = &iter->stream;
+  const char* ptr = iter->ptr;
+  if (iter->error || upb_EpsCopyInputStream_IsDone(stream, &ptr)) {
+    iter->error |= upb_EpsCopyInputStream_IsError(stream);
+    return false;
+  }
+
+  // The input is a flat buffer, so aliased pointers can be subtracted even if
+  // the stream has moved to its patch buffer in between.
+  const char* begin = upb_EpsCopyInputStream_GetAliasedPtr(stream, ptr);
+  uint32_t tag;
+  ptr = upb_WireReader_ReadTag(ptr, &tag);
+  if (!ptr) goto err;
+  field->field_number = upb_WireReader_GetFieldNumber(tag);
+  field->wire_type = upb_WireReader_GetWireType(tag);
+
+  switch (field->wire_type) {
+    case kUpb_WireType_Varint:
+      ptr = upb_WireReader_ReadVarint(ptr, &field->data.varint);
+      break;
+    case kUpb_WireType_64Bit:
+      ptr = upb_WireReader_ReadFixed64(ptr, &field->data.fixed64);
+      break;
+    case kUpb_WireType_32Bit:
+      ptr = upb_WireReader_ReadFixed32(ptr, &field->data.fixed32);
+      break;
+    case kUpb_WireType_Delimited: {
+      int size;
+      ptr = upb_WireReader_ReadSize(ptr, &size);
+      if (!ptr ||
+          !upb_EpsCopyInputStream_CheckDataSizeAvailable(stream, ptr, size)) {
+        goto err;
+      }
+      const char* str = ptr;
+      ptr = upb_EpsCopyInputStream_ReadStringAliased(stream, &str, size);
+      field->data.delimited = upb_StringView_FromDataAndSize(str, size);
+      break;
+    }
+    case kUpb_WireType_StartGroup: {
+      const char* body = upb_EpsCopyInputStream_GetAliasedPtr(stream, ptr);
+      const char* body_end;
+      ptr = upb_UnknownFieldIter_SkipGroup(iter, ptr, tag, &body_end);
+      if (!ptr) goto err;
+      field->data.group =
+          upb_StringView_FromDataAndSize(body, body_end - body);
+      break;
+    }
+    default:
+      goto err;  // An unmatched end group tag, or an invalid wire type.
+  }
+  if (!ptr) goto err;
+
+  // Check that the value did not run past the end of the data before
+  // returning it.
+  if (upb_EpsCopyInputStream_IsDone(stream, &ptr) &&
+      upb_EpsCopyInputStream_IsError(stream)) {
+    goto err;
+  }
+  const char* end = upb_EpsCopyInputStream_GetAliasedPtr(stream, ptr);
+  field->encoded = upb_StringView_FromDataAndSize(begin, end - begin);
+  iter->ptr = ptr;
+  return true;
+
+err:
+  iter->error = true;
+  return false;
+}
@@ -0,0 +1,122 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Iteration over unknown fields without allocating.
+//
+// upb_UnknownFieldIter parses the data returned by upb_Message_GetUnknown()
+// one field at a time, yielding each field's number, wire type and value.
+// Strings and groups are returned as views into the input, so the input must
+// outlive any values read from it.
+
+#ifndef UPB_MESSAGE_UNKNOWN_H_
+#define UPB_MESSAGE_UNKNOWN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "upb/base/string_view.h"
+#include "upb/message/message.h"
+#include "upb/wire/eps_copy_input_stream.h"
+#include "upb/wire/types.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef struct {
+  uint32_t field_number;
+  upb_WireType wire_type;  // Never kUpb_WireType_EndGroup.
+  union {
+    uint64_t varint;
+    uint64_t fixed64;
+    uint32_t fixed32;
+    upb_StringView delimited;
+    upb_StringView group;  // The group's fields, without its end tag.
+  } data;
+  upb_StringView encoded;  // The whole field, including its tag.
+} upb_UnknownFieldView;
+
+// The members are private.  An iterator points into itself, so it must not be
+// copied or moved once initialized.
+typedef struct {
+  upb_EpsCopyInputStream stream;
+  const char* ptr;
+  int depth_limit;
+  bool error;
+} upb_UnknownFieldIter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Iterate over the unknown fields in `buf`:
+//
+// upb_UnknownFieldIter iter;
+// upb_UnknownFieldIter_Init(&iter, buf, size,
+//                           kUpb_WireFormat_DefaultDepthLimit);
+// upb_UnknownFieldView field;
+// while (upb_UnknownFieldIter_Next(&iter, &field)) {
+//   process_field(&field);
+// }
+// if (upb_UnknownFieldIter_IsError(&iter)) return false;
+//
+// The contents of a group are not visited, but can be by iterating over
+// `field.data.group`.  Groups nested more than `depth_limit` deep are treated
+// as malformed.
+UPB_API void upb_UnknownFieldIter_Init(upb_UnknownFieldIter* iter,
+                                       const char* buf, size_t size,
+                                       int depth_limit);
+
+// Iterates over the unknown fields of `msg`, which must not be modified until
+// the iteration is done.
+UPB_API_INLINE void upb_Message_IterUnknown(const upb_Message* msg,
+                                            upb_UnknownFieldIter* iter) {
+  size_t size;
+  const char* buf = upb_Message_GetUnknown(msg, &size);
+  upb_UnknownFieldIter_Init(iter, buf, size, kUpb_WireFormat_DefaultDepthLimit);
+}
+
+// Reads the next field into `*field`.  Returns false at the end of the data,
+// or if the data is malformed, in which case no more fields are returned.
+UPB_API bool upb_UnknownFieldIter_Next(upb_UnknownFieldIter* iter,
+                                       upb_UnknownFieldView* field);
+
+// Returns true if iteration stopped because the data was malformed.
+UPB_API_INLINE bool upb_UnknownFieldIter_IsError(
+    const upb_UnknownFieldIter* iter) {
+  return iter->error;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_MESSAGE_UNKNOWN_H_
@@ -0,0 +1,220 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/unknown.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/base/string_view.h"
+#include "upb/mem/arena.hpp"
+#include "upb/message/internal/message.h"
+#include "upb/wire/types.h"
+
+namespace {
+
+void EncodeVarint(uint64_t val, std::string* str) {
+  do {
+    char byte = val & 0x7fU;
+    val >>= 7;
+    if (val) byte |= 0x80U;
+    str->push_back(byte);
+  } while (val);
+}
+
+void EncodeTag(uint32_t field_number, upb_WireType wire_type,
+               std::string* str) {
+  EncodeVarint(field_number << 3 | wire_type, str);
+}
+
+std::string AsString(upb_StringView view) {
+  return std::string(view.data, view.size);
+}
+
+bool IsWithin(upb_StringView view, const std::string& buf) {
+  const char* end = buf.data() + buf.size();
+  return view.data >= buf.data() && view.data + view.size <= end;
+}
+
+// Returns the fields in `buf`, or an empty vector if `buf` is malformed.
+std::vector<upb_UnknownFieldView> Parse(const std::string& buf,
+                                        int depth_limit = 100) {
+  std::vector<upb_UnknownFieldView> fields;
+  upb_UnknownFieldIter iter;
+  upb_UnknownFieldIter_Init(&iter, buf.data(), buf.size(), depth_limit);
+  upb_UnknownFieldView field;
+  while (upb_UnknownFieldIter_Next(&iter, &field)) fields.push_back(field);
+  if (upb_UnknownFieldIter_IsError(&iter)) fields.clear();
+  return fields;
+}
+
+TEST(UnknownFieldIterTest, AllWireTypes) {
+  std::string buf;
+  EncodeTag(1, kUpb_WireType_Varint, &buf);
+  EncodeVarint(300, &buf);
+  EncodeTag(2, kUpb_WireType_64Bit, &buf);
+  buf.append("\x01\x00\x00\x00\x00\x00\x00\x80", 8);
+  EncodeTag(3, kUpb_WireType_32Bit, &buf);
+  buf.append("\x02\x00\x00\x00", 4);
+  EncodeTag(4, kUpb_WireType_Delimited, &buf);
+  EncodeVarint(40, &buf);
+  buf.append(std::string(40, 'x'));
+  std::string group;
+  EncodeTag(1, kUpb_WireType_Varint, &group);
+  EncodeVarint(7, &group);
+  EncodeTag(5, kUpb_WireType_StartGroup, &buf);
+  buf.append(group);
+  EncodeTag(5, kUpb_WireType_EndGroup, &buf);
+  EncodeTag(123456, kUpb_WireType_Varint, &buf);
+  EncodeVarint(1, &buf);
+
+  std::vector<upb_UnknownFieldView> fields = Parse(buf);
+  ASSERT_EQ(6, fields.size());
+  EXPECT_EQ(1, fields[0].field_number);
+  EXPECT_EQ(kUpb_WireType_Varint, fields[0].wire_type);
+  EXPECT_EQ(300, fields[0].data.varint);
+  EXPECT_EQ(kUpb_WireType_64Bit, fields[1].wire_type);
+  EXPECT_EQ(0x8000000000000001, fields[1].data.fixed64);
+  EXPECT_EQ(kUpb_WireType_32Bit, fields[2].wire_type);
+  EXPECT_EQ(2, fields[2].data.fixed32);
+  EXPECT_EQ(kUpb_WireType_Delimited, fields[3].wire_type);
+  EXPECT_EQ(std::string(40, 'x'), AsString(fields[3].data.delimited));
+  EXPECT_EQ(5, fields[4].field_number);
+  EXPECT_EQ(kUpb_WireType_StartGroup, fields[4].wire_type);
+  EXPECT_EQ(group, AsString(fields[4].data.group));
+  EXPECT_EQ(123456, fields[5].field_number);
+
+  // Every view points into the input, and the encoded fields tile it.
+  std::string encoded;
+  for (const upb_UnknownFieldView& field : fields) {
+    EXPECT_TRUE(IsWithin(field.encoded, buf));
+    encoded.append(AsString(field.encoded));
+  }
+  EXPECT_EQ(buf, encoded);
+  EXPECT_TRUE(IsWithin(fields[3].data.delimited, buf));
+  EXPECT_TRUE(IsWithin(fields[4].data.group, buf));
+
+  std::string group_str = AsString(fields[4].data.group);
+  std::vector<upb_UnknownFieldView> group_fields = Parse(group_str);
+  ASSERT_EQ(1, group_fields.size());
+  EXPECT_EQ(1, group_fields[0].field_number);
+  EXPECT_EQ(7, group_fields[0].data.varint);
+}
+
+TEST(UnknownFieldIterTest, Empty) {
+  upb_UnknownFieldIter iter;
+  upb_UnknownFieldIter_Init(&iter, nullptr, 0, 100);
+  upb_UnknownFieldView field;
+  EXPECT_FALSE(upb_UnknownFieldIter_Next(&iter, &field));
+  EXPECT_FALSE(upb_UnknownFieldIter_IsError(&iter));
+}
+
+TEST(UnknownFieldIterTest, Malformed) {
+  std::string valid;
+  EncodeTag(1, kUpb_WireType_Varint, &valid);
+  EncodeVarint(1, &valid);
+
+  std::vector<std::string> bufs;
+  std::string buf = valid;
+  EncodeTag(2, kUpb_WireType_Delimited, &buf);
+  EncodeVarint(5, &buf);
+  buf.append("abcd");
+  bufs.push_back(buf);  // Truncated string.
+
+  buf = valid;
+  EncodeTag(2, kUpb_WireType_64Bit, &buf);
+  buf.append("abcd");
+  bufs.push_back(buf);  // Truncated fixed64.
+
+  buf = valid;
+  EncodeTag(2, kUpb_WireType_EndGroup, &buf);
+  bufs.push_back(buf);  // Unmatched end group.
+
+  buf = valid;
+  EncodeTag(2, kUpb_WireType_StartGroup, &buf);
+  buf.append(valid);
+  bufs.push_back(buf);  // Unterminated group.
+
+  buf = valid;
+  EncodeTag(2, kUpb_WireType_StartGroup, &buf);
+  EncodeTag(3, kUpb_WireType_EndGroup, &buf);
+  bufs.push_back(buf);  // Mismatched end group.
+
+  buf = valid;
+  EncodeTag(2, static_cast<upb_WireType>(6), &buf);
+  bufs.push_back(buf);  // Invalid wire type.
+
+  for (const std::string& buf : bufs) {
+    upb_UnknownFieldIter iter;
+    upb_UnknownFieldIter_Init(&iter, buf.data(), buf.size(), 100);
+    upb_UnknownFieldView field;
+    // The valid field is still returned.
+    EXPECT_TRUE(upb_UnknownFieldIter_Next(&iter, &field));
+    EXPECT_FALSE(upb_UnknownFieldIter_Next(&iter, &field));
+    EXPECT_TRUE(upb_UnknownFieldIter_IsError(&iter));
+    EXPECT_FALSE(upb_UnknownFieldIter_Next(&iter, &field));
+  }
+}
+
+TEST(UnknownFieldIterTest, DepthLimit) {
+  std::string buf;
+  for (int i = 0; i < 3; i++) EncodeTag(1, kUpb_WireType_StartGroup, &buf);
+  for (int i = 0; i < 3; i++) EncodeTag(1, kUpb_WireType_EndGroup, &buf);
+  EXPECT_EQ(1, Parse(buf, 4).size());
+  EXPECT_EQ(0, Parse(buf, 3).size());
+}
+
+TEST(UnknownFieldIterTest, Message) {
+  upb::Arena arena;
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena.ptr());
+  std::string buf;
+  EncodeTag(999, kUpb_WireType_Delimited, &buf);
+  EncodeVarint(3, &buf);
+  buf.append("abc");
+  ASSERT_TRUE(_upb_Message_AddUnknown(msg, buf.data(), buf.size(),
+                                      arena.ptr()));
+
+  upb_UnknownFieldIter iter;
+  upb_Message_IterUnknown(msg, &iter);
+  upb_UnknownFieldView field;
+  ASSERT_TRUE(upb_UnknownFieldIter_Next(&iter, &field));
+  EXPECT_EQ(999, field.field_number);
+  EXPECT_EQ("abc", AsString(field.data.delimited));
+  EXPECT_EQ(buf, AsString(field.encoded));
+  EXPECT_FALSE(upb_UnknownFieldIter_Next(&iter, &field));
+  EXPECT_FALSE(upb_UnknownFieldIter_IsError(&iter));
+}
+
+}  // namespace
@@ -0,0 +1,178 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/validate_utf8.h"
+
+#include "upb/base/descriptor_constants.h"
+#include "upb/collections/internal/array.h"
+#include "upb/collections/map.h"
+#include "upb/lex/utf8.h"
+#include "upb/message/accessors.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/internal/message.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/internal/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Mirrors upb_Decode(), which checks exactly the fields of type String.
+static bool _upb_Field_NeedsUtf8(const upb_MiniTableField* field) {
+  return field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_String;
+}
+
+static bool _upb_StringView_IsUtf8(upb_StringView str) {
+  return upb_Utf8_IsValid(str.data, str.size);
+}
+
+// A sub-message may be in the unlinked, "empty" state, which has no fields.
+static bool _upb_TaggedMessage_ValidateUtf8(upb_TaggedMessagePtr tagged,
+                                            const upb_MiniTable* mini_table) {
+  upb_Message* msg = _upb_TaggedMessagePtr_GetMessage(tagged);
+  if (!msg || upb_TaggedMessagePtr_IsEmpty(tagged) || !mini_table) {
+    return true;
+  }
+  return upb_Message_ValidateUtf8(msg, mini_table);
+}
+
+static bool _upb_Array_ValidateUtf8(const upb_Array* arr,
+                                    const upb_MiniTableField* field,
+                                    const upb_MiniTable* sub) {
+  const size_t size = arr->size;
+  if (_upb_Field_NeedsUtf8(field)) {
+    const upb_StringView* elems = _upb_array_constptr(arr);
+    for (size_t i = 0; i < size; i++) {
+      if (!_upb_StringView_IsUtf8(elems[i])) return false;
+    }
+  } else if (upb_MiniTableField_CType(field) == kUpb_CType_Message && sub) {
+    if (_upb_Array_HasInlineMessages(arr)) {
+      for (size_t i = 0; i < size; i++) {
+        if (!upb_Message_ValidateUtf8(_upb_Array_InlineMessage(arr, i), sub)) {
+          return false;
+        }
+      }
+    } else {
+      const upb_TaggedMessagePtr* elems = _upb_array_constptr(arr);
+      for (size_t i = 0; i < size; i++) {
+        if (!_upb_TaggedMessage_ValidateUtf8(elems[i], sub)) return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool _upb_Map_ValidateUtf8(const upb_Map* map,
+                                  const upb_MiniTable* entry) {
+  const upb_MiniTableField* key_field = &entry->fields[0];
+  const upb_MiniTableField* val_field = &entry->fields[1];
+  bool check_key = _upb_Field_NeedsUtf8(key_field);
+  bool check_val = _upb_Field_NeedsUtf8(val_field);
+  const upb_MiniTable* sub =
+      upb_MiniTableField_CType(val_field) == kUpb_CType_Message
+          ? upb_MiniTable_GetSubMessageTable(entry, val_field)
+          : NULL;
+  if (!check_key && !check_val && !sub) return true;
+
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue key, val;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    if (check_key && !_upb_StringView_IsUtf8(key.str_val)) return false;
+    if (check_val && !_upb_StringView_IsUtf8(val.str_val)) return false;
+    if (sub && !upb_Message_ValidateUtf8(val.msg_val, sub)) return false;
+  }
+  return true;
+}
+
+bool upb_Message_ValidateUtf8(const upb_Message* msg,
+                              const upb_MiniTable* mini_table) {
+  for (size_t i = 0; i < mini_table->field_count; i++) {
+    const upb_MiniTableField* field = &mini_table->fields[i];
+    bool is_message = upb_MiniTableField_CType(field) == kUpb_CType_Message;
+    if (!is_message && !_upb_Field_NeedsUtf8(field)) continue;
+
+    switch (upb_FieldMode_Get(field)) {
+      case kUpb_FieldMode_Map: {
+        const upb_Map* map = upb_Message_GetMap(msg, field);
+        if (map && !_upb_Map_ValidateUtf8(
+                       map, upb_MiniTable_GetSubMessageTable(mini_table,
+                                                             field))) {
+          return false;
+        }
+        break;
+      }
+      case kUpb_FieldMode_Array: {
+        const upb_Array* arr = upb_Message_GetArray(msg, field);
+        const upb_MiniTable* sub =
+            is_message && field->UPB_PRIVATE(submsg_index) != kUpb_NoSub
+                ? upb_MiniTable_GetSubMessageTable(mini_table, field)
+                : NULL;
+        if (arr && !_upb_Array_ValidateUtf8(arr, field, sub)) return false;
+        break;
+      }
+      case kUpb_FieldMode_Scalar: {
+        // The slot holds some other member of the oneof if the field is unset.
+        if (field->presence != 0 &&
+            !_upb_Message_HasNonExtensionField(msg, field)) {
+          break;
+        }
+        const void* val = _upb_MiniTableField_GetConstPtr(msg, field);
+        if (is_message
+                ? !_upb_TaggedMessage_ValidateUtf8(
+                      *(const upb_TaggedMessagePtr*)val,
+                      upb_MiniTable_GetSubMessageTable(mini_table, field))
+                : !_upb_StringView_IsUtf8(*(const upb_StringView*)val)) {
+          return false;
+        }
+        break;
+      }
+    }
+  }
+
+  size_t ext_count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &ext_count);
+  for (size_t i = 0; i < ext_count; i++) {
+    const upb_MiniTableExtension* e = ext[i].ext;
+    const upb_MiniTableField* field = &e->field;
+    if (upb_IsRepeatedOrMap(field)) {
+      if (!_upb_Array_ValidateUtf8(ext[i].data.ptr, field, e->sub.submsg)) {
+        return false;
+      }
+    } else if (upb_MiniTableField_CType(field) == kUpb_CType_Message) {
+      if (!_upb_TaggedMessage_ValidateUtf8(
+              (upb_TaggedMessagePtr)ext[i].data.ptr, e->sub.submsg)) {
+        return false;
+      }
+    } else if (_upb_Field_NeedsUtf8(field) &&
+               !_upb_StringView_IsUtf8(ext[i].data.str)) {
+      return false;
+    }
+  }
+  return true;
+}
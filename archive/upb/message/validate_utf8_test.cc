@@ -0,0 +1,104 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/message/validate_utf8.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "upb/base/descriptor_constants.h"
+#include "upb/base/status.hpp"
+#include "upb/mem/arena.hpp"
+#include "upb/message/message.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_table/message.h"
+#include "upb/wire/decode.h"
+
+namespace {
+
+class ValidateUtf8Test : public testing::Test {
+ protected:
+  // A proto3 message with a string (1), itself (2), a repeated string (3) and
+  // bytes (4).
+  void SetUp() override {
+    upb::MtDataEncoder e;
+    ASSERT_TRUE(e.StartMessage(kUpb_MessageModifier_ValidateUtf8));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_String, 1, 0));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Message, 2, 0));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_String, 3,
+                           kUpb_FieldModifier_IsRepeated));
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Bytes, 4, 0));
+    upb::Status status;
+    mt_ = upb_MiniTable_Build(e.data().data(), e.data().size(), arena_.ptr(),
+                              status.ptr());
+    ASSERT_NE(mt_, nullptr);
+    ASSERT_TRUE(upb_MiniTable_SetSubMessage(
+        mt_, const_cast<upb_MiniTableField*>(
+                 upb_MiniTable_FindFieldByNumber(mt_, 2)),
+        mt_));
+  }
+
+  upb_DecodeStatus Decode(const std::string& data, int options,
+                          upb_Message** msg) {
+    *msg = upb_Message_New(mt_, arena_.ptr());
+    return upb_Decode(data.data(), data.size(), *msg, mt_, nullptr, options,
+                      arena_.ptr());
+  }
+
+  upb::Arena arena_;
+  upb_MiniTable* mt_;
+};
+
+TEST_F(ValidateUtf8Test, DeferredUntilValidated) {
+  const std::string bad_nested("\x12\x05\x0a\x03\xed\xa0\x81", 7);
+  const std::string bad_repeated("\x1a\x01x\x1a\x01\xff", 6);
+  for (const std::string& data : {bad_nested, bad_repeated}) {
+    upb_Message* msg;
+    EXPECT_EQ(kUpb_DecodeStatus_BadUtf8, Decode(data, 0, &msg));
+    ASSERT_EQ(kUpb_DecodeStatus_Ok,
+              Decode(data, kUpb_DecodeOption_DeferUtf8Validation, &msg));
+    EXPECT_FALSE(upb_Message_ValidateUtf8(msg, mt_));
+  }
+}
+
+TEST_F(ValidateUtf8Test, ValidMessages) {
+  const std::string good("\x0a\x02ok\x12\x05\x0a\x03\xc3\xa9x\x1a\x00", 13);
+  const std::string bad_bytes("\x22\x02\xff\xff", 4);
+  for (const std::string& data : {good, bad_bytes}) {
+    upb_Message* msg;
+    ASSERT_EQ(kUpb_DecodeStatus_Ok,
+              Decode(data, kUpb_DecodeOption_DeferUtf8Validation, &msg));
+    EXPECT_TRUE(upb_Message_ValidateUtf8(msg, mt_));
+  }
+}
+
+}  // namespace
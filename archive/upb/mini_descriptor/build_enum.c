@@ -69,6 +69,9 @@ static void upb_MiniTableEnum_BuildValue(upb_MdEnumDecoder* d, uint32_t val) {
   if (table->value_count || (val > 512 && d->enum_value_count < val / 32)) {
     if (table->value_count == 0) {
       assert(d->enum_data_count == table->mask_limit / 32);
+    } else if (val <= table->data[d->enum_data_count - 1]) {
+      // Only values that wrapped around get here; lookups binary search.
+      upb_MdDecoder_ErrorJmp(&d->base, "Enum value out of order: %u", val);
     }
     table = _upb_MiniTable_AddEnumDataMember(d, val);
     table->value_count++;
@@ -0,0 +1,274 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+#include "upb/mini_descriptor/cache.h"
+
+#include <string.h>
+
+#include "upb/hash/concurrent_table.h"
+#include "upb/mem/alloc.h"
+#include "upb/mem/arena.h"
+#include "upb/mini_descriptor/build_enum.h"
+#include "upb/mini_descriptor/link.h"
+#include "upb/port/atomic.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// One table built from a message MiniDescriptor, with the sub-tables it was
+// linked to.  The arrays hold the sub-tables as passed by the caller, so they
+// may contain kUpb_MiniTableCache_Self.
+typedef struct upb_MiniTableCache_Linked {
+  const upb_MiniTable* table;
+  const upb_MiniTable** sub_tables;
+  const upb_MiniTableEnum** sub_enums;
+  size_t sub_table_count;
+  size_t sub_enum_count;
+  const struct upb_MiniTableCache_Linked* next;
+} upb_MiniTableCache_Linked;
+
+// All of the tables built from one message MiniDescriptor.  New tables are
+// pushed to the front of the list with a release, after they are linked.
+typedef struct {
+  UPB_ATOMIC(const upb_MiniTableCache_Linked*) head;
+} upb_MiniTableCache_Entry;
+
+struct upb_MiniTableCache {
+  upb_Arena* arena;
+  upb_concurrenttable* msgs;   // MiniDescriptor -> upb_MiniTableCache_Entry*
+  upb_concurrenttable* enums;  // MiniDescriptor -> upb_MiniTableEnum*
+  upb_MiniTablePlatform platform;
+  UPB_ATOMIC(uintptr_t) lock;
+  // Everything below is only accessed while holding the lock.
+  void* scratch_data;
+  size_t scratch_size;
+};
+
+upb_MiniTableCache* upb_MiniTableCache_New(upb_MiniTablePlatform platform) {
+  upb_MiniTableCache* cache = upb_gmalloc(sizeof(*cache));
+  if (!cache) return NULL;
+
+  cache->arena = upb_Arena_New();
+  if (!cache->arena) goto err;
+  cache->msgs = upb_concurrenttable_new(cache->arena, true);
+  cache->enums = upb_concurrenttable_new(cache->arena, true);
+  if (!cache->msgs || !cache->enums) goto err;
+  cache->platform = platform;
+  upb_Atomic_Init(&cache->lock, 0);
+  cache->scratch_data = NULL;
+  cache->scratch_size = 0;
+  return cache;
+
+err:
+  if (cache->arena) upb_Arena_Free(cache->arena);
+  upb_gfree(cache);
+  return NULL;
+}
+
+void upb_MiniTableCache_Free(upb_MiniTableCache* cache) {
+  upb_Arena_Free(cache->arena);
+  upb_gfree(cache->scratch_data);
+  upb_gfree(cache);
+}
+
+static void upb_MiniTableCache_Lock(upb_MiniTableCache* cache) {
+  uintptr_t unlocked = 0;
+  while (!upb_Atomic_CompareExchangeWeak(&cache->lock, &unlocked, 1,
+                                         memory_order_acquire,
+                                         memory_order_relaxed)) {
+    unlocked = 0;
+  }
+}
+
+static void upb_MiniTableCache_Unlock(upb_MiniTableCache* cache) {
+  upb_Atomic_Store(&cache->lock, 0, memory_order_release);
+}
+
+// Unlike memcmp(), accepts NULL when `size` is zero.
+static bool upb_MiniTableCache_Equal(const void* a, const void* b,
+                                     size_t size) {
+  return size == 0 || memcmp(a, b, size) == 0;
+}
+
+static const upb_MiniTable* upb_MiniTableCache_Find(
+    const upb_MiniTableCache_Entry* entry, const upb_MiniTable** sub_tables,
+    size_t sub_table_count, const upb_MiniTableEnum** sub_enums,
+    size_t sub_enum_count) {
+  const upb_MiniTableCache_Linked* l =
+      upb_Atomic_Load(&entry->head, memory_order_acquire);
+  for (; l; l = l->next) {
+    if (l->sub_table_count == sub_table_count &&
+        l->sub_enum_count == sub_enum_count &&
+        upb_MiniTableCache_Equal(l->sub_tables, sub_tables,
+                                 sub_table_count * sizeof(*sub_tables)) &&
+        upb_MiniTableCache_Equal(l->sub_enums, sub_enums,
+                                 sub_enum_count * sizeof(*sub_enums))) {
+      return l->table;
+    }
+  }
+  return NULL;
+}
+
+static void* upb_MiniTableCache_Dup(upb_Arena* arena, const void* data,
+                                    size_t size) {
+  void* ret = upb_Arena_Malloc(arena, UPB_MAX(size, 1));
+  if (ret && size) memcpy(ret, data, size);
+  return ret;
+}
+
+// Builds, links and publishes a new table.  Must hold the lock.
+static const upb_MiniTable* upb_MiniTableCache_Build(
+    upb_MiniTableCache* cache, upb_MiniTableCache_Entry* entry,
+    const char* data, size_t len, const upb_MiniTable** sub_tables,
+    size_t sub_table_count, const upb_MiniTableEnum** sub_enums,
+    size_t sub_enum_count, upb_Status* status) {
+  upb_MiniTableCache_Linked* l = upb_Arena_Malloc(cache->arena, sizeof(*l));
+  if (!l) goto oom;
+  l->sub_table_count = sub_table_count;
+  l->sub_enum_count = sub_enum_count;
+  l->sub_tables = upb_MiniTableCache_Dup(
+      cache->arena, sub_tables, sub_table_count * sizeof(*sub_tables));
+  l->sub_enums = upb_MiniTableCache_Dup(cache->arena, sub_enums,
+                                        sub_enum_count * sizeof(*sub_enums));
+  if (!l->sub_tables || !l->sub_enums) goto oom;
+
+  upb_MiniTable* table = upb_MiniTable_BuildWithBuf(
+      data, len, cache->platform, cache->arena, &cache->scratch_data,
+      &cache->scratch_size, status);
+  if (!table) return NULL;
+
+  if (sub_table_count || sub_enum_count) {
+    // Link against the table itself wherever the caller asked for it, then
+    // put the placeholder back so that later lookups compare equal.
+    for (size_t i = 0; i < sub_table_count; i++) {
+      if (l->sub_tables[i] == kUpb_MiniTableCache_Self) {
+        l->sub_tables[i] = table;
+      }
+    }
+    bool ok = upb_MiniTable_Link(table, l->sub_tables, sub_table_count,
+                                 l->sub_enums, sub_enum_count);
+    for (size_t i = 0; i < sub_table_count; i++) {
+      if (l->sub_tables[i] == table) {
+        l->sub_tables[i] = kUpb_MiniTableCache_Self;
+      }
+    }
+    if (!ok) {
+      upb_Status_SetErrorMessage(status, "failed to link mini table");
+      return NULL;
+    }
+  }
+
+  l->table = table;
+  l->next = upb_Atomic_Load(&entry->head, memory_order_relaxed);
+  upb_Atomic_Store(&entry->head, l, memory_order_release);
+  return table;
+
+oom:
+  upb_Status_SetErrorMessage(status, "out of memory");
+  return NULL;
+}
+
+const upb_MiniTable* upb_MiniTableCache_Get(
+    upb_MiniTableCache* cache, const char* data, size_t len,
+    const upb_MiniTable** sub_tables, size_t sub_table_count,
+    const upb_MiniTableEnum** sub_enums, size_t sub_enum_count,
+    upb_Status* status) {
+  upb_value v;
+  const upb_MiniTable* ret;
+  if (upb_concurrenttable_lookupstr(cache->msgs, data, len, &v)) {
+    ret = upb_MiniTableCache_Find(upb_value_getptr(v), sub_tables,
+                                  sub_table_count, sub_enums, sub_enum_count);
+    if (ret) return ret;
+  }
+
+  upb_MiniTableCache_Lock(cache);
+
+  // Another thread may have built the table while we were waiting.
+  upb_MiniTableCache_Entry* entry;
+  if (upb_concurrenttable_lookupstr(cache->msgs, data, len, &v)) {
+    entry = upb_value_getptr(v);
+    ret = upb_MiniTableCache_Find(entry, sub_tables, sub_table_count,
+                                  sub_enums, sub_enum_count);
+    if (ret) goto done;
+  } else {
+    entry = upb_Arena_Malloc(cache->arena, sizeof(*entry));
+    char* key = upb_MiniTableCache_Dup(cache->arena, data, len);
+    if (!entry || !key) goto oom;
+    upb_Atomic_Init(&entry->head, NULL);
+    if (!upb_concurrenttable_insertstr(cache->msgs, key, len,
+                                       upb_value_ptr(entry))) {
+      goto oom;
+    }
+  }
+
+  ret = upb_MiniTableCache_Build(cache, entry, data, len, sub_tables,
+                                 sub_table_count, sub_enums, sub_enum_count,
+                                 status);
+
+done:
+  upb_MiniTableCache_Unlock(cache);
+  return ret;
+
+oom:
+  upb_MiniTableCache_Unlock(cache);
+  upb_Status_SetErrorMessage(status, "out of memory");
+  return NULL;
+}
+
+const upb_MiniTableEnum* upb_MiniTableCache_GetEnum(upb_MiniTableCache* cache,
+                                                    const char* data,
+                                                    size_t len,
+                                                    upb_Status* status) {
+  upb_value v;
+  if (upb_concurrenttable_lookupstr(cache->enums, data, len, &v)) {
+    return upb_value_getconstptr(v);
+  }
+
+  upb_MiniTableCache_Lock(cache);
+
+  const upb_MiniTableEnum* ret;
+  if (upb_concurrenttable_lookupstr(cache->enums, data, len, &v)) {
+    ret = upb_value_getconstptr(v);
+    goto done;
+  }
+
+  char* key = upb_MiniTableCache_Dup(cache->arena, data, len);
+  if (!key || !upb_concurrenttable_reserve(cache->enums, 1)) {
+    upb_Status_SetErrorMessage(status, "out of memory");
+    ret = NULL;
+    goto done;
+  }
+  ret = upb_MiniDescriptor_BuildEnum(data, len, cache->arena, status);
+  if (ret) {
+    upb_concurrenttable_insertstr(cache->enums, key, len,
+                                  upb_value_constptr(ret));
+  }
+
+done:
+  upb_MiniTableCache_Unlock(cache);
+  return ret;
+}
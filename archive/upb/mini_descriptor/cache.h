@@ -0,0 +1,92 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// A cache of MiniTables keyed by the contents of their MiniDescriptors, so that
+// identical descriptors received many times share one built and linked table.
+
+#ifndef UPB_MINI_DESCRIPTOR_CACHE_H_
+#define UPB_MINI_DESCRIPTOR_CACHE_H_
+
+#include "upb/base/status.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_table/enum.h"
+#include "upb/mini_table/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Tables are looked up without locking, so any number of threads may use the
+// cache at once.  A thread that misses builds and links the table while
+// holding a spin lock, so concurrent misses are built one at a time.  Without
+// C11 atomics (see UPB_USE_C11_ATOMICS) the cache is only safe to use from one
+// thread.
+//
+// Tables returned by the cache are shared and must not be modified, eg. with
+// upb_MiniTable_SetSubMessage().  They live until the cache is freed.
+typedef struct upb_MiniTableCache upb_MiniTableCache;
+
+// Stands for the table being looked up when it appears in the `sub_tables`
+// passed to upb_MiniTableCache_Get(), for messages that contain themselves.
+#define kUpb_MiniTableCache_Self ((const upb_MiniTable*)1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns NULL if memory allocation failed.
+UPB_API upb_MiniTableCache* upb_MiniTableCache_New(
+    upb_MiniTablePlatform platform);
+
+UPB_API void upb_MiniTableCache_Free(upb_MiniTableCache* cache);
+
+// Returns the MiniTable for a message MiniDescriptor, linked to `sub_tables`
+// and `sub_enums` as by upb_MiniTable_Link(), building it on first use.  The
+// sub-tables are part of the key, so passing tables that are themselves from
+// the cache lets identical schemas share every table.  If both counts are zero
+// the table is left unlinked.
+//
+// Returns NULL and sets `status` if the MiniDescriptor is invalid, the table
+// fails to link, or memory allocation failed.
+UPB_API const upb_MiniTable* upb_MiniTableCache_Get(
+    upb_MiniTableCache* cache, const char* data, size_t len,
+    const upb_MiniTable** sub_tables, size_t sub_table_count,
+    const upb_MiniTableEnum** sub_enums, size_t sub_enum_count,
+    upb_Status* status);
+
+// Returns the MiniTableEnum for an enum MiniDescriptor, building it on first
+// use.
+UPB_API const upb_MiniTableEnum* upb_MiniTableCache_GetEnum(
+    upb_MiniTableCache* cache, const char* data, size_t len,
+    upb_Status* status);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_MINI_DESCRIPTOR_CACHE_H_
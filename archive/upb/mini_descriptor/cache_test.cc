@@ -0,0 +1,185 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+#include "upb/mini_descriptor/cache.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "upb/base/status.hpp"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_table/message.h"
+
+namespace {
+
+class MiniTableCacheTest : public testing::Test {
+ protected:
+  MiniTableCacheTest()
+      : cache_(upb_MiniTableCache_New(kUpb_MiniTablePlatform_Native)) {}
+  ~MiniTableCacheTest() override { upb_MiniTableCache_Free(cache_); }
+
+  upb_MiniTableCache* cache_;
+};
+
+std::string ScalarMessage() {
+  upb::MtDataEncoder e;
+  EXPECT_TRUE(e.StartMessage(0));
+  EXPECT_TRUE(e.PutField(kUpb_FieldType_Int32, 1, 0));
+  EXPECT_TRUE(e.PutField(kUpb_FieldType_String, 2, 0));
+  return e.data();
+}
+
+// A message with a sub-message field and a closed enum field.
+std::string MessageWithSubs() {
+  upb::MtDataEncoder e;
+  EXPECT_TRUE(e.StartMessage(0));
+  EXPECT_TRUE(e.PutField(kUpb_FieldType_Message, 1, 0));
+  EXPECT_TRUE(
+      e.PutField(kUpb_FieldType_Enum, 2, kUpb_FieldModifier_IsClosedEnum));
+  return e.data();
+}
+
+std::string Enum() {
+  upb::MtDataEncoder e;
+  EXPECT_TRUE(e.StartEnum());
+  EXPECT_TRUE(e.PutEnumValue(0));
+  EXPECT_TRUE(e.PutEnumValue(1));
+  EXPECT_TRUE(e.EndEnum());
+  return e.data();
+}
+
+TEST_F(MiniTableCacheTest, SharesIdenticalDescriptors) {
+  upb::Status status;
+  std::string desc = ScalarMessage();
+  const upb_MiniTable* t1 = upb_MiniTableCache_Get(
+      cache_, desc.data(), desc.size(), nullptr, 0, nullptr, 0, status.ptr());
+  ASSERT_NE(nullptr, t1) << status.error_message();
+  EXPECT_EQ(2, t1->field_count);
+
+  std::string copy = desc;
+  EXPECT_EQ(t1, upb_MiniTableCache_Get(cache_, copy.data(), copy.size(),
+                                       nullptr, 0, nullptr, 0, status.ptr()));
+
+  std::string other = MessageWithSubs();
+  EXPECT_NE(t1, upb_MiniTableCache_Get(cache_, other.data(), other.size(),
+                                       nullptr, 0, nullptr, 0, status.ptr()));
+}
+
+TEST_F(MiniTableCacheTest, KeysOnLinkedSubTables) {
+  upb::Status status;
+  std::string scalar = ScalarMessage();
+  std::string with_subs = MessageWithSubs();
+  std::string enum_desc = Enum();
+  const upb_MiniTable* sub = upb_MiniTableCache_Get(
+      cache_, scalar.data(), scalar.size(), nullptr, 0, nullptr, 0,
+      status.ptr());
+  const upb_MiniTableEnum* sub_enum = upb_MiniTableCache_GetEnum(
+      cache_, enum_desc.data(), enum_desc.size(), status.ptr());
+  ASSERT_NE(nullptr, sub);
+  ASSERT_NE(nullptr, sub_enum);
+  EXPECT_EQ(sub_enum, upb_MiniTableCache_GetEnum(cache_, enum_desc.data(),
+                                                 enum_desc.size(),
+                                                 status.ptr()));
+
+  const upb_MiniTable* sub_tables[] = {sub};
+  const upb_MiniTableEnum* sub_enums[] = {sub_enum};
+  const upb_MiniTable* linked = upb_MiniTableCache_Get(
+      cache_, with_subs.data(), with_subs.size(), sub_tables, 1, sub_enums, 1,
+      status.ptr());
+  ASSERT_NE(nullptr, linked) << status.error_message();
+  EXPECT_EQ(sub, upb_MiniTable_GetSubMessageTable(linked, &linked->fields[0]));
+  EXPECT_EQ(sub_enum,
+            upb_MiniTable_GetSubEnumTable(linked, &linked->fields[1]));
+  EXPECT_EQ(linked, upb_MiniTableCache_Get(cache_, with_subs.data(),
+                                           with_subs.size(), sub_tables, 1,
+                                           sub_enums, 1, status.ptr()));
+
+  // Linking the same descriptor to another sub-table gives another table.
+  const upb_MiniTable* self_tables[] = {kUpb_MiniTableCache_Self};
+  const upb_MiniTable* recursive = upb_MiniTableCache_Get(
+      cache_, with_subs.data(), with_subs.size(), self_tables, 1, sub_enums, 1,
+      status.ptr());
+  ASSERT_NE(nullptr, recursive) << status.error_message();
+  EXPECT_NE(linked, recursive);
+  EXPECT_EQ(recursive,
+            upb_MiniTable_GetSubMessageTable(recursive, &recursive->fields[0]));
+  EXPECT_EQ(recursive, upb_MiniTableCache_Get(cache_, with_subs.data(),
+                                              with_subs.size(), self_tables, 1,
+                                              sub_enums, 1, status.ptr()));
+}
+
+TEST_F(MiniTableCacheTest, Errors) {
+  upb::Status status;
+  EXPECT_EQ(nullptr, upb_MiniTableCache_Get(cache_, "xyz", 3, nullptr, 0,
+                                            nullptr, 0, status.ptr()));
+  EXPECT_FALSE(status.ok());
+
+  // Too few sub-tables to link.
+  status.Clear();
+  std::string with_subs = MessageWithSubs();
+  const upb_MiniTable* sub_tables[] = {kUpb_MiniTableCache_Self};
+  EXPECT_EQ(nullptr, upb_MiniTableCache_Get(cache_, with_subs.data(),
+                                            with_subs.size(), sub_tables, 1,
+                                            nullptr, 0, status.ptr()));
+  EXPECT_FALSE(status.ok());
+}
+
+TEST_F(MiniTableCacheTest, Threads) {
+  std::vector<std::string> descs;
+  for (int i = 1; i <= 64; i++) {
+    upb::MtDataEncoder e;
+    ASSERT_TRUE(e.StartMessage(0));
+    for (int j = 1; j <= i; j++) {
+      ASSERT_TRUE(e.PutField(kUpb_FieldType_Int64, j, 0));
+    }
+    descs.push_back(e.data());
+  }
+
+  std::vector<std::vector<const upb_MiniTable*>> results(8);
+  std::vector<std::thread> threads;
+  for (auto& result : results) {
+    threads.emplace_back([&] {
+      for (const std::string& desc : descs) {
+        result.push_back(upb_MiniTableCache_Get(cache_, desc.data(),
+                                                desc.size(), nullptr, 0,
+                                                nullptr, 0, nullptr));
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  for (size_t i = 0; i < descs.size(); i++) {
+    ASSERT_NE(nullptr, results[0][i]);
+    EXPECT_EQ(i + 1, results[0][i]->field_count);
+    for (const auto& result : results) EXPECT_EQ(results[0][i], result[i]);
+  }
+}
+
+}  // namespace
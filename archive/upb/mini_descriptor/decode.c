@@ -32,7 +32,9 @@
 
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "upb/base/internal/log2.h"
 #include "upb/base/string_view.h"
 #include "upb/mem/arena.h"
 #include "upb/mini_descriptor/internal/base92.h"
@@ -61,6 +63,7 @@ typedef struct {
   uint16_t offset;
   upb_FieldRep rep;
   upb_LayoutItemType type;
+  uint8_t group;  // Hot fields first, then default, cold and out-of-line.
 } upb_LayoutItem;
 
 typedef struct {
@@ -76,6 +79,9 @@ typedef struct {
   upb_MiniTablePlatform platform;
   upb_LayoutItemVector vec;
   upb_Arena* arena;
+  const uint8_t* hotness;  // upb_FieldHotness by field index.
+  size_t hotness_count;
+  size_t out_of_line_size;  // Size of the out-of-line block laid out so far.
 } upb_MtDecoder;
 
 // In each field's offset, we temporarily store a presence classifier:
@@ -240,6 +246,13 @@ static void upb_MtDecoder_ModifyField(upb_MtDecoder* d,
   }
 }
 
+static void upb_MtDecoder_ReserveItems(upb_MtDecoder* d, size_t count) {
+  if (d->vec.capacity >= count) return;
+  d->vec.data = realloc(d->vec.data, count * sizeof(*d->vec.data));
+  upb_MdDecoder_CheckOutOfMemory(&d->base, d->vec.data);
+  d->vec.capacity = count;
+}
+
 static void upb_MtDecoder_PushItem(upb_MtDecoder* d, upb_LayoutItem item) {
   if (d->vec.size == d->vec.capacity) {
     size_t new_cap = UPB_MAX(8, d->vec.size * 2);
@@ -386,12 +399,9 @@ static const char* upb_MtDecoder_ParseModifier(upb_MtDecoder* d,
   return ptr;
 }
 
-static void upb_MtDecoder_AllocateSubs(upb_MtDecoder* d,
-                                       upb_SubCounts sub_counts) {
-  uint32_t total_count = sub_counts.submsg_count + sub_counts.subenum_count;
-  size_t subs_bytes = sizeof(*d->table->subs) * total_count;
-  upb_MiniTableSub* subs = upb_Arena_Malloc(d->arena, subs_bytes);
-  upb_MdDecoder_CheckOutOfMemory(&d->base, subs);
+static void upb_MtDecoder_InitSubs(upb_MtDecoder* d,
+                                   upb_SubCounts sub_counts) {
+  upb_MiniTableSub* subs = (upb_MiniTableSub*)d->table->subs;
   uint32_t i = 0;
   for (; i < sub_counts.submsg_count; i++) {
     subs[i].submsg = &_kUpb_MiniTable_Empty;
@@ -408,7 +418,6 @@ static void upb_MtDecoder_AllocateSubs(upb_MtDecoder* d,
       subs[i].subenum = NULL;
     }
   }
-  d->table->subs = subs;
 }
 
 static const char* upb_MtDecoder_Parse(upb_MtDecoder* d, const char* ptr,
@@ -470,47 +479,184 @@ static const char* upb_MtDecoder_Parse(upb_MtDecoder* d, const char* ptr,
   return ptr;
 }
 
+typedef struct {
+  size_t field_count;
+  size_t sub_count;
+  size_t oneof_count;
+} upb_MtDecoder_Counts;
+
+// Counts the fields, subs and oneofs of a message mini descriptor without
+// decoding it, so the table can be allocated at its final size up front.
+// Classifying each character is enough: the continuation characters of
+// modifier and skip varints never fall in the field range, and oneof members
+// never collide with the oneof separator.  Malformed input is left for
+// upb_MtDecoder_Parse() to reject; the counts stay exact for what it writes.
+static void upb_MtDecoder_CountMessage(const char* ptr, size_t len,
+                                       upb_MtDecoder_Counts* counts) {
+  const char* end = UPB_PTRADD(ptr, len);
+  counts->field_count = 0;
+  counts->sub_count = 0;
+  counts->oneof_count = 0;
+
+  for (; ptr < end; ptr++) {
+    char ch = *ptr;
+    if (ch == kUpb_EncodedValue_End) {
+      counts->oneof_count = 1;
+      for (ptr++; ptr < end; ptr++) {
+        if (*ptr == kUpb_EncodedValue_OneofSeparator) counts->oneof_count++;
+      }
+      break;
+    }
+    if (ch > kUpb_EncodedValue_MaxField) continue;
+
+    counts->field_count++;
+    int8_t type = _upb_FromBase92(ch);
+    if (ch >= _upb_ToBase92(kUpb_EncodedType_RepeatedBase)) {
+      type -= kUpb_EncodedType_RepeatedBase;
+    }
+    if (type == kUpb_EncodedType_Message || type == kUpb_EncodedType_Group ||
+        type == kUpb_EncodedType_ClosedEnum) {
+      counts->sub_count++;
+    }
+  }
+}
+
+// Allocates the table together with its subs and fields in a single block.
+// The subs (pointers) go first since the table's size is pointer-aligned.
+static void upb_MtDecoder_AllocateTable(upb_MtDecoder* d, size_t field_count,
+                                        size_t sub_count) {
+  size_t subs_bytes = sizeof(upb_MiniTableSub) * sub_count;
+  size_t fields_bytes = sizeof(upb_MiniTableField) * field_count;
+  size_t bytes = sizeof(upb_MiniTable) + subs_bytes + fields_bytes;
+  d->table = upb_Arena_Malloc(d->arena, bytes);
+  upb_MdDecoder_CheckOutOfMemory(&d->base, d->table);
+
+  upb_MiniTableSub* subs = UPB_PTR_AT(d->table, sizeof(upb_MiniTable), void);
+  d->fields = UPB_PTR_AT(subs, subs_bytes, upb_MiniTableField);
+  d->table->subs = subs;
+  d->table->fields = d->fields;
+  d->table->size = 0;
+  d->table->field_count = 0;
+  d->table->ext = kUpb_ExtMode_NonExtendable;
+  d->table->dense_below = 0;
+  d->table->table_mask = -1;
+  d->table->required_count = 0;
+  d->table->flags = 0;
+  d->table->field_index = NULL;
+  d->table->presence_index = NULL;
+}
+
 static void upb_MtDecoder_ParseMessage(upb_MtDecoder* d, const char* data,
                                        size_t len) {
-  // Buffer length is an upper bound on the number of fields. We will return
-  // what we don't use.
-  d->fields = upb_Arena_Malloc(d->arena, sizeof(*d->fields) * len);
-  upb_MdDecoder_CheckOutOfMemory(&d->base, d->fields);
+  // Count first so that everything is allocated exactly once: the table, its
+  // subs and fields in one arena block, and the layout items (one per field
+  // plus two per oneof, at most) in the caller's buffer.
+  upb_MtDecoder_Counts counts;
+  upb_MtDecoder_CountMessage(data, len, &counts);
+  upb_MtDecoder_AllocateTable(d, counts.field_count, counts.sub_count);
+  upb_MtDecoder_ReserveItems(d, counts.field_count + 2 * counts.oneof_count);
 
   upb_SubCounts sub_counts = {0, 0};
-  d->table->field_count = 0;
-  d->table->fields = d->fields;
   upb_MtDecoder_Parse(d, data, len, d->fields, sizeof(*d->fields),
                       &d->table->field_count, &sub_counts);
+  upb_MtDecoder_InitSubs(d, sub_counts);
+}
 
-  upb_Arena_ShrinkLast(d->arena, d->fields, sizeof(*d->fields) * len,
-                       sizeof(*d->fields) * d->table->field_count);
-  d->table->fields = d->fields;
-  upb_MtDecoder_AllocateSubs(d, sub_counts);
+// Layout groups, in the order they are placed in the message.
+enum {
+  kUpb_LayoutGroup_Hot = 0,
+  kUpb_LayoutGroup_Default = 1,
+  kUpb_LayoutGroup_Cold = 2,
+  kUpb_LayoutGroup_OutOfLine = 3,  // Not in the message at all.
+
+  kUpb_LayoutGroup_Max = kUpb_LayoutGroup_OutOfLine,
+};
+
+// Only singular fields outside of oneofs can live out of line, since oneof
+// members share their storage.  Sub-messages and closed enums are excluded too,
+// because their setters do not take an arena.  Must be called before offsets
+// are assigned, while `offset` still holds the presence class.
+static bool upb_MtDecoder_CanBeOutOfLine(upb_MtDecoder* d,
+                                         size_t field_index) {
+  const upb_MiniTableField* f = &d->fields[field_index];
+  return upb_FieldMode_Get(f) == kUpb_FieldMode_Scalar &&
+         f->offset < kOneofBase && !upb_IsSubMessage(f) &&
+         f->UPB_PRIVATE(descriptortype) != kUpb_FieldType_Enum;
+}
+
+// Only singular string fields outside of oneofs can have inline storage, since
+// it has to follow the field's own data.  Must be called before offsets are
+// assigned.
+static bool upb_MtDecoder_IsInlineString(upb_MtDecoder* d,
+                                         size_t field_index) {
+  const upb_MiniTableField* f = &d->fields[field_index];
+  if (field_index >= d->hotness_count ||
+      d->hotness[field_index] != kUpb_FieldHotness_InlineString) {
+    return false;
+  }
+  return upb_FieldMode_Get(f) == kUpb_FieldMode_Scalar &&
+         f->offset < kOneofBase &&
+         _upb_MiniTableField_GetRep(f) == kUpb_FieldRep_StringView;
+}
+
+static int upb_MtDecoder_FieldGroup(upb_MtDecoder* d, size_t field_index) {
+  if (field_index >= d->hotness_count) return kUpb_LayoutGroup_Default;
+  switch (d->hotness[field_index]) {
+    case kUpb_FieldHotness_Default:
+      return kUpb_LayoutGroup_Default;
+    case kUpb_FieldHotness_Hot:
+    case kUpb_FieldHotness_InlineString:
+      return kUpb_LayoutGroup_Hot;
+    case kUpb_FieldHotness_Cold:
+      return kUpb_LayoutGroup_Cold;
+    case kUpb_FieldHotness_OutOfLine:
+      return upb_MtDecoder_CanBeOutOfLine(d, field_index)
+                 ? kUpb_LayoutGroup_OutOfLine
+                 : kUpb_LayoutGroup_Cold;
+    default:
+      upb_MdDecoder_ErrorJmp(&d->base, "Invalid hotness for field %zu",
+                             field_index);
+  }
 }
 
 int upb_MtDecoder_CompareFields(const void* _a, const void* _b) {
   const upb_LayoutItem* a = _a;
   const upb_LayoutItem* b = _b;
   // Currently we just sort by:
-  //  1. rep (smallest fields first)
-  //  2. type (oneof cases first)
-  //  2. field_index (smallest numbers first)
-  // The main goal of this is to reduce space lost to padding.
-  // Later we may have more subtle reasons to prefer a different ordering.
+  //  1. group (hot fields first, cold and out-of-line fields last)
+  //  2. rep (smallest fields first)
+  //  3. type (oneof cases first)
+  //  4. field_index (smallest numbers first)
+  // The main goal of this is to reduce space lost to padding, while keeping
+  // hot fields together at the front of the message.
   const int rep_bits = upb_Log2Ceiling(kUpb_FieldRep_Max);
   const int type_bits = upb_Log2Ceiling(kUpb_LayoutItemType_Max);
+  const int group_bits = upb_Log2Ceiling(kUpb_LayoutGroup_Max);
   const int idx_bits = (sizeof(a->field_index) * 8);
-  UPB_ASSERT(idx_bits + rep_bits + type_bits < 32);
-#define UPB_COMBINE(rep, ty, idx) (((rep << type_bits) | ty) << idx_bits) | idx
-  uint32_t a_packed = UPB_COMBINE(a->rep, a->type, a->field_index);
-  uint32_t b_packed = UPB_COMBINE(b->rep, b->type, b->field_index);
+  UPB_ASSERT(idx_bits + rep_bits + type_bits + group_bits < 32);
+#define UPB_COMBINE(group, rep, ty, idx) \
+  (((((group << rep_bits) | rep) << type_bits) | ty) << idx_bits) | idx
+  uint32_t a_packed = UPB_COMBINE(a->group, a->rep, a->type, a->field_index);
+  uint32_t b_packed = UPB_COMBINE(b->group, b->rep, b->type, b->field_index);
   assert(a_packed != b_packed);
 #undef UPB_COMBINE
   return a_packed < b_packed ? -1 : 1;
 }
 
 static bool upb_MtDecoder_SortLayoutItems(upb_MtDecoder* d) {
+  // A oneof is placed with its hottest member.
+  upb_LayoutItem* end = UPB_PTRADD(d->vec.data, d->vec.size);
+  for (upb_LayoutItem* item = d->vec.data; item < end; item++) {
+    uint16_t index = item->field_index;
+    item->group = kUpb_LayoutGroup_Cold;
+    while (true) {
+      item->group = UPB_MIN(item->group, upb_MtDecoder_FieldGroup(d, index));
+      uint16_t next = d->fields[index].offset;
+      if (next == kUpb_LayoutItem_IndexSentinel) break;
+      index = next - kOneofBase;
+    }
+  }
+
   // Add items for all non-oneof fields (oneofs were already added).
   int n = d->table->field_count;
   for (int i = 0; i < n; i++) {
@@ -518,7 +664,8 @@ static bool upb_MtDecoder_SortLayoutItems(upb_MtDecoder* d) {
     if (f->offset >= kOneofBase) continue;
     upb_LayoutItem item = {.field_index = i,
                            .rep = f->mode >> kUpb_FieldRep_Shift,
-                           .type = kUpb_LayoutItemType_Field};
+                           .type = kUpb_LayoutItemType_Field,
+                           .group = upb_MtDecoder_FieldGroup(d, i)};
     upb_MtDecoder_PushItem(d, item);
   }
 
@@ -554,37 +701,73 @@ static void upb_MtDecoder_AssignHasbits(upb_MtDecoder* d) {
     upb_MdDecoder_ErrorJmp(&d->base, "Too many required fields");
   }
 
-  // Next assign non-required hasbit fields.
-  for (int i = 0; i < n; i++) {
-    upb_MiniTableField* field = (upb_MiniTableField*)&ret->fields[i];
-    if (field->offset == kHasbitPresence) {
-      field->presence = ++last_hasbit;
+  // Next assign non-required hasbit fields, hot fields first.
+  const bool grouped = d->hotness_count > 0;
+  const int first = grouped ? kUpb_LayoutGroup_Hot : kUpb_LayoutGroup_Default;
+  const int last =
+      grouped ? kUpb_LayoutGroup_OutOfLine : kUpb_LayoutGroup_Default;
+  for (int group = first; group <= last; group++) {
+    for (int i = 0; i < n; i++) {
+      upb_MiniTableField* field = (upb_MiniTableField*)&ret->fields[i];
+      if (field->offset == kHasbitPresence &&
+          upb_MtDecoder_FieldGroup(d, i) == group) {
+        field->presence = ++last_hasbit;
+      }
     }
   }
 
   ret->size = last_hasbit ? upb_MiniTable_DivideRoundUp(last_hasbit + 1, 8) : 0;
 }
 
-size_t upb_MtDecoder_Place(upb_MtDecoder* d, upb_FieldRep rep) {
+static size_t upb_MtDecoder_PlaceIn(upb_MtDecoder* d, upb_FieldRep rep,
+                                    size_t* block_size) {
   size_t size = upb_MtDecoder_SizeOfRep(rep, d->platform);
   size_t align = upb_MtDecoder_AlignOfRep(rep, d->platform);
-  size_t ret = UPB_ALIGN_UP(d->table->size, align);
+  size_t ret = UPB_ALIGN_UP(*block_size, align);
   static const size_t max = UINT16_MAX;
   size_t new_size = ret + size;
   if (new_size > max) {
     upb_MdDecoder_ErrorJmp(
         &d->base, "Message size exceeded maximum size of %zu bytes", max);
   }
-  d->table->size = new_size;
+  *block_size = new_size;
+  return ret;
+}
+
+size_t upb_MtDecoder_Place(upb_MtDecoder* d, upb_FieldRep rep) {
+  size_t size = d->table->size;
+  size_t ret = upb_MtDecoder_PlaceIn(d, rep, &size);
+  d->table->size = size;
   return ret;
 }
 
+// Appends `size` bytes that belong to the previously placed field.
+static void upb_MtDecoder_Reserve(upb_MtDecoder* d, size_t size) {
+  static const size_t max = UINT16_MAX;
+  size_t new_size = d->table->size + size;
+  if (new_size > max) {
+    upb_MdDecoder_ErrorJmp(
+        &d->base, "Message size exceeded maximum size of %zu bytes", max);
+  }
+  d->table->size = new_size;
+}
+
 static void upb_MtDecoder_AssignOffsets(upb_MtDecoder* d) {
   upb_LayoutItem* end = UPB_PTRADD(d->vec.data, d->vec.size);
 
-  // Compute offsets.
+  // Compute offsets.  Out-of-line fields are laid out in their own block, and
+  // inline strings are followed by their buffer.
   for (upb_LayoutItem* item = d->vec.data; item < end; item++) {
-    item->offset = upb_MtDecoder_Place(d, item->rep);
+    if (item->group == kUpb_LayoutGroup_OutOfLine) {
+      item->offset = upb_MtDecoder_PlaceIn(d, item->rep, &d->out_of_line_size);
+    } else {
+      item->offset = upb_MtDecoder_Place(d, item->rep);
+      if (item->type == kUpb_LayoutItemType_Field &&
+          upb_MtDecoder_IsInlineString(d, item->field_index)) {
+        upb_MtDecoder_Reserve(d, kUpb_MiniTableField_InlineStringSize);
+        d->fields[item->field_index].mode |= kUpb_LabelFlags_IsInlineString;
+      }
+    }
   }
 
   // Assign oneof case offsets.  We must do these first, since assigning
@@ -614,6 +797,9 @@ static void upb_MtDecoder_AssignOffsets(upb_MtDecoder* d) {
         break;
       case kUpb_LayoutItemType_Field:
         f->offset = item->offset;
+        if (item->group == kUpb_LayoutGroup_OutOfLine) {
+          f->mode |= kUpb_LabelFlags_IsOutOfLine;
+        }
         break;
       default:
         break;
@@ -658,6 +844,75 @@ static void upb_MtDecoder_ValidateEntryField(upb_MtDecoder* d,
   }
 }
 
+static void upb_MtDecoder_BuildFieldIndex(upb_MtDecoder* d) {
+  const int first = d->table->dense_below;
+  const int count = d->table->field_count - first;
+  if (count < kUpb_MiniTable_MinIndexedFields) return;
+
+  // Keep the index at most half full, with a mask that fits in a slot.
+  const size_t size = upb_Log2CeilingSize(count * 2);
+  if (size > UINT16_MAX + 1) return;
+  uint16_t* index = upb_Arena_Malloc(d->arena, (size + 1) * sizeof(*index));
+  upb_MdDecoder_CheckOutOfMemory(&d->base, index);
+  memset(index, 0, (size + 1) * sizeof(*index));
+  index[0] = size - 1;
+
+  for (int i = first; i < d->table->field_count; i++) {
+    uint32_t slot = _upb_MiniTable_FieldIndexHash(d->fields[i].number);
+    while (index[1 + (slot & index[0])]) slot++;
+    index[1 + (slot & index[0])] = i + 1;
+  }
+  d->table->field_index = index;
+}
+
+// Builds the table described for upb_MiniTable.presence_index, in the same
+// way as upb_PresenceIndex_New().
+static void upb_MtDecoder_BuildPresenceIndex(upb_MtDecoder* d) {
+  const int n = d->table->field_count;
+  if (n < kUpb_MiniTable_MinPresenceIndexedFields ||
+      n > kUpb_MiniTable_MaxPresenceIndexedFields) {
+    return;
+  }
+
+  size_t hasbit_end = 1;
+  for (int i = 0; i < n; i++) {
+    if (d->fields[i].presence > 0) {
+      hasbit_end = UPB_MAX(hasbit_end, (size_t)d->fields[i].presence + 1);
+    }
+  }
+
+  // Fields without hasbits are at most all of them.
+  const size_t size = 2 + hasbit_end + n;
+  uint16_t* index = upb_Arena_Malloc(d->arena, size * sizeof(*index));
+  upb_MdDecoder_CheckOutOfMemory(&d->base, index);
+  memset(index, 0, size * sizeof(*index));
+  index[0] = hasbit_end;
+  uint16_t* by_hasbit = &index[1];
+  uint16_t* other_count = &index[1 + hasbit_end];
+  uint16_t* others = other_count + 1;
+
+  for (int i = 0; i < n; i++) {
+    const upb_MiniTableField* f = &d->fields[i];
+    if (f->presence > 0) {
+      by_hasbit[f->presence] = i;
+      continue;
+    }
+    if (f->presence < 0) {
+      // Members of a oneof share a case, so only the first one is listed.
+      bool seen = false;
+      for (int j = 0; j < *other_count; j++) {
+        if (d->fields[others[j]].presence == f->presence) {
+          seen = true;
+          break;
+        }
+      }
+      if (seen) continue;
+    }
+    others[(*other_count)++] = i;
+  }
+  d->table->presence_index = index;
+}
+
 static void upb_MtDecoder_ParseMap(upb_MtDecoder* d, const char* data,
                                    size_t len) {
   upb_MtDecoder_ParseMessage(d, data, len);
@@ -692,6 +947,19 @@ static void upb_MtDecoder_ParseMap(upb_MtDecoder* d, const char* data,
   d->table->ext |= kUpb_ExtMode_IsMapEntry;
 }
 
+// Sub-messages are not linked yet, so only messages without any can be known
+// not to reach required fields.  upb_DefBuilder sets the flag on the rest.
+static void upb_MtDecoder_SetFlags(upb_MtDecoder* d) {
+  upb_MiniTable* ret = d->table;
+  if (ret->required_count || ret->ext != kUpb_ExtMode_NonExtendable) return;
+  for (int i = 0; i < ret->field_count; i++) {
+    if (upb_MiniTableField_CType(&ret->fields[i]) == kUpb_CType_Message) {
+      return;
+    }
+  }
+  ret->flags |= kUpb_MiniTableFlag_NoReachableRequired;
+}
+
 static void upb_MtDecoder_ParseMessageSet(upb_MtDecoder* d, const char* data,
                                           size_t len) {
   if (len > 0) {
@@ -699,29 +967,18 @@ static void upb_MtDecoder_ParseMessageSet(upb_MtDecoder* d, const char* data,
                            len);
   }
 
-  upb_MiniTable* ret = d->table;
-  ret->size = 0;
-  ret->field_count = 0;
-  ret->ext = kUpb_ExtMode_IsMessageSet;
-  ret->dense_below = 0;
-  ret->table_mask = -1;
-  ret->required_count = 0;
+  upb_MtDecoder_AllocateTable(d, 0, 0);
+  d->table->ext = kUpb_ExtMode_IsMessageSet;
 }
 
 static upb_MiniTable* upb_MtDecoder_DoBuildMiniTableWithBuf(
     upb_MtDecoder* decoder, const char* data, size_t len, void** buf,
     size_t* buf_size) {
-  upb_MdDecoder_CheckOutOfMemory(&decoder->base, decoder->table);
-
-  decoder->table->size = 0;
-  decoder->table->field_count = 0;
-  decoder->table->ext = kUpb_ExtMode_NonExtendable;
-  decoder->table->dense_below = 0;
-  decoder->table->table_mask = -1;
-  decoder->table->required_count = 0;
-
   // Strip off and verify the version tag.
-  if (!len--) goto done;
+  if (!len--) {
+    upb_MtDecoder_AllocateTable(decoder, 0, 0);
+    goto done;
+  }
   const char vers = *data++;
 
   switch (vers) {
@@ -734,6 +991,9 @@ static upb_MiniTable* upb_MtDecoder_DoBuildMiniTableWithBuf(
       upb_MtDecoder_AssignHasbits(decoder);
       upb_MtDecoder_SortLayoutItems(decoder);
       upb_MtDecoder_AssignOffsets(decoder);
+      upb_MtDecoder_BuildFieldIndex(decoder);
+      upb_MtDecoder_BuildPresenceIndex(decoder);
+      upb_MtDecoder_SetFlags(decoder);
       break;
 
     case kUpb_EncodedVersion_MessageSetV1:
@@ -769,6 +1029,14 @@ upb_MiniTable* upb_MiniTable_BuildWithBuf(const char* data, size_t len,
                                           upb_Arena* arena, void** buf,
                                           size_t* buf_size,
                                           upb_Status* status) {
+  return upb_MiniTable_BuildWithHotness(data, len, platform, NULL, 0, arena,
+                                        buf, buf_size, status);
+}
+
+upb_MiniTable* upb_MiniTable_BuildWithHotness(
+    const char* data, size_t len, upb_MiniTablePlatform platform,
+    const uint8_t* hotness, size_t hotness_count, upb_Arena* arena, void** buf,
+    size_t* buf_size, upb_Status* status) {
   upb_MtDecoder decoder = {
       .base = {.status = status},
       .platform = platform,
@@ -779,7 +1047,9 @@ upb_MiniTable* upb_MiniTable_BuildWithBuf(const char* data, size_t len,
               .size = 0,
           },
       .arena = arena,
-      .table = upb_Arena_Malloc(arena, sizeof(*decoder.table)),
+      .table = NULL,
+      .hotness = hotness,
+      .hotness_count = hotness ? hotness_count : 0,
   };
 
   return upb_MtDecoder_BuildMiniTableWithBuf(&decoder, data, len, buf,
@@ -55,6 +55,15 @@ typedef enum {
       UPB_SIZE(kUpb_MiniTablePlatform_32Bit, kUpb_MiniTablePlatform_64Bit),
 } upb_MiniTablePlatform;
 
+// Layout hints for individual fields, see upb_MiniTable_BuildWithHotness().
+typedef enum {
+  kUpb_FieldHotness_Default = 0,
+  kUpb_FieldHotness_Hot = 1,        // Frequently accessed.
+  kUpb_FieldHotness_Cold = 2,       // Rarely present.
+  kUpb_FieldHotness_OutOfLine = 3,  // Almost never present.
+  kUpb_FieldHotness_InlineString = 4,  // Hot, with short values inline.
+} upb_FieldHotness;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -134,6 +143,39 @@ upb_MiniTable* upb_MiniTable_BuildWithBuf(const char* data, size_t len,
                                           upb_Arena* arena, void** buf,
                                           size_t* buf_size, upb_Status* status);
 
+// Like upb_MiniTable_BuildWithBuf(), but lays out the message according to
+// `hotness`, which holds a upb_FieldHotness for each of the first
+// `hotness_count` fields in the order they appear in the mini descriptor (ie.
+// by field number).  Further fields are kUpb_FieldHotness_Default.
+//
+// Hot fields get the lowest hasbits after required fields, and their data is
+// placed right after the hasbits, so as many of them as possible share the
+// first cache line of the message.  Cold fields get the highest hasbits and
+// are placed after all other fields.  Within each group fields are still
+// sorted by size to avoid padding.  Map entries ignore `hotness`, since their
+// layout is fixed.
+//
+// Out-of-line fields take no space in the message: their data lives in a
+// block that is allocated on the message's arena the first time one of them
+// is set, so they only cost memory in the messages that use them.  This
+// applies to singular scalar and string fields outside of oneofs, except
+// closed enums; other fields marked kUpb_FieldHotness_OutOfLine are treated
+// as cold.  Setting an out-of-line field requires an arena, so such tables
+// cannot back generated code, whose setters take none; they are meant for
+// tables built at runtime and accessed through upb_Message_* and reflection.
+//
+// Inline-string fields are hot fields that also reserve
+// kUpb_MiniTableField_InlineStringSize bytes in the message right after their
+// upb_StringView.  When the parser has to copy a value that fits, it stores it
+// there instead of allocating it from the arena, so that reading the string
+// stays within the message.  This applies to singular string and bytes fields
+// outside of oneofs; other fields marked kUpb_FieldHotness_InlineString are
+// treated as hot.
+upb_MiniTable* upb_MiniTable_BuildWithHotness(
+    const char* data, size_t len, upb_MiniTablePlatform platform,
+    const uint8_t* hotness, size_t hotness_count, upb_Arena* arena, void** buf,
+    size_t* buf_size, upb_Status* status);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
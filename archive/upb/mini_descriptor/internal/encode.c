@@ -173,9 +173,9 @@ static char* _upb_MtDataEncoder_MaybePutFieldSkip(upb_MtDataEncoder* e,
   return ptr;
 }
 
-static char* _upb_MtDataEncoder_PutFieldType(upb_MtDataEncoder* e, char* ptr,
-                                             upb_FieldType type,
-                                             uint64_t field_mod) {
+UPB_FORCEINLINE
+static int _upb_MtDataEncoder_EncodedType(upb_FieldType type,
+                                          uint64_t field_mod) {
   static const char kUpb_TypeToEncoded[] = {
       [kUpb_FieldType_Double] = kUpb_EncodedType_Double,
       [kUpb_FieldType_Float] = kUpb_EncodedType_Float,
@@ -210,19 +210,18 @@ static char* _upb_MtDataEncoder_PutFieldType(upb_MtDataEncoder* e, char* ptr,
     encoded_type += kUpb_EncodedType_RepeatedBase;
   }
 
-  return upb_MtDataEncoder_Put(e, ptr, encoded_type);
+  return encoded_type;
 }
 
-static char* _upb_MtDataEncoder_MaybePutModifiers(upb_MtDataEncoder* e,
-                                                  char* ptr, upb_FieldType type,
-                                                  uint64_t field_mod) {
-  upb_MtDataEncoderInternal* in = (upb_MtDataEncoderInternal*)e->internal;
+UPB_FORCEINLINE
+static uint32_t _upb_MtDataEncoder_EncodedModifiers(upb_FieldType type,
+                                                    uint64_t field_mod,
+                                                    uint64_t msg_mod) {
   uint32_t encoded_modifiers = 0;
   if ((field_mod & kUpb_FieldModifier_IsRepeated) &&
       upb_FieldType_IsPackable(type)) {
     bool field_is_packed = field_mod & kUpb_FieldModifier_IsPacked;
-    bool default_is_packed = in->state.msg_state.msg_modifiers &
-                             kUpb_MessageModifier_DefaultIsPacked;
+    bool default_is_packed = msg_mod & kUpb_MessageModifier_DefaultIsPacked;
     if (field_is_packed != default_is_packed) {
       encoded_modifiers |= kUpb_EncodedFieldModifier_FlipPacked;
     }
@@ -236,7 +235,24 @@ static char* _upb_MtDataEncoder_MaybePutModifiers(upb_MtDataEncoder* e,
     encoded_modifiers |= kUpb_EncodedFieldModifier_IsRequired;
   }
 
-  return upb_MtDataEncoder_PutModifier(e, ptr, encoded_modifiers);
+  return encoded_modifiers;
+}
+
+static char* _upb_MtDataEncoder_PutFieldType(upb_MtDataEncoder* e, char* ptr,
+                                             upb_FieldType type,
+                                             uint64_t field_mod) {
+  return upb_MtDataEncoder_Put(
+      e, ptr, _upb_MtDataEncoder_EncodedType(type, field_mod));
+}
+
+static char* _upb_MtDataEncoder_MaybePutModifiers(upb_MtDataEncoder* e,
+                                                  char* ptr, upb_FieldType type,
+                                                  uint64_t field_mod) {
+  upb_MtDataEncoderInternal* in = (upb_MtDataEncoderInternal*)e->internal;
+  return upb_MtDataEncoder_PutModifier(
+      e, ptr,
+      _upb_MtDataEncoder_EncodedModifiers(type, field_mod,
+                                          in->state.msg_state.msg_modifiers));
 }
 
 char* upb_MtDataEncoder_PutField(upb_MtDataEncoder* e, char* ptr,
@@ -279,6 +295,159 @@ char* upb_MtDataEncoder_PutOneofField(upb_MtDataEncoder* e, char* ptr,
   return ptr;
 }
 
+// The batched encoder below writes the same characters as the calls above, but
+// into a buffer that is known to be big enough, so it checks no bounds.
+
+// Bits per character of skips, modifiers and oneof field numbers, whose
+// characters are contiguous in base92.
+enum {
+  kUpb_MtDataEncoder_SkipShift = 5,
+  kUpb_MtDataEncoder_ModifierShift = 4,
+  kUpb_MtDataEncoder_OneofFieldShift = 6,
+};
+
+static void _upb_MtDataEncoder_CheckShift(char min, char max, int shift) {
+  UPB_ASSERT(_upb_FromBase92(max) - _upb_FromBase92(min) + 1 == 1 << shift);
+  UPB_UNUSED(min);
+  UPB_UNUSED(max);
+  UPB_UNUSED(shift);
+}
+
+static void _upb_MtDataEncoder_CheckShifts(void) {
+  _upb_MtDataEncoder_CheckShift(kUpb_EncodedValue_MinSkip,
+                                kUpb_EncodedValue_MaxSkip,
+                                kUpb_MtDataEncoder_SkipShift);
+  _upb_MtDataEncoder_CheckShift(kUpb_EncodedValue_MinModifier,
+                                kUpb_EncodedValue_MaxModifier,
+                                kUpb_MtDataEncoder_ModifierShift);
+}
+
+UPB_FORCEINLINE
+static size_t _upb_MtDataEncoder_VarintSize(uint32_t val, int shift) {
+  // The number of significant bits, at least one, in whole characters.
+  const int bits = UPB_MAX(1, upb_Log2Ceiling(val + 1));
+  return (bits + shift - 1) / shift;
+}
+
+UPB_FORCEINLINE
+static char* _upb_MtDataEncoder_WriteVarint(char* ptr, uint32_t val, int min,
+                                            int shift) {
+  const uint32_t mask = (1 << shift) - 1;
+  do {
+    *ptr++ = _upb_ToBase92((val & mask) + min);
+    val >>= shift;
+  } while (val);
+  return ptr;
+}
+
+size_t upb_MtDataEncoder_MessageSize(uint64_t msg_mod,
+                                     const upb_MtDataEncoder_Field* fields,
+                                     size_t field_count,
+                                     const uint32_t* oneof_fields,
+                                     size_t oneof_field_count) {
+  _upb_MtDataEncoder_CheckShifts();
+  size_t size = 1;
+  if (msg_mod) {
+    size += _upb_MtDataEncoder_VarintSize(msg_mod,
+                                          kUpb_MtDataEncoder_ModifierShift);
+  }
+
+  uint32_t last_field_num = 0;
+  for (size_t i = 0; i < field_count; i++) {
+    const upb_MtDataEncoder_Field* f = &fields[i];
+    if (f->number <= last_field_num) return 0;
+    if (f->number != last_field_num + 1) {
+      size += _upb_MtDataEncoder_VarintSize(f->number - last_field_num,
+                                            kUpb_MtDataEncoder_SkipShift);
+    }
+    last_field_num = f->number;
+    uint32_t mod =
+        _upb_MtDataEncoder_EncodedModifiers(f->type, f->modifiers, msg_mod);
+    size++;
+    if (mod) {
+      size +=
+          _upb_MtDataEncoder_VarintSize(mod, kUpb_MtDataEncoder_ModifierShift);
+    }
+  }
+
+  // Each oneof starts with a separator, and each field after the first in a
+  // oneof has one too.
+  bool new_oneof = true;
+  bool first_in_oneof = true;
+  for (size_t i = 0; i < oneof_field_count; i++) {
+    if (new_oneof) {
+      size++;
+      new_oneof = false;
+      first_in_oneof = true;
+    }
+    if (oneof_fields[i] == 0) {
+      new_oneof = true;
+      continue;
+    }
+    if (!first_in_oneof) size++;
+    size += _upb_MtDataEncoder_VarintSize(
+        oneof_fields[i], kUpb_MtDataEncoder_OneofFieldShift);
+    first_in_oneof = false;
+  }
+  return size;
+}
+
+char* upb_MtDataEncoder_EncodeMessage(char* buf, uint64_t msg_mod,
+                                      const upb_MtDataEncoder_Field* fields,
+                                      size_t field_count,
+                                      const uint32_t* oneof_fields,
+                                      size_t oneof_field_count) {
+  _upb_MtDataEncoder_CheckShifts();
+  const int min_skip = _upb_FromBase92(kUpb_EncodedValue_MinSkip);
+  const int min_modifier = _upb_FromBase92(kUpb_EncodedValue_MinModifier);
+  char* ptr = buf;
+  *ptr++ = kUpb_EncodedVersion_MessageV1;
+  if (msg_mod) {
+    ptr = _upb_MtDataEncoder_WriteVarint(ptr, msg_mod, min_modifier,
+                                         kUpb_MtDataEncoder_ModifierShift);
+  }
+
+  uint32_t last_field_num = 0;
+  for (size_t i = 0; i < field_count; i++) {
+    const upb_MtDataEncoder_Field* f = &fields[i];
+    UPB_ASSERT(f->number > last_field_num);
+    if (f->number != last_field_num + 1) {
+      ptr = _upb_MtDataEncoder_WriteVarint(ptr, f->number - last_field_num,
+                                           min_skip,
+                                           kUpb_MtDataEncoder_SkipShift);
+    }
+    last_field_num = f->number;
+    *ptr++ =
+        _upb_ToBase92(_upb_MtDataEncoder_EncodedType(f->type, f->modifiers));
+    uint32_t mod =
+        _upb_MtDataEncoder_EncodedModifiers(f->type, f->modifiers, msg_mod);
+    if (mod) {
+      ptr = _upb_MtDataEncoder_WriteVarint(ptr, mod, min_modifier,
+                                           kUpb_MtDataEncoder_ModifierShift);
+    }
+  }
+
+  bool new_oneof = true;
+  bool first_in_oneof = true;
+  for (size_t i = 0; i < oneof_field_count; i++) {
+    if (new_oneof) {
+      *ptr++ = i == 0 ? kUpb_EncodedValue_End
+                      : kUpb_EncodedValue_OneofSeparator;
+      new_oneof = false;
+      first_in_oneof = true;
+    }
+    if (oneof_fields[i] == 0) {
+      new_oneof = true;
+      continue;
+    }
+    if (!first_in_oneof) *ptr++ = kUpb_EncodedValue_FieldSeparator;
+    ptr = _upb_MtDataEncoder_WriteVarint(
+        ptr, oneof_fields[i], 0, kUpb_MtDataEncoder_OneofFieldShift);
+    first_in_oneof = false;
+  }
+  return ptr;
+}
+
 char* upb_MtDataEncoder_StartEnum(upb_MtDataEncoder* e, char* ptr) {
   upb_MtDataEncoderInternal* in = upb_MtDataEncoder_GetInternal(e, ptr);
   in->state.enum_state.present_values_mask = 0;
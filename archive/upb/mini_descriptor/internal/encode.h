@@ -31,6 +31,7 @@
 #ifndef UPB_MINI_DESCRIPTOR_INTERNAL_ENCODE_H_
 #define UPB_MINI_DESCRIPTOR_INTERNAL_ENCODE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "upb/base/descriptor_constants.h"
@@ -48,6 +49,13 @@ typedef struct {
   char internal[32];
 } upb_MtDataEncoder;
 
+// A field of a message, for upb_MtDataEncoder_EncodeMessage().
+typedef struct {
+  upb_FieldType type;
+  uint32_t number;
+  uint64_t modifiers;  // Bitwise | of kUpb_FieldModifiers or zero.
+} upb_MtDataEncoder_Field;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -85,6 +93,33 @@ char* upb_MtDataEncoder_StartOneof(upb_MtDataEncoder* e, char* ptr);
 char* upb_MtDataEncoder_PutOneofField(upb_MtDataEncoder* e, char* ptr,
                                       uint32_t field_num);
 
+// Encodes an entire mini descriptor for a message in one go, with the same
+// result as the calls above.  |fields| must be in field number order, and
+// |oneof_fields| holds the field numbers of each oneof in turn, with a 0 after
+// each oneof.  Sizing the buffer first with upb_MtDataEncoder_MessageSize()
+// lets the encoder write without checking for space after every character:
+//
+//   size_t size = upb_MtDataEncoder_MessageSize(msg_mod, fields, n,
+//                                               oneof_fields, oneof_n);
+//   if (size == 0) return false;  // Fields out of order.
+//   char* buf = malloc(size);
+//   upb_MtDataEncoder_EncodeMessage(buf, msg_mod, fields, n, oneof_fields,
+//                                   oneof_n);
+//
+// upb_MtDataEncoder_MessageSize() returns the number of characters to be
+// written, or 0 if the fields are not in field number order.
+// upb_MtDataEncoder_EncodeMessage() returns the end of what it wrote.
+size_t upb_MtDataEncoder_MessageSize(uint64_t msg_mod,
+                                     const upb_MtDataEncoder_Field* fields,
+                                     size_t field_count,
+                                     const uint32_t* oneof_fields,
+                                     size_t oneof_field_count);
+char* upb_MtDataEncoder_EncodeMessage(char* buf, uint64_t msg_mod,
+                                      const upb_MtDataEncoder_Field* fields,
+                                      size_t field_count,
+                                      const uint32_t* oneof_fields,
+                                      size_t oneof_field_count);
+
 // Encodes the set of values for a given enum. The values must be given in
 // order (after casting to uint32_t), and repeats are not allowed.
 char* upb_MtDataEncoder_StartEnum(upb_MtDataEncoder* e, char* ptr);
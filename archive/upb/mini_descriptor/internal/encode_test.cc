@@ -30,6 +30,8 @@
 
 #include "upb/mini_descriptor/internal/encode.hpp"
 
+#include <random>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -39,12 +41,15 @@
 #include "google/protobuf/descriptor.h"
 #include "upb/base/status.hpp"
 #include "upb/mem/arena.hpp"
+#include "upb/message/accessors.h"
 #include "upb/message/internal/accessors.h"
+#include "upb/message/message.h"
 #include "upb/mini_descriptor/decode.h"
 #include "upb/mini_descriptor/internal/base92.h"
 #include "upb/mini_descriptor/internal/modifiers.h"
 #include "upb/mini_table/enum.h"
 #include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
 
 // begin:google_only
 // #include "testing/fuzzing/fuzztest.h"
@@ -144,6 +149,93 @@ TEST_P(MiniTableTest, Skips) {
   EXPECT_EQ(0, table->required_count);
 }
 
+TEST_P(MiniTableTest, SparseFieldIndex) {
+  upb::Arena arena;
+  upb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartMessage(0));
+  std::vector<uint32_t> field_numbers;
+  for (uint32_t i = 0; i < 200; i++) {
+    field_numbers.push_back(1000 + 7 * i);
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, field_numbers.back(), 0));
+  }
+  upb::Status status;
+  upb_MiniTable* table = _upb_MiniTable_Build(
+      e.data().data(), e.data().size(), GetParam(), arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table);
+  ASSERT_NE(nullptr, table->field_index);
+  for (uint32_t i = 0; i < field_numbers.size(); i++) {
+    EXPECT_EQ(&table->fields[i],
+              upb_MiniTable_FindFieldByNumber(table, field_numbers[i]));
+    EXPECT_EQ(nullptr,
+              upb_MiniTable_FindFieldByNumber(table, field_numbers[i] + 1));
+  }
+  EXPECT_EQ(nullptr, upb_MiniTable_FindFieldByNumber(table, 0));
+
+  // Fields in reverse order, followed by an unknown field.
+  std::string wire;
+  for (auto it = field_numbers.rbegin(); it != field_numbers.rend(); ++it) {
+    for (uint64_t v : {uint64_t{*it} << 3, uint64_t{*it % 100}}) {
+      for (; v >= 0x80; v >>= 7) wire.push_back(static_cast<char>(v | 0x80));
+      wire.push_back(static_cast<char>(v));
+    }
+  }
+  wire.append("\x90\x7d\x01");  // Field 2002, varint 1.
+  upb_Message* msg = upb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(wire.data(), wire.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+  for (uint32_t i = 0; i < field_numbers.size(); i++) {
+    EXPECT_EQ(field_numbers[i] % 100,
+              upb_Message_GetInt32(msg, &table->fields[i], -1));
+  }
+  size_t unknown_size;
+  upb_Message_GetUnknown(msg, &unknown_size);
+  EXPECT_EQ(3, unknown_size);
+}
+
+TEST(MiniTableEncodeTest, PresenceIndex) {
+  // Fields 1-40 have hasbits, 41-60 are proto3 scalars, 61-70 are repeated
+  // and 71-80 are a oneof.
+  upb::Arena arena;
+  upb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartMessage(0));
+  for (uint32_t i = 1; i <= 80; i++) {
+    uint64_t mod = 0;
+    if (i > 40) mod = kUpb_FieldModifier_IsProto3Singular;
+    if (i > 60) mod = kUpb_FieldModifier_IsRepeated;
+    if (i > 70) mod = 0;
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Int32, i, mod));
+  }
+  ASSERT_TRUE(e.StartOneof());
+  for (uint32_t i = 71; i <= 80; i++) {
+    ASSERT_TRUE(e.PutOneofField(i));
+  }
+  upb::Status status;
+  upb_MiniTable* table = upb_MiniTable_Build(e.data().data(), e.data().size(),
+                                             arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table) << status.error_message();
+  ASSERT_NE(nullptr, table->presence_index);
+
+  // A few fields of each kind, in field number order, so that encoding the
+  // parsed message gives back the same bytes.
+  std::string wire;
+  for (uint32_t i : {2, 39, 40, 45, 61, 61, 70, 77}) {
+    for (uint64_t v : {uint64_t{i} << 3, uint64_t{i}}) {
+      for (; v >= 0x80; v >>= 7) wire.push_back(static_cast<char>(v | 0x80));
+      wire.push_back(static_cast<char>(v));
+    }
+  }
+  upb_Message* msg = upb_Message_New(table, arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(wire.data(), wire.size(), msg, table, nullptr, 0,
+                       arena.ptr()));
+  char* buf;
+  size_t size;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, table, 0, arena.ptr(), &buf, &size));
+  EXPECT_EQ(wire, std::string(buf, size));
+}
+
 TEST_P(MiniTableTest, AllScalarTypesOneof) {
   upb::Arena arena;
   upb::MtDataEncoder e;
@@ -205,6 +297,55 @@ TEST_P(MiniTableTest, SizeOverflow) {
   ASSERT_EQ(nullptr, table2) << status.error_message();
 }
 
+TEST_P(MiniTableTest, Hotness) {
+  upb::Arena arena;
+  upb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartMessage(0));
+  for (int i = 1; i <= 8; i++) {
+    ASSERT_TRUE(e.PutField(kUpb_FieldType_Int64, i, 0));
+  }
+  ASSERT_TRUE(e.PutField(kUpb_FieldType_Bool, 9, 0));
+  // Field 8 is hot and field 1 is cold; the bool is default and stays in its
+  // group.
+  std::vector<uint8_t> hotness(8, kUpb_FieldHotness_Default);
+  hotness[7] = kUpb_FieldHotness_Hot;
+  hotness[0] = kUpb_FieldHotness_Cold;
+  upb::Status status;
+  void* buf = nullptr;
+  size_t size = 0;
+  upb_MiniTable* table = upb_MiniTable_BuildWithHotness(
+      e.data().data(), e.data().size(), GetParam(), hotness.data(),
+      hotness.size(), arena.ptr(), &buf, &size, status.ptr());
+  ASSERT_NE(nullptr, table) << status.error_message();
+  ASSERT_EQ(9, table->field_count);
+  const upb_MiniTableField* hot = &table->fields[7];
+  const upb_MiniTableField* cold = &table->fields[0];
+  EXPECT_EQ(1, hot->presence);
+  EXPECT_EQ(9, cold->presence);
+  for (int i = 0; i < table->field_count; i++) {
+    const upb_MiniTableField* f = &table->fields[i];
+    if (f != hot) EXPECT_LT(hot->offset, f->offset);
+    if (f != cold) EXPECT_GT(cold->offset, f->offset);
+  }
+
+  // Without hotness the smallest field comes first.
+  upb_MiniTable* plain = upb_MiniTable_BuildWithBuf(
+      e.data().data(), e.data().size(), GetParam(), arena.ptr(), &buf, &size,
+      status.ptr());
+  ASSERT_NE(nullptr, plain) << status.error_message();
+  EXPECT_EQ(1, plain->fields[0].presence);
+  for (int i = 0; i < 8; i++) {
+    EXPECT_LT(plain->fields[8].offset, plain->fields[i].offset);
+  }
+
+  hotness[3] = 7;
+  EXPECT_EQ(nullptr, upb_MiniTable_BuildWithHotness(
+                         e.data().data(), e.data().size(), GetParam(),
+                         hotness.data(), hotness.size(), arena.ptr(), &buf,
+                         &size, status.ptr()));
+  free(buf);
+}
+
 INSTANTIATE_TEST_SUITE_P(Platforms, MiniTableTest,
                          testing::Values(kUpb_MiniTablePlatform_32Bit,
                                          kUpb_MiniTablePlatform_64Bit));
@@ -223,6 +364,71 @@ TEST(MiniTablePlatformIndependentTest, IsTypePackable) {
   }
 }
 
+TEST(MiniTablePlatformIndependentTest, EncodeMessage) {
+  const upb_FieldType kTypes[] = {kUpb_FieldType_Int32, kUpb_FieldType_String,
+                                  kUpb_FieldType_Enum, kUpb_FieldType_Message,
+                                  kUpb_FieldType_Double};
+  const uint64_t kMods[] = {
+      0,
+      kUpb_FieldModifier_IsRepeated,
+      kUpb_FieldModifier_IsRepeated | kUpb_FieldModifier_IsPacked,
+      kUpb_FieldModifier_IsProto3Singular,
+      kUpb_FieldModifier_IsRequired,
+  };
+  std::mt19937 rng(1234);
+  for (int iter = 0; iter < 500; iter++) {
+    const uint64_t msg_mod = rng() % 8;
+    std::vector<upb_MtDataEncoder_Field> fields;
+    uint32_t number = 0;
+    for (int i = rng() % 40; i > 0; i--) {
+      // Mostly consecutive numbers, with skips of every length.
+      number += rng() % 3 ? 1 : 1 + (rng() >> (rng() % 32)) % (1 << 20);
+      upb_MtDataEncoder_Field f = {kTypes[rng() % 5], number, kMods[rng() % 5]};
+      if (f.type == kUpb_FieldType_Enum && rng() % 2) {
+        f.modifiers |= kUpb_FieldModifier_IsClosedEnum;
+      }
+      fields.push_back(f);
+    }
+    std::vector<uint32_t> oneof_fields;
+    for (int i = rng() % 4; i > 0; i--) {
+      for (int j = rng() % 4; j > 0 && !fields.empty(); j--) {
+        oneof_fields.push_back(fields[rng() % fields.size()].number);
+      }
+      oneof_fields.push_back(0);
+    }
+
+    upb::MtDataEncoder e;
+    ASSERT_TRUE(e.StartMessage(msg_mod));
+    for (const auto& f : fields) {
+      ASSERT_TRUE(e.PutField(f.type, f.number, f.modifiers));
+    }
+    bool new_oneof = true;
+    for (uint32_t field_num : oneof_fields) {
+      if (new_oneof) ASSERT_TRUE(e.StartOneof());
+      new_oneof = field_num == 0;
+      if (field_num) ASSERT_TRUE(e.PutOneofField(field_num));
+    }
+
+    const size_t size =
+        upb_MtDataEncoder_MessageSize(msg_mod, fields.data(), fields.size(),
+                                      oneof_fields.data(), oneof_fields.size());
+    ASSERT_EQ(e.data().size(), size);
+    std::string buf(size, '\0');
+    char* end = upb_MtDataEncoder_EncodeMessage(
+        &buf[0], msg_mod, fields.data(), fields.size(), oneof_fields.data(),
+        oneof_fields.size());
+    EXPECT_EQ(&buf[0] + size, end);
+    EXPECT_EQ(e.data(), buf);
+  }
+
+  // Fields must be in field number order.
+  upb_MtDataEncoder_Field fields[] = {{kUpb_FieldType_Int32, 2, 0},
+                                     {kUpb_FieldType_Int32, 2, 0}};
+  EXPECT_EQ(0, upb_MtDataEncoder_MessageSize(0, fields, 2, nullptr, 0));
+  fields[1].number = 1;
+  EXPECT_EQ(0, upb_MtDataEncoder_MessageSize(0, fields, 2, nullptr, 0));
+}
+
 TEST(MiniTableEnumTest, Enum) {
   upb::Arena arena;
   upb::MtDataEncoder e;
@@ -287,6 +493,33 @@ TEST(MiniTableEnumTest, PositiveAndNegative) {
   }
 }
 
+TEST(MiniTableEnumTest, LargeSparse) {
+  upb::Arena arena;
+  upb::MtDataEncoder e;
+
+  // Too sparse for the bitmask, and too many values to scan.
+  ASSERT_TRUE(e.StartEnum());
+  absl::flat_hash_set<int32_t> values;
+  for (int i = 0; i < 2000; i++) {
+    values.insert(1000 + i * 37);
+    e.PutEnumValue(1000 + i * 37);
+  }
+  for (int i = 20; i > 0; i--) {
+    values.insert(-i * 3);
+    e.PutEnumValue(-i * 3);
+  }
+  e.EndEnum();
+
+  upb::Status status;
+  upb_MiniTableEnum* table = upb_MiniTableEnum_Build(
+      e.data().data(), e.data().size(), arena.ptr(), status.ptr());
+  ASSERT_NE(nullptr, table) << status.error_message();
+
+  for (int i = -100; i < 1000 + 2000 * 37 + 100; i++) {
+    EXPECT_EQ(values.contains(i), upb_MiniTableEnum_CheckValue(table, i)) << i;
+  }
+}
+
 TEST_P(MiniTableTest, Extendible) {
   upb::Arena arena;
   upb::MtDataEncoder e;
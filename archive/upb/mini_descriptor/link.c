@@ -30,6 +30,9 @@
 
 #include "upb/mini_descriptor/link.h"
 
+#include "upb/base/internal/log2.h"
+#include "upb/collections/internal/array.h"
+
 // Must be last.
 #include "upb/port/def.inc"
 
@@ -70,6 +73,45 @@ bool upb_MiniTable_SetSubMessage(upb_MiniTable* table,
   return true;
 }
 
+bool upb_MiniTable_SetInlineSubMessage(upb_MiniTable* table,
+                                       upb_MiniTableField* field,
+                                       upb_MiniTable* sub) {
+  if (field->UPB_PRIVATE(descriptortype) != kUpb_FieldType_Message ||
+      upb_FieldMode_Get(field) != kUpb_FieldMode_Array || sub == table ||
+      (sub->ext & kUpb_ExtMode_IsMapEntry)) {
+    return false;
+  }
+  int lg2 = UPB_MAX(upb_Log2Ceiling(kUpb_Array_InlineHeaderSize + sub->size),
+                    kUpb_Array_MinInlineLg2);
+  if (lg2 > kUpb_Array_MaxInlineLg2) return false;
+  for (int i = 0; i < sub->field_count; i++) {
+    // Out-of-line storage hangs off the header, which upb_Array_Set() does
+    // not copy, and inline strings would move with the array.
+    const upb_MiniTableField* f = &sub->fields[i];
+    if (_upb_MiniTableField_IsOutOfLine(f) ||
+        _upb_MiniTableField_HasInlineString(f)) {
+      return false;
+    }
+  }
+  if (!upb_MiniTable_SetSubMessage(table, field, sub)) return false;
+  sub->size = (1 << lg2) - kUpb_Array_InlineHeaderSize;
+  field->mode |= kUpb_LabelFlags_IsInlineMessages;
+  return true;
+}
+
+bool upb_MiniTable_SetOrderedMap(upb_MiniTable* table,
+                                 upb_MiniTableField* field) {
+  UPB_ASSERT((uintptr_t)table->fields <= (uintptr_t)field &&
+             (uintptr_t)field <
+                 (uintptr_t)(table->fields + table->field_count));
+  if (upb_FieldMode_Get(field) != kUpb_FieldMode_Map ||
+      table->table_mask != (uint8_t)-1) {
+    return false;
+  }
+  field->mode |= kUpb_LabelFlags_IsOrderedMap;
+  return true;
+}
+
 bool upb_MiniTable_SetSubEnum(upb_MiniTable* table, upb_MiniTableField* field,
                               const upb_MiniTableEnum* sub) {
   UPB_ASSERT((uintptr_t)table->fields <= (uintptr_t)field &&
@@ -122,8 +164,8 @@ bool upb_MiniTable_Link(upb_MiniTable* mt, const upb_MiniTable** sub_tables,
   for (int i = 0; i < mt->field_count; i++) {
     upb_MiniTableField* f = (upb_MiniTableField*)&mt->fields[i];
     if (upb_MiniTableField_CType(f) == kUpb_CType_Message) {
+      if (msg_count >= sub_table_count) return false;
       const upb_MiniTable* sub = sub_tables[msg_count++];
-      if (msg_count > sub_table_count) return false;
       if (sub != NULL) {
         if (!upb_MiniTable_SetSubMessage(mt, f, sub)) return false;
       }
@@ -133,8 +175,8 @@ bool upb_MiniTable_Link(upb_MiniTable* mt, const upb_MiniTable** sub_tables,
   for (int i = 0; i < mt->field_count; i++) {
     upb_MiniTableField* f = (upb_MiniTableField*)&mt->fields[i];
     if (upb_MiniTableField_IsClosedEnum(f)) {
+      if (enum_count >= sub_enum_count) return false;
       const upb_MiniTableEnum* sub = sub_enums[enum_count++];
-      if (enum_count > sub_enum_count) return false;
       if (sub != NULL) {
         if (!upb_MiniTable_SetSubEnum(mt, f, sub)) return false;
       }
@@ -143,3 +185,43 @@ bool upb_MiniTable_Link(upb_MiniTable* mt, const upb_MiniTable** sub_tables,
 
   return true;
 }
+
+bool upb_MiniTableFile_LinkAll(const upb_MiniTableFile* file,
+                               const upb_MiniTable** sub_tables,
+                               size_t sub_table_count,
+                               const upb_MiniTableEnum** sub_enums,
+                               size_t sub_enum_count,
+                               const uint32_t* sub_indexes,
+                               size_t sub_index_count) {
+  for (int i = 0; i < file->msg_count; i++) {
+    upb_MiniTable* mt = (upb_MiniTable*)file->msgs[i];
+    size_t sub_count = 0;
+
+    for (int j = 0; j < mt->field_count; j++) {
+      upb_MiniTableField* f = (upb_MiniTableField*)&mt->fields[j];
+      // The decoder numbers the subs of a message in the same order as
+      // upb_MiniTable_GetSubList() lists them.
+      const uint16_t sub_index = f->UPB_PRIVATE(submsg_index);
+      if (sub_index == kUpb_NoSub) continue;
+      if (sub_index >= sub_index_count) return false;
+      sub_count = UPB_MAX(sub_count, (size_t)sub_index + 1);
+
+      const uint32_t index = sub_indexes[sub_index];
+      if (index == kUpb_MiniTableFile_NoLink) continue;
+      if (upb_MiniTableField_CType(f) == kUpb_CType_Message) {
+        if (index >= sub_table_count) return false;
+        const upb_MiniTable* sub = sub_tables[index];
+        if (sub && !upb_MiniTable_SetSubMessage(mt, f, sub)) return false;
+      } else {
+        if (index >= sub_enum_count) return false;
+        const upb_MiniTableEnum* sub = sub_enums[index];
+        if (sub && !upb_MiniTable_SetSubEnum(mt, f, sub)) return false;
+      }
+    }
+
+    sub_indexes += sub_count;
+    sub_index_count -= sub_count;
+  }
+
+  return true;
+}
@@ -43,6 +43,7 @@
 #include "upb/mem/arena.h"
 #include "upb/mini_table/extension.h"
 #include "upb/mini_table/field.h"
+#include "upb/mini_table/file.h"
 #include "upb/mini_table/message.h"
 #include "upb/mini_table/sub.h"
 
@@ -64,6 +65,36 @@ UPB_API bool upb_MiniTable_SetSubMessage(upb_MiniTable* table,
                                          upb_MiniTableField* field,
                                          const upb_MiniTable* sub);
 
+// Like upb_MiniTable_SetSubMessage(), but for a repeated message field whose
+// elements should be stored by value in the array instead of by pointer, so
+// that iterating over them does not chase a pointer per element.
+//
+// This requires `sub` to be small, to have no out-of-line or inline-string
+// fields and not to be `table` itself.  To let upb_Array_Set() copy any message
+// of this type into an array, `sub` is padded so that every message of its type
+// has the size of an array element.  For this reason it must be called before
+// any message of type `sub` is created.
+//
+// Only arrays created by the parser are inline; arrays created through other
+// interfaces still hold pointers, which readers handle just as well.  Note
+// that pointers to the elements of an inline array, as returned by
+// upb_Array_Get(), are invalidated when the array grows.
+//
+// Returns false if the field or sub-message does not qualify.
+UPB_API bool upb_MiniTable_SetInlineSubMessage(upb_MiniTable* table,
+                                               upb_MiniTableField* field,
+                                               upb_MiniTable* sub);
+
+// Marks a map field so that the parser creates its maps in ordered mode (see
+// upb_Map_SetOrdered()), for maps that are serialized deterministically many
+// times.  Maps created through other interfaces are not ordered unless
+// upb_Map_SetOrdered() is called on them.
+//
+// The fast table parser does not support ordered maps, so this returns false
+// for tables that have a fast table, as well as for fields that are not maps.
+UPB_API bool upb_MiniTable_SetOrderedMap(upb_MiniTable* table,
+                                         upb_MiniTableField* field);
+
 // Links an enum field to a MiniTable for that enum.
 // All enum fields must be linked prior to parsing.
 // Returns success/failure.
@@ -98,6 +129,34 @@ UPB_API bool upb_MiniTable_Link(upb_MiniTable* mt,
                                 const upb_MiniTableEnum** sub_enums,
                                 size_t sub_enum_count);
 
+// An entry of the `sub_indexes` passed to upb_MiniTableFile_LinkAll() that
+// leaves its field unlinked, like a NULL passed to upb_MiniTable_Link().
+#define kUpb_MiniTableFile_NoLink UINT32_MAX
+
+// Links every message of `file` at once.  For each message in order,
+// `sub_indexes` holds the list that upb_MiniTable_GetSubList() would return,
+// with each sub-message field replaced by the index of its sub-message in
+// `sub_tables`, and each sub-enum field by the index of its sub-enum in
+// `sub_enums`.  Most often these are the file's own `msgs` and `enums`, with
+// the tables of any dependencies appended.  As with upb_MiniTable_Link(), NULL
+// tables leave their fields unlinked.
+//
+// Unlike calling upb_MiniTable_GetSubList() and upb_MiniTable_Link() for each
+// message, this takes a single pass over the fields and needs no arrays of
+// fields or tables per message.  The messages must have been built from
+// MiniDescriptors.
+//
+// Returns false if `sub_indexes` is too short, if an index is out of range,
+// or if any of the tables fails to link.  Messages before the one that failed
+// are linked.
+UPB_API bool upb_MiniTableFile_LinkAll(const upb_MiniTableFile* file,
+                                       const upb_MiniTable** sub_tables,
+                                       size_t sub_table_count,
+                                       const upb_MiniTableEnum** sub_enums,
+                                       size_t sub_enum_count,
+                                       const uint32_t* sub_indexes,
+                                       size_t sub_index_count);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,152 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+#include "upb/mini_descriptor/link.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "upb/base/status.hpp"
+#include "upb/mem/arena.hpp"
+#include "upb/mini_descriptor/build_enum.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_table/message.h"
+
+namespace {
+
+class LinkAllTest : public testing::Test {
+ protected:
+  upb_MiniTable* Build(const std::string& desc) {
+    upb::Status status;
+    upb_MiniTable* table = upb_MiniTable_Build(desc.data(), desc.size(),
+                                               arena_.ptr(), status.ptr());
+    EXPECT_NE(nullptr, table) << status.error_message();
+    return table;
+  }
+
+  upb::Arena arena_;
+};
+
+// Fields 1 and 3 are sub-messages and field 2 is a closed enum, so the sub
+// list is {1, 3, 2}.
+std::string MessageWithSubs() {
+  upb::MtDataEncoder e;
+  EXPECT_TRUE(e.StartMessage(0));
+  EXPECT_TRUE(e.PutField(kUpb_FieldType_Message, 1, 0));
+  EXPECT_TRUE(
+      e.PutField(kUpb_FieldType_Enum, 2, kUpb_FieldModifier_IsClosedEnum));
+  EXPECT_TRUE(e.PutField(kUpb_FieldType_Message, 3, 0));
+  return e.data();
+}
+
+std::string Leaf() {
+  upb::MtDataEncoder e;
+  EXPECT_TRUE(e.StartMessage(0));
+  EXPECT_TRUE(e.PutField(kUpb_FieldType_Int32, 1, 0));
+  return e.data();
+}
+
+TEST_F(LinkAllTest, LinksEveryMessage) {
+  upb::MtDataEncoder e;
+  ASSERT_TRUE(e.StartEnum());
+  ASSERT_TRUE(e.PutEnumValue(0));
+  ASSERT_TRUE(e.EndEnum());
+  const upb_MiniTableEnum* enum_table = upb_MiniDescriptor_BuildEnum(
+      e.data().data(), e.data().size(), arena_.ptr(), nullptr);
+  ASSERT_NE(nullptr, enum_table);
+
+  const upb_MiniTable* msgs[] = {Build(MessageWithSubs()), Build(Leaf()),
+                                 Build(MessageWithSubs())};
+  const upb_MiniTableEnum* enums[] = {enum_table};
+  upb_MiniTableFile file = {msgs, enums, nullptr, 3, 1, 0};
+
+  // The first message refers to itself and the leaf, the second has no subs
+  // and the third leaves its last sub-message unlinked.
+  const uint32_t sub_indexes[] = {0, 1, 0, 1, kUpb_MiniTableFile_NoLink, 0};
+  ASSERT_TRUE(upb_MiniTableFile_LinkAll(&file, msgs, 3, enums, 1, sub_indexes,
+                                        6));
+
+  EXPECT_EQ(msgs[0], upb_MiniTable_GetSubMessageTable(msgs[0],
+                                                      &msgs[0]->fields[0]));
+  EXPECT_EQ(msgs[1], upb_MiniTable_GetSubMessageTable(msgs[0],
+                                                      &msgs[0]->fields[2]));
+  EXPECT_EQ(enum_table,
+            upb_MiniTable_GetSubEnumTable(msgs[0], &msgs[0]->fields[1]));
+  EXPECT_EQ(msgs[1], upb_MiniTable_GetSubMessageTable(msgs[2],
+                                                      &msgs[2]->fields[0]));
+  EXPECT_EQ(nullptr, upb_MiniTable_GetSubMessageTable(msgs[2],
+                                                      &msgs[2]->fields[2]));
+  EXPECT_EQ(enum_table,
+            upb_MiniTable_GetSubEnumTable(msgs[2], &msgs[2]->fields[1]));
+}
+
+TEST_F(LinkAllTest, MatchesLink) {
+  const upb_MiniTable* leaf = Build(Leaf());
+  upb_MiniTable* linked = Build(MessageWithSubs());
+  upb_MiniTable* batch = Build(MessageWithSubs());
+
+  const upb_MiniTableField* fields[3];
+  ASSERT_EQ((2 << 16) | 1, upb_MiniTable_GetSubList(linked, fields));
+  const upb_MiniTable* sub_tables[] = {leaf, linked};
+  const upb_MiniTableEnum* sub_enums[] = {nullptr};
+  ASSERT_TRUE(upb_MiniTable_Link(linked, sub_tables, 2, sub_enums, 1));
+
+  const upb_MiniTable* msgs[] = {batch};
+  upb_MiniTableFile file = {msgs, nullptr, nullptr, 1, 0, 0};
+  const upb_MiniTable* batch_subs[] = {leaf, batch};
+  const uint32_t sub_indexes[] = {0, 1, kUpb_MiniTableFile_NoLink};
+  ASSERT_TRUE(upb_MiniTableFile_LinkAll(&file, batch_subs, 2, nullptr, 0,
+                                        sub_indexes, 3));
+
+  for (int i = 0; i < 3; i += 2) {
+    const upb_MiniTable* linked_sub =
+        upb_MiniTable_GetSubMessageTable(linked, &linked->fields[i]);
+    const upb_MiniTable* batch_sub =
+        upb_MiniTable_GetSubMessageTable(batch, &batch->fields[i]);
+    EXPECT_EQ(linked_sub == linked ? batch : linked_sub, batch_sub);
+  }
+}
+
+TEST_F(LinkAllTest, Errors) {
+  const upb_MiniTable* msgs[] = {Build(MessageWithSubs())};
+  upb_MiniTableFile file = {msgs, nullptr, nullptr, 1, 0, 0};
+
+  // Too few indexes.
+  const uint32_t short_indexes[] = {0, 0};
+  EXPECT_FALSE(upb_MiniTableFile_LinkAll(&file, msgs, 1, nullptr, 0,
+                                         short_indexes, 2));
+
+  // Index out of range.
+  const uint32_t bad_indexes[] = {0, 1, kUpb_MiniTableFile_NoLink};
+  EXPECT_FALSE(upb_MiniTableFile_LinkAll(&file, msgs, 1, nullptr, 0,
+                                         bad_indexes, 3));
+}
+
+}  // namespace
@@ -30,39 +30,121 @@
 
 #include "upb/mini_table/extension_registry.h"
 
-#include "upb/hash/str_table.h"
+#include <string.h>
+
+#include "upb/hash/frozen_table.h"
+#include "upb/hash/int_table.h"
 #include "upb/mini_table/extension.h"
+#include "upb/mini_table/internal/extension_registry.h"
 
 // Must be last.
 #include "upb/port/def.inc"
 
-#define EXTREG_KEY_SIZE (sizeof(upb_MiniTable*) + sizeof(uint32_t))
-
 struct upb_ExtensionRegistry {
   upb_Arena* arena;
-  upb_strtable exts;  // Key is upb_MiniTable* concatenated with fieldnum.
+  upb_inttable exts;  // Key is upb_MiniTable*, value is the extendee's entry.
+  upb_frozentable frozen_exts;  // Replaces `exts` once frozen.
+  bool frozen;
 };
 
-static void extreg_key(char* buf, const upb_MiniTable* l, uint32_t fieldnum) {
-  memcpy(buf, &l, sizeof(l));
-  memcpy(buf + sizeof(l), &fieldnum, sizeof(fieldnum));
-}
-
 upb_ExtensionRegistry* upb_ExtensionRegistry_New(upb_Arena* arena) {
   upb_ExtensionRegistry* r = upb_Arena_Malloc(arena, sizeof(*r));
   if (!r) return NULL;
   r->arena = arena;
-  if (!upb_strtable_init(&r->exts, 8, arena)) return NULL;
+  r->frozen = false;
+  if (!upb_inttable_init(&r->exts, arena)) return NULL;
   return r;
 }
 
+const upb_ExtensionRegistryEntry* _upb_ExtensionRegistry_GetEntry(
+    const upb_ExtensionRegistry* r, const upb_MiniTable* t) {
+  upb_value v;
+  bool found =
+      r->frozen ? upb_frozentable_lookupint(&r->frozen_exts, (uintptr_t)t, &v)
+                : upb_inttable_lookup(&r->exts, (uintptr_t)t, &v);
+  return found ? upb_value_getconstptr(v) : NULL;
+}
+
+// Returns the index of the first number in `e` that is not less than `num`.
+static uint32_t upb_ExtensionRegistryEntry_LowerBound(
+    const upb_ExtensionRegistryEntry* e, uint32_t num) {
+  uint32_t lo = 0;
+  uint32_t hi = e->size;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (e->numbers[mid] < num) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static bool upb_ExtensionRegistryEntry_Grow(upb_ExtensionRegistryEntry* e,
+                                            upb_Arena* a) {
+  uint32_t old = e->capacity;
+  uint32_t new_cap = old ? old * 2 : 4;
+  void* numbers = upb_Arena_Realloc(a, e->numbers, old * sizeof(*e->numbers),
+                                    new_cap * sizeof(*e->numbers));
+  if (!numbers) return false;
+  e->numbers = numbers;
+  void* exts = upb_Arena_Realloc(a, (void*)e->exts, old * sizeof(*e->exts),
+                                 new_cap * sizeof(*e->exts));
+  if (!exts) return false;
+  e->exts = exts;
+  e->capacity = new_cap;
+  return true;
+}
+
 UPB_API bool upb_ExtensionRegistry_Add(upb_ExtensionRegistry* r,
                                        const upb_MiniTableExtension* e) {
-  char buf[EXTREG_KEY_SIZE];
-  extreg_key(buf, e->extendee, e->field.number);
-  if (upb_strtable_lookup2(&r->exts, buf, EXTREG_KEY_SIZE, NULL)) return false;
-  return upb_strtable_insert(&r->exts, buf, EXTREG_KEY_SIZE,
-                             upb_value_constptr(e), r->arena);
+  upb_ExtensionRegistryEntry* entry;
+  upb_value v;
+  uint32_t num = e->field.number;
+  if (r->frozen) return false;
+  if (upb_inttable_lookup(&r->exts, (uintptr_t)e->extendee, &v)) {
+    entry = upb_value_getptr(v);
+  } else {
+    entry = upb_Arena_Malloc(r->arena, sizeof(*entry));
+    if (!entry) return false;
+    memset(entry, 0, sizeof(*entry));
+    if (!upb_inttable_insert(&r->exts, (uintptr_t)e->extendee,
+                             upb_value_ptr(entry), r->arena)) {
+      return false;
+    }
+  }
+
+  uint32_t i = upb_ExtensionRegistryEntry_LowerBound(entry, num);
+  if (i < entry->size && entry->numbers[i] == num) return false;
+  if (entry->size == entry->capacity &&
+      !upb_ExtensionRegistryEntry_Grow(entry, r->arena)) {
+    return false;
+  }
+  uint32_t tail = entry->size - i;
+  memmove(&entry->numbers[i + 1], &entry->numbers[i],
+          tail * sizeof(*entry->numbers));
+  memmove((void*)&entry->exts[i + 1], &entry->exts[i],
+          tail * sizeof(*entry->exts));
+  entry->numbers[i] = num;
+  entry->exts[i] = e;
+  entry->size++;
+  return true;
+}
+
+static void upb_ExtensionRegistry_Remove(upb_ExtensionRegistry* r,
+                                         const upb_MiniTableExtension* e) {
+  upb_value v;
+  if (!upb_inttable_lookup(&r->exts, (uintptr_t)e->extendee, &v)) return;
+  upb_ExtensionRegistryEntry* entry = upb_value_getptr(v);
+  uint32_t i = upb_ExtensionRegistryEntry_LowerBound(entry, e->field.number);
+  if (i == entry->size || entry->exts[i] != e) return;
+  uint32_t tail = entry->size - i - 1;
+  memmove(&entry->numbers[i], &entry->numbers[i + 1],
+          tail * sizeof(*entry->numbers));
+  memmove((void*)&entry->exts[i], &entry->exts[i + 1],
+          tail * sizeof(*entry->exts));
+  entry->size--;
 }
 
 bool upb_ExtensionRegistry_AddArray(upb_ExtensionRegistry* r,
@@ -78,22 +160,73 @@ bool upb_ExtensionRegistry_AddArray(upb_ExtensionRegistry* r,
 failure:
   // Back out the entries previously added.
   for (end = e, e = start; e < end; e++) {
-    const upb_MiniTableExtension* ext = *e;
-    char buf[EXTREG_KEY_SIZE];
-    extreg_key(buf, ext->extendee, ext->field.number);
-    upb_strtable_remove2(&r->exts, buf, EXTREG_KEY_SIZE, NULL);
+    upb_ExtensionRegistry_Remove(r, *e);
   }
   return false;
 }
 
 const upb_MiniTableExtension* upb_ExtensionRegistry_Lookup(
     const upb_ExtensionRegistry* r, const upb_MiniTable* t, uint32_t num) {
-  char buf[EXTREG_KEY_SIZE];
+  const upb_ExtensionRegistryEntry* entry =
+      _upb_ExtensionRegistry_GetEntry(r, t);
+  uint32_t hint = 0;
+  return entry ? _upb_ExtensionRegistryEntry_Find(entry, num, &hint) : NULL;
+}
+
+// Copies every entry into a single block: the entries, then all of the
+// extension pointers, then all of the numbers.
+static bool _upb_ExtensionRegistry_Compact(upb_ExtensionRegistry* r) {
+  size_t entry_count = upb_inttable_count(&r->exts);
+  size_t ext_count = 0;
+  intptr_t iter = UPB_INTTABLE_BEGIN;
+  uintptr_t key;
   upb_value v;
-  extreg_key(buf, t, num);
-  if (upb_strtable_lookup2(&r->exts, buf, EXTREG_KEY_SIZE, &v)) {
-    return upb_value_getconstptr(v);
-  } else {
-    return NULL;
+  while (upb_inttable_next(&r->exts, &key, &v, &iter)) {
+    const upb_ExtensionRegistryEntry* entry = upb_value_getptr(v);
+    ext_count += entry->size;
+  }
+
+  size_t size =
+      entry_count * sizeof(upb_ExtensionRegistryEntry) +
+      ext_count * (sizeof(upb_MiniTableExtension*) + sizeof(uint32_t));
+  if (size == 0) return true;
+  char* block = upb_Arena_Malloc(r->arena, size);
+  if (!block) return false;
+  upb_ExtensionRegistryEntry* entry = (upb_ExtensionRegistryEntry*)block;
+  const upb_MiniTableExtension** exts =
+      (const upb_MiniTableExtension**)(block + entry_count * sizeof(*entry));
+  uint32_t* numbers = (uint32_t*)(block + entry_count * sizeof(*entry) +
+                                  ext_count * sizeof(*exts));
+
+  iter = UPB_INTTABLE_BEGIN;
+  while (upb_inttable_next(&r->exts, &key, &v, &iter)) {
+    const upb_ExtensionRegistryEntry* old = upb_value_getptr(v);
+    memcpy(numbers, old->numbers, old->size * sizeof(*numbers));
+    memcpy((void*)exts, old->exts, old->size * sizeof(*exts));
+    entry->numbers = numbers;
+    entry->exts = exts;
+    entry->size = old->size;
+    entry->capacity = old->size;
+    numbers += old->size;
+    exts += old->size;
+    upb_inttable_replace(&r->exts, key, upb_value_ptr(entry++));
   }
+  return true;
+}
+
+bool upb_ExtensionRegistry_Freeze(upb_ExtensionRegistry* r) {
+  if (r->frozen) return true;
+  if (!_upb_ExtensionRegistry_Compact(r)) return false;
+
+  // The copies hold the same extensions, so the registry is still usable
+  // if this fails.
+  if (!upb_frozentable_initint(&r->frozen_exts, &r->exts, r->arena)) {
+    return false;
+  }
+  r->frozen = true;
+  return true;
+}
+
+bool upb_ExtensionRegistry_IsFrozen(const upb_ExtensionRegistry* r) {
+  return r->frozen;
 }
@@ -99,6 +99,16 @@ bool upb_ExtensionRegistry_AddArray(upb_ExtensionRegistry* r,
 UPB_API const upb_MiniTableExtension* upb_ExtensionRegistry_Lookup(
     const upb_ExtensionRegistry* r, const upb_MiniTable* t, uint32_t num);
 
+// Makes the registry read-only and lays it out for fast lookups: the
+// extensions are copied into one contiguous block, grouped by extendee and
+// sorted by number, and the extendees are indexed by a perfect hash.  After
+// this, adding extensions fails.  Call it once every extension has been
+// added, for example at the end of startup.  Returns false, leaving the
+// registry usable but not frozen, if memory allocation failed.
+UPB_API bool upb_ExtensionRegistry_Freeze(upb_ExtensionRegistry* r);
+
+UPB_API bool upb_ExtensionRegistry_IsFrozen(const upb_ExtensionRegistry* r);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
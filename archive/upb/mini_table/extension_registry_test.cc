@@ -0,0 +1,200 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+#include "upb/mini_descriptor/link.h"
+
+
+#include "upb/mini_table/extension_registry.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "upb/base/status.hpp"
+#include "upb/mem/arena.hpp"
+#include "upb/message/accessors.h"
+#include "upb/message/message.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/wire/decode.h"
+
+namespace {
+
+void PutVarint(std::string* out, uint32_t val) {
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back((char)byte);
+  } while (val);
+}
+
+class ExtensionRegistryTest : public testing::Test {
+ protected:
+  void SetUp() override { extendee_ = BuildExtendee(); }
+
+  upb_MiniTable* BuildExtendee() {
+    upb::MtDataEncoder e;
+    EXPECT_TRUE(e.StartMessage(kUpb_MessageModifier_IsExtendable));
+    EXPECT_TRUE(e.PutField(kUpb_FieldType_Int32, 1, 0));
+    upb::Status status;
+    upb_MiniTable* table = upb_MiniTable_Build(
+        e.data().data(), e.data().size(), arena_.ptr(), status.ptr());
+    EXPECT_NE(nullptr, table) << status.error_message();
+    return table;
+  }
+
+  const upb_MiniTableExtension* BuildExtension(const upb_MiniTable* extendee,
+                                               uint32_t number) {
+    upb::MtDataEncoder e;
+    EXPECT_TRUE(e.EncodeExtension(kUpb_FieldType_Int32, number, 0));
+    upb::Status status;
+    const upb_MiniTableExtension* ext =
+        upb_MiniTableExtension_Build(e.data().data(), e.data().size(),
+                                     extendee, arena_.ptr(), status.ptr());
+    EXPECT_NE(nullptr, ext) << status.error_message();
+    return ext;
+  }
+
+  upb::Arena arena_;
+  upb_MiniTable* extendee_;
+};
+
+TEST_F(ExtensionRegistryTest, LookupOutOfOrder) {
+  upb_ExtensionRegistry* r = upb_ExtensionRegistry_New(arena_.ptr());
+  std::vector<const upb_MiniTableExtension*> exts;
+  // Register in a scrambled order so that inserts land all over the array.
+  for (uint32_t i = 0; i < 50; i++) {
+    exts.push_back(BuildExtension(extendee_, 100 + (i * 37) % 50));
+    ASSERT_TRUE(upb_ExtensionRegistry_Add(r, exts.back()));
+  }
+  for (const upb_MiniTableExtension* ext : exts) {
+    EXPECT_EQ(ext, upb_ExtensionRegistry_Lookup(r, extendee_,
+                                                ext->field.number));
+  }
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, extendee_, 99));
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, extendee_, 150));
+
+  // Numbers are per extendee.
+  const upb_MiniTable* other_extendee = BuildExtendee();
+  const upb_MiniTableExtension* other = BuildExtension(other_extendee, 100);
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, other_extendee, 100));
+  EXPECT_TRUE(upb_ExtensionRegistry_Add(r, other));
+  EXPECT_EQ(other, upb_ExtensionRegistry_Lookup(r, other_extendee, 100));
+  EXPECT_EQ(exts[0], upb_ExtensionRegistry_Lookup(r, extendee_, 100));
+}
+
+TEST_F(ExtensionRegistryTest, AddArrayBacksOutOnDuplicate) {
+  upb_ExtensionRegistry* r = upb_ExtensionRegistry_New(arena_.ptr());
+  const upb_MiniTableExtension* existing = BuildExtension(extendee_, 7);
+  ASSERT_TRUE(upb_ExtensionRegistry_Add(r, existing));
+
+  const upb_MiniTableExtension* batch[] = {
+      BuildExtension(extendee_, 5),
+      BuildExtension(extendee_, 9),
+      BuildExtension(extendee_, 7),
+  };
+  EXPECT_FALSE(upb_ExtensionRegistry_AddArray(r, batch, 3));
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, extendee_, 5));
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, extendee_, 9));
+  EXPECT_EQ(existing, upb_ExtensionRegistry_Lookup(r, extendee_, 7));
+
+  EXPECT_TRUE(upb_ExtensionRegistry_AddArray(r, batch, 2));
+  EXPECT_EQ(batch[0], upb_ExtensionRegistry_Lookup(r, extendee_, 5));
+  EXPECT_EQ(batch[1], upb_ExtensionRegistry_Lookup(r, extendee_, 9));
+}
+
+TEST_F(ExtensionRegistryTest, Freeze) {
+  upb_ExtensionRegistry* r = upb_ExtensionRegistry_New(arena_.ptr());
+  std::vector<const upb_MiniTable*> extendees;
+  std::vector<const upb_MiniTableExtension*> exts;
+  for (int i = 0; i < 10; i++) {
+    extendees.push_back(BuildExtendee());
+    for (uint32_t j = 0; j < 20; j++) {
+      exts.push_back(BuildExtension(extendees.back(), 100 + (j * 7) % 20));
+      ASSERT_TRUE(upb_ExtensionRegistry_Add(r, exts.back()));
+    }
+  }
+
+  EXPECT_FALSE(upb_ExtensionRegistry_IsFrozen(r));
+  ASSERT_TRUE(upb_ExtensionRegistry_Freeze(r));
+  EXPECT_TRUE(upb_ExtensionRegistry_IsFrozen(r));
+  EXPECT_TRUE(upb_ExtensionRegistry_Freeze(r));
+
+  for (const upb_MiniTableExtension* ext : exts) {
+    EXPECT_EQ(ext, upb_ExtensionRegistry_Lookup(r, ext->extendee,
+                                                ext->field.number));
+  }
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, extendees[0], 99));
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, extendee_, 100));
+
+  const upb_MiniTableExtension* late = BuildExtension(extendee_, 100);
+  EXPECT_FALSE(upb_ExtensionRegistry_Add(r, late));
+  EXPECT_FALSE(upb_ExtensionRegistry_AddArray(r, &late, 1));
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(r, extendee_, 100));
+
+  // An empty registry can be frozen too.
+  upb_ExtensionRegistry* empty = upb_ExtensionRegistry_New(arena_.ptr());
+  ASSERT_TRUE(upb_ExtensionRegistry_Freeze(empty));
+  EXPECT_EQ(nullptr, upb_ExtensionRegistry_Lookup(empty, extendee_, 100));
+}
+
+TEST_F(ExtensionRegistryTest, Decode) {
+  upb_ExtensionRegistry* r = upb_ExtensionRegistry_New(arena_.ptr());
+  std::vector<const upb_MiniTableExtension*> exts;
+  for (uint32_t i = 0; i < 20; i++) {
+    exts.push_back(BuildExtension(extendee_, 10 + i));
+    ASSERT_TRUE(upb_ExtensionRegistry_Add(r, exts.back()));
+  }
+
+  // Extensions 10..29 in order, then 29..10 in reverse, then the unregistered
+  // extension 30; the later value of each extension wins.
+  std::string data;
+  for (int i = 0; i < 20; i++) {
+    PutVarint(&data, (10 + i) << 3);
+    PutVarint(&data, i);
+  }
+  for (int i = 19; i >= 0; i--) {
+    PutVarint(&data, (10 + i) << 3);
+    PutVarint(&data, i + 1);
+  }
+  PutVarint(&data, 30 << 3);
+  PutVarint(&data, 1);
+
+  upb_Message* msg = upb_Message_New(extendee_, arena_.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, upb_Decode(data.data(), data.size(), msg,
+                                             extendee_, r, 0, arena_.ptr()));
+  for (int i = 0; i < 20; i++) {
+    EXPECT_EQ(i + 1, upb_Message_GetInt32(msg, &exts[i]->field, -1));
+  }
+  size_t unknown_size;
+  upb_Message_GetUnknown(msg, &unknown_size);
+  EXPECT_EQ(3, unknown_size);
+}
+
+}  // namespace
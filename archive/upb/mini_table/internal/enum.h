@@ -39,9 +39,13 @@
 struct upb_MiniTableEnum {
   uint32_t mask_limit;   // Limit enum value that can be tested with mask.
   uint32_t value_count;  // Number of values after the bitfield.
-  uint32_t data[];       // Bitmask + enumerated values follow.
+  uint32_t data[];       // Bitmask + enumerated values follow, in ascending
+                         // order.
 };
 
+// Lists of values up to this long are scanned rather than binary searched.
+#define kUpb_MiniTableEnum_MaxLinearScan 16
+
 typedef enum {
   _kUpb_FastEnumCheck_ValueIsInEnum = 0,
   _kUpb_FastEnumCheck_ValueIsNotInEnum = 1,
@@ -63,13 +67,21 @@ UPB_INLINE _kUpb_FastEnumCheck_Status _upb_MiniTable_CheckEnumValueFast(
 UPB_INLINE bool _upb_MiniTable_CheckEnumValueSlow(
     const struct upb_MiniTableEnum* e, uint32_t val) {
   if (val < e->mask_limit) return e->data[val / 32] & (1ULL << (val % 32));
-  // OPT: binary search long lists?
-  const uint32_t* start = &e->data[e->mask_limit / 32];
-  const uint32_t* limit = &e->data[(e->mask_limit / 32) + e->value_count];
-  for (const uint32_t* p = start; p < limit; p++) {
-    if (*p == val) return true;
+  const uint32_t* p = &e->data[e->mask_limit / 32];
+  uint32_t n = e->value_count;
+  if (n <= kUpb_MiniTableEnum_MaxLinearScan) {
+    // Without an early exit the compiler can vectorize this.
+    bool found = false;
+    for (uint32_t i = 0; i < n; i++) found |= p[i] == val;
+    return found;
+  }
+  // Find the last value <= val.
+  while (n > 1) {
+    uint32_t half = n / 2;
+    if (p[half] <= val) p += half;
+    n -= half;
   }
-  return false;
+  return *p == val;
 }
 
 #ifdef __cplusplus
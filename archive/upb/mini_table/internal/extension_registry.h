@@ -0,0 +1,87 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_MINI_TABLE_INTERNAL_EXTENSION_REGISTRY_H_
+#define UPB_MINI_TABLE_INTERNAL_EXTENSION_REGISTRY_H_
+
+#include <stdint.h>
+
+#include "upb/mini_table/extension_registry.h"
+#include "upb/mini_table/internal/extension.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// The extensions registered for a single extendee, sorted by field number so
+// that the decoder can search them without hashing.
+typedef struct {
+  uint32_t* numbers;  // Sorted field numbers.
+  const upb_MiniTableExtension** exts;  // exts[i] has number numbers[i].
+  uint32_t size;
+  uint32_t capacity;
+} upb_ExtensionRegistryEntry;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the extensions registered for `t`, or NULL if there are none.
+const upb_ExtensionRegistryEntry* _upb_ExtensionRegistry_GetEntry(
+    const upb_ExtensionRegistry* r, const upb_MiniTable* t);
+
+// Returns the extension numbered `num` in `e`, or NULL if there is none.
+// `*hint` is the index to try first; on success it is set to the index after
+// the match, so extensions that arrive in field order are found without a
+// search.
+UPB_INLINE const upb_MiniTableExtension* _upb_ExtensionRegistryEntry_Find(
+    const upb_ExtensionRegistryEntry* e, uint32_t num, uint32_t* hint) {
+  uint32_t lo = 0;
+  uint32_t hi = e->size;
+  if (*hint < hi && e->numbers[*hint] == num) return e->exts[(*hint)++];
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (e->numbers[mid] < num) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == e->size || e->numbers[lo] != num) return NULL;
+  *hint = lo + 1;
+  return e->exts[lo];
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_MINI_TABLE_INTERNAL_EXTENSION_REGISTRY_H_ */
@@ -74,8 +74,28 @@ typedef enum {
   //   - for Bytes, this indicates that the actual type is String (but does
   //     not require any UTF-8 check).
   kUpb_LabelFlags_IsAlternate = 16,
+  // The field's data is not stored in the message but in its out-of-line
+  // block (see upb_Message_InternalData), at `offset` within that block.  Its
+  // hasbit is still in the message.
+  kUpb_LabelFlags_IsOutOfLine = 32,
+  // Only scalar arrays are ever packed, so the packed bit is reused by other
+  // kinds of field; always test it through the predicates below, which check
+  // the field's mode and type.
+  //
+  // For message arrays this bit indicates that new arrays store the messages
+  // by value rather than by pointer (see upb_MiniTable_SetInlineSubMessage()).
+  kUpb_LabelFlags_IsInlineMessages = kUpb_LabelFlags_IsPacked,
+  // For singular string and bytes fields this bit indicates that the
+  // field's upb_StringView is followed by kUpb_MiniTableField_InlineStringSize
+  // bytes in the message, where the parser may store short values.
+  kUpb_LabelFlags_IsInlineString = kUpb_LabelFlags_IsPacked,
+  // For map fields this bit indicates that the parser creates the map in
+  // ordered mode (see upb_MiniTable_SetOrderedMap()).
+  kUpb_LabelFlags_IsOrderedMap = kUpb_LabelFlags_IsPacked,
 } upb_LabelFlags;
 
+#define kUpb_MiniTableField_InlineStringSize 16
+
 // Note: we sort by this number when calculating layout order.
 typedef enum {
   kUpb_FieldRep_1Byte = 0,
@@ -123,11 +143,42 @@ UPB_INLINE bool upb_IsRepeatedOrMap(const struct upb_MiniTableField* field) {
   return !(field->mode & kUpb_FieldMode_Scalar);
 }
 
+UPB_INLINE bool _upb_MiniTableField_IsOutOfLine(
+    const struct upb_MiniTableField* field) {
+  return field->mode & kUpb_LabelFlags_IsOutOfLine;
+}
+
 UPB_INLINE bool upb_IsSubMessage(const struct upb_MiniTableField* field) {
   return field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_Message ||
          field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_Group;
 }
 
+UPB_INLINE bool _upb_MiniTableField_IsPacked(
+    const struct upb_MiniTableField* field) {
+  return (field->mode & kUpb_LabelFlags_IsPacked) &&
+         upb_FieldMode_Get(field) == kUpb_FieldMode_Array &&
+         !upb_IsSubMessage(field);
+}
+
+UPB_INLINE bool _upb_MiniTableField_HasInlineString(
+    const struct upb_MiniTableField* field) {
+  return (field->mode & kUpb_LabelFlags_IsInlineString) &&
+         upb_FieldMode_Get(field) == kUpb_FieldMode_Scalar;
+}
+
+UPB_INLINE bool _upb_MiniTableField_IsOrderedMap(
+    const struct upb_MiniTableField* field) {
+  return (field->mode & kUpb_LabelFlags_IsOrderedMap) &&
+         upb_FieldMode_Get(field) == kUpb_FieldMode_Map;
+}
+
+UPB_INLINE bool _upb_MiniTableField_HasInlineMessages(
+    const struct upb_MiniTableField* field) {
+  return (field->mode & kUpb_LabelFlags_IsInlineMessages) &&
+         upb_FieldMode_Get(field) == kUpb_FieldMode_Array &&
+         field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_Message;
+}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -39,4 +39,7 @@ const struct upb_MiniTable _kUpb_MiniTable_Empty = {
     .dense_below = 0,
     .table_mask = -1,
     .required_count = 0,
+    .flags = kUpb_MiniTableFlag_NoReachableRequired,
+    .field_index = NULL,
+    .presence_index = NULL,
 };
@@ -58,6 +58,14 @@ typedef enum {
   kUpb_ExtMode_IsMapEntry = 4,
 } upb_ExtMode;
 
+typedef enum {
+  // Neither this message nor any message reachable from it through its
+  // sub-message fields has required fields or is extendable, so checks for
+  // unset required fields need not look inside it.  Leaving this unset is
+  // always safe.
+  kUpb_MiniTableFlag_NoReachableRequired = 1,
+} upb_MiniTableFlags;
+
 union upb_MiniTableSub;
 
 // upb_MiniTable represents the memory layout of a given upb_MessageDef.
@@ -76,6 +84,23 @@ struct upb_MiniTable {
   uint8_t dense_below;
   uint8_t table_mask;
   uint8_t required_count;  // Required fields have the lowest hasbits.
+  uint8_t flags;           // upb_MiniTableFlags
+
+  // A hash index of the fields from `dense_below` on, for messages that have
+  // at least kUpb_MiniTable_MinIndexedFields of them, and NULL otherwise.
+  // index[0] is the hash mask and index[1 + slot] holds one plus the position
+  // of a field in `fields`, or zero for an empty slot.  At most half of the
+  // slots are full, and collisions are resolved by linear probing.
+  const uint16_t* field_index;
+
+  // Lets the encoder find the fields that are set without testing every one,
+  // for messages with kUpb_MiniTable_MinPresenceIndexedFields to
+  // kUpb_MiniTable_MaxPresenceIndexedFields fields, and NULL otherwise.
+  // presence_index[0] is one more than the highest hasbit, and the next
+  // that many entries hold the position in `fields` of the field with each
+  // hasbit.  They are followed by the number of fields without hasbits and
+  // their positions, in order, with only the first member of each oneof.
+  const uint16_t* presence_index;
 
   // To statically initialize the tables of variable length, we need a flexible
   // array member, and we need to compile in gnu99 mode (constant initialization
@@ -90,6 +115,32 @@ extern "C" {
 // A MiniTable for an empty message, used for unlinked sub-messages.
 extern const struct upb_MiniTable _kUpb_MiniTable_Empty;
 
+// Messages with fewer fields past `dense_below` are searched without an index.
+#define kUpb_MiniTable_MinIndexedFields 16
+
+// Messages with fewer fields are encoded by testing each field in turn, and
+// larger ones would need too much stack to sort their present fields.
+#define kUpb_MiniTable_MinPresenceIndexedFields 16
+#define kUpb_MiniTable_MaxPresenceIndexedFields 512
+
+UPB_INLINE uint32_t _upb_MiniTable_FieldIndexHash(uint32_t number) {
+  return (number * 0x9E3779B1u) >> 16;
+}
+
+// Returns the position in `t->fields` of the field with the given number,
+// using `t->field_index`, which must not be NULL.  Returns -1 if there is no
+// such field past `dense_below`.
+UPB_INLINE int _upb_MiniTable_FindIndexedField(const struct upb_MiniTable* t,
+                                               uint32_t number) {
+  const uint16_t* index = t->field_index;
+  const uint32_t mask = index[0];
+  for (uint32_t i = _upb_MiniTable_FieldIndexHash(number);; i++) {
+    const uint16_t pos = index[1 + (i & mask)];
+    if (!pos) return -1;
+    if (t->fields[pos - 1].number == number) return pos - 1;
+  }
+}
+
 // Computes a bitmask in which the |l->required_count| lowest bits are set,
 // except that we skip the lowest bit (because upb never uses hasbit 0).
 //
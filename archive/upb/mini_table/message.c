@@ -48,6 +48,11 @@ const upb_MiniTableField* upb_MiniTable_FindFieldByNumber(
     return &t->fields[i];
   }
 
+  if (t->field_index) {
+    const int pos = _upb_MiniTable_FindIndexedField(t, number);
+    return pos >= 0 ? &t->fields[pos] : NULL;
+  }
+
   // Slow case: binary search
   int lo = t->dense_below;
   int hi = t->field_count - 1;
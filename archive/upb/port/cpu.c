@@ -0,0 +1,128 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#include "upb/port/cpu.h"
+
+#include <stdint.h>
+
+#include "upb/port/atomic.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+#define UPB_CPU_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Set in `features` once detection has run.
+#define kUpb_Cpu_Detected (1u << 31)
+
+static UPB_ATOMIC(uint32_t) features = 0;
+static UPB_ATOMIC(uint32_t) feature_mask = ~(uint32_t)0;
+
+#ifdef UPB_CPU_X86
+
+static void _upb_Cpu_Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t r[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int regs[4];
+  __cpuidex(regs, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; i++) r[i] = (uint32_t)regs[i];
+#else
+  __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// Returns XCR0, the set of register states the OS saves on context switches.
+static uint64_t _upb_Cpu_Xcr0(void) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return (uint64_t)edx << 32 | eax;
+#endif
+}
+
+static uint32_t _upb_Cpu_Detect(void) {
+  uint32_t r[4];  // eax, ebx, ecx, edx
+  _upb_Cpu_Cpuid(0, 0, r);
+  uint32_t max_leaf = r[0];
+  if (max_leaf < 1) return 0;
+
+  uint32_t ret = 0;
+  _upb_Cpu_Cpuid(1, 0, r);
+  if (r[2] & (1u << 20)) ret |= kUpb_CpuFeature_Sse42;
+
+  // The YMM registers need the SSE and AVX states, and the ZMM registers
+  // additionally the opmask and both halves of the upper ZMM states.
+  bool avx = (r[2] & (1u << 28)) != 0;
+  bool ymm = false;
+  bool zmm = false;
+  if (r[2] & (1u << 27)) {  // OSXSAVE
+    uint64_t xcr0 = _upb_Cpu_Xcr0();
+    ymm = (xcr0 & 0x06) == 0x06;
+    zmm = (xcr0 & 0xe6) == 0xe6;
+  }
+
+  if (max_leaf < 7) return ret;
+  _upb_Cpu_Cpuid(7, 0, r);
+  if (avx && ymm && (r[1] & (1u << 5))) ret |= kUpb_CpuFeature_Avx2;
+  if (r[1] & (1u << 8)) ret |= kUpb_CpuFeature_Bmi2;
+  const uint32_t avx512 = (1u << 16) | (1u << 30) | (1u << 31);  // F, BW, VL
+  if (zmm && (r[1] & avx512) == avx512) ret |= kUpb_CpuFeature_Avx512Bw;
+  return ret;
+}
+
+#else
+
+static uint32_t _upb_Cpu_Detect(void) { return 0; }
+
+#endif
+
+uint32_t upb_Cpu_Features(void) {
+  uint32_t ret = upb_Atomic_Load(&features, memory_order_relaxed);
+  if (UPB_UNLIKELY(!(ret & kUpb_Cpu_Detected))) {
+    // Threads that race here all store the same value.
+    ret = _upb_Cpu_Detect() | kUpb_Cpu_Detected;
+    upb_Atomic_Store(&features, ret, memory_order_relaxed);
+  }
+  return ret & upb_Atomic_Load(&feature_mask, memory_order_relaxed) &
+         ~kUpb_Cpu_Detected;
+}
+
+uint32_t upb_Cpu_SetFeatureMask(uint32_t mask) {
+  uint32_t ret = upb_Atomic_Load(&feature_mask, memory_order_relaxed);
+  upb_Atomic_Store(&feature_mask, mask, memory_order_relaxed);
+  return ret;
+}
@@ -0,0 +1,81 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+/* Runtime CPU feature detection for kernels with vectorized variants.
+ *
+ * A portable build (one without -mavx2 and the like) compiles each variant
+ * with __attribute__((target(...))) and picks it at run time with
+ * upb_Cpu_Has(), so one binary uses AVX2 or AVX-512 where the CPU has them
+ * and the scalar code elsewhere.  The features are detected on first use and
+ * cached; a feature is only reported if the OS also saves the registers it
+ * needs.  On platforms other than x86 no features are reported. */
+
+#ifndef UPB_PORT_CPU_H_
+#define UPB_PORT_CPU_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef enum {
+  kUpb_CpuFeature_Sse42 = 1 << 0,
+  kUpb_CpuFeature_Avx2 = 1 << 1,
+  kUpb_CpuFeature_Bmi2 = 1 << 2,
+
+  // AVX512F together with AVX512BW and AVX512VL, the subsets byte-oriented
+  // kernels need.
+  kUpb_CpuFeature_Avx512Bw = 1 << 3,
+} upb_CpuFeature;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns the set of upb_CpuFeature bits that are available, restricted to
+// the mask from upb_Cpu_SetFeatureMask().
+UPB_API uint32_t upb_Cpu_Features(void);
+
+UPB_API_INLINE bool upb_Cpu_Has(uint32_t features) {
+  return (upb_Cpu_Features() & features) == features;
+}
+
+// Limits the features reported from now on to those in `mask` and returns
+// the previous mask, which is initially all features.  This is meant for
+// tests of the fallback paths and for working around a faulty kernel; a
+// kernel that is running when the mask changes keeps its variant.
+UPB_API uint32_t upb_Cpu_SetFeatureMask(uint32_t mask);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_PORT_CPU_H_
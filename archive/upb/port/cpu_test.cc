@@ -0,0 +1,68 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#include "upb/port/cpu.h"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(CpuTest, FeatureMask) {
+  uint32_t all = upb_Cpu_Features();
+  EXPECT_TRUE(upb_Cpu_Has(0));
+
+  uint32_t old = upb_Cpu_SetFeatureMask(kUpb_CpuFeature_Avx2);
+  EXPECT_EQ(all & kUpb_CpuFeature_Avx2, upb_Cpu_Features());
+  EXPECT_FALSE(upb_Cpu_Has(kUpb_CpuFeature_Sse42));
+  EXPECT_FALSE(upb_Cpu_Has(kUpb_CpuFeature_Avx2 | kUpb_CpuFeature_Bmi2));
+
+  upb_Cpu_SetFeatureMask(0);
+  EXPECT_EQ(0, upb_Cpu_Features());
+  EXPECT_EQ(0, upb_Cpu_SetFeatureMask(old));
+  EXPECT_EQ(all, upb_Cpu_Features());
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+TEST(CpuTest, MatchesCompiler) {
+  __builtin_cpu_init();
+  EXPECT_EQ(!!__builtin_cpu_supports("sse4.2"),
+            upb_Cpu_Has(kUpb_CpuFeature_Sse42));
+  EXPECT_EQ(!!__builtin_cpu_supports("avx2"),
+            upb_Cpu_Has(kUpb_CpuFeature_Avx2));
+  EXPECT_EQ(!!__builtin_cpu_supports("bmi2"),
+            upb_Cpu_Has(kUpb_CpuFeature_Bmi2));
+  EXPECT_EQ(__builtin_cpu_supports("avx512f") &&
+                __builtin_cpu_supports("avx512bw") &&
+                __builtin_cpu_supports("avx512vl"),
+            upb_Cpu_Has(kUpb_CpuFeature_Avx512Bw));
+}
+
+#endif
+
+}  // namespace
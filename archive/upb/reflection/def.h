@@ -31,6 +31,7 @@
 #ifndef UPB_REFLECTION_DEF_H_
 #define UPB_REFLECTION_DEF_H_
 
+#include "upb/reflection/def_image.h"
 #include "upb/reflection/def_pool.h"
 #include "upb/reflection/enum_def.h"
 #include "upb/reflection/enum_value_def.h"
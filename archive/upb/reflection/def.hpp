@@ -565,6 +565,27 @@ class DefPool {
     _upb_DefPool_SetPlatform(ptr_.get(), platform);
   }
 
+  void _SetFieldHotness(_upb_DefPool_FieldHotnessFunc* func, void* closure) {
+    _upb_DefPool_SetFieldHotness(ptr_.get(), func, closure);
+  }
+
+  // Makes lookups faster; no files can be added afterwards.
+  bool Freeze() { return upb_DefPool_Freeze(ptr_.get()); }
+
+  // Lets other threads look up defs while one thread adds files.
+  bool MakeConcurrent() { return upb_DefPool_MakeConcurrent(ptr_.get()); }
+
+  // Adds an image from upb_DefImage_Build(), which must outlive the pool.
+  bool AddImage(const char* data, size_t size, Status* status) {
+    return upb_DefPool_AddImage(ptr_.get(), data, size, status->ptr());
+  }
+
+  // Registers a serialized FileDescriptorProto to be built when first looked
+  // up, see upb_DefPool_RegisterFile().
+  bool RegisterFile(const char* data, size_t size, Status* status) {
+    return upb_DefPool_RegisterFile(ptr_.get(), data, size, status->ptr());
+  }
+
   // TODO: iteration?
 
   // Adds the given serialized FileDescriptorProto to the pool.
@@ -94,6 +94,22 @@ static void _upb_DefBuilder_CheckIdentNotFull(upb_DefBuilder* ctx,
   if (!good) _upb_DefBuilder_CheckIdentSlow(ctx, name, false);
 }
 
+const upb_Message* _upb_DefBuilder_CopyOptions(upb_DefBuilder* ctx,
+                                               const upb_Message* opts,
+                                               const upb_MiniTable* m) {
+  const upb_Message* ret = _upb_DefPool_InternOptions(ctx->symtab, opts, m);
+  if (!ret) _upb_DefBuilder_OomErr(ctx);
+  return ret;
+}
+
+const char* _upb_DefBuilder_InternString(upb_DefBuilder* ctx,
+                                         upb_StringView str) {
+  const char* ret =
+      _upb_DefPool_InternString(ctx->symtab, str.data, str.size);
+  if (!ret) _upb_DefBuilder_OomErr(ctx);
+  return ret;
+}
+
 const char* _upb_DefBuilder_MakeFullName(upb_DefBuilder* ctx,
                                          const char* prefix,
                                          upb_StringView name) {
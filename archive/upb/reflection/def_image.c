@@ -0,0 +1,549 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "upb/reflection/internal/def_image.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "upb/hash/str_table.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Layout of an image, in which every number is a little-endian uint32 and
+// every offset is from the start of the image:
+//
+//   magic         "upbdefs1"
+//   file_count
+//   sym_count
+//   files         file_count * {name_ofs, name_len, desc_ofs, desc_len,
+//                               deps_ofs, dep_count}
+//   syms          sym_count * {name_ofs, name_len, file}, sorted by name
+//   file_order    file_count * file, sorted by the file's name
+//   data          dependency lists, names and descriptors
+
+static const char kUpb_DefImage_Magic[8] = {'u', 'p', 'b', 'd',
+                                            'e', 'f', 's', '1'};
+
+enum {
+  kUpb_DefImage_HeaderSize = 16,
+  kUpb_DefImage_FileSize = 24,
+  kUpb_DefImage_SymSize = 12,
+};
+
+static uint32_t _upb_DefImage_Get32(const char* p) {
+  const unsigned char* u = (const unsigned char*)p;
+  return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static void _upb_DefImage_Put32(char* p, uint32_t val) {
+  p[0] = val & 0xff;
+  p[1] = (val >> 8) & 0xff;
+  p[2] = (val >> 16) & 0xff;
+  p[3] = val >> 24;
+}
+
+static int _upb_DefImage_Compare(upb_StringView a, upb_StringView b) {
+  size_t n = UPB_MIN(a.size, b.size);
+  int cmp = n ? memcmp(a.data, b.data, n) : 0;
+  if (cmp) return cmp;
+  return (a.size > b.size) - (a.size < b.size);
+}
+
+/* Scanning serialized descriptors ********************************************/
+
+static const char* _upb_DefImage_ScanVarint(const char* ptr, const char* end,
+                                            uint64_t* val) {
+  *val = 0;
+  for (int shift = 0; ptr < end && shift < 64; shift += 7) {
+    *val |= (uint64_t)(*ptr & 0x7f) << shift;
+    if (!(*ptr++ & 0x80)) return ptr;
+  }
+  return NULL;
+}
+
+bool _upb_DefImage_ScanField(const char** ptr, const char* end, uint32_t* num,
+                             upb_StringView* val) {
+  uint64_t tag, len = 0;
+  const char* p = _upb_DefImage_ScanVarint(*ptr, end, &tag);
+  val->data = NULL;
+  val->size = 0;
+  if (p) {
+    switch (tag & 7) {
+      case 0:  // Varint
+        p = _upb_DefImage_ScanVarint(p, end, &len);
+        len = 0;
+        break;
+      case 1:  // 64-bit
+        len = 8;
+        break;
+      case 2:  // Delimited
+        p = _upb_DefImage_ScanVarint(p, end, &len);
+        val->data = p;
+        val->size = len;
+        break;
+      case 5:  // 32-bit
+        len = 4;
+        break;
+      default:
+        p = NULL;
+    }
+  }
+  if (!p || len > (size_t)(end - p)) {
+    *ptr = NULL;
+    return false;
+  }
+  *num = tag >> 3;
+  *ptr = p + len;
+  return true;
+}
+
+// Returns the name (field 1) of a serialized DescriptorProto or other def, or
+// a NULL view if it has none or is malformed.
+static upb_StringView _upb_DefImage_ScanName(upb_StringView proto) {
+  const char* ptr = proto.data;
+  const char* end = ptr + proto.size;
+  uint32_t num;
+  upb_StringView val, name = {NULL, 0};
+  while (ptr < end && _upb_DefImage_ScanField(&ptr, end, &num, &val)) {
+    if (num == 1 && val.data) name = val;
+  }
+  return ptr ? name : (upb_StringView){NULL, 0};
+}
+
+static bool _upb_DefImage_ScanSymbol(upb_StringView package,
+                                     upb_StringView proto, upb_Arena* a,
+                                     _upb_DefImage_SymbolFunc* func,
+                                     void* closure) {
+  upb_StringView name = _upb_DefImage_ScanName(proto);
+  if (!name.data) return false;
+  upb_StringView sym;
+  sym.size = package.size + (package.size > 0) + name.size;
+  char* buf = upb_Arena_Malloc(a, sym.size);
+  if (!buf) return false;
+  if (package.size) {
+    memcpy(buf, package.data, package.size);
+    buf[package.size] = '.';
+  }
+  memcpy(buf + sym.size - name.size, name.data, name.size);
+  sym.data = buf;
+  return func(closure, sym);
+}
+
+bool _upb_DefImage_ScanSymbols(upb_StringView file, upb_Arena* a,
+                               _upb_DefImage_SymbolFunc* func, void* closure) {
+  const char* end = file.data + file.size;
+  const char* ptr = file.data;
+  uint32_t num;
+  upb_StringView val, package = {NULL, 0};
+  while (ptr < end && _upb_DefImage_ScanField(&ptr, end, &num, &val)) {
+    if (num == 2 && val.data) package = val;
+  }
+  if (!ptr) return false;
+
+  ptr = file.data;
+  while (ptr < end && _upb_DefImage_ScanField(&ptr, end, &num, &val)) {
+    // message_type = 4, enum_type = 5, service = 6, extension = 7.
+    if (!val.data || num < 4 || num > 7) continue;
+    if (!_upb_DefImage_ScanSymbol(package, val, a, func, closure)) {
+      return false;
+    }
+    if (num != 5) continue;
+
+    // Enum values are scoped to the enum's parent, so the values of a
+    // top-level enum are top-level too.
+    const char* v_ptr = val.data;
+    const char* v_end = v_ptr + val.size;
+    uint32_t v_num;
+    upb_StringView value;
+    while (v_ptr < v_end &&
+           _upb_DefImage_ScanField(&v_ptr, v_end, &v_num, &value)) {
+      if (v_num == 2 && value.data &&
+          !_upb_DefImage_ScanSymbol(package, value, a, func, closure)) {
+        return false;
+      }
+    }
+    if (!v_ptr) return false;
+  }
+  return ptr != NULL;
+}
+
+/* Reading images *************************************************************/
+
+bool _upb_DefImage_Init(_upb_DefImage* img, const char* data, size_t size) {
+  if (size < kUpb_DefImage_HeaderSize ||
+      memcmp(data, kUpb_DefImage_Magic, sizeof(kUpb_DefImage_Magic)) != 0) {
+    return false;
+  }
+  uint64_t file_count = _upb_DefImage_Get32(data + 8);
+  uint64_t sym_count = _upb_DefImage_Get32(data + 12);
+  uint64_t tables = kUpb_DefImage_HeaderSize +
+                    file_count * (kUpb_DefImage_FileSize + 4) +
+                    sym_count * kUpb_DefImage_SymSize;
+  if (file_count > INT32_MAX || tables > size) return false;
+  img->data = data;
+  img->size = size;
+  img->file_count = file_count;
+  img->sym_count = sym_count;
+  return true;
+}
+
+// Sets |*view| to the |len| bytes at |ofs|, if they are inside the image.
+static bool _upb_DefImage_GetData(const _upb_DefImage* img, uint32_t ofs,
+                                  uint32_t len, upb_StringView* view) {
+  if (ofs > img->size || len > img->size - ofs) return false;
+  view->data = img->data + ofs;
+  view->size = len;
+  return true;
+}
+
+static const char* _upb_DefImage_Syms(const _upb_DefImage* img) {
+  return img->data + kUpb_DefImage_HeaderSize +
+         img->file_count * kUpb_DefImage_FileSize;
+}
+
+static const char* _upb_DefImage_FileOrder(const _upb_DefImage* img) {
+  return _upb_DefImage_Syms(img) + img->sym_count * kUpb_DefImage_SymSize;
+}
+
+bool _upb_DefImage_GetFile(const _upb_DefImage* img, uint32_t i,
+                           _upb_DefImage_File* file) {
+  if (i >= img->file_count) return false;
+  const char* ent =
+      img->data + kUpb_DefImage_HeaderSize + i * kUpb_DefImage_FileSize;
+  upb_StringView deps;
+  uint32_t dep_count = _upb_DefImage_Get32(ent + 20);
+  if (dep_count > img->file_count ||
+      !_upb_DefImage_GetData(img, _upb_DefImage_Get32(ent),
+                             _upb_DefImage_Get32(ent + 4), &file->name) ||
+      !_upb_DefImage_GetData(img, _upb_DefImage_Get32(ent + 8),
+                             _upb_DefImage_Get32(ent + 12),
+                             &file->descriptor) ||
+      !_upb_DefImage_GetData(img, _upb_DefImage_Get32(ent + 16),
+                             dep_count * 4, &deps)) {
+    return false;
+  }
+  file->deps = deps.data;
+  file->dep_count = dep_count;
+  return true;
+}
+
+uint32_t _upb_DefImage_FileDep(const _upb_DefImage_File* file, uint32_t i) {
+  UPB_ASSERT(i < file->dep_count);
+  return _upb_DefImage_Get32(file->deps + i * 4);
+}
+
+int32_t _upb_DefImage_FindFile(const _upb_DefImage* img, const char* name,
+                               size_t size) {
+  const upb_StringView key = {name, size};
+  const char* order = _upb_DefImage_FileOrder(img);
+  uint32_t lo = 0, hi = img->file_count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t i = _upb_DefImage_Get32(order + mid * 4);
+    _upb_DefImage_File file;
+    if (!_upb_DefImage_GetFile(img, i, &file)) return -1;
+    int cmp = _upb_DefImage_Compare(key, file.name);
+    if (cmp == 0) return i;
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return -1;
+}
+
+int32_t _upb_DefImage_FindSymbol(const _upb_DefImage* img, const char* sym,
+                                 size_t size) {
+  const upb_StringView key = {sym, size};
+  const char* syms = _upb_DefImage_Syms(img);
+  uint32_t lo = 0, hi = img->sym_count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    const char* ent = syms + mid * kUpb_DefImage_SymSize;
+    upb_StringView name;
+    if (!_upb_DefImage_GetData(img, _upb_DefImage_Get32(ent),
+                               _upb_DefImage_Get32(ent + 4), &name)) {
+      return -1;
+    }
+    int cmp = _upb_DefImage_Compare(key, name);
+    if (cmp == 0) {
+      uint32_t file = _upb_DefImage_Get32(ent + 8);
+      return file < img->file_count ? (int32_t)file : -1;
+    }
+    if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return -1;
+}
+
+/* Building images ************************************************************/
+
+typedef struct {
+  upb_StringView name;
+  upb_StringView descriptor;
+  uint32_t* deps;
+  uint32_t dep_count;
+} _upb_DefImage_BuildFile;
+
+typedef struct {
+  upb_StringView name;
+  uint32_t file;
+} _upb_DefImage_BuildSym;
+
+typedef struct {
+  _upb_DefImage_BuildSym* syms;
+  size_t count;
+  size_t size;
+  uint32_t file;
+  upb_Arena* arena;
+} _upb_DefImage_SymList;
+
+static bool _upb_DefImage_AddSym(void* closure, upb_StringView sym) {
+  _upb_DefImage_SymList* list = closure;
+  if (list->count == list->size) {
+    size_t size = UPB_MAX(64, list->size * 2);
+    void* p = upb_Arena_Realloc(list->arena, list->syms,
+                                list->size * sizeof(*list->syms),
+                                size * sizeof(*list->syms));
+    if (!p) return false;
+    list->syms = p;
+    list->size = size;
+  }
+  list->syms[list->count].name = sym;
+  list->syms[list->count].file = list->file;
+  list->count++;
+  return true;
+}
+
+static int _upb_DefImage_CompareSyms(const void* a, const void* b) {
+  return _upb_DefImage_Compare(((const _upb_DefImage_BuildSym*)a)->name,
+                               ((const _upb_DefImage_BuildSym*)b)->name);
+}
+
+static int _upb_DefImage_CompareFiles(const void* a, const void* b) {
+  return _upb_DefImage_Compare(
+      (*(const _upb_DefImage_BuildFile* const*)a)->name,
+      (*(const _upb_DefImage_BuildFile* const*)b)->name);
+}
+
+// Reads the name and dependencies of each file, and the symbols it defines.
+static bool _upb_DefImage_ScanFiles(const upb_StringView* protos,
+                                    _upb_DefImage_BuildFile* files,
+                                    uint32_t count, _upb_DefImage_SymList* syms,
+                                    upb_Status* status) {
+  upb_strtable names;
+  if (!upb_strtable_init(&names, count, syms->arena)) goto oom;
+
+  for (uint32_t i = 0; i < count; i++) {
+    _upb_DefImage_BuildFile* f = &files[i];
+    const char* ptr = protos[i].data;
+    const char* end = ptr + protos[i].size;
+    uint32_t num;
+    upb_StringView val;
+    f->name.data = NULL;
+    f->descriptor = protos[i];
+    f->dep_count = 0;
+    while (ptr < end && _upb_DefImage_ScanField(&ptr, end, &num, &val)) {
+      if (num == 1 && val.data) f->name = val;
+      if (num == 3 && val.data) f->dep_count++;
+    }
+    if (!ptr || !f->name.data) {
+      upb_Status_SetErrorFormat(status, "file %u is malformed", (unsigned)i);
+      return false;
+    }
+    if (upb_strtable_lookup2(&names, f->name.data, f->name.size, NULL)) {
+      upb_Status_SetErrorFormat(status,
+                                "duplicate file name " UPB_STRINGVIEW_FORMAT,
+                                UPB_STRINGVIEW_ARGS(f->name));
+      return false;
+    }
+    if (!upb_strtable_insert(&names, f->name.data, f->name.size,
+                             upb_value_uint32(i), syms->arena)) {
+      goto oom;
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    _upb_DefImage_BuildFile* f = &files[i];
+    const char* ptr = f->descriptor.data;
+    const char* end = ptr + f->descriptor.size;
+    uint32_t num, j = 0;
+    upb_StringView val;
+    f->deps = upb_Arena_Malloc(syms->arena, f->dep_count * sizeof(*f->deps));
+    if (f->dep_count && !f->deps) goto oom;
+    while (ptr < end && _upb_DefImage_ScanField(&ptr, end, &num, &val)) {
+      if (num != 3 || !val.data) continue;
+      upb_value v;
+      if (!upb_strtable_lookup2(&names, val.data, val.size, &v)) {
+        upb_Status_SetErrorFormat(
+            status, UPB_STRINGVIEW_FORMAT " depends on " UPB_STRINGVIEW_FORMAT
+                                          ", which is not in the image",
+            UPB_STRINGVIEW_ARGS(f->name), UPB_STRINGVIEW_ARGS(val));
+        return false;
+      }
+      f->deps[j++] = upb_value_getuint32(v);
+    }
+
+    syms->file = i;
+    if (!_upb_DefImage_ScanSymbols(f->descriptor, syms->arena,
+                                   _upb_DefImage_AddSym, syms)) {
+      upb_Status_SetErrorFormat(status,
+                                "file " UPB_STRINGVIEW_FORMAT " is malformed",
+                                UPB_STRINGVIEW_ARGS(f->name));
+      return false;
+    }
+  }
+  return true;
+
+oom:
+  upb_Status_SetErrorMessage(status, "out of memory");
+  return false;
+}
+
+static char* _upb_DefImage_Write(const _upb_DefImage_BuildFile* files,
+                                 uint32_t file_count,
+                                 const _upb_DefImage_SymList* syms,
+                                 upb_Arena* tmp, upb_Arena* a, size_t* size,
+                                 upb_Status* status) {
+  const _upb_DefImage_BuildFile** order =
+      upb_Arena_Malloc(tmp, file_count * sizeof(*order));
+  if (file_count && !order) goto oom;
+  for (uint32_t i = 0; i < file_count; i++) order[i] = &files[i];
+  if (file_count) {
+    qsort(order, file_count, sizeof(*order), _upb_DefImage_CompareFiles);
+  }
+
+  uint64_t total = kUpb_DefImage_HeaderSize +
+                   (uint64_t)file_count * (kUpb_DefImage_FileSize + 4) +
+                   (uint64_t)syms->count * kUpb_DefImage_SymSize;
+  for (uint32_t i = 0; i < file_count; i++) {
+    total += files[i].dep_count * 4 + files[i].name.size +
+             files[i].descriptor.size;
+  }
+  for (size_t i = 0; i < syms->count; i++) total += syms->syms[i].name.size;
+  if (total > UINT32_MAX) {
+    upb_Status_SetErrorMessage(status, "image is too large");
+    return NULL;
+  }
+
+  char* image = upb_Arena_Malloc(a, total);
+  if (!image) goto oom;
+  memcpy(image, kUpb_DefImage_Magic, sizeof(kUpb_DefImage_Magic));
+  _upb_DefImage_Put32(image + 8, file_count);
+  _upb_DefImage_Put32(image + 12, syms->count);
+  char* sym_ent =
+      image + kUpb_DefImage_HeaderSize + file_count * kUpb_DefImage_FileSize;
+  char* order_ent = sym_ent + syms->count * kUpb_DefImage_SymSize;
+  char* data = order_ent + file_count * 4;
+
+  for (uint32_t i = 0; i < file_count; i++) {
+    const _upb_DefImage_BuildFile* f = &files[i];
+    char* file_ent =
+        image + kUpb_DefImage_HeaderSize + i * kUpb_DefImage_FileSize;
+    _upb_DefImage_Put32(file_ent + 16, data - image);
+    _upb_DefImage_Put32(file_ent + 20, f->dep_count);
+    for (uint32_t j = 0; j < f->dep_count; j++, data += 4) {
+      _upb_DefImage_Put32(data, f->deps[j]);
+    }
+    _upb_DefImage_Put32(file_ent, data - image);
+    _upb_DefImage_Put32(file_ent + 4, f->name.size);
+    memcpy(data, f->name.data, f->name.size);
+    data += f->name.size;
+    _upb_DefImage_Put32(file_ent + 8, data - image);
+    _upb_DefImage_Put32(file_ent + 12, f->descriptor.size);
+    if (f->descriptor.size) {
+      memcpy(data, f->descriptor.data, f->descriptor.size);
+    }
+    data += f->descriptor.size;
+    _upb_DefImage_Put32(order_ent + i * 4, order[i] - files);
+  }
+  for (size_t i = 0; i < syms->count; i++, sym_ent += kUpb_DefImage_SymSize) {
+    const _upb_DefImage_BuildSym* sym = &syms->syms[i];
+    _upb_DefImage_Put32(sym_ent, data - image);
+    _upb_DefImage_Put32(sym_ent + 4, sym->name.size);
+    _upb_DefImage_Put32(sym_ent + 8, sym->file);
+    memcpy(data, sym->name.data, sym->name.size);
+    data += sym->name.size;
+  }
+  UPB_ASSERT(data == image + total);
+  *size = total;
+  return image;
+
+oom:
+  upb_Status_SetErrorMessage(status, "out of memory");
+  return NULL;
+}
+
+char* upb_DefImage_Build(const upb_StringView* files, size_t count,
+                         upb_Arena* a, size_t* size, upb_Status* status) {
+  if (count > UINT32_MAX / kUpb_DefImage_FileSize) {
+    upb_Status_SetErrorMessage(status, "too many files");
+    return NULL;
+  }
+  upb_Arena* tmp = upb_Arena_New();
+  if (!tmp) {
+    upb_Status_SetErrorMessage(status, "out of memory");
+    return NULL;
+  }
+  char* image = NULL;
+  _upb_DefImage_SymList syms = {NULL, 0, 0, 0, tmp};
+  _upb_DefImage_BuildFile* build =
+      upb_Arena_Malloc(tmp, count * sizeof(*build));
+  if (count && !build) {
+    upb_Status_SetErrorMessage(status, "out of memory");
+    goto done;
+  }
+  if (!_upb_DefImage_ScanFiles(files, build, count, &syms, status)) goto done;
+
+  if (syms.count) {
+    qsort(syms.syms, syms.count, sizeof(*syms.syms),
+          _upb_DefImage_CompareSyms);
+  }
+  for (size_t i = 1; i < syms.count; i++) {
+    if (_upb_DefImage_Compare(syms.syms[i - 1].name, syms.syms[i].name) == 0) {
+      upb_Status_SetErrorFormat(status,
+                                "duplicate symbol " UPB_STRINGVIEW_FORMAT,
+                                UPB_STRINGVIEW_ARGS(syms.syms[i].name));
+      goto done;
+    }
+  }
+  image = _upb_DefImage_Write(build, count, &syms, tmp, a, size, status);
+
+done:
+  upb_Arena_Free(tmp);
+  return image;
+}
@@ -30,10 +30,17 @@
 
 #include "upb/reflection/internal/def_pool.h"
 
+#include "upb/hash/concurrent_table.h"
+#include "upb/hash/frozen_table.h"
 #include "upb/hash/int_table.h"
 #include "upb/hash/str_table.h"
+#include "upb/message/compare.h"
+#include "upb/message/copy.h"
+#include "upb/mini_table/extension_registry.h"
+#include "upb/port/atomic.h"
 #include "upb/reflection/def_type.h"
 #include "upb/reflection/internal/def_builder.h"
+#include "upb/reflection/internal/def_image.h"
 #include "upb/reflection/internal/enum_def.h"
 #include "upb/reflection/internal/enum_value_def.h"
 #include "upb/reflection/internal/field_def.h"
@@ -44,13 +51,82 @@
 // Must be last.
 #include "upb/port/def.inc"
 
+// A def added by the file being built, to be published to the shared tables
+// of a concurrent pool once the file is complete.
+typedef struct {
+  upb_StringView sym;                 // Empty for an extension.
+  const upb_MiniTableExtension* ext;  // NULL for a symbol.
+  upb_value val;
+} _upb_DefPool_NewDef;
+
+#define UPB_DEFPOOL_EXTNUM_KEY_SIZE (sizeof(upb_MiniTable*) + sizeof(uint32_t))
+
+// The extensions of one message, in the order they were added.  An entry is
+// written before `size` is raised past it, and a full array is replaced by a
+// bigger copy, so a reader that loads `size` and then `exts` sees `size`
+// valid entries.  Replaced arrays stay in the arena, so the arrays returned
+// by upb_DefPool_GetExtensions() never change.
+typedef struct {
+  UPB_ATOMIC(size_t) size;
+  UPB_ATOMIC(const upb_FieldDef**) exts;
+  // Entries written, which exceeds `size` while a file that adds to the list
+  // is being built in a concurrent pool.  Only the writer uses these.
+  size_t pending;
+  size_t capacity;
+} _upb_DefPool_ExtList;
+
+// Options shared by defs, in a list of those with the same hash.
+typedef struct _upb_DefPool_Options {
+  const upb_MiniTable* m;
+  const upb_Message* opts;
+  struct _upb_DefPool_Options* next;
+} _upb_DefPool_Options;
+
 struct upb_DefPool {
   upb_Arena* arena;
   upb_strtable syms;   // full_name -> packed def ptr
   upb_strtable files;  // file_name -> (upb_FileDef*)
   upb_inttable exts;   // (upb_MiniTableExtension*) -> (upb_FieldDef*)
+  upb_inttable ext_lists;  // (upb_MessageDef*) -> (_upb_DefPool_ExtList*)
+  // Shared by the defs of all files, see _upb_DefPool_InternString() and
+  // _upb_DefPool_InternOptions().
+  upb_strtable strings;  // string -> (unused)
+  upb_inttable options;  // hash -> (_upb_DefPool_Options*)
+  // Copies of the three tables above, used instead of them once frozen.
+  upb_frozentable frozen_syms;
+  upb_frozentable frozen_files;
+  upb_frozentable frozen_exts;
+  bool frozen;
+  // Used for lookups instead of the tables above in a concurrent pool, and
+  // NULL otherwise.  Only the defs of files that were added successfully are
+  // published to these.
+  upb_concurrenttable* shared_syms;
+  upb_concurrenttable* shared_files;
+  upb_concurrenttable* shared_exts;
+  upb_concurrenttable* shared_extnums;  // (upb_MiniTable*, num) -> FieldDef*
+  upb_concurrenttable* shared_ext_lists;  // Same as `ext_lists`.
+  _upb_DefPool_NewDef* new_defs;
+  size_t new_defs_count;
+  size_t new_defs_size;
+  // Generated files that are loaded when first looked up, see
+  // _upb_DefPool_RegisterDefInit().  Initialized on first use.
+  upb_strtable lazy_syms;   // top-level full_name -> (_upb_DefPool_Init*)
+  upb_strtable lazy_files;  // file_name -> (_upb_DefPool_Init*)
+  bool lazy;
+  // How many files registered with upb_DefPool_RegisterFile() are being
+  // built, which bounds the recursion if their imports have a cycle.
+  size_t lazy_depth;
+  // Files of the image added with upb_DefPool_AddImage(), which are also
+  // loaded when first looked up.
+  _upb_DefImage image;
+  bool has_image;
+  // The pool that defs are looked up in after this one, while this one builds
+  // a file for upb_DefPool_AddFiles().  It is only read.
+  const upb_DefPool* parent;
   upb_ExtensionRegistry* extreg;
   upb_MiniTablePlatform platform;
+  _upb_DefPool_FieldHotnessFunc* hotness_func;
+  void* hotness_closure;
   void* scratch_data;
   size_t scratch_size;
   size_t bytes_loaded;
@@ -59,6 +135,7 @@ struct upb_DefPool {
 void upb_DefPool_Free(upb_DefPool* s) {
   upb_Arena_Free(s->arena);
   upb_gfree(s->scratch_data);
+  upb_gfree(s->new_defs);
   upb_gfree(s);
 }
 
@@ -68,6 +145,19 @@ upb_DefPool* upb_DefPool_New(void) {
 
   s->arena = upb_Arena_New();
   s->bytes_loaded = 0;
+  s->frozen = false;
+  s->shared_syms = NULL;
+  s->shared_files = NULL;
+  s->shared_exts = NULL;
+  s->shared_extnums = NULL;
+  s->shared_ext_lists = NULL;
+  s->new_defs = NULL;
+  s->new_defs_count = 0;
+  s->new_defs_size = 0;
+  s->lazy = false;
+  s->lazy_depth = 0;
+  s->has_image = false;
+  s->parent = NULL;
 
   s->scratch_size = 240;
   s->scratch_data = upb_gmalloc(s->scratch_size);
@@ -76,11 +166,16 @@ upb_DefPool* upb_DefPool_New(void) {
   if (!upb_strtable_init(&s->syms, 32, s->arena)) goto err;
   if (!upb_strtable_init(&s->files, 4, s->arena)) goto err;
   if (!upb_inttable_init(&s->exts, s->arena)) goto err;
+  if (!upb_inttable_init(&s->ext_lists, s->arena)) goto err;
+  if (!upb_strtable_init(&s->strings, 32, s->arena)) goto err;
+  if (!upb_inttable_init(&s->options, s->arena)) goto err;
 
   s->extreg = upb_ExtensionRegistry_New(s->arena);
   if (!s->extreg) goto err;
 
   s->platform = kUpb_MiniTablePlatform_Native;
+  s->hotness_func = NULL;
+  s->hotness_closure = NULL;
 
   return s;
 
@@ -89,38 +184,363 @@ err:
   return NULL;
 }
 
+bool upb_DefPool_Freeze(upb_DefPool* s) {
+  if (s->frozen) return true;
+  upb_frozentable syms, files, exts;
+  if (!upb_frozentable_initstr(&syms, &s->syms, s->arena) ||
+      !upb_frozentable_initstr(&files, &s->files, s->arena) ||
+      !upb_frozentable_initint(&exts, &s->exts, s->arena) ||
+      !upb_ExtensionRegistry_Freeze(s->extreg)) {
+    return false;
+  }
+  s->frozen_syms = syms;
+  s->frozen_files = files;
+  s->frozen_exts = exts;
+  s->frozen = true;
+  return true;
+}
+
+bool upb_DefPool_IsFrozen(const upb_DefPool* s) { return s->frozen; }
+
+static void _upb_DefPool_ExtNumKey(char* buf, const upb_FieldDef* f) {
+  const upb_MiniTable* t =
+      upb_MessageDef_MiniTable(upb_FieldDef_ContainingType(f));
+  uint32_t num = upb_FieldDef_Number(f);
+  memcpy(buf, &t, sizeof(t));
+  memcpy(buf + sizeof(t), &num, sizeof(num));
+}
+
+// Publishes an extension, whose key for `shared_extnums` is stored at |buf|.
+static void _upb_DefPool_PublishExt(upb_DefPool* s,
+                                    const upb_MiniTableExtension* ext,
+                                    upb_value v, char* buf) {
+  _upb_DefPool_ExtNumKey(buf, upb_value_getconstptr(v));
+  bool ok = upb_concurrenttable_insertint(s->shared_exts, (uintptr_t)ext, v) &&
+            upb_concurrenttable_insertstr(s->shared_extnums, buf,
+                                          UPB_DEFPOOL_EXTNUM_KEY_SIZE, v);
+  UPB_ASSERT(ok);
+}
+
+static _upb_DefPool_ExtList* _upb_DefPool_FindExtList(
+    const upb_DefPool* s, const upb_MessageDef* m) {
+  upb_value v;
+  bool found = s->shared_ext_lists
+                   ? upb_concurrenttable_lookupint(s->shared_ext_lists,
+                                                   (uintptr_t)m, &v)
+                   : upb_inttable_lookup(&s->ext_lists, (uintptr_t)m, &v);
+  return found ? upb_value_getptr(v) : NULL;
+}
+
+// Writes |f| after the pending entries of its extendee's list, which is
+// created if needed.  Returns false if memory allocation failed.
+static bool _upb_DefPool_AddExtListEntry(upb_DefPool* s,
+                                         const upb_FieldDef* f) {
+  const upb_MessageDef* m = upb_FieldDef_ContainingType(f);
+  _upb_DefPool_ExtList* l = _upb_DefPool_FindExtList(s, m);
+  if (!l) {
+    l = upb_Arena_Malloc(s->arena, sizeof(*l));
+    if (!l) return false;
+    upb_Atomic_Init(&l->size, 0);
+    upb_Atomic_Init(&l->exts, NULL);
+    l->pending = 0;
+    l->capacity = 0;
+    upb_value v = upb_value_ptr(l);
+    if ((s->shared_ext_lists &&
+         !upb_concurrenttable_reserve(s->shared_ext_lists, 1)) ||
+        !upb_inttable_insert(&s->ext_lists, (uintptr_t)m, v, s->arena)) {
+      return false;
+    }
+    // An empty list can be published right away.
+    if (s->shared_ext_lists) {
+      upb_concurrenttable_insertint(s->shared_ext_lists, (uintptr_t)m, v);
+    }
+  }
+
+  const upb_FieldDef** exts = upb_Atomic_Load(&l->exts, memory_order_relaxed);
+  if (l->pending == l->capacity) {
+    size_t capacity = UPB_MAX(4, l->capacity * 2);
+    const upb_FieldDef** grown =
+        upb_Arena_Malloc(s->arena, capacity * sizeof(*grown));
+    if (!grown) return false;
+    if (l->pending) memcpy(grown, exts, l->pending * sizeof(*exts));
+    exts = grown;
+    l->capacity = capacity;
+    upb_Atomic_Store(&l->exts, exts, memory_order_release);
+  }
+  exts[l->pending++] = f;
+  if (!s->shared_ext_lists) {
+    upb_Atomic_Store(&l->size, l->pending, memory_order_relaxed);
+  }
+  return true;
+}
+
+// Makes the next pending entry of the list for |f|'s extendee, which is |f|,
+// visible to readers of a concurrent pool.
+static void _upb_DefPool_PublishExtListEntry(upb_DefPool* s,
+                                             const upb_FieldDef* f) {
+  _upb_DefPool_ExtList* l =
+      _upb_DefPool_FindExtList(s, upb_FieldDef_ContainingType(f));
+  size_t size = upb_Atomic_Load(&l->size, memory_order_relaxed);
+  UPB_ASSERT(size < l->pending);
+  upb_Atomic_Store(&l->size, size + 1, memory_order_release);
+}
+
+// Removes the extensions of |file|, which was not added, from |s->exts| and
+// from the ends of the lists.
+static void _upb_DefPool_RemoveExts(upb_DefPool* s, const upb_FileDef* file) {
+  intptr_t iter = UPB_INTTABLE_BEGIN;
+  uintptr_t m;
+  upb_value v;
+  while (upb_inttable_next(&s->ext_lists, &m, &v, &iter)) {
+    _upb_DefPool_ExtList* l = upb_value_getptr(v);
+    const upb_FieldDef** exts =
+        upb_Atomic_Load(&l->exts, memory_order_relaxed);
+    while (l->pending && upb_FieldDef_File(exts[l->pending - 1]) == file) {
+      const upb_FieldDef* f = exts[--l->pending];
+      upb_inttable_remove(&s->exts,
+                          (uintptr_t)_upb_FieldDef_ExtensionMiniTable(f), NULL);
+    }
+    if (upb_Atomic_Load(&l->size, memory_order_relaxed) > l->pending) {
+      // Only a pool that is not concurrent publishes entries early.
+      UPB_ASSERT(!s->shared_ext_lists);
+      upb_Atomic_Store(&l->size, l->pending, memory_order_relaxed);
+    }
+  }
+}
+
+bool upb_DefPool_MakeConcurrent(upb_DefPool* s) {
+  if (s->shared_syms || s->frozen) return true;
+  upb_concurrenttable* syms = upb_concurrenttable_new(s->arena, true);
+  upb_concurrenttable* files = upb_concurrenttable_new(s->arena, true);
+  upb_concurrenttable* exts = upb_concurrenttable_new(s->arena, false);
+  upb_concurrenttable* extnums = upb_concurrenttable_new(s->arena, true);
+  upb_concurrenttable* ext_lists = upb_concurrenttable_new(s->arena, false);
+  size_t ext_count = upb_inttable_count(&s->exts);
+  size_t ext_list_count = upb_inttable_count(&s->ext_lists);
+  char* keys =
+      ext_count
+          ? upb_Arena_Malloc(s->arena, ext_count * UPB_DEFPOOL_EXTNUM_KEY_SIZE)
+          : NULL;
+  if (!syms || !files || !exts || !extnums || !ext_lists ||
+      (ext_count && !keys) ||
+      !upb_concurrenttable_reserve(syms, upb_strtable_count(&s->syms)) ||
+      !upb_concurrenttable_reserve(files, upb_strtable_count(&s->files)) ||
+      !upb_concurrenttable_reserve(exts, ext_count) ||
+      !upb_concurrenttable_reserve(extnums, ext_count) ||
+      !upb_concurrenttable_reserve(ext_lists, ext_list_count)) {
+    return false;
+  }
+  s->shared_syms = syms;
+  s->shared_files = files;
+  s->shared_exts = exts;
+  s->shared_extnums = extnums;
+  s->shared_ext_lists = ext_lists;
+
+  // The keys of the existing tables stay in the arena, so they can be shared.
+  intptr_t iter = UPB_STRTABLE_BEGIN;
+  upb_StringView key;
+  upb_value v;
+  while (upb_strtable_next2(&s->syms, &key, &v, &iter)) {
+    upb_concurrenttable_insertstr(syms, key.data, key.size, v);
+  }
+  iter = UPB_STRTABLE_BEGIN;
+  while (upb_strtable_next2(&s->files, &key, &v, &iter)) {
+    upb_concurrenttable_insertstr(files, key.data, key.size, v);
+  }
+  iter = UPB_INTTABLE_BEGIN;
+  uintptr_t ext;
+  for (size_t i = 0; upb_inttable_next(&s->exts, &ext, &v, &iter); i++) {
+    _upb_DefPool_PublishExt(s, (const upb_MiniTableExtension*)ext, v,
+                            keys + i * UPB_DEFPOOL_EXTNUM_KEY_SIZE);
+  }
+  iter = UPB_INTTABLE_BEGIN;
+  uintptr_t m;
+  while (upb_inttable_next(&s->ext_lists, &m, &v, &iter)) {
+    upb_concurrenttable_insertint(ext_lists, m, v);
+  }
+  return true;
+}
+
+bool upb_DefPool_IsConcurrent(const upb_DefPool* s) {
+  return s->shared_syms != NULL;
+}
+
+// Makes room for the defs of the file being built in the shared tables, so
+// that publishing them cannot fail halfway, then publishes its symbols and
+// extensions.  The file itself is published last, by the caller.
+static void _upb_DefPool_PublishNewDefs(upb_DefBuilder* ctx) {
+  upb_DefPool* s = ctx->symtab;
+  size_t ext_count = 0;
+  for (size_t i = 0; i < s->new_defs_count; i++) {
+    if (s->new_defs[i].ext) ext_count++;
+  }
+  char* keys =
+      _upb_DefBuilder_Alloc(ctx, ext_count * UPB_DEFPOOL_EXTNUM_KEY_SIZE);
+  if (!upb_concurrenttable_reserve(s->shared_syms,
+                                   s->new_defs_count - ext_count) ||
+      !upb_concurrenttable_reserve(s->shared_files, 1) ||
+      !upb_concurrenttable_reserve(s->shared_exts, ext_count) ||
+      !upb_concurrenttable_reserve(s->shared_extnums, ext_count)) {
+    _upb_DefBuilder_OomErr(ctx);
+  }
+
+  for (size_t i = 0; i < s->new_defs_count; i++) {
+    const _upb_DefPool_NewDef* d = &s->new_defs[i];
+    if (d->ext) {
+      _upb_DefPool_PublishExt(s, d->ext, d->val, keys);
+      _upb_DefPool_PublishExtListEntry(s, upb_value_getconstptr(d->val));
+      keys += UPB_DEFPOOL_EXTNUM_KEY_SIZE;
+    } else {
+      upb_concurrenttable_insertstr(s->shared_syms, d->sym.data, d->sym.size,
+                                    d->val);
+    }
+  }
+}
+
+static bool _upb_DefPool_AddNewDef(upb_DefPool* s, upb_StringView sym,
+                                   const upb_MiniTableExtension* ext,
+                                   upb_value v) {
+  if (s->new_defs_count == s->new_defs_size) {
+    size_t size = UPB_MAX(16, s->new_defs_size * 2);
+    void* p = upb_grealloc(s->new_defs, s->new_defs_size * sizeof(*s->new_defs),
+                           size * sizeof(*s->new_defs));
+    if (!p) return false;
+    s->new_defs = p;
+    s->new_defs_size = size;
+  }
+  _upb_DefPool_NewDef* d = &s->new_defs[s->new_defs_count++];
+  d->sym = sym;
+  d->ext = ext;
+  d->val = v;
+  return true;
+}
+
+// Frozen and concurrent pools never change during lookups.
+bool _upb_DefPool_LoadsLazily(const upb_DefPool* s) {
+  return (s->lazy || s->has_image) && !s->frozen && !s->shared_syms;
+}
+
+static bool _upb_DefPool_LoadImageFile(upb_DefPool* s, uint32_t i,
+                                       uint32_t depth);
+
+static bool _upb_DefPool_LookupFile(const upb_DefPool* s, const char* name,
+                                    size_t size, upb_value* v) {
+  if (s->frozen) {
+    return upb_frozentable_lookupstr(&s->frozen_files, name, size, v);
+  }
+  if (s->shared_files) {
+    return upb_concurrenttable_lookupstr(s->shared_files, name, size, v);
+  }
+  if (upb_strtable_lookup2(&s->files, name, size, v)) return true;
+  if (s->parent) return upb_strtable_lookup2(&s->parent->files, name, size, v);
+
+  if (!_upb_DefPool_LoadsLazily(s)) return false;
+
+  upb_value init;
+  if (s->lazy && upb_strtable_lookup2(&s->lazy_files, name, size, &init)) {
+    return _upb_DefPool_LoadDefInit((upb_DefPool*)s,
+                                    upb_value_getconstptr(init)) &&
+           upb_strtable_lookup2(&s->files, name, size, v);
+  }
+  int32_t i = s->has_image ? _upb_DefImage_FindFile(&s->image, name, size) : -1;
+  return i >= 0 && _upb_DefPool_LoadImageFile((upb_DefPool*)s, i, 0) &&
+         upb_strtable_lookup2(&s->files, name, size, v);
+}
+
+static bool _upb_DefPool_LookupExt(const upb_DefPool* s,
+                                   const upb_MiniTableExtension* ext,
+                                   upb_value* v) {
+  if (s->frozen) {
+    return upb_frozentable_lookupint(&s->frozen_exts, (uintptr_t)ext, v);
+  }
+  if (s->shared_exts) {
+    return upb_concurrenttable_lookupint(s->shared_exts, (uintptr_t)ext, v);
+  }
+  return upb_inttable_lookup(&s->exts, (uintptr_t)ext, v);
+}
+
 bool _upb_DefPool_InsertExt(upb_DefPool* s, const upb_MiniTableExtension* ext,
                             const upb_FieldDef* f) {
-  return upb_inttable_insert(&s->exts, (uintptr_t)ext, upb_value_constptr(f),
-                             s->arena);
+  UPB_ASSERT(!s->frozen);
+  upb_value v = upb_value_constptr(f);
+  if (s->shared_exts) {
+    upb_StringView empty = {NULL, 0};
+    if (!_upb_DefPool_AddNewDef(s, empty, ext, v)) return false;
+  }
+  if (!upb_inttable_insert(&s->exts, (uintptr_t)ext, v, s->arena)) {
+    return false;
+  }
+  if (!_upb_DefPool_AddExtListEntry(s, f)) {
+    upb_inttable_remove(&s->exts, (uintptr_t)ext, NULL);
+    return false;
+  }
+  return true;
 }
 
 bool _upb_DefPool_InsertSym(upb_DefPool* s, upb_StringView sym, upb_value v,
                             upb_Status* status) {
+  UPB_ASSERT(!s->frozen);
   // TODO: table should support an operation "tryinsert" to avoid the double
   // lookup.
-  if (upb_strtable_lookup2(&s->syms, sym.data, sym.size, NULL)) {
+  if (_upb_DefPool_LookupSym(s, sym.data, sym.size, NULL)) {
     upb_Status_SetErrorFormat(status, "duplicate symbol '%s'", sym.data);
     return false;
   }
-  if (!upb_strtable_insert(&s->syms, sym.data, sym.size, v, s->arena)) {
+  if (!upb_strtable_insert(&s->syms, sym.data, sym.size, v, s->arena) ||
+      (s->shared_syms && !_upb_DefPool_AddNewDef(s, sym, NULL, v))) {
     upb_Status_SetErrorMessage(status, "out of memory");
     return false;
   }
   return true;
 }
 
+bool _upb_DefPool_LookupSym(const upb_DefPool* s, const char* sym, size_t size,
+                            upb_value* v) {
+  if (s->frozen) {
+    return upb_frozentable_lookupstr(&s->frozen_syms, sym, size, v);
+  }
+  return upb_strtable_lookup2(&s->syms, sym, size, v) ||
+         (s->parent && upb_strtable_lookup2(&s->parent->syms, sym, size, v));
+}
+
+// Loads the registered or image file that defines |sym|, or the top-level
+// symbol that |sym| is nested in, and then looks |sym| up again.
+static bool _upb_DefPool_LoadSym(const upb_DefPool* s, const char* sym,
+                                 size_t size, upb_value* v) {
+  for (size_t len = size; len > 0; len--) {
+    if (len < size && sym[len] != '.') continue;
+    upb_value init;
+    if (s->lazy && upb_strtable_lookup2(&s->lazy_syms, sym, len, &init)) {
+      return _upb_DefPool_LoadDefInit((upb_DefPool*)s,
+                                      upb_value_getconstptr(init)) &&
+             upb_strtable_lookup2(&s->syms, sym, size, v);
+    }
+    int32_t i =
+        s->has_image ? _upb_DefImage_FindSymbol(&s->image, sym, len) : -1;
+    if (i >= 0) {
+      return _upb_DefPool_LoadImageFile((upb_DefPool*)s, i, 0) &&
+             upb_strtable_lookup2(&s->syms, sym, size, v);
+    }
+  }
+  return false;
+}
+
+// Like _upb_DefPool_LookupSym(), but in a concurrent pool only finds the
+// symbols that have been published, and loads registered files on demand.
+static bool _upb_DefPool_FindSym(const upb_DefPool* s, const char* sym,
+                                 size_t size, upb_value* v) {
+  if (s->shared_syms && !s->frozen) {
+    return upb_concurrenttable_lookupstr(s->shared_syms, sym, size, v);
+  }
+  if (_upb_DefPool_LookupSym(s, sym, size, v)) return true;
+  return _upb_DefPool_LoadsLazily(s) && _upb_DefPool_LoadSym(s, sym, size, v);
+}
+
 static const void* _upb_DefPool_Unpack(const upb_DefPool* s, const char* sym,
                                        size_t size, upb_deftype_t type) {
   upb_value v;
-  return upb_strtable_lookup2(&s->syms, sym, size, &v)
-             ? _upb_DefType_Unpack(v, type)
-             : NULL;
-}
-
-bool _upb_DefPool_LookupSym(const upb_DefPool* s, const char* sym, size_t size,
-                            upb_value* v) {
-  return upb_strtable_lookup2(&s->syms, sym, size, v);
+  return _upb_DefPool_FindSym(s, sym, size, &v) ? _upb_DefType_Unpack(v, type)
+                                                : NULL;
 }
 
 upb_ExtensionRegistry* _upb_DefPool_ExtReg(const upb_DefPool* s) {
@@ -140,6 +560,20 @@ void _upb_DefPool_SetPlatform(upb_DefPool* s, upb_MiniTablePlatform platform) {
   s->platform = platform;
 }
 
+void _upb_DefPool_SetFieldHotness(upb_DefPool* s,
+                                  _upb_DefPool_FieldHotnessFunc* func,
+                                  void* closure) {
+  assert(upb_strtable_count(&s->files) == 0);
+  s->hotness_func = func;
+  s->hotness_closure = closure;
+}
+
+_upb_DefPool_FieldHotnessFunc* _upb_DefPool_FieldHotness(const upb_DefPool* s,
+                                                         void** closure) {
+  *closure = s->hotness_closure;
+  return s->hotness_func;
+}
+
 const upb_MessageDef* upb_DefPool_FindMessageByName(const upb_DefPool* s,
                                                     const char* sym) {
   return _upb_DefPool_Unpack(s, sym, strlen(sym), UPB_DEFTYPE_MSG);
@@ -162,24 +596,21 @@ const upb_EnumValueDef* upb_DefPool_FindEnumByNameval(const upb_DefPool* s,
 
 const upb_FileDef* upb_DefPool_FindFileByName(const upb_DefPool* s,
                                               const char* name) {
-  upb_value v;
-  return upb_strtable_lookup(&s->files, name, &v) ? upb_value_getconstptr(v)
-                                                  : NULL;
+  return upb_DefPool_FindFileByNameWithSize(s, name, strlen(name));
 }
 
 const upb_FileDef* upb_DefPool_FindFileByNameWithSize(const upb_DefPool* s,
                                                       const char* name,
                                                       size_t len) {
   upb_value v;
-  return upb_strtable_lookup2(&s->files, name, len, &v)
-             ? upb_value_getconstptr(v)
-             : NULL;
+  return _upb_DefPool_LookupFile(s, name, len, &v) ? upb_value_getconstptr(v)
+                                                   : NULL;
 }
 
 const upb_FieldDef* upb_DefPool_FindExtensionByNameWithSize(
     const upb_DefPool* s, const char* name, size_t size) {
   upb_value v;
-  if (!upb_strtable_lookup2(&s->syms, name, size, &v)) return NULL;
+  if (!_upb_DefPool_FindSym(s, name, size, &v)) return NULL;
 
   switch (_upb_DefType_Type(v)) {
     case UPB_DEFTYPE_FIELD:
@@ -216,7 +647,7 @@ const upb_FileDef* upb_DefPool_FindFileContainingSymbol(const upb_DefPool* s,
                                                         const char* name) {
   upb_value v;
   // TODO(haberman): non-extension fields and oneofs.
-  if (upb_strtable_lookup(&s->syms, name, &v)) {
+  if (_upb_DefPool_FindSym(s, name, strlen(name), &v)) {
     switch (_upb_DefType_Type(v)) {
       case UPB_DEFTYPE_EXT: {
         const upb_FieldDef* f = _upb_DefType_Unpack(v, UPB_DEFTYPE_EXT);
@@ -290,6 +721,7 @@ static void remove_filedef(upb_DefPool* s, upb_FileDef* file) {
 
     if (f == file) upb_strtable_removeiter(&s->syms, &iter);
   }
+  _upb_DefPool_RemoveExts(s, file);
 }
 
 static const upb_FileDef* upb_DefBuilder_AddFileToPool(
@@ -306,10 +738,18 @@ static const upb_FileDef* upb_DefBuilder_AddFileToPool(
     _upb_DefBuilder_OomErr(builder);
   } else {
     _upb_FileDef_Create(builder, file_proto);
+    if (s->shared_syms) _upb_DefPool_PublishNewDefs(builder);
     upb_strtable_insert(&s->files, name.data, name.size,
                         upb_value_constptr(builder->file), builder->arena);
     UPB_ASSERT(upb_Status_IsOk(status));
     upb_Arena_Fuse(s->arena, builder->arena);
+    if (s->shared_files) {
+      // Publish the file last, so that all of its defs can be found once it
+      // can be.
+      upb_concurrenttable_insertstr(s->shared_files,
+                                    upb_FileDef_Name(builder->file), name.size,
+                                    upb_value_constptr(builder->file));
+    }
   }
 
   if (builder->arena) upb_Arena_Free(builder->arena);
@@ -317,11 +757,24 @@ static const upb_FileDef* upb_DefBuilder_AddFileToPool(
   return builder->file;
 }
 
+// |serialized| is |file_proto| serialized, if the caller has bytes that
+// outlive the pool, and empty otherwise.
 static const upb_FileDef* _upb_DefPool_AddFile(
     upb_DefPool* s, const UPB_DESC(FileDescriptorProto) * file_proto,
-    const upb_MiniTableFile* layout, upb_Status* status) {
+    const upb_MiniTableFile* layout, upb_StringView serialized,
+    upb_Status* status) {
   const upb_StringView name = UPB_DESC(FileDescriptorProto_name)(file_proto);
 
+  if (s->frozen) {
+    upb_Status_SetErrorFormat(status,
+                              "cannot add file " UPB_STRINGVIEW_FORMAT
+                              " to a frozen pool",
+                              UPB_STRINGVIEW_ARGS(name));
+    return NULL;
+  }
+
+  s->new_defs_count = 0;
+
   // Determine whether we already know about this file.
   {
     upb_value v;
@@ -341,6 +794,7 @@ static const upb_FileDef* _upb_DefPool_AddFile(
       .enum_count = 0,
       .ext_count = 0,
       .status = status,
+      .serialized = serialized,
       .file = NULL,
       .arena = upb_Arena_New(),
       .tmp_arena = upb_Arena_New(),
@@ -353,7 +807,320 @@ const upb_FileDef* upb_DefPool_AddFile(upb_DefPool* s,
                                        const UPB_DESC(FileDescriptorProto) *
                                            file_proto,
                                        upb_Status* status) {
-  return _upb_DefPool_AddFile(s, file_proto, NULL, status);
+  return _upb_DefPool_AddFile(s, file_proto, NULL,
+                              upb_StringView_FromDataAndSize(NULL, 0), status);
+}
+
+const upb_FileDef* upb_DefPool_AddSerializedFile(upb_DefPool* s,
+                                                 const char* data, size_t size,
+                                                 upb_Status* status) {
+  upb_Arena* arena = upb_Arena_New();
+  if (!arena) {
+    upb_Status_SetErrorMessage(status, "out of memory");
+    return NULL;
+  }
+  const upb_FileDef* file = NULL;
+  UPB_DESC(FileDescriptorProto)* file_proto =
+      UPB_DESC(FileDescriptorProto_parse_ex)(
+          data, size, NULL, kUpb_DecodeOption_AliasString, arena);
+  if (!file_proto) {
+    upb_Status_SetErrorMessage(status, "could not parse file descriptor");
+  } else {
+    file = _upb_DefPool_AddFile(s, file_proto, NULL,
+                                upb_StringView_FromDataAndSize(NULL, 0),
+                                status);
+  }
+  upb_Arena_Free(arena);
+
+  // Keep a copy of the bytes.  If that fails, they are rebuilt when needed.
+  upb_StringView* serialized =
+      file ? upb_Arena_Malloc(s->arena, sizeof(*serialized) + size) : NULL;
+  if (serialized) {
+    char* copy = (char*)(serialized + 1);
+    if (size) memcpy(copy, data, size);
+    *serialized = upb_StringView_FromDataAndSize(copy, size);
+    _upb_FileDef_SetSerializedProto(file, serialized);
+  }
+  return file;
+}
+
+// Files of one upb_DefPool_AddFiles() call whose dependencies have all been
+// added, which are built at the same time, each in a pool of its own.
+typedef struct {
+  upb_DefPool* s;
+  const UPB_DESC(FileDescriptorProto) * const* files;
+  const uint32_t* ready;  // Indexes of the files to build.
+  upb_DefPool** pools;
+  const upb_FileDef** built;
+  upb_Status* statuses;
+} _upb_DefPool_Batch;
+
+static void _upb_DefPool_BuildInBatch(void* arg, size_t i) {
+  _upb_DefPool_Batch* b = arg;
+  upb_DefPool* pool = upb_DefPool_New();
+  b->pools[i] = pool;
+  b->built[i] = NULL;
+  upb_Status_Clear(&b->statuses[i]);
+  if (!pool) {
+    upb_Status_SetErrorMessage(&b->statuses[i], "out of memory");
+    return;
+  }
+  pool->parent = b->s;
+  pool->platform = b->s->platform;
+  pool->hotness_func = b->s->hotness_func;
+  pool->hotness_closure = b->s->hotness_closure;
+  b->built[i] = _upb_DefPool_AddFile(pool, b->files[b->ready[i]], NULL,
+                                     upb_StringView_FromDataAndSize(NULL, 0),
+                                     &b->statuses[i]);
+}
+
+// Moves |file|, which was built in |pool|, and its defs to |s|.
+static bool _upb_DefPool_Merge(upb_DefPool* s, upb_DefPool* pool,
+                               const upb_FileDef* file, upb_Status* status) {
+  // Files that were built at the same time may define the same symbol.
+  intptr_t iter = UPB_STRTABLE_BEGIN;
+  upb_StringView key;
+  upb_value v;
+  while (upb_strtable_next2(&pool->syms, &key, &v, &iter)) {
+    if (upb_strtable_lookup2(&s->syms, key.data, key.size, NULL)) {
+      upb_Status_SetErrorFormat(status,
+                                "duplicate symbol '" UPB_STRINGVIEW_FORMAT "'",
+                                UPB_STRINGVIEW_ARGS(key));
+      return false;
+    }
+  }
+  if (!upb_Arena_Fuse(s->arena, pool->arena)) goto oom;
+
+  size_t ext_count = upb_inttable_count(&pool->exts);
+  if (ext_count) {
+    const upb_MiniTableExtension** exts =
+        upb_gmalloc(ext_count * sizeof(*exts));
+    if (!exts) goto oom;
+    uintptr_t ext;
+    iter = UPB_INTTABLE_BEGIN;
+    for (size_t i = 0; upb_inttable_next(&pool->exts, &ext, &v, &iter); i++) {
+      exts[i] = (const upb_MiniTableExtension*)ext;
+    }
+    bool ok = upb_ExtensionRegistry_AddArray(s->extreg, exts, ext_count);
+    upb_gfree(exts);
+    if (!ok) {
+      upb_Status_SetErrorFormat(status,
+                                "could not register the extensions of %s",
+                                upb_FileDef_Name(file));
+      return false;
+    }
+    // Each list of |pool| is in the order its extensions were added.
+    iter = UPB_INTTABLE_BEGIN;
+    uintptr_t m;
+    while (upb_inttable_next(&pool->ext_lists, &m, &v, &iter)) {
+      const _upb_DefPool_ExtList* l = upb_value_getptr(v);
+      const upb_FieldDef** fields =
+          upb_Atomic_Load(&l->exts, memory_order_relaxed);
+      for (size_t i = 0; i < l->pending; i++) {
+        const upb_FieldDef* f = fields[i];
+        if (!_upb_DefPool_InsertExt(s, _upb_FieldDef_ExtensionMiniTable(f),
+                                    f)) {
+          remove_filedef(s, (upb_FileDef*)file);
+          goto oom;
+        }
+      }
+    }
+  }
+
+  iter = UPB_STRTABLE_BEGIN;
+  while (upb_strtable_next2(&pool->syms, &key, &v, &iter)) {
+    if (!upb_strtable_insert(&s->syms, key.data, key.size, v, s->arena)) {
+      remove_filedef(s, (upb_FileDef*)file);
+      goto oom;
+    }
+  }
+  const char* name = upb_FileDef_Name(file);
+  if (!upb_strtable_insert(&s->files, name, strlen(name),
+                           upb_value_constptr(file), s->arena)) {
+    remove_filedef(s, (upb_FileDef*)file);
+    goto oom;
+  }
+  _upb_FileDef_SetPool((upb_FileDef*)file, s);
+  return true;
+
+oom:
+  upb_Status_SetErrorMessage(status, "out of memory");
+  return false;
+}
+
+// Builds and merges the |count| files of |b| that are ready, stopping at the
+// first one that fails.
+static bool _upb_DefPool_AddBatch(_upb_DefPool_Batch* b, size_t count,
+                                  upb_DefPool_ParallelForFunc* parallel_for,
+                                  void* closure, upb_Status* status) {
+  parallel_for(closure, count, _upb_DefPool_BuildInBatch, b);
+  bool ok = true;
+  for (size_t i = 0; i < count; i++) {
+    if (ok && !b->built[i]) {
+      *status = b->statuses[i];
+      ok = false;
+    } else if (ok) {
+      ok = _upb_DefPool_Merge(b->s, b->pools[i], b->built[i], status);
+    }
+    if (b->pools[i]) upb_DefPool_Free(b->pools[i]);
+  }
+  return ok;
+}
+
+bool upb_DefPool_AddFiles(upb_DefPool* s,
+                          const UPB_DESC(FileDescriptorProto) * const* files,
+                          size_t count,
+                          upb_DefPool_ParallelForFunc* parallel_for,
+                          void* closure, upb_Status* status) {
+  if (s->frozen) {
+    upb_Status_SetErrorMessage(status, "cannot add files to a frozen pool");
+    return false;
+  }
+  // Publishing the defs of a concurrent pool relies on files being built in
+  // the pool itself.
+  if (s->shared_syms) parallel_for = NULL;
+
+  bool ok = false;
+  upb_Arena* tmp = upb_Arena_New();
+  if (!tmp) goto oom;
+  upb_strtable names;
+  uint32_t** deps = upb_Arena_Malloc(tmp, count * sizeof(*deps));
+  size_t* dep_counts = upb_Arena_Malloc(tmp, count * sizeof(*dep_counts));
+  bool* added = upb_Arena_Malloc(tmp, count * sizeof(*added));
+  uint32_t* ready = upb_Arena_Malloc(tmp, count * sizeof(*ready));
+  _upb_DefPool_Batch b = {
+      .s = s,
+      .files = files,
+      .ready = ready,
+      .pools = upb_Arena_Malloc(tmp, count * sizeof(*b.pools)),
+      .built = upb_Arena_Malloc(tmp, count * sizeof(*b.built)),
+      .statuses = upb_Arena_Malloc(tmp, count * sizeof(*b.statuses)),
+  };
+  if (count && (!deps || !dep_counts || !added || !ready || !b.pools ||
+                !b.built || !b.statuses)) {
+    goto oom;
+  }
+  if (!upb_strtable_init(&names, count, tmp)) goto oom;
+
+  for (size_t i = 0; i < count; i++) {
+    upb_StringView name = UPB_DESC(FileDescriptorProto_name)(files[i]);
+    if (upb_strtable_lookup2(&names, name.data, name.size, NULL) ||
+        upb_strtable_lookup2(&s->files, name.data, name.size, NULL)) {
+      upb_Status_SetErrorFormat(status,
+                                "duplicate file name " UPB_STRINGVIEW_FORMAT,
+                                UPB_STRINGVIEW_ARGS(name));
+      goto done;
+    }
+    if (!upb_strtable_insert(&names, name.data, name.size,
+                             upb_value_uint32(i), tmp)) {
+      goto oom;
+    }
+    added[i] = false;
+  }
+
+  // Find which files each file depends on within |files|, and load the others
+  // now if they are loaded lazily, as the pool must not change while files are
+  // being built from it.
+  for (size_t i = 0; i < count; i++) {
+    size_t n;
+    const upb_StringView* strs =
+        UPB_DESC(FileDescriptorProto_dependency)(files[i], &n);
+    deps[i] = upb_Arena_Malloc(tmp, n * sizeof(**deps));
+    if (n && !deps[i]) goto oom;
+    dep_counts[i] = 0;
+    for (size_t j = 0; j < n; j++) {
+      upb_value v;
+      if (upb_strtable_lookup2(&names, strs[j].data, strs[j].size, &v)) {
+        deps[i][dep_counts[i]++] = upb_value_getuint32(v);
+      } else {
+        upb_DefPool_FindFileByNameWithSize(s, strs[j].data, strs[j].size);
+      }
+    }
+  }
+
+  for (size_t left = count; left > 0;) {
+    size_t ready_count = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (added[i]) continue;
+      size_t j = 0;
+      while (j < dep_counts[i] && added[deps[i][j]]) j++;
+      if (j == dep_counts[i]) ready[ready_count++] = i;
+    }
+    if (ready_count == 0) {
+      for (size_t i = 0; i < count; i++) {
+        if (added[i]) continue;
+        upb_StringView name = UPB_DESC(FileDescriptorProto_name)(files[i]);
+        upb_Status_SetErrorFormat(status,
+                                  "file " UPB_STRINGVIEW_FORMAT
+                                  " is part of an import cycle",
+                                  UPB_STRINGVIEW_ARGS(name));
+        goto done;
+      }
+    }
+
+    if (parallel_for && ready_count > 1) {
+      if (!_upb_DefPool_AddBatch(&b, ready_count, parallel_for, closure,
+                                 status)) {
+        goto done;
+      }
+    } else {
+      for (size_t i = 0; i < ready_count; i++) {
+        if (!_upb_DefPool_AddFile(s, files[ready[i]], NULL,
+                                  upb_StringView_FromDataAndSize(NULL, 0),
+                                  status)) {
+          goto done;
+        }
+      }
+    }
+    for (size_t i = 0; i < ready_count; i++) added[ready[i]] = true;
+    left -= ready_count;
+  }
+  ok = true;
+  goto done;
+
+oom:
+  upb_Status_SetErrorMessage(status, "out of memory");
+
+done:
+  if (tmp) upb_Arena_Free(tmp);
+  return ok;
+}
+
+// Builds a file registered with upb_DefPool_RegisterFile() after the files it
+// imports, which are looked up by name and so may be registered too.
+static bool _upb_DefPool_LoadRegisteredFile(upb_DefPool* s,
+                                            const _upb_DefPool_Init* init) {
+  if (s->lazy_depth > upb_strtable_count(&s->lazy_files)) return false;
+  s->lazy_depth++;
+
+  const char* ptr = init->descriptor.data;
+  const char* end = ptr + init->descriptor.size;
+  uint32_t num;
+  upb_StringView val;
+  while (ptr < end && _upb_DefImage_ScanField(&ptr, end, &num, &val)) {
+    // Field 3 is FileDescriptorProto.dependency; a missing import is reported
+    // when the file is built.
+    if (num == 3 && val.data) {
+      upb_DefPool_FindFileByNameWithSize(s, val.data, val.size);
+    }
+  }
+
+  bool ok = false;
+  upb_Arena* arena = upb_Arena_New();
+  upb_Status status;
+  upb_Status_Clear(&status);
+  if (arena && ptr) {
+    UPB_DESC(FileDescriptorProto)* file =
+        UPB_DESC(FileDescriptorProto_parse_ex)(
+            init->descriptor.data, init->descriptor.size, NULL,
+            kUpb_DecodeOption_AliasString, arena);
+    s->bytes_loaded += init->descriptor.size;
+    ok = file &&
+         _upb_DefPool_AddFile(s, file, NULL, init->descriptor, &status);
+  }
+  upb_Arena_Free(arena);
+  s->lazy_depth--;
+  return ok;
 }
 
 bool _upb_DefPool_LoadDefInitEx(upb_DefPool* s, const _upb_DefPool_Init* init,
@@ -367,10 +1134,14 @@ bool _upb_DefPool_LoadDefInitEx(upb_DefPool* s, const _upb_DefPool_Init* init,
 
   upb_Status_Clear(&status);
 
-  if (upb_DefPool_FindFileByName(s, init->filename)) {
+  if (upb_strtable_lookup(&s->files, init->filename, NULL)) {
     return true;
   }
 
+  // Files registered with upb_DefPool_RegisterFile() may come from anywhere,
+  // so unlike generated ones they can fail quietly.
+  if (!deps) return _upb_DefPool_LoadRegisteredFile(s, init);
+
   arena = upb_Arena_New();
 
   for (; *deps; deps++) {
@@ -392,7 +1163,7 @@ bool _upb_DefPool_LoadDefInitEx(upb_DefPool* s, const _upb_DefPool_Init* init,
   }
 
   const upb_MiniTableFile* mt = rebuild_minitable ? NULL : init->layout;
-  if (!_upb_DefPool_AddFile(s, file, mt, &status)) {
+  if (!_upb_DefPool_AddFile(s, file, mt, init->descriptor, &status)) {
     goto err;
   }
 
@@ -408,16 +1179,103 @@ err:
   return false;
 }
 
+// Builds file |i| of the image after its dependencies.  |depth| bounds the
+// recursion, since a corrupt image may have a cycle.
+static bool _upb_DefPool_LoadImageFile(upb_DefPool* s, uint32_t i,
+                                       uint32_t depth) {
+  _upb_DefImage_File f;
+  upb_Status status;
+  upb_Status_Clear(&status);
+  if (depth > s->image.file_count || !_upb_DefImage_GetFile(&s->image, i, &f)) {
+    return false;
+  }
+  if (upb_strtable_lookup2(&s->files, f.name.data, f.name.size, NULL)) {
+    return true;
+  }
+  for (uint32_t j = 0; j < f.dep_count; j++) {
+    if (!_upb_DefPool_LoadImageFile(s, _upb_DefImage_FileDep(&f, j),
+                                    depth + 1)) {
+      return false;
+    }
+  }
+
+  upb_Arena* arena = upb_Arena_New();
+  if (!arena) return false;
+  UPB_DESC(FileDescriptorProto)* file = UPB_DESC(FileDescriptorProto_parse_ex)(
+      f.descriptor.data, f.descriptor.size, NULL, kUpb_DecodeOption_AliasString,
+      arena);
+  bool ok =
+      file && _upb_DefPool_AddFile(s, file, NULL, f.descriptor, &status);
+  if (ok) s->bytes_loaded += f.descriptor.size;
+  upb_Arena_Free(arena);
+  return ok;
+}
+
+bool upb_DefPool_AddImage(upb_DefPool* s, const char* data, size_t size,
+                          upb_Status* status) {
+  if (s->has_image || s->frozen || s->shared_syms) {
+    upb_Status_SetErrorMessage(status, "cannot add an image to this pool");
+    return false;
+  }
+  if (!_upb_DefImage_Init(&s->image, data, size)) {
+    upb_Status_SetErrorMessage(status, "invalid image");
+    return false;
+  }
+  s->has_image = true;
+  return true;
+}
+
 size_t _upb_DefPool_BytesLoaded(const upb_DefPool* s) {
   return s->bytes_loaded;
 }
 
 upb_Arena* _upb_DefPool_Arena(const upb_DefPool* s) { return s->arena; }
 
+const char* _upb_DefPool_InternString(upb_DefPool* s, const char* str,
+                                      size_t size) {
+  const upb_tabent* e = upb_strtable_lookupentry(&s->strings, str, size);
+  if (!e) {
+    if (!upb_strtable_insert(&s->strings, str, size, upb_value_bool(true),
+                             s->arena)) {
+      return NULL;
+    }
+    e = upb_strtable_lookupentry(&s->strings, str, size);
+  }
+  return upb_tabstr(e->key, NULL);
+}
+
+const upb_Message* _upb_DefPool_InternOptions(upb_DefPool* s,
+                                              const upb_Message* opts,
+                                              const upb_MiniTable* m) {
+  const uint32_t hash = upb_Message_Hash(opts, m, (uintptr_t)m);
+  upb_value v;
+  _upb_DefPool_Options* head = NULL;
+  if (upb_inttable_lookup(&s->options, hash, &v)) {
+    head = upb_value_getptr(v);
+    for (const _upb_DefPool_Options* o = head; o; o = o->next) {
+      if (o->m == m && upb_Message_IsEqual(o->opts, opts, m)) return o->opts;
+    }
+  }
+
+  _upb_DefPool_Options* o = upb_Arena_Malloc(s->arena, sizeof(*o));
+  if (!o) return NULL;
+  o->m = m;
+  o->opts = upb_Message_DeepClone(opts, m, s->arena);
+  if (!o->opts) return NULL;
+  o->next = head;
+  if (head) {
+    upb_inttable_replace(&s->options, hash, upb_value_ptr(o));
+  } else if (!upb_inttable_insert(&s->options, hash, upb_value_ptr(o),
+                                  s->arena)) {
+    return NULL;
+  }
+  return o->opts;
+}
+
 const upb_FieldDef* upb_DefPool_FindExtensionByMiniTable(
     const upb_DefPool* s, const upb_MiniTableExtension* ext) {
   upb_value v;
-  bool ok = upb_inttable_lookup(&s->exts, (uintptr_t)ext, &v);
+  bool ok = _upb_DefPool_LookupExt(s, ext, &v);
   UPB_ASSERT(ok);
   return upb_value_getconstptr(v);
 }
@@ -426,6 +1284,18 @@ const upb_FieldDef* upb_DefPool_FindExtensionByNumber(const upb_DefPool* s,
                                                       const upb_MessageDef* m,
                                                       int32_t fieldnum) {
   const upb_MiniTable* t = upb_MessageDef_MiniTable(m);
+  if (s->shared_extnums && !s->frozen) {
+    // The extension registry may be changing under us.
+    char buf[UPB_DEFPOOL_EXTNUM_KEY_SIZE];
+    uint32_t num = fieldnum;
+    upb_value v;
+    memcpy(buf, &t, sizeof(t));
+    memcpy(buf + sizeof(t), &num, sizeof(num));
+    return upb_concurrenttable_lookupstr(s->shared_extnums, buf, sizeof(buf),
+                                         &v)
+               ? upb_value_getconstptr(v)
+               : NULL;
+  }
   const upb_MiniTableExtension* ext =
       upb_ExtensionRegistry_Lookup(s->extreg, t, fieldnum);
   return ext ? upb_DefPool_FindExtensionByMiniTable(s, ext) : NULL;
@@ -436,29 +1306,123 @@ const upb_ExtensionRegistry* upb_DefPool_ExtensionRegistry(
   return s->extreg;
 }
 
+const upb_FieldDef* const* upb_DefPool_GetExtensions(const upb_DefPool* s,
+                                                     const upb_MessageDef* m,
+                                                     size_t* count) {
+  _upb_DefPool_ExtList* l = _upb_DefPool_FindExtList(s, m);
+  if (!l) {
+    *count = 0;
+    return NULL;
+  }
+  *count = upb_Atomic_Load(&l->size, memory_order_acquire);
+  return upb_Atomic_Load(&l->exts, memory_order_acquire);
+}
+
 const upb_FieldDef** upb_DefPool_GetAllExtensions(const upb_DefPool* s,
                                                   const upb_MessageDef* m,
                                                   size_t* count) {
-  size_t n = 0;
-  intptr_t iter = UPB_INTTABLE_BEGIN;
-  uintptr_t key;
-  upb_value val;
-  // This is O(all exts) instead of O(exts for m).  If we need this to be
-  // efficient we may need to make extreg into a two-level table, or have a
-  // second per-message index.
-  while (upb_inttable_next(&s->exts, &key, &val, &iter)) {
-    const upb_FieldDef* f = upb_value_getconstptr(val);
-    if (upb_FieldDef_ContainingType(f) == m) n++;
-  }
-  const upb_FieldDef** exts = malloc(n * sizeof(*exts));
-  iter = UPB_INTTABLE_BEGIN;
-  size_t i = 0;
-  while (upb_inttable_next(&s->exts, &key, &val, &iter)) {
-    const upb_FieldDef* f = upb_value_getconstptr(val);
-    if (upb_FieldDef_ContainingType(f) == m) exts[i++] = f;
+  size_t n;
+  const upb_FieldDef* const* exts = upb_DefPool_GetExtensions(s, m, &n);
+  const upb_FieldDef** ret = malloc(n * sizeof(*ret));
+  if (ret && n) memcpy(ret, exts, n * sizeof(*ret));
+  *count = ret ? n : 0;
+  return ret;
+}
+
+typedef struct {
+  upb_DefPool* s;
+  const _upb_DefPool_Init* init;
+} _upb_DefPool_Registration;
+
+static bool _upb_DefPool_RegisterSym(void* closure, upb_StringView sym) {
+  _upb_DefPool_Registration* r = closure;
+  upb_DefPool* s = r->s;
+  return upb_strtable_lookup2(&s->lazy_syms, sym.data, sym.size, NULL) ||
+         upb_strtable_insert(&s->lazy_syms, sym.data, sym.size,
+                             upb_value_constptr(r->init), s->arena);
+}
+
+bool _upb_DefPool_RegisterDefInit(upb_DefPool* s,
+                                  const _upb_DefPool_Init* init) {
+  const size_t name_len = strlen(init->filename);
+  if (upb_strtable_lookup2(&s->files, init->filename, name_len, NULL)) {
+    return true;
+  }
+  if (!s->lazy) {
+    if (!upb_strtable_init(&s->lazy_syms, 32, s->arena) ||
+        !upb_strtable_init(&s->lazy_files, 4, s->arena)) {
+      return false;
+    }
+    s->lazy = true;
+  }
+  if (upb_strtable_lookup2(&s->lazy_files, init->filename, name_len, NULL)) {
+    return true;
+  }
+
+  // Only the top-level defs of the file are named here; nested ones are
+  // found through their parents.
+  _upb_DefPool_Registration r = {s, init};
+  if (!_upb_DefImage_ScanSymbols(init->descriptor, s->arena,
+                                 _upb_DefPool_RegisterSym, &r)) {
+    return false;
+  }
+
+  if (!upb_strtable_insert(&s->lazy_files, init->filename, name_len,
+                           upb_value_constptr(init), s->arena)) {
+    return false;
   }
-  *count = n;
-  return exts;
+  for (_upb_DefPool_Init** deps = init->deps; deps && *deps; deps++) {
+    if (!_upb_DefPool_RegisterDefInit(s, *deps)) return false;
+  }
+  return true;
+}
+
+bool upb_DefPool_RegisterFile(upb_DefPool* s, const char* data, size_t size,
+                              upb_Status* status) {
+  if (s->frozen || s->shared_syms) {
+    upb_Status_SetErrorMessage(status,
+                               "cannot register files in a frozen or "
+                               "concurrent pool");
+    return false;
+  }
+
+  // Field 1 is FileDescriptorProto.name.
+  const char* ptr = data;
+  const char* end = data + size;
+  uint32_t num;
+  upb_StringView val;
+  upb_StringView name = upb_StringView_FromDataAndSize(NULL, 0);
+  while (ptr < end && _upb_DefImage_ScanField(&ptr, end, &num, &val)) {
+    if (num == 1 && val.data) name = val;
+  }
+  if (!ptr || !name.data) {
+    upb_Status_SetErrorMessage(status, "malformed file descriptor");
+    return false;
+  }
+  if (upb_strtable_lookup2(&s->files, name.data, name.size, NULL) ||
+      (s->lazy &&
+       upb_strtable_lookup2(&s->lazy_files, name.data, name.size, NULL))) {
+    return true;
+  }
+
+  // The registration owns a copy of the descriptor, followed by the file name
+  // with a terminating NUL.
+  _upb_DefPool_Init* init = upb_Arena_Malloc(s->arena, sizeof(*init));
+  char* buf = upb_Arena_Malloc(s->arena, size + name.size + 1);
+  if (!init || !buf) goto oom;
+  memcpy(buf, data, size);
+  memcpy(buf + size, name.data, name.size);
+  buf[size + name.size] = '\0';
+  init->deps = NULL;
+  init->layout = NULL;
+  init->filename = buf + size;
+  init->descriptor = upb_StringView_FromDataAndSize(buf, size);
+  if (!_upb_DefPool_RegisterDefInit(s, init)) goto oom;
+  return true;
+
+oom:
+  upb_Status_SetErrorMessage(status, "out of memory");
+  return false;
 }
 
 bool _upb_DefPool_LoadDefInit(upb_DefPool* s, const _upb_DefPool_Init* init) {
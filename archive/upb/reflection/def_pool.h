@@ -94,13 +94,98 @@ UPB_API const upb_FileDef* upb_DefPool_AddFile(
     upb_DefPool* s, const UPB_DESC(FileDescriptorProto) * file_proto,
     upb_Status* status);
 
+// Like upb_DefPool_AddFile(), but takes a serialized FileDescriptorProto.  The
+// pool keeps a copy of the bytes, which upb_FileDef_SerializedProto() (see
+// upb/util/def_to_proto.h) then returns instead of rebuilding them.
+UPB_API const upb_FileDef* upb_DefPool_AddSerializedFile(upb_DefPool* s,
+                                                         const char* data,
+                                                         size_t size,
+                                                         upb_Status* status);
+
+// Runs |task(arg, i)| for every |i| below |count|, possibly on several threads
+// at once, and returns once all of the calls have returned.
+typedef void upb_DefPool_ParallelForFunc(void* closure, size_t count,
+                                         void (*task)(void* arg, size_t i),
+                                         void* arg);
+
+// Adds |count| files, which may be given in any order as long as each file's
+// dependencies are either among them or already in the pool.  Files whose
+// dependencies have all been added are built together with |parallel_for|,
+// each in a pool of its own that is then merged into |s|; if |parallel_for| is
+// NULL, or the pool is concurrent, the files are built one at a time.  On
+// failure, the files that were added before the error stay in the pool.
+UPB_API bool upb_DefPool_AddFiles(
+    upb_DefPool* s, const UPB_DESC(FileDescriptorProto) * const* files,
+    size_t count, upb_DefPool_ParallelForFunc* parallel_for, void* closure,
+    upb_Status* status);
+
 const upb_ExtensionRegistry* upb_DefPool_ExtensionRegistry(
     const upb_DefPool* s);
 
+// Returns the extensions of |m| in this pool, in the order they were added,
+// and sets |*count| to their number.  The array belongs to the pool and stays
+// valid and unchanged until the pool is freed; extensions added later are
+// only seen by later calls.  Takes the same time however many extensions
+// other messages have.
+UPB_API const upb_FieldDef* const* upb_DefPool_GetExtensions(
+    const upb_DefPool* s, const upb_MessageDef* m, size_t* count);
+
+// Like upb_DefPool_GetExtensions(), but returns a copy that the caller must
+// free().
 const upb_FieldDef** upb_DefPool_GetAllExtensions(const upb_DefPool* s,
                                                   const upb_MessageDef* m,
                                                   size_t* count);
 
+// Rebuilds the symbol, file and extension tables as perfect hash tables, so
+// that each lookup hashes the name once and compares it with a single entry,
+// and freezes the extension registry (see upb_ExtensionRegistry_Freeze()).
+// Once frozen, upb_DefPool_AddFile() fails, so load every file first; the
+// DefPool's accessors work as before.  Returns false, leaving the pool as it
+// was, if memory allocation failed.
+UPB_API bool upb_DefPool_Freeze(upb_DefPool* s);
+
+UPB_API bool upb_DefPool_IsFrozen(const upb_DefPool* s);
+
+// Lets other threads look up defs while files are being added.  In a
+// concurrent pool the upb_DefPool_Find*() and upb_DefPool_Get*Extensions()
+// functions never lock or block, and see the defs of a file once
+// upb_DefPool_AddFile() has finished building all of it: once a file can be
+// found by name, so can everything in it.  Files that fail to build are never
+// seen.
+//
+// Only one thread at a time may add files, and loading generated defs (with
+// the *_getmsgdef() functions) counts as adding files.  The extension
+// registry returned by upb_DefPool_ExtensionRegistry() is still updated in
+// place, so it must not be used while files are being added.
+//
+// The lookup tables grow by copying, and the old copies are kept until the
+// pool is freed.  Call this before sharing the pool with other threads.
+// Requires C11 atomics (see UPB_USE_C11_ATOMICS).  Returns false, leaving the
+// pool as it was, if memory allocation failed.
+UPB_API bool upb_DefPool_MakeConcurrent(upb_DefPool* s);
+
+UPB_API bool upb_DefPool_IsConcurrent(const upb_DefPool* s);
+
+// Adds a def image built by upb_DefImage_Build(), whose files are then built
+// the first time that they or one of their defs are looked up; see
+// upb/reflection/def_image.h.  This only checks the image's header, so adding
+// it is fast whatever its size.  The image is not copied and must outlive the
+// pool.  A pool can have only one image, and once the pool is frozen or made
+// concurrent its unloaded files are no longer loaded.
+UPB_API bool upb_DefPool_AddImage(upb_DefPool* s, const char* data,
+                                  size_t size, upb_Status* status);
+
+// Registers a serialized FileDescriptorProto to be built the first time that
+// the file or one of its defs is looked up by name, after the files it
+// imports, which are looked up by name then and so may be registered too.
+// Until then only the names of the file and its top-level defs are read.  The
+// descriptor is copied.  Lookups by extension number or mini table only find
+// the extensions of built files, and a file that fails to build is treated as
+// missing.  Registering a file that was already added or registered does
+// nothing.  Frozen and concurrent pools do not accept registrations.
+UPB_API bool upb_DefPool_RegisterFile(upb_DefPool* s, const char* data,
+                                      size_t size, upb_Status* status);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -222,8 +222,7 @@ static upb_StringView* _upb_EnumReservedNames_New(
     upb_DefBuilder* ctx, int n, const upb_StringView* protos) {
   upb_StringView* sv = _upb_DefBuilder_Alloc(ctx, sizeof(upb_StringView) * n);
   for (int i = 0; i < n; i++) {
-    sv[i].data =
-        upb_strdup2(protos[i].data, protos[i].size, _upb_DefBuilder_Arena(ctx));
+    sv[i].data = _upb_DefBuilder_InternString(ctx, protos[i]);
     sv[i].size = protos[i].size;
   }
   return sv;
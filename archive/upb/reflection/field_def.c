@@ -564,14 +564,22 @@ static void _upb_FieldDef_Create(upb_DefBuilder* ctx, const char* prefix,
   f->scope.oneof = NULL;
 
   f->has_json_name = UPB_DESC(FieldDescriptorProto_has_json_name)(field_proto);
+  upb_StringView json_name;
   if (f->has_json_name) {
-    const upb_StringView sv =
-        UPB_DESC(FieldDescriptorProto_json_name)(field_proto);
-    f->json_name = upb_strdup2(sv.data, sv.size, ctx->arena);
+    json_name = UPB_DESC(FieldDescriptorProto_json_name)(field_proto);
   } else {
-    f->json_name = make_json_name(name.data, name.size, ctx->arena);
+    char* buf = make_json_name(name.data, name.size, ctx->tmp_arena);
+    if (!buf) _upb_DefBuilder_OomErr(ctx);
+    json_name = upb_StringView_FromString(buf);
+  }
+  // The JSON name is often the short name, which the full name ends with.
+  const char* short_name = _upb_DefBuilder_FullToShort(f->full_name);
+  if (upb_StringView_IsEqual(
+          json_name, upb_StringView_FromDataAndSize(short_name, name.size))) {
+    f->json_name = short_name;
+  } else {
+    f->json_name = _upb_DefBuilder_InternString(ctx, json_name);
   }
-  if (!f->json_name) _upb_DefBuilder_OomErr(ctx);
 
   const bool has_type = UPB_DESC(FieldDescriptorProto_has_type)(field_proto);
   const bool has_type_name =
@@ -30,6 +30,7 @@
 
 #include "upb/reflection/internal/file_def.h"
 
+#include "upb/port/atomic.h"
 #include "upb/reflection/def_pool.h"
 #include "upb/reflection/internal/def_builder.h"
 #include "upb/reflection/internal/enum_def.h"
@@ -55,6 +56,8 @@ struct upb_FileDef {
   const upb_ServiceDef* services;
   const upb_MiniTableExtension** ext_layouts;
   const upb_DefPool* symtab;
+  // The serialized FileDescriptorProto, or NULL until it is known.
+  UPB_ATOMIC(const upb_StringView*) serialized;
 
   int dep_count;
   int public_dep_count;
@@ -158,6 +161,27 @@ const upb_ServiceDef* upb_FileDef_Service(const upb_FileDef* f, int i) {
 
 const upb_DefPool* upb_FileDef_Pool(const upb_FileDef* f) { return f->symtab; }
 
+void _upb_FileDef_SetPool(upb_FileDef* f, const upb_DefPool* s) {
+  f->symtab = s;
+}
+
+const upb_StringView* _upb_FileDef_SerializedProto(const upb_FileDef* f) {
+  upb_FileDef* mut = (upb_FileDef*)f;
+  return upb_Atomic_Load(&mut->serialized, memory_order_acquire);
+}
+
+const upb_StringView* _upb_FileDef_SetSerializedProto(
+    const upb_FileDef* f, const upb_StringView* serialized) {
+  upb_FileDef* mut = (upb_FileDef*)f;
+  const upb_StringView* expected = NULL;
+  if (upb_Atomic_CompareExchangeStrong(&mut->serialized, &expected,
+                                       serialized, memory_order_acq_rel,
+                                       memory_order_acquire)) {
+    return serialized;
+  }
+  return expected;
+}
+
 const upb_MiniTableExtension* _upb_FileDef_ExtensionMiniTable(
     const upb_FileDef* f, int i) {
   return f->ext_layouts[i];
@@ -203,6 +227,12 @@ void _upb_FileDef_Create(upb_DefBuilder* ctx,
   size_t n;
 
   file->symtab = ctx->symtab;
+  upb_StringView* serialized = NULL;
+  if (ctx->serialized.data) {
+    serialized = _upb_DefBuilder_Alloc(ctx, sizeof(*serialized));
+    *serialized = ctx->serialized;
+  }
+  upb_Atomic_Init(&file->serialized, serialized);
 
   // Count all extensions in the file, to build a flat array of layouts.
   UPB_DESC(FileDescriptorProto_extension)(file_proto, &n);
@@ -365,6 +395,8 @@ void _upb_FileDef_Create(upb_DefBuilder* ctx,
     upb_MessageDef* m = (upb_MessageDef*)upb_FileDef_TopLevelMessage(file, i);
     _upb_MessageDef_LinkMiniTable(ctx, m);
   }
+  _upb_MessageDefs_FlagRequired(ctx, file->top_lvl_msgs,
+                                file->top_lvl_msg_count);
 
   if (file->ext_count) {
     bool ok = upb_ExtensionRegistry_AddArray(
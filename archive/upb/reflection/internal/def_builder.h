@@ -31,6 +31,8 @@
 #ifndef UPB_REFLECTION_DEF_BUILDER_INTERNAL_H_
 #define UPB_REFLECTION_DEF_BUILDER_INTERNAL_H_
 
+#include "upb/message/types.h"
+#include "upb/mini_table/message.h"
 #include "upb/reflection/common.h"
 #include "upb/reflection/def_type.h"
 #include "upb/reflection/internal/def_pool.h"
@@ -38,19 +40,26 @@
 // Must be last.
 #include "upb/port/def.inc"
 
+// The stage0 bootstrap descriptors build their MiniTables lazily, so there
+// the *_msg_init symbols are functions rather than MiniTable objects.
+#ifdef UPB_BOOTSTRAP_STAGE0
+#define UPB_DEF_OPTIONS_MSG_INIT(options_type) \
+  UPB_DESC(options_type##_msg_init)()
+#else
+#define UPB_DEF_OPTIONS_MSG_INIT(options_type) \
+  &UPB_DESC(options_type##_msg_init)
+#endif
+
 // We want to copy the options verbatim into the destination options proto.
-// We use serialize+parse as our deep copy.
-#define UPB_DEF_SET_OPTIONS(target, desc_type, options_type, proto)           \
-  if (UPB_DESC(desc_type##_has_options)(proto)) {                             \
-    size_t size;                                                              \
-    char* pb = UPB_DESC(options_type##_serialize)(                            \
-        UPB_DESC(desc_type##_options)(proto), ctx->tmp_arena, &size);         \
-    if (!pb) _upb_DefBuilder_OomErr(ctx);                                     \
-    target =                                                                  \
-        UPB_DESC(options_type##_parse)(pb, size, _upb_DefBuilder_Arena(ctx)); \
-    if (!target) _upb_DefBuilder_OomErr(ctx);                                 \
-  } else {                                                                    \
-    target = (const UPB_DESC(options_type)*)kUpbDefOptDefault;                \
+// The options are already parsed, so a deep clone is enough; unknown fields,
+// like custom options, are copied as they are.
+#define UPB_DEF_SET_OPTIONS(target, desc_type, options_type, proto)      \
+  if (UPB_DESC(desc_type##_has_options)(proto)) {                        \
+    target = (const UPB_DESC(options_type)*)_upb_DefBuilder_CopyOptions( \
+        ctx, UPB_DESC(desc_type##_options)(proto),                       \
+        UPB_DEF_OPTIONS_MSG_INIT(options_type));                         \
+  } else {                                                               \
+    target = (const UPB_DESC(options_type)*)kUpbDefOptDefault;           \
   }
 
 #ifdef __cplusplus
@@ -68,6 +77,7 @@ struct upb_DefBuilder {
   int enum_count;                    // Count of enums built so far.
   int msg_count;                     // Count of messages built so far.
   int ext_count;                     // Count of extensions built so far.
+  upb_StringView serialized;         // Outlives the pool; empty if unknown.
   jmp_buf err;                       // longjmp() on error.
 };
 
@@ -80,6 +90,17 @@ UPB_NORETURN void _upb_DefBuilder_Errf(upb_DefBuilder* ctx, const char* fmt,
                                        ...) UPB_PRINTF(2, 3);
 UPB_NORETURN void _upb_DefBuilder_OomErr(upb_DefBuilder* ctx);
 
+// Returns a deep copy of |opts|, which is shared with every other def in the
+// pool that has equal options.
+const upb_Message* _upb_DefBuilder_CopyOptions(upb_DefBuilder* ctx,
+                                               const upb_Message* opts,
+                                               const upb_MiniTable* m);
+
+// Returns a NUL-terminated copy of |str| that is shared with the rest of the
+// pool, for strings such as JSON names that many defs have in common.
+const char* _upb_DefBuilder_InternString(upb_DefBuilder* ctx,
+                                         upb_StringView str);
+
 const char* _upb_DefBuilder_MakeFullName(upb_DefBuilder* ctx,
                                          const char* prefix,
                                          upb_StringView name);
@@ -0,0 +1,93 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_REFLECTION_DEF_IMAGE_INTERNAL_H_
+#define UPB_REFLECTION_DEF_IMAGE_INTERNAL_H_
+
+#include "upb/reflection/def_image.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reads the field at |*ptr| of a serialized proto, setting |*val| to its data
+// if it is length-delimited and to NULL otherwise.  Returns false at the end
+// of the data or if it is malformed, in which case |*ptr| is set to NULL.
+bool _upb_DefImage_ScanField(const char** ptr, const char* end, uint32_t* num,
+                             upb_StringView* val);
+
+// Calls |func| with the full name of every top-level def in a serialized
+// FileDescriptorProto: messages, enums, enum values, services, and
+// extensions.  The names are allocated from |a|.  Returns false if the file is
+// malformed or |func| returned false.
+typedef bool _upb_DefImage_SymbolFunc(void* closure, upb_StringView sym);
+bool _upb_DefImage_ScanSymbols(upb_StringView file, upb_Arena* a,
+                               _upb_DefImage_SymbolFunc* func, void* closure);
+
+// A def image that passed the checks of _upb_DefImage_Init().  Every access
+// checks the offsets that it reads, so a corrupt image is never read out of
+// bounds.
+typedef struct {
+  const char* data;
+  size_t size;
+  uint32_t file_count;
+  uint32_t sym_count;
+} _upb_DefImage;
+
+typedef struct {
+  upb_StringView name;
+  upb_StringView descriptor;
+  const char* deps;  // `dep_count` file indexes.
+  uint32_t dep_count;
+} _upb_DefImage_File;
+
+bool _upb_DefImage_Init(_upb_DefImage* img, const char* data, size_t size);
+
+// Returns the index of the file with the given name, or of the file that
+// defines the given top-level symbol, or -1 if there is none.
+int32_t _upb_DefImage_FindFile(const _upb_DefImage* img, const char* name,
+                               size_t size);
+int32_t _upb_DefImage_FindSymbol(const _upb_DefImage* img, const char* sym,
+                                 size_t size);
+
+bool _upb_DefImage_GetFile(const _upb_DefImage* img, uint32_t i,
+                           _upb_DefImage_File* file);
+uint32_t _upb_DefImage_FileDep(const _upb_DefImage_File* file, uint32_t i);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_REFLECTION_DEF_IMAGE_INTERNAL_H_ */
@@ -45,6 +45,18 @@ upb_Arena* _upb_DefPool_Arena(const upb_DefPool* s);
 size_t _upb_DefPool_BytesLoaded(const upb_DefPool* s);
 upb_ExtensionRegistry* _upb_DefPool_ExtReg(const upb_DefPool* s);
 
+// Returns the pool's NUL-terminated copy of |str|, made on first use, or NULL
+// if memory allocation failed.
+const char* _upb_DefPool_InternString(upb_DefPool* s, const char* str,
+                                      size_t size);
+
+// Returns the pool's copy of an options message equal to |opts|, of type |m|,
+// made on first use, or NULL if memory allocation failed.  The copies are
+// never modified, so defs with equal options share one.
+const upb_Message* _upb_DefPool_InternOptions(upb_DefPool* s,
+                                              const upb_Message* opts,
+                                              const upb_MiniTable* m);
+
 bool _upb_DefPool_InsertExt(upb_DefPool* s, const upb_MiniTableExtension* ext,
                             const upb_FieldDef* f);
 bool _upb_DefPool_InsertSym(upb_DefPool* s, upb_StringView sym, upb_value v,
@@ -56,6 +68,20 @@ void** _upb_DefPool_ScratchData(const upb_DefPool* s);
 size_t* _upb_DefPool_ScratchSize(const upb_DefPool* s);
 void _upb_DefPool_SetPlatform(upb_DefPool* s, upb_MiniTablePlatform platform);
 
+// Returns the layout hint for a field whose mini table is being built.
+typedef upb_FieldHotness _upb_DefPool_FieldHotnessFunc(const upb_FieldDef* f,
+                                                       void* closure);
+
+// Makes the pool lay out the mini tables it builds according to `func`, see
+// upb_MiniTable_BuildWithHotness().  Like the platform, this must be set
+// before any files are added.  Tables loaded from generated code keep their
+// layout.
+void _upb_DefPool_SetFieldHotness(upb_DefPool* s,
+                                  _upb_DefPool_FieldHotnessFunc* func,
+                                  void* closure);
+_upb_DefPool_FieldHotnessFunc* _upb_DefPool_FieldHotness(const upb_DefPool* s,
+                                                         void** closure);
+
 // For generated code only: loads a generated descriptor.
 typedef struct _upb_DefPool_Init {
   struct _upb_DefPool_Init** deps;  // Dependencies of this file.
@@ -66,6 +92,21 @@ typedef struct _upb_DefPool_Init {
 
 bool _upb_DefPool_LoadDefInit(upb_DefPool* s, const _upb_DefPool_Init* init);
 
+// Registers a generated file, and the files it depends on, to be loaded the
+// first time that the file or one of its defs is looked up by name with
+// upb_DefPool_Find*(), instead of when its generated *_getmsgdef() functions
+// are first called.  Until then only the names of its top-level defs are
+// read, from the serialized descriptor.  Lookups by extension number or mini
+// table only find the extensions of loaded files, and frozen and concurrent
+// pools do not load registered files.  Returns false if memory allocation
+// failed or the descriptor is malformed.
+bool _upb_DefPool_RegisterDefInit(upb_DefPool* s,
+                                  const _upb_DefPool_Init* init);
+
+// Whether lookups in `s` may still build registered or image files, which
+// adds them to the pool and its extension registry.
+bool _upb_DefPool_LoadsLazily(const upb_DefPool* s);
+
 // Should only be directly called by tests. This variant lets us suppress
 // the use of compiled-in tables, forcing a rebuild of the tables at runtime.
 bool _upb_DefPool_LoadDefInitEx(upb_DefPool* s, const _upb_DefPool_Init* init,
@@ -51,6 +51,18 @@ const char* _upb_FileDef_RawPackage(const upb_FileDef* f);
 void _upb_FileDef_Create(upb_DefBuilder* ctx,
                          const UPB_DESC(FileDescriptorProto) * file_proto);
 
+// Moves a file, with all its defs, to the pool |s|.
+void _upb_FileDef_SetPool(upb_FileDef* f, const upb_DefPool* s);
+
+// The serialized FileDescriptorProto of |f|, which lives as long as its pool,
+// or NULL if it is not known yet.
+const upb_StringView* _upb_FileDef_SerializedProto(const upb_FileDef* f);
+
+// Sets the serialized FileDescriptorProto of |f| unless another thread set it
+// first, and returns the one that was kept.
+const upb_StringView* _upb_FileDef_SetSerializedProto(
+    const upb_FileDef* f, const upb_StringView* serialized);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -31,6 +31,7 @@
 #ifndef UPB_REFLECTION_MESSAGE_DEF_INTERNAL_H_
 #define UPB_REFLECTION_MESSAGE_DEF_INTERNAL_H_
 
+#include "upb/message/presence_index.h"
 #include "upb/reflection/message_def.h"
 
 // Must be last.
@@ -50,8 +51,19 @@ bool _upb_MessageDef_IsValidExtensionNumber(const upb_MessageDef* m, int n);
 void _upb_MessageDef_CreateMiniTable(upb_DefBuilder* ctx, upb_MessageDef* m);
 void _upb_MessageDef_LinkMiniTable(upb_DefBuilder* ctx,
                                    const upb_MessageDef* m);
+// Sets kUpb_MiniTableFlag_NoReachableRequired on the linked MiniTables of
+// `msgs` and their nested messages, unless they were generated.
+void _upb_MessageDefs_FlagRequired(upb_DefBuilder* ctx,
+                                   const upb_MessageDef* msgs, int n);
 void _upb_MessageDef_Resolve(upb_DefBuilder* ctx, upb_MessageDef* m);
 
+// The presence index of the MiniTable of `m`, and the field at position `i`
+// of its fields.  Both are available once the MiniTable has been created.
+const upb_PresenceIndex* _upb_MessageDef_PresenceIndex(
+    const upb_MessageDef* m);
+const upb_FieldDef* _upb_MessageDef_LayoutField(const upb_MessageDef* m,
+                                                int i);
+
 // Allocate and initialize an array of |n| message defs.
 upb_MessageDef* _upb_MessageDefs_New(
     upb_DefBuilder* ctx, int n, const UPB_DESC(DescriptorProto) * const* protos,
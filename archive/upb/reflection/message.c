@@ -35,12 +35,16 @@
 #include "upb/collections/map.h"
 #include "upb/hash/common.h"
 #include "upb/message/accessors.h"
+#include "upb/message/internal/presence_index.h"
 #include "upb/message/message.h"
+#include "upb/message/presence_index.h"
 #include "upb/mini_table/field.h"
+#include "upb/mini_table/internal/message.h"
 #include "upb/reflection/def.h"
 #include "upb/reflection/def_pool.h"
 #include "upb/reflection/def_type.h"
 #include "upb/reflection/internal/field_def.h"
+#include "upb/reflection/internal/message_def.h"
 #include "upb/reflection/message_def.h"
 #include "upb/reflection/oneof_def.h"
 
@@ -127,6 +131,52 @@ void upb_Message_ClearByDef(upb_Message* msg, const upb_MessageDef* m) {
   upb_Message_Clear(msg, upb_MessageDef_MiniTable(m));
 }
 
+// Returns the extension at position `*iter` of an iteration over `msg` whose
+// regular fields take the positions before `n`.
+static bool _upb_Message_NextExtension(const upb_Message* msg,
+                                       const upb_DefPool* ext_pool, size_t n,
+                                       const upb_FieldDef** out_f,
+                                       upb_MessageValue* out_val,
+                                       size_t* iter) {
+  if (!ext_pool) return false;
+  size_t i = *iter;
+  size_t count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &count);
+  if (i - n >= count) return false;
+  ext += count - 1 - (i - n);
+  memcpy(out_val, &ext->data, sizeof(*out_val));
+  *out_f = upb_DefPool_FindExtensionByMiniTable(ext_pool, ext->ext);
+  return true;
+}
+
+// Returns true if `f` is set in `msg`, storing its value in `*out_val`.
+// Fields without presence are set when they are nonzero or non-empty.
+static bool _upb_Message_IsFieldSet(const upb_Message* msg,
+                                    const upb_FieldDef* f,
+                                    upb_MessageValue* out_val) {
+  const upb_MiniTableField* field = upb_FieldDef_MiniTable(f);
+  upb_MessageValue val = upb_Message_GetFieldByDef(msg, f);
+
+  if (upb_MiniTableField_HasPresence(field)) {
+    if (!upb_Message_HasFieldByDef(msg, f)) return false;
+  } else {
+    switch (upb_FieldMode_Get(field)) {
+      case kUpb_FieldMode_Map:
+        if (!val.map_val || upb_Map_Size(val.map_val) == 0) return false;
+        break;
+      case kUpb_FieldMode_Array:
+        if (!val.array_val || upb_Array_Size(val.array_val) == 0) return false;
+        break;
+      case kUpb_FieldMode_Scalar:
+        if (!_upb_MiniTable_ValueIsNonZero(&val, field)) return false;
+        break;
+    }
+  }
+
+  *out_val = val;
+  return true;
+}
+
 bool upb_Message_Next(const upb_Message* msg, const upb_MessageDef* m,
                       const upb_DefPool* ext_pool, const upb_FieldDef** out_f,
                       upb_MessageValue* out_val, size_t* iter) {
@@ -137,47 +187,61 @@ bool upb_Message_Next(const upb_Message* msg, const upb_MessageDef* m,
   // Iterate over normal fields, returning the first one that is set.
   while (++i < n) {
     const upb_FieldDef* f = upb_MessageDef_Field(m, i);
-    const upb_MiniTableField* field = upb_FieldDef_MiniTable(f);
-    upb_MessageValue val = upb_Message_GetFieldByDef(msg, f);
+    if (!_upb_Message_IsFieldSet(msg, f, out_val)) continue;
+    *out_f = f;
+    *iter = i;
+    return true;
+  }
 
-    // Skip field if unset or empty.
-    if (upb_MiniTableField_HasPresence(field)) {
-      if (!upb_Message_HasFieldByDef(msg, f)) continue;
-    } else {
-      switch (upb_FieldMode_Get(field)) {
-        case kUpb_FieldMode_Map:
-          if (!val.map_val || upb_Map_Size(val.map_val) == 0) continue;
-          break;
-        case kUpb_FieldMode_Array:
-          if (!val.array_val || upb_Array_Size(val.array_val) == 0) continue;
-          break;
-        case kUpb_FieldMode_Scalar:
-          if (!_upb_MiniTable_ValueIsNonZero(&val, field)) continue;
-          break;
-      }
-    }
+  *iter = i;
+  return _upb_Message_NextExtension(msg, ext_pool, n, out_f, out_val, iter);
+}
 
-    *out_val = val;
+bool upb_Message_NextByNumber(const upb_Message* msg, const upb_MessageDef* m,
+                              const upb_FieldDef** out_f,
+                              upb_MessageValue* out_val, size_t* iter) {
+  size_t i = *iter;
+  size_t n = upb_MessageDef_FieldCount(m);
+
+  // The MiniTable keeps its fields sorted by number, so its layout order is
+  // the field number order.
+  while (++i < n) {
+    const upb_FieldDef* f = _upb_MessageDef_LayoutField(m, i);
+    if (!_upb_Message_IsFieldSet(msg, f, out_val)) continue;
     *out_f = f;
     *iter = i;
     return true;
   }
 
-  if (ext_pool) {
-    // Return any extensions that are set.
-    size_t count;
-    const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &count);
-    if (i - n < count) {
-      ext += count - 1 - (i - n);
-      memcpy(out_val, &ext->data, sizeof(*out_val));
-      *out_f = upb_DefPool_FindExtensionByMiniTable(ext_pool, ext->ext);
+  *iter = i;
+  return false;
+}
+
+bool upb_Message_NextPresent(const upb_Message* msg, const upb_MessageDef* m,
+                             const upb_DefPool* ext_pool,
+                             const upb_FieldDef** out_f,
+                             upb_MessageValue* out_val, size_t* iter) {
+  const upb_PresenceIndex* index = _upb_MessageDef_PresenceIndex(m);
+  const upb_MiniTable* mt = upb_MessageDef_MiniTable(m);
+  size_t i = *iter;
+  size_t n = _upb_PresenceIndex_End(index);
+
+  if (i + 1 < n) {
+    const upb_MiniTableField* field;
+    if (upb_Message_NextPresentField(msg, index, &field, &i)) {
+      const upb_FieldDef* f =
+          _upb_MessageDef_LayoutField(m, field - mt->fields);
+      *out_val = upb_Message_GetFieldByDef(msg, f);
+      *out_f = f;
       *iter = i;
       return true;
     }
+  } else {
+    i++;
   }
 
   *iter = i;
-  return false;
+  return _upb_Message_NextExtension(msg, ext_pool, n, out_f, out_val, iter);
 }
 
 bool _upb_Message_DiscardUnknown(upb_Message* msg, const upb_MessageDef* m,
@@ -191,7 +255,7 @@ bool _upb_Message_DiscardUnknown(upb_Message* msg, const upb_MessageDef* m,
 
   _upb_Message_DiscardUnknown_shallow(msg);
 
-  while (upb_Message_Next(msg, m, NULL /*ext_pool*/, &f, &val, &iter)) {
+  while (upb_Message_NextPresent(msg, m, NULL /*ext_pool*/, &f, &val, &iter)) {
     const upb_MessageDef* subm = upb_FieldDef_MessageSubDef(f);
     if (!subm) continue;
     if (upb_FieldDef_IsMap(f)) {
@@ -94,6 +94,23 @@ bool upb_Message_Next(const upb_Message* msg, const upb_MessageDef* m,
                       const upb_DefPool* ext_pool, const upb_FieldDef** f,
                       upb_MessageValue* val, size_t* iter);
 
+// Like upb_Message_Next(), but returns the regular fields of `m` in field
+// number order.  Extensions are not returned; callers that need them in order
+// must merge them in separately.
+bool upb_Message_NextByNumber(const upb_Message* msg, const upb_MessageDef* m,
+                              const upb_FieldDef** f, upb_MessageValue* val,
+                              size_t* iter);
+
+// Like upb_Message_Next(), but finds the set fields by scanning hasbits
+// instead of visiting every field of `m` (see upb/message/presence_index.h),
+// so the cost depends on the number of set fields rather than declared ones.
+// Fields are returned in no particular order, followed by extensions.  Prefer
+// this when the order does not matter.
+bool upb_Message_NextPresent(const upb_Message* msg, const upb_MessageDef* m,
+                             const upb_DefPool* ext_pool,
+                             const upb_FieldDef** f, upb_MessageValue* val,
+                             size_t* iter);
+
 // Clears all unknown field data from this message and all submessages.
 UPB_API bool upb_Message_DiscardUnknown(upb_Message* msg,
                                         const upb_MessageDef* m, int maxdepth);
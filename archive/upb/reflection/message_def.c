@@ -30,6 +30,7 @@
 
 #include "upb/reflection/internal/message_def.h"
 
+#include "upb/hash/frozen_table.h"
 #include "upb/hash/int_table.h"
 #include "upb/hash/str_table.h"
 #include "upb/mini_descriptor/decode.h"
@@ -55,9 +56,12 @@ struct upb_MessageDef {
   const upb_MessageDef* containing_type;
   const char* full_name;
 
-  // Tables for looking up fields by number and name.
+  // Tables for looking up fields by number and name.  Once the message is
+  // built, names are looked up in the perfect hash copy of `ntof`, unless it
+  // could not be built.
   upb_inttable itof;
   upb_strtable ntof;
+  upb_frozentable frozen_ntof;
 
   /* All nested defs.
    * MEM: We could save some space here by putting nested defs in a contiguous
@@ -71,6 +75,11 @@ struct upb_MessageDef {
   const upb_EnumDef* nested_enums;
   const upb_FieldDef* nested_exts;
 
+  // For upb_Message_NextPresent(): the fields in `layout` order, and an index
+  // that finds the ones set in a message.
+  const upb_FieldDef** layout_fields;
+  const upb_PresenceIndex* presence_index;
+
   // TODO(salo): These counters don't need anywhere near 32 bits.
   int field_count;
   int real_oneof_count;
@@ -83,10 +92,8 @@ struct upb_MessageDef {
   int nested_ext_count;
   bool in_message_set;
   bool is_sorted;
+  bool has_frozen_ntof;
   upb_WellKnown well_known_type;
-#if UINTPTR_MAX == 0xffffffff
-  uint32_t padding;  // Increase size to a multiple of 8.
-#endif
 };
 
 static void assign_msg_wellknowntype(upb_MessageDef* m) {
@@ -182,11 +189,22 @@ const upb_FieldDef* upb_MessageDef_FindFieldByNumber(const upb_MessageDef* m,
                                                 : NULL;
 }
 
+// Messages with at least this many names look them up with a perfect hash.
+enum { kUpb_MessageDef_MinFrozenNames = 16 };
+
+static bool _upb_MessageDef_LookupName(const upb_MessageDef* m,
+                                       const char* name, size_t size,
+                                       upb_value* v) {
+  return m->has_frozen_ntof
+             ? upb_frozentable_lookupstr(&m->frozen_ntof, name, size, v)
+             : upb_strtable_lookup2(&m->ntof, name, size, v);
+}
+
 const upb_FieldDef* upb_MessageDef_FindFieldByNameWithSize(
     const upb_MessageDef* m, const char* name, size_t size) {
   upb_value val;
 
-  if (!upb_strtable_lookup2(&m->ntof, name, size, &val)) {
+  if (!_upb_MessageDef_LookupName(m, name, size, &val)) {
     return NULL;
   }
 
@@ -197,7 +215,7 @@ const upb_OneofDef* upb_MessageDef_FindOneofByNameWithSize(
     const upb_MessageDef* m, const char* name, size_t size) {
   upb_value val;
 
-  if (!upb_strtable_lookup2(&m->ntof, name, size, &val)) {
+  if (!_upb_MessageDef_LookupName(m, name, size, &val)) {
     return NULL;
   }
 
@@ -215,7 +233,7 @@ bool upb_MessageDef_FindByNameWithSize(const upb_MessageDef* m,
                                        const upb_OneofDef** out_o) {
   upb_value val;
 
-  if (!upb_strtable_lookup2(&m->ntof, name, len, &val)) {
+  if (!_upb_MessageDef_LookupName(m, name, len, &val)) {
     return false;
   }
 
@@ -231,7 +249,7 @@ const upb_FieldDef* upb_MessageDef_FindByJsonNameWithSize(
   upb_value val;
   const upb_FieldDef* f;
 
-  if (!upb_strtable_lookup2(&m->ntof, name, size, &val)) {
+  if (!_upb_MessageDef_LookupName(m, name, size, &val)) {
     return NULL;
   }
 
@@ -281,6 +299,17 @@ const upb_MiniTable* upb_MessageDef_MiniTable(const upb_MessageDef* m) {
   return m->layout;
 }
 
+const upb_PresenceIndex* _upb_MessageDef_PresenceIndex(
+    const upb_MessageDef* m) {
+  return m->presence_index;
+}
+
+const upb_FieldDef* _upb_MessageDef_LayoutField(const upb_MessageDef* m,
+                                                int i) {
+  UPB_ASSERT(0 <= i && i < m->field_count);
+  return m->layout_fields[i];
+}
+
 const upb_ExtensionRange* upb_MessageDef_ExtensionRange(const upb_MessageDef* m,
                                                         int i) {
   UPB_ASSERT(0 <= i && i < m->ext_range_count);
@@ -359,11 +388,26 @@ static upb_MiniTable* _upb_MessageDef_MakeMiniTable(upb_DefBuilder* ctx,
   bool ok = upb_MessageDef_MiniDescriptorEncode(m, ctx->tmp_arena, &desc);
   if (!ok) _upb_DefBuilder_OomErr(ctx);
 
+  // Fields appear in the mini descriptor in layout_index order.
+  void* closure;
+  _upb_DefPool_FieldHotnessFunc* hotness_func =
+      _upb_DefPool_FieldHotness(ctx->symtab, &closure);
+  uint8_t* hotness = NULL;
+  if (hotness_func && m->field_count) {
+    hotness = upb_Arena_Malloc(ctx->tmp_arena, m->field_count);
+    if (!hotness) _upb_DefBuilder_OomErr(ctx);
+    for (int i = 0; i < m->field_count; i++) {
+      const upb_FieldDef* f = upb_MessageDef_Field(m, i);
+      hotness[_upb_FieldDef_LayoutIndex(f)] = hotness_func(f, closure);
+    }
+  }
+
   void** scratch_data = _upb_DefPool_ScratchData(ctx->symtab);
   size_t* scratch_size = _upb_DefPool_ScratchSize(ctx->symtab);
-  upb_MiniTable* ret = upb_MiniTable_BuildWithBuf(
-      desc.data, desc.size, ctx->platform, ctx->arena, scratch_data,
-      scratch_size, ctx->status);
+  upb_MiniTable* ret = upb_MiniTable_BuildWithHotness(
+      desc.data, desc.size, ctx->platform, hotness,
+      hotness ? m->field_count : 0, ctx->arena, scratch_data, scratch_size,
+      ctx->status);
   if (!ret) _upb_DefBuilder_FailJmp(ctx);
 
   return ret;
@@ -450,6 +494,16 @@ void _upb_MessageDef_CreateMiniTable(upb_DefBuilder* ctx, upb_MessageDef* m) {
     _upb_FieldDefs_Sorted(m->fields, m->field_count, ctx->tmp_arena);
   }
 
+  const upb_FieldDef** layout_fields =
+      _upb_DefBuilder_Alloc(ctx, sizeof(*layout_fields) * m->field_count);
+  for (int i = 0; i < m->field_count; i++) {
+    const upb_FieldDef* f = upb_MessageDef_Field(m, i);
+    layout_fields[_upb_FieldDef_LayoutIndex(f)] = f;
+  }
+  m->layout_fields = layout_fields;
+  m->presence_index = upb_PresenceIndex_New(m->layout, ctx->arena);
+  if (!m->presence_index) _upb_DefBuilder_OomErr(ctx);
+
   for (int i = 0; i < m->nested_msg_count; i++) {
     upb_MessageDef* nested =
         (upb_MessageDef*)upb_MessageDef_NestedMessage(m, i);
@@ -511,6 +565,57 @@ void _upb_MessageDef_LinkMiniTable(upb_DefBuilder* ctx,
 #endif
 }
 
+static void _upb_MessageDef_InitRequiredFlag(const upb_MessageDef* m) {
+  upb_MiniTable* mt = (upb_MiniTable*)m->layout;
+  if (!mt->required_count && mt->ext == kUpb_ExtMode_NonExtendable) {
+    mt->flags |= kUpb_MiniTableFlag_NoReachableRequired;
+  }
+  for (int i = 0; i < m->nested_msg_count; i++) {
+    _upb_MessageDef_InitRequiredFlag(upb_MessageDef_NestedMessage(m, i));
+  }
+}
+
+// Clears the flag of `m` and its nested messages wherever a sub-message lacks
+// it, returning true if anything changed.
+static bool _upb_MessageDef_ClearRequiredFlag(const upb_MessageDef* m) {
+  upb_MiniTable* mt = (upb_MiniTable*)m->layout;
+  bool changed = false;
+  if (mt->flags & kUpb_MiniTableFlag_NoReachableRequired) {
+    for (int i = 0; i < mt->field_count; i++) {
+      const upb_MiniTableField* f = &mt->fields[i];
+      if (upb_MiniTableField_CType(f) != kUpb_CType_Message) continue;
+      const upb_MiniTable* sub = upb_MiniTable_GetSubMessageTable(mt, f);
+      if (!sub || !(sub->flags & kUpb_MiniTableFlag_NoReachableRequired)) {
+        mt->flags &= ~kUpb_MiniTableFlag_NoReachableRequired;
+        changed = true;
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < m->nested_msg_count; i++) {
+    changed |= _upb_MessageDef_ClearRequiredFlag(
+        upb_MessageDef_NestedMessage(m, i));
+  }
+  return changed;
+}
+
+void _upb_MessageDefs_FlagRequired(upb_DefBuilder* ctx,
+                                   const upb_MessageDef* msgs, int n) {
+  if (ctx->layout) return;
+
+  // Start from every message without required fields of its own and clear
+  // the flag until it holds for all sub-messages, so that a cycle of messages
+  // without required fields keeps it.
+  for (int i = 0; i < n; i++) _upb_MessageDef_InitRequiredFlag(&msgs[i]);
+  bool changed;
+  do {
+    changed = false;
+    for (int i = 0; i < n; i++) {
+      changed |= _upb_MessageDef_ClearRequiredFlag(&msgs[i]);
+    }
+  } while (changed);
+}
+
 static uint64_t _upb_MessageDef_Modifiers(const upb_MessageDef* m) {
   uint64_t out = 0;
   if (upb_FileDef_Syntax(m->file) == kUpb_Syntax_Proto3) {
@@ -540,42 +645,68 @@ static bool _upb_MessageDef_EncodeMap(upb_DescState* s, const upb_MessageDef* m,
   return true;
 }
 
-static bool _upb_MessageDef_EncodeMessage(upb_DescState* s,
-                                          const upb_MessageDef* m,
-                                          upb_Arena* a) {
+// Encodes a message with the batched encoder, which writes the whole mini
+// descriptor at once into a buffer of the exact size.
+static bool _upb_MessageDef_EncodeMessage(const upb_MessageDef* m,
+                                          upb_Arena* a, upb_StringView* out) {
   const upb_FieldDef** sorted = NULL;
   if (!m->is_sorted) {
     sorted = _upb_FieldDefs_Sorted(m->fields, m->field_count, a);
     if (!sorted) return false;
   }
 
-  s->ptr = upb_MtDataEncoder_StartMessage(&s->e, s->ptr,
-                                          _upb_MessageDef_Modifiers(m));
+  // Most messages fit in these, so only large ones allocate from the arena.
+  enum { kStackFields = 64 };
+  upb_MtDataEncoder_Field fields_buf[kStackFields];
+  uint32_t oneof_fields_buf[kStackFields];
 
+  upb_MtDataEncoder_Field* fields = fields_buf;
+  if (m->field_count > kStackFields) {
+    fields = upb_Arena_Malloc(a, m->field_count * sizeof(*fields));
+    if (!fields) return false;
+  }
   for (int i = 0; i < m->field_count; i++) {
     const upb_FieldDef* f = sorted ? sorted[i] : upb_MessageDef_Field(m, i);
-    const upb_FieldType type = upb_FieldDef_Type(f);
-    const int number = upb_FieldDef_Number(f);
-    const uint64_t modifiers = _upb_FieldDef_Modifiers(f);
-
-    if (!_upb_DescState_Grow(s, a)) return false;
-    s->ptr = upb_MtDataEncoder_PutField(&s->e, s->ptr, type, number, modifiers);
+    fields[i].type = upb_FieldDef_Type(f);
+    fields[i].number = upb_FieldDef_Number(f);
+    fields[i].modifiers = _upb_FieldDef_Modifiers(f);
   }
 
+  // The fields of each oneof, with a 0 after each one.
+  size_t oneof_field_count = m->real_oneof_count;
+  for (int i = 0; i < m->real_oneof_count; i++) {
+    oneof_field_count += upb_OneofDef_FieldCount(upb_MessageDef_Oneof(m, i));
+  }
+  uint32_t* oneof_fields = oneof_fields_buf;
+  if (oneof_field_count > kStackFields) {
+    oneof_fields =
+        upb_Arena_Malloc(a, oneof_field_count * sizeof(*oneof_fields));
+    if (!oneof_fields) return false;
+  }
+  uint32_t* oneof_ptr = oneof_fields;
   for (int i = 0; i < m->real_oneof_count; i++) {
-    if (!_upb_DescState_Grow(s, a)) return false;
-    s->ptr = upb_MtDataEncoder_StartOneof(&s->e, s->ptr);
-
     const upb_OneofDef* o = upb_MessageDef_Oneof(m, i);
     const int field_count = upb_OneofDef_FieldCount(o);
     for (int j = 0; j < field_count; j++) {
-      const int number = upb_FieldDef_Number(upb_OneofDef_Field(o, j));
-
-      if (!_upb_DescState_Grow(s, a)) return false;
-      s->ptr = upb_MtDataEncoder_PutOneofField(&s->e, s->ptr, number);
+      *oneof_ptr++ = upb_FieldDef_Number(upb_OneofDef_Field(o, j));
     }
+    *oneof_ptr++ = 0;
   }
 
+  const uint64_t msg_mod = _upb_MessageDef_Modifiers(m);
+  const size_t size =
+      upb_MtDataEncoder_MessageSize(msg_mod, fields, m->field_count,
+                                    oneof_fields, oneof_field_count);
+  UPB_ASSERT(size);
+  char* buf = upb_Arena_Malloc(a, size + 1);
+  if (!buf) return false;
+  char* end = upb_MtDataEncoder_EncodeMessage(
+      buf, msg_mod, fields, m->field_count, oneof_fields, oneof_field_count);
+  UPB_ASSERT(end == buf + size);
+  *end = '\0';
+
+  out->data = buf;
+  out->size = size;
   return true;
 }
 
@@ -589,6 +720,11 @@ static bool _upb_MessageDef_EncodeMessageSet(upb_DescState* s,
 
 bool upb_MessageDef_MiniDescriptorEncode(const upb_MessageDef* m, upb_Arena* a,
                                          upb_StringView* out) {
+  if (!upb_MessageDef_IsMapEntry(m) &&
+      !UPB_DESC(MessageOptions_message_set_wire_format)(m->opts)) {
+    return _upb_MessageDef_EncodeMessage(m, a, out);
+  }
+
   upb_DescState s;
   _upb_DescState_Init(&s);
 
@@ -596,10 +732,8 @@ bool upb_MessageDef_MiniDescriptorEncode(const upb_MessageDef* m, upb_Arena* a,
 
   if (upb_MessageDef_IsMapEntry(m)) {
     if (!_upb_MessageDef_EncodeMap(&s, m, a)) return false;
-  } else if (UPB_DESC(MessageOptions_message_set_wire_format)(m->opts)) {
-    if (!_upb_MessageDef_EncodeMessageSet(&s, m, a)) return false;
   } else {
-    if (!_upb_MessageDef_EncodeMessage(&s, m, a)) return false;
+    if (!_upb_MessageDef_EncodeMessageSet(&s, m, a)) return false;
   }
 
   if (!_upb_DescState_Grow(&s, a)) return false;
@@ -614,8 +748,7 @@ static upb_StringView* _upb_ReservedNames_New(upb_DefBuilder* ctx, int n,
                                               const upb_StringView* protos) {
   upb_StringView* sv = _upb_DefBuilder_Alloc(ctx, sizeof(upb_StringView) * n);
   for (int i = 0; i < n; i++) {
-    sv[i].data =
-        upb_strdup2(protos[i].data, protos[i].size, _upb_DefBuilder_Arena(ctx));
+    sv[i].data = _upb_DefBuilder_InternString(ctx, protos[i]);
     sv[i].size = protos[i].size;
   }
   return sv;
@@ -639,6 +772,7 @@ static void create_msgdef(upb_DefBuilder* ctx, const char* prefix,
 
   m->containing_type = containing_type;
   m->is_sorted = true;
+  m->has_frozen_ntof = false;
 
   name = UPB_DESC(DescriptorProto_name)(msg_proto);
 
@@ -690,6 +824,11 @@ static void create_msgdef(upb_DefBuilder* ctx, const char* prefix,
 
   assign_msg_wellknowntype(m);
   upb_inttable_compact(&m->itof, ctx->arena);
+  // Small tables are found within a probe or two anyway.  If no perfect hash
+  // is found, lookups simply keep using `ntof`.
+  m->has_frozen_ntof =
+      upb_strtable_count(&m->ntof) >= kUpb_MessageDef_MinFrozenNames &&
+      upb_frozentable_initstr(&m->frozen_ntof, &m->ntof, ctx->arena);
 
   const UPB_DESC(EnumDescriptorProto)* const* enums =
       UPB_DESC(DescriptorProto_enum_type)(msg_proto, &n_enum);
@@ -185,6 +185,11 @@ size_t _upb_OneofDefs_Finalize(upb_DefBuilder* ctx, upb_MessageDef* m) {
     }
   }
 
+  for (int i = 0; i < upb_MessageDef_OneofCount(m); i++) {
+    upb_OneofDef* o = (upb_OneofDef*)upb_MessageDef_Oneof(m, i);
+    upb_inttable_compact(&o->itof, ctx->arena);
+  }
+
   return synthetic_count;
 }
 
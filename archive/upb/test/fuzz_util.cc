@@ -30,6 +30,9 @@
 
 #include "upb/test/fuzz_util.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "upb/base/status.hpp"
 #include "upb/message/message.h"
 #include "upb/mini_descriptor/decode.h"
@@ -187,5 +190,24 @@ const upb_MiniTable* BuildMiniTable(const MiniTableFuzzInput& input,
   return builder.Build(exts);
 }
 
+void SlowInputTracker::Record(std::string_view input,
+                              std::chrono::nanoseconds elapsed) {
+  if (input.size() < min_size_) return;
+  double ns_per_byte = static_cast<double>(elapsed.count()) / input.size();
+  if (ns_per_byte <= worst_ns_per_byte_) return;
+  worst_ns_per_byte_ = ns_per_byte;
+  fprintf(stderr, "%s: new slowest input, %zu bytes at %.1f ns/byte\n",
+          prefix_.c_str(), input.size(), ns_per_byte);
+
+  const char* dir = getenv("UPB_FUZZ_SLOW_INPUTS");
+  if (!dir) return;
+  std::string path = std::string(dir) + "/" + prefix_ + "-" +
+                     std::to_string(static_cast<long>(ns_per_byte)) + ".input";
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) return;
+  fwrite(input.data(), 1, input.size(), f);
+  fclose(f);
+}
+
 }  // namespace fuzz
 }  // namespace upb
@@ -31,7 +31,12 @@
 #ifndef UPB_TEST_FUZZ_UTIL_H_
 #define UPB_TEST_FUZZ_UTIL_H_
 
+#include <stddef.h>
+
+#include <chrono>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include "upb/mini_table/extension_registry.h"
@@ -78,6 +83,52 @@ const upb_MiniTable* BuildMiniTable(const MiniTableFuzzInput& input,
                                     upb_ExtensionRegistry** exts,
                                     upb_Arena* arena);
 
+// Watches how long the code under test takes on each fuzz input, to find
+// inputs that are slow rather than wrong: deeply nested groups, huge unknown
+// fields, adversarial map keys and the like.  Every input that sets a new
+// record for time per byte is reported on stderr and, if the environment
+// variable UPB_FUZZ_SLOW_INPUTS names a directory, written there as
+// "<prefix>-<ns per byte>.input" for benchmarks/benchmark.cc to replay.
+//
+//   static upb::fuzz::SlowInputTracker tracker("wire");
+//   upb::fuzz::SlowInputTracker::Timer timer(&tracker, payload);
+//   upb_Decode(payload.data(), payload.size(), ...);
+//
+// Inputs shorter than `min_size` are not tracked, since fixed per-call costs
+// dominate their time.
+class SlowInputTracker {
+ public:
+  explicit SlowInputTracker(std::string prefix, size_t min_size = 64)
+      : prefix_(std::move(prefix)), min_size_(min_size) {}
+
+  void Record(std::string_view input, std::chrono::nanoseconds elapsed);
+
+  // The slowest time per byte recorded so far.
+  double worst_ns_per_byte() const { return worst_ns_per_byte_; }
+
+  // Records the time from construction to destruction.
+  class Timer {
+   public:
+    Timer(SlowInputTracker* tracker, std::string_view input)
+        : tracker_(tracker),
+          input_(input),
+          start_(std::chrono::steady_clock::now()) {}
+    ~Timer() {
+      tracker_->Record(input_, std::chrono::steady_clock::now() - start_);
+    }
+
+   private:
+    SlowInputTracker* tracker_;
+    std::string_view input_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+ private:
+  std::string prefix_;
+  size_t min_size_;
+  double worst_ns_per_byte_ = 0;
+};
+
 }  // namespace fuzz
 }  // namespace upb
 
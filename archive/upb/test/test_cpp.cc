@@ -32,10 +32,14 @@
 
 #include <string.h>
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <set>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "google/protobuf/timestamp.upb.h"
 #include "google/protobuf/timestamp.upbdefs.h"
@@ -70,6 +74,665 @@ TEST(Cpp, Iteration) {
   EXPECT_EQ(oneof_count, md.oneof_count());
 }
 
+TEST(Cpp, FreezeDefPool) {
+  upb::DefPool defpool;
+  upb::MessageDefPtr md(upb_test_TestMessage_getmsgdef(defpool.ptr()));
+  ASSERT_TRUE(md);
+  EXPECT_FALSE(upb_DefPool_IsFrozen(defpool.ptr()));
+  ASSERT_TRUE(defpool.Freeze());
+  EXPECT_TRUE(upb_DefPool_IsFrozen(defpool.ptr()));
+  EXPECT_TRUE(defpool.Freeze());
+
+  EXPECT_EQ(md, defpool.FindMessageByName("upb.test.TestMessage"));
+  EXPECT_FALSE(defpool.FindMessageByName("upb.test.TestMessage2"));
+  EXPECT_EQ(md.file(), defpool.FindFileByName("upb/test/test_cpp.proto"));
+  EXPECT_FALSE(defpool.FindFileByName("upb/test/test.proto"));
+  EXPECT_EQ(md, upb::MessageDefPtr(
+                    upb_test_TestMessage_getmsgdef(defpool.ptr())));
+  EXPECT_EQ(md.file(),
+            upb::FileDefPtr(upb_DefPool_FindFileContainingSymbol(
+                defpool.ptr(), "upb.test.TestMessage.i32")));
+
+  // No new files can be loaded into a frozen pool.
+  EXPECT_EQ(nullptr, google_protobuf_Timestamp_getmsgdef(defpool.ptr()));
+}
+
+// Returns a copy of |str| allocated from |arena|.
+static upb_StringView ArenaString(upb::Arena* arena, const std::string& str) {
+  char* data = static_cast<char*>(upb_Arena_Malloc(arena->ptr(), str.size()));
+  memcpy(data, str.data(), str.size());
+  return upb_StringView_FromDataAndSize(data, str.size());
+}
+
+// Returns "f<i>.proto", which defines "pkg<i>.M" with a field of the type
+// "pkg<prev>.M" defined by "f<prev>.proto", the file before by default.  M has
+// the extension range [100, 200).
+static UPB_DESC(FileDescriptorProto) *
+    NewChainedFile(upb::Arena* arena, int i, int prev_file = -1) {
+  const std::string prev = std::to_string(prev_file < 0 ? i - 1 : prev_file);
+  UPB_DESC(FileDescriptorProto)* file =
+      UPB_DESC(FileDescriptorProto_new)(arena->ptr());
+  UPB_DESC(FileDescriptorProto_set_name)(
+      file, ArenaString(arena, "f" + std::to_string(i) + ".proto"));
+  UPB_DESC(FileDescriptorProto_set_package)(
+      file, ArenaString(arena, "pkg" + std::to_string(i)));
+  UPB_DESC(DescriptorProto)* msg =
+      UPB_DESC(FileDescriptorProto_add_message_type)(file, arena->ptr());
+  UPB_DESC(DescriptorProto_set_name)(msg, upb_StringView_FromString("M"));
+  UPB_DESC(DescriptorProto_ExtensionRange)* range =
+      UPB_DESC(DescriptorProto_add_extension_range)(msg, arena->ptr());
+  UPB_DESC(DescriptorProto_ExtensionRange_set_start)(range, 100);
+  UPB_DESC(DescriptorProto_ExtensionRange_set_end)(range, 200);
+  if (i > 0) {
+    upb_StringView* deps =
+        UPB_DESC(FileDescriptorProto_resize_dependency)(file, 1, arena->ptr());
+    deps[0] = ArenaString(arena, "f" + prev + ".proto");
+    UPB_DESC(FieldDescriptorProto)* field =
+        UPB_DESC(DescriptorProto_add_field)(msg, arena->ptr());
+    UPB_DESC(FieldDescriptorProto_set_name)(field,
+                                            upb_StringView_FromString("prev"));
+    UPB_DESC(FieldDescriptorProto_set_number)(field, 1);
+    UPB_DESC(FieldDescriptorProto_set_label)(
+        field, UPB_DESC(FieldDescriptorProto_LABEL_OPTIONAL));
+    UPB_DESC(FieldDescriptorProto_set_type)(
+        field, UPB_DESC(FieldDescriptorProto_TYPE_MESSAGE));
+    UPB_DESC(FieldDescriptorProto_set_type_name)(
+        field, ArenaString(arena, ".pkg" + prev + ".M"));
+  }
+  return file;
+}
+
+// Adds NewChainedFile(i) and returns whether it succeeded.
+static bool AddChainedFile(upb::DefPool* defpool, int i) {
+  upb::Arena arena;
+  upb::Status status;
+  UPB_DESC(FileDescriptorProto)* file = NewChainedFile(&arena, i);
+  return static_cast<bool>(defpool->AddFile(file, &status));
+}
+
+TEST(Cpp, ConcurrentDefPool) {
+  constexpr int kFiles = 300;
+  upb::DefPool defpool;
+  ASSERT_TRUE(AddChainedFile(&defpool, 0));
+  ASSERT_TRUE(defpool.MakeConcurrent());
+  EXPECT_TRUE(upb_DefPool_IsConcurrent(defpool.ptr()));
+
+  std::atomic<bool> done{false};
+  std::atomic<int> seen{0};
+  auto reader = [&] {
+    while (!done.load()) {
+      for (int i = kFiles - 1; i >= 0; i--) {
+        const std::string name = "f" + std::to_string(i) + ".proto";
+        upb::FileDefPtr file = defpool.FindFileByName(name.c_str());
+        if (!file) continue;
+        // Once a file can be found, so can everything in it and before it.
+        const std::string msg = "pkg" + std::to_string(i) + ".M";
+        upb::MessageDefPtr m = defpool.FindMessageByName(msg.c_str());
+        ASSERT_TRUE(m) << msg;
+        EXPECT_EQ(file, m.file());
+        if (i > 0) {
+          upb::FieldDefPtr prev = m.FindFieldByName("prev");
+          ASSERT_TRUE(prev);
+          EXPECT_TRUE(
+              defpool.FindMessageByName(prev.message_type().full_name()));
+        }
+        EXPECT_FALSE(defpool.FindMessageByName("pkg1.Bad"));
+        seen.fetch_add(1);
+        break;
+      }
+    }
+  };
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; i++) readers.emplace_back(reader);
+
+  for (int i = 1; i < kFiles; i++) {
+    ASSERT_TRUE(AddChainedFile(&defpool, i)) << i;
+    if (i == kFiles / 2) {
+      // A file that fails to build leaves nothing behind.
+      upb::Arena arena;
+      upb::Status status;
+      UPB_DESC(FileDescriptorProto)* file =
+          UPB_DESC(FileDescriptorProto_new)(arena.ptr());
+      UPB_DESC(FileDescriptorProto_set_name)(
+          file, upb_StringView_FromString("bad.proto"));
+      UPB_DESC(FileDescriptorProto_set_package)(
+          file, upb_StringView_FromString("pkg1"));
+      for (const char* msg : {"Bad", "M"}) {
+        UPB_DESC(DescriptorProto_set_name)(
+            UPB_DESC(FileDescriptorProto_add_message_type)(file, arena.ptr()),
+            upb_StringView_FromString(msg));
+      }
+      EXPECT_FALSE(defpool.AddFile(file, &status));
+    }
+  }
+  done.store(true);
+  for (std::thread& t : readers) t.join();
+
+  EXPECT_GT(seen.load(), 0);
+  EXPECT_FALSE(defpool.FindFileByName("bad.proto"));
+  for (int i = 0; i < kFiles; i++) {
+    const std::string msg = "pkg" + std::to_string(i) + ".M";
+    EXPECT_TRUE(defpool.FindMessageByName(msg.c_str())) << msg;
+  }
+}
+
+// Returns "x<i>.proto", which extends "pkg0.M" with the field "x<i>.ext"
+// numbered |num|.
+static UPB_DESC(FileDescriptorProto) *
+    NewExtensionFile(upb::Arena* arena, int i, int num) {
+  UPB_DESC(FileDescriptorProto)* file =
+      UPB_DESC(FileDescriptorProto_new)(arena->ptr());
+  UPB_DESC(FileDescriptorProto_set_name)(
+      file, ArenaString(arena, "x" + std::to_string(i) + ".proto"));
+  UPB_DESC(FileDescriptorProto_set_package)(
+      file, ArenaString(arena, "x" + std::to_string(i)));
+  upb_StringView* deps =
+      UPB_DESC(FileDescriptorProto_resize_dependency)(file, 1, arena->ptr());
+  deps[0] = upb_StringView_FromString("f0.proto");
+  UPB_DESC(FieldDescriptorProto)* ext =
+      UPB_DESC(FileDescriptorProto_add_extension)(file, arena->ptr());
+  UPB_DESC(FieldDescriptorProto_set_name)(ext,
+                                          upb_StringView_FromString("ext"));
+  UPB_DESC(FieldDescriptorProto_set_number)(ext, num);
+  UPB_DESC(FieldDescriptorProto_set_label)(
+      ext, UPB_DESC(FieldDescriptorProto_LABEL_OPTIONAL));
+  UPB_DESC(FieldDescriptorProto_set_type)(
+      ext, UPB_DESC(FieldDescriptorProto_TYPE_INT32));
+  UPB_DESC(FieldDescriptorProto_set_extendee)(
+      ext, upb_StringView_FromString(".pkg0.M"));
+  return file;
+}
+
+// A upb_DefPool_ParallelForFunc that runs the tasks on |*closure| threads.
+static void ThreadedParallelFor(void* closure, size_t count,
+                                void (*task)(void* arg, size_t i), void* arg) {
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < *static_cast<int*>(closure); t++) {
+    threads.emplace_back([&] {
+      for (size_t i; (i = next.fetch_add(1)) < count;) task(arg, i);
+    });
+  }
+  for (std::thread& t : threads) t.join();
+}
+
+TEST(Cpp, AddFiles) {
+  // A tree of files, in which f<i> depends on f<(i-1)/2>, given leaves first,
+  // and two files that extend the message at its root.
+  constexpr int kFiles = 127;
+  upb::Arena arena;
+  std::vector<const UPB_DESC(FileDescriptorProto)*> files;
+  for (int i = kFiles - 1; i >= 0; i--) {
+    files.push_back(NewChainedFile(&arena, i, (i - 1) / 2));
+  }
+  files.push_back(NewExtensionFile(&arena, 1, 101));
+  files.push_back(NewExtensionFile(&arena, 2, 102));
+
+  for (int threads : {0, 4}) {
+    upb::DefPool defpool;
+    upb::Status status;
+    ASSERT_TRUE(upb_DefPool_AddFiles(defpool.ptr(), files.data(), files.size(),
+                                     threads ? ThreadedParallelFor : nullptr,
+                                     &threads, status.ptr()))
+        << status.error_message();
+    for (int i = 0; i < kFiles; i++) {
+      const std::string name = "f" + std::to_string(i) + ".proto";
+      upb::FileDefPtr file = defpool.FindFileByName(name.c_str());
+      ASSERT_TRUE(file) << name;
+      EXPECT_EQ(defpool.ptr(), upb_FileDef_Pool(file.ptr()));
+      const std::string msg = "pkg" + std::to_string(i) + ".M";
+      upb::MessageDefPtr m = defpool.FindMessageByName(msg.c_str());
+      ASSERT_TRUE(m) << msg;
+      EXPECT_EQ(file, m.file());
+      if (i > 0) {
+        const std::string prev = "pkg" + std::to_string((i - 1) / 2) + ".M";
+        EXPECT_EQ(defpool.FindMessageByName(prev.c_str()),
+                  m.FindFieldByName("prev").message_type());
+      }
+    }
+
+    const upb_MessageDef* root = defpool.FindMessageByName("pkg0.M").ptr();
+    for (int num : {101, 102}) {
+      const upb_FieldDef* ext =
+          upb_DefPool_FindExtensionByNumber(defpool.ptr(), root, num);
+      ASSERT_TRUE(ext) << num;
+      EXPECT_EQ(ext, upb_DefPool_FindExtensionByName(
+                         defpool.ptr(), num == 101 ? "x1.ext" : "x2.ext"));
+      const upb_MiniTableExtension* mt = upb_ExtensionRegistry_Lookup(
+          upb_DefPool_ExtensionRegistry(defpool.ptr()),
+          upb_MessageDef_MiniTable(root), num);
+      ASSERT_TRUE(mt);
+      EXPECT_EQ(ext, upb_DefPool_FindExtensionByMiniTable(defpool.ptr(), mt));
+    }
+    size_t count;
+    upb_gfree(upb_DefPool_GetAllExtensions(defpool.ptr(), root, &count));
+    EXPECT_EQ(2, count);
+    const upb_FieldDef* const* exts =
+        upb_DefPool_GetExtensions(defpool.ptr(), root, &count);
+    ASSERT_EQ(2, count);
+    EXPECT_NE(exts[0], exts[1]);
+  }
+}
+
+TEST(Cpp, AddFilesErrors) {
+  upb::Arena arena;
+  int threads = 2;
+  auto add_files =
+      [&](std::vector<const UPB_DESC(FileDescriptorProto)*> files,
+          upb::DefPool* defpool) -> std::string {
+    upb::Status status;
+    bool ok = upb_DefPool_AddFiles(defpool->ptr(), files.data(), files.size(),
+                                   ThreadedParallelFor, &threads, status.ptr());
+    return ok ? "" : status.error_message();
+  };
+
+  // Files that are built at the same time clash when they are merged.
+  upb::DefPool defpool;
+  UPB_DESC(FileDescriptorProto)* clash = NewChainedFile(&arena, 1);
+  UPB_DESC(FileDescriptorProto_set_name)(
+      clash, upb_StringView_FromString("clash.proto"));
+  EXPECT_EQ("duplicate symbol 'pkg1.M'",
+            add_files({NewChainedFile(&arena, 0), NewChainedFile(&arena, 1),
+                       clash},
+                      &defpool));
+  EXPECT_TRUE(defpool.FindFileByName("f1.proto"));
+  EXPECT_FALSE(defpool.FindFileByName("clash.proto"));
+
+  EXPECT_EQ("could not register the extensions of x2.proto",
+            add_files({NewExtensionFile(&arena, 1, 101),
+                       NewExtensionFile(&arena, 2, 101)},
+                      &defpool));
+  EXPECT_FALSE(defpool.FindFileByName("x2.proto"));
+  EXPECT_FALSE(upb_DefPool_FindExtensionByName(defpool.ptr(), "x2.ext"));
+  size_t count;
+  const upb_FieldDef* const* exts = upb_DefPool_GetExtensions(
+      defpool.ptr(), defpool.FindMessageByName("pkg0.M").ptr(), &count);
+  ASSERT_EQ(1, count);
+  EXPECT_EQ(upb_DefPool_FindExtensionByName(defpool.ptr(), "x1.ext"), exts[0]);
+
+  EXPECT_EQ("duplicate file name f1.proto",
+            add_files({NewChainedFile(&arena, 1)}, &defpool));
+
+  // f3 and f4 depend on each other.
+  UPB_DESC(FileDescriptorProto)* f3 = NewChainedFile(&arena, 3, 4);
+  EXPECT_EQ("file f3.proto is part of an import cycle",
+            add_files({f3, NewChainedFile(&arena, 4)}, &defpool));
+}
+
+TEST(Cpp, GetExtensions) {
+  constexpr int kExts = 40;
+  upb::Arena arena;
+  upb::DefPool defpool;
+  ASSERT_TRUE(AddChainedFile(&defpool, 0));
+  ASSERT_TRUE(AddChainedFile(&defpool, 1));
+  const upb_MessageDef* root = defpool.FindMessageByName("pkg0.M").ptr();
+  const upb_MessageDef* other = defpool.FindMessageByName("pkg1.M").ptr();
+  size_t count;
+  EXPECT_EQ(nullptr, upb_DefPool_GetExtensions(defpool.ptr(), root, &count));
+  EXPECT_EQ(0, count);
+
+  const upb_FieldDef* const* first = nullptr;
+  for (int i = 0; i < kExts; i++) {
+    if (i == kExts / 2) ASSERT_TRUE(defpool.MakeConcurrent());
+    upb::Status status;
+    ASSERT_TRUE(defpool.AddFile(NewExtensionFile(&arena, i, 100 + i), &status))
+        << status.error_message();
+    if (i == 0) first = upb_DefPool_GetExtensions(defpool.ptr(), root, &count);
+
+    // An extension whose number is taken fails and leaves nothing behind.
+    upb::Status dup_status;
+    EXPECT_FALSE(defpool.AddFile(NewExtensionFile(&arena, kExts + i, 100),
+                                 &dup_status));
+  }
+
+  // In the order they were added, while earlier arrays stay as they were.
+  const upb_FieldDef* const* exts =
+      upb_DefPool_GetExtensions(defpool.ptr(), root, &count);
+  ASSERT_EQ(kExts, count);
+  for (int i = 0; i < kExts; i++) {
+    const std::string name = "x" + std::to_string(i) + ".ext";
+    EXPECT_EQ(upb_DefPool_FindExtensionByName(defpool.ptr(), name.c_str()),
+              exts[i])
+        << name;
+  }
+  EXPECT_EQ(exts[0], first[0]);
+  EXPECT_EQ(nullptr, upb_DefPool_GetExtensions(defpool.ptr(), other, &count));
+  EXPECT_EQ(0, count);
+}
+
+TEST(Cpp, WideMessageLookups) {
+  // Enough fields that their names are looked up with a perfect hash.
+  constexpr int kFields = 40;
+  upb::Arena arena;
+  UPB_DESC(FileDescriptorProto)* file = NewChainedFile(&arena, 0);
+  size_t n;
+  UPB_DESC(DescriptorProto)* msg =
+      UPB_DESC(FileDescriptorProto_mutable_message_type)(file, &n)[0];
+  UPB_DESC(DescriptorProto_add_oneof_decl)(msg, arena.ptr());
+  UPB_DESC(OneofDescriptorProto_set_name)(
+      UPB_DESC(DescriptorProto_mutable_oneof_decl)(msg, &n)[0],
+      upb_StringView_FromString("choice"));
+  for (int i = 1; i <= kFields; i++) {
+    UPB_DESC(FieldDescriptorProto)* field =
+        UPB_DESC(DescriptorProto_add_field)(msg, arena.ptr());
+    UPB_DESC(FieldDescriptorProto_set_name)(
+        field, ArenaString(&arena, "field_" + std::to_string(i)));
+    UPB_DESC(FieldDescriptorProto_set_number)(field, i);
+    UPB_DESC(FieldDescriptorProto_set_label)(
+        field, UPB_DESC(FieldDescriptorProto_LABEL_OPTIONAL));
+    UPB_DESC(FieldDescriptorProto_set_type)(
+        field, UPB_DESC(FieldDescriptorProto_TYPE_INT32));
+    if (i == kFields) UPB_DESC(FieldDescriptorProto_set_oneof_index)(field, 0);
+  }
+  upb::DefPool defpool;
+  upb::Status status;
+  ASSERT_TRUE(defpool.AddFile(file, &status)) << status.error_message();
+
+  upb::MessageDefPtr m = defpool.FindMessageByName("pkg0.M");
+  for (int i = 1; i <= kFields; i++) {
+    const std::string name = "field_" + std::to_string(i);
+    const std::string json_name = "field" + std::to_string(i);
+    upb::FieldDefPtr f = m.FindFieldByName(name);
+    ASSERT_TRUE(f) << name;
+    EXPECT_EQ(i, f.number());
+    EXPECT_FALSE(m.FindFieldByName(json_name));
+    EXPECT_EQ(f.ptr(), upb_MessageDef_FindByJsonNameWithSize(
+                           m.ptr(), json_name.data(), json_name.size()));
+    EXPECT_EQ(f.ptr(), upb_MessageDef_FindByJsonNameWithSize(
+                           m.ptr(), name.data(), name.size()));
+  }
+  EXPECT_TRUE(upb_MessageDef_FindOneofByName(m.ptr(), "choice"));
+  EXPECT_FALSE(upb_MessageDef_FindOneofByName(m.ptr(), "field_1"));
+  EXPECT_FALSE(m.FindFieldByName("field_0"));
+  EXPECT_FALSE(m.FindFieldByName(""));
+}
+
+TEST(Cpp, DefOptions) {
+  // deprecated: true, and the unknown (custom) option 1000: 7.
+  const std::string serialized("\x18\x01\xc0\x3e\x07", 5);
+  upb::DefPool defpool;
+  {
+    upb::Arena arena;
+    UPB_DESC(FileDescriptorProto)* file = NewChainedFile(&arena, 0);
+    size_t n;
+    UPB_DESC(DescriptorProto)* msg =
+        UPB_DESC(FileDescriptorProto_mutable_message_type)(file, &n)[0];
+    UPB_DESC(MessageOptions)* opts = UPB_DESC(MessageOptions_parse)(
+        serialized.data(), serialized.size(), arena.ptr());
+    ASSERT_TRUE(opts);
+    UPB_DESC(DescriptorProto_set_options)(msg, opts);
+    upb::Status status;
+    ASSERT_TRUE(defpool.AddFile(file, &status)) << status.error_message();
+  }
+
+  // The options are copied out of the proto they were added from.
+  upb::MessageDefPtr m = defpool.FindMessageByName("pkg0.M");
+  ASSERT_TRUE(m);
+  const UPB_DESC(MessageOptions)* opts = upb_MessageDef_Options(m.ptr());
+  EXPECT_TRUE(UPB_DESC(MessageOptions_deprecated)(opts));
+  upb::Arena arena;
+  size_t size;
+  char* data = UPB_DESC(MessageOptions_serialize)(opts, arena.ptr(), &size);
+  EXPECT_EQ(serialized, std::string(data, size));
+}
+
+TEST(Cpp, SharedDefNamesAndOptions) {
+  // deprecated: true, which is the same field number for every options type.
+  const std::string deprecated("\x18\x01", 2);
+  const std::string not_deprecated("\x18\x00", 2);
+  upb::DefPool defpool;
+  for (int i = 0; i < 3; i++) {
+    upb::Arena arena;
+    UPB_DESC(FileDescriptorProto)* file = NewChainedFile(&arena, i);
+    size_t n;
+    UPB_DESC(DescriptorProto)* msg =
+        UPB_DESC(FileDescriptorProto_mutable_message_type)(file, &n)[0];
+    UPB_DESC(MessageOptions)* msg_opts = UPB_DESC(MessageOptions_parse)(
+        deprecated.data(), deprecated.size(), arena.ptr());
+    ASSERT_TRUE(msg_opts);
+    UPB_DESC(DescriptorProto_set_options)(msg, msg_opts);
+    UPB_DESC(FieldDescriptorProto)* field =
+        UPB_DESC(DescriptorProto_add_field)(msg, arena.ptr());
+    UPB_DESC(FieldDescriptorProto_set_name)(
+        field, upb_StringView_FromString("some_value"));
+    UPB_DESC(FieldDescriptorProto_set_number)(field, 2);
+    UPB_DESC(FieldDescriptorProto_set_label)(
+        field, UPB_DESC(FieldDescriptorProto_LABEL_OPTIONAL));
+    UPB_DESC(FieldDescriptorProto_set_type)(
+        field, UPB_DESC(FieldDescriptorProto_TYPE_INT32));
+    const std::string& serialized = i < 2 ? deprecated : not_deprecated;
+    UPB_DESC(FieldOptions)* field_opts = UPB_DESC(FieldOptions_parse)(
+        serialized.data(), serialized.size(), arena.ptr());
+    ASSERT_TRUE(field_opts);
+    UPB_DESC(FieldDescriptorProto_set_options)(field, field_opts);
+    upb::Status status;
+    ASSERT_TRUE(defpool.AddFile(file, &status)) << status.error_message();
+  }
+
+  upb::FieldDefPtr fields[3];
+  for (int i = 0; i < 3; i++) {
+    const std::string name = "pkg" + std::to_string(i) + ".M";
+    upb::MessageDefPtr m = defpool.FindMessageByName(name.c_str());
+    ASSERT_TRUE(m);
+    fields[i] = m.FindFieldByName("some_value");
+    ASSERT_TRUE(fields[i]);
+  }
+
+  // JSON names are shared, and those equal to the field name are not copied.
+  EXPECT_STREQ("someValue", fields[0].json_name());
+  EXPECT_EQ(fields[0].json_name(), fields[1].json_name());
+  upb::FieldDefPtr prev =
+      defpool.FindMessageByName("pkg1.M").FindFieldByName("prev");
+  EXPECT_STREQ("prev", prev.json_name());
+  EXPECT_EQ(prev.name(), prev.json_name());
+
+  // Equal options of the same type are shared.
+  const UPB_DESC(FieldOptions)* opts[3];
+  for (int i = 0; i < 3; i++) opts[i] = upb_FieldDef_Options(fields[i].ptr());
+  EXPECT_EQ(opts[0], opts[1]);
+  EXPECT_NE(opts[0], opts[2]);
+  EXPECT_TRUE(UPB_DESC(FieldOptions_deprecated)(opts[0]));
+  EXPECT_TRUE(UPB_DESC(FieldOptions_has_deprecated)(opts[2]));
+  EXPECT_FALSE(UPB_DESC(FieldOptions_deprecated)(opts[2]));
+  const UPB_DESC(MessageOptions)* msg_opts =
+      upb_MessageDef_Options(fields[0].containing_type().ptr());
+  EXPECT_EQ(msg_opts,
+            upb_MessageDef_Options(fields[1].containing_type().ptr()));
+  EXPECT_NE(static_cast<const void*>(msg_opts),
+            static_cast<const void*>(opts[0]));
+  EXPECT_TRUE(UPB_DESC(MessageOptions_deprecated)(msg_opts));
+}
+
+TEST(Cpp, LazyDefPool) {
+  upb::DefPool defpool;
+  ASSERT_TRUE(_upb_DefPool_RegisterDefInit(
+      defpool.ptr(), &upb_test_test_cpp_proto_upbdefinit));
+  ASSERT_TRUE(_upb_DefPool_RegisterDefInit(
+      defpool.ptr(), &google_protobuf_timestamp_proto_upbdefinit));
+  EXPECT_EQ(0, _upb_DefPool_BytesLoaded(defpool.ptr()));
+  EXPECT_FALSE(defpool.FindMessageByName("upb.test.Missing"));
+  EXPECT_FALSE(defpool.FindMessageByName("upb"));
+  EXPECT_EQ(0, _upb_DefPool_BytesLoaded(defpool.ptr()));
+
+  // Looking up a def loads its file, and only that file.
+  upb::MessageDefPtr md = defpool.FindMessageByName("upb.test.TestMessage");
+  ASSERT_TRUE(md);
+  const size_t loaded = _upb_DefPool_BytesLoaded(defpool.ptr());
+  EXPECT_GT(loaded, 0);
+  EXPECT_EQ(md, upb::MessageDefPtr(
+                    upb_test_TestMessage_getmsgdef(defpool.ptr())));
+  EXPECT_EQ(loaded, _upb_DefPool_BytesLoaded(defpool.ptr()));
+
+  // Nested names are found through the top-level def they are in.
+  const upb_FileDef* file = upb_DefPool_FindFileContainingSymbol(
+      defpool.ptr(), "google.protobuf.Timestamp.seconds");
+  ASSERT_TRUE(file);
+  EXPECT_STREQ("google/protobuf/timestamp.proto", upb_FileDef_Name(file));
+  EXPECT_GT(_upb_DefPool_BytesLoaded(defpool.ptr()), loaded);
+  EXPECT_TRUE(defpool.FindFileByName("google/protobuf/timestamp.proto"));
+
+  // A malformed descriptor is rejected without loading anything.
+  upb::DefPool other;
+  _upb_DefPool_Init* deps[1] = {nullptr};
+  _upb_DefPool_Init bad = {deps, nullptr, "bad.proto", {"\x12\x05" "ab", 4}};
+  EXPECT_FALSE(_upb_DefPool_RegisterDefInit(other.ptr(), &bad));
+}
+
+TEST(Cpp, LazyDefPoolByFileName) {
+  upb::DefPool defpool;
+  ASSERT_TRUE(_upb_DefPool_RegisterDefInit(
+      defpool.ptr(), &upb_test_test_cpp_proto_upbdefinit));
+  upb::FileDefPtr file = defpool.FindFileByName("upb/test/test_cpp.proto");
+  ASSERT_TRUE(file);
+  EXPECT_EQ(1, file.toplevel_message_count());
+  EXPECT_TRUE(defpool.FindMessageByName("upb.test.TestMessage"));
+}
+
+TEST(Cpp, DefImage) {
+  constexpr int kFiles = 10;
+  upb::Arena arena;
+  std::vector<upb_StringView> files;
+  // Files may be given in any order.
+  for (int i = kFiles - 1; i >= 0; i--) {
+    upb_StringView file;
+    file.data = UPB_DESC(FileDescriptorProto_serialize)(
+        NewChainedFile(&arena, i), arena.ptr(), &file.size);
+    ASSERT_TRUE(file.data);
+    files.push_back(file);
+  }
+  files.push_back(upb_test_test_cpp_proto_upbdefinit.descriptor);
+  files.push_back(google_protobuf_timestamp_proto_upbdefinit.descriptor);
+
+  upb::Status status;
+  size_t size;
+  const char* image = upb_DefImage_Build(files.data(), files.size(),
+                                         arena.ptr(), &size, status.ptr());
+  ASSERT_TRUE(image) << status.error_message();
+
+  upb::DefPool defpool;
+  ASSERT_TRUE(defpool.AddImage(image, size, &status));
+  EXPECT_FALSE(defpool.AddImage(image, size, &status));
+  EXPECT_EQ(0, _upb_DefPool_BytesLoaded(defpool.ptr()));
+  EXPECT_FALSE(defpool.FindMessageByName("pkg3.Missing"));
+  EXPECT_FALSE(defpool.FindFileByName("missing.proto"));
+  EXPECT_EQ(0, _upb_DefPool_BytesLoaded(defpool.ptr()));
+
+  // Looking up a def builds its file and the files it depends on.
+  upb::MessageDefPtr m = defpool.FindMessageByName("pkg3.M");
+  ASSERT_TRUE(m);
+  EXPECT_STREQ("f3.proto", m.file().name());
+  EXPECT_TRUE(upb_DefPool_FindFileByName(defpool.ptr(), "f0.proto"));
+  const size_t loaded = _upb_DefPool_BytesLoaded(defpool.ptr());
+  EXPECT_EQ(files[kFiles - 4].size + files[kFiles - 3].size +
+                files[kFiles - 2].size + files[kFiles - 1].size,
+            loaded);
+
+  EXPECT_TRUE(defpool.FindFileByName("f9.proto"));
+  EXPECT_TRUE(defpool.FindMessageByName("upb.test.TestMessage"));
+  const upb_FileDef* file = upb_DefPool_FindFileContainingSymbol(
+      defpool.ptr(), "google.protobuf.Timestamp.seconds");
+  ASSERT_TRUE(file);
+  EXPECT_STREQ("google/protobuf/timestamp.proto", upb_FileDef_Name(file));
+  EXPECT_GT(_upb_DefPool_BytesLoaded(defpool.ptr()), loaded);
+
+  // A corrupt image is rejected, or at worst finds nothing.
+  upb::DefPool other;
+  EXPECT_FALSE(other.AddImage(image, 12, &status));
+  std::string corrupt(image, size);
+  corrupt[0] = 'x';
+  EXPECT_FALSE(other.AddImage(corrupt.data(), corrupt.size(), &status));
+  corrupt = std::string(image, size);
+  for (size_t i = 16; i < 16 + 24 * files.size(); i++) corrupt[i] = '\xff';
+  ASSERT_TRUE(other.AddImage(corrupt.data(), corrupt.size(), &status));
+  EXPECT_FALSE(other.FindMessageByName("pkg3.M"));
+  EXPECT_FALSE(other.FindFileByName("f3.proto"));
+}
+
+TEST(Cpp, DefImageErrors) {
+  upb::Arena arena;
+  upb::Status status;
+  size_t size;
+  upb_StringView files[2];
+  files[0].data = UPB_DESC(FileDescriptorProto_serialize)(
+      NewChainedFile(&arena, 1), arena.ptr(), &files[0].size);
+  EXPECT_FALSE(
+      upb_DefImage_Build(files, 1, arena.ptr(), &size, status.ptr()));
+  EXPECT_TRUE(strstr(status.error_message(), "f0.proto"));
+
+  files[1] = files[0];
+  status.Clear();
+  EXPECT_FALSE(
+      upb_DefImage_Build(files, 2, arena.ptr(), &size, status.ptr()));
+  EXPECT_TRUE(strstr(status.error_message(), "duplicate file"));
+
+  // Two files that both define pkg1.M.
+  UPB_DESC(FileDescriptorProto)* file = NewChainedFile(&arena, 0);
+  UPB_DESC(FileDescriptorProto_set_package)(file,
+                                            upb_StringView_FromString("pkg1"));
+  files[0].data = UPB_DESC(FileDescriptorProto_serialize)(file, arena.ptr(),
+                                                          &files[0].size);
+  UPB_DESC(FileDescriptorProto_set_name)(
+      file, upb_StringView_FromString("other.proto"));
+  files[1].data = UPB_DESC(FileDescriptorProto_serialize)(file, arena.ptr(),
+                                                          &files[1].size);
+  status.Clear();
+  EXPECT_FALSE(
+      upb_DefImage_Build(files, 2, arena.ptr(), &size, status.ptr()));
+  EXPECT_TRUE(strstr(status.error_message(), "duplicate symbol pkg1.M"));
+
+  files[0] = upb_StringView_FromString("\x0a\x05" "ab");
+  status.Clear();
+  EXPECT_FALSE(
+      upb_DefImage_Build(files, 1, arena.ptr(), &size, status.ptr()));
+}
+
+TEST(Cpp, RegisterFile) {
+  constexpr int kFiles = 6;
+  upb::DefPool defpool;
+  upb::Status status;
+  std::vector<size_t> sizes;
+  // Files may be registered before the files they import.
+  for (int i = kFiles - 1; i >= 0; i--) {
+    upb::Arena arena;
+    size_t size;
+    const char* data = UPB_DESC(FileDescriptorProto_serialize)(
+        NewChainedFile(&arena, i), arena.ptr(), &size);
+    ASSERT_TRUE(data);
+    ASSERT_TRUE(defpool.RegisterFile(data, size, &status))
+        << status.error_message();
+    ASSERT_TRUE(defpool.RegisterFile(data, size, &status));
+    sizes.insert(sizes.begin(), size);
+  }
+  EXPECT_EQ(0, _upb_DefPool_BytesLoaded(defpool.ptr()));
+  EXPECT_FALSE(defpool.FindMessageByName("pkg2.Missing"));
+  EXPECT_EQ(0, _upb_DefPool_BytesLoaded(defpool.ptr()));
+
+  // Looking up a def builds its file after the files it imports.
+  upb::MessageDefPtr m = defpool.FindMessageByName("pkg2.M");
+  ASSERT_TRUE(m);
+  EXPECT_EQ(defpool.FindMessageByName("pkg1.M"),
+            m.FindFieldByName("prev").message_type());
+  EXPECT_EQ(sizes[0] + sizes[1] + sizes[2],
+            _upb_DefPool_BytesLoaded(defpool.ptr()));
+  EXPECT_TRUE(defpool.FindFileByName("f5.proto"));
+  EXPECT_TRUE(AddChainedFile(&defpool, kFiles));
+
+  // Files that fail to build, here because they import each other, are not
+  // found.
+  upb::DefPool other;
+  for (int i : {1, 2}) {
+    upb::Arena arena;
+    size_t size;
+    const char* data = UPB_DESC(FileDescriptorProto_serialize)(
+        NewChainedFile(&arena, i, 3 - i), arena.ptr(), &size);
+    ASSERT_TRUE(other.RegisterFile(data, size, &status));
+  }
+  EXPECT_FALSE(other.FindMessageByName("pkg1.M"));
+  EXPECT_FALSE(other.FindFileByName("f2.proto"));
+  EXPECT_FALSE(other.RegisterFile("\x0a\x05" "ab", 4, &status));
+  EXPECT_FALSE(other.RegisterFile("\x12\x02" "ab", 4, &status));
+}
+
 TEST(Cpp, InlinedArena2) {
   upb::InlinedArena<64> arena;
   upb_Arena_Malloc(arena.ptr(), sizeof(int));
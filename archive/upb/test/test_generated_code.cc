@@ -35,6 +35,9 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "google/protobuf/test_messages_proto2.upb.h"
@@ -42,8 +45,17 @@
 #include "upb/base/status.h"
 #include "upb/base/string_view.h"
 #include "upb/collections/array.h"
+#include "upb/collections/map.h"
+#include "upb/io/chunked_output_stream.h"
+#include "upb/io/encode_stream.h"
+#include "upb/io/zero_copy_output_stream.h"
 #include "upb/mem/arena.hpp"
+#include "upb/message/accessors.h"
+#include "upb/mini_table/message.h"
 #include "upb/test/test.upb.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+#include "upb/wire/incremental_decode.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -370,6 +382,52 @@ TEST(GeneratedCode, ScalarsProto2) {
   upb_Arena_Free(arena);
 }
 
+// Closed enum values that are not in the enum must end up in the unknown
+// fields, whether the fast table or the generic parser handles the field.
+TEST(GeneratedCode, ClosedEnums) {
+  std::string data;
+  // optional_nested_enum: BAZ, then a value that is not in the enum.
+  data += "\xa8\x01\x02\xa8\x01\x05";
+  // repeated_nested_enum: BAR, BAZ, not in the enum, FOO, NEG.
+  data += std::string("\x98\x03\x01\x98\x03\x02\x98\x03\x07\x98\x03\x00", 12);
+  data += "\x98\x03\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01";
+  // oneof_enum: BAR, then a value that is not in the enum.
+  data += "\xb8\x07\x01\xb8\x07\x09";
+
+  upb::Arena arena;
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_parse(
+          data.data(), data.size(), arena.ptr());
+  ASSERT_NE(nullptr, msg);
+
+  EXPECT_TRUE(
+      protobuf_test_messages_proto2_TestAllTypesProto2_has_optional_nested_enum(
+          msg));
+  EXPECT_EQ(
+      protobuf_test_messages_proto2_TestAllTypesProto2_BAZ,
+      protobuf_test_messages_proto2_TestAllTypesProto2_optional_nested_enum(
+          msg));
+  size_t n;
+  const int32_t* repeated =
+      protobuf_test_messages_proto2_TestAllTypesProto2_repeated_nested_enum(
+          msg, &n);
+  ASSERT_EQ(4, n);
+  EXPECT_EQ(protobuf_test_messages_proto2_TestAllTypesProto2_BAR, repeated[0]);
+  EXPECT_EQ(protobuf_test_messages_proto2_TestAllTypesProto2_BAZ, repeated[1]);
+  EXPECT_EQ(protobuf_test_messages_proto2_TestAllTypesProto2_FOO, repeated[2]);
+  EXPECT_EQ(protobuf_test_messages_proto2_TestAllTypesProto2_NEG, repeated[3]);
+  EXPECT_EQ(
+      protobuf_test_messages_proto2_TestAllTypesProto2_oneof_field_oneof_enum,
+      protobuf_test_messages_proto2_TestAllTypesProto2_oneof_field_case(msg));
+  EXPECT_EQ(protobuf_test_messages_proto2_TestAllTypesProto2_BAR,
+            protobuf_test_messages_proto2_TestAllTypesProto2_oneof_enum(msg));
+
+  size_t unknown_size;
+  const char* unknown = upb_Message_GetUnknown(msg, &unknown_size);
+  EXPECT_EQ(std::string("\xa8\x01\x05\x98\x03\x07\xb8\x07\x09"),
+            std::string(unknown, unknown_size));
+}
+
 TEST(GeneratedCode, RepeatedClear) {
   upb_Arena* arena = upb_Arena_New();
   protobuf_test_messages_proto2_TestAllTypesProto2* msg =
@@ -516,6 +574,21 @@ TEST(GeneratedCode, UTF8) {
       serialized.data, serialized.size, arena);
   EXPECT_EQ(nullptr, msg2);
 
+  // Long strings take the block-at-a-time path.
+  std::string text;
+  for (int i = 0; i < 50; i++) text += "z\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80";
+  for (bool valid : {true, false}) {
+    if (!valid) text.back() = '\xff';
+    protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_string(
+        msg, upb_StringView_FromDataAndSize(text.data(), text.size()));
+    serialized.data =
+        protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+            msg, arena, &serialized.size);
+    msg2 = protobuf_test_messages_proto3_TestAllTypesProto3_parse(
+        serialized.data, serialized.size, arena);
+    EXPECT_EQ(valid, msg2 != nullptr);
+  }
+
   upb_Arena_Free(arena);
 }
 
@@ -788,6 +861,95 @@ TEST(GeneratedCode, Int32Map) {
   upb_Arena_Free(arena);
 }
 
+// Map entries in every encoding the wire format allows, canonical or not, so
+// that the fast-table map parsers and the generic fallback agree.
+TEST(GeneratedCode, MapEntryEncodings) {
+  const std::string kInt32Tag = "\xc2\x03";   // Field 56, length-delimited.
+  const std::string kStringTag = "\xaa\x04";  // Field 69, length-delimited.
+  auto entry = [](const std::string& tag, const std::string& body) {
+    return tag + std::string(1, (char)body.size()) + body;
+  };
+  int32_t val;
+  upb_StringView str;
+
+  std::string data;
+  data += entry(kInt32Tag, "\x08\x01\x10\x02");  // {1: 2}
+  data += entry(kInt32Tag,  // {-1: 3}
+                "\x08\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01\x10\x03");
+  data += entry(kInt32Tag, "\x10\x05\x08\x04");  // Reversed: {4: 5}
+  data += entry(kInt32Tag, "\x10\x07");          // No key: {0: 7}
+  data += entry(kInt32Tag, "\x08\x06");          // No value: {6: 0}
+  data += entry(kInt32Tag, "\x08\x01\x10\x0a");  // Replaces {1: 2}.
+  data += entry(kInt32Tag, "\x08\x0b\x10\x0c\x10\x0d");  // Last value wins.
+  // An entry with an unknown field is kept as an unknown field of the parent.
+  data += entry(kInt32Tag, "\x08\x08\x18\x63\x10\x09");
+  data += entry(kStringTag, std::string("\x0a\x01k\x12\x01v", 6));
+  data += entry(kStringTag, std::string("\x12\x00\x0a\x00", 4));
+  std::string long_value(200, 'x');
+  data += kStringTag + "\xd1\x01" + "\x0a\x04long\x12\xc8\x01" + long_value;
+
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_parse(
+          data.data(), data.size(), arena.ptr());
+  ASSERT_NE(nullptr, msg);
+
+  EXPECT_EQ(
+      6, protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_size(
+             msg));
+  const std::pair<int32_t, int32_t> kInt32Entries[] = {
+      {1, 10}, {-1, 3}, {4, 5}, {0, 7}, {6, 0}, {11, 13}};
+  for (const auto& e : kInt32Entries) {
+    EXPECT_TRUE(
+        protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_get(
+            msg, e.first, &val))
+        << e.first;
+    EXPECT_EQ(e.second, val) << e.first;
+  }
+
+  size_t unknown_size;
+  upb_Message_GetUnknown(msg, &unknown_size);
+  EXPECT_EQ(kInt32Tag.size() + 7, unknown_size);
+
+  EXPECT_EQ(
+      3,
+      protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_size(
+          msg));
+  EXPECT_TRUE(
+      protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_get(
+          msg, upb_StringView_FromString("k"), &str));
+  EXPECT_EQ("v", std::string(str.data, str.size));
+  EXPECT_TRUE(
+      protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_get(
+          msg, upb_StringView_FromString(""), &str));
+  EXPECT_EQ(0, str.size);
+  EXPECT_TRUE(
+      protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_get(
+          msg, upb_StringView_FromString("long"), &str));
+  EXPECT_EQ(long_value, std::string(str.data, str.size));
+
+  // String values must not point into the input buffer unless aliasing.
+  std::string copy = data;
+  msg = protobuf_test_messages_proto3_TestAllTypesProto3_parse(
+      copy.data(), copy.size(), arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  copy.assign(copy.size(), '\0');
+  EXPECT_TRUE(
+      protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_get(
+          msg, upb_StringView_FromString("k"), &str));
+  EXPECT_EQ("v", std::string(str.data, str.size));
+
+  // Malformed entries fail the parse.
+  for (const std::string& bad : {
+           entry(kInt32Tag, "\x08\x01\x10\x80"),
+           entry(kInt32Tag, "\x08\x01\x12\x05"),
+           kInt32Tag + "\x04\x08\x01\x10",
+       }) {
+    EXPECT_EQ(nullptr, protobuf_test_messages_proto3_TestAllTypesProto3_parse(
+                           bad.data(), bad.size(), arena.ptr()));
+  }
+}
+
 TEST(GeneratedCode, TestRepeated) {
   upb_Arena* arena = upb_Arena_New();
   protobuf_test_messages_proto3_TestAllTypesProto3* msg =
@@ -828,6 +990,1210 @@ TEST(GeneratedCode, TestRepeated) {
   upb_Arena_Free(arena);
 }
 
+TEST(GeneratedCode, PrescanRepeated) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  for (int i = 0; i < 100; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int32(
+        msg, i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_unpacked_int32(
+        msg, i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_unpacked_double(
+        msg, i * 0.5, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_string(
+        msg, upb_StringView_FromString("abc"), arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_set_a(
+        protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_nested_message(
+            msg, arena.ptr()),
+        i);
+  }
+  size_t size;
+  char* serialized = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, serialized);
+
+  for (int options : {0, (int)kUpb_DecodeOption_PrescanRepeated,
+                      (int)kUpb_DecodeOption_BulkSubMessages,
+                      kUpb_DecodeOption_PrescanRepeated |
+                          kUpb_DecodeOption_BulkSubMessages}) {
+    protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+        protobuf_test_messages_proto3_TestAllTypesProto3_parse_ex(
+            serialized, size, nullptr, options, arena.ptr());
+    ASSERT_NE(nullptr, parsed);
+
+    size_t n;
+    const int32_t* ints =
+        protobuf_test_messages_proto3_TestAllTypesProto3_unpacked_int32(parsed,
+                                                                        &n);
+    ASSERT_EQ(100, n);
+    for (int i = 0; i < 100; i++) EXPECT_EQ(i, ints[i]);
+    const double* doubles =
+        protobuf_test_messages_proto3_TestAllTypesProto3_unpacked_double(
+            parsed, &n);
+    ASSERT_EQ(100, n);
+    for (int i = 0; i < 100; i++) EXPECT_EQ(i * 0.5, doubles[i]);
+    const protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage* const*
+        nested =
+            protobuf_test_messages_proto3_TestAllTypesProto3_repeated_nested_message(
+                parsed, &n);
+    ASSERT_EQ(100, n);
+    for (int i = 0; i < 100; i++) {
+      EXPECT_EQ(
+          i, protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_a(
+                 nested[i]));
+    }
+
+    size_t size2;
+    char* serialized2 =
+        protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+            parsed, arena.ptr(), &size2);
+    ASSERT_EQ(size, size2);
+    EXPECT_EQ(0, memcmp(serialized, serialized2, size));
+  }
+}
+
+TEST(GeneratedCode, PrescanMap) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  std::vector<std::string> keys;
+  for (int i = 0; i < 10000; i++) keys.push_back(std::to_string(i));
+  for (int i = 0; i < 10000; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_set(
+        msg, i * 3, i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_set(
+        msg, upb_StringView_FromString(keys[i].c_str()),
+        upb_StringView_FromString("v"), arena.ptr());
+  }
+  size_t size;
+  char* serialized = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, serialized);
+
+  for (int options : {0, (int)kUpb_DecodeOption_PrescanRepeated}) {
+    protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+        protobuf_test_messages_proto3_TestAllTypesProto3_parse_ex(
+            serialized, size, nullptr, options, arena.ptr());
+    ASSERT_NE(nullptr, parsed);
+    EXPECT_EQ(
+        10000,
+        protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_size(
+            parsed));
+    EXPECT_EQ(
+        10000,
+        protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_size(
+            parsed));
+    for (int i = 0; i < 10000; i++) {
+      int32_t v;
+      ASSERT_TRUE(
+          protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_get(
+              parsed, i * 3, &v));
+      EXPECT_EQ(i, v);
+      upb_StringView sv;
+      EXPECT_TRUE(
+          protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_get(
+              parsed, upb_StringView_FromString(keys[i].c_str()), &sv));
+    }
+  }
+}
+
+// Packed varints of mixed lengths, in arrays long enough to exercise both the
+// sixteen-byte bulk path and the element-at-a-time tail.
+static uint64_t PackedVarintValue(int i) {
+  if (i % 3 == 0) return i % 128;
+  return (uint64_t)1 << ((i * 7) % 64) | i;
+}
+
+TEST(GeneratedCode, PackedVarints) {
+  for (int count : {1, 15, 16, 17, 40, 300}) {
+    upb::Arena arena;
+    protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+        protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+    for (int i = 0; i < count; i++) {
+      uint64_t v = PackedVarintValue(i);
+      protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int32(
+          msg, (int32_t)v, arena.ptr());
+      protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int64(
+          msg, (int64_t)v, arena.ptr());
+      protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_uint32(
+          msg, (uint32_t)v, arena.ptr());
+      protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_sint32(
+          msg, -(int32_t)v, arena.ptr());
+      protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_sint64(
+          msg, -(int64_t)v, arena.ptr());
+      protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_bool(
+          msg, v & 1, arena.ptr());
+      protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_nested_enum(
+          msg, i % 2 ? protobuf_test_messages_proto3_TestAllTypesProto3_NEG
+                     : protobuf_test_messages_proto3_TestAllTypesProto3_BAZ,
+          arena.ptr());
+    }
+    size_t size;
+    char* serialized =
+        protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+            msg, arena.ptr(), &size);
+    ASSERT_NE(nullptr, serialized);
+
+    for (int options : {0, (int)kUpb_DecodeOption_PrescanRepeated}) {
+      protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+          protobuf_test_messages_proto3_TestAllTypesProto3_parse_ex(
+              serialized, size, nullptr, options, arena.ptr());
+      ASSERT_NE(nullptr, parsed);
+
+      size_t n;
+      const int32_t* int32s =
+          protobuf_test_messages_proto3_TestAllTypesProto3_repeated_int32(
+              parsed, &n);
+      ASSERT_EQ(count, n);
+      const int64_t* int64s =
+          protobuf_test_messages_proto3_TestAllTypesProto3_repeated_int64(
+              parsed, &n);
+      ASSERT_EQ(count, n);
+      const uint32_t* uint32s =
+          protobuf_test_messages_proto3_TestAllTypesProto3_repeated_uint32(
+              parsed, &n);
+      ASSERT_EQ(count, n);
+      const int32_t* sint32s =
+          protobuf_test_messages_proto3_TestAllTypesProto3_repeated_sint32(
+              parsed, &n);
+      ASSERT_EQ(count, n);
+      const int64_t* sint64s =
+          protobuf_test_messages_proto3_TestAllTypesProto3_repeated_sint64(
+              parsed, &n);
+      ASSERT_EQ(count, n);
+      const bool* bools =
+          protobuf_test_messages_proto3_TestAllTypesProto3_repeated_bool(
+              parsed, &n);
+      ASSERT_EQ(count, n);
+      const int32_t* enums =
+          protobuf_test_messages_proto3_TestAllTypesProto3_repeated_nested_enum(
+              parsed, &n);
+      ASSERT_EQ(count, n);
+      for (int i = 0; i < count; i++) {
+        uint64_t v = PackedVarintValue(i);
+        EXPECT_EQ((int32_t)v, int32s[i]);
+        EXPECT_EQ((int64_t)v, int64s[i]);
+        EXPECT_EQ((uint32_t)v, uint32s[i]);
+        EXPECT_EQ(-(int32_t)v, sint32s[i]);
+        EXPECT_EQ(-(int64_t)v, sint64s[i]);
+        EXPECT_EQ((bool)(v & 1), bools[i]);
+        EXPECT_EQ(i % 2 ? -1 : 2, enums[i]);
+      }
+    }
+  }
+
+  // A varint longer than ten bytes is rejected wherever it falls in the field.
+  for (int prefix : {0, 5, 20}) {
+    std::string data = "\xfa\x01";  // Field 31, length-delimited.
+    data.push_back(prefix + 11 + 20);
+    data.append(prefix, '\x01');
+    data.append(11, '\x80');
+    data.append(20, '\x01');
+    upb::Arena arena;
+    EXPECT_EQ(nullptr, protobuf_test_messages_proto3_TestAllTypesProto3_parse(
+                           data.data(), data.size(), arena.ptr()));
+  }
+}
+
+TEST(GeneratedCode, DecodeBatch) {
+  upb::Arena arena;
+  std::vector<std::string> serialized;
+  for (int i = 0; i < 4; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+        protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(msg, i);
+    size_t size;
+    char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+        msg, arena.ptr(), &size);
+    ASSERT_NE(nullptr, data);
+    serialized.emplace_back(data, size);
+  }
+  // A truncated varint.
+  serialized[2] = "\x08\x80";
+
+  upb_StringView bufs[4];
+  for (int i = 0; i < 4; i++) {
+    bufs[i] = upb_StringView_FromDataAndSize(serialized[i].data(),
+                                             serialized[i].size());
+  }
+  upb_Message* msgs[4] = {nullptr, nullptr, nullptr, nullptr};
+  msgs[3] = upb_Message_New(
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init, arena.ptr());
+  upb_Message* existing = msgs[3];
+  upb_DecodeStatus statuses[4];
+
+  EXPECT_EQ(3, upb_DecodeBatch(
+                   bufs, 4, msgs,
+                   &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init,
+                   nullptr, 0, arena.ptr(), statuses));
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, statuses[0]);
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, statuses[1]);
+  EXPECT_EQ(kUpb_DecodeStatus_Malformed, statuses[2]);
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, statuses[3]);
+  EXPECT_EQ(existing, msgs[3]);
+  for (int i : {0, 1, 3}) {
+    EXPECT_EQ(i, protobuf_test_messages_proto3_TestAllTypesProto3_optional_int32(
+                     (protobuf_test_messages_proto3_TestAllTypesProto3*)msgs[i]));
+  }
+}
+
+TEST(GeneratedCode, DecodeExplicitStack) {
+  upb::Arena arena;
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init;
+  // 1000 levels of TestAllTypesProto2 -> NestedMessage -> TestAllTypesProto2,
+  // with a repeated sub-message and a scalar at every level.
+  protobuf_test_messages_proto2_TestAllTypesProto2* root =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena.ptr());
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg = root;
+  for (int i = 0; i < 1000; i++) {
+    protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(msg, i);
+    protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_set_a(
+        protobuf_test_messages_proto2_TestAllTypesProto2_add_repeated_nested_message(
+            msg, arena.ptr()),
+        i);
+    msg = protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_mutable_corecursive(
+        protobuf_test_messages_proto2_TestAllTypesProto2_mutable_optional_nested_message(
+            msg, arena.ptr()),
+        arena.ptr());
+  }
+  char* data;
+  size_t size;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(root, mt, upb_EncodeOptions_MaxDepth(5000), arena.ptr(),
+                       &data, &size));
+  const std::string serialized(data, size);
+
+  for (int options : {0, (int)kUpb_DecodeOption_ExplicitStack}) {
+    // The default depth limit still applies.
+    upb_Message* parsed = upb_Message_New(mt, arena.ptr());
+    EXPECT_EQ(kUpb_DecodeStatus_MaxDepthExceeded,
+              upb_Decode(data, size, parsed, mt, nullptr, options, arena.ptr()));
+
+    // Truncated input fails cleanly however deep the stack is.
+    parsed = upb_Message_New(mt, arena.ptr());
+    EXPECT_EQ(kUpb_DecodeStatus_Malformed,
+              upb_Decode(data, size - 1, parsed, mt, nullptr,
+                         options | upb_DecodeOptions_MaxDepth(5000),
+                         arena.ptr()));
+
+    parsed = upb_Message_New(mt, arena.ptr());
+    ASSERT_EQ(kUpb_DecodeStatus_Ok,
+              upb_Decode(data, size, parsed, mt, nullptr,
+                         options | upb_DecodeOptions_MaxDepth(5000),
+                         arena.ptr()));
+    char* data2;
+    size_t size2;
+    ASSERT_EQ(kUpb_EncodeStatus_Ok,
+              upb_Encode(parsed, mt, upb_EncodeOptions_MaxDepth(5000),
+                         arena.ptr(), &data2, &size2));
+    EXPECT_EQ(serialized, std::string(data2, size2));
+  }
+}
+
+TEST(GeneratedCode, DecodeMaxSpaceAllocated) {
+  upb::Arena arena;
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init;
+  // Each empty sub-message is 2 bytes on the wire, but much more in memory.
+  std::string serialized;
+  for (int i = 0; i < 10000; i++) serialized.append("\x82\x03\x00", 3);
+
+  upb_ArenaOptions options = {};
+  options.max_space_allocated = 64 * 1024;
+  upb::Arena limited(options);
+  upb_Message* parsed = upb_Message_New(mt, limited.ptr());
+  EXPECT_EQ(kUpb_DecodeStatus_OutOfMemory,
+            upb_Decode(serialized.data(), serialized.size(), parsed, mt,
+                       nullptr, 0, limited.ptr()));
+  EXPECT_LE(upb_Arena_SpaceAllocated(limited.ptr()),
+            options.max_space_allocated);
+
+  parsed = upb_Message_New(mt, arena.ptr());
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(serialized.data(), serialized.size(), parsed, mt,
+                       nullptr, 0, arena.ptr()));
+}
+
+TEST(GeneratedCode, DecodeInternStrings) {
+  upb::Arena arena;
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena.ptr());
+  const std::string value(60, 'v');
+  for (int i = 0; i < 1000; i++) {
+    std::string key = "key" + std::to_string(i);
+    protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_set(
+        msg, upb_StringView_FromDataAndSize(key.data(), key.size()),
+        upb_StringView_FromDataAndSize(value.data(), value.size()),
+        arena.ptr());
+  }
+  size_t size;
+  char* data = protobuf_test_messages_proto2_TestAllTypesProto2_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(data, nullptr);
+
+  size_t space[2];
+  for (int options : {0, (int)kUpb_DecodeOption_InternStrings,
+                      kUpb_DecodeOption_InternStrings |
+                          kUpb_DecodeOption_AliasString}) {
+    // Equal blocks make the space allocated track the space used.
+    upb_ArenaOptions arena_options = {};
+    arena_options.initial_block_size = 4096;
+    arena_options.growth_factor = 1;
+    upb::Arena decode_arena(arena_options);
+    size_t before = upb_Arena_SpaceAllocated(decode_arena.ptr());
+    protobuf_test_messages_proto2_TestAllTypesProto2* parsed =
+        protobuf_test_messages_proto2_TestAllTypesProto2_parse_ex(
+            data, size, nullptr, options, decode_arena.ptr());
+    ASSERT_NE(parsed, nullptr);
+
+    upb_StringView v0, v1;
+    ASSERT_TRUE(
+        protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_get(
+            parsed, upb_StringView_FromString("key0"), &v0));
+    ASSERT_TRUE(
+        protobuf_test_messages_proto2_TestAllTypesProto2_map_string_string_get(
+            parsed, upb_StringView_FromString("key1"), &v1));
+    EXPECT_EQ(value, std::string(v0.data, v0.size));
+    EXPECT_EQ(value, std::string(v1.data, v1.size));
+    if (options & kUpb_DecodeOption_AliasString) {
+      // Aliased strings are left alone.
+      EXPECT_TRUE(v0.data >= data && v0.data < data + size);
+      EXPECT_TRUE(v1.data >= data && v1.data < data + size);
+    } else {
+      bool intern = options & kUpb_DecodeOption_InternStrings;
+      EXPECT_EQ(intern, v0.data == v1.data);
+      space[intern] = upb_Arena_SpaceAllocated(decode_arena.ptr()) - before;
+    }
+  }
+  EXPECT_LT(space[1], space[0]);
+}
+
+TEST(GeneratedCode, DecodeSelected) {
+  upb::Arena arena;
+  upb_test_ModelWithSubMessages* msg =
+      upb_test_ModelWithSubMessages_new(arena.ptr());
+  upb_test_ModelWithSubMessages_set_id(msg, 1);
+  upb_test_ModelWithExtensions* child =
+      upb_test_ModelWithSubMessages_mutable_optional_child(msg, arena.ptr());
+  upb_test_ModelWithExtensions_set_random_int32(child, 2);
+  upb_test_ModelWithExtensions_set_random_name(child,
+                                               upb_StringView_FromString("x"));
+  for (int i = 0; i < 3; i++) {
+    upb_test_ModelWithExtensions* item =
+        upb_test_ModelWithSubMessages_add_items(msg, arena.ptr());
+    upb_test_ModelWithExtensions_set_random_int32(item, i);
+    upb_test_ModelWithExtensions_add_repeated_int32(item, i, arena.ptr());
+  }
+  size_t size;
+  char* data = upb_test_ModelWithSubMessages_serialize(msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+
+  upb_FieldSelection* selection = upb_FieldSelection_New(
+      &upb_test_ModelWithSubMessages_msg_init, arena.ptr());
+  ASSERT_NE(nullptr, selection);
+  const uint32_t id_path[] = {4};
+  const uint32_t child_int32_path[] = {5, 3};
+  const uint32_t items_int32_path[] = {6, 3};
+  EXPECT_TRUE(upb_FieldSelection_AddPath(selection, id_path, 1, arena.ptr()));
+  EXPECT_TRUE(
+      upb_FieldSelection_AddPath(selection, child_int32_path, 2, arena.ptr()));
+  EXPECT_TRUE(
+      upb_FieldSelection_AddPath(selection, items_int32_path, 2, arena.ptr()));
+
+  // Invalid paths are rejected.
+  const uint32_t missing_path[] = {5, 999};
+  const uint32_t scalar_path[] = {4, 1};
+  EXPECT_FALSE(upb_FieldSelection_AddPath(selection, id_path, 0, arena.ptr()));
+  EXPECT_FALSE(
+      upb_FieldSelection_AddPath(selection, missing_path, 2, arena.ptr()));
+  EXPECT_FALSE(
+      upb_FieldSelection_AddPath(selection, scalar_path, 2, arena.ptr()));
+  upb_FieldSelection* map_selection =
+      upb_FieldSelection_New(&upb_test_ModelWithMaps_msg_init, arena.ptr());
+  ASSERT_NE(nullptr, map_selection);
+  const uint32_t map_path[] = {5, 1};
+  EXPECT_FALSE(
+      upb_FieldSelection_AddPath(map_selection, map_path, 2, arena.ptr()));
+
+  upb_test_ModelWithSubMessages* parsed =
+      upb_test_ModelWithSubMessages_new(arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_DecodeSelected(data, size, (upb_Message*)parsed, selection,
+                               nullptr, 0, arena.ptr()));
+  EXPECT_EQ(1, upb_test_ModelWithSubMessages_id(parsed));
+  const upb_test_ModelWithExtensions* parsed_child =
+      upb_test_ModelWithSubMessages_optional_child(parsed);
+  ASSERT_NE(nullptr, parsed_child);
+  EXPECT_EQ(2, upb_test_ModelWithExtensions_random_int32(parsed_child));
+  EXPECT_FALSE(upb_test_ModelWithExtensions_has_random_name(parsed_child));
+
+  size_t len;
+  const upb_test_ModelWithExtensions* const* items =
+      upb_test_ModelWithSubMessages_items(parsed, &len);
+  ASSERT_EQ(3, len);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(i, upb_test_ModelWithExtensions_random_int32(items[i]));
+    upb_test_ModelWithExtensions_repeated_int32(items[i], &len);
+    EXPECT_EQ(0, len);
+  }
+
+  // Skipped fields are not preserved as unknown fields.
+  size_t unknown_size;
+  upb_Message_GetUnknown((const upb_Message*)parsed_child, &unknown_size);
+  EXPECT_EQ(0, unknown_size);
+  upb_Message_GetUnknown((const upb_Message*)items[0], &unknown_size);
+  EXPECT_EQ(0, unknown_size);
+
+  // Selecting a whole message field supersedes narrower paths into it.
+  const uint32_t child_path[] = {5};
+  EXPECT_TRUE(
+      upb_FieldSelection_AddPath(selection, child_path, 1, arena.ptr()));
+  parsed = upb_test_ModelWithSubMessages_new(arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_DecodeSelected(data, size, (upb_Message*)parsed, selection,
+                               nullptr, 0, arena.ptr()));
+  parsed_child = upb_test_ModelWithSubMessages_optional_child(parsed);
+  ASSERT_NE(nullptr, parsed_child);
+  upb_StringView name = upb_test_ModelWithExtensions_random_name(parsed_child);
+  EXPECT_EQ("x", std::string(name.data, name.size));
+}
+
+TEST(GeneratedCode, EncodeExcluding) {
+  upb::Arena arena;
+  upb_test_ModelWithSubMessages* msg =
+      upb_test_ModelWithSubMessages_new(arena.ptr());
+  upb_test_ModelWithSubMessages_set_id(msg, 1);
+  upb_test_ModelWithExtensions* child =
+      upb_test_ModelWithSubMessages_mutable_optional_child(msg, arena.ptr());
+  upb_test_ModelWithExtensions_set_random_int32(child, 2);
+  upb_test_ModelWithExtensions_set_random_name(child,
+                                               upb_StringView_FromString("x"));
+  for (int i = 0; i < 3; i++) {
+    upb_test_ModelWithExtensions* item =
+        upb_test_ModelWithSubMessages_add_items(msg, arena.ptr());
+    upb_test_ModelWithExtensions_set_random_int32(item, i);
+    upb_test_ModelWithExtensions_add_repeated_int32(item, i, arena.ptr());
+  }
+
+  const upb_MiniTable* mini_table = &upb_test_ModelWithSubMessages_msg_init;
+  upb_FieldSelection* exclude = upb_FieldSelection_New(mini_table, arena.ptr());
+  ASSERT_NE(nullptr, exclude);
+  const uint32_t id_path[] = {4};
+  const uint32_t child_name_path[] = {5, 4};
+  const uint32_t items_int32_path[] = {6, 5};
+  EXPECT_TRUE(upb_FieldSelection_AddPath(exclude, id_path, 1, arena.ptr()));
+  EXPECT_TRUE(
+      upb_FieldSelection_AddPath(exclude, child_name_path, 2, arena.ptr()));
+  EXPECT_TRUE(
+      upb_FieldSelection_AddPath(exclude, items_int32_path, 2, arena.ptr()));
+
+  size_t size;
+  char* data;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_EncodeExcluding(msg, mini_table, exclude, 0, arena.ptr(),
+                                &data, &size));
+
+  // The output matches a plain encode of the message with the excluded
+  // fields cleared.
+  upb_test_ModelWithSubMessages_clear_id(msg);
+  upb_test_ModelWithExtensions_clear_random_name(child);
+  size_t len;
+  upb_test_ModelWithExtensions** items =
+      upb_test_ModelWithSubMessages_mutable_items(msg, &len);
+  for (size_t i = 0; i < len; i++) {
+    upb_test_ModelWithExtensions_clear_repeated_int32(items[i]);
+  }
+  size_t expected_size;
+  char* expected =
+      upb_test_ModelWithSubMessages_serialize(msg, arena.ptr(), &expected_size);
+  ASSERT_NE(nullptr, expected);
+  EXPECT_EQ(std::string(expected, expected_size), std::string(data, size));
+
+  // An empty exclusion set encodes everything.
+  upb_FieldSelection* none = upb_FieldSelection_New(mini_table, arena.ptr());
+  ASSERT_NE(nullptr, none);
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_EncodeExcluding(msg, mini_table, none, 0, arena.ptr(), &data,
+                                &size));
+  EXPECT_EQ(std::string(expected, expected_size), std::string(data, size));
+}
+
+TEST(GeneratedCode, AliasUnknown) {
+  upb::Arena arena;
+  upb_test_ModelWithSubMessages* msg =
+      upb_test_ModelWithSubMessages_new(arena.ptr());
+  upb_test_ModelWithSubMessages_set_id(msg, 1);
+  upb_test_ModelWithExtensions_set_random_int32(
+      upb_test_ModelWithSubMessages_mutable_optional_child(msg, arena.ptr()), 2);
+  for (int i = 0; i < 10; i++) {
+    upb_test_ModelWithExtensions_set_random_name(
+        upb_test_ModelWithSubMessages_add_items(msg, arena.ptr()),
+        upb_StringView_FromString("some item"));
+  }
+  size_t size;
+  char* data = upb_test_ModelWithSubMessages_serialize(msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+
+  // All of the data is unknown to this type, so it is referenced in place.
+  const int options = kUpb_DecodeOption_AliasString |
+                      kUpb_DecodeOption_AliasUnknown;
+  upb_Message* empty =
+      upb_Message_New(&upb_test_EmptyMessageWithExtensions_msg_init,
+                      arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(data, size, empty,
+                       &upb_test_EmptyMessageWithExtensions_msg_init, nullptr,
+                       options, arena.ptr()));
+  size_t unknown_size;
+  const char* unknown = upb_Message_GetUnknown(empty, &unknown_size);
+  EXPECT_EQ(data, unknown);
+  EXPECT_EQ(size, unknown_size);
+
+  char* reencoded;
+  size_t reencoded_size;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(empty, &upb_test_EmptyMessageWithExtensions_msg_init, 0,
+                       arena.ptr(), &reencoded, &reencoded_size));
+  EXPECT_EQ(std::string(data, size), std::string(reencoded, reencoded_size));
+
+  // Unknown fields that are interrupted by a known one are copied.
+  const std::string interrupted = "\x08\x01\x18\x05\x10\x02";
+  upb_test_ModelWithExtensions* known =
+      upb_test_ModelWithExtensions_new(arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(interrupted.data(), interrupted.size(),
+                       (upb_Message*)known,
+                       &upb_test_ModelWithExtensions_msg_init, nullptr,
+                       options, arena.ptr()));
+  EXPECT_EQ(5, upb_test_ModelWithExtensions_random_int32(known));
+  unknown = upb_Message_GetUnknown((upb_Message*)known, &unknown_size);
+  EXPECT_EQ("\x08\x01\x10\x02", std::string(unknown, unknown_size));
+
+  // A truncated unknown field at the end of the input is never read from
+  // beyond the end of the caller's buffer.
+  const char truncated[] = "\xfa\xf0\x04\x03" "abc\x08\x01\xf0\xf0\x04\x80";
+  std::vector<char> buf(truncated, truncated + sizeof(truncated) - 1);
+  protobuf_test_messages_proto2_TestAllTypesProto2* all =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena.ptr());
+  EXPECT_NE(
+      kUpb_DecodeStatus_Ok,
+      upb_Decode(buf.data(), buf.size(), (upb_Message*)all,
+                 &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+                 nullptr, options, arena.ptr()));
+}
+
+TEST(GeneratedCode, AliasFixedArrays) {
+  // optional_int32 (five bytes), then the tag and length of repeated_double,
+  // so that the packed doubles start eight bytes into the buffer.
+  std::string wire("\x08\x80\x80\x80\x01\xd2\x02\x18", 8);
+  const double values[] = {1.5, -2.25, 1e300};
+  wire.append(reinterpret_cast<const char*>(values), sizeof(values));
+  std::vector<uint64_t> storage(wire.size() / 8 + 1);
+  char* buf = reinterpret_cast<char*>(storage.data());
+  memcpy(buf, wire.data(), wire.size());
+
+  upb::Arena arena;
+  const int options =
+      kUpb_DecodeOption_AliasString | kUpb_DecodeOption_AliasFixedArrays;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_parse_ex(
+          buf, wire.size(), nullptr, options, arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  size_t size;
+  const double* got =
+      protobuf_test_messages_proto3_TestAllTypesProto3_repeated_double(msg,
+                                                                       &size);
+  ASSERT_EQ(3, size);
+  EXPECT_EQ(buf + 8, reinterpret_cast<const char*>(got));
+  EXPECT_EQ(1e300, got[2]);
+  const upb_MiniTable* mini_table =
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+  const upb_MiniTableField* field =
+      upb_MiniTable_FindFieldByNumber(mini_table, 42);
+  EXPECT_TRUE(upb_Array_IsFrozen(upb_Message_GetArray(msg, field)));
+
+  char* reencoded;
+  size_t reencoded_size;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, mini_table, 0, arena.ptr(), &reencoded,
+                       &reencoded_size));
+  EXPECT_EQ(wire, std::string(reencoded, reencoded_size));
+
+  // Without kUpb_DecodeOption_AliasString the data is copied.
+  msg = protobuf_test_messages_proto3_TestAllTypesProto3_parse_ex(
+      buf, wire.size(), nullptr, kUpb_DecodeOption_AliasFixedArrays,
+      arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  got = protobuf_test_messages_proto3_TestAllTypesProto3_repeated_double(
+      msg, &size);
+  ASSERT_EQ(3, size);
+  EXPECT_NE(buf + 8, reinterpret_cast<const char*>(got));
+  EXPECT_FALSE(upb_Array_IsFrozen(upb_Message_GetArray(msg, field)));
+
+  // A second piece of the same field is appended to a copy.
+  std::string twice = wire + wire.substr(5);
+  storage.resize(twice.size() / 8 + 1);
+  buf = reinterpret_cast<char*>(storage.data());
+  memcpy(buf, twice.data(), twice.size());
+  msg = protobuf_test_messages_proto3_TestAllTypesProto3_parse_ex(
+      buf, twice.size(), nullptr, options, arena.ptr());
+  ASSERT_NE(nullptr, msg);
+  got = protobuf_test_messages_proto3_TestAllTypesProto3_repeated_double(
+      msg, &size);
+  ASSERT_EQ(6, size);
+  EXPECT_FALSE(upb_Array_IsFrozen(upb_Message_GetArray(msg, field)));
+  for (int i = 0; i < 6; i++) EXPECT_EQ(values[i % 3], got[i]);
+}
+
+TEST(GeneratedCode, IncrementalDecode) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  std::string long_string(300, 'x');
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(msg, 123);
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_string(
+      msg, upb_StringView_FromDataAndSize(long_string.data(),
+                                          long_string.size()));
+  protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_set_a(
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_optional_nested_message(
+          msg, arena.ptr()),
+      5);
+  for (int i = 0; i < 50; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int32(
+        msg, i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_string(
+        msg, upb_StringView_FromString("str"), arena.ptr());
+  }
+  size_t size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+  std::string serialized(data, size);
+
+  for (size_t chunk : {1, 2, 3, 5, 16, 100, 1000}) {
+    upb::Arena arena2;
+    protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+        protobuf_test_messages_proto3_TestAllTypesProto3_new(arena2.ptr());
+    upb_IncrementalDecoder* d = upb_IncrementalDecoder_New(
+        parsed, &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init,
+        nullptr, 0, arena2.ptr());
+    ASSERT_NE(nullptr, d);
+    for (size_t ofs = 0; ofs < size; ofs += chunk) {
+      // Copy each chunk to its own buffer so that reads past the end of a
+      // chunk are caught by sanitizers.
+      std::string piece = serialized.substr(ofs, chunk);
+      upb_DecodeStatus status =
+          upb_IncrementalDecoder_Feed(d, piece.data(), piece.size());
+      ASSERT_TRUE(status == kUpb_DecodeStatus_Ok ||
+                  status == kUpb_DecodeStatus_NeedMoreData)
+          << status;
+    }
+    ASSERT_EQ(kUpb_DecodeStatus_Ok, upb_IncrementalDecoder_Finish(d));
+
+    size_t size2;
+    char* data2 = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+        parsed, arena2.ptr(), &size2);
+    EXPECT_EQ(serialized, std::string(data2, size2)) << chunk;
+  }
+
+  // Input that ends in the middle of a field is malformed.
+  protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  upb_IncrementalDecoder* d = upb_IncrementalDecoder_New(
+      parsed, &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init,
+      nullptr, 0, arena.ptr());
+  EXPECT_EQ(kUpb_DecodeStatus_NeedMoreData,
+            upb_IncrementalDecoder_Feed(d, serialized.data(), size - 1));
+  EXPECT_EQ(kUpb_DecodeStatus_Malformed, upb_IncrementalDecoder_Finish(d));
+}
+
+TEST(GeneratedCode, IncrementalDecodeLargeGroup) {
+  // A group whose size is not known until its end tag arrives, with some
+  // unknown groups nested inside it.
+  std::string wire = "\xcb\x0c";  // Start of Data.
+  for (int i = 0; i < 20000; i++) {
+    if (i % 1000 == 0) wire += "\xeb\x0c\x08\x01\xec\x0c";
+    wire += "\xd0\x0c";  // group_int32
+    wire += static_cast<char>(i % 100);
+  }
+  wire += "\xcc\x0c";  // End of Data.
+
+  // Feeding the group a byte at a time must not rescan it from the start
+  // each time, or this takes far too long.
+  for (size_t chunk : {1, 16}) {
+    upb::Arena arena;
+    protobuf_test_messages_proto2_TestAllTypesProto2* parsed =
+        protobuf_test_messages_proto2_TestAllTypesProto2_new(arena.ptr());
+    upb_IncrementalDecoder* d = upb_IncrementalDecoder_New(
+        parsed, &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+        nullptr, 0, arena.ptr());
+    ASSERT_NE(nullptr, d);
+    for (size_t ofs = 0; ofs < wire.size(); ofs += chunk) {
+      std::string piece = wire.substr(ofs, chunk);
+      ASSERT_EQ(ofs + piece.size() < wire.size()
+                    ? kUpb_DecodeStatus_NeedMoreData
+                    : kUpb_DecodeStatus_Ok,
+                upb_IncrementalDecoder_Feed(d, piece.data(), piece.size()));
+    }
+    ASSERT_EQ(kUpb_DecodeStatus_Ok, upb_IncrementalDecoder_Finish(d));
+    const protobuf_test_messages_proto2_TestAllTypesProto2_Data* data =
+        protobuf_test_messages_proto2_TestAllTypesProto2_data(parsed);
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(
+        99,
+        protobuf_test_messages_proto2_TestAllTypesProto2_Data_group_int32(data));
+  }
+}
+
+TEST(GeneratedCode, DecodeIovec) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  std::string long_string(300, 'x');
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(msg, 123);
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_string(
+      msg, upb_StringView_FromDataAndSize(long_string.data(),
+                                          long_string.size()));
+  for (int i = 0; i < 50; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_string(
+        msg, upb_StringView_FromString("str"), arena.ptr());
+  }
+  size_t size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+  std::string serialized(data, size);
+
+  for (size_t segment_size : {1, 7, 64, 400, 10000}) {
+    for (int options : {0, static_cast<int>(kUpb_DecodeOption_AliasString)}) {
+      // Each segment has its own buffer so that reads past the end of one are
+      // caught by sanitizers.
+      std::vector<std::string> pieces;
+      for (size_t ofs = 0; ofs < size; ofs += segment_size) {
+        pieces.push_back(serialized.substr(ofs, segment_size));
+      }
+      std::vector<upb_StringView> segments;
+      for (const std::string& piece : pieces) {
+        segments.push_back(
+            upb_StringView_FromDataAndSize(piece.data(), piece.size()));
+      }
+
+      upb::Arena arena2;
+      protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+          protobuf_test_messages_proto3_TestAllTypesProto3_new(arena2.ptr());
+      ASSERT_EQ(kUpb_DecodeStatus_Ok,
+                upb_DecodeIovec(
+                    segments.data(), segments.size(), parsed,
+                    &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init,
+                    nullptr, options, arena2.ptr()))
+          << segment_size;
+      size_t size2;
+      char* data2 = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+          parsed, arena2.ptr(), &size2);
+      EXPECT_EQ(serialized, std::string(data2, size2)) << segment_size;
+
+      if (segment_size == 400 && options) {
+        // The long string lies within the first segment, and is aliased.
+        upb_StringView str =
+            protobuf_test_messages_proto3_TestAllTypesProto3_optional_string(
+                parsed);
+        EXPECT_GE(str.data, pieces[0].data());
+        EXPECT_LE(str.data + str.size, pieces[0].data() + pieces[0].size());
+      }
+    }
+  }
+
+  // Input that ends in the middle of a field is malformed.
+  upb_StringView segments[] = {
+      upb_StringView_FromDataAndSize(serialized.data(), 10),
+      upb_StringView_FromDataAndSize(serialized.data() + 10, size - 11),
+  };
+  protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  EXPECT_EQ(kUpb_DecodeStatus_Malformed,
+            upb_DecodeIovec(
+                segments, 2, parsed,
+                &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init,
+                nullptr, 0, arena.ptr()));
+}
+
+TEST(GeneratedCode, EncodeToStream) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  std::string long_string(300, 'x');
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(msg, -1);
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_string(
+      msg, upb_StringView_FromDataAndSize(long_string.data(),
+                                          long_string.size()));
+  protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage* nested =
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_optional_nested_message(
+          msg, arena.ptr());
+  protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_set_a(nested,
+                                                                       5);
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(
+      protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_mutable_corecursive(
+          nested, arena.ptr()),
+      7);
+  for (int i = 0; i < 50; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int32(
+        msg, i * 1000 - 100, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_unpacked_double(
+        msg, i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_set_a(
+        protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_nested_message(
+            msg, arena.ptr()),
+        i);
+  }
+  size_t size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize_ex(
+      msg, kUpb_EncodeOption_Deterministic, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+  std::string serialized(data, size);
+
+  for (size_t chunk : {1, 2, 3, 5, 16, 100, 10000}) {
+    std::string buf(size, '\0');
+    upb_ZeroCopyOutputStream* stream =
+        upb_ChunkedOutputStream_New(&buf[0], buf.size(), chunk, arena.ptr());
+    upb_Status status;
+    EXPECT_EQ(kUpb_EncodeStatus_Ok,
+              upb_EncodeToStream(
+                  msg, &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init,
+                  kUpb_EncodeOption_Deterministic, arena.ptr(), stream,
+                  &status));
+    EXPECT_EQ(size, upb_ZeroCopyOutputStream_ByteCount(stream));
+    EXPECT_EQ(serialized, buf) << chunk;
+  }
+
+  // Running out of room in the stream is reported as a write error.
+  std::string buf(size - 1, '\0');
+  upb_ZeroCopyOutputStream* stream =
+      upb_ChunkedOutputStream_New(&buf[0], buf.size(), 16, arena.ptr());
+  upb_Status status;
+  EXPECT_EQ(kUpb_EncodeStatus_WriteError,
+            upb_EncodeToStream(
+                msg, &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init,
+                0, arena.ptr(), stream, &status));
+  EXPECT_FALSE(upb_Status_IsOk(&status));
+}
+
+TEST(GeneratedCode, ByteSize) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+  size_t size;
+  EXPECT_EQ(kUpb_EncodeStatus_Ok, upb_Message_ByteSize(msg, mt, 0, &size));
+  EXPECT_EQ(0, size);
+
+  std::string long_string(200, 'x');
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(msg, -1);
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_string(
+      msg, upb_StringView_FromDataAndSize(long_string.data(),
+                                          long_string.size()));
+  protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_set_a(
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_optional_nested_message(
+          msg, arena.ptr()),
+      300);
+  for (int i = 0; i < 20; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int32(
+        msg, i * 100, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_unpacked_int32(
+        msg, -i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_string(
+        msg, upb_StringView_FromString("str"), arena.ptr());
+  }
+  size_t encoded_size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &encoded_size);
+  ASSERT_NE(nullptr, data);
+  EXPECT_EQ(kUpb_EncodeStatus_Ok, upb_Message_ByteSize(msg, mt, 0, &size));
+  EXPECT_EQ(encoded_size, size);
+
+  // Only one level of nesting is allowed here.
+  EXPECT_EQ(kUpb_EncodeStatus_MaxDepthExceeded,
+            upb_Message_ByteSize(msg, mt, upb_EncodeOptions_MaxDepth(1),
+                                 &size));
+
+  // Unknown fields are counted unless they would be skipped.
+  std::string with_unknown(data, encoded_size);
+  with_unknown += "\xa8\x1f\x01";  // Field 501, varint 1.
+  protobuf_test_messages_proto3_TestAllTypesProto3* parsed =
+      protobuf_test_messages_proto3_TestAllTypesProto3_parse(
+          with_unknown.data(), with_unknown.size(), arena.ptr());
+  ASSERT_NE(nullptr, parsed);
+  EXPECT_EQ(kUpb_EncodeStatus_Ok, upb_Message_ByteSize(parsed, mt, 0, &size));
+  EXPECT_EQ(with_unknown.size(), size);
+  EXPECT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Message_ByteSize(parsed, mt, kUpb_EncodeOption_SkipUnknown,
+                                 &size));
+  EXPECT_EQ(encoded_size, size);
+}
+
+TEST(GeneratedCode, EncodeToBuffer) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(msg, -1);
+  for (int i = 0; i < 20; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_string(
+        msg, upb_StringView_FromString("str"), arena.ptr());
+  }
+  size_t size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+  std::string serialized(data, size);
+
+  // Query the size without a buffer.
+  size_t len;
+  EXPECT_EQ(kUpb_EncodeStatus_NeedMoreSpace,
+            upb_EncodeToBuffer(msg, mt, 0, nullptr, 0, &len));
+  EXPECT_EQ(size, len);
+
+  std::string buf(size - 1, '\0');
+  EXPECT_EQ(kUpb_EncodeStatus_NeedMoreSpace,
+            upb_EncodeToBuffer(msg, mt, 0, &buf[0], buf.size(), &len));
+  EXPECT_EQ(size, len);
+
+  // An exactly-sized buffer and a larger one both work.
+  for (size_t cap : {size, size + 100}) {
+    buf.assign(cap, '\0');
+    EXPECT_EQ(kUpb_EncodeStatus_Ok,
+              upb_EncodeToBuffer(msg, mt, 0, &buf[0], buf.size(), &len));
+    EXPECT_EQ(serialized, buf.substr(0, len));
+  }
+}
+
+TEST(GeneratedCode, EncodeWithSizeHint) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+  for (int i = 0; i < 1000; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int64(
+        msg, -i, arena.ptr());
+  }
+  size_t size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+  std::string serialized(data, size);
+
+  // Hints that are too small, exact and too large all give the same output.
+  for (size_t hint : {(size_t)1, size / 3, size, size + 100}) {
+    upb::Arena encode_arena;
+    char* out;
+    size_t len;
+    ASSERT_EQ(kUpb_EncodeStatus_Ok,
+              upb_EncodeWithSizeHint(msg, mt, 0, hint, encode_arena.ptr(),
+                                     &out, &len));
+    EXPECT_EQ(serialized, std::string(out, len));
+    if (hint >= size) {
+      // The hinted buffer was used as is.
+      EXPECT_LT(upb_Arena_SpaceAllocated(encode_arena.ptr()), hint + 1024);
+    }
+  }
+}
+
+TEST(GeneratedCode, EncodeToSegments) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+  std::string big(5000, 'x');
+  std::string small(10, 'y');
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(msg, 1);
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_bytes(
+      msg, upb_StringView_FromDataAndSize(big.data(), big.size()));
+  for (int i = 0; i < 100; i++) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_string(
+        msg, upb_StringView_FromDataAndSize(small.data(), small.size()),
+        arena.ptr());
+  }
+  protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_string(
+      msg, upb_StringView_FromDataAndSize(big.data(), big.size()),
+      arena.ptr());
+  protobuf_test_messages_proto3_TestAllTypesProto3* child =
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_recursive_message(
+          msg, arena.ptr());
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_string(
+      child, upb_StringView_FromDataAndSize(big.data(), big.size()));
+  size_t size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+      msg, arena.ptr(), &size);
+  ASSERT_NE(nullptr, data);
+  std::string serialized(data, size);
+
+  for (size_t min_ref_size : {(size_t)1, (size_t)1000, (size_t)10000}) {
+    upb::Arena encode_arena;
+    upb_StringView* segments;
+    size_t count;
+    ASSERT_EQ(kUpb_EncodeStatus_Ok,
+              upb_EncodeToSegments(msg, mt, 0, min_ref_size,
+                                   encode_arena.ptr(), &segments, &count));
+    std::string joined;
+    size_t refs = 0;
+    for (size_t i = 0; i < count; i++) {
+      EXPECT_NE(0, segments[i].size);
+      joined.append(segments[i].data, segments[i].size);
+      if (segments[i].data == big.data()) refs++;
+    }
+    EXPECT_EQ(serialized, joined);
+
+    // The large strings were referenced, not copied.
+    EXPECT_EQ(min_ref_size <= big.size() ? 3 : 0, refs);
+    if (min_ref_size == 1000) {
+      EXPECT_LT(upb_Arena_SpaceAllocated(encode_arena.ptr()), big.size());
+    }
+  }
+}
+
+TEST(GeneratedCode, EncodeCache) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+  std::string big(500, 'x');
+  protobuf_test_messages_proto3_TestAllTypesProto3* child =
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_recursive_message(
+          msg, arena.ptr());
+  protobuf_test_messages_proto3_TestAllTypesProto3* grandchild =
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_recursive_message(
+          child, arena.ptr());
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_string(
+      grandchild, upb_StringView_FromDataAndSize(big.data(), big.size()));
+  protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage* nested =
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_optional_nested_message(
+          msg, arena.ptr());
+
+  // Every encoding with the cache must match one without it, whichever
+  // accessor changed the message in between.
+  auto expect_same = [&]() {
+    upb::Arena plain_arena;
+    size_t plain_size;
+    char* plain = protobuf_test_messages_proto3_TestAllTypesProto3_serialize(
+        msg, plain_arena.ptr(), &plain_size);
+    ASSERT_NE(nullptr, plain);
+    size_t size;
+    char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize_ex(
+        msg, kUpb_EncodeOption_CacheEncodings, arena.ptr(), &size);
+    ASSERT_NE(nullptr, data);
+    EXPECT_EQ(std::string(plain, plain_size), std::string(data, size));
+  };
+
+  expect_same();
+  expect_same();
+  protobuf_test_messages_proto3_TestAllTypesProto3_set_optional_int32(
+      grandchild, 1);
+  expect_same();
+  protobuf_test_messages_proto3_TestAllTypesProto3_NestedMessage_set_a(nested,
+                                                                       2);
+  expect_same();
+  protobuf_test_messages_proto3_TestAllTypesProto3_add_repeated_int32(
+      child, 3, arena.ptr());
+  expect_same();
+  int32_t* ints =
+      protobuf_test_messages_proto3_TestAllTypesProto3_mutable_repeated_int32(
+          child, nullptr);
+  ints[0] = 4;
+  expect_same();
+  protobuf_test_messages_proto3_TestAllTypesProto3_clear_optional_string(
+      grandchild);
+  expect_same();
+
+  // Parsing merges into the existing sub-messages.
+  // recursive_message { recursive_message { optional_int32: 5 } }
+  std::string more = "\xda\x01\x05\xda\x01\x02\x08\x05";
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(more.data(), more.size(), msg, mt, nullptr, 0,
+                       arena.ptr()));
+  expect_same();
+  upb_Message_Clear(child, mt);
+  expect_same();
+}
+
+static std::string SerializeDeterministic(
+    const protobuf_test_messages_proto3_TestAllTypesProto3* msg,
+    upb_Arena* arena) {
+  size_t size;
+  char* data = protobuf_test_messages_proto3_TestAllTypesProto3_serialize_ex(
+      msg, kUpb_EncodeOption_Deterministic, arena, &size);
+  return std::string(data, size);
+}
+
+TEST(GeneratedCode, DeterministicMapOrder) {
+  upb::Arena arena;
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg1 =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+  protobuf_test_messages_proto3_TestAllTypesProto3* msg2 =
+      protobuf_test_messages_proto3_TestAllTypesProto3_new(arena.ptr());
+
+  // Enough entries to take the radix and merge sort paths, inserted in
+  // opposite orders.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 200; i++) keys.push_back(std::to_string(i * 7919));
+  for (int i = 0; i < 200; i++) {
+    int j = 199 - i;
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_set(
+        msg1, i * 7919 - 100000, i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_set(
+        msg2, j * 7919 - 100000, j, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_int64_int64_set(
+        msg1, -(int64_t)i << 40, i, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_int64_int64_set(
+        msg2, -(int64_t)j << 40, j, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_set(
+        msg1, upb_StringView_FromString(keys[i].c_str()),
+        upb_StringView_FromString("v"), arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_set(
+        msg2, upb_StringView_FromString(keys[j].c_str()),
+        upb_StringView_FromString("v"), arena.ptr());
+  }
+  std::string serialized = SerializeDeterministic(msg1, arena.ptr());
+  EXPECT_EQ(serialized, SerializeDeterministic(msg2, arena.ptr()));
+
+  // A saved sort order gives the same output.
+  const upb_MiniTable* mt =
+      &protobuf_test_messages_proto3_TestAllTypesProto3_msg_init;
+  upb_Map* int_map = upb_Message_GetMutableMap(
+      msg1, upb_MiniTable_FindFieldByNumber(mt, 56));
+  upb_Map* str_map = upb_Message_GetMutableMap(
+      msg1, upb_MiniTable_FindFieldByNumber(mt, 69));
+  ASSERT_TRUE(upb_Map_SortKeys(int_map, kUpb_CType_Int32, arena.ptr()));
+  ASSERT_TRUE(upb_Map_SortKeys(str_map, kUpb_CType_String, arena.ptr()));
+  EXPECT_EQ(serialized, SerializeDeterministic(msg1, arena.ptr()));
+
+  // Changing a value keeps the saved order valid.
+  protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_set(
+      msg1, -100000, 12345, arena.ptr());
+  protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_set(
+      msg2, -100000, 12345, arena.ptr());
+  EXPECT_EQ(SerializeDeterministic(msg2, arena.ptr()),
+            SerializeDeterministic(msg1, arena.ptr()));
+
+  // Adding and removing keys drops it.
+  ASSERT_TRUE(upb_Map_SortKeys(int_map, kUpb_CType_Int32, arena.ptr()));
+  for (auto* msg : {msg1, msg2}) {
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_set(
+        msg, 5, 5, arena.ptr());
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_int32_int32_delete(
+        msg, 7919 - 100000);
+    protobuf_test_messages_proto3_TestAllTypesProto3_map_string_string_delete(
+        msg, upb_StringView_FromString(keys[3].c_str()));
+  }
+  EXPECT_EQ(SerializeDeterministic(msg2, arena.ptr()),
+            SerializeDeterministic(msg1, arena.ptr()));
+}
+
 TEST(GeneratedCode, Issue9440) {
   upb::Arena arena;
   upb_test_HelloRequest* msg = upb_test_HelloRequest_new(arena.ptr());
@@ -931,3 +2297,74 @@ TEST(GeneratedCode, Extensions) {
   ASSERT_EQ(size1, size2);
   ASSERT_EQ(0, memcmp(pb1, pb2, size1));
 }
+
+TEST(GeneratedCode, MapEntryWireVariants) {
+  upb::Arena arena;
+  const std::string data(
+      // map_im {value {random_int32: 7} key: 1}: value before key.
+      "\x2a\x06\x12\x02\x18\x07\x08\x01"
+      // map_im {key: 1 value {random_name: "x"}}: replaces the value above.
+      "\x2a\x07\x08\x01\x12\x03\x22\x01x"
+      // map_ii {value: 5}: missing key.
+      "\x22\x02\x10\x05"
+      // map_ii {key: 2 value: 6}, plus an unknown field.
+      "\x22\x06\x08\x02\x10\x06\x18\x01"
+      // map_ss {key: "k"}: missing value.
+      "\x1a\x03\x0a\x01k",
+      34);
+  upb_test_ModelWithMaps* msg =
+      upb_test_ModelWithMaps_parse(data.data(), data.size(), arena.ptr());
+  ASSERT_NE(nullptr, msg);
+
+  upb_test_ModelWithExtensions* val;
+  ASSERT_TRUE(upb_test_ModelWithMaps_map_im_get(msg, 1, &val));
+  EXPECT_FALSE(upb_test_ModelWithExtensions_has_random_int32(val));
+  EXPECT_TRUE(upb_StringView_IsEqual(
+      upb_StringView_FromString("x"),
+      upb_test_ModelWithExtensions_random_name(val)));
+
+  int32_t i;
+  ASSERT_TRUE(upb_test_ModelWithMaps_map_ii_get(msg, 0, &i));
+  EXPECT_EQ(5, i);
+  // An entry with unknown fields is preserved as unknown.
+  EXPECT_FALSE(upb_test_ModelWithMaps_map_ii_get(msg, 2, &i));
+  size_t unknown_size;
+  upb_Message_GetUnknown((upb_Message*)msg, &unknown_size);
+  EXPECT_EQ(8, unknown_size);
+
+  upb_StringView s;
+  ASSERT_TRUE(upb_test_ModelWithMaps_map_ss_get(
+      msg, upb_StringView_FromString("k"), &s));
+  EXPECT_EQ(0, s.size);
+
+  // Parsing an entry for a key that is already present replaces its value,
+  // leaving the old one untouched.
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(data.data(), 8, (upb_Message*)msg,
+                       &upb_test_ModelWithMaps_msg_init, nullptr, 0,
+                       arena.ptr()));
+  upb_test_ModelWithExtensions* val2;
+  ASSERT_TRUE(upb_test_ModelWithMaps_map_im_get(msg, 1, &val2));
+  EXPECT_NE(val, val2);
+  EXPECT_EQ(7, upb_test_ModelWithExtensions_random_int32(val2));
+  EXPECT_FALSE(upb_test_ModelWithExtensions_has_random_name(val2));
+  EXPECT_TRUE(upb_StringView_IsEqual(
+      upb_StringView_FromString("x"),
+      upb_test_ModelWithExtensions_random_name(val)));
+}
+
+TEST(GeneratedCode, MapEntryOverlongLength) {
+  upb::Arena arena;
+  // map_string_string {key: ...}, where the key's length varint runs past the
+  // end of the entry.
+  const char data[] =
+      "\xaa\x04\x02\x0a\x80\x80\x80\x80\xf0\xff\xff\xff\xff\x01";
+  std::vector<char> buf(data, data + sizeof(data) - 1);
+  protobuf_test_messages_proto2_TestAllTypesProto2* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena.ptr());
+  EXPECT_NE(
+      kUpb_DecodeStatus_Ok,
+      upb_Decode(buf.data(), buf.size(), (upb_Message*)msg,
+                 &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init,
+                 nullptr, 0, arena.ptr()));
+}
@@ -0,0 +1,697 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/text/decode.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "upb/collections/array.h"
+#include "upb/collections/map.h"
+#include "upb/io/string.h"
+#include "upb/io/tokenizer.h"
+#include "upb/reflection/message.h"
+#include "upb/wire/encode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef struct {
+  upb_Tokenizer* tok;
+  upb_Status tok_status;  // The tokenizer's errors, before they are rewritten.
+  upb_String name;        // Scratch space for "[pkg.ext]" names.
+  upb_Arena* arena;
+  const upb_DefPool* symtab;
+  int options;
+  int depth;
+  upb_Status* status;
+  jmp_buf err;
+} txtdec;
+
+static void txtdec_fields(txtdec* d, upb_Message* msg, const upb_MessageDef* m,
+                          char close);
+static void txtdec_skipfields(txtdec* d, char close);
+
+/* Errors are reported at the current token, with a one-based line and a
+ * zero-based column, like the JSON decoder. */
+
+UPB_NORETURN static void txtdec_err(txtdec* d, const char* msg) {
+  upb_Status_SetErrorFormat(d->status, "Error parsing text format @%d:%d: %s",
+                            upb_Tokenizer_Line(d->tok) + 1,
+                            upb_Tokenizer_Column(d->tok), msg);
+  UPB_LONGJMP(d->err, 1);
+}
+
+UPB_PRINTF(2, 3)
+UPB_NORETURN static void txtdec_errf(txtdec* d, const char* fmt, ...) {
+  va_list argp;
+  upb_Status_SetErrorFormat(d->status, "Error parsing text format @%d:%d: ",
+                            upb_Tokenizer_Line(d->tok) + 1,
+                            upb_Tokenizer_Column(d->tok));
+  va_start(argp, fmt);
+  upb_Status_VAppendErrorFormat(d->status, fmt, argp);
+  va_end(argp);
+  UPB_LONGJMP(d->err, 1);
+}
+
+UPB_NORETURN static void txtdec_expected(txtdec* d, const char* what) {
+  if (upb_Tokenizer_Type(d->tok) == kUpb_TokenType_End) {
+    txtdec_errf(d, "Expected %s, reached end of input", what);
+  }
+  txtdec_errf(d, "Expected %s, found \"%s\"", what,
+              upb_Tokenizer_TextData(d->tok));
+}
+
+static void* txtdec_alloc(txtdec* d, size_t size) {
+  void* ret = upb_Arena_Malloc(d->arena, size);
+  if (!ret) txtdec_err(d, "Out of memory");
+  return ret;
+}
+
+static void txtdec_next(txtdec* d) {
+  if (upb_Tokenizer_Next(d->tok, &d->tok_status)) return;
+  if (upb_Status_IsOk(&d->tok_status)) return;  // End of input.
+
+  // The tokenizer reports "line:column: msg" with a zero-based line.
+  const char* msg = upb_Status_ErrorMessage(&d->tok_status);
+  char* ptr;
+  long line = strtol(msg, &ptr, 10);
+  long col = *ptr == ':' ? strtol(ptr + 1, &ptr, 10) : 0;
+  if (ptr[0] == ':' && ptr[1] == ' ') {
+    msg = ptr + 2;
+  } else {
+    line = upb_Tokenizer_Line(d->tok);
+    col = upb_Tokenizer_Column(d->tok);
+  }
+  upb_Status_SetErrorFormat(d->status, "Error parsing text format @%d:%d: %s",
+                            (int)line + 1, (int)col, msg);
+  UPB_LONGJMP(d->err, 1);
+}
+
+static upb_TokenType txtdec_type(txtdec* d) {
+  return upb_Tokenizer_Type(d->tok);
+}
+
+static const char* txtdec_text(txtdec* d) {
+  return upb_Tokenizer_TextData(d->tok);
+}
+
+static bool txtdec_issym(txtdec* d, char ch) {
+  return txtdec_type(d) == kUpb_TokenType_Symbol && txtdec_text(d)[0] == ch;
+}
+
+static bool txtdec_trysym(txtdec* d, char ch) {
+  if (!txtdec_issym(d, ch)) return false;
+  txtdec_next(d);
+  return true;
+}
+
+static void txtdec_sym(txtdec* d, char ch) {
+  if (!txtdec_trysym(d, ch)) {
+    char what[] = {'\'', ch, '\'', '\0'};
+    txtdec_expected(d, what);
+  }
+}
+
+/* Returns the closing delimiter for the message that starts at the current
+ * token, which is consumed. */
+static char txtdec_open(txtdec* d) {
+  if (txtdec_trysym(d, '{')) return '}';
+  if (txtdec_trysym(d, '<')) return '>';
+  txtdec_expected(d, "'{' or '<'");
+}
+
+static void txtdec_push(txtdec* d) {
+  if (--d->depth < 0) {
+    txtdec_err(d, "Recursion limit exceeded");
+  }
+}
+
+static void txtdec_pop(txtdec* d) { d->depth++; }
+
+/* Whether the current token is |lit|, ignoring ASCII case. */
+static bool txtdec_isidentnocase(txtdec* d, const char* lit) {
+  const char* text = txtdec_text(d);
+  if (txtdec_type(d) != kUpb_TokenType_Identifier) return false;
+  for (; *lit; text++, lit++) {
+    char ch = *text;
+    if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+    if (ch != *lit) return false;
+  }
+  return *text == '\0';
+}
+
+/* Scalars ********************************************************************/
+
+static uint64_t txtdec_uint(txtdec* d, uint64_t max) {
+  uint64_t val;
+  if (txtdec_type(d) != kUpb_TokenType_Integer) {
+    txtdec_expected(d, "integer");
+  }
+  if (!upb_Parse_Integer(txtdec_text(d), max, &val)) {
+    txtdec_errf(d, "Integer out of range (%s)", txtdec_text(d));
+  }
+  txtdec_next(d);
+  return val;
+}
+
+static int64_t txtdec_int(txtdec* d, int64_t min, int64_t max) {
+  if (txtdec_trysym(d, '-')) {
+    // The magnitude of |min|, computed without overflowing.
+    uint64_t val = txtdec_uint(d, (uint64_t) - (min + 1) + 1);
+    return (int64_t)(0 - val);
+  }
+  return (int64_t)txtdec_uint(d, (uint64_t)max);
+}
+
+static double txtdec_double(txtdec* d) {
+  bool neg = txtdec_trysym(d, '-');
+  const char* text = txtdec_text(d);
+  double val;
+
+  switch (txtdec_type(d)) {
+    case kUpb_TokenType_Float:
+      val = upb_Parse_Float(text);
+      break;
+    case kUpb_TokenType_Integer: {
+      uint64_t u;
+      if (upb_Parse_Integer(text, UINT64_MAX, &u)) {
+        val = (double)u;
+      } else if (text[0] != '0') {
+        // A decimal integer too large for uint64 is still a valid double.
+        val = upb_Parse_Float(text);
+      } else {
+        txtdec_errf(d, "Integer out of range (%s)", text);
+      }
+      break;
+    }
+    case kUpb_TokenType_Identifier:
+      if (txtdec_isidentnocase(d, "inf") ||
+          txtdec_isidentnocase(d, "infinity")) {
+        val = INFINITY;
+        break;
+      }
+      if (txtdec_isidentnocase(d, "nan")) {
+        val = NAN;
+        break;
+      }
+      txtdec_expected(d, "number");
+    default:
+      txtdec_expected(d, "number");
+  }
+
+  txtdec_next(d);
+  return neg ? -val : val;
+}
+
+static bool txtdec_bool(txtdec* d, const upb_FieldDef* f) {
+  const char* text = txtdec_text(d);
+  if (txtdec_type(d) == kUpb_TokenType_Integer) {
+    return txtdec_uint(d, 1) != 0;
+  }
+  if (txtdec_type(d) == kUpb_TokenType_Identifier) {
+    bool val;
+    if (!strcmp(text, "true") || !strcmp(text, "True") || !strcmp(text, "t")) {
+      val = true;
+    } else if (!strcmp(text, "false") || !strcmp(text, "False") ||
+               !strcmp(text, "f")) {
+      val = false;
+    } else {
+      goto badbool;
+    }
+    txtdec_next(d);
+    return val;
+  }
+
+badbool:
+  txtdec_errf(d, "Invalid value for boolean field \"%s\": \"%s\"",
+              upb_FieldDef_Name(f), text);
+}
+
+static int32_t txtdec_enum(txtdec* d, const upb_FieldDef* f) {
+  const upb_EnumDef* e = upb_FieldDef_EnumSubDef(f);
+
+  if (txtdec_type(d) == kUpb_TokenType_Identifier) {
+    const char* text = txtdec_text(d);
+    const upb_EnumValueDef* ev =
+        upb_EnumDef_FindValueByNameWithSize(e, text, strlen(text));
+    if (!ev) {
+      txtdec_errf(d, "Unknown enumerator \"%s\" for field \"%s\"", text,
+                  upb_FieldDef_Name(f));
+    }
+    txtdec_next(d);
+    return upb_EnumValueDef_Number(ev);
+  } else {
+    int32_t val = (int32_t)txtdec_int(d, INT32_MIN, INT32_MAX);
+    // Closed enums cannot hold values that are not declared.
+    if (upb_EnumDef_IsClosed(e) && !upb_EnumDef_FindValueByNumber(e, val)) {
+      txtdec_errf(d, "Unknown enumerator %" PRId32 " for field \"%s\"", val,
+                  upb_FieldDef_Name(f));
+    }
+    return val;
+  }
+}
+
+/* Adjacent string literals are concatenated, as in C. */
+static upb_StringView txtdec_string(txtdec* d) {
+  upb_StringView str;
+
+  if (txtdec_type(d) != kUpb_TokenType_String) {
+    txtdec_expected(d, "string");
+  }
+  str = upb_Parse_String(txtdec_text(d), d->arena);
+  if (!str.data) txtdec_err(d, "Out of memory");
+  txtdec_next(d);
+
+  while (txtdec_type(d) == kUpb_TokenType_String) {
+    upb_StringView more = upb_Parse_String(txtdec_text(d), d->arena);
+    char* buf = txtdec_alloc(d, str.size + more.size);
+    if (!more.data) txtdec_err(d, "Out of memory");
+    memcpy(buf, str.data, str.size);
+    memcpy(buf + str.size, more.data, more.size);
+    str.data = buf;
+    str.size += more.size;
+    txtdec_next(d);
+  }
+
+  return str;
+}
+
+static upb_MessageValue txtdec_scalar(txtdec* d, const upb_FieldDef* f) {
+  upb_MessageValue val;
+
+  switch (upb_FieldDef_CType(f)) {
+    case kUpb_CType_Bool:
+      val.bool_val = txtdec_bool(d, f);
+      break;
+    case kUpb_CType_Float:
+      val.float_val = (float)txtdec_double(d);
+      break;
+    case kUpb_CType_Double:
+      val.double_val = txtdec_double(d);
+      break;
+    case kUpb_CType_Int32:
+      val.int32_val = (int32_t)txtdec_int(d, INT32_MIN, INT32_MAX);
+      break;
+    case kUpb_CType_UInt32:
+      val.uint32_val = (uint32_t)txtdec_uint(d, UINT32_MAX);
+      break;
+    case kUpb_CType_Int64:
+      val.int64_val = txtdec_int(d, INT64_MIN, INT64_MAX);
+      break;
+    case kUpb_CType_UInt64:
+      val.uint64_val = txtdec_uint(d, UINT64_MAX);
+      break;
+    case kUpb_CType_Enum:
+      val.int32_val = txtdec_enum(d, f);
+      break;
+    case kUpb_CType_String:
+    case kUpb_CType_Bytes:
+      val.str_val = txtdec_string(d);
+      break;
+    default:
+      UPB_UNREACHABLE();
+  }
+
+  return val;
+}
+
+/* Messages *******************************************************************/
+
+static upb_Message* txtdec_newmsg(txtdec* d, const upb_MessageDef* m) {
+  upb_Message* msg = upb_Message_New(upb_MessageDef_MiniTable(m), d->arena);
+  if (!msg) txtdec_err(d, "Out of memory");
+  return msg;
+}
+
+static void txtdec_msg(txtdec* d, upb_Message* msg, const upb_MessageDef* m) {
+  char close = txtdec_open(d);
+  txtdec_push(d);
+  txtdec_fields(d, msg, m, close);
+  txtdec_pop(d);
+}
+
+/* Map entries are written as messages with "key" and "value" fields. */
+static void txtdec_mapentry(txtdec* d, upb_Map* map, const upb_FieldDef* f) {
+  const upb_MessageDef* entry = upb_FieldDef_MessageSubDef(f);
+  const upb_FieldDef* key_f = upb_MessageDef_FindFieldByNumber(entry, 1);
+  const upb_FieldDef* val_f = upb_MessageDef_FindFieldByNumber(entry, 2);
+  upb_Message* ent = txtdec_newmsg(d, entry);
+  upb_MessageValue key, val;
+
+  txtdec_msg(d, ent, entry);
+  key = upb_Message_GetFieldByDef(ent, key_f);
+  val = upb_Message_GetFieldByDef(ent, val_f);
+  if (upb_FieldDef_IsSubMessage(val_f) && !val.msg_val) {
+    val.msg_val = txtdec_newmsg(d, upb_FieldDef_MessageSubDef(val_f));
+  }
+  if (!upb_Map_Set(map, key, val, d->arena)) {
+    txtdec_err(d, "Out of memory");
+  }
+}
+
+static void txtdec_value(txtdec* d, upb_Message* msg, const upb_FieldDef* f) {
+  upb_MessageValue val;
+
+  if (upb_FieldDef_IsMap(f)) {
+    txtdec_mapentry(d, upb_Message_Mutable(msg, f, d->arena).map, f);
+  } else if (upb_FieldDef_IsRepeated(f)) {
+    upb_Array* arr = upb_Message_Mutable(msg, f, d->arena).array;
+    if (upb_FieldDef_IsSubMessage(f)) {
+      const upb_MessageDef* subm = upb_FieldDef_MessageSubDef(f);
+      upb_Message* submsg = txtdec_newmsg(d, subm);
+      txtdec_msg(d, submsg, subm);
+      val.msg_val = submsg;
+    } else {
+      val = txtdec_scalar(d, f);
+    }
+    if (!upb_Array_Append(arr, val, d->arena)) {
+      txtdec_err(d, "Out of memory");
+    }
+  } else if (upb_FieldDef_IsSubMessage(f)) {
+    upb_Message* submsg = upb_Message_Mutable(msg, f, d->arena).msg;
+    if (!submsg) txtdec_err(d, "Out of memory");
+    txtdec_msg(d, submsg, upb_FieldDef_MessageSubDef(f));
+  } else {
+    val = txtdec_scalar(d, f);
+    upb_Message_SetFieldByDef(msg, f, val, d->arena);
+  }
+}
+
+/* Reads the name inside "[...]" (after the '['), for an extension or an Any
+ * type URL.  The result is valid until the next call. */
+static upb_StringView txtdec_bracketname(txtdec* d) {
+  upb_String_Clear(&d->name);
+  for (;;) {
+    if (txtdec_type(d) != kUpb_TokenType_Identifier) {
+      txtdec_expected(d, "identifier");
+    }
+    if (!upb_String_Append(&d->name, txtdec_text(d),
+                           upb_Tokenizer_TextSize(d->tok))) {
+      txtdec_err(d, "Out of memory");
+    }
+    txtdec_next(d);
+    if (txtdec_issym(d, '.') || txtdec_issym(d, '/')) {
+      if (!upb_String_PushBack(&d->name, txtdec_text(d)[0])) {
+        txtdec_err(d, "Out of memory");
+      }
+      txtdec_next(d);
+    } else {
+      txtdec_sym(d, ']');
+      return upb_StringView_FromDataAndSize(upb_String_Data(&d->name),
+                                            upb_String_Size(&d->name));
+    }
+  }
+}
+
+/* Parses "[type.googleapis.com/pkg.Msg] { ... }" in a google.protobuf.Any
+ * into its serialized form. */
+static void txtdec_any(txtdec* d, upb_Message* msg, const upb_MessageDef* m,
+                       upb_StringView url) {
+  const upb_FieldDef* type_url_f = upb_MessageDef_FindFieldByNumber(m, 1);
+  const upb_FieldDef* value_f = upb_MessageDef_FindFieldByNumber(m, 2);
+  const char* end = url.data + url.size;
+  const char* ptr = end;
+  const upb_MessageDef* any_m;
+  upb_Message* any_msg;
+  upb_MessageValue val;
+
+  /* Find message name after the last '/' */
+  while (ptr > url.data && *--ptr != '/') {
+  }
+  ptr++;
+
+  any_m = d->symtab ? upb_DefPool_FindMessageByNameWithSize(d->symtab, ptr,
+                                                             end - ptr)
+                    : NULL;
+  if (!any_m) {
+    txtdec_errf(d, "Type \"" UPB_STRINGVIEW_FORMAT "\" was not found",
+                UPB_STRINGVIEW_ARGS(url));
+  }
+
+  char* url_copy = txtdec_alloc(d, url.size);
+  memcpy(url_copy, url.data, url.size);
+  val.str_val = upb_StringView_FromDataAndSize(url_copy, url.size);
+  upb_Message_SetFieldByDef(msg, type_url_f, val, d->arena);
+
+  txtdec_trysym(d, ':');
+  any_msg = txtdec_newmsg(d, any_m);
+  txtdec_msg(d, any_msg, any_m);
+
+  if (upb_Encode(any_msg, upb_MessageDef_MiniTable(any_m), 0, d->arena,
+                 (char**)&val.str_val.data,
+                 &val.str_val.size) != kUpb_EncodeStatus_Ok) {
+    txtdec_err(d, "Failed to serialize Any");
+  }
+  upb_Message_SetFieldByDef(msg, value_f, val, d->arena);
+}
+
+/* Finds a field by name.  Groups are written with the name of their type,
+ * which is the field name capitalized. */
+static const upb_FieldDef* txtdec_findfield(const upb_MessageDef* m,
+                                            const char* name, size_t size) {
+  const upb_FieldDef* f = upb_MessageDef_FindFieldByNameWithSize(m, name, size);
+  if (f) return f;
+
+  char lower[64];
+  if (size == 0 || size > sizeof(lower)) return NULL;
+  for (size_t i = 0; i < size; i++) {
+    char ch = name[i];
+    lower[i] = (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+  }
+  f = upb_MessageDef_FindFieldByNameWithSize(m, lower, size);
+  if (f && upb_FieldDef_Type(f) == kUpb_FieldType_Group &&
+      strcmp(upb_MessageDef_Name(upb_FieldDef_MessageSubDef(f)), name) == 0) {
+    return f;
+  }
+  return NULL;
+}
+
+/* Fields that are given twice, or together with another member of their oneof,
+ * are errors rather than silently overwriting the first value. */
+static void txtdec_checkdup(txtdec* d, upb_Message* msg,
+                            const upb_FieldDef* f) {
+  const upb_OneofDef* o = upb_FieldDef_RealContainingOneof(f);
+
+  if (upb_FieldDef_IsRepeated(f)) return;
+  if (upb_FieldDef_HasPresence(f) && upb_Message_HasFieldByDef(msg, f)) {
+    txtdec_errf(d, "Non-repeated field \"%s\" is specified multiple times",
+                upb_FieldDef_Name(f));
+  }
+  if (o) {
+    const upb_FieldDef* other = upb_Message_WhichOneof(msg, o);
+    if (other && other != f) {
+      txtdec_errf(d, "Field \"%s\" is specified along with field \"%s\", "
+                  "another member of oneof \"%s\"",
+                  upb_FieldDef_Name(f), upb_FieldDef_Name(other),
+                  upb_OneofDef_Name(o));
+    }
+  }
+}
+
+static void txtdec_skipvalue(txtdec* d) {
+  if (txtdec_issym(d, '{') || txtdec_issym(d, '<')) {
+    char close = txtdec_open(d);
+    txtdec_push(d);
+    txtdec_skipfields(d, close);
+    txtdec_pop(d);
+  } else if (txtdec_type(d) == kUpb_TokenType_String) {
+    while (txtdec_type(d) == kUpb_TokenType_String) txtdec_next(d);
+  } else {
+    txtdec_trysym(d, '-');
+    switch (txtdec_type(d)) {
+      case kUpb_TokenType_Identifier:
+      case kUpb_TokenType_Integer:
+      case kUpb_TokenType_Float:
+        txtdec_next(d);
+        break;
+      default:
+        txtdec_expected(d, "value");
+    }
+  }
+}
+
+/* Skips what follows the name of an unknown field. */
+static void txtdec_skipfield(txtdec* d) {
+  bool colon = txtdec_trysym(d, ':');
+  if (!colon && !txtdec_issym(d, '{') && !txtdec_issym(d, '<') &&
+      !txtdec_issym(d, '[')) {
+    txtdec_expected(d, "':'");
+  }
+  if (txtdec_trysym(d, '[')) {
+    if (!txtdec_trysym(d, ']')) {
+      do {
+        txtdec_skipvalue(d);
+      } while (txtdec_trysym(d, ','));
+      txtdec_sym(d, ']');
+    }
+  } else {
+    txtdec_skipvalue(d);
+  }
+  if (!txtdec_trysym(d, ';')) txtdec_trysym(d, ',');
+}
+
+static void txtdec_skipfields(txtdec* d, char close) {
+  while (!txtdec_trysym(d, close)) {
+    if (txtdec_trysym(d, '[')) {
+      txtdec_bracketname(d);
+    } else if (txtdec_type(d) == kUpb_TokenType_Identifier) {
+      txtdec_next(d);
+    } else {
+      txtdec_expected(d, "field name");
+    }
+    txtdec_skipfield(d);
+  }
+}
+
+static void txtdec_field(txtdec* d, upb_Message* msg,
+                         const upb_MessageDef* m) {
+  const upb_FieldDef* f;
+
+  if (txtdec_trysym(d, '[')) {
+    upb_StringView name = txtdec_bracketname(d);
+    if (memchr(name.data, '/', name.size)) {
+      if (upb_MessageDef_WellKnownType(m) != kUpb_WellKnown_Any) {
+        txtdec_errf(d, "Type URL \"" UPB_STRINGVIEW_FORMAT
+                    "\" used in message %s, which is not an Any",
+                    UPB_STRINGVIEW_ARGS(name), upb_MessageDef_FullName(m));
+      }
+      txtdec_any(d, msg, m, name);
+      if (!txtdec_trysym(d, ';')) txtdec_trysym(d, ',');
+      return;
+    }
+    f = d->symtab ? upb_DefPool_FindExtensionByNameWithSize(
+                        d->symtab, name.data, name.size)
+                  : NULL;
+    if (f && upb_FieldDef_ContainingType(f) != m) {
+      txtdec_errf(
+          d, "Extension %s extends message %s, but was seen in message %s",
+          upb_FieldDef_FullName(f),
+          upb_MessageDef_FullName(upb_FieldDef_ContainingType(f)),
+          upb_MessageDef_FullName(m));
+    }
+    if (!f && (d->options & UPB_TXTDEC_IGNOREUNKNOWN) == 0) {
+      txtdec_errf(d, "No such extension: " UPB_STRINGVIEW_FORMAT,
+                  UPB_STRINGVIEW_ARGS(name));
+    }
+    if (f) txtdec_checkdup(d, msg, f);
+  } else {
+    if (txtdec_type(d) != kUpb_TokenType_Identifier) {
+      txtdec_expected(d, "field name");
+    }
+    f = txtdec_findfield(m, txtdec_text(d), upb_Tokenizer_TextSize(d->tok));
+    if (!f && (d->options & UPB_TXTDEC_IGNOREUNKNOWN) == 0) {
+      txtdec_errf(d, "No such field: %s", txtdec_text(d));
+    }
+    if (f) txtdec_checkdup(d, msg, f);
+    txtdec_next(d);
+  }
+
+  if (!f) {
+    txtdec_skipfield(d);
+    return;
+  }
+
+  // The ':' is optional before a message, and required before a scalar.
+  if (upb_FieldDef_IsSubMessage(f)) {
+    txtdec_trysym(d, ':');
+  } else {
+    txtdec_sym(d, ':');
+  }
+
+  if (upb_FieldDef_IsRepeated(f) && txtdec_trysym(d, '[')) {
+    if (!txtdec_trysym(d, ']')) {
+      do {
+        txtdec_value(d, msg, f);
+      } while (txtdec_trysym(d, ','));
+      txtdec_sym(d, ']');
+    }
+  } else {
+    txtdec_value(d, msg, f);
+  }
+
+  if (!txtdec_trysym(d, ';')) txtdec_trysym(d, ',');
+}
+
+/* Parses fields up to the |close| delimiter, or to the end of input if |close|
+ * is zero. */
+static void txtdec_fields(txtdec* d, upb_Message* msg, const upb_MessageDef* m,
+                          char close) {
+  for (;;) {
+    if (close ? txtdec_trysym(d, close)
+              : txtdec_type(d) == kUpb_TokenType_End) {
+      return;
+    }
+    if (close && txtdec_type(d) == kUpb_TokenType_End) {
+      char what[] = {'\'', close, '\'', '\0'};
+      txtdec_expected(d, what);
+    }
+    txtdec_field(d, msg, m);
+  }
+}
+
+static bool upb_TextDecoder_Decode(txtdec* const d, upb_Message* const msg,
+                                   const upb_MessageDef* const m) {
+  if (UPB_SETJMP(d->err)) return false;
+
+  if (!upb_String_Init(&d->name, d->arena)) txtdec_err(d, "Out of memory");
+  txtdec_next(d);
+  txtdec_fields(d, msg, m, '\0');
+  return true;
+}
+
+bool upb_TextDecode(const char* buf, size_t size, upb_Message* msg,
+                    const upb_MessageDef* m, const upb_DefPool* symtab,
+                    int options, upb_Arena* arena, upb_Status* status) {
+  txtdec d;
+
+  // Text format uses shell-style comments, and accepts "1.5f" for floats.
+  d.tok = upb_Tokenizer_New(buf, size, NULL,
+                            kUpb_TokenizerOption_CommentStyleShell |
+                                kUpb_TokenizerOption_AllowFAfterFloat,
+                            arena);
+  if (!d.tok) {
+    upb_Status_SetErrorMessage(status, "Out of memory");
+    return false;
+  }
+  upb_Status_Clear(&d.tok_status);
+  d.arena = arena;
+  d.symtab = symtab;
+  d.options = options;
+  d.depth = 64;
+  d.status = status;
+
+  bool ok = upb_TextDecoder_Decode(&d, msg, m);
+  upb_Tokenizer_Fini(d.tok);
+  return ok;
+}
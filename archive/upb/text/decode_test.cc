@@ -0,0 +1,161 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/text/decode.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "upb/mem/arena.hpp"
+#include "upb/reflection/def.hpp"
+#include "upb/text/encode.h"
+#include "upb/text/test.upb.h"
+#include "upb/text/test.upbdefs.h"
+
+// Decodes |text| and prints the result back on a single line, or returns the
+// error message.
+static std::string RoundTrip(const char* text, int options = 0) {
+  upb::Arena arena;
+  upb::Status status;
+  upb::DefPool defpool;
+  const upb_MessageDef* m =
+      upb_text_test_TestMessage_getmsgdef(defpool.ptr());
+  upb_Message* msg = (upb_Message*)upb_text_test_TestMessage_new(arena.ptr());
+  if (!upb_TextDecode(text, strlen(text), msg, m, defpool.ptr(), options,
+                      arena.ptr(), status.ptr())) {
+    return std::string("error: ") + status.error_message();
+  }
+  char buf[1024];
+  size_t size = upb_TextEncode(msg, m, defpool.ptr(), UPB_TXTENC_SINGLELINE,
+                               buf, sizeof(buf));
+  EXPECT_LT(size, sizeof(buf));
+  return std::string(buf, size);
+}
+
+TEST(TextDecodeTest, Empty) {
+  EXPECT_EQ(RoundTrip(""), "");
+  EXPECT_EQ(RoundTrip("  # Just a comment\n"), "");
+}
+
+TEST(TextDecodeTest, Scalars) {
+  EXPECT_EQ(RoundTrip("i32: -2147483648 i64: -9223372036854775808 "
+                      "u32: 4294967295 u64: 0xffffffffffffffff"),
+            "i32: -2147483648 i64: -9223372036854775808 u32: 4294967295 "
+            "u64: 18446744073709551615 ");
+  EXPECT_EQ(RoundTrip("i32: 010, u32: 0x10; i64: 0"),
+            "i32: 8 i64: 0 u32: 16 ");
+  EXPECT_EQ(RoundTrip("f: 1.5f d: -2"), "f: 1.5 d: -2 ");
+  EXPECT_EQ(RoundTrip("f: -inf d: Infinity"), "f: -inf d: inf ");
+  EXPECT_EQ(RoundTrip("d: 100000000000000000000000"), "d: 1e+23 ");
+  EXPECT_EQ(RoundTrip("b: true"), "b: true ");
+  EXPECT_EQ(RoundTrip("b: f"), "b: false ");
+  EXPECT_EQ(RoundTrip("b: 1"), "b: true ");
+  EXPECT_EQ(RoundTrip("color: BLUE"), "color: BLUE ");
+  EXPECT_EQ(RoundTrip("color: 1"), "color: GREEN ");
+}
+
+TEST(TextDecodeTest, Strings) {
+  EXPECT_EQ(RoundTrip(R"(s: "a\"b" 'c\'d' "\x41\101é")"),
+            "s: \"a\\\"bc\\'dAA\xc3\xa9\" ");
+  EXPECT_EQ(RoundTrip(R"(by: "\000\377")"), "by: \"\\000\\377\" ");
+}
+
+TEST(TextDecodeTest, Messages) {
+  EXPECT_EQ(RoundTrip("nested { a: 1 } r_nested: < a: 2 > r_nested [{}, {a: 3}]"),
+            "nested { a: 1 } r_nested { a: 2 } r_nested { } r_nested { a: 3 } ");
+  EXPECT_EQ(RoundTrip("r_i32: 1 r_i32: [2, 3] r_i32: []"),
+            "r_i32: 1 r_i32: 2 r_i32: 3 ");
+  EXPECT_EQ(RoundTrip("Grp { g: 5 }"), "grp { g: 5 } ");
+  EXPECT_EQ(RoundTrip("o_int: 7"), "o_int: 7 ");
+  EXPECT_EQ(RoundTrip("[upb_text_test.ext]: 9"), "[upb_text_test.ext]: 9 ");
+}
+
+TEST(TextDecodeTest, Maps) {
+  EXPECT_EQ(RoundTrip(R"(m_str { key: "b" value: 2 } m_str { key: "a" }
+                         m_msg [{ key: 1 value { a: 4 } }, { key: 2 }]
+                         m_str { key: "b" value: 3 })"),
+            "m_str { key: \"b\" value: 3 } m_str { key: \"a\" value: 0 } "
+            "m_msg { key: 1 value { a: 4 } } m_msg { key: 2 value { } } ");
+}
+
+TEST(TextDecodeTest, Any) {
+  std::string out = RoundTrip(
+      "any { [type.googleapis.com/upb_text_test.Nested] { a: 5 } }");
+  EXPECT_EQ(out,
+            "any { type_url: \"type.googleapis.com/upb_text_test.Nested\" "
+            "value: \"\\010\\005\" } ");
+}
+
+TEST(TextDecodeTest, Unknown) {
+  const char* text = R"(i32: 1 nope: 2 nope { x: [1, -2] y < z: "s" > }
+                        [upb_text_test.nope]: 3 i64: 4)";
+  EXPECT_EQ(RoundTrip(text, UPB_TXTDEC_IGNOREUNKNOWN), "i32: 1 i64: 4 ");
+  EXPECT_EQ(RoundTrip(text),
+            "error: Error parsing text format @1:7: No such field: nope");
+}
+
+TEST(TextDecodeTest, Errors) {
+  EXPECT_EQ(RoundTrip("i32: 2147483648"),
+            "error: Error parsing text format @1:5: Integer out of range "
+            "(2147483648)");
+  EXPECT_EQ(RoundTrip("u32: -1"),
+            "error: Error parsing text format @1:5: Expected integer, found "
+            "\"-\"");
+  EXPECT_EQ(RoundTrip("i32: 1.5"),
+            "error: Error parsing text format @1:5: Expected integer, found "
+            "\"1.5\"");
+  EXPECT_EQ(RoundTrip("i32 1"),
+            "error: Error parsing text format @1:4: Expected ':', found \"1\"");
+  EXPECT_EQ(RoundTrip("color: 5"),
+            "error: Error parsing text format @1:8: Unknown enumerator 5 for "
+            "field \"color\"");
+  EXPECT_EQ(RoundTrip("\n  i32: 1 i32: 2"),
+            "error: Error parsing text format @2:9: Non-repeated field "
+            "\"i32\" is specified multiple times");
+  EXPECT_EQ(RoundTrip("o_str: \"x\" o_int: 1"),
+            "error: Error parsing text format @1:11: Field \"o_int\" is "
+            "specified along with field \"o_str\", another member of oneof "
+            "\"kind\"");
+  EXPECT_EQ(RoundTrip("nested { a: 1"),
+            "error: Error parsing text format @1:13: Expected '}', reached end "
+            "of input");
+  EXPECT_EQ(RoundTrip("s: \"abc"),
+            "error: Error parsing text format @1:7: Unexpected end of string.");
+  EXPECT_EQ(RoundTrip("b: yes"),
+            "error: Error parsing text format @1:3: Invalid value for boolean "
+            "field \"b\": \"yes\"");
+
+  std::string deep;
+  for (int i = 0; i < 100; i++) deep += "nested { ";
+  EXPECT_EQ(RoundTrip(deep.c_str()).substr(0, 33),
+            "error: Error parsing text format ");
+}
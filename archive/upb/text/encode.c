@@ -30,7 +30,6 @@
 
 #include "upb/text/encode.h"
 
-#include <ctype.h>
 #include <float.h>
 #include <inttypes.h>
 #include <stdarg.h>
@@ -38,6 +37,7 @@
 
 #include "upb/collections/internal/map_sorter.h"
 #include "upb/collections/map.h"
+#include "upb/lex/atoi.h"
 #include "upb/lex/round_trip.h"
 #include "upb/port/vsnprintf_compat.h"
 #include "upb/reflection/message.h"
@@ -78,6 +78,41 @@ static void txtenc_putstr(txtenc* e, const char* str) {
   txtenc_putbytes(e, str, strlen(str));
 }
 
+static void txtenc_putint(txtenc* e, int64_t val) {
+  if (UPB_LIKELY(e->end - e->ptr >= kUpb_Int64BufferSize)) {
+    e->ptr += upb_Int64ToBuf(val, e->ptr);
+  } else {
+    char buf[kUpb_Int64BufferSize];
+    txtenc_putbytes(e, buf, upb_Int64ToBuf(val, buf));
+  }
+}
+
+static void txtenc_putuint(txtenc* e, uint64_t val) {
+  if (UPB_LIKELY(e->end - e->ptr >= kUpb_Int64BufferSize)) {
+    e->ptr += upb_Uint64ToBuf(val, e->ptr);
+  } else {
+    char buf[kUpb_Int64BufferSize];
+    txtenc_putbytes(e, buf, upb_Uint64ToBuf(val, buf));
+  }
+}
+
+static void txtenc_putdouble(txtenc* e, double val, bool is_float) {
+  // Format in place when there is room, so the common case is a single pass.
+  char tmp[kUpb_RoundTripBufferSize];
+  bool direct = e->end - e->ptr >= kUpb_RoundTripBufferSize;
+  char* buf = direct ? e->ptr : tmp;
+  if (is_float) {
+    _upb_EncodeRoundTripFloat((float)val, buf, kUpb_RoundTripBufferSize);
+  } else {
+    _upb_EncodeRoundTripDouble(val, buf, kUpb_RoundTripBufferSize);
+  }
+  if (direct) {
+    e->ptr += strlen(buf);
+  } else {
+    txtenc_putstr(e, buf);
+  }
+}
+
 static void txtenc_printf(txtenc* e, const char* fmt, ...) {
   size_t n;
   size_t have = e->end - e->ptr;
@@ -96,11 +131,14 @@ static void txtenc_printf(txtenc* e, const char* fmt, ...) {
 }
 
 static void txtenc_indent(txtenc* e) {
+  static const char spaces[] = "                                ";
   if ((e->options & UPB_TXTENC_SINGLELINE) == 0) {
-    int i = e->indent_depth;
-    while (i-- > 0) {
-      txtenc_putstr(e, "  ");
+    size_t n = (size_t)e->indent_depth * 2;
+    while (n > sizeof(spaces) - 1) {
+      txtenc_putbytes(e, spaces, sizeof(spaces) - 1);
+      n -= sizeof(spaces) - 1;
     }
+    txtenc_putbytes(e, spaces, n);
   }
 }
 
@@ -117,18 +155,31 @@ static void txtenc_enum(int32_t val, const upb_FieldDef* f, txtenc* e) {
   const upb_EnumValueDef* ev = upb_EnumDef_FindValueByNumber(e_def, val);
 
   if (ev) {
-    txtenc_printf(e, "%s", upb_EnumValueDef_Name(ev));
+    txtenc_putstr(e, upb_EnumValueDef_Name(ev));
   } else {
-    txtenc_printf(e, "%" PRId32, val);
+    txtenc_putint(e, val);
   }
 }
 
+// Whether the byte can be copied through unescaped.  For strings, bytes >= 0x80
+// are part of UTF-8 sequences and are passed through as well.
+static bool txtenc_isplain(uint8_t ch, bool bytes) {
+  if (ch >= 0x80) return !bytes;
+  return ch >= 0x20 && ch < 0x7f && ch != '"' && ch != '\'' && ch != '\\';
+}
+
 static void txtenc_string(txtenc* e, upb_StringView str, bool bytes) {
   const char* ptr = str.data;
   const char* end = ptr + str.size;
   txtenc_putstr(e, "\"");
 
   while (ptr < end) {
+    // Copy runs of bytes that need no escaping with a single putbytes().
+    const char* run = ptr;
+    while (ptr < end && txtenc_isplain((uint8_t)*ptr, bytes)) ptr++;
+    if (ptr != run) txtenc_putbytes(e, run, ptr - run);
+    if (ptr == end) break;
+
     switch (*ptr) {
       case '\n':
         txtenc_putstr(e, "\\n");
@@ -148,13 +199,13 @@ static void txtenc_string(txtenc* e, upb_StringView str, bool bytes) {
       case '\\':
         txtenc_putstr(e, "\\\\");
         break;
-      default:
-        if ((bytes || (uint8_t)*ptr < 0x80) && !isprint(*ptr)) {
-          txtenc_printf(e, "\\%03o", (int)(uint8_t)*ptr);
-        } else {
-          txtenc_putbytes(e, ptr, 1);
-        }
+      default: {
+        uint8_t ch = (uint8_t)*ptr;
+        char oct[4] = {'\\', '0' + (ch >> 6), '0' + ((ch >> 3) & 7),
+                       '0' + (ch & 7)};
+        txtenc_putbytes(e, oct, sizeof(oct));
         break;
+      }
     }
     ptr++;
   }
@@ -167,15 +218,17 @@ static void txtenc_field(txtenc* e, upb_MessageValue val,
   txtenc_indent(e);
   const upb_CType type = upb_FieldDef_CType(f);
   const bool is_ext = upb_FieldDef_IsExtension(f);
-  const char* full = upb_FieldDef_FullName(f);
-  const char* name = upb_FieldDef_Name(f);
+
+  if (is_ext) {
+    txtenc_putstr(e, "[");
+    txtenc_putstr(e, upb_FieldDef_FullName(f));
+    txtenc_putstr(e, "]");
+  } else {
+    txtenc_putstr(e, upb_FieldDef_Name(f));
+  }
 
   if (type == kUpb_CType_Message) {
-    if (is_ext) {
-      txtenc_printf(e, "[%s] {", full);
-    } else {
-      txtenc_printf(e, "%s {", name);
-    }
+    txtenc_putstr(e, " {");
     txtenc_endfield(e);
     e->indent_depth++;
     txtenc_msg(e, val.msg_val, upb_FieldDef_MessageSubDef(f));
@@ -186,39 +239,29 @@ static void txtenc_field(txtenc* e, upb_MessageValue val,
     return;
   }
 
-  if (is_ext) {
-    txtenc_printf(e, "[%s]: ", full);
-  } else {
-    txtenc_printf(e, "%s: ", name);
-  }
+  txtenc_putstr(e, ": ");
 
   switch (type) {
     case kUpb_CType_Bool:
       txtenc_putstr(e, val.bool_val ? "true" : "false");
       break;
-    case kUpb_CType_Float: {
-      char buf[32];
-      _upb_EncodeRoundTripFloat(val.float_val, buf, sizeof(buf));
-      txtenc_putstr(e, buf);
+    case kUpb_CType_Float:
+      txtenc_putdouble(e, val.float_val, true);
       break;
-    }
-    case kUpb_CType_Double: {
-      char buf[32];
-      _upb_EncodeRoundTripDouble(val.double_val, buf, sizeof(buf));
-      txtenc_putstr(e, buf);
+    case kUpb_CType_Double:
+      txtenc_putdouble(e, val.double_val, false);
       break;
-    }
     case kUpb_CType_Int32:
-      txtenc_printf(e, "%" PRId32, val.int32_val);
+      txtenc_putint(e, val.int32_val);
       break;
     case kUpb_CType_UInt32:
-      txtenc_printf(e, "%" PRIu32, val.uint32_val);
+      txtenc_putuint(e, val.uint32_val);
       break;
     case kUpb_CType_Int64:
-      txtenc_printf(e, "%" PRId64, val.int64_val);
+      txtenc_putint(e, val.int64_val);
       break;
     case kUpb_CType_UInt64:
-      txtenc_printf(e, "%" PRIu64, val.uint64_val);
+      txtenc_putuint(e, val.uint64_val);
       break;
     case kUpb_CType_String:
       txtenc_string(e, val.str_val, false);
@@ -259,7 +302,8 @@ static void txtenc_mapentry(txtenc* e, upb_MessageValue key,
   const upb_FieldDef* key_f = upb_MessageDef_Field(entry, 0);
   const upb_FieldDef* val_f = upb_MessageDef_Field(entry, 1);
   txtenc_indent(e);
-  txtenc_printf(e, "%s {", upb_FieldDef_Name(f));
+  txtenc_putstr(e, upb_FieldDef_Name(f));
+  txtenc_putstr(e, " {");
   txtenc_endfield(e);
   e->indent_depth++;
 
@@ -341,13 +385,14 @@ static const char* txtenc_unknown(txtenc* e, const char* ptr,
     if (tag == end_group) return ptr;
 
     txtenc_indent(e);
-    txtenc_printf(e, "%d: ", (int)upb_WireReader_GetFieldNumber(tag));
+    txtenc_putint(e, upb_WireReader_GetFieldNumber(tag));
+    txtenc_putstr(e, ": ");
 
     switch (upb_WireReader_GetWireType(tag)) {
       case kUpb_WireType_Varint: {
         uint64_t val;
         CHK(ptr = upb_WireReader_ReadVarint(ptr, &val));
-        txtenc_printf(e, "%" PRIu64, val);
+        txtenc_putuint(e, val);
         break;
       }
       case kUpb_WireType_32Bit: {
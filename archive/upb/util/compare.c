@@ -33,6 +33,7 @@
 #include <stdlib.h>
 
 #include "upb/base/string_view.h"
+#include "upb/message/unknown.h"
 #include "upb/wire/eps_copy_input_stream.h"
 #include "upb/wire/reader.h"
 #include "upb/wire/types.h"
@@ -60,7 +61,6 @@ struct upb_UnknownFields {
 };
 
 typedef struct {
-  upb_EpsCopyInputStream stream;
   upb_Arena* arena;
   upb_UnknownField* tmp;
   size_t tmp_size;
@@ -114,7 +114,7 @@ static void upb_UnknownFields_Merge(upb_UnknownField* arr, size_t start,
   if (ptr1 < end1) {
     memcpy(out, ptr1, (end1 - ptr1) * sizeof(*out));
   } else if (ptr2 < end2) {
-    memcpy(out, ptr1, (end2 - ptr2) * sizeof(*out));
+    memcpy(out, ptr2, (end2 - ptr2) * sizeof(*out));
   }
 }
 
@@ -138,20 +138,21 @@ static void upb_UnknownFields_Sort(upb_UnknownField_Context* ctx,
   upb_UnknownFields_SortRecursive(fields->fields, 0, fields->size, ctx->tmp);
 }
 
-static upb_UnknownFields* upb_UnknownFields_DoBuild(
-    upb_UnknownField_Context* ctx, const char** buf) {
+// Builds a upb_UnknownFields data structure from the binary data in buf.
+static upb_UnknownFields* upb_UnknownFields_Build(upb_UnknownField_Context* ctx,
+                                                  const char* buf,
+                                                  size_t size) {
   upb_UnknownField* arr_base = NULL;
   upb_UnknownField* arr_ptr = NULL;
   upb_UnknownField* arr_end = NULL;
-  const char* ptr = *buf;
   uint32_t last_tag = 0;
   bool sorted = true;
-  while (!upb_EpsCopyInputStream_IsDone(&ctx->stream, &ptr)) {
-    uint32_t tag;
-    ptr = upb_WireReader_ReadTag(ptr, &tag);
-    UPB_ASSERT(tag <= UINT32_MAX);
-    int wire_type = upb_WireReader_GetWireType(tag);
-    if (wire_type == kUpb_WireType_EndGroup) break;
+  upb_UnknownFieldIter iter;
+  upb_UnknownFieldIter_Init(&iter, buf, size, ctx->depth);
+  upb_UnknownFieldView view;
+  while (upb_UnknownFieldIter_Next(&iter, &view)) {
+    uint32_t tag = view.field_number << kUpb_WireReader_WireTypeBits |
+                   view.wire_type;
     if (tag < last_tag) sorted = false;
     last_tag = tag;
 
@@ -162,32 +163,24 @@ static upb_UnknownFields* upb_UnknownFields_DoBuild(
     field->tag = tag;
     arr_ptr++;
 
-    switch (wire_type) {
+    switch (view.wire_type) {
       case kUpb_WireType_Varint:
-        ptr = upb_WireReader_ReadVarint(ptr, &field->data.varint);
+        field->data.varint = view.data.varint;
         break;
       case kUpb_WireType_64Bit:
-        ptr = upb_WireReader_ReadFixed64(ptr, &field->data.uint64);
+        field->data.uint64 = view.data.fixed64;
         break;
       case kUpb_WireType_32Bit:
-        ptr = upb_WireReader_ReadFixed32(ptr, &field->data.uint32);
+        field->data.uint32 = view.data.fixed32;
         break;
-      case kUpb_WireType_Delimited: {
-        int size;
-        ptr = upb_WireReader_ReadSize(ptr, &size);
-        const char* s_ptr = ptr;
-        ptr = upb_EpsCopyInputStream_ReadStringAliased(&ctx->stream, &s_ptr,
-                                                       size);
-        field->data.delimited.data = s_ptr;
-        field->data.delimited.size = size;
+      case kUpb_WireType_Delimited:
+        field->data.delimited = view.data.delimited;
         break;
-      }
       case kUpb_WireType_StartGroup:
-        if (--ctx->depth == 0) {
-          ctx->status = kUpb_UnknownCompareResult_MaxDepthExceeded;
-          UPB_LONGJMP(ctx->err, 1);
-        }
-        field->data.group = upb_UnknownFields_DoBuild(ctx, &ptr);
+        ctx->depth--;
+        field->data.group =
+            upb_UnknownFields_Build(ctx, view.data.group.data,
+                                    view.data.group.size);
         ctx->depth++;
         break;
       default:
@@ -195,7 +188,13 @@ static upb_UnknownFields* upb_UnknownFields_DoBuild(
     }
   }
 
-  *buf = ptr;
+  // The input must be valid, so the iterator can only have stopped early
+  // because the groups are nested too deeply.
+  if (upb_UnknownFieldIter_IsError(&iter)) {
+    ctx->status = kUpb_UnknownCompareResult_MaxDepthExceeded;
+    UPB_LONGJMP(ctx->err, 1);
+  }
+
   upb_UnknownFields* ret = upb_Arena_Malloc(ctx->arena, sizeof(*ret));
   if (!ret) upb_UnknownFields_OutOfMemory(ctx);
   ret->fields = arr_base;
@@ -207,17 +206,6 @@ static upb_UnknownFields* upb_UnknownFields_DoBuild(
   return ret;
 }
 
-// Builds a upb_UnknownFields data structure from the binary data in buf.
-static upb_UnknownFields* upb_UnknownFields_Build(upb_UnknownField_Context* ctx,
-                                                  const char* ptr,
-                                                  size_t size) {
-  upb_EpsCopyInputStream_Init(&ctx->stream, &ptr, size, true);
-  upb_UnknownFields* fields = upb_UnknownFields_DoBuild(ctx, &ptr);
-  UPB_ASSERT(upb_EpsCopyInputStream_IsDone(&ctx->stream, &ptr) &&
-             !upb_EpsCopyInputStream_IsError(&ctx->stream));
-  return fields;
-}
-
 // Compares two sorted upb_UnknownFields structures for equality.
 static bool upb_UnknownFields_IsEqual(const upb_UnknownFields* uf1,
                                       const upb_UnknownFields* uf2) {
@@ -254,6 +242,79 @@ static bool upb_UnknownFields_IsEqual(const upb_UnknownFields* uf1,
   return true;
 }
 
+// Compares two streams of unknown fields in place, up to the end of the
+// buffers or of the current group.  This only gives the right answer if both
+// streams are already in field order, so it returns false as soon as it finds
+// fields out of order or any difference at all, leaving the caller to fall
+// back to building and sorting upb_UnknownFields.
+static bool upb_UnknownFields_StreamIsEqual(upb_EpsCopyInputStream* s1,
+                                            const char** buf1,
+                                            upb_EpsCopyInputStream* s2,
+                                            const char** buf2, int depth) {
+  const char* ptr1 = *buf1;
+  const char* ptr2 = *buf2;
+  uint32_t last_tag = 0;
+  while (true) {
+    bool done1 = upb_EpsCopyInputStream_IsDone(s1, &ptr1);
+    bool done2 = upb_EpsCopyInputStream_IsDone(s2, &ptr2);
+    if (done1 || done2) {
+      if (done1 != done2) return false;
+      break;
+    }
+    uint32_t tag1 = 0, tag2 = 0;
+    ptr1 = upb_WireReader_ReadTag(ptr1, &tag1);
+    ptr2 = upb_WireReader_ReadTag(ptr2, &tag2);
+    if (tag1 != tag2 || tag1 < last_tag) return false;
+    int wire_type = upb_WireReader_GetWireType(tag1);
+    if (wire_type == kUpb_WireType_EndGroup) break;
+    last_tag = tag1;
+
+    switch (wire_type) {
+      case kUpb_WireType_Varint: {
+        uint64_t val1 = 0, val2 = 0;
+        ptr1 = upb_WireReader_ReadVarint(ptr1, &val1);
+        ptr2 = upb_WireReader_ReadVarint(ptr2, &val2);
+        if (val1 != val2) return false;
+        break;
+      }
+      case kUpb_WireType_64Bit:
+        if (memcmp(ptr1, ptr2, 8) != 0) return false;
+        ptr1 += 8;
+        ptr2 += 8;
+        break;
+      case kUpb_WireType_32Bit:
+        if (memcmp(ptr1, ptr2, 4) != 0) return false;
+        ptr1 += 4;
+        ptr2 += 4;
+        break;
+      case kUpb_WireType_Delimited: {
+        int size1 = 0, size2 = 0;
+        ptr1 = upb_WireReader_ReadSize(ptr1, &size1);
+        ptr2 = upb_WireReader_ReadSize(ptr2, &size2);
+        if (size1 != size2) return false;
+        const char* str1 = ptr1;
+        const char* str2 = ptr2;
+        ptr1 = upb_EpsCopyInputStream_ReadStringAliased(s1, &str1, size1);
+        ptr2 = upb_EpsCopyInputStream_ReadStringAliased(s2, &str2, size2);
+        if (memcmp(str1, str2, size1) != 0) return false;
+        break;
+      }
+      case kUpb_WireType_StartGroup:
+        // Let the slow path report the depth error.
+        if (depth == 1) return false;
+        if (!upb_UnknownFields_StreamIsEqual(s1, &ptr1, s2, &ptr2, depth - 1)) {
+          return false;
+        }
+        break;
+      default:
+        UPB_UNREACHABLE();
+    }
+  }
+  *buf1 = ptr1;
+  *buf2 = ptr2;
+  return true;
+}
+
 static upb_UnknownCompareResult upb_UnknownField_DoCompare(
     upb_UnknownField_Context* ctx, const char* buf1, size_t size1,
     const char* buf2, size_t size2) {
@@ -295,7 +356,20 @@ upb_UnknownCompareResult upb_Message_UnknownFieldsAreEqual(const char* buf1,
                                                            int max_depth) {
   if (size1 == 0 && size2 == 0) return kUpb_UnknownCompareResult_Equal;
   if (size1 == 0 || size2 == 0) return kUpb_UnknownCompareResult_NotEqual;
-  if (memcmp(buf1, buf2, size1) == 0) return kUpb_UnknownCompareResult_Equal;
+  if (size1 == size2 && memcmp(buf1, buf2, size1) == 0) {
+    return kUpb_UnknownCompareResult_Equal;
+  }
+
+  // Unknown fields are usually serialized in field order, in which case they
+  // can be compared without building and sorting them.
+  upb_EpsCopyInputStream s1, s2;
+  const char* ptr1 = buf1;
+  const char* ptr2 = buf2;
+  upb_EpsCopyInputStream_Init(&s1, &ptr1, size1, true);
+  upb_EpsCopyInputStream_Init(&s2, &ptr2, size2, true);
+  if (upb_UnknownFields_StreamIsEqual(&s1, &ptr1, &s2, &ptr2, max_depth)) {
+    return kUpb_UnknownCompareResult_Equal;
+  }
 
   upb_UnknownField_Context ctx = {
       .arena = upb_Arena_New(),
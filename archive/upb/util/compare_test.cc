@@ -178,6 +178,28 @@ TEST(CompareTest, UnknownFieldsOrdering) {
           {{1, Group({{2, Group({{4, Fixed64(123)}, {3, Fixed32(456)}})}})}}));
 }
 
+TEST(CompareTest, UnknownFieldsInterleaved) {
+  EXPECT_EQ(kUpb_UnknownCompareResult_Equal,
+            CompareUnknown({{3, Varint(3)},
+                            {1, Varint(1)},
+                            {4, Varint(4)},
+                            {2, Varint(2)}},
+                           {{1, Varint(1)},
+                            {2, Varint(2)},
+                            {3, Varint(3)},
+                            {4, Varint(4)}}));
+}
+
+TEST(CompareTest, UnknownFieldsPrefix) {
+  EXPECT_EQ(kUpb_UnknownCompareResult_NotEqual,
+            CompareUnknown({{1, Varint(1)}, {2, Varint(2)}}, {{1, Varint(1)}}));
+  EXPECT_EQ(kUpb_UnknownCompareResult_NotEqual,
+            CompareUnknown({{1, Varint(1)}}, {{1, Varint(1)}, {2, Varint(2)}}));
+  EXPECT_EQ(kUpb_UnknownCompareResult_NotEqual,
+            CompareUnknown({{1, Group({{2, Varint(2)}})}},
+                           {{1, Group({{2, Varint(2)}, {3, Varint(3)}})}}));
+}
+
 TEST(CompareTest, LongVarint) {
   EXPECT_EQ(kUpb_UnknownCompareResult_Equal,
             CompareUnknown({{1, LongVarint(123)}, {2, LongVarint(456)}},
@@ -194,4 +216,9 @@ TEST(CompareTest, MaxDepth) {
           {{1, Group({{2, Group({{3, Fixed32(456)}, {4, Fixed64(123)}})}})}},
           {{1, Group({{2, Group({{4, Fixed64(123)}, {3, Fixed32(456)}})}})}},
           2));
+  // Also when both are in field order but differ in encoding.
+  EXPECT_EQ(kUpb_UnknownCompareResult_MaxDepthExceeded,
+            CompareUnknownWithMaxDepth(
+                {{1, Group({{2, Group({{3, LongVarint(456)}})}})}},
+                {{1, Group({{2, Group({{3, Varint(456)}})}})}}, 2));
 }
@@ -0,0 +1,117 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/util/decode_stats.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "upb/mini_table/message.h"
+#include "upb/port/vsnprintf_compat.h"
+#include "upb/reflection/def.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef struct {
+  char *buf, *ptr, *end;
+  size_t overflow;
+  const upb_DecodeStats* stats;
+} upb_ProfileWriter;
+
+static void upb_ProfileWriter_Printf(upb_ProfileWriter* w, const char* fmt,
+                                     ...) {
+  size_t n;
+  size_t have = w->end - w->ptr;
+  va_list args;
+
+  va_start(args, fmt);
+  n = _upb_vsnprintf(w->ptr, have, fmt, args);
+  va_end(args);
+
+  if (UPB_LIKELY(have > n)) {
+    w->ptr += n;
+  } else {
+    w->ptr = UPB_PTRADD(w->ptr, have);
+    w->overflow += (n - have);
+  }
+}
+
+static void upb_ProfileWriter_Message(upb_ProfileWriter* w,
+                                      const upb_MessageDef* m) {
+  const upb_MiniTable* mt = upb_MessageDef_MiniTable(m);
+  const upb_DecodeMessageStats* stats = upb_DecodeStats_Get(w->stats, mt);
+
+  if (stats) {
+    upb_ProfileWriter_Printf(
+        w,
+        "# %s: %" PRIu64 " messages, %" PRIu64 " fast-table fields, %" PRIu64
+        " generic fields, %" PRIu64 " unknown fields (%" PRIu64 " bytes)\n",
+        upb_MessageDef_FullName(m), stats->messages, stats->fast_fields,
+        stats->generic_fields, stats->unknown.count, stats->unknown.bytes);
+    for (int i = 0; i < upb_MessageDef_FieldCount(m); i++) {
+      const upb_FieldDef* f = upb_MessageDef_Field(m, i);
+      const upb_MiniTableField* mt_f =
+          upb_MiniTable_FindFieldByNumber(mt, upb_FieldDef_Number(f));
+      const upb_DecodeFieldStats* field_stats =
+          &stats->fields[mt_f - mt->fields];
+      upb_ProfileWriter_Printf(w, "%s %" PRIu64 "  # %" PRIu64 " bytes\n",
+                               upb_FieldDef_FullName(f), field_stats->count,
+                               field_stats->bytes);
+    }
+  }
+
+  for (int i = 0; i < upb_MessageDef_NestedMessageCount(m); i++) {
+    upb_ProfileWriter_Message(w, upb_MessageDef_NestedMessage(m, i));
+  }
+}
+
+size_t upb_DecodeStats_WriteProfile(const upb_DecodeStats* stats,
+                                    const upb_FileDef* file, char* buf,
+                                    size_t size) {
+  upb_ProfileWriter w;
+  w.buf = buf;
+  w.ptr = buf;
+  w.end = UPB_PTRADD(buf, size);
+  w.overflow = 0;
+  w.stats = stats;
+
+  for (int i = 0; i < upb_FileDef_TopLevelMessageCount(file); i++) {
+    upb_ProfileWriter_Message(&w, upb_FileDef_TopLevelMessage(file, i));
+  }
+
+  size_t ret = w.ptr - w.buf + w.overflow;
+  if (size > 0) {
+    if (w.ptr == w.end) w.ptr--;
+    *w.ptr = '\0';
+  }
+  return ret;
+}
@@ -0,0 +1,102 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/util/decode_stats.h"
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "upb/mem/arena.hpp"
+#include "upb/reflection/def.hpp"
+#include "upb/util/required_fields_test.upb.h"
+#include "upb/util/required_fields_test.upbdefs.h"
+#include "upb/wire/decode.h"
+
+namespace {
+
+TEST(DecodeStatsTest, CountsFieldsAndWritesProfile) {
+  upb::Arena arena;
+  upb_util_test_TestRequiredFields* msg =
+      upb_util_test_TestRequiredFields_new(arena.ptr());
+  upb_util_test_TestRequiredFields_mutable_required_message(msg, arena.ptr());
+  upb_util_test_TestRequiredFields_mutable_optional_message(msg, arena.ptr());
+  for (int i = 0; i < 3; i++) {
+    upb_util_test_HasRequiredField_set_required_int32(
+        upb_util_test_TestRequiredFields_add_repeated_message(msg,
+                                                              arena.ptr()),
+        i);
+  }
+  size_t size;
+  char* data = upb_util_test_TestRequiredFields_serialize(msg, arena.ptr(),
+                                                          &size);
+  ASSERT_NE(nullptr, data);
+
+  upb_DecodeStats* stats = upb_DecodeStats_New(arena.ptr());
+  ASSERT_NE(nullptr, stats);
+  const upb_MiniTable* mt = &upb_util_test_TestRequiredFields_msg_init;
+  EXPECT_EQ(nullptr, upb_DecodeStats_Get(stats, mt));
+  for (int i = 0; i < 2; i++) {
+    upb_Message* parsed = upb_Message_New(mt, arena.ptr());
+    ASSERT_EQ(kUpb_DecodeStatus_Ok,
+              upb_DecodeWithStats(data, size, parsed, mt, nullptr, 0, stats,
+                                  arena.ptr()));
+  }
+
+  const upb_DecodeMessageStats* top = upb_DecodeStats_Get(stats, mt);
+  ASSERT_NE(nullptr, top);
+  EXPECT_EQ(4, top->messages);  // Two top-level and two optional_message.
+  EXPECT_EQ(10, top->fast_fields + top->generic_fields);
+  EXPECT_EQ(0, top->unknown.count);
+  const upb_MiniTableField* repeated =
+      upb_MiniTable_FindFieldByNumber(mt, 3);
+  EXPECT_EQ(6, top->fields[repeated - mt->fields].count);
+  EXPECT_EQ(6 * 4, top->fields[repeated - mt->fields].bytes);
+
+  upb::DefPool defpool;
+  upb::MessageDefPtr m(
+      upb_util_test_TestRequiredFields_getmsgdef(defpool.ptr()));
+  const upb_FileDef* file = m.file().ptr();
+  size_t len = upb_DecodeStats_WriteProfile(stats, file, nullptr, 0);
+  std::string profile(len, '\0');
+  EXPECT_EQ(len, upb_DecodeStats_WriteProfile(stats, file, &profile[0],
+                                              len + 1));
+  EXPECT_THAT(profile,
+              testing::HasSubstr(
+                  "upb_util_test.HasRequiredField.required_int32 6  # 12 "
+                  "bytes\n"));
+  EXPECT_THAT(profile, testing::HasSubstr(
+                           "upb_util_test.TestRequiredFields.map_bool_message "
+                           "0  # 0 bytes\n"));
+  EXPECT_THAT(profile, testing::HasSubstr("# upb_util_test.EmptyMessage: 2 "
+                                          "messages"));
+}
+
+}  // namespace
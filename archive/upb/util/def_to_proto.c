@@ -32,10 +32,12 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <string.h>
 
 #include "upb/port/vsnprintf_compat.h"
 #include "upb/reflection/enum_reserved_range.h"
 #include "upb/reflection/extension_range.h"
+#include "upb/reflection/internal/def_pool.h"
 #include "upb/reflection/internal/field_def.h"
 #include "upb/reflection/internal/file_def.h"
 #include "upb/reflection/message.h"
@@ -668,6 +670,37 @@ google_protobuf_FileDescriptorProto* upb_FileDef_ToProto(const upb_FileDef* f,
   return upb_ToProto_ConvertFileDef(&ctx, f);
 }
 
+bool upb_FileDef_SerializedProto(const upb_FileDef* f, upb_StringView* out) {
+  const upb_StringView* serialized = _upb_FileDef_SerializedProto(f);
+  if (!serialized) {
+    // Only the bytes are kept: they are copied to an arena of their own, which
+    // is then fused with the pool's so that they live as long as the file.
+    upb_Arena* tmp = upb_Arena_New();
+    upb_Arena* keep = upb_Arena_New();
+    google_protobuf_FileDescriptorProto* proto =
+        tmp && keep ? upb_FileDef_ToProto(f, tmp) : NULL;
+    size_t size = 0;
+    char* data = proto ? google_protobuf_FileDescriptorProto_serialize(
+                             proto, tmp, &size)
+                       : NULL;
+    upb_StringView* built =
+        data ? upb_Arena_Malloc(keep, sizeof(*built) + size) : NULL;
+    bool ok = built && upb_Arena_Fuse(
+                           _upb_DefPool_Arena(upb_FileDef_Pool(f)), keep);
+    if (ok) {
+      char* copy = (char*)(built + 1);
+      memcpy(copy, data, size);
+      *built = upb_StringView_FromDataAndSize(copy, size);
+      serialized = _upb_FileDef_SetSerializedProto(f, built);
+    }
+    upb_Arena_Free(tmp);
+    upb_Arena_Free(keep);
+    if (!ok) return false;
+  }
+  *out = *serialized;
+  return true;
+}
+
 google_protobuf_MethodDescriptorProto* upb_ToProto_ConvertMethodDef(
     upb_ToProto_Context* const ctx, const upb_MethodDef* m) {
   if (UPB_SETJMP(ctx->err)) return NULL;
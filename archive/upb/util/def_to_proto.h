@@ -58,6 +58,15 @@ google_protobuf_MethodDescriptorProto* upb_MethodDef_ToProto(
 google_protobuf_ServiceDescriptorProto* upb_ServiceDef_ToProto(
     const upb_ServiceDef* s, upb_Arena* a);
 
+// Sets |*out| to the serialized FileDescriptorProto of |f|, which lives as long
+// as its pool.  Files built from serialized descriptors (generated code,
+// upb_DefPool_RegisterFile(), def images and upb_DefPool_AddSerializedFile())
+// return the bytes they were built from.  For other files the first call
+// serializes upb_FileDef_ToProto() and later calls return the same bytes.  Safe
+// to call from several threads at once.  Returns false if memory allocation
+// failed.
+bool upb_FileDef_SerializedProto(const upb_FileDef* f, upb_StringView* out);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -155,6 +155,53 @@ TEST(DefToProto, TestRuntimeReflection) {
   CheckFile(file, file_desc);
 }
 
+TEST(DefToProto, SerializedProto) {
+  upb::DefPool defpool;
+  upb::FileDefPtr generated =
+      upb::MessageDefPtr(pkg_Message_getmsgdef(defpool.ptr())).file();
+  upb_StringView init = upb_util_def_to_proto_test_proto_upbdefinit.descriptor;
+  upb_StringView serialized;
+  ASSERT_TRUE(upb_FileDef_SerializedProto(generated.ptr(), &serialized));
+  EXPECT_EQ(init.data, serialized.data);
+  EXPECT_EQ(init.size, serialized.size);
+
+  google::protobuf::FileDescriptorSet set = ParseTextProtoOrDie(
+      R"pb(file {
+             name: "serialized.proto"
+             package: "pkg2"
+             message_type { name: "M" }
+           })pb");
+  std::string bytes;
+  set.file(0).SerializeToString(&bytes);
+  upb::Status status;
+
+  // The pool keeps a copy of the bytes it was given.
+  upb::DefPool copied;
+  const upb_FileDef* file = upb_DefPool_AddSerializedFile(
+      copied.ptr(), bytes.data(), bytes.size(), status.ptr());
+  ASSERT_TRUE(file) << status.error_message();
+  ASSERT_TRUE(upb_FileDef_SerializedProto(file, &serialized));
+  EXPECT_NE(bytes.data(), serialized.data);
+  EXPECT_EQ(bytes, std::string(serialized.data, serialized.size));
+
+  // Otherwise the bytes are built once.
+  upb::DefPool built;
+  upb::Arena arena;
+  upb::FileDefPtr file2 =
+      built.AddFile(google_protobuf_FileDescriptorProto_parse(
+                        bytes.data(), bytes.size(), arena.ptr()),
+                    &status);
+  ASSERT_TRUE(file2) << status.error_message();
+  ASSERT_TRUE(upb_FileDef_SerializedProto(file2.ptr(), &serialized));
+  google::protobuf::FileDescriptorProto parsed;
+  ASSERT_TRUE(parsed.ParseFromArray(serialized.data, serialized.size));
+  EXPECT_EQ("serialized.proto", parsed.name());
+  EXPECT_EQ("M", parsed.message_type(0).name());
+  upb_StringView again;
+  ASSERT_TRUE(upb_FileDef_SerializedProto(file2.ptr(), &again));
+  EXPECT_EQ(serialized.data, again.data);
+}
+
 // Fuzz test regressions.
 
 TEST(FuzzTest, EmptyPackage) {
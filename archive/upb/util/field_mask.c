@@ -0,0 +1,282 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/util/field_mask.h"
+
+#include <string.h>
+
+#include "upb/collections/array.h"
+#include "upb/collections/map.h"
+#include "upb/message/accessors.h"
+#include "upb/message/copy.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/field.h"
+#include "upb/mini_table/internal/field.h"
+#include "upb/mini_table/internal/message.h"
+#include "upb/reflection/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+struct upb_FieldMask {
+  const upb_MiniTable* mini_table;
+  // Indexed like mini_table->fields.  NULL if the field is not covered,
+  // &_upb_FieldMask_All if all of it is, otherwise the mask for its
+  // sub-message.
+  upb_FieldMask** fields;
+};
+
+static upb_FieldMask _upb_FieldMask_All;
+
+static upb_FieldMask* _upb_FieldMask_NewNode(const upb_MiniTable* mini_table,
+                                             upb_Arena* arena) {
+  upb_FieldMask* mask = upb_Arena_Malloc(arena, sizeof(*mask));
+  if (!mask) return NULL;
+  size_t size = mini_table->field_count * sizeof(*mask->fields);
+  mask->fields = upb_Arena_Malloc(arena, size);
+  if (!mask->fields) return NULL;
+  memset(mask->fields, 0, size);
+  mask->mini_table = mini_table;
+  return mask;
+}
+
+static bool _upb_FieldMask_AddPath(upb_FieldMask* mask, const upb_MessageDef* m,
+                                   upb_StringView path, upb_Arena* arena,
+                                   upb_Status* status) {
+  const char* ptr = path.data;
+  const char* end = path.data + path.size;
+  while (true) {
+    const char* dot = memchr(ptr, '.', end - ptr);
+    const char* name_end = dot ? dot : end;
+    const upb_FieldDef* f =
+        upb_MessageDef_FindFieldByNameWithSize(m, ptr, name_end - ptr);
+    if (!f) {
+      upb_Status_SetErrorFormat(status, "no field '%.*s' in message %s",
+                                (int)(name_end - ptr), ptr,
+                                upb_MessageDef_FullName(m));
+      return false;
+    }
+    upb_FieldMask** slot =
+        &mask->fields[upb_FieldDef_MiniTable(f) - mask->mini_table->fields];
+    if (*slot == &_upb_FieldMask_All) return true;
+    if (!dot) {
+      *slot = &_upb_FieldMask_All;
+      return true;
+    }
+    if (!upb_FieldDef_IsSubMessage(f) || upb_FieldDef_IsRepeated(f)) {
+      upb_Status_SetErrorFormat(status,
+                                "field mask path '%.*s' descends into field "
+                                "'%s', which is not a singular message",
+                                (int)path.size, path.data,
+                                upb_FieldDef_Name(f));
+      return false;
+    }
+    m = upb_FieldDef_MessageSubDef(f);
+    if (!*slot) {
+      *slot = _upb_FieldMask_NewNode(upb_MessageDef_MiniTable(m), arena);
+      if (!*slot) {
+        upb_Status_SetErrorMessage(status, "out of memory");
+        return false;
+      }
+    }
+    mask = *slot;
+    ptr = dot + 1;
+  }
+}
+
+upb_FieldMask* upb_FieldMask_New(const upb_MessageDef* m,
+                                 const upb_StringView* paths, size_t count,
+                                 upb_Arena* arena, upb_Status* status) {
+  upb_FieldMask* mask = _upb_FieldMask_NewNode(upb_MessageDef_MiniTable(m),
+                                               arena);
+  if (!mask) {
+    upb_Status_SetErrorMessage(status, "out of memory");
+    return NULL;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (!_upb_FieldMask_AddPath(mask, m, paths[i], arena, status)) return NULL;
+  }
+  return mask;
+}
+
+const upb_MiniTable* upb_FieldMask_MiniTable(const upb_FieldMask* mask) {
+  return mask->mini_table;
+}
+
+void upb_Message_Project(upb_Message* msg, const upb_FieldMask* mask) {
+  const upb_MiniTable* mt = mask->mini_table;
+  for (size_t i = 0; i < mt->field_count; i++) {
+    const upb_MiniTableField* field = &mt->fields[i];
+    const upb_FieldMask* sub = mask->fields[i];
+    if (sub == &_upb_FieldMask_All) continue;
+    if (!sub) {
+      upb_Message_ClearField(msg, field);
+      continue;
+    }
+    upb_TaggedMessagePtr tagged = upb_Message_GetTaggedMessagePtr(msg, field,
+                                                                  NULL);
+    upb_Message* sub_msg = _upb_TaggedMessagePtr_GetMessage(tagged);
+    if (sub_msg && !upb_TaggedMessagePtr_IsEmpty(tagged)) {
+      upb_Message_Project(sub_msg, sub);
+    }
+  }
+}
+
+// Copies a scalar or string field that is set in `src`, or clears it.
+static bool _upb_FieldMask_MergeScalar(upb_Message* dst, const upb_Message* src,
+                                       const upb_MiniTableField* field,
+                                       upb_Arena* arena) {
+  if (field->presence != 0 && !_upb_Message_HasNonExtensionField(src, field)) {
+    upb_Message_ClearField(dst, field);
+    return true;
+  }
+  const char zeros[16] = {0};
+  upb_MessageValue val;
+  _upb_Message_GetNonExtensionField(src, field, zeros, &val);
+  if (_upb_MiniTableField_GetRep(field) == kUpb_FieldRep_StringView &&
+      val.str_val.size) {
+    char* data = upb_Arena_Malloc(arena, val.str_val.size);
+    if (!data) return false;
+    memcpy(data, val.str_val.data, val.str_val.size);
+    val.str_val.data = data;
+  }
+  return _upb_Message_SetField(dst, field, &val, arena);
+}
+
+static bool _upb_FieldMask_MergeArray(upb_Message* dst, const upb_Message* src,
+                                      const upb_MiniTable* mt,
+                                      const upb_MiniTableField* field,
+                                      int options, upb_Arena* arena) {
+  if (options & kUpb_FieldMaskMerge_ReplaceRepeated) {
+    upb_Message_ClearField(dst, field);
+  }
+  const upb_Array* arr = upb_Message_GetArray(src, field);
+  if (!arr || upb_Array_Size(arr) == 0) return true;
+  upb_CType type = upb_MiniTableField_CType(field);
+  const upb_MiniTable* sub = type == kUpb_CType_Message
+                                 ? upb_MiniTable_GetSubMessageTable(mt, field)
+                                 : NULL;
+  upb_Array* clone = upb_Array_DeepClone(arr, type, sub, arena);
+  if (!clone) return false;
+  upb_Array* dst_arr = upb_Message_GetMutableArray(dst, field);
+  if (!dst_arr || upb_Array_Size(dst_arr) == 0) {
+    return _upb_Message_SetField(dst, field, &clone, arena);
+  }
+  for (size_t i = 0, n = upb_Array_Size(clone); i < n; i++) {
+    if (!upb_Array_Append(dst_arr, upb_Array_Get(clone, i), arena)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool _upb_FieldMask_MergeMap(upb_Message* dst, const upb_Message* src,
+                                    const upb_MiniTable* mt,
+                                    const upb_MiniTableField* field,
+                                    int options, upb_Arena* arena) {
+  if (options & kUpb_FieldMaskMerge_ReplaceRepeated) {
+    upb_Message_ClearField(dst, field);
+  }
+  const upb_Map* map = upb_Message_GetMap(src, field);
+  if (!map || upb_Map_Size(map) == 0) return true;
+  const upb_MiniTable* entry = upb_MiniTable_GetSubMessageTable(mt, field);
+  upb_Map* clone =
+      upb_Map_DeepClone(map, upb_MiniTableField_CType(&entry->fields[0]),
+                        upb_MiniTableField_CType(&entry->fields[1]), entry,
+                        arena);
+  if (!clone) return false;
+  upb_Map* dst_map = upb_Message_GetMutableMap(dst, field);
+  if (!dst_map || upb_Map_Size(dst_map) == 0) {
+    return _upb_Message_SetField(dst, field, &clone, arena);
+  }
+  upb_MessageValue key, val;
+  size_t iter = kUpb_Map_Begin;
+  while (upb_Map_Next(clone, &key, &val, &iter)) {
+    if (!upb_Map_Set(dst_map, key, val, arena)) return false;
+  }
+  return true;
+}
+
+static bool _upb_FieldMask_MergeMessage(upb_Message* dst,
+                                        const upb_Message* src,
+                                        const upb_MiniTable* mt,
+                                        const upb_MiniTableField* field,
+                                        int options, upb_Arena* arena) {
+  if (options & kUpb_FieldMaskMerge_ReplaceMessages) {
+    upb_Message_ClearField(dst, field);
+  }
+  const upb_Message* src_sub = upb_Message_GetMessage(src, field, NULL);
+  if (!src_sub) return true;
+  const upb_MiniTable* sub = upb_MiniTable_GetSubMessageTable(mt, field);
+  if (!upb_Message_HasField(dst, field)) {
+    upb_Message* clone = upb_Message_DeepClone(src_sub, sub, arena);
+    if (!clone) return false;
+    upb_Message_SetMessage(dst, mt, field, clone);
+    return true;
+  }
+  upb_Message* dst_sub =
+      upb_Message_GetOrCreateMutableMessage(dst, mt, field, arena);
+  return dst_sub && upb_Message_Merge(dst_sub, src_sub, sub, arena);
+}
+
+bool upb_Message_MergeMasked(upb_Message* dst, const upb_Message* src,
+                             const upb_FieldMask* mask, int options,
+                             upb_Arena* arena) {
+  const upb_MiniTable* mt = mask->mini_table;
+  for (size_t i = 0; i < mt->field_count; i++) {
+    const upb_MiniTableField* field = &mt->fields[i];
+    const upb_FieldMask* sub = mask->fields[i];
+    bool ok;
+    if (!sub) {
+      continue;
+    } else if (sub != &_upb_FieldMask_All) {
+      // Like C++, descend even if neither message has the field, so that
+      // `dst` ends up with the (empty) sub-message.
+      const upb_MiniTable* sub_mt = upb_MiniTable_GetSubMessageTable(mt, field);
+      const upb_Message* src_sub = upb_Message_GetMessage(src, field, NULL);
+      if (!src_sub) src_sub = upb_Message_New(sub_mt, arena);
+      upb_Message* dst_sub =
+          upb_Message_GetOrCreateMutableMessage(dst, mt, field, arena);
+      ok = src_sub && dst_sub &&
+           upb_Message_MergeMasked(dst_sub, src_sub, sub, options, arena);
+    } else if (upb_FieldMode_Get(field) == kUpb_FieldMode_Map) {
+      ok = _upb_FieldMask_MergeMap(dst, src, mt, field, options, arena);
+    } else if (upb_FieldMode_Get(field) == kUpb_FieldMode_Array) {
+      ok = _upb_FieldMask_MergeArray(dst, src, mt, field, options, arena);
+    } else if (upb_MiniTableField_CType(field) == kUpb_CType_Message) {
+      ok = _upb_FieldMask_MergeMessage(dst, src, mt, field, options, arena);
+    } else {
+      ok = _upb_FieldMask_MergeScalar(dst, src, field, arena);
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
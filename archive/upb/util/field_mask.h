@@ -0,0 +1,98 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_UTIL_FIELD_MASK_H_
+#define UPB_UTIL_FIELD_MASK_H_
+
+#include <stddef.h>
+
+#include "upb/base/status.h"
+#include "upb/base/string_view.h"
+#include "upb/mem/arena.h"
+#include "upb/message/message.h"
+#include "upb/reflection/def.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A compiled google.protobuf.FieldMask: a tree of the fields named by a list of
+// paths, resolved to MiniTable fields once so that applying the mask to a
+// message needs neither path parsing nor reflection.
+typedef struct upb_FieldMask upb_FieldMask;
+
+// Compiles `count` paths, each a dot-separated list of field names such as
+// "foo.bar", against message type `m`.  Only the last field of a path may be
+// repeated or a map, and a path also covers all paths below it.  Returns NULL
+// and sets `status` if a path names an unknown field or descends through a
+// field that is not a singular message.  The mask lives in `arena` and refers
+// to the MiniTables of `m`.
+upb_FieldMask* upb_FieldMask_New(const upb_MessageDef* m,
+                                 const upb_StringView* paths, size_t count,
+                                 upb_Arena* arena, upb_Status* status);
+
+// Returns the MiniTable of the message type the mask was compiled against.
+const upb_MiniTable* upb_FieldMask_MiniTable(const upb_FieldMask* mask);
+
+// Clears every field of `msg` that is not covered by `mask`, like
+// FieldMaskUtil::TrimMessage() in C++.  Extensions and unknown fields are kept.
+// Sub-messages that were never promoted (see upb/message/promote.h) are kept
+// whole.
+void upb_Message_Project(upb_Message* msg, const upb_FieldMask* mask);
+
+enum {
+  // Replace, rather than merge, singular message fields covered by the mask.
+  kUpb_FieldMaskMerge_ReplaceMessages = 1,
+
+  // Replace, rather than append to, repeated and map fields covered by the
+  // mask.
+  kUpb_FieldMaskMerge_ReplaceRepeated = 2,
+};
+
+// Merges the fields covered by `mask` from `src` into `dst`, like
+// FieldMaskUtil::MergeMessageTo() in C++.  A covered scalar or string field
+// is copied if it is set in `src` and cleared otherwise.  Values are deep
+// copied into `arena`, so `src` need not outlive `dst`.  `options` is a
+// bitwise OR of the kUpb_FieldMaskMerge_* flags above.  Returns false if
+// memory allocation failed, in which case `dst` may be partially merged.
+bool upb_Message_MergeMasked(upb_Message* dst, const upb_Message* src,
+                             const upb_FieldMask* mask, int options,
+                             upb_Arena* arena);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_UTIL_FIELD_MASK_H_ */
@@ -0,0 +1,189 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+
+#include "upb/util/field_mask.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "upb/base/status.hpp"
+#include "upb/base/string_view.h"
+#include "upb/json/decode.h"
+#include "upb/json/encode.h"
+#include "upb/mem/arena.hpp"
+#include "upb/reflection/def.hpp"
+#include "upb/util/field_mask_test.upb.h"
+#include "upb/util/field_mask_test.upbdefs.h"
+
+namespace {
+
+class FieldMaskTest : public testing::Test {
+ protected:
+  FieldMaskTest()
+      : m_(upb_util_test_FieldMaskTest_getmsgdef(defpool_.ptr())) {}
+
+  const upb_FieldMask* Compile(const std::vector<std::string>& paths,
+                               upb::Status* status = nullptr) {
+    std::vector<upb_StringView> views;
+    for (const auto& path : paths) {
+      views.push_back(upb_StringView_FromDataAndSize(path.data(), path.size()));
+    }
+    upb::Status tmp;
+    return upb_FieldMask_New(m_.ptr(), views.data(), views.size(),
+                             arena_.ptr(), status ? status->ptr() : tmp.ptr());
+  }
+
+  upb_Message* Parse(const std::string& json, upb_Arena* arena) {
+    upb_Message* msg = upb_Message_New(m_.mini_table(), arena);
+    upb::Status status;
+    EXPECT_TRUE(upb_JsonDecode(json.data(), json.size(), msg, m_.ptr(),
+                               defpool_.ptr(), 0, arena, status.ptr()))
+        << status.error_message();
+    return msg;
+  }
+
+  std::string ToJson(const upb_Message* msg) {
+    char buf[1024];
+    upb::Status status;
+    size_t size = upb_JsonEncode(msg, m_.ptr(), defpool_.ptr(), 0, buf,
+                                 sizeof(buf), status.ptr());
+    EXPECT_LT(size, sizeof(buf)) << status.error_message();
+    return std::string(buf, size);
+  }
+
+  std::string Project(const std::string& json,
+                      const std::vector<std::string>& paths) {
+    upb_Message* msg = Parse(json, arena_.ptr());
+    const upb_FieldMask* mask = Compile(paths);
+    EXPECT_NE(mask, nullptr);
+    upb_Message_Project(msg, mask);
+    return ToJson(msg);
+  }
+
+  std::string Merge(const std::string& dst_json, const std::string& src_json,
+                    const std::vector<std::string>& paths, int options = 0) {
+    upb_Message* dst = Parse(dst_json, arena_.ptr());
+    const upb_FieldMask* mask = Compile(paths);
+    EXPECT_NE(mask, nullptr);
+    {
+      // `dst` must not keep pointers into the source's arena.
+      upb::Arena src_arena;
+      upb_Message* src = Parse(src_json, src_arena.ptr());
+      EXPECT_TRUE(
+          upb_Message_MergeMasked(dst, src, mask, options, arena_.ptr()));
+    }
+    return ToJson(dst);
+  }
+
+  upb::Arena arena_;
+  upb::DefPool defpool_;
+  upb::MessageDefPtr m_;
+};
+
+TEST_F(FieldMaskTest, InvalidPaths) {
+  upb::Status status;
+  EXPECT_EQ(Compile({"i32", "missing"}, &status), nullptr);
+  EXPECT_NE(std::string(status.error_message()).find("missing"),
+            std::string::npos);
+  EXPECT_EQ(Compile({"i32.a"}), nullptr);
+  EXPECT_EQ(Compile({"rep.a"}), nullptr);
+  EXPECT_EQ(Compile({"nested.missing"}), nullptr);
+  EXPECT_EQ(Compile({"nested."}), nullptr);
+  EXPECT_NE(Compile({"rep", "nested.child.child.b", "map"}), nullptr);
+}
+
+TEST_F(FieldMaskTest, Project) {
+  const char* json =
+      R"({"i32":1,"str":"s","nested":{"a":2,"b":"t","child":{"a":3}},)"
+      R"("rep":[{"a":4}],"map":{"k":5},"oStr":"o"})";
+  EXPECT_EQ(Project(json, {"i32", "nested.b", "nested.child"}),
+            R"({"i32":1,"nested":{"b":"t","child":{"a":3}}})");
+  EXPECT_EQ(Project(json, {"rep", "map", "o_str"}),
+            R"({"rep":[{"a":4}],"map":{"k":5},"oStr":"o"})");
+  EXPECT_EQ(Project(json, {"o_int"}), "{}");
+  // A path covers everything below it, whatever order they come in.
+  EXPECT_EQ(Project(json, {"nested.child.a", "nested"}),
+            R"({"nested":{"a":2,"b":"t","child":{"a":3}}})");
+  EXPECT_EQ(Project(json, {}), "{}");
+}
+
+TEST_F(FieldMaskTest, MergeScalars) {
+  // Covered fields are copied when set in the source and cleared otherwise.
+  EXPECT_EQ(Merge(R"({"i32":1,"str":"old"})", R"({"str":"new"})",
+                  {"i32", "str"}),
+            R"({"str":"new"})");
+  EXPECT_EQ(Merge(R"({"i32":1,"str":"old"})", R"({"i32":2,"str":"new"})",
+                  {"i32"}),
+            R"({"i32":2,"str":"old"})");
+  EXPECT_EQ(Merge(R"({"oInt":1})", R"({"oStr":"x"})", {"o_str"}),
+            R"({"oStr":"x"})");
+  EXPECT_EQ(Merge(R"({"oInt":1})", R"({})", {"o_str"}), R"({"oInt":1})");
+}
+
+TEST_F(FieldMaskTest, MergeSubPaths) {
+  EXPECT_EQ(Merge(R"({"nested":{"a":1,"b":"old"}})",
+                  R"({"nested":{"a":2,"b":"new"}})", {"nested.b"}),
+            R"({"nested":{"a":1,"b":"new"}})");
+  EXPECT_EQ(Merge(R"({"nested":{"a":1,"b":"old"}})", R"({})", {"nested.b"}),
+            R"({"nested":{"a":1}})");
+  EXPECT_EQ(Merge(R"({})", R"({"nested":{"child":{"a":3,"b":"x"}}})",
+                  {"nested.child.b"}),
+            R"({"nested":{"child":{"b":"x"}}})");
+}
+
+TEST_F(FieldMaskTest, MergeMessages) {
+  const char* dst = R"({"nested":{"a":1,"b":"old"}})";
+  const char* src = R"({"nested":{"b":"new","child":{"a":2}}})";
+  EXPECT_EQ(Merge(dst, src, {"nested"}),
+            R"({"nested":{"a":1,"b":"new","child":{"a":2}}})");
+  EXPECT_EQ(Merge(dst, src, {"nested"}, kUpb_FieldMaskMerge_ReplaceMessages),
+            R"({"nested":{"b":"new","child":{"a":2}}})");
+  EXPECT_EQ(Merge(R"({})", src, {"nested"}),
+            R"({"nested":{"b":"new","child":{"a":2}}})");
+  EXPECT_EQ(Merge(dst, R"({})", {"nested"}), dst);
+  EXPECT_EQ(Merge(dst, R"({})", {"nested"},
+                  kUpb_FieldMaskMerge_ReplaceMessages),
+            "{}");
+}
+
+TEST_F(FieldMaskTest, MergeRepeated) {
+  const char* dst = R"({"rep":[{"a":1}],"repStr":["x"],"map":{"k":1,"l":2}})";
+  const char* src = R"({"rep":[{"b":"y"}],"repStr":["y"],"map":{"k":3}})";
+  EXPECT_EQ(Merge(dst, src, {"rep", "rep_str", "map"}),
+            R"({"rep":[{"a":1},{"b":"y"}],"repStr":["x","y"],)"
+            R"("map":{"k":3,"l":2}})");
+  EXPECT_EQ(Merge(dst, src, {"rep", "rep_str", "map"},
+                  kUpb_FieldMaskMerge_ReplaceRepeated),
+            src);
+  EXPECT_EQ(Merge(R"({})", src, {"rep", "rep_str", "map"}), src);
+  EXPECT_EQ(Merge(dst, R"({})", {"rep"}, kUpb_FieldMaskMerge_ReplaceRepeated),
+            R"({"repStr":["x"],"map":{"k":1,"l":2}})");
+}
+
+}  // namespace
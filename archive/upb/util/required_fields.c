@@ -34,8 +34,12 @@
 #include <stdarg.h>
 
 #include "upb/collections/map.h"
+#include "upb/message/accessors.h"
+#include "upb/message/internal/extension.h"
+#include "upb/mini_table/internal/message.h"
 #include "upb/port/vsnprintf_compat.h"
 #include "upb/reflection/message.h"
+#include "upb/wire/internal/swap.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -168,7 +172,6 @@ typedef struct {
   const upb_DefPool* ext_pool;
   jmp_buf err;
   bool has_unset_required;
-  bool save_paths;
 } upb_FindContext;
 
 static void upb_FieldPathVector_Init(upb_FieldPathVector* vec) {
@@ -192,13 +195,11 @@ static void upb_FieldPathVector_Reserve(upb_FindContext* ctx,
 }
 
 static void upb_FindContext_Push(upb_FindContext* ctx, upb_FieldPathEntry ent) {
-  if (!ctx->save_paths) return;
   upb_FieldPathVector_Reserve(ctx, &ctx->stack, 1);
   ctx->stack.path[ctx->stack.size++] = ent;
 }
 
 static void upb_FindContext_Pop(upb_FindContext* ctx) {
-  if (!ctx->save_paths) return;
   assert(ctx->stack.size != 0);
   ctx->stack.size--;
 }
@@ -215,20 +216,18 @@ static void upb_util_FindUnsetInMessage(upb_FindContext* ctx,
       // A required field is missing.
       ctx->has_unset_required = true;
 
-      if (ctx->save_paths) {
-        // Append the contents of the stack to the out array, then
-        // NULL-terminate.
-        upb_FieldPathVector_Reserve(ctx, &ctx->out_fields, ctx->stack.size + 2);
-        if (ctx->stack.size) {
-          memcpy(&ctx->out_fields.path[ctx->out_fields.size], ctx->stack.path,
-                 ctx->stack.size * sizeof(*ctx->stack.path));
-        }
-        ctx->out_fields.size += ctx->stack.size;
-        ctx->out_fields.path[ctx->out_fields.size++] =
-            (upb_FieldPathEntry){.field = f};
-        ctx->out_fields.path[ctx->out_fields.size++] =
-            (upb_FieldPathEntry){.field = NULL};
+      // Append the contents of the stack to the out array, then
+      // NULL-terminate.
+      upb_FieldPathVector_Reserve(ctx, &ctx->out_fields, ctx->stack.size + 2);
+      if (ctx->stack.size) {
+        memcpy(&ctx->out_fields.path[ctx->out_fields.size], ctx->stack.path,
+               ctx->stack.size * sizeof(*ctx->stack.path));
       }
+      ctx->out_fields.size += ctx->stack.size;
+      ctx->out_fields.path[ctx->out_fields.size++] =
+          (upb_FieldPathEntry){.field = f};
+      ctx->out_fields.path[ctx->out_fields.size++] =
+          (upb_FieldPathEntry){.field = NULL};
     }
   }
 }
@@ -236,9 +235,7 @@ static void upb_util_FindUnsetInMessage(upb_FindContext* ctx,
 static void upb_util_FindUnsetRequiredInternal(upb_FindContext* ctx,
                                                const upb_Message* msg,
                                                const upb_MessageDef* m) {
-  // OPT: add markers in the schema for where we can avoid iterating:
-  // 1. messages with no required fields.
-  // 2. messages that cannot possibly reach any required fields.
+  // OPT: add markers in the schema for messages with no required fields.
 
   upb_util_FindUnsetInMessage(ctx, msg, m);
   if (!msg) return;
@@ -248,18 +245,23 @@ static void upb_util_FindUnsetRequiredInternal(upb_FindContext* ctx,
   // in the previous loop.  We do this separately because this loop will also
   // find present extensions, which the previous loop will not.
   //
-  // TODO(haberman): consider changing upb_Message_Next() to be capable of
-  // visiting extensions only, for example with a kUpb_Message_BeginEXT
+  // TODO(haberman): consider changing upb_Message_NextPresent() to be capable
+  // of visiting extensions only, for example with a kUpb_Message_BeginEXT
   // constant.
   size_t iter = kUpb_Message_Begin;
   const upb_FieldDef* f;
   upb_MessageValue val;
-  while (upb_Message_Next(msg, m, ctx->ext_pool, &f, &val, &iter)) {
-    // Skip non-submessage fields.
+  while (upb_Message_NextPresent(msg, m, ctx->ext_pool, &f, &val, &iter)) {
+    // Skip non-submessage fields, and those that cannot reach any required
+    // fields.
     if (!upb_FieldDef_IsSubMessage(f)) continue;
+    const upb_MessageDef* sub_m = upb_FieldDef_MessageSubDef(f);
+    if (upb_MessageDef_MiniTable(sub_m)->flags &
+        kUpb_MiniTableFlag_NoReachableRequired) {
+      continue;
+    }
 
     upb_FindContext_Push(ctx, (upb_FieldPathEntry){.field = f});
-    const upb_MessageDef* sub_m = upb_FieldDef_MessageSubDef(f);
 
     if (upb_FieldDef_IsMap(f)) {
       // Map field.
@@ -292,22 +294,144 @@ static void upb_util_FindUnsetRequiredInternal(upb_FindContext* ctx,
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// upb_util_HasUnsetRequiredByMiniTable()
+////////////////////////////////////////////////////////////////////////////////
+
+static bool upb_util_HasUnsetRequiredInternal(const upb_Message* msg,
+                                              const upb_MiniTable* mt,
+                                              bool check_extensions);
+
+// Sub-messages parsed lazily or without a linked MiniTable are tagged as
+// empty; their required fields count as unset, just like in an empty message.
+static const upb_Message* upb_util_Untag(const upb_Message* msg) {
+  return _upb_TaggedMessagePtr_GetMessage((upb_TaggedMessagePtr)msg);
+}
+
+static bool upb_util_HasUnsetRequiredInArray(const upb_Array* arr,
+                                             const upb_MiniTable* sub,
+                                             bool check_extensions) {
+  if (!arr) return false;
+  for (size_t i = 0, n = upb_Array_Size(arr); i < n; i++) {
+    const upb_Message* elem = upb_util_Untag(upb_Array_Get(arr, i).msg_val);
+    if (upb_util_HasUnsetRequiredInternal(elem, sub, check_extensions)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool upb_util_HasUnsetRequiredInMap(const upb_Map* map,
+                                           const upb_MiniTable* entry,
+                                           bool check_extensions) {
+  const upb_MiniTableField* val_f = &entry->fields[1];
+  if (!map || upb_MiniTableField_CType(val_f) != kUpb_CType_Message) {
+    return false;
+  }
+  const upb_MiniTable* sub = upb_MiniTable_GetSubMessageTable(entry, val_f);
+  if (!sub || (sub->flags & kUpb_MiniTableFlag_NoReachableRequired)) {
+    return false;
+  }
+  size_t iter = kUpb_Map_Begin;
+  upb_MessageValue key, val;
+  while (upb_Map_Next(map, &key, &val, &iter)) {
+    if (upb_util_HasUnsetRequiredInternal(upb_util_Untag(val.msg_val), sub,
+                                          check_extensions)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool upb_util_HasUnsetRequiredInExtensions(const upb_Message* msg) {
+  size_t count;
+  const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &count);
+  for (size_t i = 0; i < count; i++) {
+    const upb_MiniTableField* f = &ext[i].ext->field;
+    if (upb_MiniTableField_CType(f) != kUpb_CType_Message) continue;
+    const upb_MiniTable* sub = ext[i].ext->sub.submsg;
+    if (sub->flags & kUpb_MiniTableFlag_NoReachableRequired) continue;
+    if (upb_IsRepeatedOrMap(f)) {
+      if (upb_util_HasUnsetRequiredInArray(ext[i].data.ptr, sub, true)) {
+        return true;
+      }
+    } else if (upb_util_HasUnsetRequiredInternal(
+                   upb_util_Untag(ext[i].data.ptr), sub, true)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool upb_util_HasUnsetRequiredInternal(const upb_Message* msg,
+                                              const upb_MiniTable* mt,
+                                              bool check_extensions) {
+  if (!msg) return mt->required_count != 0;
+
+  if (mt->required_count) {
+    uint64_t msg_head;
+    memcpy(&msg_head, msg, 8);
+    msg_head = _upb_BigEndian_Swap64(msg_head);
+    if (upb_MiniTable_requiredmask(mt) & ~msg_head) return true;
+  }
+
+  for (int i = 0; i < mt->field_count; i++) {
+    const upb_MiniTableField* f = &mt->fields[i];
+    if (upb_MiniTableField_CType(f) != kUpb_CType_Message) continue;
+    const upb_MiniTable* sub = upb_MiniTable_GetSubMessageTable(mt, f);
+    // Unlinked sub-messages can only hold unknown fields.
+    if (!sub || (sub->flags & kUpb_MiniTableFlag_NoReachableRequired)) continue;
+
+    bool unset;
+    switch (upb_FieldMode_Get(f)) {
+      case kUpb_FieldMode_Map:
+        unset = upb_util_HasUnsetRequiredInMap(upb_Message_GetMap(msg, f), sub,
+                                               check_extensions);
+        break;
+      case kUpb_FieldMode_Array:
+        unset = upb_util_HasUnsetRequiredInArray(upb_Message_GetArray(msg, f),
+                                                 sub, check_extensions);
+        break;
+      default: {
+        upb_TaggedMessagePtr tagged =
+            upb_Message_GetTaggedMessagePtr(msg, f, NULL);
+        unset = tagged && upb_util_HasUnsetRequiredInternal(
+                              _upb_TaggedMessagePtr_GetMessage(tagged), sub,
+                              check_extensions);
+        break;
+      }
+    }
+    if (unset) return true;
+  }
+
+  return check_extensions && mt->ext != kUpb_ExtMode_NonExtendable &&
+         upb_util_HasUnsetRequiredInExtensions(msg);
+}
+
+bool upb_util_HasUnsetRequiredByMiniTable(const upb_Message* msg,
+                                          const upb_MiniTable* mt,
+                                          bool check_extensions) {
+  return upb_util_HasUnsetRequiredInternal(msg, mt, check_extensions);
+}
+
 bool upb_util_HasUnsetRequired(const upb_Message* msg, const upb_MessageDef* m,
                                const upb_DefPool* ext_pool,
                                upb_FieldPathEntry** fields) {
+  if (!fields) {
+    // Without paths to report, the MiniTables have everything we need.
+    return upb_util_HasUnsetRequiredByMiniTable(
+        msg, upb_MessageDef_MiniTable(m), ext_pool != NULL);
+  }
+
   upb_FindContext ctx;
   ctx.has_unset_required = false;
-  ctx.save_paths = fields != NULL;
   ctx.ext_pool = ext_pool;
   upb_FieldPathVector_Init(&ctx.stack);
   upb_FieldPathVector_Init(&ctx.out_fields);
   upb_util_FindUnsetRequiredInternal(&ctx, msg, m);
   free(ctx.stack.path);
-  if (fields) {
-    upb_FieldPathVector_Reserve(&ctx, &ctx.out_fields, 1);
-    ctx.out_fields.path[ctx.out_fields.size] =
-        (upb_FieldPathEntry){.field = NULL};
-    *fields = ctx.out_fields.path;
-  }
+  upb_FieldPathVector_Reserve(&ctx, &ctx.out_fields, 1);
+  ctx.out_fields.path[ctx.out_fields.size] = (upb_FieldPathEntry){.field = NULL};
+  *fields = ctx.out_fields.path;
   return ctx.has_unset_required;
 }
@@ -88,6 +88,14 @@ bool upb_util_HasUnsetRequired(const upb_Message* msg, const upb_MessageDef* m,
                                const upb_DefPool* ext_pool,
                                upb_FieldPathEntry** fields);
 
+// Like upb_util_HasUnsetRequired() with NULL `fields`, but needs only the
+// MiniTable `mt` of `msg`, and never allocates.  Present extensions are
+// checked too if `check_extensions` is true.  Sub-messages whose MiniTables
+// cannot reach any required fields are not visited.
+bool upb_util_HasUnsetRequiredByMiniTable(const upb_Message* msg,
+                                          const upb_MiniTable* mt,
+                                          bool check_extensions);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
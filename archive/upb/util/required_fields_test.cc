@@ -36,7 +36,9 @@
 #include "upb/base/status.hpp"
 #include "upb/json/decode.h"
 #include "upb/mem/arena.hpp"
+#include "upb/mini_table/internal/message.h"
 #include "upb/reflection/def.hpp"
+#include "upb/util/def_to_proto.h"
 #include "upb/util/required_fields_test.upb.h"
 #include "upb/util/required_fields_test.upbdefs.h"
 
@@ -61,6 +63,21 @@ std::vector<std::string> PathsToText(upb_FieldPathEntry* entry) {
   return ret;
 }
 
+// Builds the test file into `pool` from its descriptor, so that its MiniTables
+// are built and flagged by the DefPool rather than generated.
+upb::MessageDefPtr BuildTestDef(upb::DefPool& pool) {
+  upb::Arena arena;
+  upb::DefPool generated;
+  upb::MessageDefPtr m(
+      upb_util_test_TestRequiredFields_getmsgdef(generated.ptr()));
+  google_protobuf_FileDescriptorProto* file_proto =
+      upb_FileDef_ToProto(m.file().ptr(), arena.ptr());
+  upb::Status status;
+  upb::FileDefPtr file = pool.AddFile(file_proto, &status);
+  EXPECT_TRUE(file) << status.error_message();
+  return pool.FindMessageByName("upb_util_test.TestRequiredFields");
+}
+
 void CheckRequired(absl::string_view json,
                    const std::vector<std::string>& missing) {
   upb::Arena arena;
@@ -83,6 +100,36 @@ void CheckRequired(absl::string_view json,
   // them.
   EXPECT_EQ(!missing.empty(),
             upb_util_HasUnsetRequired(test_msg, m.ptr(), defpool.ptr(), NULL));
+
+  // The MiniTable alone gives the same answer, whether it is the generated one
+  // or the one the DefPool built.
+  EXPECT_EQ(!missing.empty(),
+            upb_util_HasUnsetRequiredByMiniTable(
+                test_msg, &upb_util_test_TestRequiredFields_msg_init, true));
+  upb::DefPool dynamic_pool;
+  upb::MessageDefPtr dynamic_m = BuildTestDef(dynamic_pool);
+  EXPECT_EQ(!missing.empty(), upb_util_HasUnsetRequiredByMiniTable(
+                                  test_msg, dynamic_m.mini_table(), true));
+}
+
+TEST(RequiredFieldsTest, NoReachableRequiredFlag) {
+  upb::DefPool defpool;
+  upb::MessageDefPtr dynamic_m = BuildTestDef(defpool);
+  for (const upb_MiniTable* mt : {
+           &upb_util_test_EmptyMessage_msg_init,
+           defpool.FindMessageByName("upb_util_test.EmptyMessage").mini_table(),
+       }) {
+    EXPECT_TRUE(mt->flags & kUpb_MiniTableFlag_NoReachableRequired);
+  }
+  for (const upb_MiniTable* mt : {
+           &upb_util_test_HasRequiredField_msg_init,
+           &upb_util_test_TestRequiredFields_msg_init,
+           defpool.FindMessageByName("upb_util_test.HasRequiredField")
+               .mini_table(),
+           dynamic_m.mini_table(),
+       }) {
+    EXPECT_FALSE(mt->flags & kUpb_MiniTableFlag_NoReachableRequired);
+  }
 }
 
 // message HasRequiredField {
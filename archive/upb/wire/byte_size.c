@@ -0,0 +1,462 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Computes the serialized size of a message without encoding it.
+
+#include <string.h>
+
+#include "upb/collections/internal/array.h"
+#include "upb/collections/internal/map_sorter.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/internal/extension.h"
+#include "upb/mini_table/sub.h"
+#include "upb/wire/encode.h"
+#include "upb/wire/internal/common.h"
+#include "upb/wire/internal/encode.h"
+#include "upb/wire/internal/swap.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+typedef struct {
+  upb_EncodeStatus status;
+  jmp_buf err;
+  upb_Arena* arena;  // NULL if we are not recording sizes.
+  int options;
+  int depth;
+  _upb_mapsorter sorter;
+  size_t* sizes;
+  size_t size_count;
+  size_t size_capacity;
+} upb_Sizer;
+
+UPB_NORETURN static void _upb_Sizer_Err(upb_Sizer* s,
+                                        upb_EncodeStatus status) {
+  UPB_ASSERT(status != kUpb_EncodeStatus_Ok);
+  s->status = status;
+  UPB_LONGJMP(s->err, 1);
+}
+
+static size_t _upb_Sizer_TagSize(uint32_t field_number) {
+  return upb_WireWriter_VarintSize(field_number << 3);
+}
+
+static size_t _upb_Sizer_DelimitedSize(size_t size) {
+  return upb_WireWriter_VarintSize(size) + size;
+}
+
+// Reserves a slot for a length that will be filled in once it is known.
+static size_t _upb_Sizer_PushSize(upb_Sizer* s) {
+  if (!s->arena) return 0;
+  if (s->size_count == s->size_capacity) {
+    size_t old_bytes = s->size_capacity * sizeof(*s->sizes);
+    size_t new_capacity = UPB_MAX(64, s->size_capacity * 2);
+    s->sizes = upb_Arena_Realloc(s->arena, s->sizes, old_bytes,
+                                 new_capacity * sizeof(*s->sizes));
+    if (!s->sizes) _upb_Sizer_Err(s, kUpb_EncodeStatus_OutOfMemory);
+    s->size_capacity = new_capacity;
+  }
+  return s->size_count++;
+}
+
+static void _upb_Sizer_SetSize(upb_Sizer* s, size_t slot, size_t size) {
+  if (s->arena) s->sizes[slot] = size;
+}
+
+// The order of the entries only matters if we are recording sizes for a
+// writer that visits them in sorted order.
+static bool _upb_Sizer_IsSorted(const upb_Sizer* s) {
+  return s->arena && (s->options & kUpb_EncodeOption_Deterministic);
+}
+
+static void _upb_Sizer_SortMap(upb_Sizer* s, const upb_MiniTable* layout,
+                               const upb_Map* map, _upb_sortedmap* sorted) {
+  if (!_upb_mapsorter_pushmap(&s->sorter,
+                              layout->fields[0].UPB_PRIVATE(descriptortype),
+                              map, sorted)) {
+    _upb_Sizer_Err(s, kUpb_EncodeStatus_OutOfMemory);
+  }
+}
+
+static void _upb_Sizer_SortExts(upb_Sizer* s, const upb_Message_Extension* ext,
+                                size_t count, _upb_sortedmap* sorted) {
+  if (!_upb_mapsorter_pushexts(&s->sorter, ext, count, sorted)) {
+    _upb_Sizer_Err(s, kUpb_EncodeStatus_OutOfMemory);
+  }
+}
+
+static size_t _upb_Sizer_SizeMessage(upb_Sizer* s, const upb_Message* msg,
+                                     const upb_MiniTable* m);
+
+static size_t _upb_Sizer_SizeSubMessage(upb_Sizer* s,
+                                        upb_TaggedMessagePtr tagged,
+                                        const upb_MiniTable* m) {
+  const upb_Message* msg = _upb_Encode_SubMessage(tagged, &m);
+  return _upb_Sizer_SizeMessage(s, msg, m);
+}
+
+static size_t _upb_Sizer_SizeDelimitedMessage(upb_Sizer* s,
+                                              upb_TaggedMessagePtr tagged,
+                                              const upb_MiniTable* m) {
+  size_t slot = _upb_Sizer_PushSize(s);
+  size_t size = _upb_Sizer_SizeSubMessage(s, tagged, m);
+  _upb_Sizer_SetSize(s, slot, size);
+  return _upb_Sizer_DelimitedSize(size);
+}
+
+static size_t _upb_Sizer_SizeScalar(upb_Sizer* s, const void* field_mem,
+                                    const upb_MiniTableSub* subs,
+                                    const upb_MiniTableField* f) {
+  size_t tag_size = _upb_Sizer_TagSize(f->number);
+
+  switch (f->UPB_PRIVATE(descriptortype)) {
+    case kUpb_FieldType_Double:
+    case kUpb_FieldType_SFixed64:
+    case kUpb_FieldType_Fixed64:
+      return tag_size + 8;
+    case kUpb_FieldType_Float:
+    case kUpb_FieldType_Fixed32:
+    case kUpb_FieldType_SFixed32:
+      return tag_size + 4;
+    case kUpb_FieldType_Int64:
+    case kUpb_FieldType_UInt64:
+      return tag_size + upb_WireWriter_VarintSize(*(uint64_t*)field_mem);
+    case kUpb_FieldType_UInt32:
+      return tag_size + upb_WireWriter_VarintSize(*(uint32_t*)field_mem);
+    case kUpb_FieldType_Int32:
+    case kUpb_FieldType_Enum:
+      return tag_size +
+             upb_WireWriter_VarintSize((int64_t)*(int32_t*)field_mem);
+    case kUpb_FieldType_Bool:
+      return tag_size + 1;
+    case kUpb_FieldType_SInt32:
+      return tag_size + upb_WireWriter_VarintSize(
+                            upb_WireWriter_ZigZag32(*(int32_t*)field_mem));
+    case kUpb_FieldType_SInt64:
+      return tag_size + upb_WireWriter_VarintSize(
+                            upb_WireWriter_ZigZag64(*(int64_t*)field_mem));
+    case kUpb_FieldType_String:
+    case kUpb_FieldType_Bytes: {
+      upb_StringView view = *(upb_StringView*)field_mem;
+      return tag_size + _upb_Sizer_DelimitedSize(view.size);
+    }
+    case kUpb_FieldType_Group: {
+      size_t size;
+      upb_TaggedMessagePtr submsg = *(upb_TaggedMessagePtr*)field_mem;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      if (submsg == 0) return 0;
+      if (--s->depth == 0) {
+        _upb_Sizer_Err(s, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
+      size = 2 * tag_size + _upb_Sizer_SizeSubMessage(s, submsg, subm);
+      s->depth++;
+      return size;
+    }
+    case kUpb_FieldType_Message: {
+      size_t size;
+      upb_TaggedMessagePtr submsg = *(upb_TaggedMessagePtr*)field_mem;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      if (submsg == 0) return 0;
+      if (--s->depth == 0) {
+        _upb_Sizer_Err(s, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
+      size = tag_size + _upb_Sizer_SizeDelimitedMessage(s, submsg, subm);
+      s->depth++;
+      return size;
+    }
+    default:
+      UPB_UNREACHABLE();
+  }
+}
+
+static size_t _upb_Sizer_SizeArray(upb_Sizer* s, const upb_Message* msg,
+                                   const upb_MiniTableSub* subs,
+                                   const upb_MiniTableField* f) {
+  const upb_Array* arr = *UPB_PTR_AT(msg, f->offset, upb_Array*);
+  bool packed = _upb_MiniTableField_IsPacked(f);
+  size_t tag_size = _upb_Sizer_TagSize(f->number);
+  size_t size = 0;
+  size_t slot = 0;
+
+  if (arr == NULL || arr->size == 0) return 0;
+
+  // Claim the slot for the packed length before any sub-message slots, to
+  // match the order in which the writer consumes them.
+  if (packed) slot = _upb_Sizer_PushSize(s);
+
+#define VARINT_CASE(ctype, encode)               \
+  {                                              \
+    const ctype* ptr = _upb_array_constptr(arr); \
+    const ctype* end = ptr + arr->size;          \
+    for (; ptr != end; ptr++) {                  \
+      size += upb_WireWriter_VarintSize(encode);    \
+    }                                            \
+    break;                                       \
+  }
+
+  switch (f->UPB_PRIVATE(descriptortype)) {
+    case kUpb_FieldType_Double:
+    case kUpb_FieldType_SFixed64:
+    case kUpb_FieldType_Fixed64:
+      size = arr->size * 8;
+      break;
+    case kUpb_FieldType_Float:
+    case kUpb_FieldType_Fixed32:
+    case kUpb_FieldType_SFixed32:
+      size = arr->size * 4;
+      break;
+    case kUpb_FieldType_Int64:
+    case kUpb_FieldType_UInt64:
+      VARINT_CASE(uint64_t, *ptr);
+    case kUpb_FieldType_UInt32:
+      VARINT_CASE(uint32_t, *ptr);
+    case kUpb_FieldType_Int32:
+    case kUpb_FieldType_Enum:
+      VARINT_CASE(int32_t, (int64_t)*ptr);
+    case kUpb_FieldType_Bool:
+      size = arr->size;
+      break;
+    case kUpb_FieldType_SInt32:
+      VARINT_CASE(int32_t, upb_WireWriter_ZigZag32(*ptr));
+    case kUpb_FieldType_SInt64:
+      VARINT_CASE(int64_t, upb_WireWriter_ZigZag64(*ptr));
+    case kUpb_FieldType_String:
+    case kUpb_FieldType_Bytes: {
+      const upb_StringView* ptr = _upb_array_constptr(arr);
+      const upb_StringView* end = ptr + arr->size;
+      for (; ptr != end; ptr++) {
+        size += tag_size + _upb_Sizer_DelimitedSize(ptr->size);
+      }
+      return size;
+    }
+    case kUpb_FieldType_Group: {
+      const upb_TaggedMessagePtr* ptr = _upb_array_constptr(arr);
+      const upb_TaggedMessagePtr* end = ptr + arr->size;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      if (--s->depth == 0) {
+        _upb_Sizer_Err(s, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
+      for (; ptr != end; ptr++) {
+        size += 2 * tag_size + _upb_Sizer_SizeSubMessage(s, *ptr, subm);
+      }
+      s->depth++;
+      return size;
+    }
+    case kUpb_FieldType_Message: {
+      const upb_TaggedMessagePtr* ptr = _upb_array_constptr(arr);
+      const upb_TaggedMessagePtr* end = ptr + arr->size;
+      const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+      if (--s->depth == 0) {
+        _upb_Sizer_Err(s, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
+      if (_upb_Array_HasInlineMessages(arr)) {
+        for (size_t i = 0; i < arr->size; i++) {
+          upb_Message* submsg = _upb_Array_InlineMessage(arr, i);
+          upb_TaggedMessagePtr tagged =
+              _upb_TaggedMessagePtr_Pack(submsg, false);
+          size += tag_size + _upb_Sizer_SizeDelimitedMessage(s, tagged, subm);
+        }
+        s->depth++;
+        return size;
+      }
+      for (; ptr != end; ptr++) {
+        size += tag_size + _upb_Sizer_SizeDelimitedMessage(s, *ptr, subm);
+      }
+      s->depth++;
+      return size;
+    }
+  }
+#undef VARINT_CASE
+
+  if (packed) {
+    _upb_Sizer_SetSize(s, slot, size);
+    return tag_size + _upb_Sizer_DelimitedSize(size);
+  }
+  return size + arr->size * tag_size;
+}
+
+static size_t _upb_Sizer_SizeMapEntry(upb_Sizer* s, uint32_t number,
+                                      const upb_MiniTable* layout,
+                                      const upb_MapEntry* ent) {
+  size_t slot = _upb_Sizer_PushSize(s);
+  size_t size = _upb_Sizer_SizeScalar(s, &ent->data.k, layout->subs,
+                                      &layout->fields[0]);
+  size += _upb_Sizer_SizeScalar(s, &ent->data.v, layout->subs,
+                                &layout->fields[1]);
+  _upb_Sizer_SetSize(s, slot, size);
+  return _upb_Sizer_TagSize(number) + _upb_Sizer_DelimitedSize(size);
+}
+
+static size_t _upb_Sizer_SizeMap(upb_Sizer* s, const upb_Message* msg,
+                                 const upb_MiniTableSub* subs,
+                                 const upb_MiniTableField* f) {
+  const upb_Map* map = *UPB_PTR_AT(msg, f->offset, const upb_Map*);
+  const upb_MiniTable* layout = subs[f->UPB_PRIVATE(submsg_index)].submsg;
+  size_t size = 0;
+  UPB_ASSERT(layout->field_count == 2);
+
+  if (map == NULL) return 0;
+
+  if (_upb_Sizer_IsSorted(s)) {
+    _upb_sortedmap sorted;
+    upb_MapEntry ent;
+    _upb_Sizer_SortMap(s, layout, map, &sorted);
+    while (_upb_sortedmap_prev(&s->sorter, map, &sorted, &ent)) {
+      size += _upb_Sizer_SizeMapEntry(s, f->number, layout, &ent);
+    }
+    _upb_mapsorter_popmap(&s->sorter, &sorted);
+  } else {
+    size_t iter = kUpb_Map_Begin;
+    upb_MapEntry ent;
+    while (_upb_Map_Next(map, &ent.data.k, &ent.data.v, &iter)) {
+      size += _upb_Sizer_SizeMapEntry(s, f->number, layout, &ent);
+    }
+  }
+  return size;
+}
+
+static size_t _upb_Sizer_SizeField(upb_Sizer* s, const upb_Message* msg,
+                                   const upb_MiniTableSub* subs,
+                                   const upb_MiniTableField* field) {
+  switch (upb_FieldMode_Get(field)) {
+    case kUpb_FieldMode_Array:
+      return _upb_Sizer_SizeArray(s, msg, subs, field);
+    case kUpb_FieldMode_Map:
+      return _upb_Sizer_SizeMap(s, msg, subs, field);
+    case kUpb_FieldMode_Scalar:
+      return _upb_Sizer_SizeScalar(
+          s, _upb_MiniTableField_GetConstPtr(msg, field), subs, field);
+    default:
+      UPB_UNREACHABLE();
+  }
+}
+
+static size_t _upb_Sizer_SizeExt(upb_Sizer* s, const upb_Message_Extension* ext,
+                                 bool is_message_set) {
+  if (UPB_UNLIKELY(is_message_set)) {
+    size_t slot = _upb_Sizer_PushSize(s);
+    size_t size = _upb_Sizer_SizeMessage(s, ext->data.ptr,
+                                         ext->ext->sub.submsg);
+    _upb_Sizer_SetSize(s, slot, size);
+    return 2 * _upb_Sizer_TagSize(kUpb_MsgSet_Item) +
+           _upb_Sizer_TagSize(kUpb_MsgSet_TypeId) +
+           upb_WireWriter_VarintSize(ext->ext->field.number) +
+           _upb_Sizer_TagSize(kUpb_MsgSet_Message) +
+           _upb_Sizer_DelimitedSize(size);
+  }
+  return _upb_Sizer_SizeField(s, &ext->data, &ext->ext->sub, &ext->ext->field);
+}
+
+static size_t _upb_Sizer_SizeMessage(upb_Sizer* s, const upb_Message* msg,
+                                     const upb_MiniTable* m) {
+  size_t size = 0;
+
+  if ((s->options & kUpb_EncodeOption_CheckRequired) && m->required_count) {
+    uint64_t msg_head;
+    memcpy(&msg_head, msg, 8);
+    msg_head = _upb_BigEndian_Swap64(msg_head);
+    if (upb_MiniTable_requiredmask(m) & ~msg_head) {
+      _upb_Sizer_Err(s, kUpb_EncodeStatus_MissingRequired);
+    }
+  }
+
+  const upb_MiniTableField* f = &m->fields[0];
+  const upb_MiniTableField* end = f + m->field_count;
+  for (; f != end; f++) {
+    if (_upb_Encode_ShouldEncode(msg, f)) {
+      size += _upb_Sizer_SizeField(s, msg, m->subs, f);
+    }
+  }
+
+  if (m->ext != kUpb_ExtMode_NonExtendable) {
+    size_t ext_count;
+    const upb_Message_Extension* ext = _upb_Message_Getexts(msg, &ext_count);
+    bool is_message_set = m->ext == kUpb_ExtMode_IsMessageSet;
+    if (ext_count) {
+      if (_upb_Sizer_IsSorted(s)) {
+        _upb_sortedmap sorted;
+        _upb_Sizer_SortExts(s, ext, ext_count, &sorted);
+        while (_upb_sortedmap_prevext(&s->sorter, &sorted, &ext)) {
+          size += _upb_Sizer_SizeExt(s, ext, is_message_set);
+        }
+        _upb_mapsorter_popmap(&s->sorter, &sorted);
+      } else {
+        const upb_Message_Extension* first = ext;
+        ext += ext_count;
+        while (ext != first) {
+          size += _upb_Sizer_SizeExt(s, --ext, is_message_set);
+        }
+      }
+    }
+  }
+
+  if ((s->options & kUpb_EncodeOption_SkipUnknown) == 0) {
+    size_t unknown_size;
+    upb_Message_GetUnknown(msg, &unknown_size);
+    size += unknown_size;
+  }
+
+  return size;
+}
+
+upb_EncodeStatus _upb_Encode_ComputeSize(const upb_Message* msg,
+                                         const upb_MiniTable* l, int options,
+                                         upb_Arena* arena, size_t** sizes,
+                                         size_t* count, size_t* size) {
+  upb_Sizer s;
+  unsigned depth = (unsigned)options >> 16;
+
+  s.status = kUpb_EncodeStatus_Ok;
+  s.arena = arena;
+  s.options = options;
+  s.depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
+  s.sizes = NULL;
+  s.size_count = 0;
+  s.size_capacity = 0;
+  _upb_mapsorter_init(&s.sorter);
+
+  if (UPB_SETJMP(s.err) == 0) {
+    *size = _upb_Sizer_SizeMessage(&s, msg, l);
+  } else {
+    *size = 0;
+  }
+
+  if (arena) {
+    *sizes = s.sizes;
+    *count = s.size_count;
+  }
+  _upb_mapsorter_destroy(&s.sorter);
+  return s.status;
+}
+
+upb_EncodeStatus upb_Message_ByteSize(const void* msg, const upb_MiniTable* l,
+                                      int options, size_t* size) {
+  return _upb_Encode_ComputeSize(msg, l, options, NULL, NULL, NULL, size);
+}
@@ -32,18 +32,33 @@
 
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UPB_DECODE_SSE2 1
+#endif
+
 #include "upb/base/descriptor_constants.h"
+#include "upb/base/internal/log2.h"
 #include "upb/collections/internal/array.h"
 #include "upb/collections/internal/map.h"
+#include "upb/hash/common.h"
+#include "upb/hash/int_table.h"
 #include "upb/mem/internal/arena.h"
+#include "upb/message/accessors.h"
 #include "upb/message/internal/accessors.h"
 #include "upb/message/internal/map_entry.h"
+#include "upb/message/internal/message.h"
+#include "upb/mini_table/message.h"
 #include "upb/mini_table/sub.h"
 #include "upb/port/atomic.h"
+#include "upb/wire/decode_fast.h"
 #include "upb/wire/encode.h"
 #include "upb/wire/eps_copy_input_stream.h"
 #include "upb/wire/internal/common.h"
 #include "upb/wire/internal/decode.h"
+#include "upb/wire/internal/field_selection.h"
+#include "upb/wire/internal/metrics.h"
 #include "upb/wire/internal/swap.h"
 #include "upb/wire/reader.h"
 
@@ -93,22 +108,24 @@ static const char* _upb_Decoder_DecodeMessage(upb_Decoder* d, const char* ptr,
                                               upb_Message* msg,
                                               const upb_MiniTable* layout);
 
-UPB_NORETURN static void* _upb_Decoder_ErrorJmp(upb_Decoder* d,
-                                                upb_DecodeStatus status) {
+// Not inlined: UPB_FAST_LONGJMP() may not be used in the function that set
+// the buffer with UPB_FAST_SETJMP().
+UPB_NORETURN UPB_NOINLINE static void* _upb_Decoder_ErrorJmp(
+    upb_Decoder* d, upb_DecodeStatus status) {
   assert(status != kUpb_DecodeStatus_Ok);
   d->status = status;
-  UPB_LONGJMP(d->err, 1);
+  UPB_FAST_LONGJMP(d->err);
 }
 
 const char* _upb_FastDecoder_ErrorJmp(upb_Decoder* d, int status) {
   assert(status != kUpb_DecodeStatus_Ok);
   d->status = status;
-  UPB_LONGJMP(d->err, 1);
+  UPB_FAST_LONGJMP(d->err);
   return NULL;
 }
 
 static void _upb_Decoder_VerifyUtf8(upb_Decoder* d, const char* buf, int len) {
-  if (!_upb_Decoder_VerifyUtf8Inline(buf, len)) {
+  if (!_upb_Decoder_Utf8Ok(d, buf, len)) {
     _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_BadUtf8);
   }
 }
@@ -121,6 +138,69 @@ static bool _upb_Decoder_Reserve(upb_Decoder* d, upb_Array* arr, size_t elem) {
   return need_realloc;
 }
 
+static int _upb_Decoder_PopCount64(uint64_t x) {
+#ifdef __GNUC__
+  return __builtin_popcountll(x);
+#else
+  int n = 0;
+  for (; x; x &= x - 1) n++;
+  return n;
+#endif
+}
+
+// Returns the number of varints in the packed field data [ptr, ptr + size),
+// which is the number of bytes with a clear high bit.  This is exact for valid
+// data and an upper bound otherwise, so it can size the array up front.  The
+// caller has already verified that the data is in bounds.
+static size_t _upb_Decoder_CountVarints(const char* ptr, uint32_t size) {
+  const char* end = ptr + size;
+  size_t count = 0;
+  for (; end - ptr >= 8; ptr += 8) {
+    uint64_t word;
+    memcpy(&word, ptr, 8);
+    count += _upb_Decoder_PopCount64(~word & 0x8080808080808080ULL);
+  }
+  for (; ptr < end; ptr++) {
+    count += (*ptr & 0x80) == 0;
+  }
+  return count;
+}
+
+// Returns the number of records with tag `tag` that immediately follow `ptr`.
+// Only records that lie entirely within the current buffer and limit are
+// counted; any others will be handled by the ordinary array growth path.
+static size_t _upb_Decoder_CountRepeatedRun(upb_Decoder* d, const char* ptr,
+                                            uint32_t tag) {
+  const char* end =
+      d->input.end + UPB_MIN(d->input.limit, kUpb_EpsCopyInputStream_SlopBytes);
+  size_t count = 0;
+  while (ptr < end) {
+    uint64_t val;
+    ptr = _upb_Decoder_ScanVarint(ptr, end, &val);
+    if (!ptr || val != tag) break;
+    switch (upb_WireReader_GetWireType(tag)) {
+      case kUpb_WireType_Varint:
+        ptr = _upb_Decoder_ScanVarint(ptr, end, &val);
+        break;
+      case kUpb_WireType_32Bit:
+        ptr = end - ptr >= 4 ? ptr + 4 : NULL;
+        break;
+      case kUpb_WireType_64Bit:
+        ptr = end - ptr >= 8 ? ptr + 8 : NULL;
+        break;
+      case kUpb_WireType_Delimited:
+        ptr = _upb_Decoder_ScanVarint(ptr, end, &val);
+        ptr = ptr && (uint64_t)(end - ptr) >= val ? ptr + val : NULL;
+        break;
+      default:
+        return count;
+    }
+    if (!ptr) break;
+    count++;
+  }
+  return count;
+}
+
 typedef struct {
   const char* ptr;
   uint64_t val;
@@ -228,6 +308,7 @@ static upb_Message* _upb_Decoder_NewSubMessage(upb_Decoder* d,
   UPB_ASSERT(subl);
   upb_Message* msg = _upb_Message_New(subl, &d->arena);
   if (!msg) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  _upb_Decoder_PrefetchArena(d);
 
   // Extensions should not be unlinked.  A message extension should not be
   // registered until its sub-message type is available to be linked.
@@ -251,7 +332,10 @@ static upb_Message* _upb_Decoder_ReuseSubMessage(
   const upb_MiniTable* subl = subs[field->UPB_PRIVATE(submsg_index)].submsg;
   UPB_ASSERT(subl);
   if (!upb_TaggedMessagePtr_IsEmpty(tagged) || subl == &_kUpb_MiniTable_Empty) {
-    return _upb_TaggedMessagePtr_GetMessage(tagged);
+    // We merge into the existing message.
+    upb_Message* existing = _upb_TaggedMessagePtr_GetMessage(tagged);
+    _upb_Message_Modified(existing);
+    return existing;
   }
 
   // We found an empty message from a previous parse that was performed before
@@ -267,8 +351,140 @@ static upb_Message* _upb_Decoder_ReuseSubMessage(
   return promoted;
 }
 
+UPB_FORCEINLINE
+static bool _upb_Decoder_IsLazySubMessage(upb_Decoder* d,
+                                          const upb_MiniTableField* field) {
+  return (d->options & kUpb_DecodeOption_ExperimentalLazySubMessages) &&
+         field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_Message &&
+         !(field->mode & kUpb_LabelFlags_IsExtension);
+}
+
+// The most unknown-field space _upb_Decoder_AddUnknown() reserves ahead.
+#define kUpb_Decoder_MaxUnknownReserve 4096
+
+// Adds the `size` bytes of data at `ptr` to the unknown fields of `msg`,
+// aliasing the input buffer if kUpb_DecodeOption_AliasUnknown allows it.
+static void _upb_Decoder_AddUnknown(upb_Decoder* d, upb_Message* msg,
+                                    const char* ptr, size_t size) {
+  bool ok;
+  // A truncated trailing field may run into the slop bytes past the end of the
+  // input, which are not part of the caller's buffer.  Copy such a field from
+  // our own buffer instead; the truncation is reported once we pass the limit.
+  if ((d->options & kUpb_DecodeOption_AliasUnknown) &&
+      upb_EpsCopyInputStream_CheckSize(&d->input, ptr, size) &&
+      upb_EpsCopyInputStream_AliasingAvailable(&d->input, ptr, size)) {
+    ptr = upb_EpsCopyInputStream_GetAliasedPtr(&d->input, ptr);
+    ok = _upb_Message_AddUnknownAliased(msg, ptr, size, &d->arena);
+  } else {
+    size_t unknown_size;
+    upb_Message_GetUnknown(msg, &unknown_size);
+    ok = true;
+    if (unknown_size) {
+      // A message with several unknown fields likely has more, so make room
+      // for the rest of it (up to a point) instead of growing field by field.
+      size_t rest = d->input.end + d->input.limit - ptr;
+      ok = _upb_Message_ReserveUnknown(
+          msg, UPB_MAX(size, UPB_MIN(rest, kUpb_Decoder_MaxUnknownReserve)),
+          &d->arena);
+    }
+    ok = ok && _upb_Message_AddUnknown(msg, ptr, size, &d->arena);
+  }
+  if (!ok) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  d->unknown_bytes += size;
+}
+
+// Stores the `size` bytes of sub-message data at `ptr` into the empty message
+// `*target`, creating it if necessary, instead of parsing them.  Returns NULL
+// if the data must be parsed after all, because `*target` holds a non-empty
+// message or the data is not contiguous in the current buffer.
+static const char* _upb_Decoder_DeferSubMessage(upb_Decoder* d,
+                                                const char* ptr,
+                                                upb_TaggedMessagePtr* target,
+                                                int size) {
+  upb_Message* empty;
+  if (*target && !upb_TaggedMessagePtr_IsEmpty(*target)) return NULL;
+  if (!upb_EpsCopyInputStream_CheckDataSizeAvailable(&d->input, ptr, size)) {
+    return NULL;
+  }
+  if (*target) {
+    empty = _upb_TaggedMessagePtr_GetEmptyMessage(*target);
+  } else {
+    empty = _upb_Message_New(&_kUpb_MiniTable_Empty, &d->arena);
+    if (!empty) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+    *target = _upb_TaggedMessagePtr_Pack(empty, true);
+  }
+  _upb_Decoder_AddUnknown(d, empty, ptr, size);
+  return ptr + size;
+}
+
+// Limits of kUpb_DecodeOption_InternStrings.
+#define kUpb_Decoder_InternMaxSize 64
+#define kUpb_Decoder_InternMinSlots 64
+#define kUpb_Decoder_InternMaxSlots 4096
+
+// Doubles the size of the intern table.  Returns false if it is already as
+// large as it may get or allocation fails, and the string should be copied
+// without interning.
+static bool _upb_Decoder_GrowInternTable(upb_Decoder* d) {
+  uint32_t slots = d->intern ? (d->intern_mask + 1) * 2
+                             : kUpb_Decoder_InternMinSlots;
+  if (slots > kUpb_Decoder_InternMaxSlots) return false;
+  upb_StringView* table = upb_gmalloc(slots * sizeof(*table));
+  if (!table) return false;
+  memset(table, 0, slots * sizeof(*table));
+  for (uint32_t i = 0; d->intern && i <= d->intern_mask; i++) {
+    upb_StringView str = d->intern[i];
+    if (!str.data) continue;
+    uint32_t j = _upb_Hash(str.data, str.size, 0) & (slots - 1);
+    while (table[j].data) j = (j + 1) & (slots - 1);
+    table[j] = str;
+  }
+  upb_gfree(d->intern);
+  d->intern = table;
+  d->intern_mask = slots - 1;
+  return true;
+}
+
+// Reads a string like _upb_Decoder_ReadString() would copy it, but reuses the
+// copy of an equal string read earlier in this decode.
+UPB_NOINLINE
+static const char* _upb_Decoder_InternString(upb_Decoder* d, const char* ptr,
+                                             int size, upb_StringView* str) {
+  uint32_t i = 0;
+  bool insert = false;
+  if (upb_EpsCopyInputStream_CheckDataSizeAvailable(&d->input, ptr, size) &&
+      (d->intern_count < (d->intern_mask + 1) / 4 * 3 ||
+       _upb_Decoder_GrowInternTable(d))) {
+    i = _upb_Hash(ptr, size, 0) & d->intern_mask;
+    for (; d->intern[i].data; i = (i + 1) & d->intern_mask) {
+      if (d->intern[i].size == (size_t)size &&
+          memcmp(d->intern[i].data, ptr, size) == 0) {
+        *str = d->intern[i];
+        return ptr + size;
+      }
+    }
+    insert = true;
+  }
+
+  const char* str_ptr = ptr;
+  ptr = upb_EpsCopyInputStream_ReadString(&d->input, &str_ptr, size, &d->arena);
+  if (!ptr) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  str->data = str_ptr;
+  str->size = size;
+  if (insert) {
+    d->intern[i] = *str;
+    d->intern_count++;
+  }
+  return ptr;
+}
+
 static const char* _upb_Decoder_ReadString(upb_Decoder* d, const char* ptr,
                                            int size, upb_StringView* str) {
+  if (UPB_UNLIKELY(d->options & kUpb_DecodeOption_InternStrings) &&
+      size > 0 && size <= kUpb_Decoder_InternMaxSize &&
+      !upb_EpsCopyInputStream_AliasingAvailable(&d->input, ptr, size)) {
+    return _upb_Decoder_InternString(d, ptr, size, str);
+  }
   const char* str_ptr = ptr;
   ptr = upb_EpsCopyInputStream_ReadString(&d->input, &str_ptr, size, &d->arena);
   if (!ptr) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
@@ -277,6 +493,23 @@ static const char* _upb_Decoder_ReadString(upb_Decoder* d, const char* ptr,
   return ptr;
 }
 
+// Like _upb_Decoder_ReadString(), but copies a short string that cannot be
+// aliased into the inline buffer that follows `str` in the message.
+static const char* _upb_Decoder_ReadInlineString(upb_Decoder* d,
+                                                 const char* ptr, int size,
+                                                 upb_StringView* str) {
+  if (size > kUpb_MiniTableField_InlineStringSize ||
+      upb_EpsCopyInputStream_AliasingAvailable(&d->input, ptr, size)) {
+    return _upb_Decoder_ReadString(d, ptr, size, str);
+  }
+  char* buf = (char*)(str + 1);
+  ptr = upb_EpsCopyInputStream_Copy(&d->input, ptr, buf, size);
+  if (!ptr) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_Malformed);
+  str->data = buf;
+  str->size = size;
+  return ptr;
+}
+
 UPB_FORCEINLINE
 static const char* _upb_Decoder_RecurseSubMessage(upb_Decoder* d,
                                                   const char* ptr,
@@ -306,6 +539,23 @@ static const char* _upb_Decoder_DecodeSubMessage(
   return ptr;
 }
 
+// Like _upb_Decoder_DecodeSubMessage(), but with
+// kUpb_DecodeOption_ExplicitStack leaves the sub-message in `d->push_msg` for
+// _upb_Decoder_DecodeMessageExplicitStack() to enter, instead of decoding it.
+// Only for fields that are decoded directly from that loop.
+UPB_FORCEINLINE
+static const char* _upb_Decoder_DecodeOrPushSubMessage(
+    upb_Decoder* d, const char* ptr, upb_Message* submsg,
+    const upb_MiniTableSub* subs, const upb_MiniTableField* field, int size) {
+  if (UPB_UNLIKELY(d->options & kUpb_DecodeOption_ExplicitStack)) {
+    d->push_msg = submsg;
+    d->push_layout = subs[field->UPB_PRIVATE(submsg_index)].submsg;
+    d->push_size = size;
+    return ptr;
+  }
+  return _upb_Decoder_DecodeSubMessage(d, ptr, submsg, subs, field, size);
+}
+
 UPB_FORCEINLINE
 static const char* _upb_Decoder_DecodeGroup(upb_Decoder* d, const char* ptr,
                                             upb_Message* submsg,
@@ -355,6 +605,7 @@ static void _upb_Decoder_AddUnknownVarints(upb_Decoder* d, upb_Message* msg,
   if (!_upb_Message_AddUnknown(msg, buf, end - buf, &d->arena)) {
     _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
   }
+  d->unknown_bytes += end - buf;
 }
 
 UPB_NOINLINE
@@ -417,24 +668,100 @@ static const char* _upb_Decoder_DecodeFixedPacked(
   arr->size += count;
   // Note: if/when the decoder supports multi-buffer input, we will need to
   // handle buffer seams here.
-  if (_upb_IsLittleEndian()) {
-    ptr = upb_EpsCopyInputStream_Copy(&d->input, ptr, mem, val->size);
+  ptr = upb_EpsCopyInputStream_Copy(&d->input, ptr, mem, val->size);
+  // Big-endian hosts convert the copied elements in one pass.
+  if (lg2 == 2) {
+    _upb_BigEndian_SwapArray32(mem, count);
   } else {
-    int delta = upb_EpsCopyInputStream_PushLimit(&d->input, ptr, val->size);
-    char* dst = mem;
-    while (!_upb_Decoder_IsDone(d, &ptr)) {
-      if (lg2 == 2) {
-        ptr = upb_WireReader_ReadFixed32(ptr, dst);
-        dst += 4;
-      } else {
-        UPB_ASSERT(lg2 == 3);
-        ptr = upb_WireReader_ReadFixed64(ptr, dst);
-        dst += 8;
+    UPB_ASSERT(lg2 == 3);
+    _upb_BigEndian_SwapArray64(mem, count);
+  }
+
+  return ptr;
+}
+
+static int _upb_Decoder_CountTrailingZeros(uint32_t x) {
+  UPB_ASSERT(x != 0);
+#ifdef __GNUC__
+  return __builtin_ctz(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Returns a mask with bit i set if byte i of the 16 bytes at `ptr` has its
+// continuation bit clear, ie. it is the last byte of a varint.
+UPB_FORCEINLINE
+static uint32_t _upb_Decoder_VarintEndMask(const char* ptr) {
+#ifdef UPB_DECODE_SSE2
+  __m128i bytes = _mm_loadu_si128((const __m128i*)ptr);
+  return ~(uint32_t)_mm_movemask_epi8(bytes) & 0xffff;
+#else
+  // Gather the top bit of each byte into the low byte of the word.
+  uint64_t lo, hi;
+  memcpy(&lo, ptr, 8);
+  memcpy(&hi, ptr + 8, 8);
+  lo = _upb_BigEndian_Swap64(lo) & 0x8080808080808080;
+  hi = _upb_BigEndian_Swap64(hi) & 0x8080808080808080;
+  uint32_t mask = (lo * 0x0002040810204081) >> 56;
+  mask |= (uint32_t)((hi * 0x0002040810204081) >> 56) << 8;
+  return ~mask & 0xffff;
+#endif
+}
+
+// Decodes the packed varints in [ptr, end) sixteen bytes at a time, appending
+// them to `arr`, which must already have room for every varint that ends in
+// that range. Stops when fewer than sixteen bytes remain, leaving any varint
+// that straddles the last window to the caller.
+UPB_FORCEINLINE
+static const char* _upb_Decoder_DecodeVarintsBulk(
+    upb_Decoder* d, const char* ptr, const char* end, upb_Array* arr,
+    const upb_MiniTableField* field, int lg2) {
+  int type = field->UPB_PRIVATE(descriptortype);
+  int scale = 1 << lg2;
+  char* out = UPB_PTR_AT(_upb_array_ptr(arr), arr->size << lg2, void);
+  char* start = out;
+  while (end - ptr >= 16) {
+    uint32_t ends = _upb_Decoder_VarintEndMask(ptr);
+    if (ends == 0xffff) {
+      // Sixteen one-byte varints, the common case for small values.
+      for (int i = 0; i < 16; i++) {
+        wireval elem;
+        elem.uint64_val = (uint8_t)ptr[i];
+        _upb_Decoder_Munge(type, &elem);
+        memcpy(out, &elem, scale);
+        out += scale;
       }
+      ptr += 16;
+      continue;
+    }
+    if (ends == 0) {
+      // No varint ends within sixteen bytes, so this one is too long.
+      _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_Malformed);
     }
-    upb_EpsCopyInputStream_PopLimit(&d->input, ptr, delta);
+    const char* window = ptr;
+    do {
+      const char* last = window + _upb_Decoder_CountTrailingZeros(ends);
+      if (last - ptr >= 10) {
+        _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_Malformed);
+      }
+      wireval elem;
+      elem.uint64_val = 0;
+      for (int shift = 0; ptr <= last; ptr++, shift += 7) {
+        elem.uint64_val |= (uint64_t)(*ptr & 0x7f) << shift;
+      }
+      _upb_Decoder_Munge(type, &elem);
+      memcpy(out, &elem, scale);
+      out += scale;
+      ends &= ends - 1;
+    } while (ends);
   }
-
+  arr->size += (out - start) >> lg2;
   return ptr;
 }
 
@@ -443,7 +770,22 @@ static const char* _upb_Decoder_DecodeVarintPacked(
     upb_Decoder* d, const char* ptr, upb_Array* arr, wireval* val,
     const upb_MiniTableField* field, int lg2) {
   int scale = 1 << lg2;
+  if (d->options & kUpb_DecodeOption_PrescanRepeated) {
+    _upb_Decoder_Reserve(d, arr, _upb_Decoder_CountVarints(ptr, val->size));
+  }
   int saved_limit = upb_EpsCopyInputStream_PushLimit(&d->input, ptr, val->size);
+  // The data before `bulk_end` is contiguous in the current buffer, so it can
+  // be scanned in wide loads without crossing a buffer seam. A field that runs
+  // past the slop region stops one byte short of it, so that the buffer flip
+  // in _upb_Decoder_IsDone() still sees an overrun it can handle.
+  const char* bulk_end =
+      d->input.end +
+      UPB_MIN(d->input.limit, kUpb_EpsCopyInputStream_SlopBytes - 1);
+  if (bulk_end - ptr >= 16) {
+    _upb_Decoder_Reserve(d, arr,
+                         _upb_Decoder_CountVarints(ptr, bulk_end - ptr));
+    ptr = _upb_Decoder_DecodeVarintsBulk(d, ptr, bulk_end, arr, field, lg2);
+  }
   char* out = UPB_PTR_AT(_upb_array_ptr(arr), arr->size << lg2, void);
   while (!_upb_Decoder_IsDone(d, &ptr)) {
     wireval elem;
@@ -466,6 +808,10 @@ static const char* _upb_Decoder_DecodeEnumPacked(
     const upb_MiniTableSub* subs, const upb_MiniTableField* field,
     wireval* val) {
   const upb_MiniTableEnum* e = subs[field->UPB_PRIVATE(submsg_index)].subenum;
+  if (d->options & kUpb_DecodeOption_PrescanRepeated) {
+    // Unknown enum values will not be appended, so this may overestimate.
+    _upb_Decoder_Reserve(d, arr, _upb_Decoder_CountVarints(ptr, val->size));
+  }
   int saved_limit = upb_EpsCopyInputStream_PushLimit(&d->input, ptr, val->size);
   char* out = UPB_PTR_AT(_upb_array_ptr(arr), arr->size * 4, void);
   while (!_upb_Decoder_IsDone(d, &ptr)) {
@@ -487,7 +833,8 @@ static const char* _upb_Decoder_DecodeEnumPacked(
 }
 
 upb_Array* _upb_Decoder_CreateArray(upb_Decoder* d,
-                                    const upb_MiniTableField* field) {
+                                    const upb_MiniTableField* field,
+                                    size_t capacity) {
   /* Maps descriptor type -> elem_size_lg2.  */
   static const uint8_t kElemSizeLg2[] = {
       [0] = -1,  // invalid descriptor type
@@ -512,11 +859,196 @@ upb_Array* _upb_Decoder_CreateArray(upb_Decoder* d,
   };
 
   size_t lg2 = kElemSizeLg2[field->UPB_PRIVATE(descriptortype)];
-  upb_Array* ret = _upb_Array_New(&d->arena, 4, lg2);
+  upb_Array* ret = _upb_Array_New(&d->arena, UPB_MAX(capacity, 4), lg2);
+  if (!ret) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  _upb_Decoder_PrefetchArena(d);
+  return ret;
+}
+
+// Creates the array for a field marked by upb_MiniTable_SetInlineSubMessage(),
+// which stores each message in a slot of upb_msg_sizeof(sub) bytes.
+static upb_Array* _upb_Decoder_CreateInlineArray(
+    upb_Decoder* d, const upb_MiniTableSub* subs,
+    const upb_MiniTableField* field, size_t capacity) {
+  const upb_MiniTable* subl = subs[field->UPB_PRIVATE(submsg_index)].submsg;
+  size_t lg2 = upb_Log2Ceiling(upb_msg_sizeof(subl));
+  UPB_ASSERT(sizeof(upb_Message_Internal) == kUpb_Array_InlineHeaderSize);
+  UPB_ASSERT(upb_msg_sizeof(subl) == (size_t)1 << lg2);
+  UPB_ASSERT(lg2 >= kUpb_Array_MinInlineLg2 && lg2 <= kUpb_Array_MaxInlineLg2);
+  upb_Array* ret = _upb_Array_New(&d->arena, UPB_MAX(capacity, 4), lg2);
   if (!ret) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
   return ret;
 }
 
+// Counts the elements of a non-packed repeated field that directly follow the
+// one being decoded, so that the array only needs to grow once.
+static size_t _upb_Decoder_PrescanRepeated(upb_Decoder* d, const char* ptr,
+                                           const upb_MiniTableField* field,
+                                           const wireval* val, int op) {
+  int wire_type;
+  switch (op) {
+    case kUpb_DecodeOp_Scalar1Byte:
+    case kUpb_DecodeOp_Scalar4Byte:
+    case kUpb_DecodeOp_Scalar8Byte:
+    case kUpb_DecodeOp_Enum:
+      switch (field->UPB_PRIVATE(descriptortype)) {
+        case kUpb_FieldType_Float:
+        case kUpb_FieldType_Fixed32:
+        case kUpb_FieldType_SFixed32:
+          wire_type = kUpb_WireType_32Bit;
+          break;
+        case kUpb_FieldType_Double:
+        case kUpb_FieldType_Fixed64:
+        case kUpb_FieldType_SFixed64:
+          wire_type = kUpb_WireType_64Bit;
+          break;
+        default:
+          wire_type = kUpb_WireType_Varint;
+          break;
+      }
+      break;
+    case kUpb_DecodeOp_String:
+    case kUpb_DecodeOp_Bytes:
+      wire_type = kUpb_WireType_Delimited;
+      ptr += val->size;
+      break;
+    case kUpb_DecodeOp_SubMessage:
+      // Groups would have to be parsed to be skipped.
+      if (field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_Group) return 0;
+      wire_type = kUpb_WireType_Delimited;
+      ptr += val->size;
+      break;
+    default:
+      // Packed fields reserve their own elements.
+      return 0;
+  }
+  uint32_t tag = ((uint32_t)field->number << 3) | wire_type;
+  return _upb_Decoder_CountRepeatedRun(d, ptr, tag);
+}
+
+// Slabs start small, so that arrays of a few elements do not waste much
+// memory, and stop doubling at this many messages or bytes.
+#define kUpb_Decoder_SlabMinSize 4
+#define kUpb_Decoder_SlabMaxSize 256
+#define kUpb_Decoder_SlabMaxBytes 16384
+
+// Returns the slab for `subl`, reusing the emptiest one if there is none.
+static upb_Decoder_Slab* _upb_Decoder_FindSlab(upb_Decoder* d,
+                                               const upb_MiniTable* subl) {
+  upb_Decoder_Slab* victim = &d->slabs[0];
+  for (int i = 0; i < kUpb_Decoder_SlabCount; i++) {
+    upb_Decoder_Slab* slab = &d->slabs[i];
+    if (slab->mini_table == subl) return slab;
+    if (slab->count < victim->count) victim = slab;
+  }
+  victim->mini_table = subl;
+  victim->count = 0;
+  victim->next_size = kUpb_Decoder_SlabMinSize;
+  return victim;
+}
+
+// Returns the empty message that upb_Message_ClearForReuse() kept in the next
+// slot of `arr` (whose address is `target`), or NULL if there is none or
+// kUpb_DecodeOption_ReuseRetained is not set.
+UPB_FORCEINLINE
+static upb_Message* _upb_Decoder_TakeRetained(
+    upb_Decoder* d, const upb_Array* arr, const upb_TaggedMessagePtr* target) {
+  if (UPB_LIKELY(!(d->options & kUpb_DecodeOption_ReuseRetained)) ||
+      arr->size >= arr->retained) {
+    return NULL;
+  }
+  upb_TaggedMessagePtr tagged = *target;
+  if (!tagged || upb_TaggedMessagePtr_IsEmpty(tagged)) return NULL;
+  return _upb_TaggedMessagePtr_GetMessage(tagged);
+}
+
+// Like _upb_Decoder_NewSubMessage(), but takes the message from a slab for
+// the element of a repeated field.  `elems` is the number of elements the
+// run is known to have left, counting this one, or 1 if it was not counted.
+static upb_Message* _upb_Decoder_NewRepeatedSubMessage(
+    upb_Decoder* d, const char* ptr, const upb_MiniTableSub* subs,
+    const upb_MiniTableField* field, wireval* val, size_t elems,
+    upb_TaggedMessagePtr* target) {
+  const upb_MiniTable* subl = subs[field->UPB_PRIVATE(submsg_index)].submsg;
+  UPB_ASSERT(subl);
+  if (subl == &_kUpb_MiniTable_Empty) {
+    // Unlinked messages are unusual, let the regular path handle them.
+    return _upb_Decoder_NewSubMessage(d, subs, field, target);
+  }
+
+  upb_Decoder_Slab* slab = _upb_Decoder_FindSlab(d, subl);
+  size_t msg_size = upb_msg_sizeof(subl);
+  if (slab->count == 0) {
+    size_t n;
+    if (d->options & kUpb_DecodeOption_PrescanRepeated) {
+      if (elems == 1) {
+        elems += _upb_Decoder_PrescanRepeated(d, ptr, field, val,
+                                              kUpb_DecodeOp_SubMessage);
+      }
+      n = elems;
+    } else {
+      n = UPB_MAX(1, UPB_MIN(slab->next_size,
+                             kUpb_Decoder_SlabMaxBytes / msg_size));
+      slab->next_size = UPB_MIN(slab->next_size * 2, kUpb_Decoder_SlabMaxSize);
+    }
+    if (n > UINT32_MAX || n > SIZE_MAX / msg_size) {
+      _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+    }
+    slab->ptr = upb_Arena_Malloc(&d->arena, n * msg_size);
+    if (!slab->ptr) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+    memset(slab->ptr, 0, n * msg_size);
+    slab->count = n;
+  }
+
+  upb_Message* msg =
+      UPB_PTR_AT(slab->ptr, sizeof(upb_Message_Internal), upb_Message);
+  slab->ptr += msg_size;
+  slab->count--;
+  upb_TaggedMessagePtr tagged = _upb_TaggedMessagePtr_Pack(msg, false);
+  memcpy(target, &tagged, sizeof(tagged));
+  return msg;
+}
+
+// Returns a copy of `arr`, which must not be modified, with room for `elems`
+// more elements.
+static upb_Array* _upb_Decoder_CopyFrozenArray(upb_Decoder* d,
+                                               const upb_Array* arr,
+                                               size_t elems) {
+  int lg2 = _upb_Array_ElementSizeLg2(arr);
+  upb_Array* ret = _upb_Array_New(&d->arena, arr->size + elems, lg2);
+  if (!ret) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  memcpy(_upb_array_ptr(ret), _upb_array_constptr(arr), arr->size << lg2);
+  ret->size = arr->size;
+  return ret;
+}
+
+// Stores packed fixed-width data of `val->size` bytes at `ptr` in a new array
+// that aliases the input (see kUpb_DecodeOption_AliasFixedArrays), and returns
+// the parsing pointer past it.  Returns NULL if the data cannot be aliased and
+// must be copied as usual.
+static const char* _upb_Decoder_AliasFixedPacked(upb_Decoder* d,
+                                                 const char* ptr,
+                                                 upb_Array** arrp,
+                                                 wireval* val, int lg2) {
+  size_t mask = (1 << lg2) - 1;
+  if (!_upb_IsLittleEndian() || val->size == 0 || (val->size & mask) != 0 ||
+      !upb_EpsCopyInputStream_AliasingAvailable(&d->input, ptr, val->size)) {
+    return NULL;
+  }
+  const char* data = upb_EpsCopyInputStream_GetAliasedPtr(&d->input, ptr);
+  // The low bits of the data pointer hold the element size.
+  if (((uintptr_t)data & 7) != 0) return NULL;
+  upb_Array* arr = upb_Arena_Malloc(&d->arena, sizeof(*arr));
+  if (!arr) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  arr->data = _upb_tag_arrptr((void*)data, lg2);
+  arr->size = val->size >> lg2;
+  arr->capacity = arr->size;
+  arr->is_frozen = true;
+  arr->retained = 0;
+  *arrp = arr;
+  return ptr + val->size;
+}
+
 static const char* _upb_Decoder_DecodeToArray(upb_Decoder* d, const char* ptr,
                                               upb_Message* msg,
                                               const upb_MiniTableSub* subs,
@@ -526,10 +1058,31 @@ static const char* _upb_Decoder_DecodeToArray(upb_Decoder* d, const char* ptr,
   upb_Array* arr = *arrp;
   void* mem;
 
-  if (arr) {
-    _upb_Decoder_Reserve(d, arr, 1);
+  size_t elems = 1;
+
+  if (!arr && (op == OP_FIXPCK_LG2(2) || op == OP_FIXPCK_LG2(3)) &&
+      (d->options & kUpb_DecodeOption_AliasFixedArrays)) {
+    const char* end =
+        _upb_Decoder_AliasFixedPacked(d, ptr, arrp, val, op - OP_FIXPCK_LG2(0));
+    if (end) return end;
+  }
+
+  if ((d->options & kUpb_DecodeOption_PrescanRepeated) &&
+      (!arr || arr->size == arr->capacity)) {
+    elems += _upb_Decoder_PrescanRepeated(d, ptr, field, val, op);
+  }
+
+  if (arr && UPB_UNLIKELY(arr->is_frozen)) {
+    // An array that aliases the input is copied before it is appended to.
+    arr = _upb_Decoder_CopyFrozenArray(d, arr, elems);
+    *arrp = arr;
+  } else if (arr) {
+    _upb_Decoder_Reserve(d, arr, elems);
+  } else if (_upb_MiniTableField_HasInlineMessages(field)) {
+    arr = _upb_Decoder_CreateInlineArray(d, subs, field, elems);
+    *arrp = arr;
   } else {
-    arr = _upb_Decoder_CreateArray(d, field);
+    arr = _upb_Decoder_CreateArray(d, field, elems);
     *arrp = arr;
   }
 
@@ -552,17 +1105,45 @@ static const char* _upb_Decoder_DecodeToArray(upb_Decoder* d, const char* ptr,
       return _upb_Decoder_ReadString(d, ptr, val->size, str);
     }
     case kUpb_DecodeOp_SubMessage: {
+      if (_upb_Array_HasInlineMessages(arr)) {
+        /* Append a submessage in place. */
+        const upb_MiniTable* subl =
+            subs[field->UPB_PRIVATE(submsg_index)].submsg;
+        upb_Message* submsg = _upb_Array_InlineMessage(arr, arr->size);
+        memset(upb_Message_Getinternal(submsg), 0, upb_msg_sizeof(subl));
+        arr->size++;
+        return _upb_Decoder_DecodeOrPushSubMessage(d, ptr, submsg, subs, field,
+                                                   val->size);
+      }
       /* Append submessage / group. */
       upb_TaggedMessagePtr* target = UPB_PTR_AT(
           _upb_array_ptr(arr), arr->size * sizeof(void*), upb_TaggedMessagePtr);
-      upb_Message* submsg = _upb_Decoder_NewSubMessage(d, subs, field, target);
+      upb_Message* submsg = _upb_Decoder_TakeRetained(d, arr, target);
+      if (!submsg && _upb_Decoder_IsLazySubMessage(d, field)) {
+        *target = 0;
+        const char* end =
+            _upb_Decoder_DeferSubMessage(d, ptr, target, val->size);
+        if (end) {
+          arr->size++;
+          return end;
+        }
+      }
+      if (submsg) {
+        // Filling an element kept by upb_Message_ClearForReuse().
+      } else if ((d->options & kUpb_DecodeOption_BulkSubMessages) &&
+                 field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_Message) {
+        submsg = _upb_Decoder_NewRepeatedSubMessage(d, ptr, subs, field, val,
+                                                    elems, target);
+      } else {
+        submsg = _upb_Decoder_NewSubMessage(d, subs, field, target);
+      }
       arr->size++;
       if (UPB_UNLIKELY(field->UPB_PRIVATE(descriptortype) ==
                        kUpb_FieldType_Group)) {
         return _upb_Decoder_DecodeKnownGroup(d, ptr, submsg, subs, field);
       } else {
-        return _upb_Decoder_DecodeSubMessage(d, ptr, submsg, subs, field,
-                                             val->size);
+        return _upb_Decoder_DecodeOrPushSubMessage(d, ptr, submsg, subs, field,
+                                                   val->size);
       }
     }
     case OP_FIXPCK_LG2(2):
@@ -583,7 +1164,8 @@ static const char* _upb_Decoder_DecodeToArray(upb_Decoder* d, const char* ptr,
   }
 }
 
-upb_Map* _upb_Decoder_CreateMap(upb_Decoder* d, const upb_MiniTable* entry) {
+upb_Map* _upb_Decoder_CreateMap(upb_Decoder* d, const upb_MiniTable* entry,
+                                size_t size) {
   /* Maps descriptor type -> upb map size.  */
   static const uint8_t kSizeInMap[] = {
       [0] = -1,  // invalid descriptor type */
@@ -613,11 +1195,204 @@ upb_Map* _upb_Decoder_CreateMap(upb_Decoder* d, const upb_MiniTable* entry) {
   char val_size = kSizeInMap[val_field->UPB_PRIVATE(descriptortype)];
   UPB_ASSERT(key_field->offset == offsetof(upb_MapEntryData, k));
   UPB_ASSERT(val_field->offset == offsetof(upb_MapEntryData, v));
-  upb_Map* ret = _upb_Map_New(&d->arena, key_size, val_size);
+  upb_Map* ret = _upb_Map_NewSized(&d->arena, key_size, val_size, size);
   if (!ret) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
   return ret;
 }
 
+// Returns the wire type of a map entry's key or value field, or -1 if the
+// field is one that _upb_Decoder_DecodeMapEntry() leaves to the generic path.
+static int _upb_Decoder_MapEntryWireType(const upb_MiniTableField* field) {
+  switch (field->UPB_PRIVATE(descriptortype)) {
+    case kUpb_FieldType_Int32:
+    case kUpb_FieldType_Int64:
+    case kUpb_FieldType_UInt32:
+    case kUpb_FieldType_UInt64:
+    case kUpb_FieldType_SInt32:
+    case kUpb_FieldType_SInt64:
+    case kUpb_FieldType_Bool:
+      return kUpb_WireType_Varint;
+    case kUpb_FieldType_Fixed32:
+    case kUpb_FieldType_SFixed32:
+    case kUpb_FieldType_Float:
+      return kUpb_WireType_32Bit;
+    case kUpb_FieldType_Fixed64:
+    case kUpb_FieldType_SFixed64:
+    case kUpb_FieldType_Double:
+      return kUpb_WireType_64Bit;
+    case kUpb_FieldType_String:
+    case kUpb_FieldType_Bytes:
+    case kUpb_FieldType_Message:
+      return kUpb_WireType_Delimited;
+    default:
+      // Closed enums need their values checked, and groups are rare.
+      return -1;
+  }
+}
+
+// Decodes the key or value at `ptr`, just past its tag, into `mem`.
+static const char* _upb_Decoder_DecodeMapEntryField(
+    upb_Decoder* d, const char* ptr, const upb_MiniTableField* field,
+    void* mem) {
+  int type = field->UPB_PRIVATE(descriptortype);
+  wireval val;
+  switch (_upb_Decoder_MapEntryWireType(field)) {
+    case kUpb_WireType_Varint:
+      ptr = _upb_Decoder_DecodeVarint(d, ptr, &val.uint64_val);
+      _upb_Decoder_Munge(type, &val);
+      break;
+    case kUpb_WireType_32Bit:
+      ptr = upb_WireReader_ReadFixed32(ptr, &val.uint32_val);
+      break;
+    case kUpb_WireType_64Bit:
+      ptr = upb_WireReader_ReadFixed64(ptr, &val.uint64_val);
+      break;
+    case kUpb_WireType_Delimited: {
+      uint64_t size;
+      ptr = _upb_Decoder_DecodeVarint(d, ptr, &size);
+      if (type == kUpb_FieldType_String) {
+        _upb_Decoder_VerifyUtf8(d, ptr, size);
+      }
+      return _upb_Decoder_ReadString(d, ptr, size, mem);
+    }
+    default:
+      UPB_UNREACHABLE();
+  }
+  switch (_upb_MiniTableField_GetRep(field)) {
+    case kUpb_FieldRep_1Byte:
+      memcpy(mem, &val, 1);
+      break;
+    case kUpb_FieldRep_4Byte:
+      memcpy(mem, &val, 4);
+      break;
+    default:
+      memcpy(mem, &val, 8);
+      break;
+  }
+  return ptr;
+}
+
+// Skips the varint at `ptr`, storing its value in `*val`.  Unlike
+// _upb_Decoder_DecodeVarint() this never reads at or past `end`, and returns
+// NULL instead of reporting an error if the varint is malformed or does not
+// end before `end`.
+static const char* _upb_Decoder_ScanMapEntryVarint(const char* ptr,
+                                                   const char* end,
+                                                   uint64_t* val) {
+  uint64_t ret = 0;
+  for (int i = 0; i < 10 && ptr < end; i++) {
+    uint8_t byte = *ptr++;
+    ret |= (uint64_t)(byte & 0x7f) << (7 * i);
+    if (!(byte & 0x80)) {
+      *val = ret;
+      return ptr;
+    }
+  }
+  return NULL;
+}
+
+// Decodes the map entry of `size` bytes at `ptr` into `map` without building
+// a temporary entry message, for the usual case of an entry that holds only
+// its key and value in their expected wire types.  A message value always
+// replaces any existing value for its key with a newly allocated one.  Returns
+// NULL, having changed nothing, if the entry must take the generic path.
+static const char* _upb_Decoder_DecodeMapEntry(upb_Decoder* d,
+                                               const char* ptr, upb_Map* map,
+                                               const upb_MiniTable* entry,
+                                               int size) {
+  const upb_MiniTableField* key_field = &entry->fields[0];
+  const upb_MiniTableField* val_field = &entry->fields[1];
+  int key_wire_type = _upb_Decoder_MapEntryWireType(key_field);
+  int val_wire_type = _upb_Decoder_MapEntryWireType(val_field);
+  bool val_is_msg =
+      val_field->UPB_PRIVATE(descriptortype) == kUpb_FieldType_Message;
+  if (key_wire_type < 0 || val_wire_type < 0 || d->depth <= 0 ||
+      d->selection || d->stats ||
+      !upb_EpsCopyInputStream_CheckSubMessageSizeAvailable(&d->input, ptr,
+                                                           size)) {
+    return NULL;
+  }
+  if (val_is_msg &&
+      (_upb_Decoder_IsLazySubMessage(d, val_field) ||
+       entry->subs[val_field->UPB_PRIVATE(submsg_index)].submsg ==
+           &_kUpb_MiniTable_Empty)) {
+    return NULL;
+  }
+
+  // Find the key and value first, so that we can bail out before changing
+  // anything.  The last occurrence of a scalar wins, as in the generic path.
+  const char* end = ptr + size;
+  const char* key_ptr = NULL;
+  const char* val_ptr = NULL;
+  uint32_t val_size = 0;
+  while (ptr < end) {
+    uint8_t tag = *ptr++;
+    int field_number = tag >> 3;
+    int wire_type = tag & 7;
+    const char* field_ptr = ptr;
+    uint64_t len;
+    if (field_number == 1 && wire_type == key_wire_type) {
+      key_ptr = field_ptr;
+    } else if (field_number == 2 && wire_type == val_wire_type) {
+      // Repeated occurrences of a message value would be merged.
+      if (val_ptr && val_is_msg) return NULL;
+      val_ptr = field_ptr;
+    } else {
+      return NULL;
+    }
+    switch (wire_type) {
+      case kUpb_WireType_Varint:
+        ptr = _upb_Decoder_ScanMapEntryVarint(ptr, end, &len);
+        if (!ptr) return NULL;
+        break;
+      case kUpb_WireType_32Bit:
+        ptr += 4;
+        break;
+      case kUpb_WireType_64Bit:
+        ptr += 8;
+        break;
+      case kUpb_WireType_Delimited:
+        ptr = _upb_Decoder_ScanMapEntryVarint(ptr, end, &len);
+        if (!ptr || ptr > end || len > (uint64_t)(end - ptr)) return NULL;
+        ptr += len;
+        if (field_number == 2) val_size = len;
+        break;
+    }
+    if (ptr > end) return NULL;
+  }
+
+  upb_MapEntryData ent;
+  memset(&ent, 0, sizeof(ent));
+  if (key_ptr) _upb_Decoder_DecodeMapEntryField(d, key_ptr, key_field, &ent.k);
+  if (!val_is_msg) {
+    if (val_ptr) {
+      _upb_Decoder_DecodeMapEntryField(d, val_ptr, val_field, &ent.v);
+    }
+  } else {
+    // The last entry for a key replaces the value of any earlier one.  The
+    // old value is left alone, as the caller may still hold it.
+    upb_TaggedMessagePtr tagged;
+    upb_Message* submsg =
+        _upb_Decoder_NewSubMessage(d, entry->subs, val_field, &tagged);
+    ent.v.val = upb_value_uintptr(tagged);
+    if (val_ptr) {
+      uint64_t len;
+      val_ptr = _upb_Decoder_DecodeVarint(d, val_ptr, &len);
+      // Account for the entry's own level of nesting.
+      d->depth--;
+      _upb_Decoder_DecodeSubMessage(d, val_ptr, submsg, entry->subs, val_field,
+                                    val_size);
+      d->depth++;
+    }
+  }
+
+  if (_upb_Map_Insert(map, &ent.k, map->key_size, &ent.v, map->val_size,
+                      &d->arena) == kUpb_MapInsertStatus_OutOfMemory) {
+    _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  }
+  return end;
+}
+
 static const char* _upb_Decoder_DecodeToMap(upb_Decoder* d, const char* ptr,
                                             upb_Message* msg,
                                             const upb_MiniTableSub* subs,
@@ -635,10 +1410,26 @@ static const char* _upb_Decoder_DecodeToMap(upb_Decoder* d, const char* ptr,
   UPB_ASSERT(!upb_IsRepeatedOrMap(&entry->fields[1]));
 
   if (!map) {
-    map = _upb_Decoder_CreateMap(d, entry);
+    // Sizing the table to the run of entries that follows saves rehashing it
+    // over and over as a large map is decoded.
+    size_t size = 4;
+    if (d->options & kUpb_DecodeOption_PrescanRepeated) {
+      size_t run = _upb_Decoder_PrescanRepeated(d, ptr, field, val,
+                                                kUpb_DecodeOp_SubMessage);
+      size = UPB_MAX(size, run + 1);
+    }
+    map = _upb_Decoder_CreateMap(d, entry, size);
+    if (_upb_MiniTableField_IsOrderedMap(field) &&
+        !_upb_Map_SetOrdered(
+            map, entry->fields[0].UPB_PRIVATE(descriptortype), &d->arena)) {
+      _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+    }
     *map_p = map;
   }
 
+  const char* end = _upb_Decoder_DecodeMapEntry(d, ptr, map, entry, val->size);
+  if (end) return end;
+
   // Parse map entry.
   memset(&ent, 0, sizeof(ent));
 
@@ -668,6 +1459,7 @@ static const char* _upb_Decoder_DecodeToMap(upb_Decoder* d, const char* ptr,
     if (!_upb_Message_AddUnknown(msg, buf, size, &d->arena)) {
       _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
     }
+    d->unknown_bytes += size;
   } else {
     if (_upb_Map_Insert(map, &ent.data.k, map->key_size, &ent.data.v,
                         map->val_size,
@@ -682,7 +1474,6 @@ static const char* _upb_Decoder_DecodeToSubMessage(
     upb_Decoder* d, const char* ptr, upb_Message* msg,
     const upb_MiniTableSub* subs, const upb_MiniTableField* field, wireval* val,
     int op) {
-  void* mem = UPB_PTR_AT(msg, field->offset, void);
   int type = field->UPB_PRIVATE(descriptortype);
 
   if (UPB_UNLIKELY(op == kUpb_DecodeOp_Enum) &&
@@ -692,6 +1483,14 @@ static const char* _upb_Decoder_DecodeToSubMessage(
     return ptr;
   }
 
+  void* mem;
+  if (UPB_UNLIKELY(_upb_MiniTableField_IsOutOfLine(field))) {
+    mem = _upb_Message_MutableOutOfLine(msg, field, &d->arena);
+    if (!mem) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+  } else {
+    mem = UPB_PTR_AT(msg, field->offset, void);
+  }
+
   /* Set presence if necessary. */
   if (field->presence > 0) {
     _upb_sethas_field(msg, field);
@@ -709,6 +1508,11 @@ static const char* _upb_Decoder_DecodeToSubMessage(
     case kUpb_DecodeOp_SubMessage: {
       upb_TaggedMessagePtr* submsgp = mem;
       upb_Message* submsg;
+      if (_upb_Decoder_IsLazySubMessage(d, field)) {
+        const char* end =
+            _upb_Decoder_DeferSubMessage(d, ptr, submsgp, val->size);
+        if (end) return end;
+      }
       if (*submsgp) {
         submsg = _upb_Decoder_ReuseSubMessage(d, subs, field, submsgp);
       } else {
@@ -717,8 +1521,8 @@ static const char* _upb_Decoder_DecodeToSubMessage(
       if (UPB_UNLIKELY(type == kUpb_FieldType_Group)) {
         ptr = _upb_Decoder_DecodeKnownGroup(d, ptr, submsg, subs, field);
       } else {
-        ptr = _upb_Decoder_DecodeSubMessage(d, ptr, submsg, subs, field,
-                                            val->size);
+        ptr = _upb_Decoder_DecodeOrPushSubMessage(d, ptr, submsg, subs, field,
+                                                  val->size);
       }
       break;
     }
@@ -726,6 +1530,9 @@ static const char* _upb_Decoder_DecodeToSubMessage(
       _upb_Decoder_VerifyUtf8(d, ptr, val->size);
       /* Fallthrough. */
     case kUpb_DecodeOp_Bytes:
+      if (_upb_MiniTableField_HasInlineString(field)) {
+        return _upb_Decoder_ReadInlineString(d, ptr, val->size, mem);
+      }
       return _upb_Decoder_ReadString(d, ptr, val->size, mem);
     case kUpb_DecodeOp_Scalar8Byte:
       memcpy(mem, val, 8);
@@ -766,16 +1573,91 @@ static bool _upb_Decoder_TryFastDispatch(upb_Decoder* d, const char** ptr,
                                          upb_Message* msg,
                                          const upb_MiniTable* layout) {
 #if UPB_FASTTABLE
-  if (layout && layout->table_mask != (unsigned char)-1) {
+  if (layout && layout->table_mask != (unsigned char)-1 && !d->selection &&
+      !d->stats &&
+      !(d->options & (kUpb_DecodeOption_AliasFixedArrays |
+                      kUpb_DecodeOption_ExplicitStack |
+                      kUpb_DecodeOption_InternStrings |
+                      kUpb_DecodeOption_ReuseRetained))) {
     uint16_t tag = _upb_FastDecoder_LoadTag(*ptr);
     intptr_t table = decode_totable(layout);
-    *ptr = _upb_FastDecoder_TagDispatch(d, *ptr, msg, table, 0, tag);
+    *ptr = _upb_FastDecoder_Decode(d, *ptr, msg, table, 0, tag);
     return true;
   }
 #endif
   return false;
 }
 
+upb_FieldSelection _upb_FieldSelection_All;
+
+struct upb_DecodeStats {
+  upb_Arena* arena;
+  upb_inttable tables;  // const upb_MiniTable* -> upb_DecodeMessageStats*
+};
+
+// Returns the statistics for `layout`, creating them if this is the first
+// message of that type, and counts one more message.
+static upb_DecodeMessageStats* _upb_Decoder_EnterStats(
+    upb_Decoder* d, const upb_MiniTable* layout) {
+  upb_value v;
+  upb_DecodeMessageStats* stats;
+  if (upb_inttable_lookup(&d->stats->tables, (uintptr_t)layout, &v)) {
+    stats = upb_value_getptr(v);
+  } else {
+    upb_Arena* a = d->stats_arena;
+    size_t fields_size = layout->field_count * sizeof(upb_DecodeFieldStats);
+    stats = upb_Arena_Malloc(a, sizeof(*stats));
+    upb_DecodeFieldStats* fields = upb_Arena_Malloc(a, fields_size);
+    if (!stats || !fields ||
+        !upb_inttable_insert(&d->stats->tables, (uintptr_t)layout,
+                             upb_value_ptr(stats), a)) {
+      _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+    }
+    memset(stats, 0, sizeof(*stats));
+    memset(fields, 0, fields_size);
+    stats->fields = fields;
+  }
+  stats->messages++;
+  return stats;
+}
+
+// Records a field whose tag starts at `tag_ptr`, where `ptr` is just past the
+// tag and varint size of a delimited field, or past the whole value otherwise.
+static void _upb_Decoder_AddFieldStats(upb_DecodeMessageStats* stats,
+                                       const upb_MiniTable* layout,
+                                       const upb_MiniTableField* field,
+                                       const char* tag_ptr, const char* ptr,
+                                       uint32_t tag, const wireval* val) {
+  upb_DecodeFieldStats* f;
+  if (field->number && !(field->mode & kUpb_LabelFlags_IsExtension)) {
+    f = (upb_DecodeFieldStats*)&stats->fields[field - layout->fields];
+  } else {
+    f = &stats->unknown;
+  }
+  f->count++;
+  f->bytes += ptr - tag_ptr;
+  if ((tag & 7) == kUpb_WireType_Delimited) f->bytes += val->size;
+
+  bool fast = false;
+#if UPB_FASTTABLE
+  // Mirrors the dispatch in _upb_FastDecoder_TagDispatch(): the entry's
+  // parser must be specialized and expect exactly this one or two byte tag.
+  if (layout->table_mask != (unsigned char)-1 && tag < (1 << 14)) {
+    uint16_t tag16 = _upb_FastDecoder_LoadTag(tag_ptr);
+    const _upb_FastTable_Entry* ent =
+        &layout->fasttable[(tag16 & layout->table_mask) >> 3];
+    uint16_t mask = tag < (1 << 7) ? 0xff : 0xffff;
+    fast = ent->field_parser != &_upb_FastDecoder_DecodeGeneric &&
+           ((ent->field_data ^ tag16) & mask) == 0;
+  }
+#endif
+  if (fast) {
+    stats->fast_fields++;
+  } else {
+    stats->generic_fields++;
+  }
+}
+
 static const char* upb_Decoder_SkipField(upb_Decoder* d, const char* ptr,
                                          uint32_t tag) {
   int field_number = tag >> 3;
@@ -808,16 +1690,23 @@ enum {
   kMessageTag = ((kUpb_MsgSet_Message << 3) | kUpb_WireType_Delimited),
 };
 
-static void upb_Decoder_AddKnownMessageSetItem(
-    upb_Decoder* d, upb_Message* msg, const upb_MiniTableExtension* item_mt,
-    const char* data, uint32_t size) {
+static upb_Message* upb_Decoder_NewMessageSetItem(
+    upb_Decoder* d, upb_Message* msg, const upb_MiniTableExtension* item_mt) {
   upb_Message_Extension* ext =
       _upb_Message_GetOrCreateExtension(msg, item_mt, &d->arena);
   if (UPB_UNLIKELY(!ext)) {
     _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
   }
-  upb_Message* submsg = _upb_Decoder_NewSubMessage(
-      d, &ext->ext->sub, &ext->ext->field, (upb_TaggedMessagePtr*)&ext->data);
+  return _upb_Decoder_NewSubMessage(d, &ext->ext->sub, &ext->ext->field,
+                                    (upb_TaggedMessagePtr*)&ext->data);
+}
+
+// For a payload that came before its type_id, so that the input has already
+// moved past it.
+static void upb_Decoder_AddKnownMessageSetItem(
+    upb_Decoder* d, upb_Message* msg, const upb_MiniTableExtension* item_mt,
+    const char* data, uint32_t size) {
+  upb_Message* submsg = upb_Decoder_NewMessageSetItem(d, msg, item_mt);
   upb_DecodeStatus status = upb_Decode(data, size, submsg, item_mt->sub.submsg,
                                        d->extreg, d->options, &d->arena);
   if (status != kUpb_DecodeStatus_Ok) _upb_Decoder_ErrorJmp(d, status);
@@ -845,6 +1734,19 @@ static void upb_Decoder_AddUnknownMessageSetItem(upb_Decoder* d,
       !_upb_Message_AddUnknown(msg, split, end - split, &d->arena)) {
     _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
   }
+  d->unknown_bytes += (end - buf) + message_size;
+}
+
+static const upb_MiniTableExtension* _upb_Decoder_FindExtension(
+    upb_Decoder* d, const upb_MiniTable* t, uint32_t field_number) {
+  if (d->extreg_extendee != t) {
+    d->extreg_extendee = t;
+    d->extreg_entry = _upb_ExtensionRegistry_GetEntry(d->extreg, t);
+    d->extreg_hint = 0;
+  }
+  if (!d->extreg_entry) return NULL;
+  return _upb_ExtensionRegistryEntry_Find(d->extreg_entry, field_number,
+                                          &d->extreg_hint);
 }
 
 static void upb_Decoder_AddMessageSetItem(upb_Decoder* d, upb_Message* msg,
@@ -852,7 +1754,7 @@ static void upb_Decoder_AddMessageSetItem(upb_Decoder* d, upb_Message* msg,
                                           uint32_t type_id, const char* data,
                                           uint32_t size) {
   const upb_MiniTableExtension* item_mt =
-      upb_ExtensionRegistry_Lookup(d->extreg, t, type_id);
+      _upb_Decoder_FindExtension(d, t, type_id);
   if (item_mt) {
     upb_Decoder_AddKnownMessageSetItem(d, msg, item_mt, data, size);
   } else {
@@ -892,15 +1794,29 @@ static const char* upb_Decoder_DecodeMessageSetItem(
         uint32_t size;
         ptr = upb_Decoder_DecodeSize(d, ptr, &size);
         const char* data = ptr;
-        ptr += size;
-        if (state_mask & kUpb_HavePayload) break;  // Ignore dup.
+        if (state_mask & kUpb_HavePayload) {  // Ignore dup.
+          ptr += size;
+          break;
+        }
         state_mask |= kUpb_HavePayload;
-        if (state_mask & kUpb_HaveId) {
-          upb_Decoder_AddMessageSetItem(d, msg, layout, type_id, data, size);
-        } else {
+        if (!(state_mask & kUpb_HaveId)) {
           // Out of order, we must preserve the payload.
           preserved.data = data;
           preserved.size = size;
+          ptr += size;
+          break;
+        }
+        const upb_MiniTableExtension* item_mt =
+            _upb_Decoder_FindExtension(d, layout, type_id);
+        if (item_mt) {
+          // The usual order: decode the payload in place, as for any other
+          // sub-message, rather than with a nested upb_Decode().
+          upb_Message* submsg = upb_Decoder_NewMessageSetItem(d, msg, item_mt);
+          ptr = _upb_Decoder_DecodeSubMessage(d, ptr, submsg, &item_mt->sub,
+                                              &item_mt->field, size);
+        } else {
+          upb_Decoder_AddUnknownMessageSetItem(d, msg, type_id, data, size);
+          ptr += size;
         }
         break;
       }
@@ -927,7 +1843,13 @@ static const upb_MiniTableField* _upb_Decoder_FindField(upb_Decoder* d,
     goto found;
   }
 
-  if (t->dense_below < t->field_count) {
+  if (t->field_index) {
+    const int pos = _upb_MiniTable_FindIndexedField(t, field_number);
+    if (pos >= 0) {
+      idx = pos;
+      goto found;
+    }
+  } else if (t->dense_below < t->field_count) {
     /* Linear search non-dense fields. Resume scanning from last_field_index
      * since fields are usually in order. */
     size_t last = *last_field_index;
@@ -948,7 +1870,7 @@ static const upb_MiniTableField* _upb_Decoder_FindField(upb_Decoder* d,
     switch (t->ext) {
       case kUpb_ExtMode_Extendable: {
         const upb_MiniTableExtension* ext =
-            upb_ExtensionRegistry_Lookup(d->extreg, t, field_number);
+            _upb_Decoder_FindExtension(d, t, field_number);
         if (ext) return &ext->field;
         break;
       }
@@ -1226,20 +2148,214 @@ static const char* _upb_Decoder_DecodeUnknownField(upb_Decoder* d,
       start = d->unknown;
       d->unknown = NULL;
     }
-    if (!_upb_Message_AddUnknown(msg, start, ptr - start, &d->arena)) {
-      _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
-    }
+    _upb_Decoder_AddUnknown(d, msg, start, ptr - start);
   } else if (wire_type == kUpb_WireType_StartGroup) {
     ptr = _upb_Decoder_DecodeUnknownGroup(d, ptr, field_number);
   }
   return ptr;
 }
 
+// Decodes the value of the field whose tag `tag` started at `tag_ptr` and
+// ended at `ptr`.  Leaves `d->selection` set for the field's sub-message, if
+// any, for the caller to restore.
+// Prefetches the mini table entry after `field`, since fields usually arrive
+// in order, and the sub-table of `field`, which a sub-message needs once its
+// length has been decoded (see UPB_ENABLE_DECODE_PREFETCH).
+UPB_FORCEINLINE
+static void _upb_Decoder_PrefetchField(const upb_MiniTable* layout,
+                                       const upb_MiniTableField* field) {
+#if UPB_DECODE_PREFETCH
+  // Unknown fields, message set items and extensions are not in `layout`.
+  if (field->number == 0 || (field->mode & kUpb_LabelFlags_IsExtension)) {
+    return;
+  }
+  UPB_PREFETCH(field + 1);
+  if (field->UPB_PRIVATE(submsg_index) != kUpb_NoSub) {
+    UPB_PREFETCH(layout->subs[field->UPB_PRIVATE(submsg_index)].submsg);
+  }
+#else
+  UPB_UNUSED(layout);
+  UPB_UNUSED(field);
+#endif
+}
+
+UPB_FORCEINLINE
+static const char* _upb_Decoder_DecodeField(
+    upb_Decoder* d, const char* ptr, upb_Message* msg,
+    const upb_MiniTable* layout, const upb_FieldSelection* selection,
+    upb_DecodeMessageStats* stats, int* last_field_index, uint32_t tag,
+    const char* tag_ptr) {
+  int field_number = tag >> 3;
+  int wire_type = tag & 7;
+  wireval val;
+  int op;
+
+  const upb_MiniTableField* field =
+      _upb_Decoder_FindField(d, layout, field_number, last_field_index);
+  _upb_Decoder_PrefetchField(layout, field);
+  ptr = _upb_Decoder_DecodeWireValue(d, ptr, layout, field, wire_type, &val,
+                                     &op);
+  if (UPB_UNLIKELY(stats)) {
+    _upb_Decoder_AddFieldStats(stats, layout, field, tag_ptr, ptr, tag, &val);
+  }
+
+  upb_Message* unknown_msg = msg;
+  if (UPB_UNLIKELY(selection)) {
+    // Extensions and unknown fields (which have number 0) are never
+    // selected.
+    const upb_FieldSelection* sub =
+        field->number && !(field->mode & kUpb_LabelFlags_IsExtension)
+            ? selection->fields[field - layout->fields]
+            : NULL;
+    if (!sub) {
+      // Skip the field entirely, without preserving it as unknown.
+      op = kUpb_DecodeOp_UnknownField;
+      unknown_msg = NULL;
+    }
+    d->selection = sub == &_upb_FieldSelection_All ? NULL : sub;
+  }
+
+  if (op >= 0) {
+    return _upb_Decoder_DecodeKnownField(d, ptr, msg, layout, field, op, &val);
+  }
+  switch (op) {
+    case kUpb_DecodeOp_UnknownField:
+      return _upb_Decoder_DecodeUnknownField(d, ptr, unknown_msg, field_number,
+                                             wire_type, val);
+    case kUpb_DecodeOp_MessageSetItem:
+      return upb_Decoder_DecodeMessageSetItem(d, ptr, msg, layout);
+    default:
+      return ptr;
+  }
+}
+
+// A message that kUpb_DecodeOption_ExplicitStack has put aside to decode one
+// of its sub-messages.
+typedef struct _upb_Decoder_Frame {
+  upb_Message* msg;
+  const upb_MiniTable* layout;
+  const upb_FieldSelection* selection;
+  upb_DecodeMessageStats* stats;
+  int last_field_index;
+  int saved_delta;  // To restore the input limit of `msg`.
+} _upb_Decoder_Frame;
+
+static _upb_Decoder_Frame* _upb_Decoder_PushFrame(upb_Decoder* d) {
+  if (d->frame_count == d->frame_capacity) {
+    uint32_t capacity = UPB_MAX(16, d->frame_capacity * 2);
+    _upb_Decoder_Frame* frames = upb_Arena_Realloc(
+        &d->arena, d->frames, d->frame_capacity * sizeof(*frames),
+        capacity * sizeof(*frames));
+    if (!frames) _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);
+    d->frames = frames;
+    d->frame_capacity = capacity;
+  }
+  return &d->frames[d->frame_count++];
+}
+
+// Like _upb_Decoder_DecodeMessage(), but a delimited sub-message is decoded in
+// the same loop, with the enclosing message saved on `d->frames`, rather than
+// by recursion.  Groups, map entries and message set items still recurse, and
+// start a loop of their own.
+UPB_NOINLINE
+static const char* _upb_Decoder_DecodeMessageExplicitStack(
+    upb_Decoder* d, const char* ptr, upb_Message* msg,
+    const upb_MiniTable* layout) {
+  const uint32_t base = d->frame_count;
+  int last_field_index = 0;
+  const upb_FieldSelection* selection = d->selection;
+  upb_DecodeMessageStats* stats = NULL;
+  if (UPB_UNLIKELY(d->stats) && layout) {
+    stats = _upb_Decoder_EnterStats(d, layout);
+  }
+
+  while (true) {
+    while (!_upb_Decoder_IsDone(d, &ptr)) {
+      uint32_t tag;
+
+#ifndef NDEBUG
+      d->debug_tagstart = ptr;
+#endif
+
+      UPB_ASSERT(ptr < d->input.limit_ptr);
+      const char* tag_ptr = ptr;
+      ptr = _upb_Decoder_DecodeTag(d, ptr, &tag);
+
+#ifndef NDEBUG
+      d->debug_valstart = ptr;
+#endif
+
+      if ((tag & 7) == kUpb_WireType_EndGroup) {
+        // A group cannot end inside a delimited sub-message.
+        if (d->frame_count != base) {
+          _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_Malformed);
+        }
+        d->end_group = tag >> 3;
+        return ptr;
+      }
+
+      ptr = _upb_Decoder_DecodeField(d, ptr, msg, layout, selection, stats,
+                                     &last_field_index, tag, tag_ptr);
+
+      if (!d->push_msg) {
+        d->selection = selection;
+        continue;
+      }
+
+      // Enter the sub-message that the field left for us.
+      _upb_Decoder_Frame* frame = _upb_Decoder_PushFrame(d);
+      frame->msg = msg;
+      frame->layout = layout;
+      frame->selection = selection;
+      frame->stats = stats;
+      frame->last_field_index = last_field_index;
+      frame->saved_delta =
+          upb_EpsCopyInputStream_PushLimit(&d->input, ptr, d->push_size);
+      if (--d->depth < 0) {
+        _upb_Decoder_ErrorJmp(d, kUpb_DecodeStatus_MaxDepthExceeded);
+      }
+      msg = d->push_msg;
+      layout = d->push_layout;
+      d->push_msg = NULL;
+      UPB_ASSERT(layout);
+      selection = d->selection;
+      stats = UPB_UNLIKELY(d->stats) ? _upb_Decoder_EnterStats(d, layout)
+                                     : NULL;
+      last_field_index = 0;
+    }
+
+    if (UPB_UNLIKELY(layout && layout->required_count)) {
+      ptr = _upb_Decoder_CheckRequired(d, ptr, msg, layout);
+    }
+    if (d->frame_count == base) return ptr;
+
+    // Return to the enclosing message.
+    _upb_Decoder_Frame* frame = &d->frames[--d->frame_count];
+    upb_EpsCopyInputStream_PopLimit(&d->input, ptr, frame->saved_delta);
+    d->depth++;
+    msg = frame->msg;
+    layout = frame->layout;
+    selection = frame->selection;
+    stats = frame->stats;
+    last_field_index = frame->last_field_index;
+    d->selection = selection;
+  }
+}
+
 UPB_NOINLINE
 static const char* _upb_Decoder_DecodeMessage(upb_Decoder* d, const char* ptr,
                                               upb_Message* msg,
                                               const upb_MiniTable* layout) {
+  if (UPB_UNLIKELY(d->options & kUpb_DecodeOption_ExplicitStack)) {
+    return _upb_Decoder_DecodeMessageExplicitStack(d, ptr, msg, layout);
+  }
+
   int last_field_index = 0;
+  const upb_FieldSelection* selection = d->selection;
+  upb_DecodeMessageStats* stats = NULL;
+  if (UPB_UNLIKELY(d->stats) && layout) {
+    stats = _upb_Decoder_EnterStats(d, layout);
+  }
 
 #if UPB_FASTTABLE
   // The first time we want to skip fast dispatch, because we may have just been
@@ -1249,11 +2365,6 @@ static const char* _upb_Decoder_DecodeMessage(upb_Decoder* d, const char* ptr,
 
   while (!_upb_Decoder_IsDone(d, &ptr)) {
     uint32_t tag;
-    const upb_MiniTableField* field;
-    int field_number;
-    int wire_type;
-    wireval val;
-    int op;
 
     if (_upb_Decoder_TryFastDispatch(d, &ptr, msg, layout)) break;
 
@@ -1266,36 +2377,21 @@ static const char* _upb_Decoder_DecodeMessage(upb_Decoder* d, const char* ptr,
 #endif
 
     UPB_ASSERT(ptr < d->input.limit_ptr);
+    const char* tag_ptr = ptr;
     ptr = _upb_Decoder_DecodeTag(d, ptr, &tag);
-    field_number = tag >> 3;
-    wire_type = tag & 7;
 
 #ifndef NDEBUG
     d->debug_valstart = ptr;
 #endif
 
-    if (wire_type == kUpb_WireType_EndGroup) {
-      d->end_group = field_number;
+    if ((tag & 7) == kUpb_WireType_EndGroup) {
+      d->end_group = tag >> 3;
       return ptr;
     }
 
-    field = _upb_Decoder_FindField(d, layout, field_number, &last_field_index);
-    ptr = _upb_Decoder_DecodeWireValue(d, ptr, layout, field, wire_type, &val,
-                                       &op);
-
-    if (op >= 0) {
-      ptr = _upb_Decoder_DecodeKnownField(d, ptr, msg, layout, field, op, &val);
-    } else {
-      switch (op) {
-        case kUpb_DecodeOp_UnknownField:
-          ptr = _upb_Decoder_DecodeUnknownField(d, ptr, msg, field_number,
-                                                wire_type, val);
-          break;
-        case kUpb_DecodeOp_MessageSetItem:
-          ptr = upb_Decoder_DecodeMessageSetItem(d, ptr, msg, layout);
-          break;
-      }
-    }
+    ptr = _upb_Decoder_DecodeField(d, ptr, msg, layout, selection, stats,
+                                   &last_field_index, tag, tag_ptr);
+    d->selection = selection;
   }
 
   return UPB_UNLIKELY(layout && layout->required_count)
@@ -1309,12 +2405,14 @@ const char* _upb_FastDecoder_DecodeGeneric(struct upb_Decoder* d,
                                            uint64_t data) {
   (void)data;
   *(uint32_t*)msg |= hasbits;
+  d->generic_fallbacks++;
   return _upb_Decoder_DecodeMessage(d, ptr, msg, decode_totablep(table));
 }
 
 static upb_DecodeStatus _upb_Decoder_DecodeTop(struct upb_Decoder* d,
                                                const char* buf, void* msg,
                                                const upb_MiniTable* l) {
+  _upb_Message_Modified(msg);
   if (!_upb_Decoder_TryFastDispatch(d, &buf, msg, l)) {
     _upb_Decoder_DecodeMessage(d, buf, msg, l);
   }
@@ -1330,54 +2428,283 @@ const char* _upb_Decoder_IsDoneFallback(upb_EpsCopyInputStream* e,
       e, ptr, overrun, _upb_Decoder_BufferFlipCallback);
 }
 
+// The intern table lives across _upb_Decoder_Reset(), so that
+// upb_DecodeBatch() can share it between messages.
+static void _upb_Decoder_InitIntern(upb_Decoder* d) {
+  d->intern = NULL;
+  d->intern_mask = 0;
+  d->intern_count = 0;
+}
+
 static upb_DecodeStatus upb_Decoder_Decode(upb_Decoder* const decoder,
                                            const char* const buf,
                                            void* const msg,
                                            const upb_MiniTable* const l,
                                            upb_Arena* const arena) {
-  if (UPB_SETJMP(decoder->err) == 0) {
+  UPB_ASSERT(!_upb_Message_IsFrozen(msg));
+  _upb_Decoder_InitIntern(decoder);
+  if (UPB_FAST_SETJMP(decoder->err) == 0) {
     decoder->status = _upb_Decoder_DecodeTop(decoder, buf, msg, l);
   } else {
     UPB_ASSERT(decoder->status != kUpb_DecodeStatus_Ok);
   }
 
-  _upb_MemBlock* blocks =
-      upb_Atomic_Load(&decoder->arena.blocks, memory_order_relaxed);
-  arena->head = decoder->arena.head;
-  upb_Atomic_Store(&arena->blocks, blocks, memory_order_relaxed);
+  upb_gfree(decoder->intern);
+  _upb_Arena_SwapOut(arena, &decoder->arena);
   return decoder->status;
 }
 
+// Like upb_Decoder_Decode(), but records the call in `metrics`.
+UPB_NOINLINE
+static upb_DecodeStatus _upb_Decoder_DecodeWithMetrics(
+    upb_Decoder* const decoder, const char* const buf, size_t size,
+    void* const msg, const upb_MiniTable* const l, upb_Arena* const arena,
+    upb_Metrics* metrics) {
+  _upb_MemBlock* blocks = upb_Atomic_Load(&arena->blocks, memory_order_relaxed);
+  size_t has = _upb_ArenaHas(arena);
+  UPB_PROBE(decode_begin, l, size);
+  upb_DecodeStatus status = upb_Decoder_Decode(decoder, buf, msg, l, arena);
+  UPB_PROBE(decode_end, l, size, status);
+  _upb_Metrics_RecordDecode(metrics, l, size, status == kUpb_DecodeStatus_Ok,
+                            decoder->unknown_bytes,
+                            decoder->generic_fallbacks,
+                            _upb_Arena_UsedSince(arena, blocks, has));
+  return status;
+}
+
+// Resets the per-message state of the decoder to parse `*buf`.
+static void _upb_Decoder_Reset(upb_Decoder* d, const char** buf, size_t size,
+                               int options) {
+  unsigned depth = (unsigned)options >> 16;
+
+  upb_EpsCopyInputStream_Init(&d->input, buf, size,
+                              options & kUpb_DecodeOption_AliasString);
+
+  d->extreg_extendee = NULL;
+  d->unknown = NULL;
+  d->depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
+  d->end_group = DECODE_NOGROUP;
+  d->missing_required = false;
+  d->selection = NULL;
+  d->stats = NULL;
+  d->unknown_bytes = 0;
+  d->generic_fallbacks = 0;
+  d->frames = NULL;
+  d->frame_count = 0;
+  d->frame_capacity = 0;
+  d->push_msg = NULL;
+  if (options & kUpb_DecodeOption_BulkSubMessages) {
+    memset(d->slabs, 0, sizeof(d->slabs));
+  }
+#if UPB_FASTTABLE_TRAMPOLINE
+  d->fast_resume = false;
+#endif
+  d->status = kUpb_DecodeStatus_Ok;
+}
+
 upb_DecodeStatus upb_Decode(const char* buf, size_t size, void* msg,
                             const upb_MiniTable* l,
                             const upb_ExtensionRegistry* extreg, int options,
                             upb_Arena* arena) {
   upb_Decoder decoder;
-  unsigned depth = (unsigned)options >> 16;
-
-  upb_EpsCopyInputStream_Init(&decoder.input, &buf, size,
-                              options & kUpb_DecodeOption_AliasString);
 
+  _upb_Decoder_Reset(&decoder, &buf, size, options);
   decoder.extreg = extreg;
-  decoder.unknown = NULL;
-  decoder.depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
-  decoder.end_group = DECODE_NOGROUP;
   decoder.options = (uint16_t)options;
-  decoder.missing_required = false;
-  decoder.status = kUpb_DecodeStatus_Ok;
 
   // Violating the encapsulation of the arena for performance reasons.
   // This is a temporary arena that we swap into and swap out of when we are
-  // done.  The temporary arena only needs to be able to handle allocation,
-  // not fuse or free, so it does not need many of the members to be initialized
-  // (particularly parent_or_count).
-  _upb_MemBlock* blocks = upb_Atomic_Load(&arena->blocks, memory_order_relaxed);
-  decoder.arena.head = arena->head;
-  decoder.arena.block_alloc = arena->block_alloc;
-  upb_Atomic_Init(&decoder.arena.blocks, blocks);
+  // done.
+  _upb_Arena_SwapIn(&decoder.arena, arena);
+
+  upb_Metrics* metrics = _upb_Metrics_Active();
+  if (UPB_UNLIKELY(metrics)) {
+    return _upb_Decoder_DecodeWithMetrics(&decoder, buf, size, msg, l, arena,
+                                          metrics);
+  }
+
+  UPB_PROBE(decode_begin, l, size);
+  upb_DecodeStatus status = upb_Decoder_Decode(&decoder, buf, msg, l, arena);
+  UPB_PROBE(decode_end, l, size, status);
+  return status;
+}
+
+upb_FieldSelection* upb_FieldSelection_New(const upb_MiniTable* mini_table,
+                                           upb_Arena* arena) {
+  upb_FieldSelection* s = upb_Arena_Malloc(arena, sizeof(*s));
+  if (!s) return NULL;
+  size_t size = mini_table->field_count * sizeof(*s->fields);
+  s->fields = upb_Arena_Malloc(arena, size);
+  if (!s->fields) return NULL;
+  memset(s->fields, 0, size);
+  s->mini_table = mini_table;
+  return s;
+}
+
+// Returns the slot for field `number` in `s`, or NULL if `s` has no such
+// field.
+static upb_FieldSelection** _upb_FieldSelection_Slot(upb_FieldSelection* s,
+                                                     uint32_t number) {
+  const upb_MiniTableField* f =
+      upb_MiniTable_FindFieldByNumber(s->mini_table, number);
+  return f ? &s->fields[f - s->mini_table->fields] : NULL;
+}
+
+// Returns the mini table for the next step of a path through field `number`,
+// or NULL if the path may not continue past it.
+static const upb_MiniTable* _upb_FieldSelection_SubTable(
+    const upb_MiniTable* mt, uint32_t number) {
+  const upb_MiniTableField* f = upb_MiniTable_FindFieldByNumber(mt, number);
+  if (!f || upb_MiniTableField_CType(f) != kUpb_CType_Message ||
+      upb_FieldMode_Get(f) == kUpb_FieldMode_Map) {
+    return NULL;
+  }
+  return upb_MiniTable_GetSubMessageTable(mt, f);
+}
+
+bool upb_FieldSelection_AddPath(upb_FieldSelection* s, const uint32_t* path,
+                                size_t path_len, upb_Arena* arena) {
+  if (path_len == 0) return false;
+
+  // Validate the whole path before modifying anything.
+  const upb_MiniTable* mt = s->mini_table;
+  for (size_t i = 0; i < path_len - 1; i++) {
+    mt = _upb_FieldSelection_SubTable(mt, path[i]);
+    if (!mt) return false;
+  }
+  if (!upb_MiniTable_FindFieldByNumber(mt, path[path_len - 1])) return false;
+
+  for (size_t i = 0; i < path_len - 1; i++) {
+    upb_FieldSelection** slot = _upb_FieldSelection_Slot(s, path[i]);
+    if (*slot == &_upb_FieldSelection_All) return true;
+    if (!*slot) {
+      *slot = upb_FieldSelection_New(
+          _upb_FieldSelection_SubTable(s->mini_table, path[i]), arena);
+      if (!*slot) return false;
+    }
+    s = *slot;
+  }
+  *_upb_FieldSelection_Slot(s, path[path_len - 1]) = &_upb_FieldSelection_All;
+  return true;
+}
+
+upb_DecodeStatus upb_DecodeSelected(const char* buf, size_t size,
+                                    upb_Message* msg,
+                                    const upb_FieldSelection* selection,
+                                    const upb_ExtensionRegistry* extreg,
+                                    int options, upb_Arena* arena) {
+  upb_Decoder decoder;
+
+  _upb_Decoder_Reset(&decoder, &buf, size, options);
+  decoder.extreg = extreg;
+  decoder.options = (uint16_t)options;
+  decoder.selection = selection;
+  _upb_Arena_SwapIn(&decoder.arena, arena);
+
+  return upb_Decoder_Decode(&decoder, buf, msg, selection->mini_table, arena);
+}
+
+upb_DecodeStats* upb_DecodeStats_New(upb_Arena* arena) {
+  upb_DecodeStats* stats = upb_Arena_Malloc(arena, sizeof(*stats));
+  if (!stats || !upb_inttable_init(&stats->tables, arena)) return NULL;
+  stats->arena = arena;
+  return stats;
+}
+
+const upb_DecodeMessageStats* upb_DecodeStats_Get(
+    const upb_DecodeStats* stats, const upb_MiniTable* mini_table) {
+  upb_value v;
+  if (!upb_inttable_lookup(&stats->tables, (uintptr_t)mini_table, &v)) {
+    return NULL;
+  }
+  return upb_value_getptr(v);
+}
+
+upb_DecodeStatus upb_DecodeWithStats(const char* buf, size_t size,
+                                     upb_Message* msg, const upb_MiniTable* l,
+                                     const upb_ExtensionRegistry* extreg,
+                                     int options, upb_DecodeStats* stats,
+                                     upb_Arena* arena) {
+  upb_Decoder decoder;
+
+  _upb_Decoder_Reset(&decoder, &buf, size, options);
+  decoder.extreg = extreg;
+  decoder.options = (uint16_t)options;
+  decoder.stats = stats;
+  // While decoding, the state of `arena` lives in decoder.arena.
+  decoder.stats_arena = stats->arena == arena ? &decoder.arena : stats->arena;
+  _upb_Arena_SwapIn(&decoder.arena, arena);
 
   return upb_Decoder_Decode(&decoder, buf, msg, l, arena);
 }
 
+static bool _upb_Decoder_AllocBatch(upb_Message** msgs, size_t count,
+                                    const upb_MiniTable* l, upb_Arena* arena) {
+  size_t missing = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (!msgs[i]) missing++;
+  }
+  if (!missing) return true;
+
+  size_t stride = UPB_ALIGN_MALLOC(upb_msg_sizeof(l));
+  if (missing > SIZE_MAX / stride) return false;
+  char* mem = upb_Arena_Malloc(arena, missing * stride);
+  if (!mem) return false;
+  memset(mem, 0, missing * stride);
+
+  for (size_t i = 0; i < count; i++) {
+    if (msgs[i]) continue;
+    msgs[i] = UPB_PTR_AT(mem, sizeof(upb_Message_Internal), upb_Message);
+    mem += stride;
+  }
+  return true;
+}
+
+size_t upb_DecodeBatch(const upb_StringView* bufs, size_t count,
+                       upb_Message** msgs, const upb_MiniTable* l,
+                       const upb_ExtensionRegistry* extreg, int options,
+                       upb_Arena* arena, upb_DecodeStatus* statuses) {
+  if (!_upb_Decoder_AllocBatch(msgs, count, l, arena)) {
+    if (statuses) {
+      for (size_t i = 0; i < count; i++) {
+        statuses[i] = kUpb_DecodeStatus_OutOfMemory;
+      }
+    }
+    return 0;
+  }
+
+  upb_Decoder decoder;
+  decoder.extreg = extreg;
+  decoder.options = (uint16_t)options;
+  _upb_Arena_SwapIn(&decoder.arena, arena);
+  _upb_Decoder_InitIntern(&decoder);
+
+  // These are modified between setjmp() and longjmp(), so they must be
+  // volatile to have well-defined values after an error.  The jump buffer is
+  // only re-armed after an item fails.
+  volatile size_t i = 0;
+  volatile size_t ok = 0;
+
+  while (i < count) {
+    if (UPB_FAST_SETJMP(decoder.err) == 0) {
+      for (; i < count; i++) {
+        const char* buf = bufs[i].data;
+        _upb_Decoder_Reset(&decoder, &buf, bufs[i].size, options);
+        decoder.status = _upb_Decoder_DecodeTop(&decoder, buf, msgs[i], l);
+        if (decoder.status == kUpb_DecodeStatus_Ok) ok++;
+        if (statuses) statuses[i] = decoder.status;
+      }
+    } else {
+      UPB_ASSERT(decoder.status != kUpb_DecodeStatus_Ok);
+      if (statuses) statuses[i] = decoder.status;
+      i++;
+    }
+  }
+
+  upb_gfree(decoder.intern);
+  _upb_Arena_SwapOut(arena, &decoder.arena);
+  return ok;
+}
+
 #undef OP_FIXPCK_LG2
 #undef OP_VARPCK_LG2
@@ -33,6 +33,7 @@
 #ifndef UPB_WIRE_DECODE_H_
 #define UPB_WIRE_DECODE_H_
 
+#include "upb/base/string_view.h"
 #include "upb/mem/arena.h"
 #include "upb/message/message.h"
 #include "upb/mini_table/extension_registry.h"
@@ -103,6 +104,127 @@ enum {
    *    be created by the parser or the message-copying logic in message/copy.h.
    */
   kUpb_DecodeOption_ExperimentalAllowUnlinked = 4,
+
+  /* If set, the parser will look ahead through repeated field data to size
+   * arrays before appending to them.  Packed varint fields are counted before
+   * they are decoded, and runs of non-packed elements of the same field that
+   * follow each other in the buffer are counted when the array needs to grow.
+   * This avoids the repeated reallocation (and copying) that doubling incurs
+   * when several repeated fields are interleaved in the same arena, at the
+   * cost of a second pass over the data.
+   *
+   * Map fields are sized the same way: when a map is created, the run of
+   * entries that follows is counted and the map's table is allocated to hold
+   * them all.
+   *
+   * Repeated groups are not prescanned, and the option does not affect the
+   * fast table parser. */
+  kUpb_DecodeOption_PrescanRepeated = 8,
+
+  /* EXPERIMENTAL:
+   *
+   * If set, length-delimited sub-message fields are not parsed.  Instead their
+   * bytes are stored in an "empty" message, exactly as if the field had been
+   * unlinked (see kUpb_DecodeOption_ExperimentalAllowUnlinked above), and the
+   * same rules apply to reading them: test the tagged pointer with
+   * upb_TaggedMessagePtr_IsEmpty(), and parse it on first use with
+   * upb_Message_GetOrPromoteMessage() or the other interfaces in
+   * message/promote.h.  Repeated occurrences of a singular sub-message field
+   * are appended to the same empty message, so they still merge when promoted.
+   *
+   * This is useful when most sub-messages of a large message are never looked
+   * at.  The bytes of a lazy sub-message are copied (unless
+   * kUpb_DecodeOption_AliasUnknown is set), but not validated, so malformed
+   * data and missing required fields inside it are only reported when it is
+   * promoted.
+   *
+   * Groups, extensions and map values are always parsed eagerly, as is a
+   * sub-message that is merged into an existing non-empty message.  The fast
+   * table parser defers to the generic parser for sub-messages when this
+   * option is set. */
+  kUpb_DecodeOption_ExperimentalLazySubMessages = 16,
+
+  /* If set together with kUpb_DecodeOption_AliasString, unknown fields (and
+   * the bytes of lazy sub-messages) alias the input buffer instead of being
+   * copied into the message, so the buffer must outlive the message.  This
+   * makes decoding and re-encoding messages that are mostly unknown to this
+   * binary, as a pass-through proxy does, close to free.
+   *
+   * A message can only alias a single run of input, so aliasing stops, and
+   * the data is copied after all, once unknown fields of the same message are
+   * interrupted by known ones. */
+  kUpb_DecodeOption_AliasUnknown = 32,
+
+  /* If set, the elements of repeated sub-message fields are allocated in
+   * contiguous slabs of several messages instead of one at a time.  This cuts
+   * the number of arena allocations and keeps the elements of an array close
+   * together in memory, which makes iterating over fields with many elements
+   * faster.  Slabs grow geometrically, or are sized to the rest of the run of
+   * elements when kUpb_DecodeOption_PrescanRepeated is also set.
+   *
+   * Messages left over in a slab at the end of the parse are wasted arena
+   * memory, which is bounded by the size of the last slab of each type.
+   * Repeated groups and extensions are allocated individually, and the option
+   * does not affect the fast table parser. */
+  kUpb_DecodeOption_BulkSubMessages = 64,
+
+  /* If set together with kUpb_DecodeOption_AliasString on a little-endian
+   * host, packed repeated fixed-width fields (float, double, [s]fixed32 and
+   * [s]fixed64) whose data is 8-byte aligned in the input are not copied:
+   * their upb_Array points directly into the input buffer, which must outlive
+   * the message.  This saves the copy and the arena space for messages that
+   * carry large numeric payloads.
+   *
+   * Such arrays are frozen (see upb_Array_IsFrozen()), and must be copied
+   * before they are modified, for example with
+   * upb_Message_MutableArrayCopyOnWrite().  A field whose data arrives in
+   * several pieces is copied after all once the second one is parsed.  The
+   * fast table parser is not used when this option is set. */
+  kUpb_DecodeOption_AliasFixedArrays = 128,
+
+  /* If set, sub-messages are decoded with an explicit stack allocated from
+   * the arena instead of by recursion, so that deeply nested messages do not
+   * need a deep native stack.  Each level of nesting then costs a few dozen
+   * bytes of arena memory rather than a native stack frame, and
+   * upb_DecodeOptions_MaxDepth() can be raised accordingly (up to 65535) on
+   * threads with small stacks.
+   *
+   * Groups, map entries and message set items still recurse, one native
+   * frame for each level of them.  The fast table parser is not used when
+   * this option is set. */
+  kUpb_DecodeOption_ExplicitStack = 256,
+
+  /* If set, string and bytes fields of up to 64 bytes that have to be copied
+   * into the arena (that is, not aliased with kUpb_DecodeOption_AliasString)
+   * share storage with an equal string decoded earlier in the same call,
+   * rather than each getting a copy of their own.  This saves arena memory
+   * for payloads that repeat the same short strings many times, at the cost
+   * of a hash lookup per string and a temporary table of up to 3072 strings
+   * from upb_alloc_global.  upb_DecodeBatch() shares one table across the
+   * whole batch.
+   *
+   * Strings stored inline in the message are not interned.  The fast table
+   * parser is not used when this option is set. */
+  kUpb_DecodeOption_InternStrings = 512,
+
+  /* If set, string fields are not checked for valid UTF-8 during the parse,
+   * so bad UTF-8 no longer fails it with kUpb_DecodeStatus_BadUtf8.  This
+   * saves the cost of validation for callers that only pass strings through,
+   * such as proxies that re-encode the message.  Callers that do read the
+   * strings should validate the message, or the parts of it they use, with
+   * upb_Message_ValidateUtf8() (in upb/message/validate_utf8.h) first. */
+  kUpb_DecodeOption_DeferUtf8Validation = 1024,
+
+  /* If set, elements of repeated message fields are decoded into the empty
+   * messages that upb_Message_ClearForReuse() (in upb/message/reuse.h) kept
+   * in the array, before new ones are allocated.  Singular sub-messages,
+   * arrays and maps are filled in place whether or not this is set, since
+   * the parser merges into what the message already holds.  Together with
+   * kUpb_DecodeOption_AliasString, a consumer that clears and re-decodes
+   * messages of the same shape then stops allocating once the first few
+   * messages have been seen.  The fast table parser is not used when this
+   * option is set. */
+  kUpb_DecodeOption_ReuseRetained = 2048,
 };
 
 UPB_INLINE uint32_t upb_DecodeOptions_MaxDepth(uint16_t depth) {
@@ -136,6 +258,11 @@ typedef enum {
   // kUpb_DecodeOptions_ExperimentalAllowUnlinked was not specified in the list
   // of options.
   kUpb_DecodeStatus_UnlinkedSubMessage = 6,
+
+  // The input ended in the middle of a field.  Only returned by the
+  // incremental decoder (see incremental_decode.h), which will resume when more
+  // data is supplied.
+  kUpb_DecodeStatus_NeedMoreData = 7,
 } upb_DecodeStatus;
 
 UPB_API upb_DecodeStatus upb_Decode(const char* buf, size_t size,
@@ -143,6 +270,106 @@ UPB_API upb_DecodeStatus upb_Decode(const char* buf, size_t size,
                                     const upb_ExtensionRegistry* extreg,
                                     int options, upb_Arena* arena);
 
+// Decodes `count` serialized messages of the same type, parsing `bufs[i]` into
+// `msgs[i]` and storing the result in `statuses[i]` (if `statuses` is
+// non-NULL).  This is equivalent to calling upb_Decode() for each item, but the
+// decoder is only set up once for the whole batch.
+//
+// Any NULL entries of `msgs` are replaced with new, empty messages allocated
+// together in a single block from `arena`.  If that allocation fails, nothing
+// is decoded and every item reports kUpb_DecodeStatus_OutOfMemory.
+//
+// A failure in one item does not stop the batch; as with upb_Decode(), the
+// message for a failed item may be partially populated.  Returns the number of
+// items that decoded with kUpb_DecodeStatus_Ok.
+UPB_API size_t upb_DecodeBatch(const upb_StringView* bufs, size_t count,
+                               upb_Message** msgs, const upb_MiniTable* l,
+                               const upb_ExtensionRegistry* extreg,
+                               int options, upb_Arena* arena,
+                               upb_DecodeStatus* statuses);
+
+// A precompiled set of field paths, like a google.protobuf.FieldMask, that
+// restricts which fields upb_DecodeSelected() will parse.
+typedef struct upb_FieldSelection upb_FieldSelection;
+
+// Creates an empty selection for messages of type `mini_table`.  Returns NULL
+// on allocation failure.
+UPB_API upb_FieldSelection* upb_FieldSelection_New(
+    const upb_MiniTable* mini_table, upb_Arena* arena);
+
+// Adds the field path `path[0].path[1]...` (given as field numbers) to the
+// selection.  Selecting a message field selects all of its sub-fields, so
+// paths behave as a union: adding "a" after "a.b" selects all of "a".
+//
+// Every field but the last must be a linked, non-map message field; repeated
+// message fields are allowed and the rest of the path applies to every
+// element.  Returns false if the path is empty, names a field that does not
+// exist or does not satisfy these rules (in which case the selection is left
+// unchanged), or on allocation failure.
+UPB_API bool upb_FieldSelection_AddPath(upb_FieldSelection* s,
+                                        const uint32_t* path, size_t path_len,
+                                        upb_Arena* arena);
+
+// Like upb_Decode(), but only parses the fields in `selection`, using the
+// mini table the selection was created with.  All other fields, including
+// extensions, are skipped without being stored as unknown fields, which makes
+// this much cheaper than a full parse when only a few fields are needed.
+//
+// With kUpb_DecodeOption_CheckRequired, a required field that is not selected
+// is reported as missing.
+UPB_API upb_DecodeStatus upb_DecodeSelected(const char* buf, size_t size,
+                                            upb_Message* msg,
+                                            const upb_FieldSelection* selection,
+                                            const upb_ExtensionRegistry* extreg,
+                                            int options, upb_Arena* arena);
+
+// Statistics gathered by upb_DecodeWithStats(), for tuning message layout and
+// fast-table assignment (see upb/util/decode_stats.h to write them as a profile
+// for upbc).
+typedef struct upb_DecodeStats upb_DecodeStats;
+
+typedef struct {
+  uint64_t count;  // Number of occurrences on the wire.
+  uint64_t bytes;  // Encoded size of those occurrences, including tags.
+} upb_DecodeFieldStats;
+
+typedef struct {
+  uint64_t messages;  // Number of messages of this type decoded.
+
+  // Field occurrences that the fast table has a specialized parser for, and
+  // field occurrences that need the generic parser.  Fields are always parsed
+  // by the generic parser while gathering statistics, so these describe what
+  // a normal parse would do.
+  uint64_t fast_fields;
+  uint64_t generic_fields;
+
+  // Occurrences of fields that are not in the mini table, including
+  // extensions.
+  upb_DecodeFieldStats unknown;
+
+  // Indexed like mini_table->fields.
+  const upb_DecodeFieldStats* fields;
+} upb_DecodeMessageStats;
+
+// Creates an empty set of statistics, allocated from `arena` (which may differ
+// from the arenas used for decoding).  Returns NULL on allocation failure.
+UPB_API upb_DecodeStats* upb_DecodeStats_New(upb_Arena* arena);
+
+// Returns the statistics gathered for messages of type `mini_table`, or NULL
+// if none were decoded.
+UPB_API const upb_DecodeMessageStats* upb_DecodeStats_Get(
+    const upb_DecodeStats* stats, const upb_MiniTable* mini_table);
+
+// Like upb_Decode(), but adds what was seen in `buf` to `stats`.  This is
+// considerably slower than upb_Decode() and meant for sampling traffic.
+UPB_API upb_DecodeStatus upb_DecodeWithStats(const char* buf, size_t size,
+                                             upb_Message* msg,
+                                             const upb_MiniTable* l,
+                                             const upb_ExtensionRegistry* extreg,
+                                             int options,
+                                             upb_DecodeStats* stats,
+                                             upb_Arena* arena);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
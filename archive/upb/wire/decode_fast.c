@@ -41,7 +41,10 @@
 #include "upb/wire/decode_fast.h"
 
 #include "upb/collections/internal/array.h"
+#include "upb/collections/internal/map.h"
+#include "upb/mini_table/internal/enum.h"
 #include "upb/wire/internal/decode.h"
+#include "upb/wire/types.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -158,6 +161,7 @@ static const char* fastdecode_delimited(
     }
     int delta = upb_EpsCopyInputStream_PushLimit(&d->input, ptr, len);
     ptr = func(&d->input, ptr, ctx);
+    if (!ptr) return NULL;  // The caller reports the error.
     upb_EpsCopyInputStream_PopLimit(&d->input, ptr, delta);
   }
   return ptr;
@@ -495,6 +499,92 @@ TAGBYTES(p)
 #undef FASTDECODE_PACKEDVARINT
 #undef FASTDECODE_VARINT
 
+/* closed enum fields *********************************************************/
+
+// Closed enum values are checked against the dense bitmask at the front of
+// the upb_MiniTableEnum.  Any other value is left untouched for the generic
+// parser, which either finds it further down the enum's value list or moves
+// it to the unknown fields.
+#define FASTDECODE_ENUM(d, ptr, msg, table, hasbits, data, tagbytes, card)    \
+  uint64_t val;                                                               \
+  void* dst = NULL;                                                           \
+  fastdecode_arr farr;                                                        \
+  const char* field_start;                                                    \
+                                                                              \
+  if (UPB_UNLIKELY(!fastdecode_checktag(data, tagbytes))) {                   \
+    RETURN_GENERIC("enum field tag mismatch\n");                              \
+  }                                                                           \
+                                                                              \
+  const upb_MiniTable* tablep = decode_totablep(table);                       \
+  const upb_MiniTableEnum* e = tablep->subs[(data >> 16) & 0xff].subenum;     \
+                                                                              \
+  if (card == CARD_r) {                                                       \
+    dst = fastdecode_getfield(d, ptr, msg, &data, &hasbits, &farr, 4, card);  \
+    if (UPB_UNLIKELY(!dst)) {                                                 \
+      RETURN_GENERIC("need array resize\n");                                  \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  again:                                                                      \
+  if (card == CARD_r) {                                                       \
+    dst = fastdecode_resizearr(d, dst, &farr, 4);                             \
+  }                                                                           \
+                                                                              \
+  field_start = ptr;                                                          \
+  ptr += tagbytes;                                                            \
+  ptr = fastdecode_varint64(ptr, &val);                                       \
+  if (ptr == NULL) _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_Malformed); \
+  if (UPB_UNLIKELY(_upb_MiniTable_CheckEnumValueFast(e, (uint32_t)val) !=     \
+                   _kUpb_FastEnumCheck_ValueIsInEnum)) {                      \
+    if (card == CARD_r) fastdecode_commitarr(dst, &farr, 4);                  \
+    ptr = field_start;                                                        \
+    RETURN_GENERIC("enum value not in bitmask\n");                            \
+  }                                                                           \
+                                                                              \
+  if (card != CARD_r) {                                                       \
+    dst = fastdecode_getfield(d, ptr, msg, &data, &hasbits, &farr, 4, card);  \
+  }                                                                           \
+  memcpy(dst, &val, 4);                                                       \
+                                                                              \
+  if (card == CARD_r) {                                                       \
+    fastdecode_nextret ret =                                                  \
+        fastdecode_nextrepeated(d, dst, &ptr, &farr, data, tagbytes, 4);      \
+    switch (ret.next) {                                                       \
+      case FD_NEXT_SAMEFIELD:                                                 \
+        dst = ret.dst;                                                        \
+        goto again;                                                           \
+      case FD_NEXT_OTHERFIELD:                                                \
+        data = ret.tag;                                                       \
+        UPB_MUSTTAIL return _upb_FastDecoder_TagDispatch(UPB_PARSE_ARGS);     \
+      case FD_NEXT_ATLIMIT:                                                   \
+        return ptr;                                                           \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  UPB_MUSTTAIL return fastdecode_dispatch(UPB_PARSE_ARGS);
+
+/* Generate all combinations:
+ * {s,o,r} x {1bt,2bt} */
+
+#define F(card, tagbytes)                                          \
+  UPB_NOINLINE                                                     \
+  const char* upb_p##card##e4_##tagbytes##bt(UPB_PARSE_PARAMS) {   \
+    FASTDECODE_ENUM(d, ptr, msg, table, hasbits, data, tagbytes,   \
+                    CARD_##card);                                  \
+  }
+
+#define TAGBYTES(card) \
+  F(card, 1)           \
+  F(card, 2)
+
+TAGBYTES(s)
+TAGBYTES(o)
+TAGBYTES(r)
+
+#undef F
+#undef TAGBYTES
+#undef FASTDECODE_ENUM
+
 /* fixed fields ***************************************************************/
 
 #define FASTDECODE_UNPACKEDFIXED(d, ptr, msg, table, hasbits, data, tagbytes, \
@@ -629,7 +719,7 @@ static const char* fastdecode_verifyutf8(upb_Decoder* d, const char* ptr,
                                          upb_Message* msg, intptr_t table,
                                          uint64_t hasbits, uint64_t data) {
   upb_StringView* dst = (upb_StringView*)data;
-  if (!_upb_Decoder_VerifyUtf8Inline(dst->data, dst->size)) {
+  if (!_upb_Decoder_Utf8Ok(d, dst->data, dst->size)) {
     _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_BadUtf8);
   }
   UPB_MUSTTAIL return fastdecode_dispatch(UPB_PARSE_ARGS);
@@ -738,7 +828,7 @@ static void fastdecode_docopy(upb_Decoder* d, const char* ptr, uint32_t size,
                                                                                \
   if (card == CARD_r) {                                                        \
     if (validate_utf8 &&                                                       \
-        !_upb_Decoder_VerifyUtf8Inline(dst->data, dst->size)) {                \
+        !_upb_Decoder_Utf8Ok(d, dst->data, dst->size)) {                       \
       _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_BadUtf8);                 \
     }                                                                          \
     fastdecode_nextret ret = fastdecode_nextrepeated(                          \
@@ -820,7 +910,7 @@ static void fastdecode_docopy(upb_Decoder* d, const char* ptr, uint32_t size,
                                                                               \
   if (card == CARD_r) {                                                       \
     if (validate_utf8 &&                                                      \
-        !_upb_Decoder_VerifyUtf8Inline(dst->data, dst->size)) {               \
+        !_upb_Decoder_Utf8Ok(d, dst->data, dst->size)) {                      \
       _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_BadUtf8);                \
     }                                                                         \
     fastdecode_nextret ret = fastdecode_nextrepeated(                         \
@@ -909,23 +999,64 @@ typedef struct {
   upb_Message* msg;
 } fastdecode_submsgdata;
 
+// Prefetches the fast table that the sub-message's first tag dispatches
+// through (see UPB_ENABLE_DECODE_PREFETCH).
+UPB_FORCEINLINE
+static void _upb_FastDecoder_PrefetchTable(const upb_MiniTable* subtablep) {
+#if UPB_DECODE_PREFETCH
+  UPB_PREFETCH(&subtablep->fasttable[0]);
+#else
+  UPB_UNUSED(subtablep);
+#endif
+}
+
 UPB_FORCEINLINE
 static const char* fastdecode_tosubmsg(upb_EpsCopyInputStream* e,
                                        const char* ptr, void* ctx) {
   upb_Decoder* d = (upb_Decoder*)e;
   fastdecode_submsgdata* submsg = ctx;
   ptr = fastdecode_dispatch(d, ptr, submsg->msg, submsg->table, 0, 0);
+#if UPB_FASTTABLE_TRAMPOLINE
+  // The first field of the sub-message unwound to us rather than to a loop.
+  if (d->fast_resume) {
+    ptr = _upb_FastDecoder_Decode(d, ptr, submsg->msg, submsg->table, 0,
+                                  _upb_FastDecoder_LoadTag(ptr));
+  }
+#endif
   UPB_ASSUME(ptr != NULL);
   return ptr;
 }
 
+// Decodes the body of a group whose start tag of `tagbytes` bytes was just
+// read, up to and including the matching end tag.  The end tag is not in the
+// fast table, so the sub-message's dispatch hands it to the generic parser,
+// which records it in `d->end_group` and unwinds back to us.  Returns NULL if
+// the group is not terminated by its own end tag.
+UPB_FORCEINLINE
+static const char* fastdecode_togroup(upb_Decoder* d, const char* ptr,
+                                      int tagbytes,
+                                      fastdecode_submsgdata* submsg) {
+  uint32_t number = (uint8_t)ptr[-tagbytes] >> 3 & 0xf;
+  if (tagbytes == 2) number |= (uint32_t)(uint8_t)ptr[-1] << 4;
+  if (_upb_Decoder_IsDone(d, &ptr)) return NULL;
+  ptr = fastdecode_tosubmsg(&d->input, ptr, submsg);
+  if (d->end_group != number) return NULL;
+  d->end_group = DECODE_NOGROUP;
+  return ptr;
+}
+
 #define FASTDECODE_SUBMSG(d, ptr, msg, table, hasbits, data, tagbytes,    \
-                          msg_ceil_bytes, card)                           \
+                          msg_ceil_bytes, card, group)                    \
                                                                           \
   if (UPB_UNLIKELY(!fastdecode_checktag(data, tagbytes))) {               \
     RETURN_GENERIC("submessage field tag mismatch\n");                    \
   }                                                                       \
                                                                           \
+  if (UPB_UNLIKELY(d->options &                                           \
+                   kUpb_DecodeOption_ExperimentalLazySubMessages)) {      \
+    RETURN_GENERIC("lazy submessage\n");                                  \
+  }                                                                       \
+                                                                          \
   if (--d->depth == 0) {                                                  \
     _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_MaxDepthExceeded);     \
   }                                                                       \
@@ -935,6 +1066,7 @@ static const char* fastdecode_tosubmsg(upb_EpsCopyInputStream* e,
   const upb_MiniTable* tablep = decode_totablep(table);                   \
   const upb_MiniTable* subtablep = tablep->subs[submsg_idx].submsg;       \
   fastdecode_submsgdata submsg = {decode_totable(subtablep)};             \
+  _upb_FastDecoder_PrefetchTable(subtablep);                              \
   fastdecode_arr farr;                                                    \
                                                                           \
   if (subtablep->table_mask == (uint8_t)-1) {                             \
@@ -958,10 +1090,14 @@ static const char* fastdecode_tosubmsg(upb_EpsCopyInputStream* e,
                                                                           \
   if (card == CARD_r || UPB_LIKELY(!submsg.msg)) {                        \
     *dst = submsg.msg = decode_newmsg_ceil(d, subtablep, msg_ceil_bytes); \
+    _upb_Decoder_PrefetchArena(d);                                        \
+  } else {                                                                \
+    _upb_Message_Modified(submsg.msg);                                    \
   }                                                                       \
                                                                           \
   ptr += tagbytes;                                                        \
-  ptr = fastdecode_delimited(d, ptr, fastdecode_tosubmsg, &submsg);       \
+  ptr = group ? fastdecode_togroup(d, ptr, tagbytes, &submsg)             \
+              : fastdecode_delimited(d, ptr, fastdecode_tosubmsg, &submsg); \
                                                                           \
   if (UPB_UNLIKELY(ptr == NULL || d->end_group != DECODE_NOGROUP)) {      \
     _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_Malformed);            \
@@ -991,7 +1127,12 @@ static const char* fastdecode_tosubmsg(upb_EpsCopyInputStream* e,
   const char* upb_p##card##m_##tagbytes##bt_max##size_ceil##b(               \
       UPB_PARSE_PARAMS) {                                                    \
     FASTDECODE_SUBMSG(d, ptr, msg, table, hasbits, data, tagbytes, ceil_arg, \
-                      CARD_##card);                                          \
+                      CARD_##card, false);                                   \
+  }                                                                          \
+  const char* upb_p##card##g_##tagbytes##bt_max##size_ceil##b(               \
+      UPB_PARSE_PARAMS) {                                                    \
+    FASTDECODE_SUBMSG(d, ptr, msg, table, hasbits, data, tagbytes, ceil_arg, \
+                      CARD_##card, true);                                    \
   }
 
 #define SIZES(card, tagbytes) \
@@ -1014,4 +1155,187 @@ TAGBYTES(r)
 #undef F
 #undef FASTDECODE_SUBMSG
 
+/* map fields *****************************************************************/
+
+typedef union {
+  upb_StringView str;
+  uint32_t u32;
+  uint64_t u64;
+} fastdecode_mapval;
+
+// Parses the key or value of a map entry, which must lie entirely within
+// [ptr, end).  Only the canonical encoding is handled: the field must carry
+// the expected tag and a string must have a one-byte length.  Returns NULL for
+// anything else so that the caller can hand the entry to the generic parser.
+UPB_FORCEINLINE
+static const char* fastdecode_mapentryfield(const char* ptr, const char* end,
+                                            uint8_t tag, int size,
+                                            upb_StringView* str,
+                                            uint64_t* num) {
+  if (ptr == end || (uint8_t)*ptr != tag) return NULL;
+  ptr++;
+  if (size == UPB_MAPTYPE_STRING) {
+    if (ptr == end) return NULL;
+    int len = (int8_t)*ptr++;  // Negative if the length is >= 128.
+    if (len < 0 || end - ptr < len) return NULL;
+    str->data = ptr;
+    str->size = len;
+    return ptr + len;
+  }
+  *num = 0;
+  for (int i = 0; i < 10; i++) {
+    if (ptr == end) return NULL;
+    uint64_t byte = (uint8_t)*ptr++;
+    *num |= (byte & 0x7f) << (7 * i);
+    if (!(byte & 0x80)) return ptr;
+  }
+  return NULL;
+}
+
+UPB_FORCEINLINE
+static void fastdecode_setmapval(fastdecode_mapval* val, int size,
+                                 upb_StringView str, uint64_t num) {
+  switch (size) {
+    case 4:
+      val->u32 = (uint32_t)num;
+      break;
+    case 8:
+      val->u64 = num;
+      break;
+    default:
+      val->str = str;
+      break;
+  }
+}
+
+// Each map entry is a two-field message: the key is field 1 and the value is
+// field 2.  Entries that are long, cross a buffer boundary, or are not
+// encoded canonically go to the generic parser, which also gets to report
+// depth limit errors.
+#define FASTDECODE_MAPENTRY(d, ptr, msg, table, hasbits, data, tagbytes,      \
+                            ksize, kwiretype, kutf8, vsize, vwiretype, vutf8) \
+  upb_Map** map_p;                                                            \
+  upb_Map* map;                                                               \
+  upb_StringView kstr = {NULL, 0};                                            \
+  upb_StringView vstr = {NULL, 0};                                            \
+  uint64_t knum = 0;                                                          \
+  uint64_t vnum = 0;                                                          \
+  fastdecode_mapval key;                                                      \
+  fastdecode_mapval val;                                                      \
+                                                                              \
+  if (UPB_UNLIKELY(!fastdecode_checktag(data, tagbytes))) {                   \
+    RETURN_GENERIC("map field tag mismatch\n");                               \
+  }                                                                           \
+                                                                              \
+  if (UPB_UNLIKELY(d->depth <= 1)) {                                          \
+    RETURN_GENERIC("map entry at depth limit\n");                             \
+  }                                                                           \
+                                                                              \
+  const char* entry = ptr + tagbytes + 1;                                     \
+  int entry_size = (int8_t)ptr[tagbytes];                                     \
+  if (UPB_UNLIKELY(!upb_EpsCopyInputStream_CheckSubMessageSizeAvailable(      \
+          &d->input, entry, entry_size))) {                                   \
+    RETURN_GENERIC("map entry is long or not in the buffer\n");               \
+  }                                                                           \
+                                                                              \
+  const char* entry_end = entry + entry_size;                                 \
+  const char* p = fastdecode_mapentryfield(entry, entry_end,                  \
+                                           (1 << 3) | kwiretype, ksize,       \
+                                           &kstr, &knum);                     \
+  if (p) {                                                                    \
+    p = fastdecode_mapentryfield(p, entry_end, (2 << 3) | vwiretype, vsize,   \
+                                 &vstr, &vnum);                               \
+  }                                                                           \
+  if (UPB_UNLIKELY(p != entry_end)) {                                         \
+    RETURN_GENERIC("map entry is not canonical\n");                           \
+  }                                                                           \
+                                                                              \
+  if ((kutf8 && !_upb_Decoder_Utf8Ok(d, kstr.data, kstr.size)) ||             \
+      (vutf8 && !_upb_Decoder_Utf8Ok(d, vstr.data, vstr.size))) {             \
+    _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_BadUtf8);                  \
+  }                                                                           \
+                                                                              \
+  map_p = fastdecode_fieldmem(msg, data);                                     \
+  map = *map_p;                                                               \
+  if (UPB_UNLIKELY(!map)) {                                                   \
+    map = _upb_Map_New(&d->arena, ksize, vsize);                              \
+    if (!map) _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);    \
+    *map_p = map;                                                             \
+  }                                                                           \
+                                                                              \
+  /* The map copies the key, but a string value must outlive the input. */    \
+  if (vsize == UPB_MAPTYPE_STRING &&                                          \
+      !upb_EpsCopyInputStream_ReadString(&d->input, &vstr.data, vstr.size,    \
+                                         &d->arena)) {                        \
+    _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);              \
+  }                                                                           \
+                                                                              \
+  fastdecode_setmapval(&key, ksize, kstr, knum);                              \
+  fastdecode_setmapval(&val, vsize, vstr, vnum);                              \
+  if (_upb_Map_Insert(map, &key, ksize, &val, vsize, &d->arena) ==            \
+      kUpb_MapInsertStatus_OutOfMemory) {                                     \
+    _upb_FastDecoder_ErrorJmp(d, kUpb_DecodeStatus_OutOfMemory);              \
+  }                                                                           \
+                                                                              \
+  ptr = entry_end;                                                            \
+  UPB_MUSTTAIL return fastdecode_dispatch(UPB_PARSE_ARGS);
+
+/* Generate all combinations:
+ * {s,b,v4,v8} x {s,b,v4,v8} x {1bt,2bt} */
+
+#define s_MAPSIZE UPB_MAPTYPE_STRING
+#define b_MAPSIZE UPB_MAPTYPE_STRING
+#define v4_MAPSIZE 4
+#define v8_MAPSIZE 8
+
+#define s_MAPWIRETYPE kUpb_WireType_Delimited
+#define b_MAPWIRETYPE kUpb_WireType_Delimited
+#define v4_MAPWIRETYPE kUpb_WireType_Varint
+#define v8_MAPWIRETYPE kUpb_WireType_Varint
+
+#define s_MAPUTF8 true
+#define b_MAPUTF8 false
+#define v4_MAPUTF8 false
+#define v8_MAPUTF8 false
+
+#define F(ktype, vtype, tagbytes)                                         \
+  const char* upb_pM##ktype##vtype##_##tagbytes##bt(UPB_PARSE_PARAMS) {   \
+    FASTDECODE_MAPENTRY(d, ptr, msg, table, hasbits, data, tagbytes,      \
+                        ktype##_MAPSIZE, ktype##_MAPWIRETYPE,             \
+                        ktype##_MAPUTF8, vtype##_MAPSIZE,                 \
+                        vtype##_MAPWIRETYPE, vtype##_MAPUTF8);            \
+  }
+
+#define VALUES(ktype, tagbytes) \
+  F(ktype, s, tagbytes)         \
+  F(ktype, b, tagbytes)         \
+  F(ktype, v4, tagbytes)        \
+  F(ktype, v8, tagbytes)
+
+#define KEYS(tagbytes) \
+  VALUES(s, tagbytes)  \
+  VALUES(b, tagbytes)  \
+  VALUES(v4, tagbytes) \
+  VALUES(v8, tagbytes)
+
+KEYS(1)
+KEYS(2)
+
+#undef s_MAPSIZE
+#undef b_MAPSIZE
+#undef v4_MAPSIZE
+#undef v8_MAPSIZE
+#undef s_MAPWIRETYPE
+#undef b_MAPWIRETYPE
+#undef v4_MAPWIRETYPE
+#undef v8_MAPWIRETYPE
+#undef s_MAPUTF8
+#undef b_MAPUTF8
+#undef v4_MAPUTF8
+#undef v8_MAPUTF8
+#undef F
+#undef VALUES
+#undef KEYS
+#undef FASTDECODE_MAPENTRY
+
 #endif /* UPB_FASTTABLE */
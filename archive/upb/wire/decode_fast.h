@@ -45,16 +45,20 @@
 //   - 'o' for oneof
 //   - 'r' for non-packed repeated
 //   - 'p' for packed repeated
+//   - 'M' for map; position 3 then holds the key type followed by the value
+//     type, eg. upb_pMsv4_1bt() for map<string, int32>
 //
 // In position 3 (type):
 //   - 'b1' for bool
 //   - 'v4' for 4-byte varint
 //   - 'v8' for 8-byte varint
+//   - 'e4' for closed enum (4-byte varint checked against the enum's values)
 //   - 'z4' for zig-zag-encoded 4-byte varint
 //   - 'z8' for zig-zag-encoded 8-byte varint
 //   - 'f4' for 4-byte fixed
 //   - 'f8' for 8-byte fixed
 //   - 'm' for sub-message
+//   - 'g' for group
 //   - 's' for string (validate UTF-8)
 //   - 'b' for bytes
 //
@@ -114,6 +118,22 @@ TAGBYTES(p)
 #undef TYPES
 #undef TAGBYTES
 
+/* closed enum fields *********************************************************/
+
+#define F(card, tagbytes) \
+  const char* upb_p##card##e4_##tagbytes##bt(UPB_PARSE_PARAMS);
+
+#define TAGBYTES(card) \
+  F(card, 1)           \
+  F(card, 2)
+
+TAGBYTES(s)
+TAGBYTES(o)
+TAGBYTES(r)
+
+#undef F
+#undef TAGBYTES
+
 /* string fields **************************************************************/
 
 #define F(card, tagbytes, type)                                     \
@@ -135,10 +155,13 @@ TAGBYTES(r)
 #undef F
 #undef TAGBYTES
 
-/* sub-message fields *********************************************************/
+/* sub-message and group fields ***********************************************/
 
-#define F(card, tagbytes, size_ceil, ceil_arg) \
-  const char* upb_p##card##m_##tagbytes##bt_max##size_ceil##b(UPB_PARSE_PARAMS);
+#define F(card, tagbytes, size_ceil, ceil_arg)                 \
+  const char* upb_p##card##m_##tagbytes##bt_max##size_ceil##b( \
+      UPB_PARSE_PARAMS);                                       \
+  const char* upb_p##card##g_##tagbytes##bt_max##size_ceil##b( \
+      UPB_PARSE_PARAMS);
 
 #define SIZES(card, tagbytes) \
   F(card, tagbytes, 64, 64)   \
@@ -159,6 +182,30 @@ TAGBYTES(r)
 #undef SIZES
 #undef F
 
+/* map fields *****************************************************************/
+
+#define F(ktype, vtype, tagbytes) \
+  const char* upb_pM##ktype##vtype##_##tagbytes##bt(UPB_PARSE_PARAMS);
+
+#define VALUES(ktype, tagbytes) \
+  F(ktype, s, tagbytes)         \
+  F(ktype, b, tagbytes)         \
+  F(ktype, v4, tagbytes)        \
+  F(ktype, v8, tagbytes)
+
+#define KEYS(tagbytes) \
+  VALUES(s, tagbytes)  \
+  VALUES(b, tagbytes)  \
+  VALUES(v4, tagbytes) \
+  VALUES(v8, tagbytes)
+
+KEYS(1)
+KEYS(2)
+
+#undef KEYS
+#undef VALUES
+#undef F
+
 #undef UPB_PARSE_PARAMS
 
 #ifdef __cplusplus
@@ -38,44 +38,17 @@
 #include "upb/collections/internal/map_sorter.h"
 #include "upb/message/internal/accessors.h"
 #include "upb/message/internal/extension.h"
+#include "upb/mini_table/message.h"
 #include "upb/mini_table/sub.h"
 #include "upb/wire/internal/common.h"
+#include "upb/wire/internal/encode.h"
+#include "upb/wire/internal/field_selection.h"
+#include "upb/wire/internal/metrics.h"
 #include "upb/wire/internal/swap.h"
 
 // Must be last.
 #include "upb/port/def.inc"
 
-#define UPB_PB_VARINT_MAX_LEN 10
-
-UPB_NOINLINE
-static size_t encode_varint64(uint64_t val, char* buf) {
-  size_t i = 0;
-  do {
-    uint8_t byte = val & 0x7fU;
-    val >>= 7;
-    if (val) byte |= 0x80U;
-    buf[i++] = byte;
-  } while (val);
-  return i;
-}
-
-static uint32_t encode_zz32(int32_t n) {
-  return ((uint32_t)n << 1) ^ (n >> 31);
-}
-static uint64_t encode_zz64(int64_t n) {
-  return ((uint64_t)n << 1) ^ (n >> 63);
-}
-
-typedef struct {
-  upb_EncodeStatus status;
-  jmp_buf err;
-  upb_Arena* arena;
-  char *buf, *ptr, *limit;
-  int options;
-  int depth;
-  _upb_mapsorter sorter;
-} upb_encstate;
-
 static size_t upb_roundup_pow2(size_t bytes) {
   size_t ret = 128;
   while (ret < bytes) {
@@ -84,19 +57,63 @@ static size_t upb_roundup_pow2(size_t bytes) {
   return ret;
 }
 
-UPB_NORETURN static void encode_err(upb_encstate* e, upb_EncodeStatus s) {
+UPB_NORETURN void _upb_Encoder_Error(upb_encstate* e, upb_EncodeStatus s) {
   UPB_ASSERT(s != kUpb_EncodeStatus_Ok);
   e->status = s;
   UPB_LONGJMP(e->err, 1);
 }
 
+static void _upb_Encoder_PushSegment(upb_encstate* e, const char* data,
+                                     size_t size) {
+  if (e->segment_count == e->segment_capacity) {
+    size_t new_capacity = UPB_MAX(8, e->segment_capacity * 2);
+    upb_StringView* segments = upb_Arena_Realloc(
+        e->arena, e->segments, e->segment_capacity * sizeof(*segments),
+        new_capacity * sizeof(*segments));
+    if (!segments) _upb_Encoder_Error(e, kUpb_EncodeStatus_OutOfMemory);
+    e->segments = segments;
+    e->segment_capacity = new_capacity;
+  }
+  e->segments[e->segment_count++] = upb_StringView_FromDataAndSize(data, size);
+  e->segment_bytes += size;
+}
+
+// Finishes the bytes written since the last segment as a segment of their
+// own.  Later output goes in front of them in the same buffer.
+static void _upb_Encoder_CutSegment(upb_encstate* e) {
+  if (e->ptr == e->limit) return;
+  _upb_Encoder_PushSegment(e, e->ptr, e->limit - e->ptr);
+  e->limit = e->ptr;
+}
+
+// Starts a new buffer for upb_EncodeToSegments().  The old one becomes a
+// segment as is, so unlike a regular encode nothing is copied.
+static void _upb_Encoder_NewSegmentBuffer(upb_encstate* e, size_t bytes) {
+  size_t old_size = e->limit - e->buf;
+  _upb_Encoder_CutSegment(e);
+  size_t new_size = upb_roundup_pow2(UPB_MAX(bytes, old_size * 2));
+  char* new_buf = upb_Arena_Malloc(e->arena, new_size);
+  if (!new_buf) _upb_Encoder_Error(e, kUpb_EncodeStatus_OutOfMemory);
+  e->buf = new_buf;
+  e->limit = new_buf + new_size;
+  e->ptr = e->limit - bytes;
+}
+
 UPB_NOINLINE
-static void encode_growbuffer(upb_encstate* e, size_t bytes) {
+void _upb_Encoder_GrowBuffer(upb_encstate* e, size_t bytes) {
+  // A caller-provided buffer (upb_EncodeToBuffer()) cannot grow.
+  if (!e->arena) _upb_Encoder_Error(e, kUpb_EncodeStatus_NeedMoreSpace);
+
+  if (e->min_ref_size) {
+    _upb_Encoder_NewSegmentBuffer(e, bytes);
+    return;
+  }
+
   size_t old_size = e->limit - e->buf;
   size_t new_size = upb_roundup_pow2(bytes + (e->limit - e->ptr));
   char* new_buf = upb_Arena_Realloc(e->arena, e->buf, old_size, new_size);
 
-  if (!new_buf) encode_err(e, kUpb_EncodeStatus_OutOfMemory);
+  if (!new_buf) _upb_Encoder_Error(e, kUpb_EncodeStatus_OutOfMemory);
 
   // We want previous data at the end, realloc() put it at the beginning.
   // TODO(salo): This is somewhat inefficient since we are copying twice.
@@ -112,54 +129,34 @@ static void encode_growbuffer(upb_encstate* e, size_t bytes) {
   e->ptr -= bytes;
 }
 
-/* Call to ensure that at least "bytes" bytes are available for writing at
- * e->ptr.  Returns false if the bytes could not be allocated. */
-UPB_FORCEINLINE
-static void encode_reserve(upb_encstate* e, size_t bytes) {
-  if ((size_t)(e->ptr - e->buf) < bytes) {
-    encode_growbuffer(e, bytes);
-    return;
-  }
-
-  e->ptr -= bytes;
-}
-
-/* Writes the given bytes to the buffer, handling reserve/advance. */
-static void encode_bytes(upb_encstate* e, const void* data, size_t len) {
-  if (len == 0) return; /* memcpy() with zero size is UB */
-  encode_reserve(e, len);
-  memcpy(e->ptr, data, len);
-}
-
-static void encode_fixed64(upb_encstate* e, uint64_t val) {
-  val = _upb_BigEndian_Swap64(val);
-  encode_bytes(e, &val, sizeof(uint64_t));
-}
-
-static void encode_fixed32(upb_encstate* e, uint32_t val) {
-  val = _upb_BigEndian_Swap32(val);
-  encode_bytes(e, &val, sizeof(uint32_t));
-}
-
 UPB_NOINLINE
-static void encode_longvarint(upb_encstate* e, uint64_t val) {
+void _upb_Encoder_LongVarint(upb_encstate* e, uint64_t val) {
   size_t len;
   char* start;
 
-  encode_reserve(e, UPB_PB_VARINT_MAX_LEN);
-  len = encode_varint64(val, e->ptr);
-  start = e->ptr + UPB_PB_VARINT_MAX_LEN - len;
+  if ((size_t)(e->ptr - e->buf) < kUpb_WireWriter_MaxVarintSize) {
+    // Only reserve what the varint actually needs, so that output which
+    // exactly fills a fixed-size buffer still fits.
+    char tmp[kUpb_WireWriter_MaxVarintSize];
+    _upb_Encoder_Bytes(e, tmp, upb_WireWriter_EncodeVarint(val, tmp));
+    return;
+  }
+
+  _upb_Encoder_Reserve(e, kUpb_WireWriter_MaxVarintSize);
+  len = upb_WireWriter_EncodeVarint(val, e->ptr);
+  start = e->ptr + kUpb_WireWriter_MaxVarintSize - len;
   memmove(start, e->ptr, len);
   e->ptr = start;
 }
 
-UPB_FORCEINLINE
-static void encode_varint(upb_encstate* e, uint64_t val) {
-  if (val < 128 && e->ptr != e->buf) {
-    --e->ptr;
-    *e->ptr = val;
+// Writes the contents of a string or bytes field, by reference if it is large
+// enough (see upb_EncodeToSegments()).
+static void encode_string(upb_encstate* e, const char* data, size_t size) {
+  if (UPB_UNLIKELY(e->min_ref_size) && size >= e->min_ref_size) {
+    _upb_Encoder_CutSegment(e);
+    _upb_Encoder_PushSegment(e, data, size);
   } else {
-    encode_longvarint(e, val);
+    _upb_Encoder_Bytes(e, data, size);
   }
 }
 
@@ -167,19 +164,19 @@ static void encode_double(upb_encstate* e, double d) {
   uint64_t u64;
   UPB_ASSERT(sizeof(double) == sizeof(uint64_t));
   memcpy(&u64, &d, sizeof(uint64_t));
-  encode_fixed64(e, u64);
+  _upb_Encoder_Fixed64(e, u64);
 }
 
 static void encode_float(upb_encstate* e, float d) {
   uint32_t u32;
   UPB_ASSERT(sizeof(float) == sizeof(uint32_t));
   memcpy(&u32, &d, sizeof(uint32_t));
-  encode_fixed32(e, u32);
+  _upb_Encoder_Fixed32(e, u32);
 }
 
 static void encode_tag(upb_encstate* e, uint32_t field_number,
                        uint8_t wire_type) {
-  encode_varint(e, (field_number << 3) | wire_type);
+  _upb_Encoder_Varint(e, (field_number << 3) | wire_type);
 }
 
 static void encode_fixedarray(upb_encstate* e, const upb_Array* arr,
@@ -188,40 +185,45 @@ static void encode_fixedarray(upb_encstate* e, const upb_Array* arr,
   const char* data = _upb_array_constptr(arr);
   const char* ptr = data + bytes - elem_size;
 
-  if (tag || !_upb_IsLittleEndian()) {
+  if (tag) {
     while (true) {
       if (elem_size == 4) {
         uint32_t val;
         memcpy(&val, ptr, sizeof(val));
         val = _upb_BigEndian_Swap32(val);
-        encode_bytes(e, &val, elem_size);
+        _upb_Encoder_Bytes(e, &val, elem_size);
       } else {
         UPB_ASSERT(elem_size == 8);
         uint64_t val;
         memcpy(&val, ptr, sizeof(val));
         val = _upb_BigEndian_Swap64(val);
-        encode_bytes(e, &val, elem_size);
+        _upb_Encoder_Bytes(e, &val, elem_size);
       }
 
-      if (tag) encode_varint(e, tag);
+      if (tag) _upb_Encoder_Varint(e, tag);
       if (ptr == data) break;
       ptr -= elem_size;
     }
   } else {
-    encode_bytes(e, data, bytes);
+    _upb_Encoder_Bytes(e, data, bytes);
+    // Big-endian hosts convert the copied elements in one pass.
+    if (bytes == 0) return;
+    if (elem_size == 4) {
+      _upb_BigEndian_SwapArray32(e->ptr, arr->size);
+    } else {
+      UPB_ASSERT(elem_size == 8);
+      _upb_BigEndian_SwapArray64(e->ptr, arr->size);
+    }
   }
 }
 
-static void encode_message(upb_encstate* e, const upb_Message* msg,
-                           const upb_MiniTable* m, size_t* size);
-
 static void encode_TaggedMessagePtr(upb_encstate* e,
                                     upb_TaggedMessagePtr tagged,
                                     const upb_MiniTable* m, size_t* size) {
   if (upb_TaggedMessagePtr_IsEmpty(tagged)) {
     m = &_kUpb_MiniTable_Empty;
   }
-  encode_message(e, _upb_TaggedMessagePtr_GetMessage(tagged), m, size);
+  _upb_Encoder_Message(e, _upb_TaggedMessagePtr_GetMessage(tagged), m, size);
 }
 
 static void encode_scalar(upb_encstate* e, const void* _field_mem,
@@ -230,44 +232,46 @@ static void encode_scalar(upb_encstate* e, const void* _field_mem,
   const char* field_mem = _field_mem;
   int wire_type;
 
-#define CASE(ctype, type, wtype, encodeval) \
-  {                                         \
-    ctype val = *(ctype*)field_mem;         \
-    encode_##type(e, encodeval);            \
-    wire_type = wtype;                      \
-    break;                                  \
+#define CASE(ctype, encode, wtype, encodeval) \
+  {                                           \
+    ctype val = *(ctype*)field_mem;           \
+    encode(e, encodeval);                     \
+    wire_type = wtype;                        \
+    break;                                    \
   }
 
   switch (f->UPB_PRIVATE(descriptortype)) {
     case kUpb_FieldType_Double:
-      CASE(double, double, kUpb_WireType_64Bit, val);
+      CASE(double, encode_double, kUpb_WireType_64Bit, val);
     case kUpb_FieldType_Float:
-      CASE(float, float, kUpb_WireType_32Bit, val);
+      CASE(float, encode_float, kUpb_WireType_32Bit, val);
     case kUpb_FieldType_Int64:
     case kUpb_FieldType_UInt64:
-      CASE(uint64_t, varint, kUpb_WireType_Varint, val);
+      CASE(uint64_t, _upb_Encoder_Varint, kUpb_WireType_Varint, val);
     case kUpb_FieldType_UInt32:
-      CASE(uint32_t, varint, kUpb_WireType_Varint, val);
+      CASE(uint32_t, _upb_Encoder_Varint, kUpb_WireType_Varint, val);
     case kUpb_FieldType_Int32:
     case kUpb_FieldType_Enum:
-      CASE(int32_t, varint, kUpb_WireType_Varint, (int64_t)val);
+      CASE(int32_t, _upb_Encoder_Varint, kUpb_WireType_Varint, (int64_t)val);
     case kUpb_FieldType_SFixed64:
     case kUpb_FieldType_Fixed64:
-      CASE(uint64_t, fixed64, kUpb_WireType_64Bit, val);
+      CASE(uint64_t, _upb_Encoder_Fixed64, kUpb_WireType_64Bit, val);
     case kUpb_FieldType_Fixed32:
     case kUpb_FieldType_SFixed32:
-      CASE(uint32_t, fixed32, kUpb_WireType_32Bit, val);
+      CASE(uint32_t, _upb_Encoder_Fixed32, kUpb_WireType_32Bit, val);
     case kUpb_FieldType_Bool:
-      CASE(bool, varint, kUpb_WireType_Varint, val);
+      CASE(bool, _upb_Encoder_Varint, kUpb_WireType_Varint, val);
     case kUpb_FieldType_SInt32:
-      CASE(int32_t, varint, kUpb_WireType_Varint, encode_zz32(val));
+      CASE(int32_t, _upb_Encoder_Varint, kUpb_WireType_Varint,
+           upb_WireWriter_ZigZag32(val));
     case kUpb_FieldType_SInt64:
-      CASE(int64_t, varint, kUpb_WireType_Varint, encode_zz64(val));
+      CASE(int64_t, _upb_Encoder_Varint, kUpb_WireType_Varint,
+           upb_WireWriter_ZigZag64(val));
     case kUpb_FieldType_String:
     case kUpb_FieldType_Bytes: {
       upb_StringView view = *(upb_StringView*)field_mem;
-      encode_bytes(e, view.data, view.size);
-      encode_varint(e, view.size);
+      encode_string(e, view.data, view.size);
+      _upb_Encoder_Varint(e, view.size);
       wire_type = kUpb_WireType_Delimited;
       break;
     }
@@ -278,7 +282,9 @@ static void encode_scalar(upb_encstate* e, const void* _field_mem,
       if (submsg == 0) {
         return;
       }
-      if (--e->depth == 0) encode_err(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      if (--e->depth == 0) {
+        _upb_Encoder_Error(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
       encode_tag(e, f->number, kUpb_WireType_EndGroup);
       encode_TaggedMessagePtr(e, submsg, subm, &size);
       wire_type = kUpb_WireType_StartGroup;
@@ -292,9 +298,11 @@ static void encode_scalar(upb_encstate* e, const void* _field_mem,
       if (submsg == 0) {
         return;
       }
-      if (--e->depth == 0) encode_err(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      if (--e->depth == 0) {
+        _upb_Encoder_Error(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
       encode_TaggedMessagePtr(e, submsg, subm, &size);
-      encode_varint(e, size);
+      _upb_Encoder_Varint(e, size);
       wire_type = kUpb_WireType_Delimited;
       e->depth++;
       break;
@@ -311,22 +319,44 @@ static void encode_array(upb_encstate* e, const upb_Message* msg,
                          const upb_MiniTableSub* subs,
                          const upb_MiniTableField* f) {
   const upb_Array* arr = *UPB_PTR_AT(msg, f->offset, upb_Array*);
-  bool packed = f->mode & kUpb_LabelFlags_IsPacked;
-  size_t pre_len = e->limit - e->ptr;
+  bool packed = _upb_MiniTableField_IsPacked(f);
+  size_t pre_len = _upb_Encoder_Written(e);
 
   if (arr == NULL || arr->size == 0) {
     return;
   }
 
+// A packed array is sized up front, so that its varints can be written
+// front to back into a single reservation.
 #define VARINT_CASE(ctype, encode)                                       \
   {                                                                      \
     const ctype* start = _upb_array_constptr(arr);                       \
-    const ctype* ptr = start + arr->size;                                \
-    uint32_t tag = packed ? 0 : (f->number << 3) | kUpb_WireType_Varint; \
+    const ctype* end = start + arr->size;                                \
+    const ctype* ptr;                                                    \
+    if (packed) {                                                        \
+      size_t bytes = 0;                                                  \
+      for (ptr = start; ptr != end; ptr++) {                             \
+        bytes += _upb_Encode_VarintSizeBranchless(encode);               \
+      }                                                                  \
+      _upb_Encoder_Reserve(e, bytes);                                    \
+      char* out = e->ptr;                                                \
+      for (ptr = start; ptr != end; ptr++) {                             \
+        uint64_t val = encode;                                           \
+        if (val < 128) {                                                 \
+          *out++ = (char)val;                                            \
+        } else {                                                         \
+          out += upb_WireWriter_EncodeVarint(val, out);                  \
+        }                                                                \
+      }                                                                  \
+      UPB_ASSERT(out == e->ptr + bytes);                                 \
+      break;                                                             \
+    }                                                                    \
+    uint32_t tag = (f->number << 3) | kUpb_WireType_Varint;              \
+    ptr = end;                                                           \
     do {                                                                 \
       ptr--;                                                             \
-      encode_varint(e, encode);                                          \
-      if (tag) encode_varint(e, tag);                                    \
+      _upb_Encoder_Varint(e, encode);                                    \
+      _upb_Encoder_Varint(e, tag);                                       \
     } while (ptr != start);                                              \
   }                                                                      \
   break;
@@ -359,17 +389,17 @@ static void encode_array(upb_encstate* e, const upb_Message* msg,
     case kUpb_FieldType_Bool:
       VARINT_CASE(bool, *ptr);
     case kUpb_FieldType_SInt32:
-      VARINT_CASE(int32_t, encode_zz32(*ptr));
+      VARINT_CASE(int32_t, upb_WireWriter_ZigZag32(*ptr));
     case kUpb_FieldType_SInt64:
-      VARINT_CASE(int64_t, encode_zz64(*ptr));
+      VARINT_CASE(int64_t, upb_WireWriter_ZigZag64(*ptr));
     case kUpb_FieldType_String:
     case kUpb_FieldType_Bytes: {
       const upb_StringView* start = _upb_array_constptr(arr);
       const upb_StringView* ptr = start + arr->size;
       do {
         ptr--;
-        encode_bytes(e, ptr->data, ptr->size);
-        encode_varint(e, ptr->size);
+        encode_string(e, ptr->data, ptr->size);
+        _upb_Encoder_Varint(e, ptr->size);
         encode_tag(e, f->number, kUpb_WireType_Delimited);
       } while (ptr != start);
       return;
@@ -378,7 +408,9 @@ static void encode_array(upb_encstate* e, const upb_Message* msg,
       const upb_TaggedMessagePtr* start = _upb_array_constptr(arr);
       const upb_TaggedMessagePtr* ptr = start + arr->size;
       const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
-      if (--e->depth == 0) encode_err(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      if (--e->depth == 0) {
+        _upb_Encoder_Error(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
       do {
         size_t size;
         ptr--;
@@ -393,12 +425,27 @@ static void encode_array(upb_encstate* e, const upb_Message* msg,
       const upb_TaggedMessagePtr* start = _upb_array_constptr(arr);
       const upb_TaggedMessagePtr* ptr = start + arr->size;
       const upb_MiniTable* subm = subs[f->UPB_PRIVATE(submsg_index)].submsg;
-      if (--e->depth == 0) encode_err(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      if (--e->depth == 0) {
+        _upb_Encoder_Error(e, kUpb_EncodeStatus_MaxDepthExceeded);
+      }
+      if (_upb_Array_HasInlineMessages(arr)) {
+        size_t i = arr->size;
+        do {
+          size_t size;
+          i--;
+          _upb_Encoder_Message(e, _upb_Array_InlineMessage(arr, i), subm,
+                               &size);
+          _upb_Encoder_Varint(e, size);
+          encode_tag(e, f->number, kUpb_WireType_Delimited);
+        } while (i != 0);
+        e->depth++;
+        return;
+      }
       do {
         size_t size;
         ptr--;
         encode_TaggedMessagePtr(e, *ptr, subm, &size);
-        encode_varint(e, size);
+        _upb_Encoder_Varint(e, size);
         encode_tag(e, f->number, kUpb_WireType_Delimited);
       } while (ptr != start);
       e->depth++;
@@ -408,7 +455,7 @@ static void encode_array(upb_encstate* e, const upb_Message* msg,
 #undef VARINT_CASE
 
   if (packed) {
-    encode_varint(e, e->limit - e->ptr - pre_len);
+    _upb_Encoder_Varint(e, _upb_Encoder_Written(e) - pre_len);
     encode_tag(e, f->number, kUpb_WireType_Delimited);
   }
 }
@@ -418,12 +465,12 @@ static void encode_mapentry(upb_encstate* e, uint32_t number,
                             const upb_MapEntry* ent) {
   const upb_MiniTableField* key_field = &layout->fields[0];
   const upb_MiniTableField* val_field = &layout->fields[1];
-  size_t pre_len = e->limit - e->ptr;
+  size_t pre_len = _upb_Encoder_Written(e);
   size_t size;
   encode_scalar(e, &ent->data.v, layout->subs, val_field);
   encode_scalar(e, &ent->data.k, layout->subs, key_field);
-  size = (e->limit - e->ptr) - pre_len;
-  encode_varint(e, size);
+  size = _upb_Encoder_Written(e) - pre_len;
+  _upb_Encoder_Varint(e, size);
   encode_tag(e, number, kUpb_WireType_Delimited);
 }
 
@@ -447,59 +494,17 @@ static void encode_map(upb_encstate* e, const upb_Message* msg,
     }
     _upb_mapsorter_popmap(&e->sorter, &sorted);
   } else {
-    intptr_t iter = UPB_STRTABLE_BEGIN;
-    upb_StringView key;
-    upb_value val;
-    while (upb_strtable_next2(&map->table, &key, &val, &iter)) {
-      upb_MapEntry ent;
-      _upb_map_fromkey(key, &ent.data.k, map->key_size);
-      _upb_map_fromvalue(val, &ent.data.v, map->val_size);
+    size_t iter = kUpb_Map_Begin;
+    upb_MapEntry ent;
+    while (_upb_Map_Next(map, &ent.data.k, &ent.data.v, &iter)) {
       encode_mapentry(e, f->number, layout, &ent);
     }
   }
 }
 
-static bool encode_shouldencode(upb_encstate* e, const upb_Message* msg,
-                                const upb_MiniTableSub* subs,
-                                const upb_MiniTableField* f) {
-  if (f->presence == 0) {
-    /* Proto3 presence or map/array. */
-    const void* mem = UPB_PTR_AT(msg, f->offset, void);
-    switch (_upb_MiniTableField_GetRep(f)) {
-      case kUpb_FieldRep_1Byte: {
-        char ch;
-        memcpy(&ch, mem, 1);
-        return ch != 0;
-      }
-      case kUpb_FieldRep_4Byte: {
-        uint32_t u32;
-        memcpy(&u32, mem, 4);
-        return u32 != 0;
-      }
-      case kUpb_FieldRep_8Byte: {
-        uint64_t u64;
-        memcpy(&u64, mem, 8);
-        return u64 != 0;
-      }
-      case kUpb_FieldRep_StringView: {
-        const upb_StringView* str = (const upb_StringView*)mem;
-        return str->size != 0;
-      }
-      default:
-        UPB_UNREACHABLE();
-    }
-  } else if (f->presence > 0) {
-    /* Proto2 presence: hasbit. */
-    return _upb_hasbit_field(msg, f);
-  } else {
-    /* Field is in a oneof. */
-    return _upb_getoneofcase_field(msg, f) == f->number;
-  }
-}
-
-static void encode_field(upb_encstate* e, const upb_Message* msg,
-                         const upb_MiniTableSub* subs,
-                         const upb_MiniTableField* field) {
+void _upb_Encoder_Field(upb_encstate* e, const upb_Message* msg,
+                        const upb_MiniTableSub* subs,
+                        const upb_MiniTableField* field) {
   switch (upb_FieldMode_Get(field)) {
     case kUpb_FieldMode_Array:
       encode_array(e, msg, subs, field);
@@ -508,7 +513,8 @@ static void encode_field(upb_encstate* e, const upb_Message* msg,
       encode_map(e, msg, subs, field);
       break;
     case kUpb_FieldMode_Scalar:
-      encode_scalar(e, UPB_PTR_AT(msg, field->offset, void), subs, field);
+      encode_scalar(e, _upb_MiniTableField_GetConstPtr(msg, field), subs,
+                    field);
       break;
     default:
       UPB_UNREACHABLE();
@@ -519,10 +525,10 @@ static void encode_msgset_item(upb_encstate* e,
                                const upb_Message_Extension* ext) {
   size_t size;
   encode_tag(e, kUpb_MsgSet_Item, kUpb_WireType_EndGroup);
-  encode_message(e, ext->data.ptr, ext->ext->sub.submsg, &size);
-  encode_varint(e, size);
+  _upb_Encoder_Message(e, ext->data.ptr, ext->ext->sub.submsg, &size);
+  _upb_Encoder_Varint(e, size);
   encode_tag(e, kUpb_MsgSet_Message, kUpb_WireType_Delimited);
-  encode_varint(e, ext->ext->field.number);
+  _upb_Encoder_Varint(e, ext->ext->field.number);
   encode_tag(e, kUpb_MsgSet_TypeId, kUpb_WireType_Varint);
   encode_tag(e, kUpb_MsgSet_Item, kUpb_WireType_StartGroup);
 }
@@ -532,20 +538,18 @@ static void encode_ext(upb_encstate* e, const upb_Message_Extension* ext,
   if (UPB_UNLIKELY(is_message_set)) {
     encode_msgset_item(e, ext);
   } else {
-    encode_field(e, &ext->data, &ext->ext->sub, &ext->ext->field);
+    _upb_Encoder_Field(e, &ext->data, &ext->ext->sub, &ext->ext->field);
   }
 }
 
-static void encode_message(upb_encstate* e, const upb_Message* msg,
-                           const upb_MiniTable* m, size_t* size) {
-  size_t pre_len = e->limit - e->ptr;
-
+void _upb_Encoder_MessagePrologue(upb_encstate* e, const upb_Message* msg,
+                                  const upb_MiniTable* m) {
   if ((e->options & kUpb_EncodeOption_CheckRequired) && m->required_count) {
     uint64_t msg_head;
     memcpy(&msg_head, msg, 8);
     msg_head = _upb_BigEndian_Swap64(msg_head);
     if (upb_MiniTable_requiredmask(m) & ~msg_head) {
-      encode_err(e, kUpb_EncodeStatus_MissingRequired);
+      _upb_Encoder_Error(e, kUpb_EncodeStatus_MissingRequired);
     }
   }
 
@@ -554,7 +558,7 @@ static void encode_message(upb_encstate* e, const upb_Message* msg,
     const char* unknown = upb_Message_GetUnknown(msg, &unknown_size);
 
     if (unknown) {
-      encode_bytes(e, unknown, unknown_size);
+      _upb_Encoder_Bytes(e, unknown, unknown_size);
     }
   }
 
@@ -580,24 +584,225 @@ static void encode_message(upb_encstate* e, const upb_Message* msg,
       }
     }
   }
+}
+
+// Encodes `msg` without the fields in e->exclude.  Fields that are only
+// partly excluded are encoded with their sub-selection in e->exclude.
+UPB_NOINLINE
+static void _upb_Encoder_MessageExcluding(upb_encstate* e,
+                                          const upb_Message* msg,
+                                          const upb_MiniTable* m,
+                                          size_t* size) {
+  const upb_FieldSelection* exclude = e->exclude;
+  size_t pre_len = _upb_Encoder_Written(e);
+  UPB_ASSERT(exclude->mini_table == m);
+
+  // Extensions are never excluded.
+  e->exclude = NULL;
+  _upb_Encoder_MessagePrologue(e, msg, m);
+
+  for (size_t i = m->field_count; i-- > 0;) {
+    const upb_MiniTableField* f = &m->fields[i];
+    const upb_FieldSelection* sub = exclude->fields[i];
+    if (sub == &_upb_FieldSelection_All) continue;
+    if (_upb_Encode_ShouldEncode(msg, f)) {
+      e->exclude = sub;
+      _upb_Encoder_Field(e, msg, m->subs, f);
+    }
+  }
+
+  e->exclude = exclude;
+  *size = _upb_Encoder_Written(e) - pre_len;
+}
+
+static int _upb_Encoder_CountLeadingZeros(uint64_t x) {
+  UPB_ASSERT(x != 0);
+#ifdef __GNUC__
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  while ((x & (1ULL << 63)) == 0) {
+    x <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
 
-  if (m->field_count) {
+static int _upb_Encoder_CountTrailingZeros(uint64_t x) {
+  UPB_ASSERT(x != 0);
+#ifdef __GNUC__
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while ((x & 1) == 0) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+// Encodes the fields of `msg` in the same order as _upb_Encoder_Message(),
+// but uses m->presence_index to visit only the ones that are set.  For wide
+// messages with few fields set, this is much cheaper than testing every
+// field: the hasbits are scanned a word at a time.
+static void _upb_Encoder_IndexedFields(upb_encstate* e, const upb_Message* msg,
+                                       const upb_MiniTable* m) {
+  const uint16_t* index = m->presence_index;
+  const size_t hasbit_end = index[0];
+  const uint16_t* by_hasbit = &index[1];
+  const size_t other_count = index[1 + hasbit_end];
+  const uint16_t* others = &index[2 + hasbit_end];
+
+  // Positions in m->fields of the fields to encode.
+  uint64_t present[kUpb_MiniTable_MaxPresenceIndexedFields / 64];
+  const size_t words = (m->field_count + 63) / 64;
+  memset(present, 0, words * sizeof(*present));
+
+  const size_t hasbit_bytes = (hasbit_end + 7) / 8;
+  for (size_t ofs = 0; ofs < hasbit_bytes; ofs += 8) {
+    uint64_t bits = 0;
+    memcpy(&bits, (const char*)msg + ofs, UPB_MIN(hasbit_bytes - ofs, 8));
+    bits = _upb_BigEndian_Swap64(bits);
+    while (bits) {
+      size_t hasbit = ofs * 8 + _upb_Encoder_CountTrailingZeros(bits);
+      bits &= bits - 1;
+      // Hasbit 0 is never used.
+      if (hasbit == 0 || hasbit >= hasbit_end) continue;
+      size_t i = by_hasbit[hasbit];
+      present[i / 64] |= 1ULL << (i % 64);
+    }
+  }
+
+  for (size_t j = 0; j < other_count; j++) {
+    size_t i = others[j];
+    const upb_MiniTableField* f = &m->fields[i];
+    if (_upb_MiniTableField_InOneOf(f)) {
+      uint32_t number = _upb_getoneofcase_field(msg, f);
+      if (number == 0) continue;
+      if (number != f->number) {
+        f = upb_MiniTable_FindFieldByNumber(m, number);
+        i = f - m->fields;
+      }
+    } else if (!_upb_Encode_ShouldEncode(msg, f)) {
+      continue;
+    }
+    present[i / 64] |= 1ULL << (i % 64);
+  }
+
+  // We encode backwards, so the highest position goes first.
+  for (size_t w = words; w-- > 0;) {
+    uint64_t bits = present[w];
+    while (bits) {
+      int bit = 63 - _upb_Encoder_CountLeadingZeros(bits);
+      bits &= ~(1ULL << bit);
+      _upb_Encoder_Field(e, msg, m->subs, &m->fields[w * 64 + bit]);
+    }
+  }
+}
+
+static void _upb_Encoder_MessageUncached(upb_encstate* e,
+                                        const upb_Message* msg,
+                                        const upb_MiniTable* m,
+                                        size_t* size) {
+  size_t pre_len = _upb_Encoder_Written(e);
+
+  _upb_Encoder_MessagePrologue(e, msg, m);
+
+  if (m->presence_index) {
+    _upb_Encoder_IndexedFields(e, msg, m);
+  } else if (m->field_count) {
     const upb_MiniTableField* f = &m->fields[m->field_count];
     const upb_MiniTableField* first = &m->fields[0];
     while (f != first) {
       f--;
-      if (encode_shouldencode(e, msg, m->subs, f)) {
-        encode_field(e, msg, m->subs, f);
+      if (_upb_Encode_ShouldEncode(msg, f)) {
+        _upb_Encoder_Field(e, msg, m->subs, f);
       }
     }
   }
 
-  *size = (e->limit - e->ptr) - pre_len;
+  *size = _upb_Encoder_Written(e) - pre_len;
+}
+
+// Encodings smaller than this are cheaper to redo than to save.
+#define kUpb_Encoder_MinCachedSize 64
+
+// Encodes `msg` from its cache if it is still valid, and otherwise encodes it
+// and saves the result (see kUpb_EncodeOption_CacheEncodings).
+UPB_NOINLINE
+static void _upb_Encoder_CachedMessage(upb_encstate* e, const upb_Message* msg,
+                                       const upb_MiniTable* m, size_t* size) {
+  if (_upb_Message_IsFrozen(msg)) {
+    _upb_Encoder_MessageUncached(e, msg, m, size);
+    return;
+  }
+
+  upb_Message* mutable_msg = (upb_Message*)msg;
+  const upb_Message_InternalData* in = _upb_Message_GetInternalData(msg);
+  upb_Message_EncodeCache* cache = in ? in->encode_cache : NULL;
+
+  // The cache records the depth it was encoded with, so that using it cannot
+  // skip a depth check that encoding the message here would fail.
+  if (cache && !cache->dirty && cache->size && cache->options == e->options &&
+      cache->depth <= e->depth) {
+    cache->parent = e->cache_parent;
+    encode_string(e, cache->data, cache->size);
+    *size = cache->size;
+    return;
+  }
+
+  if (!cache) {
+    cache = upb_Arena_Malloc(e->arena, sizeof(*cache));
+    if (!cache) _upb_Encoder_Error(e, kUpb_EncodeStatus_OutOfMemory);
+    cache->data = NULL;
+    cache->capacity = 0;
+    cache->dirty = true;
+    if (!_upb_Message_SetEncodeCache(mutable_msg, cache, e->arena)) {
+      _upb_Encoder_Error(e, kUpb_EncodeStatus_OutOfMemory);
+    }
+  }
+
+  upb_Message* parent = e->cache_parent;
+  size_t segment_bytes = e->segment_bytes;
+  e->cache_parent = mutable_msg;
+  _upb_Encoder_MessageUncached(e, msg, m, size);
+  e->cache_parent = parent;
+
+  // With upb_EncodeToSegments() the encoding may not be contiguous.
+  cache->size = 0;
+  if (*size >= kUpb_Encoder_MinCachedSize && *size <= UINT32_MAX &&
+      e->segment_bytes == segment_bytes) {
+    if (*size > cache->capacity) {
+      cache->data = upb_Arena_Malloc(e->arena, *size);
+      if (!cache->data) _upb_Encoder_Error(e, kUpb_EncodeStatus_OutOfMemory);
+      cache->capacity = *size;
+    }
+    memcpy(cache->data, e->ptr, *size);
+    cache->size = *size;
+  }
+  cache->parent = parent;
+  cache->options = e->options;
+  cache->depth = e->depth;
+  cache->dirty = false;
+}
+
+void _upb_Encoder_Message(upb_encstate* e, const upb_Message* msg,
+                          const upb_MiniTable* m, size_t* size) {
+  if (UPB_UNLIKELY(e->exclude)) {
+    _upb_Encoder_MessageExcluding(e, msg, m, size);
+  } else if (UPB_UNLIKELY(e->options & kUpb_EncodeOption_CacheEncodings)) {
+    _upb_Encoder_CachedMessage(e, msg, m, size);
+  } else {
+    _upb_Encoder_MessageUncached(e, msg, m, size);
+  }
 }
 
 static upb_EncodeStatus upb_Encoder_Encode(upb_encstate* const encoder,
                                            const void* const msg,
                                            const upb_MiniTable* const l,
+                                           _upb_EncodeFunc* const fn,
                                            char** const buf,
                                            size_t* const size) {
   // Unfortunately we must continue to perform hackery here because there are
@@ -605,7 +810,11 @@ static upb_EncodeStatus upb_Encoder_Encode(upb_encstate* const encoder,
   // check for errors until much later (b/235839510). So we still set *buf to
   // NULL on error and we still set it to non-NULL on a successful empty result.
   if (UPB_SETJMP(encoder->err) == 0) {
-    encode_message(encoder, msg, l, size);
+    if (fn) {
+      fn(encoder, msg, size);
+    } else {
+      _upb_Encoder_Message(encoder, msg, l, size);
+    }
     *size = encoder->limit - encoder->ptr;
     if (*size == 0) {
       static char ch;
@@ -624,12 +833,18 @@ static upb_EncodeStatus upb_Encoder_Encode(upb_encstate* const encoder,
   return encoder->status;
 }
 
-upb_EncodeStatus upb_Encode(const void* msg, const upb_MiniTable* l,
-                            int options, upb_Arena* arena, char** buf,
-                            size_t* size) {
+// Encodes into a buffer allocated from `arena`, see upb_Encode() and its
+// variants for the parameters.
+static upb_EncodeStatus _upb_Encode_ToArena(
+    const void* msg, const upb_MiniTable* l, _upb_EncodeFunc* fn,
+    const upb_FieldSelection* exclude, int options, size_t size_hint,
+    upb_Arena* arena, char** buf, size_t* size) {
   upb_encstate e;
   unsigned depth = (unsigned)options >> 16;
 
+  // Neither of these keeps the encode cache up to date.
+  if (fn || exclude) options &= ~kUpb_EncodeOption_CacheEncodings;
+
   e.status = kUpb_EncodeStatus_Ok;
   e.arena = arena;
   e.buf = NULL;
@@ -637,7 +852,222 @@ upb_EncodeStatus upb_Encode(const void* msg, const upb_MiniTable* l,
   e.ptr = NULL;
   e.depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
   e.options = options;
+  e.exclude = exclude;
+  e.segments = NULL;
+  e.segment_count = 0;
+  e.segment_capacity = 0;
+  e.segment_bytes = 0;
+  e.min_ref_size = 0;
+  e.cache_parent = NULL;
   _upb_mapsorter_init(&e.sorter);
 
-  return upb_Encoder_Encode(&e, msg, l, buf, size);
+  if (size_hint) {
+    e.buf = upb_Arena_Malloc(arena, size_hint);
+    if (!e.buf) {
+      *buf = NULL;
+      *size = 0;
+      return kUpb_EncodeStatus_OutOfMemory;
+    }
+    e.limit = e.buf + size_hint;
+    e.ptr = e.limit;
+  }
+
+  return upb_Encoder_Encode(&e, msg, l, fn, buf, size);
+}
+
+upb_EncodeStatus _upb_Encode_WithFunc(const void* msg, const upb_MiniTable* l,
+                                      _upb_EncodeFunc* fn, int options,
+                                      upb_Arena* arena, char** buf,
+                                      size_t* size) {
+  return _upb_Encode_ToArena(msg, l, fn, NULL, options, 0, arena, buf, size);
+}
+
+upb_EncodeStatus upb_Encode(const void* msg, const upb_MiniTable* l,
+                            int options, upb_Arena* arena, char** buf,
+                            size_t* size) {
+  UPB_PROBE(encode_begin, l);
+  upb_EncodeStatus status =
+      _upb_Encode_WithFunc(msg, l, NULL, options, arena, buf, size);
+  UPB_PROBE(encode_end, l, *size, status);
+  upb_Metrics* metrics = _upb_Metrics_Active();
+  if (UPB_UNLIKELY(metrics)) {
+    _upb_Metrics_RecordEncode(metrics, l, *size,
+                              status == kUpb_EncodeStatus_Ok);
+  }
+  return status;
+}
+
+upb_EncodeStatus upb_EncodeWithSizeHint(const void* msg,
+                                        const upb_MiniTable* l, int options,
+                                        size_t size_hint, upb_Arena* arena,
+                                        char** buf, size_t* size) {
+  return _upb_Encode_ToArena(msg, l, NULL, NULL, options, size_hint, arena,
+                             buf, size);
+}
+
+upb_EncodeStatus upb_EncodeExcluding(const void* msg, const upb_MiniTable* l,
+                                     const upb_FieldSelection* exclude,
+                                     int options, upb_Arena* arena, char** buf,
+                                     size_t* size) {
+  UPB_ASSERT(exclude->mini_table == l);
+  return _upb_Encode_ToArena(msg, l, NULL, exclude, options, 0, arena, buf,
+                             size);
+}
+
+upb_EncodeStatus upb_EncodeToBuffer(const void* msg, const upb_MiniTable* l,
+                                    int options, char* buf, size_t cap,
+                                    size_t* len) {
+  upb_encstate e;
+  unsigned depth = (unsigned)options >> 16;
+  char* out;
+
+  e.status = kUpb_EncodeStatus_Ok;
+  e.arena = NULL;
+  e.buf = buf;
+  e.limit = buf ? buf + cap : NULL;
+  e.ptr = e.limit;
+  e.depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
+  // There is no arena to save encodings in.
+  e.options = options & ~kUpb_EncodeOption_CacheEncodings;
+  e.exclude = NULL;
+  e.segments = NULL;
+  e.segment_count = 0;
+  e.segment_capacity = 0;
+  e.segment_bytes = 0;
+  e.min_ref_size = 0;
+  e.cache_parent = NULL;
+  _upb_mapsorter_init(&e.sorter);
+
+  upb_EncodeStatus status = upb_Encoder_Encode(&e, msg, l, NULL, &out, len);
+
+  if (status == kUpb_EncodeStatus_NeedMoreSpace) {
+    status = upb_Message_ByteSize(msg, l, options, len);
+    return status == kUpb_EncodeStatus_Ok ? kUpb_EncodeStatus_NeedMoreSpace
+                                          : status;
+  }
+
+  // We encode backwards, so the output ends at buf + cap.
+  if (status == kUpb_EncodeStatus_Ok && *len && out != buf) {
+    memmove(buf, out, *len);
+  }
+  return status;
+}
+
+static void _upb_Encoder_InitForArena(upb_encstate* e, int options,
+                                      upb_Arena* arena) {
+  unsigned depth = (unsigned)options >> 16;
+  e->status = kUpb_EncodeStatus_Ok;
+  e->arena = arena;
+  e->buf = NULL;
+  e->limit = NULL;
+  e->ptr = NULL;
+  e->depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
+  e->options = options;
+  e->exclude = NULL;
+  e->segments = NULL;
+  e->segment_count = 0;
+  e->segment_capacity = 0;
+  e->segment_bytes = 0;
+  e->min_ref_size = 0;
+  e->cache_parent = NULL;
+  _upb_mapsorter_init(&e->sorter);
+}
+
+// Returns the output of a partial encode started with
+// _upb_Encoder_InitForArena().  Unlike upb_Encoder_Encode(), an empty output
+// may be NULL.
+static upb_EncodeStatus _upb_Encoder_FinishPart(upb_encstate* e, char** buf,
+                                                size_t* size) {
+  if (e->status == kUpb_EncodeStatus_Ok) {
+    *buf = e->ptr;
+    *size = e->limit - e->ptr;
+  } else {
+    *buf = NULL;
+    *size = 0;
+  }
+  _upb_mapsorter_destroy(&e->sorter);
+  return e->status;
+}
+
+upb_EncodeStatus _upb_Encode_FieldRange(const upb_Message* msg,
+                                        const upb_MiniTable* l, size_t begin,
+                                        size_t end, bool prologue, int options,
+                                        upb_Arena* arena, char** buf,
+                                        size_t* size) {
+  upb_encstate e;
+  // The pieces are encoded concurrently, so they must not touch the cache.
+  _upb_Encoder_InitForArena(&e, options & ~kUpb_EncodeOption_CacheEncodings,
+                            arena);
+
+  if (UPB_SETJMP(e.err) == 0) {
+    if (prologue) _upb_Encoder_MessagePrologue(&e, msg, l);
+    for (size_t i = end; i-- > begin;) {
+      const upb_MiniTableField* f = &l->fields[i];
+      if (_upb_Encode_ShouldEncode(msg, f)) {
+        _upb_Encoder_Field(&e, msg, l->subs, f);
+      }
+    }
+  }
+  return _upb_Encoder_FinishPart(&e, buf, size);
+}
+
+upb_EncodeStatus _upb_Encode_ArraySlice(const upb_Message* msg,
+                                        const upb_MiniTable* l,
+                                        const upb_MiniTableField* f,
+                                        size_t begin, size_t end, int options,
+                                        upb_Arena* arena, char** buf,
+                                        size_t* size) {
+  const upb_Array* arr = *UPB_PTR_AT(msg, f->offset, upb_Array*);
+  const upb_TaggedMessagePtr* elems = _upb_array_constptr(arr);
+  const upb_MiniTable* subm = l->subs[f->UPB_PRIVATE(submsg_index)].submsg;
+  upb_encstate e;
+  // The pieces are encoded concurrently, so they must not touch the cache.
+  _upb_Encoder_InitForArena(&e, options & ~kUpb_EncodeOption_CacheEncodings,
+                            arena);
+
+  if (UPB_SETJMP(e.err) == 0) {
+    // As in encode_array(), the depth is checked once for the whole array.
+    if (--e.depth == 0) {
+      _upb_Encoder_Error(&e, kUpb_EncodeStatus_MaxDepthExceeded);
+    }
+    for (size_t i = end; i-- > begin;) {
+      size_t elem_size;
+      encode_TaggedMessagePtr(&e, elems[i], subm, &elem_size);
+      _upb_Encoder_Varint(&e, elem_size);
+      encode_tag(&e, f->number, kUpb_WireType_Delimited);
+    }
+  }
+  return _upb_Encoder_FinishPart(&e, buf, size);
+}
+
+upb_EncodeStatus upb_EncodeToSegments(const void* msg, const upb_MiniTable* l,
+                                      int options, size_t min_ref_size,
+                                      upb_Arena* arena,
+                                      upb_StringView** segments,
+                                      size_t* count) {
+  UPB_ASSERT(min_ref_size > 0);
+  upb_encstate e;
+  size_t size;
+  _upb_Encoder_InitForArena(&e, options, arena);
+  e.min_ref_size = min_ref_size;
+
+  if (UPB_SETJMP(e.err) == 0) {
+    _upb_Encoder_Message(&e, msg, l, &size);
+    _upb_Encoder_CutSegment(&e);
+
+    // We encode backwards, so the segments were pushed last one first.
+    for (size_t i = 0; i < e.segment_count / 2; i++) {
+      size_t j = e.segment_count - 1 - i;
+      upb_StringView tmp = e.segments[i];
+      e.segments[i] = e.segments[j];
+      e.segments[j] = tmp;
+    }
+    *segments = e.segments;
+    *count = e.segment_count;
+  } else {
+    *segments = NULL;
+    *count = 0;
+  }
+  _upb_mapsorter_destroy(&e.sorter);
+  return e.status;
 }
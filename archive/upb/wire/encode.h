@@ -33,6 +33,7 @@
 #ifndef UPB_WIRE_ENCODE_H_
 #define UPB_WIRE_ENCODE_H_
 
+#include "upb/base/string_view.h"
 #include "upb/message/message.h"
 #include "upb/wire/types.h"
 
@@ -57,6 +58,23 @@ enum {
 
   // When set, the encode will fail if any required fields are missing.
   kUpb_EncodeOption_CheckRequired = 4,
+
+  // When set, the encoding of each message is saved in the message, and
+  // reused by the next encode with the same options unless the message or
+  // anything in it changed in between, so that re-encoding a large message
+  // after a small change only encodes the messages on the path to the change.
+  // The saved encodings are allocated from `arena`, which must live as long
+  // as the message, and the message must not be encoded by several threads
+  // at once.  Frozen messages are encoded without the cache.
+  //
+  // Changes made with the accessors in upb/message/accessors.h, the generated
+  // setters and upb_Decode() are tracked; changes made directly through a
+  // upb_Array* or upb_Map* are only seen if the array or map was fetched with
+  // a mutable accessor since the last encode.  A sub-message is only tracked
+  // in the last message it was encoded in, so it must not be shared between
+  // several parents.  Only upb_Encode(), upb_EncodeWithSizeHint() and
+  // upb_EncodeToSegments() use the cache; the other encoders ignore it.
+  kUpb_EncodeOption_CacheEncodings = 8,
 };
 
 typedef enum {
@@ -66,6 +84,12 @@ typedef enum {
 
   // kUpb_EncodeOption_CheckRequired failed but the parse otherwise succeeded.
   kUpb_EncodeStatus_MissingRequired = 3,
+
+  // The output stream failed (see upb_EncodeToStream()).
+  kUpb_EncodeStatus_WriteError = 4,
+
+  // The caller's buffer is too small (see upb_EncodeToBuffer()).
+  kUpb_EncodeStatus_NeedMoreSpace = 5,
 } upb_EncodeStatus;
 
 UPB_INLINE uint32_t upb_EncodeOptions_MaxDepth(uint16_t depth) {
@@ -87,6 +111,64 @@ UPB_API upb_EncodeStatus upb_Encode(const void* msg, const upb_MiniTable* l,
                                     int options, upb_Arena* arena, char** buf,
                                     size_t* size);
 
+// Like upb_Encode(), but starts with an output buffer of `size_hint` bytes.
+// The encoder writes backward and grows its buffer by doubling, copying what
+// it has written so far each time, so large outputs are cheaper to produce
+// with a good hint.  Useful hints are the size of the last message of the
+// same type, or the exact size from upb_Message_ByteSize().  A hint that is
+// too small only costs the usual growth, and one that is too large wastes
+// arena space in front of the output.
+UPB_API upb_EncodeStatus upb_EncodeWithSizeHint(const void* msg,
+                                                const upb_MiniTable* l,
+                                                int options, size_t size_hint,
+                                                upb_Arena* arena, char** buf,
+                                                size_t* size);
+
+// Declared in upb/wire/decode.h.
+struct upb_FieldSelection;
+
+// Like upb_Encode(), but leaves out the fields in `exclude` (see
+// upb_FieldSelection_AddPath()), which must have been created for `l`.  A
+// path to a message field drops the whole sub-message, and a longer path
+// drops only the named field inside it (inside every element, for a repeated
+// field).  This redacts fields without cloning and clearing the message.
+UPB_API upb_EncodeStatus upb_EncodeExcluding(
+    const void* msg, const upb_MiniTable* l,
+    const struct upb_FieldSelection* exclude, int options, upb_Arena* arena,
+    char** buf, size_t* size);
+
+// Like upb_Encode(), but writes the output to buf[0, *len) instead of
+// allocating it from an arena.  If the output does not fit in `cap` bytes,
+// returns kUpb_EncodeStatus_NeedMoreSpace and sets *len to the number of bytes
+// required; the contents of `buf` are then unspecified.  `buf` may be NULL if
+// `cap` is zero, which can be used to query the size.
+UPB_API upb_EncodeStatus upb_EncodeToBuffer(const void* msg,
+                                            const upb_MiniTable* l, int options,
+                                            char* buf, size_t cap, size_t* len);
+
+// Like upb_Encode(), but returns the output as a list of segments, suitable
+// for writev(), so that large string and bytes fields are not copied.  Every
+// string of at least `min_ref_size` (which must be nonzero) bytes becomes a
+// segment pointing at the field's own data, which must therefore stay alive
+// and unchanged for as long as the output is used.  Everything else is
+// written to buffers from `arena`, which are not copied as they grow either.
+// The segments are returned in order in `*segments` and `*count`, allocated
+// from `arena`; concatenated, they are the same bytes upb_Encode() produces.
+UPB_API upb_EncodeStatus upb_EncodeToSegments(const void* msg,
+                                              const upb_MiniTable* l,
+                                              int options, size_t min_ref_size,
+                                              upb_Arena* arena,
+                                              upb_StringView** segments,
+                                              size_t* count);
+
+// Computes the number of bytes upb_Encode() would produce for `msg` with the
+// same options, without encoding it.  Sizing never allocates, so this cannot
+// fail with kUpb_EncodeStatus_OutOfMemory; the required-field and depth
+// checks are the same as for upb_Encode().
+UPB_API upb_EncodeStatus upb_Message_ByteSize(const void* msg,
+                                              const upb_MiniTable* l,
+                                              int options, size_t* size);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
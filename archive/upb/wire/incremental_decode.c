@@ -0,0 +1,308 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/incremental_decode.h"
+
+#include <string.h>
+
+#include "upb/wire/internal/decode.h"
+#include "upb/wire/types.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+struct upb_IncrementalDecoder {
+  upb_Message* msg;
+  const upb_MiniTable* mini_table;
+  const upb_ExtensionRegistry* extreg;
+  upb_Arena* arena;
+  int options;
+  int max_depth;
+  upb_DecodeStatus status;
+
+  // A partial top-level field carried over from a previous chunk.
+  char* carry;
+  size_t carry_size;
+  size_t carry_capacity;
+
+  // Where scanning of the carried field resumes: the offset of the first
+  // element of a group not yet known to be complete, and the group depth
+  // there.  Both are 0 when the scan must start from the beginning.
+  size_t scan_offset;
+  int scan_depth;
+};
+
+typedef enum {
+  kUpb_FieldScan_Complete,
+  kUpb_FieldScan_Incomplete,
+  kUpb_FieldScan_Malformed,
+} upb_FieldScanResult;
+
+static upb_FieldScanResult upb_IncrementalDecoder_VarintResult(
+    const char* ptr, const char* end) {
+  return end - ptr >= 10 ? kUpb_FieldScan_Malformed
+                         : kUpb_FieldScan_Incomplete;
+}
+
+// Finds the end of the top-level field that starts at `start`, resuming
+// `*scan_offset` bytes in at group depth `*scan_depth`.  If the field is
+// complete, stores its size in `*size` and resets the scan state to 0.  If it
+// is incomplete, stores the total size of the field in `*need` if that is known
+// yet, or 0 otherwise, and leaves the scan state at the element where scanning
+// stopped, so that a group that arrives in many chunks is only scanned once.
+//
+// Only the framing is checked here; the field contents are validated when the
+// field is decoded.
+static upb_FieldScanResult upb_IncrementalDecoder_ScanField(
+    const upb_IncrementalDecoder* d, const char* start, const char* end,
+    size_t* scan_offset, int* scan_depth, size_t* size, size_t* need) {
+  const char* ptr = start + *scan_offset;
+  int depth = *scan_depth;
+  *need = 0;
+
+  do {
+    uint64_t tag;
+    uint64_t val;
+    *scan_offset = ptr - start;
+    *scan_depth = depth;
+    const char* p = _upb_Decoder_ScanVarint(ptr, end, &tag);
+    if (!p) return upb_IncrementalDecoder_VarintResult(ptr, end);
+    if (tag > UINT32_MAX) return kUpb_FieldScan_Malformed;
+    ptr = p;
+
+    switch (tag & 7) {
+      case kUpb_WireType_Varint:
+        p = _upb_Decoder_ScanVarint(ptr, end, &val);
+        if (!p) return upb_IncrementalDecoder_VarintResult(ptr, end);
+        ptr = p;
+        break;
+      case kUpb_WireType_64Bit:
+      case kUpb_WireType_32Bit: {
+        size_t n = (tag & 7) == kUpb_WireType_64Bit ? 8 : 4;
+        if ((size_t)(end - ptr) < n) {
+          if (depth == 0) *need = (ptr - start) + n;
+          return kUpb_FieldScan_Incomplete;
+        }
+        ptr += n;
+        break;
+      }
+      case kUpb_WireType_Delimited:
+        p = _upb_Decoder_ScanVarint(ptr, end, &val);
+        if (!p) return upb_IncrementalDecoder_VarintResult(ptr, end);
+        if (val > INT32_MAX) return kUpb_FieldScan_Malformed;
+        ptr = p;
+        if ((uint64_t)(end - ptr) < val) {
+          if (depth == 0) *need = (ptr - start) + val;
+          return kUpb_FieldScan_Incomplete;
+        }
+        ptr += val;
+        break;
+      case kUpb_WireType_StartGroup:
+        if (++depth > d->max_depth) return kUpb_FieldScan_Malformed;
+        break;
+      case kUpb_WireType_EndGroup:
+        if (depth-- == 0) return kUpb_FieldScan_Malformed;
+        break;
+      default:
+        return kUpb_FieldScan_Malformed;
+    }
+  } while (depth > 0);
+
+  *size = ptr - start;
+  *scan_offset = 0;
+  *scan_depth = 0;
+  return kUpb_FieldScan_Complete;
+}
+
+static bool upb_IncrementalDecoder_Append(upb_IncrementalDecoder* d,
+                                          const char* buf, size_t size,
+                                          size_t need) {
+  size_t min_capacity = UPB_MAX(d->carry_size + size, need);
+  if (d->carry_capacity < min_capacity) {
+    size_t new_capacity = UPB_MAX(d->carry_capacity * 2, 64);
+    new_capacity = UPB_MAX(new_capacity, min_capacity);
+    char* carry = upb_Arena_Realloc(d->arena, d->carry, d->carry_capacity,
+                                    new_capacity);
+    if (!carry) return false;
+    d->carry = carry;
+    d->carry_capacity = new_capacity;
+  }
+  memcpy(d->carry + d->carry_size, buf, size);
+  d->carry_size += size;
+  return true;
+}
+
+static upb_DecodeStatus upb_IncrementalDecoder_Decode(upb_IncrementalDecoder* d,
+                                                      const char* buf,
+                                                      size_t size) {
+  if (size == 0) return kUpb_DecodeStatus_Ok;
+  // Required fields can only be checked once the whole message has been seen.
+  int options = d->options & ~kUpb_DecodeOption_CheckRequired;
+  return upb_Decode(buf, size, d->msg, d->mini_table, d->extreg, options,
+                    d->arena);
+}
+
+static void upb_IncrementalDecoder_Init(upb_IncrementalDecoder* d,
+                                        upb_Message* msg,
+                                        const upb_MiniTable* l,
+                                        const upb_ExtensionRegistry* extreg,
+                                        int options, upb_Arena* arena) {
+  int depth = upb_DecodeOptions_GetMaxDepth(options);
+  d->msg = msg;
+  d->mini_table = l;
+  d->extreg = extreg;
+  d->arena = arena;
+  d->options = options;
+  d->max_depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
+  d->status = kUpb_DecodeStatus_Ok;
+  d->carry = NULL;
+  d->carry_size = 0;
+  d->carry_capacity = 0;
+  d->scan_offset = 0;
+  d->scan_depth = 0;
+}
+
+upb_IncrementalDecoder* upb_IncrementalDecoder_New(
+    upb_Message* msg, const upb_MiniTable* l,
+    const upb_ExtensionRegistry* extreg, int options, upb_Arena* arena) {
+  upb_IncrementalDecoder* d = upb_Arena_Malloc(arena, sizeof(*d));
+  if (!d) return NULL;
+  upb_IncrementalDecoder_Init(d, msg, l, extreg, options, arena);
+  return d;
+}
+
+upb_DecodeStatus upb_IncrementalDecoder_Feed(upb_IncrementalDecoder* d,
+                                             const char* buf, size_t size) {
+  if (d->status != kUpb_DecodeStatus_Ok &&
+      d->status != kUpb_DecodeStatus_NeedMoreData) {
+    return d->status;
+  }
+
+  const char* ptr = buf;
+  const char* end = buf + size;
+
+  // First complete the field carried over from the previous chunk, copying
+  // only as much of this chunk as the field needs.
+  while (d->carry_size) {
+    size_t field_size;
+    size_t need;
+    switch (upb_IncrementalDecoder_ScanField(
+        d, d->carry, d->carry + d->carry_size, &d->scan_offset, &d->scan_depth,
+        &field_size, &need)) {
+      case kUpb_FieldScan_Malformed:
+        return d->status = kUpb_DecodeStatus_Malformed;
+      case kUpb_FieldScan_Complete: {
+        // Any bytes past the end of the field came from this chunk.
+        ptr -= d->carry_size - field_size;
+        d->carry_size = 0;
+        upb_DecodeStatus status =
+            upb_IncrementalDecoder_Decode(d, d->carry, field_size);
+        if (d->options & kUpb_DecodeOption_AliasString) {
+          // The message may point into the carry buffer, so it cannot be
+          // reused for the next field.
+          d->carry = NULL;
+          d->carry_capacity = 0;
+        }
+        if (status != kUpb_DecodeStatus_Ok) return d->status = status;
+        break;
+      }
+      case kUpb_FieldScan_Incomplete: {
+        if (ptr == end) return d->status = kUpb_DecodeStatus_NeedMoreData;
+        size_t n = need ? need - d->carry_size : UPB_MAX(d->carry_size, 16);
+        n = UPB_MIN(n, (size_t)(end - ptr));
+        if (!upb_IncrementalDecoder_Append(d, ptr, n, need)) {
+          return d->status = kUpb_DecodeStatus_OutOfMemory;
+        }
+        ptr += n;
+        break;
+      }
+    }
+  }
+
+  // Decode all of the complete fields in this chunk without copying them.  The
+  // scan state of an incomplete last field carries over along with its data.
+  const char* start = ptr;
+  while (ptr < end) {
+    size_t field_size;
+    size_t need;
+    upb_FieldScanResult result = upb_IncrementalDecoder_ScanField(
+        d, ptr, end, &d->scan_offset, &d->scan_depth, &field_size, &need);
+    if (result == kUpb_FieldScan_Malformed) {
+      return d->status = kUpb_DecodeStatus_Malformed;
+    }
+    if (result == kUpb_FieldScan_Incomplete) {
+      if (!upb_IncrementalDecoder_Append(d, ptr, end - ptr, need)) {
+        return d->status = kUpb_DecodeStatus_OutOfMemory;
+      }
+      break;
+    }
+    ptr += field_size;
+  }
+
+  upb_DecodeStatus status =
+      upb_IncrementalDecoder_Decode(d, start, ptr - start);
+  if (status != kUpb_DecodeStatus_Ok) return d->status = status;
+  return d->status = d->carry_size ? kUpb_DecodeStatus_NeedMoreData
+                                   : kUpb_DecodeStatus_Ok;
+}
+
+upb_DecodeStatus upb_IncrementalDecoder_Finish(upb_IncrementalDecoder* d) {
+  if (d->status == kUpb_DecodeStatus_NeedMoreData) {
+    return d->status = kUpb_DecodeStatus_Malformed;
+  }
+  if (d->status != kUpb_DecodeStatus_Ok) return d->status;
+  if (d->options & kUpb_DecodeOption_CheckRequired) {
+    // An empty parse only performs the required field check.
+    d->status = upb_Decode(NULL, 0, d->msg, d->mini_table, d->extreg,
+                           d->options, d->arena);
+  }
+  return d->status;
+}
+
+upb_DecodeStatus upb_DecodeIovec(const upb_StringView* segments, size_t count,
+                                 upb_Message* msg, const upb_MiniTable* l,
+                                 const upb_ExtensionRegistry* extreg,
+                                 int options, upb_Arena* arena) {
+  if (count == 1) {
+    return upb_Decode(segments[0].data, segments[0].size, msg, l, extreg,
+                      options, arena);
+  }
+  upb_IncrementalDecoder d;
+  upb_IncrementalDecoder_Init(&d, msg, l, extreg, options, arena);
+  for (size_t i = 0; i < count; i++) {
+    upb_DecodeStatus status =
+        upb_IncrementalDecoder_Feed(&d, segments[i].data, segments[i].size);
+    if (status != kUpb_DecodeStatus_Ok &&
+        status != kUpb_DecodeStatus_NeedMoreData) {
+      return status;
+    }
+  }
+  return upb_IncrementalDecoder_Finish(&d);
+}
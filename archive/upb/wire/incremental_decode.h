@@ -0,0 +1,103 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// An incremental decoder that accepts the serialized message in chunks, as
+// they arrive from the network, without first reassembling them into one
+// contiguous buffer.
+//
+// The decoder parses every top-level field that is complete in a chunk
+// directly from that chunk.  Only a top-level field that straddles a chunk
+// boundary is copied, so that it can be decoded once the rest of it arrives.
+// Since a sub-message is a single top-level field, a large sub-message that
+// spans several chunks is still copied in full.
+
+#ifndef UPB_WIRE_INCREMENTAL_DECODE_H_
+#define UPB_WIRE_INCREMENTAL_DECODE_H_
+
+#include "upb/base/string_view.h"
+#include "upb/mem/arena.h"
+#include "upb/message/message.h"
+#include "upb/mini_table/extension_registry.h"
+#include "upb/wire/decode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct upb_IncrementalDecoder upb_IncrementalDecoder;
+
+// Creates a decoder that will parse into `msg`, with the same meaning for the
+// other arguments as for upb_Decode().  Returns NULL if allocation fails.
+//
+// If kUpb_DecodeOption_AliasString is set, every chunk passed to
+// upb_IncrementalDecoder_Feed() must outlive the message data.
+UPB_API upb_IncrementalDecoder* upb_IncrementalDecoder_New(
+    upb_Message* msg, const upb_MiniTable* l,
+    const upb_ExtensionRegistry* extreg, int options, upb_Arena* arena);
+
+// Decodes the next `size` bytes of input.  Returns kUpb_DecodeStatus_Ok if
+// the input ended at a field boundary, kUpb_DecodeStatus_NeedMoreData if it
+// ended in the middle of a field, or an error.  Errors are permanent: all
+// subsequent calls will return the same status.
+UPB_API upb_DecodeStatus upb_IncrementalDecoder_Feed(upb_IncrementalDecoder* d,
+                                                     const char* buf,
+                                                     size_t size);
+
+// Signals the end of the input.  Returns kUpb_DecodeStatus_Malformed if the
+// input ended in the middle of a field, and otherwise the final status of the
+// parse (including the kUpb_DecodeOption_CheckRequired check, if requested).
+UPB_API upb_DecodeStatus upb_IncrementalDecoder_Finish(
+    upb_IncrementalDecoder* d);
+
+// Decodes a message whose serialized form is split across `count` segments,
+// such as the buffers of a scatter-gather read, without first copying them
+// into one contiguous buffer.  The arguments after `count` have the same
+// meaning as for upb_Decode().
+//
+// Fields are decoded directly from the segment that holds them, aliasing it
+// with kUpb_DecodeOption_AliasString, so every segment must then outlive the
+// message.  Only a top-level field that straddles a segment boundary is
+// copied (in full; see above) into a buffer allocated from `arena`.
+UPB_API upb_DecodeStatus upb_DecodeIovec(const upb_StringView* segments,
+                                         size_t count, upb_Message* msg,
+                                         const upb_MiniTable* l,
+                                         const upb_ExtensionRegistry* extreg,
+                                         int options, upb_Arena* arena);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_WIRE_INCREMENTAL_DECODE_H_ */
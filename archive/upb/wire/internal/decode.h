@@ -36,29 +36,73 @@
 #ifndef UPB_WIRE_INTERNAL_DECODE_H_
 #define UPB_WIRE_INTERNAL_DECODE_H_
 
+#include "upb/lex/utf8.h"
 #include "upb/mem/internal/arena.h"
 #include "upb/message/internal/message.h"
+#include "upb/mini_table/internal/extension_registry.h"
 #include "upb/wire/decode.h"
 #include "upb/wire/eps_copy_input_stream.h"
-#include "utf8_range.h"
 
 // Must be last.
 #include "upb/port/def.inc"
 
 #define DECODE_NOGROUP (uint32_t) - 1
 
+// Preallocated messages of a single type, see
+// kUpb_DecodeOption_BulkSubMessages.
+typedef struct {
+  const upb_MiniTable* mini_table;  // NULL if unused.
+  char* ptr;                        // Next free message, including its header.
+  uint32_t count;                   // Messages left at `ptr`.
+  uint32_t next_size;               // Size of the next slab, in messages.
+} upb_Decoder_Slab;
+
+#define kUpb_Decoder_SlabCount 4
+
 typedef struct upb_Decoder {
   upb_EpsCopyInputStream input;
   const upb_ExtensionRegistry* extreg;
+  // The extendee of the last extension lookup and its registered extensions,
+  // so repeated extensions of one message skip the registry's hash lookup.
+  const upb_MiniTable* extreg_extendee;  // NULL if no lookup yet.
+  const upb_ExtensionRegistryEntry* extreg_entry;
+  uint32_t extreg_hint;  // Index to try first in `extreg_entry`.
   const char* unknown;       // Start of unknown data, preserve at buffer flip
   upb_Message* unknown_msg;  // Pointer to preserve data to
   int depth;                 // Tracks recursion depth to bound stack usage.
   uint32_t end_group;  // field number of END_GROUP tag, else DECODE_NOGROUP.
   uint16_t options;
   bool missing_required;
+  // Fields to decode in the current message, or NULL for all of them.
+  const struct upb_FieldSelection* selection;
+  struct upb_DecodeStats* stats;  // Statistics to gather, or NULL.
+  upb_Arena* stats_arena;         // Where to allocate new statistics.
+  // For upb_Metrics: unknown field bytes stored, and calls to
+  // _upb_FastDecoder_DecodeGeneric().
+  size_t unknown_bytes;
+  uint32_t generic_fallbacks;
+  // Slabs for repeated sub-messages, only initialized with
+  // kUpb_DecodeOption_BulkSubMessages.
+  upb_Decoder_Slab slabs[kUpb_Decoder_SlabCount];
+  // The saved messages of kUpb_DecodeOption_ExplicitStack, and the sub-message
+  // that the last field asks to enter, if any.
+  struct _upb_Decoder_Frame* frames;
+  uint32_t frame_count;
+  uint32_t frame_capacity;
+  upb_Message* push_msg;
+  const upb_MiniTable* push_layout;
+  int push_size;
+  // The strings of kUpb_DecodeOption_InternStrings, an open-addressed hash
+  // set with `intern_mask + 1` slots, or NULL before the first string.
+  upb_StringView* intern;
+  uint32_t intern_mask;
+  uint32_t intern_count;
+#if UPB_FASTTABLE_TRAMPOLINE
+  bool fast_resume;  // Set by a fast parser that wants the next field parsed.
+#endif
   upb_Arena arena;
   upb_DecodeStatus status;
-  jmp_buf err;
+  UPB_FAST_JMP_BUF(err);
 
 #ifndef NDEBUG
   const char* debug_tagstart;
@@ -81,6 +125,9 @@ UPB_INLINE
 bool _upb_Decoder_VerifyUtf8Inline(const char* ptr, int len) {
   const char* end = ptr + len;
 
+  // Long strings are faster to check in wide blocks from the start.
+  if (len >= 64) return upb_Utf8_IsValid(ptr, len);
+
   // Check 8 bytes at a time for any non-ASCII char.
   while (end - ptr >= 8) {
     uint64_t data;
@@ -98,13 +145,34 @@ bool _upb_Decoder_VerifyUtf8Inline(const char* ptr, int len) {
   return true;
 
 non_ascii:
-  return utf8_range2((const unsigned char*)ptr, end - ptr) == 0;
+  return upb_Utf8_IsValid(ptr, end - ptr);
+}
+
+// Like _upb_Decoder_VerifyUtf8Inline(), but any string passes with
+// kUpb_DecodeOption_DeferUtf8Validation.
+UPB_INLINE
+bool _upb_Decoder_Utf8Ok(const upb_Decoder* d, const char* ptr, int len) {
+  return (d->options & kUpb_DecodeOption_DeferUtf8Validation) ||
+         _upb_Decoder_VerifyUtf8Inline(ptr, len);
 }
 
 const char* _upb_Decoder_CheckRequired(upb_Decoder* d, const char* ptr,
                                        const upb_Message* msg,
                                        const upb_MiniTable* l);
 
+// Prefetches the arena memory that the next allocation will take, after one
+// that may have moved the decoder into a fresh part of its block (see
+// UPB_ENABLE_DECODE_PREFETCH).
+UPB_INLINE void _upb_Decoder_PrefetchArena(upb_Decoder* d) {
+#if UPB_DECODE_PREFETCH
+  const char* next = d->arena.head.ptr;
+  UPB_PREFETCH_WRITE(next);
+  UPB_PREFETCH_WRITE(next + 64);
+#else
+  UPB_UNUSED(d);
+#endif
+}
+
 /* x86-64 pointers always have the high 16 bits matching. So we can shift
  * left 8 and right 8 without loss of information. */
 UPB_INLINE intptr_t decode_totable(const upb_MiniTable* tablep) {
@@ -138,11 +206,17 @@ UPB_INLINE const char* _upb_Decoder_BufferFlipCallback(
   return new_start;
 }
 
+UPB_INLINE uint32_t _upb_FastDecoder_LoadTag(const char* ptr) {
+  uint16_t tag;
+  memcpy(&tag, ptr, 2);
+  return tag;
+}
+
 #if UPB_FASTTABLE
 UPB_INLINE
-const char* _upb_FastDecoder_TagDispatch(upb_Decoder* d, const char* ptr,
-                                         upb_Message* msg, intptr_t table,
-                                         uint64_t hasbits, uint64_t tag) {
+const char* _upb_FastDecoder_CallParser(upb_Decoder* d, const char* ptr,
+                                        upb_Message* msg, intptr_t table,
+                                        uint64_t hasbits, uint64_t tag) {
   const upb_MiniTable* table_p = decode_totablep(table);
   uint8_t mask = table;
   uint64_t data;
@@ -153,12 +227,61 @@ const char* _upb_FastDecoder_TagDispatch(upb_Decoder* d, const char* ptr,
   UPB_MUSTTAIL return table_p->fasttable[idx].field_parser(d, ptr, msg, table,
                                                            hasbits, data);
 }
+
+// Continues fast decoding with the field whose tag is `tag`.  Fast parsers
+// call this once they are done with their own field.
+UPB_INLINE
+const char* _upb_FastDecoder_TagDispatch(upb_Decoder* d, const char* ptr,
+                                         upb_Message* msg, intptr_t table,
+                                         uint64_t hasbits, uint64_t tag) {
+#if UPB_FASTTABLE_TRAMPOLINE
+  // Unwind to the loop in _upb_FastDecoder_Decode(), which will reload the
+  // tag and call the next parser.
+  (void)table;
+  (void)tag;
+  *(uint32_t*)msg |= hasbits;  // Sync hasbits.
+  d->fast_resume = true;
+  return ptr;
+#else
+  UPB_MUSTTAIL return _upb_FastDecoder_CallParser(d, ptr, msg, table, hasbits,
+                                                  tag);
 #endif
+}
 
-UPB_INLINE uint32_t _upb_FastDecoder_LoadTag(const char* ptr) {
-  uint16_t tag;
-  memcpy(&tag, ptr, 2);
-  return tag;
+// Fast decodes `msg` starting with the field whose tag is `tag`, returning
+// when the message is done.
+UPB_INLINE
+const char* _upb_FastDecoder_Decode(upb_Decoder* d, const char* ptr,
+                                    upb_Message* msg, intptr_t table,
+                                    uint64_t hasbits, uint64_t tag) {
+#if UPB_FASTTABLE_TRAMPOLINE
+  for (;;) {
+    d->fast_resume = false;
+    ptr = _upb_FastDecoder_CallParser(d, ptr, msg, table, hasbits, tag);
+    if (!d->fast_resume) return ptr;
+    hasbits = 0;
+    tag = _upb_FastDecoder_LoadTag(ptr);
+  }
+#else
+  return _upb_FastDecoder_CallParser(d, ptr, msg, table, hasbits, tag);
+#endif
+}
+#endif
+
+// Reads a varint from [ptr, end) without relying on slop bytes, returning NULL
+// if the varint is malformed or not entirely before `end`.
+UPB_INLINE const char* _upb_Decoder_ScanVarint(const char* ptr,
+                                               const char* end, uint64_t* val) {
+  uint64_t ret = 0;
+  for (int i = 0; i < 10 && ptr < end; i++) {
+    uint64_t byte = (uint8_t)*ptr++;
+    ret |= (byte & 0x7f) << (7 * i);
+    if ((byte & 0x80) == 0) {
+      *val = ret;
+      return ptr;
+    }
+  }
+  return NULL;
 }
 
 #include "upb/port/undef.inc"
@@ -0,0 +1,281 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Internal helpers shared by the encoders.
+
+#ifndef UPB_WIRE_INTERNAL_ENCODE_H_
+#define UPB_WIRE_INTERNAL_ENCODE_H_
+
+#include <string.h>
+
+#include "upb/base/string_view.h"
+#include "upb/collections/internal/map_sorter.h"
+#include "upb/mem/arena.h"
+#include "upb/message/internal/accessors.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/field.h"
+#include "upb/mini_table/internal/message.h"
+#include "upb/mini_table/sub.h"
+#include "upb/wire/encode.h"
+#include "upb/wire/internal/swap.h"
+#include "upb/wire/writer.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// Like upb_WireWriter_VarintSize(), but without a data-dependent loop, so that
+// summing the sizes of a whole array can be vectorized.
+UPB_INLINE size_t _upb_Encode_VarintSizeBranchless(uint64_t val) {
+#ifdef __GNUC__
+  // 1 + floor(bits / 7) for 1..64 significant bits.
+  size_t bits = 64 - __builtin_clzll(val | 1);
+  return (bits * 9 + 64) / 64;
+#else
+  return upb_WireWriter_VarintSize(val);
+#endif
+}
+
+// Returns true if field `f` of `msg` is present and must be serialized.
+UPB_INLINE bool _upb_Encode_ShouldEncode(const upb_Message* msg,
+                                         const upb_MiniTableField* f) {
+  if (f->presence == 0) {
+    /* Proto3 presence or map/array. */
+    const void* mem = _upb_MiniTableField_GetConstPtr(msg, f);
+    switch (_upb_MiniTableField_GetRep(f)) {
+      case kUpb_FieldRep_1Byte: {
+        char ch;
+        memcpy(&ch, mem, 1);
+        return ch != 0;
+      }
+      case kUpb_FieldRep_4Byte: {
+        uint32_t u32;
+        memcpy(&u32, mem, 4);
+        return u32 != 0;
+      }
+      case kUpb_FieldRep_8Byte: {
+        uint64_t u64;
+        memcpy(&u64, mem, 8);
+        return u64 != 0;
+      }
+      case kUpb_FieldRep_StringView: {
+        const upb_StringView* str = (const upb_StringView*)mem;
+        return str->size != 0;
+      }
+      default:
+        UPB_UNREACHABLE();
+    }
+  } else if (f->presence > 0) {
+    /* Proto2 presence: hasbit. */
+    return _upb_hasbit_field(msg, f);
+  } else {
+    /* Field is in a oneof. */
+    return _upb_getoneofcase_field(msg, f) == f->number;
+  }
+}
+
+// Returns the message pointed to by `tagged`, replacing `*m` with the empty
+// mini table if the message is an unlinked placeholder.
+UPB_INLINE const upb_Message* _upb_Encode_SubMessage(
+    upb_TaggedMessagePtr tagged, const upb_MiniTable** m) {
+  if (upb_TaggedMessagePtr_IsEmpty(tagged)) {
+    *m = &_kUpb_MiniTable_Empty;
+  }
+  return _upb_TaggedMessagePtr_GetMessage(tagged);
+}
+
+// The state of a (backwards) encode.  Generated code that opts into
+// specialized encoders writes through this directly, so any change here must
+// be matched by a change to upbc.
+typedef struct upb_encstate {
+  upb_EncodeStatus status;
+  jmp_buf err;
+  upb_Arena* arena;
+  char *buf, *ptr, *limit;
+  int options;
+  int depth;
+  _upb_mapsorter sorter;
+  // Fields to leave out of the current message (see upb_EncodeExcluding()),
+  // or NULL to encode all of them.
+  const struct upb_FieldSelection* exclude;
+  // For upb_EncodeToSegments(): the segments finished so far, last one first,
+  // and their total size.  Strings of at least `min_ref_size` bytes become
+  // segments of their own; zero means the output is a single buffer.
+  upb_StringView* segments;
+  size_t segment_count, segment_capacity;
+  size_t segment_bytes;
+  size_t min_ref_size;
+  // With kUpb_EncodeOption_CacheEncodings, the message whose fields are being
+  // encoded, which every message encoded in it is linked to.
+  upb_Message* cache_parent;
+} upb_encstate;
+
+// Encodes the fields of one message type as _upb_Encoder_Message() would,
+// storing the number of bytes written in `*size`.  upbc generates one of these
+// per message when given the `specialized_encoders` option.
+typedef void _upb_EncodeFunc(upb_encstate* e, const upb_Message* msg,
+                             size_t* size);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+UPB_NORETURN void _upb_Encoder_Error(upb_encstate* e, upb_EncodeStatus s);
+
+// Grows the buffer so that at least `bytes` more bytes fit, then reserves
+// them.
+void _upb_Encoder_GrowBuffer(upb_encstate* e, size_t bytes);
+
+void _upb_Encoder_LongVarint(upb_encstate* e, uint64_t val);
+
+// Encodes field `f` of `msg`, which must be present, with the table-driven
+// encoder.
+void _upb_Encoder_Field(upb_encstate* e, const upb_Message* msg,
+                        const upb_MiniTableSub* subs,
+                        const upb_MiniTableField* f);
+
+// Checks the required fields of `msg` and encodes its unknown fields and
+// extensions.  Since we encode backwards, these end up after the regular
+// fields.
+void _upb_Encoder_MessagePrologue(upb_encstate* e, const upb_Message* msg,
+                                  const upb_MiniTable* m);
+
+void _upb_Encoder_Message(upb_encstate* e, const upb_Message* msg,
+                          const upb_MiniTable* m, size_t* size);
+
+// Like upb_Encode(), but encodes the top-level message with `fn` if it is
+// non-NULL.
+upb_EncodeStatus _upb_Encode_WithFunc(const void* msg, const upb_MiniTable* l,
+                                      _upb_EncodeFunc* fn, int options,
+                                      upb_Arena* arena, char** buf,
+                                      size_t* size);
+
+// Computes the encoded size of `msg` as upb_Message_ByteSize() does.  If
+// `arena` is non-NULL, also records the length of every delimited
+// sub-message, map entry and packed field, in the order in which a forward
+// encoder (see upb_EncodeToStream()) writes their length prefixes.  The
+// table is allocated from `arena` and returned in `*sizes` and `*count`.
+upb_EncodeStatus _upb_Encode_ComputeSize(const upb_Message* msg,
+                                         const upb_MiniTable* l, int options,
+                                         upb_Arena* arena, size_t** sizes,
+                                         size_t* count, size_t* size);
+
+// Encodes the fields l->fields[begin, end) of `msg`, and its unknown fields
+// and extensions if `prologue` is true, into a buffer from `arena`.  These are
+// the pieces of upb_Encode()'s output that upb_EncodeParallel() encodes
+// separately: a message encodes as its fields in order followed by the
+// prologue.  An empty output may be NULL.
+upb_EncodeStatus _upb_Encode_FieldRange(const upb_Message* msg,
+                                        const upb_MiniTable* l, size_t begin,
+                                        size_t end, bool prologue, int options,
+                                        upb_Arena* arena, char** buf,
+                                        size_t* size);
+
+// Encodes elements [begin, end) of `f`, a repeated message field of `msg`
+// whose elements are not inline, as upb_Encode() would encode them as part
+// of `msg`.  Thread-safe as long as `msg` is not modified.
+upb_EncodeStatus _upb_Encode_ArraySlice(const upb_Message* msg,
+                                        const upb_MiniTable* l,
+                                        const upb_MiniTableField* f,
+                                        size_t begin, size_t end, int options,
+                                        upb_Arena* arena, char** buf,
+                                        size_t* size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/* Call to ensure that at least "bytes" bytes are available for writing at
+ * e->ptr.  Returns false if the bytes could not be allocated. */
+static UPB_FORCEINLINE void _upb_Encoder_Reserve(upb_encstate* e,
+                                                size_t bytes) {
+  if ((size_t)(e->ptr - e->buf) < bytes) {
+    _upb_Encoder_GrowBuffer(e, bytes);
+    return;
+  }
+
+  e->ptr -= bytes;
+}
+
+/* Writes the given bytes to the buffer, handling reserve/advance. */
+UPB_INLINE void _upb_Encoder_Bytes(upb_encstate* e, const void* data,
+                                   size_t len) {
+  if (len == 0) return; /* memcpy() with zero size is UB */
+  _upb_Encoder_Reserve(e, len);
+  memcpy(e->ptr, data, len);
+}
+
+UPB_INLINE void _upb_Encoder_Fixed64(upb_encstate* e, uint64_t val) {
+  val = _upb_BigEndian_Swap64(val);
+  _upb_Encoder_Bytes(e, &val, sizeof(uint64_t));
+}
+
+UPB_INLINE void _upb_Encoder_Fixed32(upb_encstate* e, uint32_t val) {
+  val = _upb_BigEndian_Swap32(val);
+  _upb_Encoder_Bytes(e, &val, sizeof(uint32_t));
+}
+
+static UPB_FORCEINLINE void _upb_Encoder_Varint(upb_encstate* e,
+                                               uint64_t val) {
+  if (val < 128 && e->ptr != e->buf) {
+    --e->ptr;
+    *e->ptr = val;
+  } else {
+    _upb_Encoder_LongVarint(e, val);
+  }
+}
+
+// Returns the number of bytes written so far.
+UPB_INLINE size_t _upb_Encoder_Written(const upb_encstate* e) {
+  return e->segment_bytes + (e->limit - e->ptr);
+}
+
+// Encodes sub-message `tagged` with `fn`, or with the table-driven encoder if
+// it is an unlinked placeholder, and returns the number of bytes written.
+// Checks and restores the depth limit around the call.
+UPB_INLINE size_t _upb_Encoder_SubMessage(upb_encstate* e,
+                                          upb_TaggedMessagePtr tagged,
+                                          _upb_EncodeFunc* fn) {
+  size_t size;
+  if (--e->depth == 0) {
+    _upb_Encoder_Error(e, kUpb_EncodeStatus_MaxDepthExceeded);
+  }
+  if (UPB_UNLIKELY(upb_TaggedMessagePtr_IsEmpty(tagged))) {
+    _upb_Encoder_Message(e, _upb_TaggedMessagePtr_GetMessage(tagged),
+                         &_kUpb_MiniTable_Empty, &size);
+  } else {
+    fn(e, _upb_TaggedMessagePtr_GetMessage(tagged), &size);
+  }
+  e->depth++;
+  return size;
+}
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_WIRE_INTERNAL_ENCODE_H_ */
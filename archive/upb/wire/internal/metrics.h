@@ -0,0 +1,69 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_WIRE_INTERNAL_METRICS_H_
+#define UPB_WIRE_INTERNAL_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "upb/port/atomic.h"
+#include "upb/wire/metrics.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The installed registry, or NULL.
+extern UPB_ATOMIC(upb_Metrics*) _upb_Metrics_Installed;
+
+UPB_INLINE upb_Metrics* _upb_Metrics_Active(void) {
+  return upb_Atomic_Load(&_upb_Metrics_Installed, memory_order_acquire);
+}
+
+// Adds one upb_Decode() call on `mini_table` to the calling thread's shard.
+void _upb_Metrics_RecordDecode(upb_Metrics* m, const upb_MiniTable* mini_table,
+                               size_t bytes, bool ok, size_t unknown_bytes,
+                               uint32_t generic_fallbacks, size_t arena_bytes);
+
+// Adds one upb_Encode() call on `mini_table` to the calling thread's shard.
+void _upb_Metrics_RecordEncode(upb_Metrics* m, const upb_MiniTable* mini_table,
+                               size_t bytes, bool ok);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_WIRE_INTERNAL_METRICS_H_ */
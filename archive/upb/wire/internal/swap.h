@@ -31,7 +31,9 @@
 #ifndef UPB_WIRE_INTERNAL_SWAP_H_
 #define UPB_WIRE_INTERNAL_SWAP_H_
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -59,6 +61,31 @@ UPB_INLINE uint64_t _upb_BigEndian_Swap64(uint64_t val) {
          _upb_BigEndian_Swap32((uint32_t)(val >> 32));
 }
 
+// Swaps `count` consecutive values in place between host and wire byte order.
+// Converting a packed field in one pass after a bulk copy compiles to a tight
+// byte-swap loop, instead of reading each element through the input stream.
+UPB_INLINE void _upb_BigEndian_SwapArray32(void* data, size_t count) {
+  if (_upb_IsLittleEndian()) return;
+  char* ptr = (char*)data;
+  for (size_t i = 0; i < count; i++, ptr += sizeof(uint32_t)) {
+    uint32_t val;
+    memcpy(&val, ptr, sizeof(val));
+    val = _upb_BigEndian_Swap32(val);
+    memcpy(ptr, &val, sizeof(val));
+  }
+}
+
+UPB_INLINE void _upb_BigEndian_SwapArray64(void* data, size_t count) {
+  if (_upb_IsLittleEndian()) return;
+  char* ptr = (char*)data;
+  for (size_t i = 0; i < count; i++, ptr += sizeof(uint64_t)) {
+    uint64_t val;
+    memcpy(&val, ptr, sizeof(val));
+    val = _upb_BigEndian_Swap64(val);
+    memcpy(ptr, &val, sizeof(val));
+  }
+}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
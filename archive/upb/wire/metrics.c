@@ -0,0 +1,348 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/metrics.h"
+
+#include <string.h>
+
+#include "upb/hash/common.h"
+#include "upb/hash/int_table.h"
+#include "upb/port/atomic.h"
+#include "upb/wire/internal/metrics.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define UPB_METRICS_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define UPB_METRICS_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define UPB_METRICS_THREAD_LOCAL _Thread_local
+#endif
+
+typedef enum {
+  kUpb_MetricsCounter_DecodeCalls,
+  kUpb_MetricsCounter_DecodeErrors,
+  kUpb_MetricsCounter_DecodeBytes,
+  kUpb_MetricsCounter_UnknownBytes,
+  kUpb_MetricsCounter_GenericFallbacks,
+  kUpb_MetricsCounter_ArenaBytes,
+  kUpb_MetricsCounter_EncodeCalls,
+  kUpb_MetricsCounter_EncodeErrors,
+  kUpb_MetricsCounter_EncodeBytes,
+  kUpb_MetricsCounter_Count,
+} upb_MetricsCounter;
+
+typedef struct {
+  // NULL until the slot is claimed, then fixed.
+  UPB_ATOMIC(const upb_MiniTable*) mini_table;
+  UPB_ATOMIC(uint64_t) counters[kUpb_MetricsCounter_Count];
+} _upb_MetricsSlot;
+
+// A thread's counters: an open-addressed table keyed by mini table, which
+// only ever gains keys, so readers can scan it while the thread records.
+typedef struct _upb_MetricsShard {
+  struct _upb_MetricsShard* next;  // Fixed once the shard is published.
+  _upb_MetricsSlot overflow;       // For types that found no free slot.
+  _upb_MetricsSlot slots[];
+} _upb_MetricsShard;
+
+struct upb_Metrics {
+  upb_alloc* alloc;
+  size_t mask;  // Number of slots per shard, minus one.
+
+  // Identifies this registry in each thread's cached shard pointer, which
+  // would be ambiguous if a registry were freed and another allocated at the
+  // same address.
+  uintptr_t generation;
+
+  UPB_ATOMIC(_upb_MetricsShard*) shards;
+};
+
+UPB_ATOMIC(upb_Metrics*) _upb_Metrics_Installed;
+
+static UPB_ATOMIC(uintptr_t) _upb_Metrics_Generation;
+
+#ifdef UPB_METRICS_THREAD_LOCAL
+static UPB_METRICS_THREAD_LOCAL uintptr_t _upb_Metrics_CachedGeneration;
+static UPB_METRICS_THREAD_LOCAL _upb_MetricsShard* _upb_Metrics_CachedShard;
+#endif
+
+upb_Metrics* upb_Metrics_New(upb_alloc* alloc, size_t max_types) {
+  // Leave half the slots empty to keep probe sequences short.
+  size_t slots = 16;
+  while (slots < max_types * 2) {
+    if (slots > SIZE_MAX / 2 / sizeof(_upb_MetricsSlot)) return NULL;
+    slots *= 2;
+  }
+
+  upb_Metrics* m = upb_malloc(alloc, sizeof(*m));
+  if (!m) return NULL;
+  m->alloc = alloc;
+  m->mask = slots - 1;
+  upb_Atomic_Init(&m->shards, NULL);
+
+  uintptr_t gen = upb_Atomic_Load(&_upb_Metrics_Generation,
+                                  memory_order_relaxed);
+  while (!upb_Atomic_CompareExchangeWeak(&_upb_Metrics_Generation, &gen,
+                                         gen + 1, memory_order_relaxed,
+                                         memory_order_relaxed)) {
+  }
+  m->generation = gen + 1;
+  return m;
+}
+
+void upb_Metrics_Free(upb_Metrics* m) {
+  UPB_ASSERT(_upb_Metrics_Active() != m);
+  _upb_MetricsShard* shard =
+      upb_Atomic_Load(&m->shards, memory_order_acquire);
+  while (shard) {
+    _upb_MetricsShard* next = shard->next;
+    upb_free(m->alloc, shard);
+    shard = next;
+  }
+  upb_free(m->alloc, m);
+}
+
+void upb_Metrics_Install(upb_Metrics* m) {
+  upb_Atomic_Store(&_upb_Metrics_Installed, m, memory_order_release);
+}
+
+static _upb_MetricsShard* _upb_Metrics_NewShard(upb_Metrics* m) {
+  size_t size = sizeof(_upb_MetricsShard) +
+                (m->mask + 1) * sizeof(_upb_MetricsSlot);
+  _upb_MetricsShard* shard = upb_malloc(m->alloc, size);
+  if (!shard) return NULL;
+  memset(shard, 0, size);
+
+  shard->next = upb_Atomic_Load(&m->shards, memory_order_relaxed);
+  while (!upb_Atomic_CompareExchangeWeak(&m->shards, &shard->next, shard,
+                                         memory_order_release,
+                                         memory_order_relaxed)) {
+  }
+  return shard;
+}
+
+// Returns the calling thread's shard of `m`, creating it if necessary.
+// Without thread-local storage, threads share the newest shard.
+static _upb_MetricsShard* _upb_Metrics_ThreadShard(upb_Metrics* m) {
+#ifdef UPB_METRICS_THREAD_LOCAL
+  if (UPB_LIKELY(_upb_Metrics_CachedGeneration == m->generation)) {
+    return _upb_Metrics_CachedShard;
+  }
+  _upb_MetricsShard* shard = _upb_Metrics_NewShard(m);
+  if (!shard) return NULL;
+  _upb_Metrics_CachedGeneration = m->generation;
+  _upb_Metrics_CachedShard = shard;
+  return shard;
+#else
+  // Several threads may race to create the first shard, which is harmless:
+  // every shard is summed, and counters are updated atomically.
+  _upb_MetricsShard* shard = upb_Atomic_Load(&m->shards, memory_order_acquire);
+  return UPB_LIKELY(shard) ? shard : _upb_Metrics_NewShard(m);
+#endif
+}
+
+static uint32_t _upb_Metrics_Hash(const upb_MiniTable* mini_table) {
+  uint64_t h = (uintptr_t)mini_table * 0x9e3779b97f4a7c15ull;
+  return (uint32_t)(h >> 32);
+}
+
+static _upb_MetricsSlot* _upb_Metrics_FindSlot(const upb_Metrics* m,
+                                               _upb_MetricsShard* shard,
+                                               const upb_MiniTable* t,
+                                               bool insert) {
+  size_t i = _upb_Metrics_Hash(t) & m->mask;
+  for (size_t n = 0; n <= m->mask; n++, i = (i + 1) & m->mask) {
+    _upb_MetricsSlot* slot = &shard->slots[i];
+    const upb_MiniTable* key =
+        upb_Atomic_Load(&slot->mini_table, memory_order_acquire);
+    if (key == t) return slot;
+    if (key) continue;
+    if (!insert) return NULL;
+    if (upb_Atomic_CompareExchangeStrong(&slot->mini_table, &key, t,
+                                         memory_order_release,
+                                         memory_order_acquire) ||
+        key == t) {
+      return slot;
+    }
+  }
+  return insert ? &shard->overflow : NULL;
+}
+
+static _upb_MetricsSlot* _upb_Metrics_ThreadSlot(upb_Metrics* m,
+                                                 const upb_MiniTable* t) {
+  _upb_MetricsShard* shard = _upb_Metrics_ThreadShard(m);
+  return shard ? _upb_Metrics_FindSlot(m, shard, t, true) : NULL;
+}
+
+static void _upb_Metrics_Add(_upb_MetricsSlot* slot, upb_MetricsCounter c,
+                             uint64_t val) {
+  upb_Atomic_Add(&slot->counters[c], val, memory_order_relaxed);
+}
+
+void _upb_Metrics_RecordDecode(upb_Metrics* m, const upb_MiniTable* mini_table,
+                               size_t bytes, bool ok, size_t unknown_bytes,
+                               uint32_t generic_fallbacks,
+                               size_t arena_bytes) {
+  _upb_MetricsSlot* slot = _upb_Metrics_ThreadSlot(m, mini_table);
+  if (!slot) return;
+  _upb_Metrics_Add(slot, kUpb_MetricsCounter_DecodeCalls, 1);
+  if (!ok) _upb_Metrics_Add(slot, kUpb_MetricsCounter_DecodeErrors, 1);
+  _upb_Metrics_Add(slot, kUpb_MetricsCounter_DecodeBytes, bytes);
+  if (unknown_bytes) {
+    _upb_Metrics_Add(slot, kUpb_MetricsCounter_UnknownBytes, unknown_bytes);
+  }
+  if (generic_fallbacks) {
+    _upb_Metrics_Add(slot, kUpb_MetricsCounter_GenericFallbacks,
+                     generic_fallbacks);
+  }
+  _upb_Metrics_Add(slot, kUpb_MetricsCounter_ArenaBytes, arena_bytes);
+}
+
+void _upb_Metrics_RecordEncode(upb_Metrics* m, const upb_MiniTable* mini_table,
+                               size_t bytes, bool ok) {
+  _upb_MetricsSlot* slot = _upb_Metrics_ThreadSlot(m, mini_table);
+  if (!slot) return;
+  _upb_Metrics_Add(slot, kUpb_MetricsCounter_EncodeCalls, 1);
+  if (!ok) _upb_Metrics_Add(slot, kUpb_MetricsCounter_EncodeErrors, 1);
+  _upb_Metrics_Add(slot, kUpb_MetricsCounter_EncodeBytes, bytes);
+}
+
+static void _upb_Metrics_Accumulate(_upb_MetricsSlot* slot,
+                                    upb_MessageMetrics* out) {
+  uint64_t c[kUpb_MetricsCounter_Count];
+  for (int i = 0; i < kUpb_MetricsCounter_Count; i++) {
+    c[i] = upb_Atomic_Load(&slot->counters[i], memory_order_relaxed);
+  }
+  out->decode_calls += c[kUpb_MetricsCounter_DecodeCalls];
+  out->decode_errors += c[kUpb_MetricsCounter_DecodeErrors];
+  out->decode_bytes += c[kUpb_MetricsCounter_DecodeBytes];
+  out->unknown_bytes += c[kUpb_MetricsCounter_UnknownBytes];
+  out->generic_fallbacks += c[kUpb_MetricsCounter_GenericFallbacks];
+  out->arena_bytes += c[kUpb_MetricsCounter_ArenaBytes];
+  out->encode_calls += c[kUpb_MetricsCounter_EncodeCalls];
+  out->encode_errors += c[kUpb_MetricsCounter_EncodeErrors];
+  out->encode_bytes += c[kUpb_MetricsCounter_EncodeBytes];
+}
+
+static bool _upb_Metrics_IsEmpty(_upb_MetricsSlot* slot) {
+  for (int i = 0; i < kUpb_MetricsCounter_Count; i++) {
+    if (upb_Atomic_Load(&slot->counters[i], memory_order_relaxed)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool upb_Metrics_Get(const upb_Metrics* m, const upb_MiniTable* mini_table,
+                     upb_MessageMetrics* out) {
+  memset(out, 0, sizeof(*out));
+  bool found = false;
+  _upb_MetricsShard* shard = upb_Atomic_Load(
+      &((upb_Metrics*)m)->shards, memory_order_acquire);
+  for (; shard; shard = shard->next) {
+    _upb_MetricsSlot* slot =
+        mini_table ? _upb_Metrics_FindSlot(m, shard, mini_table, false)
+                   : &shard->overflow;
+    if (!slot || (!mini_table && _upb_Metrics_IsEmpty(slot))) continue;
+    _upb_Metrics_Accumulate(slot, out);
+    found = true;
+  }
+  return found;
+}
+
+// Adds `slot` to the entry for `mini_table` in `*entries`, which has `*count`
+// elements and room for `*capacity`, with `index` mapping each mini table to
+// its entry.
+static bool _upb_Metrics_Merge(const upb_MiniTable* mini_table,
+                               _upb_MetricsSlot* slot, upb_inttable* index,
+                               upb_MetricsEntry** entries, size_t* count,
+                               size_t* capacity, upb_Arena* arena) {
+  upb_value v;
+  upb_MetricsEntry* entry;
+  if (upb_inttable_lookup(index, (uintptr_t)mini_table, &v)) {
+    entry = &(*entries)[upb_value_getuint64(v)];
+  } else {
+    if (*count == *capacity) {
+      size_t new_capacity = UPB_MAX(*capacity * 2, 16);
+      upb_MetricsEntry* grown = upb_Arena_Realloc(
+          arena, *entries, *capacity * sizeof(**entries),
+          new_capacity * sizeof(**entries));
+      if (!grown) return false;
+      *entries = grown;
+      *capacity = new_capacity;
+    }
+    if (!upb_inttable_insert(index, (uintptr_t)mini_table,
+                             upb_value_uint64(*count), arena)) {
+      return false;
+    }
+    entry = &(*entries)[(*count)++];
+    memset(entry, 0, sizeof(*entry));
+    entry->mini_table = mini_table;
+  }
+  _upb_Metrics_Accumulate(slot, &entry->metrics);
+  return true;
+}
+
+bool upb_Metrics_Snapshot(const upb_Metrics* m, upb_Arena* arena,
+                          const upb_MetricsEntry** entries, size_t* count) {
+  upb_inttable index;
+  upb_MetricsEntry* out = NULL;
+  size_t n = 0;
+  size_t capacity = 0;
+  if (!upb_inttable_init(&index, arena)) return false;
+
+  _upb_MetricsShard* shard = upb_Atomic_Load(
+      &((upb_Metrics*)m)->shards, memory_order_acquire);
+  for (; shard; shard = shard->next) {
+    for (size_t i = 0; i <= m->mask; i++) {
+      _upb_MetricsSlot* slot = &shard->slots[i];
+      const upb_MiniTable* t =
+          upb_Atomic_Load(&slot->mini_table, memory_order_acquire);
+      if (!t) continue;
+      if (!_upb_Metrics_Merge(t, slot, &index, &out, &n, &capacity, arena)) {
+        return false;
+      }
+    }
+    if (_upb_Metrics_IsEmpty(&shard->overflow)) continue;
+    if (!_upb_Metrics_Merge(NULL, &shard->overflow, &index, &out, &n,
+                            &capacity, arena)) {
+      return false;
+    }
+  }
+
+  *entries = out;
+  *count = n;
+  return true;
+}
+
+#undef UPB_METRICS_THREAD_LOCAL
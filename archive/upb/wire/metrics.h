@@ -0,0 +1,123 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// upb_Metrics counts what upb_Decode() and upb_Encode() do for each message
+// type, for dashboards that show which types cost CPU and memory.
+//
+// A registry only records while it is installed with upb_Metrics_Install().
+// When none is installed, decoding and encoding pay for one relaxed atomic
+// load.  Each thread adds to its own shard of the registry, so recording
+// takes no locks and threads don't write to shared cache lines.  Readers
+// sum the shards with upb_Metrics_Get() or upb_Metrics_Snapshot(), which
+// may run concurrently with recording.
+//
+// Calls are attributed to the mini table passed to upb_Decode() or
+// upb_Encode(); sub-messages are counted as part of their top-level message.
+
+#ifndef UPB_WIRE_METRICS_H_
+#define UPB_WIRE_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "upb/mem/alloc.h"
+#include "upb/mem/arena.h"
+#include "upb/mini_table/message.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint64_t decode_calls;
+  uint64_t decode_errors;  // Calls that did not return kUpb_DecodeStatus_Ok.
+  uint64_t decode_bytes;   // Wire bytes passed to the decoder.
+
+  // Bytes of unknown fields that the decoder stored, at any depth.
+  uint64_t unknown_bytes;
+
+  // Times the fast table decoder handed a field or message to the generic
+  // decoder (always 0 in builds without UPB_FASTTABLE).
+  uint64_t generic_fallbacks;
+
+  // Arena space used up by decoding, including any space left unused at the
+  // end of a block when the decoder needed a new one.
+  uint64_t arena_bytes;
+
+  uint64_t encode_calls;
+  uint64_t encode_errors;  // Calls that did not return kUpb_EncodeStatus_Ok.
+  uint64_t encode_bytes;   // Wire bytes produced by the encoder.
+} upb_MessageMetrics;
+
+typedef struct {
+  // NULL for the calls on message types that did not fit in `max_types`.
+  const upb_MiniTable* mini_table;
+  upb_MessageMetrics metrics;
+} upb_MetricsEntry;
+
+typedef struct upb_Metrics upb_Metrics;
+
+// Creates an empty registry whose shards are allocated from `alloc`.  Each
+// thread's shard tracks up to `max_types` message types; calls on any others
+// are counted under a NULL mini table.  Returns NULL on allocation failure.
+UPB_API upb_Metrics* upb_Metrics_New(upb_alloc* alloc, size_t max_types);
+
+// Frees the registry and all its shards.  It must not be installed, and no
+// upb_Decode() or upb_Encode() that started while it was installed may still
+// be running.
+UPB_API void upb_Metrics_Free(upb_Metrics* m);
+
+// Makes `m` the registry that all threads record into, replacing the one
+// installed before, if any.  NULL stops recording.
+UPB_API void upb_Metrics_Install(upb_Metrics* m);
+
+// Sets `*out` to the sum over all threads of the counters for `mini_table`.
+// Returns false (with `*out` zeroed) if no call on that type was recorded.
+UPB_API bool upb_Metrics_Get(const upb_Metrics* m,
+                             const upb_MiniTable* mini_table,
+                             upb_MessageMetrics* out);
+
+// Sums the counters of all threads into an array allocated from `arena`, with
+// one entry per message type that was recorded, in no particular order.
+// Returns false on allocation failure.
+UPB_API bool upb_Metrics_Snapshot(const upb_Metrics* m, upb_Arena* arena,
+                                  const upb_MetricsEntry** entries,
+                                  size_t* count);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_WIRE_METRICS_H_ */
@@ -0,0 +1,176 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/metrics.h"
+
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/mem/alloc.h"
+#include "upb/mem/arena.hpp"
+#include "upb/mini_table/message.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+
+namespace {
+
+const upb_MiniTable* kMiniTable =
+    &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init;
+const upb_MiniTable* kNestedMiniTable =
+    &protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_msg_init;
+
+// optional_int32: 1, optional_string: "hello", then field 501 (unknown): 1.
+const std::string kInput("\x08\x01\x72\x05hello\xa8\x1f\x01", 12);
+
+upb_DecodeStatus Decode(const std::string& input) {
+  upb::Arena arena;
+  upb_Message* msg = upb_Message_New(kMiniTable, arena.ptr());
+  return upb_Decode(input.data(), input.size(), msg, kMiniTable, nullptr, 0,
+                    arena.ptr());
+}
+
+class MetricsTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    metrics_ = upb_Metrics_New(&upb_alloc_global, 8);
+    ASSERT_NE(nullptr, metrics_);
+  }
+
+  void TearDown() override {
+    upb_Metrics_Install(nullptr);
+    upb_Metrics_Free(metrics_);
+  }
+
+  upb_Metrics* metrics_;
+};
+
+TEST_F(MetricsTest, OnlyRecordsWhileInstalled) {
+  upb_MessageMetrics m;
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Decode(kInput));
+  EXPECT_FALSE(upb_Metrics_Get(metrics_, kMiniTable, &m));
+  EXPECT_EQ(0, m.decode_calls);
+
+  upb_Metrics_Install(metrics_);
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Decode(kInput));
+  upb_Metrics_Install(nullptr);
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Decode(kInput));
+
+  EXPECT_TRUE(upb_Metrics_Get(metrics_, kMiniTable, &m));
+  EXPECT_EQ(1, m.decode_calls);
+  EXPECT_FALSE(upb_Metrics_Get(metrics_, kNestedMiniTable, &m));
+}
+
+TEST_F(MetricsTest, Counters) {
+  upb_Metrics_Install(metrics_);
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Decode(kInput));
+  EXPECT_EQ(kUpb_DecodeStatus_Malformed, Decode("\x08\x80"));
+
+  upb::Arena arena;
+  auto* msg = protobuf_test_messages_proto2_TestAllTypesProto2_new(arena.ptr());
+  protobuf_test_messages_proto2_TestAllTypesProto2_set_optional_int32(msg, 1);
+  char* buf;
+  size_t size;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, kMiniTable, 0, arena.ptr(), &buf, &size));
+  upb_Metrics_Install(nullptr);
+
+  upb_MessageMetrics m;
+  ASSERT_TRUE(upb_Metrics_Get(metrics_, kMiniTable, &m));
+  EXPECT_EQ(2, m.decode_calls);
+  EXPECT_EQ(1, m.decode_errors);
+  EXPECT_EQ(kInput.size() + 2, m.decode_bytes);
+  EXPECT_EQ(3, m.unknown_bytes);
+  // At least the message, the string copy and the unknown field.
+  EXPECT_GE(m.arena_bytes, 5 + 3);
+  EXPECT_EQ(1, m.encode_calls);
+  EXPECT_EQ(0, m.encode_errors);
+  EXPECT_EQ(size, m.encode_bytes);
+}
+
+TEST_F(MetricsTest, Threads) {
+  constexpr int kThreads = 4;
+  constexpr int kCalls = 100;
+  upb_Metrics_Install(metrics_);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([] {
+      for (int j = 0; j < kCalls; j++) Decode(kInput);
+    });
+  }
+  for (auto& t : threads) t.join();
+  upb_Metrics_Install(nullptr);
+
+  upb_MessageMetrics m;
+  ASSERT_TRUE(upb_Metrics_Get(metrics_, kMiniTable, &m));
+  EXPECT_EQ(kThreads * kCalls, m.decode_calls);
+  EXPECT_EQ(kThreads * kCalls * kInput.size(), m.decode_bytes);
+
+  upb::Arena arena;
+  const upb_MetricsEntry* entries;
+  size_t count;
+  ASSERT_TRUE(upb_Metrics_Snapshot(metrics_, arena.ptr(), &entries, &count));
+  ASSERT_EQ(1, count);
+  EXPECT_EQ(kMiniTable, entries[0].mini_table);
+  EXPECT_EQ(kThreads * kCalls, entries[0].metrics.decode_calls);
+  EXPECT_EQ(kThreads * kCalls * 3, entries[0].metrics.unknown_bytes);
+}
+
+TEST_F(MetricsTest, Overflow) {
+  // Far more types than the 8 that `metrics_` was created for.
+  std::vector<upb_MiniTable> tables(40, *kNestedMiniTable);
+  upb_Metrics_Install(metrics_);
+  upb::Arena arena;
+  for (const upb_MiniTable& t : tables) {
+    upb_Message* msg = upb_Message_New(&t, arena.ptr());
+    EXPECT_EQ(kUpb_DecodeStatus_Ok,
+              upb_Decode("\x08\x01", 2, msg, &t, nullptr, 0, arena.ptr()));
+  }
+  upb_Metrics_Install(nullptr);
+
+  const upb_MetricsEntry* entries;
+  size_t count;
+  ASSERT_TRUE(upb_Metrics_Snapshot(metrics_, arena.ptr(), &entries, &count));
+  uint64_t calls = 0;
+  bool has_overflow = false;
+  for (size_t i = 0; i < count; i++) {
+    calls += entries[i].metrics.decode_calls;
+    if (!entries[i].mini_table) has_overflow = true;
+  }
+  EXPECT_EQ(tables.size(), calls);
+  EXPECT_TRUE(has_overflow);
+  upb_MessageMetrics m;
+  EXPECT_TRUE(upb_Metrics_Get(metrics_, nullptr, &m));
+}
+
+}  // namespace
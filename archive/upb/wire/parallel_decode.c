@@ -0,0 +1,342 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// For pthreads, which are not part of C99.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "upb/wire/parallel_decode.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "upb/collections/internal/array.h"
+#include "upb/mem/arena.h"
+#include "upb/message/accessors.h"
+#include "upb/message/tagged_ptr.h"
+#include "upb/mini_table/internal/field.h"
+#include "upb/wire/scanner.h"
+#include "upb/wire/types.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifndef _WIN32
+
+enum {
+  // Less input than this is decoded faster than a thread can be started.
+  kUpb_DecodeParallel_MinBytesPerThread = 64 * 1024,
+
+  // Elements are handed to upb_DecodeBatch() this many at a time, so that
+  // the message pointers and statuses fit on the stack.
+  kUpb_DecodeParallel_BatchSize = 256,
+};
+
+typedef struct {
+  const upb_StringView* elems;
+  size_t count;
+  upb_TaggedMessagePtr* out;  // This chunk's slice of the array.
+  const upb_MiniTable* mini_table;
+  const upb_ExtensionRegistry* extreg;
+  int options;
+  upb_Arena* arena;
+  upb_DecodeStatus status;
+  pthread_t thread;
+  bool started;
+} upb_DecodeParallel_Chunk;
+
+// A growable array in the scratch arena.
+typedef struct {
+  void* data;
+  size_t size;
+  size_t capacity;
+} upb_DecodeParallel_Vec;
+
+static bool _upb_DecodeParallel_Push(upb_DecodeParallel_Vec* v,
+                                     const void* elem, size_t elem_size,
+                                     upb_Arena* a) {
+  if (v->size == v->capacity) {
+    size_t capacity = UPB_MAX(64, v->capacity * 2);
+    void* data = upb_Arena_Realloc(a, v->data, v->capacity * elem_size,
+                                   capacity * elem_size);
+    if (!data) return false;
+    v->data = data;
+    v->capacity = capacity;
+  }
+  memcpy((char*)v->data + v->size++ * elem_size, elem, elem_size);
+  return true;
+}
+
+static void _upb_DecodeParallel_Run(upb_DecodeParallel_Chunk* c) {
+  upb_Message* msgs[kUpb_DecodeParallel_BatchSize];
+  upb_DecodeStatus statuses[kUpb_DecodeParallel_BatchSize];
+
+  for (size_t i = 0; i < c->count; i += kUpb_DecodeParallel_BatchSize) {
+    size_t n = UPB_MIN(c->count - i, kUpb_DecodeParallel_BatchSize);
+    memset(msgs, 0, n * sizeof(*msgs));
+    if (upb_DecodeBatch(c->elems + i, n, msgs, c->mini_table, c->extreg,
+                        c->options, c->arena, statuses) != n) {
+      for (size_t j = 0; j < n; j++) {
+        if (statuses[j] != kUpb_DecodeStatus_Ok) {
+          c->status = statuses[j];
+          return;
+        }
+      }
+    }
+    for (size_t j = 0; j < n; j++) {
+      c->out[i + j] = _upb_TaggedMessagePtr_Pack(msgs[j], false);
+    }
+  }
+  c->status = kUpb_DecodeStatus_Ok;
+}
+
+static void* _upb_DecodeParallel_Thread(void* arg) {
+  _upb_DecodeParallel_Run(arg);
+  return NULL;
+}
+
+// Finds the elements of the field numbered `number` at the top level of
+// `buf`, and the ranges of everything else.
+static upb_DecodeStatus _upb_DecodeParallel_Scan(const char* buf, size_t size,
+                                                 uint32_t number,
+                                                 upb_DecodeParallel_Vec* elems,
+                                                 upb_DecodeParallel_Vec* rest,
+                                                 upb_Arena* scratch) {
+  upb_WireScanner s;
+  upb_WireField f;
+  size_t start = 0;
+  upb_WireScanner_Init(&s, buf, size);
+  while (upb_WireScanner_Next(&s, &f)) {
+    size_t end = upb_WireScanner_Position(&s);
+    if (f.field_number == number && f.wire_type == kUpb_WireType_Delimited) {
+      upb_StringView elem =
+          upb_StringView_FromDataAndSize(buf + f.offset, f.length);
+      if (!_upb_DecodeParallel_Push(elems, &elem, sizeof(elem), scratch)) {
+        return kUpb_DecodeStatus_OutOfMemory;
+      }
+    } else {
+      // Merge with the previous range if they touch.
+      upb_StringView* last =
+          rest->size ? (upb_StringView*)rest->data + rest->size - 1 : NULL;
+      if (last && last->data + last->size == buf + start) {
+        last->size += end - start;
+      } else {
+        upb_StringView range =
+            upb_StringView_FromDataAndSize(buf + start, end - start);
+        if (!_upb_DecodeParallel_Push(rest, &range, sizeof(range), scratch)) {
+          return kUpb_DecodeStatus_OutOfMemory;
+        }
+      }
+    }
+    start = end;
+  }
+  return upb_WireScanner_IsError(&s) ? kUpb_DecodeStatus_Malformed
+                                     : kUpb_DecodeStatus_Ok;
+}
+
+// Decodes the top-level fields other than the elements, copied together into
+// one buffer, into `msg`.
+static upb_DecodeStatus _upb_DecodeParallel_Rest(
+    const upb_DecodeParallel_Vec* rest, upb_Message* msg,
+    const upb_MiniTable* l, const upb_ExtensionRegistry* extreg, int options,
+    upb_Arena* arena, upb_Arena* scratch) {
+  const upb_StringView* ranges = rest->data;
+  size_t size = 0;
+  for (size_t i = 0; i < rest->size; i++) size += ranges[i].size;
+  if (size == 0) return kUpb_DecodeStatus_Ok;
+
+  // Aliased strings must live as long as the message.
+  upb_Arena* a = (options & kUpb_DecodeOption_AliasString) ? arena : scratch;
+  char* buf = upb_Arena_Malloc(a, size);
+  if (!buf) return kUpb_DecodeStatus_OutOfMemory;
+  char* ptr = buf;
+  for (size_t i = 0; i < rest->size; i++) {
+    memcpy(ptr, ranges[i].data, ranges[i].size);
+    ptr += ranges[i].size;
+  }
+  return upb_Decode(buf, size, msg, l, extreg, options, arena);
+}
+
+// Decodes the elements on `count` threads (including this one), once the
+// top-level scan has found them.  Returns false without decoding anything if
+// the arenas cannot be set up.
+static bool _upb_DecodeParallel_Elements(
+    const upb_DecodeParallel_Vec* elems, const upb_DecodeParallel_Vec* rest,
+    size_t elem_bytes, int count, upb_Message* msg, const upb_MiniTable* l,
+    const upb_MiniTableField* field, const upb_ExtensionRegistry* extreg,
+    int options, int elem_options, upb_Arena* arena, upb_Arena* scratch,
+    upb_DecodeStatus* status) {
+  upb_DecodeParallel_Chunk* chunks =
+      upb_Arena_Malloc(scratch, count * sizeof(*chunks));
+  if (!chunks) return false;
+  memset(chunks, 0, count * sizeof(*chunks));
+
+  // Each thread but this one allocates from its own arena, fused with
+  // `arena` so that the messages live as long as it does.
+  bool ok = true;
+  chunks[0].arena = arena;
+  for (int i = 1; i < count; i++) {
+    chunks[i].arena = upb_Arena_New();
+    if (!chunks[i].arena || !upb_Arena_Fuse(arena, chunks[i].arena)) {
+      ok = false;
+      break;
+    }
+  }
+
+  upb_Array* arr = NULL;
+  size_t old_size = 0;
+  if (ok) {
+    arr = upb_Message_GetOrCreateMutableArray(msg, field, arena);
+    if (arr) old_size = upb_Array_Size(arr);
+    ok = arr && _upb_Array_ResizeUninitialized(arr, old_size + elems->size,
+                                               arena);
+  }
+  if (!ok) {
+    for (int i = 1; i < count; i++) {
+      if (chunks[i].arena) upb_Arena_Free(chunks[i].arena);
+    }
+    return false;
+  }
+
+  // Split the elements into runs of about the same number of bytes.
+  const upb_StringView* elem = elems->data;
+  upb_TaggedMessagePtr* out =
+      (upb_TaggedMessagePtr*)_upb_array_ptr(arr) + old_size;
+  size_t begin = 0;
+  size_t bytes = 0;
+  for (int i = 0; i < count; i++) {
+    size_t end = begin;
+    size_t target = elem_bytes / count * (i + 1);
+    while (end < elems->size && (i == count - 1 || bytes < target)) {
+      bytes += elem[end++].size;
+    }
+    upb_DecodeParallel_Chunk* c = &chunks[i];
+    c->elems = elem + begin;
+    c->count = end - begin;
+    c->out = out + begin;
+    c->mini_table = upb_MiniTable_GetSubMessageTable(l, field);
+    c->extreg = extreg;
+    c->options = elem_options;
+    begin = end;
+  }
+
+  for (int i = 1; i < count; i++) {
+    chunks[i].started = pthread_create(&chunks[i].thread, NULL,
+                                       _upb_DecodeParallel_Thread,
+                                       &chunks[i]) == 0;
+  }
+
+  *status = _upb_DecodeParallel_Rest(rest, msg, l, extreg, options, arena,
+                                     scratch);
+  _upb_DecodeParallel_Run(&chunks[0]);
+  for (int i = 1; i < count; i++) {
+    if (chunks[i].started) {
+      pthread_join(chunks[i].thread, NULL);
+    } else {
+      _upb_DecodeParallel_Run(&chunks[i]);
+    }
+    upb_Arena_Free(chunks[i].arena);
+  }
+
+  for (int i = 0; i < count && *status == kUpb_DecodeStatus_Ok; i++) {
+    *status = chunks[i].status;
+  }
+  if (*status != kUpb_DecodeStatus_Ok) {
+    // Some elements may not have been stored.
+    _upb_Array_ResizeUninitialized(arr, old_size, NULL);
+  }
+  return true;
+}
+
+upb_DecodeStatus upb_DecodeParallel(const char* buf, size_t size,
+                                    upb_Message* msg, const upb_MiniTable* l,
+                                    const upb_MiniTableField* field,
+                                    const upb_ExtensionRegistry* extreg,
+                                    int options, int thread_count,
+                                    upb_Arena* arena) {
+  UPB_ASSERT(upb_MiniTableField_CType(field) == kUpb_CType_Message);
+  UPB_ASSERT(upb_FieldMode_Get(field) == kUpb_FieldMode_Array);
+
+  // The elements are one level down, so they are decoded with one less level
+  // of nesting allowed.
+  unsigned depth = (unsigned)options >> 16;
+  if (depth == 0) depth = kUpb_WireFormat_DefaultDepthLimit;
+  int elem_options = upb_DecodeOptions_MaxDepth(depth - 1) | (options & 0xffff);
+
+  if (thread_count <= 1 || depth <= 1 ||
+      upb_MiniTableField_Type(field) != kUpb_FieldType_Message ||
+      _upb_MiniTableField_HasInlineMessages(field) ||
+      !upb_MiniTable_MessageFieldIsLinked(l, field)) {
+    return upb_Decode(buf, size, msg, l, extreg, options, arena);
+  }
+
+  upb_Arena* scratch = upb_Arena_New();
+  if (!scratch) return kUpb_DecodeStatus_OutOfMemory;
+
+  upb_DecodeParallel_Vec elems = {NULL, 0, 0};
+  upb_DecodeParallel_Vec rest = {NULL, 0, 0};
+  upb_DecodeStatus status = _upb_DecodeParallel_Scan(
+      buf, size, field->number, &elems, &rest, scratch);
+
+  if (status == kUpb_DecodeStatus_Ok) {
+    size_t elem_bytes = 0;
+    const upb_StringView* elem = elems.data;
+    for (size_t i = 0; i < elems.size; i++) elem_bytes += elem[i].size;
+
+    size_t count = elem_bytes / kUpb_DecodeParallel_MinBytesPerThread;
+    count = UPB_MIN(count, UPB_MIN((size_t)thread_count, elems.size));
+    if (count <= 1 ||
+        !_upb_DecodeParallel_Elements(&elems, &rest, elem_bytes, (int)count,
+                                      msg, l, field, extreg, options,
+                                      elem_options, arena, scratch, &status)) {
+      status = upb_Decode(buf, size, msg, l, extreg, options, arena);
+    }
+  }
+
+  upb_Arena_Free(scratch);
+  return status;
+}
+
+#else  // _WIN32
+
+upb_DecodeStatus upb_DecodeParallel(const char* buf, size_t size,
+                                    upb_Message* msg, const upb_MiniTable* l,
+                                    const upb_MiniTableField* field,
+                                    const upb_ExtensionRegistry* extreg,
+                                    int options, int thread_count,
+                                    upb_Arena* arena) {
+  return upb_Decode(buf, size, msg, l, extreg, options, arena);
+}
+
+#endif  // _WIN32
@@ -0,0 +1,76 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_WIRE_PARALLEL_DECODE_H_
+#define UPB_WIRE_PARALLEL_DECODE_H_
+
+#include "upb/wire/decode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Like upb_Decode(), but splits the elements of `field`, a repeated message
+// field of `l`, between up to `thread_count` threads.  This is meant for large
+// batch messages that are mostly one repeated field, such as
+// `repeated Record records = 1;`.
+//
+// The top level of `buf` is first scanned to find the elements.  Each thread
+// then decodes a run of them with upb_DecodeBatch() into an arena of its own,
+// fused with `arena`, while the calling thread also decodes the other
+// top-level fields.  The elements are appended to `field` in their original
+// order, so the result is the same as from upb_Decode().  If the input has
+// more than one error, the status may name a different one than upb_Decode()
+// would.
+//
+// Threads are started for each call and joined before it returns.  Everything
+// is decoded by upb_Decode() on the calling thread instead if `thread_count`
+// is 1 or less, if the elements are too few or too small to be worth a
+// thread, if `arena` cannot be fused (because it has an initial block), if the
+// elements are unlinked or stored inline (see
+// upb_MiniTable_SetInlineSubMessage()), or where threads are not supported.
+//
+// `extreg` and the mini tables are read from several threads at once, and must
+// not be modified during the call.
+UPB_API upb_DecodeStatus upb_DecodeParallel(
+    const char* buf, size_t size, upb_Message* msg, const upb_MiniTable* l,
+    const upb_MiniTableField* field, const upb_ExtensionRegistry* extreg,
+    int options, int thread_count, upb_Arena* arena);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_WIRE_PARALLEL_DECODE_H_ */
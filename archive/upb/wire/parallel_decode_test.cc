@@ -0,0 +1,240 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "upb/wire/parallel_decode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/mem/arena.hpp"
+#include "upb/mini_table/message.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+#include "upb/wire/types.h"
+
+namespace {
+
+using TestMessage = protobuf_test_messages_proto2_TestAllTypesProto2;
+
+const upb_MiniTable* kMiniTable =
+    &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init;
+
+void AppendVarint(std::string* out, uint64_t val) {
+  do {
+    char byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back(byte);
+  } while (val);
+}
+
+void AppendDelimited(std::string* out, uint32_t number,
+                     const std::string& value) {
+  AppendVarint(out, number << 3 | kUpb_WireType_Delimited);
+  AppendVarint(out, value.size());
+  out->append(value);
+}
+
+// Returns `count` elements of repeated_nested_message (field 48), each
+// {a: i, corecursive: {optional_string: "..."}}, with optional_int32 and an
+// unknown field between some of them.  The string is moved `depth` levels
+// further down through corecursive.optional_nested_message (field 18).
+std::string MakeInput(int count, int depth = 0) {
+  std::string ret;
+  for (int i = 0; i < count; i++) {
+    if (i % 1000 == 500) {
+      AppendVarint(&ret, 1 << 3 | kUpb_WireType_Varint);
+      AppendVarint(&ret, i);
+      AppendVarint(&ret, 9999 << 3 | kUpb_WireType_Varint);
+      AppendVarint(&ret, i);
+    }
+    std::string inner;
+    AppendDelimited(&inner, 14, "a string long enough to matter");
+    for (int j = 0; j < depth; j++) {
+      std::string nested;
+      AppendDelimited(&nested, 2, inner);
+      inner.clear();
+      AppendDelimited(&inner, 18, nested);
+    }
+    std::string elem;
+    AppendVarint(&elem, 1 << 3 | kUpb_WireType_Varint);
+    AppendVarint(&elem, i);
+    AppendDelimited(&elem, 2, inner);
+    AppendDelimited(&ret, 48, elem);
+  }
+  return ret;
+}
+
+upb_DecodeStatus DecodeParallel(const std::string& input, TestMessage* msg,
+                                int options, int threads, upb_Arena* arena) {
+  return upb_DecodeParallel(input.data(), input.size(), (upb_Message*)msg,
+                            kMiniTable,
+                            upb_MiniTable_FindFieldByNumber(kMiniTable, 48),
+                            nullptr, options, threads, arena);
+}
+
+upb_DecodeStatus Decode(const std::string& input, TestMessage* msg,
+                        int options, upb_Arena* arena) {
+  return upb_Decode(input.data(), input.size(), (upb_Message*)msg, kMiniTable,
+                    nullptr, options, arena);
+}
+
+// Returns the `a` field of each element of repeated_nested_message.
+std::vector<int32_t> Elements(const TestMessage* msg) {
+  size_t size;
+  auto elems =
+      protobuf_test_messages_proto2_TestAllTypesProto2_repeated_nested_message(
+          msg, &size);
+  std::vector<int32_t> ret;
+  for (size_t i = 0; i < size; i++) {
+    ret.push_back(
+        protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_a(
+            elems[i]));
+  }
+  return ret;
+}
+
+std::vector<int32_t> Range(int32_t count) {
+  std::vector<int32_t> ret;
+  for (int32_t i = 0; i < count; i++) ret.push_back(i);
+  return ret;
+}
+
+TestMessage* NewMessage(upb_Arena* arena) {
+  return protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+}
+
+std::string Serialize(const TestMessage* msg, upb_Arena* arena) {
+  char* data;
+  size_t size;
+  EXPECT_EQ(kUpb_EncodeStatus_Ok,
+            upb_Encode(msg, kMiniTable, kUpb_EncodeOption_Deterministic,
+                       arena, &data, &size));
+  return std::string(data, size);
+}
+
+TEST(ParallelDecodeTest, MatchesDecode) {
+  std::string input = MakeInput(20000);
+  upb::Arena arena;
+  TestMessage* expected = NewMessage(arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, Decode(input, expected, 0, arena.ptr()));
+  std::string expected_data = Serialize(expected, arena.ptr());
+
+  for (int threads : {1, 2, 3, 8, 64}) {
+    upb::Arena arena2;
+    TestMessage* msg = NewMessage(arena2.ptr());
+    ASSERT_EQ(kUpb_DecodeStatus_Ok,
+              DecodeParallel(input, msg, 0, threads, arena2.ptr()))
+        << threads;
+    EXPECT_EQ(Range(20000), Elements(msg)) << threads;
+    EXPECT_EQ(19500,
+              protobuf_test_messages_proto2_TestAllTypesProto2_optional_int32(
+                  msg));
+    EXPECT_EQ(expected_data, Serialize(msg, arena2.ptr())) << threads;
+  }
+}
+
+TEST(ParallelDecodeTest, AliasString) {
+  std::string input = MakeInput(20000);
+  upb::Arena arena;
+  TestMessage* expected = NewMessage(arena.ptr());
+  TestMessage* msg = NewMessage(arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok, Decode(input, expected, 0, arena.ptr()));
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            DecodeParallel(input, msg, kUpb_DecodeOption_AliasString, 4,
+                           arena.ptr()));
+  EXPECT_EQ(Serialize(expected, arena.ptr()), Serialize(msg, arena.ptr()));
+}
+
+TEST(ParallelDecodeTest, AppendsToExistingElements) {
+  std::string input = MakeInput(20000);
+  upb::Arena arena;
+  TestMessage* msg = NewMessage(arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            DecodeParallel(input, msg, 0, 4, arena.ptr()));
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            DecodeParallel(input, msg, 0, 4, arena.ptr()));
+  std::vector<int32_t> expected = Range(20000);
+  expected.insert(expected.end(), expected.begin(), expected.end());
+  EXPECT_EQ(expected, Elements(msg));
+}
+
+TEST(ParallelDecodeTest, MalformedElement) {
+  std::string input = MakeInput(20000);
+  std::string elem;
+  AppendVarint(&elem, 1 << 3 | kUpb_WireType_Delimited);
+  AppendVarint(&elem, 100);  // Longer than the element.
+  std::string field;
+  AppendDelimited(&field, 48, elem);
+  input.insert(input.size() / 2, field);
+
+  upb::Arena arena;
+  TestMessage* msg = NewMessage(arena.ptr());
+  EXPECT_EQ(kUpb_DecodeStatus_Malformed,
+            DecodeParallel(input, msg, 0, 4, arena.ptr()));
+  EXPECT_EQ(std::vector<int32_t>(), Elements(msg));
+}
+
+TEST(ParallelDecodeTest, MalformedTopLevel) {
+  std::string input = MakeInput(20000);
+  input.pop_back();
+  upb::Arena arena;
+  TestMessage* msg = NewMessage(arena.ptr());
+  EXPECT_EQ(kUpb_DecodeStatus_Malformed,
+            DecodeParallel(input, msg, 0, 4, arena.ptr()));
+}
+
+TEST(ParallelDecodeTest, DepthLimit) {
+  std::string input = MakeInput(20000, 2);
+  for (int limit = 1; limit < 8; limit++) {
+    int options = upb_DecodeOptions_MaxDepth(limit);
+    upb::Arena arena;
+    EXPECT_EQ(Decode(input, NewMessage(arena.ptr()), options, arena.ptr()),
+              DecodeParallel(input, NewMessage(arena.ptr()), options, 4,
+                             arena.ptr()))
+        << limit;
+  }
+}
+
+TEST(ParallelDecodeTest, ArenaWithInitialBlock) {
+  // This arena cannot be fused, so everything is decoded on this thread.
+  std::string input = MakeInput(20000);
+  char initial[1024];
+  upb::Arena arena(initial, sizeof(initial));
+  TestMessage* msg = NewMessage(arena.ptr());
+  ASSERT_EQ(kUpb_DecodeStatus_Ok,
+            DecodeParallel(input, msg, 0, 4, arena.ptr()));
+  EXPECT_EQ(Range(20000), Elements(msg));
+}
+
+}  // namespace
@@ -0,0 +1,209 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// For pthreads, which are not part of C99.
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "upb/wire/parallel_encode.h"
+
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "upb/collections/internal/array.h"
+#include "upb/mem/arena.h"
+#include "upb/message/accessors.h"
+#include "upb/mini_table/internal/message.h"
+#include "upb/wire/internal/encode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifndef _WIN32
+
+enum {
+  // Fewer elements than this are encoded faster than a thread can be started.
+  kUpb_EncodeParallel_MinElementsPerThread = 1024,
+};
+
+typedef struct {
+  const upb_Message* msg;
+  const upb_MiniTable* mini_table;
+  const upb_MiniTableField* field;
+  size_t begin;
+  size_t end;
+  int options;
+  upb_Arena* arena;  // Holds the output until it is copied.
+  char* buf;
+  size_t size;
+  upb_EncodeStatus status;
+  pthread_t thread;
+  bool started;
+} upb_EncodeParallel_Chunk;
+
+static void _upb_EncodeParallel_Run(upb_EncodeParallel_Chunk* c) {
+  c->status = _upb_Encode_ArraySlice(c->msg, c->mini_table, c->field, c->begin,
+                                     c->end, c->options, c->arena, &c->buf,
+                                     &c->size);
+}
+
+static void* _upb_EncodeParallel_Thread(void* arg) {
+  _upb_EncodeParallel_Run(arg);
+  return NULL;
+}
+
+// Encodes the elements on `count` threads (including this one) and the other
+// fields on this one, and copies the pieces together.
+static upb_EncodeStatus _upb_EncodeParallel_Chunks(
+    const upb_Message* msg, const upb_MiniTable* l,
+    const upb_MiniTableField* field, size_t elem_count, int options,
+    int count, upb_Arena* arena, upb_Arena* scratch, char** buf,
+    size_t* size) {
+  upb_EncodeParallel_Chunk* chunks =
+      upb_Arena_Malloc(scratch, count * sizeof(*chunks));
+  if (!chunks) return kUpb_EncodeStatus_OutOfMemory;
+  memset(chunks, 0, count * sizeof(*chunks));
+
+  for (int i = 0; i < count; i++) {
+    upb_EncodeParallel_Chunk* c = &chunks[i];
+    c->msg = msg;
+    c->mini_table = l;
+    c->field = field;
+    c->begin = elem_count * i / count;
+    c->end = elem_count * (i + 1) / count;
+    c->options = options;
+    c->arena = i == 0 ? scratch : upb_Arena_New();
+    if (!c->arena) {
+      c->status = kUpb_EncodeStatus_OutOfMemory;
+    } else if (i > 0) {
+      c->started = pthread_create(&c->thread, NULL, _upb_EncodeParallel_Thread,
+                                  c) == 0;
+    }
+  }
+
+  // The elements go between the fields before and after `field`.
+  size_t index = field - l->fields;
+  char* prefix = NULL;
+  char* suffix = NULL;
+  size_t prefix_size = 0;
+  size_t suffix_size = 0;
+  upb_EncodeStatus status = _upb_Encode_FieldRange(
+      msg, l, 0, index, false, options, scratch, &prefix, &prefix_size);
+  if (status == kUpb_EncodeStatus_Ok) {
+    status = _upb_Encode_FieldRange(msg, l, index + 1, l->field_count, true,
+                                    options, scratch, &suffix, &suffix_size);
+  }
+  _upb_EncodeParallel_Run(&chunks[0]);
+
+  size_t total = prefix_size + suffix_size;
+  for (int i = 1; i < count; i++) {
+    upb_EncodeParallel_Chunk* c = &chunks[i];
+    if (c->started) {
+      pthread_join(c->thread, NULL);
+    } else if (c->arena) {
+      _upb_EncodeParallel_Run(c);
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    if (status == kUpb_EncodeStatus_Ok) status = chunks[i].status;
+    total += chunks[i].size;
+  }
+
+  char* out = NULL;
+  if (status == kUpb_EncodeStatus_Ok) {
+    out = upb_Arena_Malloc(arena, total);
+    if (!out) status = kUpb_EncodeStatus_OutOfMemory;
+  }
+  if (out) {
+    char* ptr = out;
+    if (prefix_size) memcpy(ptr, prefix, prefix_size);
+    ptr += prefix_size;
+    for (int i = 0; i < count; i++) {
+      if (chunks[i].size) memcpy(ptr, chunks[i].buf, chunks[i].size);
+      ptr += chunks[i].size;
+    }
+    if (suffix_size) memcpy(ptr, suffix, suffix_size);
+  }
+
+  for (int i = 1; i < count; i++) {
+    if (chunks[i].arena) upb_Arena_Free(chunks[i].arena);
+  }
+  *buf = out;
+  *size = out ? total : 0;
+  return status;
+}
+
+upb_EncodeStatus upb_EncodeParallel(const upb_Message* msg,
+                                    const upb_MiniTable* l,
+                                    const upb_MiniTableField* field,
+                                    int options, int thread_count,
+                                    upb_Arena* arena, char** buf,
+                                    size_t* size) {
+  UPB_ASSERT(field >= l->fields && field < l->fields + l->field_count);
+  UPB_ASSERT(upb_MiniTableField_CType(field) == kUpb_CType_Message);
+  UPB_ASSERT(upb_FieldMode_Get(field) == kUpb_FieldMode_Array);
+
+  const upb_Array* arr = upb_Message_GetArray(msg, field);
+  size_t elem_count = arr ? upb_Array_Size(arr) : 0;
+  size_t count = elem_count / kUpb_EncodeParallel_MinElementsPerThread;
+  count = UPB_MIN(count, (size_t)UPB_MAX(thread_count, 1));
+
+  if (count <= 1 || _upb_Array_HasInlineMessages(arr)) {
+    return upb_Encode(msg, l, options, arena, buf, size);
+  }
+
+  upb_Arena* scratch = upb_Arena_New();
+  if (!scratch) {
+    *buf = NULL;
+    *size = 0;
+    return kUpb_EncodeStatus_OutOfMemory;
+  }
+  upb_EncodeStatus status =
+      _upb_EncodeParallel_Chunks(msg, l, field, elem_count, options,
+                                 (int)count, arena, scratch, buf, size);
+  upb_Arena_Free(scratch);
+  return status;
+}
+
+#else  // _WIN32
+
+upb_EncodeStatus upb_EncodeParallel(const upb_Message* msg,
+                                    const upb_MiniTable* l,
+                                    const upb_MiniTableField* field,
+                                    int options, int thread_count,
+                                    upb_Arena* arena, char** buf,
+                                    size_t* size) {
+  return upb_Encode(msg, l, options, arena, buf, size);
+}
+
+#endif  // _WIN32
@@ -0,0 +1,74 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_WIRE_PARALLEL_ENCODE_H_
+#define UPB_WIRE_PARALLEL_ENCODE_H_
+
+#include "upb/wire/encode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Like upb_Encode(), but splits the elements of `field`, a repeated message
+// field of `l`, between up to `thread_count` threads.  This is the
+// counterpart of upb_DecodeParallel(), for large responses that are mostly
+// one repeated field.
+//
+// Each thread encodes a run of elements into a buffer of its own, while the
+// calling thread encodes the other fields.  The pieces are then copied
+// together into one buffer from `arena`.  The output is the same as from
+// upb_Encode().
+//
+// Threads are started for each call and joined before it returns.  Everything
+// is encoded by upb_Encode() on the calling thread instead if `thread_count`
+// is 1 or less, if the field has too few elements to be worth a thread, if
+// the elements are stored inline (see upb_MiniTable_SetInlineSubMessage()),
+// or where threads are not supported.
+//
+// `msg` is read from several threads at once, and must not be modified
+// during the call.
+UPB_API upb_EncodeStatus upb_EncodeParallel(const upb_Message* msg,
+                                            const upb_MiniTable* l,
+                                            const upb_MiniTableField* field,
+                                            int options, int thread_count,
+                                            upb_Arena* arena, char** buf,
+                                            size_t* size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_WIRE_PARALLEL_ENCODE_H_ */
@@ -0,0 +1,172 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "upb/wire/parallel_encode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/mem/arena.hpp"
+#include "upb/mini_table/message.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+#include "upb/wire/types.h"
+
+namespace {
+
+using TestMessage = protobuf_test_messages_proto2_TestAllTypesProto2;
+
+const upb_MiniTable* kMiniTable =
+    &protobuf_test_messages_proto2_TestAllTypesProto2_msg_init;
+
+void AppendVarint(std::string* out, uint64_t val) {
+  do {
+    char byte = val & 0x7f;
+    val >>= 7;
+    if (val) byte |= 0x80;
+    out->push_back(byte);
+  } while (val);
+}
+
+void AppendDelimited(std::string* out, uint32_t number,
+                     const std::string& value) {
+  AppendVarint(out, number << 3 | kUpb_WireType_Delimited);
+  AppendVarint(out, value.size());
+  out->append(value);
+}
+
+// Returns a message with `count` elements of repeated_nested_message (field
+// 48), each {a: i, corecursive: {optional_string: "..."}}, and some fields on
+// either side of it in the mini table, including an unknown field.
+TestMessage* MakeMessage(int count, upb_Arena* arena) {
+  std::string data;
+  AppendVarint(&data, 1 << 3 | kUpb_WireType_Varint);
+  AppendVarint(&data, 123);
+  AppendDelimited(&data, 14, "before");
+  AppendVarint(&data, 9999 << 3 | kUpb_WireType_Varint);
+  AppendVarint(&data, 456);
+  for (int i = 0; i < count; i++) {
+    std::string inner;
+    AppendDelimited(&inner, 14, "a string long enough to matter");
+    std::string elem;
+    AppendVarint(&elem, 1 << 3 | kUpb_WireType_Varint);
+    AppendVarint(&elem, i);
+    AppendDelimited(&elem, 2, inner);
+    AppendDelimited(&data, 48, elem);
+  }
+  std::string entry;
+  AppendVarint(&entry, 1 << 3 | kUpb_WireType_Varint);
+  AppendVarint(&entry, 7);
+  AppendVarint(&entry, 2 << 3 | kUpb_WireType_Varint);
+  AppendVarint(&entry, 8);
+  AppendDelimited(&data, 56, entry);
+
+  TestMessage* msg =
+      protobuf_test_messages_proto2_TestAllTypesProto2_new(arena);
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            upb_Decode(data.data(), data.size(), (upb_Message*)msg, kMiniTable,
+                       nullptr, 0, arena));
+  return msg;
+}
+
+upb_EncodeStatus EncodeParallel(const TestMessage* msg, int options,
+                                int threads, upb_Arena* arena,
+                                std::string* out) {
+  char* buf;
+  size_t size;
+  upb_EncodeStatus status = upb_EncodeParallel(
+      msg, kMiniTable, upb_MiniTable_FindFieldByNumber(kMiniTable, 48),
+      options, threads, arena, &buf, &size);
+  if (status == kUpb_EncodeStatus_Ok) {
+    out->assign(buf, size);
+  } else {
+    EXPECT_EQ(nullptr, buf);
+  }
+  return status;
+}
+
+upb_EncodeStatus Encode(const TestMessage* msg, int options, upb_Arena* arena,
+                        std::string* out) {
+  char* buf;
+  size_t size;
+  upb_EncodeStatus status = upb_Encode(msg, kMiniTable, options, arena, &buf,
+                                       &size);
+  if (status == kUpb_EncodeStatus_Ok) out->assign(buf, size);
+  return status;
+}
+
+TEST(ParallelEncodeTest, MatchesEncode) {
+  upb::Arena arena;
+  for (int count : {0, 1, 2047, 2048, 20000}) {
+    TestMessage* msg = MakeMessage(count, arena.ptr());
+    std::string expected;
+    ASSERT_EQ(kUpb_EncodeStatus_Ok,
+              Encode(msg, kUpb_EncodeOption_Deterministic, arena.ptr(),
+                     &expected));
+    for (int threads : {0, 1, 2, 3, 8, 64}) {
+      std::string data;
+      ASSERT_EQ(kUpb_EncodeStatus_Ok,
+                EncodeParallel(msg, kUpb_EncodeOption_Deterministic, threads,
+                               arena.ptr(), &data));
+      EXPECT_EQ(expected, data) << count << " " << threads;
+    }
+  }
+}
+
+TEST(ParallelEncodeTest, SkipUnknown) {
+  upb::Arena arena;
+  TestMessage* msg = MakeMessage(20000, arena.ptr());
+  std::string expected;
+  std::string data;
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            Encode(msg, kUpb_EncodeOption_SkipUnknown, arena.ptr(), &expected));
+  ASSERT_EQ(kUpb_EncodeStatus_Ok,
+            EncodeParallel(msg, kUpb_EncodeOption_SkipUnknown, 4, arena.ptr(),
+                           &data));
+  EXPECT_EQ(expected, data);
+}
+
+TEST(ParallelEncodeTest, DepthLimit) {
+  upb::Arena arena;
+  TestMessage* msg = MakeMessage(20000, arena.ptr());
+  for (int limit = 1; limit < 5; limit++) {
+    int options = upb_EncodeOptions_MaxDepth(limit);
+    std::string expected;
+    std::string data;
+    EXPECT_EQ(Encode(msg, options, arena.ptr(), &expected),
+              EncodeParallel(msg, options, 4, arena.ptr(), &data))
+        << limit;
+    EXPECT_EQ(expected, data) << limit;
+  }
+}
+
+}  // namespace
@@ -0,0 +1,171 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/scanner.h"
+
+#include <string.h>
+
+#include "upb/wire/eps_copy_input_stream.h"
+#include "upb/wire/internal/swap.h"
+#include "upb/wire/reader.h"
+#include "upb/wire/types.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+static void _upb_WireScanner_Start(upb_WireScanner* s, const char* buf,
+                                   size_t size, const char* origin) {
+  s->origin = origin;
+  s->end = buf - origin + size;
+  s->error = false;
+  upb_EpsCopyInputStream_Init(&s->input, &buf, size, true);
+  s->ptr = buf;
+}
+
+void upb_WireScanner_Init(upb_WireScanner* s, const char* buf, size_t size) {
+  _upb_WireScanner_Start(s, buf, size, buf);
+}
+
+bool upb_WireScanner_InitSub(upb_WireScanner* s, const upb_WireScanner* parent,
+                             const upb_WireField* field) {
+  if (field->wire_type != kUpb_WireType_Delimited) return false;
+  _upb_WireScanner_Start(s, parent->origin + field->offset, field->length,
+                         parent->origin);
+  return true;
+}
+
+// Skips a varint, checking the continuation bits of its first eight bytes at
+// once instead of one byte at a time.  Varints of 3-8 bytes are common for
+// large integers, timestamps and negative numbers.
+UPB_FORCEINLINE
+static const char* _upb_WireScanner_SkipVarint(const char* ptr) {
+  uint64_t word;
+  memcpy(&word, ptr, 8);
+  uint64_t ends = ~_upb_BigEndian_Swap64(word) & 0x8080808080808080;
+  if (UPB_LIKELY(ends)) {
+#ifdef __GNUC__
+    return ptr + (__builtin_ctzll(ends) >> 3) + 1;
+#else
+    while (*ptr & 0x80) ptr++;
+    return ptr + 1;
+#endif
+  }
+  return upb_WireReader_SkipVarint(ptr);
+}
+
+static size_t _upb_WireScanner_Offset(upb_WireScanner* s, const char* ptr) {
+  return upb_EpsCopyInputStream_GetAliasedPtr(&s->input, ptr) - s->origin;
+}
+
+static bool _upb_WireScanner_Error(upb_WireScanner* s) {
+  s->error = true;
+  return false;
+}
+
+// Skips the contents of a group up to and including its end-group tag, and
+// sets field->length.  Unlike upb_WireReader_SkipGroup(), this fails if the end
+// of the data is reached first.
+static const char* _upb_WireScanner_SkipGroup(upb_WireScanner* s,
+                                              const char* ptr, uint32_t tag,
+                                              upb_WireField* field) {
+  uint32_t end_group_tag = (tag & ~7U) | kUpb_WireType_EndGroup;
+  while (!upb_EpsCopyInputStream_IsDone(&s->input, &ptr)) {
+    const char* field_start = ptr;
+    uint32_t field_tag;
+    ptr = upb_WireReader_ReadTag(ptr, &field_tag);
+    if (!ptr) return NULL;
+    if (field_tag == end_group_tag) {
+      field->length = _upb_WireScanner_Offset(s, field_start) - field->offset;
+      return ptr;
+    }
+    ptr = upb_WireReader_SkipValue(ptr, field_tag, &s->input);
+    if (!ptr) return NULL;
+  }
+  return NULL;
+}
+
+bool upb_WireScanner_Next(upb_WireScanner* s, upb_WireField* field) {
+  const char* ptr = s->ptr;
+  if (upb_EpsCopyInputStream_IsDone(&s->input, &ptr)) {
+    if (upb_EpsCopyInputStream_IsError(&s->input)) {
+      return _upb_WireScanner_Error(s);
+    }
+    return false;
+  }
+
+  uint32_t tag;
+  ptr = upb_WireReader_ReadTag(ptr, &tag);
+  if (!ptr) return _upb_WireScanner_Error(s);
+  field->field_number = upb_WireReader_GetFieldNumber(tag);
+  field->wire_type = upb_WireReader_GetWireType(tag);
+  if (field->field_number == 0) return _upb_WireScanner_Error(s);
+
+  switch (field->wire_type) {
+    case kUpb_WireType_Varint: {
+      const char* end = _upb_WireScanner_SkipVarint(ptr);
+      if (!end) return _upb_WireScanner_Error(s);
+      field->length = end - ptr;
+      break;
+    }
+    case kUpb_WireType_64Bit:
+      field->length = 8;
+      break;
+    case kUpb_WireType_32Bit:
+      field->length = 4;
+      break;
+    case kUpb_WireType_Delimited: {
+      int size;
+      ptr = upb_WireReader_ReadSize(ptr, &size);
+      if (!ptr) return _upb_WireScanner_Error(s);
+      field->length = size;
+      break;
+    }
+    case kUpb_WireType_StartGroup:
+      field->offset = _upb_WireScanner_Offset(s, ptr);
+      ptr = _upb_WireScanner_SkipGroup(s, ptr, tag, field);
+      if (!ptr) return _upb_WireScanner_Error(s);
+      s->ptr = ptr;
+      return true;
+    default:
+      return _upb_WireScanner_Error(s);
+  }
+
+  // Values that run past the end of the data are only caught by the stream
+  // once it flips to the next buffer, so check them here before reporting
+  // them.
+  field->offset = _upb_WireScanner_Offset(s, ptr);
+  if (field->length > s->end - field->offset) return _upb_WireScanner_Error(s);
+  s->ptr = ptr + field->length;
+  return true;
+}
+
+size_t upb_WireScanner_Position(upb_WireScanner* s) {
+  return _upb_WireScanner_Offset(s, s->ptr);
+}
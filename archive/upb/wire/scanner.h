@@ -0,0 +1,124 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_WIRE_SCANNER_H_
+#define UPB_WIRE_SCANNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "upb/wire/eps_copy_input_stream.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The upb_WireScanner walks serialized protobuf data and reports where each
+// field is, without decoding it into a message.  It needs no arena and no
+// mini table, so it is suitable for indexing or extracting a few fields from
+// large inputs.  Nested messages are scanned by starting a sub-scanner over a
+// length-delimited field with upb_WireScanner_InitSub().
+//
+// Example:
+//
+//   upb_WireScanner s;
+//   upb_WireScanner_Init(&s, buf, size);
+//   upb_WireField f;
+//   while (upb_WireScanner_Next(&s, &f)) {
+//     if (f.field_number == 5) Index(f.offset, f.length);
+//   }
+//   if (upb_WireScanner_IsError(&s)) { ... }
+
+typedef struct {
+  uint32_t field_number;
+  uint8_t wire_type;  // A upb_WireType, never kUpb_WireType_EndGroup.
+
+  // The location of the value within the buffer given to the outermost
+  // upb_WireScanner_Init(), excluding the tag and, for length-delimited
+  // fields, the length prefix.  For groups this spans the group's contents,
+  // excluding the end-group tag.
+  size_t offset;
+  size_t length;
+} upb_WireField;
+
+// Internal-only; members are private.
+typedef struct {
+  upb_EpsCopyInputStream input;
+  const char* ptr;     // Parse position, possibly inside input.patch.
+  const char* origin;  // The outermost buffer, which offsets are relative to.
+  size_t end;          // Offset of the end of the data being scanned.
+  bool error;
+} upb_WireScanner;
+
+// Starts scanning the `size` bytes at `buf`, which must stay alive while the
+// scanner is in use.  The scanner must not be copied once initialized.
+UPB_API void upb_WireScanner_Init(upb_WireScanner* s, const char* buf,
+                                  size_t size);
+
+// Starts scanning the contents of `field`, a length-delimited field that was
+// just returned by `parent`, so that its sub-fields can be found.  Offsets
+// reported by `s` stay relative to the outermost buffer.  Returns false if
+// `field` is not length-delimited.  `parent` may continue to be used.
+UPB_API bool upb_WireScanner_InitSub(upb_WireScanner* s,
+                                     const upb_WireScanner* parent,
+                                     const upb_WireField* field);
+
+// Reads the next field into `*field` and skips past its value.  Returns false
+// at the end of the data or if the data is malformed (which can be told apart
+// with upb_WireScanner_IsError()); the scanner must not be used after that.
+UPB_API bool upb_WireScanner_Next(upb_WireScanner* s, upb_WireField* field);
+
+// Returns the offset (like upb_WireField.offset) at which the next field's tag
+// starts.  This is also where the field last returned by upb_WireScanner_Next()
+// ends, including any end-group tag, so consecutive calls bracket whole
+// fields.
+UPB_API size_t upb_WireScanner_Position(upb_WireScanner* s);
+
+// Returns true if upb_WireScanner_Next() stopped because of malformed data.
+UPB_API_INLINE bool upb_WireScanner_IsError(const upb_WireScanner* s) {
+  return s->error;
+}
+
+// Returns a pointer to the value of `field` (see upb_WireField.offset).
+UPB_API_INLINE const char* upb_WireScanner_Value(const upb_WireScanner* s,
+                                                 const upb_WireField* field) {
+  return s->origin + field->offset;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_WIRE_SCANNER_H_
@@ -0,0 +1,185 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/scanner.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "upb/wire/types.h"
+
+namespace {
+
+struct Field {
+  uint32_t number;
+  int wire_type;
+  std::string value;
+
+  bool operator==(const Field& other) const {
+    return number == other.number && wire_type == other.wire_type &&
+           value == other.value;
+  }
+};
+
+// Returns the fields of `data`, or of the sub-message at `path` within it, or an
+// empty vector on error.
+std::vector<Field> Scan(const std::string& data,
+                        std::vector<uint32_t> path = {}) {
+  std::vector<Field> ret;
+  upb_WireScanner scanners[2];
+  upb_WireScanner* s = &scanners[0];
+  upb_WireScanner_Init(s, data.data(), data.size());
+  upb_WireField f;
+  while (upb_WireScanner_Next(s, &f)) {
+    EXPECT_LE(f.offset + f.length, data.size());
+    if (!path.empty()) {
+      if (f.field_number == path[0]) {
+        path.erase(path.begin());
+        upb_WireScanner* sub = s == &scanners[0] ? &scanners[1] : &scanners[0];
+        EXPECT_TRUE(upb_WireScanner_InitSub(sub, s, &f));
+        s = sub;
+      }
+      continue;
+    }
+    EXPECT_EQ(data.data() + f.offset, upb_WireScanner_Value(s, &f));
+    ret.push_back({f.field_number, f.wire_type,
+                   std::string(data.data() + f.offset, f.length)});
+  }
+  if (upb_WireScanner_IsError(s)) return {};
+  return ret;
+}
+
+TEST(WireScannerTest, Empty) {
+  EXPECT_TRUE(Scan("").empty());
+}
+
+TEST(WireScannerTest, AllWireTypes) {
+  std::string data =
+      "\x08\x96\x01"                        // 1: varint 150
+      "\x11\x01\x02\x03\x04\x05\x06\x07\x08"  // 2: fixed64
+      "\x1a\x03"
+      "abc"                 // 3: "abc"
+      "\x23\x08\x01\x24"    // 4: group { 1: 1 }
+      "\x2d\x01\x02\x03\x04"  // 5: fixed32
+      "\x30\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01";  // 6: 10-byte varint
+  std::vector<Field> expected = {
+      {1, kUpb_WireType_Varint, "\x96\x01"},
+      {2, kUpb_WireType_64Bit, "\x01\x02\x03\x04\x05\x06\x07\x08"},
+      {3, kUpb_WireType_Delimited, "abc"},
+      {4, kUpb_WireType_StartGroup, "\x08\x01"},
+      {5, kUpb_WireType_32Bit, "\x01\x02\x03\x04"},
+      {6, kUpb_WireType_Varint, "\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01"},
+  };
+  EXPECT_EQ(expected, Scan(data));
+
+  // Offsets stay correct wherever the data falls relative to the stream's
+  // internal buffer boundaries.
+  for (int pad = 1; pad < 40; pad++) {
+    std::string padded = "\x3a" + std::string(1, pad) + std::string(pad, 'x');
+    std::vector<Field> padded_expected = {
+        {7, kUpb_WireType_Delimited, std::string(pad, 'x')}};
+    padded_expected.insert(padded_expected.end(), expected.begin(),
+                           expected.end());
+    EXPECT_EQ(padded_expected, Scan(padded + data)) << pad;
+  }
+}
+
+TEST(WireScannerTest, Position) {
+  std::string data =
+      "\x08\x96\x01"        // 1: varint 150
+      "\x23\x08\x01\x24"    // 4: group { 1: 1 }
+      "\x1a\x03"
+      "abc";  // 3: "abc"
+  for (int pad = 1; pad < 40; pad++) {
+    std::string padded = "\x3a" + std::string(1, pad) + std::string(pad, 'x') +
+                         data + "\x08\x01";
+    upb_WireScanner s;
+    upb_WireScanner_Init(&s, padded.data(), padded.size());
+    EXPECT_EQ(0, upb_WireScanner_Position(&s));
+
+    // Each field lies between the positions before and after it.
+    std::vector<size_t> ends;
+    size_t start = 0;
+    upb_WireField f;
+    while (upb_WireScanner_Next(&s, &f)) {
+      size_t end = upb_WireScanner_Position(&s);
+      EXPECT_LT(start, f.offset) << pad;
+      EXPECT_LE(f.offset + f.length, end) << pad;
+      ends.push_back(end);
+      start = end;
+    }
+    EXPECT_FALSE(upb_WireScanner_IsError(&s));
+    size_t base = pad + 2;
+    std::vector<size_t> expected = {base, base + 3, base + 7, base + 12,
+                                    base + 14};
+    EXPECT_EQ(expected, ends) << pad;
+  }
+}
+
+TEST(WireScannerTest, SubMessage) {
+  std::string inner = "\x08\x01\x12\x02hi";
+  std::string data = "\x08\x05" "\x12" + std::string(1, inner.size()) + inner +
+                     "\x18\x07";
+  std::vector<Field> expected = {
+      {1, kUpb_WireType_Varint, "\x01"},
+      {2, kUpb_WireType_Delimited, "hi"},
+  };
+  EXPECT_EQ(expected, Scan(data, {2}));
+
+  upb_WireScanner s, sub;
+  upb_WireScanner_Init(&s, data.data(), data.size());
+  upb_WireField f;
+  ASSERT_TRUE(upb_WireScanner_Next(&s, &f));
+  EXPECT_FALSE(upb_WireScanner_InitSub(&sub, &s, &f));
+}
+
+TEST(WireScannerTest, Malformed) {
+  for (const std::string& data : std::vector<std::string>{
+           "\x08",                       // Missing varint.
+           "\x12\x05"
+           "abc",                         // Truncated string.
+           "\x11\x01\x02",               // Truncated fixed64.
+           "\x23\x08\x01",               // Unterminated group.
+           "\x24",                       // Unexpected end group.
+           std::string("\x00\x01", 2),   // Field number zero.
+           "\x0f",                       // Invalid wire type.
+       }) {
+    upb_WireScanner s;
+    upb_WireScanner_Init(&s, data.data(), data.size());
+    upb_WireField f;
+    while (upb_WireScanner_Next(&s, &f)) {
+    }
+    EXPECT_TRUE(upb_WireScanner_IsError(&s)) << data;
+  }
+}
+
+}  // namespace
@@ -0,0 +1,482 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/validate.h"
+
+#include <string.h>
+
+#include "upb/base/descriptor_constants.h"
+#include "upb/lex/utf8.h"
+#include "upb/mini_table/enum.h"
+#include "upb/mini_table/extension.h"
+#include "upb/mini_table/field.h"
+#include "upb/mini_table/internal/message.h"
+#include "upb/mini_table/sub.h"
+#include "upb/wire/eps_copy_input_stream.h"
+#include "upb/wire/internal/common.h"
+#include "upb/wire/reader.h"
+#include "upb/wire/types.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+// The validator follows the structure of the decoder in decode.c, keeping
+// only the checks that can fail a parse, so that the two agree on which
+// inputs are valid.
+
+#define VALIDATE_NOGROUP (uint32_t) - 1
+
+typedef struct {
+  upb_EpsCopyInputStream input;
+  const upb_ExtensionRegistry* extreg;
+  int depth;
+  uint32_t end_group;  // field number of END_GROUP tag, else VALIDATE_NOGROUP.
+  uint16_t options;
+  bool missing_required;
+  upb_DecodeStatus status;
+  jmp_buf err;
+} upb_Validator;
+
+enum {
+  kUpb_Validator_VarintTypes =
+      (1 << kUpb_FieldType_Int64) | (1 << kUpb_FieldType_UInt64) |
+      (1 << kUpb_FieldType_Int32) | (1 << kUpb_FieldType_Bool) |
+      (1 << kUpb_FieldType_UInt32) | (1 << kUpb_FieldType_Enum) |
+      (1 << kUpb_FieldType_SInt32) | (1 << kUpb_FieldType_SInt64),
+  kUpb_Validator_Fixed32Types = (1 << kUpb_FieldType_Float) |
+                                (1 << kUpb_FieldType_Fixed32) |
+                                (1 << kUpb_FieldType_SFixed32),
+  kUpb_Validator_Fixed64Types = (1 << kUpb_FieldType_Double) |
+                                (1 << kUpb_FieldType_Fixed64) |
+                                (1 << kUpb_FieldType_SFixed64),
+};
+
+enum {
+  kStartItemTag = ((kUpb_MsgSet_Item << 3) | kUpb_WireType_StartGroup),
+  kEndItemTag = ((kUpb_MsgSet_Item << 3) | kUpb_WireType_EndGroup),
+  kTypeIdTag = ((kUpb_MsgSet_TypeId << 3) | kUpb_WireType_Varint),
+  kMessageTag = ((kUpb_MsgSet_Message << 3) | kUpb_WireType_Delimited),
+};
+
+static const char* _upb_Validator_ValidateMessage(upb_Validator* v,
+                                                  const char* ptr,
+                                                  const upb_MiniTable* t);
+
+UPB_NORETURN static void _upb_Validator_ErrorJmp(upb_Validator* v,
+                                                 upb_DecodeStatus status) {
+  UPB_ASSERT(status != kUpb_DecodeStatus_Ok);
+  v->status = status;
+  UPB_LONGJMP(v->err, 1);
+}
+
+UPB_FORCEINLINE
+static bool _upb_Validator_IsDone(upb_Validator* v, const char** ptr) {
+  if (!upb_EpsCopyInputStream_IsDone(&v->input, ptr)) return false;
+  if (upb_EpsCopyInputStream_IsError(&v->input)) {
+    _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  }
+  return true;
+}
+
+UPB_FORCEINLINE
+static const char* _upb_Validator_ReadVarint(upb_Validator* v,
+                                             const char* ptr, uint64_t* val) {
+  ptr = upb_WireReader_ReadVarint(ptr, val);
+  if (!ptr) _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  return ptr;
+}
+
+UPB_FORCEINLINE
+static const char* _upb_Validator_ReadTag(upb_Validator* v, const char* ptr,
+                                          uint32_t* tag) {
+  ptr = upb_WireReader_ReadTag(ptr, tag);
+  if (!ptr) _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  return ptr;
+}
+
+UPB_FORCEINLINE
+static const char* _upb_Validator_ReadSize(upb_Validator* v, const char* ptr,
+                                           int* size) {
+  ptr = upb_WireReader_ReadSize(ptr, size);
+  if (!ptr || !upb_EpsCopyInputStream_CheckSize(&v->input, ptr, *size)) {
+    _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  }
+  return ptr;
+}
+
+// Returns true if the `size` bytes at `ptr` are a sequence of whole varints
+// of at most 10 bytes each.  Bytes without a continuation bit are skipped
+// eight at a time, which is the common case for small values.
+static bool _upb_Validator_CheckVarints(const char* ptr, size_t size) {
+  const char* end = ptr + size;
+  int run = 0;  // Continuation bytes in the current varint.
+  while (ptr < end) {
+    if (run == 0 && end - ptr >= 8) {
+      uint64_t word;
+      memcpy(&word, ptr, 8);
+      if ((word & 0x8080808080808080) == 0) {
+        ptr += 8;
+        continue;
+      }
+    }
+    if (*ptr++ & 0x80) {
+      if (++run == 10) return false;
+    } else {
+      run = 0;
+    }
+  }
+  return run == 0;
+}
+
+static const char* _upb_Validator_Recurse(upb_Validator* v, const char* ptr,
+                                          const upb_MiniTable* t,
+                                          uint32_t expected_end_group) {
+  if (--v->depth < 0) {
+    _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_MaxDepthExceeded);
+  }
+  ptr = _upb_Validator_ValidateMessage(v, ptr, t);
+  v->depth++;
+  if (v->end_group != expected_end_group) {
+    _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  }
+  return ptr;
+}
+
+static const char* _upb_Validator_ValidateSubMessage(upb_Validator* v,
+                                                     const char* ptr,
+                                                     const upb_MiniTable* t,
+                                                     int size) {
+  int saved_delta = upb_EpsCopyInputStream_PushLimit(&v->input, ptr, size);
+  ptr = _upb_Validator_Recurse(v, ptr, t, VALIDATE_NOGROUP);
+  upb_EpsCopyInputStream_PopLimit(&v->input, ptr, saved_delta);
+  return ptr;
+}
+
+// Validates the group `number` up to and including its end-group tag, with
+// `t` as its type or NULL if it is an unknown field.
+static const char* _upb_Validator_ValidateGroup(upb_Validator* v,
+                                                const char* ptr,
+                                                const upb_MiniTable* t,
+                                                uint32_t number) {
+  if (_upb_Validator_IsDone(v, &ptr)) {
+    _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  }
+  ptr = _upb_Validator_Recurse(v, ptr, t, number);
+  v->end_group = VALIDATE_NOGROUP;
+  return ptr;
+}
+
+static const char* _upb_Validator_SkipField(upb_Validator* v, const char* ptr,
+                                            uint32_t tag) {
+  switch (tag & 7) {
+    case kUpb_WireType_Varint: {
+      uint64_t val;
+      return _upb_Validator_ReadVarint(v, ptr, &val);
+    }
+    case kUpb_WireType_64Bit:
+      return ptr + 8;
+    case kUpb_WireType_32Bit:
+      return ptr + 4;
+    case kUpb_WireType_Delimited: {
+      int size;
+      ptr = _upb_Validator_ReadSize(v, ptr, &size);
+      return ptr + size;
+    }
+    case kUpb_WireType_StartGroup:
+      return _upb_Validator_ValidateGroup(v, ptr, NULL, tag >> 3);
+    default:
+      _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  }
+}
+
+static const char* _upb_Validator_ValidateMessageSetItem(
+    upb_Validator* v, const char* ptr, const upb_MiniTable* t) {
+  uint32_t type_id = 0;
+  bool have_id = false;
+  const char* payload = NULL;  // Aliased, once seen.
+  int payload_size = 0;
+  while (!_upb_Validator_IsDone(v, &ptr)) {
+    uint32_t tag;
+    ptr = _upb_Validator_ReadTag(v, ptr, &tag);
+    switch (tag) {
+      case kEndItemTag:
+        return ptr;
+      case kTypeIdTag: {
+        uint64_t tmp;
+        ptr = _upb_Validator_ReadVarint(v, ptr, &tmp);
+        if (have_id) break;  // Ignore dup.
+        have_id = true;
+        type_id = tmp;
+        if (!payload) break;
+        // The payload came first and the input has moved past it, so check it
+        // on its own, as upb_Decode() does.
+        const upb_MiniTableExtension* item_mt =
+            upb_ExtensionRegistry_Lookup(v->extreg, t, type_id);
+        if (!item_mt) break;
+        upb_DecodeStatus status = upb_Validate(
+            payload, payload_size, item_mt->sub.submsg, v->extreg, v->options);
+        if (status != kUpb_DecodeStatus_Ok) _upb_Validator_ErrorJmp(v, status);
+        break;
+      }
+      case kMessageTag: {
+        int size;
+        ptr = _upb_Validator_ReadSize(v, ptr, &size);
+        if (payload) {  // Ignore dup.
+          ptr += size;
+          break;
+        }
+        payload = upb_EpsCopyInputStream_GetAliasedPtr(&v->input, ptr);
+        payload_size = size;
+        const upb_MiniTableExtension* item_mt =
+            have_id ? upb_ExtensionRegistry_Lookup(v->extreg, t, type_id)
+                    : NULL;
+        if (item_mt) {
+          ptr = _upb_Validator_ValidateSubMessage(v, ptr, item_mt->sub.submsg,
+                                                  size);
+        } else {
+          ptr += size;
+        }
+        break;
+      }
+      default:
+        // Unexpected fields inside a message set item are not preserved.
+        ptr = _upb_Validator_SkipField(v, ptr, tag);
+        break;
+    }
+  }
+  _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+}
+
+static const upb_MiniTableField* _upb_Validator_FindField(
+    upb_Validator* v, const upb_MiniTable* t, uint32_t field_number) {
+  if (!t) return NULL;
+  const upb_MiniTableField* field =
+      upb_MiniTable_FindFieldByNumber(t, field_number);
+  if (field || !v->extreg || t->ext != kUpb_ExtMode_Extendable) return field;
+  const upb_MiniTableExtension* ext =
+      upb_ExtensionRegistry_Lookup(v->extreg, t, field_number);
+  return ext ? &ext->field : NULL;
+}
+
+static const upb_MiniTableSub* _upb_Validator_GetSub(
+    const upb_MiniTable* t, const upb_MiniTableField* field) {
+  if (field->mode & kUpb_LabelFlags_IsExtension) {
+    return &((const upb_MiniTableExtension*)field)->sub;
+  }
+  return &t->subs[field->UPB_PRIVATE(submsg_index)];
+}
+
+// Returns the type of the message or group field `field`, or NULL if its data
+// is skipped as an unknown field because the field is not linked.
+static const upb_MiniTable* _upb_Validator_GetSubMessage(
+    upb_Validator* v, const upb_MiniTable* t,
+    const upb_MiniTableField* field) {
+  const upb_MiniTable* sub = _upb_Validator_GetSub(t, field)->submsg;
+  UPB_ASSERT(sub);
+  if (sub == &_kUpb_MiniTable_Empty &&
+      !(v->options & kUpb_DecodeOption_ExperimentalAllowUnlinked)) {
+    return NULL;
+  }
+  return sub;
+}
+
+// Records that `field` was set, for the kUpb_DecodeOption_CheckRequired check.
+// Required fields have the lowest hasbits.
+UPB_FORCEINLINE
+static void _upb_Validator_SetField(const upb_MiniTableField* field,
+                                    uint64_t* present) {
+  if (field->presence > 0 && field->presence < 64) {
+    *present |= 1ULL << field->presence;
+  }
+}
+
+static const char* _upb_Validator_ValidatePacked(
+    upb_Validator* v, const char* ptr, const upb_MiniTableField* field,
+    int size) {
+  unsigned type_bit = 1U << field->UPB_PRIVATE(descriptortype);
+  if (type_bit & kUpb_Validator_Fixed32Types) {
+    if (size & 3) _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  } else if (type_bit & kUpb_Validator_Fixed64Types) {
+    if (size & 7) _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  } else if (type_bit & kUpb_Validator_VarintTypes) {
+    // The value may straddle the stream's patch buffer, but the original
+    // buffer holds all of it.
+    const char* data = upb_EpsCopyInputStream_GetAliasedPtr(&v->input, ptr);
+    if (!_upb_Validator_CheckVarints(data, size)) {
+      _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+    }
+  }
+  return ptr + size;
+}
+
+static const char* _upb_Validator_ValidateDelimited(
+    upb_Validator* v, const char* ptr, const upb_MiniTable* t,
+    const upb_MiniTableField* field, int size, uint64_t* present) {
+  bool is_array = upb_FieldMode_Get(field) == kUpb_FieldMode_Array;
+  switch (field->UPB_PRIVATE(descriptortype)) {
+    case kUpb_FieldType_String:
+      if (!(v->options & kUpb_DecodeOption_DeferUtf8Validation) &&
+          !upb_Utf8_IsValid(
+              upb_EpsCopyInputStream_GetAliasedPtr(&v->input, ptr), size)) {
+        _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_BadUtf8);
+      }
+      _upb_Validator_SetField(field, present);
+      return ptr + size;
+    case kUpb_FieldType_Bytes:
+      _upb_Validator_SetField(field, present);
+      return ptr + size;
+    case kUpb_FieldType_Group:
+      // Only repeated groups accept the delimited encoding.
+      if (!is_array) return ptr + size;
+      // Fallthrough.
+    case kUpb_FieldType_Message: {
+      const upb_MiniTable* sub = _upb_Validator_GetSubMessage(v, t, field);
+      if (!sub) return ptr + size;
+      ptr = _upb_Validator_ValidateSubMessage(v, ptr, sub, size);
+      _upb_Validator_SetField(field, present);
+      return ptr;
+    }
+    default:
+      if (!is_array) return ptr + size;
+      return _upb_Validator_ValidatePacked(v, ptr, field, size);
+  }
+}
+
+// Validates the value of the field whose tag was just read.  `field` is NULL
+// for unknown fields.
+UPB_FORCEINLINE
+static const char* _upb_Validator_ValidateField(
+    upb_Validator* v, const char* ptr, const upb_MiniTable* t,
+    const upb_MiniTableField* field, uint32_t tag, uint64_t* present) {
+  uint32_t field_number = tag >> 3;
+  unsigned type_bit = field ? 1U << field->UPB_PRIVATE(descriptortype) : 0;
+  switch (tag & 7) {
+    case kUpb_WireType_Varint: {
+      uint64_t val;
+      ptr = _upb_Validator_ReadVarint(v, ptr, &val);
+      if (!(type_bit & kUpb_Validator_VarintTypes)) return ptr;
+      if (upb_MiniTableField_IsClosedEnum(field)) {
+        const upb_MiniTableEnum* e = _upb_Validator_GetSub(t, field)->subenum;
+        // An unknown value becomes an unknown field.
+        if (!upb_MiniTableEnum_CheckValue(e, (uint32_t)val)) return ptr;
+      }
+      _upb_Validator_SetField(field, present);
+      return ptr;
+    }
+    case kUpb_WireType_32Bit:
+      if (type_bit & kUpb_Validator_Fixed32Types) {
+        _upb_Validator_SetField(field, present);
+      }
+      return ptr + 4;
+    case kUpb_WireType_64Bit:
+      if (type_bit & kUpb_Validator_Fixed64Types) {
+        _upb_Validator_SetField(field, present);
+      }
+      return ptr + 8;
+    case kUpb_WireType_Delimited: {
+      int size;
+      ptr = _upb_Validator_ReadSize(v, ptr, &size);
+      if (!field) return ptr + size;
+      return _upb_Validator_ValidateDelimited(v, ptr, t, field, size, present);
+    }
+    case kUpb_WireType_StartGroup:
+      if (type_bit & (1 << kUpb_FieldType_Group)) {
+        const upb_MiniTable* sub = _upb_Validator_GetSubMessage(v, t, field);
+        ptr = _upb_Validator_ValidateGroup(v, ptr, sub, field_number);
+        if (sub) _upb_Validator_SetField(field, present);
+        return ptr;
+      }
+      if (!field && field_number == kUpb_MsgSet_Item && t && v->extreg &&
+          t->ext == kUpb_ExtMode_IsMessageSet) {
+        return _upb_Validator_ValidateMessageSetItem(v, ptr, t);
+      }
+      return _upb_Validator_ValidateGroup(v, ptr, NULL, field_number);
+    default:
+      _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+  }
+}
+
+static const char* _upb_Validator_ValidateMessage(upb_Validator* v,
+                                                  const char* ptr,
+                                                  const upb_MiniTable* t) {
+  uint64_t present = 0;
+  while (!_upb_Validator_IsDone(v, &ptr)) {
+    uint32_t tag;
+    ptr = _upb_Validator_ReadTag(v, ptr, &tag);
+    if ((tag & 7) == kUpb_WireType_EndGroup) {
+      v->end_group = tag >> 3;
+      return ptr;
+    }
+    uint32_t field_number = tag >> 3;
+    if (field_number == 0) {
+      _upb_Validator_ErrorJmp(v, kUpb_DecodeStatus_Malformed);
+    }
+    const upb_MiniTableField* field =
+        _upb_Validator_FindField(v, t, field_number);
+    ptr = _upb_Validator_ValidateField(v, ptr, t, field, tag, &present);
+  }
+  if (UPB_UNLIKELY(t && t->required_count) &&
+      (v->options & kUpb_DecodeOption_CheckRequired) &&
+      (upb_MiniTable_requiredmask(t) & ~present)) {
+    v->missing_required = true;
+  }
+  return ptr;
+}
+
+static upb_DecodeStatus _upb_Validator_Validate(upb_Validator* const v,
+                                                const char* const buf,
+                                                const upb_MiniTable* const t) {
+  if (UPB_SETJMP(v->err) != 0) return v->status;
+  _upb_Validator_ValidateMessage(v, buf, t);
+  if (v->end_group != VALIDATE_NOGROUP) return kUpb_DecodeStatus_Malformed;
+  if (v->missing_required) return kUpb_DecodeStatus_MissingRequired;
+  return kUpb_DecodeStatus_Ok;
+}
+
+upb_DecodeStatus upb_Validate(const char* buf, size_t size,
+                              const upb_MiniTable* mini_table,
+                              const upb_ExtensionRegistry* extreg,
+                              int options) {
+  upb_Validator v;
+  unsigned depth = (unsigned)options >> 16;
+
+  // Aliasing lets strings and packed fields be checked in the caller's
+  // buffer even where the stream has copied their start into its patch
+  // buffer.
+  upb_EpsCopyInputStream_Init(&v.input, &buf, size, true);
+  v.extreg = extreg;
+  v.depth = depth ? depth : kUpb_WireFormat_DefaultDepthLimit;
+  v.end_group = VALIDATE_NOGROUP;
+  v.options = (uint16_t)options;
+  v.missing_required = false;
+  v.status = kUpb_DecodeStatus_Ok;
+
+  return _upb_Validator_Validate(&v, buf, mini_table);
+}
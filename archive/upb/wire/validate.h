@@ -0,0 +1,80 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// upb_Validate: checks serialized data against a upb_MiniTable without
+// decoding it into a message.
+
+#ifndef UPB_WIRE_VALIDATE_H_
+#define UPB_WIRE_VALIDATE_H_
+
+#include <stddef.h>
+
+#include "upb/mini_table/extension_registry.h"
+#include "upb/mini_table/message.h"
+#include "upb/wire/decode.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Checks that the `size` bytes at `buf` would decode as a message of type
+// `mini_table`, and returns the status that upb_Decode() would return for
+// them, without building the message or allocating any memory.  This is much
+// cheaper than a decode for a proxy that must reject malformed payloads but
+// forwards the bytes unchanged.
+//
+// The wire format is checked down to the last nested message, including
+// string fields for valid UTF-8 (unless kUpb_DecodeOption_DeferUtf8Validation
+// is set), the depth limit and, with kUpb_DecodeOption_CheckRequired, required
+// fields.  As in upb_Decode(), a closed enum value that is not in the enum is
+// not an error, but it does not count as setting a required field.  Extensions
+// in `extreg` (which may be NULL) are checked as their own types.
+//
+// Options that only affect how the message would be stored are ignored; in
+// particular, sub-messages are always checked, as if
+// kUpb_DecodeOption_ExperimentalLazySubMessages were not set.  Required fields
+// are checked in each occurrence of a message on its own, so a message whose
+// required fields are spread over several occurrences of the same field fails
+// here although it would merge into a complete one in upb_Decode().
+UPB_API upb_DecodeStatus upb_Validate(const char* buf, size_t size,
+                                      const upb_MiniTable* mini_table,
+                                      const upb_ExtensionRegistry* extreg,
+                                      int options);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif /* UPB_WIRE_VALIDATE_H_ */
@@ -0,0 +1,275 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/validate.h"
+
+#include <stdint.h>
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "upb/base/descriptor_constants.h"
+#include "upb/base/status.hpp"
+#include "upb/mem/arena.hpp"
+#include "upb/message/message.h"
+#include "upb/mini_descriptor/build_enum.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/internal/encode.hpp"
+#include "upb/mini_descriptor/internal/modifiers.h"
+#include "upb/mini_table/extension_registry.h"
+#include "upb/mini_table/message.h"
+#include "upb/wire/decode.h"
+
+namespace {
+
+std::string Bytes(std::initializer_list<uint8_t> bytes) {
+  return std::string(bytes.begin(), bytes.end());
+}
+
+class ValidateTest : public testing::Test {
+ protected:
+  // A proto3-style (UTF-8 checked) message with:
+  //   1: required int32          2: string
+  //   3: itself                  4: packed repeated int32
+  //   5: closed enum {0, 1, 2}   6: itself, as a group
+  //   7: packed repeated fixed32 8: bytes
+  //   9: required closed enum
+  // and an extension 100 of its own type.  A message set has the message as
+  // its item 1000.
+  void SetUp() override {
+    upb::Status status;
+    upb::MtDataEncoder e;
+    ASSERT_TRUE(e.StartEnum());
+    for (uint32_t i = 0; i < 3; i++) ASSERT_TRUE(e.PutEnumValue(i));
+    ASSERT_TRUE(e.EndEnum());
+    upb_MiniTableEnum* enum_mt = upb_MiniTableEnum_Build(
+        e.data().data(), e.data().size(), arena_.ptr(), status.ptr());
+    ASSERT_NE(enum_mt, nullptr);
+
+    upb::MtDataEncoder m;
+    ASSERT_TRUE(m.StartMessage(kUpb_MessageModifier_ValidateUtf8 |
+                               kUpb_MessageModifier_IsExtendable));
+    ASSERT_TRUE(m.PutField(kUpb_FieldType_Int32, 1,
+                           kUpb_FieldModifier_IsRequired));
+    ASSERT_TRUE(m.PutField(kUpb_FieldType_String, 2, 0));
+    ASSERT_TRUE(m.PutField(kUpb_FieldType_Message, 3, 0));
+    ASSERT_TRUE(m.PutField(
+        kUpb_FieldType_Int32, 4,
+        kUpb_FieldModifier_IsRepeated | kUpb_FieldModifier_IsPacked));
+    ASSERT_TRUE(m.PutField(kUpb_FieldType_Enum, 5,
+                           kUpb_FieldModifier_IsClosedEnum));
+    ASSERT_TRUE(m.PutField(kUpb_FieldType_Group, 6, 0));
+    ASSERT_TRUE(m.PutField(
+        kUpb_FieldType_Fixed32, 7,
+        kUpb_FieldModifier_IsRepeated | kUpb_FieldModifier_IsPacked));
+    ASSERT_TRUE(m.PutField(kUpb_FieldType_Bytes, 8, 0));
+    ASSERT_TRUE(m.PutField(
+        kUpb_FieldType_Enum, 9,
+        kUpb_FieldModifier_IsClosedEnum | kUpb_FieldModifier_IsRequired));
+    mt_ = upb_MiniTable_Build(m.data().data(), m.data().size(), arena_.ptr(),
+                              status.ptr());
+    ASSERT_NE(mt_, nullptr);
+    for (uint32_t number : {3, 6}) {
+      ASSERT_TRUE(upb_MiniTable_SetSubMessage(mt_, Field(number), mt_));
+    }
+    for (uint32_t number : {5, 9}) {
+      ASSERT_TRUE(upb_MiniTable_SetSubEnum(mt_, Field(number), enum_mt));
+    }
+
+    upb::MtDataEncoder set;
+    ASSERT_TRUE(set.EncodeMessageSet());
+    set_mt_ = upb_MiniTable_Build(set.data().data(), set.data().size(),
+                                  arena_.ptr(), status.ptr());
+    ASSERT_NE(set_mt_, nullptr);
+
+    extreg_ = upb_ExtensionRegistry_New(arena_.ptr());
+    ASSERT_NE(extreg_, nullptr);
+    AddExtension(mt_, 100);
+    AddExtension(set_mt_, 1000);
+  }
+
+  upb_MiniTableField* Field(uint32_t number) {
+    return const_cast<upb_MiniTableField*>(
+        upb_MiniTable_FindFieldByNumber(mt_, number));
+  }
+
+  void AddExtension(const upb_MiniTable* extendee, uint32_t number) {
+    upb::MtDataEncoder e;
+    ASSERT_TRUE(e.EncodeExtension(kUpb_FieldType_Message, number, 0));
+    upb::Status status;
+    upb_MiniTableExtension* ext = upb_MiniTableExtension_BuildMessage(
+        e.data().data(), e.data().size(), extendee, mt_, arena_.ptr(),
+        status.ptr());
+    ASSERT_NE(ext, nullptr);
+    ASSERT_TRUE(upb_ExtensionRegistry_Add(extreg_, ext));
+  }
+
+  upb_DecodeStatus Validate(const std::string& data, const upb_MiniTable* mt,
+                            int options) {
+    return upb_Validate(data.data(), data.size(), mt, extreg_, options);
+  }
+
+  upb_DecodeStatus Decode(const std::string& data, const upb_MiniTable* mt,
+                          int options) {
+    upb::Arena arena;
+    upb_Message* msg = upb_Message_New(mt, arena.ptr());
+    return upb_Decode(data.data(), data.size(), msg, mt, extreg_, options,
+                      arena.ptr());
+  }
+
+  upb::Arena arena_;
+  upb_MiniTable* mt_;
+  upb_MiniTable* set_mt_;
+  upb_ExtensionRegistry* extreg_;
+};
+
+const std::string kMessage = Bytes({
+    0x08, 0x96, 0x01,                          // 1: 150
+    0x12, 0x06, 'h', 0xc3, 0xa9, 'l', 'l', 'o',  // 2: "héllo"
+    0x1a, 0x09, 0x08, 0x01, 0x48, 0x02,        // 3: {1: 1, 9: 2,
+    0x22, 0x03, 0x01, 0xac, 0x02,              //     4: [1, 300]}
+    0x22, 0x02, 0x01, 0x02,                    // 4: [1, 2]
+    0x28, 0x01,                                // 5: 1
+    0x33, 0x08, 0x02, 0x48, 0x00, 0x34,        // 6: group {1: 2, 9: 0}
+    0x3a, 0x08, 0x01, 0x00, 0x00, 0x00,        // 7: [1,
+    0x02, 0x00, 0x00, 0x00,                    //     2]
+    0x42, 0x01, 0xff,                          // 8: "\xff"
+    0x48, 0x01,                                // 9: 1
+    0xa2, 0x06, 0x04, 0x08, 0x03, 0x48, 0x00,  // 100: {1: 3, 9: 0}
+    0x90, 0x03, 0x05,                          // 50: 5 (unknown)
+    0x9b, 0x03, 0x08, 0x01, 0x9c, 0x03,        // 51: group {1: 1} (unknown)
+});
+
+const std::string kMessageSet = Bytes({
+    // Item 1000: {1: 1, 9: 0}.
+    0x0b, 0x10, 0xe8, 0x07, 0x1a, 0x04, 0x08, 0x01, 0x48, 0x00, 0x0c,
+    // Item 1000 again, with the payload first: {1: 2, 9: 1}.
+    0x0b, 0x1a, 0x04, 0x08, 0x02, 0x48, 0x01, 0x10, 0xe8, 0x07, 0x0c,
+    // Unknown item 5.
+    0x0b, 0x10, 0x05, 0x1a, 0x01, 0xff, 0x0c,
+});
+
+TEST_F(ValidateTest, Valid) {
+  int options = kUpb_DecodeOption_CheckRequired;
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Validate("", set_mt_, options));
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Validate(kMessage, mt_, options));
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Validate(kMessageSet, set_mt_, options));
+}
+
+// Every truncation and many single-byte corruptions of valid data get the
+// same status from upb_Validate() as from upb_Decode().
+TEST_F(ValidateTest, AgreesWithDecode) {
+  const int kOptions[] = {
+      0,
+      kUpb_DecodeOption_DeferUtf8Validation,
+      static_cast<int>(upb_DecodeOptions_MaxDepth(2)),
+  };
+  const uint8_t kBytes[] = {0x00, 0x01, 0x08, 0x0b, 0x0c, 0x0f,
+                            0x12, 0x7f, 0x80, 0xc3, 0xff};
+  for (const upb_MiniTable* mt : {mt_, set_mt_}) {
+    const std::string& valid = mt == mt_ ? kMessage : kMessageSet;
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < valid.size(); i++) {
+      inputs.push_back(valid.substr(0, i));
+      for (uint8_t byte : kBytes) {
+        std::string corrupt = valid;
+        corrupt[i] = byte;
+        inputs.push_back(corrupt);
+      }
+    }
+    for (const std::string& input : inputs) {
+      for (int options : kOptions) {
+        EXPECT_EQ(Decode(input, mt, options), Validate(input, mt, options))
+            << testing::PrintToString(input) << " " << options;
+      }
+    }
+  }
+}
+
+TEST_F(ValidateTest, Utf8) {
+  std::string data = Bytes({0x12, 0x02, 0xc3, 0x28});
+  EXPECT_EQ(kUpb_DecodeStatus_BadUtf8, Validate(data, mt_, 0));
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            Validate(data, mt_, kUpb_DecodeOption_DeferUtf8Validation));
+
+  // Bytes are not checked.
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            Validate(Bytes({0x42, 0x02, 0xc3, 0x28}), mt_, 0));
+
+  // Nor are strings in a group whose type is unknown.
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            Validate(Bytes({0x9b, 0x03, 0x12, 0x01, 0xff, 0x9c, 0x03}), mt_,
+                     0));
+}
+
+TEST_F(ValidateTest, Required) {
+  int options = kUpb_DecodeOption_CheckRequired;
+  std::string data = Bytes({0x08, 0x01, 0x48, 0x01});
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Validate(data, mt_, options));
+  EXPECT_EQ(kUpb_DecodeStatus_MissingRequired,
+            Validate(data.substr(0, 2), mt_, options));
+  EXPECT_EQ(kUpb_DecodeStatus_Ok, Validate(data.substr(0, 2), mt_, 0));
+
+  // A value that is not in the closed enum does not set the field.
+  data = Bytes({0x08, 0x01, 0x48, 0x07});
+  EXPECT_EQ(kUpb_DecodeStatus_MissingRequired, Validate(data, mt_, options));
+  EXPECT_EQ(kUpb_DecodeStatus_MissingRequired, Decode(data, mt_, options));
+
+  // Sub-messages are checked too.
+  data = Bytes({0x08, 0x01, 0x48, 0x01, 0x1a, 0x02, 0x08, 0x01});
+  EXPECT_EQ(kUpb_DecodeStatus_MissingRequired, Validate(data, mt_, options));
+}
+
+TEST_F(ValidateTest, Depth) {
+  // {3: {3: {3: {}}}}
+  std::string data = Bytes({0x1a, 0x04, 0x1a, 0x02, 0x1a, 0x00});
+  EXPECT_EQ(kUpb_DecodeStatus_Ok,
+            Validate(data, mt_, upb_DecodeOptions_MaxDepth(3)));
+  EXPECT_EQ(kUpb_DecodeStatus_MaxDepthExceeded,
+            Validate(data, mt_, upb_DecodeOptions_MaxDepth(2)));
+}
+
+TEST_F(ValidateTest, LongInput) {
+  // Strings and packed fields that straddle the input stream's internal
+  // buffer boundaries.
+  for (int pad = 0; pad < 40; pad++) {
+    std::string data =
+        Bytes({0x42, static_cast<uint8_t>(pad)}) + std::string(pad, 'x');
+    data += Bytes({0x12, 0x06, 'h', 0xc3, 0xa9, 'l', 'l', 'o'});
+    data += Bytes({0x22, 0x05, 0x80, 0x80, 0x80, 0x80, 0x01});
+    EXPECT_EQ(kUpb_DecodeStatus_Ok, Validate(data, mt_, 0)) << pad;
+    data.back() = 0x80;  // The last varint no longer ends.
+    EXPECT_EQ(kUpb_DecodeStatus_Malformed, Validate(data, mt_, 0)) << pad;
+  }
+}
+
+}  // namespace
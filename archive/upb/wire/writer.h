@@ -0,0 +1,257 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef UPB_WIRE_WRITER_H_
+#define UPB_WIRE_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "upb/mem/arena.h"
+#include "upb/wire/internal/swap.h"
+#include "upb/wire/types.h"
+
+// Must be last.
+#include "upb/port/def.inc"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The upb_WireWriter interface writes protobuf binary wire format directly,
+// for callers that serialize their own data structures without building a
+// upb_Message first.  It is the counterpart of upb_WireReader.
+//
+// Fields are written front to back.  Space is reserved with
+// upb_WireWriter_Reserve() and then filled by the upb_WireWriter_Put*()
+// functions, which perform no checks, so a hot loop can reserve once for
+// several fields.  The upb_WireWriter_Write*Field() functions reserve and put
+// a whole field at once.
+
+#define kUpb_WireWriter_MaxVarintSize 10
+
+// Space reserved for the length of a delimited field whose size is not known
+// in advance (see upb_WireWriter_StartDelimited()).  Enough for any length
+// below 2GB.
+#define kUpb_WireWriter_MaxLengthSize 5
+
+// Returns the number of bytes needed to encode `val` as a varint.
+UPB_INLINE size_t upb_WireWriter_VarintSize(uint64_t val) {
+  size_t i = 1;
+  while (val >= 0x80U) {
+    val >>= 7;
+    i++;
+  }
+  return i;
+}
+
+// Writes `val` as a varint to `buf`, which must have room for
+// kUpb_WireWriter_MaxVarintSize bytes, and returns the number of bytes
+// written.
+UPB_INLINE size_t upb_WireWriter_EncodeVarint(uint64_t val, char* buf) {
+  size_t i = 0;
+  do {
+    uint8_t byte = val & 0x7fU;
+    val >>= 7;
+    if (val) byte |= 0x80U;
+    buf[i++] = byte;
+  } while (val);
+  return i;
+}
+
+// Encodes a signed value for a sint32 or sint64 field.
+UPB_INLINE uint32_t upb_WireWriter_ZigZag32(int32_t n) {
+  return ((uint32_t)n << 1) ^ (n >> 31);
+}
+
+UPB_INLINE uint64_t upb_WireWriter_ZigZag64(int64_t n) {
+  return ((uint64_t)n << 1) ^ (n >> 63);
+}
+
+// The members are private.
+typedef struct {
+  char* buf;
+  char* ptr;  // Where the next byte goes.
+  char* end;
+  upb_Arena* arena;  // NULL if the buffer cannot grow.
+} upb_WireWriter;
+
+// Initializes `w` to write into a buffer that grows in `arena`.
+UPB_INLINE void upb_WireWriter_Init(upb_WireWriter* w, upb_Arena* arena) {
+  w->buf = NULL;
+  w->ptr = NULL;
+  w->end = NULL;
+  w->arena = arena;
+}
+
+// Initializes `w` to write into the `size` bytes at `buf`, which do not grow.
+UPB_INLINE void upb_WireWriter_InitWithBuffer(upb_WireWriter* w, char* buf,
+                                              size_t size) {
+  w->buf = buf;
+  w->ptr = buf;
+  w->end = buf + size;
+  w->arena = NULL;
+}
+
+// Returns the output written so far.  It moves when the buffer grows.
+UPB_INLINE char* upb_WireWriter_Data(const upb_WireWriter* w) {
+  return w->buf;
+}
+
+UPB_INLINE size_t upb_WireWriter_Size(const upb_WireWriter* w) {
+  return w->ptr - w->buf;
+}
+
+bool _upb_WireWriter_Grow(upb_WireWriter* w, size_t bytes);
+
+// Makes room for at least `bytes` more bytes of output, returning false if
+// the buffer is fixed and too small or allocation fails.
+UPB_INLINE bool upb_WireWriter_Reserve(upb_WireWriter* w, size_t bytes) {
+  if (UPB_LIKELY((size_t)(w->end - w->ptr) >= bytes)) return true;
+  return _upb_WireWriter_Grow(w, bytes);
+}
+
+// REQUIRES: kUpb_WireWriter_MaxVarintSize bytes have been reserved.
+UPB_INLINE void upb_WireWriter_PutVarint(upb_WireWriter* w, uint64_t val) {
+  w->ptr += upb_WireWriter_EncodeVarint(val, w->ptr);
+}
+
+// REQUIRES: 5 bytes have been reserved.
+UPB_INLINE void upb_WireWriter_PutTag(upb_WireWriter* w, uint32_t field_number,
+                                      upb_WireType wire_type) {
+  upb_WireWriter_PutVarint(w, (field_number << 3) | wire_type);
+}
+
+// REQUIRES: 4 bytes have been reserved.
+UPB_INLINE void upb_WireWriter_PutFixed32(upb_WireWriter* w, uint32_t val) {
+  val = _upb_BigEndian_Swap32(val);
+  memcpy(w->ptr, &val, 4);
+  w->ptr += 4;
+}
+
+// REQUIRES: 8 bytes have been reserved.
+UPB_INLINE void upb_WireWriter_PutFixed64(upb_WireWriter* w, uint64_t val) {
+  val = _upb_BigEndian_Swap64(val);
+  memcpy(w->ptr, &val, 8);
+  w->ptr += 8;
+}
+
+// REQUIRES: `size` bytes have been reserved.
+UPB_INLINE void upb_WireWriter_PutBytes(upb_WireWriter* w, const void* data,
+                                        size_t size) {
+  if (size == 0) return;  // memcpy() with a NULL pointer is UB.
+  memcpy(w->ptr, data, size);
+  w->ptr += size;
+}
+
+// The following write a whole field, returning false if space could not be
+// reserved for it.
+
+UPB_INLINE bool upb_WireWriter_WriteVarintField(upb_WireWriter* w,
+                                                uint32_t field_number,
+                                                uint64_t val) {
+  if (!upb_WireWriter_Reserve(w, 5 + kUpb_WireWriter_MaxVarintSize)) {
+    return false;
+  }
+  upb_WireWriter_PutTag(w, field_number, kUpb_WireType_Varint);
+  upb_WireWriter_PutVarint(w, val);
+  return true;
+}
+
+UPB_INLINE bool upb_WireWriter_WriteFixed32Field(upb_WireWriter* w,
+                                                 uint32_t field_number,
+                                                 uint32_t val) {
+  if (!upb_WireWriter_Reserve(w, 5 + 4)) return false;
+  upb_WireWriter_PutTag(w, field_number, kUpb_WireType_32Bit);
+  upb_WireWriter_PutFixed32(w, val);
+  return true;
+}
+
+UPB_INLINE bool upb_WireWriter_WriteFixed64Field(upb_WireWriter* w,
+                                                 uint32_t field_number,
+                                                 uint64_t val) {
+  if (!upb_WireWriter_Reserve(w, 5 + 8)) return false;
+  upb_WireWriter_PutTag(w, field_number, kUpb_WireType_64Bit);
+  upb_WireWriter_PutFixed64(w, val);
+  return true;
+}
+
+UPB_INLINE bool upb_WireWriter_WriteDelimitedField(upb_WireWriter* w,
+                                                   uint32_t field_number,
+                                                   const void* data,
+                                                   size_t size) {
+  if (!upb_WireWriter_Reserve(w, 5 + kUpb_WireWriter_MaxVarintSize + size)) {
+    return false;
+  }
+  upb_WireWriter_PutTag(w, field_number, kUpb_WireType_Delimited);
+  upb_WireWriter_PutVarint(w, size);
+  upb_WireWriter_PutBytes(w, data, size);
+  return true;
+}
+
+// Starts a delimited field, such as a sub-message, whose size is not known
+// yet.  Its contents are written next, and then the field is finished by
+// passing the value stored in `*start` to upb_WireWriter_EndDelimited().
+// Delimited fields may be nested.
+UPB_INLINE bool upb_WireWriter_StartDelimited(upb_WireWriter* w,
+                                              uint32_t field_number,
+                                              size_t* start) {
+  if (!upb_WireWriter_Reserve(w, 5 + kUpb_WireWriter_MaxLengthSize)) {
+    return false;
+  }
+  upb_WireWriter_PutTag(w, field_number, kUpb_WireType_Delimited);
+  w->ptr += kUpb_WireWriter_MaxLengthSize;
+  *start = upb_WireWriter_Size(w);
+  return true;
+}
+
+// Writes the length of the delimited field that began at `start`.  The space
+// reserved for the length is patched in place, and the contents are moved
+// back over whatever part of it the length does not need.
+UPB_INLINE void upb_WireWriter_EndDelimited(upb_WireWriter* w, size_t start) {
+  size_t size = upb_WireWriter_Size(w) - start;
+  UPB_ASSERT(size <= INT32_MAX);
+  char* contents = w->buf + start;
+  char* prefix = contents - kUpb_WireWriter_MaxLengthSize;
+  char tmp[kUpb_WireWriter_MaxVarintSize];
+  size_t n = upb_WireWriter_EncodeVarint(size, tmp);
+  memmove(prefix + n, contents, size);
+  memcpy(prefix, tmp, n);
+  w->ptr = prefix + n + size;
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#include "upb/port/undef.inc"
+
+#endif  // UPB_WIRE_WRITER_H_
@@ -0,0 +1,153 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2023 Google LLC.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google LLC nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "upb/wire/writer.h"
+
+#include <stdint.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "google/protobuf/test_messages_proto2.upb.h"
+#include "upb/base/string_view.h"
+#include "upb/mem/arena.hpp"
+
+namespace {
+
+using TestAllTypes = protobuf_test_messages_proto2_TestAllTypesProto2;
+using NestedMessage =
+    protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage;
+
+std::string Output(const upb_WireWriter& w) {
+  return std::string(upb_WireWriter_Data(&w), upb_WireWriter_Size(&w));
+}
+
+TEST(WireWriterTest, Varint) {
+  const uint64_t vals[] = {0, 1, 127, 128, 300, 1ULL << 35, UINT64_MAX};
+  for (uint64_t val : vals) {
+    char buf[kUpb_WireWriter_MaxVarintSize];
+    EXPECT_EQ(upb_WireWriter_VarintSize(val),
+              upb_WireWriter_EncodeVarint(val, buf));
+  }
+  EXPECT_EQ(kUpb_WireWriter_MaxVarintSize,
+            upb_WireWriter_VarintSize(UINT64_MAX));
+  EXPECT_EQ(1, upb_WireWriter_ZigZag32(-1));
+  EXPECT_EQ(2, upb_WireWriter_ZigZag32(1));
+  EXPECT_EQ(UINT64_MAX, upb_WireWriter_ZigZag64(INT64_MIN));
+}
+
+TEST(WireWriterTest, Fields) {
+  upb::Arena arena;
+  upb_WireWriter w;
+  upb_WireWriter_Init(&w, arena.ptr());
+  ASSERT_TRUE(upb_WireWriter_WriteVarintField(&w, 1, 150));
+  ASSERT_TRUE(upb_WireWriter_WriteDelimitedField(&w, 2, "testing", 7));
+  ASSERT_TRUE(upb_WireWriter_WriteFixed32Field(&w, 3, 1));
+  ASSERT_TRUE(upb_WireWriter_WriteFixed64Field(&w, 4, 2));
+  EXPECT_EQ(std::string("\x08\x96\x01"
+                        "\x12\x07testing"
+                        "\x1d\x01\x00\x00\x00"
+                        "\x21\x02\x00\x00\x00\x00\x00\x00\x00",
+                        3 + 9 + 5 + 9),
+            Output(w));
+}
+
+// Writes a TestAllTypesProto2 whose optional_nested_message.corecursive has
+// `string_size` bytes of optional_string, nested `depth` times.
+void WriteNested(upb_WireWriter* w, size_t string_size, int depth) {
+  ASSERT_TRUE(upb_WireWriter_WriteVarintField(w, 1, depth));
+  if (depth == 0) {
+    std::string str(string_size, 'x');
+    ASSERT_TRUE(upb_WireWriter_WriteDelimitedField(w, 14, str.data(),
+                                                   str.size()));
+    return;
+  }
+  size_t nested, corecursive;
+  ASSERT_TRUE(upb_WireWriter_StartDelimited(w, 18, &nested));
+  ASSERT_TRUE(upb_WireWriter_WriteVarintField(w, 1, depth));
+  ASSERT_TRUE(upb_WireWriter_StartDelimited(w, 2, &corecursive));
+  WriteNested(w, string_size, depth - 1);
+  upb_WireWriter_EndDelimited(w, corecursive);
+  upb_WireWriter_EndDelimited(w, nested);
+}
+
+TEST(WireWriterTest, MatchesEncoder) {
+  for (size_t string_size : {0, 10, 200, 20000}) {
+    upb::Arena arena;
+    upb_WireWriter w;
+    upb_WireWriter_Init(&w, arena.ptr());
+    WriteNested(&w, string_size, 3);
+    std::string out = Output(w);
+
+    const TestAllTypes* top =
+        protobuf_test_messages_proto2_TestAllTypesProto2_parse(
+            out.data(), out.size(), arena.ptr());
+    ASSERT_NE(nullptr, top);
+    const TestAllTypes* msg = top;
+    for (int depth = 3; depth > 0; depth--) {
+      EXPECT_EQ(depth,
+                protobuf_test_messages_proto2_TestAllTypesProto2_optional_int32(
+                    msg));
+      const NestedMessage* nested =
+          protobuf_test_messages_proto2_TestAllTypesProto2_optional_nested_message(
+              msg);
+      ASSERT_NE(nullptr, nested);
+      msg = protobuf_test_messages_proto2_TestAllTypesProto2_NestedMessage_corecursive(
+          nested);
+      ASSERT_NE(nullptr, msg);
+    }
+    upb_StringView str =
+        protobuf_test_messages_proto2_TestAllTypesProto2_optional_string(msg);
+    EXPECT_EQ(string_size, str.size);
+
+    // The encoder writes the same fields in the same order, so the length
+    // prefixes must come out identical.
+    size_t size;
+    char* encoded = protobuf_test_messages_proto2_TestAllTypesProto2_serialize(
+        top, arena.ptr(), &size);
+    ASSERT_NE(nullptr, encoded);
+    EXPECT_EQ(std::string(encoded, size), out);
+  }
+}
+
+TEST(WireWriterTest, FixedBuffer) {
+  char buf[8];
+  upb_WireWriter w;
+  upb_WireWriter_InitWithBuffer(&w, buf, sizeof(buf));
+  // Writing a field reserves room for the largest tag and value.
+  EXPECT_FALSE(upb_WireWriter_WriteVarintField(&w, 1, 1));
+  ASSERT_TRUE(upb_WireWriter_Reserve(&w, 4));
+  upb_WireWriter_PutTag(&w, 1, kUpb_WireType_Varint);
+  upb_WireWriter_PutVarint(&w, 1);
+  EXPECT_EQ(std::string("\x08\x01", 2), Output(w));
+  EXPECT_EQ(buf, upb_WireWriter_Data(&w));
+}
+
+}  // namespace
@@ -31,9 +31,10 @@
 #ifndef UPBC_COMMON_H
 #define UPBC_COMMON_H
 
+#include <string>
 #include <vector>
 
-#include "absl/strings/str_replace.h"
+#include "absl/strings/match.h"
 #include "absl/strings/substitute.h"
 #include "upb/reflection/def.hpp"
 
@@ -43,37 +44,57 @@ class Output {
  public:
   template <class... Arg>
   void operator()(absl::string_view format, const Arg&... arg) {
-    Write(absl::Substitute(format, arg...));
+    // The scratch buffer keeps its capacity, so most calls do not allocate.
+    scratch_.clear();
+    absl::SubstituteAndAppend(&scratch_, format, arg...);
+    Write(scratch_);
   }
 
   absl::string_view output() const { return output_; }
 
+  // Returns the output and leaves this object empty, without copying.
+  std::string TakeOutput() {
+    std::string ret;
+    ret.swap(output_);
+    return ret;
+  }
+
  private:
   void Write(absl::string_view data) {
-    std::string stripped;
-    if (absl::StartsWith(data, "\n ")) {
-      size_t indent = data.substr(1).find_first_not_of(' ');
-      if (indent != absl::string_view::npos) {
-        // Remove indentation from all lines.
-        auto line_prefix = data.substr(0, indent + 1);
-        // The final line has an extra newline and is indented two less, eg.
-        //    R"cc(
-        //      UPB_INLINE $0 $1_$2(const $1 *msg) {
-        //        return $1_has_$2(msg) ? *UPB_PTR_AT(msg, $3, $0) : $4;
-        //      }
-        //    )cc",
-        std::string last_line_prefix = std::string(line_prefix);
-        last_line_prefix.resize(last_line_prefix.size() - 2);
-        data.remove_prefix(line_prefix.size());
-        stripped = absl::StrReplaceAll(
-            data, {{line_prefix, "\n"}, {last_line_prefix, "\n"}});
-        data = stripped;
+    size_t indent = absl::StartsWith(data, "\n ")
+                        ? data.substr(1).find_first_not_of(' ')
+                        : absl::string_view::npos;
+    if (indent == absl::string_view::npos) {
+      output_.append(data.data(), data.size());
+      return;
+    }
+    // Remove indentation from all lines, appending each line as we go.  The
+    // final line has an extra newline and is indented two less, eg.
+    //    R"cc(
+    //      UPB_INLINE $0 $1_$2(const $1 *msg) {
+    //        return $1_has_$2(msg) ? *UPB_PTR_AT(msg, $3, $0) : $4;
+    //      }
+    //    )cc",
+    size_t last_indent = indent >= 2 ? indent - 2 : 0;
+    data.remove_prefix(indent + 1);
+    while (true) {
+      size_t newline = data.find('\n');
+      if (newline == absl::string_view::npos) break;
+      output_.append(data.data(), newline + 1);
+      data.remove_prefix(newline + 1);
+      size_t spaces = data.find_first_not_of(' ');
+      if (spaces == absl::string_view::npos) spaces = data.size();
+      if (spaces >= indent) {
+        data.remove_prefix(indent);
+      } else if (spaces >= last_indent) {
+        data.remove_prefix(last_indent);
       }
     }
-    absl::StrAppend(&output_, data);
+    output_.append(data.data(), data.size());
   }
 
   std::string output_;
+  std::string scratch_;
 };
 
 std::string StripExtension(absl::string_view fname);
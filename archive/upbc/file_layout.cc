@@ -36,6 +36,9 @@
 #include "upb/mini_table/internal/extension.h"
 #include "upbc/common.h"
 
+// Must be last.
+#include "upb/port/def.inc"
+
 namespace upbc {
 
 const char* kEnumsInit = "enums_layout";
@@ -141,4 +144,69 @@ std::vector<upb::FieldDefPtr> FieldNumberOrder(upb::MessageDefPtr message) {
   return fields;
 }
 
+namespace {
+
+struct AddFilesTask {
+  upb::DefPool* pools[2];
+  upb::Status statuses[2];
+  bool ok[2];
+  const UPB_DESC(FileDescriptorProto) * const* files;
+  size_t count;
+  upb_DefPool_ParallelForFunc* parallel_for;
+  void* closure;
+};
+
+void AddFilesToPool(void* arg, size_t i) {
+  AddFilesTask* task = static_cast<AddFilesTask*>(arg);
+  task->ok[i] = upb_DefPool_AddFiles(
+      task->pools[i]->ptr(), task->files, task->count, task->parallel_for,
+      task->closure, task->statuses[i].ptr());
+}
+
+}  // namespace
+
+std::vector<upb::FileDefPtr> DefPoolPair::AddFiles(
+    const UPB_DESC(FileDescriptorProto) * const* files, size_t count,
+    upb_DefPool_ParallelForFunc* parallel_for, void* closure,
+    upb::Status* status) {
+  AddFilesTask task{{&pool32_, &pool64_}, {}, {false, false}, files, count,
+                    parallel_for, closure};
+  if (parallel_for) {
+    parallel_for(closure, 2, &AddFilesToPool, &task);
+  } else {
+    AddFilesToPool(&task, 0);
+    AddFilesToPool(&task, 1);
+  }
+  for (int i = 0; i < 2; i++) {
+    if (!task.ok[i]) {
+      status->SetErrorMessage(task.statuses[i].error_message());
+      return {};
+    }
+  }
+
+  std::vector<upb::FileDefPtr> ret;
+  ret.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    upb_StringView name = UPB_DESC(FileDescriptorProto_name)(files[i]);
+    std::string name_str(name.data, name.size);
+    upb::FileDefPtr file32 = pool32_.FindFileByName(name_str.c_str());
+    upb::FileDefPtr file64 = pool64_.FindFileByName(name_str.c_str());
+    // Both pools were built from the same protos, so their defs line up.
+    std::vector<upb::MessageDefPtr> messages32 = SortedMessages(file32);
+    std::vector<upb::MessageDefPtr> messages64 = SortedMessages(file64);
+    for (size_t j = 0; j < messages64.size(); j++) {
+      messages32_[messages64[j].ptr()] = messages32[j].ptr();
+    }
+    std::vector<upb::FieldDefPtr> exts32 = SortedExtensions(file32);
+    std::vector<upb::FieldDefPtr> exts64 = SortedExtensions(file64);
+    for (size_t j = 0; j < exts64.size(); j++) {
+      extensions32_[exts64[j].ptr()] = exts32[j].ptr();
+    }
+    ret.push_back(file64);
+  }
+  return ret;
+}
+
 }  // namespace upbc
+
+#include "upb/port/undef.inc"
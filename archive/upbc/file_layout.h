@@ -32,6 +32,7 @@
 #define UPBC_FILE_LAYOUT_H
 
 #include <string>
+#include <vector>
 
 // begin:google_only
 // #ifndef UPB_BOOTSTRAP_STAGE0
@@ -75,6 +76,12 @@ std::vector<upb::FieldDefPtr> SortedExtensions(upb::FileDefPtr file);
 std::vector<upb::FieldDefPtr> FieldNumberOrder(upb::MessageDefPtr message);
 
 // DefPoolPair is a pair of DefPools: one for 32-bit and one for 64-bit.
+//
+// The generator reads the defs of the 64-bit pool.  The layouts of both
+// platforms are computed while the defs are built, so each pool builds its own
+// defs, but both are built from the same FileDescriptorProtos at the same time.
+// The 32-bit def of every message and extension is then recorded once, so
+// that the 32-bit lookups below are pointer lookups rather than by name.
 class DefPoolPair {
  public:
   DefPoolPair() {
@@ -82,44 +89,49 @@ class DefPoolPair {
     pool64_._SetPlatform(kUpb_MiniTablePlatform_64Bit);
   }
 
-  upb::FileDefPtr AddFile(const UPB_DESC(FileDescriptorProto) * file_proto,
-                          upb::Status* status) {
-    upb::FileDefPtr file32 = pool32_.AddFile(file_proto, status);
-    upb::FileDefPtr file64 = pool64_.AddFile(file_proto, status);
-    if (!file32) return file32;
-    return file64;
+  // Must be called before any files are added.  `func` may be called from
+  // several threads at once.
+  void SetFieldHotness(_upb_DefPool_FieldHotnessFunc* func, void* closure) {
+    pool32_._SetFieldHotness(func, closure);
+    pool64_._SetFieldHotness(func, closure);
   }
 
+  // Adds `count` files to both pools, with upb_DefPool_AddFiles() and the
+  // given `parallel_for`, which also builds the two pools concurrently.
+  // Returns the 64-bit files in the order they were given, or an empty vector
+  // on failure.  Every def passed to the methods below must come from these
+  // files.
+  std::vector<upb::FileDefPtr> AddFiles(
+      const UPB_DESC(FileDescriptorProto) * const* files, size_t count,
+      upb_DefPool_ParallelForFunc* parallel_for, void* closure,
+      upb::Status* status);
+
   const upb_MiniTable* GetMiniTable32(upb::MessageDefPtr m) const {
-    return pool32_.FindMessageByName(m.full_name()).mini_table();
+    return upb_MessageDef_MiniTable(messages32_.at(m.ptr()));
   }
 
   const upb_MiniTable* GetMiniTable64(upb::MessageDefPtr m) const {
-    return pool64_.FindMessageByName(m.full_name()).mini_table();
+    return m.mini_table();
   }
 
   const upb_MiniTableField* GetField32(upb::FieldDefPtr f) const {
-    return GetFieldFromPool(&pool32_, f);
+    if (f.is_extension()) {
+      return upb_FieldDef_MiniTable(extensions32_.at(f.ptr()));
+    }
+    const upb_MessageDef* m32 = messages32_.at(f.containing_type().ptr());
+    return upb_FieldDef_MiniTable(upb_MessageDef_Field(m32, f.index()));
   }
 
   const upb_MiniTableField* GetField64(upb::FieldDefPtr f) const {
-    return GetFieldFromPool(&pool64_, f);
+    return f.mini_table();
   }
 
  private:
-  static const upb_MiniTableField* GetFieldFromPool(const upb::DefPool* pool,
-                                                    upb::FieldDefPtr f) {
-    if (f.is_extension()) {
-      return pool->FindExtensionByName(f.full_name()).mini_table();
-    } else {
-      return pool->FindMessageByName(f.containing_type().full_name())
-          .FindFieldByNumber(f.number())
-          .mini_table();
-    }
-  }
-
   upb::DefPool pool32_;
   upb::DefPool pool64_;
+  absl::flat_hash_map<const upb_MessageDef*, const upb_MessageDef*>
+      messages32_;
+  absl::flat_hash_map<const upb_FieldDef*, const upb_FieldDef*> extensions32_;
 };
 
 }  // namespace upbc
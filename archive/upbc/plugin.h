@@ -34,6 +34,7 @@
 #include <stdio.h>
 
 #include <string>
+#include <utility>
 #include <vector>
 #ifdef _WIN32
 #include <fcntl.h>
@@ -60,6 +61,8 @@
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "upb/reflection/def.hpp"
+#include "upb/wire/types.h"
+#include "upb/wire/writer.h"
 
 // Must be last.
 #include "upb/port/def.inc"
@@ -148,11 +151,19 @@ class Plugin {
     (file, StringDup(content));
   }
 
+  // Like the above, but takes ownership of `content`, which is written
+  // straight to stdout after the rest of the response instead of being copied
+  // into it.
+  void AddOutputFile(absl::string_view filename, std::string&& content) {
+    owned_files_.emplace_back(std::string(filename), std::move(content));
+  }
+
  private:
   upb::Arena arena_;
   upb::DefPool pool_;
   UPB_DESC(compiler_CodeGeneratorRequest) * request_;
   UPB_DESC(compiler_CodeGeneratorResponse) * response_;
+  std::vector<std::pair<std::string, std::string>> owned_files_;
 
   static absl::string_view ToStringView(upb_StringView sv) {
     return absl::string_view(sv.data, sv.size);
@@ -202,6 +213,38 @@ class Plugin {
     if (fwrite(serialized, 1, size, stdout) != size) {
       ABSL_LOG(FATAL) << "Failed to write response to stdout";
     }
+
+    // Repeated fields may be split across a message's encoding, so the owned
+    // files are appended as more CodeGeneratorResponse.file entries.
+    for (const auto& file : owned_files_) {
+      WriteFileEntry(file.first, file.second);
+    }
+  }
+
+  void WriteFileEntry(absl::string_view name, absl::string_view content) {
+    // CodeGeneratorResponse.file = 15, File.name = 1, File.content = 15, all
+    // with one-byte tags.  Everything before the content is put in `header`,
+    // which is large enough for it.
+    size_t file_size = 1 + upb_WireWriter_VarintSize(name.size()) +
+                       name.size() + 1 +
+                       upb_WireWriter_VarintSize(content.size()) +
+                       content.size();
+    std::string header(3 * (5 + kUpb_WireWriter_MaxVarintSize) + name.size(),
+                       '\0');
+    upb_WireWriter w;
+    upb_WireWriter_InitWithBuffer(&w, &header[0], header.size());
+    upb_WireWriter_PutTag(&w, 15, kUpb_WireType_Delimited);
+    upb_WireWriter_PutVarint(&w, file_size);
+    upb_WireWriter_PutTag(&w, 1, kUpb_WireType_Delimited);
+    upb_WireWriter_PutVarint(&w, name.size());
+    upb_WireWriter_PutBytes(&w, name.data(), name.size());
+    upb_WireWriter_PutTag(&w, 15, kUpb_WireType_Delimited);
+    upb_WireWriter_PutVarint(&w, content.size());
+    size_t header_size = upb_WireWriter_Size(&w);
+    if (fwrite(header.data(), 1, header_size, stdout) != header_size ||
+        fwrite(content.data(), 1, content.size(), stdout) != content.size()) {
+      ABSL_LOG(FATAL) << "Failed to write response to stdout";
+    }
   }
 };
 
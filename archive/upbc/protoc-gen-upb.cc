@@ -29,15 +29,20 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -45,11 +50,15 @@
 #include "absl/container/flat_hash_set.h"
 #include "absl/log/absl_check.h"
 #include "absl/log/absl_log.h"
+#include "absl/strings/ascii.h"
 #include "absl/strings/escaping.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/substitute.h"
 #include "upb/base/descriptor_constants.h"
 #include "upb/base/string_view.h"
+#include "upb/mem/arena.hpp"
 #include "upb/reflection/def.hpp"
 #include "upb/wire/types.h"
 #include "upbc/common.h"
@@ -65,27 +74,149 @@ namespace {
 
 struct Options {
   bool bootstrap = false;
+  // Also emit a .upb_fasttable.txt file describing which fields of each
+  // message got a fast-table slot, and why the others did not.
+  bool fasttable_report = false;
+  // Counts of how often each field (by full name) appears in serialized
+  // payloads, read from the file named by `field_hotness=`.  They order the
+  // fast-table slots and the layout of each message.
+  absl::flat_hash_map<std::string, uint64_t> field_hotness;
+  // Emit a specialized encoder for each message and use it in the generated
+  // _serialize() functions, instead of the table-driven upb_Encode().
+  bool specialized_encoders = false;
+  // If set, only the fields named in `used_fields` (read from the file given
+  // by `used_fields=`, eg. the output of upbdev_GetUsedFields()) and required
+  // fields are kept; all others are dropped from the mini tables and the
+  // generated API, and are parsed as unknown fields.  Every file that is
+  // linked together must be generated with the same list, and the result
+  // cannot be used with upb_proto_reflection_library().
+  bool shake_unused_fields = false;
+  absl::flat_hash_set<std::string> used_fields;
+  // How many threads build the defs and generate the files, set by `jobs=`.
+  // Zero means one per hardware thread.
+  int jobs = 0;
 };
 
 // Returns fields in order of "hotness", eg. how frequently they appear in
-// serialized payloads. Ideally this will use a profile. When we don't have
-// that, we assume that fields with smaller numbers are used more frequently.
+// serialized payloads. If a profile was given with `field_hotness=` we order
+// by its counts; fields missing from the profile, and ties, fall back to
+// assuming that fields with smaller numbers are used more frequently.
+// Required fields always come first, since they are present in every message.
 inline std::vector<upb::FieldDefPtr> FieldHotnessOrder(
-    upb::MessageDefPtr message) {
+    upb::MessageDefPtr message, const Options& options) {
   std::vector<upb::FieldDefPtr> fields;
   size_t field_count = message.field_count();
   fields.reserve(field_count);
   for (size_t i = 0; i < field_count; i++) {
     fields.push_back(message.field(i));
   }
+  auto hotness = [&](upb::FieldDefPtr f) -> uint64_t {
+    auto it = options.field_hotness.find(f.full_name());
+    return it == options.field_hotness.end() ? 0 : it->second;
+  };
   std::sort(fields.begin(), fields.end(),
-            [](upb::FieldDefPtr a, upb::FieldDefPtr b) {
-              return std::make_pair(!a.is_required(), a.number()) <
-                     std::make_pair(!b.is_required(), b.number());
+            [&](upb::FieldDefPtr a, upb::FieldDefPtr b) {
+              // Complementing the count sorts hotter fields first.
+              return std::make_tuple(!a.is_required(), ~hotness(a),
+                                     a.number()) <
+                     std::make_tuple(!b.is_required(), ~hotness(b),
+                                     b.number());
             });
   return fields;
 }
 
+// Lays out messages by the `field_hotness=` profile.  In each message that the
+// profile has counts for, fields are hot in order of their counts for as long
+// as they (approximately) fit in the first cache line on 64-bit platforms, and
+// fields that never occurred are cold.  Other messages keep the default
+// layout.
+class FieldLayoutHints {
+ public:
+  explicit FieldLayoutHints(const Options& options) : options_(options) {}
+
+  static upb_FieldHotness Get(const upb_FieldDef* f, void* closure) {
+    return static_cast<FieldLayoutHints*>(closure)->Classify(
+        upb::FieldDefPtr(f));
+  }
+
+ private:
+  using MessageHints = absl::flat_hash_map<uint32_t, upb_FieldHotness>;
+
+  static constexpr size_t kCacheLineSize = 64;
+  static constexpr size_t kHasbitsSize = 8;
+
+  upb_FieldHotness Classify(upb::FieldDefPtr f) {
+    // Files may be built on several threads at once.
+    std::lock_guard<std::mutex> lock(mutex_);
+    upb::MessageDefPtr message = f.containing_type();
+    auto it = hints_.find(message.full_name());
+    if (it == hints_.end()) {
+      it = hints_.emplace(message.full_name(), ClassifyMessage(message)).first;
+    }
+    auto field_it = it->second.find(f.number());
+    return field_it == it->second.end() ? kUpb_FieldHotness_Default
+                                        : field_it->second;
+  }
+
+  uint64_t Count(upb::FieldDefPtr f) const {
+    auto it = options_.field_hotness.find(f.full_name());
+    return it == options_.field_hotness.end() ? 0 : it->second;
+  }
+
+  // Size of the field's data on 64-bit platforms.
+  static size_t FieldSize(upb::FieldDefPtr f) {
+    if (f.IsSequence()) return 8;
+    switch (f.ctype()) {
+      case kUpb_CType_Bool:
+        return 1;
+      case kUpb_CType_Int32:
+      case kUpb_CType_UInt32:
+      case kUpb_CType_Enum:
+      case kUpb_CType_Float:
+        return 4;
+      case kUpb_CType_String:
+      case kUpb_CType_Bytes:
+        return 16;
+      default:
+        return 8;
+    }
+  }
+
+  MessageHints ClassifyMessage(upb::MessageDefPtr message) const {
+    std::vector<upb::FieldDefPtr> fields;
+    for (int i = 0; i < message.field_count(); i++) {
+      upb::FieldDefPtr f = message.field(i);
+      if (Count(f)) fields.push_back(f);
+    }
+    MessageHints hints;
+    if (fields.empty()) return hints;
+
+    std::sort(fields.begin(), fields.end(),
+              [&](upb::FieldDefPtr a, upb::FieldDefPtr b) {
+                return std::make_tuple(~Count(a), a.number()) <
+                       std::make_tuple(~Count(b), b.number());
+              });
+    for (int i = 0; i < message.field_count(); i++) {
+      hints[message.field(i).number()] = kUpb_FieldHotness_Cold;
+    }
+    size_t used = kHasbitsSize;
+    for (const auto field : fields) {
+      size_t size = FieldSize(field);
+      if (used + size <= kCacheLineSize) {
+        hints[field.number()] = kUpb_FieldHotness_Hot;
+        used += size;
+      } else {
+        hints[field.number()] = kUpb_FieldHotness_Default;
+      }
+    }
+    return hints;
+  }
+
+  const Options& options_;
+  std::mutex mutex_;
+  absl::flat_hash_map<std::string, MessageHints> hints_;
+};
+
 std::string SourceFilename(upb::FileDefPtr file) {
   return StripExtension(file.name()) + ".upb.c";
 }
@@ -94,6 +225,15 @@ std::string MessageInitName(upb::MessageDefPtr descriptor) {
   return absl::StrCat(MessageName(descriptor), "_msg_init");
 }
 
+bool UseSpecializedEncoders(const Options& options) {
+  // The bootstrap code has no static mini tables to encode against.
+  return options.specialized_encoders && !options.bootstrap;
+}
+
+std::string SpecializedEncoderName(upb::MessageDefPtr descriptor) {
+  return absl::StrCat("_", MessageName(descriptor), "_Encode");
+}
+
 std::string MessageMiniTableRef(upb::MessageDefPtr descriptor,
                                 const Options& options) {
   if (options.bootstrap) {
@@ -295,6 +435,7 @@ void DumpEnumValues(upb::EnumDefPtr desc, Output& output) {
 }
 
 std::string GetFieldRep(const DefPoolPair& pools, upb::FieldDefPtr field);
+std::string ArchDependentSize(int64_t size32, int64_t size64);
 
 void GenerateExtensionInHeader(const DefPoolPair& pools, upb::FieldDefPtr ext,
                                Output& output) {
@@ -352,6 +493,16 @@ void GenerateExtensionInHeader(const DefPoolPair& pools, upb::FieldDefPtr ext,
 
 void GenerateMessageFunctionsInHeader(upb::MessageDefPtr message,
                                       const Options& options, Output& output) {
+  std::string encode =
+      absl::StrCat("upb_Encode(msg, ", MessageMiniTableRef(message, options));
+  if (UseSpecializedEncoders(options)) {
+    output(
+        "upb_EncodeStatus $0(const $1* msg, int options, upb_Arena* arena,\n"
+        "                    char** buf, size_t* size);\n",
+        SpecializedEncoderName(message), MessageName(message));
+    encode = absl::StrCat(SpecializedEncoderName(message), "(msg");
+  }
+
   // TODO(b/235839510): The generated code here does not check the return values
   // from upb_Encode(). How can we even fix this without breaking other things?
   output(
@@ -380,17 +531,17 @@ void GenerateMessageFunctionsInHeader(upb::MessageDefPtr message,
         }
         UPB_INLINE char* $0_serialize(const $0* msg, upb_Arena* arena, size_t* len) {
           char* ptr;
-          (void)upb_Encode(msg, $1, 0, arena, &ptr, len);
+          (void)$2, 0, arena, &ptr, len);
           return ptr;
         }
         UPB_INLINE char* $0_serialize_ex(const $0* msg, int options,
                                          upb_Arena* arena, size_t* len) {
           char* ptr;
-          (void)upb_Encode(msg, $1, options, arena, &ptr, len);
+          (void)$2, options, arena, &ptr, len);
           return ptr;
         }
       )cc",
-      MessageName(message), MessageMiniTableRef(message, options));
+      MessageName(message), MessageMiniTableRef(message, options), encode);
 }
 
 void GenerateOneofInHeader(upb::OneofDefPtr oneof, const DefPoolPair& pools,
@@ -582,23 +733,90 @@ void GenerateRepeatedGetters(upb::FieldDefPtr field, const DefPoolPair& pools,
   );
 }
 
+// Whether the getter must check presence before reading the field, because
+// the field's default is not the all-zero value its storage holds when unset.
+bool HasNonZeroDefault(upb::FieldDefPtr field) {
+  upb_MessageValue def = field.default_value();
+  switch (field.ctype()) {
+    case kUpb_CType_Message:
+      return false;
+    case kUpb_CType_Bytes:
+    case kUpb_CType_String:
+      return def.str_val.size != 0;
+    case kUpb_CType_Bool:
+      return def.bool_val;
+    case kUpb_CType_Int32:
+    case kUpb_CType_Enum:
+      return def.int32_val != 0;
+    case kUpb_CType_UInt32:
+      return def.uint32_val != 0;
+    case kUpb_CType_Int64:
+      return def.int64_val != 0;
+    case kUpb_CType_UInt64:
+      return def.uint64_val != 0;
+    case kUpb_CType_Float:
+      // FloatToCLiteral() writes -0.0 as "-0", which is positive zero.
+      return def.float_val != 0 || std::isnan(def.float_val);
+    case kUpb_CType_Double:
+      return def.double_val != 0 || std::isnan(def.double_val);
+  }
+  ABSL_ASSERT(false);
+  return true;
+}
+
 void GenerateScalarGetters(upb::FieldDefPtr field, const DefPoolPair& pools,
                            absl::string_view msg_name,
                            const NameToFieldDefMap& field_names,
-                           const Options& Options, Output& output) {
+                           const Options& options, Output& output) {
   std::string field_name = ResolveFieldName(field, field_names);
+  const upb_MiniTableField* field32 = pools.GetField32(field);
+  const upb_MiniTableField* field64 = pools.GetField64(field);
+  if (options.bootstrap || _upb_MiniTableField_IsOutOfLine(field64)) {
+    output(
+        R"cc(
+          UPB_INLINE $0 $1_$2(const $1* msg) {
+            $0 default_val = $3;
+            $0 ret;
+            const upb_MiniTableField field = $4;
+            _upb_Message_GetNonExtensionField(msg, &field, &default_val, &ret);
+            return ret;
+          }
+        )cc",
+        CTypeConst(field), msg_name, field_name, FieldDefault(field),
+        FieldInitializer(pools, field, options));
+    return;
+  }
+
+  // Read the field at its constant offset, so that the getter is a single load
+  // (plus a presence test for oneofs and non-zero defaults) even where the
+  // compiler would not fold a upb_MiniTableField initializer.
+  std::string offset = ArchDependentSize(field32->offset, field64->offset);
+  std::string load = absl::Substitute("*UPB_PTR_AT(msg, $0, $1 const)",
+                                      offset, CTypeConst(field));
+  std::string value;
+  if (field64->presence < 0) {
+    value = absl::Substitute(
+        "*UPB_PTR_AT(msg, $0, const uint32_t) == $1 ? $2 : $3",
+        ArchDependentSize(~field32->presence, ~field64->presence),
+        field.number(), load, FieldDefault(field));
+  } else if (field64->presence > 0 && HasNonZeroDefault(field)) {
+    value = absl::Substitute(
+        "_upb_hasbit(msg, $0) ? $1 : $2",
+        ArchDependentSize(field32->presence, field64->presence), load,
+        FieldDefault(field));
+  } else {
+    value = load;
+  }
   output(
       R"cc(
         UPB_INLINE $0 $1_$2(const $1* msg) {
-          $0 default_val = $3;
-          $0 ret;
-          const upb_MiniTableField field = $4;
-          _upb_Message_GetNonExtensionField(msg, &field, &default_val, &ret);
-          return ret;
+          UPB_ASSERT(_upb_MiniTable_CheckFieldLayout(&$3, $4, $5, $6));
+          return $7;
         }
       )cc",
-      CTypeConst(field), msg_name, field_name, FieldDefault(field),
-      FieldInitializer(pools, field, Options));
+      CTypeConst(field), msg_name, field_name,
+      MessageInitName(field.containing_type()), field.number(), offset,
+      ArchDependentSize(field32->presence, field64->presence), value);
 }
 
 void GenerateGetters(upb::FieldDefPtr field, const DefPoolPair& pools,
@@ -1052,11 +1270,60 @@ int GetTableSlot(upb::FieldDefPtr field) {
   return (tag & 0xf8) >> 3;
 }
 
+// Returns the fast-table type code for the key or value of a map entry, or
+// the empty string if the fast map parsers do not handle this type.
+//
+// We switch on the descriptor type rather than upb_MiniTableField_Type()
+// because that is what the generic decoder uses to decide whether to validate
+// UTF-8, and both paths must accept the same inputs.  Open enums are encoded
+// as int32 and closed enums, which need a range check, are not handled.
+std::string GetMapEntryFieldType(const upb_MiniTableField* f) {
+  switch (f->UPB_PRIVATE(descriptortype)) {
+    case kUpb_FieldType_Int32:
+    case kUpb_FieldType_UInt32:
+      return "v4";
+    case kUpb_FieldType_Int64:
+    case kUpb_FieldType_UInt64:
+      return "v8";
+    case kUpb_FieldType_String:
+      return "s";
+    case kUpb_FieldType_Bytes:
+      return "b";
+    default:
+      return "";
+  }
+}
+
+bool TryFillMapTableEntry(const DefPoolPair& pools, upb::FieldDefPtr field,
+                          const upb_MiniTableField* mt_f, TableEntry& ent) {
+  const upb_MiniTable* entry = pools.GetMiniTable64(field.message_type());
+  std::string key = GetMapEntryFieldType(&entry->fields[0]);
+  std::string val = GetMapEntryFieldType(&entry->fields[1]);
+  if (key.empty() || val.empty()) return false;
+
+  uint64_t expected_tag = GetEncodedTag(field);
+  ent.first = absl::Substitute("upb_pM$0$1_$2bt", key, val,
+                               expected_tag > 0xff ? "2" : "1");
+
+  // Data is:
+  //
+  //                  48                32                16                 0
+  // |--------|--------|--------|--------|--------|--------|--------|--------|
+  // |   offset (16)   |              (unused)             |  exp. tag (16)  |
+  // |--------|--------|--------|--------|--------|--------|--------|--------|
+  ent.second = (static_cast<uint64_t>(mt_f->offset) << 48) | expected_tag;
+  return true;
+}
+
 bool TryFillTableEntry(const DefPoolPair& pools, upb::FieldDefPtr field,
                        TableEntry& ent) {
   const upb_MiniTable* mt = pools.GetMiniTable64(field.containing_type());
   const upb_MiniTableField* mt_f =
       upb_MiniTable_FindFieldByNumber(mt, field.number());
+  if (upb_FieldMode_Get(mt_f) == kUpb_FieldMode_Map) {
+    return TryFillMapTableEntry(pools, field, mt_f, ent);
+  }
+
   std::string type = "";
   std::string cardinality = "";
   switch (upb_MiniTableField_Type(mt_f)) {
@@ -1065,8 +1332,10 @@ bool TryFillTableEntry(const DefPoolPair& pools, upb::FieldDefPtr field,
       break;
     case kUpb_FieldType_Enum:
       if (upb_MiniTableField_IsClosedEnum(mt_f)) {
-        // We don't have the means to test proto2 enum fields for valid values.
-        return false;
+        // Checked against the enum's bitmask, so the upb_MiniTableEnum is
+        // passed as a sub below.
+        type = "e4";
+        break;
       }
       [[fallthrough]];
     case kUpb_FieldType_Int32:
@@ -1102,15 +1371,20 @@ bool TryFillTableEntry(const DefPoolPair& pools, upb::FieldDefPtr field,
     case kUpb_FieldType_Message:
       type = "m";
       break;
+    case kUpb_FieldType_Group:
+      type = "g";
+      break;
     default:
       return false;  // Not supported yet.
   }
 
   switch (upb_FieldMode_Get(mt_f)) {
     case kUpb_FieldMode_Map:
-      return false;  // Not supported yet (ever?).
+      UPB_UNREACHABLE();  // Handled by TryFillMapTableEntry().
     case kUpb_FieldMode_Array:
-      if (mt_f->mode & kUpb_LabelFlags_IsPacked) {
+      if (_upb_MiniTableField_IsPacked(mt_f)) {
+        // A packed closed enum can have unknown values anywhere in the run.
+        if (type == "e4") return false;
         cardinality = "p";
       } else {
         cardinality = "r";
@@ -1135,6 +1409,7 @@ bool TryFillTableEntry(const DefPoolPair& pools, upb::FieldDefPtr field,
   // |--------|--------|--------|--------|--------|--------|--------|--------|
   //
   // - |presence| is either hasbit index or field number for oneofs.
+  // - |submsg| is the index of the sub-message or closed enum in `subs`.
 
   uint64_t data = static_cast<uint64_t>(mt_f->offset) << 48 | expected_tag;
 
@@ -1181,6 +1456,11 @@ bool TryFillTableEntry(const DefPoolPair& pools, upb::FieldDefPtr field,
                                  expected_tag > 0xff ? "2" : "1", size_ceil);
 
   } else {
+    if (type == "e4") {
+      uint64_t idx = mt_f->UPB_PRIVATE(submsg_index);
+      if (idx > 255) return false;
+      data |= idx << 16;
+    }
     ent.first = absl::Substitute("upb_p$0$1_$2bt", cardinality, type,
                                  expected_tag > 0xff ? "2" : "1");
   }
@@ -1188,19 +1468,29 @@ bool TryFillTableEntry(const DefPoolPair& pools, upb::FieldDefPtr field,
   return true;
 }
 
+// Builds the fast table for `message`. If `report` is non-NULL, also writes
+// a line per field saying which slot it went to or why it was left out.
 std::vector<TableEntry> FastDecodeTable(upb::MessageDefPtr message,
-                                        const DefPoolPair& pools) {
+                                        const DefPoolPair& pools,
+                                        const Options& options,
+                                        Output* report = nullptr) {
   std::vector<TableEntry> table;
-  for (const auto field : FieldHotnessOrder(message)) {
+  std::map<int, upb::FieldDefPtr> slot_owners;
+  std::vector<std::string> lines;
+  for (const auto field : FieldHotnessOrder(message, options)) {
     TableEntry ent;
     int slot = GetTableSlot(field);
-    // std::cerr << "table slot: " << field->number() << ": " << slot << "\n";
+    std::string desc = absl::Substitute("  $0 = $1: ", field.name(),
+                                        field.number());
     if (slot < 0) {
       // Tag can't fit in the table.
+      lines.push_back(desc + "no slot, tag is longer than two bytes");
       continue;
     }
     if (!TryFillTableEntry(pools, field, ent)) {
       // Unsupported field type or offset, hasbit index, etc. doesn't fit.
+      lines.push_back(absl::Substitute(
+          "$0slot $1, no fast parser for this type or layout", desc, slot));
       continue;
     }
     while ((size_t)slot >= table.size()) {
@@ -1209,9 +1499,22 @@ std::vector<TableEntry> FastDecodeTable(upb::MessageDefPtr message,
     }
     if (table[slot].first != "_upb_FastDecoder_DecodeGeneric") {
       // A hotter field already filled this slot.
+      upb::FieldDefPtr owner = slot_owners[slot];
+      lines.push_back(absl::Substitute("$0slot $1, collides with $2 = $3",
+                                       desc, slot, owner.name(),
+                                       owner.number()));
       continue;
     }
     table[slot] = ent;
+    slot_owners[slot] = field;
+    lines.push_back(absl::Substitute("$0slot $1, $2", desc, slot, ent.first));
+  }
+  if (report) {
+    (*report)("$0: $1 of $2 fields in a $3-entry table\n",
+              message.full_name(), slot_owners.size(), lines.size(),
+              table.size());
+    for (const auto& line : lines) (*report)("$0\n", line);
+    (*report)("\n");
   }
   return table;
 }
@@ -1274,7 +1577,16 @@ std::string GetModeInit(const upb_MiniTableField* field32,
   }
 
   if (mode32 & kUpb_LabelFlags_IsPacked) {
-    absl::StrAppend(&ret, " | (int)kUpb_LabelFlags_IsPacked");
+    // The packed bit means something else for fields that cannot be packed.
+    absl::string_view flag = "kUpb_LabelFlags_IsPacked";
+    if (_upb_MiniTableField_HasInlineString(field32)) {
+      flag = "kUpb_LabelFlags_IsInlineString";
+    } else if (_upb_MiniTableField_HasInlineMessages(field32)) {
+      flag = "kUpb_LabelFlags_IsInlineMessages";
+    } else if (_upb_MiniTableField_IsOrderedMap(field32)) {
+      flag = "kUpb_LabelFlags_IsOrderedMap";
+    }
+    absl::StrAppend(&ret, " | (int)", flag);
   }
 
   if (mode32 & kUpb_LabelFlags_IsExtension) {
@@ -1387,10 +1699,38 @@ void WriteMessage(upb::MessageDefPtr message, const DefPoolPair& pools,
     output("};\n\n");
   }
 
+  std::string field_index_ref = "NULL";
+  if (mt_64->field_index) {
+    // The index only depends on the field numbers, so it is the same for both
+    // platforms.
+    std::string field_index_name = msg_name + "__field_index";
+    field_index_ref = "&" + field_index_name + "[0]";
+    size_t size = mt_64->field_index[0] + 2;
+    output("static const uint16_t $0[$1] = {\n", field_index_name, size);
+    for (size_t i = 0; i < size; i++) {
+      output("  $0,\n", mt_64->field_index[i]);
+    }
+    output("};\n\n");
+  }
+
+  std::string presence_index_ref = "NULL";
+  if (mt_64->presence_index) {
+    // Hasbits and field order do not depend on the platform either.
+    std::string presence_index_name = msg_name + "__presence_index";
+    presence_index_ref = "&" + presence_index_name + "[0]";
+    const uint16_t* index = mt_64->presence_index;
+    size_t size = 2 + index[0] + index[1 + index[0]];
+    output("static const uint16_t $0[$1] = {\n", presence_index_name, size);
+    for (size_t i = 0; i < size; i++) {
+      output("  $0,\n", index[i]);
+    }
+    output("};\n\n");
+  }
+
   std::vector<TableEntry> table;
   uint8_t table_mask = -1;
 
-  table = FastDecodeTable(message, pools);
+  table = FastDecodeTable(message, pools, options);
 
   if (table.size() > 1) {
     assert((table.size() & (table.size() - 1)) == 0);
@@ -1407,12 +1747,20 @@ void WriteMessage(upb::MessageDefPtr message, const DefPoolPair& pools,
     }
   }
 
+  std::string flags = "0";
+  if (mt_64->flags & kUpb_MiniTableFlag_NoReachableRequired) {
+    flags = "kUpb_MiniTableFlag_NoReachableRequired";
+  }
+
   output("const upb_MiniTable $0 = {\n", MessageInitName(message));
   output("  $0,\n", submsgs_array_ref);
   output("  $0,\n", fields_array_ref);
   output("  $0, $1, $2, $3, UPB_FASTTABLE_MASK($4), $5,\n",
          ArchDependentSize(mt_32->size, mt_64->size), mt_64->field_count,
          msgext, mt_64->dense_below, table_mask, mt_64->required_count);
+  output("  $0,\n", flags);
+  output("  $0,\n", field_index_ref);
+  output("  $0,\n", presence_index_ref);
   if (!table.empty()) {
     output("  UPB_FASTTABLE_INIT({\n");
     for (const auto& ent : table) {
@@ -1488,6 +1836,196 @@ int WriteMessages(const DefPoolPair& pools, upb::FileDefPtr file,
   return file_messages.size();
 }
 
+// Returns the encoded tag of `field` as a C string literal, eg. "\x0a".
+std::string EncodedTagLiteral(upb::FieldDefPtr field, size_t* len) {
+  char tag_bytes[10];
+  *len = WriteVarint32ToArray(
+      MakeTag(field.number(), GetWireTypeForField(field)), tag_bytes);
+  std::string ret = "\"";
+  for (size_t i = 0; i < *len; i++) {
+    absl::StrAppend(&ret, "\\x",
+                    absl::Hex(tag_bytes[i] & 0xff, absl::kZeroPad2));
+  }
+  return ret + "\"";
+}
+
+std::string SpecializedEncoderFieldsName(upb::MessageDefPtr message) {
+  return absl::StrCat("_", MessageName(message), "_EncodeFields");
+}
+
+// Returns true if `field` refers to a message whose fields have a specialized
+// encoder in this file.
+bool HasSpecializedSubEncoder(upb::FieldDefPtr field) {
+  return field.type() == kUpb_FieldType_Message &&
+         field.message_type().file() == field.containing_type().file();
+}
+
+// Writes the code that encodes field `i` of `message`, which is known to be
+// present.  The value is written before the tag since we encode backwards.
+void WriteFieldEncoder(upb::MessageDefPtr message, upb::FieldDefPtr field,
+                       int i, const Options& options, Output& output) {
+  size_t tag_len;
+  std::string tag = EncodedTagLiteral(field, &tag_len);
+  std::string ptr =
+      absl::Substitute("_upb_MiniTableField_GetConstPtr(msg, &f[$0])", i);
+  std::string generic =
+      absl::Substitute("_upb_Encoder_Field(e, msg, $0.subs, &f[$1]);\n",
+                       MessageInitName(message), i);
+
+  if (field.IsMap() ||
+      (field.IsSequence() && !HasSpecializedSubEncoder(field))) {
+    output("    $0", generic);
+    return;
+  }
+
+  if (field.IsSequence()) {
+    output(
+        "    const upb_Array* arr = *(const upb_Array**)$0;\n"
+        "    if (_upb_Array_HasInlineMessages(arr)) {\n"
+        "      $1"
+        "    } else if (arr->size) {\n"
+        "      const upb_TaggedMessagePtr* start = _upb_array_constptr(arr);\n"
+        "      const upb_TaggedMessagePtr* ptr = start + arr->size;\n"
+        "      do {\n"
+        "        ptr--;\n"
+        "        _upb_Encoder_Varint(\n"
+        "            e, _upb_Encoder_SubMessage(e, *ptr, &$2));\n"
+        "        _upb_Encoder_Bytes(e, $3, $4);\n"
+        "      } while (ptr != start);\n"
+        "    }\n",
+        ptr, generic, SpecializedEncoderFieldsName(field.message_type()), tag,
+        tag_len);
+    return;
+  }
+
+  if (HasSpecializedSubEncoder(field)) {
+    output(
+        "    upb_TaggedMessagePtr val;\n"
+        "    memcpy(&val, $0, sizeof(val));\n"
+        "    if (val) {\n"
+        "      _upb_Encoder_Varint(e, _upb_Encoder_SubMessage(e, val, &$1));\n"
+        "      _upb_Encoder_Bytes(e, $2, $3);\n"
+        "    }\n",
+        ptr, SpecializedEncoderFieldsName(field.message_type()), tag, tag_len);
+    return;
+  }
+
+  std::string ctype;
+  std::string encode;
+  switch (field.type()) {
+    case kUpb_FieldType_Double:
+    case kUpb_FieldType_Fixed64:
+    case kUpb_FieldType_SFixed64:
+      ctype = "uint64_t";
+      encode = "_upb_Encoder_Fixed64(e, val)";
+      break;
+    case kUpb_FieldType_Float:
+    case kUpb_FieldType_Fixed32:
+    case kUpb_FieldType_SFixed32:
+      ctype = "uint32_t";
+      encode = "_upb_Encoder_Fixed32(e, val)";
+      break;
+    case kUpb_FieldType_Int64:
+    case kUpb_FieldType_UInt64:
+      ctype = "uint64_t";
+      encode = "_upb_Encoder_Varint(e, val)";
+      break;
+    case kUpb_FieldType_UInt32:
+      ctype = "uint32_t";
+      encode = "_upb_Encoder_Varint(e, val)";
+      break;
+    case kUpb_FieldType_Int32:
+    case kUpb_FieldType_Enum:
+      ctype = "int32_t";
+      encode = "_upb_Encoder_Varint(e, (int64_t)val)";
+      break;
+    case kUpb_FieldType_Bool:
+      ctype = "bool";
+      encode = "_upb_Encoder_Varint(e, val)";
+      break;
+    case kUpb_FieldType_SInt32:
+      ctype = "int32_t";
+      encode = "_upb_Encoder_Varint(e, upb_WireWriter_ZigZag32(val))";
+      break;
+    case kUpb_FieldType_SInt64:
+      ctype = "int64_t";
+      encode = "_upb_Encoder_Varint(e, upb_WireWriter_ZigZag64(val))";
+      break;
+    case kUpb_FieldType_String:
+    case kUpb_FieldType_Bytes:
+      ctype = "upb_StringView";
+      encode =
+          "_upb_Encoder_Bytes(e, val.data, val.size);\n"
+          "    _upb_Encoder_Varint(e, val.size)";
+      break;
+    default:
+      output("    $0", generic);
+      return;
+  }
+  output(
+      "    $0 val;\n"
+      "    memcpy(&val, $1, sizeof(val));\n"
+      "    $2;\n"
+      "    _upb_Encoder_Bytes(e, $3, $4);\n",
+      ctype, ptr, encode, tag, tag_len);
+}
+
+// Writes a straight-line encoder for `message` that visits its fields in the
+// same order as the table-driven encoder, with the tags precomputed.  Anything
+// it does not specialize falls back to the table-driven field encoder.
+void WriteMessageEncoder(upb::MessageDefPtr message, const DefPoolPair& pools,
+                         const Options& options, Output& output) {
+  const upb_MiniTable* mt_64 = pools.GetMiniTable64(message);
+  output(
+      "static void $0(upb_encstate* e, const upb_Message* msg, size_t* size) "
+      "{\n",
+      SpecializedEncoderFieldsName(message));
+  if (mt_64->field_count > 0) {
+    output("  const upb_MiniTableField* f = &$0__fields[0];\n",
+           ToCIdent(message.full_name()));
+  }
+  output(
+      "  size_t pre_len = _upb_Encoder_Written(e);\n"
+      "  _upb_Encoder_MessagePrologue(e, msg, &$0);\n",
+      MessageInitName(message));
+  for (int i = mt_64->field_count - 1; i >= 0; i--) {
+    upb::FieldDefPtr field = message.FindFieldByNumber(mt_64->fields[i].number);
+    output("  if (_upb_Encode_ShouldEncode(msg, &f[$0])) {\n", i);
+    WriteFieldEncoder(message, field, i, options, output);
+    output("  }\n");
+  }
+  output(
+      "  *size = _upb_Encoder_Written(e) - pre_len;\n"
+      "}\n\n");
+
+  output(
+      "upb_EncodeStatus $0(const $1* msg, int options, upb_Arena* arena,\n"
+      "                    char** buf, size_t* size) {\n"
+      "  return _upb_Encode_WithFunc(msg, &$2, &$3, options, arena, buf, "
+      "size);\n"
+      "}\n\n",
+      SpecializedEncoderName(message), MessageName(message),
+      MessageInitName(message), SpecializedEncoderFieldsName(message));
+}
+
+void WriteMessageEncoders(const DefPoolPair& pools, upb::FileDefPtr file,
+                          const Options& options, Output& output) {
+  std::vector<upb::MessageDefPtr> file_messages = SortedMessages(file);
+
+  // Messages may refer to each other's encoders in any order.
+  for (auto message : file_messages) {
+    output(
+        "static void $0(upb_encstate* e, const upb_Message* msg, "
+        "size_t* size);\n",
+        SpecializedEncoderFieldsName(message));
+  }
+  output("\n");
+
+  for (auto message : file_messages) {
+    WriteMessageEncoder(message, pools, options, output);
+  }
+}
+
 void WriteExtension(upb::FieldDefPtr ext, const DefPoolPair& pools,
                     const Options& options, Output& output) {
   output("$0,\n", FieldInitializer(pools, ext, options));
@@ -1560,6 +2098,10 @@ void WriteMiniTableSource(const DefPoolPair& pools, upb::FileDefPtr file,
   int ext_count = WriteExtensions(pools, file, options, output);
   int enum_count = WriteEnums(pools, file, output);
 
+  if (UseSpecializedEncoders(options) && msg_count) {
+    WriteMessageEncoders(pools, file, options, output);
+  }
+
   output("const upb_MiniTableFile $0 = {\n", FileLayoutName(file));
   output("  $0,\n", msg_count ? kMessagesInit : "NULL");
   output("  $0,\n", enum_count ? kEnumsInit : "NULL");
@@ -1671,21 +2213,197 @@ void WriteSource(const DefPoolPair& pools, upb::FileDefPtr file,
   }
 }
 
-void GenerateFile(const DefPoolPair& pools, upb::FileDefPtr file,
-                  const Options& options, Plugin* plugin) {
-  Output h_output;
-  WriteHeader(pools, file, options, h_output);
-  plugin->AddOutputFile(HeaderFilename(file), h_output.output());
+// The files generated for one .proto file, as (filename, contents) pairs.
+using GeneratedFiles = std::vector<std::pair<std::string, Output>>;
+
+GeneratedFiles GenerateFile(const DefPoolPair& pools, upb::FileDefPtr file,
+                            const Options& options) {
+  GeneratedFiles ret;
+  ret.emplace_back(HeaderFilename(file), Output());
+  WriteHeader(pools, file, options, ret.back().second);
 
-  Output c_output;
-  WriteSource(pools, file, options, c_output);
-  plugin->AddOutputFile(SourceFilename(file), c_output.output());
+  ret.emplace_back(SourceFilename(file), Output());
+  WriteSource(pools, file, options, ret.back().second);
+
+  if (options.fasttable_report && !options.bootstrap) {
+    ret.emplace_back(StripExtension(file.name()) + ".upb_fasttable.txt",
+                     Output());
+    for (const auto message : SortedMessages(file)) {
+      FastDecodeTable(message, pools, options, &ret.back().second);
+    }
+  }
+  return ret;
+}
+
+// A upb_DefPool_ParallelForFunc that runs the tasks on up to |*closure|
+// threads.
+void ParallelFor(void* closure, size_t count, void (*task)(void* arg, size_t i),
+                 void* arg) {
+  size_t threads = std::min(static_cast<size_t>(*static_cast<int*>(closure)),
+                            count);
+  std::atomic<size_t> next{0};
+  auto run = [&] {
+    for (size_t i; (i = next.fetch_add(1)) < count;) task(arg, i);
+  };
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; t++) workers.emplace_back(run);
+  run();
+  for (std::thread& t : workers) t.join();
+}
+
+// Reads a field hotness profile: one "<full field name> <count>" pair per
+// line, with '#' starting a comment that runs to the end of the line.  This is
+// the format written by upb_DecodeStats_WriteProfile().
+absl::string_view ToStringView(upb_StringView str) {
+  return absl::string_view(str.data, str.size);
+}
+
+// Removes the fields of `message` and its nested messages that are neither
+// used nor required, along with any oneofs that are left empty.  Map entries
+// are kept whole, since the map's wire format depends on them.
+void StripUnusedFields(UPB_DESC(DescriptorProto) * message,
+                       absl::string_view scope, const Options& options,
+                       upb_Arena* arena) {
+  std::string name = absl::StrCat(
+      scope, scope.empty() ? "" : ".",
+      ToStringView(UPB_DESC(DescriptorProto_name)(message)));
+
+  size_t nested_count;
+  UPB_DESC(DescriptorProto)** nested =
+      UPB_DESC(DescriptorProto_mutable_nested_type)(message, &nested_count);
+  for (size_t i = 0; i < nested_count; i++) {
+    StripUnusedFields(nested[i], name, options, arena);
+  }
+
+  const UPB_DESC(MessageOptions)* msg_options =
+      UPB_DESC(DescriptorProto_options)(message);
+  if (msg_options && UPB_DESC(MessageOptions_map_entry)(msg_options)) return;
+
+  size_t field_count;
+  size_t oneof_count;
+  UPB_DESC(FieldDescriptorProto)** fields =
+      UPB_DESC(DescriptorProto_mutable_field)(message, &field_count);
+  UPB_DESC(OneofDescriptorProto)** oneofs =
+      UPB_DESC(DescriptorProto_mutable_oneof_decl)(message, &oneof_count);
+  std::vector<int> oneof_index(oneof_count, -1);
+  size_t kept = 0;
+  for (size_t i = 0; i < field_count; i++) {
+    UPB_DESC(FieldDescriptorProto)* field = fields[i];
+    std::string full_name = absl::StrCat(
+        name, ".", ToStringView(UPB_DESC(FieldDescriptorProto_name)(field)));
+    if (UPB_DESC(FieldDescriptorProto_label)(field) != kUpb_Label_Required &&
+        !options.used_fields.contains(full_name)) {
+      continue;
+    }
+    if (UPB_DESC(FieldDescriptorProto_has_oneof_index)(field)) {
+      oneof_index[UPB_DESC(FieldDescriptorProto_oneof_index)(field)] = 0;
+    }
+    fields[kept++] = field;
+  }
+  UPB_DESC(DescriptorProto_resize_field)(message, kept, arena);
+
+  size_t kept_oneofs = 0;
+  for (size_t i = 0; i < oneof_count; i++) {
+    if (oneof_index[i] < 0) continue;
+    oneof_index[i] = kept_oneofs;
+    oneofs[kept_oneofs++] = oneofs[i];
+  }
+  UPB_DESC(DescriptorProto_resize_oneof_decl)(message, kept_oneofs, arena);
+  for (size_t i = 0; i < kept; i++) {
+    if (UPB_DESC(FieldDescriptorProto_has_oneof_index)(fields[i])) {
+      UPB_DESC(FieldDescriptorProto_set_oneof_index)(
+          fields[i],
+          oneof_index[UPB_DESC(FieldDescriptorProto_oneof_index)(fields[i])]);
+    }
+  }
+}
+
+// Returns a copy of `file_proto`, allocated from `arena`, with the fields that
+// are not in `options.used_fields` removed.
+const UPB_DESC(FileDescriptorProto) *
+    ShakeUnusedFields(const UPB_DESC(FileDescriptorProto) * file_proto,
+                      const Options& options, upb_Arena* arena) {
+  size_t size;
+  char* data =
+      UPB_DESC(FileDescriptorProto_serialize)(file_proto, arena, &size);
+  UPB_DESC(FileDescriptorProto)* copy =
+      data ? UPB_DESC(FileDescriptorProto_parse)(data, size, arena) : nullptr;
+  ABSL_CHECK(copy);
+
+  absl::string_view package =
+      ToStringView(UPB_DESC(FileDescriptorProto_package)(copy));
+  size_t count;
+  UPB_DESC(DescriptorProto)** messages =
+      UPB_DESC(FileDescriptorProto_mutable_message_type)(copy, &count);
+  for (size_t i = 0; i < count; i++) {
+    StripUnusedFields(messages[i], package, options, arena);
+  }
+  return copy;
+}
+
+bool ReadFieldHotness(Plugin* plugin, const std::string& filename,
+                      Options* options) {
+  std::ifstream in(filename);
+  if (!in) {
+    plugin->SetError(absl::Substitute("Couldn't open $0", filename));
+    return false;
+  }
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    absl::string_view text = line;
+    text = absl::StripAsciiWhitespace(text.substr(0, text.find('#')));
+    if (text.empty()) continue;
+    std::vector<absl::string_view> parts =
+        absl::StrSplit(text, ' ', absl::SkipEmpty());
+    uint64_t count;
+    if (parts.size() != 2 || !absl::SimpleAtoi(parts[1], &count)) {
+      plugin->SetError(absl::Substitute("$0:$1: expected \"<field> <count>\"",
+                                        filename, line_number));
+      return false;
+    }
+    options->field_hotness[std::string(parts[0])] = count;
+  }
+  return true;
+}
+
+bool ReadUsedFields(Plugin* plugin, const std::string& filename,
+                    Options* options) {
+  std::ifstream in(filename);
+  if (!in) {
+    plugin->SetError(absl::Substitute("Couldn't open $0", filename));
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    absl::string_view text = line;
+    text = absl::StripAsciiWhitespace(text.substr(0, text.find('#')));
+    if (text.empty()) continue;
+    options->used_fields.insert(std::string(text));
+  }
+  options->shake_unused_fields = true;
+  return true;
 }
 
 bool ParseOptions(Plugin* plugin, Options* options) {
   for (const auto& pair : ParseGeneratorParameter(plugin->parameter())) {
     if (pair.first == "bootstrap_upb") {
       options->bootstrap = true;
+    } else if (pair.first == "fasttable_report") {
+      options->fasttable_report = true;
+    } else if (pair.first == "used_fields") {
+      if (!ReadUsedFields(plugin, pair.second, options)) return false;
+    } else if (pair.first == "specialized_encoders") {
+      options->specialized_encoders = true;
+    } else if (pair.first == "field_hotness") {
+      if (!ReadFieldHotness(plugin, pair.second, options)) return false;
+    } else if (pair.first == "jobs") {
+      if (!absl::SimpleAtoi(pair.second, &options->jobs) ||
+          options->jobs < 0) {
+        plugin->SetError(absl::Substitute("Bad jobs value: $0", pair.second));
+        return false;
+      }
     } else {
       plugin->SetError(absl::Substitute("Unknown parameter: $0", pair.first));
       return false;
@@ -1695,10 +2413,6 @@ bool ParseOptions(Plugin* plugin, Options* options) {
   return true;
 }
 
-absl::string_view ToStringView(upb_StringView str) {
-  return absl::string_view(str.data, str.size);
-}
-
 }  // namespace
 
 }  // namespace upbc
@@ -1708,17 +2422,59 @@ int main(int argc, char** argv) {
   upbc::Plugin plugin;
   upbc::Options options;
   if (!ParseOptions(&plugin, &options)) return 0;
+  upbc::FieldLayoutHints layout_hints(options);
+  if (!options.field_hotness.empty()) {
+    pools.SetFieldHotness(&upbc::FieldLayoutHints::Get, &layout_hints);
+  }
+  if (options.jobs == 0) {
+    options.jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+  upb::Arena arena;
+  std::vector<const UPB_DESC(FileDescriptorProto)*> file_protos;
+  std::vector<size_t> to_generate;
   plugin.GenerateFilesRaw([&](const UPB_DESC(FileDescriptorProto) * file_proto,
                               bool generate) {
-    upb::Status status;
-    upb::FileDefPtr file = pools.AddFile(file_proto, &status);
-    if (!file) {
-      absl::string_view name =
-          upbc::ToStringView(UPB_DESC(FileDescriptorProto_name)(file_proto));
-      ABSL_LOG(FATAL) << "Couldn't add file " << name
-                      << " to DefPool: " << status.error_message();
+    if (options.shake_unused_fields) {
+      file_proto = upbc::ShakeUnusedFields(file_proto, options, arena.ptr());
     }
-    if (generate) GenerateFile(pools, file, options, &plugin);
+    if (generate) to_generate.push_back(file_protos.size());
+    file_protos.push_back(file_proto);
   });
+  upb_DefPool_ParallelForFunc* parallel_for =
+      options.jobs > 1 ? &upbc::ParallelFor : nullptr;
+  upb::Status status;
+  std::vector<upb::FileDefPtr> files =
+      pools.AddFiles(file_protos.data(), file_protos.size(), parallel_for,
+                     &options.jobs, &status);
+  if (files.size() != file_protos.size()) {
+    ABSL_LOG(FATAL) << "Couldn't add files to DefPool: "
+                    << status.error_message();
+  }
+
+  // Each file is generated into its own buffers, and the results are added to
+  // the response in the order protoc asked for them.
+  struct GenerateTask {
+    const upbc::DefPoolPair* pools;
+    const upbc::Options* options;
+    const std::vector<upb::FileDefPtr>* files;
+    const std::vector<size_t>* to_generate;
+    std::vector<upbc::GeneratedFiles> generated;
+  } task{&pools, &options, &files, &to_generate,
+         std::vector<upbc::GeneratedFiles>(to_generate.size())};
+  auto generate = [](void* arg, size_t i) {
+    GenerateTask* task = static_cast<GenerateTask*>(arg);
+    task->generated[i] = upbc::GenerateFile(
+        *task->pools, (*task->files)[(*task->to_generate)[i]], *task->options);
+  };
+  if (parallel_for) {
+    parallel_for(&options.jobs, to_generate.size(), generate, &task);
+  } else {
+    for (size_t i = 0; i < to_generate.size(); i++) generate(&task, i);
+  }
+  for (auto& generated : task.generated) {
+    for (auto& output : generated) {
+      plugin.AddOutputFile(output.first, output.second.TakeOutput());
+    }
+  }
   return 0;
 }